@@ -0,0 +1,60 @@
+#version 460
+
+// Writes the surface under the pixel to the G-buffer for
+// deferred_lighting.comp to light, see src/deferred.hpp. The normal is the
+// face normal from the derivatives like in shader.frag, turned towards the
+// viewer with the view of the frame's lights.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+
+layout(location = 0) in vec3 frag_color;
+layout(location = 1) in vec3 frag_position;
+
+layout(location = 0) out uvec4 out_surface;
+
+// LightClusterView in src/light_clusters.hpp, the lights are not read here.
+layout(set = 0, binding = 1, std430) readonly buffer LightList {
+	mat4 view;
+	mat4 inverse_projection;
+	vec4 extent;
+} light_lists[g_bindless_buffer_capacity];
+
+// The light fields of DrawHandles in src/uniforms.hpp.
+layout(push_constant) uniform DrawHandles {
+	layout(offset = 76) uint lights;
+} handles;
+
+// The unit vector folded onto the octahedron and flattened into the square
+// [-1, 1]^2, the lower half folded over the diagonals.
+vec2 encode_octahedral(vec3 normal) {
+	normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+	if (normal.z < 0.0) {
+		vec2 signs = vec2(
+			normal.x >= 0.0 ? 1.0 : -1.0,
+			normal.y >= 0.0 ? 1.0 : -1.0);
+		return (1.0 - abs(normal.yx)) * signs;
+	}
+	return normal.xy;
+}
+
+void main() {
+	vec3 normal = normalize(cross(dFdx(frag_position), dFdy(frag_position)));
+	vec2 extent = light_lists[handles.lights].extent.xy;
+	vec4 eye = light_lists[handles.lights].inverse_projection *
+		vec4(gl_FragCoord.xy / extent * 2.0 - 1.0, 1.0, 1.0);
+	vec3 view_position = (light_lists[handles.lights].view *
+		vec4(frag_position, 1.0)).xyz;
+	vec3 view_normal = mat3(light_lists[handles.lights].view) * normal;
+	if (dot(view_normal, eye.xyz / eye.w - view_position) < 0.0) {
+		normal = -normal;
+	}
+
+	uvec2 octahedral =
+		uvec2(round(clamp(encode_octahedral(normal) * 0.5 + 0.5, 0.0, 1.0) *
+			255.0));
+	uvec3 color = uvec3(round(clamp(frag_color, 0.0, 1.0) *
+		vec3(31.0, 63.0, 31.0)));
+	out_surface = uvec4(
+		floatBitsToUint(frag_position),
+		octahedral.x | octahedral.y << 8 |
+			(color.r << 11 | color.g << 5 | color.b) << 16);
+}
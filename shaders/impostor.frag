@@ -0,0 +1,39 @@
+#version 460
+
+// An atlas view of an impostor, cut out at the mesh's silhouette. Opaque
+// like the meshes it stands in for, so it is tested and written the same.
+layout(constant_id = 0) const uint g_bindless_image_capacity = 1;
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+layout(constant_id = 2) const uint g_bindless_sampler_capacity = 1;
+
+layout(set = 0, binding = 0) uniform texture2D
+		bindless_images[g_bindless_image_capacity];
+
+layout(set = 0, binding = 2) uniform sampler
+		bindless_samplers[g_bindless_sampler_capacity];
+
+// ImpostorConstants in src/impostor.cpp.
+layout(push_constant) uniform ImpostorConstants {
+	vec4 bounding_sphere;
+	vec4 camera;
+	uint uniform_buffer;
+	uint transform;
+	uint atlas;
+	uint atlas_sampler;
+} constants;
+
+layout(location = 0) in vec2 frag_uv;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	vec4 color = texture(
+			sampler2D(
+					bindless_images[constants.atlas],
+					bindless_samplers[constants.atlas_sampler]),
+			frag_uv);
+	if (color.a < 0.5) {
+		discard;
+	}
+	out_color = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,109 @@
+#version 460
+
+// The quads of the instances drawn as impostors, see ImpostorRenderer in
+// src/impostor.hpp. Vertex k of an instance is corner k of a quad over its
+// bounding sphere, facing the atlas view nearest to the direction the camera
+// sees the instance from, which the quad is textured with.
+layout(constant_id = 0) const uint g_bindless_image_capacity = 1;
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+layout(constant_id = 2) const uint g_bindless_sampler_capacity = 1;
+
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+// See src/impostor.hpp.
+const int g_impostor_views = 8;
+
+// ImpostorConstants in src/impostor.cpp.
+layout(push_constant) uniform ImpostorConstants {
+	vec4 bounding_sphere;
+	// In the instances' space, a point with a w of 1 or the direction towards
+	// it with a w of 0.
+	vec4 camera;
+	uint uniform_buffer;
+	uint transform;
+	uint atlas;
+	uint atlas_sampler;
+} constants;
+
+// Rows of InstanceTransform, at the locations shader.vert has them.
+layout(location = 2) in vec4 in_instance_rows[3];
+
+layout(location = 0) out vec2 frag_uv;
+
+const float g_corners_x[6] = float[](-1.0, 1.0, -1.0, -1.0, 1.0, 1.0);
+const float g_corners_y[6] = float[](-1.0, -1.0, 1.0, 1.0, -1.0, 1.0);
+
+vec2 sign_not_zero(vec2 v) {
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// The unit sphere folded onto [0, 1] squared, the +z half inside the
+// diamond.
+vec2 octahedral_encode(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 f = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * sign_not_zero(n.xy);
+	return f * 0.5 + 0.5;
+}
+
+// The inverse of octahedral_encode, like octahedral_decode in
+// src/impostor.cpp.
+vec3 octahedral_decode(vec2 uv) {
+	vec2 f = uv * 2.0 - 1.0;
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(f.yx)) * sign_not_zero(f);
+	}
+	return normalize(n);
+}
+
+// Right and up of a view from direction, like view_basis in
+// src/impostor.cpp.
+void view_basis(vec3 direction, out vec3 right, out vec3 up) {
+	vec3 axis = abs(direction.y) < 0.999 ? vec3(0.0, 1.0, 0.0)
+			: vec3(0.0, 0.0, 1.0);
+	right = normalize(cross(axis, direction));
+	up = cross(direction, right);
+}
+
+void main() {
+	mat3 linear = transpose(mat3(
+			in_instance_rows[0].xyz,
+			in_instance_rows[1].xyz,
+			in_instance_rows[2].xyz));
+	vec3 translation = vec3(
+			in_instance_rows[0].w,
+			in_instance_rows[1].w,
+			in_instance_rows[2].w);
+	vec3 center = constants.bounding_sphere.xyz;
+	float radius = constants.bounding_sphere.w;
+
+	vec3 to_camera = constants.camera.w != 0.0
+			? constants.camera.xyz - (linear * center + translation)
+			: constants.camera.xyz;
+	vec3 direction = normalize(inverse(linear) * to_camera);
+	ivec2 view = min(
+			ivec2(octahedral_encode(direction) * float(g_impostor_views)),
+			ivec2(g_impostor_views - 1));
+	vec3 right;
+	vec3 up;
+	view_basis(
+			octahedral_decode((vec2(view) + 0.5) / float(g_impostor_views)),
+			right,
+			up);
+
+	int corner = gl_VertexIndex;
+	vec2 offset = vec2(g_corners_x[corner], g_corners_y[corner]);
+	frag_uv = (vec2(view) + vec2(0.5 + 0.5 * offset.x, 0.5 - 0.5 * offset.y)) /
+			float(g_impostor_views);
+
+	uint slot = constants.transform;
+	mat4 transform = mat4(
+		uniform_rings[constants.uniform_buffer].slots[slot],
+		uniform_rings[constants.uniform_buffer].slots[slot + 1],
+		uniform_rings[constants.uniform_buffer].slots[slot + 2],
+		uniform_rings[constants.uniform_buffer].slots[slot + 3]);
+	vec3 position = center + (right * offset.x + up * offset.y) * radius;
+	gl_Position = transform * vec4(linear * position + translation, 1.0);
+}
@@ -0,0 +1,36 @@
+#version 460
+
+// Coverage of the line of line.vert over its quad, premultiplied for the
+// blend over the scene. The sides, caps and dash ends fade out over a pixel,
+// which is what keeps the lines smooth without multisampling.
+layout(location = 0) noperspective in float frag_across;
+layout(location = 1) noperspective in float frag_along;
+layout(location = 2) noperspective in float frag_length;
+layout(location = 3) flat in vec4 frag_color;
+
+layout(location = 0) out vec4 out_color;
+
+// LineConstants in src/lines.cpp, only the fields read here.
+layout(push_constant) uniform LineConstants {
+	layout(offset = 36) float width;
+	float dash;
+	float gap;
+} constants;
+
+void main() {
+	float half_width = 0.5 * constants.width;
+	float coverage = clamp(half_width + 0.5 - abs(frag_across), 0.0, 1.0);
+	// Butt ends, so that edges joined at a vertex meet without a doubled
+	// overlap.
+	float outside = max(-frag_along, frag_along - frag_length);
+	coverage *= clamp(0.5 - outside, 0.0, 1.0);
+	if (constants.dash > 0.0) {
+		float phase = mod(frag_along, constants.dash + constants.gap);
+		coverage *= clamp(min(phase, constants.dash - phase) + 0.5, 0.0, 1.0);
+	}
+	if (coverage <= 0.0) {
+		discard;
+	}
+	float alpha = frag_color.a * coverage;
+	out_color = vec4(frag_color.rgb * alpha, alpha);
+}
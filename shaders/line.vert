@@ -0,0 +1,147 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+// Expands the edges of a mesh's triangles into screen aligned quads, see
+// LineRenderer in src/lines.hpp. Vertex 6 * e + c is corner c of edge e, and
+// edge e is the side of triangle e / 3 from its vertex e % 3 to the next.
+// The endpoints are pulled through device addresses like in pulling.vert,
+// the indices too, so nothing but the push constants is bound.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+// Whether the mesh is quantized, see QuantizedVertex in src/mesh.hpp.
+layout(constant_id = 3) const bool g_quantized_vertices = false;
+
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer
+		Floats {
+	float values[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer
+		Uints {
+	uint values[];
+};
+
+// LineConstants in src/lines.cpp.
+layout(push_constant) uniform LineConstants {
+	Floats positions;
+	Uints indices;
+	uint vertex_stride;
+	uint uniform_buffer;
+	uint transform;
+	uint first_index;
+	uint index_size;
+	float width;
+	float dash;
+	float gap;
+	vec2 extent;
+	float position_scale[3];
+	float position_offset[3];
+	uint color;
+} constants;
+
+// Distance from the line's center across it and along it from its start,
+// and its length, all in pixels.
+layout(location = 0) noperspective out float frag_across;
+layout(location = 1) noperspective out float frag_along;
+layout(location = 2) noperspective out float frag_length;
+layout(location = 3) flat out vec4 frag_color;
+
+// Which end of the edge and which side of it each corner of the quad's two
+// triangles is on.
+const float g_ends[6] = float[](0.0, 0.0, 1.0, 1.0, 0.0, 1.0);
+const float g_sides[6] = float[](-1.0, 1.0, -1.0, -1.0, 1.0, 1.0);
+
+// Lines are pulled this far towards the viewer in clip w, so that they win
+// the depth test against the faces they are the edges of.
+const float g_depth_bias = 1e-4;
+
+uint fetch_index(uint index) {
+	if (constants.index_size == 2) {
+		uint word = constants.indices.values[index / 2];
+		return (index % 2 == 0) ? (word & 0xffffu) : (word >> 16);
+	}
+	return constants.indices.values[index];
+}
+
+vec3 fetch_position(uint vertex) {
+	uint base = vertex * (constants.vertex_stride / 4);
+	if (g_quantized_vertices) {
+		Uints attribute = Uints(constants.positions);
+		return vec3(
+			unpackSnorm2x16(attribute.values[base]),
+			unpackSnorm2x16(attribute.values[base + 1]).x);
+	}
+	return vec3(
+		constants.positions.values[base],
+		constants.positions.values[base + 1],
+		constants.positions.values[base + 2]);
+}
+
+void main() {
+	uint edge = uint(gl_VertexIndex) / 6;
+	uint corner = uint(gl_VertexIndex) % 6;
+	uint triangle = constants.first_index + (edge / 3) * 3;
+	uint start = fetch_index(triangle + edge % 3);
+	uint end = fetch_index(triangle + (edge + 1) % 3);
+
+	uint slot = constants.transform;
+	mat4 transform = mat4(
+		uniform_rings[constants.uniform_buffer].slots[slot],
+		uniform_rings[constants.uniform_buffer].slots[slot + 1],
+		uniform_rings[constants.uniform_buffer].slots[slot + 2],
+		uniform_rings[constants.uniform_buffer].slots[slot + 3]);
+	vec3 scale = vec3(
+		constants.position_scale[0],
+		constants.position_scale[1],
+		constants.position_scale[2]);
+	vec3 offset = vec3(
+		constants.position_offset[0],
+		constants.position_offset[1],
+		constants.position_offset[2]);
+	vec4 a = transform * vec4(fetch_position(start) * scale + offset, 1.0);
+	vec4 b = transform * vec4(fetch_position(end) * scale + offset, 1.0);
+
+	// Clips the edge to the near plane, z <= w with depth reversed, so that
+	// both ends can be divided by w. Edges wholly behind it collapse.
+	float near_a = a.w - a.z;
+	float near_b = b.w - b.z;
+	if (near_a < 0.0 && near_b < 0.0) {
+		gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+	if (near_a < 0.0) {
+		a = mix(a, b, near_a / (near_a - near_b));
+	} else if (near_b < 0.0) {
+		b = mix(b, a, near_b / (near_b - near_a));
+	}
+
+	vec2 half_extent = 0.5 * constants.extent;
+	vec2 pixel_a = a.xy / a.w * half_extent;
+	vec2 pixel_b = b.xy / b.w * half_extent;
+	vec2 direction = pixel_b - pixel_a;
+	float segment_length = max(length(direction), 1e-3);
+	direction /= segment_length;
+	vec2 normal = vec2(-direction.y, direction.x);
+
+	// A pixel wider and longer than the line on every side, for line.frag to
+	// fade its edges over.
+	float half_width = 0.5 * constants.width + 1.0;
+	float along = g_ends[corner];
+	float side = g_sides[corner];
+	float extension = along * 2.0 - 1.0;
+	vec4 position = along == 0.0 ? a : b;
+	vec2 pixel = (along == 0.0 ? pixel_a : pixel_b) +
+		normal * side * half_width + direction * extension;
+	gl_Position = vec4(
+		pixel / half_extent * position.w,
+		position.z + g_depth_bias * position.w,
+		position.w);
+
+	frag_across = side * half_width;
+	frag_along = along * segment_length + extension;
+	frag_length = segment_length;
+	frag_color = unpackUnorm4x8(constants.color);
+}
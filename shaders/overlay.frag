@@ -0,0 +1,39 @@
+#version 460
+
+// Fills a cell of overlay.vert with its glyph or its background,
+// premultiplied for the blend over the scene. The glyph sits a font pixel
+// below the top of the cell, with the spacing right of it and below it.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+
+// Two words per glyph, bit y * 5 + x for pixel x, y, see pack_font in
+// src/overlay.cpp.
+layout(set = 0, binding = 1, std430) readonly buffer Font {
+	uint words[];
+} fonts[g_bindless_buffer_capacity];
+
+layout(location = 0) noperspective in vec2 frag_cell;
+layout(location = 1) flat in uint frag_glyph;
+layout(location = 2) flat in vec4 frag_color;
+layout(location = 3) flat in vec4 frag_background;
+
+layout(location = 0) out vec4 out_color;
+
+// OverlayConstants in src/overlay.cpp, only the fields read here.
+layout(push_constant) uniform OverlayConstants {
+	layout(offset = 4) uint font;
+} constants;
+
+void main() {
+	ivec2 pixel = ivec2(frag_cell) - ivec2(0, 1);
+	bool lit = false;
+	if (pixel.x >= 0 && pixel.x < 5 && pixel.y >= 0 && pixel.y < 7) {
+		uint bit = uint(pixel.y * 5 + pixel.x);
+		uint word = fonts[constants.font].words[frag_glyph * 2 + bit / 32];
+		lit = ((word >> (bit % 32)) & 1u) != 0;
+	}
+	vec4 color = lit ? frag_color : frag_background;
+	if (color.a <= 0.0) {
+		discard;
+	}
+	out_color = vec4(color.rgb * color.a, color.a);
+}
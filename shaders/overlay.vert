@@ -0,0 +1,56 @@
+#version 460
+
+// Expands the cells of the overlay's text into screen aligned quads, see
+// OverlayRenderer in src/overlay.hpp. Vertex 6 * c + k is corner k of cell c,
+// pulled from the frame's cell buffer, so nothing but the push constants is
+// bound.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+
+// OverlayCell in src/overlay.cpp.
+struct Cell {
+	uint position;
+	uint glyph;
+	uint color;
+	uint background;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer Cells {
+	Cell cells[];
+} cell_buffers[g_bindless_buffer_capacity];
+
+// OverlayConstants in src/overlay.cpp.
+layout(push_constant) uniform OverlayConstants {
+	uint cells;
+	uint font;
+	vec2 extent;
+} constants;
+
+// Where in the cell the fragment is, in font pixels.
+layout(location = 0) noperspective out vec2 frag_cell;
+layout(location = 1) flat out uint frag_glyph;
+layout(location = 2) flat out vec4 frag_color;
+layout(location = 3) flat out vec4 frag_background;
+
+const vec2 g_corners[6] = vec2[](
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(0.0, 1.0),
+	vec2(0.0, 1.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0));
+// g_overlay_cell_width and g_overlay_cell_height in src/overlay.hpp.
+const vec2 g_cell = vec2(6.0, 9.0);
+
+void main() {
+	Cell cell = cell_buffers[constants.cells].cells[gl_VertexIndex / 6];
+	vec2 corner = g_corners[gl_VertexIndex % 6];
+	float scale = float(cell.glyph >> 8);
+	vec2 origin = vec2(cell.position & 0xffffu, cell.position >> 16);
+	vec2 pixel = origin + corner * g_cell * scale;
+	gl_Position = vec4(pixel / constants.extent * 2.0 - 1.0, 0.0, 1.0);
+
+	frag_cell = corner * g_cell;
+	frag_glyph = cell.glyph & 0xffu;
+	frag_color = unpackUnorm4x8(cell.color);
+	frag_background = unpackUnorm4x8(cell.background);
+}
@@ -0,0 +1,34 @@
+#version 460
+
+// A soft round sprite over the quad of particle.vert, premultiplied for the
+// blend over the scene. The WEIGHTED_OIT variant instead adds it to the
+// accumulation of src/transparency.hpp, weighted by how near it is, and
+// writes its coverage for the revealage.
+layout(location = 0) in vec4 frag_color;
+layout(location = 1) in vec2 frag_corner;
+
+layout(location = 0) out vec4 out_color;
+#ifdef WEIGHTED_OIT
+layout(location = 1) out vec4 out_revealage;
+#endif
+
+void main() {
+	float falloff = 1.0 - dot(frag_corner, frag_corner);
+	if (falloff <= 0.0) {
+		discard;
+	}
+	float alpha = frag_color.a * falloff * falloff;
+#ifdef WEIGHTED_OIT
+	// McGuire and Bavoil's depth weight, with depth reversed so that 0 is
+	// the far plane. Nearer fragments outweigh the ones they cover.
+	float distance = 1.0 - gl_FragCoord.z;
+	float weight = clamp(
+		alpha * max(1e-2, 3e3 * distance * distance * distance),
+		1e-2,
+		3e3);
+	out_color = vec4(frag_color.rgb * alpha, alpha) * weight;
+	out_revealage = vec4(alpha);
+#else
+	out_color = vec4(frag_color.rgb * alpha, alpha);
+#endif
+}
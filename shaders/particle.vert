@@ -0,0 +1,57 @@
+#version 460
+
+// Draws the particles particles.comp kept in view as quads facing the
+// screen, four vertices of a triangle strip per instance, see
+// src/particles.hpp. Instances follow the keys, which are sorted so they
+// blend from the farthest to the nearest unless the blend needs no order.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+
+// Colors over a particle's life, in the scene's linear color. Hot and bright
+// enough to bloom when post-processing, fading out as they cool.
+const vec4 g_young_color = vec4(2.0, 1.2, 0.4, 0.8);
+const vec4 g_old_color = vec4(0.6, 0.1, 0.05, 0.0);
+
+// The uniform ring as an array of vec4 slots, see src/uniforms.hpp.
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+// See particles.comp.
+layout(set = 0, binding = 1, std430) readonly buffer ParticleDraws {
+	vec4 draws[];
+} draw_lists[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 1, std430) readonly buffer SortKeys {
+	uvec2 keys[];
+} key_lists[g_bindless_buffer_capacity];
+
+// ParticleDrawHandles in src/particles.cpp.
+layout(push_constant) uniform ParticleDrawHandles {
+	uint uniform_buffer;
+	uint transform;
+	uint draws;
+	uint keys;
+	// Half the quad's size in normalized device coordinates.
+	vec2 size;
+} handles;
+
+layout(location = 0) out vec4 frag_color;
+// The vertex's corner of the quad, from -1 to 1.
+layout(location = 1) out vec2 frag_corner;
+
+void main() {
+	// DrawUniforms::transform, one column per slot.
+	uint slot = handles.transform;
+	mat4 transform = mat4(
+		uniform_rings[handles.uniform_buffer].slots[slot],
+		uniform_rings[handles.uniform_buffer].slots[slot + 1],
+		uniform_rings[handles.uniform_buffer].slots[slot + 2],
+		uniform_rings[handles.uniform_buffer].slots[slot + 3]);
+	uint draw = key_lists[handles.keys].keys[gl_InstanceIndex].y;
+	vec4 particle = draw_lists[handles.draws].draws[draw];
+	frag_corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1) * 2.0 - 1.0;
+	frag_color = mix(g_young_color, g_old_color, particle.w);
+	gl_Position = transform * vec4(particle.xyz, 1.0);
+	gl_Position.xy +=
+		frag_corner * handles.size * mix(1.0, 0.4, particle.w) * gl_Position.w;
+}
@@ -0,0 +1,128 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+
+// shader.vert with the vertices read through device addresses instead of
+// vertex input, see Mesh::attribute_addresses in src/mesh.hpp.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+// Whether the mesh is quantized, see QuantizedVertex in src/mesh.hpp.
+layout(constant_id = 3) const bool g_quantized_vertices = false;
+// Whether positions are skinned every frame, see src/skinning.hpp, so the
+// motion vectors need the ones of the frame before.
+layout(constant_id = 4) const bool g_skinned = false;
+
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+struct DrawInstance {
+	uint transform;
+	uint material;
+	uint batch;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer InstanceList {
+	DrawInstance instances[];
+} instance_lists[g_bindless_buffer_capacity];
+
+// Attributes are tightly packed vec3, which std430 would pad to 16 bytes.
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer
+		Floats {
+	float values[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer
+		Uints {
+	uint values[];
+};
+
+// See src/uniforms.hpp.
+const uint g_no_instance_list = 0xffffffffu;
+
+layout(push_constant) uniform DrawHandles {
+	Floats positions;
+	Floats colors;
+	uint vertex_stride;
+	uint uniform_buffer;
+	uint instances;
+	uint transform;
+	uint material;
+	uint mesh;
+	float position_scale[3];
+	float position_offset[3];
+	layout(offset = 88) Floats previous_positions;
+} handles;
+
+layout(location = 0) out vec3 frag_color;
+// See shader.vert.
+layout(location = 1) out vec3 frag_position;
+#ifdef MOTION_VECTORS
+layout(location = 2) out vec4 frag_clip;
+layout(location = 3) out vec4 frag_previous_clip;
+#endif
+// The depth pre-pass and the shading pass must produce the same depth for the
+// EQUAL test.
+invariant gl_Position;
+
+vec3 fetch(Floats attribute) {
+	uint base = uint(gl_VertexIndex) * (handles.vertex_stride / 4);
+	return vec3(
+		attribute.values[base],
+		attribute.values[base + 1],
+		attribute.values[base + 2]);
+}
+
+// Decodes the way R16G16B16A16_SNORM and R8G8B8A8_UNORM vertex input would.
+vec3 fetch_quantized_position() {
+	Uints attribute = Uints(handles.positions);
+	uint base = uint(gl_VertexIndex) * (handles.vertex_stride / 4);
+	return vec3(
+		unpackSnorm2x16(attribute.values[base]),
+		unpackSnorm2x16(attribute.values[base + 1]).x);
+}
+
+vec3 fetch_quantized_color() {
+	Uints attribute = Uints(handles.colors);
+	uint base = uint(gl_VertexIndex) * (handles.vertex_stride / 4);
+	return unpackUnorm4x8(attribute.values[base]).rgb;
+}
+
+void main() {
+	uint slot = handles.transform;
+	if (handles.instances != g_no_instance_list) {
+		slot = instance_lists[handles.instances].instances[gl_InstanceIndex]
+			.transform;
+	}
+	mat4 transform = mat4(
+		uniform_rings[handles.uniform_buffer].slots[slot],
+		uniform_rings[handles.uniform_buffer].slots[slot + 1],
+		uniform_rings[handles.uniform_buffer].slots[slot + 2],
+		uniform_rings[handles.uniform_buffer].slots[slot + 3]);
+	vec3 position = g_quantized_vertices ? fetch_quantized_position()
+		: fetch(handles.positions);
+	vec3 scale = vec3(
+		handles.position_scale[0],
+		handles.position_scale[1],
+		handles.position_scale[2]);
+	vec3 offset = vec3(
+		handles.position_offset[0],
+		handles.position_offset[1],
+		handles.position_offset[2]);
+	frag_position = position * scale + offset;
+	gl_Position = transform * vec4(frag_position, 1.0);
+	frag_color = g_quantized_vertices ? fetch_quantized_color()
+		: fetch(handles.colors);
+#ifdef MOTION_VECTORS
+	mat4 previous_transform = mat4(
+		uniform_rings[handles.uniform_buffer].slots[slot + 4],
+		uniform_rings[handles.uniform_buffer].slots[slot + 5],
+		uniform_rings[handles.uniform_buffer].slots[slot + 6],
+		uniform_rings[handles.uniform_buffer].slots[slot + 7]);
+	vec2 jitter = uniform_rings[handles.uniform_buffer].slots[slot + 8].xy;
+	frag_clip = gl_Position - vec4(jitter * gl_Position.w, 0.0, 0.0);
+	vec3 previous_position = frag_position;
+	if (g_skinned) {
+		previous_position = fetch(handles.previous_positions) * scale + offset;
+	}
+	frag_previous_clip = previous_transform * vec4(previous_position, 1.0);
+#endif
+}
@@ -0,0 +1,79 @@
+#version 460
+#extension GL_EXT_ray_query : require
+
+// shader.frag with a shadow and ambient occlusion traced through the scene's
+// acceleration structure, see src/ray_tracing.hpp.
+layout(set = 0, binding = 3) uniform accelerationStructureEXT scene;
+
+layout(location = 0) in vec3 frag_color;
+layout(location = 1) in vec3 frag_position;
+
+layout(location = 0) out vec4 out_color;
+
+// Towards a light far enough away for its rays to be parallel. The demo
+// draws with an identity transform, so +z points at the viewer.
+const vec3 g_light_direction = vec3(-0.36, -0.48, 0.8);
+const vec3 g_view_direction = vec3(0.0, 0.0, 1.0);
+// How much of the light is ambient, attenuated by occlusion only.
+const float g_ambient = 0.3;
+// Occlusion rays per fragment and how far they look for occluders.
+const uint g_occlusion_rays = 4;
+const float g_occlusion_radius = 0.1;
+// Rays start off the surface so they do not hit the triangle they leave.
+const float g_ray_offset = 1e-4;
+
+// Any hit will do, so traversal stops at the first one.
+bool occluded(vec3 origin, vec3 direction, float range) {
+	rayQueryEXT query;
+	rayQueryInitializeEXT(
+		query,
+		scene,
+		gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT,
+		0xff,
+		origin,
+		g_ray_offset,
+		direction,
+		range);
+	while (rayQueryProceedEXT(query)) {
+	}
+	return rayQueryGetIntersectionTypeEXT(query, true) !=
+		gl_RayQueryCommittedIntersectionNoneEXT;
+}
+
+// No discard and no gl_FragDepth writes, so the depth test can run before
+// shading.
+void main() {
+	vec3 normal = normalize(cross(dFdx(frag_position), dFdy(frag_position)));
+	if (dot(normal, g_view_direction) < 0.0) {
+		normal = -normal;
+	}
+	vec3 origin = frag_position + normal * g_ray_offset;
+
+	float direct = max(dot(normal, g_light_direction), 0.0);
+	if (direct > 0.0 && occluded(origin, g_light_direction, 1e30)) {
+		direct = 0.0;
+	}
+
+	// Cosine weighted directions around the normal, rotated per pixel by
+	// interleaved gradient noise so neighbours sample differently.
+	vec3 helper = abs(normal.x) < 0.9 ? vec3(1.0, 0.0, 0.0)
+		: vec3(0.0, 1.0, 0.0);
+	vec3 tangent = normalize(cross(helper, normal));
+	vec3 bitangent = cross(normal, tangent);
+	float noise = fract(
+		52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	float open = 0.0;
+	for (uint i = 0; i < g_occlusion_rays; i++) {
+		float radius = sqrt((float(i) + 0.5) / float(g_occlusion_rays));
+		float angle = 6.2831853 * (float(i) * 0.618034 + noise);
+		vec3 direction = normalize(
+			tangent * (radius * cos(angle)) + bitangent * (radius * sin(angle)) +
+			normal * sqrt(max(1.0 - radius * radius, 0.0)));
+		if (!occluded(origin, direction, g_occlusion_radius)) {
+			open += 1.0;
+		}
+	}
+	float ambient = g_ambient * open / float(g_occlusion_rays);
+
+	out_color = vec4(frag_color * (ambient + (1.0 - g_ambient) * direct), 1.0);
+}
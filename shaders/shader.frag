@@ -1,9 +1,352 @@
 #version 460
 
+// HALF_FLOAT does the color and light weight math with 16-bit floats, which
+// have the precision an 8 or 10-bit output shows. Positions and distances
+// stay 32-bit, since world space needs more.
+#ifdef HALF_FLOAT
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#define half float16_t
+#define half3 f16vec3
+#else
+#define half float
+#define half3 vec3
+#endif
+
 layout(location = 0) in vec3 frag_color;
+#ifdef CLUSTERED_LIGHTS
+layout(location = 1) in vec3 frag_position;
+#endif
+#ifdef MOTION_VECTORS
+layout(location = 2) in vec4 frag_clip;
+layout(location = 3) in vec4 frag_previous_clip;
+#endif
 
 layout(location = 0) out vec4 out_color;
+#ifdef MOTION_VECTORS
+// How far the surface moved since the last frame, in normalized coordinates
+// of the render area, see src/temporal.hpp.
+layout(location = 1) out vec2 out_motion;
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+// Shades with the lights and decals light_cluster.comp binned into the
+// fragment's cluster, see src/light_clusters.hpp.
+layout(constant_id = 0) const uint g_bindless_image_capacity = 1;
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+layout(constant_id = 2) const uint g_bindless_sampler_capacity = 1;
+
+const uvec3 g_grid = uvec3(16, 9, 24);
+const uint g_cluster_count = g_grid.x * g_grid.y * g_grid.z;
+const uint g_max_cluster_lights = 128;
+const uint g_max_cluster_decals = 32;
+const uint g_decal_counts = g_cluster_count * (1 + g_max_cluster_lights);
+const uint g_decal_lists = g_decal_counts + g_cluster_count;
+// Light every surface gets, so unlit parts of the scene stay visible.
+const float g_ambient = 0.1;
+
+struct Light {
+	vec3 position;
+	float radius;
+	vec3 color;
+	float spot_outer;
+	vec3 direction;
+	float spot_inner;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer LightList {
+	mat4 view;
+	mat4 inverse_projection;
+	vec4 extent;
+	vec4 depth;
+	uint light_count;
+	// ClusterFog in src/light_clusters.hpp.
+	uint fog_volume;
+	uint fog_sampler;
+	uint decal_count;
+	uint decal_list;
+	// ClusterDecals in src/light_clusters.hpp.
+	uint decal_atlas;
+	uint decal_sampler;
+	// The frame's ShadowView in src/shadow.hpp, with SHADOWS.
+	uint shadows;
+	Light lights[];
+} light_lists[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 1, std430) readonly buffer LightGrid {
+	uint data[];
+} light_grids[g_bindless_buffer_capacity];
+
+struct Decal {
+	mat4 transform;
+	vec4 atlas_rect;
+	vec4 sphere;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer DecalList {
+	Decal decals[];
+} decal_lists[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 0) uniform texture2D
+		bindless_textures[g_bindless_image_capacity];
+
+layout(set = 0, binding = 2) uniform sampler
+		bindless_samplers[g_bindless_sampler_capacity];
+
+// The light fields of DrawHandles in src/uniforms.hpp.
+layout(push_constant) uniform DrawHandles {
+	layout(offset = 76) uint lights;
+	uint light_grid;
+} handles;
+
+// Fades to zero at the radius, roughly with the inverse square before it.
+// Only called inside the radius, so the ratio is at most 1.
+half attenuation(float distance, float radius) {
+	half ratio = half(distance / radius);
+	half falloff = clamp(half(1.0) - pow(ratio, half(4.0)), half(0.0), half(1.0));
+	return falloff * falloff / (half(1.0) + half(16.0) * (ratio * ratio));
+}
+
+uint cluster_index(vec3 position) {
+	vec4 depth = light_lists[handles.lights].depth;
+	vec2 extent = light_lists[handles.lights].extent.xy;
+	float view_depth = -(light_lists[handles.lights].view *
+		vec4(position, 1.0)).z;
+	uint slice = uint(clamp(
+		log(max(view_depth, depth.x)) * depth.z - depth.w,
+		0.0,
+		float(g_grid.z - 1)));
+	uvec2 tile = min(
+		uvec2(gl_FragCoord.xy / extent * vec2(g_grid.xy)),
+		g_grid.xy - 1);
+	return (slice * g_grid.y + tile.y) * g_grid.x + tile.x;
+}
+
+// Blends the cluster's decals over color in the order they were listed. The
+// atlas is sampled with gradients from the position's derivatives, which
+// are taken in uniform control flow, so decals filter like a texture on the
+// surface.
+vec3 apply_decals(
+	vec3 color,
+	vec3 position,
+	vec3 position_dx,
+	vec3 position_dy,
+	uint cluster) {
+	uint list = light_lists[handles.lights].decal_list;
+	uint atlas = light_lists[handles.lights].decal_atlas;
+	uint atlas_sampler = light_lists[handles.lights].decal_sampler;
+	uint count = light_grids[handles.light_grid].data[g_decal_counts + cluster];
+	uint first = g_decal_lists + cluster * g_max_cluster_decals;
+	for (uint i = 0; i < count; i++) {
+		Decal decal = decal_lists[list]
+			.decals[light_grids[handles.light_grid].data[first + i]];
+		vec3 box = (decal.transform * vec4(position, 1.0)).xyz;
+		if (any(greaterThan(abs(box), vec3(1.0)))) {
+			continue;
+		}
+		mat3 to_box = mat3(decal.transform);
+		vec2 scale = decal.atlas_rect.xy * 0.5;
+		vec4 texel = textureGrad(
+			sampler2D(bindless_textures[atlas], bindless_samplers[atlas_sampler]),
+			box.xy * scale + scale + decal.atlas_rect.zw,
+			(to_box * position_dx).xy * scale,
+			(to_box * position_dy).xy * scale);
+		// Fades out towards the ends of the box, so surfaces leaving it along
+		// the projection do not show a hard edge.
+		float fade = 1.0 - smoothstep(0.75, 1.0, abs(box.z));
+		color = mix(color, texel.rgb, texel.a * fade);
+	}
+	return color;
+}
+
+#ifdef SHADOWS
+// Lights with a sun casting the cascaded shadow maps of src/shadow.hpp.
+
+const uint g_max_shadow_cascades = 4;
+// Texels of its cascade a surface is moved out along its normal by before
+// the lookup, so it does not shadow itself.
+const float g_shadow_normal_offset = 1.5;
+
+// ShadowView in src/shadow.hpp.
+layout(set = 0, binding = 1, std430) readonly buffer ShadowList {
+	mat4 transforms[g_max_shadow_cascades];
+	vec4 splits;
+	vec4 texel_sizes;
+	vec3 to_light;
+	uint cascade_count;
+	vec3 color;
+	uint map;
+	uint map_sampler;
+	// ShadowAtlasHandles in src/shadow.hpp.
+	uint atlas_map;
+	uint atlas_tiles;
+} shadow_lists[g_bindless_buffer_capacity];
+
+// ShadowAtlasTileView in src/shadow_atlas.hpp, indexed like the lights.
+struct ShadowTile {
+	mat4 transform;
+	float texel_scale;
+	uint valid;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer ShadowTileList {
+	ShadowTile tiles[];
+} shadow_tiles[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 0) uniform texture2DArray
+		bindless_arrays[g_bindless_image_capacity];
+
+layout(set = 0, binding = 2) uniform samplerShadow
+		bindless_shadow_samplers[g_bindless_sampler_capacity];
+
+// The sun's light on a surface at view_depth, shadowed by the first cascade
+// whose split is beyond it. Past the last split, and before the maps were
+// first rendered, nothing is shadowed. The maps have one level, so the
+// lookup takes zero gradients rather than derivatives in the cascade's
+// branch.
+half3 sun_light(vec3 position, vec3 normal, float view_depth) {
+	uint list = light_lists[handles.lights].shadows;
+	uint count = shadow_lists[list].cascade_count;
+	uint cascade = 0;
+	while (cascade < count && view_depth >= shadow_lists[list].splits[cascade]) {
+		cascade++;
+	}
+	half lit = half(1.0);
+	if (cascade < count) {
+		float offset = shadow_lists[list].texel_sizes[cascade] *
+			g_shadow_normal_offset;
+		vec4 clip = shadow_lists[list].transforms[cascade] *
+			vec4(position + normal * offset, 1.0);
+		vec3 coords = clip.xyz / clip.w;
+		lit = half(textureGrad(
+			sampler2DArrayShadow(
+				bindless_arrays[shadow_lists[list].map],
+				bindless_shadow_samplers[shadow_lists[list].map_sampler]),
+			vec4(coords.xy * 0.5 + 0.5, float(cascade), coords.z),
+			vec2(0.0),
+			vec2(0.0)));
+	}
+	half lambert = half(max(dot(normal, shadow_lists[list].to_light), 0.0));
+	return half3(shadow_lists[list].color) * (lambert * lit);
+}
+
+// How much of a spot light at distance its tile of the atlas lets through,
+// all of it for lights without a valid tile. Looked up like the cascades.
+half spot_shadow(uint light, vec3 position, vec3 normal, float distance) {
+	uint list = light_lists[handles.lights].shadows;
+	ShadowTile tile = shadow_tiles[shadow_lists[list].atlas_tiles].tiles[light];
+	if (tile.valid == 0) {
+		return half(1.0);
+	}
+	float offset = distance * tile.texel_scale * g_shadow_normal_offset;
+	vec4 clip = tile.transform * vec4(position + normal * offset, 1.0);
+	return half(textureGrad(
+		sampler2DShadow(
+			bindless_textures[shadow_lists[list].atlas_map],
+			bindless_shadow_samplers[shadow_lists[list].map_sampler]),
+		clip.xyz / clip.w,
+		vec2(0.0),
+		vec2(0.0)));
+}
+#endif
+
+half3 shade(vec3 position, vec3 normal, uint cluster) {
+	half3 light_sum = half3(g_ambient);
+	uint count = light_grids[handles.light_grid].data[cluster];
+	uint first = g_cluster_count + cluster * g_max_cluster_lights;
+	for (uint i = 0; i < count; i++) {
+		uint index = light_grids[handles.light_grid].data[first + i];
+		Light light = light_lists[handles.lights].lights[index];
+		vec3 to_light = light.position - position;
+		float distance = length(to_light);
+		if (distance >= light.radius) {
+			continue;
+		}
+		vec3 direction = to_light / max(distance, 1e-6);
+		// Point lights have both cosines at -1, which smoothstep is undefined
+		// for.
+		half cone = half(1.0);
+		if (light.spot_outer > -1.0) {
+			cone = half(smoothstep(
+				light.spot_outer,
+				light.spot_inner,
+				dot(-direction, light.direction)));
+#ifdef SHADOWS
+			cone *= spot_shadow(index, position, normal, distance);
+#endif
+		}
+		light_sum += half3(light.color) *
+			(half(max(dot(normal, direction), 0.0)) *
+				attenuation(distance, light.radius) * cone);
+	}
+	return light_sum;
+}
+
+#ifdef FOG
+// Fogs with the integrated volume of src/fog.hpp.
+
+// Froxel slices of the volume, g_fog_grid_z.
+const uint g_fog_slices = 48;
+
+layout(set = 0, binding = 0) uniform texture3D
+		bindless_volumes[g_bindless_image_capacity];
+
+// Dims color by the fog in front of view_position and adds the light it
+// scatters towards the viewer. Integrated froxels hold the fog up to their
+// far side, so the lookup is half a froxel closer than the depth.
+vec3 apply_fog(vec3 color, vec3 view_position) {
+	vec4 depth = light_lists[handles.lights].depth;
+	vec2 extent = light_lists[handles.lights].extent.xy;
+	float slice = log(max(-view_position.z, depth.x)) * depth.z - depth.w;
+	float froxel = slice * float(g_fog_slices) / float(g_grid.z);
+	vec4 integrated = texture(
+		sampler3D(
+			bindless_volumes[light_lists[handles.lights].fog_volume],
+			bindless_samplers[light_lists[handles.lights].fog_sampler]),
+		vec3(gl_FragCoord.xy / extent, (froxel - 0.5) / float(g_fog_slices)));
+	return color * integrated.a + integrated.rgb;
+}
+#endif
+#endif
 
+// No discard and no gl_FragDepth writes, so the depth test can run before
+// shading.
 void main() {
+#ifdef CLUSTERED_LIGHTS
+	// The face normal from the derivatives, turned towards the viewer: a
+	// point the pixel's ray passes on the near plane.
+	vec3 position_dx = dFdx(frag_position);
+	vec3 position_dy = dFdy(frag_position);
+	vec3 normal = normalize(cross(position_dx, position_dy));
+	vec2 extent = light_lists[handles.lights].extent.xy;
+	vec4 eye = light_lists[handles.lights].inverse_projection *
+		vec4(gl_FragCoord.xy / extent * 2.0 - 1.0, 1.0, 1.0);
+	vec3 view_position = (light_lists[handles.lights].view *
+		vec4(frag_position, 1.0)).xyz;
+	vec3 view_normal = mat3(light_lists[handles.lights].view) * normal;
+	if (dot(view_normal, eye.xyz / eye.w - view_position) < 0.0) {
+		normal = -normal;
+	}
+	uint cluster = cluster_index(frag_position);
+	vec3 albedo = apply_decals(
+		frag_color,
+		frag_position,
+		position_dx,
+		position_dy,
+		cluster);
+	half3 light = shade(frag_position, normal, cluster);
+#ifdef SHADOWS
+	light += sun_light(frag_position, normal, -view_position.z);
+#endif
+	vec3 color = vec3(half3(albedo) * light);
+#ifdef FOG
+	color = apply_fog(color, view_position);
+#endif
+	out_color = vec4(color, 1.0);
+#else
 	out_color = vec4(frag_color, 1.0);
+#endif
+#ifdef MOTION_VECTORS
+	out_motion = (frag_clip.xy / frag_clip.w -
+		frag_previous_clip.xy / frag_previous_clip.w) * 0.5;
+#endif
 }
@@ -1,20 +1,116 @@
 #version 460
+#ifdef STEREO
+#extension GL_EXT_multiview : require
+#endif
 
-layout(location = 0) out vec3 frag_color;
+// The bindless table, see src/bindless.hpp. Array sizes are specialized to
+// the table's capacities.
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+
+// The uniform ring as an array of vec4 slots, see src/uniforms.hpp.
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+// Instances of draws built by a draw list, see src/draw_list.hpp.
+struct DrawInstance {
+	uint transform;
+	uint material;
+	uint batch;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer InstanceList {
+	DrawInstance instances[];
+} instance_lists[g_bindless_buffer_capacity];
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
+const uint g_no_instance_list = 0xffffffffu;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+// See src/uniforms.hpp. The vertex addresses are only used by pulling.vert.
+layout(push_constant) uniform DrawHandles {
+	uvec2 positions;
+	uvec2 colors;
+	uint vertex_stride;
+	uint uniform_buffer;
+	uint instances;
+	uint transform;
+	uint material;
+	uint mesh;
+	float position_scale[3];
+	float position_offset[3];
+} handles;
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
+#ifdef INSTANCED
+// Rows of InstanceTransform from the per-instance stream of
+// src/instancing.hpp. Only the instanced variant declares them, so the
+// others have no inputs the pipeline does not provide.
+layout(location = 2) in vec4 in_instance_rows[3];
+#endif
+
+layout(location = 0) out vec3 frag_color;
+// Placed by the instance but not yet transformed by the draw, the space the
+// scene's acceleration structure is built in, for ray_query.frag.
+layout(location = 1) out vec3 frag_position;
+#ifdef MOTION_VECTORS
+// Where the vertex is this frame without the jitter, and where it was the
+// frame before, for the motion vectors shader.frag writes.
+layout(location = 2) out vec4 frag_clip;
+layout(location = 3) out vec4 frag_previous_clip;
+#endif
+// The depth pre-pass and the shading pass must produce the same depth for the
+// EQUAL test.
+invariant gl_Position;
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	frag_color = colors[gl_VertexIndex];
+	// DrawUniforms::transform, one column per slot.
+	uint slot = handles.transform;
+	if (handles.instances != g_no_instance_list) {
+		slot = instance_lists[handles.instances].instances[gl_InstanceIndex]
+			.transform;
+	}
+	mat4 transform = mat4(
+		uniform_rings[handles.uniform_buffer].slots[slot],
+		uniform_rings[handles.uniform_buffer].slots[slot + 1],
+		uniform_rings[handles.uniform_buffer].slots[slot + 2],
+		uniform_rings[handles.uniform_buffer].slots[slot + 3]);
+	vec3 scale = vec3(
+		handles.position_scale[0],
+		handles.position_scale[1],
+		handles.position_scale[2]);
+	vec3 offset = vec3(
+		handles.position_offset[0],
+		handles.position_offset[1],
+		handles.position_offset[2]);
+	vec4 position = vec4(in_position * scale + offset, 1.0);
+#ifdef INSTANCED
+	position = vec4(
+		dot(in_instance_rows[0], position),
+		dot(in_instance_rows[1], position),
+		dot(in_instance_rows[2], position),
+		1.0);
+#endif
+	gl_Position = transform * position;
+#ifdef STEREO
+	// DrawUniforms::jitter holds how far the transform was narrowed for
+	// culling, the eyes' separation and the convergence depth, see
+	// src/stereo.hpp. The left eye is view 0.
+	vec4 stereo = uniform_rings[handles.uniform_buffer].slots[slot + 8];
+	float eye = gl_ViewIndex == 0 ? 1.0 : -1.0;
+	gl_Position.x = gl_Position.x * stereo.x +
+		eye * stereo.y * (gl_Position.z - stereo.z * gl_Position.w);
+#endif
+	frag_color = in_color;
+	frag_position = position.xyz;
+#ifdef MOTION_VECTORS
+	// DrawUniforms::previous_transform and jitter follow the transform.
+	mat4 previous_transform = mat4(
+		uniform_rings[handles.uniform_buffer].slots[slot + 4],
+		uniform_rings[handles.uniform_buffer].slots[slot + 5],
+		uniform_rings[handles.uniform_buffer].slots[slot + 6],
+		uniform_rings[handles.uniform_buffer].slots[slot + 7]);
+	vec2 jitter = uniform_rings[handles.uniform_buffer].slots[slot + 8].xy;
+	frag_clip = gl_Position - vec4(jitter * gl_Position.w, 0.0, 0.0);
+	frag_previous_clip = previous_transform * position;
+#endif
 }
@@ -0,0 +1,26 @@
+#!/usr/bin/env python3
+# Writes a SPIR-V module as a C initializer list of 32-bit words, the same
+# format glslc -mfmt=c emits, for src/shaders.cpp to embed.
+import struct
+import sys
+
+WORDS_PER_LINE = 8
+
+
+def main():
+    source, output = sys.argv[1:]
+    with open(source, 'rb') as f:
+        code = f.read()
+    if len(code) % 4 != 0:
+        sys.exit(f'Truncated SPIR-V module {source}')
+    words = struct.unpack(f'<{len(code) // 4}I', code)
+    lines = []
+    for i in range(0, len(words), WORDS_PER_LINE):
+        chunk = words[i:i + WORDS_PER_LINE]
+        lines.append(','.join(f'0x{word:08x}' for word in chunk))
+    with open(output, 'w') as f:
+        f.write('{' + ',\n'.join(lines) + '}\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,111 @@
+// Subgroup helpers, included by shaders after their #extension lines, which
+// have to enable GL_KHR_shader_subgroup_basic and
+// GL_KHR_shader_subgroup_ballot, and GL_KHR_shader_subgroup_arithmetic for
+// the workgroup reductions. The host picks the variants that include it from
+// the device's subgroup support, see src/subgroups.hpp. Nothing here assumes
+// a subgroup size: loops step by gl_SubgroupSize, so the same code runs on
+// subgroups of 4 to 128 invocations.
+
+// Runs statement once for each distinct value of index among the active
+// invocations, with uniform_index holding it. uniform_index is dynamically
+// uniform within statement, so it can index a descriptor array without
+// nonuniformEXT, which some devices turn into a slow per-invocation path or
+// get wrong. Each round the first active invocation's value is broadcast and
+// the invocations holding it run statement and leave, so a subgroup whose
+// invocations agree takes one round.
+#define SCALARIZE(index, uniform_index, statement) \
+	for (;;) { \
+		uint uniform_index = subgroupBroadcastFirst(index); \
+		if (uniform_index == (index)) { \
+			statement; \
+			break; \
+		} \
+	}
+
+// Where an invocation that keeps an item writes it among the items the
+// subgroup keeps, counting from 0.
+uint subgroup_compact_index(bool keep) {
+	return subgroupBallotExclusiveBitCount(subgroupBallot(keep));
+}
+
+// How many items the subgroup keeps.
+uint subgroup_compact_count(bool keep) {
+	return subgroupBallotBitCount(subgroupBallot(keep));
+}
+
+// Sets slot to where the invocation appends its item to a list whose length
+// is the uint counter, with one atomic per subgroup instead of one per item.
+// Invocations that do not keep an item get the slot after the ones before
+// them and must not write it. A macro, since buffers cannot be passed.
+#define SUBGROUP_APPEND(counter, keep, slot) \
+	do { \
+		uvec4 append_ballot = subgroupBallot(keep); \
+		uint append_base = 0; \
+		if (subgroupElect()) { \
+			append_base = atomicAdd(counter, subgroupBallotBitCount(append_ballot)); \
+		} \
+		slot = subgroupBroadcastFirst(append_base) + \
+			subgroupBallotExclusiveBitCount(append_ballot); \
+	} while (false)
+
+#ifdef SUBGROUP_WORKGROUP_SIZE
+// Reductions over a compute workgroup of SUBGROUP_WORKGROUP_SIZE
+// invocations, which the including shader defines before the include along
+// with enabling the arithmetic extension. They combine the subgroups'
+// results through shared memory, sized for subgroups of one invocation,
+// which a device may run. Every invocation of the workgroup has to call
+// them, in uniform control flow.
+shared uint subgroup_partials[SUBGROUP_WORKGROUP_SIZE];
+
+// The sum of value over the workgroup before this invocation's subgroup, and
+// over the whole workgroup in total.
+uint workgroup_subgroup_prefix(uint value, out uint total) {
+	uint sum = subgroupAdd(value);
+	if (subgroupElect()) {
+		subgroup_partials[gl_SubgroupID] = sum;
+	}
+	barrier();
+	uint before = 0;
+	uint all = 0;
+	for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups;
+		i += gl_SubgroupSize) {
+		uint partial = subgroup_partials[i];
+		all += partial;
+		before += i < gl_SubgroupID ? partial : 0;
+	}
+	// The partials are read, they can be written again.
+	barrier();
+	total = subgroupAdd(all);
+	return subgroupAdd(before);
+}
+
+uint workgroup_sum(uint value) {
+	uint total;
+	workgroup_subgroup_prefix(value, total);
+	return total;
+}
+
+// The sum of value over the invocations before this one by
+// gl_LocalInvocationIndex, which subgroups follow in order on the devices
+// this runs on when the workgroup is a multiple of the subgroup size, like
+// scan.comp relies on.
+uint workgroup_exclusive_sum(uint value, out uint total) {
+	return workgroup_subgroup_prefix(value, total) +
+		subgroupExclusiveAdd(value);
+}
+
+uint workgroup_max(uint value) {
+	uint largest = subgroupMax(value);
+	if (subgroupElect()) {
+		subgroup_partials[gl_SubgroupID] = largest;
+	}
+	barrier();
+	largest = 0;
+	for (uint i = gl_SubgroupInvocationID; i < gl_NumSubgroups;
+		i += gl_SubgroupSize) {
+		largest = max(largest, subgroup_partials[i]);
+	}
+	barrier();
+	return subgroupMax(largest);
+}
+#endif
@@ -0,0 +1,128 @@
+#version 460
+
+// Grass on the flats, rock on the slopes and snow on the peaks, lit by a
+// fixed sun and faded into haze with distance. VIRTUAL_TEXTURE samples them
+// from the material baked into a virtual texture instead, see
+// TerrainMaterial in src/terrain.hpp.
+layout(location = 0) in vec3 frag_normal;
+layout(location = 1) in float frag_height;
+layout(location = 2) in vec2 frag_ground;
+
+layout(location = 0) out vec4 out_color;
+
+#ifdef VIRTUAL_TEXTURE
+layout(constant_id = 0) const uint g_bindless_image_capacity = 1;
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+layout(constant_id = 2) const uint g_bindless_sampler_capacity = 1;
+
+// See src/terrain.cpp. Level 0 has g_material_pages pages along each side,
+// and the levels halve down to a single page.
+const uint g_material_size = 16384;
+const uint g_material_page_size = 128;
+const uint g_material_atlas_pages = 16;
+const uint g_material_pages = g_material_size / g_material_page_size;
+const uint g_material_levels = 8;
+// g_virtual_page_absent in src/virtual_texture.hpp.
+const uint g_page_absent = 0;
+
+layout(set = 0, binding = 0) uniform texture2D
+		bindless_textures[g_bindless_image_capacity];
+
+layout(set = 0, binding = 1, std430) readonly buffer PageTable {
+	uint entries[];
+} page_tables[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 1, std430) writeonly buffer Feedback {
+	uint pages[];
+} feedbacks[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 2) uniform sampler
+		bindless_samplers[g_bindless_sampler_capacity];
+
+// The material fields of TerrainConstants in src/terrain.cpp.
+layout(push_constant) uniform TerrainMaterial {
+	layout(offset = 88) uint page_table;
+	uint feedback;
+	uint atlas;
+	uint atlas_sampler;
+	float period;
+} material;
+
+// The page of level at uv, levels after level in the table.
+uint page_index(uint level, vec2 uv) {
+	uint pages = g_material_pages >> level;
+	// Each level has a quarter of the pages of the one before.
+	uint offset = 0;
+	for (uint l = 0; l < level; l++) {
+		offset += (g_material_pages >> l) * (g_material_pages >> l);
+	}
+	uvec2 page = min(uvec2(uv * float(pages)), uvec2(pages - 1));
+	return offset + page.y * pages + page.x;
+}
+
+// Asks for the page of the level the texel footprint wants, and samples the
+// finest resident one at or above it. The coarsest page is resident once its
+// upload is in, until then the material is a flat grey.
+vec3 sample_material(vec2 ground) {
+	vec2 texels = ground / material.period * float(g_material_size);
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+	uint level = min(uint(lod), g_material_levels - 1);
+	vec2 uv = fract(ground / material.period);
+	feedbacks[material.feedback].pages[page_index(level, uv)] = 1;
+	uint entry = g_page_absent;
+	for (; level < g_material_levels; level++) {
+		entry = page_tables[material.page_table].entries[page_index(level, uv)];
+		if (entry != g_page_absent) {
+			break;
+		}
+	}
+	if (entry == g_page_absent) {
+		return vec3(0.3);
+	}
+	uint slot = entry - 1;
+	uvec2 corner = uvec2(
+			slot % g_material_atlas_pages,
+			slot / g_material_atlas_pages);
+	// Half a texel inside the page, so filtering does not reach its neighbours.
+	float page_size = float(g_material_page_size);
+	vec2 in_page = clamp(
+			fract(uv * float(g_material_pages >> level)) * page_size,
+			0.5,
+			page_size - 0.5);
+	vec2 atlas_uv = (vec2(corner) * page_size + in_page) /
+			(page_size * float(g_material_atlas_pages));
+	return textureLod(
+			sampler2D(
+					bindless_textures[material.atlas],
+					bindless_samplers[material.atlas_sampler]),
+			atlas_uv,
+			0.0).rgb;
+}
+#endif
+
+const vec3 g_sun = vec3(0.4, 0.8, 0.3);
+const vec3 g_grass = vec3(0.18, 0.3, 0.1);
+const vec3 g_rock = vec3(0.35, 0.32, 0.28);
+const vec3 g_snow = vec3(0.9, 0.92, 0.95);
+const vec3 g_haze = vec3(0.6, 0.7, 0.8);
+// Per meter of view depth.
+const float g_haze_density = 2e-5;
+
+void main() {
+	vec3 normal = normalize(frag_normal);
+#ifdef VIRTUAL_TEXTURE
+	vec3 color = sample_material(frag_ground);
+#else
+	vec3 color = mix(g_grass, g_rock, smoothstep(0.9, 0.7, normal.y));
+	color = mix(
+			color,
+			g_snow,
+			smoothstep(0.75, 0.85, frag_height) * smoothstep(0.6, 0.8, normal.y));
+#endif
+	float light = 0.25 + 0.75 * max(dot(normal, normalize(g_sun)), 0.0);
+	// gl_FragCoord.w is one over the clip w, which is the view depth.
+	float haze = 1.0 - exp(-g_haze_density / gl_FragCoord.w);
+	out_color = vec4(mix(color * light, g_haze, haze), 1.0);
+}
@@ -0,0 +1,121 @@
+#version 460
+
+// The grids of a geometry clipmap, see Terrain in src/terrain.hpp. Instance l
+// draws level l, and vertex 6 * c + k is corner k of its cell c, counted
+// row-major. Levels past the first leave out the cells the one before
+// covers, and blend their heights into the next level's over the last
+// g_transition texels to their outer edge, which is where they meet it.
+layout(constant_id = 0) const uint g_bindless_image_capacity = 1;
+layout(constant_id = 1) const uint g_bindless_buffer_capacity = 1;
+layout(constant_id = 2) const uint g_bindless_sampler_capacity = 1;
+
+layout(set = 0, binding = 0) uniform utexture2D
+		bindless_images[g_bindless_image_capacity];
+
+layout(set = 0, binding = 1, std430) readonly buffer UniformRing {
+	vec4 slots[];
+} uniform_rings[g_bindless_buffer_capacity];
+
+layout(set = 0, binding = 2) uniform sampler
+		bindless_samplers[g_bindless_sampler_capacity];
+
+// See src/terrain.hpp.
+const int g_clipmap_size = 128;
+const int g_clipmap_cells = 124;
+const int g_max_clipmap_levels = 8;
+const int g_clipmap_margin = (g_clipmap_size - g_clipmap_cells) / 2;
+const float g_transition = 12.0;
+
+// TerrainConstants in src/terrain.cpp.
+layout(push_constant) uniform TerrainConstants {
+	uint uniform_buffer;
+	uint transform;
+	uint heights;
+	uint height_sampler;
+	float texel_size;
+	float height_scale;
+	ivec2 origins[g_max_clipmap_levels];
+} constants;
+
+layout(location = 0) out vec3 frag_normal;
+// Height over the largest one.
+layout(location = 1) out float frag_height;
+// Meters along x and z, where the material is looked up.
+layout(location = 2) out vec2 frag_ground;
+
+const int g_corners_x[6] = int[](0, 1, 0, 0, 1, 1);
+const int g_corners_y[6] = int[](0, 0, 1, 1, 0, 1);
+
+// In meters.
+float fetch(int level, ivec2 texel) {
+	ivec2 wrapped = texel & (g_clipmap_size - 1);
+	uint height = texelFetch(
+			usampler2D(
+					bindless_images[constants.heights],
+					bindless_samplers[constants.height_sampler]),
+			ivec2(wrapped.x, level * g_clipmap_size + wrapped.y),
+			0).r;
+	return float(height) / 65535.0 * constants.height_scale;
+}
+
+// The height the next level's cells have at a texel of level, halfway
+// between its texels where the texel is odd.
+float fetch_coarse(int level, ivec2 texel) {
+	ivec2 low = texel >> 1;
+	ivec2 high = (texel + 1) >> 1;
+	return 0.25 * (fetch(level + 1, low) +
+			fetch(level + 1, ivec2(high.x, low.y)) +
+			fetch(level + 1, ivec2(low.x, high.y)) +
+			fetch(level + 1, high));
+}
+
+void main() {
+	int level = gl_InstanceIndex;
+	int cell = gl_VertexIndex / 6;
+	int corner = gl_VertexIndex % 6;
+	ivec2 start = constants.origins[level] + g_clipmap_margin;
+	ivec2 cell_texel =
+			start + ivec2(cell % g_clipmap_cells, cell / g_clipmap_cells);
+	if (level > 0) {
+		ivec2 inner = (constants.origins[level - 1] + g_clipmap_margin) >> 1;
+		if (all(greaterThanEqual(cell_texel, inner)) &&
+				all(lessThan(cell_texel, inner + g_clipmap_cells / 2))) {
+			// Collapsed, so the cell rasterizes nothing.
+			gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+			frag_normal = vec3(0.0, 1.0, 0.0);
+			frag_height = 0.0;
+			frag_ground = vec2(0.0);
+			return;
+		}
+	}
+	ivec2 texel = cell_texel + ivec2(g_corners_x[corner], g_corners_y[corner]);
+
+	float height = fetch(level, texel);
+	vec2 offset = abs(vec2(texel - start) - 0.5 * float(g_clipmap_cells));
+	float blend = clamp(
+			(max(offset.x, offset.y) - (0.5 * float(g_clipmap_cells) -
+					g_transition)) / g_transition,
+			0.0,
+			1.0);
+	if (blend > 0.0 && level + 1 < g_max_clipmap_levels) {
+		height = mix(height, fetch_coarse(level, texel), blend);
+	}
+
+	float spacing = constants.texel_size * float(1 << level);
+	float dx = fetch(level, texel + ivec2(1, 0)) -
+			fetch(level, texel - ivec2(1, 0));
+	float dz = fetch(level, texel + ivec2(0, 1)) -
+			fetch(level, texel - ivec2(0, 1));
+	frag_normal = vec3(-dx, 2.0 * spacing, -dz);
+	frag_height = height / constants.height_scale;
+
+	uint slot = constants.transform;
+	mat4 transform = mat4(
+		uniform_rings[constants.uniform_buffer].slots[slot],
+		uniform_rings[constants.uniform_buffer].slots[slot + 1],
+		uniform_rings[constants.uniform_buffer].slots[slot + 2],
+		uniform_rings[constants.uniform_buffer].slots[slot + 3]);
+	vec3 position = vec3(vec2(texel) * spacing, height).xzy;
+	frag_ground = position.xz;
+	gl_Position = transform * vec4(position, 1.0);
+}
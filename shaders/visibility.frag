@@ -0,0 +1,17 @@
+#version 460
+
+// Writes which triangle of which draw covers the pixel, for
+// visibility_shade.comp to shade, see src/visibility.hpp. The draw goes to
+// the top 8 bits, offset by one so 0 stays the clear value, the draw's
+// triangle to the low 24.
+layout(location = 0) out uint out_visibility;
+
+// The draw field of DrawHandles in src/uniforms.hpp.
+layout(push_constant) uniform DrawHandles {
+	layout(offset = 84) uint draw;
+} handles;
+
+void main() {
+	out_visibility = (handles.draw + 1) << 24 |
+		(uint(gl_PrimitiveID) & 0xffffffu);
+}
@@ -0,0 +1,783 @@
+#include "allocator.hpp"
+
+#include "host_memory.hpp"
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_default_block_size = VkDeviceSize{64} << 20U;
+constexpr auto g_small_heap_size = VkDeviceSize{1} << 30U;
+
+struct ListIndex {
+	uint32_t fl{};
+	uint32_t sl{};
+};
+
+auto floor_log2(VkDeviceSize value) -> uint32_t {
+	return static_cast<uint32_t>(std::bit_width(value)) - 1;
+}
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+auto list_index(VkDeviceSize size) -> ListIndex {
+	if (size < g_tlsf_small_size) {
+		return ListIndex{
+				.fl = 0,
+				.sl = static_cast<uint32_t>(
+						size / (g_tlsf_small_size / g_tlsf_sl_count))};
+	}
+	auto log2 = floor_log2(size);
+	return ListIndex{
+			.fl = log2 - g_tlsf_small_log2 + 1,
+			.sl = static_cast<uint32_t>(size >> (log2 - g_tlsf_sl_log2)) ^
+					g_tlsf_sl_count};
+}
+
+// Rounds a request up so that every range in the list it maps to is large
+// enough, which lets the search take the head of a list without scanning it.
+auto round_up_to_list(VkDeviceSize size) -> VkDeviceSize {
+	if (size < g_tlsf_small_size) {
+		return align_up(size, g_tlsf_small_size / g_tlsf_sl_count);
+	}
+	return size + (VkDeviceSize{1} << (floor_log2(size) - g_tlsf_sl_log2)) - 1;
+}
+
+auto new_range(MemoryBlock& block) -> uint32_t {
+	if (!block.unused_ranges.empty()) {
+		auto idx = block.unused_ranges.back();
+		block.unused_ranges.pop_back();
+		return idx;
+	}
+	block.ranges.emplace_back();
+	return static_cast<uint32_t>(block.ranges.size() - 1);
+}
+
+void release_range(MemoryBlock& block, uint32_t idx) {
+	block.ranges.at(idx) = BlockRange{};
+	block.unused_ranges.emplace_back(idx);
+}
+
+void insert_free(MemoryBlock& block, uint32_t idx) {
+	auto& range = block.ranges.at(idx);
+	auto [fl, sl] = list_index(range.size);
+	auto& head = block.free_heads.at(fl).at(sl);
+	range.free = true;
+	range.prev_free = g_tlsf_null;
+	range.next_free = head;
+	if (head != g_tlsf_null) {
+		block.ranges.at(head).prev_free = idx;
+	}
+	head = idx;
+	block.fl_bitmap |= uint64_t{1} << fl;
+	block.sl_bitmaps.at(fl) |= 1U << sl;
+}
+
+void remove_free(MemoryBlock& block, uint32_t idx) {
+	auto& range = block.ranges.at(idx);
+	if (range.prev_free != g_tlsf_null) {
+		block.ranges.at(range.prev_free).next_free = range.next_free;
+	}
+	if (range.next_free != g_tlsf_null) {
+		block.ranges.at(range.next_free).prev_free = range.prev_free;
+	}
+	auto [fl, sl] = list_index(range.size);
+	auto& head = block.free_heads.at(fl).at(sl);
+	if (head == idx) {
+		head = range.next_free;
+		if (head == g_tlsf_null) {
+			block.sl_bitmaps.at(fl) &= ~(1U << sl);
+			if (block.sl_bitmaps.at(fl) == 0) {
+				block.fl_bitmap &= ~(uint64_t{1} << fl);
+			}
+		}
+	}
+	range.free = false;
+	range.prev_free = g_tlsf_null;
+	range.next_free = g_tlsf_null;
+}
+
+auto find_free_range(MemoryBlock& block, VkDeviceSize size) -> uint32_t {
+	auto [fl, sl] = list_index(round_up_to_list(size));
+	if (fl >= g_tlsf_fl_count) {
+		return g_tlsf_null;
+	}
+	auto sl_map = block.sl_bitmaps.at(fl) & (~0U << sl);
+	if (sl_map == 0) {
+		auto fl_map = fl + 1 < g_tlsf_fl_count
+				? block.fl_bitmap & (~uint64_t{0} << (fl + 1))
+				: 0;
+		if (fl_map == 0) {
+			return g_tlsf_null;
+		}
+		fl = static_cast<uint32_t>(std::countr_zero(fl_map));
+		sl_map = block.sl_bitmaps.at(fl);
+	}
+	sl = static_cast<uint32_t>(std::countr_zero(sl_map));
+	return block.free_heads.at(fl).at(sl);
+}
+
+// Adjacent free ranges are always merged, so the neighbours of a free range
+// that gets split are in use and the split-off pieces need not be merged.
+auto allocate_range(
+		MemoryBlock& block,
+		VkDeviceSize size,
+		VkDeviceSize alignment) -> uint32_t {
+	auto idx = find_free_range(block, size + alignment - 1);
+	if (idx == g_tlsf_null) {
+		return g_tlsf_null;
+	}
+	remove_free(block, idx);
+
+	auto offset = block.ranges.at(idx).offset;
+	auto aligned = align_up(offset, alignment);
+	if (aligned > offset) {
+		auto padding = new_range(block);
+		auto& range = block.ranges.at(idx);
+		block.ranges.at(padding) = BlockRange{
+				.offset = offset,
+				.size = aligned - offset,
+				.prev_physical = range.prev_physical,
+				.next_physical = idx,
+				.prev_free = g_tlsf_null,
+				.next_free = g_tlsf_null,
+				.free = false};
+		if (range.prev_physical != g_tlsf_null) {
+			block.ranges.at(range.prev_physical).next_physical = padding;
+		}
+		range.prev_physical = padding;
+		range.offset = aligned;
+		range.size -= aligned - offset;
+		insert_free(block, padding);
+	}
+
+	if (block.ranges.at(idx).size > size) {
+		auto tail = new_range(block);
+		auto& range = block.ranges.at(idx);
+		block.ranges.at(tail) = BlockRange{
+				.offset = range.offset + size,
+				.size = range.size - size,
+				.prev_physical = idx,
+				.next_physical = range.next_physical,
+				.prev_free = g_tlsf_null,
+				.next_free = g_tlsf_null,
+				.free = false};
+		if (range.next_physical != g_tlsf_null) {
+			block.ranges.at(range.next_physical).prev_physical = tail;
+		}
+		range.next_physical = tail;
+		range.size = size;
+		insert_free(block, tail);
+	}
+	block.allocated += size;
+	return idx;
+}
+
+void free_range(MemoryBlock& block, uint32_t idx) {
+	block.allocated -= block.ranges.at(idx).size;
+
+	auto prev = block.ranges.at(idx).prev_physical;
+	if (prev != g_tlsf_null && block.ranges.at(prev).free) {
+		remove_free(block, prev);
+		auto& range = block.ranges.at(idx);
+		block.ranges.at(prev).size += range.size;
+		block.ranges.at(prev).next_physical = range.next_physical;
+		if (range.next_physical != g_tlsf_null) {
+			block.ranges.at(range.next_physical).prev_physical = prev;
+		}
+		release_range(block, idx);
+		idx = prev;
+	}
+
+	auto next = block.ranges.at(idx).next_physical;
+	if (next != g_tlsf_null && block.ranges.at(next).free) {
+		remove_free(block, next);
+		auto& range = block.ranges.at(next);
+		block.ranges.at(idx).size += range.size;
+		block.ranges.at(idx).next_physical = range.next_physical;
+		if (range.next_physical != g_tlsf_null) {
+			block.ranges.at(range.next_physical).prev_physical = idx;
+		}
+		release_range(block, next);
+	}
+	insert_free(block, idx);
+}
+
+auto is_host_visible(const Allocator& allocator, uint32_t memory_type) -> bool {
+	return (allocator.memory_properties.memoryTypes[memory_type].propertyFlags &
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0U;
+}
+
+auto is_device_local(const Allocator& allocator, uint32_t memory_type)
+		-> bool {
+	return (allocator.memory_properties.memoryTypes[memory_type].propertyFlags &
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0U;
+}
+
+auto priority_value(MemoryPriority priority) -> float {
+	switch (priority) {
+		case MemoryPriority::low:
+			return 0.25F;
+		case MemoryPriority::normal:
+			break;
+		case MemoryPriority::high:
+			return 1.0F;
+	}
+	// The priority of memory allocated without one.
+	return 0.5F;
+}
+
+auto is_lazily_allocated(const Allocator& allocator, uint32_t memory_type)
+		-> bool {
+	return (allocator.memory_properties.memoryTypes[memory_type].propertyFlags &
+					VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0U;
+}
+
+// Returns a null handle when the heap is exhausted.
+auto allocate_device_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		uint32_t memory_type,
+		VkDeviceSize size,
+		MemoryPriority priority) -> VkDeviceMemory {
+	VKDEMO_ZONE("allocate_device_memory");
+	if (allocator.allocation_count >= allocator.max_allocation_count) {
+		fmt::print(
+				stderr,
+				"Device memory allocation limit of {} reached\n",
+				allocator.max_allocation_count);
+		std::terminate();
+	}
+	// The priority follows the flags, or the allocate info without them.
+	auto priority_info = VkMemoryPriorityAllocateInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.priority = priority_value(priority)};
+	auto flags_info = VkMemoryAllocateFlagsInfo{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+			.pNext = allocator.memory_priority ? &priority_info : VK_NULL_HANDLE,
+			.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+			.deviceMask = 0};
+	auto allocate_info = VkMemoryAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = allocator.device_address ? &flags_info : flags_info.pNext,
+			.allocationSize = size,
+			.memoryTypeIndex = memory_type};
+	auto* memory = VkDeviceMemory{};
+	if (vkAllocateMemory(device, &allocate_info, host_callbacks(), &memory) !=
+			VK_SUCCESS) {
+		return VK_NULL_HANDLE;
+	}
+	allocator.allocation_count++;
+	allocator.heap_usage.at(
+			allocator.memory_properties.memoryTypes[memory_type].heapIndex) += size;
+	VKDEMO_ALLOC(memory, size, "device memory");
+	return memory;
+}
+
+void free_device_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		uint32_t memory_type,
+		VkDeviceSize size,
+		VkDeviceMemory memory,
+		std::byte* mapped) {
+	if (mapped != nullptr) {
+		vkUnmapMemory(device, memory);
+	}
+	VKDEMO_FREE(memory, "device memory");
+	vkFreeMemory(device, memory, host_callbacks());
+	allocator.allocation_count--;
+	allocator.heap_usage.at(
+			allocator.memory_properties.memoryTypes[memory_type].heapIndex) -= size;
+}
+
+auto map_memory(VkDevice& device, VkDeviceMemory memory) -> std::byte* {
+	auto* mapped = static_cast<void*>(nullptr);
+	if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to map device memory\n");
+		std::terminate();
+	}
+	return static_cast<std::byte*>(mapped);
+}
+
+// Halves the block size when the heap cannot fit a full block, down to what
+// the request that caused the block to be created needs. allocate_range
+// searches for its size plus the worst case alignment padding, rounded up to
+// the list it maps to, so a smaller block would not satisfy it.
+auto create_block(
+		VkDevice& device,
+		Allocator& allocator,
+		const MemoryPool& pool,
+		VkDeviceSize request_size,
+		VkDeviceSize alignment) -> std::unique_ptr<MemoryBlock> {
+	auto min_size = round_up_to_list(request_size + alignment - 1);
+	auto size = std::max(pool.block_size, min_size);
+	auto* memory = allocate_device_memory(
+			device,
+			allocator,
+			pool.memory_type,
+			size,
+			pool.priority);
+	while (memory == VK_NULL_HANDLE && size / 2 >= min_size) {
+		size /= 2;
+		memory = allocate_device_memory(
+				device,
+				allocator,
+				pool.memory_type,
+				size,
+				pool.priority);
+	}
+	if (memory == VK_NULL_HANDLE) {
+		fmt::print(stderr, "Out of device memory\n");
+		std::terminate();
+	}
+
+	auto block = std::make_unique<MemoryBlock>();
+	block->memory = memory;
+	block->size = size;
+	if (is_host_visible(allocator, pool.memory_type)) {
+		block->mapped = map_memory(device, memory);
+	}
+	for (auto& heads : block->free_heads) {
+		heads.fill(g_tlsf_null);
+	}
+	block->ranges.emplace_back(BlockRange{
+			.offset = 0,
+			.size = size,
+			.prev_physical = g_tlsf_null,
+			.next_physical = g_tlsf_null,
+			.prev_free = g_tlsf_null,
+			.next_free = g_tlsf_null,
+			.free = false});
+	insert_free(*block, 0);
+	return block;
+}
+
+auto select_memory_type(
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		uint32_t type_bits,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred) -> std::optional<uint32_t> {
+	auto selected = std::optional<uint32_t>{};
+	auto selected_score = 0;
+	for (auto i = uint32_t{}; i < memory_properties.memoryTypeCount; i++) {
+		auto flags = memory_properties.memoryTypes[i].propertyFlags;
+		if ((type_bits & (1U << i)) == 0U || (flags & required) != required) {
+			continue;
+		}
+		auto score = std::popcount(flags & preferred);
+		if (!selected.has_value() || score > selected_score) {
+			selected = i;
+			selected_score = score;
+		}
+	}
+	return selected;
+}
+
+auto create_buffer_handle(
+		VkDevice& device,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		const std::array<uint32_t, 2>& queue_families) -> VkBuffer {
+	auto concurrent = queue_families[0] != queue_families[1];
+	auto buffer_info = VkBufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.size = size,
+			.usage = usage,
+			.sharingMode =
+					concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = concurrent ? 2U : 0U,
+			.pQueueFamilyIndices = concurrent ? queue_families.data() : nullptr};
+	auto* buffer = VkBuffer{};
+	if (vkCreateBuffer(device, &buffer_info, host_callbacks(), &buffer) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create buffer\n");
+		std::terminate();
+	}
+	return buffer;
+}
+
+}  // namespace
+
+auto create_allocator(
+		const VkPhysicalDeviceProperties& properties,
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		bool device_address,
+		bool memory_priority) -> Allocator {
+	auto allocator = Allocator{};
+	allocator.memory_properties = memory_properties;
+	allocator.device_address = device_address;
+	allocator.memory_priority = memory_priority;
+	allocator.buffer_image_granularity =
+			properties.limits.bufferImageGranularity;
+	allocator.max_allocation_count = properties.limits.maxMemoryAllocationCount;
+	// By memory type, then resource kind, then priority.
+	allocator.pools.resize(
+			size_t{memory_properties.memoryTypeCount} * 2 *
+			g_memory_priority_count);
+	for (auto i = size_t{}; i < allocator.pools.size(); i++) {
+		auto& pool = allocator.pools.at(i);
+		pool.memory_type = static_cast<uint32_t>(i / (2 * g_memory_priority_count));
+		pool.priority = static_cast<MemoryPriority>(i % g_memory_priority_count);
+		auto heap_idx = memory_properties.memoryTypes[pool.memory_type].heapIndex;
+		auto heap_size = memory_properties.memoryHeaps[heap_idx].size;
+		// Small heaps, like the 256MB BAR window, would be used up by a handful
+		// of default sized blocks.
+		pool.block_size =
+				heap_size <= g_small_heap_size ? heap_size / 8 : g_default_block_size;
+	}
+	auto mappable_local = VkMemoryPropertyFlags{
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+	for (auto i = uint32_t{}; i < memory_properties.memoryTypeCount; i++) {
+		const auto& memory_type = memory_properties.memoryTypes[i];
+		if ((memory_type.propertyFlags & mappable_local) == mappable_local &&
+				memory_properties.memoryHeaps[memory_type.heapIndex].size >
+						g_bar_window_size) {
+			allocator.resizable_bar = true;
+		}
+	}
+	return allocator;
+}
+
+void destroy_allocator(VkDevice& device, Allocator& allocator) {
+	for (auto& pool : allocator.pools) {
+		for (auto& block : pool.blocks) {
+			free_device_memory(
+					device,
+					allocator,
+					pool.memory_type,
+					block->size,
+					block->memory,
+					block->mapped);
+		}
+	}
+	allocator.pools.clear();
+}
+
+auto allocate_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkMemoryRequirements& requirements,
+		ResourceKind kind,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred,
+		MemoryPriority priority) -> Allocation {
+	auto memory_type = select_memory_type(
+			allocator.memory_properties,
+			requirements.memoryTypeBits,
+			required,
+			preferred);
+	if (!memory_type.has_value()) {
+		fmt::print(stderr, "No suitable memory type for allocation\n");
+		std::terminate();
+	}
+	auto separate_kinds = allocator.buffer_image_granularity > 1;
+	// Only device local memory is ever demoted.
+	if (!allocator.memory_priority || !is_device_local(allocator, *memory_type)) {
+		priority = MemoryPriority::normal;
+	}
+	auto pool_idx = (*memory_type * 2 +
+			(separate_kinds && kind == ResourceKind::optimal ? 1 : 0)) *
+					g_memory_priority_count +
+			static_cast<size_t>(priority);
+	auto& pool = allocator.pools.at(pool_idx);
+
+	auto allocation = Allocation{};
+	allocation.size = requirements.size;
+	allocation.pool = pool_idx;
+	// Lazily allocated memory is only committed as the GPU touches it, so
+	// transient attachments get their own instead of reserving a whole block.
+	if (requirements.size > pool.block_size / 2 ||
+			is_lazily_allocated(allocator, pool.memory_type)) {
+		allocation.memory = allocate_device_memory(
+				device,
+				allocator,
+				pool.memory_type,
+				requirements.size,
+				priority);
+		if (allocation.memory == VK_NULL_HANDLE) {
+			fmt::print(stderr, "Out of device memory\n");
+			std::terminate();
+		}
+		if (is_host_visible(allocator, pool.memory_type)) {
+			allocation.mapped = map_memory(device, allocation.memory);
+		}
+		return allocation;
+	}
+
+	for (auto& block : pool.blocks) {
+		auto range =
+				allocate_range(*block, requirements.size, requirements.alignment);
+		if (range != g_tlsf_null) {
+			allocation.block = block.get();
+			allocation.range = range;
+			break;
+		}
+	}
+	if (allocation.block == nullptr) {
+		auto& block = pool.blocks.emplace_back(
+				create_block(
+						device,
+						allocator,
+						pool,
+						requirements.size,
+						requirements.alignment));
+		allocation.block = block.get();
+		allocation.range =
+				allocate_range(*block, requirements.size, requirements.alignment);
+	}
+	allocation.memory = allocation.block->memory;
+	allocation.offset = allocation.block->ranges.at(allocation.range).offset;
+	if (allocation.block->mapped != nullptr) {
+		allocation.mapped = allocation.block->mapped + allocation.offset;
+	}
+	return allocation;
+}
+
+void free_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+	if (allocation.block == nullptr) {
+		free_device_memory(
+				device,
+				allocator,
+				allocator.pools.at(allocation.pool).memory_type,
+				allocation.size,
+				allocation.memory,
+				allocation.mapped);
+		allocation = Allocation{};
+		return;
+	}
+
+	auto& pool = allocator.pools.at(allocation.pool);
+	auto* block = allocation.block;
+	free_range(*block, allocation.range);
+	// Keep the last block around so a pool that empties and refills every
+	// frame does not allocate device memory every frame.
+	if (block->allocated == 0 && pool.blocks.size() > 1) {
+		free_device_memory(
+				device,
+				allocator,
+				pool.memory_type,
+				block->size,
+				block->memory,
+				block->mapped);
+		std::erase_if(
+				pool.blocks,
+				[&](const std::unique_ptr<MemoryBlock>& candidate) {
+					return candidate.get() == block;
+				});
+	}
+	allocation = Allocation{};
+}
+
+auto allocation_heap(const Allocator& allocator, const Allocation& allocation)
+		-> uint32_t {
+	auto memory_type = allocator.pools.at(allocation.pool).memory_type;
+	return allocator.memory_properties.memoryTypes[memory_type].heapIndex;
+}
+
+auto create_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred) -> Buffer {
+	return create_shared_buffer(
+			device,
+			allocator,
+			size,
+			usage,
+			required,
+			preferred,
+			{});
+}
+
+auto create_shared_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred,
+		const std::array<uint32_t, 2>& queue_families) -> Buffer {
+	auto buffer = Buffer{};
+	buffer.handle = create_buffer_handle(device, size, usage, queue_families);
+	buffer.size = size;
+	buffer.usage = usage;
+	buffer.queue_families = queue_families;
+	auto requirements = VkMemoryRequirements{};
+	vkGetBufferMemoryRequirements(device, buffer.handle, &requirements);
+	buffer.allocation = allocate_memory(
+			device,
+			allocator,
+			requirements,
+			ResourceKind::linear,
+			required,
+			preferred,
+			(required & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0U
+					? MemoryPriority::high
+					: MemoryPriority::normal);
+	vkBindBufferMemory(
+			device,
+			buffer.handle,
+			buffer.allocation.memory,
+			buffer.allocation.offset);
+	return buffer;
+}
+
+auto create_dynamic_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage) -> Buffer {
+	auto preferred = VkMemoryPropertyFlags{};
+	if (allocator.resizable_bar || size <= g_small_dynamic_buffer_size) {
+		preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
+	return create_buffer(
+			device,
+			allocator,
+			size,
+			usage,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			preferred);
+}
+
+void destroy_buffer(VkDevice& device, Allocator& allocator, Buffer& buffer) {
+	vkDestroyBuffer(device, buffer.handle, host_callbacks());
+	free_memory(device, allocator, buffer.allocation);
+	buffer.handle = VK_NULL_HANDLE;
+}
+
+auto in_sparse_block(const Allocator& allocator, const Allocation& allocation)
+		-> bool {
+	if (allocation.block == nullptr ||
+			allocator.pools.at(allocation.pool).blocks.size() < 2) {
+		return false;
+	}
+	const auto& block = *allocation.block;
+	return block.allocated * 100 < block.size * g_sparse_block_percent;
+}
+
+auto relocate_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		const Buffer& buffer) -> std::optional<Buffer> {
+	auto moved = Buffer{};
+	moved.handle = create_buffer_handle(
+			device,
+			buffer.size,
+			buffer.usage,
+			buffer.queue_families);
+	moved.size = buffer.size;
+	moved.usage = buffer.usage;
+	moved.queue_families = buffer.queue_families;
+	auto requirements = VkMemoryRequirements{};
+	vkGetBufferMemoryRequirements(device, moved.handle, &requirements);
+	// Only fuller blocks take it, so repeated moves drain the sparse blocks
+	// instead of trading ranges between them.
+	auto& pool = allocator.pools.at(buffer.allocation.pool);
+	for (auto& block : pool.blocks) {
+		if (block.get() == buffer.allocation.block ||
+				block->allocated <= buffer.allocation.block->allocated) {
+			continue;
+		}
+		auto range =
+				allocate_range(*block, requirements.size, requirements.alignment);
+		if (range == g_tlsf_null) {
+			continue;
+		}
+		moved.allocation.memory = block->memory;
+		moved.allocation.offset = block->ranges.at(range).offset;
+		moved.allocation.size = requirements.size;
+		if (block->mapped != nullptr) {
+			moved.allocation.mapped = block->mapped + moved.allocation.offset;
+		}
+		moved.allocation.block = block.get();
+		moved.allocation.range = range;
+		moved.allocation.pool = buffer.allocation.pool;
+		vkBindBufferMemory(
+				device,
+				moved.handle,
+				moved.allocation.memory,
+				moved.allocation.offset);
+		return moved;
+	}
+	vkDestroyBuffer(device, moved.handle, host_callbacks());
+	return std::nullopt;
+}
+
+auto buffer_device_address(VkDevice& device, const Buffer& buffer)
+		-> VkDeviceAddress {
+	auto address_info = VkBufferDeviceAddressInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.buffer = buffer.handle};
+	return vkGetBufferDeviceAddress(device, &address_info);
+}
+
+auto create_image(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkImageCreateInfo& image_info,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred) -> Image {
+	auto image = Image{};
+	if (vkCreateImage(device, &image_info, host_callbacks(), &image.handle) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create image\n");
+		std::terminate();
+	}
+	auto requirements = VkMemoryRequirements{};
+	vkGetImageMemoryRequirements(device, image.handle, &requirements);
+	auto kind = image_info.tiling == VK_IMAGE_TILING_LINEAR
+			? ResourceKind::linear
+			: ResourceKind::optimal;
+	auto written = VkImageUsageFlags{
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+			VK_IMAGE_USAGE_STORAGE_BIT};
+	image.allocation = allocate_memory(
+			device,
+			allocator,
+			requirements,
+			kind,
+			required,
+			preferred,
+			(image_info.usage & written) != 0U ? MemoryPriority::high
+																				: MemoryPriority::low);
+	vkBindImageMemory(
+			device,
+			image.handle,
+			image.allocation.memory,
+			image.allocation.offset);
+	return image;
+}
+
+void destroy_image(VkDevice& device, Allocator& allocator, Image& image) {
+	vkDestroyImage(device, image.handle, host_callbacks());
+	free_memory(device, allocator, image.allocation);
+	image.handle = VK_NULL_HANDLE;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Free lists are indexed TLSF style: the first level is the power of two of
+// the size, the second level splits each power of two into linear ranges.
+// Blocks smaller than g_tlsf_small_size share the first list.
+constexpr auto g_tlsf_sl_log2 = 5U;
+constexpr auto g_tlsf_sl_count = 1U << g_tlsf_sl_log2;
+constexpr auto g_tlsf_small_log2 = 8U;
+constexpr auto g_tlsf_small_size = VkDeviceSize{1} << g_tlsf_small_log2;
+constexpr auto g_tlsf_fl_count = 64U - g_tlsf_small_log2 + 1U;
+constexpr auto g_tlsf_null = UINT32_MAX;
+// Blocks less full than this, in percent, are worth emptying into the other
+// blocks of their pool so they can be freed.
+constexpr auto g_sparse_block_percent = VkDeviceSize{50};
+
+struct BlockRange {
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+	uint32_t prev_physical{g_tlsf_null};
+	uint32_t next_physical{g_tlsf_null};
+	uint32_t prev_free{g_tlsf_null};
+	uint32_t next_free{g_tlsf_null};
+	bool free{};
+};
+
+// One vkAllocateMemory call, carved up into ranges. Host visible blocks stay
+// mapped for their whole lifetime.
+struct MemoryBlock {
+	VkDeviceMemory memory{};
+	VkDeviceSize size{};
+	std::byte* mapped{};
+	VkDeviceSize allocated{};
+	std::vector<BlockRange> ranges;
+	std::vector<uint32_t> unused_ranges;
+	uint64_t fl_bitmap{};
+	std::array<uint32_t, g_tlsf_fl_count> sl_bitmaps{};
+	std::array<std::array<uint32_t, g_tlsf_sl_count>, g_tlsf_fl_count>
+			free_heads{};
+};
+
+// What an oversubscribed device keeps in its device local heaps longest,
+// with VK_EXT_memory_priority. A block of memory has a single priority, so
+// each priority has pools of its own.
+enum class MemoryPriority {
+	// Demoted first, like textures, which can drop levels.
+	low,
+	normal,
+	// What every frame touches, like render targets.
+	high,
+};
+constexpr auto g_memory_priority_count = size_t{3};
+
+struct MemoryPool {
+	uint32_t memory_type{};
+	MemoryPriority priority{};
+	VkDeviceSize block_size{};
+	std::vector<std::unique_ptr<MemoryBlock>> blocks;
+};
+
+struct Allocation {
+	VkDeviceMemory memory{};
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+	// Null unless the memory type is host visible.
+	std::byte* mapped{};
+	// Null for dedicated allocations, which own their memory.
+	MemoryBlock* block{};
+	uint32_t range{g_tlsf_null};
+	uint32_t pool{};
+};
+
+// Linear resources (buffers and linear images) and optimally tiled images
+// must not share a bufferImageGranularity page, so devices with a
+// granularity above one get a separate pool for each kind.
+enum class ResourceKind {
+	linear,
+	optimal,
+};
+
+// Without resizable BAR the CPU maps only this much of the device local
+// memory, a window the driver shares with every other process.
+constexpr auto g_bar_window_size = VkDeviceSize{256} << 20U;
+// Dynamic buffers up to this size go through the window anyway.
+constexpr auto g_small_dynamic_buffer_size = VkDeviceSize{4} << 20U;
+
+// Sub-allocates resources from large blocks, one set of blocks per memory type
+// and resource kind. Resources too large to share a block get a dedicated
+// allocation.
+struct Allocator {
+	VkPhysicalDeviceMemoryProperties memory_properties{};
+	// Every allocation can back buffers used through device addresses.
+	bool device_address{};
+	// Device local memory is allocated with its priority. Without it every
+	// allocation is normal.
+	bool memory_priority{};
+	// A device local heap the CPU can map is larger than the BAR window, with
+	// resizable BAR or Smart Access Memory, or on integrated GPUs.
+	bool resizable_bar{};
+	VkDeviceSize buffer_image_granularity{};
+	uint32_t max_allocation_count{};
+	uint32_t allocation_count{};
+	// Device memory allocated from each heap, blocks counted whole.
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heap_usage{};
+	std::vector<MemoryPool> pools;
+};
+
+// device_address requires the bufferDeviceAddress feature, memory_priority
+// the memoryPriority feature of VK_EXT_memory_priority.
+auto create_allocator(
+		const VkPhysicalDeviceProperties& properties,
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		bool device_address,
+		bool memory_priority) -> Allocator;
+// Every allocation must have been freed.
+void destroy_allocator(VkDevice& device, Allocator& allocator);
+
+// Picks the memory type with all of the required flags and the most preferred
+// ones.
+auto allocate_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkMemoryRequirements& requirements,
+		ResourceKind kind,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred,
+		MemoryPriority priority) -> Allocation;
+void free_memory(
+		VkDevice& device,
+		Allocator& allocator,
+		Allocation& allocation);
+// The heap allocation's memory comes from.
+auto allocation_heap(const Allocator& allocator, const Allocation& allocation)
+		-> uint32_t;
+
+struct Buffer {
+	VkBuffer handle{};
+	Allocation allocation;
+	// What the buffer was created with, so it can be created again elsewhere.
+	VkDeviceSize size{};
+	VkBufferUsageFlags usage{};
+	// Shared concurrently by both families when they differ.
+	std::array<uint32_t, 2> queue_families{};
+};
+
+struct Image {
+	VkImage handle{};
+	Allocation allocation;
+};
+
+// Buffers in device local memory are high priority, others normal.
+auto create_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred) -> Buffer;
+// A buffer both queue families use without ownership transfers, like work
+// on the async compute queue and the graphics queue reading its results.
+auto create_shared_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred,
+		const std::array<uint32_t, 2>& queue_families) -> Buffer;
+// A buffer the CPU writes every frame and the GPU reads in place, like
+// instance transforms, uniforms and indirect arguments, with no staging
+// copy. It is device local where the CPU can map plenty of that, and in host
+// memory the GPU reads over PCIe otherwise, unless it is small enough for
+// the BAR window.
+auto create_dynamic_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage) -> Buffer;
+void destroy_buffer(VkDevice& device, Allocator& allocator, Buffer& buffer);
+
+// Whether allocation is in a sparse block whose pool has others to move it to.
+auto in_sparse_block(const Allocator& allocator, const Allocation& allocation)
+		-> bool;
+// Creates a buffer like buffer in a fuller block of its pool, to move it out of
+// a sparse one. Returns nothing when none of them has room, new blocks are
+// never allocated for it.
+auto relocate_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		const Buffer& buffer) -> std::optional<Buffer>;
+
+// The buffer must have been created with
+// VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT by a device_address allocator.
+auto buffer_device_address(VkDevice& device, const Buffer& buffer)
+		-> VkDeviceAddress;
+
+// Images that are rendered to or written by shaders are high priority, ones
+// that are only sampled low.
+auto create_image(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkImageCreateInfo& image_info,
+		VkMemoryPropertyFlags required,
+		VkMemoryPropertyFlags preferred) -> Image;
+void destroy_image(VkDevice& device, Allocator& allocator, Image& image);
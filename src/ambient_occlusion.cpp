@@ -0,0 +1,355 @@
+#include "ambient_occlusion.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_occlusion_gbuffer_binding = 0U;
+constexpr auto g_occlusion_history_binding = 1U;
+constexpr auto g_occlusion_written_binding = 2U;
+
+constexpr auto g_storage_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in ambient_occlusion.comp.
+struct OcclusionConstants {
+	glm::mat4 previous_transform{1.0F};
+	BindlessHandle lights{};
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t previous_width{};
+	uint32_t previous_height{};
+	uint32_t frame{};
+	float radius_pixels{};
+	float falloff_distance{};
+	float history_weight{};
+	uint32_t history_valid{};
+};
+static_assert(sizeof(OcclusionConstants) <= 128);
+
+// Points the frame's set at this frame's views. The frame's fence was waited
+// on, so the set is no longer in use.
+void write_occlusion_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		VkDescriptorSet set,
+		std::array<uint32_t, 3> images) {
+	auto infos = std::array<VkDescriptorImageInfo, 3>{};
+	auto writes = std::array<VkWriteDescriptorSet, 3>{};
+	for (auto i = size_t{}; i < images.size(); i++) {
+		infos.at(i) = VkDescriptorImageInfo{
+				.sampler = VK_NULL_HANDLE,
+				.imageView = graph_image_view(graph, images.at(i)),
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+		writes.at(i) = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = static_cast<uint32_t>(i),
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = &infos.at(i),
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE};
+	}
+	vkUpdateDescriptorSets(
+			device,
+			static_cast<uint32_t>(writes.size()),
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+}
+
+}  // namespace
+
+auto create_ambient_occlusion(
+		VkDevice& device,
+		const BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization) -> AmbientOcclusion {
+	auto occlusion = AmbientOcclusion{};
+	auto storage_binding = [](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = VK_NULL_HANDLE};
+	};
+	auto bindings = std::array{
+			storage_binding(g_occlusion_gbuffer_binding),
+			storage_binding(g_occlusion_history_binding),
+			storage_binding(g_occlusion_written_binding),
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&occlusion.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create ambient occlusion set layout\n");
+		std::terminate();
+	}
+
+	auto set_layouts = std::array{bindless.set_layout, occlusion.set_layout};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(OcclusionConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&occlusion.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create ambient occlusion pipeline layout\n");
+		std::terminate();
+	}
+	occlusion.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			occlusion.pipeline_layout,
+			module,
+			specialization,
+			0);
+	return occlusion;
+}
+
+void destroy_ambient_occlusion(
+		VkDevice& device,
+		Allocator& allocator,
+		AmbientOcclusion& occlusion) {
+	for (auto i = size_t{}; i < occlusion.history.size(); i++) {
+		if (occlusion.history.at(i).handle != VK_NULL_HANDLE) {
+			vkDestroyImageView(
+					device,
+					occlusion.history_views.at(i),
+					host_callbacks());
+			destroy_image(device, allocator, occlusion.history.at(i));
+		}
+	}
+	vkDestroyPipeline(device, occlusion.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, occlusion.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, occlusion.set_layout, host_callbacks());
+	occlusion = AmbientOcclusion{};
+}
+
+void resize_ambient_occlusion(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		AmbientOcclusion& occlusion,
+		VkExtent2D target_extent) {
+	auto extent = VkExtent2D{
+			.width = (target_extent.width + 1) / 2,
+			.height = (target_extent.height + 1) / 2};
+	if (extent.width == occlusion.extent.width &&
+			extent.height == occlusion.extent.height) {
+		return;
+	}
+	if (occlusion.history.at(0).handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device,
+				 &allocator,
+				 history = occlusion.history,
+				 views = occlusion.history_views]() mutable {
+					for (auto i = size_t{}; i < history.size(); i++) {
+						vkDestroyImageView(device, views.at(i), host_callbacks());
+						destroy_image(device, allocator, history.at(i));
+					}
+				});
+	}
+	occlusion.extent = extent;
+	occlusion.history_valid = false;
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_ambient_occlusion_format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	for (auto i = size_t{}; i < occlusion.history.size(); i++) {
+		occlusion.history.at(i) = create_image(
+				device,
+				allocator,
+				image_info,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0);
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = occlusion.history.at(i).handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = g_ambient_occlusion_format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = VkImageSubresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1}};
+		if (vkCreateImageView(
+						device,
+						&view_info,
+						host_callbacks(),
+						&occlusion.history_views.at(i)) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create ambient occlusion view\n");
+			std::terminate();
+		}
+	}
+}
+
+auto add_ambient_occlusion_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		AmbientOcclusion& occlusion,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle lights,
+		uint32_t gbuffer,
+		const glm::mat4& transform,
+		VkExtent2D render_extent) -> uint32_t {
+	auto current = occlusion.current;
+	auto previous = 1 - current;
+	// Both images are left for storage reads at the end of the frame, so the
+	// next frame's write waits for the lighting pass's reads.
+	auto used = occlusion.history_valid ? g_storage_read : GraphState{};
+	auto history = import_graph_image(
+			graph,
+			occlusion.history.at(previous).handle,
+			occlusion.history_views.at(previous),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			std::nullopt);
+	auto written = import_graph_image(
+			graph,
+			occlusion.history.at(current).handle,
+			occlusion.history_views.at(current),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			g_storage_read);
+	const auto& settings = occlusion.settings;
+	auto constants = OcclusionConstants{
+			.previous_transform = occlusion.previous_transform,
+			.lights = lights,
+			.width = render_extent.width,
+			.height = render_extent.height,
+			.previous_width = occlusion.previous_render_extent.width,
+			.previous_height = occlusion.previous_render_extent.height,
+			.frame = occlusion.frame_index,
+			.radius_pixels = settings.radius_pixels,
+			.falloff_distance = settings.falloff_distance,
+			.history_weight = settings.history_weight,
+			.history_valid = occlusion.history_valid ? 1U : 0U};
+	auto images = std::array{gbuffer, history, written};
+	auto record = [&device, &graph, &profiler, &descriptors, &occlusion,
+								 &bindless, frame_idx, constants, images](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass = begin_gpu_pass(
+				profiler,
+				command_buffer,
+				frame_idx,
+				"ambient_occlusion");
+		auto* set = allocate_frame_set(
+				device,
+				descriptors,
+				frame_idx,
+				occlusion.set_layout);
+		write_occlusion_set(device, graph, set, images);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				occlusion.pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				occlusion.pipeline_layout,
+				bindless);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				occlusion.pipeline_layout,
+				1,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		vkCmdPushConstants(
+				command_buffer,
+				occlusion.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		// A texel per 2x2 block of the render area.
+		auto width = (constants.width + 1) / 2;
+		auto height = (constants.height + 1) / 2;
+		vkCmdDispatch(
+				command_buffer,
+				(width + g_ambient_occlusion_group_size - 1) /
+						g_ambient_occlusion_group_size,
+				(height + g_ambient_occlusion_group_size - 1) /
+						g_ambient_occlusion_group_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "ambient_occlusion", record, false);
+	graph_read(graph, pass, gbuffer, g_storage_read);
+	graph_read(graph, pass, history, g_storage_read);
+	graph_write(graph, pass, written, g_storage_write);
+	occlusion.current = previous;
+	occlusion.history_valid = true;
+	occlusion.frame_index++;
+	occlusion.previous_transform = transform;
+	occlusion.previous_render_extent = render_extent;
+	return written;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "deletion.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Matches local_size in ambient_occlusion.comp.
+constexpr auto g_ambient_occlusion_group_size = 8U;
+// A texel per 2x2 block of pixels: the occlusion and the view depth it was
+// found at as two halves, packHalf2x16 order, which deferred_lighting.comp
+// weighs the upsampling with. Pixels nothing covers have a depth of zero.
+constexpr auto g_ambient_occlusion_format = VK_FORMAT_R32_UINT;
+
+struct AmbientOcclusionSettings {
+	// How far from a pixel the horizons are searched, in render pixels.
+	float radius_pixels{24.0F};
+	// Distance at which occluders have faded out, in the G-buffer's units.
+	float falloff_distance{0.2F};
+	// How much of a texel's history is kept where it reprojected to a
+	// surface at the same depth. Every frame rotates the slice directions and
+	// moves the sample within the block, which the history averages.
+	float history_weight{0.9F};
+};
+
+// Ambient occlusion of the deferred G-buffer, ground truth style: for a few
+// screen space slices through each texel's view vector, ambient_occlusion.comp
+// finds the highest horizon on either side among the G-buffer's positions and
+// integrates the cosine weighted visibility between them around the
+// surface's normal. It runs at half resolution and accumulates over frames in
+// place of more slices, in two images that ping-pong like TemporalAa's
+// history. The lighting pass upsamples it, weighing the four nearest texels
+// by how close their depths are to the pixel's, so occlusion does not bleed
+// over silhouettes.
+//
+// The pass binds the bindless table as set 0, which it reads the view
+// through, and a set of its own as set 1: binding 0 the G-buffer, binding 1
+// the previous occlusion and binding 2 the occlusion written, all storage
+// images taken from the frame's descriptor pools.
+struct AmbientOcclusion {
+	AmbientOcclusionSettings settings;
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::array<Image, 2> history;
+	std::array<VkImageView, 2> history_views{};
+	// Half the target's extent, rounded up.
+	VkExtent2D extent{};
+	// The history the next frame writes, the other one is the previous.
+	uint32_t current{};
+	// Whether the previous history holds an earlier frame.
+	bool history_valid{};
+	uint32_t frame_index{};
+	// Last frame's world to clip transform and render extent, which the
+	// history is reprojected with.
+	glm::mat4 previous_transform{1.0F};
+	VkExtent2D previous_render_extent{};
+};
+
+// module is ambient_occlusion.comp, whose bindless arrays are sized by
+// specialization.
+auto create_ambient_occlusion(
+		VkDevice& device,
+		const BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization) -> AmbientOcclusion;
+// The device must be idle.
+void destroy_ambient_occlusion(
+		VkDevice& device,
+		Allocator& allocator,
+		AmbientOcclusion& occlusion);
+
+// Recreates the history when the target's extent changed, the old images
+// are destroyed once the frames using them are done. The accumulation starts
+// over.
+void resize_ambient_occlusion(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		AmbientOcclusion& occlusion,
+		VkExtent2D target_extent);
+
+// Adds the pass finding the occlusion of the top left render_extent of
+// gbuffer, and returns the occlusion written, which the lighting pass reads
+// as a storage image. Must be called after resize_ambient_occlusion and the
+// frame fence was waited on. lights is the frame's deferred lights, whose
+// view the G-buffer's positions are seen through, and transform takes them
+// to clip space.
+auto add_ambient_occlusion_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		AmbientOcclusion& occlusion,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle lights,
+		uint32_t gbuffer,
+		const glm::mat4& transform,
+		VkExtent2D render_extent) -> uint32_t;
@@ -0,0 +1,436 @@
+#include "animation.hpp"
+
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr auto g_rotation_scale = 32767.0F;
+
+// A channel of as many joints as fit a register, and the few operations the
+// kernels need on them.
+#if defined(__AVX__)
+using Lanes = __m256;
+constexpr auto g_lane_count = size_t{8};
+
+auto load(const float* values) -> Lanes {
+	return _mm256_loadu_ps(values);
+}
+// Sign extended, AVX implies SSE4.1.
+auto load_keys(const int16_t* values) -> Lanes {
+	auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+	auto low = _mm_cvtepi16_epi32(packed);
+	auto high = _mm_cvtepi16_epi32(_mm_srli_si128(packed, 8));
+	return _mm256_cvtepi32_ps(_mm256_set_m128i(high, low));
+}
+void store(float* values, Lanes lanes) {
+	_mm256_storeu_ps(values, lanes);
+}
+auto splat(float value) -> Lanes {
+	return _mm256_set1_ps(value);
+}
+auto add(Lanes a, Lanes b) -> Lanes {
+	return _mm256_add_ps(a, b);
+}
+auto subtract(Lanes a, Lanes b) -> Lanes {
+	return _mm256_sub_ps(a, b);
+}
+auto multiply(Lanes a, Lanes b) -> Lanes {
+	return _mm256_mul_ps(a, b);
+}
+auto inverse_sqrt(Lanes lanes) -> Lanes {
+	return _mm256_div_ps(_mm256_set1_ps(1.0F), _mm256_sqrt_ps(lanes));
+}
+// lanes, negated where sign is negative.
+auto flip_negative(Lanes sign, Lanes lanes) -> Lanes {
+	return _mm256_xor_ps(lanes, _mm256_and_ps(sign, _mm256_set1_ps(-0.0F)));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+using Lanes = __m128;
+constexpr auto g_lane_count = size_t{4};
+
+auto load(const float* values) -> Lanes {
+	return _mm_loadu_ps(values);
+}
+// Each value in the high half of a 32-bit lane, shifted down with its sign.
+auto load_keys(const int16_t* values) -> Lanes {
+	auto packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(values));
+	return _mm_cvtepi32_ps(
+			_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+}
+void store(float* values, Lanes lanes) {
+	_mm_storeu_ps(values, lanes);
+}
+auto splat(float value) -> Lanes {
+	return _mm_set1_ps(value);
+}
+auto add(Lanes a, Lanes b) -> Lanes {
+	return _mm_add_ps(a, b);
+}
+auto subtract(Lanes a, Lanes b) -> Lanes {
+	return _mm_sub_ps(a, b);
+}
+auto multiply(Lanes a, Lanes b) -> Lanes {
+	return _mm_mul_ps(a, b);
+}
+auto inverse_sqrt(Lanes lanes) -> Lanes {
+	return _mm_div_ps(_mm_set1_ps(1.0F), _mm_sqrt_ps(lanes));
+}
+auto flip_negative(Lanes sign, Lanes lanes) -> Lanes {
+	return _mm_xor_ps(lanes, _mm_and_ps(sign, _mm_set1_ps(-0.0F)));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+using Lanes = float32x4_t;
+constexpr auto g_lane_count = size_t{4};
+
+auto load(const float* values) -> Lanes {
+	return vld1q_f32(values);
+}
+auto load_keys(const int16_t* values) -> Lanes {
+	return vcvtq_f32_s32(vmovl_s16(vld1_s16(values)));
+}
+void store(float* values, Lanes lanes) {
+	vst1q_f32(values, lanes);
+}
+auto splat(float value) -> Lanes {
+	return vdupq_n_f32(value);
+}
+auto add(Lanes a, Lanes b) -> Lanes {
+	return vaddq_f32(a, b);
+}
+auto subtract(Lanes a, Lanes b) -> Lanes {
+	return vsubq_f32(a, b);
+}
+auto multiply(Lanes a, Lanes b) -> Lanes {
+	return vmulq_f32(a, b);
+}
+auto inverse_sqrt(Lanes lanes) -> Lanes {
+	return vdivq_f32(vdupq_n_f32(1.0F), vsqrtq_f32(lanes));
+}
+auto flip_negative(Lanes sign, Lanes lanes) -> Lanes {
+	auto sign_bits =
+			vandq_u32(vreinterpretq_u32_f32(sign), vdupq_n_u32(0x80000000U));
+	return vreinterpretq_f32_u32(
+			veorq_u32(vreinterpretq_u32_f32(lanes), sign_bits));
+}
+#else
+using Lanes = float;
+constexpr auto g_lane_count = size_t{1};
+
+auto load(const float* values) -> Lanes {
+	return *values;
+}
+auto load_keys(const int16_t* values) -> Lanes {
+	return static_cast<float>(*values);
+}
+void store(float* values, Lanes lanes) {
+	*values = lanes;
+}
+auto splat(float value) -> Lanes {
+	return value;
+}
+auto add(Lanes a, Lanes b) -> Lanes {
+	return a + b;
+}
+auto subtract(Lanes a, Lanes b) -> Lanes {
+	return a - b;
+}
+auto multiply(Lanes a, Lanes b) -> Lanes {
+	return a * b;
+}
+auto inverse_sqrt(Lanes lanes) -> Lanes {
+	return 1.0F / std::sqrt(lanes);
+}
+auto flip_negative(Lanes sign, Lanes lanes) -> Lanes {
+	return std::signbit(sign) ? -lanes : lanes;
+}
+#endif
+
+static_assert(g_animation_lanes % g_lane_count == 0);
+
+// Lanes of joints, one register per channel. A plain array, std::array
+// would drop the vector types' alignment attributes.
+struct PoseLanes {
+	// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+	Lanes channels[g_pose_channels];
+
+	auto operator[](size_t channel) -> Lanes& {
+		return channels[channel];
+	}
+	auto operator[](size_t channel) const -> const Lanes& {
+		return channels[channel];
+	}
+};
+
+auto load_pose(const float* channels, size_t stride) -> PoseLanes {
+	auto pose = PoseLanes{};
+	for (auto c = size_t{}; c < g_pose_channels; c++) {
+		pose[c] = load(channels + c * stride);
+	}
+	return pose;
+}
+
+auto load_key(const int16_t* key, size_t stride, Lanes translation_scale)
+		-> PoseLanes {
+	auto pose = PoseLanes{};
+	auto rotation_scale = splat(1.0F / g_rotation_scale);
+	for (auto c = size_t{}; c < 4; c++) {
+		pose[c] = multiply(load_keys(key + c * stride), rotation_scale);
+	}
+	for (auto c = size_t{4}; c < g_pose_channels; c++) {
+		pose[c] = multiply(load_keys(key + c * stride), translation_scale);
+	}
+	return pose;
+}
+
+void store_pose(float* channels, size_t stride, const PoseLanes& pose) {
+	for (auto c = size_t{}; c < g_pose_channels; c++) {
+		store(channels + c * stride, pose[c]);
+	}
+}
+
+// Normalized lerp of the rotations along the shorter arc, lerp of the
+// translations. Both rotations need not be unit length, the result is.
+auto blend_lanes(const PoseLanes& a, const PoseLanes& b, Lanes weight)
+		-> PoseLanes {
+	auto dot = add(
+			add(multiply(a[0], b[0]), multiply(a[1], b[1])),
+			add(multiply(a[2], b[2]), multiply(a[3], b[3])));
+	auto pose = PoseLanes{};
+	for (auto c = size_t{}; c < 4; c++) {
+		auto to = flip_negative(dot, b[c]);
+		pose[c] = add(a[c], multiply(subtract(to, a[c]), weight));
+	}
+	auto length = add(
+			add(multiply(pose[0], pose[0]), multiply(pose[1], pose[1])),
+			add(multiply(pose[2], pose[2]), multiply(pose[3], pose[3])));
+	auto scale = inverse_sqrt(length);
+	for (auto c = size_t{}; c < 4; c++) {
+		pose[c] = multiply(pose[c], scale);
+	}
+	for (auto c = size_t{4}; c < g_pose_channels; c++) {
+		pose[c] = add(a[c], multiply(subtract(b[c], a[c]), weight));
+	}
+	return pose;
+}
+
+// The keys around seconds, at the first joint, and how far between them it
+// is.
+struct KeyPair {
+	const int16_t* from{};
+	const int16_t* to{};
+	float fraction{};
+};
+
+auto find_keys(const AnimationClip& clip, float seconds) -> KeyPair {
+	auto key_count = static_cast<float>(clip.key_count);
+	auto position = seconds / clip.duration * key_count;
+	position -= std::floor(position / key_count) * key_count;
+	auto from = std::min(static_cast<uint32_t>(position), clip.key_count - 1);
+	auto to = (from + 1) % clip.key_count;
+	auto key_size = g_pose_channels * clip.joint_stride;
+	return KeyPair{
+			.from = clip.keys.data() + from * key_size,
+			.to = clip.keys.data() + to * key_size,
+			.fraction = position - static_cast<float>(from)};
+}
+
+auto sample_lanes(
+		const AnimationClip& clip,
+		const KeyPair& keys,
+		size_t joint) -> PoseLanes {
+	auto translation_scale = splat(clip.translation_scale);
+	return blend_lanes(
+			load_key(keys.from + joint, clip.joint_stride, translation_scale),
+			load_key(keys.to + joint, clip.joint_stride, translation_scale),
+			splat(keys.fraction));
+}
+
+void check_joints(const AnimationClip& clip, const JointPoses& poses) {
+	if (clip.joint_count != poses.joint_count) {
+		fmt::print(
+				stderr,
+				"Animation joint mismatch: {} joints, expected {}\n",
+				clip.joint_count,
+				poses.joint_count);
+		std::terminate();
+	}
+}
+
+auto round_up_joints(uint32_t joint_count) -> uint32_t {
+	auto lanes = static_cast<uint32_t>(g_animation_lanes);
+	return (joint_count + lanes - 1) / lanes * lanes;
+}
+
+}  // namespace
+
+auto compress_clip(
+		uint32_t joint_count,
+		float duration,
+		std::span<const glm::quat> rotations,
+		std::span<const glm::vec3> translations) -> AnimationClip {
+	if (joint_count == 0 || rotations.empty() ||
+			rotations.size() % joint_count != 0 ||
+			translations.size() != rotations.size() || !(duration > 0.0F)) {
+		fmt::print(
+				stderr,
+				"Invalid animation clip: {} rotations and {} translations of {} "
+				"joints over {} s\n",
+				rotations.size(),
+				translations.size(),
+				joint_count,
+				duration);
+		std::terminate();
+	}
+	auto clip = AnimationClip{
+			.joint_count = joint_count,
+			.joint_stride = round_up_joints(joint_count),
+			.key_count = static_cast<uint32_t>(rotations.size() / joint_count),
+			.duration = duration,
+			.translation_scale = 0.0F,
+			.keys = {}};
+	auto largest = 1e-6F;
+	for (const auto& translation : translations) {
+		auto component = glm::abs(translation);
+		largest = std::max({largest, component.x, component.y, component.z});
+	}
+	clip.translation_scale = largest / g_rotation_scale;
+	auto key_size = g_pose_channels * clip.joint_stride;
+	clip.keys.resize(key_size * clip.key_count);
+	auto quantize = [](float value) {
+		return static_cast<int16_t>(std::lround(
+				std::clamp(value, -g_rotation_scale, g_rotation_scale)));
+	};
+	for (auto key = size_t{}; key < clip.key_count; key++) {
+		auto* channels = clip.keys.data() + key * key_size;
+		for (auto joint = size_t{}; joint < clip.joint_stride; joint++) {
+			auto rotation = glm::quat(1.0F, 0.0F, 0.0F, 0.0F);
+			auto translation = glm::vec3(0.0F);
+			if (joint < joint_count) {
+				rotation = glm::normalize(rotations[key * joint_count + joint]);
+				translation = translations[key * joint_count + joint];
+			}
+			auto values = std::array{
+					rotation.x * g_rotation_scale,
+					rotation.y * g_rotation_scale,
+					rotation.z * g_rotation_scale,
+					rotation.w * g_rotation_scale,
+					translation.x / clip.translation_scale,
+					translation.y / clip.translation_scale,
+					translation.z / clip.translation_scale};
+			for (auto c = size_t{}; c < g_pose_channels; c++) {
+				channels[c * clip.joint_stride + joint] = quantize(values.at(c));
+			}
+		}
+	}
+	return clip;
+}
+
+auto create_joint_poses(uint32_t joint_count) -> JointPoses {
+	auto poses = JointPoses{
+			.joint_count = joint_count,
+			.joint_stride = round_up_joints(joint_count),
+			.channels = {}};
+	poses.channels.resize(g_pose_channels * poses.joint_stride);
+	std::fill_n(
+			poses.channels.begin() + 3 * poses.joint_stride,
+			poses.joint_stride,
+			1.0F);
+	return poses;
+}
+
+void sample_clip(const AnimationClip& clip, float seconds, JointPoses& out) {
+	VKDEMO_ZONE("sample_clip");
+	check_joints(clip, out);
+	auto keys = find_keys(clip, seconds);
+	for (auto joint = size_t{}; joint < out.joint_stride; joint += g_lane_count) {
+		store_pose(
+				out.channels.data() + joint,
+				out.joint_stride,
+				sample_lanes(clip, keys, joint));
+	}
+}
+
+void sample_blend(const AnimationBlend& blend, JointPoses& out) {
+	check_joints(*blend.base, out);
+	check_joints(*blend.layer, out);
+	auto base_keys = find_keys(*blend.base, blend.base_seconds);
+	auto layer_keys = find_keys(*blend.layer, blend.layer_seconds);
+	auto weight = splat(std::clamp(blend.weight, 0.0F, 1.0F));
+	for (auto joint = size_t{}; joint < out.joint_stride; joint += g_lane_count) {
+		auto base = sample_lanes(*blend.base, base_keys, joint);
+		auto layer = sample_lanes(*blend.layer, layer_keys, joint);
+		store_pose(
+				out.channels.data() + joint,
+				out.joint_stride,
+				blend_lanes(base, layer, weight));
+	}
+}
+
+void blend_poses(
+		const JointPoses& a,
+		const JointPoses& b,
+		float weight,
+		JointPoses& out) {
+	auto weights = splat(weight);
+	for (auto joint = size_t{}; joint < out.joint_stride; joint += g_lane_count) {
+		store_pose(
+				out.channels.data() + joint,
+				out.joint_stride,
+				blend_lanes(
+						load_pose(a.channels.data() + joint, a.joint_stride),
+						load_pose(b.channels.data() + joint, b.joint_stride),
+						weights));
+	}
+}
+
+void sample_blends_parallel(
+		JobSystem& jobs,
+		std::span<const AnimationBlend> blends,
+		std::span<JointPoses> out) {
+	VKDEMO_ZONE("sample_blends_parallel");
+	parallel_for(
+			jobs,
+			blends.size(),
+			g_animation_grain,
+			[&](size_t begin, size_t end) {
+				for (auto i = begin; i < end; i++) {
+					sample_blend(blends[i], out[i]);
+				}
+			});
+}
+
+void pose_matrices(const JointPoses& poses, std::span<glm::mat4> out) {
+	const auto* channels = poses.channels.data();
+	auto stride = poses.joint_stride;
+	for (auto joint = size_t{}; joint < poses.joint_count; joint++) {
+		auto rotation = glm::quat(
+				channels[3 * stride + joint],
+				channels[joint],
+				channels[stride + joint],
+				channels[2 * stride + joint]);
+		auto& matrix = out[joint];
+		matrix = glm::mat4_cast(rotation);
+		matrix[3] = glm::vec4(
+				channels[4 * stride + joint],
+				channels[5 * stride + joint],
+				channels[6 * stride + joint],
+				1.0F);
+	}
+}
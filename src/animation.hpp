@@ -0,0 +1,92 @@
+#pragma once
+
+#include "jobs.hpp"
+
+#include <glm/ext/quaternion_float.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Joints per SIMD step at the widest. Clips and poses pad their joints to a
+// multiple of it, so the kernels never step over a partial group.
+constexpr auto g_animation_lanes = size_t{8};
+// Channels of a joint transform: rotation x, y, z, w then translation x, y,
+// z.
+constexpr auto g_pose_channels = size_t{7};
+// Characters per sampling job.
+constexpr auto g_animation_grain = size_t{16};
+
+// A looping clip of joint transforms keyed at a fixed rate, key k at
+// k * duration / key_count. Each channel of a key is a run of 16-bit values
+// across the joints, so one load fills a register with the channel of
+// g_animation_lanes joints without shuffles. Rotations are unit quaternions
+// scaled by 32767, translations are divided by translation_scale: 14 bytes a
+// joint a key rather than 28.
+struct AnimationClip {
+	uint32_t joint_count{};
+	// joint_count rounded up to g_animation_lanes. Padding joints hold the
+	// identity.
+	uint32_t joint_stride{};
+	uint32_t key_count{};
+	float duration{};
+	float translation_scale{};
+	// Channel c of key k starts at (k * g_pose_channels + c) * joint_stride.
+	std::vector<int16_t> keys;
+};
+
+// Sampled joint transforms, laid out like a single key of a clip in floats.
+struct JointPoses {
+	uint32_t joint_count{};
+	uint32_t joint_stride{};
+	// Channel c starts at c * joint_stride.
+	std::vector<float> channels;
+};
+
+// One character's animation: base sampled at base_seconds, blended towards
+// layer sampled at layer_seconds by weight. Both clips must have as many
+// joints as the poses they are sampled into.
+struct AnimationBlend {
+	const AnimationClip* base{};
+	const AnimationClip* layer{};
+	float base_seconds{};
+	float layer_seconds{};
+	float weight{};
+};
+
+// rotations and translations hold the keys one after the other, each with
+// joint_count joints. duration must be positive.
+auto compress_clip(
+		uint32_t joint_count,
+		float duration,
+		std::span<const glm::quat> rotations,
+		std::span<const glm::vec3> translations) -> AnimationClip;
+
+// Every joint at the identity.
+auto create_joint_poses(uint32_t joint_count) -> JointPoses;
+
+// Interpolates between the keys around seconds, wrapping around the clip,
+// with normalized lerps along the shorter arc. Uses AVX, SSE2 or NEON when
+// the build targets them.
+void sample_clip(const AnimationClip& clip, float seconds, JointPoses& out);
+// Samples both clips of blend and blends them in the same step, without
+// storing either pose.
+void sample_blend(const AnimationBlend& blend, JointPoses& out);
+// out = a blended towards b by weight. out may be a or b.
+void blend_poses(
+		const JointPoses& a,
+		const JointPoses& b,
+		float weight,
+		JointPoses& out);
+// Samples every blend into the poses of the same index, spread over the
+// job system. out must be as long as blends.
+void sample_blends_parallel(
+		JobSystem& jobs,
+		std::span<const AnimationBlend> blends,
+		std::span<JointPoses> out);
+
+// The joint transforms as matrices. out must have room for joint_count.
+void pose_matrices(const JointPoses& poses, std::span<glm::mat4> out);
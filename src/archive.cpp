@@ -0,0 +1,283 @@
+#include "archive.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+constexpr auto g_archive_magic =
+		std::array<char, 8>{'V', 'K', 'D', 'P', 'A', 'C', 'K', '\0'};
+constexpr auto g_archive_version = 1U;
+constexpr auto g_fnv_offset_basis = uint64_t{14695981039346656037U};
+constexpr auto g_fnv_prime = uint64_t{1099511628211U};
+
+auto fnv1a(std::span<const std::byte> bytes) -> uint64_t {
+	auto hash = g_fnv_offset_basis;
+	for (auto byte : bytes) {
+		hash = (hash ^ std::to_integer<uint64_t>(byte)) * g_fnv_prime;
+	}
+	return hash;
+}
+
+auto align_payload(uint64_t offset) -> uint64_t {
+	auto mask = uint64_t{g_archive_alignment} - 1;
+	return (offset + mask) & ~mask;
+}
+
+// Page aligned memory that unmap_file frees, as the file reader hands out.
+auto allocate_expanded(size_t size) -> std::byte* {
+#ifdef _WIN32
+	return static_cast<std::byte*>(
+			VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+	auto* memory = mmap(
+			nullptr,
+			size,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+	return memory == MAP_FAILED ? nullptr : static_cast<std::byte*>(memory);
+#endif
+}
+
+auto valid_entry(const ArchiveEntry& entry, uint64_t archive_size) -> bool {
+	if (entry.offset > archive_size ||
+			entry.stored_size > archive_size - entry.offset || entry.size == 0) {
+		return false;
+	}
+	switch (entry.codec) {
+		case PayloadCodec::none:
+			return entry.stored_size == entry.size;
+		case PayloadCodec::chunked_lz:
+			return entry.size <= std::numeric_limits<uint32_t>::max();
+	}
+	return false;
+}
+
+// Where an earlier entry with the same contents put its payload.
+struct StoredPayload {
+	uint64_t offset{};
+	uint64_t stored_size{};
+	PayloadCodec codec{};
+};
+
+}  // namespace
+
+auto archive_name_hash(const std::filesystem::path& path) -> uint64_t {
+	auto name = path.lexically_normal().generic_u8string();
+	return fnv1a(std::as_bytes(std::span(name)));
+}
+
+auto pack_archive(
+		const std::filesystem::path& directory,
+		const std::filesystem::path& path,
+		bool compress) -> bool {
+	auto error = std::error_code{};
+	// The archive may be written into the directory it packs.
+	auto output = std::filesystem::weakly_canonical(path, error);
+	auto paths = std::vector<std::filesystem::path>{};
+	auto it = std::filesystem::recursive_directory_iterator(directory, error);
+	for (; !error && it != std::filesystem::end(it); it.increment(error)) {
+		if (it->is_regular_file(error) && it->file_size(error) != 0 &&
+				std::filesystem::weakly_canonical(it->path(), error) != output) {
+			paths.emplace_back(it->path());
+		}
+	}
+	if (error) {
+		fmt::print(stderr, "Failed to list {}\n", directory.string());
+		return false;
+	}
+	// Sorted, so packing the same files gives the same archive.
+	std::ranges::sort(paths);
+
+	auto entries = std::vector<ArchiveEntry>{};
+	auto payloads = std::vector<std::byte>{};
+	auto stored = std::unordered_map<uint64_t, StoredPayload>{};
+	for (const auto& file_path : paths) {
+		auto file = map_file(file_path);
+		if (!file.has_value()) {
+			fmt::print(stderr, "Failed to map {}\n", file_path.string());
+			return false;
+		}
+		auto entry = ArchiveEntry{
+				.name_hash = archive_name_hash(
+						file_path.lexically_relative(directory)),
+				.content_hash = fnv1a(file->bytes),
+				.offset = 0,
+				.stored_size = 0,
+				.size = file->bytes.size(),
+				.codec = PayloadCodec::none,
+				.padding = 0};
+		auto same = stored.find(entry.content_hash);
+		if (same == stored.end()) {
+			auto payload = std::vector<std::byte>{};
+			if (compress &&
+					file->bytes.size() <= std::numeric_limits<uint32_t>::max()) {
+				payload = compress_payload(file->bytes);
+			}
+			auto compressed = !payload.empty() &&
+					payload.size() + payload.size() / 8 <= file->bytes.size();
+			auto bytes = compressed ? std::span<const std::byte>(payload)
+															: file->bytes;
+			auto offset = align_payload(payloads.size());
+			payloads.resize(offset + bytes.size());
+			std::memcpy(payloads.data() + offset, bytes.data(), bytes.size());
+			same = stored
+								 .emplace(
+										 entry.content_hash,
+										 StoredPayload{
+												 .offset = offset,
+												 .stored_size = bytes.size(),
+												 .codec = compressed ? PayloadCodec::chunked_lz
+																						 : PayloadCodec::none})
+								 .first;
+		}
+		entry.offset = same->second.offset;
+		entry.stored_size = same->second.stored_size;
+		entry.codec = same->second.codec;
+		entries.emplace_back(entry);
+		unmap_file(*file);
+	}
+
+	std::ranges::sort(entries, {}, &ArchiveEntry::name_hash);
+	for (auto i = size_t{1}; i < entries.size(); i++) {
+		if (entries[i].name_hash == entries[i - 1].name_hash) {
+			fmt::print(
+					stderr,
+					"Two files below {} have the same name hash\n",
+					directory.string());
+			return false;
+		}
+	}
+	auto payloads_offset = align_payload(
+			sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry));
+	for (auto& entry : entries) {
+		entry.offset += payloads_offset;
+	}
+	auto header = ArchiveHeader{
+			.magic = g_archive_magic,
+			.version = g_archive_version,
+			.padding = 0,
+			.entry_count = entries.size()};
+	auto bytes = std::vector<std::byte>(payloads_offset + payloads.size());
+	std::memcpy(bytes.data(), &header, sizeof(header));
+	std::memcpy(
+			bytes.data() + sizeof(header),
+			entries.data(),
+			entries.size() * sizeof(ArchiveEntry));
+	std::memcpy(
+			bytes.data() + payloads_offset,
+			payloads.data(),
+			payloads.size());
+
+	auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	file.write(reinterpret_cast<const char*>(bytes.data()),
+			static_cast<std::streamsize>(bytes.size()));
+	if (!file) {
+		fmt::print(stderr, "Failed to write archive {}\n", path.string());
+		return false;
+	}
+	return true;
+}
+
+auto open_archive(const std::filesystem::path& path) -> std::optional<Archive> {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		return std::nullopt;
+	}
+	auto header = ArchiveHeader{};
+	if (file->bytes.size() >= sizeof(header)) {
+		std::memcpy(&header, file->bytes.data(), sizeof(header));
+	}
+	auto index_capacity =
+			(file->bytes.size() - std::min(file->bytes.size(), sizeof(header))) /
+			sizeof(ArchiveEntry);
+	if (header.magic != g_archive_magic || header.version != g_archive_version ||
+			header.entry_count > index_capacity) {
+		unmap_file(*file);
+		return std::nullopt;
+	}
+	auto entries = std::span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<const ArchiveEntry*>(
+					file->bytes.subspan(sizeof(header)).data()),
+			header.entry_count);
+	auto sorted =
+			std::ranges::is_sorted(entries, std::less<>{}, &ArchiveEntry::name_hash);
+	auto valid = std::ranges::all_of(entries, [&file](const auto& entry) {
+		return valid_entry(entry, file->bytes.size());
+	});
+	if (!sorted || !valid) {
+		unmap_file(*file);
+		return std::nullopt;
+	}
+	return Archive{.file = *file, .entries = entries};
+}
+
+void close_archive(Archive& archive) {
+	unmap_file(archive.file);
+	archive = Archive{};
+}
+
+auto archive_file(const Archive& archive, const std::filesystem::path& path)
+		-> std::optional<MappedFile> {
+	auto hash = archive_name_hash(path);
+	auto entry = std::ranges::lower_bound(
+			archive.entries,
+			hash,
+			std::less<>{},
+			&ArchiveEntry::name_hash);
+	if (entry == archive.entries.end() || entry->name_hash != hash) {
+		return std::nullopt;
+	}
+	auto payload = archive.file.bytes.subspan(entry->offset, entry->stored_size);
+	if (entry->codec == PayloadCodec::none) {
+		return MappedFile{.bytes = payload, .borrowed = true};
+	}
+	auto* memory = allocate_expanded(entry->size);
+	if (memory == nullptr) {
+		return std::nullopt;
+	}
+	auto file = MappedFile{
+			.bytes = std::span<const std::byte>(memory, entry->size),
+			.borrowed = false};
+	if (!expand_payload(payload, std::span(memory, entry->size))) {
+		fmt::print(
+				stderr,
+				"Archived {} does not expand to its size\n",
+				path.string());
+		unmap_file(file);
+		return std::nullopt;
+	}
+	return file;
+}
+
+auto open_asset(const Archive* archive, const std::filesystem::path& path)
+		-> std::optional<MappedFile> {
+	if (archive != nullptr) {
+		auto file = archive_file(*archive, path);
+		if (file.has_value()) {
+			return file;
+		}
+	}
+	return map_file(path);
+}
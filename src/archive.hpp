@@ -0,0 +1,78 @@
+#pragma once
+
+#include "decompress.hpp"
+#include "mapped_file.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+// Payloads start at multiples of this, so the views archive_file hands out
+// keep the page alignment of mapped files.
+constexpr auto g_archive_alignment = size_t{4096};
+
+// The file starts with an ArchiveHeader, followed by the index, then the
+// payloads.
+struct ArchiveHeader {
+	std::array<char, 8> magic{};
+	uint32_t version{};
+	uint32_t padding{};
+	uint64_t entry_count{};
+};
+
+// Entries are sorted by name_hash and found by a binary search, so opening
+// an asset costs no system call and no string compare. Names themselves are
+// not stored, pack_archive refuses directories where two of them collide.
+struct ArchiveEntry {
+	// archive_name_hash of the path relative to the packed directory.
+	uint64_t name_hash{};
+	// FNV-1a of the expanded bytes. Entries with the same contents share a
+	// payload.
+	uint64_t content_hash{};
+	// Of the payload, from the start of the archive.
+	uint64_t offset{};
+	uint64_t stored_size{};
+	// Of the expanded bytes.
+	uint64_t size{};
+	PayloadCodec codec{};
+	uint32_t padding{};
+};
+
+// Asset files packed into one file that is mapped once at startup, so
+// loading does not open and stat every loose file, which is slow on network
+// mounts.
+struct Archive {
+	MappedFile file;
+	std::span<const ArchiveEntry> entries;
+};
+
+// FNV-1a of the lexically normal form of path with forward slashes, so one
+// name hashes the same on every platform.
+auto archive_name_hash(const std::filesystem::path& path) -> uint64_t;
+
+// Packs every non-empty regular file below directory into an archive at
+// path. With compress, entries that shrink by at least an eighth are stored
+// as chunked_lz.
+auto pack_archive(
+		const std::filesystem::path& directory,
+		const std::filesystem::path& path,
+		bool compress) -> bool;
+// Maps the archive at path and checks its index, nothing when it is not a
+// valid archive.
+auto open_archive(const std::filesystem::path& path) -> std::optional<Archive>;
+// No file of the archive may be in use.
+void close_archive(Archive& archive);
+
+// The file stored under path, relative to the directory that was packed, or
+// nothing when the archive has none. Stored entries are borrowed views into
+// the archive, compressed ones are expanded into memory of their own. Either
+// is released with unmap_file.
+auto archive_file(const Archive& archive, const std::filesystem::path& path)
+		-> std::optional<MappedFile>;
+// Looks path up in archive when there is one, and maps it from the disk
+// otherwise or when the archive does not have it.
+auto open_asset(const Archive* archive, const std::filesystem::path& path)
+		-> std::optional<MappedFile>;
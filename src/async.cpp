@@ -0,0 +1,117 @@
+#include "async.hpp"
+
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Touched per page while a file is read in, smaller than any page size.
+constexpr auto g_read_stride = size_t{4096};
+
+void resume_as_job(AsyncScheduler& scheduler, std::coroutine_handle<> handle) {
+	submit_background_job(*scheduler.jobs, scheduler.resuming, [handle] {
+		handle.resume();
+	});
+}
+
+}  // namespace
+
+void AsyncCondition::await_suspend(std::coroutine_handle<> handle) {
+	auto lock = std::scoped_lock(scheduler->mutex);
+	scheduler->waits.emplace_back(AsyncWait{
+			.ready = std::move(ready),
+			.handle = handle,
+			.on_poll = on_poll});
+}
+
+void AsyncFileRead::await_suspend(std::coroutine_handle<> handle) {
+	auto started = start_file_read(
+			*scheduler->files,
+			path,
+			[this, handle](std::optional<MappedFile> read) {
+				file = read;
+				resume_as_job(*scheduler, handle);
+			});
+	if (started) {
+		return;
+	}
+	submit_background_job(
+			*scheduler->jobs,
+			scheduler->resuming,
+			[this, handle] {
+				file = map_file(path);
+				if (file.has_value()) {
+					// Faults the pages in here rather than wherever the bytes are read.
+					[[maybe_unused]] auto volatile touched = std::byte{};
+					for (auto i = size_t{}; i < file->bytes.size();
+							 i += g_read_stride) {
+						touched = file->bytes[i];
+					}
+				}
+				handle.resume();
+			});
+}
+
+void AsyncJob::await_suspend(std::coroutine_handle<> handle) {
+	resume_as_job(*scheduler, handle);
+}
+
+auto create_async_scheduler(JobSystem& jobs, VkDevice device)
+		-> std::unique_ptr<AsyncScheduler> {
+	auto scheduler = std::make_unique<AsyncScheduler>();
+	scheduler->jobs = &jobs;
+	scheduler->device = device;
+	scheduler->files = create_file_reader();
+	return scheduler;
+}
+
+void destroy_async_scheduler(AsyncScheduler& scheduler) {
+	wait_for_async(scheduler);
+	destroy_file_reader(*scheduler.files);
+}
+
+void poll_async(AsyncScheduler& scheduler) {
+	poll_file_reads(*scheduler.files);
+	auto reached = std::vector<AsyncWait>{};
+	{
+		auto lock = std::scoped_lock(scheduler.mutex);
+		auto pending = std::vector<AsyncWait>{};
+		for (auto& wait : scheduler.waits) {
+			(wait.ready() ? reached : pending).emplace_back(std::move(wait));
+		}
+		scheduler.waits = std::move(pending);
+	}
+	// Resumed without the lock, they may suspend again right away.
+	for (auto& wait : reached) {
+		if (wait.on_poll) {
+			wait.handle.resume();
+		} else {
+			resume_as_job(scheduler, wait.handle);
+		}
+	}
+}
+
+void wait_for_async(AsyncScheduler& scheduler) {
+	while (scheduler.live.load(std::memory_order_acquire) != 0) {
+		poll_async(scheduler);
+		wait_for_counter(*scheduler.jobs, scheduler.resuming);
+		std::this_thread::yield();
+	}
+}
+
+auto read_file(AsyncScheduler& scheduler, const std::filesystem::path& path)
+		-> AsyncFileRead {
+	return AsyncFileRead{.scheduler = &scheduler, .path = path, .file = {}};
+}
+
+auto resume_on_jobs(AsyncScheduler& scheduler) -> AsyncJob {
+	return AsyncJob{.scheduler = &scheduler};
+}
+
+auto resume_on_poll(AsyncScheduler& scheduler) -> AsyncCondition {
+	return AsyncCondition{
+			.scheduler = &scheduler,
+			.ready = [] { return true; },
+			.on_poll = true};
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "file_io.hpp"
+#include "jobs.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Coroutines for loading code, so it reads top to bottom without holding a
+// thread while it waits. Files are read by the file reader, whose completions
+// poll_async picks up, or where it is not available, mapped on a job that
+// resumes the coroutine. Conditions are checked by poll_async too, which the
+// thread owning the uploader calls, thread 0 of the job system. Once reached
+// they resume the coroutine as a job. Code that touches the uploader first
+// moves onto that thread with resume_on_poll.
+struct AsyncWait {
+	// Checked on the polling thread.
+	std::function<bool()> ready;
+	std::coroutine_handle<> handle;
+	// Resumed right on the polling thread instead of as a job.
+	bool on_poll{};
+};
+
+struct AsyncScheduler {
+	JobSystem* jobs{};
+	VkDevice device{};
+	// The jobs that read files and resume coroutines.
+	JobCounter resuming;
+	std::unique_ptr<FileReader> files;
+	std::mutex mutex;
+	std::vector<AsyncWait> waits;
+	// Started tasks that did not return yet.
+	std::atomic<size_t> live{};
+};
+
+// A coroutine that starts right away and is not awaited. Its first parameter
+// must be the scheduler, which counts it until it returns, so
+// wait_for_async knows when it is done.
+struct AsyncTask {
+	struct promise_type {
+		AsyncScheduler* scheduler{};
+
+		template <typename... Args>
+		explicit promise_type(AsyncScheduler& scheduler, Args&... /*args*/)
+				: scheduler(&scheduler) {
+			scheduler.live.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		auto get_return_object() -> AsyncTask {
+			return {};
+		}
+		auto initial_suspend() -> std::suspend_never {
+			return {};
+		}
+		auto final_suspend() noexcept -> std::suspend_never {
+			scheduler->live.fetch_sub(1, std::memory_order_release);
+			return {};
+		}
+		void return_void() {}
+		void unhandled_exception() {
+			std::terminate();
+		}
+	};
+};
+
+// Suspends until ready holds, checked by poll_async.
+struct AsyncCondition {
+	AsyncScheduler* scheduler{};
+	std::function<bool()> ready;
+	bool on_poll{};
+
+	auto await_ready() -> bool {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle);
+	void await_resume() {}
+};
+
+// Reads a whole file before the coroutine resumes as a job, so it does not
+// fault on its pages later. Empty when the file cannot be read.
+struct AsyncFileRead {
+	AsyncScheduler* scheduler{};
+	std::filesystem::path path;
+	std::optional<MappedFile> file;
+
+	auto await_ready() -> bool {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle);
+	auto await_resume() -> std::optional<MappedFile> {
+		return file;
+	}
+};
+
+// Moves the coroutine onto a job.
+struct AsyncJob {
+	AsyncScheduler* scheduler{};
+
+	auto await_ready() -> bool {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle);
+	void await_resume() {}
+};
+
+auto create_async_scheduler(JobSystem& jobs, VkDevice device)
+		-> std::unique_ptr<AsyncScheduler>;
+// Waits for every task, on the polling thread.
+void destroy_async_scheduler(AsyncScheduler& scheduler);
+
+// Resumes the coroutines whose waits were reached.
+void poll_async(AsyncScheduler& scheduler);
+// Polls and runs jobs until every task returned.
+void wait_for_async(AsyncScheduler& scheduler);
+
+auto read_file(AsyncScheduler& scheduler, const std::filesystem::path& path)
+		-> AsyncFileRead;
+auto resume_on_jobs(AsyncScheduler& scheduler) -> AsyncJob;
+auto resume_on_poll(AsyncScheduler& scheduler) -> AsyncCondition;
@@ -0,0 +1,163 @@
+#include "attachments.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+auto create_transient_attachment(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		VkImageAspectFlags aspect,
+		uint32_t layers,
+		VkImageUsageFlags extra_usage) -> Attachment {
+	auto attachment = Attachment{};
+	attachment.format = format;
+	attachment.samples = samples;
+	attachment.extent = extent;
+	auto usage = extra_usage != 0
+			? extra_usage
+			: VkImageUsageFlags{VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT};
+	usage |= aspect == VK_IMAGE_ASPECT_COLOR_BIT
+			? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+			: VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = layers,
+			.samples = samples,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	attachment.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			extra_usage != 0 ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = attachment.image.handle,
+			.viewType =
+					layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D,
+			.format = format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = aspect,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = layers}};
+	if (vkCreateImageView(
+					device,
+					&view_info,
+					host_callbacks(),
+					&attachment.view) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create an attachment image view\n");
+		std::terminate();
+	}
+	return attachment;
+}
+
+void destroy_attachment(
+		VkDevice& device,
+		Allocator& allocator,
+		Attachment& attachment) {
+	vkDestroyImageView(device, attachment.view, host_callbacks());
+	destroy_image(device, allocator, attachment.image);
+	attachment = Attachment{};
+}
+
+auto select_sample_count(
+		const VkPhysicalDeviceLimits& limits,
+		uint32_t requested) -> VkSampleCountFlagBits {
+	constexpr auto candidates = std::array{
+			VK_SAMPLE_COUNT_8_BIT,
+			VK_SAMPLE_COUNT_4_BIT,
+			VK_SAMPLE_COUNT_2_BIT};
+	auto supported =
+			limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+	for (auto samples : candidates) {
+		if (samples <= requested && (supported & samples) != 0) {
+			return samples;
+		}
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+auto create_scene_attachments(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat color_format,
+		VkFormat depth_format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		uint32_t layers,
+		VkImageUsageFlags depth_usage) -> SceneAttachments {
+	auto attachments = SceneAttachments{};
+	attachments.samples = samples;
+	if (samples != VK_SAMPLE_COUNT_1_BIT) {
+		attachments.color = create_transient_attachment(
+				device,
+				allocator,
+				color_format,
+				extent,
+				samples,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				layers,
+				0);
+	}
+	attachments.depth = create_transient_attachment(
+			device,
+			allocator,
+			depth_format,
+			extent,
+			samples,
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			layers,
+			depth_usage);
+	return attachments;
+}
+
+void destroy_scene_attachments(
+		VkDevice& device,
+		Allocator& allocator,
+		SceneAttachments& attachments) {
+	destroy_attachment(device, allocator, attachments.color);
+	destroy_attachment(device, allocator, attachments.depth);
+	attachments = SceneAttachments{};
+}
+
+auto scene_framebuffer_views(
+		const SceneAttachments& attachments,
+		VkImageView target) -> std::vector<VkImageView> {
+	if (attachments.color.view == VK_NULL_HANDLE) {
+		return {target, attachments.depth.view};
+	}
+	return {attachments.color.view, attachments.depth.view, target};
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// An image that only lives within a render pass. It is never loaded or
+// stored, so tile-based GPUs keep it in tile memory and can back it with
+// lazily allocated memory that is never committed.
+struct Attachment {
+	VkFormat format{};
+	VkSampleCountFlagBits samples{};
+	VkExtent2D extent{};
+	Image image;
+	VkImageView view{};
+};
+
+// aspect picks color or depth attachment usage. Lazily allocated memory is
+// preferred where the device has it. With more than one layer the view is a
+// 2D array, one layer per view of multiview rendering. An attachment with
+// extra_usage is read outside its render pass, so it is neither transient
+// nor lazily allocated.
+auto create_transient_attachment(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		VkImageAspectFlags aspect,
+		uint32_t layers,
+		VkImageUsageFlags extra_usage) -> Attachment;
+// The device must be idle.
+void destroy_attachment(
+		VkDevice& device,
+		Allocator& allocator,
+		Attachment& attachment);
+
+// The highest sample count up to requested that both color and depth
+// framebuffer attachments support.
+auto select_sample_count(
+		const VkPhysicalDeviceLimits& limits,
+		uint32_t requested) -> VkSampleCountFlagBits;
+
+// What a scene pass renders to besides its color target, shared by every
+// target of a swap chain or offscreen set. With MSAA, color is drawn to a
+// multisampled attachment and resolved into the target at the end of the
+// pass. Without, color is null and the target is drawn to directly.
+struct SceneAttachments {
+	VkSampleCountFlagBits samples{};
+	Attachment color;
+	Attachment depth;
+};
+
+// depth_usage is the extra_usage of the depth attachment.
+auto create_scene_attachments(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat color_format,
+		VkFormat depth_format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		uint32_t layers,
+		VkImageUsageFlags depth_usage) -> SceneAttachments;
+// The device must be idle.
+void destroy_scene_attachments(
+		VkDevice& device,
+		Allocator& allocator,
+		SceneAttachments& attachments);
+
+// Framebuffer views in render pass attachment order: color, depth, then the
+// resolve target with MSAA.
+auto scene_framebuffer_views(
+		const SceneAttachments& attachments,
+		VkImageView target) -> std::vector<VkImageView>;
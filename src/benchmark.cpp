@@ -0,0 +1,193 @@
+#include "benchmark.hpp"
+
+#include "json.hpp"
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <numeric>
+#include <span>
+#include <sstream>
+
+namespace {
+
+constexpr auto g_histogram_bucket_ms = 0.5;
+
+auto elapsed_milliseconds(
+		std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end) -> double {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void write_summary(std::ostream& out, std::span<const double> samples) {
+	auto sorted = std::vector<double>(samples.begin(), samples.end());
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](size_t p) {
+		return sorted.at((sorted.size() - 1) * p / 100);
+	};
+	if (sorted.empty()) {
+		fmt::print(out, "{{\"samples\": 0}}");
+		return;
+	}
+	auto sum = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+	fmt::print(
+			out,
+			"{{\"samples\": {}, \"min_ms\": {:.4f}, \"avg_ms\": {:.4f}, "
+			"\"p50_ms\": {:.4f}, \"p90_ms\": {:.4f}, \"p99_ms\": {:.4f}, "
+			"\"max_ms\": {:.4f}}}",
+			sorted.size(),
+			sorted.front(),
+			sum / static_cast<double>(sorted.size()),
+			percentile(50),
+			percentile(90),
+			percentile(99),
+			sorted.back());
+}
+
+void write_histogram(std::ostream& out, std::span<const double> samples) {
+	auto counts = std::vector<size_t>{};
+	for (auto sample : samples) {
+		auto bucket = static_cast<size_t>(sample / g_histogram_bucket_ms);
+		if (bucket >= counts.size()) {
+			counts.resize(bucket + 1);
+		}
+		counts.at(bucket)++;
+	}
+	fmt::print(
+			out,
+			"{{\"bucket_ms\": {}, \"counts\": [{}]}}",
+			g_histogram_bucket_ms,
+			fmt::join(counts, ", "));
+}
+
+void write_report(
+		std::ostream& out,
+		const Benchmark& benchmark,
+		const GpuProfiler& profiler,
+		std::string_view device_name,
+		bool headless,
+		bool depth_prepass) {
+	fmt::print(out, "{{\n");
+	fmt::print(out, "  \"device\": {},\n", json_string(device_name));
+	fmt::print(out, "  \"headless\": {},\n", headless);
+	fmt::print(out, "  \"depth_prepass\": {},\n", depth_prepass);
+	fmt::print(out, "  \"frames\": {},\n", benchmark.frame_times.size());
+	fmt::print(out, "  \"startup_phases\": [");
+	for (auto i = size_t{}; i < benchmark.startup_phases.size(); i++) {
+		const auto& phase = benchmark.startup_phases.at(i);
+		fmt::print(
+				out,
+				"{}\n    {{\"name\": {}, \"ms\": {:.4f}}}",
+				i == 0 ? "" : ",",
+				json_string(phase.name),
+				phase.milliseconds);
+	}
+	fmt::print(out, "\n  ],\n");
+	fmt::print(out, "  \"frame_time\": ");
+	write_summary(out, benchmark.frame_times);
+	fmt::print(out, ",\n  \"frame_time_histogram\": ");
+	write_histogram(out, benchmark.frame_times);
+	fmt::print(out, ",\n  \"cpu_record_time\": ");
+	write_summary(out, benchmark.record_times);
+	fmt::print(out, ",\n  \"gpu_passes\": [");
+	for (auto i = size_t{}; i < profiler.passes.size(); i++) {
+		const auto& pass = profiler.passes.at(i);
+		fmt::print(
+				out,
+				"{}\n    {{\"name\": {}, \"time\": ",
+				i == 0 ? "" : ",",
+				json_string(pass.name));
+		write_summary(out, pass.history);
+		if (pass.performance_frames != 0) {
+			fmt::print(out, ", \"counters\": [");
+			for (auto c = size_t{}; c < profiler.performance_counters.size(); c++) {
+				const auto& counter = profiler.performance_counters.at(c);
+				fmt::print(
+						out,
+						"{}{{\"name\": {}, \"unit\": {}, \"avg\": {:.4f}}}",
+						c == 0 ? "" : ", ",
+						json_string(counter.name),
+						json_string(performance_counter_unit(counter)),
+						pass.performance_totals.at(c) /
+								static_cast<double>(pass.performance_frames));
+			}
+			fmt::print(out, "]");
+		}
+		fmt::print(out, "}}");
+	}
+	fmt::print(out, "\n  ]\n}}\n");
+}
+
+}  // namespace
+
+auto create_benchmark(
+		size_t frame_count,
+		const std::filesystem::path& report_path) -> Benchmark {
+	auto benchmark = Benchmark{};
+	benchmark.frame_count = frame_count;
+	benchmark.report_path = report_path;
+	benchmark.phase_start = std::chrono::steady_clock::now();
+	benchmark.frame_times.reserve(frame_count);
+	benchmark.record_times.reserve(frame_count);
+	return benchmark;
+}
+
+void end_startup_phase(Benchmark& benchmark, std::string_view name) {
+	auto now = std::chrono::steady_clock::now();
+	benchmark.startup_phases.emplace_back(StartupPhase{
+			.name = std::string(name),
+			.milliseconds = elapsed_milliseconds(benchmark.phase_start, now)});
+	benchmark.phase_start = now;
+}
+
+void end_benchmark_frame(Benchmark& benchmark, double record_milliseconds) {
+	auto now = std::chrono::steady_clock::now();
+	// The first frame has no predecessor; its cost is part of startup.
+	if (benchmark.last_frame_end.has_value()) {
+		benchmark.frame_times.emplace_back(
+				elapsed_milliseconds(*benchmark.last_frame_end, now));
+		benchmark.record_times.emplace_back(record_milliseconds);
+	}
+	benchmark.last_frame_end = now;
+}
+
+auto benchmark_finished(const Benchmark& benchmark) -> bool {
+	return benchmark.frame_times.size() >= benchmark.frame_count;
+}
+
+void write_benchmark_report(
+		const Benchmark& benchmark,
+		const GpuProfiler& profiler,
+		std::string_view device_name,
+		bool headless,
+		bool depth_prepass) {
+	if (benchmark.report_path.empty()) {
+		auto out = std::ostringstream{};
+		write_report(
+				out,
+				benchmark,
+				profiler,
+				device_name,
+				headless,
+				depth_prepass);
+		fmt::print("{}", out.str());
+		return;
+	}
+	auto file = std::ofstream(benchmark.report_path, std::ios::trunc);
+	if (!file) {
+		fmt::print(stderr, "Failed to open {}\n", benchmark.report_path.string());
+		std::terminate();
+	}
+	write_report(
+			file,
+			benchmark,
+			profiler,
+			device_name,
+			headless,
+			depth_prepass);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "profiler.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct StartupPhase {
+	std::string name;
+	double milliseconds{};
+};
+
+// Collects the timings of a fixed length run for a machine-readable report.
+struct Benchmark {
+	size_t frame_count{};
+	std::filesystem::path report_path;
+	std::chrono::steady_clock::time_point phase_start;
+	std::vector<StartupPhase> startup_phases;
+	std::optional<std::chrono::steady_clock::time_point> last_frame_end;
+	std::vector<double> frame_times;
+	std::vector<double> record_times;
+};
+
+// Startup phases are measured from this call. An empty report_path writes the
+// report to stdout.
+auto create_benchmark(
+		size_t frame_count,
+		const std::filesystem::path& report_path) -> Benchmark;
+
+// Records the time since the previous phase ended under name.
+void end_startup_phase(Benchmark& benchmark, std::string_view name);
+
+// Frame times are measured between consecutive calls.
+void end_benchmark_frame(Benchmark& benchmark, double record_milliseconds);
+auto benchmark_finished(const Benchmark& benchmark) -> bool;
+
+// The profiler must have been flushed so every frame's GPU times are in.
+// depth_prepass is whether the pre-pass was on at the end, which the D key
+// may have toggled since startup.
+void write_benchmark_report(
+		const Benchmark& benchmark,
+		const GpuProfiler& profiler,
+		std::string_view device_name,
+		bool headless,
+		bool depth_prepass);
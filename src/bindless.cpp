@@ -0,0 +1,376 @@
+#include "bindless.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+auto create_array(
+		VkDescriptorType type,
+		uint32_t binding,
+		uint32_t capacity) -> BindlessArray {
+	auto array = BindlessArray{};
+	array.type = type;
+	array.binding = binding;
+	array.capacity = capacity;
+	return array;
+}
+
+// A quarter of the per stage resources each leaves room for attachments and
+// everything else a stage binds.
+auto legacy_capacity(
+		uint32_t capacity,
+		uint32_t per_stage_limit,
+		uint32_t set_limit,
+		const VkPhysicalDeviceLimits& limits) -> uint32_t {
+	return std::max(
+			std::min({
+					capacity,
+					per_stage_limit,
+					set_limit,
+					limits.maxPerStageResources / 4}),
+			1U);
+}
+
+auto acquire_slot(BindlessArray& array) -> BindlessHandle {
+	if (!array.free.empty()) {
+		auto handle = array.free.back();
+		array.free.pop_back();
+		return handle;
+	}
+	if (array.next == array.capacity) {
+		fmt::print(
+				stderr,
+				"Bindless array {} is full at {} descriptors\n",
+				array.binding,
+				array.capacity);
+		std::terminate();
+	}
+	return array.next++;
+}
+
+// Writes slots first to first + count - 1 with the same descriptor.
+void write_slots(
+		VkDevice& device,
+		const BindlessTable& table,
+		const BindlessArray& array,
+		BindlessHandle first,
+		uint32_t count,
+		const VkDescriptorImageInfo& image_info,
+		const VkDescriptorBufferInfo& buffer_info) {
+	auto is_buffer = array.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	auto image_infos = std::vector<VkDescriptorImageInfo>{};
+	auto buffer_infos = std::vector<VkDescriptorBufferInfo>{};
+	if (is_buffer) {
+		buffer_infos.assign(count, buffer_info);
+	} else {
+		image_infos.assign(count, image_info);
+	}
+	auto write = VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.pNext = VK_NULL_HANDLE,
+			.dstSet = table.descriptor_set,
+			.dstBinding = array.binding,
+			.dstArrayElement = first,
+			.descriptorCount = count,
+			.descriptorType = array.type,
+			.pImageInfo = is_buffer ? VK_NULL_HANDLE : image_infos.data(),
+			.pBufferInfo = is_buffer ? buffer_infos.data() : VK_NULL_HANDLE,
+			.pTexelBufferView = VK_NULL_HANDLE};
+	vkUpdateDescriptorSets(device, 1, &write, 0, VK_NULL_HANDLE);
+}
+
+auto add_descriptor(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessArray& array,
+		const VkDescriptorImageInfo& image_info,
+		const VkDescriptorBufferInfo& buffer_info) -> BindlessHandle {
+	auto first = array.next == 0;
+	auto handle = acquire_slot(array);
+	if (first) {
+		array.fallback_image = image_info;
+		array.fallback_buffer = buffer_info;
+		if (!table.descriptor_indexing) {
+			write_slots(
+					device,
+					table,
+					array,
+					0,
+					array.capacity,
+					image_info,
+					buffer_info);
+			return handle;
+		}
+	}
+	write_slots(device, table, array, handle, 1, image_info, buffer_info);
+	return handle;
+}
+
+void remove_descriptor(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessArray& array,
+		BindlessHandle handle) {
+	// A stale descriptor would make the whole array invalid.
+	if (!table.descriptor_indexing) {
+		write_slots(
+				device,
+				table,
+				array,
+				handle,
+				1,
+				array.fallback_image,
+				array.fallback_buffer);
+	}
+	array.free.emplace_back(handle);
+}
+
+}  // namespace
+
+auto create_bindless_table(
+		VkDevice& device,
+		const VkPhysicalDeviceLimits& limits,
+		bool descriptor_indexing,
+		bool scene) -> BindlessTable {
+	auto table = BindlessTable{};
+	table.descriptor_indexing = descriptor_indexing;
+	table.scene = scene;
+	table.images = create_array(
+			VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+			g_bindless_image_binding,
+			g_bindless_image_capacity);
+	table.buffers = create_array(
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			g_bindless_buffer_binding,
+			g_bindless_buffer_capacity);
+	table.samplers = create_array(
+			VK_DESCRIPTOR_TYPE_SAMPLER,
+			g_bindless_sampler_binding,
+			g_bindless_sampler_capacity);
+	if (!descriptor_indexing) {
+		table.images.capacity = legacy_capacity(
+				table.images.capacity,
+				limits.maxPerStageDescriptorSampledImages,
+				limits.maxDescriptorSetSampledImages,
+				limits);
+		table.buffers.capacity = legacy_capacity(
+				table.buffers.capacity,
+				limits.maxPerStageDescriptorStorageBuffers,
+				limits.maxDescriptorSetStorageBuffers,
+				limits);
+		table.samplers.capacity = legacy_capacity(
+				table.samplers.capacity,
+				limits.maxPerStageDescriptorSamplers,
+				limits.maxDescriptorSetSamplers,
+				limits);
+	}
+
+	auto arrays = std::array{&table.images, &table.buffers, &table.samplers};
+	auto bindings = std::vector<VkDescriptorSetLayoutBinding>{};
+	auto pool_sizes = std::vector<VkDescriptorPoolSize>{};
+	for (const auto* array : arrays) {
+		bindings.emplace_back(VkDescriptorSetLayoutBinding{
+				.binding = array->binding,
+				.descriptorType = array->type,
+				.descriptorCount = array->capacity,
+				.stageFlags = VK_SHADER_STAGE_ALL,
+				.pImmutableSamplers = VK_NULL_HANDLE});
+		pool_sizes.emplace_back(VkDescriptorPoolSize{
+				.type = array->type,
+				.descriptorCount = array->capacity});
+	}
+	auto binding_flags = std::vector<VkDescriptorBindingFlags>(
+			arrays.size(),
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+					VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+					VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+	// Updating acceleration structures after bind is a feature of its own.
+	if (scene) {
+		bindings.emplace_back(VkDescriptorSetLayoutBinding{
+				.binding = g_bindless_scene_binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_ALL,
+				.pImmutableSamplers = VK_NULL_HANDLE});
+		pool_sizes.emplace_back(VkDescriptorPoolSize{
+				.type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+				.descriptorCount = 1});
+		binding_flags.emplace_back(0);
+	}
+	auto binding_flags_info = VkDescriptorSetLayoutBindingFlagsCreateInfo{
+			.sType =
+					VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.bindingCount = static_cast<uint32_t>(binding_flags.size()),
+			.pBindingFlags = binding_flags.data()};
+	auto layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = descriptor_indexing ? &binding_flags_info : VK_NULL_HANDLE,
+			.flags = descriptor_indexing
+					? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT
+					: 0U,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&table.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create bindless descriptor set layout\n");
+		std::terminate();
+	}
+
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_indexing
+					? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT
+					: 0U,
+			.maxSets = 1,
+			.poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data()};
+	if (vkCreateDescriptorPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&table.descriptor_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create bindless descriptor pool\n");
+		std::terminate();
+	}
+	auto allocate_info = VkDescriptorSetAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = table.descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &table.set_layout};
+	if (vkAllocateDescriptorSets(
+					device,
+					&allocate_info,
+					&table.descriptor_set) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate bindless descriptor set\n");
+		std::terminate();
+	}
+	return table;
+}
+
+void destroy_bindless_table(VkDevice& device, BindlessTable& table) {
+	vkDestroyDescriptorPool(device, table.descriptor_pool, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, table.set_layout, host_callbacks());
+	table = BindlessTable{};
+}
+
+auto add_bindless_image(
+		VkDevice& device,
+		BindlessTable& table,
+		VkImageView view,
+		VkImageLayout layout) -> BindlessHandle {
+	return add_descriptor(
+			device,
+			table,
+			table.images,
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = view,
+					.imageLayout = layout},
+			VkDescriptorBufferInfo{});
+}
+
+auto add_bindless_buffer(
+		VkDevice& device,
+		BindlessTable& table,
+		VkBuffer buffer,
+		VkDeviceSize offset,
+		VkDeviceSize range) -> BindlessHandle {
+	return add_descriptor(
+			device,
+			table,
+			table.buffers,
+			VkDescriptorImageInfo{},
+			VkDescriptorBufferInfo{
+					.buffer = buffer,
+					.offset = offset,
+					.range = range});
+}
+
+auto add_bindless_sampler(
+		VkDevice& device,
+		BindlessTable& table,
+		VkSampler sampler) -> BindlessHandle {
+	return add_descriptor(
+			device,
+			table,
+			table.samplers,
+			VkDescriptorImageInfo{
+					.sampler = sampler,
+					.imageView = VK_NULL_HANDLE,
+					.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+			VkDescriptorBufferInfo{});
+}
+
+void remove_bindless_image(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle) {
+	remove_descriptor(device, table, table.images, handle);
+}
+
+void remove_bindless_buffer(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle) {
+	remove_descriptor(device, table, table.buffers, handle);
+}
+
+void remove_bindless_sampler(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle) {
+	remove_descriptor(device, table, table.samplers, handle);
+}
+
+void set_bindless_scene(
+		VkDevice& device,
+		BindlessTable& table,
+		VkAccelerationStructureKHR scene) {
+	auto scene_info = VkWriteDescriptorSetAccelerationStructureKHR{
+			.sType =
+					VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.accelerationStructureCount = 1,
+			.pAccelerationStructures = &scene};
+	auto write = VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.pNext = &scene_info,
+			.dstSet = table.descriptor_set,
+			.dstBinding = g_bindless_scene_binding,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+			.pImageInfo = VK_NULL_HANDLE,
+			.pBufferInfo = VK_NULL_HANDLE,
+			.pTexelBufferView = VK_NULL_HANDLE};
+	vkUpdateDescriptorSets(device, 1, &write, 0, VK_NULL_HANDLE);
+}
+
+void bind_bindless_table(
+		VkCommandBuffer command_buffer,
+		VkPipelineBindPoint bind_point,
+		VkPipelineLayout layout,
+		const BindlessTable& table) {
+	vkCmdBindDescriptorSets(
+			command_buffer,
+			bind_point,
+			layout,
+			0,
+			1,
+			&table.descriptor_set,
+			0,
+			VK_NULL_HANDLE);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Index of a descriptor in one of the bindless arrays. Shaders receive them
+// through push constants.
+using BindlessHandle = uint32_t;
+
+constexpr auto g_bindless_image_binding = 0U;
+constexpr auto g_bindless_buffer_binding = 1U;
+constexpr auto g_bindless_sampler_binding = 2U;
+// A single top level acceleration structure for ray queries, see
+// ray_tracing.hpp.
+constexpr auto g_bindless_scene_binding = 3U;
+
+// Array sizes with descriptor indexing, well below the 500000 update after
+// bind descriptors every implementation of the feature allows per stage.
+constexpr auto g_bindless_image_capacity = 16384U;
+constexpr auto g_bindless_buffer_capacity = 16384U;
+constexpr auto g_bindless_sampler_capacity = 1024U;
+
+struct BindlessArray {
+	VkDescriptorType type{};
+	uint32_t binding{};
+	uint32_t capacity{};
+	// Slots from next on have never been handed out.
+	uint32_t next{};
+	std::vector<BindlessHandle> free;
+	// The first descriptor added, which fills unused slots without descriptor
+	// indexing.
+	VkDescriptorImageInfo fallback_image{};
+	VkDescriptorBufferInfo fallback_buffer{};
+};
+
+// A single descriptor set holding every sampled image, storage buffer and
+// sampler, bound once per command buffer. Draws select their resources with
+// handles instead of binding sets of their own, so nothing is allocated or
+// bound per draw.
+//
+// With descriptor indexing the arrays are partially bound and updated after
+// bind, so descriptors can be added while frames are in flight. Without it,
+// every slot of an array the shaders use has to be valid: the first
+// descriptor added to an array is written to all of its slots and must stay
+// alive as long as the table, and adding or removing descriptors is only
+// allowed while no command buffer the set is bound in is recording or
+// executing.
+struct BindlessTable {
+	bool descriptor_indexing{};
+	VkDescriptorSetLayout set_layout{};
+	VkDescriptorPool descriptor_pool{};
+	VkDescriptorSet descriptor_set{};
+	BindlessArray images;
+	BindlessArray buffers;
+	BindlessArray samplers;
+	// The table has g_bindless_scene_binding. It is not updated after bind,
+	// the scene is set once before anything is drawn.
+	bool scene{};
+};
+
+// Without descriptor indexing the arrays are shrunk to fit the per stage
+// limits. Shaders size their arrays with specialization constants 0, 1 and
+// 2, set to the image, buffer and sampler capacities. scene adds the
+// acceleration structure binding, which needs the ray query capability.
+auto create_bindless_table(
+		VkDevice& device,
+		const VkPhysicalDeviceLimits& limits,
+		bool descriptor_indexing,
+		bool scene) -> BindlessTable;
+// The device must be idle.
+void destroy_bindless_table(VkDevice& device, BindlessTable& table);
+
+// The resources must stay alive while shaders can reach them.
+auto add_bindless_image(
+		VkDevice& device,
+		BindlessTable& table,
+		VkImageView view,
+		VkImageLayout layout) -> BindlessHandle;
+auto add_bindless_buffer(
+		VkDevice& device,
+		BindlessTable& table,
+		VkBuffer buffer,
+		VkDeviceSize offset,
+		VkDeviceSize range) -> BindlessHandle;
+auto add_bindless_sampler(
+		VkDevice& device,
+		BindlessTable& table,
+		VkSampler sampler) -> BindlessHandle;
+
+// Hands the slot out again. No submitted work may still use it.
+void remove_bindless_image(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle);
+void remove_bindless_buffer(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle);
+void remove_bindless_sampler(
+		VkDevice& device,
+		BindlessTable& table,
+		BindlessHandle handle);
+
+// Points g_bindless_scene_binding at scene. Only allowed while no command
+// buffer the set is bound in is recording or executing, and before the first
+// draw whose shaders read it.
+void set_bindless_scene(
+		VkDevice& device,
+		BindlessTable& table,
+		VkAccelerationStructureKHR scene);
+
+// Binds the table as set 0 of layout.
+void bind_bindless_table(
+		VkCommandBuffer command_buffer,
+		VkPipelineBindPoint bind_point,
+		VkPipelineLayout layout,
+		const BindlessTable& table);
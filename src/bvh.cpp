@@ -0,0 +1,384 @@
+#include "bvh.hpp"
+
+#include "instrument.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// Deep enough for any tree split at the median.
+constexpr auto g_bvh_stack_size = size_t{64};
+
+struct BvhStack {
+	std::array<uint32_t, g_bvh_stack_size> nodes{};
+	size_t size{};
+};
+
+void push(BvhStack& stack, uint32_t node) {
+	stack.nodes.at(stack.size++) = node;
+}
+
+auto pop(BvhStack& stack) -> uint32_t {
+	return stack.nodes.at(--stack.size);
+}
+
+auto sphere_center(const BoundingSpheres& spheres, uint32_t idx) -> glm::vec3 {
+	return {spheres.x[idx], spheres.y[idx], spheres.z[idx]};
+}
+
+void fit_leaf(Bvh& bvh, const BoundingSpheres& spheres, BvhNode& node) {
+	node.min = glm::vec3(std::numeric_limits<float>::max());
+	node.max = glm::vec3(std::numeric_limits<float>::lowest());
+	for (auto i = node.first; i < node.first + node.count; i++) {
+		auto object = bvh.objects[i];
+		auto center = sphere_center(spheres, object);
+		auto radius = glm::vec3(spheres.radius[object]);
+		node.min = glm::min(node.min, center - radius);
+		node.max = glm::max(node.max, center + radius);
+	}
+}
+
+void fit_interior(Bvh& bvh, BvhNode& node) {
+	const auto& left = bvh.nodes[node.children];
+	const auto& right = bvh.nodes[node.children + 1];
+	node.min = glm::min(left.min, right.min);
+	node.max = glm::max(left.max, right.max);
+}
+
+auto surface_area(const BvhNode& node) -> float {
+	auto extent = glm::max(node.max - node.min, glm::vec3(0.0F));
+	return 2.0F *
+			(extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void build_node(
+		Bvh& bvh,
+		const BoundingSpheres& spheres,
+		uint32_t node_idx) {
+	auto& node = bvh.nodes[node_idx];
+	fit_leaf(bvh, spheres, node);
+	if (node.count <= g_bvh_leaf_size) {
+		for (auto i = node.first; i < node.first + node.count; i++) {
+			bvh.object_leaves[bvh.objects[i]] = node_idx;
+		}
+		return;
+	}
+
+	auto centers_min = glm::vec3(std::numeric_limits<float>::max());
+	auto centers_max = glm::vec3(std::numeric_limits<float>::lowest());
+	for (auto i = node.first; i < node.first + node.count; i++) {
+		auto center = sphere_center(spheres, bvh.objects[i]);
+		centers_min = glm::min(centers_min, center);
+		centers_max = glm::max(centers_max, center);
+	}
+	auto extent = centers_max - centers_min;
+	const auto* coordinates = &spheres.z;
+	if (extent.x >= extent.y && extent.x >= extent.z) {
+		coordinates = &spheres.x;
+	} else if (extent.y >= extent.z) {
+		coordinates = &spheres.y;
+	}
+	auto first = node.first;
+	auto count = node.count;
+	auto begin = bvh.objects.begin() + first;
+	std::nth_element(
+			begin,
+			begin + count / 2,
+			begin + count,
+			[&](uint32_t left, uint32_t right) {
+				return (*coordinates)[left] < (*coordinates)[right];
+			});
+
+	auto children = static_cast<uint32_t>(bvh.nodes.size());
+	node.children = children;
+	// node is not used past here, adding the children may move it.
+	bvh.nodes.emplace_back(BvhNode{
+			.min = {},
+			.children = 0,
+			.max = {},
+			.first = first,
+			.count = count / 2});
+	bvh.nodes.emplace_back(BvhNode{
+			.min = {},
+			.children = 0,
+			.max = {},
+			.first = first + count / 2,
+			.count = count - count / 2});
+	bvh.parents.emplace_back(node_idx);
+	bvh.parents.emplace_back(node_idx);
+	build_node(bvh, spheres, children);
+	build_node(bvh, spheres, children + 1);
+}
+
+// -1 when the box is outside the frustum, 1 when inside and 0 when it
+// straddles a plane.
+auto classify(const Frustum& frustum, const BvhNode& node) -> int {
+	auto center = 0.5F * (node.min + node.max);
+	auto extent = 0.5F * (node.max - node.min);
+	auto result = 1;
+	for (const auto& plane : frustum.planes) {
+		auto normal = glm::vec3(plane);
+		auto distance = glm::dot(normal, center) + plane.w;
+		auto radius = glm::dot(glm::abs(normal), extent);
+		if (distance < -radius) {
+			return -1;
+		}
+		if (distance < radius) {
+			result = 0;
+		}
+	}
+	return result;
+}
+
+auto sphere_visible(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		uint32_t idx) -> bool {
+	auto center = sphere_center(spheres, idx);
+	return std::ranges::all_of(frustum.planes, [&](const glm::vec4& plane) {
+		return glm::dot(glm::vec3(plane), center) + plane.w >=
+				-spheres.radius[idx];
+	});
+}
+
+// Entry distance of the ray into the box, or nothing when it misses.
+auto ray_box(const BvhNode& node, glm::vec3 origin, glm::vec3 inverse)
+		-> std::optional<float> {
+	auto near = (node.min - origin) * inverse;
+	auto far = (node.max - origin) * inverse;
+	auto entry = glm::min(near, far);
+	auto exit = glm::max(near, far);
+	auto enter = std::max({entry.x, entry.y, entry.z, 0.0F});
+	auto leave = std::min({exit.x, exit.y, exit.z});
+	if (enter > leave) {
+		return std::nullopt;
+	}
+	return enter;
+}
+
+auto ray_sphere(
+		const BoundingSpheres& spheres,
+		uint32_t idx,
+		glm::vec3 origin,
+		glm::vec3 direction) -> std::optional<float> {
+	auto offset = origin - sphere_center(spheres, idx);
+	auto radius = spheres.radius[idx];
+	auto a = glm::dot(direction, direction);
+	auto b = glm::dot(offset, direction);
+	auto c = glm::dot(offset, offset) - radius * radius;
+	if (c <= 0.0F) {
+		return 0.0F;
+	}
+	auto discriminant = b * b - a * c;
+	if (discriminant < 0.0F || b > 0.0F) {
+		return std::nullopt;
+	}
+	return (-b - std::sqrt(discriminant)) / a;
+}
+
+}  // namespace
+
+auto build_bvh(const BoundingSpheres& spheres) -> Bvh {
+	auto count = static_cast<uint32_t>(spheres.x.size());
+	auto bvh = Bvh{};
+	bvh.objects.resize(count);
+	for (auto i = 0U; i < count; i++) {
+		bvh.objects[i] = i;
+	}
+	bvh.object_leaves.resize(count);
+	// Leaves hold at least half of g_bvh_leaf_size objects.
+	bvh.nodes.reserve(4 * (count / g_bvh_leaf_size) + 1);
+	bvh.nodes.emplace_back(BvhNode{
+			.min = {},
+			.children = 0,
+			.max = {},
+			.first = 0,
+			.count = count});
+	bvh.parents.emplace_back(g_bvh_no_node);
+	build_node(bvh, spheres, 0);
+	bvh.build_cost = bvh_cost(bvh);
+	return bvh;
+}
+
+void refit_bvh(Bvh& bvh, const BoundingSpheres& spheres) {
+	for (auto i = bvh.nodes.size(); i-- > 0;) {
+		auto& node = bvh.nodes[i];
+		if (node.children == 0) {
+			fit_leaf(bvh, spheres, node);
+		} else {
+			fit_interior(bvh, node);
+		}
+	}
+}
+
+void refit_bvh(
+		Bvh& bvh,
+		const BoundingSpheres& spheres,
+		std::span<const uint32_t> moved) {
+	for (auto object : moved) {
+		auto leaf = bvh.object_leaves.at(object);
+		fit_leaf(bvh, spheres, bvh.nodes[leaf]);
+		for (auto parent = bvh.parents[leaf]; parent != g_bvh_no_node;
+				 parent = bvh.parents[parent]) {
+			auto& node = bvh.nodes[parent];
+			auto min = node.min;
+			auto max = node.max;
+			fit_interior(bvh, node);
+			if (node.min == min && node.max == max) {
+				break;
+			}
+		}
+	}
+}
+
+auto bvh_cost(const Bvh& bvh) -> float {
+	auto root_area = surface_area(bvh.nodes.front());
+	if (root_area <= 0.0F) {
+		return 0.0F;
+	}
+	// A query reaching a node pays one box test for interior nodes and one
+	// sphere test per object for leaves, and reaches it with a probability
+	// proportional to its area.
+	auto cost = 0.0F;
+	for (const auto& node : bvh.nodes) {
+		auto tests = node.children == 0 ? static_cast<float>(node.count) : 1.0F;
+		cost += surface_area(node) * tests;
+	}
+	return cost / root_area;
+}
+
+auto create_dynamic_bvh() -> std::unique_ptr<DynamicBvh> {
+	return std::make_unique<DynamicBvh>();
+}
+
+void destroy_dynamic_bvh(JobSystem& jobs, DynamicBvh& bvh) {
+	wait_for_counter(jobs, bvh.rebuild_counter);
+	bvh.tree = Bvh{};
+	bvh.rebuilt = Bvh{};
+	bvh.rebuild_spheres = BoundingSpheres{};
+	bvh.rebuilding = false;
+}
+
+void update_dynamic_bvh(
+		JobSystem& jobs,
+		DynamicBvh& bvh,
+		const BoundingSpheres& spheres,
+		std::span<const uint32_t> moved) {
+	if (bvh.rebuilding && bvh.rebuild_counter.pending == 0) {
+		bvh.rebuilding = false;
+		// Objects kept moving while it was built.
+		if (bvh.rebuilt.objects.size() == spheres.x.size()) {
+			bvh.tree = std::move(bvh.rebuilt);
+			refit_bvh(bvh.tree, spheres);
+			bvh.refits = 0;
+		}
+		bvh.rebuilt = Bvh{};
+	}
+	if (bvh.tree.nodes.empty() || bvh.tree.objects.size() != spheres.x.size()) {
+		bvh.tree = build_bvh(spheres);
+		bvh.refits = 0;
+		return;
+	}
+	if (moved.empty()) {
+		return;
+	}
+	refit_bvh(bvh.tree, spheres, moved);
+	bvh.refits++;
+	if (bvh.rebuilding || bvh.refits % g_bvh_check_interval != 0 ||
+			bvh_cost(bvh.tree) <= g_bvh_rebuild_ratio * bvh.tree.build_cost) {
+		return;
+	}
+	bvh.rebuild_spheres = spheres;
+	bvh.rebuilding = true;
+	submit_job(jobs, bvh.rebuild_counter, [&bvh] {
+		bvh.rebuilt = build_bvh(bvh.rebuild_spheres);
+	});
+}
+
+void find_moved_spheres(
+		const BoundingSpheres& before,
+		const BoundingSpheres& after,
+		std::vector<uint32_t>& moved) {
+	moved.clear();
+	if (before.x.size() != after.x.size()) {
+		return;
+	}
+	for (auto i = size_t{}; i < after.x.size(); i++) {
+		if (before.x[i] != after.x[i] || before.y[i] != after.y[i] ||
+				before.z[i] != after.z[i] || before.radius[i] != after.radius[i]) {
+			moved.emplace_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void cull_bvh(
+		const Bvh& bvh,
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		std::span<uint8_t> visible) {
+	VKDEMO_ZONE("cull_bvh");
+	std::ranges::fill(visible.first(spheres.x.size()), uint8_t{0});
+	if (bvh.objects.empty()) {
+		return;
+	}
+	auto stack = BvhStack{};
+	push(stack, 0);
+	while (stack.size != 0) {
+		const auto& node = bvh.nodes[pop(stack)];
+		auto side = classify(frustum, node);
+		if (side < 0) {
+			continue;
+		}
+		if (side > 0 || node.children == 0) {
+			for (auto i = node.first; i < node.first + node.count; i++) {
+				auto object = bvh.objects[i];
+				visible[object] =
+						side > 0 || sphere_visible(frustum, spheres, object) ? 1 : 0;
+			}
+			continue;
+		}
+		push(stack, node.children + 1);
+		push(stack, node.children);
+	}
+}
+
+auto pick_bvh(
+		const Bvh& bvh,
+		const BoundingSpheres& spheres,
+		glm::vec3 origin,
+		glm::vec3 direction) -> std::optional<BvhHit> {
+	if (bvh.objects.empty()) {
+		return std::nullopt;
+	}
+	auto inverse = 1.0F / direction;
+	auto hit = std::optional<BvhHit>{};
+	auto stack = BvhStack{};
+	push(stack, 0);
+	while (stack.size != 0) {
+		const auto& node = bvh.nodes[pop(stack)];
+		auto entry = ray_box(node, origin, inverse);
+		if (!entry || (hit && *entry > hit->distance)) {
+			continue;
+		}
+		if (node.children != 0) {
+			push(stack, node.children + 1);
+			push(stack, node.children);
+			continue;
+		}
+		for (auto i = node.first; i < node.first + node.count; i++) {
+			auto object = bvh.objects[i];
+			auto distance = ray_sphere(spheres, object, origin, direction);
+			if (distance && (!hit || *distance < hit->distance)) {
+				hit = BvhHit{.object = object, .distance = *distance};
+			}
+		}
+	}
+	return hit;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "culling.hpp"
+#include "jobs.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Objects per leaf, leaves are tested sphere by sphere.
+constexpr auto g_bvh_leaf_size = size_t{8};
+// Refits between two quality checks.
+constexpr auto g_bvh_check_interval = size_t{16};
+// Surface area cost over the cost right after building at which a rebuild is
+// started.
+constexpr auto g_bvh_rebuild_ratio = 1.5F;
+constexpr auto g_bvh_no_node = ~uint32_t{};
+
+// Every node covers a contiguous range of Bvh::objects, interior nodes too,
+// so a node entirely inside a query takes its objects without descending.
+struct BvhNode {
+	glm::vec3 min{};
+	// Index of the first child, the second follows it. Zero for leaves, as the
+	// root is nobody's child.
+	uint32_t children{};
+	glm::vec3 max{};
+	uint32_t first{};
+	uint32_t count{};
+};
+
+// Bounding volume hierarchy of axis aligned boxes around BoundingSpheres,
+// split at the median of the longest axis. Children always come after their
+// parent, so a reverse walk over the nodes refits them bottom up.
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> parents;
+	// Object indices in leaf order.
+	std::vector<uint32_t> objects;
+	// The leaf holding each object.
+	std::vector<uint32_t> object_leaves;
+	// Surface area heuristic cost when built.
+	float build_cost{};
+};
+
+auto build_bvh(const BoundingSpheres& spheres) -> Bvh;
+// Refits every node to the spheres, which must be as many as when built.
+void refit_bvh(Bvh& bvh, const BoundingSpheres& spheres);
+// Refits the leaves of the moved objects and their ancestors, stopping once a
+// node's bounds stay the same.
+void refit_bvh(
+		Bvh& bvh,
+		const BoundingSpheres& spheres,
+		std::span<const uint32_t> moved);
+// Expected cost of a random query relative to testing the root, lower is
+// better. Grows as refitting stretches nodes over objects that drifted
+// apart.
+auto bvh_cost(const Bvh& bvh) -> float;
+
+// A BVH kept current over objects that move. Moved objects are refitted every
+// frame; once refitting degraded the tree past g_bvh_rebuild_ratio, a new one
+// is built on the job system from a copy of the spheres, and swapped in and
+// refitted to the latest spheres when done. Adding or removing objects
+// rebuilds it on the spot.
+struct DynamicBvh {
+	Bvh tree;
+	size_t refits{};
+	JobCounter rebuild_counter;
+	bool rebuilding{};
+	BoundingSpheres rebuild_spheres;
+	Bvh rebuilt;
+};
+
+// The rebuild counter is waited on through a fixed address.
+auto create_dynamic_bvh() -> std::unique_ptr<DynamicBvh>;
+// Waits for a rebuild still running.
+void destroy_dynamic_bvh(JobSystem& jobs, DynamicBvh& bvh);
+void update_dynamic_bvh(
+		JobSystem& jobs,
+		DynamicBvh& bvh,
+		const BoundingSpheres& spheres,
+		std::span<const uint32_t> moved);
+// Replaces moved with the objects whose sphere differs between before and
+// after. Empty when their counts differ, which rebuilds the tree anyway.
+void find_moved_spheres(
+		const BoundingSpheres& before,
+		const BoundingSpheres& after,
+		std::vector<uint32_t>& moved);
+
+// Sets visible[i] to 1 for the spheres that intersect the frustum and to 0
+// for the others, like cull_spheres. visible must have room for every sphere.
+void cull_bvh(
+		const Bvh& bvh,
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		std::span<uint8_t> visible);
+
+struct BvhHit {
+	uint32_t object{};
+	// Along the ray's direction, in multiples of its length.
+	float distance{};
+};
+
+// The nearest sphere the ray enters or starts in, for picking.
+auto pick_bvh(
+		const Bvh& bvh,
+		const BoundingSpheres& spheres,
+		glm::vec3 origin,
+		glm::vec3 direction) -> std::optional<BvhHit>;
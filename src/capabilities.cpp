@@ -0,0 +1,667 @@
+#include "capabilities.hpp"
+
+#include "fullscreen.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+auto has_extension(
+		std::span<const VkExtensionProperties> extensions,
+		std::string_view name) -> bool {
+	return std::any_of(
+			extensions.begin(),
+			extensions.end(),
+			[&](const VkExtensionProperties& extension) {
+				return std::string_view(extension.extensionName) == name;
+			});
+}
+
+auto has_host_time_domain(VkPhysicalDevice device) -> bool {
+	auto count = uint32_t{};
+	if (vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(device, &count, nullptr) !=
+			VK_SUCCESS) {
+		return false;
+	}
+	auto domains = std::vector<VkTimeDomainEXT>(count);
+	if (vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(
+					device,
+					&count,
+					domains.data()) != VK_SUCCESS) {
+		return false;
+	}
+	auto has_domain = [&](VkTimeDomainEXT domain) {
+		return std::find(domains.begin(), domains.end(), domain) !=
+				domains.end();
+	};
+	return has_domain(VK_TIME_DOMAIN_DEVICE_EXT) &&
+			has_domain(g_host_time_domain);
+}
+
+template <typename T>
+void append_features(void**& tail, T& features) {
+	*tail = &features;
+	tail = &features.pNext;
+}
+
+// The Vulkan 1.1 and 1.2 structures are always linked, the others only when
+// the device has them.
+void link_device_features(
+		DeviceFeatures& features,
+		bool vulkan_1_3,
+		bool mesh_shader,
+		bool present_wait,
+		bool graphics_pipeline_library,
+		bool ray_query,
+		bool fragment_shading_rate,
+		bool device_generated_commands,
+		bool performance_query,
+		bool shader_object,
+		bool shader_module_identifier,
+		bool descriptor_buffer,
+		bool host_image_copy,
+		bool conditional_rendering,
+		bool memory_priority,
+		bool pageable_device_local_memory,
+		bool image_compression_control,
+		bool swapchain_compression_control,
+		bool swapchain_maintenance1) {
+	features.core.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.vulkan_1_1.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	features.vulkan_1_2.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features.vulkan_1_3.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features.mesh_shader.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+	features.present_id.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	features.present_wait.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	features.graphics_pipeline_library.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+	features.acceleration_structure.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+	features.ray_query.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+	features.fragment_shading_rate.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+	features.maintenance5.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+	features.device_generated_commands.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEVICE_GENERATED_COMMANDS_FEATURES_EXT;
+	features.performance_query.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PERFORMANCE_QUERY_FEATURES_KHR;
+	features.shader_object.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+	features.shader_module_identifier.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+	features.descriptor_buffer.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+	features.host_image_copy.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+	features.conditional_rendering.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+	features.memory_priority.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PRIORITY_FEATURES_EXT;
+	features.pageable_device_local_memory.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PAGEABLE_DEVICE_LOCAL_MEMORY_FEATURES_EXT;
+	features.image_compression_control.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_COMPRESSION_CONTROL_FEATURES_EXT;
+	features.swapchain_compression_control.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_COMPRESSION_CONTROL_SWAPCHAIN_FEATURES_EXT;
+	features.swapchain_maintenance1.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+	auto** tail = &features.core.pNext;
+	append_features(tail, features.vulkan_1_1);
+	append_features(tail, features.vulkan_1_2);
+	if (vulkan_1_3) {
+		append_features(tail, features.vulkan_1_3);
+	}
+	if (mesh_shader) {
+		append_features(tail, features.mesh_shader);
+	}
+	if (present_wait) {
+		append_features(tail, features.present_id);
+		append_features(tail, features.present_wait);
+	}
+	if (graphics_pipeline_library) {
+		append_features(tail, features.graphics_pipeline_library);
+	}
+	if (ray_query) {
+		append_features(tail, features.acceleration_structure);
+		append_features(tail, features.ray_query);
+	}
+	if (fragment_shading_rate) {
+		append_features(tail, features.fragment_shading_rate);
+	}
+	if (device_generated_commands) {
+		append_features(tail, features.maintenance5);
+		append_features(tail, features.device_generated_commands);
+	}
+	if (performance_query) {
+		append_features(tail, features.performance_query);
+	}
+	if (shader_object) {
+		append_features(tail, features.shader_object);
+	}
+	if (shader_module_identifier) {
+		append_features(tail, features.shader_module_identifier);
+	}
+	if (descriptor_buffer) {
+		append_features(tail, features.descriptor_buffer);
+	}
+	if (host_image_copy) {
+		append_features(tail, features.host_image_copy);
+	}
+	if (conditional_rendering) {
+		append_features(tail, features.conditional_rendering);
+	}
+	if (memory_priority) {
+		append_features(tail, features.memory_priority);
+	}
+	if (pageable_device_local_memory) {
+		append_features(tail, features.pageable_device_local_memory);
+	}
+	if (image_compression_control) {
+		append_features(tail, features.image_compression_control);
+	}
+	if (swapchain_compression_control) {
+		append_features(tail, features.swapchain_compression_control);
+	}
+	if (swapchain_maintenance1) {
+		append_features(tail, features.swapchain_maintenance1);
+	}
+}
+
+}  // namespace
+
+auto query_device_capabilities(
+		VkPhysicalDevice device,
+		uint32_t instance_version,
+		const VkPhysicalDeviceProperties& properties,
+		std::span<const VkExtensionProperties> extensions,
+		bool present,
+		bool fullscreen,
+		bool surface_maintenance,
+		bool global_priority,
+		bool performance_counters,
+		bool shader_objects,
+		bool descriptor_buffers) -> DeviceCapabilities {
+	auto capabilities = DeviceCapabilities{};
+	// The budget is chained to vkGetPhysicalDeviceMemoryProperties2, which is
+	// core in Vulkan 1.1 and only resolved for an instance of it.
+	capabilities.memory_budget =
+			has_extension(extensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) &&
+			instance_version >= VK_API_VERSION_1_1 &&
+			properties.apiVersion >= VK_API_VERSION_1_1 &&
+			vkGetPhysicalDeviceMemoryProperties2 != nullptr;
+	// The instance only resolves the query when some device has the
+	// extension.
+	capabilities.calibrated_timestamps =
+			has_extension(extensions, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) &&
+			vkGetPhysicalDeviceCalibrateableTimeDomainsEXT != nullptr &&
+			has_host_time_domain(device);
+	capabilities.incremental_present = present &&
+			has_extension(extensions, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+	if (global_priority) {
+		for (const auto* name :
+				 {VK_KHR_GLOBAL_PRIORITY_EXTENSION_NAME,
+					VK_EXT_GLOBAL_PRIORITY_EXTENSION_NAME}) {
+			if (has_extension(extensions, name)) {
+				capabilities.global_priority_extension = name;
+				break;
+			}
+		}
+	}
+#ifdef _WIN32
+	capabilities.full_screen_exclusive = fullscreen &&
+			has_extension(extensions, g_full_screen_exclusive_extension);
+#else
+	static_cast<void>(fullscreen);
+#endif
+	capabilities.features2 = instance_version >= VK_API_VERSION_1_3 &&
+			properties.apiVersion >= VK_API_VERSION_1_2;
+	if (!capabilities.features2) {
+		return capabilities;
+	}
+
+	auto vulkan_1_3 = properties.apiVersion >= VK_API_VERSION_1_3;
+	auto mesh_shader_extension =
+			has_extension(extensions, VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	auto present_wait_extensions = present &&
+			has_extension(extensions, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+			has_extension(extensions, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	auto pipeline_library_extensions =
+			has_extension(extensions, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+			has_extension(
+					extensions,
+					VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	auto ray_query_extensions =
+			has_extension(
+					extensions,
+					VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
+			has_extension(extensions, VK_KHR_RAY_QUERY_EXTENSION_NAME) &&
+			has_extension(
+					extensions,
+					VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+	auto shading_rate_extension = has_extension(
+			extensions,
+			VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+	auto generated_commands_extensions =
+			has_extension(extensions, VK_KHR_MAINTENANCE_5_EXTENSION_NAME) &&
+			has_extension(
+					extensions,
+					VK_EXT_DEVICE_GENERATED_COMMANDS_EXTENSION_NAME);
+	// The instance only resolves the counter queries when some device has the
+	// extension.
+	auto performance_query_extension = performance_counters &&
+			has_extension(extensions, VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME) &&
+			vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR !=
+					nullptr;
+	auto shader_object_extension = shader_objects &&
+			has_extension(extensions, VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+	auto identifier_extension = vulkan_1_3 &&
+			has_extension(
+					extensions,
+					VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+	auto descriptor_buffer_extension = descriptor_buffers &&
+			has_extension(extensions, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+	// Needs copy_commands2 and format_feature_flags2, which are core in 1.3.
+	auto host_copy_extension = vulkan_1_3 &&
+			has_extension(extensions, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+	auto conditional_rendering_extension = has_extension(
+			extensions,
+			VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+	auto memory_priority_extension =
+			has_extension(extensions, VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME);
+	auto pageable_memory_extension = memory_priority_extension &&
+			has_extension(
+					extensions,
+					VK_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_EXTENSION_NAME);
+	auto compression_extension = has_extension(
+			extensions,
+			VK_EXT_IMAGE_COMPRESSION_CONTROL_EXTENSION_NAME);
+	auto swapchain_compression_extension = present && compression_extension &&
+			has_extension(
+					extensions,
+					VK_EXT_IMAGE_COMPRESSION_CONTROL_SWAPCHAIN_EXTENSION_NAME);
+	auto swapchain_maintenance_extension = present && surface_maintenance &&
+			has_extension(extensions, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+	auto features = DeviceFeatures{};
+	link_device_features(
+			features,
+			vulkan_1_3,
+			mesh_shader_extension,
+			present_wait_extensions,
+			pipeline_library_extensions,
+			ray_query_extensions,
+			shading_rate_extension,
+			generated_commands_extensions,
+			performance_query_extension,
+			shader_object_extension,
+			identifier_extension,
+			descriptor_buffer_extension,
+			host_copy_extension,
+			conditional_rendering_extension,
+			memory_priority_extension,
+			pageable_memory_extension,
+			compression_extension,
+			swapchain_compression_extension,
+			swapchain_maintenance_extension);
+	vkGetPhysicalDeviceFeatures2(device, &features.core);
+	// Without fast linking a linked pipeline costs about as much as a whole
+	// one, so the libraries would only add work.
+	auto library_properties =
+			VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT{};
+	library_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+	auto properties2 = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &library_properties,
+			.properties = {}};
+	if (pipeline_library_extensions) {
+		vkGetPhysicalDeviceProperties2(device, &properties2);
+	}
+	// The index buffer tokens take VkBindIndexBufferIndirectCommandEXT.
+	auto generated_properties =
+			VkPhysicalDeviceDeviceGeneratedCommandsPropertiesEXT{};
+	generated_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DEVICE_GENERATED_COMMANDS_PROPERTIES_EXT;
+	auto generated_properties2 = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &generated_properties,
+			.properties = {}};
+	if (generated_commands_extensions) {
+		vkGetPhysicalDeviceProperties2(device, &generated_properties2);
+	}
+
+	const auto& vulkan_1_1_features = features.vulkan_1_1;
+	const auto& vulkan_1_2_features = features.vulkan_1_2;
+	const auto& vulkan_1_3_features = features.vulkan_1_3;
+	// Extended dynamic state has no feature bit in 1.3.
+	capabilities.dynamic_rendering =
+			vulkan_1_3 && vulkan_1_3_features.dynamicRendering == VK_TRUE;
+	capabilities.extended_dynamic_state = vulkan_1_3;
+	capabilities.synchronization2 = vulkan_1_3 &&
+			vulkan_1_3_features.synchronization2 == VK_TRUE &&
+			vulkan_1_2_features.timelineSemaphore == VK_TRUE;
+	// What the bindless table needs: partially bound arrays of images and
+	// buffers that can be updated after binding, plus unsized arrays of images
+	// indexed with non-uniform indices for bindless texturing.
+	capabilities.descriptor_indexing =
+			vulkan_1_2_features.descriptorIndexing == VK_TRUE &&
+			vulkan_1_2_features.runtimeDescriptorArray == VK_TRUE &&
+			vulkan_1_2_features.descriptorBindingPartiallyBound == VK_TRUE &&
+			vulkan_1_2_features.descriptorBindingUpdateUnusedWhilePending ==
+					VK_TRUE &&
+			vulkan_1_2_features.descriptorBindingSampledImageUpdateAfterBind ==
+					VK_TRUE &&
+			vulkan_1_2_features.descriptorBindingStorageBufferUpdateAfterBind ==
+					VK_TRUE &&
+			vulkan_1_2_features.shaderSampledImageArrayNonUniformIndexing ==
+					VK_TRUE;
+	capabilities.buffer_device_address =
+			vulkan_1_2_features.bufferDeviceAddress == VK_TRUE;
+	capabilities.draw_indirect_count =
+			vulkan_1_2_features.drawIndirectCount == VK_TRUE &&
+			features.core.features.multiDrawIndirect == VK_TRUE &&
+			features.core.features.drawIndirectFirstInstance == VK_TRUE;
+	capabilities.mesh_shader = mesh_shader_extension &&
+			features.mesh_shader.taskShader == VK_TRUE &&
+			features.mesh_shader.meshShader == VK_TRUE;
+	capabilities.storage_8bit =
+			vulkan_1_2_features.storageBuffer8BitAccess == VK_TRUE;
+	capabilities.storage_16bit =
+			vulkan_1_1_features.storageBuffer16BitAccess == VK_TRUE;
+	capabilities.shader_float16 = vulkan_1_2_features.shaderFloat16 == VK_TRUE;
+	capabilities.multiview = vulkan_1_1_features.multiview == VK_TRUE;
+	capabilities.int64_atomics = features.core.features.shaderInt64 == VK_TRUE &&
+			vulkan_1_2_features.shaderBufferInt64Atomics == VK_TRUE;
+	capabilities.present_wait = present_wait_extensions &&
+			features.present_id.presentId == VK_TRUE &&
+			features.present_wait.presentWait == VK_TRUE;
+	capabilities.graphics_pipeline_library = pipeline_library_extensions &&
+			features.graphics_pipeline_library.graphicsPipelineLibrary ==
+					VK_TRUE &&
+			library_properties.graphicsPipelineLibraryFastLinking == VK_TRUE;
+	// Builds read their inputs and the instances their bottom levels through
+	// device addresses.
+	capabilities.ray_query = ray_query_extensions &&
+			features.acceleration_structure.accelerationStructure == VK_TRUE &&
+			features.ray_query.rayQuery == VK_TRUE &&
+			capabilities.buffer_device_address;
+	capabilities.fragment_shading_rate = shading_rate_extension &&
+			features.fragment_shading_rate.attachmentFragmentShadingRate ==
+					VK_TRUE;
+	// The streams' tokens read the meshes through device addresses.
+	capabilities.device_generated_commands = generated_commands_extensions &&
+			features.maintenance5.maintenance5 == VK_TRUE &&
+			features.device_generated_commands.deviceGeneratedCommands ==
+					VK_TRUE &&
+			(generated_properties.supportedIndirectCommandsInputModes &
+					VK_INDIRECT_COMMANDS_INPUT_MODE_VULKAN_INDEX_BUFFER_EXT) != 0 &&
+			capabilities.buffer_device_address;
+	// Counter queries must be reset outside the command buffers that begin
+	// them, so the profiler resets them from the host.
+	capabilities.performance_query = performance_query_extension &&
+			features.performance_query.performanceCounterQueryPools == VK_TRUE &&
+			vulkan_1_2_features.hostQueryReset == VK_TRUE;
+	capabilities.shader_object = shader_object_extension &&
+			features.shader_object.shaderObject == VK_TRUE &&
+			capabilities.dynamic_rendering;
+	capabilities.shader_module_identifier = identifier_extension &&
+			features.shader_module_identifier.shaderModuleIdentifier == VK_TRUE &&
+			vulkan_1_3_features.pipelineCreationCacheControl == VK_TRUE;
+	capabilities.descriptor_buffer = descriptor_buffer_extension &&
+			features.descriptor_buffer.descriptorBuffer == VK_TRUE &&
+			capabilities.buffer_device_address;
+	capabilities.host_image_copy = host_copy_extension &&
+			features.host_image_copy.hostImageCopy == VK_TRUE;
+	capabilities.conditional_rendering = conditional_rendering_extension &&
+			features.conditional_rendering.conditionalRendering == VK_TRUE;
+	capabilities.memory_priority = memory_priority_extension &&
+			features.memory_priority.memoryPriority == VK_TRUE;
+	capabilities.pageable_device_local_memory = pageable_memory_extension &&
+			features.pageable_device_local_memory.pageableDeviceLocalMemory ==
+					VK_TRUE &&
+			capabilities.memory_priority;
+	capabilities.image_compression_control = compression_extension &&
+			features.image_compression_control.imageCompressionControl == VK_TRUE;
+	capabilities.swapchain_compression_control =
+			swapchain_compression_extension &&
+			features.swapchain_compression_control
+							.imageCompressionControlSwapchain == VK_TRUE &&
+			capabilities.image_compression_control;
+	capabilities.swapchain_maintenance1 = swapchain_maintenance_extension &&
+			features.swapchain_maintenance1.swapchainMaintenance1 == VK_TRUE;
+	return capabilities;
+}
+
+auto enable_device_capabilities(
+		const DeviceCapabilities& capabilities,
+		DeviceFeatures& features,
+		DeviceExtensions& extensions) -> const void* {
+	if (capabilities.memory_budget) {
+		extensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+	if (capabilities.calibrated_timestamps) {
+		extensions.emplace_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	}
+	if (capabilities.full_screen_exclusive) {
+		extensions.emplace_back(g_full_screen_exclusive_extension);
+	}
+	if (capabilities.incremental_present) {
+		extensions.emplace_back(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+	}
+	if (capabilities.global_priority_extension != nullptr) {
+		extensions.emplace_back(capabilities.global_priority_extension);
+	}
+	if (!capabilities.features2) {
+		return VK_NULL_HANDLE;
+	}
+
+	link_device_features(
+			features,
+			capabilities.dynamic_rendering || capabilities.synchronization2,
+			capabilities.mesh_shader,
+			capabilities.present_wait,
+			capabilities.graphics_pipeline_library,
+			capabilities.ray_query,
+			capabilities.fragment_shading_rate,
+			capabilities.device_generated_commands,
+			capabilities.performance_query,
+			capabilities.shader_object,
+			capabilities.shader_module_identifier,
+			capabilities.descriptor_buffer,
+			capabilities.host_image_copy,
+			capabilities.conditional_rendering,
+			capabilities.memory_priority,
+			capabilities.pageable_device_local_memory,
+			capabilities.image_compression_control,
+			capabilities.swapchain_compression_control,
+			capabilities.swapchain_maintenance1);
+	auto enable = [](bool capability) {
+		return capability ? VK_TRUE : VK_FALSE;
+	};
+	auto& vulkan_1_2_features = features.vulkan_1_2;
+	features.vulkan_1_1.storageBuffer16BitAccess =
+			enable(capabilities.storage_16bit);
+	features.vulkan_1_1.multiview = enable(capabilities.multiview);
+	vulkan_1_2_features.storageBuffer8BitAccess =
+			enable(capabilities.storage_8bit);
+	vulkan_1_2_features.shaderFloat16 = enable(capabilities.shader_float16);
+	vulkan_1_2_features.descriptorIndexing =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.runtimeDescriptorArray =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.descriptorBindingPartiallyBound =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.descriptorBindingUpdateUnusedWhilePending =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.descriptorBindingSampledImageUpdateAfterBind =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.descriptorBindingStorageBufferUpdateAfterBind =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.shaderSampledImageArrayNonUniformIndexing =
+			enable(capabilities.descriptor_indexing);
+	vulkan_1_2_features.timelineSemaphore =
+			enable(capabilities.synchronization2);
+	vulkan_1_2_features.bufferDeviceAddress =
+			enable(capabilities.buffer_device_address);
+	vulkan_1_2_features.drawIndirectCount =
+			enable(capabilities.draw_indirect_count);
+	vulkan_1_2_features.hostQueryReset = enable(capabilities.performance_query);
+	vulkan_1_2_features.shaderBufferInt64Atomics =
+			enable(capabilities.int64_atomics);
+	if (capabilities.int64_atomics) {
+		features.core.features.shaderInt64 = VK_TRUE;
+	}
+	if (capabilities.draw_indirect_count) {
+		features.core.features.multiDrawIndirect = VK_TRUE;
+		features.core.features.drawIndirectFirstInstance = VK_TRUE;
+	}
+	features.vulkan_1_3.dynamicRendering =
+			enable(capabilities.dynamic_rendering);
+	features.vulkan_1_3.synchronization2 =
+			enable(capabilities.synchronization2);
+	features.vulkan_1_3.pipelineCreationCacheControl =
+			enable(capabilities.shader_module_identifier);
+	if (capabilities.mesh_shader) {
+		features.mesh_shader.taskShader = VK_TRUE;
+		features.mesh_shader.meshShader = VK_TRUE;
+		extensions.emplace_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+	}
+	if (capabilities.present_wait) {
+		features.present_id.presentId = VK_TRUE;
+		features.present_wait.presentWait = VK_TRUE;
+		extensions.emplace_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		extensions.emplace_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+	if (capabilities.graphics_pipeline_library) {
+		features.graphics_pipeline_library.graphicsPipelineLibrary = VK_TRUE;
+		extensions.emplace_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		extensions.emplace_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	}
+	if (capabilities.ray_query) {
+		features.acceleration_structure.accelerationStructure = VK_TRUE;
+		features.ray_query.rayQuery = VK_TRUE;
+		extensions.emplace_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+		extensions.emplace_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+		extensions.emplace_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+	}
+	if (capabilities.fragment_shading_rate) {
+		features.fragment_shading_rate.attachmentFragmentShadingRate = VK_TRUE;
+		extensions.emplace_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+	}
+	if (capabilities.device_generated_commands) {
+		features.maintenance5.maintenance5 = VK_TRUE;
+		features.device_generated_commands.deviceGeneratedCommands = VK_TRUE;
+		extensions.emplace_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+		extensions.emplace_back(VK_EXT_DEVICE_GENERATED_COMMANDS_EXTENSION_NAME);
+	}
+	if (capabilities.performance_query) {
+		features.performance_query.performanceCounterQueryPools = VK_TRUE;
+		extensions.emplace_back(VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME);
+	}
+	if (capabilities.shader_object) {
+		features.shader_object.shaderObject = VK_TRUE;
+		extensions.emplace_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+	}
+	if (capabilities.shader_module_identifier) {
+		features.shader_module_identifier.shaderModuleIdentifier = VK_TRUE;
+		extensions.emplace_back(VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME);
+	}
+	if (capabilities.descriptor_buffer) {
+		features.descriptor_buffer.descriptorBuffer = VK_TRUE;
+		extensions.emplace_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+	}
+	if (capabilities.host_image_copy) {
+		features.host_image_copy.hostImageCopy = VK_TRUE;
+		extensions.emplace_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+	}
+	if (capabilities.conditional_rendering) {
+		features.conditional_rendering.conditionalRendering = VK_TRUE;
+		extensions.emplace_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+	}
+	if (capabilities.memory_priority) {
+		features.memory_priority.memoryPriority = VK_TRUE;
+		extensions.emplace_back(VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME);
+	}
+	if (capabilities.pageable_device_local_memory) {
+		features.pageable_device_local_memory.pageableDeviceLocalMemory = VK_TRUE;
+		extensions.emplace_back(
+				VK_EXT_PAGEABLE_DEVICE_LOCAL_MEMORY_EXTENSION_NAME);
+	}
+	if (capabilities.image_compression_control) {
+		features.image_compression_control.imageCompressionControl = VK_TRUE;
+		extensions.emplace_back(VK_EXT_IMAGE_COMPRESSION_CONTROL_EXTENSION_NAME);
+	}
+	if (capabilities.swapchain_compression_control) {
+		features.swapchain_compression_control.imageCompressionControlSwapchain =
+				VK_TRUE;
+		extensions.emplace_back(
+				VK_EXT_IMAGE_COMPRESSION_CONTROL_SWAPCHAIN_EXTENSION_NAME);
+	}
+	if (capabilities.swapchain_maintenance1) {
+		features.swapchain_maintenance1.swapchainMaintenance1 = VK_TRUE;
+		extensions.emplace_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+	}
+	return &features.core;
+}
+
+auto describe_device_capabilities(const DeviceCapabilities& capabilities)
+		-> std::string {
+	auto names = std::vector<std::string_view>{};
+	auto add = [&](bool available, std::string_view name) {
+		if (available) {
+			names.emplace_back(name);
+		}
+	};
+	add(capabilities.dynamic_rendering, "dynamic rendering");
+	add(capabilities.extended_dynamic_state, "extended dynamic state");
+	add(capabilities.synchronization2, "synchronization2");
+	add(capabilities.descriptor_indexing, "descriptor indexing");
+	add(capabilities.buffer_device_address, "buffer device address");
+	add(capabilities.draw_indirect_count, "draw indirect count");
+	add(capabilities.mesh_shader, "mesh shaders");
+	add(capabilities.storage_8bit, "8-bit storage");
+	add(capabilities.storage_16bit, "16-bit storage");
+	add(capabilities.shader_float16, "16-bit float math");
+	add(capabilities.multiview, "multiview");
+	add(capabilities.int64_atomics, "64-bit atomics");
+	add(capabilities.memory_budget, "memory budget");
+	add(capabilities.memory_priority, "memory priority");
+	add(
+			capabilities.pageable_device_local_memory,
+			"pageable device local memory");
+	add(capabilities.calibrated_timestamps, "calibrated timestamps");
+	add(capabilities.present_wait, "present wait");
+	add(capabilities.full_screen_exclusive, "full screen exclusive");
+	add(capabilities.incremental_present, "incremental present");
+	add(capabilities.global_priority_extension != nullptr, "global priority");
+	add(capabilities.graphics_pipeline_library, "graphics pipeline library");
+	add(capabilities.ray_query, "ray query");
+	add(capabilities.fragment_shading_rate, "fragment shading rate");
+	add(capabilities.device_generated_commands, "device generated commands");
+	add(capabilities.performance_query, "performance query");
+	add(capabilities.shader_object, "shader objects");
+	add(capabilities.shader_module_identifier, "shader module identifiers");
+	add(capabilities.descriptor_buffer, "descriptor buffers");
+	add(capabilities.host_image_copy, "host image copy");
+	add(capabilities.conditional_rendering, "conditional rendering");
+	add(capabilities.image_compression_control, "image compression control");
+	add(
+			capabilities.swapchain_compression_control,
+			"swap chain compression control");
+	add(capabilities.swapchain_maintenance1, "swap chain maintenance");
+	if (names.empty()) {
+		return "none";
+	}
+	return fmt::format("{}", fmt::join(names, ", "));
+}
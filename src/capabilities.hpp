@@ -0,0 +1,182 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "static_vector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Extensions a device is created with, the required ones and those the
+// capabilities add.
+constexpr auto g_max_device_extensions = size_t{32};
+using DeviceExtensions = StaticVector<const char*, g_max_device_extensions>;
+
+// The time domain of std::chrono::steady_clock, which calibrated timestamps
+// are sampled in next to the device's.
+#ifdef _WIN32
+constexpr auto g_host_time_domain =
+		VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+constexpr auto g_host_time_domain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+// Optional fast paths of a physical device. They are settled once at device
+// creation, so the renderer picks its code paths at init instead of checking
+// features while drawing.
+struct DeviceCapabilities {
+	// Features beyond VkPhysicalDeviceFeatures can be queried and enabled,
+	// which takes a Vulkan 1.3 instance and at least a Vulkan 1.2 device.
+	bool features2{};
+	bool dynamic_rendering{};
+	bool extended_dynamic_state{};
+	// Includes timeline semaphores.
+	bool synchronization2{};
+	bool descriptor_indexing{};
+	bool buffer_device_address{};
+	// vkCmdDrawIndexedIndirectCount with many draws that set firstInstance.
+	bool draw_indirect_count{};
+	bool mesh_shader{};
+	bool storage_8bit{};
+	bool storage_16bit{};
+	// Shaders can do arithmetic on 16-bit floats, which many GPUs run at twice
+	// the rate of 32-bit ones and keep in half the registers.
+	bool shader_float16{};
+	// Render passes can draw every view of a mask into its own layer, with
+	// the vertex shaders telling the views apart by gl_ViewIndex.
+	bool multiview{};
+	// Shaders can do 64-bit integer math and atomics on storage buffers.
+	bool int64_atomics{};
+	bool memory_budget{};
+	// Allocations can be given a priority, which decides what is demoted out
+	// of device local heaps first when they are oversubscribed.
+	bool memory_priority{};
+	// Device local memory can be paged out to make room for other
+	// allocations instead of failing them. Includes memory priority, which
+	// decides what goes first.
+	bool pageable_device_local_memory{};
+	// Device timestamps can be sampled together with g_host_time_domain.
+	bool calibrated_timestamps{};
+	bool present_wait{};
+	// Swap chains can take the display from the desktop compositor, see
+	// src/fullscreen.hpp.
+	bool full_screen_exclusive{};
+	// Presents can list the rectangles that changed, see src/damage.hpp.
+	bool incremental_present{};
+	// Queues can be created with a priority against the queues of other
+	// processes, through VK_KHR_global_priority or the EXT it was promoted
+	// from, which this names. Null without either.
+	const char* global_priority_extension{};
+	// Pipelines can be built from separately compiled parts, and linking the
+	// parts is fast enough to do while drawing.
+	bool graphics_pipeline_library{};
+	// Acceleration structures built on the device, which any shader stage can
+	// trace rays through with ray queries.
+	bool ray_query{};
+	// Render passes can take an image of fragment sizes per tile of pixels.
+	bool fragment_shading_rate{};
+	// Streams of indirect commands that set index buffers and push constants
+	// before each indexed draw, written by shaders and executed without a
+	// pipeline switch. Includes maintenance5, whose buffer usage flags the
+	// preprocess buffers take.
+	bool device_generated_commands{};
+	// Query pools of vendor performance counters, reset from the host.
+	bool performance_query{};
+	// Shaders bound without a pipeline, with all of their state set while
+	// recording. Includes dynamic rendering, the only way they draw.
+	bool shader_object{};
+	// Pipelines can be created from the identifiers of modules of an earlier
+	// run, which the driver finds in its pipeline cache without the SPIR-V.
+	// Includes failing such a create instead of compiling on a cache miss.
+	bool shader_module_identifier{};
+	// Descriptors can be written into buffers with memcpy like copies and
+	// bound by offset, without pools or sets. Includes buffer device address,
+	// which the buffers are bound with.
+	bool descriptor_buffer{};
+	// Images can be written from host memory and change layout on the host,
+	// without a staging buffer or a submission.
+	bool host_image_copy{};
+	// Draws and dispatches can be skipped by a value the GPU wrote into a
+	// buffer, without the CPU reading it back.
+	bool conditional_rendering{};
+	// Images can be created with lossless compression, fixed rate compression
+	// or none asked for, and tell which one they got.
+	bool image_compression_control{};
+	// The same for swap chain images. Includes image compression control,
+	// which their compression is looked up with.
+	bool swapchain_compression_control{};
+	// Presents can signal fences once the presentation engine is done with
+	// them and switch between compatible present modes, and acquired images
+	// can be given back without presenting them.
+	bool swapchain_maintenance1{};
+};
+
+// The feature structures chained into VkDeviceCreateInfo. The chain points
+// into the struct, so it must stay in place until the device is created.
+struct DeviceFeatures {
+	VkPhysicalDeviceFeatures2 core{};
+	VkPhysicalDeviceVulkan11Features vulkan_1_1{};
+	VkPhysicalDeviceVulkan12Features vulkan_1_2{};
+	VkPhysicalDeviceVulkan13Features vulkan_1_3{};
+	VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader{};
+	VkPhysicalDevicePresentIdFeaturesKHR present_id{};
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait{};
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT
+			graphics_pipeline_library{};
+	VkPhysicalDeviceAccelerationStructureFeaturesKHR acceleration_structure{};
+	VkPhysicalDeviceRayQueryFeaturesKHR ray_query{};
+	VkPhysicalDeviceFragmentShadingRateFeaturesKHR fragment_shading_rate{};
+	VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5{};
+	VkPhysicalDeviceDeviceGeneratedCommandsFeaturesEXT
+			device_generated_commands{};
+	VkPhysicalDevicePerformanceQueryFeaturesKHR performance_query{};
+	VkPhysicalDeviceShaderObjectFeaturesEXT shader_object{};
+	VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT shader_module_identifier{};
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer{};
+	VkPhysicalDeviceHostImageCopyFeaturesEXT host_image_copy{};
+	VkPhysicalDeviceConditionalRenderingFeaturesEXT conditional_rendering{};
+	VkPhysicalDeviceMemoryPriorityFeaturesEXT memory_priority{};
+	VkPhysicalDevicePageableDeviceLocalMemoryFeaturesEXT
+			pageable_device_local_memory{};
+	VkPhysicalDeviceImageCompressionControlFeaturesEXT
+			image_compression_control{};
+	VkPhysicalDeviceImageCompressionControlSwapchainFeaturesEXT
+			swapchain_compression_control{};
+	VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance1{};
+};
+
+// instance_version is the API version the instance was created with.
+// Present wait and swap chain compression control are only considered when
+// the device has to present, and global
+// priorities, performance queries, shader objects and descriptor buffers
+// when they are asked for, since drivers may do more work with the
+// extensions enabled.
+// Exclusive fullscreen is only considered for a fullscreen window, on an
+// instance with VK_KHR_get_surface_capabilities2, which it depends on, and
+// swap chain maintenance on an instance with VK_EXT_surface_maintenance1.
+auto query_device_capabilities(
+		VkPhysicalDevice device,
+		uint32_t instance_version,
+		const VkPhysicalDeviceProperties& properties,
+		std::span<const VkExtensionProperties> extensions,
+		bool present,
+		bool fullscreen,
+		bool surface_maintenance,
+		bool global_priority,
+		bool performance_counters,
+		bool shader_objects,
+		bool descriptor_buffers) -> DeviceCapabilities;
+
+// Turns on the features of every capability in features, which must be empty
+// apart from the core features to enable, and appends the extensions they
+// need. Returns the chain for VkDeviceCreateInfo::pNext. It is null without
+// features2, in which case the core features go through pEnabledFeatures.
+auto enable_device_capabilities(
+		const DeviceCapabilities& capabilities,
+		DeviceFeatures& features,
+		DeviceExtensions& extensions) -> const void*;
+
+// Comma separated names of the available capabilities.
+auto describe_device_capabilities(const DeviceCapabilities& capabilities)
+		-> std::string;
@@ -0,0 +1,506 @@
+#include "capture.hpp"
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <span>
+
+namespace {
+
+// Every supported format packs a pixel into 32 bits.
+constexpr auto g_capture_pixel_size = VkDeviceSize{4};
+// Longest stored deflate block.
+constexpr auto g_max_stored_block = size_t{65535};
+constexpr auto g_adler_modulus = uint32_t{65521};
+
+constexpr auto g_crc_table = [] {
+	auto table = std::array<uint32_t, 256>{};
+	for (auto i = uint32_t{}; i < table.size(); i++) {
+		auto crc = i;
+		for (auto bit = 0; bit < 8; bit++) {
+			crc = (crc & 1U) != 0 ? 0xedb88320U ^ (crc >> 1U) : crc >> 1U;
+		}
+		table.at(i) = crc;
+	}
+	return table;
+}();
+
+auto update_crc(uint32_t crc, std::span<const uint8_t> bytes) -> uint32_t {
+	for (auto byte : bytes) {
+		crc = g_crc_table.at((crc ^ byte) & 0xffU) ^ (crc >> 8U);
+	}
+	return crc;
+}
+
+auto channel_10bit(uint32_t pixel, uint32_t shift) -> uint8_t {
+	return static_cast<uint8_t>(((pixel >> shift) & 0x3ffU) * 255U / 1023U);
+}
+
+// Converts the slot's pixels to tightly packed RGB24.
+void convert_to_rgb(const CaptureSlot& slot, std::vector<uint8_t>& rgb) {
+	auto pixel_count = size_t{slot.extent.width} * slot.extent.height;
+	rgb.resize(pixel_count * 3);
+	const auto* source = slot.buffer.allocation.mapped;
+	for (auto i = size_t{}; i < pixel_count; i++) {
+		auto pixel = uint32_t{};
+		std::memcpy(&pixel, source + i * g_capture_pixel_size, sizeof(pixel));
+		auto* out = &rgb.at(i * 3);
+		switch (slot.format) {
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+				out[0] = static_cast<uint8_t>(pixel >> 16U);
+				out[1] = static_cast<uint8_t>(pixel >> 8U);
+				out[2] = static_cast<uint8_t>(pixel);
+				break;
+			case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+				out[0] = channel_10bit(pixel, 0);
+				out[1] = channel_10bit(pixel, 10);
+				out[2] = channel_10bit(pixel, 20);
+				break;
+			case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+				out[0] = channel_10bit(pixel, 20);
+				out[1] = channel_10bit(pixel, 10);
+				out[2] = channel_10bit(pixel, 0);
+				break;
+			default:
+				out[0] = static_cast<uint8_t>(pixel);
+				out[1] = static_cast<uint8_t>(pixel >> 8U);
+				out[2] = static_cast<uint8_t>(pixel >> 16U);
+				break;
+		}
+	}
+}
+
+void write_bytes(std::FILE* file, std::span<const uint8_t> bytes) {
+	if (std::fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+		fmt::print(stderr, "Failed to write captured frame\n");
+		std::terminate();
+	}
+}
+
+void write_text(std::FILE* file, std::string_view text) {
+	if (std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+		fmt::print(stderr, "Failed to write captured frame\n");
+		std::terminate();
+	}
+}
+
+void append_big_endian(std::vector<uint8_t>& bytes, uint32_t value) {
+	for (auto shift = 24; shift >= 0; shift -= 8) {
+		bytes.emplace_back(static_cast<uint8_t>(value >> shift));
+	}
+}
+
+// type and data of the chunk, framed by its length and CRC.
+void write_png_chunk(
+		std::FILE* file,
+		std::string_view type,
+		std::span<const uint8_t> data) {
+	auto header = std::vector<uint8_t>{};
+	append_big_endian(header, static_cast<uint32_t>(data.size()));
+	header.insert(header.end(), type.begin(), type.end());
+	auto crc = update_crc(0xffffffffU, std::span(header).subspan(4));
+	crc = update_crc(crc, data) ^ 0xffffffffU;
+	auto trailer = std::vector<uint8_t>{};
+	append_big_endian(trailer, crc);
+	write_bytes(file, header);
+	write_bytes(file, data);
+	write_bytes(file, trailer);
+}
+
+// Writes the image with stored deflate blocks. Compressing would cost the
+// encoder more time than the disk saves, a PNG optimizer can shrink the
+// files afterwards.
+void write_png(
+		const std::filesystem::path& path,
+		VkExtent2D extent,
+		std::span<const uint8_t> rgb) {
+	auto* file = std::fopen(path.string().c_str(), "wb");
+	if (file == nullptr) {
+		fmt::print(stderr, "Failed to open {}\n", path.string());
+		std::terminate();
+	}
+	constexpr auto signature =
+			std::array<uint8_t, 8>{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	write_bytes(file, signature);
+
+	auto header = std::vector<uint8_t>{};
+	append_big_endian(header, extent.width);
+	append_big_endian(header, extent.height);
+	// 8-bit RGB, deflate, adaptive filtering, not interlaced.
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	write_png_chunk(file, "IHDR", header);
+
+	// Every row starts with filter type 0.
+	auto row_size = size_t{extent.width} * 3;
+	auto filtered = std::vector<uint8_t>{};
+	filtered.reserve((row_size + 1) * extent.height);
+	for (auto y = size_t{}; y < extent.height; y++) {
+		filtered.emplace_back(0);
+		auto row = rgb.subspan(y * row_size, row_size);
+		filtered.insert(filtered.end(), row.begin(), row.end());
+	}
+	auto low = uint32_t{1};
+	auto high = uint32_t{};
+	for (auto byte : filtered) {
+		low = (low + byte) % g_adler_modulus;
+		high = (high + low) % g_adler_modulus;
+	}
+	auto data = std::vector<uint8_t>{0x78, 0x01};
+	data.reserve(
+			filtered.size() + (filtered.size() / g_max_stored_block + 1) * 5 + 6);
+	for (auto offset = size_t{};;) {
+		auto length = std::min(filtered.size() - offset, g_max_stored_block);
+		auto last = offset + length == filtered.size();
+		data.emplace_back(last ? 1 : 0);
+		data.emplace_back(static_cast<uint8_t>(length));
+		data.emplace_back(static_cast<uint8_t>(length >> 8U));
+		data.emplace_back(static_cast<uint8_t>(~length));
+		data.emplace_back(static_cast<uint8_t>(~length >> 8U));
+		data.insert(
+				data.end(),
+				filtered.begin() + static_cast<std::ptrdiff_t>(offset),
+				filtered.begin() + static_cast<std::ptrdiff_t>(offset + length));
+		offset += length;
+		if (last) {
+			break;
+		}
+	}
+	append_big_endian(data, (high << 16U) | low);
+	write_png_chunk(file, "IDAT", data);
+	write_png_chunk(file, "IEND", {});
+	std::fclose(file);
+}
+
+// Full range BT.601, planar 4:4:4.
+void write_y4m_frame(std::FILE* file, std::span<const uint8_t> rgb) {
+	auto pixel_count = rgb.size() / 3;
+	auto planes = std::vector<uint8_t>(pixel_count * 3);
+	for (auto i = size_t{}; i < pixel_count; i++) {
+		auto r = static_cast<float>(rgb[i * 3]);
+		auto g = static_cast<float>(rgb[i * 3 + 1]);
+		auto b = static_cast<float>(rgb[i * 3 + 2]);
+		auto to_byte = [](float value) {
+			return static_cast<uint8_t>(std::clamp(value + 0.5F, 0.0F, 255.0F));
+		};
+		planes[i] = to_byte(0.299F * r + 0.587F * g + 0.114F * b);
+		planes[pixel_count + i] =
+				to_byte(128.0F - 0.168736F * r - 0.331264F * g + 0.5F * b);
+		planes[pixel_count * 2 + i] =
+				to_byte(128.0F + 0.5F * r - 0.418688F * g - 0.081312F * b);
+	}
+	write_text(file, "FRAME\n");
+	write_bytes(file, planes);
+}
+
+void write_frame(
+		FrameCapture& capture,
+		const CaptureSlot& slot,
+		std::span<const uint8_t> rgb) {
+	if (capture.format == CaptureFormat::png) {
+		auto path = capture.path;
+		path.replace_filename(fmt::format(
+				"{}-{:06}.png",
+				capture.path.stem().string(),
+				slot.frame_number));
+		write_png(path, slot.extent, rgb);
+		return;
+	}
+	// Streams keep the extent of their first frame.
+	if (capture.stream_extent.width == 0) {
+		capture.stream_extent = slot.extent;
+		if (capture.format == CaptureFormat::y4m) {
+			write_text(
+					capture.stream,
+					fmt::format(
+							"YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444 XCOLORRANGE=FULL\n",
+							slot.extent.width,
+							slot.extent.height,
+							g_capture_frame_rate));
+		}
+	}
+	if (slot.extent.width != capture.stream_extent.width ||
+			slot.extent.height != capture.stream_extent.height) {
+		fmt::print(
+				stderr,
+				"Capture skipped frame {}, its extent differs from the stream's\n",
+				slot.frame_number);
+		return;
+	}
+	if (capture.format == CaptureFormat::y4m) {
+		write_y4m_frame(capture.stream, rgb);
+	} else {
+		write_bytes(capture.stream, rgb);
+	}
+}
+
+void run_encoder(FrameCapture& capture) {
+	auto rgb = std::vector<uint8_t>{};
+	auto lock = std::unique_lock(capture.mutex);
+	while (true) {
+		capture.changed.wait(
+				lock,
+				[&] { return capture.stopping || !capture.queue.empty(); });
+		if (capture.queue.empty()) {
+			return;
+		}
+		auto* slot = capture.queue.front();
+		capture.queue.pop_front();
+		lock.unlock();
+		convert_to_rgb(*slot, rgb);
+		write_frame(capture, *slot, rgb);
+		lock.lock();
+		slot->state = CaptureSlotState::free;
+		capture.changed.notify_all();
+	}
+}
+
+// Null when the frame is dropped.
+auto acquire_slot(FrameCapture& capture) -> CaptureSlot* {
+	auto lock = std::unique_lock(capture.mutex);
+	auto find_free = [&] {
+		return std::find_if(
+				capture.slots.begin(),
+				capture.slots.end(),
+				[](const auto& slot) {
+					return slot->state == CaptureSlotState::free;
+				});
+	};
+	auto found = find_free();
+	// At most one slot per frame in flight is copying, so the encoder always
+	// holds the rest and eventually frees one.
+	while (found == capture.slots.end() && capture.block) {
+		capture.changed.wait(lock);
+		found = find_free();
+	}
+	if (found == capture.slots.end()) {
+		return nullptr;
+	}
+	(*found)->state = CaptureSlotState::copying;
+	return found->get();
+}
+
+auto open_pipe(const std::string& command) -> std::FILE* {
+#ifdef _WIN32
+	return _popen(command.c_str(), "wb");
+#else
+	return popen(command.c_str(), "w");
+#endif
+}
+
+void close_pipe(std::FILE* pipe) {
+#ifdef _WIN32
+	_pclose(pipe);
+#else
+	pclose(pipe);
+#endif
+}
+
+}  // namespace
+
+auto capture_supported(VkFormat format) -> bool {
+	switch (format) {
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+		case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+			return true;
+		default:
+			return false;
+	}
+}
+
+auto create_frame_capture(
+		std::string_view target,
+		size_t interval,
+		bool block,
+		size_t frame_count) -> std::unique_ptr<FrameCapture> {
+	auto capture = std::make_unique<FrameCapture>();
+	capture->interval = interval;
+	capture->block = block;
+	if (target.starts_with('|')) {
+		capture->format = CaptureFormat::raw;
+		capture->piped = true;
+		capture->stream = open_pipe(std::string(target.substr(1)));
+	} else {
+		capture->path = target;
+		auto extension = capture->path.extension();
+		if (extension == ".png") {
+			capture->format = CaptureFormat::png;
+		} else {
+			capture->format =
+					extension == ".y4m" ? CaptureFormat::y4m : CaptureFormat::raw;
+			capture->stream = std::fopen(capture->path.string().c_str(), "wb");
+		}
+	}
+	if (capture->format != CaptureFormat::png && capture->stream == nullptr) {
+		fmt::print(stderr, "Failed to open capture target {}\n", target);
+		std::terminate();
+	}
+	for (auto i = size_t{}; i < frame_count + g_capture_spare_slots; i++) {
+		capture->slots.emplace_back(std::make_unique<CaptureSlot>());
+	}
+	capture->encoder = std::thread(run_encoder, std::ref(*capture));
+	return capture;
+}
+
+void destroy_frame_capture(
+		VkDevice& device,
+		Allocator& allocator,
+		FrameCapture& capture) {
+	{
+		auto lock = std::scoped_lock(capture.mutex);
+		auto copying = std::vector<CaptureSlot*>{};
+		for (auto& slot : capture.slots) {
+			if (slot->state == CaptureSlotState::copying) {
+				copying.emplace_back(slot.get());
+			}
+		}
+		std::sort(
+				copying.begin(),
+				copying.end(),
+				[](const CaptureSlot* a, const CaptureSlot* b) {
+					return a->frame_number < b->frame_number;
+				});
+		for (auto* slot : copying) {
+			slot->state = CaptureSlotState::encoding;
+			capture.queue.emplace_back(slot);
+		}
+		capture.stopping = true;
+	}
+	capture.changed.notify_all();
+	capture.encoder.join();
+	for (auto& slot : capture.slots) {
+		if (slot->buffer.handle != VK_NULL_HANDLE) {
+			destroy_buffer(device, allocator, slot->buffer);
+		}
+	}
+	if (capture.stream != nullptr) {
+		if (capture.piped) {
+			close_pipe(capture.stream);
+		} else {
+			std::fclose(capture.stream);
+		}
+	}
+	if (capture.dropped != 0) {
+		fmt::print(
+				stderr,
+				"Capture dropped {} frames the encoder could not keep up with\n",
+				capture.dropped);
+	}
+}
+
+void collect_captures(FrameCapture& capture, size_t frame_idx) {
+	{
+		auto lock = std::scoped_lock(capture.mutex);
+		for (auto& slot : capture.slots) {
+			if (slot->state == CaptureSlotState::copying &&
+					slot->frame_idx == frame_idx) {
+				slot->state = CaptureSlotState::encoding;
+				capture.queue.emplace_back(slot.get());
+			}
+		}
+	}
+	capture.changed.notify_all();
+}
+
+void add_capture_pass(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph,
+		FrameCapture& capture,
+		size_t frame_idx,
+		uint32_t image,
+		VkExtent2D extent,
+		VkFormat format) {
+	auto frame_number = capture.frame_number++;
+	if (frame_number % capture.interval != 0) {
+		return;
+	}
+	auto* slot = acquire_slot(capture);
+	if (slot == nullptr) {
+		capture.dropped++;
+		return;
+	}
+	// Free slots are not in use by the GPU or the encoder.
+	auto size = VkDeviceSize{extent.width} * extent.height * g_capture_pixel_size;
+	if (slot->size < size) {
+		if (slot->buffer.handle != VK_NULL_HANDLE) {
+			destroy_buffer(device, allocator, slot->buffer);
+		}
+		// Cached memory keeps the encoder's reads fast where the device has it.
+		slot->buffer = create_buffer(
+				device,
+				allocator,
+				size,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		slot->size = size;
+	}
+	slot->extent = extent;
+	slot->format = format;
+	slot->frame_idx = frame_idx;
+	slot->frame_number = frame_number;
+
+	// The frame's fence makes the copy available to the host once the final
+	// barrier has made it visible there.
+	auto buffer = import_graph_buffer(
+			graph,
+			slot->buffer.handle,
+			GraphState{},
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_HOST_BIT,
+					.access = VK_ACCESS_2_HOST_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+	auto record = [&graph, slot, image, extent](VkCommandBuffer command_buffer) {
+		auto region = VkBufferImageCopy{
+				.bufferOffset = 0,
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource =
+						VkImageSubresourceLayers{
+								.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+								.mipLevel = 0,
+								.baseArrayLayer = 0,
+								.layerCount = 1},
+				.imageOffset = VkOffset3D{},
+				.imageExtent =
+						VkExtent3D{
+								.width = extent.width,
+								.height = extent.height,
+								.depth = 1}};
+		vkCmdCopyImageToBuffer(
+				command_buffer,
+				graph_image(graph, image),
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				slot->buffer.handle,
+				1,
+				&region);
+	};
+	auto pass = add_graph_pass(graph, "capture", record, true);
+	graph_read(
+			graph,
+			pass,
+			image,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL});
+	graph_write(
+			graph,
+			pass,
+			buffer,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+}
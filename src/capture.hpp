@@ -0,0 +1,111 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+#include "render_graph.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Frames kept for the encoder on top of the ones in flight, before capturing
+// either drops frames or waits for it.
+constexpr auto g_capture_spare_slots = size_t{2};
+// Frame rate written into Y4M headers.
+constexpr auto g_capture_frame_rate = 60U;
+
+enum class CaptureFormat {
+	// One file per frame, numbered after the frame.
+	png,
+	y4m,
+	// Bare RGB24 frames, for piping to an encoder.
+	raw,
+};
+
+enum class CaptureSlotState {
+	free,
+	// Filled by a frame still in flight.
+	copying,
+	// Waiting for or being written by the encoder thread.
+	encoding,
+};
+
+// A host visible buffer a frame copies its target into.
+struct CaptureSlot {
+	Buffer buffer;
+	VkDeviceSize size{};
+	VkExtent2D extent{};
+	VkFormat format{};
+	size_t frame_idx{};
+	size_t frame_number{};
+	CaptureSlotState state{};
+};
+
+// Copies frames into a ring of host visible buffers from within the frame's
+// command buffer and hands them to an encoder thread once the frame's fence
+// has passed, so capturing never waits on the GPU. Frames are converted to
+// 8-bit RGB on the encoder thread. When every slot is still with the encoder
+// a windowed run drops the frame, a blocking one waits, so benchmarks and
+// regression runs keep every frame.
+struct FrameCapture {
+	CaptureFormat format{};
+	std::filesystem::path path;
+	std::FILE* stream{};
+	bool piped{};
+	size_t interval{1};
+	bool block{};
+	size_t frame_number{};
+	size_t dropped{};
+	// Extent of the Y4M stream, taken from its first frame.
+	VkExtent2D stream_extent{};
+	std::vector<std::unique_ptr<CaptureSlot>> slots;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<CaptureSlot*> queue;
+	bool stopping{};
+	std::thread encoder;
+};
+
+// Formats the encoder converts, the 8-bit and 10-bit UNORM and SRGB ones.
+// Their samples are written as stored, so sRGB and PQ encoded frames keep
+// their encoding.
+auto capture_supported(VkFormat format) -> bool;
+
+// A target starting with | is a command the frames are piped to as raw
+// RGB24, otherwise its extension picks the format, .png, .y4m or raw for
+// any other. frame_count is the number of frames in flight.
+auto create_frame_capture(
+		std::string_view target,
+		size_t interval,
+		bool block,
+		size_t frame_count) -> std::unique_ptr<FrameCapture>;
+// The device must be idle. Frames still copying are encoded before the
+// encoder thread stops.
+void destroy_frame_capture(
+		VkDevice& device,
+		Allocator& allocator,
+		FrameCapture& capture);
+
+// Hands the frames frame_idx captured to the encoder. Called once its fence
+// has passed.
+void collect_captures(FrameCapture& capture, size_t frame_idx);
+// Adds a pass copying image into a capture slot when the interval is due.
+// image needs TRANSFER_SRC usage and a capture_supported format.
+void add_capture_pass(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph,
+		FrameCapture& capture,
+		size_t frame_idx,
+		uint32_t image,
+		VkExtent2D extent,
+		VkFormat format);
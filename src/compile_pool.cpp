@@ -0,0 +1,104 @@
+#include "compile_pool.hpp"
+
+#include "instrument.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Share of the cores that compile by default.
+constexpr auto g_compile_core_fraction = size_t{4};
+
+auto has_queued(const CompilePool& pool) -> bool {
+	return std::any_of(
+			pool.queues.begin(),
+			pool.queues.end(),
+			[](const auto& queue) { return !queue.empty(); });
+}
+
+void compile_main(CompilePool& pool, [[maybe_unused]] size_t thread_idx) {
+	VKDEMO_THREAD_NAME(fmt::format("compile {}", thread_idx).c_str());
+	auto lock = std::unique_lock(pool.mutex);
+	while (true) {
+		pool.wake.wait(lock, [&] { return pool.stopping || has_queued(pool); });
+		if (pool.stopping) {
+			return;
+		}
+		auto queue = std::find_if(
+				pool.queues.begin(),
+				pool.queues.end(),
+				[](const auto& candidate) { return !candidate.empty(); });
+		auto compile = std::move(queue->front());
+		queue->pop_front();
+		pool.running++;
+		lock.unlock();
+		compile();
+		lock.lock();
+		pool.running--;
+		if (pool.running == 0 && !has_queued(pool)) {
+			pool.idle.notify_all();
+		}
+	}
+}
+
+}  // namespace
+
+auto create_compile_pool(
+		size_t thread_count,
+		ThreadPlacement placement,
+		const CoreTopology& topology) -> std::unique_ptr<CompilePool> {
+	if (thread_count == 0) {
+		auto core_count =
+				std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		thread_count = std::max<size_t>(core_count / g_compile_core_fraction, 1);
+	}
+	// Without efficiency cores they share the performance cores.
+	const auto& cores = topology.efficiency.empty()
+			? topology.performance
+			: topology.efficiency;
+	auto pool = std::make_unique<CompilePool>();
+	pool->threads.reserve(thread_count);
+	for (auto i = size_t{}; i < thread_count; i++) {
+		auto& thread =
+				pool->threads.emplace_back(compile_main, std::ref(*pool), i);
+		if (placement == ThreadPlacement::core_types) {
+			set_thread_cores(thread, cores);
+		}
+	}
+	return pool;
+}
+
+void destroy_compile_pool(CompilePool& pool) {
+	{
+		auto lock = std::scoped_lock(pool.mutex);
+		pool.stopping = true;
+		for (auto& queue : pool.queues) {
+			queue.clear();
+		}
+	}
+	pool.wake.notify_all();
+	for (auto& thread : pool.threads) {
+		thread.join();
+	}
+	pool.threads.clear();
+}
+
+void queue_compile(
+		CompilePool& pool,
+		CompilePriority priority,
+		std::function<void()> compile) {
+	{
+		auto lock = std::scoped_lock(pool.mutex);
+		pool.queues.at(static_cast<size_t>(priority))
+				.emplace_back(std::move(compile));
+	}
+	pool.wake.notify_one();
+}
+
+void wait_for_compiles(CompilePool& pool) {
+	auto lock = std::unique_lock(pool.mutex);
+	pool.idle.wait(lock, [&] { return pool.running == 0 && !has_queued(pool); });
+}
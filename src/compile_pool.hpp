@@ -0,0 +1,59 @@
+#pragma once
+
+#include "thread_placement.hpp"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How soon a compiled pipeline is needed, most urgent first. Visible ones are
+// drawn as soon as they are ready, predicted ones are likely to be soon, such
+// as the passes of a toggle after their shaders were reloaded, and warmup
+// ones may never be.
+enum class CompilePriority {
+	visible,
+	predicted,
+	warmup,
+};
+
+constexpr auto g_compile_priority_count = size_t{3};
+
+// Threads that compile pipelines and nothing else, so compiles never hold up
+// the jobs a frame waits on, and a backlog of warmup never holds up what the
+// frame is missing: each thread takes the most urgent queued compile. The
+// compiles share one VkPipelineCache, so drivers that compile on threads of
+// their own can work on all of them at once.
+struct CompilePool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Notified when the last queued compile finished.
+	std::condition_variable idle;
+	std::array<std::deque<std::function<void()>>, g_compile_priority_count>
+			queues;
+	size_t running{};
+	bool stopping{};
+};
+
+// Zero thread_count picks a quarter of the cores, at least one. With core
+// types placement the threads run on the efficiency cores where there are
+// any.
+auto create_compile_pool(
+		size_t thread_count,
+		ThreadPlacement placement,
+		const CoreTopology& topology) -> std::unique_ptr<CompilePool>;
+// Drops the compiles that did not start and waits for the others.
+void destroy_compile_pool(CompilePool& pool);
+
+void queue_compile(
+		CompilePool& pool,
+		CompilePriority priority,
+		std::function<void()> compile);
+// Waits until every queued compile finished.
+void wait_for_compiles(CompilePool& pool);
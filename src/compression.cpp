@@ -0,0 +1,71 @@
+#include "compression.hpp"
+
+#include <fmt/core.h>
+
+#include <bit>
+
+auto image_compression_flags(ImageCompressionPolicy policy)
+		-> VkImageCompressionFlagsEXT {
+	switch (policy) {
+		case ImageCompressionPolicy::fixed_rate:
+			return VK_IMAGE_COMPRESSION_FIXED_RATE_DEFAULT_EXT;
+		case ImageCompressionPolicy::disabled:
+			return VK_IMAGE_COMPRESSION_DISABLED_EXT;
+		default:
+			return VK_IMAGE_COMPRESSION_DEFAULT_EXT;
+	}
+}
+
+auto image_compression_control(
+		VkImageCompressionFlagsEXT flags,
+		const void* next) -> VkImageCompressionControlEXT {
+	return VkImageCompressionControlEXT{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_CONTROL_EXT,
+			.pNext = next,
+			.flags = flags,
+			.compressionControlPlaneCount = 0,
+			.pFixedRateFlags = VK_NULL_HANDLE};
+}
+
+auto query_image_compression(
+		VkDevice device,
+		VkImage image,
+		VkImageAspectFlags aspect) -> VkImageCompressionPropertiesEXT {
+	auto compression = VkImageCompressionPropertiesEXT{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_COMPRESSION_PROPERTIES_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.imageCompressionFlags = 0,
+			.imageCompressionFixedRateFlags = 0};
+	auto layout = VkSubresourceLayout2EXT{
+			.sType = VK_STRUCTURE_TYPE_SUBRESOURCE_LAYOUT_2_EXT,
+			.pNext = &compression,
+			.subresourceLayout = {}};
+	auto subresource = VkImageSubresource2EXT{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_SUBRESOURCE_2_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.imageSubresource = VkImageSubresource{
+					.aspectMask = (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0
+							? VkImageAspectFlags{VK_IMAGE_ASPECT_DEPTH_BIT}
+							: aspect,
+					.mipLevel = 0,
+					.arrayLayer = 0}};
+	vkGetImageSubresourceLayout2EXT(device, image, &subresource, &layout);
+	return compression;
+}
+
+auto describe_image_compression(
+		const VkImageCompressionPropertiesEXT& compression) -> std::string {
+	auto flags = compression.imageCompressionFlags;
+	if ((flags & VK_IMAGE_COMPRESSION_DISABLED_EXT) != 0) {
+		return "none";
+	}
+	auto rates = compression.imageCompressionFixedRateFlags;
+	if ((flags & VK_IMAGE_COMPRESSION_FIXED_RATE_EXPLICIT_EXT) != 0 &&
+			rates != 0) {
+		// The lowest flag is 1 bit per component, each next one a bit more.
+		return fmt::format(
+				"fixed rate {} bits per component",
+				std::countr_zero(rates) + 1);
+	}
+	return "lossless";
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "config.hpp"
+#include "dispatch.hpp"
+
+#include <string>
+
+// What VkImageCompressionControlEXT asks for under policy.
+auto image_compression_flags(ImageCompressionPolicy policy)
+		-> VkImageCompressionFlagsEXT;
+
+// Chains flags in front of next, for VkImageCreateInfo or
+// VkSwapchainCreateInfoKHR. Fixed rates are left for the driver to pick.
+auto image_compression_control(
+		VkImageCompressionFlagsEXT flags,
+		const void* next) -> VkImageCompressionControlEXT;
+
+// The compression the driver gave image, which needs image compression
+// control. Depth stencil images are looked up by their depth aspect.
+auto query_image_compression(
+		VkDevice device,
+		VkImage image,
+		VkImageAspectFlags aspect) -> VkImageCompressionPropertiesEXT;
+
+// "lossless", "none" or the fixed rate, for logs.
+auto describe_image_compression(
+		const VkImageCompressionPropertiesEXT& compression) -> std::string;
@@ -0,0 +1,176 @@
+#include "compute.hpp"
+
+#include "debug_labels.hpp"
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace {
+
+auto create_compute_frame(
+		VkDevice& device,
+		uint32_t family_idx,
+		bool binary_semaphore) -> ComputeFrame {
+	auto frame = ComputeFrame{};
+	auto pool_info = VkCommandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = family_idx};
+	if (vkCreateCommandPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&frame.command_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create compute command pool\n");
+		std::terminate();
+	}
+	auto allocate_info = VkCommandBufferAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.commandPool = frame.command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1};
+	if (vkAllocateCommandBuffers(
+					device,
+					&allocate_info,
+					&frame.command_buffer) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate compute command buffer\n");
+		std::terminate();
+	}
+	if (!binary_semaphore) {
+		return frame;
+	}
+	auto semaphore_info = VkSemaphoreCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0};
+	if (vkCreateSemaphore(
+					device,
+					&semaphore_info,
+					host_callbacks(),
+					&frame.finished) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create compute semaphore\n");
+		std::terminate();
+	}
+	return frame;
+}
+
+}  // namespace
+
+auto create_compute_scheduler(
+		VkDevice& device,
+		uint32_t family_idx,
+		size_t frame_count,
+		bool synchronization2) -> ComputeScheduler {
+	auto scheduler = ComputeScheduler{};
+	scheduler.family_idx = family_idx;
+	scheduler.synchronization2 = synchronization2;
+	scheduler.timeline = create_queue_timeline(device, synchronization2);
+	vkGetDeviceQueue(device, family_idx, 0, &scheduler.queue);
+	scheduler.frames.reserve(frame_count);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		scheduler.frames.emplace_back(
+				create_compute_frame(device, family_idx, !synchronization2));
+	}
+	return scheduler;
+}
+
+void destroy_compute_scheduler(VkDevice& device, ComputeScheduler& scheduler) {
+	for (auto& frame : scheduler.frames) {
+		vkDestroySemaphore(device, frame.finished, host_callbacks());
+		vkDestroyCommandPool(device, frame.command_pool, host_callbacks());
+	}
+	scheduler.frames.clear();
+	scheduler.jobs.clear();
+	destroy_queue_timeline(device, scheduler.timeline);
+}
+
+void add_compute_job(ComputeScheduler& scheduler, ComputeJob job) {
+	scheduler.jobs.emplace_back(std::move(job));
+}
+
+auto record_compute(
+		VkDevice& device,
+		ComputeScheduler& scheduler,
+		size_t frame_idx,
+		std::vector<SemaphoreOp>& waits) -> std::optional<QueuedSubmission> {
+	if (scheduler.jobs.empty()) {
+		return std::nullopt;
+	}
+	auto& frame = scheduler.frames.at(frame_idx);
+	vkResetCommandPool(device, frame.command_pool, 0);
+	auto begin_info = VkCommandBufferBeginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.pInheritanceInfo = VK_NULL_HANDLE};
+	vkBeginCommandBuffer(frame.command_buffer, &begin_info);
+	auto consumer_stages = VkPipelineStageFlags2{};
+	for (auto& job : scheduler.jobs) {
+		auto pass = scheduler.profiler == nullptr
+				? g_gpu_pass_none
+				: begin_gpu_queue_pass(
+							*scheduler.profiler,
+							frame.command_buffer,
+							frame_idx,
+							job.name,
+							scheduler.timestamp_valid_bits);
+		begin_debug_label(frame.command_buffer, job.name);
+		job.record(frame.command_buffer, frame_idx);
+		end_debug_label(frame.command_buffer);
+		if (scheduler.profiler != nullptr) {
+			end_gpu_pass(*scheduler.profiler, frame.command_buffer, frame_idx, pass);
+		}
+		consumer_stages |= job.consumer_stage;
+	}
+	if (vkEndCommandBuffer(frame.command_buffer) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to record compute command buffer\n");
+		std::terminate();
+	}
+
+	auto signal = SemaphoreOp{
+			.semaphore = frame.finished,
+			.value = 0,
+			.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT};
+	if (scheduler.timeline.semaphore != VK_NULL_HANDLE) {
+		signal.semaphore = scheduler.timeline.semaphore;
+		signal.value = ++scheduler.timeline.value;
+	}
+	waits.emplace_back(SemaphoreOp{
+			.semaphore = signal.semaphore,
+			.value = signal.value,
+			.stages = consumer_stages});
+	auto submission = QueuedSubmission{};
+	submission.queue = scheduler.queue;
+	submission.command_buffers.emplace_back(frame.command_buffer);
+	submission.signals.emplace_back(signal);
+	return submission;
+}
+
+void submit_compute(
+		VkDevice& device,
+		ComputeScheduler& scheduler,
+		size_t frame_idx,
+		std::vector<SemaphoreOp>& waits) {
+	auto submission = record_compute(device, scheduler, frame_idx, waits);
+	if (!submission.has_value()) {
+		return;
+	}
+	if (submit_commands(
+					scheduler.synchronization2,
+					submission->queue,
+					submission->command_buffers,
+					{},
+					submission->signals,
+					VK_NULL_HANDLE,
+					0) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to submit compute command buffer\n");
+		std::terminate();
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "profiler.hpp"
+#include "sync.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Compute work recorded once per frame. consumer_stage is the first graphics
+// stage that reads the results; graphics work ahead of it overlaps with the
+// dispatches. Jobs run concurrently with the previous frame's rendering, so
+// anything graphics reads should be indexed by frame_idx, and resources
+// shared with graphics should use concurrent sharing.
+struct ComputeJob {
+	// Name of the job's GPU timing pass.
+	std::string name;
+	std::function<void(VkCommandBuffer command_buffer, size_t frame_idx)>
+			record;
+	VkPipelineStageFlags2 consumer_stage{VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT};
+};
+
+struct ComputeFrame {
+	VkCommandPool command_pool{};
+	VkCommandBuffer command_buffer{};
+	// Only used without timeline semaphores.
+	VkSemaphore finished{};
+};
+
+// Runs compute jobs on an async compute queue when the device has one, and as
+// a separate submission on the graphics queue otherwise.
+struct ComputeScheduler {
+	VkQueue queue{};
+	uint32_t family_idx{};
+	bool synchronization2{};
+	QueueTimeline timeline;
+	std::vector<ComputeFrame> frames;
+	std::vector<ComputeJob> jobs;
+	// Times every job when set, unless the family's timestamps have no valid
+	// bits.
+	GpuProfiler* profiler{};
+	uint32_t timestamp_valid_bits{};
+};
+
+auto create_compute_scheduler(
+		VkDevice& device,
+		uint32_t family_idx,
+		size_t frame_count,
+		bool synchronization2) -> ComputeScheduler;
+// The device must be idle.
+void destroy_compute_scheduler(VkDevice& device, ComputeScheduler& scheduler);
+
+void add_compute_job(ComputeScheduler& scheduler, ComputeJob job);
+
+// Records and submits the jobs for a frame slot and appends the wait the
+// graphics submission of that frame needs. The graphics submission that last
+// waited on this slot must have finished, which waiting for the frame
+// guarantees. Does nothing when there are no jobs.
+void submit_compute(
+		VkDevice& device,
+		ComputeScheduler& scheduler,
+		size_t frame_idx,
+		std::vector<SemaphoreOp>& waits);
+// Records like submit_compute but leaves submitting to the caller, which
+// has to submit before the graphics submission that waits on it.
+auto record_compute(
+		VkDevice& device,
+		ComputeScheduler& scheduler,
+		size_t frame_idx,
+		std::vector<SemaphoreOp>& waits) -> std::optional<QueuedSubmission>;
@@ -0,0 +1,973 @@
+#include "config.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+constexpr auto g_present_policy_names =
+		std::array<std::pair<PresentPolicy, std::string_view>, 4>{{
+				{PresentPolicy::low_latency, "low-latency"},
+				{PresentPolicy::vsync, "vsync"},
+				{PresentPolicy::adaptive, "adaptive"},
+				{PresentPolicy::uncapped, "uncapped"},
+		}};
+static_assert(g_present_policy_names.size() == g_present_policy_count);
+
+constexpr auto g_output_policy_names =
+		std::array<std::pair<OutputPolicy, std::string_view>, 3>{{
+				{OutputPolicy::sdr, "sdr"},
+				{OutputPolicy::hdr10, "hdr10"},
+				{OutputPolicy::scrgb, "scrgb"},
+		}};
+
+constexpr auto g_shading_rate_policy_names =
+		std::array<std::pair<ShadingRatePolicy, std::string_view>, 3>{{
+				{ShadingRatePolicy::off, "off"},
+				{ShadingRatePolicy::foveated, "foveated"},
+				{ShadingRatePolicy::content, "content"},
+		}};
+
+constexpr auto g_image_compression_policy_names =
+		std::array<std::pair<ImageCompressionPolicy, std::string_view>, 3>{{
+				{ImageCompressionPolicy::driver, "driver"},
+				{ImageCompressionPolicy::fixed_rate, "fixed-rate"},
+				{ImageCompressionPolicy::disabled, "disabled"},
+		}};
+
+constexpr auto g_stress_scene_names =
+		std::array<std::pair<StressScene, std::string_view>, 6>{{
+				{StressScene::none, "none"},
+				{StressScene::cubes, "cubes"},
+				{StressScene::meshes, "meshes"},
+				{StressScene::lights, "lights"},
+				{StressScene::overdraw, "overdraw"},
+				{StressScene::streaming, "streaming"},
+		}};
+
+constexpr auto g_validation_profile_names =
+		std::array<std::pair<ValidationProfile, std::string_view>, 5>{{
+				{ValidationProfile::full, "full"},
+				{ValidationProfile::fast, "fast"},
+				{ValidationProfile::sync, "sync"},
+				{ValidationProfile::gpu, "gpu"},
+				{ValidationProfile::best_practices, "best-practices"},
+		}};
+
+constexpr auto g_log_level_names =
+		std::array<std::pair<LogLevel, std::string_view>, 4>{{
+				{LogLevel::debug, "debug"},
+				{LogLevel::info, "info"},
+				{LogLevel::warning, "warning"},
+				{LogLevel::error, "error"},
+		}};
+
+constexpr auto g_thread_placement_names =
+		std::array<std::pair<ThreadPlacement, std::string_view>, 3>{{
+				{ThreadPlacement::shared, "shared"},
+				{ThreadPlacement::pinned, "pinned"},
+				{ThreadPlacement::core_types, "core-types"},
+		}};
+
+void usage_error(std::string_view message, std::string_view value) {
+	fmt::print(stderr, "{}: {}\n", message, value);
+	std::terminate();
+}
+
+void set_present_policy(Config& config, std::string_view value) {
+	auto policy = parse_present_policy(value);
+	if (!policy.has_value()) {
+		usage_error("Unknown present mode policy", value);
+	}
+	config.present_policy = *policy;
+}
+
+void set_output_policy(Config& config, std::string_view value) {
+	auto policy = parse_output_policy(value);
+	if (!policy.has_value()) {
+		usage_error("Unknown output policy", value);
+	}
+	config.output_policy = *policy;
+}
+
+void set_shading_rate_policy(Config& config, std::string_view value) {
+	auto policy = parse_shading_rate_policy(value);
+	if (!policy.has_value()) {
+		usage_error("Unknown shading rate policy", value);
+	}
+	config.shading_rate_policy = *policy;
+}
+
+void set_image_compression_policy(Config& config, std::string_view value) {
+	auto policy = parse_image_compression_policy(value);
+	if (!policy.has_value()) {
+		usage_error("Unknown image compression policy", value);
+	}
+	config.image_compression = *policy;
+}
+
+void set_stress_scene(Config& config, std::string_view value) {
+	auto scene = parse_stress_scene(value);
+	if (!scene.has_value()) {
+		usage_error("Unknown stress scene", value);
+	}
+	config.stress_scene = *scene;
+}
+
+void set_validation_profile(Config& config, std::string_view value) {
+	auto profile = parse_validation_profile(value);
+	if (!profile.has_value()) {
+		usage_error("Unknown validation profile", value);
+	}
+	config.validation_profile = *profile;
+}
+
+void set_log_level(Config& config, std::string_view value) {
+	auto level = parse_log_level(value);
+	if (!level.has_value()) {
+		usage_error("Unknown log level", value);
+	}
+	config.log_level = *level;
+}
+
+void set_thread_placement(Config& config, std::string_view value) {
+	auto placement = parse_thread_placement(value);
+	if (!placement.has_value()) {
+		usage_error("Unknown thread placement", value);
+	}
+	config.thread_placement = *placement;
+}
+
+// Scenes that bring their own mesh replace --mesh.
+void apply_stress_scene(Config& config) {
+	switch (config.stress_scene) {
+		case StressScene::none:
+			break;
+		case StressScene::cubes:
+			config.mesh.clear();
+			config.instances = 100000;
+			break;
+		case StressScene::meshes:
+			config.mesh.clear();
+			config.instances = 1;
+			break;
+		case StressScene::lights:
+			config.mesh.clear();
+			config.lights = 5000;
+			break;
+		case StressScene::overdraw:
+			config.mesh.clear();
+			config.particles = size_t{1} << 20U;
+			config.post_process = true;
+			config.weighted_oit = true;
+			break;
+		case StressScene::streaming:
+			if (config.texture.empty()) {
+				fmt::print(
+						stderr,
+						"The streaming scene needs --texture, flying over the mesh "
+						"alone\n");
+			}
+			break;
+	}
+}
+
+// A comma separated list of paths.
+auto split_paths(std::string_view list) -> std::vector<std::filesystem::path> {
+	auto paths = std::vector<std::filesystem::path>{};
+	while (!list.empty()) {
+		auto end = std::min(list.find(','), list.size());
+		if (end != 0) {
+			paths.emplace_back(list.substr(0, end));
+		}
+		list.remove_prefix(std::min(end + 1, list.size()));
+	}
+	return paths;
+}
+
+auto parse_count(std::string_view message, std::string_view value) -> size_t {
+	auto count = size_t{};
+	auto [end, error] =
+			std::from_chars(value.data(), value.data() + value.size(), count);
+	if (error != std::errc{} || end != value.data() + value.size()) {
+		usage_error(message, value);
+	}
+	return count;
+}
+
+void set_msaa_samples(Config& config, std::string_view value) {
+	auto samples = parse_count("Invalid MSAA sample count", value);
+	if (samples != 1 && samples != 2 && samples != 4 && samples != 8) {
+		usage_error("MSAA sample count must be 1, 2, 4 or 8", value);
+	}
+	config.msaa_samples = static_cast<uint32_t>(samples);
+}
+
+// Follows the XDG base directory spec, falling back to the working directory
+// when no home directory is known.
+auto default_cache_dir() -> std::filesystem::path {
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr) {
+		return std::filesystem::path(xdg) / "vulkan-demo";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* home = std::getenv("HOME"); home != nullptr) {
+		return std::filesystem::path(home) / ".cache" / "vulkan-demo";
+	}
+	return ".cache";
+}
+
+}  // namespace
+
+auto parse_present_policy(std::string_view name)
+		-> std::optional<PresentPolicy> {
+	for (const auto& [policy, policy_name] : g_present_policy_names) {
+		if (policy_name == name) {
+			return policy;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(PresentPolicy policy) -> std::string_view {
+	for (const auto& [candidate, name] : g_present_policy_names) {
+		if (candidate == policy) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto next_present_policy(PresentPolicy policy) -> PresentPolicy {
+	auto idx = static_cast<int>(policy);
+	return static_cast<PresentPolicy>((idx + 1) % g_present_policy_count);
+}
+
+auto parse_output_policy(std::string_view name)
+		-> std::optional<OutputPolicy> {
+	for (const auto& [policy, policy_name] : g_output_policy_names) {
+		if (policy_name == name) {
+			return policy;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(OutputPolicy policy) -> std::string_view {
+	for (const auto& [candidate, name] : g_output_policy_names) {
+		if (candidate == policy) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_shading_rate_policy(std::string_view name)
+		-> std::optional<ShadingRatePolicy> {
+	for (const auto& [policy, policy_name] : g_shading_rate_policy_names) {
+		if (policy_name == name) {
+			return policy;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(ShadingRatePolicy policy) -> std::string_view {
+	for (const auto& [candidate, name] : g_shading_rate_policy_names) {
+		if (candidate == policy) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_image_compression_policy(std::string_view name)
+		-> std::optional<ImageCompressionPolicy> {
+	for (const auto& [policy, policy_name] : g_image_compression_policy_names) {
+		if (policy_name == name) {
+			return policy;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(ImageCompressionPolicy policy) -> std::string_view {
+	for (const auto& [candidate, name] : g_image_compression_policy_names) {
+		if (candidate == policy) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_stress_scene(std::string_view name) -> std::optional<StressScene> {
+	for (const auto& [scene, scene_name] : g_stress_scene_names) {
+		if (scene_name == name) {
+			return scene;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(StressScene scene) -> std::string_view {
+	for (const auto& [candidate, name] : g_stress_scene_names) {
+		if (candidate == scene) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_validation_profile(std::string_view name)
+		-> std::optional<ValidationProfile> {
+	for (const auto& [profile, profile_name] : g_validation_profile_names) {
+		if (profile_name == name) {
+			return profile;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(ValidationProfile profile) -> std::string_view {
+	for (const auto& [candidate, name] : g_validation_profile_names) {
+		if (candidate == profile) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_log_level(std::string_view name) -> std::optional<LogLevel> {
+	for (const auto& [level, level_name] : g_log_level_names) {
+		if (level_name == name) {
+			return level;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(LogLevel level) -> std::string_view {
+	for (const auto& [candidate, name] : g_log_level_names) {
+		if (candidate == level) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_thread_placement(std::string_view name)
+		-> std::optional<ThreadPlacement> {
+	for (const auto& [placement, placement_name] : g_thread_placement_names) {
+		if (placement_name == name) {
+			return placement;
+		}
+	}
+	return std::nullopt;
+}
+
+auto to_string(ThreadPlacement placement) -> std::string_view {
+	for (const auto& [candidate, name] : g_thread_placement_names) {
+		if (candidate == placement) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+auto parse_config(std::span<char*> args) -> Config {
+	auto config = Config{};
+	config.cache_dir = default_cache_dir();
+
+	// NOLINTNEXTLINE(concurrency-mt-unsafe) read before any threads start
+	if (const auto* env = std::getenv("VKDEMO_PRESENT_MODE"); env != nullptr) {
+		set_present_policy(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_OUTPUT"); env != nullptr) {
+		set_output_policy(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHADING_RATE"); env != nullptr) {
+		set_shading_rate_policy(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_IMAGE_COMPRESSION");
+			env != nullptr) {
+		set_image_compression_policy(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_GPU"); env != nullptr) {
+		config.gpu = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_CACHE_DIR"); env != nullptr) {
+		config.cache_dir = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHARED_PIPELINE_CACHE");
+			env != nullptr) {
+		config.shared_pipeline_cache_dir = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHADER_DIR"); env != nullptr) {
+		config.shader_dir = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHADER_SOURCES"); env != nullptr) {
+		config.shader_source_dir = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_THREADS"); env != nullptr) {
+		config.job_threads = parse_count("Invalid thread count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PIN_THREADS"); env != nullptr) {
+		config.thread_placement = std::string_view(env) != "0"
+				? ThreadPlacement::pinned
+				: ThreadPlacement::shared;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_THREAD_PLACEMENT");
+			env != nullptr) {
+		set_thread_placement(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_COMPILE_THREADS");
+			env != nullptr) {
+		config.compile_threads =
+				parse_count("Invalid compile thread count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHADER_OBJECTS");
+			env != nullptr) {
+		config.shader_objects = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DESCRIPTOR_BUFFERS");
+			env != nullptr) {
+		config.descriptor_buffers = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_THREAD_PRIORITY");
+			env != nullptr) {
+		config.raise_thread_priority = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_GPU_STATS"); env != nullptr) {
+		config.gpu_statistics = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PERF_COUNTERS"); env != nullptr) {
+		config.performance_counters = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_INDIRECT"); env != nullptr) {
+		config.indirect_draws = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_OCCLUSION_CULLING");
+			env != nullptr) {
+		config.occlusion_culling = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DGC"); env != nullptr) {
+		config.device_generated_commands = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DEPTH_PREPASS"); env != nullptr) {
+		config.depth_prepass = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MESH_SHADING"); env != nullptr) {
+		config.mesh_shading = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_RAY_QUERY"); env != nullptr) {
+		config.ray_query = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_VISIBILITY_BUFFER");
+			env != nullptr) {
+		config.visibility_buffer = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DEFERRED"); env != nullptr) {
+		config.deferred = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_AMBIENT_OCCLUSION");
+			env != nullptr) {
+		config.ambient_occlusion = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_FOG"); env != nullptr) {
+		config.fog = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SHADOWS"); env != nullptr) {
+		config.shadows = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PICK"); env != nullptr) {
+		config.picking = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_TEMPORAL_AA"); env != nullptr) {
+		config.temporal_aa = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_FRAME_PACING"); env != nullptr) {
+		config.frame_pacing = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MAX_FPS"); env != nullptr) {
+		config.max_frame_rate = parse_count("Invalid frame rate", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HIGH_PRIORITY"); env != nullptr) {
+		config.high_queue_priority = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_ON_DEMAND"); env != nullptr) {
+		config.redraw_on_demand = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PRE_ROTATE"); env != nullptr) {
+		config.pre_rotate = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_STEREO"); env != nullptr) {
+		config.stereo = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SUBMIT_THREAD"); env != nullptr) {
+		config.submit_thread = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_QUANTIZE"); env != nullptr) {
+		config.quantize_vertices = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_INSTANCES"); env != nullptr) {
+		config.instances = parse_count("Invalid instance count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_BAKED_DRAWS"); env != nullptr) {
+		config.baked_draws = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_LIGHTS"); env != nullptr) {
+		config.lights = parse_count("Invalid light count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DECALS"); env != nullptr) {
+		config.decals = parse_count("Invalid decal count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PARTICLES"); env != nullptr) {
+		config.particles = parse_count("Invalid particle count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_OIT"); env != nullptr) {
+		config.weighted_oit = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MSAA"); env != nullptr) {
+		set_msaa_samples(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DYNAMIC_RESOLUTION");
+			env != nullptr) {
+		config.dynamic_resolution = parse_count("Invalid frame rate", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_POST"); env != nullptr) {
+		config.post_process = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_GPU_STATS_CSV"); env != nullptr) {
+		config.gpu_stats_csv = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_BENCHMARK"); env != nullptr) {
+		config.benchmark_frames = parse_count("Invalid frame count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_BENCHMARK_REPORT");
+			env != nullptr) {
+		config.benchmark_report = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DEVICE_GROUP"); env != nullptr) {
+		config.device_group = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_WINDOWS"); env != nullptr) {
+		config.windows = parse_count("Invalid window count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_FULLSCREEN"); env != nullptr) {
+		config.fullscreen = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_DISPLAY"); env != nullptr) {
+		config.display = parse_count("Invalid display index", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_FRAMES"); env != nullptr) {
+		config.frame_count = parse_count("Invalid frame count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SIMULATION_RATE"); env != nullptr) {
+		config.simulation_rate = parse_count("Invalid simulation rate", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HEADLESS"); env != nullptr) {
+		config.headless = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_CAPTURE"); env != nullptr) {
+		config.capture = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_CAPTURE_INTERVAL");
+			env != nullptr) {
+		config.capture_interval = parse_count("Invalid capture interval", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_TRACE"); env != nullptr) {
+		config.trace = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SCENE"); env != nullptr) {
+		set_stress_scene(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MICROBENCH"); env != nullptr) {
+		config.microbenchmarks = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HITCH"); env != nullptr) {
+		config.hitch_threshold = parse_count("Invalid hitch threshold", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HITCH_DIR"); env != nullptr) {
+		config.hitch_dir = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_TELEMETRY"); env != nullptr) {
+		config.telemetry = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_VALIDATION"); env != nullptr) {
+		set_validation_profile(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_LOG_LEVEL"); env != nullptr) {
+		set_log_level(config, env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_TEXTURE"); env != nullptr) {
+		config.texture = {env};
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_REFLECTION_PROBES");
+			env != nullptr) {
+		config.reflection_probes =
+				parse_count("Invalid reflection probe count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MEMORY_BUDGET"); env != nullptr) {
+		config.memory_budget = parse_count("Invalid memory budget", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HOST_ALLOCATOR"); env != nullptr) {
+		config.host_allocator = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_HUGE_PAGES"); env != nullptr) {
+		config.huge_pages = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_MESH"); env != nullptr) {
+		config.mesh = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SPARSE_GEOMETRY"); env != nullptr) {
+		config.sparse_geometry = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_POINT_CLOUD"); env != nullptr) {
+		config.point_cloud = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_PAGED_SCENE"); env != nullptr) {
+		config.paged_scene = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SCENE_CACHE"); env != nullptr) {
+		config.scene_cache_cells = parse_count("Invalid scene cache size", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_LINES"); env != nullptr) {
+		config.line_width = parse_count("Invalid line width", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_TERRAIN"); env != nullptr) {
+		config.terrain = env;
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_VIRTUAL_TEXTURE"); env != nullptr) {
+		config.virtual_texture = std::string_view(env) != "0";
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_IMPOSTORS"); env != nullptr) {
+		config.impostor_pixels = parse_count("Invalid impostor size", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_SKIN"); env != nullptr) {
+		config.skin_joints = parse_count("Invalid joint count", env);
+	}
+	// NOLINTNEXTLINE(concurrency-mt-unsafe)
+	if (const auto* env = std::getenv("VKDEMO_OVERLAY"); env != nullptr) {
+		config.overlay = std::string_view(env) != "0";
+	}
+
+	for (auto i = size_t{1}; i < args.size(); i++) {
+		auto arg = std::string_view(args[i]);
+		auto has_value = i + 1 < args.size();
+		if (arg == "--present-mode" && has_value) {
+			set_present_policy(config, args[++i]);
+		} else if (arg == "--output" && has_value) {
+			set_output_policy(config, args[++i]);
+		} else if (arg == "--shading-rate" && has_value) {
+			set_shading_rate_policy(config, args[++i]);
+		} else if (arg == "--image-compression" && has_value) {
+			set_image_compression_policy(config, args[++i]);
+		} else if (arg == "--gpu" && has_value) {
+			config.gpu = args[++i];
+		} else if (arg == "--cache-dir" && has_value) {
+			config.cache_dir = args[++i];
+		} else if (arg == "--shared-pipeline-cache" && has_value) {
+			config.shared_pipeline_cache_dir = args[++i];
+		} else if (arg == "--shader-dir" && has_value) {
+			config.shader_dir = args[++i];
+		} else if (arg == "--shader-sources" && has_value) {
+			config.shader_source_dir = args[++i];
+		} else if (arg == "--threads" && has_value) {
+			config.job_threads = parse_count("Invalid thread count", args[++i]);
+		} else if (arg == "--pin-threads") {
+			config.thread_placement = ThreadPlacement::pinned;
+		} else if (arg == "--thread-placement" && has_value) {
+			set_thread_placement(config, args[++i]);
+		} else if (arg == "--compile-threads" && has_value) {
+			config.compile_threads =
+					parse_count("Invalid compile thread count", args[++i]);
+		} else if (arg == "--shader-objects") {
+			config.shader_objects = true;
+		} else if (arg == "--descriptor-buffers") {
+			config.descriptor_buffers = true;
+		} else if (arg == "--thread-priority") {
+			config.raise_thread_priority = true;
+		} else if (arg == "--gpu-stats") {
+			config.gpu_statistics = true;
+		} else if (arg == "--perf-counters" && has_value) {
+			config.performance_counters = args[++i];
+		} else if (arg == "--indirect") {
+			config.indirect_draws = true;
+		} else if (arg == "--occlusion-culling") {
+			config.occlusion_culling = true;
+		} else if (arg == "--dgc") {
+			config.device_generated_commands = true;
+		} else if (arg == "--depth-prepass") {
+			config.depth_prepass = true;
+		} else if (arg == "--mesh-shading") {
+			config.mesh_shading = true;
+		} else if (arg == "--ray-query") {
+			config.ray_query = true;
+		} else if (arg == "--visibility-buffer") {
+			config.visibility_buffer = true;
+		} else if (arg == "--deferred") {
+			config.deferred = true;
+		} else if (arg == "--ambient-occlusion") {
+			config.ambient_occlusion = true;
+		} else if (arg == "--fog") {
+			config.fog = true;
+		} else if (arg == "--shadows") {
+			config.shadows = true;
+		} else if (arg == "--pick") {
+			config.picking = true;
+		} else if (arg == "--temporal-aa") {
+			config.temporal_aa = true;
+		} else if (arg == "--frame-pacing") {
+			config.frame_pacing = true;
+		} else if (arg == "--max-fps" && has_value) {
+			config.max_frame_rate = parse_count("Invalid frame rate", args[++i]);
+		} else if (arg == "--high-priority") {
+			config.high_queue_priority = true;
+		} else if (arg == "--on-demand") {
+			config.redraw_on_demand = true;
+		} else if (arg == "--pre-rotate") {
+			config.pre_rotate = true;
+		} else if (arg == "--stereo") {
+			config.stereo = true;
+		} else if (arg == "--submit-thread") {
+			config.submit_thread = true;
+		} else if (arg == "--quantize") {
+			config.quantize_vertices = true;
+		} else if (arg == "--instances" && has_value) {
+			config.instances = parse_count("Invalid instance count", args[++i]);
+		} else if (arg == "--baked-draws") {
+			config.baked_draws = true;
+		} else if (arg == "--lights" && has_value) {
+			config.lights = parse_count("Invalid light count", args[++i]);
+		} else if (arg == "--decals" && has_value) {
+			config.decals = parse_count("Invalid decal count", args[++i]);
+		} else if (arg == "--particles" && has_value) {
+			config.particles = parse_count("Invalid particle count", args[++i]);
+		} else if (arg == "--oit") {
+			config.weighted_oit = true;
+		} else if (arg == "--msaa" && has_value) {
+			set_msaa_samples(config, args[++i]);
+		} else if (arg == "--dynamic-resolution" && has_value) {
+			config.dynamic_resolution =
+					parse_count("Invalid frame rate", args[++i]);
+		} else if (arg == "--post") {
+			config.post_process = true;
+		} else if (arg == "--gpu-stats-csv" && has_value) {
+			config.gpu_stats_csv = args[++i];
+		} else if (arg == "--benchmark" && has_value) {
+			config.benchmark_frames = parse_count("Invalid frame count", args[++i]);
+		} else if (arg == "--benchmark-report" && has_value) {
+			config.benchmark_report = args[++i];
+		} else if (arg == "--device-group") {
+			config.device_group = true;
+		} else if (arg == "--windows" && has_value) {
+			config.windows = parse_count("Invalid window count", args[++i]);
+		} else if (arg == "--fullscreen") {
+			config.fullscreen = true;
+		} else if (arg == "--display" && has_value) {
+			config.display = parse_count("Invalid display index", args[++i]);
+		} else if (arg == "--frames" && has_value) {
+			config.frame_count = parse_count("Invalid frame count", args[++i]);
+		} else if (arg == "--simulation-rate" && has_value) {
+			config.simulation_rate =
+					parse_count("Invalid simulation rate", args[++i]);
+		} else if (arg == "--headless") {
+			config.headless = true;
+		} else if (arg == "--capture" && has_value) {
+			config.capture = args[++i];
+		} else if (arg == "--capture-interval" && has_value) {
+			config.capture_interval =
+					parse_count("Invalid capture interval", args[++i]);
+		} else if (arg == "--trace" && has_value) {
+			config.trace = args[++i];
+		} else if (arg == "--scene" && has_value) {
+			set_stress_scene(config, args[++i]);
+		} else if (arg == "--microbench" && has_value) {
+			config.microbenchmarks = args[++i];
+		} else if (arg == "--hitch" && has_value) {
+			config.hitch_threshold =
+					parse_count("Invalid hitch threshold", args[++i]);
+		} else if (arg == "--hitch-dir" && has_value) {
+			config.hitch_dir = args[++i];
+		} else if (arg == "--telemetry" && has_value) {
+			config.telemetry = args[++i];
+		} else if (arg == "--validation" && has_value) {
+			set_validation_profile(config, args[++i]);
+		} else if (arg == "--log-level" && has_value) {
+			set_log_level(config, args[++i]);
+		} else if (arg == "--texture" && has_value) {
+			config.texture.emplace_back(args[++i]);
+		} else if (arg == "--environment" && has_value) {
+			config.environment.emplace_back(args[++i]);
+		} else if (arg == "--reflection-probes" && has_value) {
+			config.reflection_probes =
+					parse_count("Invalid reflection probe count", args[++i]);
+		} else if (arg == "--memory-budget" && has_value) {
+			config.memory_budget = parse_count("Invalid memory budget", args[++i]);
+		} else if (arg == "--host-allocator") {
+			config.host_allocator = true;
+		} else if (arg == "--huge-pages") {
+			config.huge_pages = true;
+		} else if (arg == "--mesh" && has_value) {
+			config.mesh = args[++i];
+		} else if (arg == "--cook-mesh" && i + 2 < args.size()) {
+			config.cook_mesh_input = args[++i];
+			config.cook_mesh_output = args[++i];
+		} else if (arg == "--compress-mesh") {
+			config.compress_mesh = true;
+		} else if (arg == "--sparse-geometry") {
+			config.sparse_geometry = true;
+		} else if (arg == "--point-cloud" && has_value) {
+			config.point_cloud = args[++i];
+		} else if (arg == "--cook-point-cloud" && i + 2 < args.size()) {
+			config.cook_point_cloud_input = args[++i];
+			config.cook_point_cloud_output = args[++i];
+		} else if (arg == "--paged-scene" && has_value) {
+			config.paged_scene = args[++i];
+		} else if (arg == "--scene-cache" && has_value) {
+			config.scene_cache_cells =
+					parse_count("Invalid scene cache size", args[++i]);
+		} else if (arg == "--cook-paged-scene" && i + 2 < args.size()) {
+			config.cook_paged_scene_input = args[++i];
+			config.cook_paged_scene_output = args[++i];
+		} else if (arg == "--lines" && has_value) {
+			config.line_width = parse_count("Invalid line width", args[++i]);
+		} else if (arg == "--line-dash" && has_value) {
+			config.line_dash = parse_count("Invalid line dash", args[++i]);
+		} else if (arg == "--terrain" && has_value) {
+			config.terrain = args[++i];
+		} else if (arg == "--virtual-texture") {
+			config.virtual_texture = true;
+		} else if (arg == "--impostors" && has_value) {
+			config.impostor_pixels = parse_count("Invalid impostor size", args[++i]);
+		} else if (arg == "--skin" && has_value) {
+			config.skin_joints = parse_count("Invalid joint count", args[++i]);
+		} else if (arg == "--overlay") {
+			config.overlay = true;
+		} else if (arg == "--archive" && has_value) {
+			config.archive = args[++i];
+		} else if (arg == "--pack-archive" && i + 2 < args.size()) {
+			config.pack_archive_input = args[++i];
+			config.pack_archive_output = args[++i];
+		} else if (arg == "--compress-archive") {
+			config.compress_archive = true;
+		} else if (arg == "--compare" && i + 2 < args.size()) {
+			config.compare_baseline = split_paths(args[++i]);
+			config.compare_candidate = split_paths(args[++i]);
+		} else {
+			usage_error("Unknown or incomplete argument", arg);
+		}
+	}
+	apply_stress_scene(config);
+	if (config.instances == 0) {
+		usage_error("Instance count must be positive", "--instances");
+	}
+	if (config.scene_cache_cells == 0) {
+		usage_error("Scene cache size must be positive", "--scene-cache");
+	}
+	if (config.windows == 0) {
+		usage_error("Window count must be positive", "--windows");
+	}
+	if (config.capture_interval == 0) {
+		usage_error("Capture interval must be positive", "--capture-interval");
+	}
+	if (config.compare_baseline.empty() != config.compare_candidate.empty()) {
+		usage_error("Comparing needs reports of both builds", "--compare");
+	}
+	// Nothing would ever stop a run without a window.
+	if (config.headless && config.benchmark_frames == 0 &&
+			config.frame_count == 0) {
+		usage_error("Headless mode needs a frame count", "--frames");
+	}
+	return config;
+}
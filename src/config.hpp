@@ -0,0 +1,421 @@
+#pragma once
+
+#include "log.hpp"
+#include "thread_placement.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class PresentPolicy {
+	low_latency,
+	vsync,
+	adaptive,
+	uncapped,
+};
+
+constexpr auto g_present_policy_count = 4;
+
+// What the swap chain images hold. SDR takes 10-bit formats when the post
+// composite can encode them, so gradients need no dither, and 8-bit sRGB
+// otherwise. HDR10 is 10-bit PQ with BT.2020 primaries, also encoded by the
+// post composite. scRGB is linear FP16 with BT.709 primaries. Both HDR
+// policies need VK_EXT_swapchain_colorspace and fall back to SDR.
+enum class OutputPolicy {
+	sdr,
+	hdr10,
+	scrgb,
+};
+
+// Where the main pass shades at less than one fragment per pixel, with a
+// shading rate image on devices with VK_KHR_fragment_shading_rate. Foveated
+// keeps full rate around the center of the view and coarsens towards the
+// edges, for head mounted displays. Content coarsens where the last frame was
+// flat, judged by the luminance contrast of each image texel's pixels.
+enum class ShadingRatePolicy {
+	off,
+	foveated,
+	content,
+};
+
+// How render targets and swap chain images are compressed, on devices with
+// VK_EXT_image_compression_control and its swap chain counterpart. Driver
+// leaves it to the driver, which usually picks lossless framebuffer
+// compression where the format has it. Fixed rate asks for lossy
+// compression at a rate the driver picks, which saves more bandwidth on GPUs
+// that have it. Disabled turns compression off, to measure what it saves.
+enum class ImageCompressionPolicy {
+	driver,
+	fixed_rate,
+	disabled,
+};
+
+// Procedural scenes for benchmark runs, see src/stress_scene.hpp. Cubes
+// draws 100k instanced cubes, meshes 10k unique meshes, lights shades a
+// plane covering the view with 5k clustered lights, overdraw blends a
+// million particles with weighted blended transparency and streaming flies
+// towards the texture given with --texture. Each overrides the options it
+// sets and moves the camera along a fixed path by frame, so runs of one
+// scene render the same frames.
+enum class StressScene {
+	none,
+	cubes,
+	meshes,
+	lights,
+	overdraw,
+	streaming,
+};
+
+// Checks the validation layers of debug builds run. Full is the layer's
+// defaults. Fast keeps the core and parameter checks but skips thread safety,
+// handle wrapping and shader validation, for usable frame rates day to day.
+// Sync adds synchronization validation, gpu GPU-assisted validation of
+// shader accesses and best-practices the layer's performance and portability
+// advice, each on top of the defaults.
+enum class ValidationProfile {
+	full,
+	fast,
+	sync,
+	gpu,
+	best_practices,
+};
+
+struct Config {
+	PresentPolicy present_policy = PresentPolicy::vsync;
+	OutputPolicy output_policy = OutputPolicy::sdr;
+	ShadingRatePolicy shading_rate_policy = ShadingRatePolicy::off;
+	ImageCompressionPolicy image_compression = ImageCompressionPolicy::driver;
+	StressScene stress_scene = StressScene::none;
+	ValidationProfile validation_profile = ValidationProfile::full;
+	// Physical device index or case-insensitive name substring, empty to pick
+	// the best scoring device.
+	std::string gpu;
+	std::filesystem::path cache_dir;
+	// Pipeline cache directory shared with other processes on the host, see
+	// SharedPipelineCache. Empty for none.
+	std::filesystem::path shared_pipeline_cache_dir;
+	// Directory of .spv files to load instead of the embedded SPIR-V.
+	std::filesystem::path shader_dir;
+	// GLSL sources to watch while running, empty to disable. A changed shader
+	// is recompiled with glslc and the pipelines using it are rebuilt.
+	std::filesystem::path shader_source_dir;
+	// Job system threads, including the main thread. Zero uses one per core.
+	size_t job_threads{};
+	ThreadPlacement thread_placement = ThreadPlacement::shared;
+	// Threads compiling pipelines in the background, apart from the job
+	// system. Zero uses a quarter of the cores.
+	size_t compile_threads{};
+	// Draws with shader objects, bound with all of their state set while
+	// recording, where a pipeline is not compiled yet. Needs
+	// VK_EXT_shader_object.
+	bool shader_objects{};
+	// Writes the descriptors of the post-processing, shading rate,
+	// transparency and temporal passes into buffers and binds them by offset,
+	// instead of allocating sets. Needs VK_EXT_descriptor_buffer.
+	bool descriptor_buffers{};
+	// Raises the priority of the main thread, which records and submits the
+	// frames, if the process may.
+	bool raise_thread_priority{};
+	// Collects pipeline statistics and occlusion counters per pass.
+	bool gpu_statistics{};
+	// Comma separated vendor performance counters to read per graphics pass
+	// and add to the benchmark report, or list to print the available ones.
+	// Needs VK_KHR_performance_query.
+	std::string performance_counters;
+	// Builds the draw commands in a compute shader and submits them with
+	// indirect count draws, on devices that support them.
+	bool indirect_draws{};
+	// Also culls the indirect draws' instances that were behind the last
+	// frame's depth, see src/depth_pyramid.hpp. Needs indirect draws.
+	bool occlusion_culling{};
+	// Has the GPU generate the state changes between the indirect draws too,
+	// the index buffer and the push constants of each draw's mesh, so draws
+	// of different meshes need no CPU sorting into batches. Needs indirect
+	// draws, pulled vertices and device generated commands.
+	bool device_generated_commands{};
+	// Draws the scene depth only first, then shades it with an EQUAL depth
+	// test so every pixel runs the fragment shader once.
+	bool depth_prepass{};
+	// Draws meshes as meshlets culled by a task shader, on devices with mesh
+	// shaders. Direct draws of the built-in mesh only, anything else falls
+	// back to the vertex shader.
+	bool mesh_shading{};
+	// Shades with shadows and ambient occlusion traced by ray queries through
+	// acceleration structures of the scene, on devices with ray queries.
+	bool ray_query{};
+	// Draws triangle ids into a visibility buffer and shades it with a compute
+	// pass, so overdraw and small triangles cost no shading.
+	bool visibility_buffer{};
+	// Reads back the visibility buffer's id under the cursor every frame and
+	// tints the draw it belongs to, see src/picking.hpp. Without a visibility
+	// buffer, logs the instanced copy under the cursor, picked through the
+	// BVH.
+	bool picking{};
+	// Draws a G-buffer and lights it a screen tile at a time with a compute
+	// pass instead of clustering the lights, see src/deferred.hpp.
+	bool deferred{};
+	// Dims the deferred path's ambient light by screen space ambient
+	// occlusion found at half resolution, see src/ambient_occlusion.hpp.
+	bool ambient_occlusion{};
+	// Lights a participating medium in a froxel grid with the clustered
+	// lights and fogs what shader.frag shades, see src/fog.hpp.
+	bool fog{};
+	// Lights what shader.frag shades with a sun casting cascaded shadow maps,
+	// see src/shadow.hpp.
+	bool shadows{};
+	// Jitters every frame and accumulates them along motion vectors, which
+	// anti-aliases and, with dynamic resolution, upscales the scene to the
+	// output resolution.
+	bool temporal_aa{};
+	// Starts frames just in time for the vblank they are shown at, on devices
+	// with present wait, so input is sampled as late as possible.
+	bool frame_pacing{};
+	// Presents per second to hold the frame rate to, zero for as many as the
+	// present mode allows, see src/frame_limiter.hpp.
+	size_t max_frame_rate{};
+	// Asks the driver to schedule the graphics queue ahead of other processes'
+	// and the compute and upload queues behind, on devices with global queue
+	// priorities. Raising it above the default can need elevated privileges.
+	bool high_queue_priority{};
+	// Draws frames only when the view, the content or the input changed, and
+	// blocks on window events in between, see src/damage.hpp. Only the ones
+	// drawn straight into the swap chain, without post-processing, dynamic
+	// resolution, the visibility buffer or particles, are limited to what
+	// changed.
+	bool redraw_on_demand{};
+	// On surfaces whose display is rotated from its native orientation, makes
+	// the swap chain in the native orientation and rotates the scene's clip
+	// space to match, so the display engine does not rotate every frame. Not
+	// with further windows or captures, which copy the images as they are.
+	bool pre_rotate{};
+	// Draws both eyes of a head mounted display side by side, in one
+	// multiview pass, see src/stereo.hpp. Not with post-processing, the
+	// visibility buffer, mesh shaders, pulled vertices, shading rates, shader
+	// objects or particles.
+	bool stereo{};
+	// Submits the frames and presents them on a thread of its own, which
+	// also acquires the swap chain images, so the time the driver takes in
+	// those calls overlaps the next frame's recording. Not where uploads
+	// share a queue with the frames.
+	bool submit_thread{};
+	// Stores meshes as 16-bit positions and 8-bit colors, which halves the
+	// vertex fetch. Also picks the layout --cook-mesh writes.
+	bool quantize_vertices{};
+	// Copies of the mesh drawn in a grid. Meshes drawn through vertex input
+	// draw all copies with one instanced draw fed by a per-instance stream.
+	size_t instances{1};
+	// Keeps the secondary command buffers of the main pass's draws and
+	// executes them again while the draws stay the same, instead of
+	// recording them every frame. Needs descriptor indexing.
+	bool baked_draws{};
+	// Point and spot lights scattered through the scene, binned into clusters
+	// by a compute pass so each fragment only shades the lights near it. Zero
+	// shades without lights.
+	size_t lights{};
+	// Decals scattered over the scene, binned into the light clusters and
+	// blended into the surface color by shader.frag, see src/decals.hpp.
+	// Needs clustered lights.
+	size_t decals{};
+	// Particles emitted, simulated, compacted and sorted back to front by
+	// compute shaders on the async compute queue, and drawn as blended quads
+	// by one indirect draw. Zero draws none.
+	size_t particles{};
+	// Draws the particles with weighted blended order independent
+	// transparency in a pass after the main one, so they need no sort.
+	bool weighted_oit{};
+	// MSAA sample count, one of 1, 2, 4 or 8. Lowered to what the device
+	// supports.
+	uint32_t msaa_samples{1};
+	// Frame rate to hold by lowering the resolution the scene is rendered at
+	// and upscaling it, zero to render at the output resolution. Needs dynamic
+	// rendering and GPU timestamps.
+	size_t dynamic_resolution{};
+	// Draws the scene in HDR and runs bloom, tonemapping, color grading and
+	// sharpening on it as compute passes. Needs a window and dynamic
+	// rendering.
+	bool post_process{};
+	// CSV file that receives every GPU pass sample, empty to disable.
+	std::filesystem::path gpu_stats_csv;
+	// Frames to render before writing a benchmark report and exiting, zero to
+	// run interactively.
+	size_t benchmark_frames{};
+	// Benchmark report file, empty for stdout.
+	std::filesystem::path benchmark_report;
+	// Comma separated microbenchmarks to run in place of the frame loop, or
+	// all of them, see src/microbench.hpp.
+	std::string microbenchmarks;
+	// Renders alternate frames on the GPUs of the selected GPU's device group,
+	// such as linked GPUs of one model. Needs Vulkan 1.1 and a single window.
+	bool device_group{};
+	// Windows to open, placed on one monitor each while there are enough. The
+	// scene is drawn once into the first, copied into the others and all of
+	// them are presented together. Ignored without a window.
+	size_t windows{1};
+	// Opens the first window fullscreen on the primary monitor at its current
+	// mode, so the compositor can hand the swap chain straight to the display.
+	// On Windows the swap chain also takes the display exclusively when the
+	// device has VK_EXT_full_screen_exclusive. Ignored without a window.
+	bool fullscreen{};
+	// Presents on the display of this index, counted over every GPU's, through
+	// VK_KHR_display instead of a window, for kiosks without a window system.
+	// See src/display.hpp. Without a window there are no keys or further
+	// windows, runs end after frame_count frames or when the process is
+	// stopped. Ignored when headless.
+	std::optional<size_t> display;
+	// Frames to render before exiting, zero to run until the window closes
+	// or the benchmark ends.
+	size_t frame_count{};
+	// Fixed simulation steps per second, independent of the frame rate. Zero
+	// steps once per frame, which headless runs and benchmarks always do so
+	// their frames are reproducible.
+	size_t simulation_rate{120};
+	// Renders offscreen without a window or surface, for render farms and CI
+	// machines without a display. Needs frame_count or benchmark_frames, the
+	// frames are kept with capture.
+	bool headless{};
+	// Copies frames to the host without stalling and writes them from a thread
+	// of its own. A .png target writes one image per captured frame, numbered
+	// after the frame, .y4m a video and anything else raw RGB24 frames. A
+	// target starting with | is a command the raw frames are piped to, like
+	// ffmpeg. Empty to capture nothing.
+	std::string capture;
+	// Frames rendered per captured frame.
+	size_t capture_interval{1};
+	// Chrome trace file that receives the startup phase timings, empty to
+	// disable.
+	std::filesystem::path trace;
+	// Frame time, in percent of the median of the recent frames, from which
+	// on a frame counts as a hitch and the CPU zones and GPU passes of the
+	// last seconds are written out as a Chrome trace. Zero disables.
+	size_t hitch_threshold{};
+	// Directory the hitch traces are written to.
+	std::filesystem::path hitch_dir{"."};
+	// File the metrics are written to every few seconds in the Prometheus
+	// text format, see src/telemetry.hpp. Empty to disable.
+	std::filesystem::path telemetry;
+	// Least severe messages logged, see src/log.hpp. Debug also asks the
+	// validation layers for their informational and verbose messages.
+	LogLevel log_level = LogLevel::info;
+	// KTX2 encodings of the texture to stream, in order of preference. The
+	// first the device can sample is used. Empty to stream none.
+	std::vector<std::filesystem::path> texture;
+	// KTX2 encodings of an equirectangular environment map, like texture.
+	// It is prefiltered for image based lighting once and cached in
+	// cache_dir, see src/environment.hpp. Empty for none.
+	std::vector<std::filesystem::path> environment;
+	// Cube map probes placed around the mesh, re-rendered a face per frame
+	// and prefiltered like the environment, see src/reflection_probes.hpp.
+	// Zero for none.
+	size_t reflection_probes{};
+	// Caps the budget of every memory heap, in MiB, so texture eviction can be
+	// tried on devices with plenty of memory. Zero keeps the driver's budget.
+	size_t memory_budget{};
+	// Routes the driver's host allocations through pooled allocators and
+	// prints what each allocation scope used at exit.
+	bool host_allocator{};
+	// Backs the frame arena and the scene's arrays with huge pages where the
+	// system has them, see src/huge_pages.hpp.
+	bool huge_pages{};
+	// Cooked mesh to draw instead of the built-in triangle, empty for the
+	// triangle.
+	std::filesystem::path mesh;
+	// OBJ file to cook into cook_mesh_output before exiting, without creating
+	// a window or a device. Empty to run normally.
+	std::filesystem::path cook_mesh_input;
+	std::filesystem::path cook_mesh_output;
+	// Compresses the blobs --cook-mesh writes, which loading expands on the
+	// GPU, so they come off the disk and cross the bus at a fraction of their
+	// size.
+	bool compress_mesh{};
+	// Places meshes in one sparse buffer whose pages are bound as they load,
+	// see src/geometry_pool.hpp.
+	bool sparse_geometry{};
+	// Cooked point cloud splatted over the scene by a compute rasterizer,
+	// its octree streamed from the file as the camera needs it, see
+	// src/point_cloud.hpp. Empty for none.
+	std::filesystem::path point_cloud;
+	// Text file of "x y z [r g b]" lines to cook into an octree at
+	// cook_point_cloud_output before exiting, like cook_mesh_input.
+	std::filesystem::path cook_point_cloud_input;
+	std::filesystem::path cook_point_cloud_output;
+	// Directory of a cooked paged scene whose cells are drawn as the
+	// instances, read in around the camera and ahead of it, see
+	// src/scene_paging.hpp. Empty to draw the grid of --instances.
+	std::filesystem::path paged_scene;
+	// Cells of the paged scene held in memory at once.
+	size_t scene_cache_cells{64};
+	// Text file of "x y z [scale]" lines to cook into a paged scene at
+	// cook_paged_scene_output before exiting, like cook_mesh_input.
+	std::filesystem::path cook_paged_scene_input;
+	std::filesystem::path cook_paged_scene_output;
+	// Width in pixels of the mesh's triangle edges drawn over it as
+	// anti-aliased lines, see src/lines.hpp. Zero draws none.
+	size_t line_width{};
+	// Dashes the lines into this many pixels drawn and as many left out, zero
+	// draws them solid.
+	size_t line_dash{};
+	// Raw square heightfield of 16-bit heights flown over as a geometry
+	// clipmap behind the scene, see src/terrain.hpp. Empty for none.
+	std::filesystem::path terrain;
+	// Bakes the terrain's material into a virtual texture whose pages
+	// terrain.frag asks for as it samples them, see src/virtual_texture.hpp.
+	bool virtual_texture{};
+	// Instances whose bounding sphere's radius projects to fewer pixels than
+	// this are drawn as octahedral impostors, see src/impostor.hpp. Also has
+	// --cook-mesh bake the mesh's atlas next to it. Zero draws every instance
+	// as a mesh.
+	size_t impostor_pixels{};
+	// Joints of a rig that twists the generated mesh, skinned by a compute
+	// pass once a frame for every pass that draws it, see src/skinning.hpp.
+	// Zero draws the mesh rigid.
+	size_t skin_joints{};
+	// Draws the frame time, GPU pass times and memory budgets over the
+	// scene, see src/overlay.hpp.
+	bool overlay{};
+	// Archive of assets mapped at startup, see src/archive.hpp. The texture,
+	// mesh and shader files given are looked up in it first, by their paths
+	// relative to the directory that was packed. Empty to load loose files.
+	std::filesystem::path archive;
+	// Directory to pack into pack_archive_output before exiting, like
+	// cooking. Empty to run normally.
+	std::filesystem::path pack_archive_input;
+	std::filesystem::path pack_archive_output;
+	// Compresses the entries --pack-archive writes where that pays off, which
+	// loading expands on the CPU.
+	bool compress_archive{};
+	// Benchmark reports of repeated runs of two builds to compare instead of
+	// running, see src/report_compare.hpp. Empty to run normally.
+	std::vector<std::filesystem::path> compare_baseline;
+	std::vector<std::filesystem::path> compare_candidate;
+};
+
+auto parse_present_policy(std::string_view name)
+		-> std::optional<PresentPolicy>;
+auto to_string(PresentPolicy policy) -> std::string_view;
+auto next_present_policy(PresentPolicy policy) -> PresentPolicy;
+auto parse_output_policy(std::string_view name) -> std::optional<OutputPolicy>;
+auto to_string(OutputPolicy policy) -> std::string_view;
+auto parse_shading_rate_policy(std::string_view name)
+		-> std::optional<ShadingRatePolicy>;
+auto to_string(ShadingRatePolicy policy) -> std::string_view;
+auto parse_image_compression_policy(std::string_view name)
+		-> std::optional<ImageCompressionPolicy>;
+auto to_string(ImageCompressionPolicy policy) -> std::string_view;
+auto parse_stress_scene(std::string_view name) -> std::optional<StressScene>;
+auto to_string(StressScene scene) -> std::string_view;
+auto parse_validation_profile(std::string_view name)
+		-> std::optional<ValidationProfile>;
+auto to_string(ValidationProfile profile) -> std::string_view;
+auto parse_log_level(std::string_view name) -> std::optional<LogLevel>;
+auto to_string(LogLevel level) -> std::string_view;
+auto parse_thread_placement(std::string_view name)
+		-> std::optional<ThreadPlacement>;
+auto to_string(ThreadPlacement placement) -> std::string_view;
+
+// Reads VKDEMO_* environment variables first so command line flags win.
+auto parse_config(std::span<char*> args) -> Config;
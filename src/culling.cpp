@@ -0,0 +1,182 @@
+#include "culling.hpp"
+
+#include "instrument.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+auto sphere_visible(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t idx) -> bool {
+	for (const auto& plane : frustum.planes) {
+		auto distance = plane.x * spheres.x[idx] + plane.y * spheres.y[idx] +
+				plane.z * spheres.z[idx] + plane.w;
+		if (distance < -spheres.radius[idx]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Tests g_cull_lanes spheres from idx on and returns one bit per visible
+// sphere.
+#if defined(__AVX__)
+constexpr auto g_cull_lanes = size_t{8};
+
+auto cull_lanes(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t idx) -> uint32_t {
+	auto x = _mm256_loadu_ps(&spheres.x[idx]);
+	auto y = _mm256_loadu_ps(&spheres.y[idx]);
+	auto z = _mm256_loadu_ps(&spheres.z[idx]);
+	auto min_distance =
+			_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[idx]));
+	auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for (const auto& plane : frustum.planes) {
+		auto distance = _mm256_add_ps(
+				_mm256_add_ps(
+						_mm256_mul_ps(x, _mm256_set1_ps(plane.x)),
+						_mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+				_mm256_add_ps(
+						_mm256_mul_ps(z, _mm256_set1_ps(plane.z)),
+						_mm256_set1_ps(plane.w)));
+		inside = _mm256_and_ps(
+				inside,
+				_mm256_cmp_ps(distance, min_distance, _CMP_GE_OQ));
+	}
+	return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+constexpr auto g_cull_lanes = size_t{4};
+
+auto cull_lanes(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t idx) -> uint32_t {
+	auto x = _mm_loadu_ps(&spheres.x[idx]);
+	auto y = _mm_loadu_ps(&spheres.y[idx]);
+	auto z = _mm_loadu_ps(&spheres.z[idx]);
+	auto min_distance =
+			_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[idx]));
+	auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (const auto& plane : frustum.planes) {
+		auto distance = _mm_add_ps(
+				_mm_add_ps(
+						_mm_mul_ps(x, _mm_set1_ps(plane.x)),
+						_mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, min_distance));
+	}
+	return static_cast<uint32_t>(_mm_movemask_ps(inside));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+constexpr auto g_cull_lanes = size_t{4};
+
+auto cull_lanes(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t idx) -> uint32_t {
+	auto x = vld1q_f32(&spheres.x[idx]);
+	auto y = vld1q_f32(&spheres.y[idx]);
+	auto z = vld1q_f32(&spheres.z[idx]);
+	auto min_distance = vnegq_f32(vld1q_f32(&spheres.radius[idx]));
+	auto inside = vdupq_n_u32(UINT32_MAX);
+	for (const auto& plane : frustum.planes) {
+		auto distance = vmlaq_n_f32(vdupq_n_f32(plane.w), x, plane.x);
+		distance = vmlaq_n_f32(distance, y, plane.y);
+		distance = vmlaq_n_f32(distance, z, plane.z);
+		inside = vandq_u32(inside, vcgeq_f32(distance, min_distance));
+	}
+	// One bit per lane, like movemask.
+	constexpr auto lane_bits = std::array<uint32_t, 4>{1, 2, 4, 8};
+	return vaddvq_u32(vandq_u32(inside, vld1q_u32(lane_bits.data())));
+}
+#else
+constexpr auto g_cull_lanes = size_t{1};
+
+auto cull_lanes(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t idx) -> uint32_t {
+	return sphere_visible(frustum, spheres, idx) ? 1U : 0U;
+}
+#endif
+
+}  // namespace
+
+void clear_bounding_spheres(BoundingSpheres& spheres) {
+	spheres.x.clear();
+	spheres.y.clear();
+	spheres.z.clear();
+	spheres.radius.clear();
+}
+
+void add_bounding_sphere(BoundingSpheres& spheres, glm::vec4 sphere) {
+	spheres.x.emplace_back(sphere.x);
+	spheres.y.emplace_back(sphere.y);
+	spheres.z.emplace_back(sphere.z);
+	spheres.radius.emplace_back(sphere.w);
+}
+
+// Gribb and Hartmann: a point is inside when its clip space coordinates are
+// within -w to w for x and y, and 0 to w for depth.
+auto extract_frustum(const glm::mat4& transform) -> Frustum {
+	auto rows = glm::transpose(transform);
+	auto frustum = Frustum{
+			.planes = {
+					rows[3] + rows[0],
+					rows[3] - rows[0],
+					rows[3] + rows[1],
+					rows[3] - rows[1],
+					rows[2],
+					rows[3] - rows[2]}};
+	for (auto& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+void cull_spheres(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t begin,
+		size_t end,
+		std::span<uint8_t> visible) {
+	VKDEMO_ZONE("cull_spheres");
+	auto idx = begin;
+	for (; idx + g_cull_lanes <= end; idx += g_cull_lanes) {
+		auto mask = cull_lanes(frustum, spheres, idx);
+		for (auto lane = size_t{}; lane < g_cull_lanes; lane++) {
+			visible[idx + lane] = static_cast<uint8_t>((mask >> lane) & 1U);
+		}
+	}
+	for (; idx < end; idx++) {
+		visible[idx] = sphere_visible(frustum, spheres, idx) ? 1 : 0;
+	}
+}
+
+void cull_spheres_parallel(
+		JobSystem& jobs,
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		std::span<uint8_t> visible) {
+	parallel_for(
+			jobs,
+			spheres.x.size(),
+			g_cull_grain,
+			[&](size_t begin, size_t end) {
+				cull_spheres(frustum, spheres, begin, end, visible);
+			});
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "jobs.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Spheres per culling job.
+constexpr auto g_cull_grain = size_t{4096};
+
+// Bounding spheres as separate arrays, so each SIMD lane tests its own sphere
+// without shuffles.
+struct BoundingSpheres {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+};
+
+void clear_bounding_spheres(BoundingSpheres& spheres);
+// sphere holds the center in xyz and the radius in w.
+void add_bounding_sphere(BoundingSpheres& spheres, glm::vec4 sphere);
+
+// Planes facing inwards with unit normals, in the space transform takes to
+// clip space.
+struct Frustum {
+	std::array<glm::vec4, 6> planes{};
+};
+
+auto extract_frustum(const glm::mat4& transform) -> Frustum;
+
+// Sets visible[i] to 1 for the spheres in [begin, end) that intersect the
+// frustum and to 0 for the others. Uses AVX, SSE2 or NEON when the build
+// targets them.
+void cull_spheres(
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		size_t begin,
+		size_t end,
+		std::span<uint8_t> visible);
+// Culls every sphere, spread over the job system. visible must have room for
+// all of them.
+void cull_spheres_parallel(
+		JobSystem& jobs,
+		const Frustum& frustum,
+		const BoundingSpheres& spheres,
+		std::span<uint8_t> visible);
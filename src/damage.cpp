@@ -0,0 +1,181 @@
+#include "damage.hpp"
+
+#include "matrix_batch.hpp"
+
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace {
+
+// Pixels a rectangle grows by on each side, for rasterization rules and
+// antialiased edges.
+constexpr auto g_damage_margin = 2;
+
+auto full_rect(const DamageTracker& tracker) -> VkRect2D {
+	return VkRect2D{
+			.offset = VkOffset2D{.x = 0, .y = 0},
+			.extent = tracker.extent};
+}
+
+// The bounds' box under camera, in pixels. The whole image once a corner is
+// behind the camera, where clip space does not bound the projection.
+auto project_bounds(const DamageTracker& tracker, const glm::mat4& camera)
+		-> VkRect2D {
+	auto corners = std::array<glm::vec3, 8>{};
+	for (auto corner = size_t{}; corner < corners.size(); corner++) {
+		corners.at(corner) = glm::vec3(
+				(corner & 1) != 0 ? tracker.bounds_max.x : tracker.bounds_min.x,
+				(corner & 2) != 0 ? tracker.bounds_max.y : tracker.bounds_min.y,
+				(corner & 4) != 0 ? tracker.bounds_max.z : tracker.bounds_min.z);
+	}
+	auto projected = std::array<glm::vec4, corners.size()>{};
+	project_points(camera, corners, projected);
+	auto min = glm::vec2(std::numeric_limits<float>::max());
+	auto max = glm::vec2(std::numeric_limits<float>::lowest());
+	for (const auto& point : projected) {
+		if (point.w <= std::numeric_limits<float>::epsilon()) {
+			return full_rect(tracker);
+		}
+		min = glm::min(min, glm::vec2(point));
+		max = glm::max(max, glm::vec2(point));
+	}
+	auto size = glm::vec2(
+			static_cast<float>(tracker.extent.width),
+			static_cast<float>(tracker.extent.height));
+	auto to_pixel = [&](glm::vec2 ndc, float margin) {
+		return glm::clamp((ndc * 0.5F + 0.5F) * size + margin, glm::vec2(0), size);
+	};
+	auto low = glm::floor(to_pixel(min, -g_damage_margin));
+	auto high = glm::ceil(to_pixel(max, g_damage_margin));
+	return VkRect2D{
+			.offset =
+					VkOffset2D{
+							.x = static_cast<int32_t>(low.x),
+							.y = static_cast<int32_t>(low.y)},
+			.extent = VkExtent2D{
+					.width = static_cast<uint32_t>(std::max(high.x - low.x, 0.0F)),
+					.height = static_cast<uint32_t>(std::max(high.y - low.y, 0.0F))}};
+}
+
+auto unite(const VkRect2D& a, const VkRect2D& b) -> VkRect2D {
+	if (a.extent.width == 0 || a.extent.height == 0) {
+		return b;
+	}
+	if (b.extent.width == 0 || b.extent.height == 0) {
+		return a;
+	}
+	auto x = std::min(a.offset.x, b.offset.x);
+	auto y = std::min(a.offset.y, b.offset.y);
+	auto right = std::max(
+			a.offset.x + static_cast<int32_t>(a.extent.width),
+			b.offset.x + static_cast<int32_t>(b.extent.width));
+	auto bottom = std::max(
+			a.offset.y + static_cast<int32_t>(a.extent.height),
+			b.offset.y + static_cast<int32_t>(b.extent.height));
+	return VkRect2D{
+			.offset = VkOffset2D{.x = x, .y = y},
+			.extent = VkExtent2D{
+					.width = static_cast<uint32_t>(right - x),
+					.height = static_cast<uint32_t>(bottom - y)}};
+}
+
+// The damage between what was drawn with before, if anything, and camera.
+auto camera_damage(
+		const DamageTracker& tracker,
+		const std::optional<glm::mat4>& before,
+		const glm::mat4& camera) -> VkRect2D {
+	if (!before.has_value()) {
+		return full_rect(tracker);
+	}
+	if (*before == camera) {
+		return VkRect2D{};
+	}
+	return unite(
+			project_bounds(tracker, *before),
+			project_bounds(tracker, camera));
+}
+
+}  // namespace
+
+void set_damage_bounds(DamageTracker& tracker, const BoundingSpheres& bounds) {
+	tracker.bounded = true;
+	tracker.bounds_min = glm::vec3(std::numeric_limits<float>::max());
+	tracker.bounds_max = glm::vec3(std::numeric_limits<float>::lowest());
+	for (auto i = size_t{}; i < bounds.x.size(); i++) {
+		auto center = glm::vec3(bounds.x[i], bounds.y[i], bounds.z[i]);
+		auto radius = glm::vec3(bounds.radius[i]);
+		tracker.bounds_min = glm::min(tracker.bounds_min, center - radius);
+		tracker.bounds_max = glm::max(tracker.bounds_max, center + radius);
+	}
+}
+
+void reset_damage(DamageTracker& tracker, VkExtent2D extent, size_t images) {
+	tracker.extent = extent;
+	tracker.image_cameras.assign(images, std::nullopt);
+	tracker.presented_camera.reset();
+}
+
+void invalidate_damage(DamageTracker& tracker) {
+	std::fill(
+			tracker.image_cameras.begin(),
+			tracker.image_cameras.end(),
+			std::nullopt);
+	tracker.presented_camera.reset();
+}
+
+auto has_damage(const DamageTracker& tracker, const glm::mat4& camera)
+		-> bool {
+	return tracker.presented_camera != camera || tracker.settling > 0;
+}
+
+auto image_damage(
+		const DamageTracker& tracker,
+		uint32_t image,
+		const glm::mat4& camera) -> VkRect2D {
+	if (!tracker.partial) {
+		return full_rect(tracker);
+	}
+	auto damage =
+			camera_damage(tracker, tracker.image_cameras.at(image), camera);
+	if (damage.extent.width == 0 || damage.extent.height == 0) {
+		damage.extent = VkExtent2D{.width = 1, .height = 1};
+	}
+	return damage;
+}
+
+auto present_damage(const DamageTracker& tracker, const glm::mat4& camera)
+		-> VkRectLayerKHR {
+	auto damage = tracker.partial
+			? camera_damage(tracker, tracker.presented_camera, camera)
+			: full_rect(tracker);
+	return VkRectLayerKHR{
+			.offset = damage.offset,
+			.extent = damage.extent,
+			.layer = 0};
+}
+
+void record_damage_present(
+		DamageTracker& tracker,
+		uint32_t image,
+		const glm::mat4& camera) {
+	if (tracker.presented_camera != camera) {
+		tracker.settling = tracker.settle_frames;
+	} else if (tracker.settling > 0) {
+		tracker.settling--;
+	}
+	tracker.image_cameras.at(image) = camera;
+	tracker.presented_camera = camera;
+}
+
+auto is_full_damage(const DamageTracker& tracker, const VkRect2D& damage)
+		-> bool {
+	return damage.offset.x == 0 && damage.offset.y == 0 &&
+			damage.extent.width == tracker.extent.width &&
+			damage.extent.height == tracker.extent.height;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "culling.hpp"
+#include "dispatch.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// How often a frame loop with nothing to draw looks at the camera again,
+// while something could change it without an event.
+constexpr auto g_damage_poll_interval = std::chrono::milliseconds{8};
+// Frames drawn after the last change for temporal antialiasing to converge.
+constexpr auto g_damage_settle_frames = 16U;
+
+// Redraw on demand for views that mostly stay still, like dashboards. The
+// scene's bounds in clip space cover everything a frame draws over the
+// clear color, so between two cameras only their union can differ. A frame
+// is only drawn once the camera or the content changed since the last
+// present, and only over the damage: the bounds under the camera the image
+// was last drawn with and under the new one. Everything else keeps what the
+// image already holds, which needs swap chains whose images keep their
+// contents, so they are not clipped and are not discarded when a frame
+// starts. The presents report what changed since the previous one, which
+// VK_KHR_incremental_present passes on to the compositor or display. Frames
+// that go through offscreen passes cannot keep the rest, so without partial
+// they are drawn in full, but still only once something changed.
+struct DamageTracker {
+	// Whether frames only redraw the damage.
+	bool partial{};
+	// Full frames drawn after each change, see g_damage_settle_frames.
+	uint32_t settle_frames{};
+	// Of those still to draw.
+	uint32_t settling{};
+	VkExtent2D extent{};
+	// The scene's bounding spheres, boxed once since the entities do not move.
+	bool bounded{};
+	glm::vec3 bounds_min{};
+	glm::vec3 bounds_max{};
+	// The camera each swap chain image was last drawn with, unset for images
+	// that have to be drawn in full.
+	std::vector<std::optional<glm::mat4>> image_cameras;
+	// Of the last present, unset when the next one changes everything.
+	std::optional<glm::mat4> presented_camera;
+};
+
+// With the bounds of the first frame's snapshot.
+void set_damage_bounds(DamageTracker& tracker, const BoundingSpheres& bounds);
+// For a new swap chain, whose images are all drawn in full.
+void reset_damage(DamageTracker& tracker, VkExtent2D extent, size_t images);
+// For content that changed under the same camera, like a texture level that
+// streamed in. Everything is drawn again.
+void invalidate_damage(DamageTracker& tracker);
+
+// Whether a frame with camera would change anything since the last present,
+// or one is still settling.
+auto has_damage(const DamageTracker& tracker, const glm::mat4& camera)
+		-> bool;
+// The area of image that drawing it with camera has to cover. Render areas
+// cannot be empty, so an image that is current already redraws a pixel.
+auto image_damage(
+		const DamageTracker& tracker,
+		uint32_t image,
+		const glm::mat4& camera) -> VkRect2D;
+// What changed since the last present, for VkPresentRegionKHR.
+auto present_damage(const DamageTracker& tracker, const glm::mat4& camera)
+		-> VkRectLayerKHR;
+// After image was drawn with camera and queued for presenting.
+void record_damage_present(
+		DamageTracker& tracker,
+		uint32_t image,
+		const glm::mat4& camera);
+
+// Whether damage covers the whole image, which is then drawn without keeping
+// its contents.
+auto is_full_damage(const DamageTracker& tracker, const VkRect2D& damage)
+		-> bool;
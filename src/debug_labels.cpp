@@ -0,0 +1,77 @@
+#include "debug_labels.hpp"
+
+#ifdef VKDEMO_DEBUG_LABELS
+#include <string>
+#include <vector>
+
+namespace {
+
+// Set once at startup, before any thread names objects.
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+bool g_debug_labels = false;
+
+}  // namespace
+
+auto debug_labels_supported() -> bool {
+	auto extension_count = uint32_t{};
+	vkEnumerateInstanceExtensionProperties(
+			VK_NULL_HANDLE,
+			&extension_count,
+			VK_NULL_HANDLE);
+	auto extensions = std::vector<VkExtensionProperties>(extension_count);
+	vkEnumerateInstanceExtensionProperties(
+			VK_NULL_HANDLE,
+			&extension_count,
+			extensions.data());
+	for (const auto& extension : extensions) {
+		if (std::string_view(extension.extensionName) ==
+				VK_EXT_DEBUG_UTILS_EXTENSION_NAME) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void enable_debug_labels() {
+	g_debug_labels = vkSetDebugUtilsObjectNameEXT != nullptr &&
+			vkCmdBeginDebugUtilsLabelEXT != nullptr &&
+			vkCmdEndDebugUtilsLabelEXT != nullptr;
+}
+
+void set_object_name(
+		VkDevice device,
+		VkObjectType type,
+		uint64_t handle,
+		std::string_view name) {
+	if (!g_debug_labels) {
+		return;
+	}
+	auto terminated = std::string(name);
+	auto name_info = VkDebugUtilsObjectNameInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.objectType = type,
+			.objectHandle = handle,
+			.pObjectName = terminated.c_str()};
+	vkSetDebugUtilsObjectNameEXT(device, &name_info);
+}
+
+void begin_debug_label(VkCommandBuffer command_buffer, std::string_view name) {
+	if (!g_debug_labels) {
+		return;
+	}
+	auto terminated = std::string(name);
+	auto label = VkDebugUtilsLabelEXT{
+			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.pLabelName = terminated.c_str(),
+			.color = {}};
+	vkCmdBeginDebugUtilsLabelEXT(command_buffer, &label);
+}
+
+void end_debug_label(VkCommandBuffer command_buffer) {
+	if (g_debug_labels) {
+		vkCmdEndDebugUtilsLabelEXT(command_buffer);
+	}
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+// Object names and command buffer labels for capture tools such as
+// RenderDoc, Nsight and RGP, through VK_EXT_debug_utils. They are built in
+// with the debug_labels meson option, on by default, and only do something
+// once enable_debug_labels saw the extension's functions, so release builds
+// without a capture tool attached pay a branch per call.
+#ifdef VKDEMO_DEBUG_LABELS
+// Whether the instance can be created with VK_EXT_debug_utils.
+auto debug_labels_supported() -> bool;
+// Called once the instance functions were loaded from an instance created
+// with the extension.
+void enable_debug_labels();
+
+// name is copied. Names set on objects that are shared between threads must
+// be set before they are shared.
+void set_object_name(
+		VkDevice device,
+		VkObjectType type,
+		uint64_t handle,
+		std::string_view name);
+
+// Labels nest and must be balanced within a command buffer.
+void begin_debug_label(VkCommandBuffer command_buffer, std::string_view name);
+void end_debug_label(VkCommandBuffer command_buffer);
+#else
+inline auto debug_labels_supported() -> bool {
+	return false;
+}
+inline void enable_debug_labels() {}
+inline void set_object_name(
+		VkDevice /*device*/,
+		VkObjectType /*type*/,
+		uint64_t /*handle*/,
+		std::string_view /*name*/) {}
+inline void begin_debug_label(
+		VkCommandBuffer /*command_buffer*/,
+		std::string_view /*name*/) {}
+inline void end_debug_label(VkCommandBuffer /*command_buffer*/) {}
+#endif
+
+// Handles are pointers on 64-bit platforms and integers elsewhere.
+template <typename Handle>
+void name_object(
+		VkDevice device,
+		VkObjectType type,
+		Handle handle,
+		std::string_view name) {
+	set_object_name(device, type, reinterpret_cast<uint64_t>(handle), name);
+}
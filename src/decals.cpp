@@ -0,0 +1,313 @@
+#include "decals.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <numbers>
+#include <span>
+#include <utility>
+
+namespace {
+
+// A float in [0, 1) from the bits of seed, the same on every run.
+auto hash_unit(uint32_t seed) -> float {
+	seed ^= seed >> 16U;
+	seed *= 0x7feb352dU;
+	seed ^= seed >> 15U;
+	seed *= 0x846ca68bU;
+	seed ^= seed >> 16U;
+	return static_cast<float>(seed >> 8U) / static_cast<float>(1U << 24U);
+}
+
+// The mark of a cell at p, which spans -1 to 1 across the cell, from a
+// signed distance to its edge. Texels outside keep the mark's color, so
+// filtering does not darken its edge.
+auto mark_texel(uint32_t cell, glm::vec2 p) -> glm::vec4 {
+	auto seed = cell * 4U;
+	auto color = glm::vec3(
+			hash_unit(seed),
+			hash_unit(seed + 1),
+			hash_unit(seed + 2));
+	auto radius = glm::length(p);
+	auto distance = 0.0F;
+	switch (cell % 4) {
+	case 0:
+		distance = std::abs(radius - 0.65F) - 0.15F;
+		break;
+	case 1: {
+		auto wobble = std::sin(
+				7.0F * std::atan2(p.y, p.x) + 6.0F * hash_unit(seed + 3));
+		distance = radius - (0.6F + 0.2F * wobble);
+		break;
+	}
+	case 2: {
+		distance = std::max(std::abs(p.x), std::abs(p.y)) - 0.9F;
+		// Hazard stripes, every other one dark.
+		if (glm::fract((p.x + p.y) * 2.0F) < 0.5F) {
+			color *= 0.1F;
+		}
+		break;
+	}
+	default:
+		distance = std::max(
+				std::min(std::abs(p.x), std::abs(p.y)) - 0.15F,
+				std::max(std::abs(p.x), std::abs(p.y)) - 0.85F);
+		break;
+	}
+	// A texel wide edge.
+	auto texel = 2.0F / static_cast<float>(g_decal_cell_size);
+	auto coverage = std::clamp(0.5F - distance / texel, 0.0F, 1.0F);
+	return glm::vec4(color, 0.9F * coverage);
+}
+
+auto pack_texel(glm::vec4 texel) -> uint32_t {
+	auto packed = uint32_t{};
+	for (auto i = 0; i < 4; i++) {
+		auto channel = static_cast<uint32_t>(
+				std::lround(std::clamp(texel[i], 0.0F, 1.0F) * 255.0F));
+		packed |= channel << (8U * static_cast<uint32_t>(i));
+	}
+	return packed;
+}
+
+// Level 0 of every cell, then each level box filtered from the one above.
+auto draw_atlas_levels() -> std::vector<std::vector<glm::vec4>> {
+	auto levels = std::vector<std::vector<glm::vec4>>{};
+	auto& base = levels.emplace_back(g_decal_atlas_size * g_decal_atlas_size);
+	for (auto y = 0U; y < g_decal_atlas_size; y++) {
+		for (auto x = 0U; x < g_decal_atlas_size; x++) {
+			auto cell = y / g_decal_cell_size * g_decal_atlas_cells +
+					x / g_decal_cell_size;
+			auto center = glm::vec2(
+					static_cast<float>(x % g_decal_cell_size) + 0.5F,
+					static_cast<float>(y % g_decal_cell_size) + 0.5F);
+			base.at(y * g_decal_atlas_size + x) = mark_texel(
+					cell,
+					center / static_cast<float>(g_decal_cell_size) * 2.0F - 1.0F);
+		}
+	}
+	for (auto level = 1U; level < g_decal_atlas_levels; level++) {
+		const auto& above = levels.at(level - 1);
+		auto above_size = g_decal_atlas_size >> (level - 1);
+		auto size = above_size / 2;
+		auto texels = std::vector<glm::vec4>(size * size);
+		for (auto y = 0U; y < size; y++) {
+			for (auto x = 0U; x < size; x++) {
+				auto first = 2 * y * above_size + 2 * x;
+				texels.at(y * size + x) = 0.25F *
+						(above.at(first) + above.at(first + 1) +
+						 above.at(first + above_size) + above.at(first + above_size + 1));
+			}
+		}
+		levels.emplace_back(std::move(texels));
+	}
+	return levels;
+}
+
+}  // namespace
+
+auto create_decal_atlas(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers) -> DecalAtlas {
+	auto atlas = DecalAtlas{};
+	// Decals are sampled with the gradients of the surfaces they land on,
+	// which the chain follows down to a texel per cell.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = static_cast<float>(g_decal_atlas_levels - 1),
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	atlas.sampler = acquire_sampler(device, samplers, sampler_info);
+	atlas.sampler_handle = add_bindless_sampler(device, bindless, atlas.sampler);
+
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_decal_format,
+			.extent =
+					VkExtent3D{
+							.width = g_decal_atlas_size,
+							.height = g_decal_atlas_size,
+							.depth = 1},
+			.mipLevels = g_decal_atlas_levels,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	atlas.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = atlas.image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = g_decal_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = g_decal_atlas_levels,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &atlas.view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create the decal atlas view\n");
+		std::terminate();
+	}
+	atlas.handle = add_bindless_image(
+			device,
+			bindless,
+			atlas.view,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	auto levels = draw_atlas_levels();
+	for (auto level = 0U; level < g_decal_atlas_levels; level++) {
+		auto packed = std::vector<uint32_t>(levels.at(level).size());
+		std::transform(
+				levels.at(level).begin(),
+				levels.at(level).end(),
+				packed.begin(),
+				pack_texel);
+		auto size = g_decal_atlas_size >> level;
+		upload_image(
+				device,
+				uploader,
+				atlas.image.handle,
+				VkImageSubresourceLayers{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = level,
+						.baseArrayLayer = 0,
+						.layerCount = 1},
+				VkExtent3D{.width = size, .height = size, .depth = 1},
+				std::as_bytes(std::span(packed)),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	}
+	return atlas;
+}
+
+void destroy_decal_atlas(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		DecalAtlas& atlas) {
+	remove_bindless_image(device, bindless, atlas.handle);
+	vkDestroyImageView(device, atlas.view, host_callbacks());
+	destroy_image(device, allocator, atlas.image);
+	remove_bindless_sampler(device, bindless, atlas.sampler_handle);
+	release_sampler(device, samplers, atlas.sampler);
+	atlas = DecalAtlas{};
+}
+
+auto cluster_decals(const DecalAtlas& atlas) -> ClusterDecals {
+	return ClusterDecals{.atlas = atlas.handle, .sampler = atlas.sampler_handle};
+}
+
+auto make_decal(
+		glm::vec3 center,
+		float half_size,
+		float half_depth,
+		float angle,
+		uint32_t cell) -> Decal {
+	// The rows of the inverse of placing the box: scaled, turned, moved.
+	auto cos = std::cos(angle);
+	auto sin = std::sin(angle);
+	auto rows = std::array{
+			glm::vec3(cos, sin, 0.0F) / half_size,
+			glm::vec3(-sin, cos, 0.0F) / half_size,
+			glm::vec3(0.0F, 0.0F, 1.0F / half_depth)};
+	auto transform = glm::mat4(1.0F);
+	for (auto i = 0; i < 3; i++) {
+		const auto& row = rows.at(static_cast<size_t>(i));
+		transform[0][i] = row.x;
+		transform[1][i] = row.y;
+		transform[2][i] = row.z;
+		transform[3][i] = -glm::dot(row, center);
+	}
+	auto cell_scale = 1.0F / static_cast<float>(g_decal_atlas_cells);
+	cell %= g_decal_atlas_cells * g_decal_atlas_cells;
+	return Decal{
+			.transform = transform,
+			.atlas_rect = glm::vec4(
+					cell_scale,
+					cell_scale,
+					static_cast<float>(cell % g_decal_atlas_cells) * cell_scale,
+					static_cast<float>(cell / g_decal_atlas_cells) * cell_scale),
+			.sphere = glm::vec4(
+					center,
+					std::sqrt(2.0F * half_size * half_size + half_depth * half_depth))};
+}
+
+auto scatter_decals(uint32_t count, glm::vec3 min, glm::vec3 max)
+		-> std::vector<Decal> {
+	// Like scatter_lights, decals are about as wide as their share of the
+	// area, so they overlap a little whatever the count. Boxes are twice as
+	// deep as the volume, which keeps its surfaces clear of their fading
+	// ends.
+	auto size = max - min;
+	auto share =
+			std::sqrt(size.x * size.y / static_cast<float>(std::max(count, 1U)));
+	auto decals = std::vector<Decal>{};
+	decals.reserve(count);
+	for (auto i = 0U; i < count; i++) {
+		auto seed = i * 5U + 0x9e37U;
+		auto center = glm::vec3(
+				min.x + hash_unit(seed) * size.x,
+				min.y + hash_unit(seed + 1) * size.y,
+				(min.z + max.z) * 0.5F);
+		decals.emplace_back(make_decal(
+				center,
+				share * (0.35F + 0.35F * hash_unit(seed + 2)),
+				size.z,
+				2.0F * std::numbers::pi_v<float> * hash_unit(seed + 3),
+				static_cast<uint32_t>(
+						hash_unit(seed + 4) *
+						static_cast<float>(g_decal_atlas_cells * g_decal_atlas_cells))));
+	}
+	return decals;
+}
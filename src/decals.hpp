@@ -0,0 +1,67 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "light_clusters.hpp"
+#include "object_cache.hpp"
+#include "upload.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Cells along each side of the atlas, and texels along each side of a cell.
+constexpr auto g_decal_atlas_cells = 4U;
+constexpr auto g_decal_cell_size = 128U;
+constexpr auto g_decal_atlas_size = g_decal_atlas_cells * g_decal_cell_size;
+// The chain stops at a texel per cell, so a cell's levels never take in its
+// neighbours.
+constexpr auto g_decal_atlas_levels = 8U;
+static_assert(g_decal_cell_size >> (g_decal_atlas_levels - 1) == 1);
+constexpr auto g_decal_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+// The marks decals project: g_decal_atlas_cells squared cells of shapes
+// drawn on the CPU at creation, rings, splats, stripes and crosses in hashed
+// colors, with alpha their coverage. The full chain is uploaded once and
+// sampled by shader.frag through the bindless table.
+struct DecalAtlas {
+	Image image;
+	VkImageView view{};
+	BindlessHandle handle{};
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+};
+
+auto create_decal_atlas(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers) -> DecalAtlas;
+// The device must be idle.
+void destroy_decal_atlas(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		DecalAtlas& atlas);
+
+// What build_light_clusters passes on to shader.frag.
+auto cluster_decals(const DecalAtlas& atlas) -> ClusterDecals;
+
+// A decal projecting the atlas cell at cell along -z. Its box is centered at
+// center, half_size across in x and y and half_depth in z, turned by angle
+// radians about z.
+auto make_decal(
+		glm::vec3 center,
+		float half_size,
+		float half_depth,
+		float angle,
+		uint32_t cell) -> Decal;
+
+// count decals of hashed cells, sizes and turns scattered over the xy of the
+// box between min and max, each box reaching through its depth.
+auto scatter_decals(uint32_t count, glm::vec3 min, glm::vec3 max)
+		-> std::vector<Decal>;
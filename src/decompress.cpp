@@ -0,0 +1,515 @@
+#include "decompress.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+
+namespace {
+
+// Matches decompress.comp.
+constexpr auto g_group_size = 64U;
+constexpr auto g_min_match = size_t{4};
+// Counts of a token that continue in the bytes after it.
+constexpr auto g_token_max = size_t{15};
+// The hash table of the compressor has 2^g_hash_bits slots.
+constexpr auto g_hash_bits = 12U;
+
+// Layout matches the push_constant block in decompress.comp.
+struct PayloadConstants {
+	uint32_t chunk_count{};
+	uint32_t size{};
+};
+
+auto chunk_count(VkDeviceSize size) -> uint32_t {
+	return static_cast<uint32_t>(
+			(size + g_decompress_chunk_size - 1) / g_decompress_chunk_size);
+}
+
+auto load_word(std::span<const std::byte> bytes, size_t offset) -> uint32_t {
+	auto word = uint32_t{};
+	std::memcpy(&word, bytes.subspan(offset, sizeof(word)).data(), sizeof(word));
+	return word;
+}
+
+auto hash_word(uint32_t word) -> uint32_t {
+	return (word * 2654435761U) >> (32U - g_hash_bits);
+}
+
+void append_count(std::vector<std::byte>& out, size_t count) {
+	if (count < g_token_max) {
+		return;
+	}
+	count -= g_token_max;
+	while (true) {
+		auto byte = std::min(count, size_t{255});
+		out.push_back(static_cast<std::byte>(byte));
+		count -= byte;
+		if (byte < 255) {
+			break;
+		}
+	}
+}
+
+// A match of zero bytes ends the chunk with literals only.
+void append_sequence(
+		std::vector<std::byte>& out,
+		std::span<const std::byte> literals,
+		size_t distance,
+		size_t match) {
+	auto match_count = match == 0 ? 0 : match - g_min_match;
+	out.push_back(static_cast<std::byte>(
+			(std::min(literals.size(), g_token_max) << 4U) |
+			std::min(match_count, g_token_max)));
+	append_count(out, literals.size());
+	out.insert(out.end(), literals.begin(), literals.end());
+	if (match == 0) {
+		return;
+	}
+	out.push_back(static_cast<std::byte>(distance & 0xffU));
+	out.push_back(static_cast<std::byte>(distance >> 8U));
+	append_count(out, match_count);
+}
+
+// Greedy matching through a hash of the next four bytes, which finds most of
+// the repeats in vertex and index data at a fraction of an optimal parse.
+void compress_chunk(
+		std::span<const std::byte> chunk,
+		std::vector<std::byte>& out) {
+	// Positions plus one, zero for empty slots.
+	auto table = std::array<uint32_t, size_t{1} << g_hash_bits>{};
+	auto literal_start = size_t{};
+	auto pos = size_t{};
+	while (pos + g_min_match <= chunk.size()) {
+		auto word = load_word(chunk, pos);
+		auto& slot = table.at(hash_word(word));
+		auto candidate = slot;
+		slot = static_cast<uint32_t>(pos + 1);
+		if (candidate == 0 || load_word(chunk, candidate - 1) != word) {
+			pos++;
+			continue;
+		}
+		auto from = size_t{candidate - 1};
+		auto match = g_min_match;
+		while (pos + match < chunk.size() &&
+					 chunk[from + match] == chunk[pos + match]) {
+			match++;
+		}
+		append_sequence(
+				out,
+				chunk.subspan(literal_start, pos - literal_start),
+				pos - from,
+				match);
+		pos += match;
+		literal_start = pos;
+	}
+	append_sequence(out, chunk.subspan(literal_start), 0, 0);
+}
+
+// Adds the bytes continuing a count of g_token_max.
+auto read_count(std::span<const std::byte> chunk, size_t& pos, size_t& count)
+		-> bool {
+	if (count != g_token_max) {
+		return true;
+	}
+	while (pos < chunk.size()) {
+		auto byte = std::to_integer<size_t>(chunk[pos++]);
+		count += byte;
+		if (byte < 255) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Unlike decompress.comp, rejects a malformed chunk instead of stopping.
+auto expand_chunk(std::span<const std::byte> chunk, std::span<std::byte> out)
+		-> bool {
+	auto in_pos = size_t{};
+	auto out_pos = size_t{};
+	while (in_pos < chunk.size()) {
+		auto token = std::to_integer<size_t>(chunk[in_pos++]);
+		auto literals = token >> 4U;
+		if (!read_count(chunk, in_pos, literals) ||
+				literals > chunk.size() - in_pos ||
+				literals > out.size() - out_pos) {
+			return false;
+		}
+		std::memcpy(
+				out.subspan(out_pos).data(),
+				chunk.subspan(in_pos).data(),
+				literals);
+		in_pos += literals;
+		out_pos += literals;
+		// The last sequence of a chunk has no match.
+		if (in_pos == chunk.size()) {
+			break;
+		}
+		if (chunk.size() - in_pos < 2) {
+			return false;
+		}
+		auto distance = std::to_integer<size_t>(chunk[in_pos]) |
+				(std::to_integer<size_t>(chunk[in_pos + 1]) << 8U);
+		in_pos += 2;
+		auto match = token & g_token_max;
+		if (!read_count(chunk, in_pos, match)) {
+			return false;
+		}
+		match += g_min_match;
+		if (distance == 0 || distance > out_pos ||
+				match > out.size() - out_pos) {
+			return false;
+		}
+		// Byte by byte, as a match may overlap the bytes it produces.
+		for (auto i = size_t{}; i < match; i++) {
+			out[out_pos + i] = out[out_pos - distance + i];
+		}
+		out_pos += match;
+	}
+	return out_pos == out.size();
+}
+
+}  // namespace
+
+auto compress_payload(std::span<const std::byte> data)
+		-> std::vector<std::byte> {
+	auto count = chunk_count(data.size());
+	auto offsets = std::vector<uint32_t>{};
+	offsets.reserve(count + 1);
+	auto out = std::vector<std::byte>((count + 1) * sizeof(uint32_t));
+	for (auto i = uint32_t{}; i < count; i++) {
+		offsets.push_back(static_cast<uint32_t>(out.size()));
+		auto start = size_t{i} * g_decompress_chunk_size;
+		compress_chunk(
+				data.subspan(
+						start,
+						std::min(data.size() - start, size_t{g_decompress_chunk_size})),
+				out);
+	}
+	offsets.push_back(static_cast<uint32_t>(out.size()));
+	std::memcpy(out.data(), offsets.data(), offsets.size() * sizeof(uint32_t));
+	return out;
+}
+
+auto valid_compressed_payload(
+		std::span<const std::byte> payload,
+		VkDeviceSize size) -> bool {
+	// Offsets and the decoder's positions are 32-bit.
+	constexpr auto max_size = VkDeviceSize{std::numeric_limits<uint32_t>::max()};
+	if (size == 0 || size > max_size || payload.size() > max_size) {
+		return false;
+	}
+	auto count = chunk_count(size);
+	auto table_size = (size_t{count} + 1) * sizeof(uint32_t);
+	if (payload.size() < table_size ||
+			load_word(payload, 0) != table_size ||
+			load_word(payload, count * sizeof(uint32_t)) != payload.size()) {
+		return false;
+	}
+	auto previous = uint32_t{};
+	for (auto i = uint32_t{}; i <= count; i++) {
+		auto offset = load_word(payload, i * sizeof(uint32_t));
+		if (offset < previous) {
+			return false;
+		}
+		previous = offset;
+	}
+	return true;
+}
+
+auto expand_payload(
+		std::span<const std::byte> payload,
+		std::span<std::byte> out) -> bool {
+	if (!valid_compressed_payload(payload, out.size())) {
+		return false;
+	}
+	auto count = chunk_count(out.size());
+	for (auto i = uint32_t{}; i < count; i++) {
+		auto start = load_word(payload, i * sizeof(uint32_t));
+		auto end = load_word(payload, (i + 1) * sizeof(uint32_t));
+		auto out_start = size_t{i} * g_decompress_chunk_size;
+		auto expanded = expand_chunk(
+				payload.subspan(start, end - start),
+				out.subspan(
+						out_start,
+						std::min(
+								out.size() - out_start,
+								size_t{g_decompress_chunk_size})));
+		if (!expanded) {
+			return false;
+		}
+	}
+	return true;
+}
+
+auto create_decompressor(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		bool synchronization2) -> Decompressor {
+	auto decompressor = Decompressor{};
+	decompressor.synchronization2 = synchronization2;
+	auto bindings = std::array{
+			VkDescriptorSetLayoutBinding{
+					.binding = 0,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+			VkDescriptorSetLayoutBinding{
+					.binding = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE}};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&decompressor.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create decompression set layout\n");
+		std::terminate();
+	}
+	auto pool_size = VkDescriptorPoolSize{
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = g_decompress_sets * 2};
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+			.maxSets = g_decompress_sets,
+			.poolSizeCount = 1,
+			.pPoolSizes = &pool_size};
+	if (vkCreateDescriptorPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&decompressor.descriptor_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create decompression descriptor pool\n");
+		std::terminate();
+	}
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(PayloadConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &decompressor.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&decompressor.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create decompression pipeline layout\n");
+		std::terminate();
+	}
+	decompressor.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			decompressor.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			0);
+	return decompressor;
+}
+
+void destroy_decompressor(
+		VkDevice& device,
+		Allocator& allocator,
+		Decompressor& decompressor) {
+	for (auto& pending : decompressor.pending) {
+		destroy_buffer(device, allocator, pending.packed);
+	}
+	vkDestroyPipeline(device, decompressor.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(
+			device,
+			decompressor.pipeline_layout,
+			host_callbacks());
+	vkDestroyDescriptorPool(
+			device,
+			decompressor.descriptor_pool,
+			host_callbacks());
+	vkDestroyDescriptorSetLayout(
+			device,
+			decompressor.set_layout,
+			host_callbacks());
+	decompressor = Decompressor{};
+}
+
+void decompress_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		Decompressor& decompressor,
+		std::span<const std::byte> payload,
+		VkBuffer target,
+		VkDeviceSize offset,
+		VkDeviceSize size,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	// The shader reads whole words, the bytes past the payload are ignored.
+	auto packed = create_buffer(
+			device,
+			allocator,
+			(payload.size() + 3) / 4 * 4,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	upload_buffer(
+			device,
+			uploader,
+			packed.handle,
+			0,
+			payload,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	decompressor.pending.emplace_back(PendingDecompression{
+			.packed = packed,
+			.target = target,
+			.offset = offset,
+			.size = size,
+			.chunk_count = chunk_count(size),
+			.ticket = uploader.next_ticket,
+			.dst_stage = dst_stage,
+			.dst_access = dst_access});
+}
+
+void record_decompressions(
+		VkDevice& device,
+		Allocator& allocator,
+		const Uploader& uploader,
+		DeletionQueue& deletions,
+		Decompressor& decompressor,
+		VkCommandBuffer command_buffer) {
+	auto& pending = decompressor.pending;
+	auto submitted = std::stable_partition(
+			pending.begin(),
+			pending.end(),
+			[&](const PendingDecompression& decompression) {
+				return decompression.ticket < uploader.next_ticket;
+			});
+	if (submitted == pending.begin()) {
+		return;
+	}
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			decompressor.pipeline);
+	auto barriers = std::vector<VkBufferMemoryBarrier2>{};
+	for (auto it = pending.begin(); it != submitted; it++) {
+		auto* set = VkDescriptorSet{};
+		auto allocate_info = VkDescriptorSetAllocateInfo{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.descriptorPool = decompressor.descriptor_pool,
+				.descriptorSetCount = 1,
+				.pSetLayouts = &decompressor.set_layout};
+		if (vkAllocateDescriptorSets(device, &allocate_info, &set) != VK_SUCCESS) {
+			fmt::print(
+					stderr,
+					"More than {} payloads are decompressed at once\n",
+					g_decompress_sets);
+			std::terminate();
+		}
+		auto buffers = std::array{
+				VkDescriptorBufferInfo{
+						.buffer = it->packed.handle,
+						.offset = 0,
+						.range = VK_WHOLE_SIZE},
+				VkDescriptorBufferInfo{
+						.buffer = it->target,
+						.offset = it->offset,
+						.range = (it->size + 3) / 4 * 4}};
+		auto writes = std::array<VkWriteDescriptorSet, 2>{};
+		for (auto i = uint32_t{}; i < writes.size(); i++) {
+			writes.at(i) = VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = i,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.pImageInfo = VK_NULL_HANDLE,
+					.pBufferInfo = &buffers.at(i),
+					.pTexelBufferView = VK_NULL_HANDLE};
+		}
+		vkUpdateDescriptorSets(
+				device,
+				static_cast<uint32_t>(writes.size()),
+				writes.data(),
+				0,
+				VK_NULL_HANDLE);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				decompressor.pipeline_layout,
+				0,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		auto constants = PayloadConstants{
+				.chunk_count = it->chunk_count,
+				.size = static_cast<uint32_t>(it->size)};
+		vkCmdPushConstants(
+				command_buffer,
+				decompressor.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(it->chunk_count + g_group_size - 1) / g_group_size,
+				1,
+				1);
+		barriers.emplace_back(VkBufferMemoryBarrier2{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+				.pNext = VK_NULL_HANDLE,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+				.dstStageMask = it->dst_stage,
+				.dstAccessMask = it->dst_access,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer = it->target,
+				.offset = it->offset,
+				.size = (it->size + 3) / 4 * 4});
+		defer_deletion(
+				deletions,
+				[&device,
+				 &allocator,
+				 pool = decompressor.descriptor_pool,
+				 set,
+				 packed = it->packed]() mutable {
+					vkFreeDescriptorSets(device, pool, 1, &set);
+					destroy_buffer(device, allocator, packed);
+				});
+	}
+	pipeline_barrier(
+			decompressor.synchronization2,
+			command_buffer,
+			barriers,
+			{});
+	pending.erase(pending.begin(), submitted);
+}
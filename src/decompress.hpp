@@ -0,0 +1,116 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "upload.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Bytes a chunk of a payload expands to, all but the last. Matches
+// decompress.comp.
+constexpr auto g_decompress_chunk_size = uint32_t{16384};
+// Payloads being expanded at once, each holding a descriptor set until the
+// frame that expands it is done.
+constexpr auto g_decompress_sets = 16U;
+
+// How the payloads of an asset are stored.
+enum class PayloadCodec : uint32_t {
+	// As the buffers hold them.
+	none,
+	// A table of where each chunk starts, and the end of the last, as uint32_t
+	// from the start of the payload, followed by the chunks. Each chunk is
+	// g_decompress_chunk_size bytes compressed on its own into LZ4 style
+	// sequences: a token of a literal count and a match length less four,
+	// counts of 15 continued in bytes until one is below 255, the literals, then
+	// a two byte distance back into the chunk's output. The last sequence of a
+	// chunk has no match. Chunks of at most 64 KiB compressed alone are also
+	// what GPU decompression APIs such as VK_NV_memory_decompression take.
+	chunked_lz,
+};
+
+// Compresses data with chunked_lz, for the cook step.
+auto compress_payload(std::span<const std::byte> data)
+		-> std::vector<std::byte>;
+// Checks the chunk table of a chunked_lz payload that expands to size bytes.
+// The chunks themselves are only checked while they are decoded, which stops
+// early at anything that would write outside of them.
+auto valid_compressed_payload(
+		std::span<const std::byte> payload,
+		VkDeviceSize size) -> bool;
+// Expands a chunked_lz payload into out, as decompress.comp does, for data
+// the CPU reads. False when the payload does not expand to exactly out.
+auto expand_payload(
+		std::span<const std::byte> payload,
+		std::span<std::byte> out) -> bool;
+
+// A payload staged into packed, to be expanded into target once the upload
+// batch of ticket was submitted.
+struct PendingDecompression {
+	Buffer packed;
+	VkBuffer target{};
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+	uint32_t chunk_count{};
+	UploadTicket ticket{};
+	VkPipelineStageFlags2 dst_stage{};
+	VkAccessFlags2 dst_access{};
+};
+
+// Expands compressed payloads on the GPU, so assets cross the bus and come
+// off the disk at their compressed size. The uploader stages the compressed
+// bytes into device-local memory, and decompress.comp expands them into the
+// target buffers on the graphics queue, right after the frame acquired the
+// batch they were staged in.
+struct Decompressor {
+	bool synchronization2{};
+	VkDescriptorSetLayout set_layout{};
+	VkDescriptorPool descriptor_pool{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::vector<PendingDecompression> pending;
+};
+
+// module is decompress.comp.
+auto create_decompressor(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		bool synchronization2) -> Decompressor;
+// The device must be idle.
+void destroy_decompressor(
+		VkDevice& device,
+		Allocator& allocator,
+		Decompressor& decompressor);
+
+// Stages payload for the uploader's current batch and queues expanding it
+// into target at offset, a storage buffer with room for size bytes rounded
+// up to a multiple of four there. offset must be aligned to
+// minStorageBufferOffsetAlignment. dst_stage and dst_access describe the
+// first use of the expanded data on the graphics queue.
+void decompress_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		Decompressor& decompressor,
+		std::span<const std::byte> payload,
+		VkBuffer target,
+		VkDeviceSize offset,
+		VkDeviceSize size,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
+// Expands every queued payload whose batch was submitted into command_buffer,
+// a graphics command buffer that acquire_uploads already recorded those
+// batches into. The staged payloads and descriptor sets go to deletions. It
+// binds a compute pipeline and set of its own, so compute work recorded after
+// it has to bind its own again.
+void record_decompressions(
+		VkDevice& device,
+		Allocator& allocator,
+		const Uploader& uploader,
+		DeletionQueue& deletions,
+		Decompressor& decompressor,
+		VkCommandBuffer command_buffer);
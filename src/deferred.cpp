@@ -0,0 +1,299 @@
+#include "deferred.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+#include <glm/matrix.hpp>
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+constexpr auto g_gbuffer_binding = 0U;
+constexpr auto g_deferred_scene_binding = 1U;
+constexpr auto g_deferred_occlusion_binding = 2U;
+
+constexpr auto g_storage_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in deferred_lighting.comp.
+struct DeferredConstants {
+	BindlessHandle lights{};
+	uint32_t width{};
+	uint32_t height{};
+};
+
+// Points the frame's set at this frame's views. The frame's fence was waited
+// on, so the set is no longer in use.
+void write_deferred_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		VkDescriptorSet set,
+		uint32_t gbuffer,
+		uint32_t scene,
+		uint32_t occlusion) {
+	auto has_occlusion = occlusion != g_graph_imported;
+	auto images = std::array{
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = graph_image_view(graph, gbuffer),
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = graph_image_view(graph, scene),
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = has_occlusion ? graph_image_view(graph, occlusion)
+																		 : VK_NULL_HANDLE,
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+	};
+	auto image_write = [&](uint32_t binding, const VkDescriptorImageInfo* info) {
+		return VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = info,
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE};
+	};
+	auto writes = std::array{
+			image_write(g_gbuffer_binding, &images.at(0)),
+			image_write(g_deferred_scene_binding, &images.at(1)),
+			image_write(g_deferred_occlusion_binding, &images.at(2)),
+	};
+	// Without occlusion the pipeline's variant leaves its binding unused.
+	vkUpdateDescriptorSets(
+			device,
+			has_occlusion ? 3U : 2U,
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+}
+
+}  // namespace
+
+auto create_deferred_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t light_capacity) -> DeferredShading {
+	auto shading = DeferredShading{};
+	shading.light_capacity = light_capacity;
+
+	auto storage_binding = [](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = VK_NULL_HANDLE};
+	};
+	auto bindings = std::array{
+			storage_binding(g_gbuffer_binding),
+			storage_binding(g_deferred_scene_binding),
+			storage_binding(g_deferred_occlusion_binding),
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&shading.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create deferred set layout\n");
+		std::terminate();
+	}
+
+	auto set_layouts = std::array{bindless.set_layout, shading.set_layout};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(DeferredConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&shading.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create deferred pipeline layout\n");
+		std::terminate();
+	}
+	shading.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			shading.pipeline_layout,
+			module,
+			specialization,
+			0);
+
+	// Lights are read in place like the uniform ring.
+	auto lights_size = VkDeviceSize{sizeof(LightClusterView)} +
+			VkDeviceSize{sizeof(Light)} * light_capacity;
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = shading.frames.emplace_back();
+		frame.lights = create_dynamic_buffer(
+				device,
+				allocator,
+				lights_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.lights_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.lights.handle,
+				0,
+				lights_size);
+	}
+	return shading;
+}
+
+void destroy_deferred_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		DeferredShading& shading) {
+	for (auto& frame : shading.frames) {
+		remove_bindless_buffer(device, bindless, frame.lights_handle);
+		destroy_buffer(device, allocator, frame.lights);
+	}
+	vkDestroyPipeline(device, shading.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, shading.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, shading.set_layout, host_callbacks());
+	shading = DeferredShading{};
+}
+
+void write_deferred_lights(
+		const DeferredShading& shading,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		VkExtent2D extent) {
+	if (lights.size() > shading.light_capacity) {
+		fmt::print(
+				stderr,
+				"Light overflow: {} lights, room for {}\n",
+				lights.size(),
+				shading.light_capacity);
+		std::terminate();
+	}
+	const auto& frame = shading.frames.at(frame_idx);
+	// Tiles are bounded by the positions they cover, the depth slices of the
+	// clusters are not needed.
+	auto light_view = LightClusterView{
+			.view = view,
+			.inverse_projection = glm::inverse(projection),
+			.extent = glm::vec4(
+					static_cast<float>(extent.width),
+					static_cast<float>(extent.height),
+					0.0F,
+					0.0F),
+			.depth = glm::vec4(0.0F),
+			.light_count = static_cast<uint32_t>(lights.size()),
+			.fog = {},
+			.decal_count = 0,
+			.decal_list = {},
+			.decals = {},
+			.padding = {}};
+	std::memcpy(frame.lights.allocation.mapped, &light_view, sizeof(light_view));
+	std::memcpy(
+			frame.lights.allocation.mapped + sizeof(light_view),
+			lights.data(),
+			lights.size_bytes());
+}
+
+void add_deferred_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		DeferredShading& shading,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		uint32_t gbuffer,
+		uint32_t scene,
+		uint32_t occlusion,
+		VkExtent2D render_extent) {
+	auto constants = DeferredConstants{
+			.lights = shading.frames.at(frame_idx).lights_handle,
+			.width = render_extent.width,
+			.height = render_extent.height};
+	auto record = [&device, &graph, &profiler, &descriptors, &shading, &bindless,
+								 frame_idx, constants, gbuffer, scene, occlusion](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "deferred");
+		auto* set = allocate_frame_set(
+				device,
+				descriptors,
+				frame_idx,
+				shading.set_layout);
+		write_deferred_set(device, graph, set, gbuffer, scene, occlusion);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline_layout,
+				bindless);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline_layout,
+				1,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		vkCmdPushConstants(
+				command_buffer,
+				shading.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(constants.width + g_deferred_tile_size - 1) / g_deferred_tile_size,
+				(constants.height + g_deferred_tile_size - 1) / g_deferred_tile_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "deferred", record, false);
+	graph_read(graph, pass, gbuffer, g_storage_read);
+	if (occlusion != g_graph_imported) {
+		graph_read(graph, pass, occlusion, g_storage_read);
+	}
+	graph_write(graph, pass, scene, g_storage_write);
+}
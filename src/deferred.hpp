@@ -0,0 +1,104 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "light_clusters.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Matches local_size in deferred_lighting.comp, a workgroup lights a tile of
+// this many pixels squared.
+constexpr auto g_deferred_tile_size = 16U;
+// Lights a tile holds. Further lights touching it are dropped.
+constexpr auto g_max_tile_lights = 256U;
+// The G-buffer holds the surface of each pixel, written by gbuffer.frag: the
+// position the lights are placed in as three floats, then the normal in
+// octahedral coordinates of 8 bits each in the low half and the color as
+// RGB565 in the high half. Pixels nothing covers keep a position of NaN, the
+// clear value.
+constexpr auto g_gbuffer_format = VK_FORMAT_R32G32B32A32_UINT;
+constexpr auto g_gbuffer_empty = UINT32_MAX;
+// What the lighting pass writes, the format of the scene it shades.
+constexpr auto g_deferred_scene_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// A frame in flight's lights, a LightClusterView followed by the lights like
+// the clusters' light buffers, so gbuffer.frag turns its normals towards the
+// viewer the way shader.frag does.
+struct DeferredFrame {
+	Buffer lights;
+	BindlessHandle lights_handle{};
+};
+
+// Deferred shading as an alternative to clustered forward lights. The main
+// pass writes the G-buffer with gbuffer.frag instead of shading, then a
+// compute pass lights it in screen tiles: each workgroup reads its pixels'
+// surfaces once, bounds their positions, culls the lights against that box
+// into shared memory and shades every pixel with the survivors. Cheaper than
+// clusters when many lights meet simple materials, at 16 bytes a pixel. The
+// pass binds the bindless table as set 0 and a set of its own as set 1:
+// binding 0 the G-buffer, binding 1 the scene and binding 2 the ambient
+// occlusion of the AMBIENT_OCCLUSION variant, all storage images taken from
+// the frame's descriptor pools like the visibility pass's.
+struct DeferredShading {
+	uint32_t light_capacity{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::vector<DeferredFrame> frames;
+};
+
+// module is a variant of deferred_lighting.comp, whose bindless arrays are
+// sized by specialization.
+auto create_deferred_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t light_capacity) -> DeferredShading;
+// The device must be idle.
+void destroy_deferred_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		DeferredShading& shading);
+
+// Writes the frame's lights and the view they are seen from, after the frame
+// fence was waited on. view and projection are the clusters' camera.
+void write_deferred_lights(
+		const DeferredShading& shading,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		VkExtent2D extent);
+
+// Adds the pass lighting gbuffer into scene with the frame's lights.
+// gbuffer must have been created with g_gbuffer_format and scene with
+// g_deferred_scene_format, both with STORAGE usage. Only the top left
+// render_extent is shaded. occlusion is what add_ambient_occlusion_pass
+// returned for the G-buffer when the module is the AMBIENT_OCCLUSION variant,
+// g_graph_imported otherwise.
+void add_deferred_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		DeferredShading& shading,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		uint32_t gbuffer,
+		uint32_t scene,
+		uint32_t occlusion,
+		VkExtent2D render_extent);
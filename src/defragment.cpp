@@ -0,0 +1,141 @@
+#include "defragment.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+
+void add_movable_buffer(
+		Defragmenter& defragmenter,
+		Buffer& buffer,
+		std::function<void()> moved) {
+	defragmenter.buffers.emplace_back(
+			MovableBuffer{.buffer = &buffer, .moved = std::move(moved)});
+}
+
+void destroy_defragmenter(
+		VkDevice& device,
+		Allocator& allocator,
+		Defragmenter& defragmenter) {
+	for (auto& move : defragmenter.moves) {
+		destroy_buffer(device, allocator, move.target);
+	}
+	defragmenter = Defragmenter{};
+}
+
+void add_defragment_pass(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		Defragmenter& defragmenter,
+		VkDeviceSize budget) {
+	for (auto& move : defragmenter.moves) {
+		defer_deletion(
+				deletions,
+				[&device, &allocator, old = *move.buffer]() mutable {
+					destroy_buffer(device, allocator, old);
+				});
+		*move.buffer = move.target;
+		const auto& movable = *std::find_if(
+				defragmenter.buffers.begin(),
+				defragmenter.buffers.end(),
+				[&](const MovableBuffer& candidate) {
+					return candidate.buffer == move.buffer;
+				});
+		if (movable.moved) {
+			movable.moved();
+		}
+	}
+	defragmenter.moves.clear();
+
+	// Emptying the sparsest blocks first frees blocks soonest.
+	auto candidates = std::pmr::vector<Buffer*>(graph.arena);
+	for (const auto& movable : defragmenter.buffers) {
+		if (in_sparse_block(allocator, movable.buffer->allocation)) {
+			candidates.emplace_back(movable.buffer);
+		}
+	}
+	std::sort(
+			candidates.begin(),
+			candidates.end(),
+			[](const Buffer* lhs, const Buffer* rhs) {
+				return lhs->allocation.block->allocated <
+						rhs->allocation.block->allocated;
+			});
+	auto copied = VkDeviceSize{};
+	for (auto* buffer : candidates) {
+		if (copied != 0 && copied + buffer->size > budget) {
+			break;
+		}
+		auto target = relocate_buffer(device, allocator, *buffer);
+		if (!target.has_value()) {
+			continue;
+		}
+		copied += buffer->size;
+		defragmenter.moves.emplace_back(
+				BufferMove{.buffer = buffer, .target = *target});
+	}
+	if (defragmenter.moves.empty()) {
+		return;
+	}
+
+	auto record = [moves = defragmenter.moves](VkCommandBuffer command_buffer) {
+		for (const auto& move : moves) {
+			auto region = VkBufferCopy{
+					.srcOffset = 0,
+					.dstOffset = 0,
+					.size = move.buffer->size};
+			vkCmdCopyBuffer(
+					command_buffer,
+					move.buffer->handle,
+					move.target.handle,
+					1,
+					&region);
+		}
+	};
+	// Whatever last wrote a buffer, an upload's ownership acquire included, has
+	// to be visible to its copy. The next frame may use the copy in any way the
+	// buffer was used.
+	auto resources =
+			std::pmr::vector<std::pair<uint32_t, uint32_t>>(graph.arena);
+	for (const auto& move : defragmenter.moves) {
+		resources.emplace_back(
+				import_graph_buffer(
+						graph,
+						move.buffer->handle,
+						GraphState{
+								.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+								.access = VK_ACCESS_2_MEMORY_WRITE_BIT,
+								.layout = VK_IMAGE_LAYOUT_UNDEFINED},
+						std::nullopt),
+				import_graph_buffer(
+						graph,
+						move.target.handle,
+						GraphState{},
+						GraphState{
+								.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+								.access = VK_ACCESS_2_MEMORY_READ_BIT,
+								.layout = VK_IMAGE_LAYOUT_UNDEFINED}));
+	}
+	auto pass = add_graph_pass(graph, "defragment", record, true);
+	for (auto [source, target] : resources) {
+		graph_read(
+				graph,
+				pass,
+				source,
+				GraphState{
+						.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+						.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+						.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+		graph_write(
+				graph,
+				pass,
+				target,
+				GraphState{
+						.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+						.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+						.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "render_graph.hpp"
+
+#include <functional>
+#include <vector>
+
+// Bytes copied per frame at most, so a move never costs a frame much.
+constexpr auto g_defragment_frame_budget = VkDeviceSize{8} * 1024 * 1024;
+
+// A buffer the defragmenter may give new memory. It needs TRANSFER_SRC usage
+// and must only be written by uploads that have completed. Once a copy is done
+// *buffer is replaced and moved is called, for its owner to refresh anything
+// derived from the handle, like device addresses or descriptors.
+struct MovableBuffer {
+	Buffer* buffer{};
+	std::function<void()> moved;
+};
+
+// A buffer copied into new memory by the frame being recorded. It takes over
+// from the old one in the next frame, which the copy's barrier makes wait.
+struct BufferMove {
+	Buffer* buffer{};
+	Buffer target;
+};
+
+// Empties sparse blocks a few buffers per frame, so a session that keeps
+// allocating and freeing does not end up holding mostly empty blocks. Buffers
+// in the sparsest blocks are copied by the GPU into fuller blocks of their
+// pool, and the emptied blocks are freed with the last range in them.
+struct Defragmenter {
+	std::vector<MovableBuffer> buffers;
+	std::vector<BufferMove> moves;
+};
+
+// buffer has to outlive the defragmenter.
+void add_movable_buffer(
+		Defragmenter& defragmenter,
+		Buffer& buffer,
+		std::function<void()> moved);
+// The device must be idle. Buffers with a move pending keep their old memory.
+void destroy_defragmenter(
+		VkDevice& device,
+		Allocator& allocator,
+		Defragmenter& defragmenter);
+
+// Switches to the buffers the previous frame copied, whose old memory goes to
+// deletions, then adds a pass copying the next ones, up to budget bytes but at
+// least one. The copies only run on the GPU the frame runs on, so device
+// groups must not defragment.
+void add_defragment_pass(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		Defragmenter& defragmenter,
+		VkDeviceSize budget);
@@ -0,0 +1,36 @@
+#include "deletion.hpp"
+
+#include <algorithm>
+#include <utility>
+
+void defer_deletion(DeletionQueue& queue, std::function<void()> destroy) {
+	queue.pending.emplace_back(PendingDeletion{
+			.ticket = queue.next_ticket,
+			.destroy = std::move(destroy)});
+}
+
+auto end_deletion_frame(DeletionQueue& queue) -> FrameTicket {
+	return queue.next_ticket++;
+}
+
+void collect_deletions(DeletionQueue& queue, FrameTicket ticket) {
+	queue.completed_ticket = std::max(queue.completed_ticket, ticket);
+	auto done = std::find_if(
+			queue.pending.begin(),
+			queue.pending.end(),
+			[&](const PendingDeletion& deletion) {
+				return deletion.ticket > queue.completed_ticket;
+			});
+	for (auto entry = queue.pending.begin(); entry != done; entry++) {
+		entry->destroy();
+	}
+	queue.pending.erase(queue.pending.begin(), done);
+}
+
+void flush_deletions(DeletionQueue& queue) {
+	for (auto& deletion : queue.pending) {
+		deletion.destroy();
+	}
+	queue.pending.clear();
+	queue.completed_ticket = queue.next_ticket - 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Identifies a submitted frame. Frames on the graphics queue complete in
+// order, so a completed ticket implies every earlier one has completed too.
+using FrameTicket = uint64_t;
+
+struct PendingDeletion {
+	FrameTicket ticket{};
+	std::function<void()> destroy;
+};
+
+// Defers destroying objects that recorded frames may still use until those
+// frames are done, instead of waiting for the device to go idle. Objects
+// queued while a frame is recorded wait for that frame, which covers every
+// earlier frame using them.
+struct DeletionQueue {
+	FrameTicket next_ticket{1};
+	FrameTicket completed_ticket{};
+	// Ordered by ticket.
+	std::vector<PendingDeletion> pending;
+};
+
+// Queues destroy to run once the frame being recorded is complete.
+void defer_deletion(DeletionQueue& queue, std::function<void()> destroy);
+// Returns the ticket of the frame being recorded, the next one starts.
+auto end_deletion_frame(DeletionQueue& queue) -> FrameTicket;
+// Runs the deletions of every frame up to ticket, which must be complete.
+void collect_deletions(DeletionQueue& queue, FrameTicket ticket);
+// Runs every deletion. The device must be idle.
+void flush_deletions(DeletionQueue& queue);
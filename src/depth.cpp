@@ -0,0 +1,47 @@
+#include "depth.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+auto select_depth_format(VkPhysicalDevice& physical_device) -> VkFormat {
+	constexpr auto candidates = std::array{
+			VK_FORMAT_D32_SFLOAT,
+			VK_FORMAT_X8_D24_UNORM_PACK32};
+	for (auto format : candidates) {
+		auto properties = VkFormatProperties{};
+		vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+		if ((properties.optimalTilingFeatures &
+				 VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0) {
+			return format;
+		}
+	}
+	fmt::print(stderr, "No supported depth format\n");
+	std::terminate();
+}
+
+auto depth_stencil_state() -> VkPipelineDepthStencilStateCreateInfo {
+	auto keep = VkStencilOpState{
+			.failOp = VK_STENCIL_OP_KEEP,
+			.passOp = VK_STENCIL_OP_KEEP,
+			.depthFailOp = VK_STENCIL_OP_KEEP,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.compareMask = 0,
+			.writeMask = 0,
+			.reference = 0};
+	return {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.depthTestEnable = VK_TRUE,
+			.depthWriteEnable = VK_TRUE,
+			.depthCompareOp = g_depth_compare_op,
+			.depthBoundsTestEnable = VK_FALSE,
+			.stencilTestEnable = VK_FALSE,
+			.front = keep,
+			.back = keep,
+			.minDepthBounds = 0,
+			.maxDepthBounds = 1};
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+// Depth is reversed: the far plane maps to 0 and the near plane to 1, so
+// targets clear to 0 and nearer fragments pass with GREATER. Floating point
+// depth keeps most of its precision near 0, which is where reversed depth puts
+// the distant geometry.
+constexpr auto g_depth_clear_value = 0.0F;
+constexpr auto g_depth_compare_op = VK_COMPARE_OP_GREATER;
+
+// Prefers D32_SFLOAT, which reversed depth benefits from, and falls back to
+// X8_D24_UNORM_PACK32. The spec guarantees one of them.
+auto select_depth_format(VkPhysicalDevice& physical_device) -> VkFormat;
+
+// Depth test and write with g_depth_compare_op. Pipelines using it should not
+// discard or write gl_FragDepth, so the test can run before the fragment
+// shader.
+auto depth_stencil_state() -> VkPipelineDepthStencilStateCreateInfo;
@@ -0,0 +1,434 @@
+#include "depth_pyramid.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_pyramid_source_binding = 0U;
+constexpr auto g_pyramid_level_binding = 1U;
+
+constexpr auto g_depth_sampled_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_pyramid_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+// Every level is written, and all but the last fetched by the next.
+constexpr auto g_pyramid_built = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in depth_pyramid.comp.
+struct PyramidConstants {
+	uint32_t source_width{};
+	uint32_t source_height{};
+	uint32_t width{};
+	uint32_t height{};
+};
+
+// Level 0 of the pyramid over extent, and how many levels it takes to get
+// to one texel.
+auto pyramid_extent(VkExtent2D extent) -> VkExtent2D {
+	return VkExtent2D{
+			.width = std::max((extent.width + 1) / 2, 1U),
+			.height = std::max((extent.height + 1) / 2, 1U)};
+}
+
+auto pyramid_levels(VkExtent2D extent) -> uint32_t {
+	return static_cast<uint32_t>(
+			std::bit_width(std::max(extent.width, extent.height)));
+}
+
+auto level_size(uint32_t size, uint32_t level) -> uint32_t {
+	return std::max((size + (1U << level) - 1) >> level, 1U);
+}
+
+auto pyramid_view(
+		VkDevice& device,
+		VkImage image,
+		uint32_t first_level,
+		uint32_t level_count) -> VkImageView {
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = g_depth_pyramid_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = first_level,
+					.levelCount = level_count,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a depth pyramid view\n");
+		std::terminate();
+	}
+	return view;
+}
+
+// The level just written is fetched by the next dispatch.
+auto level_barrier(VkImage image, uint32_t level) -> VkImageMemoryBarrier2 {
+	return VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = level,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+}
+
+void destroy_pyramid_image(
+		VkDevice& device,
+		Allocator& allocator,
+		Image& image,
+		VkImageView view,
+		const std::vector<VkImageView>& level_views) {
+	for (auto* level_view : level_views) {
+		vkDestroyImageView(device, level_view, host_callbacks());
+	}
+	vkDestroyImageView(device, view, host_callbacks());
+	destroy_image(device, allocator, image);
+}
+
+}  // namespace
+
+auto create_depth_pyramid(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors,
+		bool synchronization2) -> DepthPyramid {
+	auto pyramid = DepthPyramid{};
+	pyramid.synchronization2 = synchronization2;
+	// Texels are fetched, the sampler is only there for the descriptor.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_NEAREST,
+			.minFilter = VK_FILTER_NEAREST,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	pyramid.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto bindings = std::array{
+			VkDescriptorSetLayoutBinding{
+					.binding = g_pyramid_source_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = &pyramid.sampler},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_pyramid_level_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_layout_flags(descriptors),
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&pyramid.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create depth pyramid set layout\n");
+		std::terminate();
+	}
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(PyramidConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &pyramid.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&pyramid.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create depth pyramid pipeline layout\n");
+		std::terminate();
+	}
+	pyramid.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			pyramid.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	return pyramid;
+}
+
+void destroy_depth_pyramid(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		DepthPyramid& pyramid) {
+	if (pyramid.image.handle != VK_NULL_HANDLE) {
+		remove_bindless_image(device, bindless, pyramid.handle);
+		destroy_pyramid_image(
+				device,
+				allocator,
+				pyramid.image,
+				pyramid.view,
+				pyramid.level_views);
+	}
+	vkDestroyPipeline(device, pyramid.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, pyramid.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, pyramid.set_layout, host_callbacks());
+	release_sampler(device, samplers, pyramid.sampler);
+	pyramid = DepthPyramid{};
+}
+
+void resize_depth_pyramid(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		BindlessTable& bindless,
+		DepthPyramid& pyramid,
+		VkExtent2D target_extent) {
+	auto extent = pyramid_extent(target_extent);
+	if (extent.width == pyramid.extent.width &&
+			extent.height == pyramid.extent.height) {
+		return;
+	}
+	if (pyramid.image.handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device,
+				 &allocator,
+				 &bindless,
+				 image = pyramid.image,
+				 view = pyramid.view,
+				 handle = pyramid.handle,
+				 level_views = pyramid.level_views]() mutable {
+					remove_bindless_image(device, bindless, handle);
+					destroy_pyramid_image(device, allocator, image, view, level_views);
+				});
+	}
+	pyramid.extent = extent;
+	pyramid.valid = false;
+	auto levels = pyramid_levels(extent);
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_depth_pyramid_format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = levels,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	pyramid.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	pyramid.view = pyramid_view(device, pyramid.image.handle, 0, levels);
+	pyramid.handle = add_bindless_image(
+			device,
+			bindless,
+			pyramid.view,
+			VK_IMAGE_LAYOUT_GENERAL);
+	pyramid.level_views.clear();
+	for (auto level = 0U; level < levels; level++) {
+		pyramid.level_views.emplace_back(
+				pyramid_view(device, pyramid.image.handle, level, 1));
+	}
+}
+
+auto import_depth_pyramid(RenderGraph& graph, const DepthPyramid& pyramid)
+		-> uint32_t {
+	return import_graph_image(
+			graph,
+			pyramid.image.handle,
+			pyramid.view,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			pyramid.valid ? g_pyramid_built : GraphState{},
+			g_pyramid_built);
+}
+
+auto depth_pyramid_occlusion(
+		const DepthPyramid& pyramid,
+		const glm::mat4& transform) -> DrawOcclusion {
+	auto occlusion = DrawOcclusion{};
+	if (!pyramid.valid) {
+		return occlusion;
+	}
+	occlusion.reprojection = pyramid.built_transform * glm::inverse(transform);
+	occlusion.pyramid = pyramid.handle;
+	occlusion.levels = pyramid.built_levels;
+	occlusion.extent = pyramid.built_extent;
+	return occlusion;
+}
+
+void add_depth_pyramid_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		DepthPyramid& pyramid,
+		size_t frame_idx,
+		uint32_t image,
+		uint32_t depth,
+		const glm::mat4& transform,
+		VkExtent2D render_extent) {
+	auto extent = pyramid_extent(render_extent);
+	auto levels = pyramid_levels(extent);
+	auto record = [&device, &graph, &profiler, &descriptors, &pyramid, frame_idx,
+								 depth, render_extent, extent, levels](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "depth_pyramid");
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				pyramid.pipeline);
+		auto source_extent = render_extent;
+		for (auto level = 0U; level < levels; level++) {
+			if (level > 0) {
+				auto barrier = level_barrier(pyramid.image.handle, level - 1);
+				pipeline_barrier(
+						pyramid.synchronization2,
+						command_buffer,
+						{},
+						{&barrier, 1});
+			}
+			auto descriptors_written = std::array{
+					FrameImageDescriptor{
+							.binding = g_pyramid_source_binding,
+							.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+							.image =
+									VkDescriptorImageInfo{
+											.sampler = pyramid.sampler,
+											.imageView = level == 0
+													? graph_image_view(graph, depth)
+													: pyramid.level_views.at(level - 1),
+											.imageLayout = level == 0
+													? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+													: VK_IMAGE_LAYOUT_GENERAL}},
+					FrameImageDescriptor{
+							.binding = g_pyramid_level_binding,
+							.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+							.image = VkDescriptorImageInfo{
+									.sampler = VK_NULL_HANDLE,
+									.imageView = pyramid.level_views.at(level),
+									.imageLayout = VK_IMAGE_LAYOUT_GENERAL}},
+			};
+			auto set = write_frame_set(
+					device,
+					descriptors,
+					frame_idx,
+					pyramid.set_layout,
+					descriptors_written);
+			bind_frame_set(
+					command_buffer,
+					descriptors,
+					frame_idx,
+					VK_PIPELINE_BIND_POINT_COMPUTE,
+					pyramid.pipeline_layout,
+					0,
+					set);
+			auto constants = PyramidConstants{
+					.source_width = source_extent.width,
+					.source_height = source_extent.height,
+					.width = level_size(extent.width, level),
+					.height = level_size(extent.height, level)};
+			vkCmdPushConstants(
+					command_buffer,
+					pyramid.pipeline_layout,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					0,
+					sizeof(constants),
+					&constants);
+			vkCmdDispatch(
+					command_buffer,
+					(constants.width + g_depth_pyramid_group_size - 1) /
+							g_depth_pyramid_group_size,
+					(constants.height + g_depth_pyramid_group_size - 1) /
+							g_depth_pyramid_group_size,
+					1);
+			source_extent =
+					VkExtent2D{.width = constants.width, .height = constants.height};
+		}
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "depth_pyramid", record, false);
+	graph_read(graph, pass, depth, g_depth_sampled_read);
+	graph_write(graph, pass, image, g_pyramid_built);
+	pyramid.valid = true;
+	pyramid.built_extent = render_extent;
+	pyramid.built_levels = levels;
+	pyramid.built_transform = transform;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "deletion.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "draw_list.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Matches local_size in depth_pyramid.comp.
+constexpr auto g_depth_pyramid_group_size = 8U;
+constexpr auto g_depth_pyramid_format = VK_FORMAT_R32_SFLOAT;
+
+// The scene's depth reduced level by level, each texel holding the farthest
+// depth of the 2x2 texels above it, which with reversed depth is the
+// smallest. Level 0 halves the render area, rounded up, so a texel of level
+// l covers exactly the pixels its 2^(l+1) square does, and the levels stop
+// at one texel. Built at the end of a frame from its depth, it is what
+// draw_list.comp tests the next frame's instances against: an instance
+// whose bounds are farther than the farthest depth under them was hidden.
+//
+// The image is sized for the target, and built over the frame's render
+// extent, which dynamic resolution changes. It stays in GENERAL: the build
+// passes write each level as a storage image and fetch the one above through
+// the pass's set, binding 0 the source with a nearest sampler and binding 1
+// the level written, and draw lists fetch any level through the bindless
+// table.
+struct DepthPyramid {
+	bool synchronization2{};
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	Image image;
+	// Of all levels, which the bindless table holds, and of each level.
+	VkImageView view{};
+	BindlessHandle handle{};
+	std::vector<VkImageView> level_views;
+	VkExtent2D extent{};
+	// Whether the image holds the last frame's depth, the render extent and
+	// levels it was built over, and the transform that frame drew with.
+	bool valid{};
+	VkExtent2D built_extent{};
+	uint32_t built_levels{};
+	glm::mat4 built_transform{1.0F};
+};
+
+// module is depth_pyramid.comp. descriptors is the allocator the passes are
+// added with.
+auto create_depth_pyramid(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors,
+		bool synchronization2) -> DepthPyramid;
+// The device must be idle.
+void destroy_depth_pyramid(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		DepthPyramid& pyramid);
+
+// Recreates the image when the target's extent changed, the old one is
+// destroyed once the frames using it are done. Until the next build nothing
+// is culled against it.
+void resize_depth_pyramid(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		BindlessTable& bindless,
+		DepthPyramid& pyramid,
+		VkExtent2D target_extent);
+
+// Imports the image into the frame's graph, for the draw list pass to read
+// and the build passes to write. Must be called after resize_depth_pyramid.
+auto import_depth_pyramid(RenderGraph& graph, const DepthPyramid& pyramid)
+		-> uint32_t;
+// What the frame's draw lists test against, the pyramid built last frame,
+// reprojected from its transform to transform. Instances are taken to have
+// stayed where they were. Tests nothing until a pyramid was built.
+auto depth_pyramid_occlusion(
+		const DepthPyramid& pyramid,
+		const glm::mat4& transform) -> DrawOcclusion;
+// Adds the passes building the pyramid from the top left render_extent of
+// depth, the scene's single sampled depth stored by the passes that wrote
+// it, drawn with transform. The draw list pass reading the pyramid must have
+// been added before.
+void add_depth_pyramid_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		DepthPyramid& pyramid,
+		size_t frame_idx,
+		uint32_t image,
+		uint32_t depth,
+		const glm::mat4& transform,
+		VkExtent2D render_extent);
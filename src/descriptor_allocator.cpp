@@ -0,0 +1,301 @@
+#include "descriptor_allocator.hpp"
+
+#include "host_memory.hpp"
+#include "static_vector.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+constexpr auto g_unknown_offset = ~VkDeviceSize{};
+constexpr auto g_descriptor_buffer_usage =
+		VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+		VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+auto create_pool(VkDevice& device) -> VkDescriptorPool {
+	auto pool_sizes = std::array{
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = g_descriptor_pool_sets * g_pool_sampled_per_set},
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = g_descriptor_pool_sets * g_pool_storage_per_set},
+	};
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.maxSets = g_descriptor_pool_sets,
+			.poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data()};
+	auto* pool = VkDescriptorPool{};
+	if (vkCreateDescriptorPool(device, &pool_info, host_callbacks(), &pool) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create frame descriptor pool\n");
+		std::terminate();
+	}
+	return pool;
+}
+
+auto try_allocate(
+		VkDevice& device,
+		VkDescriptorPool pool,
+		VkDescriptorSetLayout layout,
+		VkDescriptorSet& set) -> VkResult {
+	auto allocate_info = VkDescriptorSetAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &layout};
+	return vkAllocateDescriptorSets(device, &allocate_info, &set);
+}
+
+auto binding_offset(
+		VkDevice& device,
+		DescriptorLayoutOffsets& offsets,
+		VkDescriptorSetLayout layout,
+		uint32_t binding) -> VkDeviceSize {
+	if (binding >= offsets.bindings.size()) {
+		offsets.bindings.resize(binding + 1, g_unknown_offset);
+	}
+	auto& offset = offsets.bindings[binding];
+	if (offset == g_unknown_offset) {
+		vkGetDescriptorSetLayoutBindingOffsetEXT(device, layout, binding, &offset);
+	}
+	return offset;
+}
+
+auto write_buffer_set(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkDescriptorSetLayout layout,
+		std::span<const FrameImageDescriptor> descriptors) -> FrameSet {
+	auto [entry, added] = pools.layouts.try_emplace(layout);
+	auto& offsets = entry->second;
+	if (added) {
+		vkGetDescriptorSetLayoutSizeEXT(device, layout, &offsets.size);
+	}
+	auto& frame = pools.buffers.at(frame_idx);
+	auto offset = align_up(frame.used, pools.offset_alignment);
+	if (offset + offsets.size > frame.buffer.size) {
+		fmt::print(
+				stderr,
+				"Frame descriptor buffer overflow: {} bytes, room for {}\n",
+				offset + offsets.size,
+				frame.buffer.size);
+		std::terminate();
+	}
+	auto* set = frame.buffer.allocation.mapped + offset;
+	for (const auto& descriptor : descriptors) {
+		auto sampled =
+				descriptor.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		auto get_info = VkDescriptorGetInfoEXT{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
+				.pNext = VK_NULL_HANDLE,
+				.type = descriptor.type,
+				.data = {}};
+		if (sampled) {
+			get_info.data.pCombinedImageSampler = &descriptor.image;
+		} else {
+			get_info.data.pStorageImage = &descriptor.image;
+		}
+		vkGetDescriptorEXT(
+				device,
+				&get_info,
+				sampled ? pools.sampled_size : pools.storage_size,
+				set + binding_offset(device, offsets, layout, descriptor.binding));
+	}
+	frame.used = offset + offsets.size;
+	return FrameSet{.set = VK_NULL_HANDLE, .offset = offset};
+}
+
+}  // namespace
+
+auto create_descriptor_allocator(
+		VkDevice& device,
+		Allocator& allocator,
+		VkPhysicalDevice physical_device,
+		size_t frame_count,
+		bool descriptor_buffer) -> DescriptorAllocator {
+	auto pools = DescriptorAllocator{};
+	pools.frames.resize(frame_count);
+	pools.descriptor_buffer = descriptor_buffer;
+	if (!descriptor_buffer) {
+		return pools;
+	}
+	auto buffer_properties = VkPhysicalDeviceDescriptorBufferPropertiesEXT{};
+	buffer_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &buffer_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	pools.offset_alignment = buffer_properties.descriptorBufferOffsetAlignment;
+	pools.sampled_size = buffer_properties.combinedImageSamplerDescriptorSize;
+	pools.storage_size = buffer_properties.storageImageDescriptorSize;
+	// The host writes descriptors the device reads once.
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = pools.buffers.emplace_back();
+		frame.buffer = create_dynamic_buffer(
+				device,
+				allocator,
+				g_frame_descriptor_buffer_size,
+				g_descriptor_buffer_usage);
+		frame.address = buffer_device_address(device, frame.buffer);
+	}
+	return pools;
+}
+
+void destroy_descriptor_allocator(
+		VkDevice& device,
+		Allocator& allocator,
+		DescriptorAllocator& pools) {
+	for (auto& frame : pools.frames) {
+		for (auto* pool : frame.pools) {
+			vkDestroyDescriptorPool(device, pool, host_callbacks());
+		}
+	}
+	for (auto& frame : pools.buffers) {
+		destroy_buffer(device, allocator, frame.buffer);
+	}
+	pools = DescriptorAllocator{};
+}
+
+auto descriptor_layout_flags(const DescriptorAllocator& pools)
+		-> VkDescriptorSetLayoutCreateFlags {
+	return pools.descriptor_buffer
+			? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+			: 0;
+}
+
+auto descriptor_pipeline_flags(const DescriptorAllocator& pools)
+		-> VkPipelineCreateFlags {
+	return pools.descriptor_buffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+																 : 0;
+}
+
+void reset_frame_descriptors(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx) {
+	auto& frame = pools.frames.at(frame_idx);
+	// Pools past current were not allocated from since the last reset.
+	for (auto i = size_t{}; i < frame.pools.size() && i <= frame.current; i++) {
+		vkResetDescriptorPool(device, frame.pools[i], 0);
+	}
+	frame.current = 0;
+	if (pools.descriptor_buffer) {
+		pools.buffers.at(frame_idx).used = 0;
+	}
+}
+
+auto allocate_frame_set(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkDescriptorSetLayout layout) -> VkDescriptorSet {
+	auto& frame = pools.frames.at(frame_idx);
+	auto* set = VkDescriptorSet{};
+	while (true) {
+		auto fresh = frame.current == frame.pools.size();
+		if (fresh) {
+			frame.pools.emplace_back(create_pool(device));
+		}
+		auto result = try_allocate(device, frame.pools[frame.current], layout, set);
+		if (result == VK_SUCCESS) {
+			return set;
+		}
+		// A full pool reports either, depending on the driver. An empty one
+		// failing means the layout does not fit a pool at all.
+		if (fresh || (result != VK_ERROR_OUT_OF_POOL_MEMORY &&
+									result != VK_ERROR_FRAGMENTED_POOL)) {
+			fmt::print(stderr, "Failed to allocate frame descriptor set\n");
+			std::terminate();
+		}
+		frame.current++;
+	}
+}
+
+auto write_frame_set(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkDescriptorSetLayout layout,
+		std::span<const FrameImageDescriptor> descriptors) -> FrameSet {
+	if (pools.descriptor_buffer) {
+		return write_buffer_set(device, pools, frame_idx, layout, descriptors);
+	}
+	auto* set = allocate_frame_set(device, pools, frame_idx, layout);
+	auto writes = StaticVector<VkWriteDescriptorSet, g_max_frame_descriptors>{};
+	for (const auto& descriptor : descriptors) {
+		writes.emplace_back(VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = descriptor.binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = descriptor.type,
+				.pImageInfo = &descriptor.image,
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE});
+	}
+	vkUpdateDescriptorSets(
+			device,
+			static_cast<uint32_t>(writes.size()),
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+	return FrameSet{.set = set, .offset = 0};
+}
+
+void bind_frame_set(
+		VkCommandBuffer command_buffer,
+		const DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkPipelineBindPoint bind_point,
+		VkPipelineLayout pipeline_layout,
+		uint32_t set_idx,
+		const FrameSet& set) {
+	if (set.set != VK_NULL_HANDLE) {
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				bind_point,
+				pipeline_layout,
+				set_idx,
+				1,
+				&set.set,
+				0,
+				VK_NULL_HANDLE);
+		return;
+	}
+	// Rebinding the buffer is cheap next to the dispatches of a pass, and
+	// keeps passes independent of what the command buffer bound before.
+	auto binding_info = VkDescriptorBufferBindingInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.address = pools.buffers.at(frame_idx).address,
+			.usage = g_descriptor_buffer_usage};
+	vkCmdBindDescriptorBuffersEXT(command_buffer, 1, &binding_info);
+	auto buffer_idx = uint32_t{};
+	vkCmdSetDescriptorBufferOffsetsEXT(
+			command_buffer,
+			bind_point,
+			pipeline_layout,
+			set_idx,
+			1,
+			&buffer_idx,
+			&set.offset);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+
+// Sets a pool of the allocator holds, and the descriptors of each type it
+// has room for per set. Sets of the passes using it take at most three
+// sampled inputs and two storage images.
+constexpr auto g_descriptor_pool_sets = 64U;
+constexpr auto g_pool_sampled_per_set = 3U;
+constexpr auto g_pool_storage_per_set = 2U;
+// Bytes of descriptors a frame writes into its descriptor buffer, far more
+// than the few sets of the passes need at any descriptor size.
+constexpr auto g_frame_descriptor_buffer_size = VkDeviceSize{64} * 1024;
+// The most descriptors a set written with write_frame_set has.
+constexpr auto g_max_frame_descriptors = size_t{4};
+
+// The pools a frame in flight allocates from. current is the one allocated
+// from, the ones before it are full.
+struct FrameDescriptorPools {
+	std::vector<VkDescriptorPool> pools;
+	size_t current{};
+};
+
+// A frame's descriptor buffer, mapped, which sets are written into from the
+// start while the frame is recorded.
+struct FrameDescriptorBuffer {
+	Buffer buffer;
+	VkDeviceAddress address{};
+	VkDeviceSize used{};
+};
+
+// Where a layout's descriptors go within its sets in a descriptor buffer, by
+// binding. Unknown offsets are queried on first use.
+struct DescriptorLayoutOffsets {
+	VkDeviceSize size{};
+	std::vector<VkDeviceSize> bindings;
+};
+
+// Descriptor sets that only live while one frame is recorded and executed,
+// for the passes outside the bindless table. Every set comes out of the
+// frame's pools and none is freed: the next use of the frame slot resets the
+// pools whole, which is cheaper on most drivers than freeing sets one by one.
+// Pools are added when a frame needs more sets, and kept, so a steady workload
+// stops creating them after its first frames. Only the thread recording
+// frames may use it.
+//
+// With descriptor buffers, sets written with write_frame_set skip the pools:
+// their descriptors are copied straight into the frame's descriptor buffer
+// and bound by offset, so nothing is allocated at all. Their layouts and
+// pipelines must be created with descriptor_layout_flags and
+// descriptor_pipeline_flags. Layouts that share a pipeline with the bindless
+// table cannot, since a pipeline takes either descriptor buffers or sets, and
+// keep allocating from the pools.
+struct DescriptorAllocator {
+	std::vector<FrameDescriptorPools> frames;
+	bool descriptor_buffer{};
+	std::vector<FrameDescriptorBuffer> buffers;
+	VkDeviceSize offset_alignment{};
+	size_t sampled_size{};
+	size_t storage_size{};
+	std::map<VkDescriptorSetLayout, DescriptorLayoutOffsets> layouts;
+};
+
+// A combined image sampler or storage image written into a frame set. The
+// sampler of a combined image sampler must be its immutable one.
+struct FrameImageDescriptor {
+	uint32_t binding{};
+	VkDescriptorType type{};
+	VkDescriptorImageInfo image{};
+};
+
+// A set written for the frame: allocated from a pool, or at offset into the
+// frame's descriptor buffer when set is null.
+struct FrameSet {
+	VkDescriptorSet set{};
+	VkDeviceSize offset{};
+};
+
+// Pools are created on first use. descriptor_buffer needs the capability
+// and a device_address allocator, and creates a descriptor buffer per frame.
+auto create_descriptor_allocator(
+		VkDevice& device,
+		Allocator& allocator,
+		VkPhysicalDevice physical_device,
+		size_t frame_count,
+		bool descriptor_buffer) -> DescriptorAllocator;
+// The device must be idle.
+void destroy_descriptor_allocator(
+		VkDevice& device,
+		Allocator& allocator,
+		DescriptorAllocator& pools);
+
+// What the layouts and pipelines of sets written with write_frame_set are
+// created with.
+auto descriptor_layout_flags(const DescriptorAllocator& pools)
+		-> VkDescriptorSetLayoutCreateFlags;
+auto descriptor_pipeline_flags(const DescriptorAllocator& pools)
+		-> VkPipelineCreateFlags;
+
+// Returns every set of the frame to its pools. Must be called after the frame
+// fence was waited on.
+void reset_frame_descriptors(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx);
+// A set of layout valid until the frame is reset, for layouts that cannot
+// live in a descriptor buffer. layout may only use COMBINED_IMAGE_SAMPLER and
+// STORAGE_IMAGE descriptors, within the per set counts above.
+auto allocate_frame_set(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkDescriptorSetLayout layout) -> VkDescriptorSet;
+// A set of layout holding descriptors, valid until the frame is reset.
+// Bindings the pipelines do not read may be left out. layout is subject to
+// the same limits as with allocate_frame_set.
+auto write_frame_set(
+		VkDevice& device,
+		DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkDescriptorSetLayout layout,
+		std::span<const FrameImageDescriptor> descriptors) -> FrameSet;
+// Binds set as set_idx of pipeline_layout. Descriptor buffer offsets and
+// bound sets invalidate each other, so passes bind every set they use.
+void bind_frame_set(
+		VkCommandBuffer command_buffer,
+		const DescriptorAllocator& pools,
+		size_t frame_idx,
+		VkPipelineBindPoint bind_point,
+		VkPipelineLayout pipeline_layout,
+		uint32_t set_idx,
+		const FrameSet& set);
@@ -0,0 +1,116 @@
+#include "device_group.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <span>
+
+namespace {
+
+constexpr auto g_alternate_frame_modes = VkDeviceGroupPresentModeFlagsKHR{
+		VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR |
+		VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR};
+
+auto presents_locally(const DeviceGroup& group, uint32_t device_idx) -> bool {
+	return (group.present_modes & VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR) !=
+			0 &&
+			(group.present_masks.at(device_idx) & (1U << device_idx)) != 0;
+}
+
+}  // namespace
+
+auto find_device_group(VkInstance& instance, VkPhysicalDevice physical_device)
+		-> DeviceGroup {
+	auto group_count = uint32_t{};
+	vkEnumeratePhysicalDeviceGroups(instance, &group_count, VK_NULL_HANDLE);
+	auto groups = std::vector<VkPhysicalDeviceGroupProperties>(
+			group_count,
+			VkPhysicalDeviceGroupProperties{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES,
+					.pNext = VK_NULL_HANDLE,
+					.physicalDeviceCount = 0,
+					.physicalDevices = {},
+					.subsetAllocation = VK_FALSE});
+	vkEnumeratePhysicalDeviceGroups(instance, &group_count, groups.data());
+	for (const auto& properties : groups) {
+		auto members = std::span(properties.physicalDevices)
+											 .first(properties.physicalDeviceCount);
+		if (members.size() > 1 &&
+				std::find(members.begin(), members.end(), physical_device) !=
+						members.end()) {
+			return DeviceGroup{
+					.devices = {members.begin(), members.end()},
+					.frame_devices = {0},
+					.present_masks = {},
+					.present_modes = 0};
+		}
+	}
+	return DeviceGroup{};
+}
+
+auto device_group_create_info(const DeviceGroup& group, const void* next)
+		-> VkDeviceGroupDeviceCreateInfo {
+	return VkDeviceGroupDeviceCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO,
+			.pNext = next,
+			.physicalDeviceCount = static_cast<uint32_t>(group.devices.size()),
+			.pPhysicalDevices = group.devices.data()};
+}
+
+void select_frame_devices(VkDevice& device, bool presents, DeviceGroup& group) {
+	if (group.devices.empty()) {
+		return;
+	}
+	group.frame_devices.clear();
+	if (presents) {
+		auto capabilities = VkDeviceGroupPresentCapabilitiesKHR{
+				.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR,
+				.pNext = VK_NULL_HANDLE,
+				.presentMask = {},
+				.modes = 0};
+		vkGetDeviceGroupPresentCapabilitiesKHR(device, &capabilities);
+		std::copy_n(
+				std::begin(capabilities.presentMask),
+				group.present_masks.size(),
+				group.present_masks.begin());
+		group.present_modes = capabilities.modes;
+	}
+	// Remote presents need some GPU that presents for the rendering one.
+	auto presented = uint32_t{};
+	for (auto mask : group.present_masks) {
+		presented |= mask;
+	}
+	auto remote =
+			(group.present_modes & VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR) != 0;
+	for (auto i = uint32_t{}; i < group.devices.size(); i++) {
+		if (!presents || presents_locally(group, i) ||
+				(remote && (presented & (1U << i)) != 0)) {
+			group.frame_devices.emplace_back(i);
+		}
+	}
+	if (group.frame_devices.empty()) {
+		group.frame_devices.emplace_back(0);
+	}
+}
+
+auto frame_device_mask(const DeviceGroup& group, size_t frame_number)
+		-> uint32_t {
+	if (group.devices.empty()) {
+		return 0;
+	}
+	return 1U << group.frame_devices.at(
+								 frame_number % group.frame_devices.size());
+}
+
+auto swap_chain_present_modes(const DeviceGroup& group)
+		-> VkDeviceGroupPresentModeFlagsKHR {
+	return group.present_modes & g_alternate_frame_modes;
+}
+
+auto frame_present_mode(const DeviceGroup& group, uint32_t device_mask)
+		-> VkDeviceGroupPresentModeFlagBitsKHR {
+	return presents_locally(
+								 group,
+								 static_cast<uint32_t>(std::countr_zero(device_mask)))
+			? VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR
+			: VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Alternate frame rendering over the GPUs of a device group, such as linked
+// GPUs of one model. Memory allocated without a device mask has an instance
+// on every GPU and command buffers submitted without one run on all of them,
+// so uploads and compute jobs keep every GPU's copy current. A frame's
+// command buffer runs on one GPU, which also waits on its semaphores and
+// signals them, and its swap chain image is presented from that GPU's
+// instance, by that GPU or by one that can present for it.
+struct DeviceGroup {
+	// The group's GPUs, in the order device indices refer to. Empty unless
+	// the device is created over more than one GPU.
+	std::vector<VkPhysicalDevice> devices;
+	// Device indices of the GPUs frames alternate over.
+	std::vector<uint32_t> frame_devices{0};
+	// From vkGetDeviceGroupPresentCapabilitiesKHR, zero without presenting.
+	// Bit j of present_masks[i] is set when GPU i presents images of GPU j.
+	std::array<uint32_t, VK_MAX_DEVICE_GROUP_SIZE> present_masks{};
+	VkDeviceGroupPresentModeFlagsKHR present_modes{};
+};
+
+// The group physical_device belongs to when it has other GPUs, an empty one
+// otherwise. The instance must be Vulkan 1.1 or newer.
+auto find_device_group(VkInstance& instance, VkPhysicalDevice physical_device)
+		-> DeviceGroup;
+// Chained into VkDeviceCreateInfo, pointing into group.
+auto device_group_create_info(const DeviceGroup& group, const void* next)
+		-> VkDeviceGroupDeviceCreateInfo;
+// Keeps the GPUs frames can be presented from. Without presenting every GPU
+// renders frames.
+void select_frame_devices(VkDevice& device, bool presents, DeviceGroup& group);
+
+// The GPU a frame runs on, zero outside of a group, which runs commands on
+// the whole device.
+auto frame_device_mask(const DeviceGroup& group, size_t frame_number)
+		-> uint32_t;
+// The modes swap chains are created for, zero outside of a group.
+auto swap_chain_present_modes(const DeviceGroup& group)
+		-> VkDeviceGroupPresentModeFlagsKHR;
+// How an image rendered by the GPU of device_mask is presented.
+auto frame_present_mode(const DeviceGroup& group, uint32_t device_mask)
+		-> VkDeviceGroupPresentModeFlagBitsKHR;
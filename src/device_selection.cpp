@@ -0,0 +1,226 @@
+#include "device_selection.hpp"
+
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+auto parse_uint(std::string_view text) -> std::optional<uint32_t> {
+	auto value = uint32_t{};
+	auto [last, error] =
+			std::from_chars(text.data(), text.data() + text.size(), value);
+	if (error != std::errc{} || last != text.data() + text.size()) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+auto parse_uuid(std::string_view hex) -> std::optional<DeviceUuid> {
+	auto uuid = DeviceUuid{};
+	if (hex.size() != uuid.size() * 2) {
+		return std::nullopt;
+	}
+	for (auto i = size_t{}; i < uuid.size(); i++) {
+		const auto* first = hex.data() + (i * 2);
+		auto [last, error] = std::from_chars(first, first + 2, uuid.at(i), 16);
+		if (error != std::errc{} || last != first + 2) {
+			return std::nullopt;
+		}
+	}
+	return uuid;
+}
+
+// Whether family is one of queue_families and has all of the flags and
+// none of the excluded ones.
+auto family_has(
+		std::span<const VkQueueFamilyProperties> queue_families,
+		uint32_t family,
+		VkQueueFlags flags,
+		VkQueueFlags excluded) -> bool {
+	if (family >= queue_families.size()) {
+		return false;
+	}
+	auto family_flags = queue_families[family].queueFlags;
+	return (family_flags & flags) == flags && (family_flags & excluded) == 0U;
+}
+
+}  // namespace
+
+auto query_device_uuid(VkPhysicalDevice device) -> DeviceUuid {
+	auto id_properties = VkPhysicalDeviceIDProperties{};
+	id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &id_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(device, &properties);
+	auto uuid = DeviceUuid{};
+	std::copy_n(
+			std::begin(id_properties.deviceUUID),
+			uuid.size(),
+			uuid.begin());
+	return uuid;
+}
+
+auto load_device_selection(const std::filesystem::path& path)
+		-> std::optional<DeviceSelection> {
+	auto file = std::ifstream(path);
+	if (!file) {
+		return std::nullopt;
+	}
+	auto selection = DeviceSelection{};
+	auto fields = 0U;
+	auto line = std::string{};
+	while (std::getline(file, line)) {
+		auto space = line.find(' ');
+		if (space == std::string::npos) {
+			fields = 0;
+			break;
+		}
+		auto key = std::string_view(line).substr(0, space);
+		auto value = std::string_view(line).substr(space + 1);
+		if (key == "device") {
+			auto uuid = parse_uuid(value);
+			if (!uuid.has_value()) {
+				fields = 0;
+				break;
+			}
+			selection.devices.emplace_back(*uuid);
+			continue;
+		}
+		auto number = parse_uint(value);
+		if (!number.has_value()) {
+			fields = 0;
+			break;
+		}
+		if (key == "selected") {
+			selection.selected = *number;
+		} else if (key == "driver") {
+			selection.driver_version = *number;
+		} else if (key == "needs_present") {
+			selection.needs_present = *number != 0;
+		} else if (key == "graphics") {
+			selection.graphics_family = *number;
+		} else if (key == "present") {
+			selection.present_family = *number;
+		} else if (key == "transfer") {
+			selection.transfer_family = *number;
+		} else if (key == "compute") {
+			selection.compute_family = *number;
+		} else {
+			fields = 0;
+			break;
+		}
+		fields++;
+	}
+	// selected, driver, needs_present and graphics are always written.
+	if (fields < 4 || selection.selected >= selection.devices.size()) {
+		log_message(
+				LogLevel::warning,
+				"Ignoring malformed device selection {}",
+				path.string());
+		return std::nullopt;
+	}
+	return selection;
+}
+
+void save_device_selection(
+		const std::filesystem::path& path,
+		const DeviceSelection& selection) {
+	auto error = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), error);
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::trunc);
+		for (const auto& uuid : selection.devices) {
+			file << "device ";
+			for (auto byte : uuid) {
+				file << fmt::format("{:02x}", byte);
+			}
+			file << '\n';
+		}
+		file << "selected " << selection.selected << '\n';
+		file << "driver " << selection.driver_version << '\n';
+		file << "needs_present " << (selection.needs_present ? 1 : 0) << '\n';
+		file << "graphics " << selection.graphics_family << '\n';
+		if (selection.present_family.has_value()) {
+			file << "present " << *selection.present_family << '\n';
+		}
+		if (selection.transfer_family.has_value()) {
+			file << "transfer " << *selection.transfer_family << '\n';
+		}
+		if (selection.compute_family.has_value()) {
+			file << "compute " << *selection.compute_family << '\n';
+		}
+		if (!file) {
+			log_message(
+					LogLevel::warning,
+					"Failed to write device selection {}",
+					path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		log_message(
+				LogLevel::warning,
+				"Failed to write device selection {}",
+				path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
+
+auto device_selection_fits(
+		VkPhysicalDevice device,
+		VkSurfaceKHR surface,
+		const DeviceSelection& selection,
+		std::span<const VkQueueFamilyProperties> queue_families) -> bool {
+	if (!family_has(
+					queue_families,
+					selection.graphics_family,
+					VK_QUEUE_GRAPHICS_BIT,
+					0)) {
+		return false;
+	}
+	if (selection.transfer_family.has_value() &&
+			!family_has(
+					queue_families,
+					*selection.transfer_family,
+					VK_QUEUE_TRANSFER_BIT,
+					VK_QUEUE_GRAPHICS_BIT)) {
+		return false;
+	}
+	if (selection.compute_family.has_value() &&
+			!family_has(
+					queue_families,
+					*selection.compute_family,
+					VK_QUEUE_COMPUTE_BIT,
+					VK_QUEUE_GRAPHICS_BIT)) {
+		return false;
+	}
+	if (!selection.needs_present) {
+		return true;
+	}
+	if (!selection.present_family.has_value() ||
+			*selection.present_family >= queue_families.size()) {
+		return false;
+	}
+	auto supports_present = VkBool32{};
+	vkGetPhysicalDeviceSurfaceSupportKHR(
+			device,
+			*selection.present_family,
+			surface,
+			&supports_present);
+	return supports_present == VK_TRUE;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+using DeviceUuid = std::array<uint8_t, VK_UUID_SIZE>;
+
+// The physical device and queue families the last run picked, saved in the
+// cache directory. While the same devices are installed and the driver did
+// not change, startup queries the picked device alone and checks the
+// families still fit instead of scoring every device and family.
+struct DeviceSelection {
+	// Of every device enumerated, in order.
+	std::vector<DeviceUuid> devices;
+	uint32_t selected{};
+	uint32_t driver_version{};
+	// Whether a family had to present, which offscreen runs do not need.
+	bool needs_present{};
+	uint32_t graphics_family{};
+	std::optional<uint32_t> present_family;
+	std::optional<uint32_t> transfer_family;
+	std::optional<uint32_t> compute_family;
+};
+
+// Needs Vulkan 1.1.
+auto query_device_uuid(VkPhysicalDevice device) -> DeviceUuid;
+
+// One line per field, the devices' UUIDs in hex. Empty when the file is
+// missing or malformed.
+auto load_device_selection(const std::filesystem::path& path)
+		-> std::optional<DeviceSelection>;
+// Replaces the file through a temporary one like the pipeline cache.
+void save_device_selection(
+		const std::filesystem::path& path,
+		const DeviceSelection& selection);
+
+// Whether the selection's families are still there with the queues they
+// were picked for, and its present family can present to surface.
+auto device_selection_fits(
+		VkPhysicalDevice device,
+		VkSurfaceKHR surface,
+		const DeviceSelection& selection,
+		std::span<const VkQueueFamilyProperties> queue_families) -> bool;
@@ -0,0 +1,132 @@
+#include "dispatch.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+#define VK_DEFINE_FUNCTION(name) PFN_##name name = nullptr;
+VK_DEFINE_FUNCTION(vkGetInstanceProcAddr)
+VK_GLOBAL_FUNCTIONS(VK_DEFINE_FUNCTION)
+VK_GLOBAL_OPTIONAL_FUNCTIONS(VK_DEFINE_FUNCTION)
+VK_INSTANCE_FUNCTIONS(VK_DEFINE_FUNCTION)
+VK_INSTANCE_OPTIONAL_FUNCTIONS(VK_DEFINE_FUNCTION)
+VK_DEVICE_FUNCTIONS(VK_DEFINE_FUNCTION)
+VK_DEVICE_OPTIONAL_FUNCTIONS(VK_DEFINE_FUNCTION)
+#undef VK_DEFINE_FUNCTION
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+namespace {
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+void* g_loader_library = nullptr;
+
+#ifdef _WIN32
+constexpr auto g_loader_names = std::array{"vulkan-1.dll"};
+#elif defined(__APPLE__)
+constexpr auto g_loader_names =
+		std::array{"libvulkan.dylib", "libvulkan.1.dylib", "libMoltenVK.dylib"};
+#else
+constexpr auto g_loader_names = std::array{"libvulkan.so.1", "libvulkan.so"};
+#endif
+
+auto open_library(const char* name) -> void* {
+#ifdef _WIN32
+	return LoadLibraryA(name);
+#else
+	return dlopen(name, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+auto library_symbol(void* library, const char* name) -> void* {
+#ifdef _WIN32
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	return reinterpret_cast<void*>(
+			GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+	return dlsym(library, name);
+#endif
+}
+
+template <typename T>
+void load_function(T& function, PFN_vkVoidFunction address) {
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	function = reinterpret_cast<T>(address);
+}
+
+template <typename T>
+void require_function(T& function, const char* name) {
+	if (function == nullptr) {
+		fmt::print(stderr, "Vulkan function not found: {}\n", name);
+		std::terminate();
+	}
+}
+
+}  // namespace
+
+void load_vulkan_loader() {
+	for (const auto* name : g_loader_names) {
+		g_loader_library = open_library(name);
+		if (g_loader_library != nullptr) {
+			break;
+		}
+	}
+	if (g_loader_library == nullptr) {
+		fmt::print(stderr, "Failed to load the Vulkan loader library\n");
+		std::terminate();
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+			library_symbol(g_loader_library, "vkGetInstanceProcAddr"));
+	require_function(vkGetInstanceProcAddr, "vkGetInstanceProcAddr");
+
+#define VK_LOAD_FUNCTION(name) \
+	load_function(name, vkGetInstanceProcAddr(VK_NULL_HANDLE, #name));
+#define VK_REQUIRE_FUNCTION(name) require_function(name, #name);
+	VK_GLOBAL_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_GLOBAL_OPTIONAL_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_GLOBAL_FUNCTIONS(VK_REQUIRE_FUNCTION)
+#undef VK_REQUIRE_FUNCTION
+#undef VK_LOAD_FUNCTION
+}
+
+void unload_vulkan_loader() {
+#ifdef _WIN32
+	FreeLibrary(static_cast<HMODULE>(g_loader_library));
+#else
+	dlclose(g_loader_library);
+#endif
+	g_loader_library = nullptr;
+}
+
+void load_instance_functions(VkInstance instance) {
+#define VK_LOAD_FUNCTION(name) \
+	load_function(name, vkGetInstanceProcAddr(instance, #name));
+#define VK_REQUIRE_FUNCTION(name) require_function(name, #name);
+	VK_INSTANCE_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_INSTANCE_OPTIONAL_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_INSTANCE_FUNCTIONS(VK_REQUIRE_FUNCTION)
+#undef VK_REQUIRE_FUNCTION
+#undef VK_LOAD_FUNCTION
+}
+
+void load_device_functions(VkDevice device) {
+#define VK_LOAD_FUNCTION(name) \
+	load_function(name, vkGetDeviceProcAddr(device, #name));
+#define VK_REQUIRE_FUNCTION(name) require_function(name, #name);
+	VK_DEVICE_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_DEVICE_OPTIONAL_FUNCTIONS(VK_LOAD_FUNCTION)
+	VK_DEVICE_FUNCTIONS(VK_REQUIRE_FUNCTION)
+#undef VK_REQUIRE_FUNCTION
+#undef VK_LOAD_FUNCTION
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+// Vulkan entry points are global function pointers with the usual names,
+// loaded from the loader library at runtime. Device functions come from
+// vkGetDeviceProcAddr, so calls on the hot path go straight to the driver
+// instead of through the loader's dispatch trampolines.
+#ifndef VK_NO_PROTOTYPES
+#define VK_NO_PROTOTYPES
+#endif
+#include <vulkan/vulkan.h>
+
+#define VK_GLOBAL_FUNCTIONS(X) \
+	X(vkCreateInstance) \
+	X(vkEnumerateInstanceExtensionProperties) \
+	X(vkEnumerateInstanceLayerProperties)
+
+#define VK_GLOBAL_OPTIONAL_FUNCTIONS(X) X(vkEnumerateInstanceVersion)
+
+#define VK_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceFormatProperties) \
+	X(vkGetPhysicalDeviceImageFormatProperties) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceSparseImageFormatProperties) \
+	X(vkGetDeviceProcAddr) \
+	X(vkCreateDevice) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkEnumerateDeviceLayerProperties) \
+	X(vkDestroySurfaceKHR) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR)
+
+// vkGetPhysicalDeviceFeatures2, vkGetPhysicalDeviceProperties2,
+// vkGetPhysicalDeviceMemoryProperties2,
+// vkGetPhysicalDeviceImageFormatProperties2 and
+// vkEnumeratePhysicalDeviceGroups are core in Vulkan 1.1 and only called when
+// the instance is created with a newer version.
+#define VK_INSTANCE_OPTIONAL_FUNCTIONS(X) \
+	X(vkGetPhysicalDeviceFeatures2) \
+	X(vkGetPhysicalDeviceProperties2) \
+	X(vkGetPhysicalDeviceMemoryProperties2) \
+	X(vkGetPhysicalDeviceImageFormatProperties2) \
+	X(vkEnumeratePhysicalDeviceGroups) \
+	X(vkCreateDebugUtilsMessengerEXT) \
+	X(vkDestroyDebugUtilsMessengerEXT) \
+	X(vkSetDebugUtilsObjectNameEXT) \
+	X(vkCmdBeginDebugUtilsLabelEXT) \
+	X(vkCmdEndDebugUtilsLabelEXT) \
+	X(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) \
+	X(vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR) \
+	X(vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR) \
+	X(vkGetPhysicalDeviceDisplayPropertiesKHR) \
+	X(vkGetPhysicalDeviceDisplayPlanePropertiesKHR) \
+	X(vkGetDisplayPlaneSupportedDisplaysKHR) \
+	X(vkGetDisplayModePropertiesKHR) \
+	X(vkGetDisplayPlaneCapabilitiesKHR) \
+	X(vkCreateDisplayPlaneSurfaceKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilities2KHR)
+
+#define VK_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkGetDeviceQueue) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkDeviceWaitIdle) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkFlushMappedMemoryRanges) \
+	X(vkInvalidateMappedMemoryRanges) \
+	X(vkGetDeviceMemoryCommitment) \
+	X(vkBindBufferMemory) \
+	X(vkBindImageMemory) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkGetImageSparseMemoryRequirements) \
+	X(vkQueueBindSparse) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkResetFences) \
+	X(vkGetFenceStatus) \
+	X(vkWaitForFences) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateEvent) \
+	X(vkDestroyEvent) \
+	X(vkGetEventStatus) \
+	X(vkSetEvent) \
+	X(vkResetEvent) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkCreateBufferView) \
+	X(vkDestroyBufferView) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkGetImageSubresourceLayout) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreatePipelineCache) \
+	X(vkDestroyPipelineCache) \
+	X(vkGetPipelineCacheData) \
+	X(vkMergePipelineCaches) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateSampler) \
+	X(vkDestroySampler) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkResetDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkFreeDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkGetRenderAreaGranularity) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkResetCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkResetCommandBuffer) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdSetLineWidth) \
+	X(vkCmdSetDepthBias) \
+	X(vkCmdSetBlendConstants) \
+	X(vkCmdSetDepthBounds) \
+	X(vkCmdSetStencilCompareMask) \
+	X(vkCmdSetStencilWriteMask) \
+	X(vkCmdSetStencilReference) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdDraw) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndirect) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDispatch) \
+	X(vkCmdDispatchIndirect) \
+	X(vkCmdCopyBuffer) \
+	X(vkCmdCopyImage) \
+	X(vkCmdBlitImage) \
+	X(vkCmdCopyBufferToImage) \
+	X(vkCmdCopyImageToBuffer) \
+	X(vkCmdUpdateBuffer) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdClearColorImage) \
+	X(vkCmdClearDepthStencilImage) \
+	X(vkCmdClearAttachments) \
+	X(vkCmdResolveImage) \
+	X(vkCmdSetEvent) \
+	X(vkCmdResetEvent) \
+	X(vkCmdWaitEvents) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdBeginQuery) \
+	X(vkCmdEndQuery) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdWriteTimestamp) \
+	X(vkCmdCopyQueryPoolResults) \
+	X(vkCmdPushConstants) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdNextSubpass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCmdExecuteCommands) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkQueuePresentKHR)
+
+// Core in Vulkan 1.1 to 1.3, so missing on older devices, or from extensions
+// that are only enabled when available.
+#define VK_DEVICE_OPTIONAL_FUNCTIONS(X) \
+	X(vkWaitSemaphores) \
+	X(vkGetSemaphoreCounterValue) \
+	X(vkQueueSubmit2) \
+	X(vkCmdPipelineBarrier2) \
+	X(vkGetBufferDeviceAddress) \
+	X(vkCmdDrawIndexedIndirectCount) \
+	X(vkCmdBeginRendering) \
+	X(vkCmdEndRendering) \
+	X(vkCmdSetCullMode) \
+	X(vkCmdSetFrontFace) \
+	X(vkCmdSetPrimitiveTopology) \
+	X(vkCmdDrawMeshTasksEXT) \
+	X(vkWaitForPresentKHR) \
+	X(vkGetDeviceGroupPresentCapabilitiesKHR) \
+	X(vkAcquireNextImage2KHR) \
+	X(vkCreateAccelerationStructureKHR) \
+	X(vkDestroyAccelerationStructureKHR) \
+	X(vkGetAccelerationStructureBuildSizesKHR) \
+	X(vkGetAccelerationStructureDeviceAddressKHR) \
+	X(vkCmdBuildAccelerationStructuresKHR) \
+	X(vkCmdWriteAccelerationStructuresPropertiesKHR) \
+	X(vkCmdCopyAccelerationStructureKHR) \
+	X(vkCreateIndirectCommandsLayoutEXT) \
+	X(vkDestroyIndirectCommandsLayoutEXT) \
+	X(vkGetGeneratedCommandsMemoryRequirementsEXT) \
+	X(vkCmdExecuteGeneratedCommandsEXT) \
+	X(vkGetCalibratedTimestampsEXT) \
+	X(vkResetQueryPool) \
+	X(vkAcquireProfilingLockKHR) \
+	X(vkReleaseProfilingLockKHR) \
+	X(vkCreateShadersEXT) \
+	X(vkDestroyShaderEXT) \
+	X(vkCmdBindShadersEXT) \
+	X(vkCmdSetViewportWithCount) \
+	X(vkCmdSetScissorWithCount) \
+	X(vkCmdSetRasterizerDiscardEnable) \
+	X(vkCmdSetPrimitiveRestartEnable) \
+	X(vkCmdSetDepthTestEnable) \
+	X(vkCmdSetDepthWriteEnable) \
+	X(vkCmdSetDepthCompareOp) \
+	X(vkCmdSetDepthBiasEnable) \
+	X(vkCmdSetDepthBoundsTestEnable) \
+	X(vkCmdSetStencilTestEnable) \
+	X(vkCmdSetVertexInputEXT) \
+	X(vkCmdSetPolygonModeEXT) \
+	X(vkCmdSetRasterizationSamplesEXT) \
+	X(vkCmdSetSampleMaskEXT) \
+	X(vkCmdSetAlphaToCoverageEnableEXT) \
+	X(vkCmdSetColorBlendEnableEXT) \
+	X(vkCmdSetColorBlendEquationEXT) \
+	X(vkCmdSetColorWriteMaskEXT) \
+	X(vkGetShaderModuleIdentifierEXT) \
+	X(vkGetDescriptorSetLayoutSizeEXT) \
+	X(vkGetDescriptorSetLayoutBindingOffsetEXT) \
+	X(vkGetDescriptorEXT) \
+	X(vkCmdBindDescriptorBuffersEXT) \
+	X(vkCmdSetDescriptorBufferOffsetsEXT) \
+	X(vkCopyMemoryToImageEXT) \
+	X(vkTransitionImageLayoutEXT) \
+	X(vkCmdBeginConditionalRenderingEXT) \
+	X(vkCmdEndConditionalRenderingEXT) \
+	X(vkGetImageSubresourceLayout2EXT) \
+	X(vkReleaseSwapchainImagesEXT)
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+#define VK_DECLARE_FUNCTION(name) extern PFN_##name name;
+VK_DECLARE_FUNCTION(vkGetInstanceProcAddr)
+VK_GLOBAL_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_GLOBAL_OPTIONAL_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_INSTANCE_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_INSTANCE_OPTIONAL_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_DEVICE_FUNCTIONS(VK_DECLARE_FUNCTION)
+VK_DEVICE_OPTIONAL_FUNCTIONS(VK_DECLARE_FUNCTION)
+#undef VK_DECLARE_FUNCTION
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Opens the Vulkan loader library and resolves the global functions.
+void load_vulkan_loader();
+void unload_vulkan_loader();
+void load_instance_functions(VkInstance instance);
+void load_device_functions(VkDevice device);
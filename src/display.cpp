@@ -0,0 +1,189 @@
+#include "display.hpp"
+
+#include "host_memory.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct DisplayPlane {
+	uint32_t index{};
+	uint32_t stack_index{};
+};
+
+auto display_modes(VkPhysicalDevice physical_device, VkDisplayKHR display)
+		-> std::vector<VkDisplayModePropertiesKHR> {
+	auto mode_count = uint32_t{};
+	vkGetDisplayModePropertiesKHR(
+			physical_device,
+			display,
+			&mode_count,
+			VK_NULL_HANDLE);
+	auto modes = std::vector<VkDisplayModePropertiesKHR>(mode_count);
+	vkGetDisplayModePropertiesKHR(
+			physical_device,
+			display,
+			&mode_count,
+			modes.data());
+	return modes;
+}
+
+// The native resolution at its fastest refresh rate, or the largest mode when
+// the display lists no mode of its physical resolution.
+auto select_display_mode(
+		std::span<const VkDisplayModePropertiesKHR> modes,
+		VkExtent2D resolution) -> const VkDisplayModePropertiesKHR* {
+	auto rank = [&](const VkDisplayModePropertiesKHR& mode) {
+		const auto& region = mode.parameters.visibleRegion;
+		auto native = region.width == resolution.width &&
+				region.height == resolution.height;
+		return std::array{
+				uint64_t{native},
+				uint64_t{region.width} * region.height,
+				uint64_t{mode.parameters.refreshRate}};
+	};
+	auto best = std::max_element(
+			modes.begin(),
+			modes.end(),
+			[&](const auto& a, const auto& b) { return rank(a) < rank(b); });
+	return best == modes.end() ? nullptr : &*best;
+}
+
+// The lowest plane that can show display and is not showing another one.
+auto select_display_plane(
+		VkPhysicalDevice physical_device,
+		VkDisplayKHR display) -> std::optional<DisplayPlane> {
+	auto plane_count = uint32_t{};
+	vkGetPhysicalDeviceDisplayPlanePropertiesKHR(
+			physical_device,
+			&plane_count,
+			VK_NULL_HANDLE);
+	auto planes = std::vector<VkDisplayPlanePropertiesKHR>(plane_count);
+	vkGetPhysicalDeviceDisplayPlanePropertiesKHR(
+			physical_device,
+			&plane_count,
+			planes.data());
+	for (auto plane = uint32_t{}; plane < plane_count; plane++) {
+		const auto* current = planes.at(plane).currentDisplay;
+		if (current != VK_NULL_HANDLE && current != display) {
+			continue;
+		}
+		auto display_count = uint32_t{};
+		vkGetDisplayPlaneSupportedDisplaysKHR(
+				physical_device,
+				plane,
+				&display_count,
+				VK_NULL_HANDLE);
+		auto displays = std::vector<VkDisplayKHR>(display_count);
+		vkGetDisplayPlaneSupportedDisplaysKHR(
+				physical_device,
+				plane,
+				&display_count,
+				displays.data());
+		if (std::find(displays.begin(), displays.end(), display) !=
+				displays.end()) {
+			return DisplayPlane{
+					.index = plane,
+					.stack_index = planes.at(plane).currentStackIndex};
+		}
+	}
+	return std::nullopt;
+}
+
+// Opaque where the plane allows it, since blending with the planes below
+// is all the other modes add.
+auto select_plane_alpha(VkDisplayPlaneAlphaFlagsKHR supported)
+		-> VkDisplayPlaneAlphaFlagBitsKHR {
+	for (auto alpha :
+			 {VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR,
+				VK_DISPLAY_PLANE_ALPHA_GLOBAL_BIT_KHR,
+				VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_BIT_KHR,
+				VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_PREMULTIPLIED_BIT_KHR}) {
+		if ((supported & alpha) != 0) {
+			return alpha;
+		}
+	}
+	return VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+}
+
+}  // namespace
+
+auto create_display_surface(VkInstance instance, size_t display_idx)
+		-> std::optional<DisplaySurface> {
+	auto index = display_idx;
+	auto device_count = uint32_t{};
+	vkEnumeratePhysicalDevices(instance, &device_count, VK_NULL_HANDLE);
+	auto physical_devices = std::vector<VkPhysicalDevice>(device_count);
+	vkEnumeratePhysicalDevices(instance, &device_count, physical_devices.data());
+	for (auto* physical_device : physical_devices) {
+		auto display_count = uint32_t{};
+		vkGetPhysicalDeviceDisplayPropertiesKHR(
+				physical_device,
+				&display_count,
+				VK_NULL_HANDLE);
+		if (display_idx >= display_count) {
+			display_idx -= display_count;
+			continue;
+		}
+		auto displays = std::vector<VkDisplayPropertiesKHR>(display_count);
+		vkGetPhysicalDeviceDisplayPropertiesKHR(
+				physical_device,
+				&display_count,
+				displays.data());
+		const auto& display = displays.at(display_idx);
+		auto modes = display_modes(physical_device, display.display);
+		const auto* mode =
+				select_display_mode(modes, display.physicalResolution);
+		auto plane = select_display_plane(physical_device, display.display);
+		if (mode == nullptr || !plane.has_value()) {
+			return std::nullopt;
+		}
+		auto plane_capabilities = VkDisplayPlaneCapabilitiesKHR{};
+		vkGetDisplayPlaneCapabilitiesKHR(
+				physical_device,
+				mode->displayMode,
+				plane->index,
+				&plane_capabilities);
+		const auto& extent = mode->parameters.visibleRegion;
+		auto surface_info = VkDisplaySurfaceCreateInfoKHR{
+				.sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.displayMode = mode->displayMode,
+				.planeIndex = plane->index,
+				.planeStackIndex = plane->stack_index,
+				.transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+				.globalAlpha = 1.0F,
+				.alphaMode = select_plane_alpha(plane_capabilities.supportedAlpha),
+				.imageExtent = extent};
+		auto display_surface = DisplaySurface{
+				.surface = VK_NULL_HANDLE,
+				.extent = extent,
+				.refresh_rate = mode->parameters.refreshRate};
+		if (vkCreateDisplayPlaneSurfaceKHR(
+						instance,
+						&surface_info,
+						host_callbacks(),
+						&display_surface.surface) != VK_SUCCESS) {
+			return std::nullopt;
+		}
+		log_message(
+				LogLevel::info,
+				"Presenting on display {} ({}), {}x{} at {:.2f} Hz on plane {}",
+				index,
+				display.displayName != nullptr
+						? std::string_view(display.displayName)
+						: std::string_view("unnamed"),
+				extent.width,
+				extent.height,
+				mode->parameters.refreshRate / 1000.0,
+				plane->index);
+		return display_surface;
+	}
+	return std::nullopt;
+}
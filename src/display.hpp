@@ -0,0 +1,36 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// What the instance needs for display plane surfaces, in place of the window
+// system's surface extensions.
+constexpr auto g_display_instance_extensions = std::array{
+		VK_KHR_SURFACE_EXTENSION_NAME,
+		VK_KHR_DISPLAY_EXTENSION_NAME};
+
+// A surface straight on a display plane through VK_KHR_display, for machines
+// without a window system such as kiosks that own their screen. The display
+// controller scans the swap chain images out at the display's vblank with no
+// compositor in between, so FIFO presents are paced by the display alone.
+// Only the GPU driving the display can present to it, the others report no
+// support for the surface.
+struct DisplaySurface {
+	VkSurfaceKHR surface{};
+	// Of the display's mode, the extent the surface has.
+	VkExtent2D extent{};
+	// In millihertz.
+	uint32_t refresh_rate{};
+};
+
+// Counts the displays of every GPU in enumeration order and puts a surface
+// on display display_idx, at its native resolution and the fastest refresh
+// rate of it, on the lowest plane that can show it. Unset when there is no
+// such display or no free plane for it. The display must not be in use by a
+// window system.
+auto create_display_surface(VkInstance instance, size_t display_idx)
+		-> std::optional<DisplaySurface>;
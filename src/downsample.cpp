@@ -0,0 +1,467 @@
+#include "downsample.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "subgroups.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <vector>
+
+namespace {
+
+// The levels array of downsample.comp, after the source at binding 0.
+constexpr auto g_levels_binding = 1U;
+constexpr auto g_counter_binding = 2U;
+
+// Layout matches the push_constant block in downsample.comp.
+struct DownsampleConstants {
+	int32_t width{};
+	int32_t height{};
+	uint32_t level_count{};
+	uint32_t srgb{};
+};
+
+auto level_view(VkDevice& device, VkImage image, uint32_t level)
+		-> VkImageView {
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = VK_FORMAT_R8G8B8A8_UNORM,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = level,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a downsample level view\n");
+		std::terminate();
+	}
+	return view;
+}
+
+auto level_barrier(
+		VkImage image,
+		uint32_t first_level,
+		uint32_t level_count,
+		VkPipelineStageFlags2 src_stage,
+		VkAccessFlags2 src_access,
+		VkImageLayout old_layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access,
+		VkImageLayout new_layout) -> VkImageMemoryBarrier2 {
+	return VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stage,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.oldLayout = old_layout,
+			.newLayout = new_layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = first_level,
+					.levelCount = level_count,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+}
+
+auto counter_barrier(
+		const Buffer& counter,
+		VkPipelineStageFlags2 src_stage,
+		VkAccessFlags2 src_access,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) -> VkBufferMemoryBarrier2 {
+	return VkBufferMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stage,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = counter.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+}  // namespace
+
+auto downsample_variant(VkPhysicalDevice physical_device) -> ShaderVariant {
+	auto support = query_subgroup_support(physical_device);
+	// Quads need subgroups of at least four, and the variant's indexing
+	// needs the group to split into full subgroups.
+	auto quads =
+			has_subgroup_operations(
+					support,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_QUAD_BIT) &&
+			support.size >= 4 && g_downsample_group_size % support.size == 0;
+	return quads ? g_shader_variant_subgroup_quad : ShaderVariant{0};
+}
+
+auto can_downsample(VkFormat format) -> bool {
+	return format == VK_FORMAT_R8G8B8A8_UNORM ||
+			format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+auto downsample_level_count(VkExtent2D extent) -> uint32_t {
+	auto largest = std::max(extent.width, extent.height);
+	auto chain = static_cast<uint32_t>(std::bit_width(largest));
+	auto generated = largest <= g_downsample_max_size ? g_downsample_max_levels
+																										: g_downsample_tile_levels;
+	return std::min(chain, generated + 1);
+}
+
+auto create_downsampler(
+		VkDevice& device,
+		Allocator& allocator,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		bool synchronization2) -> Downsampler {
+	auto downsampler = Downsampler{};
+	downsampler.synchronization2 = synchronization2;
+	auto bindings = std::array{
+			VkDescriptorSetLayoutBinding{
+					.binding = 0,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_levels_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = g_downsample_max_levels,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_counter_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE}};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&downsampler.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create downsample set layout\n");
+		std::terminate();
+	}
+	auto pool_sizes = std::array{
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = g_downsample_sets * (g_downsample_max_levels + 1)},
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = g_downsample_sets}};
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+			.maxSets = g_downsample_sets,
+			.poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data()};
+	if (vkCreateDescriptorPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&downsampler.descriptor_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create downsample descriptor pool\n");
+		std::terminate();
+	}
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(DownsampleConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &downsampler.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&downsampler.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create downsample pipeline layout\n");
+		std::terminate();
+	}
+	downsampler.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			downsampler.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			0);
+	downsampler.counter = create_buffer(
+			device,
+			allocator,
+			sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	return downsampler;
+}
+
+void destroy_downsampler(
+		VkDevice& device,
+		Allocator& allocator,
+		Downsampler& downsampler) {
+	destroy_buffer(device, allocator, downsampler.counter);
+	vkDestroyPipeline(device, downsampler.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(
+			device,
+			downsampler.pipeline_layout,
+			host_callbacks());
+	vkDestroyDescriptorPool(
+			device,
+			downsampler.descriptor_pool,
+			host_callbacks());
+	vkDestroyDescriptorSetLayout(
+			device,
+			downsampler.set_layout,
+			host_callbacks());
+	downsampler = Downsampler{};
+}
+
+void record_downsample(
+		VkDevice& device,
+		DeletionQueue& deletions,
+		Downsampler& downsampler,
+		VkCommandBuffer command_buffer,
+		VkImage image,
+		VkFormat format,
+		VkExtent2D extent,
+		uint32_t level_count,
+		VkPipelineStageFlags2 src_stage,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	if (level_count < 2) {
+		return;
+	}
+	auto views = std::vector<VkImageView>(level_count);
+	for (auto i = uint32_t{}; i < level_count; i++) {
+		views[i] = level_view(device, image, i);
+	}
+	auto* set = VkDescriptorSet{};
+	auto allocate_info = VkDescriptorSetAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = downsampler.descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &downsampler.set_layout};
+	if (vkAllocateDescriptorSets(device, &allocate_info, &set) != VK_SUCCESS) {
+		fmt::print(
+				stderr,
+				"More than {} mip chains are generated at once\n",
+				g_downsample_sets);
+		std::terminate();
+	}
+	// Every element of the levels array is bound. The ones past the chain
+	// repeat its last level, which the shader never writes to through them.
+	auto images =
+			std::array<VkDescriptorImageInfo, g_downsample_max_levels + 1>{};
+	for (auto i = size_t{}; i < images.size(); i++) {
+		images.at(i) = VkDescriptorImageInfo{
+				.sampler = VK_NULL_HANDLE,
+				.imageView = views.at(std::min<size_t>(i, level_count - 1)),
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+	}
+	auto counter_info = VkDescriptorBufferInfo{
+			.buffer = downsampler.counter.handle,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE};
+	auto writes = std::array{
+			VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = 0,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.pImageInfo = images.data(),
+					.pBufferInfo = VK_NULL_HANDLE,
+					.pTexelBufferView = VK_NULL_HANDLE},
+			VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = g_levels_binding,
+					.dstArrayElement = 0,
+					.descriptorCount = g_downsample_max_levels,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.pImageInfo = &images.at(1),
+					.pBufferInfo = VK_NULL_HANDLE,
+					.pTexelBufferView = VK_NULL_HANDLE},
+			VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = g_counter_binding,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.pImageInfo = VK_NULL_HANDLE,
+					.pBufferInfo = &counter_info,
+					.pTexelBufferView = VK_NULL_HANDLE}};
+	vkUpdateDescriptorSets(
+			device,
+			static_cast<uint32_t>(writes.size()),
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+
+	constexpr auto counter_access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	// The counter is cleared after the previous chain's dispatch is done with
+	// it.
+	auto before = std::array{
+			level_barrier(
+					image,
+					0,
+					1,
+					src_stage,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+					VK_IMAGE_LAYOUT_GENERAL),
+			level_barrier(
+					image,
+					1,
+					level_count - 1,
+					VK_PIPELINE_STAGE_2_NONE,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+							VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL)};
+	auto clear = counter_barrier(
+			downsampler.counter,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			counter_access,
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	pipeline_barrier(
+			downsampler.synchronization2,
+			command_buffer,
+			std::span{&clear, 1},
+			before);
+	vkCmdFillBuffer(
+			command_buffer,
+			downsampler.counter.handle,
+			0,
+			VK_WHOLE_SIZE,
+			0);
+	auto cleared = counter_barrier(
+			downsampler.counter,
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			counter_access);
+	pipeline_barrier(
+			downsampler.synchronization2,
+			command_buffer,
+			std::span{&cleared, 1},
+			{});
+
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			downsampler.pipeline);
+	vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			downsampler.pipeline_layout,
+			0,
+			1,
+			&set,
+			0,
+			VK_NULL_HANDLE);
+	auto constants = DownsampleConstants{
+			.width = static_cast<int32_t>(extent.width),
+			.height = static_cast<int32_t>(extent.height),
+			.level_count = level_count - 1,
+			.srgb = format == VK_FORMAT_R8G8B8A8_SRGB ? 1U : 0U};
+	vkCmdPushConstants(
+			command_buffer,
+			downsampler.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+	vkCmdDispatch(
+			command_buffer,
+			(extent.width + g_downsample_tile_size - 1) / g_downsample_tile_size,
+			(extent.height + g_downsample_tile_size - 1) / g_downsample_tile_size,
+			1);
+
+	auto after = std::array{
+			level_barrier(
+					image,
+					0,
+					1,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_GENERAL,
+					dst_stage,
+					dst_access,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			level_barrier(
+					image,
+					1,
+					level_count - 1,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL,
+					dst_stage,
+					dst_access,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)};
+	pipeline_barrier(downsampler.synchronization2, command_buffer, {}, after);
+	defer_deletion(
+			deletions,
+			[&device,
+			 pool = downsampler.descriptor_pool,
+			 set,
+			 views = std::move(views)]() mutable {
+				vkFreeDescriptorSets(device, pool, 1, &set);
+				for (auto* view : views) {
+					vkDestroyImageView(device, view, host_callbacks());
+				}
+			});
+}
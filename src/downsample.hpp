@@ -0,0 +1,78 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "shaders.hpp"
+
+#include <cstdint>
+
+// Match downsample.comp. A group reduces a tile of g_downsample_tile_size
+// texels in each direction to one texel g_downsample_tile_levels below, and
+// the last group to finish reduces those as well, so one dispatch writes up
+// to twice that many levels.
+constexpr auto g_downsample_group_size = 256U;
+constexpr auto g_downsample_tile_size = 64U;
+constexpr auto g_downsample_tile_levels = 6U;
+constexpr auto g_downsample_max_levels = g_downsample_tile_levels * 2;
+// The largest level 0 the last group can take all of. Larger images get
+// g_downsample_tile_levels levels below it.
+constexpr auto g_downsample_max_size =
+		g_downsample_tile_size * g_downsample_tile_size;
+// Chains generated at once, each holding a descriptor set until the frame
+// that generates it is done.
+constexpr auto g_downsample_sets = 8U;
+
+// Generates the levels of a mip chain below level 0 in a single compute
+// dispatch, instead of a blit and a barrier per level that each wait for the
+// one before. Chains are of RGBA8 images, UNORM or sRGB.
+struct Downsampler {
+	bool synchronization2{};
+	VkDescriptorSetLayout set_layout{};
+	VkDescriptorPool descriptor_pool{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	// Groups that finished their tile, cleared before every dispatch.
+	Buffer counter;
+};
+
+// The downsample.comp variant for the device, which must have Vulkan 1.1.
+auto downsample_variant(VkPhysicalDevice physical_device) -> ShaderVariant;
+auto can_downsample(VkFormat format) -> bool;
+// Levels of a chain starting at extent that one dispatch generates, level 0
+// included.
+auto downsample_level_count(VkExtent2D extent) -> uint32_t;
+
+// module is the downsample_variant of downsample.comp.
+auto create_downsampler(
+		VkDevice& device,
+		Allocator& allocator,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		bool synchronization2) -> Downsampler;
+// The device must be idle.
+void destroy_downsampler(
+		VkDevice& device,
+		Allocator& allocator,
+		Downsampler& downsampler);
+
+// Writes levels 1 to level_count - 1 of image from its level 0, which must
+// be in SHADER_READ_ONLY_OPTIMAL with its writes visible to src_stage.
+// level_count is at most the downsample_level_count of extent, the size of
+// level 0. Every level ends up in SHADER_READ_ONLY_OPTIMAL, visible to
+// dst_stage and dst_access. image needs STORAGE usage, and MUTABLE_FORMAT
+// when sRGB, since its levels are written through UNORM views. The views
+// and the descriptor set go to deletions. Binds a compute pipeline of its
+// own.
+void record_downsample(
+		VkDevice& device,
+		DeletionQueue& deletions,
+		Downsampler& downsampler,
+		VkCommandBuffer command_buffer,
+		VkImage image,
+		VkFormat format,
+		VkExtent2D extent,
+		uint32_t level_count,
+		VkPipelineStageFlags2 src_stage,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
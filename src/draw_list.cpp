@@ -0,0 +1,675 @@
+#include "draw_list.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "specialization.hpp"
+#include "sync.hpp"
+#include "uniforms.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant block in draw_list.comp.
+struct DrawListHandles {
+	glm::mat4 reprojection{1.0F};
+	BindlessHandle uniform_buffer{};
+	BindlessHandle instances{};
+	BindlessHandle batches{};
+	BindlessHandle commands{};
+	BindlessHandle counts{};
+	uint32_t instance_count{};
+	float lod_scale{};
+	BindlessHandle pyramid{};
+	uint32_t pyramid_levels{};
+	uint32_t pyramid_width{};
+	uint32_t pyramid_height{};
+};
+static_assert(sizeof(DrawListHandles) <= g_max_push_constants_size);
+
+// The command sequence of a generated draw. Layout matches GeneratedDraw in
+// draw_list.comp. The two push constant ranges are DrawHandles from positions
+// to vertex_stride and from material to position_offset.
+struct GeneratedDraw {
+	VkBindIndexBufferIndirectCommandEXT index_buffer{};
+	VkDeviceAddress positions{};
+	VkDeviceAddress colors{};
+	uint32_t vertex_stride{};
+	uint32_t material{};
+	uint32_t mesh{};
+	std::array<float, 3> position_scale{};
+	std::array<float, 3> position_offset{};
+	VkDrawIndexedIndirectCommand command{};
+};
+static_assert(sizeof(GeneratedDraw) == 88);
+static_assert(
+		offsetof(DrawHandles, position_offset) + sizeof(glm::vec3) ==
+		offsetof(DrawHandles, meshlets));
+
+auto push_constant_token(
+		const VkIndirectCommandsPushConstantTokenEXT& push_constant,
+		uint32_t offset) -> VkIndirectCommandsLayoutTokenEXT {
+	return {
+			.sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_PUSH_CONSTANT_EXT,
+			.data = {.pPushConstant = &push_constant},
+			.offset = offset};
+}
+
+// Binds the index buffer, pushes the mesh's DrawHandles fields and draws.
+auto create_commands_layout(
+		VkDevice& device,
+		VkPipelineLayout draw_layout,
+		VkShaderStageFlags draw_stages) -> VkIndirectCommandsLayoutEXT {
+	auto index_buffer = VkIndirectCommandsIndexBufferTokenEXT{
+			.mode = VK_INDIRECT_COMMANDS_INPUT_MODE_VULKAN_INDEX_BUFFER_EXT};
+	auto vertex_fields = VkIndirectCommandsPushConstantTokenEXT{
+			.updateRange = {
+					.stageFlags = draw_stages,
+					.offset = offsetof(DrawHandles, positions),
+					.size = offsetof(DrawHandles, uniform_buffer) -
+							offsetof(DrawHandles, positions)}};
+	auto mesh_fields = VkIndirectCommandsPushConstantTokenEXT{
+			.updateRange = {
+					.stageFlags = draw_stages,
+					.offset = offsetof(DrawHandles, material),
+					.size = offsetof(DrawHandles, meshlets) -
+							offsetof(DrawHandles, material)}};
+	auto tokens = std::array{
+			VkIndirectCommandsLayoutTokenEXT{
+					.sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+					.pNext = VK_NULL_HANDLE,
+					.type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_INDEX_BUFFER_EXT,
+					.data = {.pIndexBuffer = &index_buffer},
+					.offset = offsetof(GeneratedDraw, index_buffer)},
+			push_constant_token(
+					vertex_fields,
+					offsetof(GeneratedDraw, positions)),
+			push_constant_token(mesh_fields, offsetof(GeneratedDraw, material)),
+			VkIndirectCommandsLayoutTokenEXT{
+					.sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_TOKEN_EXT,
+					.pNext = VK_NULL_HANDLE,
+					.type = VK_INDIRECT_COMMANDS_TOKEN_TYPE_DRAW_INDEXED_EXT,
+					.data = {},
+					.offset = offsetof(GeneratedDraw, command)},
+	};
+	// Visible instances are appended in whatever order their invocations
+	// run, so the order of the sequences carries no meaning.
+	auto layout_info = VkIndirectCommandsLayoutCreateInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_INDIRECT_COMMANDS_LAYOUT_CREATE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_INDIRECT_COMMANDS_LAYOUT_USAGE_UNORDERED_SEQUENCES_BIT_EXT,
+			.shaderStages = draw_stages,
+			.indirectStride = sizeof(GeneratedDraw),
+			.pipelineLayout = draw_layout,
+			.tokenCount = static_cast<uint32_t>(tokens.size()),
+			.pTokens = tokens.data()};
+	auto* layout = VkIndirectCommandsLayoutEXT{};
+	if (vkCreateIndirectCommandsLayoutEXT(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create indirect commands layout\n");
+		std::terminate();
+	}
+	return layout;
+}
+
+// The preprocess buffer usage only exists as a VkBufferUsageFlags2, which
+// replaces the usage of the create info, and the memory must also suit the
+// generated commands.
+auto create_preprocess_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkMemoryRequirements& commands_requirements) -> Buffer {
+	auto usage = VkBufferUsageFlags2CreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_USAGE_FLAGS_2_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.usage = VK_BUFFER_USAGE_2_PREPROCESS_BUFFER_BIT_EXT |
+					VK_BUFFER_USAGE_2_SHADER_DEVICE_ADDRESS_BIT_KHR};
+	auto buffer_info = VkBufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = &usage,
+			.flags = 0,
+			.size = commands_requirements.size,
+			.usage = 0,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE};
+	auto buffer = Buffer{};
+	buffer.size = commands_requirements.size;
+	buffer.usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	if (vkCreateBuffer(device, &buffer_info, host_callbacks(), &buffer.handle) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create preprocess buffer\n");
+		std::terminate();
+	}
+	auto requirements = VkMemoryRequirements{};
+	vkGetBufferMemoryRequirements(device, buffer.handle, &requirements);
+	requirements.alignment =
+			std::max(requirements.alignment, commands_requirements.alignment);
+	requirements.memoryTypeBits &= commands_requirements.memoryTypeBits;
+	buffer.allocation = allocate_memory(
+			device,
+			allocator,
+			requirements,
+			ResourceKind::linear,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0,
+			MemoryPriority::high);
+	vkBindBufferMemory(
+			device,
+			buffer.handle,
+			buffer.allocation.memory,
+			buffer.allocation.offset);
+	return buffer;
+}
+
+auto create_list_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		bool host_visible,
+		BindlessHandle& handle) -> Buffer {
+	// Lists written by the CPU are read in place, like the uniform ring.
+	auto buffer = host_visible
+			? create_dynamic_buffer(
+						device,
+						allocator,
+						size,
+						usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+			: create_buffer(
+						device,
+						allocator,
+						size,
+						usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						0);
+	handle = add_bindless_buffer(device, bindless, buffer.handle, 0, size);
+	return buffer;
+}
+
+auto buffer_barrier(
+		const Buffer& buffer,
+		VkPipelineStageFlags2 src_stage,
+		VkAccessFlags2 src_access,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) -> VkBufferMemoryBarrier2 {
+	return {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stage,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+}  // namespace
+
+auto create_draw_lists(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		BindlessHandle uniform_buffer,
+		size_t frame_count,
+		uint32_t instance_capacity,
+		uint32_t batch_capacity,
+		uint32_t max_draw_count,
+		bool generated,
+		bool conditional_rendering,
+		VkPipelineLayout draw_layout,
+		VkShaderStageFlags draw_stages,
+		bool synchronization2) -> DrawLists {
+	auto lists = DrawLists{};
+	lists.synchronization2 = synchronization2;
+	lists.generated = generated;
+	lists.conditional_rendering = conditional_rendering;
+	lists.uniform_buffer = uniform_buffer;
+	lists.instance_capacity = instance_capacity;
+	lists.batch_capacity = batch_capacity;
+	lists.max_draw_count = max_draw_count;
+	lists.instances.reserve(instance_capacity);
+	lists.batches.reserve(batch_capacity);
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(DrawListHandles)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&lists.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create draw list pipeline layout\n");
+		std::terminate();
+	}
+	auto constants = make_specialization_constants(
+			bindless.images.capacity,
+			bindless.buffers.capacity,
+			bindless.samplers.capacity,
+			generated ? VK_TRUE : VK_FALSE);
+	auto specialization = specialization_info(constants);
+	lists.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			lists.pipeline_layout,
+			module,
+			&specialization,
+			0);
+	if (generated) {
+		lists.draw_stages = draw_stages;
+		lists.commands_layout =
+				create_commands_layout(device, draw_layout, draw_stages);
+	}
+
+	// Generated draws hand the GPU the addresses of their sequences and
+	// their count.
+	auto generated_usage = generated
+			? VkBufferUsageFlags{VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT}
+			: VkBufferUsageFlags{};
+	auto counts_usage = VkBufferUsageFlags{
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+	if (conditional_rendering) {
+		counts_usage |= VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT;
+	}
+	auto command_size = generated
+			? sizeof(GeneratedDraw)
+			: sizeof(VkDrawIndexedIndirectCommand);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = lists.frames.emplace_back();
+		frame.instances = create_list_buffer(
+				device,
+				allocator,
+				bindless,
+				sizeof(DrawInstance) * instance_capacity,
+				0,
+				true,
+				frame.instances_handle);
+		frame.batches = create_list_buffer(
+				device,
+				allocator,
+				bindless,
+				sizeof(DrawBatch) * batch_capacity,
+				0,
+				true,
+				frame.batches_handle);
+		frame.commands = create_list_buffer(
+				device,
+				allocator,
+				bindless,
+				command_size * instance_capacity,
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | generated_usage,
+				false,
+				frame.commands_handle);
+		frame.counts = create_list_buffer(
+				device,
+				allocator,
+				bindless,
+				sizeof(uint32_t) * batch_capacity,
+				counts_usage | generated_usage,
+				false,
+				frame.counts_handle);
+		if (generated) {
+			frame.commands_address = buffer_device_address(device, frame.commands);
+			frame.counts_address = buffer_device_address(device, frame.counts);
+		}
+	}
+	return lists;
+}
+
+void destroy_draw_lists(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		DrawLists& lists) {
+	for (auto& frame : lists.frames) {
+		remove_bindless_buffer(device, bindless, frame.instances_handle);
+		remove_bindless_buffer(device, bindless, frame.batches_handle);
+		remove_bindless_buffer(device, bindless, frame.commands_handle);
+		remove_bindless_buffer(device, bindless, frame.counts_handle);
+		destroy_buffer(device, allocator, frame.instances);
+		destroy_buffer(device, allocator, frame.batches);
+		destroy_buffer(device, allocator, frame.commands);
+		destroy_buffer(device, allocator, frame.counts);
+		for (auto& preprocess : frame.preprocess) {
+			destroy_buffer(device, allocator, preprocess.buffer);
+		}
+	}
+	if (lists.commands_layout != VK_NULL_HANDLE) {
+		vkDestroyIndirectCommandsLayoutEXT(
+				device,
+				lists.commands_layout,
+				host_callbacks());
+	}
+	vkDestroyPipeline(device, lists.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, lists.pipeline_layout, host_callbacks());
+	lists = DrawLists{};
+}
+
+void reset_draw_lists(DrawLists& lists) {
+	lists.instances.clear();
+	lists.batches.clear();
+}
+
+auto add_draw_batch(DrawLists& lists, const Mesh& mesh, uint32_t mesh_idx)
+		-> uint32_t {
+	if (lists.batches.size() >= lists.batch_capacity) {
+		fmt::print(
+				stderr,
+				"Draw list overflow: more than {} batches\n",
+				lists.batch_capacity);
+		std::terminate();
+	}
+	auto& batch = lists.batches.emplace_back(DrawBatch{
+			.bounding_sphere = mesh.bounding_sphere,
+			.first_instance = static_cast<uint32_t>(lists.instances.size()),
+			.instance_count = 0,
+			.lod_count = mesh.lod_count,
+			.padding = 0,
+			.lods = {},
+			.binds = {}});
+	for (auto i = 0U; i < mesh.lod_count; i++) {
+		batch.lods.at(i) = DrawLod{
+				.first_index = mesh.lods.at(i).first_index,
+				.index_count = mesh.lods.at(i).index_count,
+				.error = mesh.lods.at(i).error,
+				.padding = 0};
+	}
+	if (lists.generated) {
+		auto index_size = mesh.index_type == VK_INDEX_TYPE_UINT16
+				? sizeof(uint16_t)
+				: sizeof(uint32_t);
+		batch.binds = DrawBinds{
+				.index_address = mesh.index_address,
+				.index_size = static_cast<uint32_t>(index_size * mesh.index_count),
+				.index_type = static_cast<uint32_t>(mesh.index_type),
+				.positions = mesh.attribute_addresses.at(0),
+				.colors = mesh.attribute_addresses.at(1),
+				.vertex_stride = mesh.attribute_stride,
+				.mesh = mesh_idx,
+				.position_scale = {},
+				.position_offset = {}};
+		for (auto i = 0; i < 3; i++) {
+			batch.binds.position_scale.at(i) = mesh.position_scale[i];
+			batch.binds.position_offset.at(i) = mesh.position_offset[i];
+		}
+	}
+	return static_cast<uint32_t>(lists.batches.size() - 1);
+}
+
+void add_draw_instance(
+		DrawLists& lists,
+		uint32_t transform,
+		uint32_t material) {
+	if (lists.instances.size() >= lists.instance_capacity) {
+		fmt::print(
+				stderr,
+				"Draw list overflow: more than {} instances\n",
+				lists.instance_capacity);
+		std::terminate();
+	}
+	if (lists.batches.empty()) {
+		fmt::print(stderr, "Draw instance added before its batch\n");
+		std::terminate();
+	}
+	lists.batches.back().instance_count++;
+	lists.instances.emplace_back(DrawInstance{
+			.transform = transform,
+			.material = material,
+			.batch = static_cast<uint32_t>(lists.batches.size() - 1)});
+}
+
+void add_generated_instance(
+		DrawLists& lists,
+		uint32_t batch,
+		uint32_t transform,
+		uint32_t material) {
+	if (lists.instances.size() >= lists.instance_capacity) {
+		fmt::print(
+				stderr,
+				"Draw list overflow: more than {} instances\n",
+				lists.instance_capacity);
+		std::terminate();
+	}
+	if (batch >= lists.batches.size()) {
+		fmt::print(stderr, "Draw instance added to a missing batch\n");
+		std::terminate();
+	}
+	lists.batches.at(batch).instance_count++;
+	lists.instances.emplace_back(DrawInstance{
+			.transform = transform,
+			.material = material,
+			.batch = batch});
+}
+
+void build_draw_lists(
+		DrawLists& lists,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		float lod_scale,
+		const DrawOcclusion& occlusion) {
+	auto& frame = lists.frames.at(frame_idx);
+	std::memcpy(
+			frame.instances.allocation.mapped,
+			lists.instances.data(),
+			lists.instances.size() * sizeof(DrawInstance));
+	std::memcpy(
+			frame.batches.allocation.mapped,
+			lists.batches.data(),
+			lists.batches.size() * sizeof(DrawBatch));
+	if (lists.batches.empty()) {
+		return;
+	}
+
+	// The frame fence covers the last frame's indirect reads, so the counts
+	// can be cleared without waiting on them. Generated draws only count
+	// their sequences.
+	auto count_count = lists.generated ? size_t{1} : lists.batches.size();
+	vkCmdFillBuffer(
+			command_buffer,
+			frame.counts.handle,
+			0,
+			count_count * sizeof(uint32_t),
+			0);
+	auto clear_barrier = buffer_barrier(
+			frame.counts,
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+	pipeline_barrier(
+			lists.synchronization2,
+			command_buffer,
+			{&clear_barrier, 1},
+			{});
+
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			lists.pipeline);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			lists.pipeline_layout,
+			bindless);
+	auto handles = DrawListHandles{
+			.reprojection = occlusion.reprojection,
+			.uniform_buffer = lists.uniform_buffer,
+			.instances = frame.instances_handle,
+			.batches = frame.batches_handle,
+			.commands = frame.commands_handle,
+			.counts = frame.counts_handle,
+			.instance_count = static_cast<uint32_t>(lists.instances.size()),
+			.lod_scale = lod_scale,
+			.pyramid = occlusion.pyramid,
+			.pyramid_levels = occlusion.levels,
+			.pyramid_width = occlusion.extent.width,
+			.pyramid_height = occlusion.extent.height};
+	vkCmdPushConstants(
+			command_buffer,
+			lists.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	vkCmdDispatch(
+			command_buffer,
+			(handles.instance_count + g_draw_list_group_size - 1) /
+					g_draw_list_group_size,
+			1,
+			1);
+}
+
+void draw_batch(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		uint32_t batch,
+		const Mesh& mesh) {
+	const auto& frame = lists.frames.at(frame_idx);
+	const auto& entry = lists.batches.at(batch);
+	bind_mesh(command_buffer, mesh);
+	vkCmdDrawIndexedIndirectCount(
+			command_buffer,
+			frame.commands.handle,
+			entry.first_instance * sizeof(VkDrawIndexedIndirectCommand),
+			frame.counts.handle,
+			batch * sizeof(uint32_t),
+			std::min(entry.instance_count, lists.max_draw_count),
+			sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void begin_batch_condition(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		uint32_t batch) {
+	// A batch's count is the 32-bit value the condition reads, nonzero when
+	// any of its instances survived.
+	auto condition = VkConditionalRenderingBeginInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.buffer = lists.frames.at(frame_idx).counts.handle,
+			.offset = batch * sizeof(uint32_t),
+			.flags = 0};
+	vkCmdBeginConditionalRenderingEXT(command_buffer, &condition);
+}
+
+void reserve_generated_draws(
+		VkDevice& device,
+		Allocator& allocator,
+		DrawLists& lists,
+		size_t frame_idx,
+		VkPipeline pipeline) {
+	auto& frame = lists.frames.at(frame_idx);
+	auto preprocess = std::find_if(
+			frame.preprocess.begin(),
+			frame.preprocess.end(),
+			[&](const DrawPreprocess& entry) { return entry.pipeline == pipeline; });
+	// Sized for every instance, so a pipeline only needs it once. The
+	// handle can come back for a pipeline built after another was evicted,
+	// which may need more.
+	auto pipeline_info = VkGeneratedCommandsPipelineInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_GENERATED_COMMANDS_PIPELINE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.pipeline = pipeline};
+	auto requirements_info = VkGeneratedCommandsMemoryRequirementsInfoEXT{
+			.sType =
+					VK_STRUCTURE_TYPE_GENERATED_COMMANDS_MEMORY_REQUIREMENTS_INFO_EXT,
+			.pNext = &pipeline_info,
+			.indirectExecutionSet = VK_NULL_HANDLE,
+			.indirectCommandsLayout = lists.commands_layout,
+			.maxSequenceCount = lists.instance_capacity,
+			.maxDrawCount = 0};
+	auto requirements = VkMemoryRequirements2{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+			.pNext = VK_NULL_HANDLE,
+			.memoryRequirements = {}};
+	vkGetGeneratedCommandsMemoryRequirementsEXT(
+			device,
+			&requirements_info,
+			&requirements);
+	auto size = requirements.memoryRequirements.size;
+	if (preprocess == frame.preprocess.end()) {
+		preprocess = frame.preprocess.insert(
+				frame.preprocess.end(),
+				DrawPreprocess{.pipeline = pipeline, .buffer = {}, .address = 0});
+	} else if (preprocess->buffer.size >= size) {
+		return;
+	}
+	// The frame fence covers the last use of the old buffer.
+	if (preprocess->buffer.handle != VK_NULL_HANDLE) {
+		destroy_buffer(device, allocator, preprocess->buffer);
+		preprocess->buffer = Buffer{};
+		preprocess->address = 0;
+	}
+	// Devices that preprocess nothing ask for no memory.
+	if (size > 0) {
+		preprocess->buffer = create_preprocess_buffer(
+				device,
+				allocator,
+				requirements.memoryRequirements);
+		preprocess->address = buffer_device_address(device, preprocess->buffer);
+	}
+}
+
+void draw_generated(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		VkPipeline pipeline) {
+	const auto& frame = lists.frames.at(frame_idx);
+	auto preprocess = std::find_if(
+			frame.preprocess.begin(),
+			frame.preprocess.end(),
+			[&](const DrawPreprocess& entry) { return entry.pipeline == pipeline; });
+	if (lists.instances.empty() || preprocess == frame.preprocess.end()) {
+		return;
+	}
+	auto pipeline_info = VkGeneratedCommandsPipelineInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_GENERATED_COMMANDS_PIPELINE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.pipeline = pipeline};
+	auto generated_info = VkGeneratedCommandsInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_GENERATED_COMMANDS_INFO_EXT,
+			.pNext = &pipeline_info,
+			.shaderStages = lists.draw_stages,
+			.indirectExecutionSet = VK_NULL_HANDLE,
+			.indirectCommandsLayout = lists.commands_layout,
+			.indirectAddress = frame.commands_address,
+			.indirectAddressSize = frame.commands.size,
+			.preprocessAddress = preprocess->address,
+			.preprocessSize = preprocess->buffer.size,
+			.maxSequenceCount = static_cast<uint32_t>(lists.instances.size()),
+			.sequenceCountAddress = frame.counts_address,
+			.maxDrawCount = 0};
+	vkCmdExecuteGeneratedCommandsEXT(command_buffer, VK_FALSE, &generated_info);
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "mesh.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Matches local_size_x in draw_list.comp.
+constexpr auto g_draw_list_group_size = 64U;
+
+// One object to draw. Layout matches draw_list.comp and the vertex shaders.
+struct DrawInstance {
+	// Ring slot of the object's DrawUniforms.
+	uint32_t transform{};
+	uint32_t material{};
+	uint32_t batch{};
+};
+
+// A MeshLod padded to the std430 array stride of uvec4.
+struct DrawLod {
+	uint32_t first_index{};
+	uint32_t index_count{};
+	float error{};
+	uint32_t padding{};
+};
+static_assert(sizeof(DrawLod) == 16);
+
+// What a generated draw binds for its batch's mesh: the index buffer as a
+// VkBindIndexBufferIndirectCommandEXT and the DrawHandles fields pulling.vert
+// reads the mesh through. Only read by generated draws.
+struct DrawBinds {
+	VkDeviceAddress index_address{};
+	uint32_t index_size{};
+	uint32_t index_type{};
+	VkDeviceAddress positions{};
+	VkDeviceAddress colors{};
+	uint32_t vertex_stride{};
+	uint32_t mesh{};
+	std::array<float, 3> position_scale{};
+	std::array<float, 3> position_offset{};
+};
+static_assert(sizeof(DrawBinds) == 64);
+
+// Instances drawn with the same mesh, contiguous in the instance list. Their
+// draw commands are written from first_instance on, each with the level of
+// detail draw_list.comp selects for the instance. Padded to the std430 array
+// stride of the vec4.
+struct DrawBatch {
+	glm::vec4 bounding_sphere{};
+	uint32_t first_instance{};
+	uint32_t instance_count{};
+	uint32_t lod_count{};
+	uint32_t padding{};
+	std::array<DrawLod, g_max_mesh_lods> lods{};
+	DrawBinds binds{};
+};
+static_assert(sizeof(DrawBatch) == 160);
+
+// The depth pyramid draw_list.comp tests instances against, see
+// src/depth_pyramid.hpp. reprojection takes this frame's clip space to the
+// one the pyramid was built in, over extent pixels in levels levels. Without
+// levels only the frustum culls.
+struct DrawOcclusion {
+	glm::mat4 reprojection{1.0F};
+	BindlessHandle pyramid{};
+	uint32_t levels{};
+	VkExtent2D extent{};
+};
+
+// Scratch memory a generated draw of the pipeline is preprocessed into.
+struct DrawPreprocess {
+	VkPipeline pipeline{};
+	Buffer buffer;
+	VkDeviceAddress address{};
+};
+
+// The lists of one frame in flight. instances and batches are written by the
+// CPU, commands and counts by draw_list.comp. Generated draws keep their
+// command sequences in commands and their count in the first of counts.
+struct DrawListFrame {
+	Buffer instances;
+	Buffer batches;
+	Buffer commands;
+	Buffer counts;
+	BindlessHandle instances_handle{};
+	BindlessHandle batches_handle{};
+	BindlessHandle commands_handle{};
+	BindlessHandle counts_handle{};
+	VkDeviceAddress commands_address{};
+	VkDeviceAddress counts_address{};
+	std::vector<DrawPreprocess> preprocess;
+};
+
+// Draws a scene with one indirect count draw per batch. The CPU only appends
+// instances; a compute shader culls them against the view frustum, and the
+// last frame's depth when given a DrawOcclusion, and turns
+// each visible one into a VkDrawIndexedIndirectCommand whose firstInstance is
+// the instance's index, counting the commands of every batch. Vertex shaders
+// find their DrawInstance at gl_InstanceIndex.
+//
+// Generated draws go further: the compute shader writes a command sequence
+// per visible instance that binds the index buffer and pushes the mesh
+// fields of DrawHandles before its draw, and all of them are executed as
+// device generated commands. Batches then only group an instance with its
+// mesh, so instances can be added in any order and a scene of many meshes
+// needs no sorting on the CPU.
+struct DrawLists {
+	bool synchronization2{};
+	bool generated{};
+	// Whether the counts can be read by conditional rendering.
+	bool conditional_rendering{};
+	// The uniform ring holding the instances' DrawUniforms.
+	BindlessHandle uniform_buffer{};
+	uint32_t instance_capacity{};
+	uint32_t batch_capacity{};
+	// The device's maxDrawIndirectCount, which a batch's draw count is clamped
+	// to.
+	uint32_t max_draw_count{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	// The stages of the graphics pipelines executing generated draws, which
+	// every push constant range covers.
+	VkShaderStageFlags draw_stages{};
+	VkIndirectCommandsLayoutEXT commands_layout{};
+	std::vector<DrawListFrame> frames;
+	// The lists being built for the current frame.
+	std::vector<DrawInstance> instances;
+	std::vector<DrawBatch> batches;
+};
+
+// Needs the draw_indirect_count capability. module is draw_list.comp.
+// Generated draws need the device_generated_commands capability and a
+// device_address allocator. They are executed by pipelines of draw_layout,
+// whose push constants are DrawHandles for draw_stages. conditional_rendering
+// needs the capability of the same name, for begin_batch_condition.
+// max_draw_count is the device's maxDrawIndirectCount, a batch's instances
+// past it are not drawn.
+auto create_draw_lists(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		BindlessHandle uniform_buffer,
+		size_t frame_count,
+		uint32_t instance_capacity,
+		uint32_t batch_capacity,
+		uint32_t max_draw_count,
+		bool generated,
+		bool conditional_rendering,
+		VkPipelineLayout draw_layout,
+		VkShaderStageFlags draw_stages,
+		bool synchronization2) -> DrawLists;
+// The device must be idle.
+void destroy_draw_lists(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		DrawLists& lists);
+
+// Empties the CPU lists for a new frame.
+void reset_draw_lists(DrawLists& lists);
+// Starts a new batch and returns its index. Instances added after it are drawn
+// with its mesh. mesh_idx is the DrawHandles::mesh of generated draws.
+auto add_draw_batch(DrawLists& lists, const Mesh& mesh, uint32_t mesh_idx)
+		-> uint32_t;
+void add_draw_instance(DrawLists& lists, uint32_t transform, uint32_t material);
+// An instance of a generated draw, which can be added after any batch.
+void add_generated_instance(
+		DrawLists& lists,
+		uint32_t batch,
+		uint32_t transform,
+		uint32_t material);
+
+// Uploads the lists and records the compute pass that builds the draw
+// commands. Must be recorded on the graphics queue outside a render pass,
+// after the frame fence was waited on. The commands and counts are written by
+// COMPUTE_SHADER, the caller makes them visible to the indirect draws.
+// lod_scale is the one select_mesh_lod takes. The pyramid of occlusion must
+// have been made visible to COMPUTE_SHADER in GENERAL.
+void build_draw_lists(
+		DrawLists& lists,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		float lod_scale,
+		const DrawOcclusion& occlusion);
+
+// Draws a batch built by the last build_draw_lists of the frame. The bound
+// pipeline must read its DrawInstance from the frame's instances_handle. The
+// lists must not change until every batch is recorded.
+void draw_batch(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		uint32_t batch,
+		const Mesh& mesh);
+
+// Starts skipping what is recorded until vkCmdEndConditionalRenderingEXT
+// when culling left nothing of a batch of the last build_draw_lists of the
+// frame, without the CPU waiting for the count. The counts must have been
+// made visible to CONDITIONAL_RENDERING, and the lists must not be
+// generated.
+void begin_batch_condition(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		uint32_t batch);
+
+// Makes room for the preprocessing of the frame's generated draws with
+// pipeline. Called before recording them, where the frame fence was waited
+// on.
+void reserve_generated_draws(
+		VkDevice& device,
+		Allocator& allocator,
+		DrawLists& lists,
+		size_t frame_idx,
+		VkPipeline pipeline);
+// Executes every generated draw of the last build_draw_lists of the frame
+// with the bound pipeline, after reserve_generated_draws for it. The
+// DrawHandles of the draws must have been pushed, the mesh fields are
+// replaced per draw. Each pipeline executes them once per frame, since its
+// preprocess memory is reused.
+void draw_generated(
+		VkCommandBuffer command_buffer,
+		const DrawLists& lists,
+		size_t frame_idx,
+		VkPipeline pipeline);
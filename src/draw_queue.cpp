@@ -0,0 +1,97 @@
+#include "draw_queue.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+namespace {
+
+constexpr auto g_radix_bits = 8U;
+constexpr auto g_radix_size = size_t{1} << g_radix_bits;
+constexpr auto g_radix_passes = 64U / g_radix_bits;
+
+void append_field(
+		uint64_t& key,
+		uint32_t value,
+		uint32_t bits,
+		const char* name) {
+	if (value >= (uint64_t{1} << bits)) {
+		fmt::print(
+				stderr,
+				"Sort key {} {} does not fit {} bits\n",
+				name,
+				value,
+				bits);
+		std::terminate();
+	}
+	key = (key << bits) | value;
+}
+
+}  // namespace
+
+auto make_sort_key(const SortKeyFields& fields) -> uint64_t {
+	auto key = uint64_t{};
+	append_field(key, fields.pass, g_sort_key_pass_bits, "pass");
+	append_field(key, fields.pipeline, g_sort_key_pipeline_bits, "pipeline");
+	append_field(key, fields.material, g_sort_key_material_bits, "material");
+	append_field(key, fields.mesh, g_sort_key_mesh_bits, "mesh");
+	// Non-negative floats order like their bit patterns, whose sign bit is 0.
+	auto depth = std::bit_cast<uint32_t>(std::max(fields.depth, 0.0F));
+	return (key << g_sort_key_depth_bits) |
+			(depth >> (31U - g_sort_key_depth_bits));
+}
+
+void reset_draw_queue(DrawQueue& queue) {
+	queue.draws.clear();
+	queue.runs.clear();
+}
+
+void enqueue_draw(DrawQueue& queue, const QueuedDraw& draw) {
+	queue.draws.emplace_back(draw);
+}
+
+void sort_draw_queue(DrawQueue& queue) {
+	auto& draws = queue.draws;
+	queue.scratch.resize(draws.size());
+	// Every pass's histogram comes from one read of the keys.
+	auto counts =
+			std::array<std::array<uint32_t, g_radix_size>, g_radix_passes>{};
+	for (const auto& draw : draws) {
+		for (auto pass = 0U; pass < g_radix_passes; pass++) {
+			counts.at(pass).at((draw.key >> (pass * g_radix_bits)) & 0xffU)++;
+		}
+	}
+	for (auto pass = 0U; pass < g_radix_passes; pass++) {
+		auto& histogram = counts.at(pass);
+		auto shift = pass * g_radix_bits;
+		if (draws.empty() ||
+				histogram.at((draws.front().key >> shift) & 0xffU) == draws.size()) {
+			continue;
+		}
+		auto offset = uint32_t{};
+		for (auto& count : histogram) {
+			offset += std::exchange(count, offset);
+		}
+		for (const auto& draw : draws) {
+			queue.scratch.at(histogram.at((draw.key >> shift) & 0xffU)++) = draw;
+		}
+		std::swap(draws, queue.scratch);
+	}
+
+	queue.runs.clear();
+	for (auto i = size_t{}; i < draws.size(); i++) {
+		if (queue.runs.empty() ||
+				sort_key_state(draws.at(i).key) !=
+						sort_key_state(draws.at(queue.runs.back().first).key)) {
+			queue.runs.emplace_back(DrawRun{
+					.first = static_cast<uint32_t>(i),
+					.count = 0});
+		}
+		queue.runs.back().count++;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sort key fields, most significant first. Draws sort by pass, then by
+// pipeline and material so state only changes between runs, then by mesh so
+// draws that can share a batch are adjacent, then front to back.
+constexpr auto g_sort_key_pass_bits = 4U;
+constexpr auto g_sort_key_pipeline_bits = 10U;
+constexpr auto g_sort_key_material_bits = 14U;
+constexpr auto g_sort_key_mesh_bits = 12U;
+constexpr auto g_sort_key_depth_bits = 24U;
+static_assert(
+		g_sort_key_pass_bits + g_sort_key_pipeline_bits +
+						g_sort_key_material_bits + g_sort_key_mesh_bits +
+						g_sort_key_depth_bits ==
+				64,
+		"Sort key fields fill 64 bits");
+
+struct SortKeyFields {
+	uint32_t pass{};
+	uint32_t pipeline{};
+	uint32_t material{};
+	uint32_t mesh{};
+	// Distance from the eye, such as clip w. Negative values sort as 0.
+	float depth{};
+};
+
+// Terminates when a field does not fit its bits. Depth keeps the top bits of
+// the float, which order like the values they came from.
+auto make_sort_key(const SortKeyFields& fields) -> uint64_t;
+// The fields above depth, equal for draws that can be merged.
+constexpr auto sort_key_state(uint64_t key) -> uint64_t {
+	return key >> g_sort_key_depth_bits;
+}
+
+// pipeline, material and mesh are the caller's indices, repeated so the
+// renderer does not have to decode them from the key. transform is the ring
+// slot of the draw's DrawUniforms.
+struct QueuedDraw {
+	uint64_t key{};
+	uint32_t pipeline{};
+	uint32_t material{};
+	uint32_t mesh{};
+	uint32_t transform{};
+};
+
+// Draws from first on that share their key's state, which become one batch.
+struct DrawRun {
+	uint32_t first{};
+	uint32_t count{};
+};
+
+// Draws enqueued in any order during a frame, then sorted once so the
+// renderer binds each pipeline and material once and merges each run of
+// the same mesh into a single batch.
+struct DrawQueue {
+	std::vector<QueuedDraw> draws;
+	std::vector<DrawRun> runs;
+	// Ping-pong target of the radix sort.
+	std::vector<QueuedDraw> scratch;
+};
+
+void reset_draw_queue(DrawQueue& queue);
+void enqueue_draw(DrawQueue& queue, const QueuedDraw& draw);
+// Stable LSD radix sort by key, one byte per pass. Passes whose byte is equal
+// for every key are skipped, which are most of them for the pass and
+// pipeline bytes. Then splits the sorted draws into runs.
+void sort_draw_queue(DrawQueue& queue);
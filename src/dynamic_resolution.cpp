@@ -0,0 +1,47 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Share of the distance to the estimated scale covered per frame.
+constexpr auto g_scale_response = 0.1;
+
+auto scale_side(uint32_t side, double scale) -> uint32_t {
+	return std::max(
+			static_cast<uint32_t>(std::lround(static_cast<double>(side) * scale)),
+			1U);
+}
+
+}  // namespace
+
+auto create_dynamic_resolution(size_t target_frame_rate) -> DynamicResolution {
+	return DynamicResolution{
+			.budget_milliseconds = 1000.0 / static_cast<double>(target_frame_rate) *
+					g_scaled_gpu_budget,
+			.scale = g_max_render_scale};
+}
+
+void update_dynamic_resolution(
+		DynamicResolution& resolution,
+		double gpu_milliseconds) {
+	if (gpu_milliseconds <= 0) {
+		return;
+	}
+	auto estimate = resolution.scale *
+			std::sqrt(resolution.budget_milliseconds / gpu_milliseconds);
+	resolution.scale = std::clamp(
+			resolution.scale + (estimate - resolution.scale) * g_scale_response,
+			g_min_render_scale,
+			g_max_render_scale);
+}
+
+auto scaled_render_extent(
+		const DynamicResolution& resolution,
+		VkExtent2D output_extent) -> VkExtent2D {
+	return VkExtent2D{
+			.width = scale_side(output_extent.width, resolution.scale),
+			.height = scale_side(output_extent.height, resolution.scale)};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstddef>
+
+// Bounds of the scale applied to both sides of the render extent.
+constexpr auto g_min_render_scale = 0.5;
+constexpr auto g_max_render_scale = 1.0;
+// Share of the frame the scaled passes may take on the GPU. The rest is left
+// for the passes that do not scale, like the upscale itself.
+constexpr auto g_scaled_gpu_budget = 0.8;
+
+// Scales the extent the scene is rendered at so its GPU time fits the frame
+// rate to hold. The scene is drawn into the top left of a target the size of
+// the output and upscaled from there, so a new scale costs no allocation.
+// GPU time is taken to grow with the pixel count, the square of the scale,
+// and the scale moves only part of the way to its estimate each frame, since
+// timestamps arrive a few frames late.
+struct DynamicResolution {
+	double budget_milliseconds{};
+	double scale{g_max_render_scale};
+};
+
+auto create_dynamic_resolution(size_t target_frame_rate) -> DynamicResolution;
+// gpu_milliseconds is the latest GPU time of the scaled passes.
+void update_dynamic_resolution(
+		DynamicResolution& resolution,
+		double gpu_milliseconds);
+// At least one pixel on either side.
+auto scaled_render_extent(
+		const DynamicResolution& resolution,
+		VkExtent2D output_extent) -> VkExtent2D;
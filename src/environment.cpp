@@ -0,0 +1,990 @@
+#include "environment.hpp"
+
+#include "host_memory.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+#include "pipeline.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+constexpr auto g_cache_magic = std::array{'V', 'K', 'E', 'N'};
+constexpr auto g_cache_version = uint32_t{1};
+constexpr auto g_fnv_offset_basis = uint64_t{14695981039346656037U};
+constexpr auto g_fnv_prime = uint64_t{1099511628211U};
+constexpr auto g_cube_faces = 6U;
+// Bytes of a g_environment_format texel.
+constexpr auto g_texel_size = VkDeviceSize{8};
+// Matches the local size of environment_prefilter.comp.
+constexpr auto g_group_size = 8U;
+
+constexpr auto g_sampled_binding = 0U;
+constexpr auto g_storage_image_binding = 1U;
+constexpr auto g_irradiance_binding = 2U;
+// A set for each specular level, the table and the irradiance.
+constexpr auto g_set_count = g_environment_specular_levels + 2;
+
+// The prefiltered data follows, the specular levels finest first with their
+// faces in order, then the table, then the irradiance, each as the GPU
+// copies them out. The sizes are there so changing them discards old files.
+struct CacheHeader {
+	std::array<char, 4> magic{};
+	uint32_t version{};
+	uint64_t source_hash{};
+	uint32_t face_size{};
+	uint32_t level_count{};
+	uint32_t lut_size{};
+	uint32_t sample_count{};
+	uint64_t data_size{};
+	uint64_t checksum{};
+};
+
+auto fnv1a(uint64_t hash, std::span<const std::byte> bytes) -> uint64_t {
+	for (auto byte : bytes) {
+		hash = (hash ^ std::to_integer<uint64_t>(byte)) * g_fnv_prime;
+	}
+	return hash;
+}
+
+auto face_size(uint32_t level) -> uint32_t {
+	return g_environment_face_size >> level;
+}
+
+auto specular_level_size(uint32_t level) -> VkDeviceSize {
+	auto side = VkDeviceSize{face_size(level)};
+	return side * side * g_cube_faces * g_texel_size;
+}
+
+auto specular_level_offset(uint32_t level) -> VkDeviceSize {
+	auto offset = VkDeviceSize{};
+	for (auto i = uint32_t{}; i < level; i++) {
+		offset += specular_level_size(i);
+	}
+	return offset;
+}
+
+constexpr auto g_lut_size =
+		VkDeviceSize{g_brdf_lut_size} * g_brdf_lut_size * g_texel_size;
+constexpr auto g_irradiance_size =
+		VkDeviceSize{g_irradiance_coefficients} * 4 * sizeof(float);
+
+auto lut_offset() -> VkDeviceSize {
+	return specular_level_offset(g_environment_specular_levels);
+}
+
+auto irradiance_offset() -> VkDeviceSize {
+	return lut_offset() + g_lut_size;
+}
+
+auto cache_data_size() -> VkDeviceSize {
+	return irradiance_offset() + g_irradiance_size;
+}
+
+auto make_header(uint64_t source_hash) -> CacheHeader {
+	return CacheHeader{
+			.magic = g_cache_magic,
+			.version = g_cache_version,
+			.source_hash = source_hash,
+			.face_size = g_environment_face_size,
+			.level_count = g_environment_specular_levels,
+			.lut_size = g_brdf_lut_size,
+			.sample_count = g_environment_sample_count,
+			.data_size = cache_data_size(),
+			.checksum = 0};
+}
+
+// Of every candidate, which all encode the same map, so the key does not
+// depend on which one the device samples.
+auto hash_candidates(
+		const Archive* archive,
+		std::span<const std::filesystem::path> candidates) -> uint64_t {
+	auto hash = g_fnv_offset_basis;
+	for (const auto& path : candidates) {
+		auto file = open_asset(archive, path);
+		if (!file.has_value()) {
+			fmt::print(stderr, "Failed to map environment {}\n", path.string());
+			std::terminate();
+		}
+		hash = fnv1a(hash, file->bytes);
+		unmap_file(*file);
+	}
+	return hash;
+}
+
+void create_environment_images(
+		VkDevice& device,
+		Allocator& allocator,
+		Environment& environment) {
+	constexpr auto usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_environment_format,
+			.extent =
+					VkExtent3D{
+							.width = g_environment_face_size,
+							.height = g_environment_face_size,
+							.depth = 1},
+			.mipLevels = g_environment_specular_levels,
+			.arrayLayers = g_cube_faces,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	environment.specular = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	image_info.flags = 0;
+	image_info.extent.width = g_brdf_lut_size;
+	image_info.extent.height = g_brdf_lut_size;
+	image_info.mipLevels = 1;
+	image_info.arrayLayers = 1;
+	environment.brdf_lut = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	environment.irradiance = create_buffer(
+			device,
+			allocator,
+			g_irradiance_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+					VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+}
+
+auto create_view(
+		VkDevice& device,
+		VkImage image,
+		VkImageViewType type,
+		uint32_t level,
+		uint32_t level_count,
+		uint32_t layer_count) -> VkImageView {
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image,
+			.viewType = type,
+			.format = g_environment_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = level,
+					.levelCount = level_count,
+					.baseArrayLayer = 0,
+					.layerCount = layer_count}};
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create an environment image view\n");
+		std::terminate();
+	}
+	return view;
+}
+
+// Stages the cached data into the images, nothing when path holds no valid
+// cache for source_hash.
+auto upload_cache(
+		VkDevice& device,
+		Uploader& uploader,
+		const std::filesystem::path& path,
+		uint64_t source_hash,
+		Environment& environment) -> bool {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		return false;
+	}
+	auto header = CacheHeader{};
+	auto expected = make_header(source_hash);
+	if (file->bytes.size() >= sizeof(header)) {
+		std::memcpy(&header, file->bytes.data(), sizeof(header));
+	}
+	auto data = file->bytes.subspan(
+			std::min(file->bytes.size(), sizeof(header)));
+	expected.checksum = fnv1a(g_fnv_offset_basis, data);
+	if (std::memcmp(&header, &expected, sizeof(header)) != 0 ||
+			data.size() != cache_data_size()) {
+		log_message(
+				LogLevel::info,
+				"Discarding stale environment cache {}",
+				path.string());
+		unmap_file(*file);
+		return false;
+	}
+	for (auto i = uint32_t{}; i < g_environment_specular_levels; i++) {
+		upload_image(
+				device,
+				uploader,
+				environment.specular.handle,
+				VkImageSubresourceLayers{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = i,
+						.baseArrayLayer = 0,
+						.layerCount = g_cube_faces},
+				VkExtent3D{.width = face_size(i), .height = face_size(i), .depth = 1},
+				data.subspan(specular_level_offset(i), specular_level_size(i)),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	}
+	upload_image(
+			device,
+			uploader,
+			environment.brdf_lut.handle,
+			VkImageSubresourceLayers{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1},
+			VkExtent3D{
+					.width = g_brdf_lut_size,
+					.height = g_brdf_lut_size,
+					.depth = 1},
+			data.subspan(lut_offset(), g_lut_size),
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	upload_buffer(
+			device,
+			uploader,
+			environment.irradiance.handle,
+			0,
+			data.subspan(irradiance_offset(), g_irradiance_size),
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	// The uploader copied the data into its staging ring.
+	environment.ticket = uploader.next_ticket;
+	unmap_file(*file);
+	return true;
+}
+
+void write_cache(const Environment& environment, uint64_t source_hash) {
+	auto data = std::span<const std::byte>(
+			environment.readback.allocation.mapped,
+			cache_data_size());
+	auto header = make_header(source_hash);
+	header.checksum = fnv1a(g_fnv_offset_basis, data);
+
+	const auto& path = environment.cache_path;
+	auto error = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), error);
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char*>(data.data()),
+				static_cast<std::streamsize>(data.size()));
+		if (!file) {
+			fmt::print(
+					stderr,
+					"Failed to write environment cache {}\n",
+					path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		fmt::print(stderr, "Failed to write environment cache {}\n", path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
+
+void save_readback(
+		VkDevice& device,
+		Allocator& allocator,
+		Environment& environment) {
+	write_cache(environment, environment.source_hash);
+	log_message(
+			LogLevel::info,
+			"Cached the prefiltered environment in {}",
+			environment.cache_path.string());
+	destroy_buffer(device, allocator, environment.readback);
+	environment.readback_frame = 0;
+}
+
+auto image_barrier(
+		VkImage image,
+		VkPipelineStageFlags2 src_stage,
+		VkAccessFlags2 src_access,
+		VkImageLayout old_layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access,
+		VkImageLayout new_layout) -> VkImageMemoryBarrier2 {
+	return VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stage,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.oldLayout = old_layout,
+			.newLayout = new_layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = VK_REMAINING_MIP_LEVELS,
+					.baseArrayLayer = 0,
+					.layerCount = VK_REMAINING_ARRAY_LAYERS}};
+}
+
+auto buffer_barrier(
+		VkBuffer buffer,
+		VkPipelineStageFlags2 src_stage,
+		VkAccessFlags2 src_access,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) -> VkBufferMemoryBarrier2 {
+	return VkBufferMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stage,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+// Binds a set sampling source and writing storage_view or the irradiance.
+void bind_set(
+		VkDevice& device,
+		EnvironmentPrefilter& prefilter,
+		VkCommandBuffer command_buffer,
+		VkImageView source,
+		VkImageView storage_view,
+		const Buffer& irradiance) {
+	auto* set = VkDescriptorSet{};
+	auto allocate_info = VkDescriptorSetAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = prefilter.descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &prefilter.set_layout};
+	if (vkAllocateDescriptorSets(device, &allocate_info, &set) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate an environment descriptor set\n");
+		std::terminate();
+	}
+	auto source_info = VkDescriptorImageInfo{
+			.sampler = VK_NULL_HANDLE,
+			.imageView = source,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	auto storage_info = VkDescriptorImageInfo{
+			.sampler = VK_NULL_HANDLE,
+			.imageView = storage_view,
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+	auto irradiance_info = VkDescriptorBufferInfo{
+			.buffer = irradiance.handle,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE};
+	auto writes = std::array{
+			VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = g_sampled_binding,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.pImageInfo = &source_info,
+					.pBufferInfo = VK_NULL_HANDLE,
+					.pTexelBufferView = VK_NULL_HANDLE},
+			VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.pNext = VK_NULL_HANDLE,
+					.dstSet = set,
+					.dstBinding = g_storage_image_binding,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.pImageInfo = &storage_info,
+					.pBufferInfo = VK_NULL_HANDLE,
+					.pTexelBufferView = VK_NULL_HANDLE}};
+	// Each shader writes either the image or the buffer, and bindings a
+	// pipeline does not use can stay empty.
+	if (storage_view == VK_NULL_HANDLE) {
+		writes[1].dstBinding = g_irradiance_binding;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[1].pImageInfo = VK_NULL_HANDLE;
+		writes[1].pBufferInfo = &irradiance_info;
+	}
+	vkUpdateDescriptorSets(
+			device,
+			static_cast<uint32_t>(writes.size()),
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+	vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			prefilter.pipeline_layout,
+			0,
+			1,
+			&set,
+			0,
+			VK_NULL_HANDLE);
+}
+
+void push_constants(
+		EnvironmentPrefilter& prefilter,
+		VkCommandBuffer command_buffer,
+		const EnvironmentConstants& constants) {
+	vkCmdPushConstants(
+			command_buffer,
+			prefilter.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+}
+
+}  // namespace
+
+auto create_environment_prefilter(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& specular_module,
+		VkShaderModule& brdf_lut_module,
+		VkShaderModule& irradiance_module,
+		VkShaderModule& cube_specular_module,
+		bool synchronization2) -> EnvironmentPrefilter {
+	auto prefilter = EnvironmentPrefilter{};
+	prefilter.synchronization2 = synchronization2;
+	// Longitude wraps around, latitude ends at the poles.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = VK_LOD_CLAMP_NONE,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	prefilter.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto bindings = std::array{
+			VkDescriptorSetLayoutBinding{
+					.binding = g_sampled_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = &prefilter.sampler},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_storage_image_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_irradiance_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE}};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&prefilter.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create environment set layout\n");
+		std::terminate();
+	}
+	auto pool_sizes = std::array{
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = g_set_count},
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = g_set_count},
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount = g_set_count}};
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.maxSets = g_set_count,
+			.poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data()};
+	if (vkCreateDescriptorPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&prefilter.descriptor_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create environment descriptor pool\n");
+		std::terminate();
+	}
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(EnvironmentConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &prefilter.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&prefilter.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create environment pipeline layout\n");
+		std::terminate();
+	}
+	prefilter.specular = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			prefilter.pipeline_layout,
+			specular_module,
+			VK_NULL_HANDLE,
+			0);
+	prefilter.brdf_lut = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			prefilter.pipeline_layout,
+			brdf_lut_module,
+			VK_NULL_HANDLE,
+			0);
+	prefilter.irradiance = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			prefilter.pipeline_layout,
+			irradiance_module,
+			VK_NULL_HANDLE,
+			0);
+	if (cube_specular_module != VK_NULL_HANDLE) {
+		prefilter.cube_specular = create_compute_pipeline(
+				device,
+				pipeline_cache,
+				prefilter.pipeline_layout,
+				cube_specular_module,
+				VK_NULL_HANDLE,
+				0);
+	}
+	return prefilter;
+}
+
+void destroy_environment_prefilter(
+		VkDevice& device,
+		SamplerCache& samplers,
+		EnvironmentPrefilter& prefilter) {
+	vkDestroyPipeline(device, prefilter.specular, host_callbacks());
+	vkDestroyPipeline(device, prefilter.brdf_lut, host_callbacks());
+	vkDestroyPipeline(device, prefilter.irradiance, host_callbacks());
+	vkDestroyPipeline(device, prefilter.cube_specular, host_callbacks());
+	vkDestroyPipelineLayout(
+			device,
+			prefilter.pipeline_layout,
+			host_callbacks());
+	vkDestroyDescriptorPool(
+			device,
+			prefilter.descriptor_pool,
+			host_callbacks());
+	vkDestroyDescriptorSetLayout(
+			device,
+			prefilter.set_layout,
+			host_callbacks());
+	release_sampler(device, samplers, prefilter.sampler);
+	prefilter = EnvironmentPrefilter{};
+}
+
+auto load_environment(
+		VkDevice& device,
+		VkPhysicalDevice& physical_device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const Archive* archive,
+		std::span<const std::filesystem::path> candidates,
+		const std::filesystem::path& cache_dir) -> Environment {
+	auto environment = Environment{};
+	auto source_hash = hash_candidates(archive, candidates);
+	environment.source_hash = source_hash;
+	environment.cache_path =
+			cache_dir / fmt::format("environment-{:016x}.cache", source_hash);
+	create_environment_images(device, allocator, environment);
+	environment.specular_view = create_view(
+			device,
+			environment.specular.handle,
+			VK_IMAGE_VIEW_TYPE_CUBE,
+			0,
+			g_environment_specular_levels,
+			g_cube_faces);
+	environment.brdf_lut_view = create_view(
+			device,
+			environment.brdf_lut.handle,
+			VK_IMAGE_VIEW_TYPE_2D,
+			0,
+			1,
+			1);
+	if (upload_cache(
+					device,
+					uploader,
+					environment.cache_path,
+					source_hash,
+					environment)) {
+		return environment;
+	}
+	// The map is only sampled by the prefilter, which reads every level.
+	environment.source = load_texture(
+			device,
+			physical_device,
+			allocator,
+			archive,
+			candidates,
+			false,
+			false);
+	return environment;
+}
+
+void destroy_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		Environment& environment) {
+	if (environment.readback.handle != VK_NULL_HANDLE) {
+		save_readback(device, allocator, environment);
+	}
+	if (environment.source.has_value()) {
+		destroy_texture(device, allocator, *environment.source);
+	}
+	vkDestroyImageView(device, environment.specular_view, host_callbacks());
+	vkDestroyImageView(device, environment.brdf_lut_view, host_callbacks());
+	destroy_image(device, allocator, environment.specular);
+	destroy_image(device, allocator, environment.brdf_lut);
+	destroy_buffer(device, allocator, environment.irradiance);
+	environment = Environment{};
+}
+
+void update_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const DeletionQueue& deletions,
+		Environment& environment,
+		VkDeviceSize budget) {
+	if (environment.readback.handle != VK_NULL_HANDLE &&
+			deletions.completed_ticket >= environment.readback_frame) {
+		save_readback(device, allocator, environment);
+	}
+	if (environment.source.has_value()) {
+		update_texture_residency(device, uploader, *environment.source);
+		stream_texture(device, uploader, *environment.source, budget);
+		return;
+	}
+	if (!environment.ready &&
+			upload_complete(device, uploader, environment.ticket)) {
+		environment.ready = true;
+	}
+}
+
+void record_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		EnvironmentPrefilter& prefilter,
+		Environment& environment,
+		VkCommandBuffer command_buffer) {
+	if (!environment.source.has_value() ||
+			environment.source->resident_level != environment.source->base_level) {
+		return;
+	}
+	auto& source = *environment.source;
+	const auto& source_extent = source.levels.at(source.base_level).extent;
+	auto constants = EnvironmentConstants{
+			.size = 0,
+			.roughness = 0,
+			.sample_count = g_environment_sample_count,
+			.source_levels = static_cast<float>(
+					source.levels.size() - source.base_level),
+			.source_texels = static_cast<float>(
+					VkDeviceSize{source_extent.width} * source_extent.height)};
+
+	// The map's uploads made it visible to fragment shaders.
+	auto before = std::array{
+			image_barrier(
+					source.image.handle,
+					VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			image_barrier(
+					environment.specular.handle,
+					VK_PIPELINE_STAGE_2_NONE,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL),
+			image_barrier(
+					environment.brdf_lut.handle,
+					VK_PIPELINE_STAGE_2_NONE,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL)};
+	pipeline_barrier(prefilter.synchronization2, command_buffer, {}, before);
+
+	auto views = std::vector<VkImageView>{};
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			prefilter.specular);
+	for (auto i = uint32_t{}; i < g_environment_specular_levels; i++) {
+		views.emplace_back(create_view(
+				device,
+				environment.specular.handle,
+				VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+				i,
+				1,
+				g_cube_faces));
+		bind_set(
+				device,
+				prefilter,
+				command_buffer,
+				source.view,
+				views.back(),
+				environment.irradiance);
+		constants.size = static_cast<int32_t>(face_size(i));
+		constants.roughness = static_cast<float>(i) /
+				static_cast<float>(g_environment_specular_levels - 1);
+		push_constants(prefilter, command_buffer, constants);
+		auto groups = (face_size(i) + g_group_size - 1) / g_group_size;
+		vkCmdDispatch(command_buffer, groups, groups, g_cube_faces);
+	}
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			prefilter.brdf_lut);
+	views.emplace_back(create_view(
+			device,
+			environment.brdf_lut.handle,
+			VK_IMAGE_VIEW_TYPE_2D,
+			0,
+			1,
+			1));
+	bind_set(
+			device,
+			prefilter,
+			command_buffer,
+			source.view,
+			views.back(),
+			environment.irradiance);
+	constants.size = static_cast<int32_t>(g_brdf_lut_size);
+	constants.sample_count = g_brdf_lut_sample_count;
+	push_constants(prefilter, command_buffer, constants);
+	auto lut_groups = (g_brdf_lut_size + g_group_size - 1) / g_group_size;
+	vkCmdDispatch(command_buffer, lut_groups, lut_groups, 1);
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			prefilter.irradiance);
+	bind_set(
+			device,
+			prefilter,
+			command_buffer,
+			source.view,
+			VK_NULL_HANDLE,
+			environment.irradiance);
+	vkCmdDispatch(command_buffer, 1, 1, 1);
+
+	// Copied out for the cache, then sampled from fragment shaders.
+	auto written_images = std::array{
+			image_barrier(
+					environment.specular.handle,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL,
+					VK_PIPELINE_STAGE_2_COPY_BIT,
+					VK_ACCESS_2_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL),
+			image_barrier(
+					environment.brdf_lut.handle,
+					VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+					VK_IMAGE_LAYOUT_GENERAL,
+					VK_PIPELINE_STAGE_2_COPY_BIT,
+					VK_ACCESS_2_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)};
+	auto written_irradiance = buffer_barrier(
+			environment.irradiance.handle,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COPY_BIT |
+					VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	pipeline_barrier(
+			prefilter.synchronization2,
+			command_buffer,
+			std::span{&written_irradiance, 1},
+			written_images);
+
+	environment.readback = create_buffer(
+			device,
+			allocator,
+			cache_data_size(),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+	auto regions = std::vector<VkBufferImageCopy>{};
+	for (auto i = uint32_t{}; i < g_environment_specular_levels; i++) {
+		regions.emplace_back(VkBufferImageCopy{
+				.bufferOffset = specular_level_offset(i),
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource =
+						VkImageSubresourceLayers{
+								.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+								.mipLevel = i,
+								.baseArrayLayer = 0,
+								.layerCount = g_cube_faces},
+				.imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
+				.imageExtent = VkExtent3D{
+						.width = face_size(i),
+						.height = face_size(i),
+						.depth = 1}});
+	}
+	vkCmdCopyImageToBuffer(
+			command_buffer,
+			environment.specular.handle,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			environment.readback.handle,
+			static_cast<uint32_t>(regions.size()),
+			regions.data());
+	auto lut_region = VkBufferImageCopy{
+			.bufferOffset = lut_offset(),
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource =
+					VkImageSubresourceLayers{
+							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+							.mipLevel = 0,
+							.baseArrayLayer = 0,
+							.layerCount = 1},
+			.imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
+			.imageExtent = VkExtent3D{
+					.width = g_brdf_lut_size,
+					.height = g_brdf_lut_size,
+					.depth = 1}};
+	vkCmdCopyImageToBuffer(
+			command_buffer,
+			environment.brdf_lut.handle,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			environment.readback.handle,
+			1,
+			&lut_region);
+	auto irradiance_region = VkBufferCopy{
+			.srcOffset = 0,
+			.dstOffset = irradiance_offset(),
+			.size = g_irradiance_size};
+	vkCmdCopyBuffer(
+			command_buffer,
+			environment.irradiance.handle,
+			environment.readback.handle,
+			1,
+			&irradiance_region);
+
+	auto sampled = std::array{
+			image_barrier(
+					environment.specular.handle,
+					VK_PIPELINE_STAGE_2_COPY_BIT,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+					VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			image_barrier(
+					environment.brdf_lut.handle,
+					VK_PIPELINE_STAGE_2_COPY_BIT,
+					VK_ACCESS_2_NONE,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+					VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)};
+	auto copied = buffer_barrier(
+			environment.readback.handle,
+			VK_PIPELINE_STAGE_2_COPY_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_HOST_BIT,
+			VK_ACCESS_2_HOST_READ_BIT);
+	pipeline_barrier(
+			prefilter.synchronization2,
+			command_buffer,
+			std::span{&copied, 1},
+			sampled);
+
+	environment.readback_frame = deletions.next_ticket;
+	environment.ready = true;
+	defer_deletion(
+			deletions,
+			[&device,
+			 &allocator,
+			 texture = std::move(source),
+			 views = std::move(views)]() mutable {
+				for (auto* view : views) {
+					vkDestroyImageView(device, view, host_callbacks());
+				}
+				destroy_texture(device, allocator, texture);
+			});
+	environment.source.reset();
+}
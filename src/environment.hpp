@@ -0,0 +1,139 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "archive.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "texture.hpp"
+#include "upload.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+// Level 0 of the specular cube has faces this many texels a side. Each level
+// below is for a rougher lobe, from zero in level 0 to one in the last.
+constexpr auto g_environment_face_size = 128U;
+constexpr auto g_environment_specular_levels = 6U;
+// GGX samples per texel of the rough levels and of the BRDF table.
+constexpr auto g_environment_sample_count = 64U;
+constexpr auto g_brdf_lut_sample_count = 512U;
+constexpr auto g_brdf_lut_size = 128U;
+// Spherical harmonics of the first three bands.
+constexpr auto g_irradiance_coefficients = 9U;
+// Of the cube and the table. The 16-bit two channel formats need the
+// shaderStorageImageExtendedFormats feature, this one does not.
+constexpr auto g_environment_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// Image based lighting made from an equirectangular environment map: a cube
+// of GGX prefiltered radiance with rougher lobes in coarser levels, the
+// irradiance as spherical harmonics, and the split sum BRDF table by n.v
+// along x and roughness along y. Prefiltering a large map takes seconds, so
+// the results are cached on disk under a hash of the map's files and later
+// runs upload those instead.
+struct Environment {
+	Image specular;
+	// A cube view of every level.
+	VkImageView specular_view{};
+	Image brdf_lut;
+	VkImageView brdf_lut_view{};
+	// g_irradiance_coefficients vec4s with RGB in xyz. Evaluated at a normal
+	// they give the irradiance, Lambertian surfaces reflect it over pi.
+	Buffer irradiance;
+	// Of the map's candidates, which names the cache file.
+	uint64_t source_hash{};
+	std::filesystem::path cache_path;
+	// The map being streamed in, until it is prefiltered.
+	std::optional<Texture> source;
+	// Host visible, filled by the frame that prefiltered and written to
+	// cache_path once readback_frame is done.
+	Buffer readback;
+	FrameTicket readback_frame{};
+	// Of the uploads from the cache.
+	UploadTicket ticket{};
+	// Everything is in SHADER_READ_ONLY_OPTIMAL and visible to fragment
+	// shaders, or will be for the commands recorded next.
+	bool ready{};
+};
+
+// Layout matches the push_constant block of the environment shaders.
+struct EnvironmentConstants {
+	int32_t size{};
+	float roughness{};
+	uint32_t sample_count{};
+	float source_levels{};
+	float source_texels{};
+};
+
+// The pipelines prefiltering runs, only needed when the cache misses or
+// reflection probes are rendered.
+struct EnvironmentPrefilter {
+	bool synchronization2{};
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkDescriptorPool descriptor_pool{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline specular{};
+	VkPipeline brdf_lut{};
+	VkPipeline irradiance{};
+	// Prefilters a cube into a specular cube, for reflection probes.
+	VkPipeline cube_specular{};
+};
+
+// specular_module, brdf_lut_module and cube_specular_module are variant 0,
+// g_shader_variant_brdf_lut and g_shader_variant_cube_source of
+// environment_prefilter.comp. A null cube_specular_module creates no
+// cube_specular pipeline.
+auto create_environment_prefilter(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& specular_module,
+		VkShaderModule& brdf_lut_module,
+		VkShaderModule& irradiance_module,
+		VkShaderModule& cube_specular_module,
+		bool synchronization2) -> EnvironmentPrefilter;
+// The device must be idle.
+void destroy_environment_prefilter(
+		VkDevice& device,
+		SamplerCache& samplers,
+		EnvironmentPrefilter& prefilter);
+
+// Hashes the candidates, which all encode the same map, and stages what
+// cache_dir holds for them into the uploader. Without a valid cache the map
+// is loaded like a texture, see load_texture, to be streamed and
+// prefiltered.
+auto load_environment(
+		VkDevice& device,
+		VkPhysicalDevice& physical_device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const Archive* archive,
+		std::span<const std::filesystem::path> candidates,
+		const std::filesystem::path& cache_dir) -> Environment;
+// The device must be idle. A cache write still waiting is done first.
+void destroy_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		Environment& environment);
+
+// Streams the map up to budget bytes, writes the cache once the frame that
+// prefiltered is done, and marks uploads from the cache ready.
+void update_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const DeletionQueue& deletions,
+		Environment& environment,
+		VkDeviceSize budget);
+// Prefilters once the whole map is resident, copies the results for the
+// cache and hands the map to deletions. Call after acquire_uploads.
+void record_environment(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		EnvironmentPrefilter& prefilter,
+		Environment& environment,
+		VkCommandBuffer command_buffer);
@@ -0,0 +1,444 @@
+#include "file_io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace {
+
+auto align_read(size_t value) -> size_t {
+	return (value + g_file_read_alignment - 1) / g_file_read_alignment *
+			g_file_read_alignment;
+}
+
+auto read_memory(const FileRead& read) -> std::byte* {
+	// The memory is the reader's own until the file is handed out.
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+	return const_cast<std::byte*>(read.file->bytes.data());
+}
+
+#ifdef _WIN32
+
+static_assert(sizeof(OVERLAPPED) <= sizeof(FileReadSlot::overlapped));
+
+auto slot_overlapped(FileReadSlot& slot) -> OVERLAPPED* {
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	return reinterpret_cast<OVERLAPPED*>(slot.overlapped.data());
+}
+
+auto open_backend(FileReader& reader) -> bool {
+	reader.completion_port =
+			CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+	return reader.completion_port != nullptr;
+}
+
+void close_backend(FileReader& reader) {
+	CloseHandle(reader.completion_port);
+}
+
+auto open_read(FileReader& reader, const std::filesystem::path& path)
+		-> std::unique_ptr<FileRead> {
+	auto* handle = CreateFileW(
+			path.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING |
+					FILE_FLAG_SEQUENTIAL_SCAN,
+			nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	auto size = LARGE_INTEGER{};
+	if (GetFileSizeEx(handle, &size) == 0 || size.QuadPart <= 0 ||
+			CreateIoCompletionPort(handle, reader.completion_port, 0, 0) ==
+					nullptr) {
+		CloseHandle(handle);
+		return nullptr;
+	}
+	auto read = std::make_unique<FileRead>();
+	read->size = static_cast<size_t>(size.QuadPart);
+	read->aligned_size = align_read(read->size);
+	auto* memory = VirtualAlloc(
+			nullptr,
+			read->aligned_size,
+			MEM_COMMIT | MEM_RESERVE,
+			PAGE_READWRITE);
+	if (memory == nullptr) {
+		CloseHandle(handle);
+		return nullptr;
+	}
+	read->file = MappedFile{
+			.bytes = std::span(static_cast<const std::byte*>(memory), read->size),
+			.borrowed = false,
+			.file_handle = nullptr,
+			.mapping_handle = nullptr};
+	read->file_handle = handle;
+	return read;
+}
+
+void close_read(FileRead& read) {
+	CloseHandle(read.file_handle);
+}
+
+auto submit_slot(FileReader& /*reader*/, FileReadSlot& slot, size_t /*idx*/)
+		-> bool {
+	auto* overlapped = slot_overlapped(slot);
+	*overlapped = OVERLAPPED{};
+	overlapped->Offset = static_cast<DWORD>(slot.offset);
+	overlapped->OffsetHigh = static_cast<DWORD>(uint64_t{slot.offset} >> 32U);
+	// Reads that complete right away still post to the completion port.
+	return ReadFile(
+						 slot.read->file_handle,
+						 read_memory(*slot.read) + slot.offset,
+						 static_cast<DWORD>(slot.length),
+						 nullptr,
+						 overlapped) != 0 ||
+			GetLastError() == ERROR_IO_PENDING;
+}
+
+void flush_submissions(FileReader& /*reader*/) {}
+
+template <typename Complete>
+void reap_completions(FileReader& reader, Complete complete) {
+	auto entries = std::array<OVERLAPPED_ENTRY, g_file_read_depth>{};
+	auto removed = ULONG{};
+	if (GetQueuedCompletionStatusEx(
+					reader.completion_port,
+					entries.data(),
+					static_cast<ULONG>(entries.size()),
+					&removed,
+					0,
+					FALSE) == 0) {
+		return;
+	}
+	for (auto i = ULONG{}; i < removed; i++) {
+		const auto& entry = entries.at(i);
+		auto slot = std::find_if(
+				reader.slots.begin(),
+				reader.slots.end(),
+				[&](FileReadSlot& candidate) {
+					return slot_overlapped(candidate) == entry.lpOverlapped;
+				});
+		// Internal holds the status of the read.
+		auto failed = entry.lpOverlapped->Internal != 0;
+		complete(
+				static_cast<size_t>(slot - reader.slots.begin()),
+				failed ? -1 : static_cast<int64_t>(entry.dwNumberOfBytesTransferred));
+	}
+}
+
+#else
+
+auto ring_field(void* ring, uint32_t offset) -> uint32_t* {
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	return reinterpret_cast<uint32_t*>(static_cast<std::byte*>(ring) + offset);
+}
+
+auto map_ring(int fd, size_t size, uint64_t offset) -> void* {
+	auto* ring = mmap(
+			nullptr,
+			size,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE,
+			fd,
+			static_cast<off_t>(offset));
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+	return ring == MAP_FAILED ? nullptr : ring;
+}
+
+void close_backend(FileReader& reader) {
+	if (reader.entries != nullptr) {
+		munmap(reader.entries, reader.entries_size);
+	}
+	if (reader.completion_ring != nullptr &&
+			reader.completion_ring != reader.submission_ring) {
+		munmap(reader.completion_ring, reader.completion_ring_size);
+	}
+	if (reader.submission_ring != nullptr) {
+		munmap(reader.submission_ring, reader.submission_ring_size);
+	}
+	if (reader.ring_fd >= 0) {
+		close(reader.ring_fd);
+	}
+}
+
+// Fails where the kernel predates io_uring or a sandbox blocks it.
+auto open_backend(FileReader& reader) -> bool {
+	auto params = io_uring_params{};
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	reader.ring_fd = static_cast<int>(syscall(
+			__NR_io_uring_setup,
+			static_cast<unsigned>(g_file_read_depth),
+			&params));
+	if (reader.ring_fd < 0) {
+		return false;
+	}
+	reader.submission_ring_size =
+			params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	reader.completion_ring_size =
+			params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	auto single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mapping) {
+		reader.submission_ring_size = std::max(
+				reader.submission_ring_size,
+				reader.completion_ring_size);
+	}
+	reader.submission_ring = map_ring(
+			reader.ring_fd,
+			reader.submission_ring_size,
+			IORING_OFF_SQ_RING);
+	reader.completion_ring = single_mapping
+			? reader.submission_ring
+			: map_ring(
+						reader.ring_fd,
+						reader.completion_ring_size,
+						IORING_OFF_CQ_RING);
+	reader.entries_size = params.sq_entries * sizeof(io_uring_sqe);
+	reader.entries =
+			map_ring(reader.ring_fd, reader.entries_size, IORING_OFF_SQES);
+	if (reader.submission_ring == nullptr || reader.completion_ring == nullptr ||
+			reader.entries == nullptr) {
+		close_backend(reader);
+		return false;
+	}
+	reader.submission_tail =
+			ring_field(reader.submission_ring, params.sq_off.tail);
+	reader.submission_mask =
+			ring_field(reader.submission_ring, params.sq_off.ring_mask);
+	reader.submission_array =
+			ring_field(reader.submission_ring, params.sq_off.array);
+	reader.completion_head =
+			ring_field(reader.completion_ring, params.cq_off.head);
+	reader.completion_tail =
+			ring_field(reader.completion_ring, params.cq_off.tail);
+	reader.completion_mask =
+			ring_field(reader.completion_ring, params.cq_off.ring_mask);
+	reader.completions = ring_field(reader.completion_ring, params.cq_off.cqes);
+	return true;
+}
+
+auto open_read(FileReader& /*reader*/, const std::filesystem::path& path)
+		-> std::unique_ptr<FileRead> {
+	// File systems without direct I/O, such as tmpfs, refuse the flag.
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+	if (fd < 0 && errno == EINVAL) {
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+		fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		return nullptr;
+	}
+	struct stat info {};
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return nullptr;
+	}
+	auto read = std::make_unique<FileRead>();
+	read->size = static_cast<size_t>(info.st_size);
+	read->aligned_size = align_read(read->size);
+	auto* memory = mmap(
+			nullptr,
+			read->aligned_size,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+	if (memory == MAP_FAILED) {
+		close(fd);
+		return nullptr;
+	}
+	// unmap_file unmaps the pages of the size, which are those of the aligned
+	// size.
+	read->file = MappedFile{
+			.bytes = std::span(static_cast<const std::byte*>(memory), read->size)};
+	read->fd = fd;
+	return read;
+}
+
+void close_read(FileRead& read) {
+	close(read.fd);
+}
+
+auto submit_slot(FileReader& reader, FileReadSlot& slot, size_t idx) -> bool {
+	auto tail = *reader.submission_tail;
+	auto index = tail & *reader.submission_mask;
+	auto* entry = static_cast<io_uring_sqe*>(reader.entries) + index;
+	*entry = io_uring_sqe{};
+	entry->opcode = IORING_OP_READ;
+	entry->fd = slot.read->fd;
+	entry->off = slot.offset;
+	auto* buffer = read_memory(*slot.read) + slot.offset;
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	entry->addr = reinterpret_cast<uint64_t>(buffer);
+	entry->len = static_cast<uint32_t>(slot.length);
+	entry->user_data = idx;
+	reader.submission_array[index] = index;
+	std::atomic_ref(*reader.submission_tail)
+			.store(tail + 1, std::memory_order_release);
+	reader.unsubmitted++;
+	return true;
+}
+
+// Hands the entries added since the last call to the kernel. Any it does not
+// take stay in the ring for the next call.
+void flush_submissions(FileReader& reader) {
+	if (reader.unsubmitted == 0) {
+		return;
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	auto submitted = syscall(
+			__NR_io_uring_enter,
+			reader.ring_fd,
+			reader.unsubmitted,
+			0,
+			0,
+			nullptr,
+			0);
+	if (submitted > 0) {
+		reader.unsubmitted -= static_cast<uint32_t>(submitted);
+	}
+}
+
+template <typename Complete>
+void reap_completions(FileReader& reader, Complete complete) {
+	auto head = *reader.completion_head;
+	auto tail = std::atomic_ref(*reader.completion_tail)
+									.load(std::memory_order_acquire);
+	for (; head != tail; head++) {
+		const auto& completion = static_cast<const io_uring_cqe*>(
+				reader.completions)[head & *reader.completion_mask];
+		complete(static_cast<size_t>(completion.user_data), completion.res);
+	}
+	std::atomic_ref(*reader.completion_head)
+			.store(head, std::memory_order_release);
+}
+
+#endif
+
+auto read_finished(const FileRead& read) -> bool {
+	return read.in_flight == 0 &&
+			(read.failed || read.next_offset >= read.aligned_size);
+}
+
+// Fills the free slots with the next requests of the files being read.
+void submit_requests(FileReader& reader) {
+	auto next = reader.reads.begin();
+	for (auto i = size_t{}; i < reader.slots.size(); i++) {
+		auto& slot = reader.slots.at(i);
+		if (slot.read != nullptr) {
+			continue;
+		}
+		next = std::find_if(next, reader.reads.end(), [](const auto& read) {
+			return !read->failed && read->next_offset < read->aligned_size;
+		});
+		if (next == reader.reads.end()) {
+			break;
+		}
+		auto& read = **next;
+		slot = FileReadSlot{
+				.read = &read,
+				.offset = read.next_offset,
+				.length = std::min(
+						g_file_read_size,
+						read.aligned_size - read.next_offset)};
+		read.next_offset += slot.length;
+		if (submit_slot(reader, slot, i)) {
+			read.in_flight++;
+		} else {
+			read.failed = true;
+			slot.read = nullptr;
+		}
+	}
+	flush_submissions(reader);
+}
+
+}  // namespace
+
+auto create_file_reader() -> std::unique_ptr<FileReader> {
+	auto reader = std::make_unique<FileReader>();
+	reader->available = open_backend(*reader);
+	return reader;
+}
+
+void destroy_file_reader(FileReader& reader) {
+	if (reader.available) {
+		close_backend(reader);
+	}
+	reader.available = false;
+}
+
+auto start_file_read(
+		FileReader& reader,
+		const std::filesystem::path& path,
+		FileReadDone done) -> bool {
+	if (!reader.available) {
+		return false;
+	}
+	auto lock = std::scoped_lock(reader.mutex);
+	auto read = open_read(reader, path);
+	if (read == nullptr) {
+		return false;
+	}
+	read->done = std::move(done);
+	reader.reads.emplace_back(std::move(read));
+	submit_requests(reader);
+	return true;
+}
+
+void poll_file_reads(FileReader& reader) {
+	if (!reader.available) {
+		return;
+	}
+	auto finished = std::vector<std::unique_ptr<FileRead>>{};
+	{
+		auto lock = std::scoped_lock(reader.mutex);
+		reap_completions(reader, [&](size_t idx, int64_t result) {
+			auto& slot = reader.slots.at(idx);
+			auto& read = *slot.read;
+			read.in_flight--;
+			// A regular file only reads short at its end.
+			auto end = slot.offset + static_cast<size_t>(std::max(result, int64_t{}));
+			if (result < 0 ||
+					(static_cast<size_t>(result) < slot.length && end < read.size)) {
+				read.failed = true;
+			}
+			slot.read = nullptr;
+		});
+		auto done = std::stable_partition(
+				reader.reads.begin(),
+				reader.reads.end(),
+				[](const auto& read) { return !read_finished(*read); });
+		std::move(done, reader.reads.end(), std::back_inserter(finished));
+		reader.reads.erase(done, reader.reads.end());
+		submit_requests(reader);
+	}
+	// Without the lock, done may start the next read.
+	for (auto& read : finished) {
+		close_read(*read);
+		if (read->failed) {
+			unmap_file(*read->file);
+			read->file.reset();
+		}
+		read->done(std::move(read->file));
+	}
+}
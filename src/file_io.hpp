@@ -0,0 +1,107 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Reads in flight at once, across every file being read.
+constexpr auto g_file_read_depth = size_t{64};
+// Bytes a read takes from a file. Large enough that each one streams at the
+// drive's full rate, small enough that a few files keep the queue full.
+constexpr auto g_file_read_size = size_t{1024} * 1024;
+// Offsets, lengths and buffers of unbuffered reads are multiples of this,
+// which covers the logical block size of every drive in use.
+constexpr auto g_file_read_alignment = size_t{4096};
+
+// Called on the thread that polls the reader once the whole file arrived,
+// with nothing when it could not be read.
+using FileReadDone = std::function<void(std::optional<MappedFile>)>;
+
+struct FileRead {
+	std::optional<MappedFile> file;
+	// The file's size, and what the reads cover, rounded up to the alignment.
+	size_t size{};
+	size_t aligned_size{};
+	// The next byte to request.
+	size_t next_offset{};
+	uint32_t in_flight{};
+	bool failed{};
+	FileReadDone done;
+#ifdef _WIN32
+	void* file_handle{};
+#else
+	int fd{-1};
+#endif
+};
+
+// One read at a time per slot. read is null for free slots.
+struct FileReadSlot {
+	FileRead* read{};
+	size_t offset{};
+	size_t length{};
+#ifdef _WIN32
+	// Room for the slot's OVERLAPPED, which the completion port hands back,
+	// so the header does not need windows.h.
+	alignas(8) std::array<std::byte, 32> overlapped{};
+#endif
+};
+
+// Reads whole files with many requests in flight, straight into page aligned
+// memory without going through the page cache where the file system allows,
+// so loading keeps a fast drive busy instead of faulting in a page at a time.
+// Requests go to an io_uring on Linux and to overlapped reads on a completion
+// port on Windows. Completions are picked up by poll_file_reads, which also
+// tops the queue up with the next requests of the files being read.
+struct FileReader {
+	// Without the backend, for example where io_uring is disabled, nothing is
+	// read and files have to be mapped instead.
+	bool available{};
+	std::mutex mutex;
+	std::vector<std::unique_ptr<FileRead>> reads;
+	std::array<FileReadSlot, g_file_read_depth> slots{};
+#ifdef _WIN32
+	void* completion_port{};
+#else
+	int ring_fd{-1};
+	// The submission and completion rings and the submission entries, mapped
+	// from the ring.
+	void* submission_ring{};
+	size_t submission_ring_size{};
+	void* completion_ring{};
+	size_t completion_ring_size{};
+	void* entries{};
+	size_t entries_size{};
+	uint32_t* submission_tail{};
+	uint32_t* submission_mask{};
+	uint32_t* submission_array{};
+	uint32_t* completion_head{};
+	uint32_t* completion_tail{};
+	uint32_t* completion_mask{};
+	void* completions{};
+	// Entries added to the submission ring that were not handed over yet.
+	uint32_t unsubmitted{};
+#endif
+};
+
+auto create_file_reader() -> std::unique_ptr<FileReader>;
+// Every read must have completed.
+void destroy_file_reader(FileReader& reader);
+
+// Starts reading the whole of path, and returns false when the reader is not
+// available or the file cannot be opened, without calling done. The file
+// done receives is backed by memory of its own, unmap_file frees it.
+auto start_file_read(
+		FileReader& reader,
+		const std::filesystem::path& path,
+		FileReadDone done) -> bool;
+// Requests the next parts of the files being read, and calls done for each
+// that finished.
+void poll_file_reads(FileReader& reader);
@@ -0,0 +1,480 @@
+#include "fog.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "temporal.hpp"
+
+#include <fmt/core.h>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_fog_written_binding = 0U;
+constexpr auto g_fog_read_binding = 1U;
+
+// Offsets of the froxel jitter sequence.
+constexpr auto g_fog_jitter_phases = 16U;
+
+constexpr auto g_sampled_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_storage_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_light_grid_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+// Layout matches the FogView block in fog_scatter.comp.
+struct FogView {
+	// This frame's view space to last frame's, and last frame's projection,
+	// which reproject the froxels into the previous scattering.
+	glm::mat4 to_previous_view{1.0F};
+	glm::mat4 previous_projection{1.0F};
+	// The froxels' sample offset from their centers in xyz, in froxels.
+	glm::vec4 jitter{};
+	// Scattering in rgb and extinction in a, per unit of distance.
+	glm::vec4 medium{};
+	float anisotropy{};
+	// Zero without a previous scattering.
+	float history_weight{};
+	BindlessHandle history{};
+	BindlessHandle history_sampler{};
+};
+static_assert(sizeof(FogView) == 176);
+
+// Layout matches the push_constant blocks in fog_scatter.comp and
+// fog_integrate.comp.
+struct FogConstants {
+	BindlessHandle lights{};
+	BindlessHandle light_grid{};
+	BindlessHandle view{};
+};
+
+auto create_volume(VkDevice& device, Allocator& allocator, VkImageView& view)
+		-> Image {
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_3D,
+			.format = g_fog_volume_format,
+			.extent =
+					VkExtent3D{
+							.width = g_fog_grid_x,
+							.height = g_fog_grid_y,
+							.depth = g_fog_grid_z},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	auto image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_3D,
+			.format = g_fog_volume_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create fog volume view\n");
+		std::terminate();
+	}
+	return image;
+}
+
+// Points the frame's set at this frame's views. The frame's fence was waited
+// on, so the set is no longer in use. The scattering pass only reads the
+// bindless table and leaves read unwritten.
+void write_fog_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		VkDescriptorSet set,
+		uint32_t written,
+		std::optional<uint32_t> read) {
+	auto images = std::array{
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = graph_image_view(graph, written),
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = read ? graph_image_view(graph, *read) : VK_NULL_HANDLE,
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+	};
+	auto image_write = [&](uint32_t binding, const VkDescriptorImageInfo* info) {
+		return VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = info,
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE};
+	};
+	auto writes = std::array{
+			image_write(g_fog_written_binding, &images.at(0)),
+			image_write(g_fog_read_binding, &images.at(1)),
+	};
+	vkUpdateDescriptorSets(
+			device,
+			read ? 2U : 1U,
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+}
+
+}  // namespace
+
+auto create_volumetric_fog(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& scatter_module,
+		VkShaderModule& integrate_module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count) -> VolumetricFog {
+	auto fog = VolumetricFog{};
+	// The history is sampled linearly where froxels reprojected to, and the
+	// integrated volume between froxels by shader.frag.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	fog.sampler = acquire_sampler(device, samplers, sampler_info);
+	fog.sampler_handle = add_bindless_sampler(device, bindless, fog.sampler);
+
+	auto storage_binding = [](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = VK_NULL_HANDLE};
+	};
+	auto bindings = std::array{
+			storage_binding(g_fog_written_binding),
+			storage_binding(g_fog_read_binding),
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&fog.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create fog set layout\n");
+		std::terminate();
+	}
+
+	auto set_layouts = std::array{bindless.set_layout, fog.set_layout};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(FogConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&fog.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create fog pipeline layout\n");
+		std::terminate();
+	}
+	fog.scatter_pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			fog.pipeline_layout,
+			scatter_module,
+			specialization,
+			0);
+	fog.integrate_pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			fog.pipeline_layout,
+			integrate_module,
+			specialization,
+			0);
+
+	for (auto i = size_t{}; i < fog.scattering.size(); i++) {
+		fog.scattering.at(i) =
+				create_volume(device, allocator, fog.scattering_views.at(i));
+		fog.scattering_handles.at(i) = add_bindless_image(
+				device,
+				bindless,
+				fog.scattering_views.at(i),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	fog.integrated = create_volume(device, allocator, fog.integrated_view);
+	fog.integrated_handle = add_bindless_image(
+			device,
+			bindless,
+			fog.integrated_view,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = fog.frames.emplace_back();
+		frame.view = create_dynamic_buffer(
+				device,
+				allocator,
+				sizeof(FogView),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.view_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.view.handle,
+				0,
+				sizeof(FogView));
+	}
+	return fog;
+}
+
+void destroy_volumetric_fog(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		VolumetricFog& fog) {
+	for (auto& frame : fog.frames) {
+		remove_bindless_buffer(device, bindless, frame.view_handle);
+		destroy_buffer(device, allocator, frame.view);
+	}
+	remove_bindless_image(device, bindless, fog.integrated_handle);
+	vkDestroyImageView(device, fog.integrated_view, host_callbacks());
+	destroy_image(device, allocator, fog.integrated);
+	for (auto i = size_t{}; i < fog.scattering.size(); i++) {
+		remove_bindless_image(device, bindless, fog.scattering_handles.at(i));
+		vkDestroyImageView(device, fog.scattering_views.at(i), host_callbacks());
+		destroy_image(device, allocator, fog.scattering.at(i));
+	}
+	vkDestroyPipeline(device, fog.integrate_pipeline, host_callbacks());
+	vkDestroyPipeline(device, fog.scatter_pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, fog.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, fog.set_layout, host_callbacks());
+	remove_bindless_sampler(device, bindless, fog.sampler_handle);
+	release_sampler(device, samplers, fog.sampler);
+	fog = VolumetricFog{};
+}
+
+auto cluster_fog(const VolumetricFog& fog) -> ClusterFog {
+	return ClusterFog{
+			.volume = fog.integrated_handle,
+			.sampler = fog.sampler_handle};
+}
+
+auto add_fog_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		VolumetricFog& fog,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		const LightClusterFrame& light_frame,
+		uint32_t light_grid,
+		const glm::mat4& view,
+		const glm::mat4& projection) -> uint32_t {
+	auto current = fog.current;
+	auto previous = 1 - current;
+	fog.jitter_index = fog.jitter_index % g_fog_jitter_phases + 1;
+	const auto& settings = fog.settings;
+	auto extinction =
+			(settings.scattering.r + settings.scattering.g +
+			 settings.scattering.b) /
+					3.0F +
+			settings.absorption;
+	auto fog_view = FogView{
+			.to_previous_view = fog.previous_view * glm::inverse(view),
+			.previous_projection = fog.previous_projection,
+			.jitter = glm::vec4(
+					halton(fog.jitter_index, 2) - 0.5F,
+					halton(fog.jitter_index, 3) - 0.5F,
+					halton(fog.jitter_index, 5) - 0.5F,
+					0.0F),
+			.medium = glm::vec4(settings.scattering, extinction),
+			.anisotropy = settings.anisotropy,
+			.history_weight = fog.history_valid ? settings.history_weight : 0.0F,
+			.history = fog.scattering_handles.at(previous),
+			.history_sampler = fog.sampler_handle};
+	const auto& frame = fog.frames.at(frame_idx);
+	std::memcpy(frame.view.allocation.mapped, &fog_view, sizeof(fog_view));
+	fog.previous_view = view;
+	fog.previous_projection = projection;
+
+	// Every volume is left readable at the end of the frame, so the next
+	// frame's writes wait for the reads.
+	auto used = fog.history_valid ? g_sampled_read : GraphState{};
+	auto history = import_graph_image(
+			graph,
+			fog.scattering.at(previous).handle,
+			fog.scattering_views.at(previous),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			std::nullopt);
+	auto scattering = import_graph_image(
+			graph,
+			fog.scattering.at(current).handle,
+			fog.scattering_views.at(current),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			g_sampled_read);
+	auto integrated = import_graph_image(
+			graph,
+			fog.integrated.handle,
+			fog.integrated_view,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			fog.history_valid ? g_fog_volume_read : GraphState{},
+			g_fog_volume_read);
+	auto constants = FogConstants{
+			.lights = light_frame.lights_handle,
+			.light_grid = light_frame.grid_handle,
+			.view = frame.view_handle};
+	auto bind = [&device, &graph, &descriptors, &fog, &bindless, frame_idx,
+							 constants](
+									VkCommandBuffer command_buffer,
+									VkPipeline pipeline,
+									uint32_t written,
+									std::optional<uint32_t> read) {
+		auto* set =
+				allocate_frame_set(device, descriptors, frame_idx, fog.set_layout);
+		write_fog_set(device, graph, set, written, read);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				fog.pipeline_layout,
+				bindless);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				fog.pipeline_layout,
+				1,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		vkCmdPushConstants(
+				command_buffer,
+				fog.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+	};
+
+	auto scatter_pass = add_graph_pass(
+			graph,
+			"fog_scatter",
+			[&profiler, &fog, frame_idx, bind, scattering](
+					VkCommandBuffer command_buffer) {
+				auto gpu_pass =
+						begin_gpu_pass(profiler, command_buffer, frame_idx, "fog_scatter");
+				bind(command_buffer, fog.scatter_pipeline, scattering, std::nullopt);
+				vkCmdDispatch(
+						command_buffer,
+						(g_fog_grid_x + g_fog_scatter_group_size - 1) /
+								g_fog_scatter_group_size,
+						(g_fog_grid_y + g_fog_scatter_group_size - 1) /
+								g_fog_scatter_group_size,
+						(g_fog_grid_z + g_fog_scatter_group_size - 1) /
+								g_fog_scatter_group_size);
+				end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+			},
+			false);
+	graph_read(graph, scatter_pass, light_grid, g_light_grid_read);
+	graph_read(graph, scatter_pass, history, g_sampled_read);
+	graph_write(graph, scatter_pass, scattering, g_storage_write);
+
+	auto integrate_pass = add_graph_pass(
+			graph,
+			"fog_integrate",
+			[&profiler, &fog, frame_idx, bind, scattering, integrated](
+					VkCommandBuffer command_buffer) {
+				auto gpu_pass = begin_gpu_pass(
+						profiler,
+						command_buffer,
+						frame_idx,
+						"fog_integrate");
+				bind(command_buffer, fog.integrate_pipeline, integrated, scattering);
+				vkCmdDispatch(
+						command_buffer,
+						(g_fog_grid_x + g_fog_integrate_group_size - 1) /
+								g_fog_integrate_group_size,
+						(g_fog_grid_y + g_fog_integrate_group_size - 1) /
+								g_fog_integrate_group_size,
+						1);
+				end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+			},
+			false);
+	graph_read(graph, integrate_pass, scattering, g_storage_read);
+	graph_write(graph, integrate_pass, integrated, g_storage_write);
+	fog.current = previous;
+	fog.history_valid = true;
+	return integrated;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "light_clusters.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The froxel grid, matching fog_scatter.comp, fog_integrate.comp and
+// shader.frag: five froxels across every cluster tile and two deep in every
+// cluster slice, so a froxel lies in a single cluster and lights with its
+// list.
+constexpr auto g_fog_grid_x = 80U;
+constexpr auto g_fog_grid_y = 45U;
+constexpr auto g_fog_grid_z = 48U;
+static_assert(g_fog_grid_x % g_light_grid_x == 0);
+static_assert(g_fog_grid_y % g_light_grid_y == 0);
+static_assert(g_fog_grid_z % g_light_grid_z == 0);
+// Match local_size in fog_scatter.comp, a workgroup lights a block of this
+// many froxels cubed, and in fog_integrate.comp, where it marches this many
+// columns squared.
+constexpr auto g_fog_scatter_group_size = 4U;
+constexpr auto g_fog_integrate_group_size = 8U;
+// Light scattered towards the viewer in rgb and extinction in a per froxel,
+// then integrated from the viewer: the light reaching it in rgb and the
+// transmittance in a.
+constexpr auto g_fog_volume_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+// How the main pass reads the integrated volume.
+constexpr auto g_fog_volume_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+// A uniform medium.
+struct FogSettings {
+	// Per unit of distance in each channel, scattering and absorbing.
+	glm::vec3 scattering{0.3F};
+	float absorption{0.05F};
+	// Henyey-Greenstein asymmetry, above 0 scattering forward.
+	float anisotropy{0.3F};
+	// How much of a froxel's history is kept when it reprojects into the
+	// previous volume. Each frame jitters the froxels' samples, which the
+	// history averages.
+	float history_weight{0.9F};
+};
+
+// Host visible, written after the frame's fence was waited on.
+struct FogFrame {
+	Buffer view;
+	BindlessHandle view_handle{};
+};
+
+// Volumetric fog in the light clusters' volume. fog_scatter.comp lights a
+// jittered point in every froxel with the lights of the cluster holding it
+// and blends the result with where the froxel was last frame, then
+// fog_integrate.comp marches each column of froxels front to back. shader.frag
+// looks the integrated volume up at the depth of what it shades, so fog costs
+// a froxel grid rather than a loop over the lights per pixel. The scattering
+// volumes ping-pong between frames like TemporalAa's history.
+//
+// Both passes bind the bindless table as set 0, which they read the lights
+// and the previous scattering through, and a set of their own as set 1:
+// binding 0 the volume written, binding 1 the one read by the integration,
+// both storage images taken from the frame's descriptor pools.
+struct VolumetricFog {
+	FogSettings settings;
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline scatter_pipeline{};
+	VkPipeline integrate_pipeline{};
+	std::array<Image, 2> scattering;
+	std::array<VkImageView, 2> scattering_views{};
+	std::array<BindlessHandle, 2> scattering_handles{};
+	Image integrated;
+	VkImageView integrated_view{};
+	BindlessHandle integrated_handle{};
+	std::vector<FogFrame> frames;
+	// The scattering the next frame writes, the other one is the previous.
+	uint32_t current{};
+	// Whether the previous scattering holds an earlier frame.
+	bool history_valid{};
+	uint32_t jitter_index{};
+	glm::mat4 previous_view{1.0F};
+	glm::mat4 previous_projection{1.0F};
+};
+
+// scatter_module is fog_scatter.comp and integrate_module fog_integrate.comp,
+// whose bindless arrays are sized by specialization.
+auto create_volumetric_fog(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& scatter_module,
+		VkShaderModule& integrate_module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count) -> VolumetricFog;
+// The device must be idle.
+void destroy_volumetric_fog(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		VolumetricFog& fog);
+
+// What build_light_clusters passes on to shader.frag.
+auto cluster_fog(const VolumetricFog& fog) -> ClusterFog;
+
+// Adds the passes filling the integrated volume from the frame's lights,
+// which must be the light clusters' frame at frame_idx, and returns it.
+// light_grid is the graph's grid buffer, written before. view and projection
+// are the clusters' camera. The volume is left for the fragment shader to
+// sample.
+auto add_fog_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		VolumetricFog& fog,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		const LightClusterFrame& light_frame,
+		uint32_t light_grid,
+		const glm::mat4& view,
+		const glm::mat4& projection) -> uint32_t;
@@ -0,0 +1,79 @@
+#include "frame_arena.hpp"
+
+#include "huge_pages.hpp"
+
+#include <fmt/core.h>
+
+#include <bit>
+#include <cstdio>
+#include <exception>
+
+auto FrameArena::do_allocate(size_t bytes, size_t alignment) -> void* {
+	auto* memory = static_cast<void*>(block.data() + used);
+	auto space = block.size() - used;
+	if (std::align(alignment, bytes, memory, space) != nullptr) {
+		used = block.size() - space + bytes;
+		return memory;
+	}
+	memory = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	overflow.emplace_back(ArenaOverflow{
+			.memory = memory,
+			.size = bytes,
+			.alignment = alignment});
+	overflow_size += bytes + alignment;
+	return memory;
+}
+
+void FrameArena::do_deallocate(
+		void* /*memory*/,
+		size_t /*bytes*/,
+		size_t /*alignment*/) {}
+
+auto FrameArena::do_is_equal(
+		const std::pmr::memory_resource& other) const noexcept -> bool {
+	return this == &other;
+}
+
+namespace {
+
+auto allocate_block(size_t size) -> std::span<std::byte> {
+	auto block = allocate_huge_pages(size);
+	if (block.empty()) {
+		fmt::print(stderr, "Failed to allocate a frame arena block\n");
+		std::terminate();
+	}
+	return block;
+}
+
+}  // namespace
+
+auto create_frame_arena(size_t size) -> std::unique_ptr<FrameArena> {
+	auto arena = std::make_unique<FrameArena>();
+	arena->block = allocate_block(size);
+	return arena;
+}
+
+void destroy_frame_arena(FrameArena& arena) {
+	reset_frame_arena(arena);
+	free_huge_pages(arena.block);
+	arena.block = {};
+}
+
+void reset_frame_arena(FrameArena& arena) {
+	for (const auto& entry : arena.overflow) {
+		std::pmr::new_delete_resource()->deallocate(
+				entry.memory,
+				entry.size,
+				entry.alignment);
+	}
+	// Growing in powers of two keeps a slowly rising peak from growing the
+	// block every frame.
+	if (arena.overflow_size != 0) {
+		auto size = std::bit_ceil(arena.block.size() + arena.overflow_size);
+		free_huge_pages(arena.block);
+		arena.block = allocate_block(size);
+	}
+	arena.used = 0;
+	arena.overflow.clear();
+	arena.overflow_size = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+// Block a frame arena starts with, grown when a frame needs more.
+constexpr auto g_frame_arena_size = size_t{256} * 1024;
+
+// A request that did not fit the block, held until the next reset.
+struct ArenaOverflow {
+	void* memory{};
+	size_t size{};
+	size_t alignment{};
+};
+
+// Bump allocator for CPU data that only lives while one frame is recorded and
+// submitted, behind the std::pmr interface so containers can use it.
+// Deallocating does nothing, everything is released at once when the next
+// frame starts. Requests past the end of the block go to the heap and the
+// following reset grows the block to cover them, so a steady workload stops
+// allocating after its first frames. Only the thread recording frames may use
+// it.
+struct FrameArena final : std::pmr::memory_resource {
+	// From allocate_huge_pages, so a block grown to huge pages gets them.
+	std::span<std::byte> block;
+	size_t used{};
+	std::vector<ArenaOverflow> overflow;
+	size_t overflow_size{};
+
+private:
+	auto do_allocate(size_t bytes, size_t alignment) -> void* override;
+	void do_deallocate(void* memory, size_t bytes, size_t alignment) override;
+	[[nodiscard]] auto do_is_equal(
+			const std::pmr::memory_resource& other) const noexcept -> bool override;
+};
+
+// Containers keep pointers to the arena, so it is not moved.
+auto create_frame_arena(size_t size) -> std::unique_ptr<FrameArena>;
+void destroy_frame_arena(FrameArena& arena);
+
+// Releases everything allocated since the last reset. Nothing allocated from
+// the arena may be used afterwards.
+void reset_frame_arena(FrameArena& arena);
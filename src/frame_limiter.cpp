@@ -0,0 +1,124 @@
+#include "frame_limiter.hpp"
+
+#include "instrument.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+// Older SDKs lack it, the flag is understood since Windows 10 1803.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Weight of a new overshoot in the smoothed spin time.
+constexpr auto g_smoothing = 8;
+
+// Wakes at until or later, as close to it as the platform's timers allow.
+void sleep_until(
+		[[maybe_unused]] const FrameLimiter& limiter,
+		Clock::time_point until) {
+#ifdef _WIN32
+	if (limiter.timer != nullptr) {
+		auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				until - Clock::now());
+		// Relative times are negative, in 100 ns units.
+		auto due = LARGE_INTEGER{};
+		due.QuadPart = -std::max(remaining.count() / 100, int64_t{1});
+		auto timer_set =
+				SetWaitableTimer(limiter.timer, &due, 0, nullptr, nullptr, FALSE);
+		if (timer_set != 0) {
+			WaitForSingleObject(limiter.timer, INFINITE);
+			return;
+		}
+	}
+	std::this_thread::sleep_until(until);
+#elif defined(__linux__)
+	// The steady clock is CLOCK_MONOTONIC, so the sleep can be absolute and
+	// does not add the time spent getting to it.
+	auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			until.time_since_epoch());
+	auto seconds =
+			std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+	auto time = timespec{
+			.tv_sec = static_cast<time_t>(seconds.count()),
+			.tv_nsec = static_cast<long>((since_epoch - seconds).count())};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) ==
+				 EINTR) {
+	}
+#else
+	std::this_thread::sleep_until(until);
+#endif
+}
+
+}  // namespace
+
+auto create_frame_limiter(size_t frame_rate) -> FrameLimiter {
+	auto limiter = FrameLimiter{};
+	if (frame_rate == 0) {
+		return limiter;
+	}
+	limiter.interval = std::chrono::nanoseconds(
+			std::chrono::nanoseconds(std::chrono::seconds(1)).count() /
+			static_cast<int64_t>(frame_rate));
+#ifdef _WIN32
+	// Without it the wait falls back to plain sleeps, which the spin then has
+	// to make up for.
+	limiter.timer = CreateWaitableTimerExW(
+			nullptr,
+			nullptr,
+			CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+			TIMER_ALL_ACCESS);
+#endif
+	return limiter;
+}
+
+void destroy_frame_limiter(FrameLimiter& limiter) {
+#ifdef _WIN32
+	if (limiter.timer != nullptr) {
+		CloseHandle(limiter.timer);
+	}
+#endif
+	limiter = FrameLimiter{};
+}
+
+void wait_for_frame_limit(FrameLimiter& limiter) {
+	VKDEMO_ZONE("wait_for_frame_limit");
+	if (limiter.interval.count() == 0) {
+		return;
+	}
+	auto now = Clock::now();
+	if (!limiter.deadline.has_value() ||
+			now > *limiter.deadline + limiter.interval * 2) {
+		limiter.deadline = now;
+		return;
+	}
+	auto deadline = *limiter.deadline + limiter.interval;
+	limiter.deadline = deadline;
+	auto wake = deadline - limiter.spin;
+	if (now < wake) {
+		sleep_until(limiter, wake);
+		// Twice the overshoot, so most sleeps still wake before the deadline.
+		auto overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				Clock::now() - wake);
+		limiter.spin = std::clamp(
+				limiter.spin + (overshoot * 2 - limiter.spin) / g_smoothing,
+				std::chrono::nanoseconds(g_min_limiter_spin),
+				std::chrono::nanoseconds(g_max_limiter_spin));
+	}
+	while (Clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
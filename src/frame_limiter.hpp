@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+// Spinning never covers less than this before a deadline, or more.
+constexpr auto g_min_limiter_spin = std::chrono::microseconds(200);
+constexpr auto g_max_limiter_spin = std::chrono::milliseconds(2);
+
+// Holds presents to a fixed rate below the display's. Each present waits for
+// its deadline, one interval after the previous one, so the rate does not
+// drift with how late the waits wake. Plain sleeps overshoot by up to a few
+// milliseconds, so the wait sleeps on a high resolution timer until shortly
+// before the deadline and spins the rest. How long it spins follows how far
+// the sleeps have been overshooting. A present that is late by a whole
+// interval restarts the deadlines from itself instead of hurrying to catch
+// up.
+struct FrameLimiter {
+	std::chrono::nanoseconds interval{};
+	std::optional<std::chrono::steady_clock::time_point> deadline;
+	// Smoothed, and clamped to the bounds above.
+	std::chrono::nanoseconds spin{g_max_limiter_spin};
+	// A high resolution waitable timer on Windows.
+	void* timer{};
+};
+
+// A zero rate gives a limiter that never waits.
+auto create_frame_limiter(size_t frame_rate) -> FrameLimiter;
+void destroy_frame_limiter(FrameLimiter& limiter);
+// Waits until the next present is due. Call right before presenting.
+void wait_for_frame_limit(FrameLimiter& limiter);
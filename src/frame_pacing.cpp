@@ -0,0 +1,100 @@
+#include "frame_pacing.hpp"
+
+#include "instrument.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Weight of a new sample in the smoothed refresh and work times.
+constexpr auto g_smoothing = 8;
+// Slack never drops below this, so scheduling noise alone does not make
+// frames miss.
+constexpr auto g_min_slack = std::chrono::nanoseconds(1'000'000);
+
+auto smooth(std::chrono::nanoseconds average, std::chrono::nanoseconds sample)
+		-> std::chrono::nanoseconds {
+	return average + (sample - average) / g_smoothing;
+}
+
+// Learns the refresh interval and adjusts slack from the time between two
+// presents reaching the display.
+void update_timing(FramePacer& pacer, std::chrono::nanoseconds shown_interval) {
+	if (pacer.refresh.count() == 0 || shown_interval * 4 < pacer.refresh * 3) {
+		pacer.refresh = shown_interval;
+		return;
+	}
+	auto refreshes = std::lround(
+			static_cast<double>(shown_interval.count()) /
+			static_cast<double>(pacer.refresh.count()));
+	if (refreshes <= 1) {
+		pacer.refresh = smooth(pacer.refresh, shown_interval);
+		pacer.slack =
+				std::max(pacer.slack - pacer.refresh / 1024, g_min_slack);
+	} else {
+		pacer.slack = std::min(pacer.slack + pacer.refresh / 4, pacer.refresh);
+	}
+}
+
+}  // namespace
+
+auto create_frame_pacer(bool enabled) -> FramePacer {
+	return FramePacer{
+			.enabled = enabled,
+			.present_id = 0,
+			.last_shown = std::nullopt,
+			.refresh = {},
+			.work = {},
+			.slack = g_min_slack,
+			.frame_start = Clock::now()};
+}
+
+void reset_frame_pacer(FramePacer& pacer) {
+	pacer.present_id = 0;
+	pacer.last_shown.reset();
+}
+
+void wait_for_frame_start(
+		VkDevice& device,
+		FramePacer& pacer,
+		VkSwapchainKHR swap_chain) {
+	VKDEMO_ZONE("wait_for_frame_start");
+	if (!pacer.enabled || pacer.present_id == 0) {
+		pacer.frame_start = Clock::now();
+		return;
+	}
+	auto timeout = std::chrono::nanoseconds(g_present_wait_timeout).count();
+	// Out of date swap chains and timeouts start unpaced, the swap chain is
+	// recreated after the present that reports it.
+	if (vkWaitForPresentKHR(
+					device,
+					swap_chain,
+					pacer.present_id,
+					static_cast<uint64_t>(timeout)) != VK_SUCCESS) {
+		pacer.last_shown.reset();
+		pacer.frame_start = Clock::now();
+		return;
+	}
+	auto shown = Clock::now();
+	if (pacer.last_shown.has_value()) {
+		update_timing(pacer, shown - *pacer.last_shown);
+	}
+	pacer.last_shown = shown;
+	if (pacer.refresh.count() != 0) {
+		std::this_thread::sleep_until(
+				shown + pacer.refresh - pacer.work - pacer.slack);
+	}
+	pacer.frame_start = Clock::now();
+}
+
+auto next_present_id(FramePacer& pacer) -> uint64_t {
+	if (!pacer.enabled) {
+		return 0;
+	}
+	pacer.work = smooth(pacer.work, Clock::now() - pacer.frame_start);
+	return ++pacer.present_id;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// How long a frame waits for the previous one to reach the display before
+// it starts unpaced.
+constexpr auto g_present_wait_timeout = std::chrono::milliseconds(100);
+
+// Starts frames late enough that they finish just before the vblank they are
+// shown at, using present wait to see when each present reaches the display.
+// Frames only start once the previous one is on screen, and input is sampled
+// at the start, so input reaches the display after about one frame of work
+// instead of after every frame queued in the swap chain.
+//
+// The refresh interval is learned from consecutive presents. A frame is
+// expected to take its CPU time up to the present plus slack, which stands
+// for the GPU and for jitter. Slack grows a quarter refresh whenever a frame
+// misses its vblank and shrinks slowly while frames make it.
+struct FramePacer {
+	bool enabled{};
+	// Id of the last present, zero before the first on the current swap chain.
+	uint64_t present_id{};
+	std::optional<std::chrono::steady_clock::time_point> last_shown;
+	// Zero until two presents were seen.
+	std::chrono::nanoseconds refresh{};
+	std::chrono::nanoseconds work{};
+	std::chrono::nanoseconds slack{};
+	std::chrono::steady_clock::time_point frame_start;
+};
+
+// Pacing needs the present_wait capability, a disabled pacer does nothing.
+auto create_frame_pacer(bool enabled) -> FramePacer;
+// Present ids count per swap chain, so this must follow every recreation.
+void reset_frame_pacer(FramePacer& pacer);
+// Waits for the last present to be shown, then until the next frame should
+// start. Call before sampling input.
+void wait_for_frame_start(
+		VkDevice& device,
+		FramePacer& pacer,
+		VkSwapchainKHR swap_chain);
+// The id for the VkPresentIdKHR of the present that ends the frame, zero
+// when pacing is disabled.
+auto next_present_id(FramePacer& pacer) -> uint64_t;
@@ -0,0 +1,51 @@
+#include "fullscreen.hpp"
+
+#include "host_memory.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <vulkan/vulkan_win32.h>
+#endif
+
+auto create_exclusive_swap_chain(
+		VkDevice device,
+		const VkSwapchainCreateInfoKHR& info,
+		VkSwapchainKHR& swap_chain) -> VkResult {
+#ifdef _WIN32
+	// The window is fullscreen on the primary monitor, so that is the one to
+	// take.
+	auto win32_info = VkSurfaceFullScreenExclusiveWin32InfoEXT{
+			.sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_WIN32_INFO_EXT,
+			.pNext = info.pNext,
+			.hmonitor = MonitorFromPoint(POINT{}, MONITOR_DEFAULTTOPRIMARY)};
+	auto exclusive_info = VkSurfaceFullScreenExclusiveInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_INFO_EXT,
+			.pNext = &win32_info,
+			.fullScreenExclusive =
+					VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT};
+	auto exclusive_swap_chain_info = info;
+	exclusive_swap_chain_info.pNext = &exclusive_info;
+	auto result = vkCreateSwapchainKHR(
+			device,
+			&exclusive_swap_chain_info,
+			host_callbacks(),
+			&swap_chain);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	// Swap chains are made rarely enough to resolve the entry point each time
+	// instead of adding it to the dispatch tables, which cannot name its type
+	// off Windows.
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	auto acquire = reinterpret_cast<PFN_vkAcquireFullScreenExclusiveModeEXT>(
+			vkGetDeviceProcAddr(device, "vkAcquireFullScreenExclusiveModeEXT"));
+	if (acquire != nullptr) {
+		acquire(device, swap_chain);
+	}
+	return VK_SUCCESS;
+#else
+	return vkCreateSwapchainKHR(device, &info, host_callbacks(), &swap_chain);
+#endif
+}
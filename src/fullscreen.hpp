@@ -0,0 +1,24 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+// VK_EXT_full_screen_exclusive, which only Windows has. Its header needs
+// windows.h, so only the name is given here and the structures stay in
+// src/fullscreen.cpp.
+constexpr auto g_full_screen_exclusive_extension =
+		"VK_EXT_full_screen_exclusive";
+
+// Creates a swap chain for a fullscreen window on the primary monitor, with
+// the application rather than the driver's heuristics deciding when it owns
+// the display, and takes the display so presents flip without going through
+// the desktop compositor. Where it cannot be taken, for example while the
+// window is not focused, the swap chain is composited until the next one is
+// made. Acquires and presents report
+// VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT once the display is lost,
+// after which the swap chain has to be made again. Needs the device to have
+// g_full_screen_exclusive_extension enabled. Off Windows the swap chain is
+// created as is.
+auto create_exclusive_swap_chain(
+		VkDevice device,
+		const VkSwapchainCreateInfoKHR& info,
+		VkSwapchainKHR& swap_chain) -> VkResult;
@@ -0,0 +1,242 @@
+#include "geometry_pool.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// The first page and one past the last page a range lies in.
+auto page_span(
+		const GeometryPool& pool,
+		VkDeviceSize offset,
+		VkDeviceSize size) -> std::pair<size_t, size_t> {
+	return {
+			static_cast<size_t>(offset / pool.page_size),
+			static_cast<size_t>(align_up(offset + size, pool.page_size) /
+													pool.page_size)};
+}
+
+void bind_page(GeometryPool& pool, size_t page, const Allocation& memory) {
+	pool.binds.emplace_back(VkSparseMemoryBind{
+			.resourceOffset = page * pool.page_size,
+			.size = pool.page_size,
+			.memory = memory.memory,
+			.memoryOffset = memory.offset,
+			.flags = 0});
+}
+
+}  // namespace
+
+auto create_geometry_pool(
+		VkDevice& device,
+		VkQueue queue,
+		VkDeviceSize size,
+		bool device_address) -> GeometryPool {
+	auto pool = GeometryPool{};
+	pool.queue = queue;
+	pool.buffer.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (device_address) {
+		pool.buffer.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	auto buffer_info = VkBufferCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_BUFFER_CREATE_SPARSE_BINDING_BIT |
+					VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT,
+			.size = size,
+			.usage = pool.buffer.usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = nullptr};
+	if (vkCreateBuffer(
+					device,
+					&buffer_info,
+					host_callbacks(),
+					&pool.buffer.handle) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create geometry pool buffer\n");
+		std::terminate();
+	}
+	// The alignment of a sparse buffer is its page size.
+	auto requirements = VkMemoryRequirements{};
+	vkGetBufferMemoryRequirements(device, pool.buffer.handle, &requirements);
+	pool.page_size = requirements.alignment;
+	pool.memory_type_bits = requirements.memoryTypeBits;
+	pool.buffer.size = align_up(size, pool.page_size);
+	pool.pages.resize(static_cast<size_t>(pool.buffer.size / pool.page_size));
+	pool.free_ranges.emplace(0, pool.buffer.size);
+	pool.timeline = create_queue_timeline(device, true);
+	return pool;
+}
+
+void destroy_geometry_pool(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool) {
+	vkDestroyBuffer(device, pool.buffer.handle, host_callbacks());
+	for (auto& page : pool.pages) {
+		if (page.memory.memory != VK_NULL_HANDLE) {
+			free_memory(device, allocator, page.memory);
+		}
+	}
+	for (auto& retired : pool.retired) {
+		free_memory(device, allocator, retired.memory);
+	}
+	destroy_queue_timeline(device, pool.timeline);
+	pool = GeometryPool{};
+}
+
+auto allocate_geometry(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool,
+		VkDeviceSize size) -> std::optional<VkDeviceSize> {
+	size = align_up(size, g_geometry_alignment);
+	// First fit keeps ranges packed towards the start, so pages towards the
+	// end stay unbound.
+	auto range = std::find_if(
+			pool.free_ranges.begin(),
+			pool.free_ranges.end(),
+			[&](const auto& free_range) { return free_range.second >= size; });
+	if (range == pool.free_ranges.end()) {
+		return std::nullopt;
+	}
+	auto offset = range->first;
+	auto remaining = range->second - size;
+	pool.free_ranges.erase(range);
+	if (remaining != 0) {
+		pool.free_ranges.emplace(offset + size, remaining);
+	}
+
+	auto [first, last] = page_span(pool, offset, size);
+	for (auto page_idx = first; page_idx < last; page_idx++) {
+		auto& page = pool.pages.at(page_idx);
+		if (page.ranges++ != 0 || page.memory.memory != VK_NULL_HANDLE) {
+			continue;
+		}
+		auto page_requirements = VkMemoryRequirements{
+				.size = pool.page_size,
+				.alignment = pool.page_size,
+				.memoryTypeBits = pool.memory_type_bits};
+		page.memory = allocate_memory(
+				device,
+				allocator,
+				page_requirements,
+				ResourceKind::linear,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0,
+				MemoryPriority::normal);
+		pool.committed += pool.page_size;
+		bind_page(pool, page_idx, page.memory);
+	}
+	return offset;
+}
+
+void free_geometry(GeometryPool& pool, VkDeviceSize offset, VkDeviceSize size) {
+	size = align_up(size, g_geometry_alignment);
+	auto [first, last] = page_span(pool, offset, size);
+	for (auto page_idx = first; page_idx < last; page_idx++) {
+		if (--pool.pages.at(page_idx).ranges == 0) {
+			pool.drained.emplace_back(page_idx);
+		}
+	}
+
+	auto next = pool.free_ranges.lower_bound(offset);
+	if (next != pool.free_ranges.end() && offset + size == next->first) {
+		size += next->second;
+		next = pool.free_ranges.erase(next);
+	}
+	if (next != pool.free_ranges.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			previous->second += size;
+			return;
+		}
+	}
+	pool.free_ranges.emplace(offset, size);
+}
+
+void flush_geometry_binds(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool,
+		Uploader& uploader) {
+	auto completed = uint64_t{};
+	vkGetSemaphoreCounterValue(device, pool.timeline.semaphore, &completed);
+	auto still_bound = std::remove_if(
+			pool.retired.begin(),
+			pool.retired.end(),
+			[&](RetiredGeometryPage& retired) {
+				if (retired.value > completed) {
+					return false;
+				}
+				free_memory(device, allocator, retired.memory);
+				return true;
+			});
+	pool.retired.erase(still_bound, pool.retired.end());
+
+	for (auto page_idx : pool.drained) {
+		auto& page = pool.pages.at(page_idx);
+		if (page.ranges != 0 || page.memory.memory == VK_NULL_HANDLE) {
+			continue;
+		}
+		bind_page(pool, page_idx, Allocation{});
+		pool.retired.emplace_back(RetiredGeometryPage{
+				.memory = page.memory,
+				.value = pool.timeline.value + 1});
+		pool.committed -= pool.page_size;
+		page.memory = Allocation{};
+	}
+	pool.drained.clear();
+	if (pool.binds.empty()) {
+		return;
+	}
+
+	auto buffer_bind = VkSparseBufferMemoryBindInfo{
+			.buffer = pool.buffer.handle,
+			.bindCount = static_cast<uint32_t>(pool.binds.size()),
+			.pBinds = pool.binds.data()};
+	auto value = ++pool.timeline.value;
+	auto timeline_info = VkTimelineSemaphoreSubmitInfo{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.waitSemaphoreValueCount = 0,
+			.pWaitSemaphoreValues = VK_NULL_HANDLE,
+			.signalSemaphoreValueCount = 1,
+			.pSignalSemaphoreValues = &value};
+	auto bind_info = VkBindSparseInfo{
+			.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO,
+			.pNext = &timeline_info,
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = VK_NULL_HANDLE,
+			.bufferBindCount = 1,
+			.pBufferBinds = &buffer_bind,
+			.imageOpaqueBindCount = 0,
+			.pImageOpaqueBinds = VK_NULL_HANDLE,
+			.imageBindCount = 0,
+			.pImageBinds = VK_NULL_HANDLE,
+			.signalSemaphoreCount = 1,
+			.pSignalSemaphores = &pool.timeline.semaphore};
+	if (vkQueueBindSparse(pool.queue, 1, &bind_info, VK_NULL_HANDLE) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to bind geometry pool pages\n");
+		std::terminate();
+	}
+	pool.binds.clear();
+	uploader.waits.emplace_back(SemaphoreOp{
+			.semaphore = pool.timeline.semaphore,
+			.value = value,
+			.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+}
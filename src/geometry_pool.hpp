@@ -0,0 +1,93 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+#include "sync.hpp"
+#include "upload.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+// Virtual size of the pool's buffer, of which only the pages some range lies
+// in are backed by memory.
+constexpr auto g_geometry_pool_size = VkDeviceSize{1} << 30U;
+// Ranges start at multiples of this, which every device takes as a storage
+// buffer offset, so compressed blobs can be expanded into a range directly.
+constexpr auto g_geometry_alignment = VkDeviceSize{256};
+
+// A page of the buffer and how many ranges lie in it, bound while its memory
+// is.
+struct GeometryPage {
+	Allocation memory;
+	uint32_t ranges{};
+};
+
+// The memory of a page unbound by the bind submission that signals value,
+// freed once it completed.
+struct RetiredGeometryPage {
+	Allocation memory;
+	uint64_t value{};
+};
+
+// One sparse vertex and index buffer shared by every mesh, whose pages are
+// bound to memory as meshes stream in and unbound as they are destroyed.
+// The buffer is never reallocated, so the device addresses of pulled meshes
+// and the bindings of baked draws stay valid while geometry memory follows
+// what is loaded. Binds are collected and go out together through
+// vkQueueBindSparse on the uploader's queue, and the next upload batch waits
+// on them, so a copy never lands on an unbound page. Requires the
+// sparseBinding and sparseResidencyBuffer features, a sparse binding upload
+// family and timeline semaphores.
+struct GeometryPool {
+	VkQueue queue{};
+	// Only handle, size and usage are set, the pages hold the memory.
+	Buffer buffer;
+	VkDeviceSize page_size{};
+	uint32_t memory_type_bits{};
+	// Free ranges by offset, each to its size, with neighbours merged.
+	std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+	std::vector<GeometryPage> pages;
+	// Pages whose last range was freed since the last flush. Binding a page
+	// again needs no unbind, so they are only unbound when they stay empty.
+	std::vector<size_t> drained;
+	std::vector<VkSparseMemoryBind> binds;
+	std::vector<RetiredGeometryPage> retired;
+	QueueTimeline timeline;
+	// Bytes of device memory the bound pages take.
+	VkDeviceSize committed{};
+};
+
+// queue must be the uploader's. device_address adds device address usage,
+// which requires a device_address allocator. size is rounded up to whole
+// pages and must not exceed sparseAddressSpaceSize.
+auto create_geometry_pool(
+		VkDevice& device,
+		VkQueue queue,
+		VkDeviceSize size,
+		bool device_address) -> GeometryPool;
+// The device must be idle.
+void destroy_geometry_pool(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool);
+
+// Reserves size bytes of the buffer and binds the pages they lie in at the
+// next flush. Returns nothing when no free range is large enough.
+auto allocate_geometry(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool,
+		VkDeviceSize size) -> std::optional<VkDeviceSize>;
+// The GPU must be done with the range, size is the one it was allocated with.
+void free_geometry(GeometryPool& pool, VkDeviceSize offset, VkDeviceSize size);
+
+// Submits the binds collected since the last flush and makes the next batch
+// of the uploader wait on them. Called before the uploader's batch is
+// submitted. Frees the memory of pages whose unbind has completed.
+void flush_geometry_binds(
+		VkDevice& device,
+		Allocator& allocator,
+		GeometryPool& pool,
+		Uploader& uploader);
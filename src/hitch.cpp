@@ -0,0 +1,219 @@
+#include "hitch.hpp"
+
+#include "jobs.hpp"
+#include "log.hpp"
+#include "queues.hpp"
+#include "trace.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace {
+
+// How far back the ring reaches, and the most events it keeps however busy
+// the frames are.
+constexpr auto g_hitch_window = std::chrono::seconds(5);
+constexpr auto g_max_hitch_events = size_t{1} << 18;
+// Events recorded in a frame before the next are dropped.
+constexpr auto g_hitch_frame_events = size_t{1} << 14;
+// Frames the median is taken over, and the fewest it needs.
+constexpr auto g_hitch_median_frames = size_t{240};
+constexpr auto g_min_hitch_median_frames = size_t{60};
+// Traces written per run at most, so a run that keeps hitching does not fill
+// the disk.
+constexpr auto g_max_hitch_dumps = size_t{16};
+
+// Zones on any thread push into the queue without taking a lock, and the
+// frame loop moves them into the window once a frame.
+struct HitchRing {
+	MpscQueue<HitchEvent, g_hitch_frame_events> recorded;
+	// Only touched by the frame loop.
+	std::deque<HitchEvent> events;
+	// Interns the names of GPU zones. Node based, so the views into the names
+	// stay valid.
+	std::mutex mutex;
+	std::set<std::string, std::less<>> names;
+};
+
+// Process wide like the zones feeding them.
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<bool> g_hitch_recording = false;
+HitchRing g_hitch_ring;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+void take_recorded_events() {
+	while (auto event = g_hitch_ring.recorded.try_pop()) {
+		if (g_hitch_ring.events.size() == g_max_hitch_events) {
+			g_hitch_ring.events.pop_front();
+		}
+		g_hitch_ring.events.emplace_back(*event);
+	}
+}
+
+void drop_old_events(std::chrono::steady_clock::time_point now) {
+	while (!g_hitch_ring.events.empty() &&
+			g_hitch_ring.events.front().end < now - g_hitch_window) {
+		g_hitch_ring.events.pop_front();
+	}
+}
+
+void write_hitch(HitchDetector& detector) {
+	take_recorded_events();
+	auto events = std::vector<TraceEvent>{};
+	events.reserve(g_hitch_ring.events.size() + 1);
+	for (const auto& event : g_hitch_ring.events) {
+		events.emplace_back(TraceEvent{
+				.name = std::string(event.name),
+				.begin = event.begin,
+				.end = event.end,
+				.thread = event.thread});
+	}
+	events.emplace_back(TraceEvent{
+			.name = std::string(detector.hitch.name),
+			.begin = detector.hitch.begin,
+			.end = detector.hitch.end,
+			.thread = detector.hitch.thread});
+	auto origin = detector.hitch.begin;
+	for (const auto& event : events) {
+		origin = std::min(origin, event.begin);
+	}
+	detector.dumps++;
+	auto path =
+			detector.directory / fmt::format("hitch-{}.json", detector.dumps);
+	write_trace_events(path, origin, events, "hitch");
+	auto duration = detector.hitch.end - detector.hitch.begin;
+	auto milliseconds =
+			std::chrono::duration<double, std::milli>(duration).count();
+	log_message(
+			LogLevel::warning,
+			"Frame took {:.2f} ms against a median of {:.2f} ms, wrote {}",
+			milliseconds,
+			detector.hitch_median,
+			path.string());
+}
+
+void add_frame(
+		HitchDetector& detector,
+		std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point end) {
+	auto milliseconds =
+			std::chrono::duration<double, std::milli>(end - begin).count();
+	if (detector.frame_times.size() >= g_min_hitch_median_frames &&
+			detector.countdown == 0 && detector.dumps < g_max_hitch_dumps) {
+		detector.sorted.assign(
+				detector.frame_times.begin(),
+				detector.frame_times.end());
+		auto middle = detector.sorted.begin() +
+				static_cast<std::ptrdiff_t>(detector.sorted.size() / 2);
+		std::nth_element(detector.sorted.begin(), middle, detector.sorted.end());
+		auto threshold =
+				*middle * static_cast<double>(detector.threshold_percent) / 100.0;
+		if (milliseconds >= threshold) {
+			detector.hitch = HitchEvent{
+					.name = "hitch",
+					.begin = begin,
+					.end = end,
+					.thread = current_job_thread()};
+			detector.hitch_median = *middle;
+			detector.countdown = detector.delay_frames + 1;
+			// Hitches stay out of the median, or a run of them would raise it.
+			return;
+		}
+	}
+	if (detector.frame_times.size() < g_hitch_median_frames) {
+		detector.frame_times.emplace_back(milliseconds);
+	} else {
+		detector.frame_times.at(detector.next) = milliseconds;
+	}
+	detector.next = (detector.next + 1) % g_hitch_median_frames;
+}
+
+}  // namespace
+
+auto hitch_recording() -> bool {
+	return g_hitch_recording.load(std::memory_order_relaxed);
+}
+
+void record_hitch_event(const HitchEvent& event) {
+	auto copy = event;
+	// A frame busy enough to fill the queue loses the rest of its events.
+	g_hitch_ring.recorded.try_push(std::move(copy));
+}
+
+void record_gpu_hitch_event(
+		std::string_view name,
+		std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point end) {
+	auto interned = std::string_view{};
+	{
+		auto lock = std::lock_guard(g_hitch_ring.mutex);
+		auto found = g_hitch_ring.names.find(name);
+		if (found == g_hitch_ring.names.end()) {
+			found = g_hitch_ring.names.emplace(name).first;
+		}
+		interned = *found;
+	}
+	record_hitch_event(HitchEvent{
+			.name = interned,
+			.begin = begin,
+			.end = end,
+			.thread = g_trace_gpu_thread});
+}
+
+HitchZone::HitchZone(std::string_view name) : name(name) {
+	if (hitch_recording()) {
+		begin = std::chrono::steady_clock::now();
+	}
+}
+
+HitchZone::~HitchZone() {
+	if (begin.has_value()) {
+		record_hitch_event(HitchEvent{
+				.name = name,
+				.begin = *begin,
+				.end = std::chrono::steady_clock::now(),
+				.thread = current_job_thread()});
+	}
+}
+
+auto create_hitch_detector(
+		size_t threshold_percent,
+		const std::filesystem::path& directory,
+		size_t delay_frames) -> HitchDetector {
+	auto detector = HitchDetector{};
+	detector.threshold_percent = threshold_percent;
+	detector.directory = directory;
+	detector.delay_frames = delay_frames;
+	detector.frame_times.reserve(g_hitch_median_frames);
+	if (threshold_percent != 0) {
+		g_hitch_recording.store(true, std::memory_order_relaxed);
+	}
+	return detector;
+}
+
+void end_hitch_frame(HitchDetector& detector) {
+	if (detector.threshold_percent == 0) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (detector.last_frame_end.has_value()) {
+		add_frame(detector, *detector.last_frame_end, now);
+	}
+	detector.last_frame_end = now;
+	if (detector.countdown != 0 && --detector.countdown == 0) {
+		write_hitch(detector);
+		// Writing the trace is no part of the next frame.
+		detector.last_frame_end = std::chrono::steady_clock::now();
+	}
+	take_recorded_events();
+	drop_old_events(now);
+}
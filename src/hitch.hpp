@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// The last few seconds of zones of every thread and of GPU passes, kept in
+// one process wide ring while hitch detection is on, so a frame that takes
+// far longer than usual can be written out along with what led up to it.
+// Zones are the VKDEMO_ZONE scopes of instrument.hpp, which include the
+// device memory allocations and pipeline compiles.
+struct HitchEvent {
+	// Zone names are literals, GPU pass names are interned by the ring.
+	std::string_view name;
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::steady_clock::time_point end;
+	// Job thread, or g_trace_gpu_thread.
+	size_t thread{};
+};
+
+// Whether events are kept, one relaxed load.
+auto hitch_recording() -> bool;
+void record_hitch_event(const HitchEvent& event);
+// A GPU pass, placed on the host clock.
+void record_gpu_hitch_event(
+		std::string_view name,
+		std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point end);
+
+// Times the rest of the enclosing scope into the ring while it is recording.
+struct HitchZone {
+	explicit HitchZone(std::string_view name);
+	HitchZone(const HitchZone&) = delete;
+	HitchZone(HitchZone&&) = delete;
+	auto operator=(const HitchZone&) -> HitchZone& = delete;
+	auto operator=(HitchZone&&) -> HitchZone& = delete;
+	~HitchZone();
+
+	std::string_view name;
+	std::optional<std::chrono::steady_clock::time_point> begin;
+};
+
+// Watches the frame times for hitches: frames taking threshold_percent of the
+// median of the recent frames or more. The ring is written out a few frames
+// after one, once the GPU passes of the frame were read back.
+struct HitchDetector {
+	size_t threshold_percent{};
+	std::filesystem::path directory;
+	size_t delay_frames{};
+	std::vector<double> frame_times;
+	size_t next{};
+	std::vector<double> sorted;
+	std::optional<std::chrono::steady_clock::time_point> last_frame_end;
+	// Frames left until the pending hitch is written, zero without one.
+	size_t countdown{};
+	HitchEvent hitch;
+	double hitch_median{};
+	size_t dumps{};
+};
+
+// Zero threshold_percent leaves detection and the ring off. Traces are
+// written to directory as hitch-N.json, in the Chrome trace event format.
+// delay_frames covers the frames in flight, for the GPU passes to arrive.
+auto create_hitch_detector(
+		size_t threshold_percent,
+		const std::filesystem::path& directory,
+		size_t delay_frames) -> HitchDetector;
+
+// Called once per frame, after it was presented, by the thread that created
+// the detector.
+void end_hitch_frame(HitchDetector& detector);
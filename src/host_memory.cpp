@@ -0,0 +1,240 @@
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace {
+
+HostAllocator* g_host_allocator = nullptr;
+
+// Written right before the pointer returned to the driver.
+struct HostBlockHeader {
+	uint64_t size;
+	// From the start of the block to the pointer returned.
+	uint32_t offset;
+	// g_host_pool_count for blocks from the heap.
+	uint16_t pool;
+	uint16_t scope;
+};
+static_assert(sizeof(HostBlockHeader) == 16);
+
+constexpr auto g_host_scope_names = std::array{
+		"command",
+		"object",
+		"cache",
+		"device",
+		"instance",
+};
+static_assert(g_host_scope_names.size() == g_host_scope_count);
+
+auto read_header(void* memory) -> HostBlockHeader {
+	auto header = HostBlockHeader{};
+	std::memcpy(
+			&header,
+			static_cast<std::byte*>(memory) - sizeof(header),
+			sizeof(header));
+	return header;
+}
+
+auto pool_allocate(HostPool& pool, size_t block_size) -> std::byte* {
+	auto lock = std::scoped_lock(pool.mutex);
+	if (pool.free != nullptr) {
+		auto* block = static_cast<std::byte*>(pool.free);
+		std::memcpy(&pool.free, block, sizeof(pool.free));
+		return block;
+	}
+	if (pool.chunk_used + block_size > g_host_chunk_size) {
+		auto* chunk = ::operator new(g_host_chunk_size, std::nothrow);
+		if (chunk == nullptr) {
+			return nullptr;
+		}
+		pool.chunks.push_back(static_cast<std::byte*>(chunk));
+		pool.chunk_used = 0;
+	}
+	auto* block = pool.chunks.back() + pool.chunk_used;
+	pool.chunk_used += block_size;
+	return block;
+}
+
+void pool_free(HostPool& pool, std::byte* block) {
+	auto lock = std::scoped_lock(pool.mutex);
+	std::memcpy(block, &pool.free, sizeof(pool.free));
+	pool.free = block;
+}
+
+void add_size(HostScopeStats& stats, size_t size) {
+	auto current = stats.size.fetch_add(size) + size;
+	auto peak = stats.peak_size.load();
+	while (peak < current &&
+			!stats.peak_size.compare_exchange_weak(peak, current)) {
+	}
+	stats.allocations++;
+}
+
+auto host_allocate(
+		HostAllocator& allocator,
+		size_t size,
+		size_t alignment,
+		VkSystemAllocationScope scope) -> void* {
+	// Blocks are 16-byte aligned, so the header always fits in front of an
+	// aligned pointer within the alignment's worth of padding.
+	alignment = std::max(alignment, sizeof(HostBlockHeader));
+	auto block_size = size + alignment;
+	auto pool = g_host_pool_count;
+	auto* block = static_cast<std::byte*>(nullptr);
+	if (block_size <= g_host_pool_max_size) {
+		pool = std::max(
+				static_cast<size_t>(std::bit_width(block_size - 1)),
+				size_t{g_host_pool_min_shift}) - g_host_pool_min_shift;
+		block = pool_allocate(
+				allocator.pools.at(pool),
+				size_t{1} << (pool + g_host_pool_min_shift));
+	} else {
+		block = static_cast<std::byte*>(::operator new(block_size, std::nothrow));
+	}
+	if (block == nullptr) {
+		return nullptr;
+	}
+
+	auto* memory = static_cast<void*>(block + sizeof(HostBlockHeader));
+	auto space = block_size - sizeof(HostBlockHeader);
+	std::align(alignment, size, memory, space);
+	auto* payload = static_cast<std::byte*>(memory);
+	auto header = HostBlockHeader{
+			.size = size,
+			.offset = static_cast<uint32_t>(payload - block),
+			.pool = static_cast<uint16_t>(pool),
+			.scope = static_cast<uint16_t>(scope)};
+	std::memcpy(payload - sizeof(header), &header, sizeof(header));
+	add_size(allocator.scopes.at(scope), size);
+	VKDEMO_ALLOC(payload, size, "vulkan host");
+	return payload;
+}
+
+void host_free(HostAllocator& allocator, void* memory) {
+	if (memory == nullptr) {
+		return;
+	}
+	VKDEMO_FREE(memory, "vulkan host");
+	auto header = read_header(memory);
+	allocator.scopes.at(header.scope).size -= header.size;
+	auto* block = static_cast<std::byte*>(memory) - header.offset;
+	if (header.pool == g_host_pool_count) {
+		::operator delete(block);
+	} else {
+		pool_free(allocator.pools.at(header.pool), block);
+	}
+}
+
+auto VKAPI_CALL allocation_callback(
+		void* user_data,
+		size_t size,
+		size_t alignment,
+		VkSystemAllocationScope scope) -> void* {
+	auto& allocator = *static_cast<HostAllocator*>(user_data);
+	return host_allocate(allocator, size, alignment, scope);
+}
+
+auto VKAPI_CALL reallocation_callback(
+		void* user_data,
+		void* original,
+		size_t size,
+		size_t alignment,
+		VkSystemAllocationScope scope) -> void* {
+	auto& allocator = *static_cast<HostAllocator*>(user_data);
+	if (original == nullptr) {
+		return host_allocate(allocator, size, alignment, scope);
+	}
+	if (size == 0) {
+		host_free(allocator, original);
+		return nullptr;
+	}
+	// The original stays valid when the new allocation fails.
+	auto* memory = host_allocate(allocator, size, alignment, scope);
+	if (memory != nullptr) {
+		auto header = read_header(original);
+		std::memcpy(memory, original, std::min(size, size_t{header.size}));
+		host_free(allocator, original);
+	}
+	return memory;
+}
+
+void VKAPI_CALL free_callback(void* user_data, void* memory) {
+	host_free(*static_cast<HostAllocator*>(user_data), memory);
+}
+
+void VKAPI_CALL internal_allocation_callback(
+		void* user_data,
+		size_t size,
+		VkInternalAllocationType /*type*/,
+		VkSystemAllocationScope scope) {
+	auto& allocator = *static_cast<HostAllocator*>(user_data);
+	allocator.scopes.at(scope).internal_size += size;
+}
+
+void VKAPI_CALL internal_free_callback(
+		void* user_data,
+		size_t size,
+		VkInternalAllocationType /*type*/,
+		VkSystemAllocationScope scope) {
+	auto& allocator = *static_cast<HostAllocator*>(user_data);
+	allocator.scopes.at(scope).internal_size -= size;
+}
+
+}  // namespace
+
+auto create_host_allocator() -> std::unique_ptr<HostAllocator> {
+	auto allocator = std::make_unique<HostAllocator>();
+	allocator->callbacks = VkAllocationCallbacks{
+			.pUserData = allocator.get(),
+			.pfnAllocation = allocation_callback,
+			.pfnReallocation = reallocation_callback,
+			.pfnFree = free_callback,
+			.pfnInternalAllocation = internal_allocation_callback,
+			.pfnInternalFree = internal_free_callback};
+	return allocator;
+}
+
+void destroy_host_allocator(HostAllocator& allocator) {
+	for (auto& pool : allocator.pools) {
+		for (auto* chunk : pool.chunks) {
+			::operator delete(chunk);
+		}
+		pool.chunks.clear();
+		pool.free = nullptr;
+		pool.chunk_used = g_host_chunk_size;
+	}
+}
+
+void install_host_allocator(HostAllocator* allocator) {
+	g_host_allocator = allocator;
+}
+
+auto host_callbacks() -> const VkAllocationCallbacks* {
+	if (g_host_allocator == nullptr) {
+		return nullptr;
+	}
+	return &g_host_allocator->callbacks;
+}
+
+void print_host_allocator_stats(const HostAllocator& allocator) {
+	for (auto i = size_t{0}; i < g_host_scope_count; i++) {
+		const auto& stats = allocator.scopes.at(i);
+		fmt::print(
+				stderr,
+				"Host memory {:<8} {:>9} bytes, peak {:>9}, {} allocations, "
+				"{} bytes internal\n",
+				g_host_scope_names.at(i),
+				stats.size.load(),
+				stats.peak_size.load(),
+				stats.allocations.load(),
+				stats.internal_size.load());
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "instrument.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Size classes are powers of two from 16 bytes, the smallest block that holds
+// an allocation's header, up to 4 KiB. Larger requests go to the heap.
+constexpr auto g_host_pool_min_shift = 4U;
+constexpr auto g_host_pool_count = size_t{9};
+constexpr auto g_host_pool_max_size = size_t{1}
+		<< (g_host_pool_min_shift + g_host_pool_count - 1);
+// Pools carve their blocks out of chunks this large.
+constexpr auto g_host_chunk_size = size_t{64} * 1024;
+// One entry per VkSystemAllocationScope.
+constexpr auto g_host_scope_count =
+		size_t{VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE} + 1;
+
+// Blocks of one size class. Freed blocks are kept on a free list, linked
+// through their first bytes, and never returned to the heap before the
+// allocator is destroyed.
+struct HostPool {
+	VKDEMO_LOCKABLE(std::mutex, mutex, "host pool");
+	void* free{};
+	std::vector<std::byte*> chunks;
+	// Bytes of the last chunk already handed out.
+	size_t chunk_used{g_host_chunk_size};
+};
+
+struct HostScopeStats {
+	// Bytes requested by live allocations.
+	std::atomic<size_t> size{};
+	std::atomic<size_t> peak_size{};
+	std::atomic<size_t> allocations{};
+	// Reported through the internal allocation notifications, for memory the
+	// driver allocates without the callbacks, such as executable code.
+	std::atomic<size_t> internal_size{};
+};
+
+// VkAllocationCallbacks serving the driver's host allocations from size-class
+// pools with a lock each, so driver threads compiling pipelines or recording
+// commands only contend when they allocate the same size, and tracking what
+// every allocation scope uses. Each block starts with a header recording its
+// size class and requested size, which reallocation and freeing need.
+struct HostAllocator {
+	std::array<HostPool, g_host_pool_count> pools;
+	std::array<HostScopeStats, g_host_scope_count> scopes;
+	VkAllocationCallbacks callbacks{};
+};
+
+// The callbacks point at the allocator, so it is not moved.
+auto create_host_allocator() -> std::unique_ptr<HostAllocator>;
+// Every object created with its callbacks must have been destroyed.
+void destroy_host_allocator(HostAllocator& allocator);
+
+// Makes host_callbacks return the allocator's callbacks, or null for the
+// driver's own allocator. Objects are destroyed with the callbacks they were
+// created with, so it is only changed while no instance exists.
+void install_host_allocator(HostAllocator* allocator);
+// The pAllocator of every object created and destroyed.
+auto host_callbacks() -> const VkAllocationCallbacks*;
+
+// Current and peak size of every scope, and how often it allocated.
+void print_host_allocator_stats(const HostAllocator& allocator);
@@ -0,0 +1,139 @@
+#include "huge_pages.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<bool> g_huge_pages = false;
+
+auto round_up(size_t size, size_t alignment) -> size_t {
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+#ifdef _WIN32
+auto allocate_pages(size_t size, bool huge) -> std::span<std::byte> {
+	auto large_page = GetLargePageMinimum();
+	if (huge && large_page != 0) {
+		auto large_size = round_up(size, large_page);
+		auto* memory = VirtualAlloc(
+				nullptr,
+				large_size,
+				MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
+				PAGE_READWRITE);
+		if (memory != nullptr) {
+			return {static_cast<std::byte*>(memory), large_size};
+		}
+	}
+	auto* memory =
+			VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (memory == nullptr) {
+		return {};
+	}
+	return {static_cast<std::byte*>(memory), size};
+}
+#else
+auto map_anonymous(size_t size, int flags) -> void* {
+	auto* memory = mmap(
+			nullptr,
+			size,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | flags,
+			-1,
+			0);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+	return memory == MAP_FAILED ? nullptr : memory;
+}
+
+auto allocate_pages(size_t size, bool huge) -> std::span<std::byte> {
+#ifndef __linux__
+	huge = false;
+#endif
+	if (!huge) {
+		auto* memory = map_anonymous(size, 0);
+		if (memory == nullptr) {
+			return {};
+		}
+		return {static_cast<std::byte*>(memory), size};
+	}
+#ifdef __linux__
+	auto huge_size = round_up(size, g_huge_page_size);
+	if (auto* memory = map_anonymous(huge_size, MAP_HUGETLB);
+			memory != nullptr) {
+		return {static_cast<std::byte*>(memory), huge_size};
+	}
+	// Transparent huge pages need the mapping aligned to them, so a huge page
+	// more is mapped and what lies outside the aligned block is unmapped.
+	auto* mapping =
+			static_cast<std::byte*>(map_anonymous(huge_size + g_huge_page_size, 0));
+	if (mapping == nullptr) {
+		return {};
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	auto address = reinterpret_cast<uintptr_t>(mapping);
+	auto head = round_up(address, g_huge_page_size) - address;
+	if (head != 0) {
+		munmap(mapping, head);
+	}
+	auto* block = mapping + head;
+	munmap(block + huge_size, g_huge_page_size - head);
+	madvise(block, huge_size, MADV_HUGEPAGE);
+	return {block, huge_size};
+#else
+	return {};
+#endif
+}
+#endif
+
+}  // namespace
+
+void enable_huge_pages(bool enabled) {
+	g_huge_pages.store(enabled, std::memory_order_relaxed);
+}
+
+auto allocate_huge_pages(size_t size) -> std::span<std::byte> {
+	if (size == 0) {
+		return {};
+	}
+	return allocate_pages(
+			size,
+			g_huge_pages.load(std::memory_order_relaxed) &&
+					size >= g_huge_page_size);
+}
+
+void free_huge_pages(std::span<std::byte> block) {
+	if (block.empty()) {
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(block.data(), 0, MEM_RELEASE);
+#else
+	munmap(block.data(), block.size());
+#endif
+}
+
+void advise_huge_pages(std::span<std::byte> bytes) {
+#ifdef __linux__
+	if (!g_huge_pages.load(std::memory_order_relaxed)) {
+		return;
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	auto address = reinterpret_cast<uintptr_t>(bytes.data());
+	auto begin = round_up(address, g_huge_page_size);
+	auto end = (address + bytes.size()) / g_huge_page_size * g_huge_page_size;
+	if (begin < end) {
+		madvise(bytes.data() + (begin - address), end - begin, MADV_HUGEPAGE);
+	}
+#else
+	static_cast<void>(bytes);
+#endif
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+// The huge page size of x86-64 and of most ARM64 kernels.
+constexpr auto g_huge_page_size = size_t{2} << 20U;
+
+// Large CPU working sets, the frame arena and the scene's arrays, can be
+// backed by 2 MiB pages, which cover their data with far fewer TLB entries
+// than 4 KiB ones. Linux takes explicit huge pages with MAP_HUGETLB where
+// some are reserved and transparent ones with MADV_HUGEPAGE otherwise.
+// Windows takes large pages where the process holds the lock memory
+// privilege. Without either the memory gets normal pages.
+//
+// Off until enabled, process wide. Enable before the first allocation.
+void enable_huge_pages(bool enabled);
+
+// Page aligned memory of at least size bytes, which free_huge_pages frees,
+// or empty when the system has none. With huge pages enabled, blocks of a
+// huge page or more are rounded up to whole huge pages and backed by them
+// where possible.
+auto allocate_huge_pages(size_t size) -> std::span<std::byte>;
+void free_huge_pages(std::span<std::byte> block);
+
+// Asks for transparent huge pages for the whole huge pages within bytes,
+// for heap memory such as a vector's, which the C library maps on its own
+// for allocations this large. Does nothing unless enabled, and outside of
+// Linux.
+void advise_huge_pages(std::span<std::byte> bytes);
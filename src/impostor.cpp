@@ -0,0 +1,595 @@
+#include "impostor.hpp"
+
+#include "host_memory.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+constexpr auto g_cache_magic = std::array{'V', 'K', 'I', 'M'};
+constexpr auto g_cache_version = uint32_t{1};
+constexpr auto g_fnv_offset_basis = uint64_t{14695981039346656037U};
+constexpr auto g_fnv_prime = uint64_t{1099511628211U};
+constexpr auto g_impostor_format = VK_FORMAT_R8G8B8A8_UNORM;
+constexpr auto g_atlas_texels =
+		size_t{g_impostor_atlas_size} * g_impostor_atlas_size;
+// Times the colors of covered texels are spread into the empty ones next to
+// them, so filtering at a silhouette does not blend in black.
+constexpr auto g_dilate_passes = 2U;
+
+// Layout matches the push_constant blocks of impostor.vert and impostor.frag.
+struct ImpostorConstants {
+	std::array<float, 4> bounding_sphere{};
+	std::array<float, 4> camera{};
+	BindlessHandle uniform_buffer{};
+	uint32_t transform{};
+	BindlessHandle atlas{};
+	BindlessHandle sampler{};
+};
+static_assert(sizeof(ImpostorConstants) == 48);
+
+// The texels follow. The sizes are there so changing them discards old
+// files.
+struct CacheHeader {
+	std::array<char, 4> magic{};
+	uint32_t version{};
+	uint32_t views{};
+	uint32_t tile_size{};
+	std::array<float, 4> bounding_sphere{};
+	uint64_t data_size{};
+	uint64_t checksum{};
+};
+
+// A view's colors, with where they came from: 0 for nothing, 1 for the mesh
+// and 2 for a dilation.
+struct ViewTile {
+	std::vector<float> depths;
+	std::vector<glm::vec3> colors;
+	std::vector<uint8_t> sources;
+};
+
+auto fnv1a(uint64_t hash, std::span<const std::byte> bytes) -> uint64_t {
+	for (auto byte : bytes) {
+		hash = (hash ^ std::to_integer<uint64_t>(byte)) * g_fnv_prime;
+	}
+	return hash;
+}
+
+auto create_layout(VkDevice& device, const BindlessTable& bindless)
+		-> VkPipelineLayout {
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			.offset = 0,
+			.size = sizeof(ImpostorConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	auto* layout = VkPipelineLayout{};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create impostor pipeline layout\n");
+		std::terminate();
+	}
+	return layout;
+}
+
+// The center of the positions' bounds and the farthest position from it.
+auto positions_sphere(std::span<const glm::vec3> positions) -> glm::vec4 {
+	if (positions.empty()) {
+		return {0.0F, 0.0F, 0.0F, 1.0F};
+	}
+	auto low = positions.front();
+	auto high = positions.front();
+	for (auto position : positions) {
+		low = glm::min(low, position);
+		high = glm::max(high, position);
+	}
+	auto center = (low + high) * 0.5F;
+	auto radius = 0.0F;
+	for (auto position : positions) {
+		radius = std::max(radius, glm::length(position - center));
+	}
+	return {center, std::max(radius, 1e-6F)};
+}
+
+// Matches octahedral_decode in impostor.vert: [0, 1] squared unfolded onto
+// the unit sphere, the +z half inside the diamond.
+auto octahedral_decode(glm::vec2 uv) -> glm::vec3 {
+	auto f = uv * 2.0F - 1.0F;
+	auto n = glm::vec3(f, 1.0F - std::abs(f.x) - std::abs(f.y));
+	if (n.z < 0.0F) {
+		n.x = (1.0F - std::abs(f.y)) * (f.x >= 0.0F ? 1.0F : -1.0F);
+		n.y = (1.0F - std::abs(f.x)) * (f.y >= 0.0F ? 1.0F : -1.0F);
+	}
+	return glm::normalize(n);
+}
+
+// Matches view_basis in impostor.vert: right and up of a view from
+// direction, which points from the mesh to the viewer.
+auto view_basis(glm::vec3 direction) -> std::pair<glm::vec3, glm::vec3> {
+	auto up = std::abs(direction.y) < 0.999F ? glm::vec3(0.0F, 1.0F, 0.0F)
+																					 : glm::vec3(0.0F, 0.0F, 1.0F);
+	auto right = glm::normalize(glm::cross(up, direction));
+	return {right, glm::cross(direction, right)};
+}
+
+auto edge(glm::vec3 a, glm::vec3 b, glm::vec2 p) -> float {
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// Draws the finest level of data into tile from direction, with depths
+// growing towards the viewer and both windings kept.
+void rasterize_view(
+		const MeshData& data,
+		glm::vec4 sphere,
+		glm::vec3 direction,
+		ViewTile& tile) {
+	constexpr auto size = static_cast<float>(g_impostor_tile_size);
+	auto [right, up] = view_basis(direction);
+	auto center = glm::vec3(sphere);
+	auto project = [&](uint32_t index) {
+		auto offset = data.positions.at(index) - center;
+		return glm::vec3(
+				(glm::dot(offset, right) / sphere.w * 0.5F + 0.5F) * size,
+				(0.5F - glm::dot(offset, up) / sphere.w * 0.5F) * size,
+				glm::dot(offset, direction));
+	};
+	auto color = [&](uint32_t index) {
+		return data.colors.size() == data.positions.size()
+				? data.colors.at(index)
+				: glm::vec3(1.0F);
+	};
+	auto index_count = data.lods.empty() ? data.indices.size()
+																			 : size_t{data.lods.front().index_count};
+	for (auto i = size_t{}; i + 2 < index_count; i += 3) {
+		auto indices = std::array{
+				data.indices.at(i),
+				data.indices.at(i + 1),
+				data.indices.at(i + 2)};
+		auto a = project(indices[0]);
+		auto b = project(indices[1]);
+		auto c = project(indices[2]);
+		auto area = edge(a, b, glm::vec2(c));
+		if (std::abs(area) < 1e-12F) {
+			continue;
+		}
+		auto low = glm::max(glm::floor(glm::min(glm::min(a, b), c)), 0.0F);
+		auto high = glm::min(glm::ceil(glm::max(glm::max(a, b), c)), size);
+		for (auto y = static_cast<uint32_t>(low.y);
+				 y < static_cast<uint32_t>(high.y);
+				 y++) {
+			for (auto x = static_cast<uint32_t>(low.x);
+					 x < static_cast<uint32_t>(high.x);
+					 x++) {
+				auto p = glm::vec2(static_cast<float>(x), static_cast<float>(y)) +
+						0.5F;
+				// Dividing by the signed area makes both windings positive
+				// inside.
+				auto weights = glm::vec3(edge(b, c, p), edge(c, a, p), edge(a, b, p)) /
+						area;
+				if (weights.x < 0.0F || weights.y < 0.0F || weights.z < 0.0F) {
+					continue;
+				}
+				auto texel = size_t{y} * g_impostor_tile_size + x;
+				auto depth = weights.x * a.z + weights.y * b.z + weights.z * c.z;
+				if (tile.sources[texel] != 0 && depth <= tile.depths[texel]) {
+					continue;
+				}
+				tile.depths[texel] = depth;
+				tile.colors[texel] = weights.x * color(indices[0]) +
+						weights.y * color(indices[1]) + weights.z * color(indices[2]);
+				tile.sources[texel] = 1;
+			}
+		}
+	}
+}
+
+// Gives the empty texels next to filled ones the average of their colors.
+void dilate(ViewTile& tile) {
+	constexpr auto size = static_cast<int32_t>(g_impostor_tile_size);
+	auto sources = tile.sources;
+	for (auto y = 0; y < size; y++) {
+		for (auto x = 0; x < size; x++) {
+			auto texel = static_cast<size_t>(y * size + x);
+			if (sources[texel] != 0) {
+				continue;
+			}
+			auto sum = glm::vec3(0.0F);
+			auto count = 0.0F;
+			for (auto [dx, dy] : std::array{
+							 std::pair{-1, 0},
+							 std::pair{1, 0},
+							 std::pair{0, -1},
+							 std::pair{0, 1}}) {
+				auto nx = x + dx;
+				auto ny = y + dy;
+				if (nx < 0 || ny < 0 || nx >= size || ny >= size) {
+					continue;
+				}
+				auto neighbor = static_cast<size_t>(ny * size + nx);
+				if (sources[neighbor] != 0) {
+					sum += tile.colors[neighbor];
+					count += 1.0F;
+				}
+			}
+			if (count > 0.0F) {
+				tile.colors[texel] = sum / count;
+				tile.sources[texel] = 2;
+			}
+		}
+	}
+}
+
+auto pack_color(glm::vec3 color, bool covered) -> uint32_t {
+	auto bytes = glm::uvec3(glm::round(glm::clamp(color, 0.0F, 1.0F) * 255.0F));
+	return bytes.x | (bytes.y << 8U) | (bytes.z << 16U) |
+			(covered ? 0xff000000U : 0U);
+}
+
+}  // namespace
+
+auto bake_impostor(const MeshData& data) -> ImpostorAtlas {
+	auto atlas = ImpostorAtlas{};
+	atlas.bounding_sphere = positions_sphere(data.positions);
+	atlas.texels.resize(g_atlas_texels);
+	constexpr auto tile_texels =
+			size_t{g_impostor_tile_size} * g_impostor_tile_size;
+	auto tile = ViewTile{};
+	for (auto view_y = 0U; view_y < g_impostor_views; view_y++) {
+		for (auto view_x = 0U; view_x < g_impostor_views; view_x++) {
+			tile.depths.assign(tile_texels, 0.0F);
+			tile.colors.assign(tile_texels, glm::vec3(0.0F));
+			tile.sources.assign(tile_texels, 0);
+			auto uv = (glm::vec2(
+										 static_cast<float>(view_x),
+										 static_cast<float>(view_y)) +
+								 0.5F) /
+					static_cast<float>(g_impostor_views);
+			rasterize_view(data, atlas.bounding_sphere, octahedral_decode(uv), tile);
+			for (auto pass = 0U; pass < g_dilate_passes; pass++) {
+				dilate(tile);
+			}
+			for (auto y = size_t{}; y < g_impostor_tile_size; y++) {
+				for (auto x = size_t{}; x < g_impostor_tile_size; x++) {
+					auto texel = y * g_impostor_tile_size + x;
+					auto row = view_y * g_impostor_tile_size + y;
+					auto column = view_x * g_impostor_tile_size + x;
+					atlas.texels[row * g_impostor_atlas_size + column] =
+							pack_color(tile.colors[texel], tile.sources[texel] == 1);
+				}
+			}
+		}
+	}
+	return atlas;
+}
+
+auto load_impostor(const std::filesystem::path& path)
+		-> std::optional<ImpostorAtlas> {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		return std::nullopt;
+	}
+	auto header = CacheHeader{};
+	if (file->bytes.size() >= sizeof(header)) {
+		std::memcpy(&header, file->bytes.data(), sizeof(header));
+	}
+	auto data = file->bytes.subspan(
+			std::min(file->bytes.size(), sizeof(header)));
+	constexpr auto data_size = g_atlas_texels * sizeof(uint32_t);
+	if (header.magic != g_cache_magic || header.version != g_cache_version ||
+			header.views != g_impostor_views ||
+			header.tile_size != g_impostor_tile_size ||
+			header.data_size != data_size || data.size() != data_size ||
+			header.checksum != fnv1a(g_fnv_offset_basis, data)) {
+		log_message(
+				LogLevel::info,
+				"Discarding stale impostor atlas {}",
+				path.string());
+		unmap_file(*file);
+		return std::nullopt;
+	}
+	auto atlas = ImpostorAtlas{};
+	atlas.bounding_sphere = glm::vec4(
+			header.bounding_sphere[0],
+			header.bounding_sphere[1],
+			header.bounding_sphere[2],
+			header.bounding_sphere[3]);
+	atlas.texels.resize(g_atlas_texels);
+	std::memcpy(atlas.texels.data(), data.data(), data_size);
+	unmap_file(*file);
+	return atlas;
+}
+
+auto save_impostor(
+		const std::filesystem::path& path,
+		const ImpostorAtlas& atlas) -> bool {
+	auto data = std::as_bytes(std::span(atlas.texels));
+	auto header = CacheHeader{
+			.magic = g_cache_magic,
+			.version = g_cache_version,
+			.views = g_impostor_views,
+			.tile_size = g_impostor_tile_size,
+			.bounding_sphere =
+					{atlas.bounding_sphere.x,
+					 atlas.bounding_sphere.y,
+					 atlas.bounding_sphere.z,
+					 atlas.bounding_sphere.w},
+			.data_size = data.size(),
+			.checksum = fnv1a(g_fnv_offset_basis, data)};
+
+	auto error = std::error_code{};
+	if (path.has_parent_path()) {
+		std::filesystem::create_directories(path.parent_path(), error);
+	}
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char*>(data.data()),
+				static_cast<std::streamsize>(data.size()));
+		if (!file) {
+			fmt::print(stderr, "Failed to write impostor atlas {}\n", path.string());
+			std::filesystem::remove(tmp_path, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		fmt::print(stderr, "Failed to write impostor atlas {}\n", path.string());
+		std::filesystem::remove(tmp_path, error);
+		return false;
+	}
+	return true;
+}
+
+auto impostor_cache_path(
+		const std::filesystem::path& cache_dir,
+		const MeshData& data) -> std::filesystem::path {
+	auto hash =
+			fnv1a(g_fnv_offset_basis, std::as_bytes(std::span(data.positions)));
+	hash = fnv1a(hash, std::as_bytes(std::span(data.colors)));
+	hash = fnv1a(hash, std::as_bytes(std::span(data.indices)));
+	hash = fnv1a(hash, std::as_bytes(std::span(data.lods)));
+	return cache_dir / fmt::format("impostor-{:016x}.cache", hash);
+}
+
+auto impostor_cooked_path(const std::filesystem::path& mesh)
+		-> std::filesystem::path {
+	auto path = mesh;
+	path += ".impostor";
+	return path;
+}
+
+auto create_impostor_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const ImpostorAtlas& atlas,
+		size_t frame_count,
+		uint32_t capacity) -> ImpostorRenderer {
+	auto impostors = ImpostorRenderer{};
+	impostors.draw_layout = create_layout(device, bindless);
+	impostors.bounding_sphere = atlas.bounding_sphere;
+	// Views are far smaller on screen than in the atlas, which has no levels
+	// to minify them with, so filtering is all they get.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	impostors.sampler = acquire_sampler(device, samplers, sampler_info);
+	impostors.sampler_handle =
+			add_bindless_sampler(device, bindless, impostors.sampler);
+
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_impostor_format,
+			.extent =
+					VkExtent3D{
+							.width = g_impostor_atlas_size,
+							.height = g_impostor_atlas_size,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	impostors.atlas = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = impostors.atlas.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = g_impostor_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(
+					device,
+					&view_info,
+					host_callbacks(),
+					&impostors.atlas_view) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create the impostor atlas view\n");
+		std::terminate();
+	}
+	impostors.atlas_handle = add_bindless_image(
+			device,
+			bindless,
+			impostors.atlas_view,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	upload_image(
+			device,
+			uploader,
+			impostors.atlas.handle,
+			VkImageSubresourceLayers{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1},
+			VkExtent3D{
+					.width = g_impostor_atlas_size,
+					.height = g_impostor_atlas_size,
+					.depth = 1},
+			std::as_bytes(std::span(atlas.texels)),
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	impostors.instances = create_instance_stream(
+			device,
+			allocator,
+			bindless,
+			frame_count,
+			capacity);
+	return impostors;
+}
+
+void destroy_impostor_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		ImpostorRenderer& impostors) {
+	destroy_instance_stream(device, allocator, bindless, impostors.instances);
+	remove_bindless_image(device, bindless, impostors.atlas_handle);
+	vkDestroyImageView(device, impostors.atlas_view, host_callbacks());
+	destroy_image(device, allocator, impostors.atlas);
+	remove_bindless_sampler(device, bindless, impostors.sampler_handle);
+	release_sampler(device, samplers, impostors.sampler);
+	vkDestroyPipelineLayout(device, impostors.draw_layout, host_callbacks());
+	impostors = ImpostorRenderer{};
+}
+
+auto impostor_distant(
+		const glm::mat4& transform,
+		glm::vec4 bounding_sphere,
+		float half_height,
+		float max_pixels) -> bool {
+	// Measured at the sphere's nearest point like select_mesh_lod.
+	auto rows = glm::transpose(transform);
+	auto center = glm::vec4(glm::vec3(bounding_sphere), 1.0F);
+	auto w = glm::dot(rows[3], center) -
+			bounding_sphere.w * glm::length(glm::vec3(rows[3]));
+	if (w <= 0.0F) {
+		return false;
+	}
+	auto scale = std::max(
+			glm::length(glm::vec3(rows[0])),
+			glm::length(glm::vec3(rows[1])));
+	return bounding_sphere.w * scale * half_height < max_pixels * w;
+}
+
+void draw_impostors(
+		VkCommandBuffer command_buffer,
+		const ImpostorRenderer& impostors,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		const glm::mat4& view_projection) {
+	auto count = impostors.instances.counts.at(frame_idx);
+	if (count == 0) {
+		return;
+	}
+	// The eye is what clip space has at w of 0 in front of the reversed
+	// depth's near plane, a direction towards it for parallel projections.
+	auto eye = glm::inverse(view_projection) * glm::vec4(0.0F, 0.0F, 1.0F, 0.0F);
+	auto camera = std::abs(eye.w) > 1e-6F
+			? glm::vec4(glm::vec3(eye) / eye.w, 1.0F)
+			: glm::vec4(glm::normalize(glm::vec3(eye)), 0.0F);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			impostors.draw_layout,
+			bindless);
+	const auto& sphere = impostors.bounding_sphere;
+	auto constants = ImpostorConstants{
+			.bounding_sphere = {sphere.x, sphere.y, sphere.z, sphere.w},
+			.camera = {camera.x, camera.y, camera.z, camera.w},
+			.uniform_buffer = uniform_buffer,
+			.transform = transform,
+			.atlas = impostors.atlas_handle,
+			.sampler = impostors.sampler_handle};
+	vkCmdPushConstants(
+			command_buffer,
+			impostors.draw_layout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+	auto offset = VkDeviceSize{};
+	vkCmdBindVertexBuffers(
+			command_buffer,
+			g_instance_binding,
+			1,
+			&impostors.instances.frames.at(frame_idx).handle,
+			&offset);
+	vkCmdDraw(command_buffer, g_impostor_vertices, count, 0, 0);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "instancing.hpp"
+#include "mesh.hpp"
+#include "object_cache.hpp"
+#include "pipeline.hpp"
+#include "upload.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Views in each direction of the octahedral map, and texels in each
+// direction of a view.
+constexpr auto g_impostor_views = 8U;
+constexpr auto g_impostor_tile_size = 64U;
+constexpr auto g_impostor_atlas_size = g_impostor_views * g_impostor_tile_size;
+constexpr auto g_impostor_vertices = 6U;
+
+// Every impostor is a quad of two triangles facing the camera.
+constexpr auto g_impostor_raster = RasterState{
+		.cull_mode = VK_CULL_MODE_NONE,
+		.front_face = VK_FRONT_FACE_CLOCKWISE,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+
+// A mesh seen from g_impostor_views squared directions, each drawn
+// orthographically over its bounding sphere into a tile of the atlas. Tile
+// (x, y) is seen from the direction the octahedral map of impostor.vert puts
+// at its center, and alpha is whether a texel was covered. Texels are RGBA8,
+// row-major, red in the low byte.
+struct ImpostorAtlas {
+	glm::vec4 bounding_sphere{};
+	std::vector<uint32_t> texels;
+};
+
+// Rasterizes the finest level of data on the CPU with its vertex colors,
+// unlit like shader.frag without clustered lights.
+auto bake_impostor(const MeshData& data) -> ImpostorAtlas;
+
+// Nothing when path holds no atlas of the current layout.
+auto load_impostor(const std::filesystem::path& path)
+		-> std::optional<ImpostorAtlas>;
+auto save_impostor(
+		const std::filesystem::path& path,
+		const ImpostorAtlas& atlas) -> bool;
+// Where the atlas of a mesh built at startup is cached, under a hash of its
+// data.
+auto impostor_cache_path(
+		const std::filesystem::path& cache_dir,
+		const MeshData& data) -> std::filesystem::path;
+// Where --cook-mesh bakes the atlas of a cooked mesh, which is never read
+// back on the CPU.
+auto impostor_cooked_path(const std::filesystem::path& mesh)
+		-> std::filesystem::path;
+
+// Octahedral impostors, after Ryan Brucks: distant instances of the mesh are
+// drawn as single quads textured with the atlas view nearest to the one the
+// camera has of them. The CPU sorts instances into the mesh's and the
+// impostors' instance streams after culling, so a frame draws each instance
+// once, and impostor.vert builds the quads from the instances' transforms.
+struct ImpostorRenderer {
+	// For the pipeline of impostor.vert and impostor.frag.
+	VkPipelineLayout draw_layout{};
+	Image atlas;
+	VkImageView atlas_view{};
+	BindlessHandle atlas_handle{};
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+	glm::vec4 bounding_sphere{};
+	InstanceStream instances;
+};
+
+// capacity is the largest count of instances a frame draws as impostors.
+auto create_impostor_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const ImpostorAtlas& atlas,
+		size_t frame_count,
+		uint32_t capacity) -> ImpostorRenderer;
+// The device must be idle.
+void destroy_impostor_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		ImpostorRenderer& impostors);
+
+// Whether a bounding sphere in the space transform takes to clip space has a
+// radius of fewer than max_pixels, with half_height the viewport's half
+// height in pixels. Spheres the camera is inside of are never distant.
+auto impostor_distant(
+		const glm::mat4& transform,
+		glm::vec4 bounding_sphere,
+		float half_height,
+		float max_pixels) -> bool;
+
+// Draws the frame's impostor instances. The bound pipeline must be one of
+// impostor.vert and impostor.frag with draw_layout and add_instance_input's
+// vertex input alone. transform is the uniform slot of view_projection, the
+// instances' space to clip space.
+void draw_impostors(
+		VkCommandBuffer command_buffer,
+		const ImpostorRenderer& impostors,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		const glm::mat4& view_projection);
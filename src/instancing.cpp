@@ -0,0 +1,103 @@
+#include "instancing.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+
+void add_instance_input(VertexInputDescription& description) {
+	description.bindings.emplace_back(VkVertexInputBindingDescription{
+			.binding = g_instance_binding,
+			.stride = sizeof(InstanceTransform),
+			.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE});
+	for (auto i = 0U; i < 3; i++) {
+		description.attributes.emplace_back(VkVertexInputAttributeDescription{
+				.location = g_instance_location + i,
+				.binding = g_instance_binding,
+				.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+				.offset = static_cast<uint32_t>(i * sizeof(glm::vec4))});
+	}
+}
+
+auto create_instance_stream(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		size_t frame_count,
+		uint32_t capacity) -> InstanceStream {
+	auto stream = InstanceStream{};
+	stream.capacity = capacity;
+	stream.counts.resize(frame_count);
+	auto size = VkDeviceSize{capacity} * sizeof(InstanceTransform);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& buffer = stream.frames.emplace_back(create_buffer(
+				device,
+				allocator,
+				size,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+						VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0));
+		stream.handles.emplace_back(
+				add_bindless_buffer(device, bindless, buffer.handle, 0, size));
+	}
+	return stream;
+}
+
+void destroy_instance_stream(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		InstanceStream& stream) {
+	for (auto i = size_t{}; i < stream.frames.size(); i++) {
+		remove_bindless_buffer(device, bindless, stream.handles.at(i));
+		destroy_buffer(device, allocator, stream.frames.at(i));
+	}
+	stream = InstanceStream{};
+}
+
+void draw_mesh_instanced(
+		VkCommandBuffer command_buffer,
+		const Mesh& mesh,
+		uint32_t lod,
+		const InstanceStream& stream,
+		size_t frame_idx) {
+	auto count = stream.counts.at(frame_idx);
+	if (count == 0) {
+		return;
+	}
+	bind_mesh(command_buffer, mesh);
+	auto offset = VkDeviceSize{};
+	vkCmdBindVertexBuffers(
+			command_buffer,
+			g_instance_binding,
+			1,
+			&stream.frames.at(frame_idx).handle,
+			&offset);
+	const auto& level = mesh.lods.at(lod);
+	vkCmdDrawIndexed(
+			command_buffer,
+			level.index_count,
+			count,
+			level.first_index,
+			0,
+			0);
+}
+
+auto instance_bounding_sphere(
+		const InstanceTransform& instance,
+		glm::vec4 bounding_sphere) -> glm::vec4 {
+	auto center = glm::vec4(glm::vec3(bounding_sphere), 1.0F);
+	const auto& rows = instance.rows;
+	// The longest column of the linear part bounds how far it stretches.
+	auto scale = std::max({
+			glm::length(glm::vec3(rows[0].x, rows[1].x, rows[2].x)),
+			glm::length(glm::vec3(rows[0].y, rows[1].y, rows[2].y)),
+			glm::length(glm::vec3(rows[0].z, rows[1].z, rows[2].z))});
+	return {
+			glm::dot(rows[0], center),
+			glm::dot(rows[1], center),
+			glm::dot(rows[2], center),
+			bounding_sphere.w * scale};
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "mesh.hpp"
+
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The instance stream binds after the mesh's vertex streams, its attributes
+// follow the per-vertex ones in shader.vert.
+constexpr auto g_instance_binding = g_max_vertex_streams;
+constexpr auto g_instance_location = g_vertex_attribute_count;
+
+// Per-instance data of an instanced draw. The rows of the affine transform
+// from the mesh's object space to the space of the draw's transform, read by
+// shader.vert as three vec4 attributes.
+struct InstanceTransform {
+	std::array<glm::vec4, 3> rows{};
+};
+
+static_assert(sizeof(InstanceTransform) == 48);
+
+// Appends the per-instance binding and attributes to a mesh's vertex input.
+void add_instance_input(VertexInputDescription& description);
+
+// One device local vertex buffer per frame in flight, which a compute pass
+// fills with the instances that survived culling, gathered from the ones
+// resident on the GPU through the frame's bindless storage buffer, see
+// src/resident_instances.hpp.
+struct InstanceStream {
+	std::vector<Buffer> frames;
+	std::vector<BindlessHandle> handles;
+	uint32_t capacity{};
+	// Instances gathered into each frame's buffer.
+	std::vector<uint32_t> counts;
+};
+
+auto create_instance_stream(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		size_t frame_count,
+		uint32_t capacity) -> InstanceStream;
+// The device must be idle.
+void destroy_instance_stream(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		InstanceStream& stream);
+
+// Draws every instance of the frame with one indexed draw. The bound pipeline
+// must have been created with the mesh's vertex layout and the instance input.
+void draw_mesh_instanced(
+		VkCommandBuffer command_buffer,
+		const Mesh& mesh,
+		uint32_t lod,
+		const InstanceStream& stream,
+		size_t frame_idx);
+
+// The bounding sphere of an instance of an object with the given one.
+auto instance_bounding_sphere(
+		const InstanceTransform& instance,
+		glm::vec4 bounding_sphere) -> glm::vec4;
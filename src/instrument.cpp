@@ -0,0 +1,90 @@
+#include "instrument.hpp"
+
+#ifdef VKDEMO_TRACY
+#include <tracy/TracyC.h>
+
+namespace {
+
+// Tracy's GpuContextType::Vulkan.
+constexpr auto g_tracy_vulkan_context = uint8_t{2};
+constexpr auto g_gpu_context_name = std::string_view{"GPU passes"};
+
+// The demo's only GPU context, so it takes the first id.
+constexpr auto g_gpu_context_id = uint8_t{0};
+// Tracy's GpuContextCalibration flag.
+constexpr auto g_tracy_calibrated_context = uint8_t{1};
+
+void create_context(uint64_t now, float period, uint8_t flags) {
+	___tracy_emit_gpu_new_context_serial(___tracy_gpu_new_context_data{
+			.gpuTime = static_cast<int64_t>(now),
+			.period = period,
+			.context = g_gpu_context_id,
+			.flags = flags,
+			.type = g_tracy_vulkan_context});
+	___tracy_emit_gpu_context_name_serial(___tracy_gpu_context_name_data{
+			.context = g_gpu_context_id,
+			.name = g_gpu_context_name.data(),
+			.len = static_cast<uint16_t>(g_gpu_context_name.size())});
+}
+
+}  // namespace
+
+void report_gpu_zone(
+		GpuZoneContext& context,
+		std::string_view name,
+		uint64_t begin,
+		uint64_t end,
+		float period) {
+	if (!context.created) {
+		create_context(begin, period, 0);
+		context.created = true;
+	}
+	// Zones are matched to their times by query ids, which only have to be
+	// unique among the zones in flight.
+	auto begin_query = context.next_query;
+	auto end_query = static_cast<uint16_t>(begin_query + 1);
+	context.next_query = static_cast<uint16_t>(begin_query + 2);
+	auto source = std::string_view{__FILE__};
+	auto function = std::string_view{__func__};
+	auto location = ___tracy_alloc_srcloc_name(
+			__LINE__,
+			source.data(),
+			source.size(),
+			function.data(),
+			function.size(),
+			name.data(),
+			name.size(),
+			0);
+	___tracy_emit_gpu_zone_begin_alloc_serial(___tracy_gpu_zone_begin_data{
+			.srcloc = location,
+			.queryId = begin_query,
+			.context = g_gpu_context_id});
+	___tracy_emit_gpu_zone_end_serial(___tracy_gpu_zone_end_data{
+			.queryId = end_query,
+			.context = g_gpu_context_id});
+	___tracy_emit_gpu_time_serial(___tracy_gpu_time_data{
+			.gpuTime = static_cast<int64_t>(begin),
+			.queryId = begin_query,
+			.context = g_gpu_context_id});
+	___tracy_emit_gpu_time_serial(___tracy_gpu_time_data{
+			.gpuTime = static_cast<int64_t>(end),
+			.queryId = end_query,
+			.context = g_gpu_context_id});
+}
+
+void calibrate_gpu_zones(GpuZoneContext& context, uint64_t now, float period) {
+	// The context and the calibrations take Tracy's CPU time as they are
+	// emitted, to pair with the timestamp.
+	auto cpu_time = tracy::Profiler::GetTime();
+	if (!context.created) {
+		create_context(now, period, g_tracy_calibrated_context);
+		context.created = true;
+	} else {
+		___tracy_emit_gpu_calibration_serial(___tracy_gpu_calibration_data{
+				.gpuTime = static_cast<int64_t>(now),
+				.cpuDelta = cpu_time - context.calibrated_at,
+				.context = g_gpu_context_id});
+	}
+	context.calibrated_at = cpu_time;
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "hitch.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+// Instrumentation for the Tracy profiler, which shows the zones of every
+// thread on one timeline next to the GPU passes. It is built in with the tracy
+// meson option; without it every macro expands to nothing and the GPU zone
+// reports are empty inlines. Zones also feed the ring of hitch.hpp, which
+// costs one relaxed load per zone while hitch detection is off.
+//
+// VKDEMO_ZONE(name) times the rest of the enclosing scope, name being a
+// string literal. VKDEMO_FRAME_MARK() ends a frame. VKDEMO_THREAD_NAME(name)
+// names the calling thread, copying name. VKDEMO_LOCKABLE(type, var, name)
+// declares a mutex whose waits and holds are tracked; it works with the
+// standard lock types. VKDEMO_ALLOC(ptr, size, pool) and VKDEMO_FREE(ptr,
+// pool) track the allocations of a named pool, pool being a string literal.
+#define VKDEMO_CONCAT_INNER(a, b) a##b
+#define VKDEMO_CONCAT(a, b) VKDEMO_CONCAT_INNER(a, b)
+#define VKDEMO_HITCH_ZONE(name) \
+	const auto VKDEMO_CONCAT(hitch_zone_, __LINE__) = HitchZone(name)
+
+#ifdef VKDEMO_TRACY
+#include <tracy/Tracy.hpp>
+
+#define VKDEMO_ZONE(name) \
+	ZoneScopedN(name);      \
+	VKDEMO_HITCH_ZONE(name)
+#define VKDEMO_FRAME_MARK() FrameMark
+#define VKDEMO_THREAD_NAME(name) tracy::SetThreadName(name)
+#define VKDEMO_LOCKABLE(type, var, name) TracyLockableN(type, var, name)
+#define VKDEMO_ALLOC(ptr, size, pool) TracyAllocN(ptr, size, pool)
+#define VKDEMO_FREE(ptr, pool) TracyFreeN(ptr, pool)
+#else
+#define VKDEMO_ZONE(name) VKDEMO_HITCH_ZONE(name)
+#define VKDEMO_FRAME_MARK()
+#define VKDEMO_THREAD_NAME(name)
+#define VKDEMO_LOCKABLE(type, var, name) type var
+#define VKDEMO_ALLOC(ptr, size, pool)
+#define VKDEMO_FREE(ptr, pool)
+#endif
+
+// A Tracy GPU context fed with timestamps read back by the GPU profiler.
+// Calibrations place its zones on the CPU timeline. Without them the context
+// starts at the first pass reported, so the GPU zones trail the CPU timeline
+// by the frames in flight it took to read it back.
+struct GpuZoneContext {
+	bool created{};
+	uint16_t next_query{};
+	// Tracy's CPU time at the last calibration.
+	int64_t calibrated_at{};
+};
+
+// Reports a pass that ran from begin to end, in timestamp ticks of period
+// nanoseconds.
+// Calibrations pass a timestamp sampled just before the call, the first one
+// before any zone is reported.
+#ifdef VKDEMO_TRACY
+void report_gpu_zone(
+		GpuZoneContext& context,
+		std::string_view name,
+		uint64_t begin,
+		uint64_t end,
+		float period);
+void calibrate_gpu_zones(GpuZoneContext& context, uint64_t now, float period);
+#else
+inline void report_gpu_zone(
+		GpuZoneContext& /*context*/,
+		std::string_view /*name*/,
+		uint64_t /*begin*/,
+		uint64_t /*end*/,
+		float /*period*/) {}
+inline void calibrate_gpu_zones(
+		GpuZoneContext& /*context*/,
+		uint64_t /*now*/,
+		float /*period*/) {}
+#endif
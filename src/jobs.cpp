@@ -0,0 +1,208 @@
+#include "jobs.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace {
+
+// Ranges per thread in parallel_for, so threads that finish early can steal.
+constexpr auto g_ranges_per_thread = size_t{4};
+
+thread_local auto t_job_thread = size_t{};
+// Set on the workers placed on efficiency cores.
+thread_local auto t_background_first = false;
+
+auto find_job(JobSystem& jobs) -> std::optional<Job> {
+	if (jobs.queued.load(std::memory_order_acquire) == 0) {
+		return std::nullopt;
+	}
+	auto self = t_job_thread;
+	auto job = std::optional<Job>{};
+	if (t_background_first) {
+		job = jobs.background->jobs.try_pop();
+	}
+	if (!job.has_value()) {
+		job = jobs.queues.at(self)->jobs.try_pop();
+	}
+	for (auto i = size_t{1}; !job.has_value() && i < jobs.queues.size(); i++) {
+		job = jobs.queues.at((self + i) % jobs.queues.size())->jobs.try_pop();
+	}
+	if (!job.has_value() && !t_background_first &&
+			(self != 0 || jobs.threads.empty())) {
+		job = jobs.background->jobs.try_pop();
+	}
+	if (job.has_value()) {
+		jobs.queued.fetch_sub(1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+void run_job(Job& job) {
+	VKDEMO_ZONE("job");
+	job.run();
+	job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void push_job(
+		JobSystem& jobs,
+		JobQueue& queue,
+		JobCounter& counter,
+		std::function<void()> run) {
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+	auto job = Job{.run = std::move(run), .counter = &counter};
+	while (!queue.jobs.try_push(std::move(job))) {
+		// Running a queued job frees a cell, or lets a worker free one.
+		if (auto other = find_job(jobs); other.has_value()) {
+			run_job(*other);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	jobs.queued.fetch_add(1, std::memory_order_release);
+	// Taking the lock orders the increment against a worker that is about to
+	// sleep, so the notification cannot be lost.
+	{
+		auto lock = std::scoped_lock(jobs.sleep_mutex);
+	}
+	jobs.wake.notify_one();
+}
+
+void worker_main(JobSystem& jobs, size_t thread_idx, bool background_first) {
+	t_job_thread = thread_idx;
+	t_background_first = background_first;
+	VKDEMO_THREAD_NAME(fmt::format("job {}", thread_idx).c_str());
+	while (true) {
+		if (auto job = find_job(jobs); job.has_value()) {
+			run_job(*job);
+			continue;
+		}
+		auto lock = std::unique_lock(jobs.sleep_mutex);
+		jobs.wake.wait(lock, [&] {
+			return jobs.stopping.load() || jobs.queued.load() != 0;
+		});
+		if (jobs.stopping.load()) {
+			return;
+		}
+	}
+}
+
+}  // namespace
+
+auto create_job_system(
+		size_t thread_count,
+		ThreadPlacement placement,
+		const CoreTopology& topology) -> std::unique_ptr<JobSystem> {
+	auto core_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	if (thread_count == 0) {
+		thread_count = core_count;
+	}
+	auto jobs = std::make_unique<JobSystem>();
+	jobs->queues.reserve(thread_count);
+	for (auto i = size_t{}; i < thread_count; i++) {
+		jobs->queues.emplace_back(std::make_unique<JobQueue>());
+	}
+	jobs->background = std::make_unique<JobQueue>();
+	t_job_thread = 0;
+	VKDEMO_THREAD_NAME("main");
+	// The last workers go to the efficiency cores, one per core at most.
+	auto efficiency_workers = placement == ThreadPlacement::core_types
+			? std::min(topology.efficiency.size(), thread_count - 1)
+			: 0;
+	auto first_efficiency_worker = thread_count - efficiency_workers;
+	if (placement == ThreadPlacement::core_types) {
+		set_current_thread_cores(topology.performance);
+	}
+	jobs->threads.reserve(thread_count - 1);
+	for (auto i = size_t{1}; i < thread_count; i++) {
+		auto efficiency = i >= first_efficiency_worker;
+		auto& thread = jobs->threads.emplace_back(
+				worker_main,
+				std::ref(*jobs),
+				i,
+				efficiency);
+		if (placement == ThreadPlacement::pinned) {
+			auto core = i % core_count;
+			set_thread_cores(thread, std::span(&core, 1));
+		} else if (placement == ThreadPlacement::core_types) {
+			set_thread_cores(
+					thread,
+					efficiency ? topology.efficiency : topology.performance);
+		}
+	}
+	return jobs;
+}
+
+void destroy_job_system(JobSystem& jobs) {
+	{
+		auto lock = std::scoped_lock(jobs.sleep_mutex);
+		jobs.stopping = true;
+	}
+	jobs.wake.notify_all();
+	for (auto& thread : jobs.threads) {
+		thread.join();
+	}
+	jobs.threads.clear();
+	jobs.queues.clear();
+	jobs.background.reset();
+}
+
+auto job_thread_count(const JobSystem& jobs) -> size_t {
+	return jobs.queues.size();
+}
+
+auto current_job_thread() -> size_t {
+	return t_job_thread;
+}
+
+void submit_job(
+		JobSystem& jobs,
+		JobCounter& counter,
+		std::function<void()> run) {
+	push_job(jobs, *jobs.queues.at(t_job_thread), counter, std::move(run));
+}
+
+void submit_background_job(
+		JobSystem& jobs,
+		JobCounter& counter,
+		std::function<void()> run) {
+	push_job(jobs, *jobs.background, counter, std::move(run));
+}
+
+void wait_for_counter(JobSystem& jobs, JobCounter& counter) {
+	while (counter.pending.load(std::memory_order_acquire) != 0) {
+		if (auto job = find_job(jobs); job.has_value()) {
+			run_job(*job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void parallel_for(
+		JobSystem& jobs,
+		size_t count,
+		size_t grain,
+		const std::function<void(size_t begin, size_t end)>& run) {
+	if (count == 0) {
+		return;
+	}
+	auto range_count = job_thread_count(jobs) * g_ranges_per_thread;
+	auto range_size = std::max(
+			std::max<size_t>(grain, 1),
+			(count + range_count - 1) / range_count);
+	// A single range is not worth a round trip through the queues.
+	if (range_size >= count) {
+		run(0, count);
+		return;
+	}
+	auto counter = JobCounter{};
+	for (auto begin = size_t{}; begin < count; begin += range_size) {
+		auto end = std::min(begin + range_size, count);
+		submit_job(jobs, counter, [&run, begin, end] { run(begin, end); });
+	}
+	wait_for_counter(jobs, counter);
+}
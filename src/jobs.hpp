@@ -0,0 +1,88 @@
+#pragma once
+
+#include "instrument.hpp"
+#include "queues.hpp"
+#include "thread_placement.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the jobs submitted against it that have not finished yet. A job that
+// depends on others waits on their counter, which keeps its thread busy
+// running other jobs in the meantime.
+struct JobCounter {
+	std::atomic<size_t> pending{};
+};
+
+struct Job {
+	std::function<void()> run;
+	JobCounter* counter{};
+};
+
+// Jobs a thread can have queued before submitting runs others to make room.
+constexpr auto g_job_queue_capacity = size_t{4096};
+
+// Owners push, owners and thieves alike pop the oldest job, which is usually
+// the largest. Lock-free, so submitting never waits on a thief.
+struct JobQueue {
+	MpmcQueue<Job, g_job_queue_capacity> jobs;
+};
+
+// Work stealing scheduler shared by the whole engine. Thread 0 is the thread
+// that created the system; it runs jobs only while waiting on a counter. Only
+// that thread and the workers may submit jobs or wait.
+//
+// Background jobs, such as pipeline compiles and asset loads, share a queue
+// of their own. Workers on efficiency cores take from it first, the others
+// once they found no other job. Thread 0 leaves them to the workers, so it
+// does not start a long compile while the frame waits on it, unless it has
+// no workers.
+struct JobSystem {
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<JobQueue>> queues;
+	std::unique_ptr<JobQueue> background;
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<size_t> queued{};
+	std::atomic<bool> stopping{};
+};
+
+// thread_count includes the calling thread. Zero picks one thread per core.
+// With core types placement the calling thread is kept on the performance
+// cores of topology.
+auto create_job_system(
+		size_t thread_count,
+		ThreadPlacement placement,
+		const CoreTopology& topology) -> std::unique_ptr<JobSystem>;
+// Every submitted job must have finished.
+void destroy_job_system(JobSystem& jobs);
+
+auto job_thread_count(const JobSystem& jobs) -> size_t;
+// Index of the calling thread, usable to pick per thread resources.
+auto current_job_thread() -> size_t;
+
+void submit_job(
+		JobSystem& jobs,
+		JobCounter& counter,
+		std::function<void()> run);
+// A job that no frame waits on.
+void submit_background_job(
+		JobSystem& jobs,
+		JobCounter& counter,
+		std::function<void()> run);
+// Runs queued jobs until every job submitted against counter has finished.
+void wait_for_counter(JobSystem& jobs, JobCounter& counter);
+
+// Splits [0, count) into ranges of at least grain items, runs them as jobs and
+// waits for all of them.
+void parallel_for(
+		JobSystem& jobs,
+		size_t count,
+		size_t grain,
+		const std::function<void(size_t begin, size_t end)>& run);
@@ -0,0 +1,227 @@
+#include "json.hpp"
+
+#include <fmt/core.h>
+
+#include <charconv>
+#include <cstdio>
+#include <system_error>
+
+namespace {
+
+// Deeper documents are rejected instead of overflowing the stack.
+constexpr auto g_max_json_depth = 64;
+
+struct JsonParser {
+	std::string_view text;
+	size_t offset{};
+	bool failed{};
+};
+
+void fail(JsonParser& parser, std::string_view message) {
+	if (!parser.failed) {
+		fmt::print(
+				stderr,
+				"Malformed JSON at offset {}: {}\n",
+				parser.offset,
+				message);
+	}
+	parser.failed = true;
+}
+
+void skip_whitespace(JsonParser& parser) {
+	while (parser.offset < parser.text.size()) {
+		auto c = parser.text[parser.offset];
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+			break;
+		}
+		parser.offset++;
+	}
+}
+
+auto consume(JsonParser& parser, char expected) -> bool {
+	skip_whitespace(parser);
+	if (parser.offset < parser.text.size() &&
+			parser.text[parser.offset] == expected) {
+		parser.offset++;
+		return true;
+	}
+	return false;
+}
+
+auto consume_word(JsonParser& parser, std::string_view word) -> bool {
+	if (parser.text.substr(parser.offset, word.size()) == word) {
+		parser.offset += word.size();
+		return true;
+	}
+	return false;
+}
+
+// Code points from \u escapes are stored as UTF-8. Surrogate pairs are not
+// combined, the demo never writes any.
+void append_utf8(std::string& out, uint32_t code_point) {
+	if (code_point < 0x80) {
+		out += static_cast<char>(code_point);
+	} else if (code_point < 0x800) {
+		out += static_cast<char>(0xc0 | (code_point >> 6U));
+		out += static_cast<char>(0x80 | (code_point & 0x3fU));
+	} else {
+		out += static_cast<char>(0xe0 | (code_point >> 12U));
+		out += static_cast<char>(0x80 | ((code_point >> 6U) & 0x3fU));
+		out += static_cast<char>(0x80 | (code_point & 0x3fU));
+	}
+}
+
+auto parse_string(JsonParser& parser) -> std::string {
+	auto out = std::string{};
+	if (!consume(parser, '"')) {
+		fail(parser, "expected a string");
+		return out;
+	}
+	while (parser.offset < parser.text.size()) {
+		auto c = parser.text[parser.offset++];
+		if (c == '"') {
+			return out;
+		}
+		if (c != '\\') {
+			out += c;
+			continue;
+		}
+		if (parser.offset >= parser.text.size()) {
+			break;
+		}
+		auto escape = parser.text[parser.offset++];
+		switch (escape) {
+			case 'b':
+				out += '\b';
+				break;
+			case 'f':
+				out += '\f';
+				break;
+			case 'n':
+				out += '\n';
+				break;
+			case 'r':
+				out += '\r';
+				break;
+			case 't':
+				out += '\t';
+				break;
+			case 'u': {
+				auto code_point = uint32_t{};
+				auto digits = parser.text.substr(parser.offset, 4);
+				auto [end, error] = std::from_chars(
+						digits.data(),
+						digits.data() + digits.size(),
+						code_point,
+						16);
+				if (error != std::errc{} || end != digits.data() + 4) {
+					fail(parser, "invalid unicode escape");
+					return out;
+				}
+				parser.offset += 4;
+				append_utf8(out, code_point);
+				break;
+			}
+			default:
+				out += escape;
+				break;
+		}
+	}
+	fail(parser, "unterminated string");
+	return out;
+}
+
+auto parse_value(JsonParser& parser, int depth) -> JsonValue {
+	auto value = JsonValue{};
+	if (depth > g_max_json_depth) {
+		fail(parser, "nested too deeply");
+		return value;
+	}
+	skip_whitespace(parser);
+	if (parser.offset >= parser.text.size()) {
+		fail(parser, "expected a value");
+		return value;
+	}
+	auto c = parser.text[parser.offset];
+	if (c == '{') {
+		parser.offset++;
+		value.kind = JsonValue::Kind::object;
+		if (consume(parser, '}')) {
+			return value;
+		}
+		do {
+			value.names.emplace_back(parse_string(parser));
+			if (!consume(parser, ':')) {
+				fail(parser, "expected ':'");
+				return value;
+			}
+			value.elements.emplace_back(parse_value(parser, depth + 1));
+		} while (!parser.failed && consume(parser, ','));
+		if (!consume(parser, '}')) {
+			fail(parser, "expected '}'");
+		}
+	} else if (c == '[') {
+		parser.offset++;
+		value.kind = JsonValue::Kind::array;
+		if (consume(parser, ']')) {
+			return value;
+		}
+		do {
+			value.elements.emplace_back(parse_value(parser, depth + 1));
+		} while (!parser.failed && consume(parser, ','));
+		if (!consume(parser, ']')) {
+			fail(parser, "expected ']'");
+		}
+	} else if (c == '"') {
+		value.kind = JsonValue::Kind::string;
+		value.string = parse_string(parser);
+	} else if (consume_word(parser, "true")) {
+		value.kind = JsonValue::Kind::boolean;
+		value.boolean = true;
+	} else if (consume_word(parser, "false")) {
+		value.kind = JsonValue::Kind::boolean;
+	} else if (consume_word(parser, "null")) {
+		value.kind = JsonValue::Kind::null;
+	} else {
+		value.kind = JsonValue::Kind::number;
+		auto rest = parser.text.substr(parser.offset);
+		auto [end, error] = std::from_chars(
+				rest.data(),
+				rest.data() + rest.size(),
+				value.number);
+		if (error != std::errc{}) {
+			fail(parser, "expected a value");
+			return value;
+		}
+		parser.offset += static_cast<size_t>(end - rest.data());
+	}
+	return value;
+}
+
+}  // namespace
+
+auto parse_json(std::string_view text) -> std::optional<JsonValue> {
+	auto parser = JsonParser{.text = text};
+	auto value = parse_value(parser, 0);
+	skip_whitespace(parser);
+	if (!parser.failed && parser.offset != text.size()) {
+		fail(parser, "trailing characters");
+	}
+	if (parser.failed) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+auto json_member(const JsonValue& value, std::string_view name)
+		-> const JsonValue* {
+	if (value.kind != JsonValue::Kind::object) {
+		return nullptr;
+	}
+	for (auto i = size_t{}; i < value.names.size(); i++) {
+		if (value.names.at(i) == name) {
+			return &value.elements.at(i);
+		}
+	}
+	return nullptr;
+}
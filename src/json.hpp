@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Quotes a string for a JSON document. Names only ever come from the engine
+// and the driver, so escaping quotes and backslashes is all they need.
+inline auto json_string(std::string_view value) -> std::string {
+	auto escaped = std::string{"\""};
+	for (auto c : value) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	escaped += '"';
+	return escaped;
+}
+
+// A parsed JSON document, for reading back the reports the demo writes.
+struct JsonValue {
+	enum class Kind : uint8_t {
+		null,
+		boolean,
+		number,
+		string,
+		array,
+		object,
+	};
+	Kind kind{};
+	bool boolean{};
+	double number{};
+	std::string string;
+	// The elements of an array, or the values of an object's members.
+	std::vector<JsonValue> elements;
+	// The names of an object's members, in the order of elements.
+	std::vector<std::string> names;
+};
+
+// Returns nothing for malformed documents, after printing where they went
+// wrong.
+auto parse_json(std::string_view text) -> std::optional<JsonValue>;
+// An object's member, null unless value is an object that has it.
+auto json_member(const JsonValue& value, std::string_view name)
+		-> const JsonValue*;
@@ -0,0 +1,278 @@
+#include "light_clusters.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant block in light_cluster.comp.
+struct LightClusterHandles {
+	BindlessHandle lights{};
+	BindlessHandle grid{};
+};
+
+// A float in [0, 1) from the bits of seed, the same on every run.
+auto hash_unit(uint32_t seed) -> float {
+	seed ^= seed >> 16U;
+	seed *= 0x7feb352dU;
+	seed ^= seed >> 15U;
+	seed *= 0x846ca68bU;
+	seed ^= seed >> 16U;
+	return static_cast<float>(seed >> 8U) / static_cast<float>(1U << 24U);
+}
+
+}  // namespace
+
+auto create_light_clusters(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t light_capacity,
+		uint32_t decal_capacity) -> LightClusters {
+	auto clusters = LightClusters{};
+	clusters.light_capacity = light_capacity;
+	clusters.decal_capacity = decal_capacity;
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(LightClusterHandles)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&clusters.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create light cluster pipeline layout\n");
+		std::terminate();
+	}
+	clusters.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			clusters.pipeline_layout,
+			module,
+			specialization,
+			0);
+
+	// Lights are read in place like the uniform ring, the grid never leaves
+	// the device.
+	auto lights_size = VkDeviceSize{sizeof(LightClusterView)} +
+			VkDeviceSize{sizeof(Light)} * light_capacity;
+	auto decals_size = VkDeviceSize{sizeof(Decal)} * decal_capacity;
+	auto grid_size = VkDeviceSize{sizeof(uint32_t)} * g_light_cluster_count *
+			(2 + g_max_cluster_lights + g_max_cluster_decals);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = clusters.frames.emplace_back();
+		frame.lights = create_dynamic_buffer(
+				device,
+				allocator,
+				lights_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.lights_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.lights.handle,
+				0,
+				lights_size);
+		frame.grid = create_buffer(
+				device,
+				allocator,
+				grid_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0);
+		frame.grid_handle =
+				add_bindless_buffer(device, bindless, frame.grid.handle, 0, grid_size);
+		if (decal_capacity == 0) {
+			continue;
+		}
+		frame.decals = create_dynamic_buffer(
+				device,
+				allocator,
+				decals_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.decals_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.decals.handle,
+				0,
+				decals_size);
+	}
+	return clusters;
+}
+
+void destroy_light_clusters(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		LightClusters& clusters) {
+	for (auto& frame : clusters.frames) {
+		remove_bindless_buffer(device, bindless, frame.lights_handle);
+		remove_bindless_buffer(device, bindless, frame.grid_handle);
+		destroy_buffer(device, allocator, frame.lights);
+		destroy_buffer(device, allocator, frame.grid);
+		if (clusters.decal_capacity != 0) {
+			remove_bindless_buffer(device, bindless, frame.decals_handle);
+			destroy_buffer(device, allocator, frame.decals);
+		}
+	}
+	vkDestroyPipeline(device, clusters.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, clusters.pipeline_layout, host_callbacks());
+	clusters = LightClusters{};
+}
+
+void build_light_clusters(
+		const LightClusters& clusters,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		glm::vec2 depth_range,
+		VkExtent2D extent,
+		ClusterFog fog,
+		std::span<const Decal> decals,
+		ClusterDecals decal_atlas,
+		BindlessHandle shadows) {
+	if (lights.size() > clusters.light_capacity) {
+		fmt::print(
+				stderr,
+				"Light overflow: {} lights, room for {}\n",
+				lights.size(),
+				clusters.light_capacity);
+		std::terminate();
+	}
+	if (decals.size() > clusters.decal_capacity) {
+		fmt::print(
+				stderr,
+				"Decal overflow: {} decals, room for {}\n",
+				decals.size(),
+				clusters.decal_capacity);
+		std::terminate();
+	}
+	const auto& frame = clusters.frames.at(frame_idx);
+	auto log_ratio = std::log(depth_range.y / depth_range.x);
+	auto slices = static_cast<float>(g_light_grid_z);
+	auto cluster_view = LightClusterView{
+			.view = view,
+			.inverse_projection = glm::inverse(projection),
+			.extent = glm::vec4(
+					static_cast<float>(extent.width),
+					static_cast<float>(extent.height),
+					0.0F,
+					0.0F),
+			.depth = glm::vec4(
+					depth_range,
+					slices / log_ratio,
+					slices * std::log(depth_range.x) / log_ratio),
+			.light_count = static_cast<uint32_t>(lights.size()),
+			.fog = fog,
+			.decal_count = static_cast<uint32_t>(decals.size()),
+			.decal_list = frame.decals_handle,
+			.decals = decal_atlas,
+			.shadows = shadows};
+	std::memcpy(
+			frame.lights.allocation.mapped,
+			&cluster_view,
+			sizeof(cluster_view));
+	std::memcpy(
+			frame.lights.allocation.mapped + sizeof(cluster_view),
+			lights.data(),
+			lights.size_bytes());
+	if (!decals.empty()) {
+		std::memcpy(
+				frame.decals.allocation.mapped,
+				decals.data(),
+				decals.size_bytes());
+	}
+
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			clusters.pipeline);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			clusters.pipeline_layout,
+			bindless);
+	auto handles = LightClusterHandles{
+			.lights = frame.lights_handle,
+			.grid = frame.grid_handle};
+	vkCmdPushConstants(
+			command_buffer,
+			clusters.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	vkCmdDispatch(
+			command_buffer,
+			(g_light_cluster_count + g_light_cluster_group_size - 1) /
+					g_light_cluster_group_size,
+			1,
+			1);
+}
+
+auto scatter_lights(uint32_t count, glm::vec3 min, glm::vec3 max)
+		-> std::vector<Light> {
+	// Lights reach about as far as their share of the box is wide, so each
+	// point is lit by a handful of them whatever the count.
+	auto size = max - min;
+	auto share = std::cbrt(
+			size.x * size.y * size.z / static_cast<float>(std::max(count, 1U)));
+	auto lights = std::vector<Light>{};
+	lights.reserve(count);
+	for (auto i = 0U; i < count; i++) {
+		auto seed = i * 8U;
+		auto position = glm::vec3(
+				hash_unit(seed),
+				hash_unit(seed + 1),
+				hash_unit(seed + 2));
+		auto color = glm::vec3(
+				hash_unit(seed + 3),
+				hash_unit(seed + 4),
+				hash_unit(seed + 5));
+		auto& light = lights.emplace_back(Light{
+				.position = min + position * size,
+				.radius = share * (1.5F + 1.5F * hash_unit(seed + 6)),
+				.color = color / std::max(color.x, std::max(color.y, color.z)),
+				.spot_outer = -1.0F,
+				.direction = glm::vec3(0.0F, 0.0F, -1.0F),
+				.spot_inner = -1.0F});
+		if (i % 4 == 3) {
+			// Spot lights look away from the viewer, into the scene, with
+			// cones of half angles between 0.5 and 1 radians.
+			auto angle = 0.5F + 0.5F * hash_unit(seed + 7);
+			light.direction = glm::normalize(glm::vec3(
+					hash_unit(seed + 6) - 0.5F,
+					hash_unit(seed + 7) - 0.5F,
+					-1.0F));
+			light.spot_outer = std::cos(angle);
+			light.spot_inner = std::cos(0.75F * angle);
+		}
+	}
+	return lights;
+}
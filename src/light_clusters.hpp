@@ -0,0 +1,168 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Match local_size_x and the grid constants in light_cluster.comp and
+// shader.frag. The grid splits the screen into tiles and the view depths
+// between near and far into exponentially growing slices, so clusters are
+// about as deep as they are wide.
+constexpr auto g_light_cluster_group_size = 64U;
+constexpr auto g_light_grid_x = 16U;
+constexpr auto g_light_grid_y = 9U;
+constexpr auto g_light_grid_z = 24U;
+constexpr auto g_light_cluster_count =
+		g_light_grid_x * g_light_grid_y * g_light_grid_z;
+// Lights a cluster holds. Further lights touching it are dropped.
+constexpr auto g_max_cluster_lights = 128U;
+// Decals a cluster holds, likewise.
+constexpr auto g_max_cluster_decals = 32U;
+
+// A point light, or a spot light when spot_outer is above -1. Layout matches
+// light_cluster.comp and shader.frag.
+struct Light {
+	glm::vec3 position{};
+	// Distance at which the light has faded out.
+	float radius{};
+	glm::vec3 color{};
+	// Cosine of the angle from direction at which the cone has faded out.
+	float spot_outer{-1.0F};
+	glm::vec3 direction{0.0F, 0.0F, -1.0F};
+	// Cosine of the angle at which the cone starts to fade.
+	float spot_inner{-1.0F};
+};
+static_assert(sizeof(Light) == 48);
+
+// The froxel fog the FOG variant of shader.frag applies to what it shades,
+// see fog.hpp: the integrated volume and the sampler it is read with.
+struct ClusterFog {
+	BindlessHandle volume{};
+	BindlessHandle sampler{};
+};
+
+// A box projecting a cell of the decal atlas onto what shader.frag shades
+// inside it. Layout matches light_cluster.comp and shader.frag.
+struct Decal {
+	// World space to the box, which spans -1 to 1 along each axis and projects
+	// along z.
+	glm::mat4 transform{1.0F};
+	// Scale in xy and offset in zw from the box's xy, mapped to [0, 1], to
+	// atlas texture coordinates.
+	glm::vec4 atlas_rect{};
+	// Center in xyz and radius in w of a sphere around the box, which the
+	// clusters bin.
+	glm::vec4 sphere{};
+};
+static_assert(sizeof(Decal) == 96);
+
+// The atlas shader.frag samples decals from, see decals.hpp.
+struct ClusterDecals {
+	BindlessHandle atlas{};
+	BindlessHandle sampler{};
+};
+
+// Where the clusters are, at the start of each frame's light buffer with the
+// lights following it. Layout matches the LightList blocks of the shaders.
+struct LightClusterView {
+	// World space to view space, which looks down -z.
+	glm::mat4 view{1.0F};
+	// Clip space to view space, with the reversed depth of depth.hpp.
+	glm::mat4 inverse_projection{1.0F};
+	// Render target size in xy.
+	glm::vec4 extent{};
+	// near and far view depths of the grid in xy. Depth d falls into slice
+	// log(d) * z - w.
+	glm::vec4 depth{};
+	uint32_t light_count{};
+	ClusterFog fog{};
+	uint32_t decal_count{};
+	// The frame's decal buffer, see LightClusterFrame.
+	BindlessHandle decal_list{};
+	ClusterDecals decals{};
+	// The frame's ShadowView, see src/shadow.hpp.
+	BindlessHandle shadows{};
+};
+static_assert(sizeof(LightClusterView) == 192);
+
+// The buffers of one frame in flight. lights and decals are written by the
+// CPU, grid by light_cluster.comp: a light count per cluster, then
+// g_max_cluster_lights light indices per cluster, then the same for decals
+// with g_max_cluster_decals.
+struct LightClusterFrame {
+	Buffer lights;
+	Buffer grid;
+	// Only with a decal capacity.
+	Buffer decals;
+	BindlessHandle lights_handle{};
+	BindlessHandle grid_handle{};
+	BindlessHandle decals_handle{};
+};
+
+// Clustered forward lighting: a compute pass bins the frame's lights into
+// view space clusters by their bounding spheres, and the fragment shader only
+// loops over the lights of the cluster it falls into. Decals are binned the
+// same way and blended into the surface color before it is lit, so they cost
+// the fragments under them a loop iteration rather than a blended box draw.
+struct LightClusters {
+	uint32_t light_capacity{};
+	uint32_t decal_capacity{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::vector<LightClusterFrame> frames;
+};
+
+// module is light_cluster.comp, whose bindless arrays are sized by
+// specialization.
+auto create_light_clusters(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t light_capacity,
+		uint32_t decal_capacity) -> LightClusters;
+// The device must be idle.
+void destroy_light_clusters(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		LightClusters& clusters);
+
+// Writes the frame's lights and view, then records the pass that bins them.
+// Must be recorded outside a render pass, after the frame fence was waited
+// on. The grid is written by COMPUTE_SHADER, the caller makes it visible to
+// the fragment shader. near and far bound the view depths of the grid;
+// fragments outside them use the first or last slice. fog, decal_atlas and
+// shadows, the frame's ShadowView, are passed on to shader.frag.
+void build_light_clusters(
+		const LightClusters& clusters,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		glm::vec2 depth_range,
+		VkExtent2D extent,
+		ClusterFog fog,
+		std::span<const Decal> decals,
+		ClusterDecals decal_atlas,
+		BindlessHandle shadows);
+
+// count lights of hashed colors, sizes and kinds, a quarter of them spot
+// lights, scattered through the box between min and max.
+auto scatter_lights(uint32_t count, glm::vec3 min, glm::vec3 max)
+		-> std::vector<Light>;
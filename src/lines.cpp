@@ -0,0 +1,119 @@
+#include "lines.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant blocks of line.vert and line.frag.
+struct LineConstants {
+	VkDeviceAddress positions{};
+	VkDeviceAddress indices{};
+	uint32_t vertex_stride{};
+	BindlessHandle uniform_buffer{};
+	uint32_t transform{};
+	uint32_t first_index{};
+	uint32_t index_size{};
+	float width{};
+	float dash{};
+	float gap{};
+	std::array<float, 2> extent{};
+	std::array<float, 3> position_scale{};
+	std::array<float, 3> position_offset{};
+	uint32_t color{};
+	uint32_t padding{};
+};
+static_assert(sizeof(LineConstants) == 88);
+
+}  // namespace
+
+auto create_line_renderer(VkDevice& device, const BindlessTable& bindless)
+		-> LineRenderer {
+	auto lines = LineRenderer{};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			.offset = 0,
+			.size = sizeof(LineConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&lines.draw_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create line pipeline layout\n");
+		std::terminate();
+	}
+	return lines;
+}
+
+void destroy_line_renderer(VkDevice& device, LineRenderer& lines) {
+	vkDestroyPipelineLayout(device, lines.draw_layout, host_callbacks());
+	lines = LineRenderer{};
+}
+
+void draw_mesh_edges(
+		VkCommandBuffer command_buffer,
+		const LineRenderer& lines,
+		const BindlessTable& bindless,
+		const DrawHandles& handles,
+		const Mesh& mesh,
+		uint32_t lod,
+		const LineStyle& style,
+		VkExtent2D extent) {
+	const auto& level = mesh.lods.at(lod);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			lines.draw_layout,
+			bindless);
+	auto constants = LineConstants{
+			.positions = handles.positions,
+			.indices = mesh.index_address,
+			.vertex_stride = handles.vertex_stride,
+			.uniform_buffer = handles.uniform_buffer,
+			.transform = handles.transform,
+			.first_index = level.first_index,
+			.index_size = mesh.index_type == VK_INDEX_TYPE_UINT16 ? 2U : 4U,
+			.width = style.width,
+			.dash = style.dash,
+			.gap = style.gap,
+			.extent =
+					{static_cast<float>(extent.width),
+					 static_cast<float>(extent.height)},
+			.position_scale =
+					{handles.position_scale.x,
+					 handles.position_scale.y,
+					 handles.position_scale.z},
+			.position_offset =
+					{handles.position_offset.x,
+					 handles.position_offset.y,
+					 handles.position_offset.z},
+			.color = style.color,
+			.padding = 0};
+	vkCmdPushConstants(
+			command_buffer,
+			lines.draw_layout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+	// Three edges per triangle.
+	vkCmdDraw(
+			command_buffer,
+			level.index_count * g_line_vertices_per_edge,
+			1,
+			0,
+			0);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "mesh.hpp"
+#include "pipeline.hpp"
+#include "uniforms.hpp"
+
+#include <cstdint>
+
+// Edges are expanded into quads of two triangles each.
+constexpr auto g_line_raster = RasterState{
+		.cull_mode = VK_CULL_MODE_NONE,
+		.front_face = VK_FRONT_FACE_CLOCKWISE,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+constexpr auto g_line_vertices_per_edge = 6U;
+
+// How edges are drawn, in pixels. A dash of 0 draws them solid. color is
+// premultiplied by its alpha when blended, red in the low byte.
+struct LineStyle {
+	float width{1.0F};
+	float dash{};
+	float gap{};
+	uint32_t color{0xffffffffU};
+};
+
+// Wide anti-aliased lines without line primitives, whose widths other than 1
+// are not portable. line.vert pulls the edges of a mesh's triangles through
+// device addresses like pulling.vert, and turns each into a screen aligned
+// quad a pixel wider than the line, which line.frag fades out at the sides,
+// caps and dash ends with coverage instead of multisampling. Nothing is
+// built on the CPU, a million triangles draw three million edges with one
+// draw, and edges shared by triangles are drawn once per triangle.
+struct LineRenderer {
+	// For the pipeline of line.vert and line.frag.
+	VkPipelineLayout draw_layout{};
+};
+
+auto create_line_renderer(VkDevice& device, const BindlessTable& bindless)
+		-> LineRenderer;
+void destroy_line_renderer(VkDevice& device, LineRenderer& lines);
+
+// Draws the edges of the mesh's level lod over what the main pass drew, with
+// handles from the mesh's draw. The bound pipeline must be one of line.vert
+// and line.frag with draw_layout, blending premultiplied, and the viewport
+// set. extent is the render area's, which the widths are measured in.
+void draw_mesh_edges(
+		VkCommandBuffer command_buffer,
+		const LineRenderer& lines,
+		const BindlessTable& bindless,
+		const DrawHandles& handles,
+		const Mesh& mesh,
+		uint32_t lod,
+		const LineStyle& style,
+		VkExtent2D extent);
@@ -0,0 +1,212 @@
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Messages a thread can have queued before it drops them, and how often the
+// writer drains the rings. Polling keeps the logging threads from waking the
+// writer, which would cost them a system call per message.
+constexpr auto g_log_ring_entries = size_t{128};
+constexpr auto g_log_interval = std::chrono::milliseconds(5);
+// Repeats of a key logged in full, then every how many one is.
+constexpr auto g_log_repeat_burst = size_t{10};
+constexpr auto g_log_repeat_interval = size_t{1000};
+// Keys rate limited at once. Keys past that are logged every time.
+constexpr auto g_log_repeat_slots = size_t{1024};
+
+struct LogEntry {
+	std::chrono::steady_clock::time_point time;
+	LogLevel level{};
+	size_t size{};
+	std::array<char, g_max_log_message> text{};
+};
+
+// Filled by its thread alone and drained by the writer alone. The entries
+// from tail up to head are the writer's until it moves tail past them.
+struct LogRing {
+	std::array<LogEntry, g_log_ring_entries> entries;
+	std::atomic<size_t> head{};
+	std::atomic<size_t> tail{};
+	std::atomic<size_t> dropped{};
+};
+
+struct LogWriter {
+	// Only taken to register a thread's ring and to list the rings.
+	std::mutex mutex;
+	// Kept until exit, for threads that log again after a restart.
+	std::vector<std::unique_ptr<LogRing>> rings;
+	std::thread thread;
+	std::atomic<bool> running{};
+	std::atomic<bool> stopping{};
+};
+
+// Zero for an empty slot, the key plus one otherwise.
+struct LogRepeat {
+	std::atomic<uint64_t> key{};
+	std::atomic<size_t> count{};
+};
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+std::atomic<LogLevel> g_log_level = LogLevel::info;
+LogWriter g_log_writer;
+std::array<LogRepeat, g_log_repeat_slots> g_log_repeats;
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+
+thread_local LogRing* t_log_ring = nullptr;
+
+// Marks what needs looking into. Info and debug messages go out as they are.
+auto level_prefix(LogLevel level) -> std::string_view {
+	switch (level) {
+		case LogLevel::debug:
+		case LogLevel::info:
+			return "";
+		case LogLevel::warning:
+			return "warning: ";
+		case LogLevel::error:
+			return "error: ";
+	}
+	return "";
+}
+
+auto thread_ring() -> LogRing& {
+	if (t_log_ring == nullptr) {
+		auto lock = std::lock_guard(g_log_writer.mutex);
+		t_log_ring =
+				g_log_writer.rings.emplace_back(std::make_unique<LogRing>()).get();
+	}
+	return *t_log_ring;
+}
+
+// Writes the queued messages of all threads in the order they were logged.
+void drain_rings() {
+	auto rings = std::vector<LogRing*>{};
+	{
+		auto lock = std::lock_guard(g_log_writer.mutex);
+		for (const auto& ring : g_log_writer.rings) {
+			rings.emplace_back(ring.get());
+		}
+	}
+	auto entries = std::vector<const LogEntry*>{};
+	auto heads = std::vector<size_t>{};
+	auto dropped = size_t{};
+	for (auto* ring : rings) {
+		auto tail = ring->tail.load(std::memory_order_relaxed);
+		auto head = ring->head.load(std::memory_order_acquire);
+		for (auto i = tail; i != head; i++) {
+			entries.emplace_back(&ring->entries.at(i % g_log_ring_entries));
+		}
+		heads.emplace_back(head);
+		dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+	}
+	std::stable_sort(
+			entries.begin(),
+			entries.end(),
+			[](const LogEntry* a, const LogEntry* b) { return a->time < b->time; });
+	for (const auto* entry : entries) {
+		fmt::print(
+				stderr,
+				"{}{}\n",
+				level_prefix(entry->level),
+				std::string_view(entry->text.data(), entry->size));
+	}
+	if (dropped != 0) {
+		fmt::print(stderr, "Dropped {} log messages of full rings\n", dropped);
+	}
+	for (auto i = size_t{}; i < rings.size(); i++) {
+		rings.at(i)->tail.store(heads.at(i), std::memory_order_release);
+	}
+}
+
+void run_writer() {
+	while (!g_log_writer.stopping.load(std::memory_order_acquire)) {
+		drain_rings();
+		std::this_thread::sleep_for(g_log_interval);
+	}
+}
+
+// How often key was logged, this time included, or zero once the table is
+// full.
+auto count_repeat(uint32_t key) -> size_t {
+	auto stored = uint64_t{key} + 1;
+	// Fibonacci hashing spreads the sequential ids the layers use.
+	auto slot = (stored * 0x9e3779b97f4a7c15) % g_log_repeat_slots;
+	for (auto probe = size_t{}; probe < g_log_repeat_slots; probe++) {
+		auto& repeat = g_log_repeats.at((slot + probe) % g_log_repeat_slots);
+		auto expected = uint64_t{};
+		if (repeat.key.compare_exchange_strong(
+						expected,
+						stored,
+						std::memory_order_relaxed) ||
+				expected == stored) {
+			return repeat.count.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+	}
+	return 0;
+}
+
+}  // namespace
+
+auto log_enabled(LogLevel level) -> bool {
+	return level >= g_log_level.load(std::memory_order_relaxed);
+}
+
+void write_log(LogLevel level, std::string_view message) {
+	if (!g_log_writer.running.load(std::memory_order_acquire)) {
+		fmt::print(stderr, "{}{}\n", level_prefix(level), message);
+		return;
+	}
+	auto& ring = thread_ring();
+	auto head = ring.head.load(std::memory_order_relaxed);
+	if (head - ring.tail.load(std::memory_order_acquire) == g_log_ring_entries) {
+		ring.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	auto& entry = ring.entries.at(head % g_log_ring_entries);
+	entry.time = std::chrono::steady_clock::now();
+	entry.level = level;
+	entry.size = std::min(message.size(), entry.text.size());
+	std::copy_n(message.begin(), entry.size, entry.text.begin());
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+void log_repeated(LogLevel level, uint32_t key, std::string_view message) {
+	if (!log_enabled(level)) {
+		return;
+	}
+	auto count = count_repeat(key);
+	if (count <= g_log_repeat_burst) {
+		write_log(level, message);
+	} else if (count % g_log_repeat_interval == 0) {
+		log_message(level, "{} (repeated {} times)", message, count);
+	}
+}
+
+void start_log(LogLevel level) {
+	g_log_level.store(level, std::memory_order_relaxed);
+	if (g_log_writer.running.load(std::memory_order_relaxed)) {
+		return;
+	}
+	g_log_writer.stopping.store(false, std::memory_order_relaxed);
+	g_log_writer.thread = std::thread(run_writer);
+	g_log_writer.running.store(true, std::memory_order_release);
+}
+
+void stop_log() {
+	if (!g_log_writer.running.load(std::memory_order_relaxed)) {
+		return;
+	}
+	g_log_writer.stopping.store(true, std::memory_order_release);
+	g_log_writer.thread.join();
+	drain_rings();
+	g_log_writer.running.store(false, std::memory_order_release);
+}
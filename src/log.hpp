@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Messages logged while the frame loop runs: validation messages, profiler
+// reports, reloads and the like. Each thread formats into a lock-free ring of
+// its own and a writer thread drains the rings to stderr, so no thread
+// blocks on the console. Messages below the level are dropped before they
+// are formatted, and a message that finds its thread's ring full is dropped
+// and counted. Fatal errors keep printing to stderr directly, as they must
+// be out before the process terminates.
+enum class LogLevel {
+	debug,
+	info,
+	warning,
+	error,
+};
+
+// Longer messages are cut short.
+constexpr auto g_max_log_message = size_t{1024};
+
+// Whether messages of level pass the filter, one relaxed load.
+auto log_enabled(LogLevel level) -> bool;
+
+// Queues message on the calling thread's ring, or writes it to stderr right
+// away without a writer.
+void write_log(LogLevel level, std::string_view message);
+
+template <typename... Args>
+void log_message(
+		LogLevel level,
+		fmt::format_string<Args...> format,
+		const Args&... args) {
+	if (!log_enabled(level)) {
+		return;
+	}
+	auto text = std::array<char, g_max_log_message>{};
+	auto result = fmt::vformat_to_n(
+			text.data(),
+			text.size(),
+			format,
+			fmt::make_format_args(args...));
+	write_log(
+			level,
+			std::string_view(text.data(), std::min(result.size, text.size())));
+}
+
+// Logs a message that may repeat by the thousands, such as a validation
+// message raised every frame, keyed by key. The first few of a key are
+// logged, after those only every thousandth, along with its count.
+void log_repeated(LogLevel level, uint32_t key, std::string_view message);
+
+// Sets the level and starts the writer thread. Until then messages are
+// written to stderr as they are logged.
+void start_log(LogLevel level);
+// Writes what the rings still hold, reports the dropped messages and stops
+// the writer. Later messages are written directly again.
+void stop_log();
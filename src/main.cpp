@@ -1,113 +1,1371 @@
+#include "dispatch.hpp"
+
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <fmt/core.h>
 
-#include <filesystem>
-#include <fstream>
+#include "allocator.hpp"
+#include "ambient_occlusion.hpp"
+#include "archive.hpp"
+#include "async.hpp"
+#include "attachments.hpp"
+#include "benchmark.hpp"
+#include "bindless.hpp"
+#include "bvh.hpp"
+#include "capabilities.hpp"
+#include "capture.hpp"
+#include "compile_pool.hpp"
+#include "compression.hpp"
+#include "compute.hpp"
+#include "config.hpp"
+#include "culling.hpp"
+#include "damage.hpp"
+#include "debug_labels.hpp"
+#include "decals.hpp"
+#include "decompress.hpp"
+#include "deferred.hpp"
+#include "defragment.hpp"
+#include "deletion.hpp"
+#include "depth.hpp"
+#include "depth_pyramid.hpp"
+#include "descriptor_allocator.hpp"
+#include "device_group.hpp"
+#include "device_selection.hpp"
+#include "display.hpp"
+#include "downsample.hpp"
+#include "draw_list.hpp"
+#include "draw_queue.hpp"
+#include "dynamic_resolution.hpp"
+#include "environment.hpp"
+#include "fog.hpp"
+#include "frame_arena.hpp"
+#include "frame_limiter.hpp"
+#include "frame_pacing.hpp"
+#include "fullscreen.hpp"
+#include "geometry_pool.hpp"
+#include "hitch.hpp"
+#include "host_memory.hpp"
+#include "huge_pages.hpp"
+#include "impostor.hpp"
+#include "instancing.hpp"
+#include "instrument.hpp"
+#include "jobs.hpp"
+#include "light_clusters.hpp"
+#include "lines.hpp"
+#include "log.hpp"
+#include "memory_budget.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+#include "microbench.hpp"
+#include "obj.hpp"
+#include "object_cache.hpp"
+#include "offscreen.hpp"
+#include "overlay.hpp"
+#include "particles.hpp"
+#include "performance_counters.hpp"
+#include "picking.hpp"
+#include "pipeline.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_manifest.hpp"
+#include "pipeline_state.hpp"
+#include "point_cloud.hpp"
+#include "post_process.hpp"
+#include "profiler.hpp"
+#include "recording.hpp"
+#include "reflection.hpp"
+#include "reflection_probes.hpp"
+#include "ray_tracing.hpp"
+#include "render_graph.hpp"
+#include "resident_instances.hpp"
+#include "report_compare.hpp"
+#include "scan.hpp"
+#include "scene.hpp"
+#include "scene_paging.hpp"
+#include "shader_identifier.hpp"
+#include "shader_object.hpp"
+#include "shader_reload.hpp"
+#include "shaders.hpp"
+#include "shading_rate.hpp"
+#include "shadow.hpp"
+#include "shadow_atlas.hpp"
+#include "simulation.hpp"
+#include "skinning.hpp"
+#include "specialization.hpp"
+#include "static_vector.hpp"
+#include "stereo.hpp"
+#include "stress_scene.hpp"
+#include "submit.hpp"
+#include "surface_format.hpp"
+#include "swap_chain_depth.hpp"
+#include "swap_chain_maintenance.hpp"
+#include "sync.hpp"
+#include "telemetry.hpp"
+#include "temporal.hpp"
+#include "terrain.hpp"
+#include "texture.hpp"
+#include "thread_placement.hpp"
+#include "trace.hpp"
+#include "transparency.hpp"
+#include "uniforms.hpp"
+#include "upload.hpp"
+#include "visibility.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <optional>
-#include <set>
 #include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 constexpr auto g_application_name = "vulkan-demo";
 constexpr auto g_window_width = 800;
 constexpr auto g_window_height = 600;
+constexpr auto g_frames_in_flight = 2;
+constexpr auto g_uniform_frame_size = VkDeviceSize{256} * 1024;
+constexpr auto g_staging_ring_size = VkDeviceSize{32} * 1024 * 1024;
+constexpr auto g_texture_stream_budget = VkDeviceSize{4} * 1024 * 1024;
+constexpr auto g_max_draw_instances = 128U * 1024;
+constexpr auto g_max_draw_batches = 1024U;
+// Screen-space error a coarser level of detail may add, in pixels.
+constexpr auto g_lod_pixel_error = 1.0F;
+constexpr auto g_required_device_extensions =
+		std::array{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+// GLFW's surface extensions, the HDR color spaces, the surface queries
+// exclusive fullscreen and swap chain maintenance need and debug utils.
+constexpr auto g_max_instance_extensions = size_t{8};
+// Present, graphics, upload and compute.
+constexpr auto g_max_queue_families = size_t{4};
+// Of the queues of one role. Frames are rendered and presented ahead of
+// async compute, and uploads, which only stream, go last. The global
+// priorities order them against other processes' queues too, when asked
+// for.
+struct QueuePriority {
+	float local{};
+	VkQueueGlobalPriorityKHR global{};
+};
+constexpr auto g_render_queue_priority = QueuePriority{
+		.local = 1.0F,
+		.global = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR};
+constexpr auto g_compute_queue_priority = QueuePriority{
+		.local = 0.75F,
+		.global = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR};
+constexpr auto g_upload_queue_priority = QueuePriority{
+		.local = 0.5F,
+		.global = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR};
+static_assert(g_frames_in_flight >= 2 && g_frames_in_flight <= 3);
+// How the main pass uses the scene attachments. They are shared between
+// frames, so the last frame's writes are where they start out, in whatever
+// layout since they are cleared.
+constexpr auto g_color_output = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+constexpr auto g_depth_output = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
 
 void glfw_error_callback(int error, const char* description) {
 	fmt::print(stderr, "GLFW error {}: {}\n", error, description);
 	std::terminate();
 }
 
+// Runs on whichever thread made the call the layers flagged, so it only
+// queues the message, and of one raised every frame only a few.
 auto VKAPI_PTR vk_diagnostic_callback(
-		VkDebugUtilsMessageSeverityFlagBitsEXT /*messageSeverity*/,
+		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		VkDebugUtilsMessageTypeFlagsEXT /*messageTypes*/,
 		const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
 		void* /*pUserData*/) -> VkBool32 {
-	fmt::print(stderr, "{}\n", pCallbackData->pMessage);
+	auto level = LogLevel::debug;
+	if ((messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) != 0) {
+		level = LogLevel::error;
+	} else if (
+			(messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) !=
+			0) {
+		level = LogLevel::warning;
+	}
+	log_repeated(
+			level,
+			static_cast<uint32_t>(pCallbackData->messageIdNumber),
+			pCallbackData->pMessage);
 	return VK_FALSE;
 }
 
+#ifdef USE_VALIDATION_LAYERS
+// What a validation profile changes about the layer's defaults.
+struct ValidationFeatures {
+	std::vector<VkValidationFeatureEnableEXT> enabled;
+	std::vector<VkValidationFeatureDisableEXT> disabled;
+};
+
+auto validation_features(ValidationProfile profile) -> ValidationFeatures {
+	auto features = ValidationFeatures{};
+	switch (profile) {
+		case ValidationProfile::full:
+			break;
+		case ValidationProfile::fast:
+			features.disabled = {
+					VK_VALIDATION_FEATURE_DISABLE_THREAD_SAFETY_EXT,
+					VK_VALIDATION_FEATURE_DISABLE_UNIQUE_HANDLES_EXT,
+					VK_VALIDATION_FEATURE_DISABLE_SHADERS_EXT};
+			break;
+		case ValidationProfile::sync:
+			features.enabled = {
+					VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT};
+			break;
+		case ValidationProfile::gpu:
+			// The reserved slot keeps the instrumentation's descriptor set clear
+			// of the sets the demo binds.
+			features.enabled = {
+					VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT,
+					VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT};
+			break;
+		case ValidationProfile::best_practices:
+			features.enabled = {VK_VALIDATION_FEATURE_ENABLE_BEST_PRACTICES_EXT};
+			break;
+	}
+	return features;
+}
+#endif
+
+// A shader variant whose module is created at startup.
+struct ShaderJob {
+	Shader shader{};
+	ShaderVariant variant{};
+	VkShaderModule* module{};
+};
+
+// A key event, stamped when GLFW delivered it.
+struct KeyEvent {
+	int key{};
+	int action{};
+	std::chrono::steady_clock::time_point time;
+};
+
+struct WindowState {
+	PresentPolicy present_policy{};
+	bool present_policy_changed{};
+	bool framebuffer_resized{};
+	bool depth_prepass{};
+	// A window showed contents it has to be drawn again for.
+	bool refresh_requested{};
+	// Delivered since the last sample_input.
+	std::vector<KeyEvent> key_events;
+	// The oldest key press that changed state and has not been presented yet.
+	std::optional<std::chrono::steady_clock::time_point> pending_input;
+};
+
+void glfw_framebuffer_size_callback(
+		GLFWwindow* window,
+		int /*width*/,
+		int /*height*/) {
+	auto* state = static_cast<WindowState*>(glfwGetWindowUserPointer(window));
+	state->framebuffer_resized = true;
+}
+
+// Uncovered or resized windows without a compositor keeping their contents.
+void glfw_window_refresh_callback(GLFWwindow* window) {
+	auto* state = static_cast<WindowState*>(glfwGetWindowUserPointer(window));
+	state->refresh_requested = true;
+}
+
+// Only queues the event, sample_input acts on it.
 void glfw_key_callback(
 		GLFWwindow* window,
 		int key,
 		int /*scancode*/,
-		int /*action*/,
+		int action,
 		int /*mods*/) {
-	switch (key) {
-		case GLFW_KEY_Q:
-		case GLFW_KEY_ESCAPE:
-			glfwSetWindowShouldClose(window, GLFW_TRUE);
+	auto* state = static_cast<WindowState*>(glfwGetWindowUserPointer(window));
+	state->key_events.emplace_back(KeyEvent{
+			.key = key,
+			.action = action,
+			.time = std::chrono::steady_clock::now()});
+}
+
+// Polls the window and applies the queued key events. Polling never blocks,
+// so a frame can sample input more than once and use the last state it saw.
+void sample_input(GLFWwindow* window, WindowState& state) {
+	glfwPollEvents();
+	for (const auto& event : state.key_events) {
+		if (event.action != GLFW_PRESS) {
+			continue;
+		}
+		switch (event.key) {
+			case GLFW_KEY_Q:
+			case GLFW_KEY_ESCAPE:
+				glfwSetWindowShouldClose(window, GLFW_TRUE);
+				continue;
+			case GLFW_KEY_P:
+				state.present_policy = next_present_policy(state.present_policy);
+				state.present_policy_changed = true;
+				break;
+			case GLFW_KEY_D:
+				state.depth_prepass = !state.depth_prepass;
+				break;
+			default:
+				continue;
+		}
+		if (!state.pending_input.has_value()) {
+			state.pending_input = event.time;
+		}
+	}
+	state.key_events.clear();
+}
+
+struct PhysicalDeviceInfo {
+	VkPhysicalDevice device{};
+	uint32_t idx{};
+	VkPhysicalDeviceProperties properties{};
+	VkPhysicalDeviceMemoryProperties memory_properties{};
+	VkPhysicalDeviceFeatures features{};
+	DeviceCapabilities capabilities;
+	VkDeviceSize device_local_bytes{};
+	std::optional<uint32_t> graphics_family_idx;
+	std::optional<uint32_t> present_family_idx;
+	std::optional<uint32_t> transfer_family_idx;
+	std::optional<uint32_t> compute_family_idx;
+	std::vector<VkQueueFamilyProperties> queue_families;
+	bool has_required_extensions{};
+	// False when rendering offscreen, where no family has to present.
+	bool needs_present{};
+};
+
+auto score_physical_device(const PhysicalDeviceInfo& info)
+		-> std::optional<uint64_t> {
+	// The shaders index the bindless storage buffers with push constants.
+	if (!info.graphics_family_idx.has_value() ||
+			(info.needs_present && !info.present_family_idx.has_value()) ||
+			!info.has_required_extensions ||
+			info.features.shaderStorageBufferArrayDynamicIndexing != VK_TRUE) {
+		return std::nullopt;
+	}
+	auto type_rank = uint64_t{};
+	switch (info.properties.deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			type_rank = 4;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			type_rank = 3;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			type_rank = 2;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:
+			type_rank = 1;
+			break;
+		default:
+			break;
+	}
+	// Device type always dominates; VRAM in MiB only orders devices of the same
+	// type, and a shared graphics/present family breaks any remaining tie.
+	constexpr auto type_weight = uint64_t{1} << 40U;
+	constexpr auto mib = uint64_t{1} << 20U;
+	auto shared_family = info.graphics_family_idx == info.present_family_idx;
+	return type_rank * type_weight + (info.device_local_bytes / mib) * 2 +
+			(shared_family ? 1 : 0);
+}
+
+auto matches_gpu_override(
+		const PhysicalDeviceInfo& info,
+		std::string_view gpu_override) -> bool {
+	if (std::all_of(gpu_override.begin(), gpu_override.end(), [](char c) {
+				return c >= '0' && c <= '9';
+			})) {
+		return std::to_string(info.idx) == gpu_override;
 	}
+	auto name = std::string_view(info.properties.deviceName);
+	auto lower = [](char c) {
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	};
+	auto match = std::search(
+			name.begin(),
+			name.end(),
+			gpu_override.begin(),
+			gpu_override.end(),
+			[&](char a, char b) { return lower(a) == lower(b); });
+	return match != name.end();
 }
 
-auto vk_func(const VkInstance& instance, const char* func_name)
-		-> PFN_vkVoidFunction {
-	auto func = vkGetInstanceProcAddr(instance, func_name);
-	if (func == nullptr) {
-		fmt::print(stderr, "Vulkan function not found: {}\n", func_name);
+auto select_physical_device(
+		std::span<const PhysicalDeviceInfo> devices_info,
+		std::string_view gpu_override) -> PhysicalDeviceInfo {
+	const auto* best = static_cast<const PhysicalDeviceInfo*>(nullptr);
+	auto best_score = uint64_t{};
+	for (const auto& info : devices_info) {
+		auto score = score_physical_device(info);
+		if (!gpu_override.empty() && matches_gpu_override(info, gpu_override)) {
+			if (!score.has_value()) {
+				fmt::print(
+						stderr,
+						"Requested physical device is not suitable: {}\n",
+						info.properties.deviceName);
+				std::terminate();
+			}
+			return info;
+		}
+		if (score.has_value() && (best == nullptr || *score > best_score)) {
+			best = &info;
+			best_score = *score;
+		}
+	}
+	if (!gpu_override.empty()) {
+		fmt::print(stderr, "No physical device matches: {}\n", gpu_override);
+		std::terminate();
+	}
+	if (best == nullptr) {
+		fmt::print(stderr, "Failed to find a suitable physical device\n");
 		std::terminate();
 	}
-	return func;
+	return *best;
 }
 
-auto read_file(const std::filesystem::path& path) -> std::vector<char> {
-	auto file = std::ifstream(path, std::ios::ate | std::ios::binary);
-	auto file_size = file.tellg();
-	auto buffer = std::vector<char>(file_size);
-	file.seekg(0);
-	file.read(buffer.data(), file_size);
-	return buffer;
+struct Frame {
+	VkCommandPool command_pool{};
+	VkCommandBuffer command_buffer{};
+	VkSemaphore image_available{};
+	SubmitPoint done;
+	// The frame last submitted from this slot, complete once done is reached.
+	FrameTicket ticket{};
+};
+
+auto create_semaphore(VkDevice& device) -> VkSemaphore {
+	auto semaphore_info = VkSemaphoreCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0};
+	auto* semaphore = VkSemaphore{};
+	if (vkCreateSemaphore(
+					device,
+					&semaphore_info,
+					host_callbacks(),
+					&semaphore) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create semaphore\n");
+		std::terminate();
+	}
+	return semaphore;
 }
 
-auto create_shader_modules(VkDevice& device, const std::span<char>& src)
-		-> VkShaderModule {
-	auto module_info = VkShaderModuleCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+auto create_frame(
+		VkDevice& device,
+		uint32_t queue_family_idx,
+		const QueueTimeline& timeline) -> Frame {
+	auto frame = Frame{};
+	// The pool is reset wholesale at the start of every frame, which is cheaper
+	// than resetting individual command buffers.
+	auto pool_info = VkCommandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.codeSize = src.size_bytes(),
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			.pCode = reinterpret_cast<uint32_t*>(src.data())};
-	auto* module = VkShaderModule{};
-	if (vkCreateShaderModule(device, &module_info, VK_NULL_HANDLE, &module) !=
-			VK_SUCCESS) {
-		fmt::print(stderr, "Failed to create shader module\n");
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = queue_family_idx};
+	if (vkCreateCommandPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&frame.command_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create command pool\n");
 		std::terminate();
 	}
-	return module;
+	auto command_buffer_info = VkCommandBufferAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.commandPool = frame.command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1};
+	if (vkAllocateCommandBuffers(
+					device,
+					&command_buffer_info,
+					&frame.command_buffer) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate command buffer\n");
+		std::terminate();
+	}
+	frame.image_available = create_semaphore(device);
+	// Reached from the start so the first wait on each frame slot returns at
+	// once.
+	frame.done = create_submit_point(device, timeline);
+	return frame;
+}
+
+void destroy_frame(VkDevice& device, Frame& frame) {
+	destroy_submit_point(device, frame.done);
+	vkDestroySemaphore(device, frame.image_available, host_callbacks());
+	vkDestroyCommandPool(device, frame.command_pool, host_callbacks());
+}
+
+auto select_present_mode(
+		PresentPolicy policy,
+		std::span<const VkPresentModeKHR> supported) -> VkPresentModeKHR {
+	auto preferred = std::span<const VkPresentModeKHR>{};
+	static constexpr auto low_latency = std::array{
+			VK_PRESENT_MODE_MAILBOX_KHR,
+			VK_PRESENT_MODE_IMMEDIATE_KHR};
+	static constexpr auto adaptive =
+			std::array{VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+	static constexpr auto uncapped = std::array{
+			VK_PRESENT_MODE_IMMEDIATE_KHR,
+			VK_PRESENT_MODE_MAILBOX_KHR};
+	switch (policy) {
+		case PresentPolicy::low_latency:
+			preferred = low_latency;
+			break;
+		case PresentPolicy::adaptive:
+			preferred = adaptive;
+			break;
+		case PresentPolicy::uncapped:
+			preferred = uncapped;
+			break;
+		case PresentPolicy::vsync:
+			break;
+	}
+	for (auto mode : preferred) {
+		if (std::find(supported.begin(), supported.end(), mode) !=
+				supported.end()) {
+			return mode;
+		}
+	}
+	// FIFO is the only mode every implementation is required to support.
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// The modes a swap chain made with present_mode can be switched to, with
+// swap chain maintenance. Empty without, which recreates it instead.
+auto switchable_present_modes(
+		VkPhysicalDevice device,
+		VkSurfaceKHR surface,
+		VkPresentModeKHR present_mode,
+		std::span<const VkPresentModeKHR> available,
+		bool maintenance) -> std::vector<VkPresentModeKHR> {
+	if (!maintenance) {
+		return {};
+	}
+	return compatible_present_modes(device, surface, present_mode, available);
+}
+
+// A device mask of zero acquires for the whole device. Within a device group
+// it names the GPU the image has to be ready for.
+auto acquire_swap_chain_image(
+		VkDevice& device,
+		VkSwapchainKHR swap_chain,
+		VkSemaphore semaphore,
+		uint32_t device_mask,
+		uint32_t& image_idx) -> VkResult {
+	VKDEMO_ZONE("acquire_swap_chain_image");
+	if (device_mask == 0) {
+		return vkAcquireNextImageKHR(
+				device,
+				swap_chain,
+				std::numeric_limits<uint64_t>::max(),
+				semaphore,
+				VK_NULL_HANDLE,
+				&image_idx);
+	}
+	auto acquire_info = VkAcquireNextImageInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.swapchain = swap_chain,
+			.timeout = std::numeric_limits<uint64_t>::max(),
+			.semaphore = semaphore,
+			.fence = VK_NULL_HANDLE,
+			.deviceMask = device_mask};
+	return vkAcquireNextImage2KHR(device, &acquire_info, &image_idx);
+}
+
+// Some platforms report the window size as the current extent, others leave it
+// to the application by reporting UINT32_MAX. Display plane surfaces, which
+// have no window, always report the extent they were made with.
+auto select_swap_extent(
+		const VkSurfaceCapabilitiesKHR& capabilities,
+		GLFWwindow* window) -> VkExtent2D {
+	if (window == nullptr ||
+			capabilities.currentExtent.width !=
+					std::numeric_limits<uint32_t>::max()) {
+		return capabilities.currentExtent;
+	}
+	auto width = int{};
+	auto height = int{};
+	glfwGetFramebufferSize(window, &width, &height);
+	return VkExtent2D{
+			.width = std::clamp(
+					static_cast<uint32_t>(width),
+					capabilities.minImageExtent.width,
+					capabilities.maxImageExtent.width),
+			.height = std::clamp(
+					static_cast<uint32_t>(height),
+					capabilities.minImageExtent.height,
+					capabilities.maxImageExtent.height)};
+}
+
+// Rotates clip space the way transform rotates a swap chain's images for the
+// display, clockwise with y pointing down, so contents drawn through it come
+// out upright.
+auto pre_rotation(VkSurfaceTransformFlagBitsKHR transform) -> glm::mat4 {
+	auto rotation = glm::mat4{1.0F};
+	switch (transform) {
+		case VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR:
+			rotation[0] = glm::vec4(0.0F, 1.0F, 0.0F, 0.0F);
+			rotation[1] = glm::vec4(-1.0F, 0.0F, 0.0F, 0.0F);
+			break;
+		case VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR:
+			rotation[0][0] = -1.0F;
+			rotation[1][1] = -1.0F;
+			break;
+		case VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR:
+			rotation[0] = glm::vec4(0.0F, -1.0F, 0.0F, 0.0F);
+			rotation[1] = glm::vec4(1.0F, 0.0F, 0.0F, 0.0F);
+			break;
+		default:
+			break;
+	}
+	return rotation;
 }
 
-auto create_pipeline_shader_info(
-		VkShaderModule& module,
-		VkShaderStageFlagBits stage) -> VkPipelineShaderStageCreateInfo {
-	return {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+struct SwapChain {
+	VkSwapchainKHR handle{};
+	VkExtent2D extent{};
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+	std::vector<VkFramebuffer> framebuffers;
+	SceneAttachments attachments;
+	// What the images' contents are rotated by for the display, see
+	// pre_rotation.
+	VkSurfaceTransformFlagBitsKHR transform{
+			VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR};
+	// Presentation may still be reading a semaphore when the frame slot that
+	// signalled it comes around again, so render completion is tracked per
+	// swap chain image rather than per frame.
+	std::vector<VkSemaphore> render_finished;
+	// The mode it is presented with. With swap chain maintenance, the modes
+	// it can be switched to without being recreated, and the fences of its
+	// presents per frame slot.
+	VkPresentModeKHR present_mode{};
+	std::vector<VkPresentModeKHR> switchable_modes;
+	PresentFences present_fences;
+};
+
+// Creates the swap chain, or replaces an existing one in place. The old handle
+// is passed as oldSwapchain so the driver can recycle its resources, and the
+// per image semaphores carry over. Views, framebuffers and the scene
+// attachments refer to the old images or extent and have to be rebuilt. The
+// views come from image_views, which they stay in until their image goes.
+// Framebuffers are only made when render_pass is set, dynamic rendering draws
+// to the views directly. The replaced objects go to deletions, so frames that
+// still use them can finish. image_count is the minimum to ask for. The
+// scene attachments are made in scene_format, which differs from the surface
+// format when the scene is post-processed, their depth with depth_usage as
+// create_scene_attachments takes it. Swap chains that are only blitted
+// to leave draws_scene unset and get no attachments or framebuffers. Within
+// a device group, group_present_modes are the modes it is presented with.
+// The images are made with compression and what they got is logged, which
+// is empty without swap chain compression control. With swap chain
+// maintenance, switchable_modes are the modes it can be switched to without
+// being recreated, present_mode first, and its presents signal fences that
+// its retirement waits for. They are empty without.
+// An exclusive swap chain takes the display, see src/fullscreen.hpp. A
+// preserved one is not clipped, so its images keep all of their contents
+// from one frame to the next. A pre-rotated one is made in the display's
+// native orientation when it is rotated by a multiple of 90 degrees, and
+// its contents have to be drawn rotated by pre_rotation. extent is in the
+// current orientation either way.
+void update_swap_chain(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		ImageViewCache& image_views,
+		VkSurfaceKHR& surface,
+		const VkSurfaceCapabilitiesKHR& capabilities,
+		VkExtent2D extent,
+		const VkSurfaceFormatKHR& surface_format,
+		VkFormat scene_format,
+		VkFormat depth_format,
+		VkSampleCountFlagBits samples,
+		VkImageUsageFlags depth_usage,
+		VkPresentModeKHR present_mode,
+		uint32_t image_count,
+		VkImageUsageFlags image_usage,
+		const std::array<uint32_t, 2>& queue_family_indices,
+		VkDeviceGroupPresentModeFlagsKHR group_present_modes,
+		std::optional<VkImageCompressionFlagsEXT> compression,
+		std::vector<VkPresentModeKHR> switchable_modes,
+		bool draws_scene,
+		bool exclusive,
+		bool preserved,
+		bool pre_rotated,
+		VkRenderPass& render_pass,
+		SwapChain& swap_chain) {
+	// Otherwise the presentation engine rotates the images as it shows them.
+	auto transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	switch (capabilities.currentTransform) {
+		case VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR:
+		case VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR:
+			if (pre_rotated) {
+				transform = capabilities.currentTransform;
+				std::swap(extent.width, extent.height);
+			}
+			break;
+		case VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR:
+			if (pre_rotated) {
+				transform = capabilities.currentTransform;
+			}
+			break;
+		default:
+			break;
+	}
+	if ((capabilities.supportedTransforms & transform) == 0) {
+		transform = capabilities.currentTransform;
+	}
+	auto group_info = VkDeviceGroupSwapchainCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR,
 			.pNext = VK_NULL_HANDLE,
+			.modes = group_present_modes};
+	const void* next = group_present_modes == 0 ? VK_NULL_HANDLE : &group_info;
+	auto compression_info = image_compression_control(
+			compression.value_or(VK_IMAGE_COMPRESSION_DEFAULT_EXT),
+			next);
+	if (compression.has_value()) {
+		next = &compression_info;
+	}
+	auto modes_info = VkSwapchainPresentModesCreateInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODES_CREATE_INFO_EXT,
+			.pNext = next,
+			.presentModeCount = static_cast<uint32_t>(switchable_modes.size()),
+			.pPresentModes = switchable_modes.data()};
+	if (!switchable_modes.empty()) {
+		next = &modes_info;
+	}
+	auto swap_chain_info = VkSwapchainCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+			.pNext = next,
 			.flags = 0,
-			.stage = stage,
-			.module = module,
-			.pName = "main",
-			.pSpecializationInfo = VK_NULL_HANDLE};
+			.surface = surface,
+			.minImageCount = image_count,
+			.imageFormat = surface_format.format,
+			.imageColorSpace = surface_format.colorSpace,
+			.imageExtent = extent,
+			.imageArrayLayers = 1,
+			.imageUsage = image_usage,
+			.imageSharingMode = queue_family_indices[0] == queue_family_indices[1]
+					? VK_SHARING_MODE_EXCLUSIVE
+					: VK_SHARING_MODE_CONCURRENT,
+			.queueFamilyIndexCount = 2,
+			.pQueueFamilyIndices = queue_family_indices.data(),
+			.preTransform = transform,
+			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			.presentMode = present_mode,
+			.clipped = preserved ? VK_FALSE : VK_TRUE,
+			.oldSwapchain = swap_chain.handle};
+
+	auto* handle = VkSwapchainKHR{};
+	auto result = exclusive
+			? create_exclusive_swap_chain(device, swap_chain_info, handle)
+			: vkCreateSwapchainKHR(
+						device,
+						&swap_chain_info,
+						host_callbacks(),
+						&handle);
+	if (result != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create swap chain\n");
+		std::terminate();
+	}
+	defer_deletion(
+			deletions,
+			[&device,
+			 &allocator,
+			 &image_views,
+			 old_handle = swap_chain.handle,
+			 framebuffers = std::move(swap_chain.framebuffers),
+			 images = std::move(swap_chain.images),
+			 attachments = swap_chain.attachments,
+			 present_fences = std::move(swap_chain.present_fences)]() mutable {
+				// The frames are done, but their presents may not be.
+				destroy_present_fences(device, present_fences);
+				for (auto& framebuffer : framebuffers) {
+					vkDestroyFramebuffer(device, framebuffer, host_callbacks());
+				}
+				// Before the swap chain, whose images could otherwise share their
+				// handles with a later one's while the views are cached.
+				for (auto* image : images) {
+					release_image_views(device, image_views, image);
+				}
+				destroy_scene_attachments(device, allocator, attachments);
+				vkDestroySwapchainKHR(device, old_handle, host_callbacks());
+			});
+	swap_chain.framebuffers.clear();
+	swap_chain.images.clear();
+	swap_chain.views.clear();
+	swap_chain.attachments = SceneAttachments{};
+	swap_chain.handle = handle;
+	swap_chain.extent = extent;
+	swap_chain.transform = transform;
+	swap_chain.present_mode = present_mode;
+	swap_chain.present_fences = PresentFences{};
+	if (!switchable_modes.empty()) {
+		swap_chain.present_fences =
+				create_present_fences(device, g_frames_in_flight);
+	}
+	swap_chain.switchable_modes = std::move(switchable_modes);
+
+	vkGetSwapchainImagesKHR(
+			device,
+			swap_chain.handle,
+			&image_count,
+			VK_NULL_HANDLE);
+	swap_chain.images.resize(image_count);
+	vkGetSwapchainImagesKHR(
+			device,
+			swap_chain.handle,
+			&image_count,
+			swap_chain.images.data());
+	for (auto i = size_t{}; i < swap_chain.images.size(); i++) {
+		name_object(
+				device,
+				VK_OBJECT_TYPE_IMAGE,
+				swap_chain.images.at(i),
+				fmt::format("swap chain image {}", i));
+	}
+	if (compression.has_value() && !swap_chain.images.empty()) {
+		log_message(
+				LogLevel::info,
+				"Swap chain image compression: {}",
+				describe_image_compression(query_image_compression(
+						device,
+						swap_chain.images.front(),
+						VK_IMAGE_ASPECT_COLOR_BIT)));
+	}
+
+	swap_chain.views.reserve(image_count);
+	for (auto& image : swap_chain.images) {
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = image,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = surface_format.format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = VkImageSubresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1}};
+		swap_chain.views.emplace_back(
+				get_image_view(device, image_views, view_info));
+	}
+
+	// Presentation of the old images may still wait on the extra semaphores.
+	// With present fences they are destroyed after the old swap chain waited
+	// for its presents.
+	while (swap_chain.render_finished.size() > image_count) {
+		defer_deletion(
+				deletions,
+				[&device, semaphore = swap_chain.render_finished.back()]() {
+					vkDestroySemaphore(device, semaphore, host_callbacks());
+				});
+		swap_chain.render_finished.pop_back();
+	}
+	while (swap_chain.render_finished.size() < image_count) {
+		swap_chain.render_finished.emplace_back(create_semaphore(device));
+	}
+	if (!draws_scene) {
+		return;
+	}
+	swap_chain.attachments = create_scene_attachments(
+			device,
+			allocator,
+			scene_format,
+			depth_format,
+			extent,
+			samples,
+			1,
+			depth_usage);
+	if (render_pass == VK_NULL_HANDLE) {
+		return;
+	}
+	swap_chain.framebuffers.reserve(image_count);
+	for (auto& view : swap_chain.views) {
+		auto attachments = scene_framebuffer_views(swap_chain.attachments, view);
+		auto framebuffer_info = VkFramebufferCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderPass = render_pass,
+				.attachmentCount = static_cast<uint32_t>(attachments.size()),
+				.pAttachments = attachments.data(),
+				.width = extent.width,
+				.height = extent.height,
+				.layers = 1};
+		auto* framebuffer = VkFramebuffer{};
+		if (vkCreateFramebuffer(
+						device,
+						&framebuffer_info,
+						host_callbacks(),
+						&framebuffer) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create framebuffer\n");
+			std::terminate();
+		}
+		swap_chain.framebuffers.emplace_back(framebuffer);
+	}
 }
 
-// NOLINTNEXTLINE(readability-function-cognitive-complexity) lol
-auto main() -> int {
-	glfwSetErrorCallback(glfw_error_callback);
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	auto* window = glfwCreateWindow(
+// Presents to swap_chain with mode from now on, if it was made able to
+// switch to it and has at least image_count images. Returns whether it did,
+// otherwise the swap chain has to be recreated.
+auto switch_present_mode(
+		SwapChain& swap_chain,
+		VkPresentModeKHR mode,
+		uint32_t image_count) -> bool {
+	const auto& modes = swap_chain.switchable_modes;
+	if (std::find(modes.begin(), modes.end(), mode) == modes.end() ||
+			swap_chain.images.size() < image_count) {
+		return false;
+	}
+	swap_chain.present_mode = mode;
+	return true;
+}
+
+void destroy_swap_chain(
+		VkDevice& device,
+		Allocator& allocator,
+		ImageViewCache& image_views,
+		SwapChain& swap_chain) {
+	// The device being idle does not mean presentation is done.
+	destroy_present_fences(device, swap_chain.present_fences);
+	for (auto& semaphore : swap_chain.render_finished) {
+		vkDestroySemaphore(device, semaphore, host_callbacks());
+	}
+	for (auto& framebuffer : swap_chain.framebuffers) {
+		vkDestroyFramebuffer(device, framebuffer, host_callbacks());
+	}
+	for (auto* image : swap_chain.images) {
+		release_image_views(device, image_views, image);
+	}
+	destroy_scene_attachments(device, allocator, swap_chain.attachments);
+	vkDestroySwapchainKHR(device, swap_chain.handle, host_callbacks());
+}
+
+// A further window showing the frames of the first on a display of its own.
+// It is presented together with the first, but acquires its images and goes
+// stale on its own.
+struct MirrorWindow {
+	GLFWwindow* window{};
+	VkSurfaceKHR surface{};
+	VkSurfaceCapabilitiesKHR capabilities{};
+	std::vector<VkPresentModeKHR> present_modes;
+	SwapChain swap_chain;
+	// Per frame slot, like Frame::image_available.
+	std::array<VkSemaphore, g_frames_in_flight> image_available{};
+	// The image the frame being recorded copies into, unset while the swap
+	// chain is out of date or the window minimized.
+	std::optional<uint32_t> image_idx;
+	bool stale{};
+};
+
+void destroy_mirror_window(
+		VkInstance& instance,
+		VkDevice& device,
+		Allocator& allocator,
+		ImageViewCache& image_views,
+		MirrorWindow& mirror) {
+	if (mirror.swap_chain.handle != VK_NULL_HANDLE) {
+		destroy_swap_chain(device, allocator, image_views, mirror.swap_chain);
+	}
+	for (auto* semaphore : mirror.image_available) {
+		vkDestroySemaphore(device, semaphore, host_callbacks());
+	}
+	vkDestroySurfaceKHR(instance, mirror.surface, host_callbacks());
+	glfwDestroyWindow(mirror.window);
+}
+
+// Whether an image in source_format, written with source_features, can be
+// scaled into a swap chain image of swap_chain_format with a linear blit.
+auto can_blit_to_swap_chain(
+		VkPhysicalDevice physical_device,
+		VkFormat source_format,
+		VkFormatFeatureFlags source_features,
+		VkFormat swap_chain_format,
+		const VkSurfaceCapabilitiesKHR& capabilities) -> bool {
+	auto needed = source_features | VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	auto source = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(physical_device, source_format, &source);
+	auto destination = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(
+			physical_device,
+			swap_chain_format,
+			&destination);
+	return (source.optimalTilingFeatures & needed) == needed &&
+			(destination.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) !=
+			0 &&
+			(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) !=
+			0;
+}
+
+// Whether the post composite can write swap chain images of
+// swap_chain_format itself, which needs them in its output format and usable
+// as storage images.
+auto can_store_to_swap_chain(
+		VkPhysicalDevice physical_device,
+		OutputTransfer transfer,
+		VkFormat swap_chain_format,
+		const VkSurfaceCapabilitiesKHR& capabilities) -> bool {
+	if (post_output_format(transfer) != swap_chain_format) {
+		return false;
+	}
+	auto properties = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(
+			physical_device,
+			swap_chain_format,
+			&properties);
+	return (properties.optimalTilingFeatures &
+					 VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0 &&
+			(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) != 0;
+}
+
+// Opens window window_idx on the monitor of the same index, if there is one.
+// Unset when the present family cannot present to it or the primary swap
+// chain's images cannot be blitted into its format. The swap chain is made
+// on the first frame, the mirror starts out stale.
+auto create_mirror_window(
+		VkInstance& instance,
+		VkDevice& device,
+		VkPhysicalDevice physical_device,
+		uint32_t present_family_idx,
+		const VkSurfaceFormatKHR& surface_format,
+		size_t window_idx) -> std::optional<MirrorWindow> {
+	auto mirror = MirrorWindow{};
+	mirror.window = glfwCreateWindow(
 			g_window_width,
 			g_window_height,
 			g_application_name,
 			nullptr,
 			nullptr);
+	auto monitor_count = 0;
+	auto** monitors = glfwGetMonitors(&monitor_count);
+	if (window_idx < static_cast<size_t>(monitor_count)) {
+		auto x = 0;
+		auto y = 0;
+		auto width = 0;
+		auto height = 0;
+		glfwGetMonitorWorkarea(monitors[window_idx], &x, &y, &width, &height);
+		glfwSetWindowPos(mirror.window, x, y);
+	}
+	if (glfwCreateWindowSurface(
+					instance,
+					mirror.window,
+					host_callbacks(),
+					&mirror.surface) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a window surface\n");
+		std::terminate();
+	}
+	auto supported = VkBool32{};
+	vkGetPhysicalDeviceSurfaceSupportKHR(
+			physical_device,
+			present_family_idx,
+			mirror.surface,
+			&supported);
+	auto format_count = uint32_t{};
+	vkGetPhysicalDeviceSurfaceFormatsKHR(
+			physical_device,
+			mirror.surface,
+			&format_count,
+			VK_NULL_HANDLE);
+	auto formats = std::vector<VkSurfaceFormatKHR>(format_count);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(
+			physical_device,
+			mirror.surface,
+			&format_count,
+			formats.data());
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+			physical_device,
+			mirror.surface,
+			&mirror.capabilities);
+	auto present_mode_count = uint32_t{};
+	vkGetPhysicalDeviceSurfacePresentModesKHR(
+			physical_device,
+			mirror.surface,
+			&present_mode_count,
+			VK_NULL_HANDLE);
+	mirror.present_modes.resize(present_mode_count);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(
+			physical_device,
+			mirror.surface,
+			&present_mode_count,
+			mirror.present_modes.data());
+	auto same_format = std::any_of(
+			formats.begin(),
+			formats.end(),
+			[&](const VkSurfaceFormatKHR& format) {
+				return format.format == surface_format.format &&
+						format.colorSpace == surface_format.colorSpace;
+			});
+	if (supported != VK_TRUE || !same_format || mirror.present_modes.empty() ||
+			!can_blit_to_swap_chain(
+					physical_device,
+					surface_format.format,
+					0,
+					surface_format.format,
+					mirror.capabilities)) {
+		vkDestroySurfaceKHR(instance, mirror.surface, host_callbacks());
+		glfwDestroyWindow(mirror.window);
+		return std::nullopt;
+	}
+	for (auto& semaphore : mirror.image_available) {
+		semaphore = create_semaphore(device);
+	}
+	mirror.stale = true;
+	return mirror;
+}
+
+// The render graph moves the images to the attachment layouts before, and
+// the target to its final layout after. The previous contents are discarded.
+// With MSAA the multisampled color is resolved into view. Motion vectors are
+// written to motion_view, cleared to no motion, and fragments are shaded at
+// the sizes in rate_view, unless they are null. A view mask draws each of
+// its views into that layer of every attachment. Motion vectors and depth are
+// only stored when store_motion and store_depth are set, so tiled GPUs keep
+// them on chip when no later pass reads them.
+void begin_scene_rendering(
+		VkCommandBuffer command_buffer,
+		VkImageView view,
+		VkImageView motion_view,
+		const SceneAttachments& attachments,
+		const VkRect2D& render_area,
+		std::span<const VkClearValue, 2> clear_values,
+		VkImageView rate_view,
+		VkExtent2D rate_texel_size,
+		uint32_t view_mask,
+		bool store_motion,
+		bool store_depth) {
+	auto msaa = attachments.color.view != VK_NULL_HANDLE;
+	auto color_attachment = VkRenderingAttachmentInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.imageView = view,
+			.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.resolveMode = VK_RESOLVE_MODE_NONE,
+			.resolveImageView = VK_NULL_HANDLE,
+			.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = clear_values[0]};
+	if (msaa) {
+		color_attachment.imageView = attachments.color.view;
+		color_attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		color_attachment.resolveImageView = view;
+		color_attachment.resolveImageLayout =
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	}
+	auto motion_attachment = VkRenderingAttachmentInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.imageView = motion_view,
+			.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.resolveMode = VK_RESOLVE_MODE_NONE,
+			.resolveImageView = VK_NULL_HANDLE,
+			.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = store_motion ? VK_ATTACHMENT_STORE_OP_STORE
+															: VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.clearValue = VkClearValue{.color = {.float32 = {0, 0, 0, 0}}}};
+	auto color_attachments = std::array{color_attachment, motion_attachment};
+	auto depth_attachment = VkRenderingAttachmentInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.imageView = attachments.depth.view,
+			.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			.resolveMode = VK_RESOLVE_MODE_NONE,
+			.resolveImageView = VK_NULL_HANDLE,
+			.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = store_depth ? VK_ATTACHMENT_STORE_OP_STORE
+														 : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.clearValue = clear_values[1]};
+	auto rate_attachment = VkRenderingFragmentShadingRateAttachmentInfoKHR{
+			.sType =
+					VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.imageView = rate_view,
+			.imageLayout =
+					VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR,
+			.shadingRateAttachmentTexelSize = rate_texel_size};
+	auto rendering_info = VkRenderingInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.pNext = rate_view != VK_NULL_HANDLE ? &rate_attachment : VK_NULL_HANDLE,
+			.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
+			.renderArea = render_area,
+			.layerCount = 1,
+			.viewMask = view_mask,
+			.colorAttachmentCount = motion_view != VK_NULL_HANDLE ? 2U : 1U,
+			.pColorAttachments = color_attachments.data(),
+			.pDepthAttachment = &depth_attachment,
+			.pStencilAttachment = VK_NULL_HANDLE};
+	vkCmdBeginRendering(command_buffer, &rendering_info);
+}
+
+// NOLINTNEXTLINE(readability-function-cognitive-complexity) lol
+auto main(int argc, char** argv) -> int {
+	auto config = parse_config(std::span(argv, argc));
+	// Cooked meshes are stored in the layout they are drawn with.
+	auto mesh_layout = config.quantize_vertices ? VertexLayout::quantized
+																							: VertexLayout::interleaved;
+	// Cooking is an offline step, parsing OBJ at startup would cost more than
+	// the rest of it.
+	if (!config.cook_mesh_input.empty()) {
+		auto data = read_obj(config.cook_mesh_input);
+		if (data.has_value()) {
+			build_mesh_lods(*data, g_max_mesh_lods);
+		}
+		// Loading reads no cooked mesh back on the CPU, so its impostors are
+		// baked here.
+		if (data.has_value() && config.impostor_pixels > 0 &&
+				!save_impostor(
+						impostor_cooked_path(config.cook_mesh_output),
+						bake_impostor(*data))) {
+			return 1;
+		}
+		return data.has_value() &&
+								 cook_mesh(
+										 *data,
+										 mesh_layout,
+										 config.compress_mesh,
+										 config.cook_mesh_output)
+				? 0
+				: 1;
+	}
+	if (!config.cook_point_cloud_input.empty()) {
+		return cook_point_cloud(
+							 config.cook_point_cloud_input,
+							 config.cook_point_cloud_output)
+				? 0
+				: 1;
+	}
+	if (!config.cook_paged_scene_input.empty()) {
+		return cook_paged_scene(
+							 config.cook_paged_scene_input,
+							 config.cook_paged_scene_output)
+				? 0
+				: 1;
+	}
+	if (!config.pack_archive_input.empty()) {
+		return pack_archive(
+							 config.pack_archive_input,
+							 config.pack_archive_output,
+							 config.compress_archive)
+				? 0
+				: 1;
+	}
+	if (!config.compare_baseline.empty()) {
+		return benchmark_reports_regressed(
+							 config.compare_baseline,
+							 config.compare_candidate)
+				? 1
+				: 0;
+	}
+	start_log(config.log_level);
+	// Mapped once, so loading does not open every asset on its own.
+	auto archive = std::optional<Archive>{};
+	if (!config.archive.empty()) {
+		archive = open_archive(config.archive);
+		if (!archive.has_value()) {
+			fmt::print(
+					stderr,
+					"Failed to open archive {}\n",
+					config.archive.string());
+			std::terminate();
+		}
+	}
+	const auto* assets = archive.has_value() ? &*archive : nullptr;
+	auto trace = create_trace(config.trace);
+	auto startup_event = begin_trace_event(trace, "startup");
+	auto benchmark =
+			create_benchmark(config.benchmark_frames, config.benchmark_report);
+	auto benchmarking = config.benchmark_frames != 0;
+	auto headless = config.headless;
+	// Presents on a display plane, with neither a window nor GLFW.
+	auto direct_display = !headless && config.display.has_value();
+	auto core_topology = detect_core_topology();
+	auto jobs = create_job_system(
+			config.job_threads,
+			config.thread_placement,
+			core_topology);
+	if (config.raise_thread_priority && !raise_current_thread_priority()) {
+		log_message(
+				LogLevel::info,
+				"Keeping the main thread at normal priority, raising it is not "
+				"permitted");
+	}
+	load_vulkan_loader();
+	enable_huge_pages(config.huge_pages);
+	// Installed before the instance exists and removed once it is gone, so
+	// every object is destroyed with the callbacks it was created with.
+	auto host_allocator = std::unique_ptr<HostAllocator>{};
+	if (config.host_allocator) {
+		host_allocator = create_host_allocator();
+		install_host_allocator(host_allocator.get());
+	}
+
+	// Headless runs never touch GLFW, so they work on machines without a
+	// display server.
+	auto* window = static_cast<GLFWwindow*>(nullptr);
+	if (!headless && !direct_display) {
+		auto glfw_event = begin_trace_event(trace, "glfwInit");
+		glfwSetErrorCallback(glfw_error_callback);
+		glfwInit();
+		end_trace_event(trace, glfw_event);
+		auto window_event = begin_trace_event(trace, "glfwCreateWindow");
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		// At the monitor's current mode the window goes fullscreen without a
+		// mode switch, and covering the whole output with an opaque surface is
+		// what lets compositors flip the swap chain images to the display:
+		// GLFW asks X11 compositors to bypass fullscreen windows, and Wayland
+		// ones scan such surfaces out directly.
+		auto* monitor = config.fullscreen ? glfwGetPrimaryMonitor() : nullptr;
+		const auto* mode =
+				monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+		if (mode != nullptr) {
+			glfwWindowHint(GLFW_RED_BITS, mode->redBits);
+			glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
+			glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
+			glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+		}
+		window = glfwCreateWindow(
+				mode != nullptr ? mode->width : g_window_width,
+				mode != nullptr ? mode->height : g_window_height,
+				g_application_name,
+				mode != nullptr ? monitor : nullptr,
+				nullptr);
+		end_trace_event(trace, window_event);
+	}
 
+	// 1.3 brings dynamic rendering. A 1.0 loader has no
+	// vkEnumerateInstanceVersion and rejects any other version.
+	auto instance_version = VK_API_VERSION_1_0;
+	if (vkEnumerateInstanceVersion != nullptr) {
+		vkEnumerateInstanceVersion(&instance_version);
+	}
+	auto api_version = instance_version >= VK_API_VERSION_1_3
+			? VK_API_VERSION_1_3
+			: VK_API_VERSION_1_0;
 	auto application_info = VkApplicationInfo{
 			.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
 			.pNext = VK_NULL_HANDLE,
@@ -115,38 +1373,123 @@ auto main() -> int {
 			.applicationVersion = VK_MAKE_VERSION(0, 0, 1),
 			.pEngineName = VK_NULL_HANDLE,
 			.engineVersion = VK_MAKE_VERSION(0, 0, 0),
-			.apiVersion = VK_API_VERSION_1_0};
+			.apiVersion = api_version};
 
-	auto extension_count = uint32_t{};
-	auto* required_extensions =
-			glfwGetRequiredInstanceExtensions(&extension_count);
-	auto span = std::span(required_extensions, extension_count);
-	auto extensions = std::vector<const char*>(extension_count);
-	extensions.assign(span.begin(), span.end());
+	auto extensions = StaticVector<const char*, g_max_instance_extensions>{};
+	if (window != nullptr) {
+		auto extension_count = uint32_t{};
+		auto* required_extensions =
+				glfwGetRequiredInstanceExtensions(&extension_count);
+		extensions.assign(std::span(required_extensions, extension_count));
+	} else if (direct_display) {
+		extensions.assign(g_display_instance_extensions);
+	}
+	// Surfaces only report the HDR color spaces with the extension enabled.
+	// Exclusive fullscreen, which only Windows has, and the present modes a
+	// swap chain can switch between depend on the extended surface queries.
+	auto hdr_color_spaces =
+			!headless && config.output_policy != OutputPolicy::sdr;
+#ifdef _WIN32
+	auto full_screen_queries = window != nullptr && config.fullscreen;
+#else
+	auto full_screen_queries = false;
+#endif
+	auto surface_maintenance = !headless;
+	if (hdr_color_spaces || full_screen_queries || surface_maintenance) {
+		auto extension_count = uint32_t{};
+		vkEnumerateInstanceExtensionProperties(
+				VK_NULL_HANDLE,
+				&extension_count,
+				VK_NULL_HANDLE);
+		auto available_extensions =
+				std::vector<VkExtensionProperties>(extension_count);
+		vkEnumerateInstanceExtensionProperties(
+				VK_NULL_HANDLE,
+				&extension_count,
+				available_extensions.data());
+		auto available = [&](std::string_view name) {
+			return std::any_of(
+					available_extensions.begin(),
+					available_extensions.end(),
+					[&](const VkExtensionProperties& extension) {
+						return std::string_view(extension.extensionName) == name;
+					});
+		};
+		if (hdr_color_spaces &&
+				available(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME)) {
+			extensions.emplace_back(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME);
+		}
+		auto surface_queries =
+				available(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+		full_screen_queries = full_screen_queries && surface_queries;
+		surface_maintenance = surface_maintenance && surface_queries &&
+				available(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+		if (full_screen_queries || surface_maintenance) {
+			extensions.emplace_back(
+					VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+		}
+		if (surface_maintenance) {
+			extensions.emplace_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+		}
+	}
 
 #ifdef USE_VALIDATION_LAYERS
 	extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	auto debug_utils = true;
 
+	// Severities below the log level are not even reported.
+	auto message_severity = VkDebugUtilsMessageSeverityFlagsEXT{};
+	if (log_enabled(LogLevel::error)) {
+		message_severity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	}
+	if (log_enabled(LogLevel::warning)) {
+		message_severity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+	}
+	if (log_enabled(LogLevel::debug)) {
+		message_severity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+				VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+	}
 	auto debug_info = VkDebugUtilsMessengerCreateInfoEXT{
 			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
-			.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT |
-					VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT,
+			.messageSeverity = message_severity,
 			.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
 					VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
 					VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
 			.pfnUserCallback = vk_diagnostic_callback,
 			.pUserData = VK_NULL_HANDLE};
+	auto features = validation_features(config.validation_profile);
+	auto validation_info = VkValidationFeaturesEXT{
+			.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+			.pNext = &debug_info,
+			.enabledValidationFeatureCount =
+					static_cast<uint32_t>(features.enabled.size()),
+			.pEnabledValidationFeatures = features.enabled.data(),
+			.disabledValidationFeatureCount =
+					static_cast<uint32_t>(features.disabled.size()),
+			.pDisabledValidationFeatures = features.disabled.data()};
+	// The full profile leaves the layer at its defaults and its extension
+	// unused.
+	auto instance_next = static_cast<const void*>(&debug_info);
+	if (!features.enabled.empty() || !features.disabled.empty()) {
+		extensions.emplace_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+		instance_next = &validation_info;
+	}
 
-	auto validation_layers =
-			std::vector<const char*>{"VK_LAYER_KHRONOS_validation"};
+	auto validation_layers = std::array{"VK_LAYER_KHRONOS_validation"};
+#else
+	// Only for the object names and labels that captures show.
+	auto debug_utils = debug_labels_supported();
+	if (debug_utils) {
+		extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
 #endif
 
 	auto instance_info = VkInstanceCreateInfo{
 			.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 #ifdef USE_VALIDATION_LAYERS
-			.pNext = &debug_info,
+			.pNext = instance_next,
 #else
 			.pNext = VK_NULL_HANDLE,
 #endif
@@ -162,57 +1505,111 @@ auto main() -> int {
 			.enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
 			.ppEnabledExtensionNames = extensions.data()};
 
+	auto instance_event = begin_trace_event(trace, "vkCreateInstance");
 	auto* instance = VkInstance{};
-	if (vkCreateInstance(&instance_info, VK_NULL_HANDLE, &instance) !=
+	if (vkCreateInstance(&instance_info, host_callbacks(), &instance) !=
 			VK_SUCCESS) {
 		fmt::print(stderr, "Failed to create vulkan instance\n");
 		std::terminate();
 	}
+	load_instance_functions(instance);
+	if (debug_utils) {
+		enable_debug_labels();
+	}
+	end_trace_event(trace, instance_event);
 
 #ifdef USE_VALIDATION_LAYERS
-	auto vkCreateDebugDebugUtilsMessengerExt =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
-					vk_func(instance, "vkCreateDebugUtilsMessengerEXT"));
 	auto* messenger = VkDebugUtilsMessengerEXT{};
-	if (vkCreateDebugDebugUtilsMessengerExt(
+	if (vkCreateDebugUtilsMessengerEXT == nullptr ||
+			vkCreateDebugUtilsMessengerEXT(
 					instance,
 					&debug_info,
-					nullptr,
+					host_callbacks(),
 					&messenger) != VK_SUCCESS) {
 		fmt::print(stderr, "Failed to setup vulkan debug callback\n");
 		std::terminate();
 	}
 #endif
 
+	end_startup_phase(benchmark, "instance");
+
+	auto surface_event = begin_trace_event(trace, "glfwCreateWindowSurface");
 	auto* surface = VkSurfaceKHR{};
-	if (glfwCreateWindowSurface(instance, window, VK_NULL_HANDLE, &surface) !=
-			VK_SUCCESS) {
+	if (direct_display) {
+		auto display_surface = create_display_surface(instance, *config.display);
+		if (!display_surface.has_value()) {
+			fmt::print(
+					stderr,
+					"Failed to find display {} or a free plane for it\n",
+					*config.display);
+			std::terminate();
+		}
+		surface = display_surface->surface;
+	} else if (
+			!headless &&
+			glfwCreateWindowSurface(instance, window, host_callbacks(), &surface) !=
+					VK_SUCCESS) {
 		fmt::print(stderr, "Failed to create a window surface\n");
 		std::terminate();
 	}
+	end_trace_event(trace, surface_event);
+	auto required_device_extensions = DeviceExtensions{};
+	if (!headless) {
+		required_device_extensions.assign(g_required_device_extensions);
+	}
 
+	// The first enumeration loads and initializes every installed driver.
+	auto enumerate_event = begin_trace_event(trace, "vkEnumeratePhysicalDevices");
 	auto device_count = uint32_t{};
 	vkEnumeratePhysicalDevices(instance, &device_count, VK_NULL_HANDLE);
 	auto physical_devices = std::vector<VkPhysicalDevice>(device_count);
 	vkEnumeratePhysicalDevices(instance, &device_count, physical_devices.data());
 
-	struct PhysicalDeviceInfo {
-		VkPhysicalDevice device{};
-		std::optional<uint32_t> graphics_family_idx;
-		std::optional<uint32_t> present_family_idx;
-		bool discrete{};
-	};
-
-	auto vkGetPhysicalDeviceSurfaceSupportKHR =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkGetPhysicalDeviceSurfaceSupportKHR>(
-					vk_func(instance, "vkGetPhysicalDeviceSurfaceSupportKHR"));
+	// Device UUIDs come from cheap property queries and tell whether the
+	// devices are the ones the last run picked from, see
+	// src/device_selection.hpp. A requested device is always searched for.
+	auto device_selection_file = config.cache_dir / "device_selection.txt";
+	auto device_uuids = std::vector<DeviceUuid>{};
+	if (api_version >= VK_API_VERSION_1_1) {
+		for (auto* candidate_device : physical_devices) {
+			device_uuids.emplace_back(query_device_uuid(candidate_device));
+		}
+	}
+	auto cached_selection = config.gpu.empty() && !device_uuids.empty()
+			? load_device_selection(device_selection_file)
+			: std::nullopt;
+	if (cached_selection.has_value() &&
+			(cached_selection->devices != device_uuids ||
+			 cached_selection->needs_present != !headless)) {
+		cached_selection.reset();
+	}
 
-	auto devices_info = std::vector<PhysicalDeviceInfo>(device_count);
-	for (auto& candidate_device : physical_devices) {
+	// The queue families come from selection when given, empty when they no
+	// longer fit, and otherwise from scanning every family.
+	auto query_physical_device =
+			[&](uint32_t device_idx, const DeviceSelection* selection)
+			-> std::optional<PhysicalDeviceInfo> {
+		auto* candidate_device = physical_devices.at(device_idx);
 		auto physical_device_info = PhysicalDeviceInfo{};
 		physical_device_info.device = candidate_device;
+		physical_device_info.idx = device_idx;
+		physical_device_info.needs_present = !headless;
+		vkGetPhysicalDeviceProperties(
+				candidate_device,
+				&physical_device_info.properties);
+		vkGetPhysicalDeviceFeatures(
+				candidate_device,
+				&physical_device_info.features);
+		auto& memory_props = physical_device_info.memory_properties;
+		vkGetPhysicalDeviceMemoryProperties(candidate_device, &memory_props);
+		auto heaps =
+				std::span(memory_props.memoryHeaps, memory_props.memoryHeapCount);
+		for (auto& heap : heaps) {
+			if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0U) {
+				physical_device_info.device_local_bytes += heap.size;
+			}
+		}
+
 		auto queue_family_count = uint32_t{};
 		vkGetPhysicalDeviceQueueFamilyProperties(
 				candidate_device,
@@ -224,63 +1621,385 @@ auto main() -> int {
 				candidate_device,
 				&queue_family_count,
 				queue_families.data());
-		auto idx = uint32_t{};
-		for (auto& queue_family : queue_families) {
-			if ((queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0U) {
-				physical_device_info.graphics_family_idx = idx;
-			}
-			auto supports_present = VkBool32{};
-			vkGetPhysicalDeviceSurfaceSupportKHR(
-					candidate_device,
-					idx,
-					surface,
-					&supports_present);
-			if (supports_present == VK_TRUE) {
-				physical_device_info.present_family_idx = idx;
+		if (selection != nullptr) {
+			if (physical_device_info.properties.driverVersion !=
+							selection->driver_version ||
+					!device_selection_fits(
+							candidate_device,
+							surface,
+							*selection,
+							queue_families)) {
+				return std::nullopt;
+			}
+			physical_device_info.graphics_family_idx = selection->graphics_family;
+			physical_device_info.present_family_idx = selection->present_family;
+			physical_device_info.transfer_family_idx = selection->transfer_family;
+			physical_device_info.compute_family_idx = selection->compute_family;
+		} else {
+			auto idx = uint32_t{};
+			auto transfer_only_family = false;
+			for (auto& queue_family : queue_families) {
+				auto graphics = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0U;
+				auto supports_present = VkBool32{};
+				if (!headless) {
+					vkGetPhysicalDeviceSurfaceSupportKHR(
+							candidate_device,
+							idx,
+							surface,
+							&supports_present);
+				}
+				auto present = supports_present == VK_TRUE;
+				// A family that can do both avoids sharing swap chain images across
+				// queues, so it wins over separate graphics and present families.
+				if (graphics && present &&
+						physical_device_info.graphics_family_idx !=
+								physical_device_info.present_family_idx) {
+					physical_device_info.graphics_family_idx = idx;
+					physical_device_info.present_family_idx = idx;
+				}
+				if (graphics && !physical_device_info.graphics_family_idx.has_value()) {
+					physical_device_info.graphics_family_idx = idx;
+				}
+				if (present && !physical_device_info.present_family_idx.has_value()) {
+					physical_device_info.present_family_idx = idx;
+				}
+				// Families with transfer but no graphics are usually backed by the
+				// copy engines, which run alongside rendering. Transfer-only families
+				// are the dedicated DMA queues and win over async compute ones.
+				auto transfer = (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0U;
+				auto compute = (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0U;
+				if (transfer && !graphics &&
+						(!physical_device_info.transfer_family_idx.has_value() ||
+						 (!compute && !transfer_only_family))) {
+					physical_device_info.transfer_family_idx = idx;
+					transfer_only_family = !compute;
+				}
+				// Compute work submitted to a family without graphics runs on the
+				// async compute engines, concurrently with rasterization.
+				if (compute && !graphics &&
+						!physical_device_info.compute_family_idx.has_value()) {
+					physical_device_info.compute_family_idx = idx;
+				}
+				idx++;
+			}
+		}
+		physical_device_info.queue_families = std::move(queue_families);
+
+		auto extension_count = uint32_t{};
+		vkEnumerateDeviceExtensionProperties(
+				candidate_device,
+				VK_NULL_HANDLE,
+				&extension_count,
+				VK_NULL_HANDLE);
+		auto available_extensions =
+				std::vector<VkExtensionProperties>(extension_count);
+		vkEnumerateDeviceExtensionProperties(
+				candidate_device,
+				VK_NULL_HANDLE,
+				&extension_count,
+				available_extensions.data());
+		physical_device_info.has_required_extensions = std::all_of(
+				required_device_extensions.begin(),
+				required_device_extensions.end(),
+				[&](const char* required) {
+					return std::any_of(
+							available_extensions.begin(),
+							available_extensions.end(),
+							[&](const VkExtensionProperties& available) {
+								return std::string_view(available.extensionName) == required;
+							});
+				});
+		physical_device_info.capabilities = query_device_capabilities(
+				candidate_device,
+				api_version,
+				physical_device_info.properties,
+				available_extensions,
+				!headless,
+				full_screen_queries,
+				surface_maintenance,
+				config.high_queue_priority,
+				!config.performance_counters.empty(),
+				config.shader_objects,
+				config.descriptor_buffers);
+		return physical_device_info;
+	};
+	auto physical_device_info = [&] {
+		if (cached_selection.has_value()) {
+			auto cached =
+					query_physical_device(cached_selection->selected, &*cached_selection);
+			if (cached.has_value() && score_physical_device(*cached).has_value()) {
+				return *cached;
 			}
-			idx++;
 		}
-		auto props = VkPhysicalDeviceProperties{};
-		vkGetPhysicalDeviceProperties(candidate_device, &props);
-		if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-			physical_device_info.discrete = true;
+		auto devices_info = std::vector<PhysicalDeviceInfo>{};
+		devices_info.reserve(device_count);
+		for (auto device_idx = uint32_t{}; device_idx < device_count;
+				 device_idx++) {
+			devices_info.emplace_back(*query_physical_device(device_idx, nullptr));
+		}
+		auto selected = select_physical_device(devices_info, config.gpu);
+		if (config.gpu.empty() && !device_uuids.empty()) {
+			save_device_selection(
+					device_selection_file,
+					DeviceSelection{
+							.devices = device_uuids,
+							.selected = selected.idx,
+							.driver_version = selected.properties.driverVersion,
+							.needs_present = !headless,
+							.graphics_family = *selected.graphics_family_idx,
+							.present_family = selected.present_family_idx,
+							.transfer_family = selected.transfer_family_idx,
+							.compute_family = selected.compute_family_idx});
+		}
+		return selected;
+	}();
+	end_trace_event(trace, enumerate_event);
+	fmt::print(
+			stderr,
+			"Using physical device {}: {}\n",
+			physical_device_info.idx,
+			physical_device_info.properties.deviceName);
+	// Alternate frame rendering takes the selected GPU's whole group.
+	auto device_group = DeviceGroup{};
+	if (config.device_group) {
+		if (api_version >= VK_API_VERSION_1_1 &&
+				vkEnumeratePhysicalDeviceGroups != nullptr) {
+			device_group = find_device_group(instance, physical_device_info.device);
 		}
-		devices_info.emplace_back(physical_device_info);
+		if (device_group.devices.empty()) {
+			fmt::print(
+					stderr,
+					"Device groups need Vulkan 1.1 and GPUs linked into one, "
+					"rendering on one GPU\n");
+		}
+	}
+	// Dynamic rendering spares the render pass and the framebuffers that would
+	// otherwise be rebuilt with every swap chain, extended dynamic state the
+	// pipeline permutations for raster state.
+	const auto& device_capabilities = physical_device_info.capabilities;
+	auto dynamic_rendering = device_capabilities.dynamic_rendering;
+	auto extended_dynamic_state = device_capabilities.extended_dynamic_state;
+	auto synchronization2 = device_capabilities.synchronization2;
+	auto indirect_draws =
+			config.indirect_draws && device_capabilities.draw_indirect_count;
+	if (config.indirect_draws && !indirect_draws) {
+		fmt::print(
+				stderr,
+				"Indirect count draws are not supported, drawing directly\n");
+	}
+	// A batch draws at most maxDrawIndirectCount of its instances.
+	auto max_draw_count =
+			physical_device_info.properties.limits.maxDrawIndirectCount;
+	if (indirect_draws && max_draw_count < g_max_draw_instances) {
+		fmt::print(
+				stderr,
+				"Indirect count draws are limited to {} per batch, drawing at most "
+				"that many copies of a mesh\n",
+				max_draw_count);
+	}
+	// Copies of the mesh are drawn at once through a per-instance vertex
+	// stream. Draw lists index their own instances with gl_InstanceIndex. A
+	// paged scene's instances are always drawn that way.
+	auto instanced = config.instances > 1 || !config.paged_scene.empty();
+	auto hardware_instancing = instanced && !indirect_draws;
+	if (instanced && !hardware_instancing) {
+		fmt::print(stderr, "Instancing needs direct draws, drawing one copy\n");
+	}
+	auto paged_scene = !config.paged_scene.empty() && hardware_instancing;
+	// Baked secondaries bind the bindless table once, so its updates must be
+	// allowed after bind.
+	auto baked_draws =
+			config.baked_draws && device_capabilities.descriptor_indexing;
+	if (config.baked_draws && !baked_draws) {
+		fmt::print(
+				stderr,
+				"Baked draws need descriptor indexing, recording every frame\n");
+	}
+	// Vertex pulling reads meshes through device addresses in push constants,
+	// so draws of different meshes need no vertex buffer binds. Instance
+	// streams are vertex input, which pulled draws have none of.
+	auto vertex_pulling =
+			device_capabilities.buffer_device_address && !hardware_instancing;
+	// Generated draws push the mesh's device addresses in place of its vertex
+	// buffers.
+	auto generated_draws = config.device_generated_commands &&
+			device_capabilities.device_generated_commands && indirect_draws &&
+			vertex_pulling;
+	if (config.device_generated_commands && !generated_draws) {
+		fmt::print(
+				stderr,
+				"Device generated commands need the extension, indirect draws and "
+				"pulled vertices, drawing with indirect count draws\n");
+	}
+	auto depth_prepass = config.depth_prepass;
+	// Mesh shaders pull vertices through device addresses, and draws of the
+	// meshlet pipeline are not built by draw lists. Cooked meshes carry no
+	// meshlets.
+	auto mesh_shading = config.mesh_shading && device_capabilities.mesh_shader &&
+			vertex_pulling && !indirect_draws && config.mesh.empty();
+	if (config.mesh_shading && !mesh_shading) {
+		fmt::print(
+				stderr,
+				"Mesh shading needs mesh shaders, device addresses, direct draws "
+				"and the built-in mesh, using the vertex shader\n");
+	}
+	// Acceleration structures are built by render graph passes, whose barriers
+	// take synchronization2, and live on one device only.
+	auto ray_query = config.ray_query && device_capabilities.ray_query &&
+			synchronization2 && device_group.devices.empty();
+	if (config.ray_query && !ray_query) {
+		fmt::print(
+				stderr,
+				"Ray query shading needs ray queries, synchronization2 and a single "
+				"GPU, shading without it\n");
+	}
+	// Lights are shaded by shader.frag, which ray query shading replaces.
+	auto clustered_lights = config.lights > 0 && !ray_query;
+	if (config.lights > 0 && !clustered_lights) {
+		fmt::print(
+				stderr,
+				"Clustered lights need the plain fragment shader, shading without "
+				"them\n");
+	}
+	// Present wait is only queried for devices that present.
+	auto frame_pacing = config.frame_pacing && device_capabilities.present_wait;
+	if (config.frame_pacing && !frame_pacing) {
+		fmt::print(stderr, "Frame pacing needs present wait, presenting unpaced\n");
+	}
+	// Without it a fullscreen window is still flipped to the display where the
+	// compositor allows.
+	auto full_screen_exclusive = device_capabilities.full_screen_exclusive;
+	fmt::print(
+			stderr,
+			"Device capabilities: {}\n",
+			describe_device_capabilities(device_capabilities));
+	if (physical_device_info.transfer_family_idx.has_value() &&
+			device_group.devices.empty()) {
+		fmt::print(
+				stderr,
+				"Using dedicated transfer queue family {}\n",
+				*physical_device_info.transfer_family_idx);
+	}
+	if (physical_device_info.compute_family_idx.has_value()) {
+		fmt::print(
+				stderr,
+				"Using async compute queue family {}\n",
+				*physical_device_info.compute_family_idx);
 	}
 
-	auto physical_device_info = PhysicalDeviceInfo{};
-	for (auto& device : devices_info) {
-		if (device.graphics_family_idx.has_value() &&
-				device.present_family_idx.has_value() &&
-				!physical_device_info.discrete) {
-			physical_device_info = device;
+	auto queue_create_infos =
+			StaticVector<VkDeviceQueueCreateInfo, g_max_queue_families>{};
+	// Within a device group a queue family transfer would only be acquired by
+	// the GPU of the frame that uses the upload, so uploads stay on the
+	// graphics family there.
+	auto upload_family_idx = device_group.devices.empty()
+			? physical_device_info.transfer_family_idx.value_or(
+						*physical_device_info.graphics_family_idx)
+			: *physical_device_info.graphics_family_idx;
+	auto compute_family_idx = physical_device_info.compute_family_idx.value_or(
+			*physical_device_info.graphics_family_idx);
+	auto present_family_idx = physical_device_info.present_family_idx.value_or(
+			*physical_device_info.graphics_family_idx);
+	// A family that serves several roles takes the highest priority.
+	auto unique_queue_families = StaticVector<uint32_t, g_max_queue_families>{};
+	auto queue_priorities = StaticVector<QueuePriority, g_max_queue_families>{};
+	for (const auto& [queue_family, priority] : std::array{
+					 std::pair{present_family_idx, g_render_queue_priority},
+					 std::pair{
+							 *physical_device_info.graphics_family_idx,
+							 g_render_queue_priority},
+					 std::pair{upload_family_idx, g_upload_queue_priority},
+					 std::pair{compute_family_idx, g_compute_queue_priority}}) {
+		const auto* found = std::find(
+				unique_queue_families.begin(),
+				unique_queue_families.end(),
+				queue_family);
+		if (found == unique_queue_families.end()) {
+			unique_queue_families.emplace_back(queue_family);
+			queue_priorities.emplace_back(priority);
+			continue;
+		}
+		auto& shared = queue_priorities[static_cast<size_t>(
+				found - unique_queue_families.begin())];
+		if (priority.local > shared.local) {
+			shared = priority;
 		}
 	}
-	if (physical_device_info.device == nullptr) {
-		fmt::print(stderr, "Failed to find a suitable physical device\n");
-		std::terminate();
+	auto global_priorities = config.high_queue_priority &&
+			device_capabilities.global_priority_extension != nullptr;
+	if (config.high_queue_priority && !global_priorities) {
+		fmt::print(
+				stderr,
+				"Queue priorities against other processes need global priorities, "
+				"using the default\n");
 	}
-
-	auto queue_create_infos = std::vector<VkDeviceQueueCreateInfo>{};
-	auto unique_queue_families = std::set<uint32_t>{
-			*physical_device_info.present_family_idx,
-			*physical_device_info.graphics_family_idx};
-	auto queue_priority = 1.0F;
-	for (auto queue_family : unique_queue_families) {
+	auto global_priority_infos = StaticVector<
+			VkDeviceQueueGlobalPriorityCreateInfoKHR,
+			g_max_queue_families>{};
+	for (auto i = size_t{}; i < unique_queue_families.size(); i++) {
+		auto global_priority_info = VkDeviceQueueGlobalPriorityCreateInfoKHR{
+				.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_GLOBAL_PRIORITY_CREATE_INFO_KHR,
+				.pNext = VK_NULL_HANDLE,
+				.globalPriority = queue_priorities[i].global};
+		const auto& chained =
+				global_priority_infos.emplace_back(global_priority_info);
 		auto device_queue_info = VkDeviceQueueCreateInfo{
 				.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-				.pNext = VK_NULL_HANDLE,
+				.pNext = global_priorities ? &chained : VK_NULL_HANDLE,
 				.flags = 0,
-				.queueFamilyIndex = queue_family,
+				.queueFamilyIndex = unique_queue_families[i],
 				.queueCount = 1,
-				.pQueuePriorities = &queue_priority};
+				.pQueuePriorities = &queue_priorities[i].local};
 		queue_create_infos.emplace_back(device_queue_info);
 	}
-	auto device_extension_names =
-			std::vector<const char*>{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	auto device_extension_names = required_device_extensions;
+	auto enabled_features = VkPhysicalDeviceFeatures{};
+	enabled_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+	enabled_features.shaderSampledImageArrayDynamicIndexing =
+			physical_device_info.features.shaderSampledImageArrayDynamicIndexing;
+	// Fragment shaders can only read gl_PrimitiveID with geometry shaders.
+	if (config.visibility_buffer) {
+		enabled_features.geometryShader =
+				physical_device_info.features.geometryShader;
+	}
+	// terrain.frag writes the virtual texture's feedback.
+	if (config.virtual_texture) {
+		enabled_features.fragmentStoresAndAtomics =
+				physical_device_info.features.fragmentStoresAndAtomics;
+	}
+	if (config.gpu_statistics) {
+		enable_gpu_statistics_features(
+				physical_device_info.features,
+				enabled_features);
+	}
+	// The pool's pages are bound on the upload queue, and its batches wait on
+	// the binds through a timeline.
+	auto sparse_geometry = config.sparse_geometry && synchronization2 &&
+			physical_device_info.features.sparseBinding == VK_TRUE &&
+			physical_device_info.features.sparseResidencyBuffer == VK_TRUE &&
+			(physical_device_info.queue_families.at(upload_family_idx).queueFlags &
+			 VK_QUEUE_SPARSE_BINDING_BIT) != 0U &&
+			g_geometry_pool_size <=
+					physical_device_info.properties.limits.sparseAddressSpaceSize;
+	if (config.sparse_geometry && !sparse_geometry) {
+		fmt::print(
+				stderr,
+				"Sparse geometry needs sparse buffers bound on the upload queue and "
+				"timeline semaphores, giving meshes buffers of their own\n");
+	}
+	if (sparse_geometry) {
+		enabled_features.sparseBinding = VK_TRUE;
+		enabled_features.sparseResidencyBuffer = VK_TRUE;
+	}
+	auto device_features = DeviceFeatures{};
+	device_features.core.features = enabled_features;
+	const auto* device_features_chain = enable_device_capabilities(
+			device_capabilities,
+			device_features,
+			device_extension_names);
 	auto device_info = VkDeviceCreateInfo{
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
+			.pNext = device_features_chain,
 			.flags = 0,
 			.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size()),
 			.pQueueCreateInfos = queue_create_infos.data(),
@@ -289,305 +2008,5266 @@ auto main() -> int {
 			.enabledExtensionCount =
 					static_cast<uint32_t>(device_extension_names.size()),
 			.ppEnabledExtensionNames = device_extension_names.data(),
-			.pEnabledFeatures = VK_NULL_HANDLE};
+			.pEnabledFeatures =
+					device_features_chain == VK_NULL_HANDLE ? &enabled_features
+																									: VK_NULL_HANDLE};
+	auto device_group_info =
+			device_group_create_info(device_group, device_info.pNext);
+	if (!device_group.devices.empty()) {
+		device_info.pNext = &device_group_info;
+	}
+	auto device_event = begin_trace_event(trace, "vkCreateDevice");
 	auto* device = VkDevice{};
-	if (vkCreateDevice(
-					physical_device_info.device,
-					&device_info,
-					VK_NULL_HANDLE,
-					&device) != VK_SUCCESS) {
+	auto device_result = vkCreateDevice(
+			physical_device_info.device,
+			&device_info,
+			host_callbacks(),
+			&device);
+	// Raising the priority above the default may take privileges the
+	// process lacks.
+	if (device_result == VK_ERROR_NOT_PERMITTED_KHR && global_priorities) {
+		fmt::print(
+				stderr,
+				"Not permitted to raise the queue priority, using the default\n");
+		for (auto& device_queue_info : queue_create_infos) {
+			device_queue_info.pNext = VK_NULL_HANDLE;
+		}
+		device_result = vkCreateDevice(
+				physical_device_info.device,
+				&device_info,
+				host_callbacks(),
+				&device);
+	}
+	if (device_result != VK_SUCCESS) {
 		fmt::print(stderr, "Failed to create a logical device\n");
 		std::terminate();
 	}
+	load_device_functions(device);
+	end_trace_event(trace, device_event);
+	if (!device_group.devices.empty()) {
+		select_frame_devices(device, !headless, device_group);
+		fmt::print(
+				stderr,
+				"Rendering alternate frames on {} of {} GPUs\n",
+				device_group.frame_devices.size(),
+				device_group.devices.size());
+	}
+	end_startup_phase(benchmark, "device");
 
-	auto vkGetPhysicalDeviceSurfaceCapabilitiesKHR =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR>(
-					vk_func(instance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR"));
-	auto vkGetPhysicalDeviceSurfaceFormatsKHR =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkGetPhysicalDeviceSurfaceFormatsKHR>(
-					vk_func(instance, "vkGetPhysicalDeviceSurfaceFormatsKHR"));
-	auto vkGetPhysicalDeviceSurfacePresentModesKHR =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkGetPhysicalDeviceSurfacePresentModesKHR>(
-					vk_func(instance, "vkGetPhysicalDeviceSurfacePresentModesKHR"));
+	// Everything past this point only needs the device, so file loading and
+	// shader and pipeline compilation run as jobs while the main thread queries
+	// the surface and builds the swap chain. Results are read only after
+	// waiting on the counter that covers them.
+	auto startup_jobs = JobCounter{};
+	auto pipeline_cache_file = pipeline_cache_path(
+			config.cache_dir,
+			physical_device_info.properties);
+	auto* pipeline_cache = VkPipelineCache{};
+	auto shared_pipeline_cache = std::optional<SharedPipelineCache>{};
+	auto cache_event = TraceEvent{};
+	submit_job(*jobs, startup_jobs, [&] {
+		cache_event = start_trace_event("load_pipeline_cache");
+		pipeline_cache = load_pipeline_cache(
+				device,
+				physical_device_info.properties,
+				pipeline_cache_file);
+		if (!config.shared_pipeline_cache_dir.empty()) {
+			shared_pipeline_cache = merge_shared_pipeline_caches(
+					device,
+					pipeline_cache,
+					physical_device_info.properties,
+					config.shared_pipeline_cache_dir);
+		}
+		finish_trace_event(cache_event);
+	});
 	auto capabilities = VkSurfaceCapabilitiesKHR{};
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-			physical_device_info.device,
-			surface,
-			&capabilities);
-	auto format_count = uint32_t{};
-	vkGetPhysicalDeviceSurfaceFormatsKHR(
-			physical_device_info.device,
-			surface,
-			&format_count,
-			VK_NULL_HANDLE);
-	auto formats = std::vector<VkSurfaceFormatKHR>(format_count);
-	vkGetPhysicalDeviceSurfaceFormatsKHR(
-			physical_device_info.device,
-			surface,
-			&format_count,
-			formats.data());
-	auto present_mode_count = uint32_t{};
-	vkGetPhysicalDeviceSurfacePresentModesKHR(
-			physical_device_info.device,
-			surface,
-			&present_mode_count,
-			VK_NULL_HANDLE);
-	auto present_modes = std::vector<VkPresentModeKHR>(present_mode_count);
-	vkGetPhysicalDeviceSurfacePresentModesKHR(
-			physical_device_info.device,
-			surface,
-			&present_mode_count,
-			present_modes.data());
-	if (formats.empty() || present_modes.empty()) {
-		fmt::print(stderr, "Insufficient swap chain support\n");
-		std::terminate();
+	auto formats = std::vector<VkSurfaceFormatKHR>{};
+	auto present_modes = std::vector<VkPresentModeKHR>{};
+	// Offscreen targets use the format the swap chain would most likely get.
+	auto surface_format = VkSurfaceFormatKHR{
+			.format = VK_FORMAT_B8G8R8A8_SRGB,
+			.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+	if (!headless) {
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+				physical_device_info.device,
+				surface,
+				&capabilities);
+		auto format_count = uint32_t{};
+		vkGetPhysicalDeviceSurfaceFormatsKHR(
+				physical_device_info.device,
+				surface,
+				&format_count,
+				VK_NULL_HANDLE);
+		formats.resize(format_count);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(
+				physical_device_info.device,
+				surface,
+				&format_count,
+				formats.data());
+		auto present_mode_count = uint32_t{};
+		vkGetPhysicalDeviceSurfacePresentModesKHR(
+				physical_device_info.device,
+				surface,
+				&present_mode_count,
+				VK_NULL_HANDLE);
+		present_modes.resize(present_mode_count);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(
+				physical_device_info.device,
+				surface,
+				&present_mode_count,
+				present_modes.data());
+		if (formats.empty() || present_modes.empty()) {
+			fmt::print(stderr, "Insufficient swap chain support\n");
+			std::terminate();
+		}
 	}
-
-	auto present_mode = VK_PRESENT_MODE_FIFO_KHR;
-	auto surface_format = VkSurfaceFormatKHR{};
-	auto format_selected = false;
-	for (auto& candidate_format : formats) {
-		if (candidate_format.format == VK_FORMAT_B8G8R8A8_SRGB &&
-				candidate_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-			surface_format = candidate_format;
-			break;
+	// Post-processing draws the scene in HDR and writes the result to an
+	// image of its own, which is blitted to the swap chain image. It is also
+	// what encodes the 10-bit and HDR10 outputs, so those need it.
+	auto post_process_possible =
+			config.post_process && !headless && dynamic_rendering;
+	auto surface_output = SurfaceOutput{
+			.format = surface_format,
+			.transfer = OutputTransfer::hardware_srgb};
+	auto can_post_process = [&](const SurfaceOutput& output) {
+		return post_process_possible &&
+				can_blit_to_swap_chain(
+						physical_device_info.device,
+						post_output_format(output.transfer),
+						VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT,
+						output.format.format,
+						capabilities);
+	};
+	auto post_process = false;
+	if (!headless) {
+		auto selected = select_surface_output(
+				formats,
+				config.output_policy,
+				post_process_possible);
+		if (!selected.has_value()) {
+			fmt::print(
+					stderr,
+					"{} output needs {}a surface format for it, using sdr\n",
+					to_string(config.output_policy),
+					config.output_policy == OutputPolicy::hdr10 ? "--post and " : "");
+			selected = select_surface_output(
+					formats,
+					OutputPolicy::sdr,
+					post_process_possible);
 		}
-		if (!format_selected) {
-			surface_format = candidate_format;
-			format_selected = true;
+		surface_output = *selected;
+		post_process = can_post_process(surface_output);
+		// The 10-bit formats need storage images the device may not have.
+		if (!post_process && output_needs_encoding(surface_output.transfer)) {
+			if (config.output_policy != OutputPolicy::sdr) {
+				fmt::print(
+						stderr,
+						"{} output needs 10-bit storage images, using sdr\n",
+						to_string(config.output_policy));
+			}
+			surface_output =
+					*select_surface_output(formats, OutputPolicy::sdr, false);
+			post_process = can_post_process(surface_output);
 		}
+		surface_format = surface_output.format;
 	}
-
-	if (capabilities.currentExtent.width ==
-			std::numeric_limits<uint32_t>::max()) {
-		fmt::print(stderr, "Display resolution things I can't be bothered with\n");
-		std::terminate();
+	if (config.post_process && !post_process) {
+		fmt::print(
+				stderr,
+				"Post-processing needs a window, dynamic rendering and blits to "
+				"the surface format, drawing without it\n");
 	}
-	auto image_count = capabilities.minImageCount + 1;
-	if (capabilities.maxImageCount > 0 &&
-			image_count > capabilities.maxImageCount) {
-		image_count = capabilities.maxImageCount;
+	// Visibility buffer ids are drawn by pulling.vert without MSAA, and shaded
+	// by a compute pass in place of the fragment shaders' lighting. The pass
+	// writes a scene of its own, which is blitted to the swap chain image
+	// unless post-processing reads it.
+	auto visibility_buffer = config.visibility_buffer && !headless &&
+			dynamic_rendering && vertex_pulling && !mesh_shading &&
+			!indirect_draws && !ray_query && !clustered_lights &&
+			config.msaa_samples <= 1 &&
+			physical_device_info.features.geometryShader == VK_TRUE &&
+			(post_process ||
+			 can_blit_to_swap_chain(
+					 physical_device_info.device,
+					 g_visibility_scene_format,
+					 VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT,
+					 surface_format.format,
+					 capabilities));
+	if (config.visibility_buffer && !visibility_buffer) {
+		fmt::print(
+				stderr,
+				"Visibility buffer shading needs a window, dynamic rendering, "
+				"pulled vertices, direct draws, the plain shading path, no MSAA, "
+				"primitive ids and blits of its scene, shading forward\n");
 	}
-
-	auto queue_family_indices = std::array<uint32_t, 2>{
-			*physical_device_info.graphics_family_idx,
-			*physical_device_info.present_family_idx};
-	auto swap_chain_info = VkSwapchainCreateInfoKHR{
-			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.surface = surface,
-			.minImageCount = image_count,
-			.imageFormat = surface_format.format,
-			.imageColorSpace = surface_format.colorSpace,
-			.imageExtent = capabilities.currentExtent,
-			.imageArrayLayers = 1,
-			.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			.imageSharingMode = physical_device_info.graphics_family_idx ==
-							physical_device_info.present_family_idx
-					? VK_SHARING_MODE_EXCLUSIVE
-					: VK_SHARING_MODE_CONCURRENT,
-			.queueFamilyIndexCount = 2,
-			.pQueueFamilyIndices = queue_family_indices.data(),
-			.preTransform = capabilities.currentTransform,
-			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-			.presentMode = present_mode,
-			.clipped = VK_TRUE,
-			.oldSwapchain = VK_NULL_HANDLE};
-
-	auto* swap_chain = VkSwapchainKHR{};
-	if (vkCreateSwapchainKHR(
-					device,
-					&swap_chain_info,
-					VK_NULL_HANDLE,
-					&swap_chain) != VK_SUCCESS) {
-		fmt::print(stderr, "Failed to create swap chain\n");
-		std::terminate();
+	// The G-buffer is drawn in place of the scene like the visibility buffer,
+	// and lit by a compute pass a screen tile at a time with the lights that
+	// would otherwise be clustered.
+	auto deferred = config.deferred && !headless && dynamic_rendering &&
+			!ray_query && !visibility_buffer && config.msaa_samples <= 1 &&
+			(post_process ||
+			 can_blit_to_swap_chain(
+					 physical_device_info.device,
+					 g_deferred_scene_format,
+					 VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT,
+					 surface_format.format,
+					 capabilities));
+	if (config.deferred && !deferred) {
+		fmt::print(
+				stderr,
+				"Deferred shading needs a window, dynamic rendering, the plain "
+				"shading path, no visibility buffer or MSAA and blits of its "
+				"scene, shading forward\n");
+	}
+	clustered_lights = clustered_lights && !deferred;
+	// Found from the G-buffer, the forward path's depth is never stored.
+	auto ambient_occlusion = config.ambient_occlusion && deferred;
+	if (config.ambient_occlusion && !ambient_occlusion) {
+		fmt::print(
+				stderr,
+				"Ambient occlusion needs deferred shading, drawing without it\n");
+	}
+	// Both have the main pass draw something else than the scene, which a
+	// compute pass then shades from it.
+	auto compute_shading = visibility_buffer || deferred;
+	// The fog is looked up by shader.frag, with the clusters' lights.
+	auto fog = config.fog && clustered_lights && !compute_shading;
+	if (config.fog && !fog) {
+		fmt::print(
+				stderr,
+				"Fog needs clustered lights shaded by the main pass, drawing "
+				"without fog\n");
+	}
+	// Decals are blended in by shader.frag, from the clusters' lists.
+	auto decals = config.decals > 0 && clustered_lights && !compute_shading;
+	if (config.decals > 0 && !decals) {
+		fmt::print(
+				stderr,
+				"Decals need clustered lights shaded by the main pass, drawing "
+				"without decals\n");
+	}
+	// The visibility buffer is the id target picks are read from. Without it,
+	// instanced copies are picked on the CPU through the BVH they are culled
+	// with.
+	auto picking = config.picking && visibility_buffer;
+	auto bvh_picking = config.picking && !picking && hardware_instancing;
+	if (config.picking && !picking && !bvh_picking) {
+		fmt::print(
+				stderr,
+				"Picking needs the visibility buffer or instanced copies, picking "
+				"nothing\n");
+	}
+	// Rates are taken by dynamic rendering only. Content rates are written
+	// from the scene the post passes sample. Visibility ids and G-buffers are
+	// not shaded by the main pass, so coarse rates would only lose triangles.
+	auto shading_rate_policy = config.shading_rate_policy;
+	auto shading_rate_texel = std::optional<VkExtent2D>{};
+	if (shading_rate_policy != ShadingRatePolicy::off &&
+			device_capabilities.fragment_shading_rate && dynamic_rendering &&
+			!compute_shading) {
+		shading_rate_texel = shading_rate_texel_size(physical_device_info.device);
+	}
+	if (shading_rate_policy != ShadingRatePolicy::off &&
+			!shading_rate_texel.has_value()) {
+		fmt::print(
+				stderr,
+				"Variable rate shading needs fragment shading rate images, "
+				"dynamic rendering, compute writes to R8_UINT and the forward "
+				"shading path, shading every pixel\n");
+		shading_rate_policy = ShadingRatePolicy::off;
+	}
+	if (shading_rate_policy == ShadingRatePolicy::content && !post_process) {
+		fmt::print(
+				stderr,
+				"Content driven shading rates need post-processing, foveating\n");
+		shading_rate_policy = ShadingRatePolicy::foveated;
+	}
+	auto shading_rate = shading_rate_policy != ShadingRatePolicy::off;
+	// Left to the driver without asking what it picked when the device cannot
+	// be told.
+	auto image_compression = std::optional<VkImageCompressionFlagsEXT>{};
+	if (device_capabilities.image_compression_control) {
+		image_compression = image_compression_flags(config.image_compression);
+	} else if (config.image_compression != ImageCompressionPolicy::driver) {
+		fmt::print(
+				stderr,
+				"Image compression control needs "
+				"VK_EXT_image_compression_control, leaving it to the driver\n");
+	}
+	auto swap_chain_compression =
+			device_capabilities.swapchain_compression_control
+			? image_compression
+			: std::nullopt;
+	auto swap_chain_maintenance = device_capabilities.swapchain_maintenance1;
+	// Shader objects draw the depth pre-pass while its pipelines compile. They
+	// only draw in dynamic rendering, and not with a shading rate image, which
+	// only pipelines can be told about. Generated draws bind pipelines
+	// themselves, and reloaded shaders would leave the objects stale.
+	auto shader_objects = config.shader_objects &&
+			device_capabilities.shader_object && !mesh_shading &&
+			!generated_draws && !shading_rate && config.shader_source_dir.empty();
+	if (config.shader_objects && !shader_objects) {
+		fmt::print(
+				stderr,
+				"Shader objects need the extension, the vertex shader, no "
+				"generated draws, shading rates or shader reload, skipping the "
+				"pre-pass until it compiles\n");
+	}
+	// The passes outside the bindless table write their sets into descriptor
+	// buffers instead of allocating them from pools.
+	auto descriptor_buffers =
+			config.descriptor_buffers && device_capabilities.descriptor_buffer;
+	if (config.descriptor_buffers && !descriptor_buffers) {
+		fmt::print(
+				stderr,
+				"Descriptor buffers need the extension, allocating sets from "
+				"pools\n");
+	}
+	// Motion vectors are written by the vertex shader paths' MOTION_VECTORS
+	// variants and shader.frag, next to the color. The accumulated scene is
+	// what the post passes read.
+	auto temporal_aa = config.temporal_aa && post_process && !mesh_shading &&
+			!ray_query && !compute_shading && config.msaa_samples <= 1;
+	if (config.temporal_aa && !temporal_aa) {
+		fmt::print(
+				stderr,
+				"Temporal anti-aliasing needs post-processing, vertex shaders, the "
+				"forward shading path and no MSAA, drawing without it\n");
+	}
+	// Particles blend over what the main pass shades, visibility ids are only
+	// shaded after it.
+	auto particles = config.particles > 0 && !compute_shading;
+	if (config.particles > 0 && !particles) {
+		fmt::print(
+				stderr,
+				"Particles need the forward shading path, drawing none\n");
+	}
+	auto particle_subgroup_size = std::optional<uint32_t>{};
+	if (particles && device_capabilities.features2) {
+		particle_subgroup_size = scan_subgroup_size(physical_device_info.device);
+	}
+	if (particles && !particle_subgroup_size.has_value()) {
+		fmt::print(
+				stderr,
+				"Particle compaction needs subgroup arithmetic in compute shaders, "
+				"appending survivors with atomics\n");
+	}
+	// The accumulation is resolved over the scene before the passes that
+	// sample it, at one sample a pixel over the main pass's stored depth.
+	auto weighted_oit = config.weighted_oit && particles && post_process &&
+			dynamic_rendering && config.msaa_samples <= 1;
+	if (config.weighted_oit && !weighted_oit) {
+		fmt::print(
+				stderr,
+				"Order independent transparency needs particles, post-processing, "
+				"dynamic rendering and no MSAA, blending without it\n");
+	}
+	// Points are splatted over the scene the post passes read, which is
+	// written as a storage image like the visibility buffer's.
+	auto point_cloud = !config.point_cloud.empty() && post_process &&
+			device_capabilities.int64_atomics;
+	if (!config.point_cloud.empty() && !point_cloud) {
+		fmt::print(
+				stderr,
+				"Point clouds need post-processing and 64-bit atomics, drawing "
+				"none\n");
+	}
+	// Edges are pulled from the mesh's buffers by the draw's own handles, so
+	// they need the pulled vertices and a draw the main pass records itself.
+	// Batches of indirect draws are culled on the GPU, so their edges are
+	// drawn under conditional rendering on the batch's count, which skips
+	// them when culling left nothing without the CPU ever reading it.
+	auto conditional_rendering = device_capabilities.conditional_rendering &&
+			indirect_draws && !generated_draws;
+	auto lines = config.line_width > 0 && vertex_pulling &&
+			(!indirect_draws || conditional_rendering) && !compute_shading;
+	if (config.line_width > 0 && !lines) {
+		fmt::print(
+				stderr,
+				"Lines need pulled vertices, conditional rendering with indirect "
+				"draws and the forward shading path without generated draws, "
+				"drawing none\n");
+	}
+	conditional_rendering = conditional_rendering && lines;
+	// Blended into the main pass's color, which the visibility buffer's holds
+	// ids in and the G-buffer's surfaces.
+	auto overlay = config.overlay && !compute_shading;
+	if (config.overlay && !overlay) {
+		fmt::print(
+				stderr,
+				"The overlay needs a main pass that shades, drawing none\n");
+	}
+	// The eyes are views of the main pass, drawn by shader.vert's STEREO
+	// variant into the layers of a scene of their own, which is copied side
+	// by side into the swap chain image. The passes after the main one only
+	// read single layer images.
+	auto stereo = config.stereo && !headless && dynamic_rendering &&
+			device_capabilities.multiview && config.microbenchmarks.empty() &&
+			!post_process && !compute_shading && !mesh_shading &&
+			!vertex_pulling && !shading_rate && !shader_objects && !particles;
+	if (config.stereo && !stereo) {
+		fmt::print(
+				stderr,
+				"Stereo needs a window, multiview, dynamic rendering and the "
+				"vertex shader, without post-processing, shading in compute, "
+				"shading rates, shader objects, particles or microbenchmarks, "
+				"drawing one view\n");
+	}
+	// Tested against a pyramid of the scene's depth, which a render pass does
+	// not store and is not single sampled with MSAA or a layer with stereo.
+	// Damage rectangles leave the rest of it from frames before.
+	auto occlusion_culling = config.occlusion_culling && indirect_draws &&
+			dynamic_rendering && config.msaa_samples <= 1 && !stereo &&
+			!config.redraw_on_demand;
+	if (config.occlusion_culling && !occlusion_culling) {
+		fmt::print(
+				stderr,
+				"Occlusion culling needs indirect draws, dynamic rendering and no "
+				"MSAA, stereo or redraw on demand, culling against the frustum\n");
+	}
+	// Drawn into the main pass behind the scene, with a view of its own.
+	auto terrain = !config.terrain.empty() && !compute_shading && !stereo;
+	if (!config.terrain.empty() && !terrain) {
+		fmt::print(
+				stderr,
+				"Terrain needs the forward shading path without stereo, drawing "
+				"none\n");
+	}
+	auto virtual_texture = config.virtual_texture && terrain &&
+			physical_device_info.features.fragmentStoresAndAtomics == VK_TRUE;
+	if (config.virtual_texture && !virtual_texture) {
+		fmt::print(
+				stderr,
+				"The virtual texture needs the terrain and fragment shader stores, "
+				"shading the terrain without it\n");
+	}
+	// Distant instances are sorted out of the instance stream after culling,
+	// and drawn into the main pass like the mesh.
+	auto impostors = config.impostor_pixels > 0 && hardware_instancing &&
+			!compute_shading && !stereo;
+	if (config.impostor_pixels > 0 && !impostors) {
+		fmt::print(
+				stderr,
+				"Impostors need instancing and the forward shading path without "
+				"stereo, drawing every instance as a mesh\n");
+	}
+	// Skinned positions stand in for the mesh's in the handles the draws
+	// push, which only the pulled draws recorded here read. The rig is made
+	// from the generated mesh's data, cooked meshes are never read back.
+	auto skinning = config.skin_joints > 0 && vertex_pulling &&
+			mesh_layout != VertexLayout::quantized && config.mesh.empty() &&
+			!generated_draws && !mesh_shading && !visibility_buffer && !ray_query;
+	if (config.skin_joints > 0 && !skinning) {
+		fmt::print(
+				stderr,
+				"Skinning needs pulled vertices of the generated mesh, unquantized "
+				"and without generated draws, mesh shaders, the visibility buffer "
+				"or ray queries, drawing it rigid\n");
+	}
+	// Faces are drawn with the scene's shaders from a transform their draws
+	// push, so they take plain draws of the forward path whose shaders read
+	// nothing tied to the main view or to other passes.
+	auto reflection_probes = config.reflection_probes > 0 &&
+			dynamic_rendering && !compute_shading && !mesh_shading && !stereo &&
+			!temporal_aa && !clustered_lights && !indirect_draws &&
+			!hardware_instancing && !skinning;
+	if (config.reflection_probes > 0 && !reflection_probes) {
+		fmt::print(
+				stderr,
+				"Reflection probes need dynamic rendering and plain draws of the "
+				"forward shading path, without mesh shaders, stereo, temporal "
+				"antialiasing, light clusters, instancing, indirect draws or "
+				"skinning, rendering none\n");
+	}
+	// The sun is shaded by shader.frag with the cluster lights. Its cascades
+	// are drawn like probe faces: plain draws of the forward path with a
+	// transform their draws push, by the depth-only stages.
+	auto shadows = config.shadows && clustered_lights && !visibility_buffer &&
+			!deferred && dynamic_rendering && !compute_shading && !mesh_shading &&
+			!stereo && !indirect_draws && !hardware_instancing && !skinning &&
+			shadow_maps_supported(physical_device_info.device);
+	if (config.shadows && !shadows) {
+		fmt::print(
+				stderr,
+				"Shadows need light clusters in the forward shading path, dynamic "
+				"rendering, plain draws without mesh shaders, stereo, instancing, "
+				"indirect draws or skinning, and a depth format to sample, "
+				"lighting without them\n");
+	}
+	auto scene_format = surface_format.format;
+	if (post_process) {
+		scene_format = g_post_scene_format;
+	} else if (visibility_buffer) {
+		scene_format = g_visibility_scene_format;
+	} else if (deferred) {
+		scene_format = g_deferred_scene_format;
+	}
+	// The format the main pass draws to.
+	auto raster_format = scene_format;
+	if (visibility_buffer) {
+		raster_format = g_visibility_format;
+	} else if (deferred) {
+		raster_format = g_gbuffer_format;
 	}
-	vkGetSwapchainImagesKHR(device, swap_chain, &image_count, VK_NULL_HANDLE);
-	auto swap_chain_images = std::vector<VkImage>(image_count);
-	vkGetSwapchainImagesKHR(
-			device,
-			swap_chain,
-			&image_count,
-			swap_chain_images.data());
 
-	auto swap_chain_views = std::vector<VkImageView>(image_count);
-	for (auto& image : swap_chain_images) {
-		auto view_info = VkImageViewCreateInfo{
-				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-				.pNext = VK_NULL_HANDLE,
-				.flags = 0,
-				.image = image,
-				.viewType = VK_IMAGE_VIEW_TYPE_2D,
-				.format = surface_format.format,
-				.components =
-						VkComponentMapping{
-								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
-				.subresourceRange = VkImageSubresourceRange{
-						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-						.baseMipLevel = 0,
-						.levelCount = 1,
-						.baseArrayLayer = 0,
-						.layerCount = 1}};
-		auto* view = VkImageView{};
-		if (vkCreateImageView(device, &view_info, VK_NULL_HANDLE, &view) !=
-				VK_SUCCESS) {
-			fmt::print(
-					stderr,
-					"Failed to create an image view for a swap chain images");
-			std::terminate();
+	auto* vert_shader_module = VkShaderModule{};
+	auto* frag_shader_module = VkShaderModule{};
+	auto* draw_list_shader_module = VkShaderModule{};
+	auto* task_shader_module = VkShaderModule{};
+	auto* mesh_shader_module = VkShaderModule{};
+	auto* bloom_downsample_shader_module = VkShaderModule{};
+	auto* bloom_blur_shader_module = VkShaderModule{};
+	auto* post_composite_shader_module = VkShaderModule{};
+	auto* light_cluster_shader_module = VkShaderModule{};
+	auto* visibility_shader_module = VkShaderModule{};
+	auto* deferred_shader_module = VkShaderModule{};
+	auto* fog_scatter_shader_module = VkShaderModule{};
+	auto* ambient_occlusion_shader_module = VkShaderModule{};
+	auto* depth_pyramid_shader_module = VkShaderModule{};
+	auto* fog_integrate_shader_module = VkShaderModule{};
+	auto* shading_rate_shader_module = VkShaderModule{};
+	auto* temporal_shader_module = VkShaderModule{};
+	auto* particles_shader_module = VkShaderModule{};
+	auto* radix_sort_shader_module = VkShaderModule{};
+	auto* scan_shader_module = VkShaderModule{};
+	auto* particle_vert_shader_module = VkShaderModule{};
+	auto* particle_frag_shader_module = VkShaderModule{};
+	auto* oit_composite_shader_module = VkShaderModule{};
+	auto* decompress_shader_module = VkShaderModule{};
+	auto* downsample_shader_module = VkShaderModule{};
+	auto* environment_specular_shader_module = VkShaderModule{};
+	auto* environment_brdf_lut_shader_module = VkShaderModule{};
+	auto* environment_irradiance_shader_module = VkShaderModule{};
+	auto* environment_cube_shader_module = VkShaderModule{};
+	auto* point_splat_shader_module = VkShaderModule{};
+	auto* point_resolve_shader_module = VkShaderModule{};
+	auto* line_vert_shader_module = VkShaderModule{};
+	auto* line_frag_shader_module = VkShaderModule{};
+	auto* terrain_vert_shader_module = VkShaderModule{};
+	auto* terrain_frag_shader_module = VkShaderModule{};
+	auto* impostor_vert_shader_module = VkShaderModule{};
+	auto* impostor_frag_shader_module = VkShaderModule{};
+	auto* skinning_shader_module = VkShaderModule{};
+	auto* instance_copy_shader_module = VkShaderModule{};
+	auto* overlay_vert_shader_module = VkShaderModule{};
+	auto* overlay_frag_shader_module = VkShaderModule{};
+	// Every variant is embedded, but only the ones this run draws with get
+	// modules.
+	auto vertex_variant = hardware_instancing ? g_shader_variant_instanced
+																						: ShaderVariant{};
+	auto frag_variant = clustered_lights ? g_shader_variant_clustered_lights
+																			 : ShaderVariant{};
+	if (temporal_aa) {
+		vertex_variant |= vertex_pulling ? g_shader_variant_pulled_motion_vectors
+																		 : g_shader_variant_motion_vectors;
+		frag_variant |= g_shader_variant_motion_vectors;
+	}
+	if (stereo) {
+		vertex_variant |= g_shader_variant_stereo;
+	}
+	// Colors and light weights are fine with 16-bit floats, positions and
+	// depths stay 32-bit.
+	auto half_variant = device_capabilities.shader_float16
+			? g_shader_variant_half_float
+			: ShaderVariant{};
+	auto frag_shader = ray_query ? Shader::ray_query_frag : Shader::shader_frag;
+	if (visibility_buffer) {
+		frag_shader = Shader::visibility_frag;
+	} else if (deferred) {
+		frag_shader = Shader::gbuffer_frag;
+	}
+	if (frag_shader == Shader::shader_frag) {
+		frag_variant |= half_variant;
+	}
+	if (fog) {
+		frag_variant |= g_shader_variant_fog;
+	}
+	if (shadows) {
+		frag_variant |= g_shader_variant_shadows;
+	}
+	auto shader_jobs = std::vector<ShaderJob>{
+			ShaderJob{
+					.shader =
+							vertex_pulling ? Shader::pulling_vert : Shader::shader_vert,
+					.variant = vertex_variant,
+					.module = &vert_shader_module},
+			ShaderJob{
+					.shader = frag_shader,
+					.variant = frag_variant,
+					.module = &frag_shader_module},
+			ShaderJob{
+					.shader = Shader::draw_list_comp,
+					.variant = 0,
+					.module = &draw_list_shader_module},
+	};
+	// Mesh shader SPIR-V is only valid on devices with the extension.
+	if (mesh_shading) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::meshlet_task,
+				.variant = 0,
+				.module = &task_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::meshlet_mesh,
+				.variant = 0,
+				.module = &mesh_shader_module});
+	}
+	if (clustered_lights) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::light_cluster_comp,
+				.variant = 0,
+				.module = &light_cluster_shader_module});
+	}
+	if (visibility_buffer) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::visibility_shade_comp,
+				.variant = visibility_shade_variant(physical_device_info.device),
+				.module = &visibility_shader_module});
+	}
+	if (deferred) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::deferred_lighting_comp,
+				.variant = ambient_occlusion ? g_shader_variant_ambient_occlusion
+																		 : ShaderVariant{},
+				.module = &deferred_shader_module});
+	}
+	if (ambient_occlusion) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::ambient_occlusion_comp,
+				.variant = 0,
+				.module = &ambient_occlusion_shader_module});
+	}
+	if (occlusion_culling) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::depth_pyramid_comp,
+				.variant = 0,
+				.module = &depth_pyramid_shader_module});
+	}
+	if (fog) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::fog_scatter_comp,
+				.variant = 0,
+				.module = &fog_scatter_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::fog_integrate_comp,
+				.variant = 0,
+				.module = &fog_integrate_shader_module});
+	}
+	if (shading_rate) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::shading_rate_comp,
+				.variant = shading_rate_policy == ShadingRatePolicy::content
+						? g_shader_variant_content_rate
+						: ShaderVariant{},
+				.module = &shading_rate_shader_module});
+	}
+	if (temporal_aa) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::temporal_comp,
+				.variant = 0,
+				.module = &temporal_shader_module});
+	}
+	if (particles) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::particles_comp,
+				.variant = 0,
+				.module = &particles_shader_module});
+		if (!weighted_oit) {
+			shader_jobs.emplace_back(ShaderJob{
+					.shader = Shader::radix_sort_comp,
+					.variant = 0,
+					.module = &radix_sort_shader_module});
 		}
-		swap_chain_views.emplace_back(view);
+		if (particle_subgroup_size.has_value()) {
+			shader_jobs.emplace_back(ShaderJob{
+					.shader = Shader::scan_comp,
+					.variant = 0,
+					.module = &scan_shader_module});
+		}
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::particle_vert,
+				.variant = 0,
+				.module = &particle_vert_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::particle_frag,
+				.variant = weighted_oit ? g_shader_variant_weighted_oit
+																: ShaderVariant{},
+				.module = &particle_frag_shader_module});
+	}
+	if (weighted_oit) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::oit_composite_comp,
+				.variant = 0,
+				.module = &oit_composite_shader_module});
+	}
+	// Whether the mesh is compressed is only known once it is read.
+	if (!config.mesh.empty()) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::decompress_comp,
+				.variant = 0,
+				.module = &decompress_shader_module});
+	}
+	// Whether the texture asks for its chain to be generated is only known
+	// once it is read.
+	auto generate_texture_levels = !config.texture.empty() &&
+			device_capabilities.features2 && api_version >= VK_API_VERSION_1_1;
+	if (generate_texture_levels) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::downsample_comp,
+				.variant = downsample_variant(physical_device_info.device),
+				.module = &downsample_shader_module});
+	}
+	// Whether the environment's cache is valid is only known once it is
+	// hashed. Reflection probes prefilter through the same pipelines.
+	if (!config.environment.empty() || reflection_probes) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::environment_prefilter_comp,
+				.variant = 0,
+				.module = &environment_specular_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::environment_prefilter_comp,
+				.variant = g_shader_variant_brdf_lut,
+				.module = &environment_brdf_lut_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::environment_irradiance_comp,
+				.variant = 0,
+				.module = &environment_irradiance_shader_module});
+	}
+	if (reflection_probes) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::environment_prefilter_comp,
+				.variant = g_shader_variant_cube_source,
+				.module = &environment_cube_shader_module});
+	}
+	if (post_process) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::bloom_downsample_comp,
+				.variant = 0,
+				.module = &bloom_downsample_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::bloom_blur_comp,
+				.variant = 0,
+				.module = &bloom_blur_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::post_composite_comp,
+				.variant =
+						post_composite_variant(surface_output.transfer) | half_variant,
+				.module = &post_composite_shader_module});
+	}
+	if (point_cloud) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::point_splat_comp,
+				.variant = 0,
+				.module = &point_splat_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::point_splat_comp,
+				.variant = g_shader_variant_point_resolve,
+				.module = &point_resolve_shader_module});
+	}
+	if (lines) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::line_vert,
+				.variant = 0,
+				.module = &line_vert_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::line_frag,
+				.variant = 0,
+				.module = &line_frag_shader_module});
+	}
+	if (overlay) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::overlay_vert,
+				.variant = 0,
+				.module = &overlay_vert_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::overlay_frag,
+				.variant = 0,
+				.module = &overlay_frag_shader_module});
+	}
+	if (terrain) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::terrain_vert,
+				.variant = 0,
+				.module = &terrain_vert_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::terrain_frag,
+				.variant = virtual_texture ? g_shader_variant_virtual_texture
+																	 : ShaderVariant{},
+				.module = &terrain_frag_shader_module});
+	}
+	if (impostors) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::impostor_vert,
+				.variant = 0,
+				.module = &impostor_vert_shader_module});
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::impostor_frag,
+				.variant = 0,
+				.module = &impostor_frag_shader_module});
+	}
+	if (skinning) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::skinning_comp,
+				.variant = 0,
+				.module = &skinning_shader_module});
+	}
+	if (hardware_instancing) {
+		shader_jobs.emplace_back(ShaderJob{
+				.shader = Shader::instance_copy_comp,
+				.variant = 0,
+				.module = &instance_copy_shader_module});
+	}
+	auto shader_events = std::vector<TraceEvent>(shader_jobs.size());
+	// The pipeline layout and vertex input are checked against what the
+	// shaders declare once they are loaded.
+	auto shader_reflections = std::vector<ShaderReflection>(shader_jobs.size());
+	// Graphics shaders that have an identifier from the last run get no
+	// module, their pipelines are looked up in the pipeline cache by the
+	// identifier. Their SPIR-V stays loaded for the compiles the cache misses.
+	// Reloading shaders replaces modules, so it needs them all.
+	auto module_identifiers = device_capabilities.shader_module_identifier &&
+			config.shader_source_dir.empty();
+	auto shader_identifier_file = config.cache_dir / "shader_identifiers.txt";
+	auto stored_identifiers = ShaderIdentifiers{};
+	if (module_identifiers) {
+		stored_identifiers = load_shader_identifiers(
+				shader_identifier_file,
+				query_identifier_algorithm(physical_device_info.device));
+	}
+	auto shader_identifiers = std::vector<ShaderIdentifier>(shader_jobs.size());
+	auto identified_shaders = std::vector<ShaderBlob>(shader_jobs.size());
+	for (auto i = size_t{}; i < shader_jobs.size(); i++) {
+		submit_job(*jobs, startup_jobs, [&, i] {
+			const auto& job = shader_jobs.at(i);
+			shader_events.at(i) = start_trace_event(shader_file_name(job.shader));
+			auto shader_src =
+					load_shader(job.shader, job.variant, assets, config.shader_dir);
+			shader_reflections.at(i) = reflect_shader(shader_src.code);
+			auto identified = module_identifiers &&
+					shader_reflections.at(i).stage != VK_SHADER_STAGE_COMPUTE_BIT;
+			auto stored = identified
+					? stored_identifiers.identifiers.find(
+								shader_binary_name(job.shader, job.variant))
+					: stored_identifiers.identifiers.end();
+			if (stored != stored_identifiers.identifiers.end()) {
+				shader_identifiers.at(i) = stored->second;
+				identified_shaders.at(i) = std::move(shader_src);
+			} else {
+				*job.module = create_shader_modules(device, shader_src.code);
+				name_object(
+						device,
+						VK_OBJECT_TYPE_SHADER_MODULE,
+						*job.module,
+						shader_file_name(job.shader));
+				if (identified) {
+					shader_identifiers.at(i) =
+							get_shader_identifier(device, *job.module);
+				}
+				release_shader(shader_src);
+			}
+			finish_trace_event(shader_events.at(i));
+		});
 	}
 
-	auto vert_shader_src = read_file("shaders/shader.vert.spv");
-	auto* vert_shader_module = create_shader_modules(device, vert_shader_src);
-	auto frag_shader_src = read_file("shaders/shader.frag.spv");
-	auto* frag_shader_module = create_shader_modules(device, frag_shader_src);
-	auto shader_stages = std::array<VkPipelineShaderStageCreateInfo, 2>{
-			create_pipeline_shader_info(
-					vert_shader_module,
-					VK_SHADER_STAGE_VERTEX_BIT),
-			create_pipeline_shader_info(
-					frag_shader_module,
-					VK_SHADER_STAGE_FRAGMENT_BIT)};
+	auto depth_format = select_depth_format(physical_device_info.device);
+	auto samples = select_sample_count(
+			physical_device_info.properties.limits,
+			config.msaa_samples);
+	auto msaa = samples != VK_SAMPLE_COUNT_1_BIT;
+	if (static_cast<uint32_t>(samples) != config.msaa_samples) {
+		fmt::print(
+				stderr,
+				"{}x MSAA is not supported, using {}x\n",
+				config.msaa_samples,
+				static_cast<uint32_t>(samples));
+	}
+	// The scene is drawn at a lower resolution into a target of its own and
+	// blitted to the swap chain image, timed with the main pass's timestamps.
+	auto timestamps =
+			physical_device_info.properties.limits.timestampComputeAndGraphics ==
+					VK_TRUE &&
+			physical_device_info.queue_families
+							.at(*physical_device_info.graphics_family_idx)
+							.timestampValidBits != 0;
+	auto dynamic_resolution = config.dynamic_resolution != 0 && !headless &&
+			dynamic_rendering && timestamps && !stereo &&
+			can_blit_to_swap_chain(
+					physical_device_info.device,
+					post_process ? post_output_format(surface_output.transfer)
+											 : surface_format.format,
+					post_process ? VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT
+											 : VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT,
+					surface_format.format,
+					capabilities);
+	if (config.dynamic_resolution != 0 && !dynamic_resolution) {
+		fmt::print(
+				stderr,
+				"Dynamic resolution needs a window, dynamic rendering, GPU "
+				"timestamps, blits of the surface format and no stereo, rendering "
+				"at full resolution\n");
+	}
+	// At full resolution the composite writes the swap chain image directly
+	// when it can, instead of an image of its own blitted over at the end of
+	// the frame.
+	auto direct_post_output = post_process && !dynamic_resolution &&
+			can_store_to_swap_chain(
+					physical_device_info.device,
+					surface_output.transfer,
+					surface_format.format,
+					capabilities);
+	if (direct_post_output) {
+		fmt::print("Post-processing straight into the swap chain images\n");
+	}
+	auto blits_to_target = dynamic_resolution ||
+			(post_process ? !direct_post_output : compute_shading);
+	auto swap_chain_usage =
+			VkImageUsageFlags{VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+	if (direct_post_output) {
+		swap_chain_usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	if (blits_to_target || stereo) {
+		swap_chain_usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+	// Captures copy the target out after everything else drew into it.
+	// Offscreen targets always allow that.
+	auto target_copyable = headless ||
+			(capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+	auto capturing = !config.capture.empty() && target_copyable &&
+			capture_supported(surface_format.format);
+	if (!config.capture.empty() && !capturing) {
+		fmt::print(
+				stderr,
+				"Capture needs an 8-bit or 10-bit target that allows copies, "
+				"capturing nothing\n");
+	}
+	// Further windows are blitted to from the first window's images. Their
+	// images would have to be presented from every GPU of a device group.
+	auto mirroring = window != nullptr && config.windows > 1 &&
+			target_copyable && device_group.devices.empty();
+	if (window != nullptr && config.windows > 1 && !mirroring) {
+		fmt::print(
+				stderr,
+				"Further windows need swap chain images that allow copies and a "
+				"single GPU, opening one\n");
+	}
+	if (capturing || mirroring) {
+		swap_chain_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	// Captures and further windows copy the images as they are, which would
+	// be rotated.
+	// Stereo's eyes are side by side on the display, not in the image.
+	auto pre_rotated = config.pre_rotate && !headless && !capturing &&
+			!mirroring && !stereo;
+	if (config.pre_rotate && !pre_rotated) {
+		fmt::print(
+				stderr,
+				"Pre-rotation needs a window and no captures, further windows or "
+				"stereo, leaving rotation to the display\n");
+	}
+	// Only the main pass is limited to the damage, so drawing just the damage
+	// needs the scene drawn straight into the swap chain images, and the
+	// damage only covers what changes with the camera. Other frames are drawn
+	// in full once something changed.
+	auto redraw_on_demand =
+			config.redraw_on_demand && !headless && !benchmarking;
+	auto damage_tracking = redraw_on_demand && !post_process &&
+			!dynamic_resolution && !compute_shading && !particles && !stereo;
+	if (config.redraw_on_demand && !redraw_on_demand) {
+		fmt::print(
+				stderr,
+				"Redraw on demand needs a window and no benchmark, drawing every "
+				"frame\n");
+	} else if (redraw_on_demand && !damage_tracking) {
+		fmt::print(
+				stderr,
+				"Damage rectangles need the scene drawn straight into the swap "
+				"chain and no particles, redrawing whole frames on demand\n");
+	}
+	auto incremental_present =
+			damage_tracking && device_capabilities.incremental_present;
+	// The post passes sample the scene, the blit otherwise reads it. The
+	// visibility buffer's and the G-buffer's scenes are written by their
+	// shading passes, and points are resolved into it.
+	auto scene_target_usage =
+			VkImageUsageFlags{VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+	// The depth pyramid is built from the scene's depth.
+	auto scene_depth_usage = occlusion_culling
+			? VkImageUsageFlags{VK_IMAGE_USAGE_SAMPLED_BIT}
+			: VkImageUsageFlags{};
+	scene_target_usage |= post_process ? VK_IMAGE_USAGE_SAMPLED_BIT
+																		 : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	if (compute_shading || point_cloud) {
+		scene_target_usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	auto vertex_input = vertex_pulling ? VertexInputDescription{}
+																		 : vertex_input_description(mesh_layout);
+	if (hardware_instancing) {
+		add_instance_input(vertex_input);
+	}
+	auto raster_state = RasterState{};
 
-	auto vertex_input_state_info = VkPipelineVertexInputStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.vertexBindingDescriptionCount = 0,
-			.pVertexBindingDescriptions = VK_NULL_HANDLE,
-			.vertexAttributeDescriptionCount = 0,
-			.pVertexAttributeDescriptions = VK_NULL_HANDLE};
+	auto allocator = create_allocator(
+			physical_device_info.properties,
+			physical_device_info.memory_properties,
+			vertex_pulling || ray_query || descriptor_buffers,
+			device_capabilities.memory_priority);
+	if (allocator.resizable_bar) {
+		fmt::print(stderr, "Writing dynamic buffers to device local memory\n");
+	}
+	// Sets of the passes outside the bindless table, reset once per frame.
+	auto frame_descriptors = create_descriptor_allocator(
+			device,
+			allocator,
+			physical_device_info.device,
+			g_frames_in_flight,
+			descriptor_buffers);
+	// Samplers of the passes, shared where they sample alike.
+	auto samplers = SamplerCache{};
+	auto uniform_ring = create_uniform_ring(
+			device,
+			allocator,
+			physical_device_info.properties.limits,
+			g_frames_in_flight,
+			g_uniform_frame_size);
+	auto bindless = create_bindless_table(
+			device,
+			physical_device_info.properties.limits,
+			device_capabilities.descriptor_indexing,
+			ray_query);
+	auto uniform_buffer = add_bindless_buffer(
+			device,
+			bindless,
+			uniform_ring.buffer.handle,
+			0,
+			VK_WHOLE_SIZE);
 
-	auto input_assembly_state_info = VkPipelineInputAssemblyStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-			.primitiveRestartEnable = VK_FALSE};
-
-	auto viewport = VkViewport{
-			.x = 0,
-			.y = 0,
-			.width = static_cast<float>(capabilities.currentExtent.width),
-			.height = static_cast<float>(capabilities.currentExtent.height),
-			.minDepth = 0,
-			.maxDepth = 1};
-	auto scissor = VkRect2D{
-			.offset = VkOffset2D{.x = 0, .y = 0},
-			.extent = capabilities.currentExtent};
-	auto viewport_state_info = VkPipelineViewportStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
+	auto color_attachment = VkAttachmentDescription{
 			.flags = 0,
-			.viewportCount = 1,
-			.pViewports = &viewport,
-			.scissorCount = 1,
-			.pScissors = &scissor};
-
-	auto rasterizer = VkPipelineRasterizationStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
+			.format = surface_format.format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	// Depth is only needed within the pass, so it is never stored.
+	auto depth_attachment = VkAttachmentDescription{
 			.flags = 0,
-			.depthClampEnable = VK_FALSE,
-			.rasterizerDiscardEnable = VK_FALSE,
-			.polygonMode = VK_POLYGON_MODE_FILL,
-			.cullMode = VK_CULL_MODE_BACK_BIT,
-			.frontFace = VK_FRONT_FACE_CLOCKWISE,
-			.depthBiasEnable = VK_FALSE,
-			.depthBiasConstantFactor = 0,
-			.depthBiasClamp = 0,
-			.depthBiasSlopeFactor = 0,
-			.lineWidth = 1};
-
-	auto multisampling = VkPipelineMultisampleStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
+			.format = depth_format,
+			.samples = samples,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+	auto attachments = std::vector{color_attachment, depth_attachment};
+	// With MSAA the target becomes the resolve attachment, and the
+	// multisampled color drawn in its place is discarded like depth.
+	if (msaa) {
+		attachments.emplace_back(color_attachment);
+		attachments.front().samples = samples;
+		attachments.front().storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments.back().loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	}
+	auto color_attachment_ref = VkAttachmentReference{
+			.attachment = 0,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	auto depth_attachment_ref = VkAttachmentReference{
+			.attachment = 1,
+			.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+	auto resolve_attachment_ref = VkAttachmentReference{
+			.attachment = 2,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	auto subpass = VkSubpassDescription{
 			.flags = 0,
-			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-			.sampleShadingEnable = VK_FALSE,
-			.minSampleShading = 0,
-			.pSampleMask = VK_NULL_HANDLE,
-			.alphaToCoverageEnable = VK_FALSE,
-			.alphaToOneEnable = VK_FALSE};
-
-	auto color_blend_attachment = VkPipelineColorBlendAttachmentState{
-			.blendEnable = VK_FALSE,
-			.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.colorBlendOp = VK_BLEND_OP_ADD,
-			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.alphaBlendOp = VK_BLEND_OP_ADD,
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-					VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
-	auto color_blending = VkPipelineColorBlendStateCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.inputAttachmentCount = 0,
+			.pInputAttachments = VK_NULL_HANDLE,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &color_attachment_ref,
+			.pResolveAttachments = msaa ? &resolve_attachment_ref : VK_NULL_HANDLE,
+			.pDepthStencilAttachment = &depth_attachment_ref,
+			.preserveAttachmentCount = 0,
+			.pPreserveAttachments = VK_NULL_HANDLE};
+	// The render graph does the layout transitions and the synchronization
+	// with the rest of the frame, so the pass needs no dependencies.
+	auto render_pass_info = VkRenderPassCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
-			.logicOpEnable = VK_FALSE,
-			.logicOp = VK_LOGIC_OP_COPY,
-			.attachmentCount = 1,
-			.pAttachments = &color_blend_attachment,
-			.blendConstants = {0, 0, 0, 0}};
-
-	auto pipeline_layout_info = VkPipelineLayoutCreateInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-	auto* pipeline_layout = VkPipelineLayout{};
-	if (vkCreatePipelineLayout(
-					device,
-					&pipeline_layout_info,
-					nullptr,
-					&pipeline_layout) != VK_SUCCESS) {
-		fmt::print("Failed to create pipeline layout\n");
+			.attachmentCount = static_cast<uint32_t>(attachments.size()),
+			.pAttachments = attachments.data(),
+			.subpassCount = 1,
+			.pSubpasses = &subpass,
+			.dependencyCount = 0,
+			.pDependencies = VK_NULL_HANDLE};
+	auto* render_pass = VkRenderPass{};
+	if (!dynamic_rendering &&
+			vkCreateRenderPass(
+					device,
+					&render_pass_info,
+					host_callbacks(),
+					&render_pass) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create render pass\n");
 		std::terminate();
 	}
-
-	auto* graphics_queue = VkQueue{};
-	vkGetDeviceQueue(
-			device,
-			*physical_device_info.graphics_family_idx,
-			0,
-			&graphics_queue);
-
-	auto* present_queue = VkQueue{};
-	vkGetDeviceQueue(
+	auto wait_event = begin_trace_event(trace, "wait_shaders");
+	wait_for_counter(*jobs, startup_jobs);
+	end_trace_event(trace, wait_event);
+	add_trace_event(trace, cache_event);
+	for (auto& event : shader_events) {
+		add_trace_event(trace, event);
+	}
+	// Push constants go to the graphics stages that declare them, and every
+	// pipeline drawn with shares the one layout the cache hands out for them.
+	auto graphics_reflections = std::vector<ShaderReflection>{};
+	std::copy_if(
+			shader_reflections.begin(),
+			shader_reflections.end(),
+			std::back_inserter(graphics_reflections),
+			[](const ShaderReflection& reflection) {
+				return reflection.stage != VK_SHADER_STAGE_COMPUTE_BIT;
+			});
+	// Every draw pushes all of DrawHandles, which stages declaring fewer of
+	// its fields ignore the end of.
+	auto push_constant_range = reflect_push_constant_range(
+			graphics_reflections,
+			sizeof(DrawHandles));
+	auto bindless_bindings = std::vector{
+			ShaderBinding{
+					.set = 0,
+					.binding = bindless.images.binding,
+					.type = bindless.images.type},
+			ShaderBinding{
+					.set = 0,
+					.binding = bindless.buffers.binding,
+					.type = bindless.buffers.type},
+			ShaderBinding{
+					.set = 0,
+					.binding = bindless.samplers.binding,
+					.type = bindless.samplers.type},
+	};
+	if (ray_query) {
+		bindless_bindings.emplace_back(ShaderBinding{
+				.set = 0,
+				.binding = g_bindless_scene_binding,
+				.type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR});
+	}
+	for (const auto& reflection : graphics_reflections) {
+		if (!shader_fits_layout(
+						reflection,
+						bindless_bindings,
+						push_constant_range)) {
+			std::terminate();
+		}
+		if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+			match_vertex_input(reflection, vertex_input);
+		}
+	}
+	auto pipeline_layouts = PipelineLayoutCache{};
+	auto* pipeline_layout = get_pipeline_layout(
 			device,
-			*physical_device_info.present_family_idx,
-			0,
-			&present_queue);
-
-	glfwSetKeyCallback(window, glfw_key_callback);
-	while (glfwWindowShouldClose(window) == GLFW_FALSE) {
-		glfwWaitEvents();
+			pipeline_layouts,
+			std::span{&bindless.set_layout, 1},
+			std::span{&push_constant_range, 1});
+	auto bindless_constants = make_specialization_constants(
+			bindless.images.capacity,
+			bindless.buffers.capacity,
+			bindless.samplers.capacity);
+	auto bindless_specialization = specialization_info(bindless_constants);
+	// Only pulling.vert decodes quantized vertices itself, vertex input does it
+	// for shader.vert. It also reads last frame's skinned positions for the
+	// motion vectors.
+	auto vertex_constants = make_specialization_constants(
+			bindless.images.capacity,
+			bindless.buffers.capacity,
+			bindless.samplers.capacity,
+			VkBool32{mesh_layout == VertexLayout::quantized},
+			VkBool32{skinning});
+	auto vertex_specialization = specialization_info(vertex_constants);
+	// A graphics shader's stage, from its module or from the identifier that
+	// stands in for it.
+	auto shader_stage = [&](
+			VkShaderStageFlagBits stage,
+			const VkShaderModule& module,
+			const VkSpecializationInfo* specialization) {
+		auto job = std::find_if(
+				shader_jobs.begin(),
+				shader_jobs.end(),
+				[&](const ShaderJob& candidate) {
+					return candidate.module == &module;
+				});
+		auto i = static_cast<size_t>(std::distance(shader_jobs.begin(), job));
+		auto identified = module == VK_NULL_HANDLE;
+		return PipelineShaderStage{
+				.stage = stage,
+				.module = module,
+				.specialization = copy_specialization(specialization),
+				.identifier =
+						identified ? shader_identifiers.at(i) : ShaderIdentifier{},
+				.code = identified_shaders.at(i).code};
+	};
+	// Raster state is baked in unless it is dynamic, viewport and scissor always
+	// are. The fragment shader goes last, so the depth pre-pass can drop it.
+	auto shading_state = GraphicsPipelineState{
+			.stages = {},
+			.bindings = vertex_input.bindings,
+			.attributes = vertex_input.attributes,
+			.raster = raster_state,
+			.extended_dynamic_state = extended_dynamic_state,
+			.samples = samples,
+			.depth_write = VK_TRUE,
+			.depth_compare = g_depth_compare_op,
+			.color_write_mask = VK_COLOR_COMPONENT_R_BIT |
+					VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
+					VK_COLOR_COMPONENT_A_BIT,
+			.color_format = raster_format,
+			.depth_format = depth_format,
+			.motion_format = temporal_aa ? g_motion_format : VK_FORMAT_UNDEFINED,
+			.shading_rate_attachment = shading_rate,
+			.view_mask = stereo ? g_stereo_view_mask : 0U,
+			.render_pass = render_pass,
+			.layout = pipeline_layout,
+			.name = "shading"};
+	if (mesh_shading) {
+		shading_state.stages.emplace_back(shader_stage(
+				VK_SHADER_STAGE_TASK_BIT_EXT,
+				task_shader_module,
+				&bindless_specialization));
+		shading_state.stages.emplace_back(shader_stage(
+				VK_SHADER_STAGE_MESH_BIT_EXT,
+				mesh_shader_module,
+				&vertex_specialization));
+	} else {
+		shading_state.stages.emplace_back(shader_stage(
+				VK_SHADER_STAGE_VERTEX_BIT,
+				vert_shader_module,
+				&vertex_specialization));
 	}
-
-	vkDestroyPipelineLayout(device, pipeline_layout, VK_NULL_HANDLE);
-	vkDestroyShaderModule(device, vert_shader_module, VK_NULL_HANDLE);
-	vkDestroyShaderModule(device, frag_shader_module, VK_NULL_HANDLE);
-	for (auto& view : swap_chain_views) {
-		vkDestroyImageView(device, view, VK_NULL_HANDLE);
+	shading_state.stages.emplace_back(shader_stage(
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			frag_shader_module,
+			&bindless_specialization));
+	// The pre-pass runs the vertex shader alone, the shading pipeline's depth
+	// only has to be equal because both transform vertices the same way. After
+	// it the depth is final, so shading only keeps the fragments that won and
+	// leaves it unchanged.
+	auto depth_only_state = shading_state;
+	depth_only_state.stages.pop_back();
+	depth_only_state.color_write_mask = 0;
+	depth_only_state.name = "depth_only";
+	auto prepass_shading_state = shading_state;
+	prepass_shading_state.depth_write = VK_FALSE;
+	prepass_shading_state.depth_compare = VK_COMPARE_OP_EQUAL;
+	prepass_shading_state.name = "prepass_shading";
+	// Probe faces are drawn like the mesh into a cube face of their own, one
+	// sample a texel. Their transforms mirror the view's, so their front
+	// faces wind the other way.
+	auto probe_state = GraphicsPipelineState{};
+	if (reflection_probes) {
+		probe_state = shading_state;
+		probe_state.raster.front_face =
+				raster_state.front_face == VK_FRONT_FACE_CLOCKWISE
+				? VK_FRONT_FACE_COUNTER_CLOCKWISE
+				: VK_FRONT_FACE_CLOCKWISE;
+		probe_state.samples = VK_SAMPLE_COUNT_1_BIT;
+		probe_state.color_format = g_environment_format;
+		probe_state.motion_format = VK_FORMAT_UNDEFINED;
+		probe_state.shading_rate_attachment = false;
+		probe_state.name = "reflection_probe";
+	}
+	// Cascades only take the depth of the casters, which are drawn from both
+	// sides so closed meshes cast from their lit faces too.
+	auto shadow_state = GraphicsPipelineState{};
+	if (shadows) {
+		shadow_state = depth_only_state;
+		shadow_state.raster.cull_mode = VK_CULL_MODE_NONE;
+		shadow_state.samples = VK_SAMPLE_COUNT_1_BIT;
+		shadow_state.color_format = VK_FORMAT_UNDEFINED;
+		shadow_state.depth_format = g_shadow_format;
+		shadow_state.motion_format = VK_FORMAT_UNDEFINED;
+		shadow_state.shading_rate_attachment = false;
+		shadow_state.render_pass = VK_NULL_HANDLE;
+		shadow_state.name = "shadow_cascade";
+	}
+	// Both pre-pass states differ from shading only in state, so the shading
+	// stages as objects draw either. The shaders load again cheaply, they are
+	// embedded or mapped.
+	auto prepass_objects = ShaderObjects{};
+	if (shader_objects) {
+		auto vertex_src = load_shader(
+				shader_jobs.at(0).shader,
+				shader_jobs.at(0).variant,
+				assets,
+				config.shader_dir);
+		auto fragment_src = load_shader(
+				shader_jobs.at(1).shader,
+				shader_jobs.at(1).variant,
+				assets,
+				config.shader_dir);
+		prepass_objects = create_shader_objects(
+				device,
+				shading_state,
+				vertex_src.code,
+				fragment_src.code,
+				std::span{&bindless.set_layout, 1},
+				std::span{&push_constant_range, 1});
+		release_shader(vertex_src);
+		release_shader(fragment_src);
+	}
+	auto compile_pool = create_compile_pool(
+			config.compile_threads,
+			config.thread_placement,
+			core_topology);
+	auto pipeline_states = create_pipeline_state_cache(
+			pipeline_cache,
+			device_capabilities.graphics_pipeline_library,
+			*compile_pool);
+	auto pipeline_event = TraceEvent{};
+	// Pre-pass pipelines are only compiled at startup when it starts enabled,
+	// otherwise they are warmed up on the compile pool once startup is done.
+	submit_job(*jobs, startup_jobs, [&] {
+		pipeline_event = start_trace_event("vkCreateGraphicsPipelines");
+		get_graphics_pipeline(device, pipeline_states, shading_state);
+		if (depth_prepass) {
+			get_graphics_pipeline(device, pipeline_states, depth_only_state);
+			get_graphics_pipeline(device, pipeline_states, prepass_shading_state);
+		}
+		finish_trace_event(pipeline_event);
+	});
+	auto draw_lists = DrawLists{};
+	if (indirect_draws) {
+		draw_lists = create_draw_lists(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				draw_list_shader_module,
+				uniform_buffer,
+				g_frames_in_flight,
+				g_max_draw_instances,
+				g_max_draw_batches,
+				max_draw_count,
+				generated_draws,
+				conditional_rendering,
+				pipeline_layout,
+				push_constant_range.stageFlags,
+				synchronization2);
+	}
+	// The demo's lights fill the view volume, which its transform makes the
+	// box from (-1, -1, 0) to (1, 1, 1). The transform is read as a reversed
+	// depth orthographic camera with its near and far planes 1 and 2 in front
+	// of it, so view space is that box pushed back by 2.
+	auto light_clusters = LightClusters{};
+	auto lights = std::vector<Light>{};
+	auto light_view = glm::mat4(1.0F);
+	light_view[3] = glm::vec4(0.0F, 0.0F, -2.0F, 1.0F);
+	auto light_projection = glm::mat4(1.0F);
+	light_projection[3] = glm::vec4(0.0F, 0.0F, 2.0F, 1.0F);
+	if (clustered_lights) {
+		light_clusters = create_light_clusters(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				light_cluster_shader_module,
+				&bindless_specialization,
+				g_frames_in_flight,
+				static_cast<uint32_t>(config.lights),
+				decals ? static_cast<uint32_t>(config.decals) : 0U);
+		lights = scatter_lights(
+				static_cast<uint32_t>(config.lights),
+				glm::vec3(-1.0F, -1.0F, 0.0F),
+				glm::vec3(1.0F));
+	}
+	auto decal_list = std::vector<Decal>{};
+	if (decals) {
+		decal_list = scatter_decals(
+				static_cast<uint32_t>(config.decals),
+				glm::vec3(-1.0F, -1.0F, 0.0F),
+				glm::vec3(1.0F));
+	}
+	auto volumetric_fog = VolumetricFog{};
+	if (fog) {
+		volumetric_fog = create_volumetric_fog(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				pipeline_cache,
+				fog_scatter_shader_module,
+				fog_integrate_shader_module,
+				&bindless_specialization,
+				g_frames_in_flight);
+	}
+	// A warm sun from a fixed direction, which the cascades follow the view
+	// under.
+	const auto sun_direction = glm::normalize(glm::vec3(0.4F, -0.6F, 1.0F));
+	const auto sun_color = glm::vec3(1.0F, 0.9F, 0.75F);
+	auto shadow_maps = ShadowMaps{};
+	auto shadow_atlas = ShadowAtlasMaps{};
+	// Whether the mesh was in and at which LOD when the cascades were last
+	// invalidated for it.
+	auto shadows_mesh_ready = false;
+	auto shadows_mesh_lod = uint32_t{};
+	if (shadows) {
+		shadow_maps = create_shadow_maps(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				ShadowSettings{},
+				shadow_filter_linear(physical_device_info.device),
+				g_frames_in_flight);
+		// A quarter of the default atlas, the lights share a smaller view.
+		shadow_atlas = create_shadow_atlas_maps(
+				device,
+				allocator,
+				bindless,
+				ShadowAtlasSettings{.size = 4096, .max_tile = 1024},
+				static_cast<uint32_t>(config.lights),
+				g_frames_in_flight);
+	}
+	auto visibility = VisibilityShading{};
+	if (visibility_buffer) {
+		visibility = create_visibility_shading(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				visibility_shader_module,
+				&vertex_specialization,
+				g_frames_in_flight,
+				g_max_visibility_draws);
+	}
+	auto deferred_shading = DeferredShading{};
+	if (deferred) {
+		deferred_shading = create_deferred_shading(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				deferred_shader_module,
+				&bindless_specialization,
+				g_frames_in_flight,
+				static_cast<uint32_t>(config.lights));
+		lights = scatter_lights(
+				static_cast<uint32_t>(config.lights),
+				glm::vec3(-1.0F, -1.0F, 0.0F),
+				glm::vec3(1.0F));
+	}
+	auto occlusion = AmbientOcclusion{};
+	if (ambient_occlusion) {
+		occlusion = create_ambient_occlusion(
+				device,
+				bindless,
+				pipeline_cache,
+				ambient_occlusion_shader_module,
+				&bindless_specialization);
+	}
+	// The draw under the cursor plus one, 0 for none.
+	auto picker = Picker{};
+	auto hovered_draw = uint32_t{};
+	// The instanced copy under the cursor plus one, 0 for none.
+	auto hovered_instance = uint32_t{};
+	if (picking) {
+		picker = create_picker(device, allocator, g_frames_in_flight);
+	}
+	auto cloud = PointCloud{};
+	auto point_renderer = PointRenderer{};
+	if (point_cloud) {
+		cloud = open_point_cloud(config.point_cloud);
+		point_renderer = create_point_renderer(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				point_splat_shader_module,
+				point_resolve_shader_module,
+				&bindless_specialization,
+				cloud,
+				g_frames_in_flight);
+	}
+	auto rates = ShadingRate{};
+	if (shading_rate) {
+		rates = create_shading_rate(
+				device,
+				samplers,
+				pipeline_cache,
+				shading_rate_shader_module,
+				shading_rate_policy,
+				*shading_rate_texel,
+				frame_descriptors);
+	}
+	auto depth_pyramid = DepthPyramid{};
+	if (occlusion_culling) {
+		depth_pyramid = create_depth_pyramid(
+				device,
+				samplers,
+				pipeline_cache,
+				depth_pyramid_shader_module,
+				frame_descriptors,
+				synchronization2);
+	}
+	auto stereo_target = StereoTarget{};
+	auto temporal = TemporalAa{};
+	if (temporal_aa) {
+		temporal = create_temporal_aa(
+				device,
+				samplers,
+				pipeline_cache,
+				temporal_shader_module,
+				frame_descriptors);
+	}
+	// The frame buffers are read by the graphics queue, the rest only by the
+	// compute queue the update runs on. Quads blend over the scene with the
+	// main pass's attachments, after its depth is final, or accumulate in the
+	// transparency pass's.
+	auto particle_system = ParticleSystem{};
+	auto particle_state = GraphicsPipelineState{};
+	if (particles) {
+		const auto& limits = physical_device_info.properties.limits;
+		particle_system = create_particle_system(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				particles_shader_module,
+				radix_sort_shader_module,
+				scan_shader_module,
+				particle_subgroup_size,
+				std::min(
+						limits.maxComputeWorkGroupInvocations,
+						limits.maxComputeWorkGroupSize[0]),
+				!weighted_oit,
+				std::array{
+						*physical_device_info.graphics_family_idx,
+						compute_family_idx},
+				g_frames_in_flight,
+				static_cast<uint32_t>(std::min(config.particles, g_max_particles)),
+				synchronization2);
+		particle_state = shading_state;
+		particle_state.stages = {
+				shader_stage(
+						VK_SHADER_STAGE_VERTEX_BIT,
+						particle_vert_shader_module,
+						&bindless_specialization),
+				shader_stage(
+						VK_SHADER_STAGE_FRAGMENT_BIT,
+						particle_frag_shader_module,
+						VK_NULL_HANDLE)};
+		particle_state.bindings.clear();
+		particle_state.attributes.clear();
+		particle_state.raster = g_particle_raster;
+		particle_state.depth_write = VK_FALSE;
+		particle_state.depth_compare = g_depth_compare_op;
+		particle_state.blend = BlendMode::premultiplied;
+		particle_state.layout = particle_system.draw_layout;
+		particle_state.name = "particles";
+		if (weighted_oit) {
+			particle_state.samples = VK_SAMPLE_COUNT_1_BIT;
+			particle_state.blend = BlendMode::weighted;
+			particle_state.color_format = g_oit_accumulation_format;
+			particle_state.motion_format = g_oit_revealage_format;
+			particle_state.shading_rate_attachment = false;
+		}
+	}
+	// Blended over the main pass like the particles, tested against its depth
+	// without writing it.
+	auto line_renderer = LineRenderer{};
+	auto line_state = GraphicsPipelineState{};
+	auto line_style = LineStyle{
+			.width = static_cast<float>(config.line_width),
+			.dash = static_cast<float>(config.line_dash),
+			.gap = static_cast<float>(config.line_dash),
+			.color = LineStyle{}.color};
+	if (lines) {
+		line_renderer = create_line_renderer(device, bindless);
+		line_state = shading_state;
+		line_state.stages = {
+				shader_stage(
+						VK_SHADER_STAGE_VERTEX_BIT,
+						line_vert_shader_module,
+						&vertex_specialization),
+				shader_stage(
+						VK_SHADER_STAGE_FRAGMENT_BIT,
+						line_frag_shader_module,
+						VK_NULL_HANDLE)};
+		line_state.bindings.clear();
+		line_state.attributes.clear();
+		line_state.raster = g_line_raster;
+		line_state.depth_write = VK_FALSE;
+		line_state.depth_compare = g_depth_compare_op;
+		line_state.blend = BlendMode::premultiplied;
+		line_state.layout = line_renderer.draw_layout;
+		line_state.name = "lines";
+	}
+	// Blended over everything drawn before it, without a depth test.
+	auto overlay_renderer = OverlayRenderer{};
+	auto overlay_state = GraphicsPipelineState{};
+	if (overlay) {
+		overlay_renderer = create_overlay_renderer(
+				device,
+				allocator,
+				bindless,
+				g_frames_in_flight);
+		overlay_state = shading_state;
+		overlay_state.stages = {
+				shader_stage(
+						VK_SHADER_STAGE_VERTEX_BIT,
+						overlay_vert_shader_module,
+						&bindless_specialization),
+				shader_stage(
+						VK_SHADER_STAGE_FRAGMENT_BIT,
+						overlay_frag_shader_module,
+						&bindless_specialization)};
+		overlay_state.bindings.clear();
+		overlay_state.attributes.clear();
+		overlay_state.raster = g_overlay_raster;
+		overlay_state.depth_write = VK_FALSE;
+		overlay_state.depth_compare = VK_COMPARE_OP_ALWAYS;
+		overlay_state.blend = BlendMode::premultiplied;
+		overlay_state.layout = overlay_renderer.draw_layout;
+		overlay_state.name = "overlay";
+	}
+	auto transparency = Transparency{};
+	if (weighted_oit) {
+		transparency = create_transparency(
+				device,
+				samplers,
+				pipeline_cache,
+				oit_composite_shader_module,
+				frame_descriptors);
+	}
+	auto post = PostProcess{};
+	if (post_process) {
+		post = create_post_process(
+				device,
+				samplers,
+				pipeline_cache,
+				bloom_downsample_shader_module,
+				bloom_blur_shader_module,
+				post_composite_shader_module,
+				surface_output.transfer,
+				frame_descriptors);
+	}
+
+	auto queue_family_indices = std::array<uint32_t, 2>{
+			*physical_device_info.graphics_family_idx,
+			present_family_idx};
+	auto window_state = WindowState{
+			.present_policy = config.present_policy,
+			.present_policy_changed = false,
+			.framebuffer_resized = false,
+			.depth_prepass = depth_prepass,
+			.refresh_requested = false,
+			.key_events = {},
+			.pending_input = std::nullopt};
+	// Benchmarks measure the renderer, not the display's refresh rate.
+	if (benchmarking) {
+		window_state.present_policy = PresentPolicy::uncapped;
+	}
+	auto swap_chain_depth = create_swap_chain_depth(window_state.present_policy);
+	auto deletions = DeletionQueue{};
+	auto image_views = ImageViewCache{};
+	auto swap_chain = SwapChain{};
+	auto damage = DamageTracker{};
+	damage.partial = damage_tracking;
+	damage.settle_frames = temporal_aa ? g_damage_settle_frames : 0U;
+	if (!headless) {
+		auto swap_chain_event = begin_trace_event(trace, "vkCreateSwapchainKHR");
+		auto present_mode =
+				select_present_mode(window_state.present_policy, present_modes);
+		update_swap_chain(
+				device,
+				allocator,
+				deletions,
+				image_views,
+				surface,
+				capabilities,
+				select_swap_extent(capabilities, window),
+				surface_format,
+				scene_format,
+				depth_format,
+				samples,
+				scene_depth_usage,
+				present_mode,
+				swap_chain_image_count(swap_chain_depth, capabilities),
+				swap_chain_usage,
+				queue_family_indices,
+				swap_chain_present_modes(device_group),
+				swap_chain_compression,
+				switchable_present_modes(
+						physical_device_info.device,
+						surface,
+						present_mode,
+						present_modes,
+						swap_chain_maintenance),
+				!stereo,
+				full_screen_exclusive,
+				damage_tracking,
+				pre_rotated,
+				render_pass,
+				swap_chain);
+		reset_damage(damage, swap_chain.extent, swap_chain.images.size());
+		end_trace_event(trace, swap_chain_event);
+	}
+	auto mirrors = std::vector<MirrorWindow>{};
+	for (auto i = size_t{1}; mirroring && i < config.windows; i++) {
+		auto mirror = create_mirror_window(
+				instance,
+				device,
+				physical_device_info.device,
+				present_family_idx,
+				surface_format,
+				i);
+		if (!mirror.has_value()) {
+			fmt::print(
+					stderr,
+					"Window {} cannot show the first window's frames, opening {}\n",
+					i + 1,
+					i);
+			break;
+		}
+		mirrors.emplace_back(std::move(*mirror));
+	}
+	end_startup_phase(benchmark, "swap_chain");
+
+	auto graphics_timeline = create_queue_timeline(device, synchronization2);
+	auto frames = std::array<Frame, g_frames_in_flight>{};
+	for (auto i = size_t{}; i < frames.size(); i++) {
+		auto& frame = frames.at(i);
+		frame = create_frame(
+				device,
+				*physical_device_info.graphics_family_idx,
+				graphics_timeline);
+		name_object(
+				device,
+				VK_OBJECT_TYPE_COMMAND_BUFFER,
+				frame.command_buffer,
+				fmt::format("frame {}", i));
+		name_object(
+				device,
+				VK_OBJECT_TYPE_SEMAPHORE,
+				frame.image_available,
+				fmt::format("frame {} image available", i));
+	}
+	auto render_graphs = std::array<RenderGraph, g_frames_in_flight>{};
+	for (auto& graph : render_graphs) {
+		graph = create_render_graph(synchronization2, image_compression);
+	}
+	// Scratch of the frame being recorded, reset once per frame.
+	auto frame_arena = create_frame_arena(g_frame_arena_size);
+	auto* graphics_queue = VkQueue{};
+	vkGetDeviceQueue(
+			device,
+			*physical_device_info.graphics_family_idx,
+			0,
+			&graphics_queue);
+
+	auto* present_queue = VkQueue{};
+	vkGetDeviceQueue(device, present_family_idx, 0, &present_queue);
+	auto uploader = create_uploader(
+			device,
+			allocator,
+			upload_family_idx,
+			*physical_device_info.graphics_family_idx,
+			g_staging_ring_size,
+			synchronization2);
+	auto geometry_pool = std::optional<GeometryPool>{};
+	if (sparse_geometry) {
+		geometry_pool = create_geometry_pool(
+				device,
+				uploader.queue,
+				g_geometry_pool_size,
+				allocator.device_address);
+	}
+	auto* mesh_pool = geometry_pool.has_value() ? &*geometry_pool : nullptr;
+	// Compressed meshes are expanded by the frame that acquires their upload.
+	auto decompressor = Decompressor{};
+	if (!config.mesh.empty()) {
+		decompressor = create_decompressor(
+				device,
+				pipeline_cache,
+				decompress_shader_module,
+				synchronization2);
+	}
+	auto downsampler = Downsampler{};
+	if (generate_texture_levels) {
+		downsampler = create_downsampler(
+				device,
+				allocator,
+				pipeline_cache,
+				downsample_shader_module,
+				synchronization2);
+	}
+	auto environment_prefilter = EnvironmentPrefilter{};
+	if (!config.environment.empty() || reflection_probes) {
+		environment_prefilter = create_environment_prefilter(
+				device,
+				samplers,
+				pipeline_cache,
+				environment_specular_shader_module,
+				environment_brdf_lut_shader_module,
+				environment_irradiance_shader_module,
+				environment_cube_shader_module,
+				synchronization2);
+	}
+	// Opaque, tested and written like the scene's own draws.
+	auto heightfield = Heightfield{};
+	auto clipmap = Terrain{};
+	auto terrain_material = TerrainMaterial{};
+	auto terrain_state = GraphicsPipelineState{};
+	if (terrain) {
+		heightfield = open_heightfield(config.terrain);
+		clipmap = create_terrain(
+				device,
+				allocator,
+				uploader,
+				bindless,
+				samplers,
+				std::array{
+						*physical_device_info.graphics_family_idx,
+						upload_family_idx},
+				g_frames_in_flight);
+		if (virtual_texture) {
+			terrain_material = create_terrain_material(
+					device,
+					allocator,
+					uploader,
+					bindless,
+					samplers,
+					heightfield,
+					std::array{
+							*physical_device_info.graphics_family_idx,
+							upload_family_idx},
+					g_frames_in_flight);
+		}
+		terrain_state = shading_state;
+		terrain_state.stages = {
+				shader_stage(
+						VK_SHADER_STAGE_VERTEX_BIT,
+						terrain_vert_shader_module,
+						&bindless_specialization),
+				shader_stage(
+						VK_SHADER_STAGE_FRAGMENT_BIT,
+						terrain_frag_shader_module,
+						virtual_texture ? &bindless_specialization : VK_NULL_HANDLE)};
+		terrain_state.bindings.clear();
+		terrain_state.attributes.clear();
+		terrain_state.raster = g_terrain_raster;
+		terrain_state.layout = clipmap.draw_layout;
+		terrain_state.name = "terrain";
+	}
+	// A cooked mesh is read on a job while the rest is set up, and only
+	// staged once it is needed.
+	auto async_scheduler = create_async_scheduler(*jobs, device);
+	// Reads cells through the scheduler, so it is destroyed after it. Its
+	// slots are the instances.
+	auto scene_pager = std::unique_ptr<ScenePager>{};
+	if (paged_scene) {
+		auto paging = ScenePagingSettings{};
+		paging.cache_cells = static_cast<uint32_t>(config.scene_cache_cells);
+		scene_pager =
+				open_paged_scene(*async_scheduler, config.paged_scene, paging);
+	}
+	auto instance_count = static_cast<uint32_t>(
+			paged_scene ? paged_instance_count(*scene_pager) : config.instances);
+	auto vertex_fetch = vertex_pulling ? VertexFetch::pulled : VertexFetch::input;
+	if (mesh_shading) {
+		vertex_fetch = VertexFetch::meshlets;
+	}
+	auto mesh = Mesh{};
+	if (!config.mesh.empty()) {
+		load_mesh_async(
+				*async_scheduler,
+				allocator,
+				uploader,
+				mesh_pool,
+				decompressor,
+				assets,
+				config.mesh,
+				mesh_layout,
+				vertex_fetch,
+				mesh);
+	}
+	auto compute_scheduler = create_compute_scheduler(
+			device,
+			compute_family_idx,
+			frames.size(),
+			synchronization2);
+
+	auto& graphics_family = physical_device_info.queue_families.at(
+			*physical_device_info.graphics_family_idx);
+	auto performance_counters = std::vector<PerformanceCounter>{};
+	if (!config.performance_counters.empty()) {
+		if (device_capabilities.performance_query) {
+			performance_counters = select_performance_counters(
+					physical_device_info.device,
+					*physical_device_info.graphics_family_idx,
+					config.performance_counters);
+		} else {
+			fmt::print(
+					stderr,
+					"Performance counters need VK_KHR_performance_query, reading "
+					"none\n");
+		}
+	}
+	auto profiler = create_gpu_profiler(
+			device,
+			physical_device_info.properties,
+			graphics_family.timestampValidBits,
+			device_capabilities.calibrated_timestamps,
+			enabled_features,
+			config.gpu_statistics,
+			*physical_device_info.graphics_family_idx,
+			std::move(performance_counters),
+			frames.size(),
+			config.gpu_stats_csv);
+	profiler.keep_history = benchmarking;
+	// Queues of the graphics family are the graphics queue itself.
+	name_object(device, VK_OBJECT_TYPE_QUEUE, graphics_queue, "graphics");
+	if (present_queue != graphics_queue) {
+		name_object(device, VK_OBJECT_TYPE_QUEUE, present_queue, "present");
+	}
+	if (uploader.queue != graphics_queue) {
+		name_object(device, VK_OBJECT_TYPE_QUEUE, uploader.queue, "upload");
+	}
+	if (compute_scheduler.queue != graphics_queue) {
+		name_object(
+				device,
+				VK_OBJECT_TYPE_QUEUE,
+				compute_scheduler.queue,
+				"compute");
+	}
+	compute_scheduler.profiler = &profiler;
+	compute_scheduler.timestamp_valid_bits =
+			physical_device_info.queue_families.at(compute_family_idx)
+					.timestampValidBits;
+	if (profiler.timestamps && compute_scheduler.timestamp_valid_bits == 0) {
+		fmt::print(
+				stderr,
+				"The compute queue family has no GPU timestamps, not timing compute "
+				"jobs\n");
+	}
+	// Uploads are submitted by the frame loop and the loading code besides
+	// the frames, which would race the submit thread on a queue they share.
+	auto threaded_submits = config.submit_thread &&
+			uploader.queue != graphics_queue && uploader.queue != present_queue &&
+			uploader.queue != compute_scheduler.queue;
+	if (config.submit_thread && !threaded_submits) {
+		fmt::print(
+				stderr,
+				"A submit thread needs a queue of its own for uploads, submitting "
+				"from the frame loop\n");
+	}
+	if (particles) {
+		add_compute_job(
+				compute_scheduler,
+				ComputeJob{
+						.name = "particles",
+						.record =
+								[&](VkCommandBuffer command_buffer, size_t frame_idx) {
+									record_particle_update(
+											particle_system,
+											bindless,
+											command_buffer,
+											frame_idx);
+								},
+						.consumer_stage = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+								VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT});
+	}
+	auto recorder = create_parallel_recorder(
+			device,
+			*jobs,
+			*physical_device_info.graphics_family_idx,
+			frames.size());
+	// One for the pre-pass and one for shading.
+	auto baked = std::array<BakedRecording, 2>{};
+	if (baked_draws) {
+		for (auto& recording : baked) {
+			recording = create_baked_recording(
+					device,
+					*jobs,
+					*physical_device_info.graphics_family_idx,
+					frames.size());
+		}
+	}
+	auto baked_key = std::vector<uint64_t>{};
+
+	auto meshlets = MeshletMesh{};
+	auto impostor_atlas = std::optional<ImpostorAtlas>{};
+	auto skinner = Skinner{};
+	if (config.mesh.empty()) {
+		auto triangle_data = MeshData{};
+		// Depth is reversed and cleared to 0, which is the far plane, so the
+		// triangle sits in front of it.
+		triangle_data.positions = {
+				glm::vec3{0.0F, -0.5F, 0.5F},
+				glm::vec3{0.5F, 0.5F, 0.5F},
+				glm::vec3{-0.5F, 0.5F, 0.5F}};
+		triangle_data.colors = {
+				glm::vec3{1.0F, 0.0F, 0.0F},
+				glm::vec3{0.0F, 1.0F, 0.0F},
+				glm::vec3{0.0F, 0.0F, 1.0F}};
+		triangle_data.indices = {0, 1, 2};
+		if (auto scene_data = stress_scene_mesh(config.stress_scene)) {
+			triangle_data = std::move(*scene_data);
+		}
+		mesh = create_mesh(
+				device,
+				allocator,
+				uploader,
+				mesh_pool,
+				triangle_data,
+				mesh_layout,
+				vertex_fetch);
+		if (mesh_shading) {
+			meshlets = create_meshlet_mesh(
+					device,
+					allocator,
+					uploader,
+					build_meshlets(triangle_data.positions, triangle_data.indices));
+		}
+		if (skinning) {
+			skinner = create_skinner(
+					device,
+					allocator,
+					uploader,
+					bindless,
+					pipeline_cache,
+					skinning_shader_module,
+					&bindless_specialization,
+					mesh,
+					rig_mesh(
+							triangle_data,
+							mesh.bounding_sphere,
+							static_cast<uint32_t>(
+									std::min<size_t>(config.skin_joints, g_max_skin_joints))),
+					g_frames_in_flight);
+		}
+		// Baked once per mesh and cached like the environment.
+		if (impostors) {
+			auto path = impostor_cache_path(config.cache_dir, triangle_data);
+			impostor_atlas = load_impostor(path);
+			if (!impostor_atlas.has_value()) {
+				impostor_atlas = bake_impostor(triangle_data);
+				save_impostor(path, *impostor_atlas);
+			}
+		}
+	} else {
+		wait_for_async(*async_scheduler);
+		if (impostors) {
+			impostor_atlas = load_impostor(impostor_cooked_path(config.mesh));
+		}
+	}
+	if (impostors && !impostor_atlas.has_value()) {
+		fmt::print(
+				stderr,
+				"Impostors need the mesh cooked with them, drawing every instance "
+				"as a mesh\n");
+		impostors = false;
+	}
+	// The instances stay on the GPU, frames upload what changed and which of
+	// them to draw.
+	auto instance_stream = InstanceStream{};
+	auto resident_instances = ResidentInstances{};
+	auto scene = Scene{};
+	auto visible_indices = std::vector<uint32_t>{};
+	if (hardware_instancing) {
+		instance_stream = create_instance_stream(
+				device,
+				allocator,
+				bindless,
+				frames.size(),
+				instance_count);
+		resident_instances = create_resident_instances(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				instance_copy_shader_module,
+				&bindless_specialization,
+				frames.size(),
+				instance_count);
+		if (!paged_scene) {
+			scene =
+					create_scene(grid_entities(instance_count, mesh.bounding_sphere));
+		}
+	}
+	// Opaque and cut out at the silhouette, tested and written like the mesh.
+	auto impostor_renderer = ImpostorRenderer{};
+	auto impostor_state = GraphicsPipelineState{};
+	auto impostor_indices = std::vector<uint32_t>{};
+	if (impostors) {
+		impostor_renderer = create_impostor_renderer(
+				device,
+				allocator,
+				uploader,
+				bindless,
+				samplers,
+				*impostor_atlas,
+				frames.size(),
+				instance_count);
+		impostor_atlas.reset();
+		auto impostor_input = VertexInputDescription{};
+		add_instance_input(impostor_input);
+		impostor_state = shading_state;
+		impostor_state.stages = {
+				shader_stage(
+						VK_SHADER_STAGE_VERTEX_BIT,
+						impostor_vert_shader_module,
+						&bindless_specialization),
+				shader_stage(
+						VK_SHADER_STAGE_FRAGMENT_BIT,
+						impostor_frag_shader_module,
+						&bindless_specialization)};
+		impostor_state.bindings = impostor_input.bindings;
+		impostor_state.attributes = impostor_input.attributes;
+		impostor_state.raster = g_impostor_raster;
+		impostor_state.layout = impostor_renderer.draw_layout;
+		impostor_state.name = "impostor";
+	}
+	// Rays are traced against every instance, culled ones cast shadows too.
+	// Without instancing the mesh is a single identity instance.
+	auto ray_tracing = RayTracing{};
+	auto identity_instance = std::array{InstanceTransform{
+			.rows = {
+					glm::vec4(1.0F, 0.0F, 0.0F, 0.0F),
+					glm::vec4(0.0F, 1.0F, 0.0F, 0.0F),
+					glm::vec4(0.0F, 0.0F, 1.0F, 0.0F)}}};
+	if (ray_query) {
+		ray_tracing = create_ray_tracing(
+				device,
+				physical_device_info.device,
+				allocator,
+				hardware_instancing ? instance_count : 1,
+				frames.size());
+		set_bindless_scene(device, bindless, ray_tracing.tlas.handle);
+	}
+	auto decal_atlas = DecalAtlas{};
+	if (decals) {
+		decal_atlas =
+				create_decal_atlas(device, allocator, uploader, bindless, samplers);
+	}
+	// Levels are streamed a budget per frame so big textures do not stall the
+	// frames they arrive in.
+	auto texture = std::optional<Texture>{};
+	if (!config.texture.empty()) {
+		texture = load_texture(
+				device,
+				physical_device_info.device,
+				allocator,
+				assets,
+				config.texture,
+				device_capabilities.host_image_copy,
+				generate_texture_levels);
+	}
+	// Streamed like the texture when it has to be prefiltered.
+	auto environment = std::optional<Environment>{};
+	if (!config.environment.empty()) {
+		environment = load_environment(
+				device,
+				physical_device_info.device,
+				allocator,
+				uploader,
+				assets,
+				config.environment,
+				config.cache_dir);
+	}
+	// Placed around the mesh once it is in, its bounds are only known then.
+	auto probes = ReflectionProbes{};
+	// The LOD of the mesh the probes last drew.
+	auto probes_mesh_lod = uint32_t{};
+	if (reflection_probes) {
+		probes = create_reflection_probes(
+				device,
+				allocator,
+				environment_prefilter,
+				config.reflection_probes,
+				depth_format);
+	}
+	auto memory_budget = create_memory_budget(
+			allocator,
+			device_capabilities.memory_budget,
+			VkDeviceSize{config.memory_budget} * 1024 * 1024);
+	// Meshes are handed to the defragmenter once their uploads are done, so
+	// its copies never race them. Device groups keep their buffers in place,
+	// a frame's copies only run on its own GPU.
+	auto defragmenter = Defragmenter{};
+	auto defragmenting = device_group.devices.empty();
+	auto meshes_movable = false;
+	auto offscreen = OffscreenTarget{};
+	if (headless) {
+		offscreen = create_offscreen_target(
+				device,
+				allocator,
+				surface_format.format,
+				depth_format,
+				VkExtent2D{.width = g_window_width, .height = g_window_height},
+				samples,
+				scene_depth_usage,
+				frames.size(),
+				render_pass);
+	}
+	end_startup_phase(benchmark, "resources");
+	wait_event = begin_trace_event(trace, "wait_pipelines");
+	wait_for_counter(*jobs, startup_jobs);
+	end_trace_event(trace, wait_event);
+	add_trace_event(trace, pipeline_event);
+	// The states requested every frame are keyed once, so the requests only
+	// probe the cache. A reload that replaces their modules keys them again.
+	auto shading_key = PipelineStateKey{};
+	auto depth_only_key = PipelineStateKey{};
+	auto prepass_shading_key = PipelineStateKey{};
+	auto particle_key = PipelineStateKey{};
+	auto line_key = PipelineStateKey{};
+	auto terrain_key = PipelineStateKey{};
+	auto impostor_key = PipelineStateKey{};
+	auto overlay_key = PipelineStateKey{};
+	auto probe_key = PipelineStateKey{};
+	auto shadow_key = PipelineStateKey{};
+	auto key_pipeline_states = [&] {
+		shading_key = pipeline_state_key(shading_state);
+		depth_only_key = pipeline_state_key(depth_only_state);
+		prepass_shading_key = pipeline_state_key(prepass_shading_state);
+		particle_key = pipeline_state_key(particle_state);
+		line_key = pipeline_state_key(line_state);
+		terrain_key = pipeline_state_key(terrain_state);
+		impostor_key = pipeline_state_key(impostor_state);
+		overlay_key = pipeline_state_key(overlay_state);
+		probe_key = pipeline_state_key(probe_state);
+		shadow_key = pipeline_state_key(shadow_state);
+	};
+	key_pipeline_states();
+	auto* pipeline = get_graphics_pipeline(
+			device,
+			pipeline_states,
+			shading_state,
+			shading_key);
+	if (!depth_prepass) {
+		for (const auto* state : {&depth_only_state, &prepass_shading_state}) {
+			request_graphics_pipeline(
+					device,
+					pipeline_states,
+					*state,
+					CompilePriority::warmup);
+		}
+	}
+	// What the last run drew with goes ahead of the warmup, it is likely to be
+	// drawn again. Particles, lines, terrain, impostors, the overlay,
+	// reflection probes and shadows have no state unless enabled.
+	auto pipeline_manifest_file = config.cache_dir / "pipeline_manifest.txt";
+	for (const auto& name : load_pipeline_manifest(pipeline_manifest_file)) {
+		for (const auto* state :
+				 {&shading_state,
+					&depth_only_state,
+					&prepass_shading_state,
+					&particle_state,
+					&line_state,
+					&terrain_state,
+					&impostor_state,
+					&overlay_state,
+					&probe_state,
+					&shadow_state}) {
+			if (state->name == name && !state->stages.empty()) {
+				request_graphics_pipeline(
+						device,
+						pipeline_states,
+						*state,
+						CompilePriority::predicted);
+			}
+		}
+	}
+	end_startup_phase(benchmark, "pipelines");
+	// Compute shaders are left out, their pipelines are built once.
+	auto shader_reloader = std::optional<ShaderReloader>{};
+	auto retired_shader_modules = std::vector<VkShaderModule>{};
+	if (!config.shader_source_dir.empty()) {
+		auto watched_shaders = std::vector<ShaderVariantName>{};
+		for (auto i = size_t{}; i < shader_jobs.size(); i++) {
+			const auto& job = shader_jobs.at(i);
+			if (shader_reflections.at(i).stage != VK_SHADER_STAGE_COMPUTE_BIT) {
+				watched_shaders.emplace_back(ShaderVariantName{
+						.shader = job.shader,
+						.variant = job.variant});
+			}
+		}
+		shader_reloader = create_shader_reloader(
+				config.shader_source_dir,
+				config.cache_dir / "shaders",
+				watched_shaders);
+	}
+	end_trace_event(trace, startup_event);
+	write_trace(trace);
+
+	if (!headless) {
+		fmt::print(
+				stderr,
+				"Present mode policy: {}\n",
+				to_string(window_state.present_policy));
+		fmt::print(stderr, "Swap chain images: {}\n", swap_chain.images.size());
+	}
+	if (window != nullptr) {
+		glfwSetWindowUserPointer(window, &window_state);
+		glfwSetKeyCallback(window, glfw_key_callback);
+		glfwSetFramebufferSizeCallback(window, glfw_framebuffer_size_callback);
+		glfwSetWindowRefreshCallback(window, glfw_window_refresh_callback);
+		// Keys work in every window. Mirrors notice resizes through their swap
+		// chains going out of date.
+		for (auto& mirror : mirrors) {
+			glfwSetWindowUserPointer(mirror.window, &window_state);
+			glfwSetKeyCallback(mirror.window, glfw_key_callback);
+			glfwSetWindowRefreshCallback(
+					mirror.window,
+					glfw_window_refresh_callback);
+		}
+		if (!mirrors.empty()) {
+			fmt::print(stderr, "Windows: {}\n", mirrors.size() + 1);
+		}
+	}
+	// Headless runs are for benchmarks and comparisons, which need every
+	// frame, interactive ones drop frames rather than stall.
+	auto capture = std::unique_ptr<FrameCapture>{};
+	if (capturing) {
+		capture = create_frame_capture(
+				config.capture,
+				config.capture_interval,
+				headless,
+				frames.size());
+	}
+	auto frame_idx = size_t{};
+	auto swap_chain_stale = false;
+	auto frame_pacer = create_frame_pacer(frame_pacing);
+	// Benchmarks measure the renderer, not a frame rate limit.
+	if (benchmarking && config.max_frame_rate != 0) {
+		fmt::print(stderr, "Benchmarks ignore the frame rate limit\n");
+	}
+	auto frame_limiter =
+			create_frame_limiter(benchmarking ? 0 : config.max_frame_rate);
+	auto submit_thread = std::unique_ptr<SubmitThread>{};
+	if (threaded_submits) {
+		submit_thread = create_submit_thread(synchronization2, frame_limiter);
+	}
+	auto hitch_detector = create_hitch_detector(
+			config.hitch_threshold,
+			config.hitch_dir,
+			g_frames_in_flight);
+	auto telemetry = create_telemetry(config.telemetry);
+	auto resolution = create_dynamic_resolution(config.dynamic_resolution);
+	auto image_count = swap_chain.images.size();
+	auto waits = std::vector<SemaphoreOp>{};
+	auto signals = std::vector<SemaphoreOp>{};
+	auto queued_submissions = std::vector<QueuedSubmission>{};
+	auto present_request = PresentRequest{};
+	auto present_outcomes = std::vector<PresentOutcome>{};
+	auto draw_handles = std::vector<DrawHandles>{};
+	auto visibility_draws = std::vector<VisibilityDraw>{};
+	auto draw_queue = DrawQueue{};
+	auto frames_rendered = size_t{};
+	// Over the instanced copies, built on the first frame and refitted to the
+	// ones that moved since the frame before, the slots a paged scene loaded
+	// or emptied.
+	auto scene_bvh = create_dynamic_bvh();
+	auto fitted_bounds = BoundingSpheres{};
+	auto moved_bounds = std::vector<uint32_t>{};
+	auto visible = std::vector<uint8_t>{};
+	auto raster_formats = std::array{raster_format, g_motion_format};
+	auto inheritance_rendering_info = VkCommandBufferInheritanceRenderingInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.viewMask = stereo ? g_stereo_view_mask : 0U,
+			.colorAttachmentCount = temporal_aa ? 2U : 1U,
+			.pColorAttachmentFormats = raster_formats.data(),
+			.depthAttachmentFormat = depth_format,
+			.stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+			.rasterizationSamples = samples};
+	// Run on the finished setup instead of any frames.
+	auto microbenchmarking = !config.microbenchmarks.empty();
+	if (microbenchmarking) {
+		vkDeviceWaitIdle(device);
+		auto inheritance_info = VkCommandBufferInheritanceInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+				.pNext = dynamic_rendering ? &inheritance_rendering_info
+																	 : VK_NULL_HANDLE,
+				.renderPass = render_pass,
+				.subpass = 0,
+				.framebuffer = VK_NULL_HANDLE,
+				.occlusionQueryEnable = VK_FALSE,
+				.queryFlags = 0,
+				.pipelineStatistics = 0};
+		auto subjects = MicrobenchmarkSubjects{
+				.device = device,
+				.jobs = jobs.get(),
+				.allocator = &allocator,
+				.bindless = &bindless,
+				.graphics_family_idx = *physical_device_info.graphics_family_idx,
+				.synchronization2 = synchronization2,
+				.pipeline_states = &pipeline_states,
+				.pipeline_cache = pipeline_cache,
+				.pipeline_state = &shading_state,
+				.pipeline = pipeline,
+				.pipeline_layout = pipeline_layout,
+				.push_constant_range = push_constant_range,
+				.extended_dynamic_state = extended_dynamic_state,
+				.inheritance = inheritance_info,
+				// Instanced and meshlet draws are left out.
+				.mesh = mesh_shading || hardware_instancing ? nullptr : &mesh};
+		run_microbenchmarks(subjects, config.microbenchmarks);
+	}
+	// The scene moves to the simulation, which sends the frame loop the
+	// transforms to draw with.
+	auto simulation = create_simulation(
+			config.stress_scene,
+			std::move(scene),
+			scene_pager.get(),
+			mesh.bounding_sphere,
+			headless || benchmarking ? 0 : config.simulation_rate);
+	if (config.thread_placement == ThreadPlacement::core_types) {
+		set_thread_cores(simulation->thread, core_topology.performance);
+	}
+	// For the overlay, of the frame before.
+	auto previous_record_start =
+			std::optional<std::chrono::steady_clock::time_point>{};
+	auto previous_record_milliseconds = 0.0;
+	// Acquired but not yet presented, which the swap chain gets back at exit.
+	auto unpresented_image = std::optional<uint32_t>{};
+	while (!microbenchmarking &&
+				 (window == nullptr || glfwWindowShouldClose(window) == GLFW_FALSE)) {
+		VKDEMO_ZONE("frame");
+		if (!headless && submit_thread) {
+			run_on_submit_thread(*submit_thread, [&] {
+				wait_for_frame_start(device, frame_pacer, swap_chain.handle);
+			});
+		} else if (!headless) {
+			wait_for_frame_start(device, frame_pacer, swap_chain.handle);
+		}
+		if (window != nullptr) {
+			sample_input(window, window_state);
+			// Closing any window ends the run.
+			for (const auto& mirror : mirrors) {
+				if (glfwWindowShouldClose(mirror.window) == GLFW_TRUE) {
+					glfwSetWindowShouldClose(window, GLFW_TRUE);
+				}
+			}
+			if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) == GLFW_TRUE) {
+				glfwWaitEvents();
+				continue;
+			}
+		}
+
+		// Swap chains that can switch to the new mode and have the images it
+		// wants keep going, starting with the next present.
+		if (window_state.present_policy_changed) {
+			window_state.present_policy_changed = false;
+			swap_chain_depth = create_swap_chain_depth(window_state.present_policy);
+			swap_chain_stale = swap_chain_stale ||
+					!switch_present_mode(
+							swap_chain,
+							select_present_mode(window_state.present_policy, present_modes),
+							swap_chain_image_count(swap_chain_depth, capabilities));
+			for (auto& mirror : mirrors) {
+				mirror.stale = mirror.stale ||
+						!switch_present_mode(
+								mirror.swap_chain,
+								select_present_mode(
+										window_state.present_policy,
+										mirror.present_modes),
+								swap_chain_image_count(swap_chain_depth, mirror.capabilities));
+			}
+			log_message(
+					LogLevel::info,
+					"Present mode policy: {}",
+					to_string(window_state.present_policy));
+		}
+		if (window_state.framebuffer_resized) {
+			window_state.framebuffer_resized = false;
+			swap_chain_stale = true;
+		}
+		if (swap_chain_stale) {
+			vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+					physical_device_info.device,
+					surface,
+					&capabilities);
+			auto extent = select_swap_extent(capabilities, window);
+			// A minimized window has a zero sized surface, which cannot back a
+			// swap chain, so sleep until something happens to the window.
+			if (extent.width == 0 || extent.height == 0) {
+				glfwWaitEvents();
+				continue;
+			}
+			if (submit_thread) {
+				wait_for_submit_thread(*submit_thread);
+			}
+			auto present_mode =
+					select_present_mode(window_state.present_policy, present_modes);
+			update_swap_chain(
+					device,
+					allocator,
+					deletions,
+					image_views,
+					surface,
+					capabilities,
+					extent,
+					surface_format,
+					scene_format,
+					depth_format,
+					samples,
+					scene_depth_usage,
+					present_mode,
+					swap_chain_image_count(swap_chain_depth, capabilities),
+					swap_chain_usage,
+					queue_family_indices,
+					swap_chain_present_modes(device_group),
+					swap_chain_compression,
+					switchable_present_modes(
+							physical_device_info.device,
+							surface,
+							present_mode,
+							present_modes,
+							swap_chain_maintenance),
+					!stereo,
+					full_screen_exclusive,
+					damage_tracking,
+					pre_rotated,
+					render_pass,
+					swap_chain);
+			reset_frame_pacer(frame_pacer);
+			reset_damage(damage, swap_chain.extent, swap_chain.images.size());
+			if (swap_chain.images.size() != image_count) {
+				image_count = swap_chain.images.size();
+				fmt::print(stderr, "Swap chain images: {}\n", image_count);
+			}
+			swap_chain_stale = false;
+		}
+
+		// With the submit thread the image is acquired there, and only waited
+		// for once the frame records into it, so while the presentation engine
+		// is behind this thread gets on with the frame instead of blocking. On
+		// demand, acquiring waits for the frame to be known to be drawn.
+		auto early_acquire = !headless && submit_thread && !redraw_on_demand;
+		auto early_acquire_ticket = uint64_t{};
+		auto early_acquire_result = VkResult{};
+		auto early_image_idx = uint32_t{};
+		if (early_acquire) {
+			const auto& next_frame = frames.at(frame_idx);
+			early_acquire_ticket = queue_on_submit_thread(
+					*submit_thread,
+					[&,
+					 done = next_frame.done,
+					 semaphore = next_frame.image_available,
+					 mask = frame_device_mask(device_group, frames_rendered)] {
+						// The semaphore is signaled again once the frame that last
+						// waited for it is done.
+						wait_for_submit_point(device, done);
+						early_acquire_result = acquire_swap_chain_image(
+								device,
+								swap_chain.handle,
+								semaphore,
+								mask,
+								early_image_idx);
+					});
+		}
+
+		// Loaders waiting on the GPU or for this thread carry on.
+		poll_async(*async_scheduler);
+
+		// A reloaded shader goes into the pipeline states right away, but the
+		// old pipelines keep drawing until the new shading pipeline compiled in
+		// the background. Then everything built from the old modules is dropped
+		// and destroyed with them once the frames using it are done.
+		if (shader_reloader.has_value()) {
+			for (auto& reloaded :
+					 poll_shader_reloader(*jobs, *shader_reloader)) {
+				auto* module = std::find_if(
+						shader_jobs.begin(),
+						shader_jobs.end(),
+						[&](const ShaderJob& job) {
+							return job.shader == reloaded.shader &&
+									job.variant == reloaded.variant;
+						})->module;
+				// The layout and vertex input stay, so an edit that needs
+				// different ones waits for a restart.
+				auto reflection = reflect_shader(reloaded.blob.code);
+				if (!shader_fits_layout(
+								reflection,
+								bindless_bindings,
+								push_constant_range) ||
+						!shader_fits_vertex_input(reflection, shading_state.attributes)) {
+					log_message(
+							LogLevel::warning,
+							"Keeping the previous {}",
+							shader_file_name(reloaded.shader));
+					release_shader(reloaded.blob);
+					continue;
+				}
+				retired_shader_modules.emplace_back(*module);
+				*module = create_shader_modules(device, reloaded.blob.code);
+				release_shader(reloaded.blob);
+				for (auto* state :
+						 {&shading_state,
+							&depth_only_state,
+							&prepass_shading_state,
+							&particle_state,
+							&line_state,
+							&terrain_state,
+							&impostor_state,
+							&overlay_state,
+							&probe_state,
+							&shadow_state}) {
+					replace_shader_module(
+							*state,
+							retired_shader_modules.back(),
+							*module);
+				}
+				key_pipeline_states();
+			}
+		}
+		if (!retired_shader_modules.empty()) {
+			auto* reloaded = request_graphics_pipeline(
+					device,
+					pipeline_states,
+					shading_state,
+					shading_key,
+					CompilePriority::visible);
+			if (reloaded != VK_NULL_HANDLE) {
+				pipeline = reloaded;
+				invalidate_damage(damage);
+				// The mesh is all the probes draw, in the shading just reloaded.
+				if (reflection_probes) {
+					invalidate_reflection_probes(
+							probes,
+							glm::vec3(mesh.bounding_sphere),
+							mesh.bounding_sphere.w);
+				}
+				if (shadows) {
+					invalidate_shadow_cache(shadow_maps.cache);
+					invalidate_shadow_atlas(
+							shadow_atlas.atlas,
+							glm::vec3(mesh.bounding_sphere),
+							mesh.bounding_sphere.w);
+				}
+				for (auto& recording : baked) {
+					invalidate_baked_recording(recording);
+				}
+				for (auto* module : retired_shader_modules) {
+					auto evicted = evict_graphics_pipelines(pipeline_states, module);
+					defer_deletion(
+							deletions,
+							[&device, module, evicted = std::move(evicted)] {
+								for (auto* evicted_pipeline : evicted) {
+									vkDestroyPipeline(device, evicted_pipeline, host_callbacks());
+								}
+								vkDestroyShaderModule(device, module, host_callbacks());
+							});
+				}
+				retired_shader_modules.clear();
+				// Queued once the eviction no longer waits for them, so turning
+				// the pre-pass back on finds them compiled.
+				if (!window_state.depth_prepass) {
+					for (const auto* state :
+							 {&depth_only_state, &prepass_shading_state}) {
+						request_graphics_pipeline(
+								device,
+								pipeline_states,
+								*state,
+								CompilePriority::predicted);
+					}
+				}
+			}
+		}
+
+		auto& frame = frames.at(frame_idx);
+		auto device_mask = frame_device_mask(device_group, frames_rendered);
+		wait_for_submit_point(device, frame.done);
+		collect_deletions(deletions, frame.ticket);
+		if (auto pick = picking ? collect_pick(picker, frame_idx, frames_rendered)
+														: std::nullopt;
+				pick.has_value()) {
+			auto draw = pick->id >> g_visibility_triangle_bits;
+			if (draw != hovered_draw) {
+				log_message(
+						LogLevel::info,
+						"Hovering draw {} at {}x{}, {} frames late",
+						static_cast<int64_t>(draw) - 1,
+						pick->pixel.x,
+						pick->pixel.y,
+						pick->latency);
+				hovered_draw = draw;
+			}
+		}
+		reset_frame_arena(*frame_arena);
+		reset_frame_descriptors(device, frame_descriptors, frame_idx);
+		if (capturing) {
+			collect_captures(*capture, frame_idx);
+		}
+
+		// On demand, whether the frame is drawn is decided before acquiring,
+		// since an acquired image has to be presented. Streaming only moves on
+		// in frames that are drawn and changes how the scene looks, so those
+		// frames are drawn in full, like frames with particles, which move on
+		// their own, key presses, which are only measured once presented, and
+		// windows that lost their contents.
+		const auto* demand_snapshot = static_cast<const FrameSnapshot*>(nullptr);
+		auto demand_camera = glm::mat4{1.0F};
+		if (redraw_on_demand) {
+			demand_snapshot = &acquire_frame_snapshot(*simulation);
+			demand_camera = pre_rotation(swap_chain.transform) *
+					interpolate_camera(
+							*simulation,
+							*demand_snapshot,
+							std::chrono::steady_clock::now());
+			if (!damage.bounded) {
+				set_damage_bounds(damage, demand_snapshot->bounds);
+			}
+			auto texture_streaming = texture.has_value() &&
+					texture->resident_level != texture->base_level;
+			auto environment_streaming =
+					environment.has_value() && !environment->ready;
+			auto mirror_stale = std::any_of(
+					mirrors.begin(),
+					mirrors.end(),
+					[](const MirrorWindow& mirror) { return mirror.stale; });
+			if (texture_streaming || environment_streaming || particles ||
+					terrain ||
+					window_state.pending_input.has_value() ||
+					window_state.refresh_requested || mirror_stale) {
+				invalidate_damage(damage);
+			}
+			window_state.refresh_requested = false;
+			if (!has_damage(damage, demand_camera)) {
+				// Idle until input or a window event. The camera of a stress scene
+				// moves and a shader reload is polled for, so with those it is
+				// looked at again after a while.
+				auto polled = config.stress_scene != StressScene::none ||
+						shader_reloader.has_value() ||
+						!retired_shader_modules.empty();
+				if (window == nullptr) {
+					std::this_thread::sleep_for(g_damage_poll_interval);
+				} else if (polled) {
+					glfwWaitEventsTimeout(
+							std::chrono::duration<double>(g_damage_poll_interval).count());
+				} else {
+					glfwWaitEvents();
+				}
+				// Time spent idle is no part of the next frame.
+				hitch_detector.last_frame_end.reset();
+				telemetry.last_frame_end.reset();
+				continue;
+			}
+		}
+
+		// Offscreen targets are owned by the frame slots, so they are free once
+		// the frame is done.
+		auto image_idx = static_cast<uint32_t>(frame_idx);
+		if (!headless) {
+			auto acquire_result = VkResult{};
+			auto acquire = [&] {
+				acquire_result = acquire_swap_chain_image(
+						device,
+						swap_chain.handle,
+						frame.image_available,
+						device_mask,
+						image_idx);
+			};
+			if (early_acquire) {
+				wait_for_submit_task(*submit_thread, early_acquire_ticket);
+				acquire_result = early_acquire_result;
+				image_idx = early_image_idx;
+			} else if (submit_thread) {
+				run_on_submit_thread(*submit_thread, acquire);
+			} else {
+				acquire();
+			}
+			// A swap chain that lost the display takes it again once remade.
+			if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR ||
+					acquire_result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+				swap_chain_stale = true;
+				continue;
+			}
+			if (acquire_result != VK_SUCCESS &&
+					acquire_result != VK_SUBOPTIMAL_KHR) {
+				fmt::print(stderr, "Failed to acquire swap chain image\n");
+				std::terminate();
+			}
+			unpresented_image = image_idx;
+		}
+		// A mirror that has no image this frame skips it.
+		for (auto& mirror : mirrors) {
+			mirror.image_idx.reset();
+			if (mirror.stale) {
+				vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+						physical_device_info.device,
+						mirror.surface,
+						&mirror.capabilities);
+				auto extent = select_swap_extent(mirror.capabilities, mirror.window);
+				if (extent.width == 0 || extent.height == 0) {
+					continue;
+				}
+				if (submit_thread) {
+					wait_for_submit_thread(*submit_thread);
+				}
+				auto present_mode = select_present_mode(
+						window_state.present_policy,
+						mirror.present_modes);
+				update_swap_chain(
+						device,
+						allocator,
+						deletions,
+						image_views,
+						mirror.surface,
+						mirror.capabilities,
+						extent,
+						surface_format,
+						scene_format,
+						depth_format,
+						samples,
+						0,
+						present_mode,
+						swap_chain_image_count(swap_chain_depth, mirror.capabilities),
+						VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+						queue_family_indices,
+						0,
+						swap_chain_compression,
+						switchable_present_modes(
+								physical_device_info.device,
+								mirror.surface,
+								present_mode,
+								mirror.present_modes,
+								swap_chain_maintenance),
+						false,
+						false,
+						false,
+						false,
+						render_pass,
+						mirror.swap_chain);
+				mirror.stale = false;
+			}
+			auto mirror_idx = uint32_t{};
+			auto acquire_result = VkResult{};
+			auto acquire = [&] {
+				acquire_result = vkAcquireNextImageKHR(
+						device,
+						mirror.swap_chain.handle,
+						std::numeric_limits<uint64_t>::max(),
+						mirror.image_available.at(frame_idx),
+						VK_NULL_HANDLE,
+						&mirror_idx);
+			};
+			if (submit_thread) {
+				run_on_submit_thread(*submit_thread, acquire);
+			} else {
+				acquire();
+			}
+			if (acquire_result == VK_ERROR_OUT_OF_DATE_KHR) {
+				mirror.stale = true;
+				continue;
+			}
+			if (acquire_result != VK_SUCCESS &&
+					acquire_result != VK_SUBOPTIMAL_KHR) {
+				fmt::print(stderr, "Failed to acquire swap chain image\n");
+				std::terminate();
+			}
+			mirror.image_idx = mirror_idx;
+		}
+		// Sampled again now that the frame is done waiting, so what it records
+		// follows the latest input.
+		if (window != nullptr) {
+			sample_input(window, window_state);
+		}
+		auto* target_image = headless ? offscreen.images.at(image_idx).handle
+																	: swap_chain.images.at(image_idx);
+		auto* target_view = headless ? offscreen.views.at(image_idx)
+																 : swap_chain.views.at(image_idx);
+		auto* framebuffer = VkFramebuffer{};
+		if (!dynamic_rendering) {
+			framebuffer = headless ? offscreen.framebuffers.at(image_idx)
+														 : swap_chain.framebuffers.at(image_idx);
+		}
+		auto target_extent = headless ? offscreen.extent : swap_chain.extent;
+		// Each eye is drawn at half the output's width.
+		if (stereo) {
+			resize_stereo_target(
+					device,
+					allocator,
+					deletions,
+					stereo_target,
+					scene_format,
+					depth_format,
+					samples,
+					target_extent);
+		}
+		const auto& target_attachments = stereo
+				? stereo_target.attachments
+				: (headless ? offscreen.attachments : swap_chain.attachments);
+		auto render_extent = stereo ? stereo_target.eye_extent : target_extent;
+		if (dynamic_resolution) {
+			auto gpu_milliseconds = latest_gpu_pass_time(profiler, "main");
+			if (gpu_milliseconds.has_value()) {
+				update_dynamic_resolution(resolution, *gpu_milliseconds);
+			}
+			render_extent = scaled_render_extent(resolution, target_extent);
+		}
+		auto lod_scale =
+				static_cast<float>(render_extent.height) * 0.5F / g_lod_pixel_error;
+		signals.clear();
+		auto* frame_fence =
+				advance_submit_point(device, frame.done, graphics_timeline, signals);
+		vkResetCommandPool(device, frame.command_pool, 0);
+		begin_gpu_frame(device, profiler, frame_idx);
+		begin_uniform_frame(uniform_ring, frame_idx);
+		begin_parallel_frame(device, recorder, frame_idx);
+
+		auto group_begin_info = VkDeviceGroupCommandBufferBeginInfo{
+				.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_COMMAND_BUFFER_BEGIN_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.deviceMask = device_mask};
+		auto begin_info = VkCommandBufferBeginInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.pNext = device_mask == 0 ? VK_NULL_HANDLE : &group_begin_info,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+				.pInheritanceInfo = VK_NULL_HANDLE};
+		auto record_start = std::chrono::steady_clock::now();
+		if (overlay) {
+			auto frame_milliseconds = previous_record_start.has_value()
+					? std::chrono::duration<double, std::milli>(
+								record_start - *previous_record_start)
+								.count()
+					: 0.0;
+			begin_overlay_frame(overlay_renderer, frame_idx);
+			write_frame_stats(
+					overlay_renderer,
+					frame_idx,
+					std::max(render_extent.height / 720, 1U),
+					frame_milliseconds,
+					previous_record_milliseconds,
+					profiler,
+					memory_budget);
+		}
+		previous_record_start = record_start;
+		vkBeginCommandBuffer(frame.command_buffer, &begin_info);
+		waits.clear();
+		if (!headless) {
+			waits.emplace_back(SemaphoreOp{
+					.semaphore = frame.image_available,
+					.value = 0,
+					.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT});
+		}
+		for (const auto& mirror : mirrors) {
+			if (mirror.image_idx.has_value()) {
+				waits.emplace_back(SemaphoreOp{
+						.semaphore = mirror.image_available.at(frame_idx),
+						.value = 0,
+						.stages = VK_PIPELINE_STAGE_2_BLIT_BIT});
+			}
+		}
+		// The submit thread hands the compute work to the driver together with
+		// the frame's, in a single call where they share the queue.
+		if (submit_thread) {
+			auto compute_submission =
+					record_compute(device, compute_scheduler, frame_idx, waits);
+			if (compute_submission.has_value()) {
+				queued_submissions.emplace_back(std::move(*compute_submission));
+			}
+		} else {
+			submit_compute(device, compute_scheduler, frame_idx, waits);
+		}
+		// The overlay shows the budgets of the frame before.
+		if (texture.has_value() || overlay) {
+			update_memory_budget(
+					physical_device_info.device,
+					allocator,
+					memory_budget);
+		}
+		if (texture.has_value()) {
+			update_texture_residency(device, uploader, *texture);
+			// After this frame's deletions, before its uploads, so the old
+			// image is only released once the uploads staged into it are done.
+			fit_texture_to_budget(
+					device,
+					allocator,
+					deletions,
+					memory_budget,
+					*texture);
+			stream_texture(device, uploader, *texture, g_texture_stream_budget);
+		}
+		if (environment.has_value()) {
+			update_environment(
+					device,
+					allocator,
+					uploader,
+					deletions,
+					*environment,
+					g_texture_stream_budget);
+		}
+		if (defragmenting && !meshes_movable &&
+				upload_complete(
+						device,
+						uploader,
+						std::max(mesh.ticket, meshlets.ticket))) {
+			// Baked draws bind the buffers moved from.
+			auto moved_mesh = [&] {
+				update_attribute_addresses(device, mesh);
+				for (auto& recording : baked) {
+					invalidate_baked_recording(recording);
+				}
+			};
+			// Ranges of the geometry pool never move, only its pages are bound.
+			if (mesh.pool == nullptr) {
+				add_movable_buffer(defragmenter, mesh.vertices, moved_mesh);
+				add_movable_buffer(defragmenter, mesh.indices, moved_mesh);
+			}
+			if (meshlets.buffer.handle != VK_NULL_HANDLE) {
+				add_movable_buffer(defragmenter, meshlets.buffer, [&] {
+					meshlets.address = buffer_device_address(device, meshlets.buffer);
+				});
+			}
+			meshes_movable = true;
+		}
+		// The clipmap goes with this frame's uploads, which it draws.
+		auto terrain_view = TerrainView{};
+		if (terrain) {
+			terrain_view = terrain_flight(
+					frames_rendered,
+					static_cast<float>(render_extent.width) /
+							static_cast<float>(std::max(render_extent.height, 1U)));
+			update_terrain(
+					device,
+					uploader,
+					clipmap,
+					heightfield,
+					frame_idx,
+					glm::vec2(terrain_view.eye.x, terrain_view.eye.z));
+			// The pages the slot's last frame asked for go with this frame's
+			// uploads too.
+			if (virtual_texture) {
+				update_virtual_texture(
+						device,
+						uploader,
+						terrain_material.texture,
+						frame_idx);
+			}
+		}
+		if (geometry_pool.has_value()) {
+			flush_geometry_binds(device, allocator, *geometry_pool, uploader);
+		}
+		submit_uploads(device, uploader);
+		acquire_uploads(uploader, frame.command_buffer, frame.done, waits);
+		record_decompressions(
+				device,
+				allocator,
+				uploader,
+				deletions,
+				decompressor,
+				frame.command_buffer);
+		if (texture.has_value() && generate_texture_levels) {
+			record_texture_levels(
+					device,
+					deletions,
+					downsampler,
+					uploader,
+					*texture,
+					frame.command_buffer);
+		}
+		if (environment.has_value()) {
+			record_environment(
+					device,
+					allocator,
+					deletions,
+					environment_prefilter,
+					*environment,
+					frame.command_buffer);
+		}
+		auto viewport = VkViewport{
+				.x = 0,
+				.y = 0,
+				.width = static_cast<float>(render_extent.width),
+				.height = static_cast<float>(render_extent.height),
+				.minDepth = 0,
+				.maxDepth = 1};
+		auto scissor = VkRect2D{
+				.offset = VkOffset2D{.x = 0, .y = 0},
+				.extent = render_extent};
+		// The rest of the image still holds what it showed last.
+		auto preserves_target = false;
+		if (redraw_on_demand && !stereo) {
+			scissor = image_damage(damage, image_idx, demand_camera);
+			preserves_target = !is_full_damage(damage, scissor);
+		}
+		auto clear_values = std::array{
+				VkClearValue{.color = {.float32 = {0, 0, 0, 1}}},
+				VkClearValue{
+						.depthStencil = {.depth = g_depth_clear_value, .stencil = 0}}};
+		auto render_pass_begin_info = VkRenderPassBeginInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.renderPass = render_pass,
+				.framebuffer = framebuffer,
+				.renderArea = scissor,
+				.clearValueCount = static_cast<uint32_t>(clear_values.size()),
+				.pClearValues = clear_values.data()};
+		// Pixels no draw covers keep the id 0, or a position of NaN.
+		if (visibility_buffer) {
+			clear_values.at(0).color = VkClearColorValue{.uint32 = {0, 0, 0, 0}};
+		} else if (deferred) {
+			clear_values.at(0).color = VkClearColorValue{
+					.uint32 = {g_gbuffer_empty, g_gbuffer_empty, g_gbuffer_empty, 0}};
+		}
+		// The uniform ring is not thread safe, so per draw constants are written
+		// up front and the recording threads only read the offsets. With
+		// indirect draws there is one set of handles per batch instead.
+		draw_handles.clear();
+		const auto& snapshot = demand_snapshot != nullptr
+				? *demand_snapshot
+				: acquire_frame_snapshot(*simulation);
+		auto draw_uniforms = DrawUniforms{.transform = demand_camera};
+		if (!redraw_on_demand) {
+			draw_uniforms.transform = pre_rotation(swap_chain.transform) *
+					interpolate_camera(
+							*simulation,
+							snapshot,
+							std::chrono::steady_clock::now());
+		}
+		if (temporal_aa) {
+			resize_temporal_aa(
+					device,
+					allocator,
+					deletions,
+					temporal,
+					target_extent);
+			draw_uniforms = temporal_draw_uniforms(
+					temporal,
+					draw_uniforms.transform,
+					render_extent,
+					target_extent);
+		} else if (stereo) {
+			draw_uniforms = stereo_draw_uniforms(draw_uniforms.transform);
+		}
+		particle_system.transform = draw_uniforms.transform;
+		// Streamed after this frame's uploads were submitted, so the nodes go
+		// with the next frame's.
+		if (point_cloud) {
+			resize_point_splats(
+					device,
+					allocator,
+					deletions,
+					bindless,
+					point_renderer,
+					target_extent);
+			update_point_cloud(
+					device,
+					uploader,
+					point_renderer,
+					cloud,
+					frame_idx,
+					draw_uniforms.transform *
+							point_cloud_fit(cloud, mesh.bounding_sphere),
+					lod_scale);
+		}
+		auto uniforms = push_uniforms(uniform_ring, sizeof(draw_uniforms));
+		std::memcpy(uniforms.data, &draw_uniforms, sizeof(draw_uniforms));
+		// The terrain's view goes through the scene's, so it pans and jitters
+		// with it.
+		auto terrain_slot = uint32_t{};
+		if (terrain) {
+			auto terrain_transform = draw_uniforms.transform * terrain_view.transform;
+			auto terrain_uniforms =
+					push_uniforms(uniform_ring, sizeof(terrain_transform));
+			std::memcpy(
+					terrain_uniforms.data,
+					&terrain_transform,
+					sizeof(terrain_transform));
+			terrain_slot = terrain_uniforms.slot;
+		}
+		auto mesh_lod = select_mesh_lod(mesh, draw_uniforms.transform, lod_scale);
+		// gbuffer.frag reads the view of the deferred lights like shader.frag
+		// does the clusters'.
+		auto lights_handle = BindlessHandle{};
+		if (clustered_lights) {
+			lights_handle = light_clusters.frames.at(frame_idx).lights_handle;
+		} else if (deferred) {
+			lights_handle = deferred_shading.frames.at(frame_idx).lights_handle;
+		}
+		auto mesh_handles = DrawHandles{
+				.positions = mesh.attribute_addresses.at(0),
+				.colors = mesh.attribute_addresses.at(1),
+				.vertex_stride = mesh.attribute_stride,
+				.uniform_buffer = uniform_buffer,
+				.instances = indirect_draws
+						? draw_lists.frames.at(frame_idx).instances_handle
+						: g_no_instance_list,
+				.transform = uniforms.slot,
+				.material = 0,
+				.mesh = 0,
+				.position_scale = mesh.position_scale,
+				.position_offset = mesh.position_offset,
+				.meshlets = meshlets.address,
+				.meshlet_count = meshlets.meshlet_count,
+				.lights = lights_handle,
+				.light_grid = clustered_lights
+						? light_clusters.frames.at(frame_idx).grid_handle
+						: BindlessHandle{}};
+		// The acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT, so the
+		// target's transition waits for that stage. Offscreen targets stay in
+		// the attachment layout, swap chain images move to the present layout.
+		auto& graph = render_graphs.at(frame_idx);
+		begin_render_graph(graph, *frame_arena);
+		if (defragmenting) {
+			add_defragment_pass(
+					device,
+					allocator,
+					deletions,
+					graph,
+					defragmenter,
+					g_defragment_frame_budget);
+		}
+		// Every pass drawing the mesh reads the one set of skinned positions.
+		auto skinned_positions = g_graph_imported;
+		if (skinning) {
+			auto skinned =
+					add_skinning_pass(graph, skinner, bindless, frame_idx, mesh);
+			mesh_handles.positions = skinned.positions;
+			mesh_handles.previous_positions = skinned.previous_positions;
+			skinned_positions = skinned.resource;
+		}
+		// A face a frame, drawn like the main pass's plain draws from the
+		// probe with a transform of its own.
+		if (reflection_probes) {
+			if (!probes.placed && upload_complete(device, uploader, mesh.ticket)) {
+				place_reflection_probes(probes, mesh.bounding_sphere);
+			}
+			// Another LOD changes what the probes around the mesh reflect.
+			if (mesh_lod != probes_mesh_lod) {
+				invalidate_reflection_probes(
+						probes,
+						glm::vec3(mesh.bounding_sphere),
+						mesh.bounding_sphere.w);
+				probes_mesh_lod = mesh_lod;
+			}
+			auto* probe_pipeline = request_graphics_pipeline(
+					device,
+					pipeline_states,
+					probe_state,
+					probe_key,
+					CompilePriority::visible);
+			auto selected = select_probe_face(probes, draw_uniforms.transform);
+			if (probe_pipeline != VK_NULL_HANDLE && selected.has_value()) {
+				auto [probe_idx, face] = *selected;
+				const auto& probe = probes.probes.at(probe_idx);
+				auto face_uniforms =
+						DrawUniforms{.transform = probe_face_transform(probe, face)};
+				face_uniforms.previous_transform = face_uniforms.transform;
+				auto face_slot = push_uniforms(uniform_ring, sizeof(face_uniforms));
+				std::memcpy(face_slot.data, &face_uniforms, sizeof(face_uniforms));
+				auto face_handles = mesh_handles;
+				face_handles.transform = face_slot.slot;
+				auto record_face = [&, probe_pipeline, face_handles](
+						VkCommandBuffer command_buffer) {
+					auto face_viewport = VkViewport{
+							.x = 0,
+							.y = 0,
+							.width = static_cast<float>(g_environment_face_size),
+							.height = static_cast<float>(g_environment_face_size),
+							.minDepth = 0,
+							.maxDepth = 1};
+					auto face_scissor = VkRect2D{
+							.offset = VkOffset2D{.x = 0, .y = 0},
+							.extent = VkExtent2D{
+									.width = g_environment_face_size,
+									.height = g_environment_face_size}};
+					vkCmdBindPipeline(
+							command_buffer,
+							VK_PIPELINE_BIND_POINT_GRAPHICS,
+							probe_pipeline);
+					vkCmdSetViewport(command_buffer, 0, 1, &face_viewport);
+					vkCmdSetScissor(command_buffer, 0, 1, &face_scissor);
+					if (extended_dynamic_state) {
+						set_raster_state(command_buffer, probe_state.raster, true);
+					}
+					bind_bindless_table(
+							command_buffer,
+							VK_PIPELINE_BIND_POINT_GRAPHICS,
+							pipeline_layout,
+							bindless);
+					vkCmdPushConstants(
+							command_buffer,
+							pipeline_layout,
+							push_constant_range.stageFlags,
+							0,
+							sizeof(DrawHandles),
+							&face_handles);
+					draw_mesh(command_buffer, mesh, mesh_lod);
+				};
+				add_reflection_probe_passes(
+						graph,
+						profiler,
+						frame_idx,
+						probes,
+						probe_idx,
+						face,
+						record_face);
+			}
+		}
+		// The sun's cascades and the spot lights' atlas tiles, drawn like the
+		// probe faces ahead of the main pass shading with them.
+		auto shadow_image = g_graph_imported;
+		auto atlas_image = g_graph_imported;
+		if (shadows) {
+			// Casters drawn before the mesh was in, or at another LOD, cast other
+			// shadows than it does now.
+			auto mesh_ready = upload_complete(device, uploader, mesh.ticket);
+			if (mesh_ready != shadows_mesh_ready || mesh_lod != shadows_mesh_lod) {
+				invalidate_shadow_cache(shadow_maps.cache);
+				invalidate_shadow_atlas(
+						shadow_atlas.atlas,
+						glm::vec3(mesh.bounding_sphere),
+						mesh.bounding_sphere.w);
+				shadows_mesh_ready = mesh_ready;
+				shadows_mesh_lod = mesh_lod;
+			}
+			auto* shadow_pipeline = request_graphics_pipeline(
+					device,
+					pipeline_states,
+					shadow_state,
+					shadow_key,
+					CompilePriority::visible);
+			auto render = update_shadow_maps(
+					shadow_maps,
+					frame_idx,
+					glm::inverse(draw_uniforms.transform),
+					1.0F,
+					2.0F,
+					sun_direction,
+					sun_color,
+					mesh.bounding_sphere,
+					shadow_atlas_handles(shadow_atlas, frame_idx));
+			// Cascades left out wait for the pipeline, tiles keep what they
+			// were last rendered with.
+			if (shadow_pipeline == VK_NULL_HANDLE) {
+				invalidate_shadow_cache(shadow_maps.cache);
+				render = 0;
+			}
+			update_shadow_atlas_maps(
+					shadow_atlas,
+					frame_idx,
+					lights,
+					draw_uniforms.transform,
+					shadow_pipeline != VK_NULL_HANDLE);
+			shadow_image = import_shadow_maps(graph, shadow_maps);
+			atlas_image = import_shadow_atlas_maps(graph, shadow_atlas);
+			// Draws the mesh into area of a map from transform.
+			auto record_casters = [&, shadow_pipeline](
+					const glm::mat4& transform, VkRect2D area) -> GraphRecord {
+				auto caster_uniforms = DrawUniforms{.transform = transform};
+				caster_uniforms.previous_transform = caster_uniforms.transform;
+				auto caster_slot = push_uniforms(uniform_ring, sizeof(caster_uniforms));
+				std::memcpy(
+						caster_slot.data,
+						&caster_uniforms,
+						sizeof(caster_uniforms));
+				auto caster_handles = mesh_handles;
+				caster_handles.transform = caster_slot.slot;
+				return [&, shadow_pipeline, area, caster_handles](
+						VkCommandBuffer command_buffer) {
+					auto caster_viewport = VkViewport{
+							.x = static_cast<float>(area.offset.x),
+							.y = static_cast<float>(area.offset.y),
+							.width = static_cast<float>(area.extent.width),
+							.height = static_cast<float>(area.extent.height),
+							.minDepth = 0,
+							.maxDepth = 1};
+					vkCmdBindPipeline(
+							command_buffer,
+							VK_PIPELINE_BIND_POINT_GRAPHICS,
+							shadow_pipeline);
+					vkCmdSetViewport(command_buffer, 0, 1, &caster_viewport);
+					vkCmdSetScissor(command_buffer, 0, 1, &area);
+					if (extended_dynamic_state) {
+						set_raster_state(command_buffer, shadow_state.raster, true);
+					}
+					bind_bindless_table(
+							command_buffer,
+							VK_PIPELINE_BIND_POINT_GRAPHICS,
+							pipeline_layout,
+							bindless);
+					vkCmdPushConstants(
+							command_buffer,
+							pipeline_layout,
+							push_constant_range.stageFlags,
+							0,
+							sizeof(DrawHandles),
+							&caster_handles);
+					draw_mesh(command_buffer, mesh, mesh_lod);
+				};
+			};
+			auto resolution = shadow_maps.settings.resolution;
+			for (auto cascade = 0U; cascade < shadow_maps.cache.cascade_count;
+					 cascade++) {
+				if ((render & (1U << cascade)) == 0) {
+					continue;
+				}
+				add_shadow_cascade_pass(
+						graph,
+						profiler,
+						frame_idx,
+						shadow_maps,
+						shadow_image,
+						cascade,
+						record_casters(
+								shadow_maps.cache.cascades.at(cascade).transform,
+								VkRect2D{
+										.offset = VkOffset2D{.x = 0, .y = 0},
+										.extent = VkExtent2D{
+												.width = resolution,
+												.height = resolution}}));
+			}
+			for (auto light : shadow_atlas.atlas.renders) {
+				const auto& entry = shadow_atlas.atlas.lights.at(light);
+				add_shadow_atlas_pass(
+						graph,
+						profiler,
+						frame_idx,
+						shadow_atlas,
+						atlas_image,
+						light,
+						record_casters(
+								entry.transform,
+								VkRect2D{
+										.offset =
+												VkOffset2D{
+														.x = static_cast<int32_t>(entry.tile.x),
+														.y = static_cast<int32_t>(entry.tile.y)},
+										.extent = VkExtent2D{
+												.width = entry.tile.size,
+												.height = entry.tile.size}}));
+			}
+		}
+		auto target_final = GraphState{
+				.stages = VK_PIPELINE_STAGE_2_NONE,
+				.access = VK_ACCESS_2_NONE,
+				.layout = headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+													 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+		auto target = import_graph_image(
+				graph,
+				target_image,
+				target_view,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				GraphState{
+						.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+						.access = VK_ACCESS_2_NONE,
+						.layout = preserves_target ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+																			 : VK_IMAGE_LAYOUT_UNDEFINED},
+				target_final);
+		auto discarded = [](GraphState state) {
+			state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			return state;
+		};
+		auto scene_depth = import_graph_image(
+				graph,
+				target_attachments.depth.image.handle,
+				target_attachments.depth.view,
+				VK_IMAGE_ASPECT_DEPTH_BIT,
+				discarded(g_depth_output),
+				std::nullopt);
+		// The scaled scene goes to the top left of a target the size of the
+		// output, so only a new output extent recreates it. A post-processed
+		// scene is drawn in HDR and sampled by the post passes.
+		// Stereo draws a layer per eye.
+		auto scene_target = target;
+		if (dynamic_resolution || post_process || compute_shading || stereo) {
+			auto scene_extent = stereo ? render_extent : target_extent;
+			scene_target = add_transient_image(
+					graph,
+					VkImageCreateInfo{
+							.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+							.pNext = VK_NULL_HANDLE,
+							.flags = 0,
+							.imageType = VK_IMAGE_TYPE_2D,
+							.format = scene_format,
+							.extent =
+									VkExtent3D{
+											.width = scene_extent.width,
+											.height = scene_extent.height,
+											.depth = 1},
+							.mipLevels = 1,
+							.arrayLayers = stereo ? g_stereo_views : 1U,
+							.samples = VK_SAMPLE_COUNT_1_BIT,
+							.tiling = VK_IMAGE_TILING_OPTIMAL,
+							.usage = scene_target_usage,
+							.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+							.queueFamilyIndexCount = 0,
+							.pQueueFamilyIndices = VK_NULL_HANDLE,
+							.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+					VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		// The visibility buffer or the G-buffer is drawn in place of the scene,
+		// which its shading pass writes.
+		auto raster_target = scene_target;
+		if (compute_shading) {
+			// Picks copy the ids under the cursor out of it.
+			auto visibility_usage = VkImageUsageFlags{
+					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT};
+			if (picking) {
+				visibility_usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			}
+			raster_target = add_transient_image(
+					graph,
+					VkImageCreateInfo{
+							.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+							.pNext = VK_NULL_HANDLE,
+							.flags = 0,
+							.imageType = VK_IMAGE_TYPE_2D,
+							.format = raster_format,
+							.extent =
+									VkExtent3D{
+											.width = target_extent.width,
+											.height = target_extent.height,
+											.depth = 1},
+							.mipLevels = 1,
+							.arrayLayers = 1,
+							.samples = VK_SAMPLE_COUNT_1_BIT,
+							.tiling = VK_IMAGE_TILING_OPTIMAL,
+							.usage = visibility_usage,
+							.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+							.queueFamilyIndexCount = 0,
+							.pQueueFamilyIndices = VK_NULL_HANDLE,
+							.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+					VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		auto motion = g_graph_imported;
+		if (temporal_aa) {
+			motion = add_transient_image(
+					graph,
+					VkImageCreateInfo{
+							.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+							.pNext = VK_NULL_HANDLE,
+							.flags = 0,
+							.imageType = VK_IMAGE_TYPE_2D,
+							.format = g_motion_format,
+							.extent =
+									VkExtent3D{
+											.width = target_extent.width,
+											.height = target_extent.height,
+											.depth = 1},
+							.mipLevels = 1,
+							.arrayLayers = 1,
+							.samples = VK_SAMPLE_COUNT_1_BIT,
+							.tiling = VK_IMAGE_TILING_OPTIMAL,
+							.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+									VK_IMAGE_USAGE_SAMPLED_BIT,
+							.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+							.queueFamilyIndexCount = 0,
+							.pQueueFamilyIndices = VK_NULL_HANDLE,
+							.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+					VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		auto scene_color = g_graph_imported;
+		if (msaa) {
+			scene_color = import_graph_image(
+					graph,
+					target_attachments.color.image.handle,
+					target_attachments.color.view,
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					discarded(g_color_output),
+					std::nullopt);
+		}
+		auto indirect_read = GraphState{
+				.stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+				.access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+				.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+		auto draw_commands = g_graph_imported;
+		auto draw_counts = g_graph_imported;
+		auto pyramid_image = g_graph_imported;
+		auto draw_occlusion = DrawOcclusion{};
+		auto instance_buffer = g_graph_imported;
+		auto impostor_instance_buffer = g_graph_imported;
+		if (indirect_draws) {
+			reset_draw_lists(draw_lists);
+			if (generated_draws) {
+				// Generated draws bind each instance's mesh themselves, so draws
+				// are added as they come, with a batch per mesh and a single
+				// execution drawing all of them.
+				draw_handles.emplace_back(mesh_handles);
+				auto batch = add_draw_batch(draw_lists, mesh, 0);
+				add_generated_instance(draw_lists, batch, uniforms.slot, 0);
+			} else {
+				// Each run of the sorted queue shares its pipeline, material and
+				// mesh, so it becomes one batch drawn with one indirect count draw.
+				// The demo has a single mesh and pipeline, both index 0.
+				reset_draw_queue(draw_queue);
+				auto center = glm::vec4(glm::vec3(mesh.bounding_sphere), 1.0F);
+				enqueue_draw(
+						draw_queue,
+						QueuedDraw{
+								.key = make_sort_key(SortKeyFields{
+										.pass = 0,
+										.pipeline = 0,
+										.material = 0,
+										.mesh = 0,
+										.depth = (draw_uniforms.transform * center).w}),
+								.pipeline = 0,
+								.material = 0,
+								.mesh = 0,
+								.transform = uniforms.slot});
+				sort_draw_queue(draw_queue);
+				for (const auto& run : draw_queue.runs) {
+					auto batch_handles = mesh_handles;
+					batch_handles.material = draw_queue.draws.at(run.first).material;
+					draw_handles.emplace_back(batch_handles);
+					add_draw_batch(draw_lists, mesh, 0);
+					for (auto i = run.first; i < run.first + run.count; i++) {
+						const auto& draw = draw_queue.draws.at(i);
+						add_draw_instance(draw_lists, draw.transform, draw.material);
+					}
+				}
+			}
+			// The frame fence covers the last frame's indirect reads.
+			const auto& list_frame = draw_lists.frames.at(frame_idx);
+			draw_commands = import_graph_buffer(
+					graph,
+					list_frame.commands.handle,
+					GraphState{},
+					std::nullopt);
+			draw_counts = import_graph_buffer(
+					graph,
+					list_frame.counts.handle,
+					GraphState{},
+					std::nullopt);
+			if (occlusion_culling) {
+				resize_depth_pyramid(
+						device,
+						allocator,
+						deletions,
+						bindless,
+						depth_pyramid,
+						target_extent);
+				pyramid_image = import_depth_pyramid(graph, depth_pyramid);
+			}
+			// Taken before this frame's pyramid passes replace what was built.
+			draw_occlusion =
+					depth_pyramid_occlusion(depth_pyramid, draw_uniforms.transform);
+			auto draw_list_pass = add_graph_pass(
+					graph,
+					"draw_list",
+					[&](VkCommandBuffer command_buffer) {
+						auto gpu_pass = begin_gpu_pass(
+								profiler,
+								command_buffer,
+								frame_idx,
+								"draw_list");
+						build_draw_lists(
+								draw_lists,
+								bindless,
+								command_buffer,
+								frame_idx,
+								lod_scale,
+								draw_occlusion);
+						end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+					},
+					false);
+			if (occlusion_culling) {
+				graph_read(
+						graph,
+						draw_list_pass,
+						pyramid_image,
+						GraphState{
+								.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+								.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+								.layout = VK_IMAGE_LAYOUT_GENERAL});
+			}
+			graph_write(
+					graph,
+					draw_list_pass,
+					draw_commands,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+							.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+			// The counts are cleared before the dispatch adds to them.
+			graph_write(
+					graph,
+					draw_list_pass,
+					draw_counts,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_CLEAR_BIT |
+									VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+							.access = VK_ACCESS_2_TRANSFER_WRITE_BIT |
+									VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+		} else {
+			// Draw lists are culled on the GPU, direct draws here. The demo's
+			// transform goes straight to clip space, so it doubles as the view
+			// projection.
+			// Instanced copies are culled through a BVH and the survivors
+			// gathered into the frame's instance stream.
+			const auto& scene_bounds = snapshot.bounds;
+			visible.resize(scene_bounds.x.size());
+			if (hardware_instancing) {
+				find_moved_spheres(fitted_bounds, scene_bounds, moved_bounds);
+				update_dynamic_bvh(*jobs, *scene_bvh, scene_bounds, moved_bounds);
+				fitted_bounds = scene_bounds;
+				cull_bvh(
+						scene_bvh->tree,
+						extract_frustum(draw_uniforms.transform),
+						scene_bounds,
+						visible);
+				// The ray under the cursor runs from the near plane, at 1 under
+				// reversed depth, through the depth halfway to the far one, which
+				// stays finite under an infinite projection. The cursor is in
+				// window coordinates, which the unrotated view is stretched over.
+				auto cursor = std::array<double, 2>{};
+				auto window_size = std::array<int, 2>{};
+				if (bvh_picking) {
+					glfwGetCursorPos(window, &cursor[0], &cursor[1]);
+					glfwGetWindowSize(window, &window_size[0], &window_size[1]);
+				}
+				if (bvh_picking && cursor[0] >= 0.0 && cursor[1] >= 0.0 &&
+						cursor[0] < window_size[0] && cursor[1] < window_size[1]) {
+					auto ndc = glm::vec2(
+							cursor[0] / window_size[0],
+							cursor[1] / window_size[1]);
+					ndc = ndc * 2.0F - 1.0F;
+					auto unproject = glm::inverse(draw_uniforms.transform) *
+							pre_rotation(swap_chain.transform);
+					auto near = unproject * glm::vec4(ndc, 1.0F, 1.0F);
+					auto through = unproject * glm::vec4(ndc, 0.5F, 1.0F);
+					auto origin = glm::vec3(near) / near.w;
+					auto hit = pick_bvh(
+							scene_bvh->tree,
+							scene_bounds,
+							origin,
+							glm::vec3(through) / through.w - origin);
+					auto instance = hit.has_value() ? hit->object + 1 : 0U;
+					if (instance != hovered_instance) {
+						log_message(
+								LogLevel::info,
+								"Hovering instance {} at {}x{}",
+								static_cast<int64_t>(instance) - 1,
+								static_cast<int>(cursor[0]),
+								static_cast<int>(cursor[1]));
+						hovered_instance = instance;
+					}
+				}
+			} else {
+				cull_spheres_parallel(
+						*jobs,
+						extract_frustum(draw_uniforms.transform),
+						scene_bounds,
+						visible);
+			}
+			if (hardware_instancing) {
+				// Distant survivors go to the impostors' stream instead.
+				visible_indices.clear();
+				impostor_indices.clear();
+				auto half_height = static_cast<float>(render_extent.height) * 0.5F;
+				for (auto i = size_t{}; i < snapshot.world.size(); i++) {
+					// Slots of a paged scene without a cell have no radius.
+					if (visible.at(i) == 0 || scene_bounds.radius.at(i) <= 0.0F) {
+						continue;
+					}
+					const auto& instance = snapshot.world.at(i);
+					if (impostors &&
+							impostor_distant(
+									draw_uniforms.transform,
+									instance_bounding_sphere(instance, mesh.bounding_sphere),
+									half_height,
+									static_cast<float>(config.impostor_pixels))) {
+						impostor_indices.emplace_back(static_cast<uint32_t>(i));
+					} else {
+						visible_indices.emplace_back(static_cast<uint32_t>(i));
+					}
+				}
+				// The frame fence covers the last frame's vertex reads.
+				stage_instance_updates(resident_instances, frame_idx, snapshot.world);
+				instance_buffer = import_graph_buffer(
+						graph,
+						instance_stream.frames.at(frame_idx).handle,
+						GraphState{},
+						std::nullopt);
+				stage_instance_gather(
+						resident_instances,
+						frame_idx,
+						instance_stream,
+						instance_buffer,
+						visible_indices);
+				if (impostors) {
+					impostor_instance_buffer = import_graph_buffer(
+							graph,
+							impostor_renderer.instances.frames.at(frame_idx).handle,
+							GraphState{},
+							std::nullopt);
+					stage_instance_gather(
+							resident_instances,
+							frame_idx,
+							impostor_renderer.instances,
+							impostor_instance_buffer,
+							impostor_indices);
+				}
+				add_resident_instance_passes(
+						graph,
+						resident_instances,
+						bindless,
+						frame_idx);
+				if (!visible_indices.empty()) {
+					draw_handles.emplace_back(mesh_handles);
+				}
+			} else if (visible.front() != 0) {
+				draw_handles.emplace_back(mesh_handles);
+			}
+		}
+		// The ids visibility.frag writes are the draws' indices.
+		visibility_draws.clear();
+		if (visibility_buffer) {
+			for (auto i = size_t{}; i < draw_handles.size(); i++) {
+				draw_handles.at(i).draw = static_cast<uint32_t>(i);
+				visibility_draws.emplace_back(
+						visibility_draw(draw_handles.at(i), mesh, mesh_lod));
+			}
+		}
+		auto light_grid = g_graph_imported;
+		if (clustered_lights) {
+			const auto& light_frame = light_clusters.frames.at(frame_idx);
+			light_grid = import_graph_buffer(
+					graph,
+					light_frame.grid.handle,
+					GraphState{},
+					std::nullopt);
+			auto light_pass = add_graph_pass(
+					graph,
+					"light_clusters",
+					[&](VkCommandBuffer command_buffer) {
+						auto gpu_pass = begin_gpu_pass(
+								profiler,
+								command_buffer,
+								frame_idx,
+								"light_clusters");
+						build_light_clusters(
+								light_clusters,
+								bindless,
+								command_buffer,
+								frame_idx,
+								lights,
+								light_view,
+								pre_rotation(swap_chain.transform) * light_projection,
+								glm::vec2(1.0F, 2.0F),
+								render_extent,
+								fog ? cluster_fog(volumetric_fog) : ClusterFog{},
+								decal_list,
+								decals ? cluster_decals(decal_atlas) : ClusterDecals{},
+								shadows ? shadow_maps.frames.at(frame_idx).view_handle
+												: BindlessHandle{});
+						end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+					},
+					false);
+			graph_write(
+					graph,
+					light_pass,
+					light_grid,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+							.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+		}
+		auto fog_volume = g_graph_imported;
+		if (fog) {
+			fog_volume = add_fog_passes(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					volumetric_fog,
+					bindless,
+					frame_idx,
+					light_clusters.frames.at(frame_idx),
+					light_grid,
+					light_view,
+					pre_rotation(swap_chain.transform) * light_projection);
+		}
+		// Foveated rates are written ahead of the main pass, content rates
+		// after it for the next frame, so the first frame shades every pixel.
+		auto rate_image = g_graph_imported;
+		auto rates_ready = false;
+		if (shading_rate) {
+			resize_shading_rate(device, allocator, deletions, rates, target_extent);
+			rate_image = import_shading_rate(graph, rates);
+			if (shading_rate_policy == ShadingRatePolicy::foveated) {
+				add_shading_rate_pass(
+						device,
+						graph,
+						profiler,
+						frame_descriptors,
+						rates,
+						frame_idx,
+						rate_image,
+						g_graph_imported,
+						render_extent,
+						target_extent);
+			}
+			rates_ready = rates.written_extent.width != 0;
+		}
+		auto tlas = g_graph_imported;
+		if (ray_query) {
+			tlas = add_ray_tracing_passes(
+					device,
+					allocator,
+					deletions,
+					graph,
+					ray_tracing,
+					mesh,
+					upload_complete(device, uploader, mesh.ticket),
+					hardware_instancing
+							? std::span<const InstanceTransform>(snapshot.world)
+							: std::span<const InstanceTransform>(identity_instance),
+					frame_idx);
+		}
+		auto inheritance_info = VkCommandBufferInheritanceInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+				.pNext = dynamic_rendering ? &inheritance_rendering_info
+																	 : VK_NULL_HANDLE,
+				.renderPass = render_pass,
+				.subpass = 0,
+				.framebuffer = framebuffer,
+				.occlusionQueryEnable = VK_FALSE,
+				.queryFlags = 0,
+				.pipelineStatistics = 0};
+		inherit_gpu_counters(profiler, inheritance_info);
+		// Until both pre-pass pipelines have compiled the pre-pass is drawn
+		// with shader objects, or skipped for the plain shading pipeline. Either
+		// never waits on a compile.
+		auto* shading_pipeline = pipeline;
+		auto* depth_pipeline = VkPipeline{};
+		auto prepass_objects_drawn = false;
+		if (window_state.depth_prepass) {
+			depth_pipeline = request_graphics_pipeline(
+					device,
+					pipeline_states,
+					depth_only_state,
+					depth_only_key,
+					CompilePriority::visible);
+			auto* equal_pipeline = request_graphics_pipeline(
+					device,
+					pipeline_states,
+					prepass_shading_state,
+					prepass_shading_key,
+					CompilePriority::visible);
+			if (depth_pipeline != VK_NULL_HANDLE &&
+					equal_pipeline != VK_NULL_HANDLE) {
+				shading_pipeline = equal_pipeline;
+			} else if (shader_objects) {
+				depth_pipeline = VK_NULL_HANDLE;
+				shading_pipeline = VK_NULL_HANDLE;
+				prepass_objects_drawn = true;
+			} else {
+				depth_pipeline = VK_NULL_HANDLE;
+			}
+		}
+		if (generated_draws) {
+			reserve_generated_draws(
+					device,
+					allocator,
+					draw_lists,
+					frame_idx,
+					shading_pipeline);
+			if (depth_pipeline != VK_NULL_HANDLE) {
+				reserve_generated_draws(
+						device,
+						allocator,
+						draw_lists,
+						frame_idx,
+						depth_pipeline);
+			}
+		}
+		// Drawn once compiled in the background, like the pre-pass.
+		auto* particle_pipeline = particles
+				? request_graphics_pipeline(
+							device,
+							pipeline_states,
+							particle_state,
+							particle_key,
+							CompilePriority::visible)
+				: VkPipeline{};
+		auto* terrain_pipeline = terrain
+				? request_graphics_pipeline(
+							device,
+							pipeline_states,
+							terrain_state,
+							terrain_key,
+							CompilePriority::visible)
+				: VkPipeline{};
+		auto* impostor_pipeline = impostors
+				? request_graphics_pipeline(
+							device,
+							pipeline_states,
+							impostor_state,
+							impostor_key,
+							CompilePriority::visible)
+				: VkPipeline{};
+		auto* line_pipeline = lines
+				? request_graphics_pipeline(
+							device,
+							pipeline_states,
+							line_state,
+							line_key,
+							CompilePriority::visible)
+				: VkPipeline{};
+		auto* overlay_pipeline = overlay
+				? request_graphics_pipeline(
+							device,
+							pipeline_states,
+							overlay_state,
+							overlay_key,
+							CompilePriority::visible)
+				: VkPipeline{};
+		// A null pipeline draws with the pre-pass shader objects and the state
+		// of the pipeline they stand in for.
+		auto record_draws = [&](
+				VkCommandBuffer command_buffer,
+				VkPipeline draw_pipeline,
+				const GraphicsPipelineState* object_state,
+				size_t begin,
+				size_t end) {
+			if (draw_pipeline != VK_NULL_HANDLE) {
+				vkCmdBindPipeline(
+						command_buffer,
+						VK_PIPELINE_BIND_POINT_GRAPHICS,
+						draw_pipeline);
+				vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+				vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+				if (extended_dynamic_state) {
+					set_raster_state(command_buffer, raster_state, !mesh_shading);
+				}
+			} else {
+				bind_shader_objects(
+						command_buffer,
+						prepass_objects,
+						*object_state,
+						viewport,
+						scissor);
+			}
+			bind_bindless_table(
+					command_buffer,
+					VK_PIPELINE_BIND_POINT_GRAPHICS,
+					pipeline_layout,
+					bindless);
+			for (auto i = begin; i < end; i++) {
+				vkCmdPushConstants(
+						command_buffer,
+						pipeline_layout,
+						push_constant_range.stageFlags,
+						0,
+						sizeof(DrawHandles),
+						&draw_handles.at(i));
+				if (generated_draws) {
+					draw_generated(command_buffer, draw_lists, frame_idx, draw_pipeline);
+				} else if (indirect_draws) {
+					draw_batch(
+							command_buffer,
+							draw_lists,
+							frame_idx,
+							static_cast<uint32_t>(i),
+							mesh);
+				} else if (mesh_shading) {
+					draw_meshlets(command_buffer, meshlets);
+				} else if (hardware_instancing) {
+					draw_mesh_instanced(
+							command_buffer,
+							mesh,
+							mesh_lod,
+							instance_stream,
+							frame_idx);
+				} else {
+					draw_mesh(command_buffer, mesh, mesh_lod);
+				}
+			}
+		};
+		// Baked draws are recorded again when anything the commands hold
+		// changed: the pipeline or shader objects, the dynamic state, the LOD,
+		// the handles pushed, the instances drawn or what the secondaries
+		// inherit.
+		auto record_main_draws = [&](
+				VkCommandBuffer command_buffer,
+				VkPipeline draw_pipeline,
+				const GraphicsPipelineState* object_state,
+				size_t recording) {
+			auto record = [&](VkCommandBuffer secondary, size_t begin, size_t end) {
+				record_draws(secondary, draw_pipeline, object_state, begin, end);
+			};
+			if (!baked_draws) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						draw_handles.size(),
+						record);
+				return;
+			}
+			baked_key.clear();
+			append_baked_key(baked_key, draw_pipeline);
+			if (draw_pipeline == VK_NULL_HANDLE) {
+				append_baked_key(baked_key, prepass_objects.vertex);
+				append_baked_key(baked_key, prepass_objects.fragment);
+				append_baked_key(baked_key, object_state);
+			}
+			append_baked_key(baked_key, viewport);
+			append_baked_key(baked_key, scissor);
+			append_baked_key(baked_key, mesh_lod);
+			append_baked_key(baked_key, inheritance_info.renderPass);
+			append_baked_key(baked_key, inheritance_info.framebuffer);
+			append_baked_key(baked_key, inheritance_info.occlusionQueryEnable);
+			append_baked_key(baked_key, inheritance_info.queryFlags);
+			append_baked_key(baked_key, inheritance_info.pipelineStatistics);
+			if (hardware_instancing) {
+				append_baked_key(baked_key, instance_stream.counts.at(frame_idx));
+			}
+			append_baked_key(baked_key, draw_handles.size());
+			for (const auto& handles : draw_handles) {
+				append_baked_key(baked_key, handles);
+			}
+			record_baked(
+					device,
+					recorder,
+					baked.at(recording),
+					frame_idx,
+					command_buffer,
+					inheritance_info,
+					draw_handles.size(),
+					baked_key,
+					record);
+		};
+		auto record_main = [&](VkCommandBuffer command_buffer) {
+			auto main_pass =
+					begin_gpu_pass(profiler, command_buffer, frame_idx, "main");
+			begin_gpu_counters(profiler, command_buffer, frame_idx, main_pass);
+			if (dynamic_rendering) {
+				auto* rate_view = rates_ready ? graph_image_view(graph, rate_image)
+																			: VkImageView{};
+				auto* motion_view = motion != g_graph_imported
+						? graph_image_view(graph, motion)
+						: VkImageView{};
+				// The temporal pass reading motion vectors and the transparency
+				// pass testing against depth may both have been culled.
+				begin_scene_rendering(
+						command_buffer,
+						graph_image_view(graph, raster_target),
+						motion_view,
+						target_attachments,
+						scissor,
+						clear_values,
+						rate_view,
+						rates.texel_size,
+						stereo ? g_stereo_view_mask : 0U,
+						motion != g_graph_imported &&
+								graph_contents_used_later(graph, motion),
+						graph_contents_used_later(graph, scene_depth));
+			} else {
+				vkCmdBeginRenderPass(
+						command_buffer,
+						&render_pass_begin_info,
+						VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			}
+			// The pre-pass is recorded as a whole before shading, so every draw
+			// tests against the final depth.
+			if (depth_pipeline != VK_NULL_HANDLE || prepass_objects_drawn) {
+				record_main_draws(
+						command_buffer,
+						depth_pipeline,
+						&depth_only_state,
+						0);
+			}
+			record_main_draws(
+					command_buffer,
+					shading_pipeline,
+					&prepass_shading_state,
+					1);
+			if (terrain_pipeline != VK_NULL_HANDLE) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						1,
+						[&](VkCommandBuffer secondary,
+								size_t /*begin*/,
+								size_t /*end*/) {
+							vkCmdBindPipeline(
+									secondary,
+									VK_PIPELINE_BIND_POINT_GRAPHICS,
+									terrain_pipeline);
+							vkCmdSetViewport(secondary, 0, 1, &viewport);
+							vkCmdSetScissor(secondary, 0, 1, &scissor);
+							if (extended_dynamic_state) {
+								set_raster_state(secondary, g_terrain_raster, true);
+							}
+							draw_terrain(
+									secondary,
+									clipmap,
+									bindless,
+									frame_idx,
+									uniform_buffer,
+									terrain_slot,
+									virtual_texture ? &terrain_material : nullptr);
+						});
+			}
+			if (impostor_pipeline != VK_NULL_HANDLE) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						1,
+						[&](VkCommandBuffer secondary,
+								size_t /*begin*/,
+								size_t /*end*/) {
+							vkCmdBindPipeline(
+									secondary,
+									VK_PIPELINE_BIND_POINT_GRAPHICS,
+									impostor_pipeline);
+							vkCmdSetViewport(secondary, 0, 1, &viewport);
+							vkCmdSetScissor(secondary, 0, 1, &scissor);
+							if (extended_dynamic_state) {
+								set_raster_state(secondary, g_impostor_raster, true);
+							}
+							draw_impostors(
+									secondary,
+									impostor_renderer,
+									bindless,
+									frame_idx,
+									uniform_buffer,
+									uniforms.slot,
+									draw_uniforms.transform);
+						});
+			}
+			if (particle_pipeline != VK_NULL_HANDLE && !weighted_oit) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						1,
+						[&](VkCommandBuffer secondary,
+								size_t /*begin*/,
+								size_t /*end*/) {
+							vkCmdBindPipeline(
+									secondary,
+									VK_PIPELINE_BIND_POINT_GRAPHICS,
+									particle_pipeline);
+							vkCmdSetViewport(secondary, 0, 1, &viewport);
+							vkCmdSetScissor(secondary, 0, 1, &scissor);
+							if (extended_dynamic_state) {
+								set_raster_state(secondary, g_particle_raster, true);
+							}
+							draw_particles(
+									secondary,
+									particle_system,
+									bindless,
+									frame_idx,
+									uniform_buffer,
+									uniforms.slot,
+									render_extent);
+						});
+			}
+			if (line_pipeline != VK_NULL_HANDLE && !draw_handles.empty()) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						1,
+						[&](VkCommandBuffer secondary,
+								size_t /*begin*/,
+								size_t /*end*/) {
+							vkCmdBindPipeline(
+									secondary,
+									VK_PIPELINE_BIND_POINT_GRAPHICS,
+									line_pipeline);
+							vkCmdSetViewport(secondary, 0, 1, &viewport);
+							vkCmdSetScissor(secondary, 0, 1, &scissor);
+							if (extended_dynamic_state) {
+								set_raster_state(secondary, g_line_raster, true);
+							}
+							for (auto i = size_t{}; i < draw_handles.size(); i++) {
+								if (conditional_rendering) {
+									begin_batch_condition(
+											secondary,
+											draw_lists,
+											frame_idx,
+											static_cast<uint32_t>(i));
+								}
+								draw_mesh_edges(
+										secondary,
+										line_renderer,
+										bindless,
+										draw_handles.at(i),
+										mesh,
+										mesh_lod,
+										line_style,
+										render_extent);
+								if (conditional_rendering) {
+									vkCmdEndConditionalRenderingEXT(secondary);
+								}
+							}
+						});
+			}
+			if (overlay_pipeline != VK_NULL_HANDLE) {
+				record_parallel(
+						device,
+						recorder,
+						frame_idx,
+						command_buffer,
+						inheritance_info,
+						1,
+						[&](VkCommandBuffer secondary,
+								size_t /*begin*/,
+								size_t /*end*/) {
+							vkCmdBindPipeline(
+									secondary,
+									VK_PIPELINE_BIND_POINT_GRAPHICS,
+									overlay_pipeline);
+							vkCmdSetViewport(secondary, 0, 1, &viewport);
+							vkCmdSetScissor(secondary, 0, 1, &scissor);
+							if (extended_dynamic_state) {
+								set_raster_state(secondary, g_overlay_raster, true);
+							}
+							draw_overlay(
+									secondary,
+									overlay_renderer,
+									bindless,
+									frame_idx,
+									render_extent);
+						});
+			}
+			if (dynamic_rendering) {
+				vkCmdEndRendering(command_buffer);
+			} else {
+				vkCmdEndRenderPass(command_buffer);
+			}
+			end_gpu_counters(profiler, command_buffer, frame_idx, main_pass);
+			end_gpu_pass(profiler, command_buffer, frame_idx, main_pass);
+		};
+		auto scene_pass = add_graph_pass(graph, "main", record_main, false);
+		if (skinning) {
+			graph_read(
+					graph,
+					scene_pass,
+					skinned_positions,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+							.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+		}
+		if (hardware_instancing) {
+			auto instance_read = GraphState{
+					.stages = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+					.access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+			graph_read(graph, scene_pass, instance_buffer, instance_read);
+			if (impostors) {
+				graph_read(graph, scene_pass, impostor_instance_buffer, instance_read);
+			}
+		}
+		if (indirect_draws) {
+			graph_read(graph, scene_pass, draw_commands, indirect_read);
+			auto counts_read = indirect_read;
+			if (conditional_rendering) {
+				counts_read.stages |=
+						VK_PIPELINE_STAGE_2_CONDITIONAL_RENDERING_BIT_EXT;
+				counts_read.access |=
+						VK_ACCESS_2_CONDITIONAL_RENDERING_READ_BIT_EXT;
+			}
+			graph_read(graph, scene_pass, draw_counts, counts_read);
+		}
+		graph_write(graph, scene_pass, raster_target, g_color_output);
+		if (temporal_aa) {
+			graph_write(graph, scene_pass, motion, g_color_output);
+		}
+		if (msaa) {
+			graph_write(graph, scene_pass, scene_color, g_color_output);
+		}
+		graph_write(graph, scene_pass, scene_depth, g_depth_output);
+		if (virtual_texture) {
+			graph_write(
+					graph,
+					scene_pass,
+					import_virtual_texture_feedback(
+							graph,
+							terrain_material.texture,
+							frame_idx),
+					g_virtual_feedback_write);
+		}
+		if (clustered_lights) {
+			graph_read(
+					graph,
+					scene_pass,
+					light_grid,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+							.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+		}
+		if (fog) {
+			graph_read(graph, scene_pass, fog_volume, g_fog_volume_read);
+		}
+		if (shadows) {
+			graph_read(graph, scene_pass, shadow_image, g_shadow_read);
+			graph_read(graph, scene_pass, atlas_image, g_shadow_read);
+		}
+		if (ray_query) {
+			graph_read(graph, scene_pass, tlas, g_tlas_read);
+		}
+		if (rates_ready) {
+			graph_read(graph, scene_pass, rate_image, g_shading_rate_read);
+		}
+		if (shading_rate_policy == ShadingRatePolicy::content) {
+			add_shading_rate_pass(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					rates,
+					frame_idx,
+					rate_image,
+					scene_target,
+					render_extent,
+					target_extent);
+		}
+		if (visibility_buffer) {
+			add_visibility_pass(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					visibility,
+					bindless,
+					frame_idx,
+					visibility_draws,
+					raster_target,
+					scene_target,
+					render_extent,
+					hovered_draw);
+		}
+		if (deferred) {
+			write_deferred_lights(
+					deferred_shading,
+					frame_idx,
+					lights,
+					light_view,
+					pre_rotation(swap_chain.transform) * light_projection,
+					render_extent);
+			auto occlusion_image = g_graph_imported;
+			if (ambient_occlusion) {
+				resize_ambient_occlusion(
+						device,
+						allocator,
+						deletions,
+						occlusion,
+						target_extent);
+				occlusion_image = add_ambient_occlusion_pass(
+						device,
+						graph,
+						profiler,
+						frame_descriptors,
+						occlusion,
+						bindless,
+						frame_idx,
+						deferred_shading.frames.at(frame_idx).lights_handle,
+						raster_target,
+						pre_rotation(swap_chain.transform) * light_projection *
+								light_view,
+						render_extent);
+			}
+			add_deferred_pass(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					deferred_shading,
+					bindless,
+					frame_idx,
+					raster_target,
+					scene_target,
+					occlusion_image,
+					render_extent);
+		}
+		// The cursor is in window coordinates, which the render area is
+		// stretched over.
+		if (picking) {
+			auto cursor = std::array<double, 2>{};
+			auto window_size = std::array<int, 2>{};
+			glfwGetCursorPos(window, &cursor[0], &cursor[1]);
+			glfwGetWindowSize(window, &window_size[0], &window_size[1]);
+			if (cursor[0] >= 0.0 && cursor[1] >= 0.0 &&
+					cursor[0] < window_size[0] && cursor[1] < window_size[1]) {
+				request_pick(
+						picker,
+						glm::uvec2(
+								cursor[0] / window_size[0] * render_extent.width,
+								cursor[1] / window_size[1] * render_extent.height),
+						frames_rendered);
+			}
+			add_pick_pass(graph, picker, frame_idx, raster_target, render_extent);
+		}
+		if (point_cloud) {
+			add_point_cloud_passes(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					point_renderer,
+					bindless,
+					frame_idx,
+					scene_target,
+					render_extent);
+		}
+		// The transparency is drawn once the pipeline is compiled, and the
+		// scene passed on as it is until then.
+		auto opaque_scene = scene_target;
+		if (weighted_oit && particle_pipeline != VK_NULL_HANDLE) {
+			auto draw_transparency = [&, particle_pipeline](
+					VkCommandBuffer command_buffer) {
+				vkCmdBindPipeline(
+						command_buffer,
+						VK_PIPELINE_BIND_POINT_GRAPHICS,
+						particle_pipeline);
+				vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+				vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+				if (extended_dynamic_state) {
+					set_raster_state(command_buffer, g_particle_raster, true);
+				}
+				draw_particles(
+						command_buffer,
+						particle_system,
+						bindless,
+						frame_idx,
+						uniform_buffer,
+						uniforms.slot,
+						render_extent);
+			};
+			opaque_scene = add_transparency_passes(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					transparency,
+					frame_idx,
+					scene_target,
+					scene_depth,
+					draw_transparency,
+					render_extent,
+					target_extent);
+		}
+		// Built once the scene's depth is final, for the next frame's draw
+		// lists.
+		if (occlusion_culling) {
+			add_depth_pyramid_passes(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					depth_pyramid,
+					frame_idx,
+					pyramid_image,
+					scene_depth,
+					draw_uniforms.transform,
+					render_extent);
+		}
+		// The accumulated scene is at the output resolution already.
+		auto post_source = opaque_scene;
+		auto post_extent = render_extent;
+		if (temporal_aa) {
+			post_source = add_temporal_pass(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					temporal,
+					frame_idx,
+					opaque_scene,
+					motion,
+					render_extent,
+					target_extent);
+			post_extent = target_extent;
+		}
+		// The blit below scales the post-processed output instead, unless the
+		// composite writes the target itself.
+		auto blit_source = scene_target;
+		if (post_process) {
+			auto post_output = target;
+			if (!direct_post_output) {
+				blit_source = add_transient_image(
+						graph,
+						VkImageCreateInfo{
+								.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+								.pNext = VK_NULL_HANDLE,
+								.flags = 0,
+								.imageType = VK_IMAGE_TYPE_2D,
+								.format = post_output_format(post.transfer),
+								.extent =
+										VkExtent3D{
+												.width = target_extent.width,
+												.height = target_extent.height,
+												.depth = 1},
+								.mipLevels = 1,
+								.arrayLayers = 1,
+								.samples = VK_SAMPLE_COUNT_1_BIT,
+								.tiling = VK_IMAGE_TILING_OPTIMAL,
+								.usage = VK_IMAGE_USAGE_STORAGE_BIT |
+										VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+								.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+								.queueFamilyIndexCount = 0,
+								.pQueueFamilyIndices = VK_NULL_HANDLE,
+								.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+						VK_IMAGE_ASPECT_COLOR_BIT);
+				post_output = blit_source;
+			}
+			add_post_passes(
+					device,
+					graph,
+					profiler,
+					frame_descriptors,
+					post,
+					frame_idx,
+					post_source,
+					post_output,
+					post_extent,
+					target_extent);
+		}
+		// Also the copy of the post-processed output or the visibility buffer's
+		// scene at full resolution, the blit converts it to the swap chain
+		// format.
+		if (blits_to_target) {
+			auto record_upscale = [&](VkCommandBuffer command_buffer) {
+				auto gpu_pass =
+						begin_gpu_pass(profiler, command_buffer, frame_idx, "upscale");
+				auto subresource = VkImageSubresourceLayers{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = 0,
+						.baseArrayLayer = 0,
+						.layerCount = 1};
+				auto corner = [](VkExtent2D extent) {
+					return VkOffset3D{
+							.x = static_cast<int32_t>(extent.width),
+							.y = static_cast<int32_t>(extent.height),
+							.z = 1};
+				};
+				auto region = VkImageBlit{
+						.srcSubresource = subresource,
+						.srcOffsets = {VkOffset3D{}, corner(post_extent)},
+						.dstSubresource = subresource,
+						.dstOffsets = {VkOffset3D{}, corner(target_extent)}};
+				vkCmdBlitImage(
+						command_buffer,
+						graph_image(graph, blit_source),
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						target_image,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						1,
+						&region,
+						VK_FILTER_LINEAR);
+				end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+			};
+			auto upscale_pass =
+					add_graph_pass(graph, "upscale", record_upscale, false);
+			graph_read(
+					graph,
+					upscale_pass,
+					blit_source,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+							.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+							.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL});
+			graph_write(
+					graph,
+					upscale_pass,
+					target,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+							.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+							.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL});
+		}
+		if (stereo) {
+			add_stereo_copy(
+					graph,
+					profiler,
+					frame_idx,
+					scene_target,
+					target,
+					render_extent);
+		}
+		if (capturing) {
+			add_capture_pass(
+					device,
+					allocator,
+					graph,
+					*capture,
+					frame_idx,
+					target,
+					target_extent,
+					surface_format.format);
+		}
+		// Mirrors get the finished frame scaled to their extent.
+		for (const auto& mirror : mirrors) {
+			if (!mirror.image_idx.has_value()) {
+				continue;
+			}
+			auto* mirror_image = mirror.swap_chain.images.at(*mirror.image_idx);
+			auto mirror_extent = mirror.swap_chain.extent;
+			auto mirror_target = import_graph_image(
+					graph,
+					mirror_image,
+					mirror.swap_chain.views.at(*mirror.image_idx),
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+							.access = VK_ACCESS_2_NONE,
+							.layout = VK_IMAGE_LAYOUT_UNDEFINED},
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_NONE,
+							.access = VK_ACCESS_2_NONE,
+							.layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
+			auto record_mirror = [&, mirror_image, mirror_extent](
+					VkCommandBuffer command_buffer) {
+				auto subresource = VkImageSubresourceLayers{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = 0,
+						.baseArrayLayer = 0,
+						.layerCount = 1};
+				auto corner = [](VkExtent2D extent) {
+					return VkOffset3D{
+							.x = static_cast<int32_t>(extent.width),
+							.y = static_cast<int32_t>(extent.height),
+							.z = 1};
+				};
+				auto region = VkImageBlit{
+						.srcSubresource = subresource,
+						.srcOffsets = {VkOffset3D{}, corner(target_extent)},
+						.dstSubresource = subresource,
+						.dstOffsets = {VkOffset3D{}, corner(mirror_extent)}};
+				vkCmdBlitImage(
+						command_buffer,
+						target_image,
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						mirror_image,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+						1,
+						&region,
+						VK_FILTER_LINEAR);
+			};
+			auto mirror_pass =
+					add_graph_pass(graph, "mirror", record_mirror, false);
+			graph_read(
+					graph,
+					mirror_pass,
+					target,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+							.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+							.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL});
+			graph_write(
+					graph,
+					mirror_pass,
+					mirror_target,
+					GraphState{
+							.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+							.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+							.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL});
+		}
+		execute_render_graph(device, allocator, graph, frame.command_buffer);
+		if (vkEndCommandBuffer(frame.command_buffer) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to record command buffer\n");
+			std::terminate();
+		}
+		auto record_milliseconds = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - record_start)
+				.count();
+		previous_record_milliseconds = record_milliseconds;
+
+		auto* signal_semaphore =
+				headless ? VkSemaphore{} : swap_chain.render_finished.at(image_idx);
+		if (!headless) {
+			signals.emplace_back(SemaphoreOp{
+					.semaphore = signal_semaphore,
+					.value = 0,
+					.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+		}
+		for (const auto& mirror : mirrors) {
+			if (mirror.image_idx.has_value()) {
+				signals.emplace_back(SemaphoreOp{
+						.semaphore =
+								mirror.swap_chain.render_finished.at(*mirror.image_idx),
+						.value = 0,
+						.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+			}
+		}
+		if (submit_thread) {
+			auto& submission = queued_submissions.emplace_back();
+			submission.queue = graphics_queue;
+			submission.command_buffers.assign({frame.command_buffer});
+			submission.waits = waits;
+			submission.signals = signals;
+			submission.fence = frame_fence;
+			submission.device_mask = device_mask;
+			queue_submissions(*submit_thread, std::move(queued_submissions));
+			queued_submissions.clear();
+		} else if (submit_commands(
+							synchronization2,
+							graphics_queue,
+							{&frame.command_buffer, 1},
+							waits,
+							signals,
+							frame_fence,
+							device_mask) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to submit draw command buffer\n");
+			std::terminate();
+		}
+		frame.ticket = end_deletion_frame(deletions);
+
+		if (benchmarking) {
+			// The first call only starts the clock, so startup ends there.
+			if (!benchmark.last_frame_end.has_value()) {
+				end_startup_phase(benchmark, "first_frame");
+			}
+			end_benchmark_frame(benchmark, record_milliseconds);
+			if (benchmark_finished(benchmark)) {
+				break;
+			}
+		}
+		if (++frames_rendered == config.frame_count) {
+			break;
+		}
+		if (headless) {
+			VKDEMO_FRAME_MARK();
+			end_hitch_frame(hitch_detector);
+			end_telemetry_frame(telemetry, allocator, memory_budget, pipeline_states);
+			frame_idx = (frame_idx + 1) % frames.size();
+			continue;
+		}
+
+		// Every window is presented by one call, the first window first. Only
+		// its presents are paced, an id of zero leaves the mirrors' alone.
+		present_request.queue = present_queue;
+		present_request.waits.assign({signal_semaphore});
+		present_request.swap_chains.assign({swap_chain.handle});
+		present_request.indices.assign({image_idx});
+		present_request.ids.clear();
+		auto present_id = next_present_id(frame_pacer);
+		if (frame_pacing) {
+			present_request.ids.emplace_back(present_id);
+		}
+		present_request.fences.clear();
+		present_request.present_modes.clear();
+		if (swap_chain_maintenance) {
+			present_request.fences.emplace_back(
+					next_present_fence(device, swap_chain.present_fences, frame_idx));
+			present_request.present_modes.emplace_back(swap_chain.present_mode);
+		}
+		for (auto& mirror : mirrors) {
+			if (mirror.image_idx.has_value()) {
+				present_request.waits.emplace_back(
+						mirror.swap_chain.render_finished.at(*mirror.image_idx));
+				present_request.swap_chains.emplace_back(mirror.swap_chain.handle);
+				present_request.indices.emplace_back(*mirror.image_idx);
+				if (frame_pacing) {
+					present_request.ids.emplace_back(0);
+				}
+				if (swap_chain_maintenance) {
+					present_request.fences.emplace_back(next_present_fence(
+							device,
+							mirror.swap_chain.present_fences,
+							frame_idx));
+					present_request.present_modes.emplace_back(
+							mirror.swap_chain.present_mode);
+				}
+			}
+		}
+		unpresented_image.reset();
+		// Device groups present the instance of the GPU that drew the frame.
+		present_request.device_mask = device_mask;
+		present_request.group_mode = frame_present_mode(device_group, device_mask);
+		// What changed since the previous present. Mirrors report all of it.
+		auto present_rectangle = VkRectLayerKHR{};
+		if (redraw_on_demand) {
+			present_rectangle = present_damage(damage, demand_camera);
+			record_damage_present(damage, image_idx, demand_camera);
+		}
+		present_request.damage.reset();
+		if (incremental_present) {
+			present_request.damage = present_rectangle;
+		}
+		// On the submit thread the outcomes come in later, usually the previous
+		// frame's.
+		present_outcomes.clear();
+		if (submit_thread) {
+			queue_present(*submit_thread, present_request);
+			present_outcomes = take_present_outcomes(*submit_thread);
+		} else {
+			present_outcomes.emplace_back(
+					present_frame(frame_limiter, present_request));
+		}
+		for (const auto& outcome : present_outcomes) {
+			for (auto i = size_t{1}; i < outcome.swap_chains.size(); i++) {
+				auto presented = std::find_if(
+						mirrors.begin(),
+						mirrors.end(),
+						[&](const MirrorWindow& mirror) {
+							return mirror.swap_chain.handle == outcome.swap_chains.at(i);
+						});
+				auto result = outcome.results.at(i);
+				if (result != VK_SUCCESS && result != VK_ERROR_OUT_OF_DATE_KHR &&
+						result != VK_SUBOPTIMAL_KHR) {
+					fmt::print(stderr, "Failed to present swap chain image\n");
+					std::terminate();
+				}
+				if (presented != mirrors.end() && result != VK_SUCCESS) {
+					presented->stale = true;
+				}
+			}
+			if (window_state.pending_input.has_value()) {
+				log_message(
+						LogLevel::info,
+						"Input to present: {:.2f} ms",
+						std::chrono::duration<double, std::milli>(
+								outcome.presented - *window_state.pending_input)
+								.count());
+				window_state.pending_input.reset();
+			}
+			// Swap chains recreated since are not stale.
+			if (outcome.swap_chains.front() != swap_chain.handle) {
+				continue;
+			}
+			auto present_result = outcome.results.front();
+			if (present_result == VK_ERROR_OUT_OF_DATE_KHR ||
+					present_result == VK_SUBOPTIMAL_KHR ||
+					present_result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+				swap_chain_stale = true;
+			} else if (present_result != VK_SUCCESS) {
+				fmt::print(stderr, "Failed to present swap chain image\n");
+				std::terminate();
+			}
+		}
+		if (record_swap_chain_present(swap_chain_depth)) {
+			swap_chain_stale = true;
+		}
+
+		VKDEMO_FRAME_MARK();
+		end_hitch_frame(hitch_detector);
+		end_telemetry_frame(telemetry, allocator, memory_budget, pipeline_states);
+		frame_idx = (frame_idx + 1) % frames.size();
+	}
+	if (submit_thread) {
+		destroy_submit_thread(*submit_thread);
+	}
+	destroy_simulation(*simulation);
+	destroy_frame_limiter(frame_limiter);
+	vkDeviceWaitIdle(device);
+	if (swap_chain_maintenance && unpresented_image.has_value()) {
+		release_swap_chain_images(
+				device,
+				swap_chain.handle,
+				std::span{&*unpresented_image, 1});
+		for (const auto& mirror : mirrors) {
+			if (mirror.image_idx.has_value()) {
+				release_swap_chain_images(
+						device,
+						mirror.swap_chain.handle,
+						std::span{&*mirror.image_idx, 1});
+			}
+		}
+	}
+	if (benchmarking) {
+		flush_gpu_profiler(device, profiler);
+		write_benchmark_report(
+				benchmark,
+				profiler,
+				physical_device_info.properties.deviceName,
+				headless,
+				window_state.depth_prepass);
+	}
+
+	if (capturing) {
+		destroy_frame_capture(device, allocator, *capture);
+	}
+	flush_deletions(deletions);
+	// Pipelines still using them belong to the pipeline state cache.
+	for (auto* module : retired_shader_modules) {
+		vkDestroyShaderModule(device, module, host_callbacks());
+	}
+	destroy_offscreen_target(device, allocator, offscreen);
+	destroy_swap_chain(device, allocator, image_views, swap_chain);
+	for (auto& mirror : mirrors) {
+		destroy_mirror_window(instance, device, allocator, image_views, mirror);
+	}
+	destroy_image_view_cache(device, image_views);
+	destroy_defragmenter(device, allocator, defragmenter);
+	destroy_mesh(device, allocator, mesh);
+	if (geometry_pool.has_value()) {
+		destroy_geometry_pool(device, allocator, *geometry_pool);
+	}
+	destroy_instance_stream(device, allocator, bindless, instance_stream);
+	if (hardware_instancing) {
+		destroy_resident_instances(device, allocator, bindless, resident_instances);
+	}
+	if (ray_query) {
+		destroy_ray_tracing(device, allocator, ray_tracing);
+	}
+	destroy_meshlet_mesh(device, allocator, meshlets);
+	if (texture.has_value()) {
+		destroy_texture(device, allocator, *texture);
+	}
+	if (environment.has_value()) {
+		destroy_environment(device, allocator, *environment);
+	}
+	if (reflection_probes) {
+		destroy_reflection_probes(device, allocator, probes);
+	}
+	if (baked_draws) {
+		for (auto& recording : baked) {
+			destroy_baked_recording(device, recording);
+		}
+	}
+	destroy_parallel_recorder(device, recorder);
+	destroy_gpu_profiler(device, profiler);
+	save_pipeline_manifest(pipeline_manifest_file, pipeline_states.used);
+	destroy_pipeline_state_cache(device, pipeline_states);
+	destroy_compile_pool(*compile_pool);
+	for (auto& shader : identified_shaders) {
+		release_shader(shader);
+	}
+	if (shader_objects) {
+		destroy_shader_objects(device, prepass_objects);
+	}
+	if (shader_reloader.has_value()) {
+		destroy_shader_reloader(*jobs, *shader_reloader);
+	}
+	destroy_dynamic_bvh(*jobs, *scene_bvh);
+	destroy_async_scheduler(*async_scheduler);
+	destroy_job_system(*jobs);
+	destroy_compute_scheduler(device, compute_scheduler);
+	destroy_uploader(device, uploader);
+	destroy_decompressor(device, allocator, decompressor);
+	if (generate_texture_levels) {
+		destroy_downsampler(device, allocator, downsampler);
+	}
+	if (indirect_draws) {
+		destroy_draw_lists(device, allocator, bindless, draw_lists);
+	}
+	if (clustered_lights) {
+		destroy_light_clusters(device, allocator, bindless, light_clusters);
+	}
+	if (decals) {
+		destroy_decal_atlas(device, allocator, bindless, samplers, decal_atlas);
+	}
+	if (fog) {
+		destroy_volumetric_fog(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				volumetric_fog);
+	}
+	if (shadows) {
+		destroy_shadow_atlas_maps(device, allocator, bindless, shadow_atlas);
+		destroy_shadow_maps(device, allocator, bindless, samplers, shadow_maps);
+	}
+	if (visibility_buffer) {
+		destroy_visibility_shading(device, allocator, bindless, visibility);
+	}
+	if (deferred) {
+		destroy_deferred_shading(device, allocator, bindless, deferred_shading);
+	}
+	if (ambient_occlusion) {
+		destroy_ambient_occlusion(device, allocator, occlusion);
+	}
+	if (occlusion_culling) {
+		destroy_depth_pyramid(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				depth_pyramid);
+	}
+	if (picking) {
+		destroy_picker(device, allocator, picker);
+	}
+	if (point_cloud) {
+		destroy_point_renderer(device, allocator, bindless, point_renderer);
+		close_point_cloud(cloud);
+	}
+	if (shading_rate) {
+		destroy_shading_rate(device, samplers, allocator, rates);
+	}
+	if (temporal_aa) {
+		destroy_temporal_aa(device, samplers, allocator, temporal);
+	}
+	if (stereo) {
+		destroy_stereo_target(device, allocator, stereo_target);
+	}
+	if (particles) {
+		destroy_particle_system(device, allocator, bindless, particle_system);
+	}
+	if (lines) {
+		destroy_line_renderer(device, line_renderer);
+	}
+	if (overlay) {
+		destroy_overlay_renderer(device, allocator, bindless, overlay_renderer);
+	}
+	if (virtual_texture) {
+		destroy_terrain_material(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				terrain_material);
+	}
+	if (terrain) {
+		destroy_terrain(device, allocator, bindless, samplers, clipmap);
+		close_heightfield(heightfield);
+	}
+	if (impostors) {
+		destroy_impostor_renderer(
+				device,
+				allocator,
+				bindless,
+				samplers,
+				impostor_renderer);
+	}
+	if (skinning) {
+		destroy_skinner(device, allocator, bindless, skinner);
+	}
+	if (weighted_oit) {
+		destroy_transparency(device, samplers, transparency);
+	}
+	if (post_process) {
+		destroy_post_process(device, samplers, post);
+	}
+	if (!config.environment.empty() || reflection_probes) {
+		destroy_environment_prefilter(device, samplers, environment_prefilter);
+	}
+	destroy_sampler_cache(device, samplers);
+	destroy_descriptor_allocator(device, allocator, frame_descriptors);
+	destroy_bindless_table(device, bindless);
+	destroy_uniform_ring(device, allocator, uniform_ring);
+	for (auto& graph : render_graphs) {
+		destroy_render_graph(device, allocator, graph);
+	}
+	destroy_frame_arena(*frame_arena);
+	destroy_allocator(device, allocator);
+	for (auto& frame : frames) {
+		destroy_frame(device, frame);
+	}
+	destroy_queue_timeline(device, graphics_timeline);
+	save_pipeline_cache(
+			device,
+			pipeline_cache,
+			physical_device_info.properties,
+			pipeline_cache_file);
+	if (shared_pipeline_cache.has_value()) {
+		save_shared_pipeline_cache(
+				device,
+				pipeline_cache,
+				physical_device_info.properties,
+				*shared_pipeline_cache);
+	}
+	// Saved with the cache they find pipelines in. Shaders this run did not
+	// load keep their identifiers for runs that do.
+	if (module_identifiers) {
+		for (auto i = size_t{}; i < shader_jobs.size(); i++) {
+			if (!shader_identifiers.at(i).empty()) {
+				const auto& job = shader_jobs.at(i);
+				stored_identifiers.identifiers.insert_or_assign(
+						shader_binary_name(job.shader, job.variant),
+						shader_identifiers.at(i));
+			}
+		}
+		save_shader_identifiers(shader_identifier_file, stored_identifiers);
+	}
+	vkDestroyPipelineCache(device, pipeline_cache, host_callbacks());
+	vkDestroyRenderPass(device, render_pass, host_callbacks());
+	destroy_pipeline_layout_cache(device, pipeline_layouts);
+	vkDestroyShaderModule(device, vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, frag_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, draw_list_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, task_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, mesh_shader_module, host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			bloom_downsample_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(device, bloom_blur_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, post_composite_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, light_cluster_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, visibility_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, deferred_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, fog_scatter_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, fog_integrate_shader_module, host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			ambient_occlusion_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(device, depth_pyramid_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, shading_rate_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, temporal_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, particles_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, radix_sort_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, scan_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, particle_vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, particle_frag_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, oit_composite_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, decompress_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, downsample_shader_module, host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			environment_specular_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			environment_brdf_lut_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			environment_irradiance_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(
+			device,
+			environment_cube_shader_module,
+			host_callbacks());
+	vkDestroyShaderModule(device, point_splat_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, point_resolve_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, line_vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, line_frag_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, terrain_vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, terrain_frag_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, impostor_vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, impostor_frag_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, skinning_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, instance_copy_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, overlay_vert_shader_module, host_callbacks());
+	vkDestroyShaderModule(device, overlay_frag_shader_module, host_callbacks());
+	vkDestroyDevice(device, host_callbacks());
+	if (!headless) {
+		vkDestroySurfaceKHR(instance, surface, host_callbacks());
+	}
+#ifdef USE_VALIDATION_LAYERS
+	vkDestroyDebugUtilsMessengerEXT(instance, messenger, host_callbacks());
+#endif
+	vkDestroyInstance(instance, host_callbacks());
+	if (archive.has_value()) {
+		close_archive(*archive);
+	}
+	stop_log();
+	if (host_allocator) {
+		install_host_allocator(nullptr);
+		print_host_allocator_stats(*host_allocator);
+		destroy_host_allocator(*host_allocator);
 	}
-	vkDestroySwapchainKHR(device, swap_chain, VK_NULL_HANDLE);
-	vkDestroyDevice(device, VK_NULL_HANDLE);
-	vkDestroySurfaceKHR(instance, surface, VK_NULL_HANDLE);
-#ifdef USE_VALIDATION_LAYERS
-	auto vkDestroyDebugUtilsMessengerExt =
-			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-			reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
-					vk_func(instance, "vkDestroyDebugUtilsMessengerEXT"));
-	vkDestroyDebugUtilsMessengerExt(instance, messenger, nullptr);
-#endif
-	vkDestroyInstance(instance, VK_NULL_HANDLE);
 	glfwTerminate();
+	unload_vulkan_loader();
 	return EXIT_SUCCESS;
 }
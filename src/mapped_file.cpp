@@ -0,0 +1,107 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+auto map_file(const std::filesystem::path& path) -> std::optional<MappedFile> {
+	auto* file = CreateFileW(
+			path.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return std::nullopt;
+	}
+	auto size = LARGE_INTEGER{};
+	if (GetFileSizeEx(file, &size) == 0 || size.QuadPart == 0) {
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	auto* mapping =
+			CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	const auto* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	return MappedFile{
+			.bytes = std::span(
+					static_cast<const std::byte*>(data),
+					static_cast<size_t>(size.QuadPart)),
+			.borrowed = false,
+			.file_handle = file,
+			.mapping_handle = mapping};
+}
+
+void unmap_file(MappedFile& file) {
+	if (file.borrowed) {
+		file = MappedFile{};
+		return;
+	}
+	if (file.mapping_handle == nullptr) {
+		// Read into memory of its own by the file reader.
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+		VirtualFree(const_cast<std::byte*>(file.bytes.data()), 0, MEM_RELEASE);
+		file = MappedFile{};
+		return;
+	}
+	UnmapViewOfFile(file.bytes.data());
+	CloseHandle(file.mapping_handle);
+	CloseHandle(file.file_handle);
+	file = MappedFile{};
+}
+
+#else
+
+auto map_file(const std::filesystem::path& path) -> std::optional<MappedFile> {
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+	auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return std::nullopt;
+	}
+	struct stat info {};
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return std::nullopt;
+	}
+	auto size = static_cast<size_t>(info.st_size);
+	auto* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file.
+	close(fd);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+	if (data == MAP_FAILED) {
+		return std::nullopt;
+	}
+	return MappedFile{
+			.bytes = std::span(static_cast<const std::byte*>(data), size)};
+}
+
+void unmap_file(MappedFile& file) {
+	if (file.borrowed) {
+		file = MappedFile{};
+		return;
+	}
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+	munmap(const_cast<std::byte*>(file.bytes.data()), file.bytes.size());
+	file = MappedFile{};
+}
+
+#endif
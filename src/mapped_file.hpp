@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+// A read-only view of a whole file. Mappings are page aligned, so the bytes
+// can be reinterpreted as any type with natural alignment up to a page. The
+// file reader of file_io.hpp hands out copies in page aligned memory of their
+// own, which unmap_file frees the same way.
+struct MappedFile {
+	std::span<const std::byte> bytes;
+	// A view into the mapping of an archive, see archive.hpp, which stays
+	// mapped when unmap_file releases the view.
+	bool borrowed{};
+#ifdef _WIN32
+	void* file_handle{};
+	void* mapping_handle{};
+#endif
+};
+
+auto map_file(const std::filesystem::path& path) -> std::optional<MappedFile>;
+void unmap_file(MappedFile& file);
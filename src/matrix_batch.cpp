@@ -0,0 +1,265 @@
+#include "matrix_batch.hpp"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+// SSE2 is part of x86-64, AVX2 is compiled for through target attributes and
+// only called once the CPU was checked for it.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MATRIX_BATCH_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+void check_sizes(size_t expected, size_t size) {
+	if (size != expected) {
+		fmt::print(
+				stderr,
+				"Matrix batch size mismatch: {} items, expected {}\n",
+				size,
+				expected);
+		std::terminate();
+	}
+}
+
+#ifdef MATRIX_BATCH_X86
+auto detect_avx2() -> bool {
+	// Globals are initialized before the CPU model is guaranteed to be.
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0 &&
+			__builtin_cpu_supports("fma") != 0;
+}
+
+const auto g_avx2 = detect_avx2();
+
+// Columns are contiguous, a product's column j only needs column j of b.
+[[gnu::target("avx2,fma")]] void multiply_avx2(
+		const float* a,
+		const float* b,
+		float* out) {
+	auto a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a));
+	auto a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 4));
+	auto a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 8));
+	auto a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 12));
+	// Two columns of b at a time, one per 128-bit lane.
+	for (auto column = 0; column < 16; column += 8) {
+		auto columns = _mm256_loadu_ps(b + column);
+		auto result = _mm256_mul_ps(a0, _mm256_shuffle_ps(columns, columns, 0x00));
+		result = _mm256_fmadd_ps(
+				a1,
+				_mm256_shuffle_ps(columns, columns, 0x55),
+				result);
+		result = _mm256_fmadd_ps(
+				a2,
+				_mm256_shuffle_ps(columns, columns, 0xAA),
+				result);
+		result = _mm256_fmadd_ps(
+				a3,
+				_mm256_shuffle_ps(columns, columns, 0xFF),
+				result);
+		_mm256_storeu_ps(out + column, result);
+	}
+}
+
+[[gnu::target("avx2,fma")]] void project_avx2(
+		const float* transform,
+		const glm::vec3* points,
+		glm::vec4* out,
+		size_t count) {
+	auto c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform));
+	auto c1 =
+			_mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform + 4));
+	auto c2 =
+			_mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform + 8));
+	auto c3 =
+			_mm256_broadcast_ps(reinterpret_cast<const __m128*>(transform + 12));
+	auto i = size_t{};
+	// Two points at a time, one per 128-bit lane.
+	for (; i + 2 <= count; i += 2) {
+		const auto& first = points[i];
+		const auto& second = points[i + 1];
+		auto clip = _mm256_fmadd_ps(
+				c0,
+				_mm256_setr_m128(_mm_set1_ps(first.x), _mm_set1_ps(second.x)),
+				c3);
+		clip = _mm256_fmadd_ps(
+				c1,
+				_mm256_setr_m128(_mm_set1_ps(first.y), _mm_set1_ps(second.y)),
+				clip);
+		clip = _mm256_fmadd_ps(
+				c2,
+				_mm256_setr_m128(_mm_set1_ps(first.z), _mm_set1_ps(second.z)),
+				clip);
+		auto projected =
+				_mm256_div_ps(clip, _mm256_shuffle_ps(clip, clip, 0xFF));
+		// Keeps clip w in the last component of each point.
+		_mm256_storeu_ps(&out[i].x, _mm256_blend_ps(projected, clip, 0x88));
+	}
+	for (; i < count; i++) {
+		const auto& point = points[i];
+		auto clip = _mm_add_ps(
+				_mm_add_ps(
+						_mm256_castps256_ps128(c3),
+						_mm_mul_ps(_mm256_castps256_ps128(c0), _mm_set1_ps(point.x))),
+				_mm_add_ps(
+						_mm_mul_ps(_mm256_castps256_ps128(c1), _mm_set1_ps(point.y)),
+						_mm_mul_ps(_mm256_castps256_ps128(c2), _mm_set1_ps(point.z))));
+		auto projected = _mm_div_ps(clip, _mm_shuffle_ps(clip, clip, 0xFF));
+		_mm_storeu_ps(&out[i].x, _mm_blend_ps(projected, clip, 0x8));
+	}
+}
+#endif
+
+#if defined(MATRIX_BATCH_X86)
+void multiply(const float* a, const float* b, float* out) {
+	auto a0 = _mm_loadu_ps(a);
+	auto a1 = _mm_loadu_ps(a + 4);
+	auto a2 = _mm_loadu_ps(a + 8);
+	auto a3 = _mm_loadu_ps(a + 12);
+	for (auto column = 0; column < 16; column += 4) {
+		auto columns = _mm_loadu_ps(b + column);
+		auto result = _mm_add_ps(
+				_mm_add_ps(
+						_mm_mul_ps(a0, _mm_shuffle_ps(columns, columns, 0x00)),
+						_mm_mul_ps(a1, _mm_shuffle_ps(columns, columns, 0x55))),
+				_mm_add_ps(
+						_mm_mul_ps(a2, _mm_shuffle_ps(columns, columns, 0xAA)),
+						_mm_mul_ps(a3, _mm_shuffle_ps(columns, columns, 0xFF))));
+		_mm_storeu_ps(out + column, result);
+	}
+}
+
+void project(
+		const float* transform,
+		const glm::vec3& point,
+		glm::vec4& out) {
+	auto clip = _mm_add_ps(
+			_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(transform), _mm_set1_ps(point.x)),
+					_mm_mul_ps(_mm_loadu_ps(transform + 4), _mm_set1_ps(point.y))),
+			_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(transform + 8), _mm_set1_ps(point.z)),
+					_mm_loadu_ps(transform + 12)));
+	auto w = _mm_shuffle_ps(clip, clip, 0xFF);
+	_mm_storeu_ps(&out.x, _mm_div_ps(clip, w));
+	out.w = _mm_cvtss_f32(w);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+void multiply(const float* a, const float* b, float* out) {
+	auto a0 = vld1q_f32(a);
+	auto a1 = vld1q_f32(a + 4);
+	auto a2 = vld1q_f32(a + 8);
+	auto a3 = vld1q_f32(a + 12);
+	for (auto column = 0; column < 16; column += 4) {
+		auto columns = vld1q_f32(b + column);
+		auto result = vmulq_laneq_f32(a0, columns, 0);
+		result = vfmaq_laneq_f32(result, a1, columns, 1);
+		result = vfmaq_laneq_f32(result, a2, columns, 2);
+		result = vfmaq_laneq_f32(result, a3, columns, 3);
+		vst1q_f32(out + column, result);
+	}
+}
+
+void project(
+		const float* transform,
+		const glm::vec3& point,
+		glm::vec4& out) {
+	auto clip = vld1q_f32(transform + 12);
+	clip = vfmaq_n_f32(clip, vld1q_f32(transform), point.x);
+	clip = vfmaq_n_f32(clip, vld1q_f32(transform + 4), point.y);
+	clip = vfmaq_n_f32(clip, vld1q_f32(transform + 8), point.z);
+	auto w = vgetq_lane_f32(clip, 3);
+	vst1q_f32(&out.x, vsetq_lane_f32(w, vdivq_f32(clip, vdupq_n_f32(w)), 3));
+}
+#else
+void multiply(const float* a, const float* b, float* out) {
+	auto left = glm::mat4{};
+	auto right = glm::mat4{};
+	std::memcpy(&left[0].x, a, sizeof(left));
+	std::memcpy(&right[0].x, b, sizeof(right));
+	auto result = left * right;
+	std::memcpy(out, &result[0].x, sizeof(result));
+}
+
+void project(
+		const float* transform,
+		const glm::vec3& point,
+		glm::vec4& out) {
+	auto matrix = glm::mat4{};
+	std::memcpy(&matrix[0].x, transform, sizeof(matrix));
+	auto clip = matrix * glm::vec4(point, 1.0F);
+	out = glm::vec4(glm::vec3(clip) / clip.w, clip.w);
+}
+#endif
+
+}  // namespace
+
+void multiply_matrices(
+		const glm::mat4& a,
+		std::span<const glm::mat4> b,
+		std::span<glm::mat4> out) {
+	check_sizes(b.size(), out.size());
+	// a is copied, since out may hold it.
+	auto left = a;
+#ifdef MATRIX_BATCH_X86
+	if (g_avx2) {
+		for (auto i = size_t{}; i < b.size(); i++) {
+			multiply_avx2(&left[0].x, &b[i][0].x, &out[i][0].x);
+		}
+		return;
+	}
+#endif
+	for (auto i = size_t{}; i < b.size(); i++) {
+		multiply(&left[0].x, &b[i][0].x, &out[i][0].x);
+	}
+}
+
+void multiply_matrices(
+		std::span<const glm::mat4> a,
+		std::span<const glm::mat4> b,
+		std::span<glm::mat4> out) {
+	check_sizes(a.size(), b.size());
+	check_sizes(a.size(), out.size());
+#ifdef MATRIX_BATCH_X86
+	if (g_avx2) {
+		for (auto i = size_t{}; i < a.size(); i++) {
+			multiply_avx2(&a[i][0].x, &b[i][0].x, &out[i][0].x);
+		}
+		return;
+	}
+#endif
+	for (auto i = size_t{}; i < a.size(); i++) {
+		multiply(&a[i][0].x, &b[i][0].x, &out[i][0].x);
+	}
+}
+
+void project_points(
+		const glm::mat4& transform,
+		std::span<const glm::vec3> points,
+		std::span<glm::vec4> out) {
+	check_sizes(points.size(), out.size());
+#ifdef MATRIX_BATCH_X86
+	if (g_avx2) {
+		project_avx2(&transform[0].x, points.data(), out.data(), points.size());
+		return;
+	}
+#endif
+	for (auto i = size_t{}; i < points.size(); i++) {
+		project(&transform[0].x, points[i], out[i]);
+	}
+}
+
+auto matrix_batch_uses_avx2() -> bool {
+#ifdef MATRIX_BATCH_X86
+	return g_avx2;
+#else
+	return false;
+#endif
+}
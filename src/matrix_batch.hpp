@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <span>
+
+// Kernels for arrays of matrices and points, where glm's per-call operators
+// leave most of the vector units idle. x86 builds pick AVX2 with FMA at
+// runtime when the CPU has it and SSE2 otherwise, ARM64 builds use NEON.
+// Other targets fall back to glm.
+
+// out[i] = a * b[i]. out must be as long as b and may be b.
+void multiply_matrices(
+		const glm::mat4& a,
+		std::span<const glm::mat4> b,
+		std::span<glm::mat4> out);
+// out[i] = a[i] * b[i]. a, b and out must be equally long, out may be either.
+void multiply_matrices(
+		std::span<const glm::mat4> a,
+		std::span<const glm::mat4> b,
+		std::span<glm::mat4> out);
+
+// Transforms points to clip space and divides by w. out[i] holds the
+// normalized device coordinates in xyz and clip w in w, negative w being
+// behind the eye. out must be as long as points. Every frame damage tracking
+// projects the scene bounds with it, and with --shadows the cascades unproject
+// the view frustum's corners.
+void project_points(
+		const glm::mat4& transform,
+		std::span<const glm::vec3> points,
+		std::span<glm::vec4> out);
+
+// Whether the AVX2 kernels are used.
+auto matrix_batch_uses_avx2() -> bool;
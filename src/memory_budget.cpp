@@ -0,0 +1,64 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+
+auto create_memory_budget(
+		const Allocator& allocator,
+		bool extension,
+		VkDeviceSize limit) -> MemoryBudget {
+	auto budget = MemoryBudget{};
+	budget.extension = extension;
+	budget.limit = limit;
+	budget.heap_count = allocator.memory_properties.memoryHeapCount;
+	return budget;
+}
+
+void update_memory_budget(
+		VkPhysicalDevice& physical_device,
+		const Allocator& allocator,
+		MemoryBudget& budget) {
+	auto budget_properties = VkPhysicalDeviceMemoryBudgetPropertiesEXT{
+			.sType =
+					VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.heapBudget = {},
+			.heapUsage = {}};
+	if (budget.extension) {
+		auto properties = VkPhysicalDeviceMemoryProperties2{
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+				.pNext = &budget_properties,
+				.memoryProperties = {}};
+		vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties);
+	}
+	for (auto i = uint32_t{}; i < budget.heap_count; i++) {
+		auto& heap = budget.heaps.at(i);
+		// The driver's usage may not include allocations made since it last
+		// updated it.
+		heap.usage = allocator.heap_usage.at(i);
+		if (budget.extension) {
+			heap.budget = budget_properties.heapBudget[i];
+			heap.usage = std::max(heap.usage, budget_properties.heapUsage[i]);
+		} else {
+			heap.budget = allocator.memory_properties.memoryHeaps[i].size *
+					g_fallback_budget_percent / 100;
+		}
+		if (budget.limit != 0) {
+			heap.budget = std::min(heap.budget, budget.limit);
+		}
+	}
+}
+
+auto memory_pressure(
+		const MemoryBudget& budget,
+		uint32_t heap,
+		VkDeviceSize added) -> MemoryPressure {
+	const auto& entry = budget.heaps.at(heap);
+	auto usage = (entry.usage + added) * 100;
+	if (usage >= entry.budget * g_budget_over_percent) {
+		return MemoryPressure::over;
+	}
+	if (usage >= entry.budget * g_budget_near_percent) {
+		return MemoryPressure::near;
+	}
+	return MemoryPressure::low;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Share of a heap, in percent, assumed to be available without
+// VK_EXT_memory_budget. The rest is left to other processes and the driver.
+constexpr auto g_fallback_budget_percent = VkDeviceSize{80};
+// Usage at or above these shares of the budget, in percent, is near and over
+// it. Resources only grow while they stay below the near share, so usage
+// settles between the two instead of evicting and restoring every frame.
+constexpr auto g_budget_near_percent = VkDeviceSize{80};
+constexpr auto g_budget_over_percent = VkDeviceSize{95};
+
+enum class MemoryPressure {
+	low,
+	// Nothing should grow.
+	near,
+	// Resources that can be rebuilt smaller should be.
+	over,
+};
+
+struct HeapBudget {
+	VkDeviceSize budget{};
+	VkDeviceSize usage{};
+};
+
+// What each memory heap can hold before allocating from it fails or starts
+// paging, refreshed every frame. With VK_EXT_memory_budget the driver reports
+// the budget, which shrinks as other processes allocate, and this process's
+// usage. Without it the budget is a fixed share of the heap and the usage
+// what the allocator holds.
+struct MemoryBudget {
+	bool extension{};
+	// Caps every heap's budget, zero for no cap. Lets eviction be exercised on
+	// devices with plenty of memory.
+	VkDeviceSize limit{};
+	uint32_t heap_count{};
+	std::array<HeapBudget, VK_MAX_MEMORY_HEAPS> heaps{};
+};
+
+// extension needs the memory_budget capability, which enables
+// VK_EXT_memory_budget and checks for vkGetPhysicalDeviceMemoryProperties2.
+auto create_memory_budget(
+		const Allocator& allocator,
+		bool extension,
+		VkDeviceSize limit) -> MemoryBudget;
+void update_memory_budget(
+		VkPhysicalDevice& physical_device,
+		const Allocator& allocator,
+		MemoryBudget& budget);
+// The pressure on heap once added more bytes were allocated from it.
+auto memory_pressure(
+		const MemoryBudget& budget,
+		uint32_t heap,
+		VkDeviceSize added) -> MemoryPressure;
@@ -0,0 +1,926 @@
+#include "mesh.hpp"
+
+#include "log.hpp"
+#include "mapped_file.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+constexpr auto g_cooked_mesh_magic =
+		std::array<char, 8>{'V', 'K', 'D', 'M', 'E', 'S', 'H', '\0'};
+constexpr auto g_cooked_mesh_version = 4U;
+// Blobs start at multiples of this, so they can be staged straight out of the
+// mapping.
+constexpr auto g_cooked_mesh_alignment = uint64_t{16};
+
+// A cooked mesh is this header followed by the vertex and the index blob,
+// each exactly as the mesh's buffers hold it or compressed with codec. The
+// stored sizes are the blobs' in the file, the others what they expand to.
+// Fields are in host byte order, files are cooked for the machines that load
+// them.
+struct CookedMeshHeader {
+	std::array<char, 8> magic{};
+	uint32_t version{};
+	uint32_t layout{};
+	uint32_t stream_count{};
+	uint32_t index_type{};
+	uint32_t vertex_count{};
+	uint32_t index_count{};
+	std::array<uint64_t, g_max_vertex_streams> stream_offsets{};
+	uint64_t vertices_offset{};
+	uint64_t vertices_size{};
+	uint64_t indices_offset{};
+	uint64_t indices_size{};
+	uint64_t vertices_stored_size{};
+	uint64_t indices_stored_size{};
+	std::array<float, 4> bounding_sphere{};
+	std::array<float, 3> position_scale{};
+	std::array<float, 3> position_offset{};
+	uint32_t lod_count{};
+	// A PayloadCodec.
+	uint32_t codec{};
+	std::array<MeshLod, g_max_mesh_lods> lods{};
+};
+
+static_assert(sizeof(CookedMeshHeader) == 192);
+
+// Grid cells along the largest side of the bounding box for the first coarse
+// level, halved for every further one.
+constexpr auto g_lod_base_grid = 64U;
+// A coarse level has to drop at least this fraction of the triangles of the
+// level before it.
+constexpr auto g_lod_min_reduction = 0.25F;
+
+// The contents of a mesh's buffers, built from MeshData or read from a cooked
+// mesh.
+struct MeshBlobs {
+	VertexLayout layout{};
+	PayloadCodec codec{};
+	std::span<const std::byte> vertices;
+	std::array<VkDeviceSize, g_max_vertex_streams> stream_offsets{};
+	uint32_t stream_count{};
+	std::span<const std::byte> indices;
+	VkIndexType index_type{};
+	uint32_t index_count{};
+	glm::vec4 bounding_sphere{};
+	glm::vec3 position_scale{1.0F};
+	glm::vec3 position_offset{};
+	std::array<MeshLod, g_max_mesh_lods> lods{};
+	uint32_t lod_count{};
+	// Bytes the buffers hold, which is more than the blobs when they are
+	// compressed.
+	VkDeviceSize vertices_size{};
+	VkDeviceSize indices_size{};
+};
+
+// Centered on the bounding box, which is not the smallest sphere but close
+// enough for culling.
+auto bounding_sphere(std::span<const glm::vec3> positions) -> glm::vec4 {
+	auto min = positions.front();
+	auto max = positions.front();
+	for (const auto& position : positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+	auto center = (min + max) * 0.5F;
+	auto radius = 0.0F;
+	for (const auto& position : positions) {
+		radius = std::max(radius, glm::distance(center, position));
+	}
+	return {center, radius};
+}
+
+template <typename T>
+void append_bytes(std::vector<std::byte>& bytes, std::span<const T> data) {
+	auto data_bytes = std::as_bytes(data);
+	bytes.insert(bytes.end(), data_bytes.begin(), data_bytes.end());
+}
+
+auto valid_lods(std::span<const MeshLod> lods, uint32_t index_count) -> bool {
+	if (lods.empty() || lods.size() > g_max_mesh_lods) {
+		return false;
+	}
+	return std::all_of(lods.begin(), lods.end(), [&](const MeshLod& lod) {
+		return lod.index_count > 0 && lod.index_count % 3 == 0 &&
+				lod.first_index <= index_count &&
+				lod.index_count <= index_count - lod.first_index;
+	});
+}
+
+auto vertex_size(VertexLayout layout) -> uint32_t {
+	return layout == VertexLayout::quantized ? sizeof(QuantizedVertex)
+																					 : sizeof(Vertex);
+}
+
+// Scales positions into [-1, 1] around the center of their bounding box, and
+// returns the scale and offset that map them back.
+auto quantize_vertices(
+		const MeshData& data,
+		std::vector<std::byte>& vertices) -> std::pair<glm::vec3, glm::vec3> {
+	auto min = data.positions.front();
+	auto max = data.positions.front();
+	for (const auto& position : data.positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+	auto offset = (min + max) * 0.5F;
+	// Flat meshes would divide by zero along their flat axis.
+	auto scale = glm::max((max - min) * 0.5F, glm::vec3{1e-6F});
+	auto quantized = std::vector<QuantizedVertex>(data.positions.size());
+	for (auto i = size_t{}; i < quantized.size(); i++) {
+		auto position = glm::round(
+				glm::clamp((data.positions[i] - offset) / scale, -1.0F, 1.0F) *
+				32767.0F);
+		auto color = glm::round(
+				glm::clamp(data.colors[i], 0.0F, 1.0F) * 255.0F);
+		quantized[i] = QuantizedVertex{
+				.position = {
+						static_cast<int16_t>(position.x),
+						static_cast<int16_t>(position.y),
+						static_cast<int16_t>(position.z),
+						0},
+				.color = {
+						static_cast<uint8_t>(color.r),
+						static_cast<uint8_t>(color.g),
+						static_cast<uint8_t>(color.b),
+						std::numeric_limits<uint8_t>::max()}};
+	}
+	append_bytes(vertices, std::span<const QuantizedVertex>(quantized));
+	return {scale, offset};
+}
+
+auto align_offset(uint64_t offset) -> uint64_t {
+	return (offset + g_cooked_mesh_alignment - 1) / g_cooked_mesh_alignment *
+			g_cooked_mesh_alignment;
+}
+
+// Lays data out the way layout stores it, into vertices and indices, which
+// the returned blobs point into. Indices are stored as 16-bit values when
+// every index fits.
+auto build_blobs(
+		const MeshData& data,
+		VertexLayout layout,
+		std::vector<std::byte>& vertices,
+		std::vector<std::byte>& indices) -> MeshBlobs {
+	if (data.positions.empty() || data.positions.size() != data.colors.size() ||
+			data.indices.empty()) {
+		fmt::print(stderr, "Invalid mesh data\n");
+		std::terminate();
+	}
+	auto blobs = MeshBlobs{
+			.layout = layout,
+			.codec = PayloadCodec::none,
+			.vertices = {},
+			.stream_offsets = {},
+			.stream_count = 0,
+			.indices = {},
+			.index_type = VK_INDEX_TYPE_UINT32,
+			.index_count = static_cast<uint32_t>(data.indices.size()),
+			.bounding_sphere = bounding_sphere(data.positions)};
+	auto lods = data.lods.empty()
+			? std::vector<MeshLod>{MeshLod{
+						.first_index = 0,
+						.index_count = blobs.index_count,
+						.error = 0.0F}}
+			: data.lods;
+	if (!valid_lods(lods, blobs.index_count)) {
+		fmt::print(stderr, "Invalid mesh LODs\n");
+		std::terminate();
+	}
+	std::copy(lods.begin(), lods.end(), blobs.lods.begin());
+	blobs.lod_count = static_cast<uint32_t>(lods.size());
+	switch (layout) {
+		case VertexLayout::interleaved: {
+			auto interleaved = std::vector<Vertex>(data.positions.size());
+			for (auto i = size_t{}; i < interleaved.size(); i++) {
+				interleaved.at(i) = Vertex{
+						.position = data.positions.at(i),
+						.color = data.colors.at(i)};
+			}
+			append_bytes(vertices, std::span<const Vertex>(interleaved));
+			blobs.stream_count = 1;
+			break;
+		}
+		case VertexLayout::split:
+			append_bytes(vertices, std::span(data.positions));
+			blobs.stream_offsets.at(1) = vertices.size();
+			append_bytes(vertices, std::span(data.colors));
+			blobs.stream_count = 2;
+			break;
+		case VertexLayout::quantized: {
+			auto [scale, offset] = quantize_vertices(data, vertices);
+			blobs.position_scale = scale;
+			blobs.position_offset = offset;
+			blobs.stream_count = 1;
+			// Rounding moves positions by up to half a step along each axis.
+			blobs.bounding_sphere.w += glm::length(scale) / 65534.0F;
+			break;
+		}
+	}
+
+	auto max_index = *std::max_element(data.indices.begin(), data.indices.end());
+	if (max_index <= std::numeric_limits<uint16_t>::max()) {
+		auto narrow = std::vector<uint16_t>(
+				data.indices.begin(),
+				data.indices.end());
+		append_bytes(indices, std::span<const uint16_t>(narrow));
+		blobs.index_type = VK_INDEX_TYPE_UINT16;
+	} else {
+		append_bytes(indices, std::span(data.indices));
+	}
+	blobs.vertices = vertices;
+	blobs.indices = indices;
+	blobs.vertices_size = vertices.size();
+	blobs.indices_size = indices.size();
+	return blobs;
+}
+
+auto create_device_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage) -> Buffer {
+	return create_buffer(
+			device,
+			allocator,
+			size,
+			usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+}
+
+// decompressor may be null when the blobs are not compressed, pool when the
+// mesh gets buffers of its own.
+auto upload_blobs(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		Decompressor* decompressor,
+		const MeshBlobs& blobs,
+		VertexFetch fetch) -> Mesh {
+	auto mesh = Mesh{};
+	mesh.layout = blobs.layout;
+	mesh.pulled = fetch != VertexFetch::input;
+	mesh.stream_offsets = blobs.stream_offsets;
+	mesh.stream_count = blobs.stream_count;
+	mesh.index_type = blobs.index_type;
+	mesh.index_count = blobs.index_count;
+	mesh.bounding_sphere = blobs.bounding_sphere;
+	mesh.attribute_stride = blobs.layout == VertexLayout::split
+			? sizeof(glm::vec3)
+			: vertex_size(blobs.layout);
+	mesh.position_scale = blobs.position_scale;
+	mesh.position_offset = blobs.position_offset;
+	mesh.lods = blobs.lods;
+	mesh.lod_count = blobs.lod_count;
+	// Compressed blobs are expanded by a shader that writes whole words.
+	auto compressed = blobs.codec != PayloadCodec::none;
+	auto expanded_usage = compressed
+			? VkBufferUsageFlags{VK_BUFFER_USAGE_STORAGE_BUFFER_BIT}
+			: VkBufferUsageFlags{};
+	auto buffer_size = [&](VkDeviceSize size) {
+		return compressed ? (size + 3) / 4 * 4 : size;
+	};
+	// Stages a blob, or its compressed bytes to be expanded on the GPU.
+	auto upload = [&](
+			const Buffer& buffer,
+			VkDeviceSize offset,
+			std::span<const std::byte> blob,
+			VkDeviceSize size,
+			VkPipelineStageFlags2 dst_stage,
+			VkAccessFlags2 dst_access) {
+		if (compressed) {
+			decompress_buffer(
+					device,
+					allocator,
+					uploader,
+					*decompressor,
+					blob,
+					buffer.handle,
+					offset,
+					size,
+					dst_stage,
+					dst_access);
+		} else {
+			upload_buffer(
+					device,
+					uploader,
+					buffer.handle,
+					offset,
+					blob,
+					dst_stage,
+					dst_access);
+		}
+	};
+
+	auto vertices_size = buffer_size(blobs.vertices_size);
+	auto indices_size = buffer_size(blobs.indices_size);
+	if (pool != nullptr) {
+		auto vertices_offset =
+				allocate_geometry(device, allocator, *pool, vertices_size);
+		auto indices_offset = vertices_offset.has_value()
+				? allocate_geometry(device, allocator, *pool, indices_size)
+				: std::nullopt;
+		if (indices_offset.has_value()) {
+			mesh.pool = pool;
+			mesh.vertices = Buffer{
+					.handle = pool->buffer.handle,
+					.allocation = {},
+					.size = vertices_size,
+					.usage = pool->buffer.usage,
+					.queue_families = {}};
+			mesh.vertices_offset = *vertices_offset;
+			mesh.indices = mesh.vertices;
+			mesh.indices.size = indices_size;
+			mesh.indices_offset = *indices_offset;
+		} else {
+			if (vertices_offset.has_value()) {
+				free_geometry(*pool, *vertices_offset, vertices_size);
+			}
+			log_message(
+					LogLevel::warning,
+					"Geometry pool is full, giving a mesh buffers of its own");
+		}
+	}
+	if (mesh.pool == nullptr) {
+		mesh.vertices = create_device_buffer(
+				device,
+				allocator,
+				vertices_size,
+				expanded_usage |
+						(mesh.pulled ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+												 : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+	}
+	// Pulled vertices are storage reads of the shader that pulls them.
+	auto vertex_stage = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+	auto vertex_access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+	switch (fetch) {
+		case VertexFetch::input:
+			break;
+		case VertexFetch::pulled:
+			vertex_stage = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+			vertex_access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+			break;
+		case VertexFetch::meshlets:
+			vertex_stage = VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+			vertex_access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+			break;
+	}
+	upload(
+			mesh.vertices,
+			mesh.vertices_offset,
+			blobs.vertices,
+			blobs.vertices_size,
+			vertex_stage,
+			vertex_access);
+
+	// The visibility buffer's shading refetches the triangles of pulled
+	// meshes.
+	auto index_usage = expanded_usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	if (mesh.pulled) {
+		index_usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	if (mesh.pool == nullptr) {
+		mesh.indices =
+				create_device_buffer(device, allocator, indices_size, index_usage);
+	}
+	upload(
+			mesh.indices,
+			mesh.indices_offset,
+			blobs.indices,
+			blobs.indices_size,
+			VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+			VK_ACCESS_2_INDEX_READ_BIT);
+	update_attribute_addresses(device, mesh);
+	mesh.ticket = uploader.next_ticket;
+	return mesh;
+}
+
+// Checks that the header describes blobs that fit the file and match what
+// load_mesh expects. Compressed blobs are checked once their bytes are known.
+auto valid_cooked_mesh(
+		const CookedMeshHeader& header,
+		VertexLayout layout,
+		size_t file_size) -> bool {
+	auto codec = static_cast<PayloadCodec>(header.codec);
+	auto stored_sizes = codec == PayloadCodec::chunked_lz ||
+			(codec == PayloadCodec::none &&
+			 header.vertices_stored_size == header.vertices_size &&
+			 header.indices_stored_size == header.indices_size);
+	auto index_size = header.index_type == VK_INDEX_TYPE_UINT16
+			? sizeof(uint16_t)
+			: sizeof(uint32_t);
+	auto expected_streams = layout == VertexLayout::split ? 2U : 1U;
+	auto second_stream = layout == VertexLayout::split
+			? uint64_t{header.vertex_count} * sizeof(glm::vec3)
+			: uint64_t{};
+	return stored_sizes && header.layout == static_cast<uint32_t>(layout) &&
+			header.stream_count == expected_streams &&
+			header.stream_offsets[0] == 0 &&
+			header.stream_offsets[1] == second_stream &&
+			(header.index_type == VK_INDEX_TYPE_UINT16 ||
+			 header.index_type == VK_INDEX_TYPE_UINT32) &&
+			header.vertex_count > 0 && header.index_count > 0 &&
+			header.vertices_size ==
+					uint64_t{header.vertex_count} * vertex_size(layout) &&
+			header.indices_size == uint64_t{header.index_count} * index_size &&
+			header.vertices_offset % g_cooked_mesh_alignment == 0 &&
+			header.indices_offset % g_cooked_mesh_alignment == 0 &&
+			header.vertices_offset <= file_size &&
+			header.vertices_stored_size <= file_size - header.vertices_offset &&
+			header.indices_offset <= file_size &&
+			header.indices_stored_size <= file_size - header.indices_offset &&
+			header.lod_count <= g_max_mesh_lods &&
+			valid_lods(
+					std::span(header.lods).first(header.lod_count),
+					header.index_count);
+}
+
+// The blobs of a mapped cooked mesh, after checking it.
+auto cooked_mesh_blobs(
+		const MappedFile& file,
+		const std::filesystem::path& path,
+		VertexLayout layout) -> MeshBlobs {
+	auto header = CookedMeshHeader{};
+	if (file.bytes.size() >= sizeof(header)) {
+		std::memcpy(&header, file.bytes.data(), sizeof(header));
+	}
+	if (header.magic != g_cooked_mesh_magic ||
+			header.version != g_cooked_mesh_version) {
+		fmt::print(
+				stderr,
+				"{} is not a cooked mesh of this version\n",
+				path.string());
+		std::terminate();
+	}
+	auto vertices = std::span<const std::byte>{};
+	auto indices = std::span<const std::byte>{};
+	auto valid = valid_cooked_mesh(header, layout, file.bytes.size());
+	if (valid) {
+		vertices = file.bytes.subspan(
+				header.vertices_offset,
+				header.vertices_stored_size);
+		indices =
+				file.bytes.subspan(header.indices_offset, header.indices_stored_size);
+		valid = static_cast<PayloadCodec>(header.codec) == PayloadCodec::none ||
+				(valid_compressed_payload(vertices, header.vertices_size) &&
+				 valid_compressed_payload(indices, header.indices_size));
+	}
+	if (!valid) {
+		fmt::print(
+				stderr,
+				"Cooked mesh {} is malformed or has another vertex layout\n",
+				path.string());
+		std::terminate();
+	}
+	return MeshBlobs{
+			.layout = layout,
+			.codec = static_cast<PayloadCodec>(header.codec),
+			.vertices = vertices,
+			.stream_offsets = {header.stream_offsets[0], header.stream_offsets[1]},
+			.stream_count = header.stream_count,
+			.indices = indices,
+			.index_type = static_cast<VkIndexType>(header.index_type),
+			.index_count = header.index_count,
+			.bounding_sphere = glm::vec4{
+					header.bounding_sphere[0],
+					header.bounding_sphere[1],
+					header.bounding_sphere[2],
+					header.bounding_sphere[3]},
+			.position_scale = glm::vec3{
+					header.position_scale[0],
+					header.position_scale[1],
+					header.position_scale[2]},
+			.position_offset = glm::vec3{
+					header.position_offset[0],
+					header.position_offset[1],
+					header.position_offset[2]},
+			.lods = header.lods,
+			.lod_count = header.lod_count,
+			.vertices_size = header.vertices_size,
+			.indices_size = header.indices_size};
+}
+
+}  // namespace
+
+auto vertex_input_description(VertexLayout layout) -> VertexInputDescription {
+	auto description = VertexInputDescription{};
+	switch (layout) {
+		case VertexLayout::interleaved:
+			description.bindings = {VkVertexInputBindingDescription{
+					.binding = 0,
+					.stride = sizeof(Vertex),
+					.inputRate = VK_VERTEX_INPUT_RATE_VERTEX}};
+			description.attributes = {
+					VkVertexInputAttributeDescription{
+							.location = 0,
+							.binding = 0,
+							.format = VK_FORMAT_R32G32B32_SFLOAT,
+							.offset = offsetof(Vertex, position)},
+					VkVertexInputAttributeDescription{
+							.location = 1,
+							.binding = 0,
+							.format = VK_FORMAT_R32G32B32_SFLOAT,
+							.offset = offsetof(Vertex, color)}};
+			break;
+		case VertexLayout::split:
+			description.bindings = {
+					VkVertexInputBindingDescription{
+							.binding = 0,
+							.stride = sizeof(glm::vec3),
+							.inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+					VkVertexInputBindingDescription{
+							.binding = 1,
+							.stride = sizeof(glm::vec3),
+							.inputRate = VK_VERTEX_INPUT_RATE_VERTEX}};
+			description.attributes = {
+					VkVertexInputAttributeDescription{
+							.location = 0,
+							.binding = 0,
+							.format = VK_FORMAT_R32G32B32_SFLOAT,
+							.offset = 0},
+					VkVertexInputAttributeDescription{
+							.location = 1,
+							.binding = 1,
+							.format = VK_FORMAT_R32G32B32_SFLOAT,
+							.offset = 0}};
+			break;
+		case VertexLayout::quantized:
+			description.bindings = {VkVertexInputBindingDescription{
+					.binding = 0,
+					.stride = sizeof(QuantizedVertex),
+					.inputRate = VK_VERTEX_INPUT_RATE_VERTEX}};
+			// Both formats are required for vertex input, and the unused
+			// components are dropped by the shader's vec3 inputs.
+			description.attributes = {
+					VkVertexInputAttributeDescription{
+							.location = 0,
+							.binding = 0,
+							.format = VK_FORMAT_R16G16B16A16_SNORM,
+							.offset = offsetof(QuantizedVertex, position)},
+					VkVertexInputAttributeDescription{
+							.location = 1,
+							.binding = 0,
+							.format = VK_FORMAT_R8G8B8A8_UNORM,
+							.offset = offsetof(QuantizedVertex, color)}};
+			break;
+	}
+	return description;
+}
+
+void build_mesh_lods(MeshData& data, uint32_t max_lods) {
+	if (data.positions.empty() || data.indices.empty()) {
+		return;
+	}
+	if (data.lods.empty()) {
+		data.lods.push_back(MeshLod{
+				.first_index = 0,
+				.index_count = static_cast<uint32_t>(data.indices.size()),
+				.error = 0.0F});
+	}
+	auto min = data.positions.front();
+	auto max = data.positions.front();
+	for (const auto& position : data.positions) {
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+	auto extent = max - min;
+	auto largest = std::max({extent.x, extent.y, extent.z});
+	if (largest <= 0.0F) {
+		return;
+	}
+	// Every level is clustered from the finest one, so errors don't add up.
+	const auto& finest = data.lods.front();
+	auto source = std::vector<uint32_t>(
+			data.indices.begin() + finest.first_index,
+			data.indices.begin() + finest.first_index + finest.index_count);
+	auto previous_count = source.size();
+	auto remap = std::vector<uint32_t>(data.positions.size());
+	auto cells = std::unordered_map<uint64_t, std::pair<uint32_t, float>>{};
+	for (auto grid = g_lod_base_grid; grid > 0 && data.lods.size() < max_lods;
+			grid /= 2) {
+		auto cell_size = largest / static_cast<float>(grid);
+		auto cell_of = [&](const glm::vec3& position) {
+			return glm::min(
+					glm::uvec3((position - min) / cell_size),
+					glm::uvec3(grid - 1));
+		};
+		auto key_of = [](const glm::uvec3& cell) {
+			return (uint64_t{cell.x} << 32U) | (uint64_t{cell.y} << 16U) |
+					uint64_t{cell.z};
+		};
+		cells.clear();
+		for (auto i = uint32_t{}; i < data.positions.size(); i++) {
+			auto cell = cell_of(data.positions.at(i));
+			auto center = min + (glm::vec3(cell) + 0.5F) * cell_size;
+			auto distance = glm::distance(data.positions.at(i), center);
+			auto [it, inserted] = cells.try_emplace(key_of(cell), i, distance);
+			// The vertex nearest the cell's center stands in for all others.
+			if (!inserted && distance < it->second.second) {
+				it->second = {i, distance};
+			}
+		}
+		for (auto i = uint32_t{}; i < data.positions.size(); i++) {
+			remap.at(i) = cells.at(key_of(cell_of(data.positions.at(i)))).first;
+		}
+
+		auto first_index = static_cast<uint32_t>(data.indices.size());
+		for (auto i = size_t{}; i + 2 < source.size(); i += 3) {
+			auto a = remap.at(source.at(i));
+			auto b = remap.at(source.at(i + 1));
+			auto c = remap.at(source.at(i + 2));
+			if (a != b && b != c && c != a) {
+				data.indices.insert(data.indices.end(), {a, b, c});
+			}
+		}
+		auto index_count = data.indices.size() - first_index;
+		if (index_count == 0) {
+			break;
+		}
+		if (static_cast<float>(index_count) >
+				(1.0F - g_lod_min_reduction) * static_cast<float>(previous_count)) {
+			data.indices.resize(first_index);
+			continue;
+		}
+		// A vertex moves by at most the cell's diagonal.
+		data.lods.push_back(MeshLod{
+				.first_index = first_index,
+				.index_count = static_cast<uint32_t>(index_count),
+				.error = cell_size * std::sqrt(3.0F)});
+		previous_count = index_count;
+	}
+}
+
+auto create_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		const MeshData& data,
+		VertexLayout layout,
+		VertexFetch fetch) -> Mesh {
+	auto vertices = std::vector<std::byte>{};
+	auto indices = std::vector<std::byte>{};
+	auto blobs = build_blobs(data, layout, vertices, indices);
+	return upload_blobs(
+			device,
+			allocator,
+			uploader,
+			pool,
+			nullptr,
+			blobs,
+			fetch);
+}
+
+auto cook_mesh(
+		const MeshData& data,
+		VertexLayout layout,
+		bool compress,
+		const std::filesystem::path& path) -> bool {
+	auto vertices = std::vector<std::byte>{};
+	auto indices = std::vector<std::byte>{};
+	auto blobs = build_blobs(data, layout, vertices, indices);
+	auto vertices_size = vertices.size();
+	auto indices_size = indices.size();
+	if (compress) {
+		vertices = compress_payload(vertices);
+		indices = compress_payload(indices);
+	}
+	auto header = CookedMeshHeader{
+			.magic = g_cooked_mesh_magic,
+			.version = g_cooked_mesh_version,
+			.layout = static_cast<uint32_t>(layout),
+			.stream_count = blobs.stream_count,
+			.index_type = static_cast<uint32_t>(blobs.index_type),
+			.vertex_count = static_cast<uint32_t>(data.positions.size()),
+			.index_count = blobs.index_count,
+			.stream_offsets = {blobs.stream_offsets[0], blobs.stream_offsets[1]},
+			.vertices_offset = align_offset(sizeof(CookedMeshHeader)),
+			.vertices_size = vertices_size,
+			.indices_offset = 0,
+			.indices_size = indices_size,
+			.vertices_stored_size = vertices.size(),
+			.indices_stored_size = indices.size(),
+			.bounding_sphere = {
+					blobs.bounding_sphere.x,
+					blobs.bounding_sphere.y,
+					blobs.bounding_sphere.z,
+					blobs.bounding_sphere.w},
+			.position_scale = {
+					blobs.position_scale.x,
+					blobs.position_scale.y,
+					blobs.position_scale.z},
+			.position_offset = {
+					blobs.position_offset.x,
+					blobs.position_offset.y,
+					blobs.position_offset.z},
+			.lod_count = blobs.lod_count,
+			.codec = static_cast<uint32_t>(
+					compress ? PayloadCodec::chunked_lz : PayloadCodec::none),
+			.lods = blobs.lods};
+	header.indices_offset =
+			align_offset(header.vertices_offset + header.vertices_stored_size);
+
+	auto bytes = std::vector<std::byte>(header.indices_offset + indices.size());
+	std::memcpy(bytes.data(), &header, sizeof(header));
+	std::copy(
+			vertices.begin(),
+			vertices.end(),
+			bytes.begin() + static_cast<ptrdiff_t>(header.vertices_offset));
+	std::copy(
+			indices.begin(),
+			indices.end(),
+			bytes.begin() + static_cast<ptrdiff_t>(header.indices_offset));
+	auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	file.write(reinterpret_cast<const char*>(bytes.data()),
+			static_cast<std::streamsize>(bytes.size()));
+	if (!file) {
+		fmt::print(stderr, "Failed to write cooked mesh {}\n", path.string());
+		return false;
+	}
+	return true;
+}
+
+auto load_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		Decompressor& decompressor,
+		const Archive* archive,
+		const std::filesystem::path& path,
+		VertexLayout layout,
+		VertexFetch fetch) -> Mesh {
+	auto file = open_asset(archive, path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map mesh {}\n", path.string());
+		std::terminate();
+	}
+	auto blobs = cooked_mesh_blobs(*file, path, layout);
+	// The blobs are copied into staging memory right away, so the file is not
+	// needed past this.
+	auto mesh = upload_blobs(
+			device,
+			allocator,
+			uploader,
+			pool,
+			&decompressor,
+			blobs,
+			fetch);
+	unmap_file(*file);
+	return mesh;
+}
+
+auto load_mesh_async(
+		AsyncScheduler& scheduler,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		Decompressor& decompressor,
+		const Archive* archive,
+		std::filesystem::path path,
+		VertexLayout layout,
+		VertexFetch fetch,
+		Mesh& mesh) -> AsyncTask {
+	auto file = std::optional<MappedFile>{};
+	if (archive != nullptr) {
+		// Expanding a compressed entry takes a while.
+		co_await resume_on_jobs(scheduler);
+		file = archive_file(*archive, path);
+	}
+	if (!file.has_value()) {
+		file = co_await read_file(scheduler, path);
+	}
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map mesh {}\n", path.string());
+		std::terminate();
+	}
+	auto blobs = cooked_mesh_blobs(*file, path, layout);
+	co_await resume_on_poll(scheduler);
+	mesh = upload_blobs(
+			scheduler.device,
+			allocator,
+			uploader,
+			pool,
+			&decompressor,
+			blobs,
+			fetch);
+	unmap_file(*file);
+}
+
+void destroy_mesh(VkDevice& device, Allocator& allocator, Mesh& mesh) {
+	if (mesh.pool != nullptr) {
+		free_geometry(*mesh.pool, mesh.indices_offset, mesh.indices.size);
+		free_geometry(*mesh.pool, mesh.vertices_offset, mesh.vertices.size);
+	} else {
+		destroy_buffer(device, allocator, mesh.indices);
+		destroy_buffer(device, allocator, mesh.vertices);
+	}
+	mesh = Mesh{};
+}
+
+void update_attribute_addresses(VkDevice& device, Mesh& mesh) {
+	if (!mesh.pulled) {
+		return;
+	}
+	mesh.index_address =
+			buffer_device_address(device, mesh.indices) + mesh.indices_offset;
+	auto address =
+			buffer_device_address(device, mesh.vertices) + mesh.vertices_offset;
+	switch (mesh.layout) {
+		case VertexLayout::interleaved:
+			mesh.attribute_addresses = {
+					address + offsetof(Vertex, position),
+					address + offsetof(Vertex, color)};
+			break;
+		case VertexLayout::split:
+			mesh.attribute_addresses = {
+					address,
+					address + mesh.stream_offsets.at(1)};
+			break;
+		case VertexLayout::quantized:
+			mesh.attribute_addresses = {
+					address + offsetof(QuantizedVertex, position),
+					address + offsetof(QuantizedVertex, color)};
+			break;
+	}
+}
+
+void bind_mesh(VkCommandBuffer command_buffer, const Mesh& mesh) {
+	if (!mesh.pulled) {
+		auto buffers = std::array<VkBuffer, g_max_vertex_streams>{};
+		buffers.fill(mesh.vertices.handle);
+		auto offsets = mesh.stream_offsets;
+		for (auto& offset : offsets) {
+			offset += mesh.vertices_offset;
+		}
+		vkCmdBindVertexBuffers(
+				command_buffer,
+				0,
+				mesh.stream_count,
+				buffers.data(),
+				offsets.data());
+	}
+	vkCmdBindIndexBuffer(
+			command_buffer,
+			mesh.indices.handle,
+			mesh.indices_offset,
+			mesh.index_type);
+}
+
+auto select_mesh_lod(
+		const Mesh& mesh,
+		const glm::mat4& transform,
+		float lod_scale) -> uint32_t {
+	auto rows = glm::transpose(transform);
+	auto center = glm::vec4(glm::vec3(mesh.bounding_sphere), 1.0F);
+	// Clip w of the sphere's nearest point, the error is largest there.
+	auto w = glm::dot(rows[3], center) -
+			mesh.bounding_sphere.w * glm::length(glm::vec3(rows[3]));
+	if (w <= 0.0F) {
+		return 0;
+	}
+	auto scale = std::max(
+			glm::length(glm::vec3(rows[0])),
+			glm::length(glm::vec3(rows[1])));
+	auto lod = 0U;
+	for (auto i = 1U; i < mesh.lod_count; i++) {
+		if (mesh.lods.at(i).error * scale * lod_scale > w) {
+			break;
+		}
+		lod = i;
+	}
+	return lod;
+}
+
+void draw_mesh(VkCommandBuffer command_buffer, const Mesh& mesh, uint32_t lod) {
+	bind_mesh(command_buffer, mesh);
+	const auto& level = mesh.lods.at(lod);
+	vkCmdDrawIndexed(
+			command_buffer,
+			level.index_count,
+			1,
+			level.first_index,
+			0,
+			0);
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "archive.hpp"
+#include "async.hpp"
+#include "decompress.hpp"
+#include "dispatch.hpp"
+#include "geometry_pool.hpp"
+#include "upload.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+constexpr auto g_max_vertex_streams = 2U;
+constexpr auto g_vertex_attribute_count = 2U;
+constexpr auto g_max_mesh_lods = 4U;
+
+// Interleaved meshes keep every attribute of a vertex together in one
+// binding. Split meshes put each attribute in its own binding, which keeps
+// position-only passes from fetching the other attributes. Quantized meshes
+// are interleaved QuantizedVertex, half the size of Vertex.
+enum class VertexLayout {
+	interleaved,
+	split,
+	quantized,
+};
+
+// How shaders read a mesh's vertices: bound as vertex buffers, or through
+// Mesh::attribute_addresses by the vertex shader or by the mesh shader of a
+// meshlet pipeline, see meshlet.hpp.
+enum class VertexFetch {
+	input,
+	pulled,
+	meshlets,
+};
+
+struct Vertex {
+	glm::vec3 position{};
+	glm::vec3 color{};
+};
+
+// Positions are 16-bit snorm within the mesh's bounding box, mapped back by
+// Mesh::position_scale and position_offset. w is unused, three component
+// 16-bit formats are rarely supported for vertex input. Colors are 8-bit
+// unorm with an unused alpha.
+struct QuantizedVertex {
+	std::array<int16_t, 4> position{};
+	std::array<uint8_t, 4> color{};
+};
+
+static_assert(sizeof(QuantizedVertex) == 12);
+
+// A level of detail, a range of the mesh's indices over the shared vertices.
+struct MeshLod {
+	uint32_t first_index{};
+	uint32_t index_count{};
+	// Object space distance the level's surface may be off the full detail
+	// one, 0 for the full detail level.
+	float error{};
+};
+
+static_assert(sizeof(MeshLod) == 12);
+
+struct MeshData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> colors;
+	std::vector<uint32_t> indices;
+	// Finest first, with errors that grow. Empty for a single level covering
+	// every index.
+	std::vector<MeshLod> lods;
+};
+
+// Appends up to max_lods - 1 coarser levels to data by clustering vertices on
+// ever coarser grids, which works on any triangle soup. Levels that would not
+// save a quarter of the triangles of the one before are skipped. Meant for the
+// cook step, it is too slow for loading.
+void build_mesh_lods(MeshData& data, uint32_t max_lods);
+
+struct VertexInputDescription {
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Attribute locations match shader.vert: position at 0, color at 1.
+auto vertex_input_description(VertexLayout layout) -> VertexInputDescription;
+
+// Vertex streams share one device-local buffer, each starting at its entry in
+// stream_offsets past vertices_offset. Meshes of a geometry pool take ranges
+// of its buffer, and vertices and indices hold its handle and the size of
+// their range. Indices are stored as 16-bit values when every index fits.
+// Pulled meshes are read by a shader through attribute_addresses,
+// the address of each attribute of the first vertex, instead of being bound
+// as vertex buffers. Their indices can also be read through index_address.
+struct Mesh {
+	VertexLayout layout{};
+	// The pool the ranges are from, null when the buffers are the mesh's own.
+	GeometryPool* pool{};
+	Buffer vertices;
+	VkDeviceSize vertices_offset{};
+	std::array<VkDeviceSize, g_max_vertex_streams> stream_offsets{};
+	uint32_t stream_count{};
+	bool pulled{};
+	std::array<VkDeviceAddress, g_vertex_attribute_count> attribute_addresses{};
+	// Bytes between the attributes of consecutive vertices.
+	uint32_t attribute_stride{};
+	// Object space positions are the fetched ones times scale plus offset,
+	// which only changes them for quantized meshes.
+	glm::vec3 position_scale{1.0F};
+	glm::vec3 position_offset{};
+	Buffer indices;
+	VkDeviceSize indices_offset{};
+	VkIndexType index_type{};
+	uint32_t index_count{};
+	VkDeviceAddress index_address{};
+	std::array<MeshLod, g_max_mesh_lods> lods{};
+	uint32_t lod_count{};
+	// Object space center in xyz and radius in w of a sphere around every
+	// vertex, for culling.
+	glm::vec4 bounding_sphere{};
+	// The mesh can be drawn by any graphics submission that acquires uploads
+	// after this ticket was submitted.
+	UploadTicket ticket{};
+};
+
+// Records the copies into the uploader's current batch. Fetching through
+// addresses requires a device_address allocator. With a pool the mesh takes
+// ranges of its buffer, and buffers of its own when the pool is full.
+auto create_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		const MeshData& data,
+		VertexLayout layout,
+		VertexFetch fetch) -> Mesh;
+// Writes data as a cooked mesh: a header followed by the vertex and index
+// blobs exactly as create_mesh would lay them out, each aligned so load_mesh
+// can stage them straight out of a mapping of the file. compress stores the
+// blobs as chunked_lz payloads, see decompress.hpp, which load at a fraction
+// of the size and are expanded on the GPU.
+auto cook_mesh(
+		const MeshData& data,
+		VertexLayout layout,
+		bool compress,
+		const std::filesystem::path& path) -> bool;
+// Maps a cooked mesh, from archive where it has it, and records the copies
+// of its blobs into the uploader's current batch, without looking at a
+// single vertex. Compressed blobs are queued on decompressor instead, and
+// expanded by the frame that acquires the batch. The file must have been
+// cooked with layout.
+auto load_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		Decompressor& decompressor,
+		const Archive* archive,
+		const std::filesystem::path& path,
+		VertexLayout layout,
+		VertexFetch fetch) -> Mesh;
+// The same as a task: reads the file, or takes it from archive on a job,
+// then records the copies on the polling thread. mesh is written once the
+// copies are recorded and must outlive the task.
+auto load_mesh_async(
+		AsyncScheduler& scheduler,
+		Allocator& allocator,
+		Uploader& uploader,
+		GeometryPool* pool,
+		Decompressor& decompressor,
+		const Archive* archive,
+		std::filesystem::path path,
+		VertexLayout layout,
+		VertexFetch fetch,
+		Mesh& mesh) -> AsyncTask;
+// The GPU must be done with the mesh. Ranges of a pool go back to it.
+void destroy_mesh(VkDevice& device, Allocator& allocator, Mesh& mesh);
+// Points attribute_addresses at mesh.vertices and index_address at
+// mesh.indices, past their offsets, for pulled meshes, after either was
+// created or moved.
+void update_attribute_addresses(VkDevice& device, Mesh& mesh);
+
+// Binds the index buffer and, unless the mesh is pulled, the vertex streams.
+void bind_mesh(VkCommandBuffer command_buffer, const Mesh& mesh);
+// Picks the coarsest level whose error projects to at most one unit of
+// lod_scale, which is half the viewport height divided by the pixel error
+// allowed. transform goes from object to clip space. Matches the selection
+// in draw_list.comp.
+auto select_mesh_lod(
+		const Mesh& mesh,
+		const glm::mat4& transform,
+		float lod_scale) -> uint32_t;
+
+// The bound pipeline must have been created with the mesh's vertex layout,
+// or without vertex input for pulled meshes.
+void draw_mesh(VkCommandBuffer command_buffer, const Mesh& mesh, uint32_t lod);
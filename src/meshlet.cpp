@@ -0,0 +1,210 @@
+#include "meshlet.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <limits>
+
+namespace {
+
+constexpr auto g_no_local_vertex = std::numeric_limits<uint32_t>::max();
+// Cones wider than this are not worth testing, hardly any view direction
+// would cull them.
+constexpr auto g_min_cone_dot = 0.1F;
+constexpr auto g_no_cone_cutoff = 2.0F;
+
+struct MeshletBuilder {
+	std::span<const glm::vec3> positions;
+	MeshletData data;
+	// Index of each mesh vertex in the current meshlet.
+	std::vector<uint32_t> local_vertices;
+	std::vector<glm::vec3> normals;
+};
+
+// Centered on the bounding box, like the mesh's own sphere.
+auto bounding_sphere(
+		std::span<const glm::vec3> positions,
+		std::span<const uint32_t> vertices) -> glm::vec4 {
+	auto min = positions[vertices.front()];
+	auto max = min;
+	for (auto vertex : vertices) {
+		min = glm::min(min, positions[vertex]);
+		max = glm::max(max, positions[vertex]);
+	}
+	auto center = (min + max) * 0.5F;
+	auto radius = 0.0F;
+	for (auto vertex : vertices) {
+		radius = std::max(radius, glm::distance(center, positions[vertex]));
+	}
+	return {center, radius};
+}
+
+auto normal_cone(std::span<const glm::vec3> normals) -> glm::vec4 {
+	auto sum = glm::vec3{};
+	for (const auto& normal : normals) {
+		sum += normal;
+	}
+	if (glm::length(sum) == 0.0F) {
+		return {0.0F, 0.0F, 0.0F, g_no_cone_cutoff};
+	}
+	auto axis = glm::normalize(sum);
+	auto min_dot = 1.0F;
+	for (const auto& normal : normals) {
+		min_dot = std::min(min_dot, glm::dot(axis, normal));
+	}
+	if (min_dot <= g_min_cone_dot) {
+		return {axis, g_no_cone_cutoff};
+	}
+	// Every normal is within acos(min_dot) of the axis, so every triangle is
+	// seen from behind by view directions within 90 degrees minus that of it.
+	// The cosine of which is the sine of the spread.
+	return {axis, std::sqrt(1.0F - min_dot * min_dot)};
+}
+
+void finish_meshlet(MeshletBuilder& builder) {
+	auto& meshlet = builder.data.meshlets.back();
+	auto vertices = std::span(builder.data.vertices).subspan(
+			meshlet.vertex_offset,
+			meshlet.vertex_count);
+	meshlet.bounding_sphere = bounding_sphere(builder.positions, vertices);
+	meshlet.cone = normal_cone(builder.normals);
+	for (auto vertex : vertices) {
+		builder.local_vertices[vertex] = g_no_local_vertex;
+	}
+	builder.normals.clear();
+}
+
+}  // namespace
+
+auto build_meshlets(
+		std::span<const glm::vec3> positions,
+		std::span<const uint32_t> indices) -> MeshletData {
+	if (positions.empty() || indices.empty() || indices.size() % 3 != 0) {
+		fmt::print(stderr, "Invalid meshlet input\n");
+		std::terminate();
+	}
+	auto builder = MeshletBuilder{
+			.positions = positions,
+			.data = {},
+			.local_vertices =
+					std::vector<uint32_t>(positions.size(), g_no_local_vertex),
+			.normals = {}};
+	auto& data = builder.data;
+	for (auto i = size_t{}; i < indices.size(); i += 3) {
+		auto corners = std::array{indices[i], indices[i + 1], indices[i + 2]};
+		auto new_vertices = std::count_if(
+				corners.begin(),
+				corners.end(),
+				[&](uint32_t vertex) {
+					return builder.local_vertices.at(vertex) == g_no_local_vertex;
+				});
+		if (data.meshlets.empty() ||
+				data.meshlets.back().vertex_count + new_vertices >
+						g_meshlet_max_vertices ||
+				data.meshlets.back().triangle_count == g_meshlet_max_triangles) {
+			if (!data.meshlets.empty()) {
+				finish_meshlet(builder);
+			}
+			data.meshlets.emplace_back(Meshlet{
+					.bounding_sphere = {},
+					.cone = {},
+					.vertex_offset = static_cast<uint32_t>(data.vertices.size()),
+					.triangle_offset = static_cast<uint32_t>(data.triangles.size()),
+					.vertex_count = 0,
+					.triangle_count = 0});
+		}
+		auto& meshlet = data.meshlets.back();
+		auto packed = uint32_t{};
+		for (auto corner = size_t{}; corner < corners.size(); corner++) {
+			auto& local = builder.local_vertices[corners[corner]];
+			if (local == g_no_local_vertex) {
+				local = meshlet.vertex_count++;
+				data.vertices.emplace_back(corners[corner]);
+			}
+			packed |= local << (corner * 8);
+		}
+		data.triangles.emplace_back(packed);
+		meshlet.triangle_count++;
+
+		// Degenerate triangles face nowhere and do not widen the cone.
+		auto normal = glm::cross(
+				positions[corners[1]] - positions[corners[0]],
+				positions[corners[2]] - positions[corners[0]]);
+		if (glm::length(normal) > 0.0F) {
+			builder.normals.emplace_back(glm::normalize(normal));
+		}
+	}
+	if (!data.meshlets.empty()) {
+		finish_meshlet(builder);
+	}
+	return data;
+}
+
+auto create_meshlet_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const MeshletData& data) -> MeshletMesh {
+	// Offsets become absolute word offsets into the buffer.
+	auto vertices_offset =
+			data.meshlets.size() * sizeof(Meshlet) / sizeof(uint32_t);
+	auto triangles_offset = vertices_offset + data.vertices.size();
+	auto meshlets = data.meshlets;
+	for (auto& meshlet : meshlets) {
+		meshlet.vertex_offset += static_cast<uint32_t>(vertices_offset);
+		meshlet.triangle_offset += static_cast<uint32_t>(triangles_offset);
+	}
+	auto size = (triangles_offset + data.triangles.size()) * sizeof(uint32_t);
+	auto mesh = MeshletMesh{};
+	mesh.meshlet_count = static_cast<uint32_t>(meshlets.size());
+	mesh.buffer = create_buffer(
+			device,
+			allocator,
+			size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+					VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+					VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	mesh.address = buffer_device_address(device, mesh.buffer);
+	auto upload = [&](VkDeviceSize offset, std::span<const std::byte> bytes) {
+		upload_buffer(
+				device,
+				uploader,
+				mesh.buffer.handle,
+				offset * sizeof(uint32_t),
+				bytes,
+				VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT |
+						VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT,
+				VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	};
+	upload(0, std::as_bytes(std::span(meshlets)));
+	upload(vertices_offset, std::as_bytes(std::span(data.vertices)));
+	upload(triangles_offset, std::as_bytes(std::span(data.triangles)));
+	mesh.ticket = uploader.next_ticket;
+	return mesh;
+}
+
+void destroy_meshlet_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		MeshletMesh& mesh) {
+	destroy_buffer(device, allocator, mesh.buffer);
+	mesh = MeshletMesh{};
+}
+
+void draw_meshlets(VkCommandBuffer command_buffer, const MeshletMesh& mesh) {
+	vkCmdDrawMeshTasksEXT(
+			command_buffer,
+			(mesh.meshlet_count + g_meshlet_task_size - 1) / g_meshlet_task_size,
+			1,
+			1);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+#include "upload.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Limits of one meshlet, matching the outputs declared in meshlet.mesh. These
+// are the sizes vendors recommend for current desktop GPUs.
+constexpr auto g_meshlet_max_vertices = 64U;
+constexpr auto g_meshlet_max_triangles = 124U;
+// Meshlets culled per task shader workgroup, its local size in meshlet.task.
+constexpr auto g_meshlet_task_size = 32U;
+
+// Matches Meshlet in meshlet.task and meshlet.mesh. Offsets count 32-bit words
+// from the start of the meshlet buffer, see MeshletMesh.
+struct Meshlet {
+	// Object space center in xyz and radius in w.
+	glm::vec4 bounding_sphere{};
+	// Every triangle faces away from a viewer looking along a direction d
+	// with dot(d, xyz) >= w * length(d), accounting for the sphere's radius.
+	// w is above 1 when the normals spread too far to ever cull.
+	glm::vec4 cone{};
+	uint32_t vertex_offset{};
+	uint32_t triangle_offset{};
+	uint32_t vertex_count{};
+	uint32_t triangle_count{};
+};
+
+static_assert(sizeof(Meshlet) == 48);
+
+struct MeshletData {
+	std::vector<Meshlet> meshlets;
+	// Mesh vertex indices, vertex_count per meshlet.
+	std::vector<uint32_t> vertices;
+	// One word per triangle holding three 8-bit indices into the meshlet's
+	// vertices, lowest byte first.
+	std::vector<uint32_t> triangles;
+};
+
+// Splits triangles in index order into meshlets within the limits above. The
+// cones assume clockwise front faces, see RasterState.
+auto build_meshlets(
+		std::span<const glm::vec3> positions,
+		std::span<const uint32_t> indices) -> MeshletData;
+
+// The meshlets, vertex indices and triangles of a mesh, one after the other in
+// one buffer read through address by the task and mesh shaders.
+struct MeshletMesh {
+	Buffer buffer;
+	VkDeviceAddress address{};
+	uint32_t meshlet_count{};
+	UploadTicket ticket{};
+};
+
+// Records the copy into the uploader's current batch. Needs a device_address
+// allocator.
+auto create_meshlet_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		const MeshletData& data) -> MeshletMesh;
+// The GPU must be done with the meshlets.
+void destroy_meshlet_mesh(
+		VkDevice& device,
+		Allocator& allocator,
+		MeshletMesh& mesh);
+
+// Launches a task shader workgroup per g_meshlet_task_size meshlets. The bound
+// pipeline must be a meshlet pipeline.
+void draw_meshlets(VkCommandBuffer command_buffer, const MeshletMesh& mesh);
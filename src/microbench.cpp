@@ -0,0 +1,515 @@
+#include "microbench.hpp"
+
+#include "animation.hpp"
+#include "culling.hpp"
+#include "host_memory.hpp"
+#include "matrix_batch.hpp"
+#include "upload.hpp"
+
+#include <fmt/core.h>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+namespace {
+
+constexpr auto g_microbenchmark_repeats = 5;
+// Allocations from 4 KiB to 1 MiB, about 56 MiB in all.
+constexpr auto g_allocator_ops = size_t{512};
+constexpr auto g_allocator_size_classes = size_t{9};
+constexpr auto g_upload_ring_size = VkDeviceSize{32} * 1024 * 1024;
+constexpr auto g_upload_size = VkDeviceSize{16} * 1024 * 1024;
+constexpr auto g_upload_chunk_size = VkDeviceSize{256} * 1024;
+constexpr auto g_descriptor_ops = size_t{256};
+constexpr auto g_recorded_draws = size_t{10000};
+constexpr auto g_pipeline_lookups = size_t{10000};
+// A 64 by 64 by 16 grid across twice the clip volume, about half of it
+// visible.
+constexpr auto g_culled_spheres = size_t{64} * 64 * 16;
+// Characters of a humanoid's joint count, each blending two clips of a
+// second keyed at 30 Hz.
+constexpr auto g_animated_characters = size_t{1024};
+constexpr auto g_animated_joints = 64U;
+constexpr auto g_animation_keys = 30U;
+// A scene's worth of model matrices and bounding box corners.
+constexpr auto g_batched_matrices = size_t{4096};
+
+struct Microbenchmark {
+	std::string_view name;
+	void (*run)(const MicrobenchmarkSubjects& subjects);
+};
+
+auto elapsed_nanoseconds(std::chrono::steady_clock::time_point start)
+		-> double {
+	return std::chrono::duration<double, std::nano>(
+						 std::chrono::steady_clock::now() - start)
+			.count();
+}
+
+// Nanoseconds per operation of the fastest repeat of run, which does ops of
+// them.
+auto best_nanoseconds(size_t ops, const std::function<void()>& run)
+		-> double {
+	run();
+	auto best = std::numeric_limits<double>::max();
+	for (auto i = 0; i < g_microbenchmark_repeats; i++) {
+		auto start = std::chrono::steady_clock::now();
+		run();
+		best = std::min(best, elapsed_nanoseconds(start));
+	}
+	return best / static_cast<double>(ops);
+}
+
+void print_result(std::string_view name, double value, std::string_view unit) {
+	fmt::print("{} {:.3f} {}\n", name, value, unit);
+}
+
+void bench_allocator(const MicrobenchmarkSubjects& subjects) {
+	auto device = subjects.device;
+	auto allocations = std::vector<Allocation>(g_allocator_ops);
+	auto nanoseconds = best_nanoseconds(g_allocator_ops, [&] {
+		for (auto i = size_t{}; i < allocations.size(); i++) {
+			auto requirements = VkMemoryRequirements{
+					.size = VkDeviceSize{4096} << (i % g_allocator_size_classes),
+					.alignment = 256,
+					.memoryTypeBits = ~0U};
+			allocations.at(i) = allocate_memory(
+					device,
+					*subjects.allocator,
+					requirements,
+					ResourceKind::linear,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					0,
+					MemoryPriority::normal);
+		}
+		// Every other one first, so frees find both free and used neighbours.
+		for (auto i = size_t{}; i < allocations.size(); i += 2) {
+			free_memory(device, *subjects.allocator, allocations.at(i));
+		}
+		for (auto i = size_t{1}; i < allocations.size(); i += 2) {
+			free_memory(device, *subjects.allocator, allocations.at(i));
+		}
+	});
+	print_result("allocate_free", nanoseconds, "ns");
+}
+
+void bench_upload(const MicrobenchmarkSubjects& subjects) {
+	auto device = subjects.device;
+	auto uploader = create_uploader(
+			device,
+			*subjects.allocator,
+			subjects.graphics_family_idx,
+			subjects.graphics_family_idx,
+			g_upload_ring_size,
+			subjects.synchronization2);
+	auto buffer = create_buffer(
+			device,
+			*subjects.allocator,
+			g_upload_size,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto data = std::vector<std::byte>(g_upload_chunk_size);
+	auto nanoseconds = best_nanoseconds(1, [&] {
+		for (auto offset = VkDeviceSize{}; offset < g_upload_size;
+				 offset += g_upload_chunk_size) {
+			upload_buffer(
+					device,
+					uploader,
+					buffer.handle,
+					offset,
+					data,
+					VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+					VK_ACCESS_2_MEMORY_READ_BIT);
+		}
+		wait_for_upload(device, uploader, submit_uploads(device, uploader));
+	});
+	print_result(
+			"upload",
+			static_cast<double>(g_upload_size) / (1024.0 * 1024.0) /
+					(nanoseconds / 1e9),
+			"MiB/s");
+	destroy_buffer(device, *subjects.allocator, buffer);
+	destroy_uploader(device, uploader);
+}
+
+void bench_descriptors(const MicrobenchmarkSubjects& subjects) {
+	// Without descriptor indexing the first descriptor of an array has to
+	// outlive the table, which a buffer of the benchmark would not.
+	if (!subjects.bindless->descriptor_indexing) {
+		fmt::print(
+				stderr,
+				"Descriptor updates need descriptor indexing, skipping them\n");
+		return;
+	}
+	auto device = subjects.device;
+	auto buffer = create_buffer(
+			device,
+			*subjects.allocator,
+			256,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto handles = std::vector<BindlessHandle>(g_descriptor_ops);
+	auto nanoseconds = best_nanoseconds(g_descriptor_ops, [&] {
+		for (auto& handle : handles) {
+			handle = add_bindless_buffer(
+					device,
+					*subjects.bindless,
+					buffer.handle,
+					0,
+					VK_WHOLE_SIZE);
+		}
+		for (auto handle : handles) {
+			remove_bindless_buffer(device, *subjects.bindless, handle);
+		}
+	});
+	print_result("bindless_buffer_add_remove", nanoseconds, "ns");
+	destroy_buffer(device, *subjects.allocator, buffer);
+}
+
+void bench_recording(const MicrobenchmarkSubjects& subjects) {
+	if (subjects.mesh == nullptr) {
+		fmt::print(
+				stderr,
+				"Draw recording needs directly drawn meshes, skipping it\n");
+		return;
+	}
+	auto device = subjects.device;
+	auto pool_info = VkCommandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = subjects.graphics_family_idx};
+	auto* command_pool = VkCommandPool{};
+	if (vkCreateCommandPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&command_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create command pool\n");
+		std::terminate();
+	}
+	auto allocate_info = VkCommandBufferAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.commandPool = command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+			.commandBufferCount = 1};
+	auto* command_buffer = VkCommandBuffer{};
+	if (vkAllocateCommandBuffers(device, &allocate_info, &command_buffer) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate command buffer\n");
+		std::terminate();
+	}
+	auto begin_info = VkCommandBufferBeginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+					VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.pInheritanceInfo = &subjects.inheritance};
+	auto viewport = VkViewport{
+			.x = 0.0F,
+			.y = 0.0F,
+			.width = 1.0F,
+			.height = 1.0F,
+			.minDepth = 0.0F,
+			.maxDepth = 1.0F};
+	auto scissor = VkRect2D{.offset = {0, 0}, .extent = {1, 1}};
+	const auto& range = subjects.push_constant_range;
+	auto push_constants = std::vector<std::byte>(range.size);
+	// Recorded only, the secondary is never executed.
+	auto nanoseconds = best_nanoseconds(g_recorded_draws, [&] {
+		vkResetCommandPool(device, command_pool, 0);
+		vkBeginCommandBuffer(command_buffer, &begin_info);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				subjects.pipeline);
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+		if (subjects.extended_dynamic_state) {
+			set_raster_state(command_buffer, subjects.pipeline_state->raster, true);
+		}
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				subjects.pipeline_layout,
+				*subjects.bindless);
+		for (auto i = size_t{}; i < g_recorded_draws; i++) {
+			if (range.size != 0) {
+				vkCmdPushConstants(
+						command_buffer,
+						subjects.pipeline_layout,
+						range.stageFlags,
+						range.offset,
+						range.size,
+						push_constants.data());
+			}
+			draw_mesh(command_buffer, *subjects.mesh, 0);
+		}
+		vkEndCommandBuffer(command_buffer);
+	});
+	print_result("record_draw", nanoseconds, "ns");
+	vkDestroyCommandPool(device, command_pool, host_callbacks());
+}
+
+// Compiles the shading pipeline into a state cache of its own, through the
+// demo's pipeline cache or, when cold, an empty one. Returns the fastest
+// compile in milliseconds.
+auto best_compile(const MicrobenchmarkSubjects& subjects, bool cold)
+		-> double {
+	auto device = subjects.device;
+	auto best = std::numeric_limits<double>::max();
+	for (auto i = 0; i < g_microbenchmark_repeats; i++) {
+		auto pipeline_cache = subjects.pipeline_cache;
+		if (cold) {
+			auto cache_info = VkPipelineCacheCreateInfo{
+					.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+					.pNext = VK_NULL_HANDLE,
+					.flags = 0,
+					.initialDataSize = 0,
+					.pInitialData = VK_NULL_HANDLE};
+			if (vkCreatePipelineCache(
+							device,
+							&cache_info,
+							host_callbacks(),
+							&pipeline_cache) != VK_SUCCESS) {
+				fmt::print(stderr, "Failed to create pipeline cache\n");
+				std::terminate();
+			}
+		}
+		auto cache = create_pipeline_state_cache(
+				pipeline_cache,
+				subjects.pipeline_states->graphics_pipeline_library,
+				*subjects.pipeline_states->compiler);
+		auto start = std::chrono::steady_clock::now();
+		get_graphics_pipeline(device, cache, *subjects.pipeline_state);
+		best = std::min(best, elapsed_nanoseconds(start) / 1e6);
+		destroy_pipeline_state_cache(device, cache);
+		if (cold) {
+			vkDestroyPipelineCache(device, pipeline_cache, host_callbacks());
+		}
+	}
+	return best;
+}
+
+void bench_pipelines(const MicrobenchmarkSubjects& subjects) {
+	auto device = subjects.device;
+	auto nanoseconds = best_nanoseconds(g_pipeline_lookups, [&] {
+		for (auto i = size_t{}; i < g_pipeline_lookups; i++) {
+			get_graphics_pipeline(
+					device,
+					*subjects.pipeline_states,
+					*subjects.pipeline_state);
+		}
+	});
+	print_result("pipeline_lookup", nanoseconds, "ns");
+	// What the frame loop's requests cost, keyed once up front.
+	auto key = pipeline_state_key(*subjects.pipeline_state);
+	nanoseconds = best_nanoseconds(g_pipeline_lookups, [&] {
+		for (auto i = size_t{}; i < g_pipeline_lookups; i++) {
+			get_graphics_pipeline(
+					device,
+					*subjects.pipeline_states,
+					*subjects.pipeline_state,
+					key);
+		}
+	});
+	print_result("pipeline_lookup_keyed", nanoseconds, "ns");
+	// Drivers with caches of their own on disk may hit those even when cold.
+	print_result(
+			"pipeline_compile_cache_hit",
+			best_compile(subjects, false),
+			"ms");
+	print_result(
+			"pipeline_compile_cache_miss",
+			best_compile(subjects, true),
+			"ms");
+}
+
+void bench_culling(const MicrobenchmarkSubjects& subjects) {
+	auto spheres = BoundingSpheres{};
+	for (auto i = size_t{}; i < g_culled_spheres; i++) {
+		auto x = static_cast<float>(i % 64) / 16.0F - 2.0F;
+		auto y = static_cast<float>(i / 64 % 64) / 16.0F - 2.0F;
+		auto z = static_cast<float>(i / 4096) / 8.0F - 0.5F;
+		add_bounding_sphere(spheres, glm::vec4{x, y, z, 0.01F});
+	}
+	auto frustum = extract_frustum(glm::mat4{1.0F});
+	auto visible = std::vector<uint8_t>(g_culled_spheres);
+	auto nanoseconds = best_nanoseconds(g_culled_spheres, [&] {
+		cull_spheres(frustum, spheres, 0, g_culled_spheres, visible);
+	});
+	print_result("cull_sphere", nanoseconds, "ns");
+	nanoseconds = best_nanoseconds(g_culled_spheres, [&] {
+		cull_spheres_parallel(*subjects.jobs, frustum, spheres, visible);
+	});
+	print_result("cull_sphere_parallel", nanoseconds, "ns");
+}
+
+// The matrix_batch kernels against glm's operators on the same data, with
+// the largest difference between their results.
+void bench_matrices(const MicrobenchmarkSubjects& /*subjects*/) {
+	auto view_projection = glm::mat4(
+			glm::vec4(1.2F, 0.1F, 0.0F, 0.0F),
+			glm::vec4(-0.1F, 1.6F, 0.2F, 0.0F),
+			glm::vec4(0.0F, -0.2F, 0.01F, 1.0F),
+			glm::vec4(0.3F, -0.4F, 0.1F, 2.0F));
+	auto models = std::vector<glm::mat4>{};
+	auto points = std::vector<glm::vec3>{};
+	for (auto i = size_t{}; i < g_batched_matrices; i++) {
+		auto offset = static_cast<float>(i) /
+				static_cast<float>(g_batched_matrices);
+		auto model = glm::mat4_cast(glm::angleAxis(
+				offset * 2.0F * std::numbers::pi_v<float>,
+				glm::normalize(glm::vec3(1.0F, offset, 1.0F - offset))));
+		model[3] = glm::vec4(offset - 0.5F, 0.5F - offset, 2.0F * offset, 1.0F);
+		models.emplace_back(model);
+		points.emplace_back(glm::vec3(model[3]) * 2.0F);
+	}
+	auto batched = std::vector<glm::mat4>(g_batched_matrices);
+	auto expected = std::vector<glm::mat4>(g_batched_matrices);
+	fmt::print("matrix_batch_avx2 {}\n", matrix_batch_uses_avx2() ? 1 : 0);
+	auto nanoseconds = best_nanoseconds(g_batched_matrices, [&] {
+		multiply_matrices(view_projection, models, batched);
+	});
+	print_result("matrix_multiply", nanoseconds, "ns");
+	nanoseconds = best_nanoseconds(g_batched_matrices, [&] {
+		for (auto i = size_t{}; i < g_batched_matrices; i++) {
+			expected[i] = view_projection * models[i];
+		}
+	});
+	print_result("matrix_multiply_glm", nanoseconds, "ns");
+	auto error = 0.0F;
+	for (auto i = size_t{}; i < g_batched_matrices; i++) {
+		for (auto column = 0; column < 4; column++) {
+			auto difference = glm::abs(batched[i][column] - expected[i][column]);
+			error = std::max(
+					{error, difference.x, difference.y, difference.z, difference.w});
+		}
+	}
+	fmt::print("matrix_multiply_error {:g}\n", error);
+
+	auto projected = std::vector<glm::vec4>(g_batched_matrices);
+	auto expected_points = std::vector<glm::vec4>(g_batched_matrices);
+	nanoseconds = best_nanoseconds(g_batched_matrices, [&] {
+		project_points(view_projection, points, projected);
+	});
+	print_result("project_point", nanoseconds, "ns");
+	nanoseconds = best_nanoseconds(g_batched_matrices, [&] {
+		for (auto i = size_t{}; i < g_batched_matrices; i++) {
+			auto clip = view_projection * glm::vec4(points[i], 1.0F);
+			expected_points[i] = glm::vec4(glm::vec3(clip) / clip.w, clip.w);
+		}
+	});
+	print_result("project_point_glm", nanoseconds, "ns");
+	error = 0.0F;
+	for (auto i = size_t{}; i < g_batched_matrices; i++) {
+		auto difference = glm::abs(projected[i] - expected_points[i]);
+		error = std::max(
+				{error, difference.x, difference.y, difference.z, difference.w});
+	}
+	fmt::print("project_point_error {:g}\n", error);
+}
+
+// A clip of every joint swinging about its own axis, phase shifted from the
+// others.
+auto swinging_clip(float phase) -> AnimationClip {
+	auto rotations = std::vector<glm::quat>{};
+	auto translations = std::vector<glm::vec3>{};
+	for (auto key = 0U; key < g_animation_keys; key++) {
+		auto time = static_cast<float>(key) / static_cast<float>(g_animation_keys);
+		for (auto joint = 0U; joint < g_animated_joints; joint++) {
+			auto along = static_cast<float>(joint) /
+					static_cast<float>(g_animated_joints);
+			auto axis = glm::normalize(glm::vec3(1.0F, along, 1.0F - along));
+			auto angle = std::sin(
+					2.0F * std::numbers::pi_v<float> * time + phase + along * 3.0F);
+			rotations.emplace_back(glm::angleAxis(angle, axis));
+			translations.emplace_back(0.0F, 0.1F + 0.01F * angle, 0.0F);
+		}
+	}
+	return compress_clip(g_animated_joints, 1.0F, rotations, translations);
+}
+
+void bench_animation(const MicrobenchmarkSubjects& subjects) {
+	auto walk = swinging_clip(0.0F);
+	auto run = swinging_clip(1.5F);
+	auto blends = std::vector<AnimationBlend>{};
+	auto poses = std::vector<JointPoses>{};
+	for (auto i = size_t{}; i < g_animated_characters; i++) {
+		auto offset = static_cast<float>(i) /
+				static_cast<float>(g_animated_characters);
+		blends.emplace_back(AnimationBlend{
+				.base = &walk,
+				.layer = &run,
+				.base_seconds = offset,
+				.layer_seconds = 2.0F * offset,
+				.weight = offset});
+		poses.emplace_back(create_joint_poses(g_animated_joints));
+	}
+	auto nanoseconds = best_nanoseconds(g_animated_characters, [&] {
+		for (auto i = size_t{}; i < g_animated_characters; i++) {
+			sample_blend(blends[i], poses[i]);
+		}
+	});
+	print_result("animation_blend", nanoseconds, "ns");
+	nanoseconds = best_nanoseconds(g_animated_characters, [&] {
+		sample_blends_parallel(*subjects.jobs, blends, poses);
+	});
+	print_result("animation_blend_parallel", nanoseconds, "ns");
+}
+
+constexpr auto g_microbenchmarks = std::array{
+		Microbenchmark{.name = "allocator", .run = bench_allocator},
+		Microbenchmark{.name = "upload", .run = bench_upload},
+		Microbenchmark{.name = "descriptors", .run = bench_descriptors},
+		Microbenchmark{.name = "recording", .run = bench_recording},
+		Microbenchmark{.name = "pipelines", .run = bench_pipelines},
+		Microbenchmark{.name = "culling", .run = bench_culling},
+		Microbenchmark{.name = "animation", .run = bench_animation},
+		Microbenchmark{.name = "matrices", .run = bench_matrices},
+};
+
+}  // namespace
+
+void run_microbenchmarks(
+		const MicrobenchmarkSubjects& subjects,
+		std::string_view names) {
+	if (names == "all") {
+		for (const auto& microbenchmark : g_microbenchmarks) {
+			microbenchmark.run(subjects);
+		}
+		return;
+	}
+	while (!names.empty()) {
+		auto end = std::min(names.find(','), names.size());
+		auto name = names.substr(0, end);
+		names.remove_prefix(std::min(end + 1, names.size()));
+		if (name.empty()) {
+			continue;
+		}
+		const auto* found = std::find_if(
+				g_microbenchmarks.begin(),
+				g_microbenchmarks.end(),
+				[&](const Microbenchmark& microbenchmark) {
+					return microbenchmark.name == name;
+				});
+		if (found == g_microbenchmarks.end()) {
+			fmt::print(stderr, "Unknown microbenchmark {}\n", name);
+			continue;
+		}
+		found->run(subjects);
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "jobs.hpp"
+#include "mesh.hpp"
+#include "pipeline.hpp"
+#include "pipeline_state.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+// What the microbenchmarks run against: the demo's own device and resources,
+// set up as for a frame. The device must be idle and stay otherwise unused
+// while they run.
+struct MicrobenchmarkSubjects {
+	VkDevice device{};
+	JobSystem* jobs{};
+	Allocator* allocator{};
+	BindlessTable* bindless{};
+	uint32_t graphics_family_idx{};
+	bool synchronization2{};
+	// The shading pipeline, compiled and cached in pipeline_states and
+	// pipeline_cache.
+	PipelineStateCache* pipeline_states{};
+	VkPipelineCache pipeline_cache{};
+	const GraphicsPipelineState* pipeline_state{};
+	VkPipeline pipeline{};
+	VkPipelineLayout pipeline_layout{};
+	VkPushConstantRange push_constant_range{};
+	bool extended_dynamic_state{};
+	// What the main pass's secondaries are begun with.
+	VkCommandBufferInheritanceInfo inheritance{};
+	const Mesh* mesh{};
+};
+
+// Runs the microbenchmarks in a comma separated list, or all of them, and
+// prints one line per result to stdout:
+//
+//   allocator    allocate_memory and free_memory of device local ranges
+//   upload       staging ring upload bandwidth through an uploader of its own
+//                on the graphics queue, which needs no ownership transfers
+//   descriptors  bindless buffer descriptor updates, with descriptor indexing
+//   recording    recording a directly drawn mesh with its push constants into
+//                a main pass secondary
+//   pipelines    pipeline state cache hits, and compiles that hit and miss
+//                the driver's pipeline cache
+//   culling      frustum culling of bounding spheres with the SIMD kernel, on
+//                one thread and spread over the job system
+//   animation    sampling and blending two compressed clips per character
+//                with the SIMD kernels, on one thread and spread over the
+//                job system
+//   matrices     matrix_batch's matrix products and point projections against
+//                glm's, with whether AVX2 is used and the largest difference
+//                between their results
+//
+// Each result is the best of a few repeats, after one to warm up.
+void run_microbenchmarks(
+		const MicrobenchmarkSubjects& subjects,
+		std::string_view names);
@@ -0,0 +1,118 @@
+#include "obj.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// Splits off the next whitespace separated token of line.
+auto next_token(std::string_view& line) -> std::string_view {
+	auto start = line.find_first_not_of(" \t\r");
+	if (start == std::string_view::npos) {
+		line = {};
+		return {};
+	}
+	line.remove_prefix(start);
+	auto end = std::min(line.find_first_of(" \t\r"), line.size());
+	auto token = line.substr(0, end);
+	line.remove_prefix(end);
+	return token;
+}
+
+auto parse_float(std::string_view token, float& value) -> bool {
+	auto [end, error] =
+			std::from_chars(token.data(), token.data() + token.size(), value);
+	return error == std::errc{} && end == token.data() + token.size();
+}
+
+// Face corners are v, v/vt, v//vn or v/vt/vn, only v is used. Negative
+// indices count back from the last position read.
+auto parse_corner(std::string_view token, size_t position_count, uint32_t& idx)
+		-> bool {
+	token = token.substr(0, token.find('/'));
+	auto value = int64_t{};
+	auto [end, error] =
+			std::from_chars(token.data(), token.data() + token.size(), value);
+	if (error != std::errc{} || end != token.data() + token.size() ||
+			value == 0) {
+		return false;
+	}
+	auto count = static_cast<int64_t>(position_count);
+	value = value < 0 ? count + value : value - 1;
+	if (value < 0 || value >= count) {
+		return false;
+	}
+	idx = static_cast<uint32_t>(value);
+	return true;
+}
+
+}  // namespace
+
+auto read_obj(const std::filesystem::path& path) -> std::optional<MeshData> {
+	auto file = std::ifstream(path);
+	if (!file) {
+		fmt::print(stderr, "Failed to open OBJ file {}\n", path.string());
+		return std::nullopt;
+	}
+	auto data = MeshData{};
+	auto corners = std::vector<uint32_t>{};
+	auto text = std::string{};
+	for (auto line_idx = size_t{1}; std::getline(file, text); line_idx++) {
+		auto line = std::string_view(text);
+		auto keyword = next_token(line);
+		auto valid = true;
+		if (keyword == "v") {
+			auto values = std::array<float, 6>{1.0F, 1.0F, 1.0F, 1.0F, 1.0F, 1.0F};
+			auto count = size_t{};
+			for (auto token = next_token(line); !token.empty() && valid;
+					 token = next_token(line)) {
+				valid = count < values.size() && parse_float(token, values.at(count));
+				count++;
+			}
+			valid = valid && (count == 3 || count == 4 || count == 6);
+			data.positions.emplace_back(values[0], values[1], values[2]);
+			// A fourth value is a homogeneous weight, not a color.
+			data.colors.emplace_back(
+					count == 6 ? glm::vec3{values[3], values[4], values[5]}
+										 : glm::vec3{1.0F});
+		} else if (keyword == "f") {
+			corners.clear();
+			for (auto token = next_token(line); !token.empty() && valid;
+					 token = next_token(line)) {
+				valid = parse_corner(
+						token,
+						data.positions.size(),
+						corners.emplace_back());
+			}
+			valid = valid && corners.size() >= 3;
+			for (auto i = size_t{2}; valid && i < corners.size(); i++) {
+				data.indices.insert(
+						data.indices.end(),
+						{corners[0], corners[i - 1], corners[i]});
+			}
+		}
+		if (!valid) {
+			fmt::print(
+					stderr,
+					"Malformed line {} in OBJ file {}\n",
+					line_idx,
+					path.string());
+			return std::nullopt;
+		}
+	}
+	if (data.positions.empty() || data.indices.empty()) {
+		fmt::print(stderr, "OBJ file {} has no faces\n", path.string());
+		return std::nullopt;
+	}
+	return data;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "mesh.hpp"
+
+#include <filesystem>
+#include <optional>
+
+// Reads the positions and faces of a Wavefront OBJ file for the mesh cook
+// step. Per vertex colors follow the position on v lines, as many exporters
+// write them, and default to white. Faces with more than three corners are
+// split into a fan. Everything else in the file is ignored.
+auto read_obj(const std::filesystem::path& path) -> std::optional<MeshData>;
@@ -0,0 +1,151 @@
+#include "object_cache.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+constexpr auto g_fnv_offset_basis = uint64_t{14695981039346656037U};
+constexpr auto g_fnv_prime = uint64_t{1099511628211U};
+
+auto sampler_key(const VkSamplerCreateInfo& info) -> SamplerKey {
+	auto key = SamplerKey{
+			.words = {
+					info.flags,
+					static_cast<uint32_t>(info.magFilter),
+					static_cast<uint32_t>(info.minFilter),
+					static_cast<uint32_t>(info.mipmapMode),
+					static_cast<uint32_t>(info.addressModeU),
+					static_cast<uint32_t>(info.addressModeV),
+					static_cast<uint32_t>(info.addressModeW),
+					std::bit_cast<uint32_t>(info.mipLodBias),
+					info.anisotropyEnable,
+					std::bit_cast<uint32_t>(info.maxAnisotropy),
+					info.compareEnable,
+					static_cast<uint32_t>(info.compareOp),
+					std::bit_cast<uint32_t>(info.minLod),
+					std::bit_cast<uint32_t>(info.maxLod),
+					static_cast<uint32_t>(info.borderColor),
+					info.unnormalizedCoordinates},
+			.hash = g_fnv_offset_basis};
+	for (auto word : key.words) {
+		for (auto i = 0U; i < 4; i++) {
+			key.hash = (key.hash ^ ((word >> (i * 8U)) & 0xffU)) * g_fnv_prime;
+		}
+	}
+	return key;
+}
+
+auto image_view_key(const VkImageViewCreateInfo& info)
+		-> std::array<uint32_t, g_image_view_key_words> {
+	const auto& range = info.subresourceRange;
+	return {
+			info.flags,
+			static_cast<uint32_t>(info.viewType),
+			static_cast<uint32_t>(info.format),
+			static_cast<uint32_t>(info.components.r),
+			static_cast<uint32_t>(info.components.g),
+			static_cast<uint32_t>(info.components.b),
+			static_cast<uint32_t>(info.components.a),
+			range.aspectMask,
+			range.baseMipLevel,
+			range.levelCount,
+			range.baseArrayLayer,
+			range.layerCount};
+}
+
+}  // namespace
+
+auto acquire_sampler(
+		VkDevice& device,
+		SamplerCache& cache,
+		const VkSamplerCreateInfo& info) -> VkSampler {
+	auto [entry, added] = cache.samplers.try_emplace(sampler_key(info));
+	auto& cached = entry->second;
+	if (added) {
+		if (vkCreateSampler(device, &info, host_callbacks(), &cached.sampler) !=
+				VK_SUCCESS) {
+			fmt::print(
+					stderr,
+					"Failed to create a sampler, {} others exist\n",
+					cache.samplers.size() - 1);
+			std::terminate();
+		}
+	}
+	cached.references++;
+	return cached.sampler;
+}
+
+void release_sampler(VkDevice& device, SamplerCache& cache, VkSampler sampler) {
+	// Few distinct samplers exist, and they are released at teardown and
+	// resizes, so a search beats keeping a second map by handle.
+	auto entry = std::find_if(
+			cache.samplers.begin(),
+			cache.samplers.end(),
+			[&](const auto& cached) { return cached.second.sampler == sampler; });
+	if (entry == cache.samplers.end()) {
+		return;
+	}
+	if (--entry->second.references == 0) {
+		vkDestroySampler(device, sampler, host_callbacks());
+		cache.samplers.erase(entry);
+	}
+}
+
+void destroy_sampler_cache(VkDevice& device, SamplerCache& cache) {
+	for (auto& [key, cached] : cache.samplers) {
+		vkDestroySampler(device, cached.sampler, host_callbacks());
+	}
+	cache = SamplerCache{};
+}
+
+auto get_image_view(
+		VkDevice& device,
+		ImageViewCache& cache,
+		const VkImageViewCreateInfo& info) -> VkImageView {
+	auto key = image_view_key(info);
+	// An image has a handful of views at most, so they are searched in order.
+	auto& views = cache.images[info.image];
+	for (const auto& cached : views) {
+		if (cached.key == key) {
+			return cached.view;
+		}
+	}
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create an image view\n");
+		std::terminate();
+	}
+	views.emplace_back(CachedImageView{.key = key, .view = view});
+	return view;
+}
+
+void release_image_views(
+		VkDevice& device,
+		ImageViewCache& cache,
+		VkImage image) {
+	auto entry = cache.images.find(image);
+	if (entry == cache.images.end()) {
+		return;
+	}
+	for (const auto& cached : entry->second) {
+		vkDestroyImageView(device, cached.view, host_callbacks());
+	}
+	cache.images.erase(entry);
+}
+
+void destroy_image_view_cache(VkDevice& device, ImageViewCache& cache) {
+	for (auto& [image, views] : cache.images) {
+		for (const auto& cached : views) {
+			vkDestroyImageView(device, cached.view, host_callbacks());
+		}
+	}
+	cache = ImageViewCache{};
+}
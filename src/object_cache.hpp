@@ -0,0 +1,85 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// The fields of a VkSamplerCreateInfo after sType and pNext, floats by their
+// bits.
+constexpr auto g_sampler_key_words = size_t{16};
+// The fields of a VkImageViewCreateInfo that tell views of one image apart.
+constexpr auto g_image_view_key_words = size_t{12};
+
+struct SamplerKey {
+	std::array<uint32_t, g_sampler_key_words> words{};
+	// FNV-1a over the words.
+	uint64_t hash{};
+};
+
+struct SamplerKeyHash {
+	auto operator()(const SamplerKey& key) const -> size_t {
+		return key.hash;
+	}
+};
+
+struct SamplerKeyEqual {
+	auto operator()(const SamplerKey& a, const SamplerKey& b) const -> bool {
+		return a.words == b.words;
+	}
+};
+
+struct CachedSampler {
+	VkSampler sampler{};
+	uint32_t references{};
+};
+
+// Samplers by their create info. Passes and textures that sample alike share
+// one sampler, which keeps the count far below maxSamplerAllocationCount
+// however many of them ask for one.
+struct SamplerCache {
+	std::unordered_map<SamplerKey, CachedSampler, SamplerKeyHash, SamplerKeyEqual>
+			samplers;
+};
+
+struct CachedImageView {
+	std::array<uint32_t, g_image_view_key_words> key{};
+	VkImageView view{};
+};
+
+// Image views by image, and within an image by type, format, swizzle and
+// subresource range. Asking for a view of an image again returns the one made
+// first. The views of an image live as long as it does: whoever destroys the
+// image releases them first.
+struct ImageViewCache {
+	std::unordered_map<VkImage, std::vector<CachedImageView>> images;
+};
+
+// A sampler made from info, shared with every other acquire of an equal info
+// until each of them released it. info must have no pNext chain.
+auto acquire_sampler(
+		VkDevice& device,
+		SamplerCache& cache,
+		const VkSamplerCreateInfo& info) -> VkSampler;
+// Destroys sampler with its last reference, which the device must no longer
+// use by then.
+void release_sampler(VkDevice& device, SamplerCache& cache, VkSampler sampler);
+// The device must be idle. Samplers not yet released are destroyed too.
+void destroy_sampler_cache(VkDevice& device, SamplerCache& cache);
+
+// The view info describes, made on first request. info must have no pNext
+// chain.
+auto get_image_view(
+		VkDevice& device,
+		ImageViewCache& cache,
+		const VkImageViewCreateInfo& info) -> VkImageView;
+// Destroys the views of image, which the device must no longer use.
+void release_image_views(
+		VkDevice& device,
+		ImageViewCache& cache,
+		VkImage image);
+// The device must be idle. Views not yet released are destroyed too.
+void destroy_image_view_cache(VkDevice& device, ImageViewCache& cache);
@@ -0,0 +1,129 @@
+#include "offscreen.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+
+auto create_offscreen_target(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat format,
+		VkFormat depth_format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		VkImageUsageFlags depth_usage,
+		size_t count,
+		VkRenderPass render_pass) -> OffscreenTarget {
+	auto target = OffscreenTarget{};
+	target.extent = extent;
+	target.attachments = create_scene_attachments(
+			device,
+			allocator,
+			format,
+			depth_format,
+			extent,
+			samples,
+			1,
+			depth_usage);
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	for (auto i = size_t{}; i < count; i++) {
+		auto& image = target.images.emplace_back(create_image(
+				device,
+				allocator,
+				image_info,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0));
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = image.handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = VkImageSubresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1}};
+		auto* view = VkImageView{};
+		if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+				VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create an offscreen image view\n");
+			std::terminate();
+		}
+		target.views.emplace_back(view);
+		if (render_pass == VK_NULL_HANDLE) {
+			continue;
+		}
+
+		auto attachments = scene_framebuffer_views(target.attachments, view);
+		auto framebuffer_info = VkFramebufferCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderPass = render_pass,
+				.attachmentCount = static_cast<uint32_t>(attachments.size()),
+				.pAttachments = attachments.data(),
+				.width = extent.width,
+				.height = extent.height,
+				.layers = 1};
+		auto* framebuffer = VkFramebuffer{};
+		if (vkCreateFramebuffer(
+						device,
+						&framebuffer_info,
+						host_callbacks(),
+						&framebuffer) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create offscreen framebuffer\n");
+			std::terminate();
+		}
+		target.framebuffers.emplace_back(framebuffer);
+	}
+	return target;
+}
+
+void destroy_offscreen_target(
+		VkDevice& device,
+		Allocator& allocator,
+		OffscreenTarget& target) {
+	for (auto& framebuffer : target.framebuffers) {
+		vkDestroyFramebuffer(device, framebuffer, host_callbacks());
+	}
+	for (auto& view : target.views) {
+		vkDestroyImageView(device, view, host_callbacks());
+	}
+	for (auto& image : target.images) {
+		destroy_image(device, allocator, image);
+	}
+	destroy_scene_attachments(device, allocator, target.attachments);
+	target = OffscreenTarget{};
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "attachments.hpp"
+#include "dispatch.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Color targets rendered to instead of a swap chain when running without a
+// surface, one per frame in flight so frames do not wait on each other. They
+// share the scene attachments.
+struct OffscreenTarget {
+	VkExtent2D extent{};
+	std::vector<Image> images;
+	std::vector<VkImageView> views;
+	std::vector<VkFramebuffer> framebuffers;
+	SceneAttachments attachments;
+};
+
+// Framebuffers are only made when render_pass is set. depth_usage is the
+// one of create_scene_attachments.
+auto create_offscreen_target(
+		VkDevice& device,
+		Allocator& allocator,
+		VkFormat format,
+		VkFormat depth_format,
+		VkExtent2D extent,
+		VkSampleCountFlagBits samples,
+		VkImageUsageFlags depth_usage,
+		size_t count,
+		VkRenderPass render_pass) -> OffscreenTarget;
+// The device must be idle.
+void destroy_offscreen_target(
+		VkDevice& device,
+		Allocator& allocator,
+		OffscreenTarget& target);
@@ -0,0 +1,363 @@
+#include "overlay.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+// Layout matches Cell in overlay.vert.
+struct OverlayCell {
+	// Top left corner in pixels, x in the low half.
+	uint32_t position{};
+	// The glyph's character less the first one in the low byte, pixels per
+	// font pixel above it.
+	uint32_t glyph{};
+	uint32_t color{};
+	uint32_t background{};
+};
+static_assert(sizeof(OverlayCell) == 16);
+
+// Layout matches the push_constant blocks of overlay.vert and overlay.frag.
+struct OverlayConstants {
+	BindlessHandle cells{};
+	BindlessHandle font{};
+	std::array<float, 2> extent{};
+};
+
+constexpr auto g_first_character = ' ';
+constexpr auto g_glyph_count = size_t{64};
+constexpr auto g_glyph_width = size_t{5};
+constexpr auto g_glyph_height = size_t{7};
+constexpr auto g_words_per_glyph = size_t{2};
+
+// Rows from the top, separated by spaces, with # for the pixels drawn.
+struct GlyphArt {
+	char character{};
+	std::string_view rows;
+};
+
+constexpr auto g_font = std::array<GlyphArt, g_glyph_count>{{
+		{' ', "..... ..... ..... ..... ..... ..... ....."},
+		{'!', "..#.. ..#.. ..#.. ..#.. ..#.. ..... ..#.."},
+		{'"', ".#.#. .#.#. .#.#. ..... ..... ..... ....."},
+		{'#', ".#.#. .#.#. ##### .#.#. ##### .#.#. .#.#."},
+		{'$', "..#.. .#### #.#.. .###. ..#.# ####. ..#.."},
+		{'%', "##... ##..# ...#. ..#.. .#... #..## ...##"},
+		{'&', ".##.. #..#. #.#.. .#... #.#.# #..#. .##.#"},
+		{'\'', "..#.. ..#.. .#... ..... ..... ..... ....."},
+		{'(', "...#. ..#.. .#... .#... .#... ..#.. ...#."},
+		{')', ".#... ..#.. ...#. ...#. ...#. ..#.. .#..."},
+		{'*', "..... ..#.. #.#.# .###. #.#.# ..#.. ....."},
+		{'+', "..... ..#.. ..#.. ##### ..#.. ..#.. ....."},
+		{',', "..... ..... ..... ..... .##.. ..#.. .#..."},
+		{'-', "..... ..... ..... ##### ..... ..... ....."},
+		{'.', "..... ..... ..... ..... ..... .##.. .##.."},
+		{'/', "..... ....# ...#. ..#.. .#... #.... ....."},
+		{'0', ".###. #...# #..## #.#.# ##..# #...# .###."},
+		{'1', "..#.. .##.. ..#.. ..#.. ..#.. ..#.. .###."},
+		{'2', ".###. #...# ....# ...#. ..#.. .#... #####"},
+		{'3', "##### ...#. ..#.. ...#. ....# #...# .###."},
+		{'4', "...#. ..##. .#.#. #..#. ##### ...#. ...#."},
+		{'5', "##### #.... ####. ....# ....# #...# .###."},
+		{'6', "..##. .#... #.... ####. #...# #...# .###."},
+		{'7', "##### ....# ...#. ..#.. .#... .#... .#..."},
+		{'8', ".###. #...# #...# .###. #...# #...# .###."},
+		{'9', ".###. #...# #...# .#### ....# ...#. .##.."},
+		{':', "..... .##.. .##.. ..... .##.. .##.. ....."},
+		{';', "..... .##.. .##.. ..... .##.. ..#.. .#..."},
+		{'<', "...#. ..#.. .#... #.... .#... ..#.. ...#."},
+		{'=', "..... ..... ##### ..... ##### ..... ....."},
+		{'>', ".#... ..#.. ...#. ....# ...#. ..#.. .#..."},
+		{'?', ".###. #...# ....# ...#. ..#.. ..... ..#.."},
+		{'@', ".###. #...# ....# .##.# #.#.# #.#.# .###."},
+		{'A', ".###. #...# #...# ##### #...# #...# #...#"},
+		{'B', "####. #...# #...# ####. #...# #...# ####."},
+		{'C', ".###. #...# #.... #.... #.... #...# .###."},
+		{'D', "###.. #..#. #...# #...# #...# #..#. ###.."},
+		{'E', "##### #.... #.... ####. #.... #.... #####"},
+		{'F', "##### #.... #.... ####. #.... #.... #...."},
+		{'G', ".###. #...# #.... #.### #...# #...# .####"},
+		{'H', "#...# #...# #...# ##### #...# #...# #...#"},
+		{'I', ".###. ..#.. ..#.. ..#.. ..#.. ..#.. .###."},
+		{'J', "..### ...#. ...#. ...#. ...#. #..#. .##.."},
+		{'K', "#...# #..#. #.#.. ##... #.#.. #..#. #...#"},
+		{'L', "#.... #.... #.... #.... #.... #.... #####"},
+		{'M', "#...# ##.## #.#.# #.#.# #...# #...# #...#"},
+		{'N', "#...# #...# ##..# #.#.# #..## #...# #...#"},
+		{'O', ".###. #...# #...# #...# #...# #...# .###."},
+		{'P', "####. #...# #...# ####. #.... #.... #...."},
+		{'Q', ".###. #...# #...# #...# #.#.# #..#. .##.#"},
+		{'R', "####. #...# #...# ####. #.#.. #..#. #...#"},
+		{'S', ".#### #.... #.... .###. ....# ....# ####."},
+		{'T', "##### ..#.. ..#.. ..#.. ..#.. ..#.. ..#.."},
+		{'U', "#...# #...# #...# #...# #...# #...# .###."},
+		{'V', "#...# #...# #...# #...# #...# .#.#. ..#.."},
+		{'W', "#...# #...# #...# #.#.# #.#.# #.#.# .#.#."},
+		{'X', "#...# #...# .#.#. ..#.. .#.#. #...# #...#"},
+		{'Y', "#...# #...# .#.#. ..#.. ..#.. ..#.. ..#.."},
+		{'Z', "##### ....# ...#. ..#.. .#... #.... #####"},
+		{'[', ".###. .#... .#... .#... .#... .#... .###."},
+		{'\\', "..... #.... .#... ..#.. ...#. ....# ....."},
+		{']', ".###. ...#. ...#. ...#. ...#. ...#. .###."},
+		{'^', "..#.. .#.#. #...# ..... ..... ..... ....."},
+		{'_', "..... ..... ..... ..... ..... ..... #####"},
+}};
+
+// Bit y * 5 + x of a glyph's words is set for pixel x, y, as overlay.frag
+// reads them.
+auto pack_font() -> std::array<uint32_t, g_glyph_count * g_words_per_glyph> {
+	auto words = std::array<uint32_t, g_glyph_count * g_words_per_glyph>{};
+	for (const auto& art : g_font) {
+		auto glyph = static_cast<size_t>(art.character - g_first_character);
+		for (auto y = size_t{}; y < g_glyph_height; y++) {
+			for (auto x = size_t{}; x < g_glyph_width; x++) {
+				if (art.rows.at(y * (g_glyph_width + 1) + x) != '#') {
+					continue;
+				}
+				auto bit = y * g_glyph_width + x;
+				words.at(glyph * g_words_per_glyph + bit / 32) |= 1U << (bit % 32);
+			}
+		}
+	}
+	return words;
+}
+
+auto glyph_index(char character) -> uint32_t {
+	if (character >= 'a' && character <= 'z') {
+		character = static_cast<char>(character - 'a' + 'A');
+	}
+	auto index = character - g_first_character;
+	if (index < 0 || static_cast<size_t>(index) >= g_glyph_count) {
+		index = '?' - g_first_character;
+	}
+	return static_cast<uint32_t>(index);
+}
+
+// Formats a line in place, so a frame's text allocates nothing. Longer lines
+// are cut short.
+template <typename... Args>
+void write_line(
+		OverlayRenderer& overlay,
+		size_t frame_idx,
+		uint32_t row,
+		uint32_t scale,
+		uint32_t color,
+		fmt::format_string<Args...> format,
+		const Args&... args) {
+	auto line = std::array<char, 64>{};
+	auto result = fmt::vformat_to_n(
+			line.data(),
+			line.size(),
+			format,
+			fmt::make_format_args(args...));
+	write_overlay_text(
+			overlay,
+			frame_idx,
+			0,
+			row,
+			scale,
+			std::string_view(line.data(), std::min(result.size, line.size())),
+			color);
+}
+
+}  // namespace
+
+auto create_overlay_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		size_t frame_count) -> OverlayRenderer {
+	auto overlay = OverlayRenderer{};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			.offset = 0,
+			.size = sizeof(OverlayConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&overlay.draw_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create overlay pipeline layout\n");
+		std::terminate();
+	}
+
+	// Half a kilobyte written once, not worth a staging copy.
+	auto font = pack_font();
+	overlay.font = create_dynamic_buffer(
+			device,
+			allocator,
+			sizeof(font),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	std::memcpy(overlay.font.allocation.mapped, font.data(), sizeof(font));
+	overlay.font_handle = add_bindless_buffer(
+			device,
+			bindless,
+			overlay.font.handle,
+			0,
+			sizeof(font));
+
+	auto cells_size = VkDeviceSize{g_overlay_capacity} * sizeof(OverlayCell);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = overlay.frames.emplace_back();
+		frame.cells = create_dynamic_buffer(
+				device,
+				allocator,
+				cells_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.cells_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.cells.handle,
+				0,
+				cells_size);
+	}
+	return overlay;
+}
+
+void destroy_overlay_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		OverlayRenderer& overlay) {
+	for (auto& frame : overlay.frames) {
+		remove_bindless_buffer(device, bindless, frame.cells_handle);
+		destroy_buffer(device, allocator, frame.cells);
+	}
+	remove_bindless_buffer(device, bindless, overlay.font_handle);
+	destroy_buffer(device, allocator, overlay.font);
+	vkDestroyPipelineLayout(device, overlay.draw_layout, host_callbacks());
+	overlay = OverlayRenderer{};
+}
+
+void begin_overlay_frame(OverlayRenderer& overlay, size_t frame_idx) {
+	overlay.frames.at(frame_idx).count = 0;
+}
+
+void write_overlay_text(
+		OverlayRenderer& overlay,
+		size_t frame_idx,
+		uint32_t column,
+		uint32_t row,
+		uint32_t scale,
+		std::string_view text,
+		uint32_t color) {
+	auto& frame = overlay.frames.at(frame_idx);
+	auto y = row * g_overlay_cell_height * scale;
+	for (auto i = size_t{}; i < text.size(); i++) {
+		if (frame.count == g_overlay_capacity) {
+			return;
+		}
+		auto x = (column + static_cast<uint32_t>(i)) * g_overlay_cell_width * scale;
+		auto cell = OverlayCell{
+				.position = (x & 0xffffU) | (y << 16),
+				.glyph = glyph_index(text[i]) | (scale << 8),
+				.color = color,
+				.background = g_overlay_background};
+		std::memcpy(
+				frame.cells.allocation.mapped + size_t{frame.count} * sizeof(cell),
+				&cell,
+				sizeof(cell));
+		frame.count++;
+	}
+}
+
+void write_frame_stats(
+		OverlayRenderer& overlay,
+		size_t frame_idx,
+		uint32_t scale,
+		double frame_milliseconds,
+		double record_milliseconds,
+		const GpuProfiler& profiler,
+		const MemoryBudget& budget) {
+	auto row = uint32_t{};
+	write_line(
+			overlay,
+			frame_idx,
+			row++,
+			scale,
+			g_overlay_text_color,
+			"frame {:7.2f} ms  cpu {:6.2f} ms",
+			frame_milliseconds,
+			record_milliseconds);
+	for (const auto& stats : profiler.passes) {
+		auto milliseconds = latest_gpu_pass_time(profiler, stats.name);
+		if (milliseconds.has_value()) {
+			write_line(
+					overlay,
+					frame_idx,
+					row++,
+					scale,
+					g_overlay_text_color,
+					"{:<16.16}{:7.2f} ms",
+					stats.name,
+					*milliseconds);
+		}
+	}
+	constexpr auto mib = VkDeviceSize{1024 * 1024};
+	for (auto heap = uint32_t{}; heap < budget.heap_count; heap++) {
+		const auto& heap_budget = budget.heaps.at(heap);
+		write_line(
+				overlay,
+				frame_idx,
+				row++,
+				scale,
+				memory_pressure(budget, heap, 0) == MemoryPressure::low
+						? g_overlay_text_color
+						: g_overlay_warning_color,
+				"heap {:<3}{:>7} / {:>7} mb",
+				heap,
+				heap_budget.usage / mib,
+				heap_budget.budget / mib);
+	}
+}
+
+void draw_overlay(
+		VkCommandBuffer command_buffer,
+		const OverlayRenderer& overlay,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		VkExtent2D extent) {
+	const auto& frame = overlay.frames.at(frame_idx);
+	if (frame.count == 0) {
+		return;
+	}
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			overlay.draw_layout,
+			bindless);
+	auto constants = OverlayConstants{
+			.cells = frame.cells_handle,
+			.font = overlay.font_handle,
+			.extent =
+					{static_cast<float>(extent.width),
+					 static_cast<float>(extent.height)}};
+	vkCmdPushConstants(
+			command_buffer,
+			overlay.draw_layout,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+	vkCmdDraw(
+			command_buffer,
+			frame.count * g_overlay_vertices_per_cell,
+			1,
+			0,
+			0);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "memory_budget.hpp"
+#include "pipeline.hpp"
+#include "profiler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Cells are expanded into quads of two triangles each.
+constexpr auto g_overlay_raster = RasterState{
+		.cull_mode = VK_CULL_MODE_NONE,
+		.front_face = VK_FRONT_FACE_CLOCKWISE,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+constexpr auto g_overlay_vertices_per_cell = 6U;
+// A cell is a 5x7 glyph with a pixel of spacing right of it and above and
+// below it, in font pixels. Matches g_cell in overlay.vert.
+constexpr auto g_overlay_cell_width = 6U;
+constexpr auto g_overlay_cell_height = 9U;
+// Cells a frame can hold, the rest of the text is dropped.
+constexpr auto g_overlay_capacity = 4096U;
+
+// Colors are premultiplied by their alpha when blended, red in the low byte.
+constexpr auto g_overlay_text_color = 0xffffffffU;
+constexpr auto g_overlay_warning_color = 0xff40c0ffU;
+constexpr auto g_overlay_background = 0xb0000000U;
+
+// Host visible, written after the frame's fence was waited on.
+struct OverlayFrame {
+	Buffer cells;
+	BindlessHandle cells_handle{};
+	uint32_t count{};
+};
+
+// Text over the scene without a UI library: every character written in a
+// frame becomes a cell in that frame's buffer, and overlay.vert pulls them by
+// gl_VertexIndex into quads that overlay.frag fills from a 1-bit font held in
+// a storage buffer, glyph or background. A frame's text is one draw, however
+// long it is, and costs no more than the bytes written for it.
+struct OverlayRenderer {
+	// For the pipeline of overlay.vert and overlay.frag.
+	VkPipelineLayout draw_layout{};
+	// Two words of glyph bits per printable ASCII character from space to
+	// underscore.
+	Buffer font;
+	BindlessHandle font_handle{};
+	std::vector<OverlayFrame> frames;
+};
+
+auto create_overlay_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		size_t frame_count) -> OverlayRenderer;
+// The device must be idle.
+void destroy_overlay_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		OverlayRenderer& overlay);
+
+// Drops the text of the frame that last used the slot, after its fence was
+// waited on.
+void begin_overlay_frame(OverlayRenderer& overlay, size_t frame_idx);
+// Writes text with its top left corner at column and row, counted in cells of
+// scale pixels per font pixel, on the background. Lowercase letters are drawn
+// as uppercase and characters the font lacks as question marks.
+void write_overlay_text(
+		OverlayRenderer& overlay,
+		size_t frame_idx,
+		uint32_t column,
+		uint32_t row,
+		uint32_t scale,
+		std::string_view text,
+		uint32_t color);
+
+// frame_milliseconds is the time since the previous frame began recording
+// and record_milliseconds how long the CPU took to record it. Every pass the
+// profiler timed is listed with its latest time, then the heaps with their
+// budgets, in cells of scale pixels from the top left corner.
+void write_frame_stats(
+		OverlayRenderer& overlay,
+		size_t frame_idx,
+		uint32_t scale,
+		double frame_milliseconds,
+		double record_milliseconds,
+		const GpuProfiler& profiler,
+		const MemoryBudget& budget);
+
+// Draws the frame's text over what the main pass drew. The bound pipeline
+// must be one of overlay.vert and overlay.frag with draw_layout, blending
+// premultiplied without a depth test, and the viewport set. extent is the
+// render area's, which the cells are placed in.
+void draw_overlay(
+		VkCommandBuffer command_buffer,
+		const OverlayRenderer& overlay,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		VkExtent2D extent);
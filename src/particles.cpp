@@ -0,0 +1,538 @@
+#include "particles.hpp"
+
+#include "host_memory.hpp"
+#include "specialization.hpp"
+#include "sync.hpp"
+
+#include <glm/vec2.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <span>
+
+namespace {
+
+// Layout matches the push_constant block in particles.comp.
+struct ParticleHandles {
+	glm::mat4 transform{1.0F};
+	BindlessHandle particles{};
+	BindlessHandle dead{};
+	BindlessHandle source{};
+	BindlessHandle target{};
+	BindlessHandle counters{};
+	BindlessHandle draws{};
+	BindlessHandle keys{};
+	BindlessHandle command{};
+	uint32_t source_slot{};
+	uint32_t capacity{};
+	uint32_t emit_count{};
+	uint32_t seed{};
+	float delta{};
+};
+// Within the push constant size every device has.
+static_assert(sizeof(ParticleHandles) <= 128);
+// The compaction takes the alive counts as slots 1 and 2 of the counters.
+static_assert(offsetof(ParticleCounters, alive_counts) == sizeof(uint32_t));
+
+// Layout matches the push_constant block in particle.vert.
+struct ParticleDrawHandles {
+	BindlessHandle uniform_buffer{};
+	uint32_t transform{};
+	BindlessHandle draws{};
+	BindlessHandle keys{};
+	glm::vec2 size{};
+};
+
+// Half a quad's height, in normalized device coordinates.
+constexpr auto g_particle_size = 0.006F;
+// Updates further apart, like after a stall, are simulated as this long so
+// particles do not jump.
+constexpr auto g_max_particle_delta = 0.1F;
+
+auto create_particle_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		const std::array<uint32_t, 2>& queue_families,
+		BindlessHandle& handle) -> Buffer {
+	auto buffer = create_shared_buffer(
+			device,
+			allocator,
+			size,
+			usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0,
+			queue_families);
+	handle = add_bindless_buffer(device, bindless, buffer.handle, 0, size);
+	return buffer;
+}
+
+auto create_layout(
+		VkDevice& device,
+		const BindlessTable& bindless,
+		VkShaderStageFlags stages,
+		uint32_t push_constant_size) -> VkPipelineLayout {
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = stages,
+			.offset = 0,
+			.size = push_constant_size};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	auto* layout = VkPipelineLayout{};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create particle pipeline layout\n");
+		std::terminate();
+	}
+	return layout;
+}
+
+// Specialized to the bindless capacities, the stage and whether survivors
+// are compacted.
+auto create_particle_pipeline(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		const BindlessTable& bindless,
+		VkPipelineLayout& layout,
+		VkShaderModule& module,
+		uint32_t stage,
+		bool compacted) -> VkPipeline {
+	auto constants = make_specialization_constants(
+			bindless.images.capacity,
+			bindless.buffers.capacity,
+			bindless.samplers.capacity,
+			stage,
+			VkBool32{compacted ? VK_TRUE : VK_FALSE});
+	auto specialization = specialization_info(constants);
+	return create_compute_pipeline(
+			device,
+			pipeline_cache,
+			layout,
+			module,
+			&specialization,
+			0);
+}
+
+auto buffer_barrier(const Buffer& buffer) -> VkBufferMemoryBarrier2 {
+	return {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+// Orders the dispatches touching buffers, reads and writes alike.
+void compute_barrier(
+		const ParticleSystem& system,
+		VkCommandBuffer command_buffer,
+		std::span<const Buffer* const> buffers) {
+	auto barriers = std::array<VkBufferMemoryBarrier2, 8>{};
+	auto count = std::min(buffers.size(), barriers.size());
+	for (auto i = size_t{}; i < count; i++) {
+		barriers.at(i) = buffer_barrier(*buffers[i]);
+	}
+	pipeline_barrier(
+			system.synchronization2,
+			command_buffer,
+			{barriers.data(), count},
+			{});
+}
+
+void dispatch_stage(
+		const ParticleSystem& system,
+		VkCommandBuffer command_buffer,
+		ParticleStage stage,
+		const ParticleHandles& handles,
+		uint32_t group_count) {
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			system.pipelines.at(static_cast<size_t>(stage)));
+	vkCmdPushConstants(
+			command_buffer,
+			system.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	if (stage == ParticleStage::simulate) {
+		vkCmdDispatchIndirect(
+				command_buffer,
+				system.counters.handle,
+				offsetof(ParticleCounters, simulate_groups));
+	} else {
+		vkCmdDispatch(command_buffer, group_count, 1, 1);
+	}
+}
+
+}  // namespace
+
+auto create_particle_system(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& simulate_module,
+		VkShaderModule& sort_module,
+		VkShaderModule& scan_module,
+		std::optional<uint32_t> subgroup_size,
+		uint32_t max_group_size,
+		bool sorted,
+		const std::array<uint32_t, 2>& queue_families,
+		size_t frame_count,
+		uint32_t capacity,
+		bool synchronization2) -> ParticleSystem {
+	auto system = ParticleSystem{};
+	system.synchronization2 = synchronization2;
+	system.capacity = capacity;
+	system.sorted = sorted;
+	system.compacted = subgroup_size.has_value();
+	system.last_update = std::chrono::steady_clock::now();
+
+	system.pipeline_layout = create_layout(
+			device,
+			bindless,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			sizeof(ParticleHandles));
+	for (auto i = 0U; i < g_particle_stage_count; i++) {
+		system.pipelines.at(i) = create_particle_pipeline(
+				device,
+				pipeline_cache,
+				bindless,
+				system.pipeline_layout,
+				simulate_module,
+				i,
+				system.compacted);
+	}
+	if (system.sorted) {
+		system.sort = create_radix_sort(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				sort_module,
+				capacity,
+				synchronization2);
+	}
+	if (system.compacted) {
+		system.scan = create_prefix_scan(
+				device,
+				allocator,
+				bindless,
+				pipeline_cache,
+				scan_module,
+				*subgroup_size,
+				max_group_size,
+				capacity,
+				synchronization2);
+	}
+	system.draw_layout = create_layout(
+			device,
+			bindless,
+			VK_SHADER_STAGE_VERTEX_BIT,
+			sizeof(ParticleDrawHandles));
+
+	// Only the compute queue uses the pool and the lists.
+	auto compute_family =
+			std::array{queue_families.at(1), queue_families.at(1)};
+	system.particles = create_particle_buffer(
+			device,
+			allocator,
+			bindless,
+			VkDeviceSize{32} * capacity,
+			0,
+			compute_family,
+			system.particles_handle);
+	system.dead = create_particle_buffer(
+			device,
+			allocator,
+			bindless,
+			sizeof(uint32_t) * capacity,
+			0,
+			compute_family,
+			system.dead_handle);
+	for (auto i = size_t{}; i < system.alive.size(); i++) {
+		system.alive.at(i) = create_particle_buffer(
+				device,
+				allocator,
+				bindless,
+				sizeof(uint32_t) * capacity,
+				0,
+				compute_family,
+				system.alive_handles.at(i));
+	}
+	system.counters = create_particle_buffer(
+			device,
+			allocator,
+			bindless,
+			sizeof(ParticleCounters),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			compute_family,
+			system.counters_handle);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = system.frames.emplace_back();
+		frame.draws = create_particle_buffer(
+				device,
+				allocator,
+				bindless,
+				VkDeviceSize{16} * capacity,
+				0,
+				queue_families,
+				frame.draws_handle);
+		frame.keys = create_particle_buffer(
+				device,
+				allocator,
+				bindless,
+				VkDeviceSize{8} * capacity,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				queue_families,
+				frame.keys_handle);
+		frame.command = create_particle_buffer(
+				device,
+				allocator,
+				bindless,
+				sizeof(VkDrawIndirectCommand),
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				queue_families,
+				frame.command_handle);
+	}
+	return system;
+}
+
+void destroy_particle_system(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ParticleSystem& system) {
+	for (auto& frame : system.frames) {
+		remove_bindless_buffer(device, bindless, frame.draws_handle);
+		remove_bindless_buffer(device, bindless, frame.keys_handle);
+		remove_bindless_buffer(device, bindless, frame.command_handle);
+		destroy_buffer(device, allocator, frame.draws);
+		destroy_buffer(device, allocator, frame.keys);
+		destroy_buffer(device, allocator, frame.command);
+	}
+	remove_bindless_buffer(device, bindless, system.particles_handle);
+	remove_bindless_buffer(device, bindless, system.dead_handle);
+	for (auto i = size_t{}; i < system.alive.size(); i++) {
+		remove_bindless_buffer(device, bindless, system.alive_handles.at(i));
+		destroy_buffer(device, allocator, system.alive.at(i));
+	}
+	remove_bindless_buffer(device, bindless, system.counters_handle);
+	destroy_buffer(device, allocator, system.particles);
+	destroy_buffer(device, allocator, system.dead);
+	destroy_buffer(device, allocator, system.counters);
+	if (system.sorted) {
+		destroy_radix_sort(device, allocator, bindless, system.sort);
+	}
+	if (system.compacted) {
+		destroy_prefix_scan(device, allocator, bindless, system.scan);
+	}
+	for (auto* pipeline : system.pipelines) {
+		vkDestroyPipeline(device, pipeline, host_callbacks());
+	}
+	vkDestroyPipelineLayout(device, system.pipeline_layout, host_callbacks());
+	vkDestroyPipelineLayout(device, system.draw_layout, host_callbacks());
+	system = ParticleSystem{};
+}
+
+void record_particle_update(
+		ParticleSystem& system,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx) {
+	const auto& frame = system.frames.at(frame_idx);
+	auto now = std::chrono::steady_clock::now();
+	auto delta = std::min(
+			std::chrono::duration<float>(now - system.last_update).count(),
+			g_max_particle_delta);
+	system.last_update = now;
+	auto rate = static_cast<float>(system.capacity) * 2.0F /
+			(g_particle_min_lifetime + g_particle_max_lifetime);
+	auto emit = rate * delta + system.emit_carry;
+	auto emit_count = std::min(
+			static_cast<uint32_t>(emit),
+			system.capacity);
+	system.emit_carry = emit - std::floor(emit);
+
+	auto handles = ParticleHandles{
+			.transform = system.transform,
+			.particles = system.particles_handle,
+			.dead = system.dead_handle,
+			.source = system.alive_handles.at(system.source),
+			.target = system.alive_handles.at(1 - system.source),
+			.counters = system.counters_handle,
+			.draws = frame.draws_handle,
+			.keys = frame.keys_handle,
+			.command = frame.command_handle,
+			.source_slot = system.source,
+			.capacity = system.capacity,
+			.emit_count = emit_count,
+			.seed = system.seed,
+			.delta = delta};
+	system.seed += emit_count;
+	auto state = std::array<const Buffer*, 8>{
+			&system.particles,
+			&system.dead,
+			&system.alive.at(0),
+			&system.alive.at(1),
+			&system.counters,
+			&frame.draws,
+			&frame.keys,
+			&frame.command};
+	auto particle_groups = (system.capacity + g_particle_group_size - 1) /
+			g_particle_group_size;
+	auto emit_groups =
+			(emit_count + g_particle_group_size - 1) / g_particle_group_size;
+
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			system.pipeline_layout,
+			bindless);
+	if (!system.reset) {
+		dispatch_stage(
+				system,
+				command_buffer,
+				ParticleStage::reset,
+				handles,
+				particle_groups);
+		system.reset = true;
+	}
+	// Keys past the draws sort last. The frame fence covers the last draw
+	// from these buffers, and the barrier the last update's dispatches, which
+	// ran before on this queue. Unsorted, only the draws' keys are read.
+	if (system.sorted) {
+		vkCmdFillBuffer(command_buffer, frame.keys.handle, 0, VK_WHOLE_SIZE, ~0U);
+	}
+	auto fill_barrier = VkBufferMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = frame.keys.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+	auto state_barriers = std::array<VkBufferMemoryBarrier2, 6>{};
+	for (auto i = size_t{}; i < 5; i++) {
+		state_barriers.at(i) = buffer_barrier(*state.at(i));
+	}
+	// The simulation's dispatch size was written by the last update.
+	state_barriers.at(4).dstStageMask |= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	state_barriers.at(4).dstAccessMask |= VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+	state_barriers.at(5) = fill_barrier;
+	pipeline_barrier(
+			system.synchronization2,
+			command_buffer,
+			std::span(state_barriers).first(system.sorted ? 6 : 5),
+			{});
+
+	dispatch_stage(system, command_buffer, ParticleStage::simulate, handles, 0);
+	compute_barrier(system, command_buffer, state);
+	if (system.compacted) {
+		// The simulation dropped the dead from the source list. The alive
+		// counts are slots 1 and 2 of the counters.
+		record_compaction(
+				system.scan,
+				bindless,
+				command_buffer,
+				handles.source,
+				handles.target,
+				ScanCounts{
+						.list = system.counters_handle,
+						.count_slot = 1 + system.source,
+						.result_slot = 2 - system.source});
+		compute_barrier(system, command_buffer, state);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				system.pipeline_layout,
+				bindless);
+	}
+	dispatch_stage(
+			system,
+			command_buffer,
+			ParticleStage::emit,
+			handles,
+			emit_groups);
+	compute_barrier(system, command_buffer, state);
+	dispatch_stage(system, command_buffer, ParticleStage::finish, handles, 1);
+	compute_barrier(system, command_buffer, state);
+	if (system.sorted) {
+		record_radix_sort(
+				system.sort,
+				bindless,
+				command_buffer,
+				frame.keys,
+				frame.keys_handle,
+				system.capacity,
+				system.compacted ? &system.scan : nullptr);
+	}
+	system.source = 1 - system.source;
+}
+
+void draw_particles(
+		VkCommandBuffer command_buffer,
+		const ParticleSystem& system,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		VkExtent2D extent) {
+	const auto& frame = system.frames.at(frame_idx);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			system.draw_layout,
+			bindless);
+	auto handles = ParticleDrawHandles{
+			.uniform_buffer = uniform_buffer,
+			.transform = transform,
+			.draws = frame.draws_handle,
+			.keys = frame.keys_handle,
+			.size = glm::vec2(
+					g_particle_size * static_cast<float>(extent.height) /
+							static_cast<float>(std::max(extent.width, 1U)),
+					g_particle_size)};
+	vkCmdPushConstants(
+			command_buffer,
+			system.draw_layout,
+			VK_SHADER_STAGE_VERTEX_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	vkCmdDrawIndirect(
+			command_buffer,
+			frame.command.handle,
+			0,
+			1,
+			sizeof(VkDrawIndirectCommand));
+}
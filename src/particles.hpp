@@ -0,0 +1,164 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "pipeline.hpp"
+#include "radix_sort.hpp"
+#include "scan.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Matches local_size_x in particles.comp.
+constexpr auto g_particle_group_size = 64U;
+// The lifetimes particles.comp gives new particles, in seconds. Emission
+// keeps the pool full at their average.
+constexpr auto g_particle_min_lifetime = 2.0F;
+constexpr auto g_particle_max_lifetime = 4.0F;
+// A cap on the pool.
+constexpr auto g_max_particles = size_t{1} << 24U;
+// Quads are drawn as triangle strips facing either way.
+constexpr auto g_particle_raster = RasterState{
+		.cull_mode = VK_CULL_MODE_NONE,
+		.front_face = VK_FRONT_FACE_CLOCKWISE,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP};
+
+// The specialization of particles.comp, one pipeline each.
+enum class ParticleStage : uint32_t {
+	reset,
+	simulate,
+	emit,
+	finish,
+};
+constexpr auto g_particle_stage_count = 4U;
+
+// Layout matches the CounterList block in particles.comp. simulate_groups
+// dispatches the next frame's simulation over the alive list written last.
+struct ParticleCounters {
+	int32_t dead_count{};
+	std::array<uint32_t, 2> alive_counts{};
+	uint32_t draw_count{};
+	VkDispatchIndirectCommand simulate_groups{};
+	uint32_t padding{};
+};
+static_assert(sizeof(ParticleCounters) == 32);
+
+// What the graphics queue reads, one set for every frame in flight: the
+// particles in view, their keys sorted back to front and the indirect draw
+// of them.
+struct ParticleFrame {
+	Buffer draws;
+	Buffer keys;
+	Buffer command;
+	BindlessHandle draws_handle{};
+	BindlessHandle keys_handle{};
+	BindlessHandle command_handle{};
+};
+
+// Particles simulated entirely on the GPU, as a compute job on the async
+// compute queue. Every frame the alive particles age and move, the dead ones
+// go back to the dead list and the survivors move to the other alive list,
+// then new ones are taken off the dead list and appended to it. Survivors are
+// compacted in order with a prefix scan where subgroup arithmetic allows, and
+// appended with atomics elsewhere. The ones in view are written to the
+// frame's draws and sorted by depth, and one indirect instanced draw of quads
+// blends them over the scene in the main pass. Unsorted, they are drawn in
+// the order they were appended, for order independent transparency.
+//
+// The pool and the lists are only used by the compute queue, whose frames
+// run in order. The frame buffers are shared with the graphics queue, which
+// waits on the job before drawing.
+struct ParticleSystem {
+	bool synchronization2{};
+	uint32_t capacity{};
+	VkPipelineLayout pipeline_layout{};
+	std::array<VkPipeline, g_particle_stage_count> pipelines{};
+	// Whether sort orders the frame's draws back to front.
+	bool sorted{};
+	// Of the frame's keys, all capacity of them. Keys past the frame's draws
+	// sort last.
+	RadixSort sort;
+	// Whether scan compacts the survivors, and scans the sort's digit counts.
+	bool compacted{};
+	PrefixScan scan;
+	// For the pipeline of particle.vert and particle.frag.
+	VkPipelineLayout draw_layout{};
+	Buffer particles;
+	Buffer dead;
+	std::array<Buffer, 2> alive;
+	Buffer counters;
+	BindlessHandle particles_handle{};
+	BindlessHandle dead_handle{};
+	std::array<BindlessHandle, 2> alive_handles{};
+	BindlessHandle counters_handle{};
+	std::vector<ParticleFrame> frames;
+	// The alive list simulated next, the other one receives the survivors.
+	uint32_t source{};
+	// Whether the lists were reset, which the first update does.
+	bool reset{};
+	// Particles owed to the emission rate that did not add up to a whole one.
+	float emit_carry{};
+	uint32_t seed{};
+	std::chrono::steady_clock::time_point last_update;
+	// Clip space of the particles, set by the caller. A frame's job is
+	// recorded before the frame's transform is known, so it culls and sorts
+	// with the one set last.
+	glm::mat4 transform{1.0F};
+};
+
+// The modules are particles.comp, radix_sort.comp, which is only used when
+// sorted, and scan.comp, which is only used with a subgroup_size from
+// scan_subgroup_size. max_group_size is the one create_prefix_scan takes.
+// The frame buffers are shared by the queue families. capacity must be at
+// least one.
+auto create_particle_system(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& simulate_module,
+		VkShaderModule& sort_module,
+		VkShaderModule& scan_module,
+		std::optional<uint32_t> subgroup_size,
+		uint32_t max_group_size,
+		bool sorted,
+		const std::array<uint32_t, 2>& queue_families,
+		size_t frame_count,
+		uint32_t capacity,
+		bool synchronization2) -> ParticleSystem;
+// The device must be idle.
+void destroy_particle_system(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ParticleSystem& system);
+
+// Records the frame's update, as the record of a ComputeJob: emission for
+// the time since the last update, simulation, and the sort if sorted. The
+// frame's draw reads its results from DRAW_INDIRECT and VERTEX_SHADER on.
+void record_particle_update(
+		ParticleSystem& system,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx);
+
+// Draws the frame's particles inside the main pass, or the transparency pass
+// of src/transparency.hpp. The bound pipeline must
+// be one of particle.vert and particle.frag with draw_layout, and the
+// viewport set. transform is the ring slot of the frame's DrawUniforms.
+// extent is the render area's, which keeps the quads square.
+void draw_particles(
+		VkCommandBuffer command_buffer,
+		const ParticleSystem& system,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		VkExtent2D extent);
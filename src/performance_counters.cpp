@@ -0,0 +1,189 @@
+#include "performance_counters.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+struct CounterList {
+	std::vector<VkPerformanceCounterKHR> counters;
+	std::vector<VkPerformanceCounterDescriptionKHR> descriptions;
+};
+
+auto enumerate_counters(
+		VkPhysicalDevice physical_device,
+		uint32_t queue_family_idx) -> CounterList {
+	auto count = uint32_t{};
+	if (vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR(
+					physical_device,
+					queue_family_idx,
+					&count,
+					nullptr,
+					nullptr) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to enumerate performance counters\n");
+		std::terminate();
+	}
+	auto list = CounterList{};
+	auto counter = VkPerformanceCounterKHR{};
+	counter.sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_KHR;
+	list.counters.resize(count, counter);
+	auto description = VkPerformanceCounterDescriptionKHR{};
+	description.sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_DESCRIPTION_KHR;
+	list.descriptions.resize(count, description);
+	if (vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR(
+					physical_device,
+					queue_family_idx,
+					&count,
+					list.counters.data(),
+					list.descriptions.data()) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to enumerate performance counters\n");
+		std::terminate();
+	}
+	list.counters.resize(count);
+	list.descriptions.resize(count);
+	return list;
+}
+
+auto pass_count(
+		VkPhysicalDevice physical_device,
+		uint32_t queue_family_idx,
+		const std::vector<uint32_t>& indices) -> uint32_t {
+	auto pool_info = VkQueryPoolPerformanceCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.queueFamilyIndex = queue_family_idx,
+			.counterIndexCount = static_cast<uint32_t>(indices.size()),
+			.pCounterIndices = indices.data()};
+	auto passes = uint32_t{};
+	vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR(
+			physical_device,
+			&pool_info,
+			&passes);
+	return passes;
+}
+
+void print_counters(const CounterList& list) {
+	for (auto i = size_t{}; i < list.counters.size(); i++) {
+		const auto& description = list.descriptions.at(i);
+		fmt::print(
+				stderr,
+				"Performance counter {} ({}): {}\n",
+				description.name,
+				description.category,
+				description.description);
+	}
+}
+
+}  // namespace
+
+auto select_performance_counters(
+		VkPhysicalDevice physical_device,
+		uint32_t queue_family_idx,
+		std::string_view names) -> std::vector<PerformanceCounter> {
+	auto list = enumerate_counters(physical_device, queue_family_idx);
+	if (names == "list") {
+		print_counters(list);
+		return {};
+	}
+	auto selected = std::vector<PerformanceCounter>{};
+	auto indices = std::vector<uint32_t>{};
+	while (!names.empty()) {
+		auto end = std::min(names.find(','), names.size());
+		auto name = names.substr(0, end);
+		names.remove_prefix(std::min(end + 1, names.size()));
+		if (name.empty()) {
+			continue;
+		}
+		auto found = std::find_if(
+				list.descriptions.begin(),
+				list.descriptions.end(),
+				[&](const VkPerformanceCounterDescriptionKHR& description) {
+					return std::string_view(description.name) == name;
+				});
+		if (found == list.descriptions.end()) {
+			fmt::print(stderr, "Unknown performance counter {}\n", name);
+			continue;
+		}
+		auto index = static_cast<uint32_t>(found - list.descriptions.begin());
+		const auto& counter = list.counters.at(index);
+		// Those would have to begin their query first in every command buffer.
+		if (counter.scope == VK_PERFORMANCE_COUNTER_SCOPE_COMMAND_BUFFER_KHR) {
+			fmt::print(
+					stderr,
+					"Performance counter {} only counts whole command buffers, "
+					"skipping it\n",
+					name);
+			continue;
+		}
+		indices.emplace_back(index);
+		if (pass_count(physical_device, queue_family_idx, indices) > 1) {
+			fmt::print(
+					stderr,
+					"Performance counter {} needs another pass over the frame, "
+					"skipping it\n",
+					name);
+			indices.pop_back();
+			continue;
+		}
+		selected.emplace_back(PerformanceCounter{
+				.name = std::string(name),
+				.index = index,
+				.unit = counter.unit,
+				.storage = counter.storage});
+	}
+	return selected;
+}
+
+auto performance_counter_value(
+		const PerformanceCounter& counter,
+		const VkPerformanceCounterResultKHR& result) -> double {
+	// NOLINTBEGIN(cppcoreguidelines-pro-type-union-access)
+	switch (counter.storage) {
+		case VK_PERFORMANCE_COUNTER_STORAGE_INT32_KHR:
+			return static_cast<double>(result.int32);
+		case VK_PERFORMANCE_COUNTER_STORAGE_INT64_KHR:
+			return static_cast<double>(result.int64);
+		case VK_PERFORMANCE_COUNTER_STORAGE_UINT32_KHR:
+			return static_cast<double>(result.uint32);
+		case VK_PERFORMANCE_COUNTER_STORAGE_UINT64_KHR:
+			return static_cast<double>(result.uint64);
+		case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT32_KHR:
+			return static_cast<double>(result.float32);
+		case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT64_KHR:
+			return result.float64;
+		default:
+			return 0.0;
+	}
+	// NOLINTEND(cppcoreguidelines-pro-type-union-access)
+}
+
+auto performance_counter_unit(const PerformanceCounter& counter)
+		-> std::string_view {
+	switch (counter.unit) {
+		case VK_PERFORMANCE_COUNTER_UNIT_PERCENTAGE_KHR:
+			return "%";
+		case VK_PERFORMANCE_COUNTER_UNIT_NANOSECONDS_KHR:
+			return "ns";
+		case VK_PERFORMANCE_COUNTER_UNIT_BYTES_KHR:
+			return "bytes";
+		case VK_PERFORMANCE_COUNTER_UNIT_BYTES_PER_SECOND_KHR:
+			return "bytes/s";
+		case VK_PERFORMANCE_COUNTER_UNIT_KELVIN_KHR:
+			return "K";
+		case VK_PERFORMANCE_COUNTER_UNIT_WATTS_KHR:
+			return "W";
+		case VK_PERFORMANCE_COUNTER_UNIT_VOLTS_KHR:
+			return "V";
+		case VK_PERFORMANCE_COUNTER_UNIT_AMPS_KHR:
+			return "A";
+		case VK_PERFORMANCE_COUNTER_UNIT_HERTZ_KHR:
+			return "Hz";
+		case VK_PERFORMANCE_COUNTER_UNIT_CYCLES_KHR:
+			return "cycles";
+		default:
+			return "";
+	}
+}
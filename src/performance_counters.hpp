@@ -0,0 +1,36 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A vendor counter of a queue family, such as a cache hit rate, shader
+// occupancy or memory bandwidth, which performance queries read per pass.
+struct PerformanceCounter {
+	std::string name;
+	// Index among the counters of the queue family.
+	uint32_t index{};
+	VkPerformanceCounterUnitKHR unit{};
+	VkPerformanceCounterStorageKHR storage{};
+};
+
+// Looks up the counters named in a comma separated list among those of the
+// queue family, or prints all of them for "list" and returns none. Counters
+// that are unknown, only count whole command buffers, or would take more
+// than one pass over the commands are left out with a warning, since every
+// frame is submitted once. Needs the performance query capability.
+auto select_performance_counters(
+		VkPhysicalDevice physical_device,
+		uint32_t queue_family_idx,
+		std::string_view names) -> std::vector<PerformanceCounter>;
+
+auto performance_counter_value(
+		const PerformanceCounter& counter,
+		const VkPerformanceCounterResultKHR& result) -> double;
+
+// The unit's name as printed after a value, empty for plain counts.
+auto performance_counter_unit(const PerformanceCounter& counter)
+		-> std::string_view;
@@ -0,0 +1,150 @@
+#include "picking.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr auto g_pick_bytes =
+		VkDeviceSize{g_pick_size} * g_pick_size * sizeof(uint32_t);
+
+constexpr auto g_copy_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+constexpr auto g_copy_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+// Where the readback is left for the fence to make visible to the CPU.
+constexpr auto g_host_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_HOST_BIT,
+		.access = VK_ACCESS_2_HOST_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+}  // namespace
+
+auto create_picker(VkDevice& device, Allocator& allocator, size_t frame_count)
+		-> Picker {
+	auto picker = Picker{};
+	picker.frames.resize(frame_count);
+	for (auto& slot : picker.frames) {
+		slot.readback = create_buffer(
+				device,
+				allocator,
+				g_pick_bytes,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+	}
+	return picker;
+}
+
+void destroy_picker(VkDevice& device, Allocator& allocator, Picker& picker) {
+	for (auto& slot : picker.frames) {
+		destroy_buffer(device, allocator, slot.readback);
+	}
+	picker = Picker{};
+}
+
+void request_pick(Picker& picker, glm::uvec2 pixel, size_t frame) {
+	picker.request = pixel;
+	picker.request_frame = frame;
+}
+
+auto collect_pick(Picker& picker, size_t frame_idx, size_t frame)
+		-> std::optional<PickResult> {
+	auto& slot = picker.frames.at(frame_idx);
+	if (!slot.pixel.has_value()) {
+		return std::nullopt;
+	}
+	auto ids = std::array<uint32_t, size_t{g_pick_size} * g_pick_size>{};
+	std::memcpy(ids.data(), slot.readback.allocation.mapped, g_pick_bytes);
+	auto result = PickResult{
+			.pixel = *slot.pixel,
+			.id = 0,
+			.latency = frame - slot.requested_frame};
+	// The copy's rows are as long as the region is wide.
+	auto center = glm::ivec2(*slot.pixel - slot.origin);
+	auto nearest = std::numeric_limits<int32_t>::max();
+	for (auto y = 0U; y < slot.extent.y; y++) {
+		for (auto x = 0U; x < slot.extent.x; x++) {
+			auto id = ids.at(size_t{y} * slot.extent.x + x);
+			auto offset = glm::ivec2(x, y) - center;
+			auto distance = offset.x * offset.x + offset.y * offset.y;
+			if (id != 0 && distance < nearest) {
+				nearest = distance;
+				result.id = id;
+			}
+		}
+	}
+	slot.pixel.reset();
+	return result;
+}
+
+void add_pick_pass(
+		RenderGraph& graph,
+		Picker& picker,
+		size_t frame_idx,
+		uint32_t ids,
+		VkExtent2D extent) {
+	if (!picker.request.has_value() || extent.width == 0 ||
+			extent.height == 0) {
+		return;
+	}
+	auto& slot = picker.frames.at(frame_idx);
+	auto size = glm::uvec2(extent.width, extent.height);
+	auto pixel = glm::min(*picker.request, size - 1U);
+	auto half = glm::uvec2(g_pick_size / 2);
+	slot.origin = glm::max(pixel, half) - half;
+	slot.extent = glm::min(size - slot.origin, glm::uvec2(g_pick_size));
+	slot.pixel = pixel;
+	slot.requested_frame = picker.request_frame;
+	picker.request.reset();
+
+	auto readback = import_graph_buffer(
+			graph,
+			slot.readback.handle,
+			GraphState{},
+			g_host_read);
+	auto region = VkBufferImageCopy{
+			.bufferOffset = 0,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource =
+					VkImageSubresourceLayers{
+							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+							.mipLevel = 0,
+							.baseArrayLayer = 0,
+							.layerCount = 1},
+			.imageOffset =
+					VkOffset3D{
+							.x = static_cast<int32_t>(slot.origin.x),
+							.y = static_cast<int32_t>(slot.origin.y),
+							.z = 0},
+			.imageExtent = VkExtent3D{
+					.width = slot.extent.x,
+					.height = slot.extent.y,
+					.depth = 1}};
+	auto pass = add_graph_pass(
+			graph,
+			"pick",
+			[&graph, ids, buffer = slot.readback.handle, region](
+					VkCommandBuffer command_buffer) {
+				vkCmdCopyImageToBuffer(
+						command_buffer,
+						graph_image(graph, ids),
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						buffer,
+						1,
+						&region);
+			},
+			false);
+	graph_read(graph, pass, ids, g_copy_read);
+	graph_write(graph, pass, readback, g_copy_write);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "render_graph.hpp"
+
+#include <glm/vec2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Pixels squared around the picked one that are read back, so picking next
+// to a thin edge or a one pixel gap still finds what is there.
+constexpr auto g_pick_size = 5U;
+
+struct PickResult {
+	glm::uvec2 pixel{};
+	// The id nearest to the pixel in the region around it, 0 for nothing.
+	uint32_t id{};
+	// Frames between asking and the answer.
+	size_t latency{};
+};
+
+// A frame in flight's readback, with the pixel it copied, if any.
+struct PickSlot {
+	Buffer readback;
+	std::optional<glm::uvec2> pixel;
+	// Where the region starts in the image and how many of its pixels were
+	// inside it, which is less than g_pick_size near the edges.
+	glm::uvec2 origin{};
+	glm::uvec2 extent{};
+	size_t requested_frame{};
+};
+
+// Picking without stalls: the region around the pixel under the cursor is
+// copied out of an id image into the frame's slot of a host visible
+// readback ring, and only read once that frame's fence was waited on for
+// the next frame in the slot. Answers arrive as many frames late as there
+// are frames in flight, nothing ever waits for the GPU, and hovering costs
+// one small copy per frame however big the scene is.
+struct Picker {
+	std::vector<PickSlot> frames;
+	// The latest pixel asked for, copied by the next frame.
+	std::optional<glm::uvec2> request;
+	size_t request_frame{};
+};
+
+auto create_picker(VkDevice& device, Allocator& allocator, size_t frame_count)
+		-> Picker;
+// The device must be idle.
+void destroy_picker(VkDevice& device, Allocator& allocator, Picker& picker);
+
+// Replaces what was asked for and not yet copied. frame counts the frames
+// rendered, for PickResult::latency.
+void request_pick(Picker& picker, glm::uvec2 pixel, size_t frame);
+
+// What the frame slot copied when it was last used, once. Must be called
+// after the slot's fence was waited on and before add_pick_pass reuses it.
+auto collect_pick(Picker& picker, size_t frame_idx, size_t frame)
+		-> std::optional<PickResult>;
+
+// Adds the pass copying the region around the requested pixel of ids into
+// the frame's slot, nothing without a request. ids must be a single level
+// R32_UINT image with TRANSFER_SRC usage, of which the top left extent is
+// drawn.
+void add_pick_pass(
+		RenderGraph& graph,
+		Picker& picker,
+		size_t frame_idx,
+		uint32_t ids,
+		VkExtent2D extent);
@@ -0,0 +1,85 @@
+#include "pipeline.hpp"
+
+#include "host_memory.hpp"
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+
+auto create_shader_modules(VkDevice& device, std::span<const uint32_t> code)
+		-> VkShaderModule {
+	auto module_info = VkShaderModuleCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.codeSize = code.size_bytes(),
+			.pCode = code.data()};
+	auto* module = VkShaderModule{};
+	if (vkCreateShaderModule(device, &module_info, host_callbacks(), &module) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create shader module\n");
+		std::terminate();
+	}
+	return module;
+}
+
+auto create_pipeline_shader_info(
+		VkShaderModule& module,
+		VkShaderStageFlagBits stage,
+		const VkSpecializationInfo* specialization)
+		-> VkPipelineShaderStageCreateInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.stage = stage,
+			.module = module,
+			.pName = "main",
+			.pSpecializationInfo = specialization};
+}
+
+auto create_compute_pipeline(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		VkPipelineLayout& layout,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		VkPipelineCreateFlags flags) -> VkPipeline {
+	VKDEMO_ZONE("create_compute_pipeline");
+	auto pipeline_info = VkComputePipelineCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = flags,
+			.stage = create_pipeline_shader_info(
+					module,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					specialization),
+			.layout = layout,
+			.basePipelineHandle = VK_NULL_HANDLE,
+			.basePipelineIndex = -1};
+	auto* pipeline = VkPipeline{};
+	if (vkCreateComputePipelines(
+					device,
+					pipeline_cache,
+					1,
+					&pipeline_info,
+					host_callbacks(),
+					&pipeline) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create compute pipeline\n");
+		std::terminate();
+	}
+	return pipeline;
+}
+
+void set_raster_state(
+		VkCommandBuffer command_buffer,
+		const RasterState& state,
+		bool topology) {
+	vkCmdSetCullMode(command_buffer, state.cull_mode);
+	vkCmdSetFrontFace(command_buffer, state.front_face);
+	if (topology) {
+		vkCmdSetPrimitiveTopology(command_buffer, state.topology);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+// Rasterization state that is set while recording on devices with extended
+// dynamic state, so one pipeline covers every combination. Elsewhere it is
+// baked into the pipeline. Dynamic topology has to stay in the same class
+// (points, lines or triangles) as the pipeline's.
+struct RasterState {
+	VkCullModeFlags cull_mode{VK_CULL_MODE_BACK_BIT};
+	VkFrontFace front_face{VK_FRONT_FACE_CLOCKWISE};
+	VkPrimitiveTopology topology{VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+};
+
+constexpr auto g_raster_dynamic_states = std::array{
+		VK_DYNAMIC_STATE_CULL_MODE,
+		VK_DYNAMIC_STATE_FRONT_FACE,
+		VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY};
+
+// Mesh shading pipelines have no input assembly, so their topology cannot be
+// dynamic.
+constexpr auto g_mesh_raster_dynamic_states = std::array{
+		VK_DYNAMIC_STATE_CULL_MODE,
+		VK_DYNAMIC_STATE_FRONT_FACE};
+
+// Needs the g_raster_dynamic_states on the bound pipeline, or the
+// g_mesh_raster_dynamic_states without topology.
+void set_raster_state(
+		VkCommandBuffer command_buffer,
+		const RasterState& state,
+		bool topology);
+
+auto create_shader_modules(VkDevice& device, std::span<const uint32_t> code)
+		-> VkShaderModule;
+// specialization may be null, otherwise it must outlive pipeline creation.
+// See specialization.hpp for building one.
+auto create_pipeline_shader_info(
+		VkShaderModule& module,
+		VkShaderStageFlagBits stage,
+		const VkSpecializationInfo* specialization)
+		-> VkPipelineShaderStageCreateInfo;
+auto create_compute_pipeline(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		VkPipelineLayout& layout,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		VkPipelineCreateFlags flags) -> VkPipeline;
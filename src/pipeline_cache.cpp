@@ -0,0 +1,260 @@
+#include "pipeline_cache.hpp"
+
+#include "host_memory.hpp"
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <random>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+constexpr auto g_cache_magic = std::array{'V', 'K', 'P', 'C'};
+constexpr auto g_cache_version = uint32_t{1};
+
+struct CacheFileHeader {
+	std::array<char, 4> magic{};
+	uint32_t version{};
+	uint32_t vendor_id{};
+	uint32_t device_id{};
+	uint32_t driver_version{};
+	std::array<uint8_t, VK_UUID_SIZE> uuid{};
+	uint64_t data_size{};
+	uint64_t checksum{};
+};
+
+auto make_header(const VkPhysicalDeviceProperties& properties)
+		-> CacheFileHeader {
+	auto header = CacheFileHeader{
+			.magic = g_cache_magic,
+			.version = g_cache_version,
+			.vendor_id = properties.vendorID,
+			.device_id = properties.deviceID,
+			.driver_version = properties.driverVersion};
+	std::memcpy(header.uuid.data(), properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+// FNV-1a; some drivers crash on corrupt cache data instead of rejecting it.
+auto checksum(std::span<const char> data) -> uint64_t {
+	auto hash = uint64_t{14695981039346656037U};
+	for (auto byte : data) {
+		hash ^= static_cast<uint8_t>(byte);
+		hash *= uint64_t{1099511628211U};
+	}
+	return hash;
+}
+
+auto is_compatible(
+		const CacheFileHeader& header,
+		const CacheFileHeader& expected,
+		std::span<const char> data) -> bool {
+	if (header.magic != expected.magic || header.version != expected.version ||
+			header.vendor_id != expected.vendor_id ||
+			header.device_id != expected.device_id ||
+			header.driver_version != expected.driver_version ||
+			header.uuid != expected.uuid || header.data_size != data.size() ||
+			header.checksum != checksum(data)) {
+		return false;
+	}
+	// The driver's own header must agree with ours as well.
+	auto vk_header = VkPipelineCacheHeaderVersionOne{};
+	if (data.size() < sizeof(vk_header)) {
+		return false;
+	}
+	std::memcpy(&vk_header, data.data(), sizeof(vk_header));
+	return vk_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			vk_header.vendorID == expected.vendor_id &&
+			vk_header.deviceID == expected.device_id &&
+			std::memcmp(
+					vk_header.pipelineCacheUUID,
+					expected.uuid.data(),
+					VK_UUID_SIZE) == 0;
+}
+
+auto read_cache_data(
+		const std::filesystem::path& path,
+		const CacheFileHeader& expected) -> std::vector<char> {
+	auto file = std::ifstream(path, std::ios::binary);
+	if (!file) {
+		return {};
+	}
+	auto header = CacheFileHeader{};
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	constexpr auto max_size = uint64_t{1} << 30U;
+	if (!file || header.data_size > max_size) {
+		return {};
+	}
+	auto data = std::vector<char>(header.data_size);
+	file.read(data.data(), static_cast<std::streamsize>(data.size()));
+	if (!file || !is_compatible(header, expected, data)) {
+		fmt::print(stderr, "Discarding stale pipeline cache {}\n", path.string());
+		return {};
+	}
+	return data;
+}
+
+// Every file of the device in a shared directory starts with it.
+auto shared_cache_prefix(const VkPhysicalDeviceProperties& properties)
+		-> std::string {
+	return fmt::format(
+			"pipeline-{:04x}-{:04x}-",
+			properties.vendorID,
+			properties.deviceID);
+}
+
+}  // namespace
+
+auto pipeline_cache_path(
+		const std::filesystem::path& cache_dir,
+		const VkPhysicalDeviceProperties& properties) -> std::filesystem::path {
+	return cache_dir /
+			fmt::format(
+						 "pipeline-{:04x}-{:04x}.cache",
+						 properties.vendorID,
+						 properties.deviceID);
+}
+
+auto load_pipeline_cache(
+		VkDevice& device,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& path) -> VkPipelineCache {
+	auto data = read_cache_data(path, make_header(properties));
+	auto cache_info = VkPipelineCacheCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.initialDataSize = data.size(),
+			.pInitialData = data.empty() ? VK_NULL_HANDLE : data.data()};
+	auto* cache = VkPipelineCache{};
+	if (vkCreatePipelineCache(device, &cache_info, host_callbacks(), &cache) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create pipeline cache\n");
+		std::terminate();
+	}
+	return cache;
+}
+
+void save_pipeline_cache(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& path) {
+	auto size = size_t{};
+	if (vkGetPipelineCacheData(device, cache, &size, VK_NULL_HANDLE) !=
+			VK_SUCCESS) {
+		return;
+	}
+	auto data = std::vector<char>(size);
+	if (vkGetPipelineCacheData(device, cache, &size, data.data()) !=
+			VK_SUCCESS) {
+		return;
+	}
+	data.resize(size);
+
+	auto header = make_header(properties);
+	header.data_size = data.size();
+	header.checksum = checksum(data);
+
+	auto error = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), error);
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::binary | std::ios::trunc);
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file) {
+			fmt::print(stderr, "Failed to write pipeline cache {}\n", path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		fmt::print(stderr, "Failed to write pipeline cache {}\n", path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
+
+auto merge_shared_pipeline_caches(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& dir) -> SharedPipelineCache {
+	auto prefix = shared_cache_prefix(properties);
+	auto random = std::random_device{};
+	auto id = (uint64_t{random()} << 32U) | random();
+	auto shared = SharedPipelineCache{
+			.own_path = dir / fmt::format("{}{:016x}.cache", prefix, id),
+			.merged = {}};
+	auto expected = make_header(properties);
+	auto error = std::error_code{};
+	for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+		auto name = entry.path().filename().string();
+		// Temporary files end in .tmp and are skipped.
+		if (!name.starts_with(prefix) || !name.ends_with(".cache")) {
+			continue;
+		}
+		auto written = entry.last_write_time(error);
+		auto data = read_cache_data(entry.path(), expected);
+		if (error || data.empty()) {
+			continue;
+		}
+		auto cache_info = VkPipelineCacheCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.initialDataSize = data.size(),
+				.pInitialData = data.data()};
+		auto* source = VkPipelineCache{};
+		if (vkCreatePipelineCache(device, &cache_info, host_callbacks(), &source) !=
+				VK_SUCCESS) {
+			continue;
+		}
+		if (vkMergePipelineCaches(device, cache, 1, &source) == VK_SUCCESS) {
+			shared.merged.emplace_back(
+					SharedCacheFile{.path = entry.path(), .written = written});
+		}
+		vkDestroyPipelineCache(device, source, host_callbacks());
+	}
+	log_message(
+			LogLevel::info,
+			"Merged {} shared pipeline caches from {}",
+			shared.merged.size(),
+			dir.string());
+	return shared;
+}
+
+void save_shared_pipeline_cache(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const SharedPipelineCache& shared) {
+	save_pipeline_cache(device, cache, properties, shared.own_path);
+	auto error = std::error_code{};
+	if (!std::filesystem::exists(shared.own_path, error)) {
+		return;
+	}
+	// A process that saved again since has pipelines this one lacks. One
+	// that saves right between the check and the removal loses its file,
+	// which costs the next runs compiles but nothing else.
+	for (const auto& file : shared.merged) {
+		if (std::filesystem::last_write_time(file.path, error) == file.written &&
+				!error) {
+			std::filesystem::remove(file.path, error);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <filesystem>
+#include <vector>
+
+auto pipeline_cache_path(
+		const std::filesystem::path& cache_dir,
+		const VkPhysicalDeviceProperties& properties) -> std::filesystem::path;
+
+// Returns an empty cache when the file is missing, corrupt, or was written by
+// a different device or driver.
+auto load_pipeline_cache(
+		VkDevice& device,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& path) -> VkPipelineCache;
+
+// Writes to a temporary file and renames it over the old one so a crash never
+// leaves a truncated cache behind.
+void save_pipeline_cache(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& path);
+
+// A pipeline cache directory that many processes on a host share. Each one
+// writes a file of its own, named with a random id, so no file is ever
+// written by two of them and none needs a lock. A process merges everyone's
+// files into its cache at startup and replaces the ones it merged with its
+// own when it saves.
+struct SharedCacheFile {
+	std::filesystem::path path;
+	std::filesystem::file_time_type written;
+};
+struct SharedPipelineCache {
+	std::filesystem::path own_path;
+	// The other processes' files that were merged.
+	std::vector<SharedCacheFile> merged;
+};
+
+// Merges the files of the same device and driver in dir into cache, which
+// must not be in use.
+auto merge_shared_pipeline_caches(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const std::filesystem::path& dir) -> SharedPipelineCache;
+
+// Saves cache as the process's own file, then removes the merged files that
+// were not written again since, whose pipelines it holds.
+void save_shared_pipeline_cache(
+		VkDevice& device,
+		VkPipelineCache& cache,
+		const VkPhysicalDeviceProperties& properties,
+		const SharedPipelineCache& shared);
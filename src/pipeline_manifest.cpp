@@ -0,0 +1,50 @@
+#include "pipeline_manifest.hpp"
+
+#include "log.hpp"
+
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+auto load_pipeline_manifest(const std::filesystem::path& path)
+		-> std::vector<std::string> {
+	auto names = std::vector<std::string>{};
+	auto file = std::ifstream(path);
+	for (auto line = std::string{}; std::getline(file, line);) {
+		if (!line.empty()) {
+			names.emplace_back(std::move(line));
+		}
+	}
+	return names;
+}
+
+void save_pipeline_manifest(
+		const std::filesystem::path& path,
+		const std::set<std::string, std::less<>>& names) {
+	auto error = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), error);
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::trunc);
+		for (const auto& name : names) {
+			file << name << '\n';
+		}
+		if (!file) {
+			log_message(
+					LogLevel::warning,
+					"Failed to write pipeline manifest {}",
+					path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		log_message(
+				LogLevel::warning,
+				"Failed to write pipeline manifest {}",
+				path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+// The names of the pipeline states a run drew with, one per line, so the
+// next run can compile them in the background before it first draws with
+// them. The disk pipeline cache makes those compiles cheap, the manifest has
+// them done before the frame that needs them. Names rather than keys, which
+// hold handles that differ between runs.
+
+// Empty when the file is missing.
+auto load_pipeline_manifest(const std::filesystem::path& path)
+		-> std::vector<std::string>;
+// Replaces the manifest through a temporary file like the pipeline cache.
+void save_pipeline_manifest(
+		const std::filesystem::path& path,
+		const std::set<std::string, std::less<>>& names);
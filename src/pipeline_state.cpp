@@ -0,0 +1,719 @@
+#include "pipeline_state.hpp"
+
+#include "depth.hpp"
+#include "host_memory.hpp"
+#include "instrument.hpp"
+#include "static_vector.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <utility>
+
+namespace {
+
+// In the order they are linked. Mesh shading pipelines have no vertex input.
+constexpr auto g_library_parts =
+		std::array<VkGraphicsPipelineLibraryFlagsEXT, 4>{
+				VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+				VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT};
+// Vertex, tessellation, geometry and fragment, or task, mesh and fragment.
+constexpr auto g_max_pipeline_stages = size_t{5};
+
+template <typename Handle>
+auto handle_word(Handle handle) -> uint64_t {
+	return std::bit_cast<uint64_t>(handle);
+}
+
+// Blending never touches a color the mask leaves out, and premultiplied
+// blending keeps the motion vectors.
+static_assert(!blend_attachment_states(BlendMode::none, 0xf)[0].blendEnable);
+static_assert(
+		blend_attachment_states(BlendMode::premultiplied, 0xf)[1]
+				.colorWriteMask == 0);
+static_assert(
+		blend_attachment_states(BlendMode::weighted, 0)[1].colorWriteMask == 0);
+static_assert(
+		hash_state_words(std::array{uint64_t{1}, uint64_t{2}}) ==
+		hash_state_word(hash_state_words(std::array{uint64_t{1}}), 2));
+
+auto has_vertex_stage(const GraphicsPipelineState& state) -> bool {
+	return std::any_of(
+			state.stages.begin(),
+			state.stages.end(),
+			[](const PipelineShaderStage& stage) {
+				return stage.stage == VK_SHADER_STAGE_VERTEX_BIT;
+			});
+}
+
+// The state a library part depends on. The rest stays at its defaults, so
+// pipelines that only differ there share the library.
+auto library_state(
+		const GraphicsPipelineState& state,
+		VkGraphicsPipelineLibraryFlagsEXT part) -> GraphicsPipelineState {
+	auto library = GraphicsPipelineState{};
+	library.shading_rate_attachment = state.shading_rate_attachment;
+	library.view_mask = state.view_mask;
+	auto fragment = [](const PipelineShaderStage& stage) {
+		return stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+	};
+	if (part == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT) {
+		library.bindings = state.bindings;
+		library.attributes = state.attributes;
+		library.raster.topology = state.raster.topology;
+		library.extended_dynamic_state = state.extended_dynamic_state;
+		return library;
+	}
+	library.color_format = state.color_format;
+	library.depth_format = state.depth_format;
+	library.motion_format = state.motion_format;
+	library.render_pass = state.render_pass;
+	if (part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+		std::copy_if(
+				state.stages.begin(),
+				state.stages.end(),
+				std::back_inserter(library.stages),
+				std::not_fn(fragment));
+		library.raster.cull_mode = state.raster.cull_mode;
+		library.raster.front_face = state.raster.front_face;
+		library.extended_dynamic_state = state.extended_dynamic_state;
+		library.layout = state.layout;
+	} else if (part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+		std::copy_if(
+				state.stages.begin(),
+				state.stages.end(),
+				std::back_inserter(library.stages),
+				fragment);
+		library.samples = state.samples;
+		library.depth_write = state.depth_write;
+		library.depth_compare = state.depth_compare;
+		library.layout = state.layout;
+	} else {
+		library.samples = state.samples;
+		library.color_write_mask = state.color_write_mask;
+		library.blend = state.blend;
+	}
+	return library;
+}
+
+// Dynamic rendering with a shading rate image only draws with pipelines that
+// were told about it.
+auto shading_rate_flags(const GraphicsPipelineState& state)
+		-> VkPipelineCreateFlags {
+	if (!state.shading_rate_attachment || state.render_pass != VK_NULL_HANDLE) {
+		return 0;
+	}
+	return VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+}
+
+// library_parts is zero for a complete pipeline. A library only describes
+// the state of its parts, which library_state already reduced it to.
+auto compile_pipeline(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		const GraphicsPipelineState& state,
+		VkGraphicsPipelineLibraryFlagsEXT library_parts) -> VkPipeline {
+	VKDEMO_ZONE("compile_pipeline");
+	auto includes = [&](VkGraphicsPipelineLibraryFlagsEXT part) {
+		return library_parts == 0 || (library_parts & part) != 0;
+	};
+	// The stages point at the specializations, which never move.
+	auto specializations =
+			StaticVector<VkSpecializationInfo, g_max_pipeline_stages>{};
+	auto stages =
+			StaticVector<VkPipelineShaderStageCreateInfo, g_max_pipeline_stages>{};
+	auto identifiers = StaticVector<
+			VkPipelineShaderStageModuleIdentifierCreateInfoEXT,
+			g_max_pipeline_stages>{};
+	// A vertex input library has no stages but is never mesh shading. The
+	// fragment parts ignore the vertex input and raster dynamic states.
+	auto mesh_shading = !state.stages.empty() && !has_vertex_stage(state);
+	auto vertex_input = !mesh_shading &&
+			includes(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+	auto pre_rasterization =
+			includes(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+	auto fragment_shader =
+			includes(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+	auto fragment_output =
+			includes(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+	for (const auto& stage : state.stages) {
+		const auto& copy = stage.specialization;
+		const auto& specialization =
+				specializations.emplace_back(VkSpecializationInfo{
+						.mapEntryCount = static_cast<uint32_t>(copy.entries.size()),
+						.pMapEntries = copy.entries.data(),
+						.dataSize = copy.data.size(),
+						.pData = copy.data.data()});
+		auto module = stage.module;
+		auto& stage_info = stages.emplace_back(create_pipeline_shader_info(
+				module,
+				stage.stage,
+				copy.entries.empty() ? VK_NULL_HANDLE : &specialization));
+		if (module == VK_NULL_HANDLE) {
+			auto& identifier = identifiers.emplace_back(
+					VkPipelineShaderStageModuleIdentifierCreateInfoEXT{});
+			identifier.sType =
+					VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+			identifier.identifierSize =
+					static_cast<uint32_t>(stage.identifier.size());
+			identifier.pIdentifier = stage.identifier.data();
+			stage_info.pNext = &identifier;
+		}
+	}
+
+	auto vertex_input_state_info = VkPipelineVertexInputStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.vertexBindingDescriptionCount =
+					static_cast<uint32_t>(state.bindings.size()),
+			.pVertexBindingDescriptions = state.bindings.data(),
+			.vertexAttributeDescriptionCount =
+					static_cast<uint32_t>(state.attributes.size()),
+			.pVertexAttributeDescriptions = state.attributes.data()};
+	auto input_assembly_state_info = VkPipelineInputAssemblyStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.topology = state.raster.topology,
+			.primitiveRestartEnable = VK_FALSE};
+
+	// Viewport and scissor follow the swap chain extent, so they are dynamic
+	// and a resize does not have to rebuild the pipeline.
+	auto viewport_state_info = VkPipelineViewportStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.viewportCount = 1,
+			.pViewports = VK_NULL_HANDLE,
+			.scissorCount = 1,
+			.pScissors = VK_NULL_HANDLE};
+	auto dynamic_states =
+			std::vector{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	if (state.extended_dynamic_state && mesh_shading) {
+		dynamic_states.insert(
+				dynamic_states.end(),
+				g_mesh_raster_dynamic_states.begin(),
+				g_mesh_raster_dynamic_states.end());
+	} else if (state.extended_dynamic_state) {
+		dynamic_states.insert(
+				dynamic_states.end(),
+				g_raster_dynamic_states.begin(),
+				g_raster_dynamic_states.end());
+	}
+	auto dynamic_state_info = VkPipelineDynamicStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+			.pDynamicStates = dynamic_states.data()};
+
+	auto rasterizer = rasterization_state(state.raster);
+	auto multisampling = multisample_state(state.samples);
+	auto depth_stencil = depth_stencil_state();
+	depth_stencil.depthWriteEnable = state.depth_write;
+	depth_stencil.depthCompareOp = state.depth_compare;
+	auto color_blend_attachments = color_blend_state(state);
+	auto color_count = color_attachment_count(state);
+	auto color_blending = VkPipelineColorBlendStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.logicOpEnable = VK_FALSE,
+			.logicOp = VK_LOGIC_OP_COPY,
+			.attachmentCount = color_count,
+			.pAttachments = color_blend_attachments.data(),
+			.blendConstants = {0, 0, 0, 0}};
+	auto color_formats = std::array{state.color_format, state.motion_format};
+	auto rendering_info = VkPipelineRenderingCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.viewMask = state.view_mask,
+			.colorAttachmentCount = color_count,
+			.pColorAttachmentFormats = color_formats.data(),
+			.depthAttachmentFormat = state.depth_format,
+			.stencilAttachmentFormat = VK_FORMAT_UNDEFINED};
+	const void* next = VK_NULL_HANDLE;
+	if (state.render_pass == VK_NULL_HANDLE &&
+			(pre_rasterization || fragment_shader || fragment_output)) {
+		next = &rendering_info;
+	}
+	// The attachment's rate is combined with the pipeline's and the
+	// primitive's, of which only the attachment's is ever coarser than 1x1.
+	auto shading_rate_info = VkPipelineFragmentShadingRateStateCreateInfoKHR{
+			.sType =
+					VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR,
+			.pNext = next,
+			.fragmentSize = VkExtent2D{.width = 1, .height = 1},
+			.combinerOps = {
+					VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+					VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR}};
+	if (state.shading_rate_attachment && (pre_rasterization || fragment_shader)) {
+		next = &shading_rate_info;
+	}
+	auto library_info = VkGraphicsPipelineLibraryCreateInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+			.pNext = next,
+			.flags = library_parts};
+	if (library_parts != 0) {
+		next = &library_info;
+	}
+
+	auto pipeline_info = VkGraphicsPipelineCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.pNext = next,
+			.flags = (library_parts != 0 ? VK_PIPELINE_CREATE_LIBRARY_BIT_KHR : 0U) |
+					(identifiers.empty()
+									? 0U
+									: VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT) |
+					shading_rate_flags(state),
+			.stageCount = static_cast<uint32_t>(stages.size()),
+			.pStages = stages.data(),
+			.pVertexInputState =
+					vertex_input ? &vertex_input_state_info : VK_NULL_HANDLE,
+			.pInputAssemblyState =
+					vertex_input ? &input_assembly_state_info : VK_NULL_HANDLE,
+			.pTessellationState = VK_NULL_HANDLE,
+			.pViewportState =
+					pre_rasterization ? &viewport_state_info : VK_NULL_HANDLE,
+			.pRasterizationState =
+					pre_rasterization ? &rasterizer : VK_NULL_HANDLE,
+			.pMultisampleState = fragment_shader || fragment_output
+					? &multisampling
+					: VK_NULL_HANDLE,
+			.pDepthStencilState =
+					fragment_shader ? &depth_stencil : VK_NULL_HANDLE,
+			.pColorBlendState =
+					fragment_output ? &color_blending : VK_NULL_HANDLE,
+			.pDynamicState = &dynamic_state_info,
+			.layout = state.layout,
+			.renderPass = state.render_pass,
+			.subpass = 0,
+			.basePipelineHandle = VK_NULL_HANDLE,
+			.basePipelineIndex = -1};
+	auto* pipeline = VkPipeline{};
+	auto result = vkCreateGraphicsPipelines(
+			device,
+			pipeline_cache,
+			1,
+			&pipeline_info,
+			host_callbacks(),
+			&pipeline);
+	// The cache does not have it, so the identified stages are compiled from
+	// their SPIR-V, through modules only kept for this compile.
+	auto modules = StaticVector<VkShaderModule, g_max_pipeline_stages>{};
+	if (result == VK_PIPELINE_COMPILE_REQUIRED) {
+		for (auto i = size_t{}; i < state.stages.size(); i++) {
+			const auto& stage = state.stages.at(i);
+			if (stage.module == VK_NULL_HANDLE) {
+				auto& stage_info = stages[i];
+				stage_info.pNext = VK_NULL_HANDLE;
+				stage_info.module =
+						modules.emplace_back(create_shader_modules(device, stage.code));
+			}
+		}
+		pipeline_info.flags &=
+				~VkPipelineCreateFlags{
+						VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT};
+		result = vkCreateGraphicsPipelines(
+				device,
+				pipeline_cache,
+				1,
+				&pipeline_info,
+				host_callbacks(),
+				&pipeline);
+		for (auto* module : modules) {
+			vkDestroyShaderModule(device, module, host_callbacks());
+		}
+	}
+	if (result != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create graphics pipeline\n");
+		std::terminate();
+	}
+	return pipeline;
+}
+
+// Without VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT the driver reuses
+// the libraries' code as it is, which is what makes the link fast.
+auto link_pipeline(
+		VkDevice& device,
+		VkPipelineCache& pipeline_cache,
+		const GraphicsPipelineState& state,
+		std::span<const VkPipeline> libraries) -> VkPipeline {
+	VKDEMO_ZONE("link_pipeline");
+	auto library_info = VkPipelineLibraryCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.libraryCount = static_cast<uint32_t>(libraries.size()),
+			.pLibraries = libraries.data()};
+	auto pipeline_info = VkGraphicsPipelineCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.pNext = &library_info,
+			.flags = shading_rate_flags(state),
+			.stageCount = 0,
+			.pStages = VK_NULL_HANDLE,
+			.pVertexInputState = VK_NULL_HANDLE,
+			.pInputAssemblyState = VK_NULL_HANDLE,
+			.pTessellationState = VK_NULL_HANDLE,
+			.pViewportState = VK_NULL_HANDLE,
+			.pRasterizationState = VK_NULL_HANDLE,
+			.pMultisampleState = VK_NULL_HANDLE,
+			.pDepthStencilState = VK_NULL_HANDLE,
+			.pColorBlendState = VK_NULL_HANDLE,
+			.pDynamicState = VK_NULL_HANDLE,
+			.layout = state.layout,
+			.renderPass = state.render_pass,
+			.subpass = 0,
+			.basePipelineHandle = VK_NULL_HANDLE,
+			.basePipelineIndex = -1};
+	auto* pipeline = VkPipeline{};
+	if (vkCreateGraphicsPipelines(
+					device,
+					pipeline_cache,
+					1,
+					&pipeline_info,
+					host_callbacks(),
+					&pipeline) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to link graphics pipeline\n");
+		std::terminate();
+	}
+	return pipeline;
+}
+
+// The key is only copied when the state is new.
+auto find_or_add(
+		CachedPipelines& pipelines,
+		const GraphicsPipelineState& state,
+		const PipelineStateKey& key,
+		VkGraphicsPipelineLibraryFlagsEXT library_parts) -> CachedPipeline& {
+	auto it = pipelines.find(key);
+	if (it == pipelines.end()) {
+		auto entry = std::make_unique<CachedPipeline>();
+		entry->state = state;
+		entry->library_parts = library_parts;
+		it = pipelines.emplace(key, std::move(entry)).first;
+	}
+	return *it->second;
+}
+
+void note_use(PipelineStateCache& cache, CachedPipeline& entry) {
+	if (!entry.used && !entry.state.name.empty()) {
+		entry.used = true;
+		cache.used.emplace(entry.state.name);
+	}
+}
+
+void publish(CachedPipeline& entry, VkPipeline pipeline) {
+	entry.pipeline.store(pipeline, std::memory_order_release);
+	entry.pipeline.notify_all();
+}
+
+// Queues entry unless it is queued at priority or a more urgent one already.
+// Entries are never removed before the cache waits for the compile pool.
+void queue_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		CachedPipeline& entry,
+		CompilePriority priority) {
+	if (entry.queued.has_value() && *entry.queued <= priority) {
+		return;
+	}
+	entry.queued = priority;
+	queue_compile(*cache.compiler, priority, [&device, &cache, &entry] {
+		if (entry.claimed.exchange(true, std::memory_order_acq_rel)) {
+			return;
+		}
+		publish(
+				entry,
+				compile_pipeline(
+						device,
+						cache.pipeline_cache,
+						entry.state,
+						entry.library_parts));
+	});
+}
+
+// Compiles entry on the calling thread, or waits for the compile that
+// claimed it first.
+auto compile_now(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		CachedPipeline& entry) -> VkPipeline {
+	if (!entry.claimed.exchange(true, std::memory_order_acq_rel)) {
+		publish(
+				entry,
+				compile_pipeline(
+						device,
+						cache.pipeline_cache,
+						entry.state,
+						entry.library_parts));
+	} else {
+		entry.pipeline.wait(VK_NULL_HANDLE, std::memory_order_acquire);
+	}
+	return entry.pipeline.load(std::memory_order_acquire);
+}
+
+// Linking is fast and only done by the thread using the cache.
+auto link_now(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		CachedPipeline& entry,
+		std::span<const VkPipeline> libraries) -> VkPipeline {
+	entry.claimed.store(true, std::memory_order_relaxed);
+	publish(
+			entry,
+			link_pipeline(device, cache.pipeline_cache, entry.state, libraries));
+	return entry.pipeline.load(std::memory_order_relaxed);
+}
+
+// The libraries of a pipeline's state in link order, null where one is not
+// compiled yet.
+auto find_libraries(
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state)
+		-> StaticVector<CachedPipeline*, g_library_parts.size()> {
+	auto libraries = StaticVector<CachedPipeline*, g_library_parts.size()>{};
+	auto vertex_input = has_vertex_stage(state);
+	for (auto part : g_library_parts) {
+		if (part == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT &&
+				!vertex_input) {
+			continue;
+		}
+		auto library = library_state(state, part);
+		auto key = pipeline_state_key(library);
+		key.words.emplace_back(part);
+		key.hash = hash_state_word(key.hash, part);
+		libraries.emplace_back(&find_or_add(cache.libraries, library, key, part));
+	}
+	return libraries;
+}
+
+}  // namespace
+
+auto color_attachment_count(const GraphicsPipelineState& state) -> uint32_t {
+	return state.motion_format != VK_FORMAT_UNDEFINED ? 2 : 1;
+}
+
+auto color_blend_state(const GraphicsPipelineState& state)
+		-> std::array<VkPipelineColorBlendAttachmentState, 2> {
+	return blend_attachment_states(state.blend, state.color_write_mask);
+}
+
+auto copy_specialization(const VkSpecializationInfo* info)
+		-> SpecializationCopy {
+	auto copy = SpecializationCopy{};
+	if (info == VK_NULL_HANDLE) {
+		return copy;
+	}
+	auto entries = std::span(info->pMapEntries, info->mapEntryCount);
+	copy.entries.assign(entries.begin(), entries.end());
+	copy.data.resize(info->dataSize);
+	std::memcpy(copy.data.data(), info->pData, info->dataSize);
+	return copy;
+}
+
+auto pipeline_state_key(const GraphicsPipelineState& state)
+		-> PipelineStateKey {
+	auto key = PipelineStateKey{};
+	auto& words = key.words;
+	words.emplace_back(state.stages.size());
+	for (const auto& stage : state.stages) {
+		words.emplace_back(stage.stage);
+		words.emplace_back(handle_word(stage.module));
+		words.emplace_back(stage.specialization.entries.size());
+		for (const auto& entry : stage.specialization.entries) {
+			words.emplace_back(
+					(uint64_t{entry.constantID} << 32U) | entry.offset);
+			words.emplace_back(entry.size);
+		}
+		words.emplace_back(stage.specialization.data.size());
+		for (auto byte : stage.specialization.data) {
+			words.emplace_back(static_cast<uint64_t>(byte));
+		}
+		words.emplace_back(stage.identifier.size());
+		for (auto byte : stage.identifier) {
+			words.emplace_back(byte);
+		}
+	}
+	words.emplace_back(state.bindings.size());
+	for (const auto& binding : state.bindings) {
+		words.emplace_back((uint64_t{binding.binding} << 32U) | binding.stride);
+		words.emplace_back(binding.inputRate);
+	}
+	words.emplace_back(state.attributes.size());
+	for (const auto& attribute : state.attributes) {
+		words.emplace_back(
+				(uint64_t{attribute.location} << 32U) | attribute.binding);
+		words.emplace_back(
+				(uint64_t{static_cast<uint32_t>(attribute.format)} << 32U) |
+				attribute.offset);
+	}
+	words.emplace_back(state.raster.cull_mode);
+	words.emplace_back(state.raster.front_face);
+	words.emplace_back(state.raster.topology);
+	words.emplace_back(state.extended_dynamic_state);
+	words.emplace_back(state.samples);
+	words.emplace_back(state.depth_write);
+	words.emplace_back(state.depth_compare);
+	words.emplace_back(state.color_write_mask);
+	words.emplace_back(static_cast<uint64_t>(state.blend));
+	words.emplace_back(state.color_format);
+	words.emplace_back(state.depth_format);
+	words.emplace_back(state.motion_format);
+	words.emplace_back(state.shading_rate_attachment);
+	words.emplace_back(state.view_mask);
+	words.emplace_back(handle_word(state.render_pass));
+	words.emplace_back(handle_word(state.layout));
+	key.hash = hash_state_words(words);
+	return key;
+}
+
+void replace_shader_module(
+		GraphicsPipelineState& state,
+		VkShaderModule from,
+		VkShaderModule to) {
+	for (auto& stage : state.stages) {
+		if (stage.module == from) {
+			stage.module = to;
+		}
+	}
+}
+
+auto create_pipeline_state_cache(
+		VkPipelineCache& pipeline_cache,
+		bool graphics_pipeline_library,
+		CompilePool& compiler) -> PipelineStateCache {
+	auto cache = PipelineStateCache{};
+	cache.pipeline_cache = pipeline_cache;
+	cache.graphics_pipeline_library = graphics_pipeline_library;
+	cache.compiler = &compiler;
+	return cache;
+}
+
+void destroy_pipeline_state_cache(
+		VkDevice& device,
+		PipelineStateCache& cache) {
+	wait_for_compiles(*cache.compiler);
+	for (auto& [key, entry] : cache.pipelines) {
+		vkDestroyPipeline(device, entry->pipeline.load(), host_callbacks());
+	}
+	cache.pipelines.clear();
+	for (auto& [key, entry] : cache.libraries) {
+		vkDestroyPipeline(device, entry->pipeline.load(), host_callbacks());
+	}
+	cache.libraries.clear();
+}
+
+auto get_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state) -> VkPipeline {
+	return get_graphics_pipeline(
+			device,
+			cache,
+			state,
+			pipeline_state_key(state));
+}
+
+auto get_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		const PipelineStateKey& key) -> VkPipeline {
+	auto& entry = find_or_add(cache.pipelines, state, key, 0);
+	note_use(cache, entry);
+	if (auto* pipeline = entry.pipeline.load(std::memory_order_acquire);
+			pipeline != VK_NULL_HANDLE) {
+		return pipeline;
+	}
+	if (!cache.graphics_pipeline_library) {
+		return compile_now(device, cache, entry);
+	}
+	auto libraries = StaticVector<VkPipeline, g_library_parts.size()>{};
+	for (auto* library : find_libraries(cache, entry.state)) {
+		libraries.emplace_back(compile_now(device, cache, *library));
+	}
+	return link_now(device, cache, entry, libraries);
+}
+
+auto request_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		CompilePriority priority) -> VkPipeline {
+	return request_graphics_pipeline(
+			device,
+			cache,
+			state,
+			pipeline_state_key(state),
+			priority);
+}
+
+auto request_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		const PipelineStateKey& key,
+		CompilePriority priority) -> VkPipeline {
+	auto& entry = find_or_add(cache.pipelines, state, key, 0);
+	if (priority == CompilePriority::visible) {
+		note_use(cache, entry);
+	}
+	auto* pipeline = entry.pipeline.load(std::memory_order_acquire);
+	if (pipeline != VK_NULL_HANDLE) {
+		return pipeline;
+	}
+	if (!cache.graphics_pipeline_library) {
+		queue_pipeline(device, cache, entry, priority);
+		return pipeline;
+	}
+	auto libraries = StaticVector<VkPipeline, g_library_parts.size()>{};
+	auto ready = true;
+	for (auto* library : find_libraries(cache, entry.state)) {
+		auto* handle = library->pipeline.load(std::memory_order_acquire);
+		if (handle == VK_NULL_HANDLE) {
+			queue_pipeline(device, cache, *library, priority);
+		}
+		ready = ready && handle != VK_NULL_HANDLE;
+		libraries.emplace_back(handle);
+	}
+	if (ready) {
+		pipeline = link_now(device, cache, entry, libraries);
+	}
+	return pipeline;
+}
+
+auto evict_graphics_pipelines(
+		PipelineStateCache& cache,
+		VkShaderModule module) -> std::vector<VkPipeline> {
+	wait_for_compiles(*cache.compiler);
+	auto evicted = std::vector<VkPipeline>{};
+	auto evict = [&](CachedPipelines& pipelines) {
+		std::erase_if(pipelines, [&](const auto& item) {
+			const auto& entry = *item.second;
+			auto uses_module = std::any_of(
+					entry.state.stages.begin(),
+					entry.state.stages.end(),
+					[&](const PipelineShaderStage& stage) {
+						return stage.module == module;
+					});
+			if (uses_module && entry.pipeline.load() != VK_NULL_HANDLE) {
+				evicted.emplace_back(entry.pipeline.load());
+			}
+			return uses_module;
+		});
+	};
+	evict(cache.pipelines);
+	evict(cache.libraries);
+	return evicted;
+}
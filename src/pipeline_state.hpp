@@ -0,0 +1,316 @@
+#pragma once
+
+#include "compile_pool.hpp"
+#include "depth.hpp"
+#include "dispatch.hpp"
+#include "pipeline.hpp"
+#include "shader_identifier.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A specialization info copied into owned storage, so a pipeline can be
+// compiled after the caller's constants are gone.
+struct SpecializationCopy {
+	std::vector<VkSpecializationMapEntry> entries;
+	std::vector<std::byte> data;
+};
+
+struct PipelineShaderStage {
+	VkShaderStageFlagBits stage{};
+	// Null when the stage is created from identifier instead.
+	VkShaderModule module{};
+	// Empty when the stage is not specialized.
+	SpecializationCopy specialization;
+	// The identifier of an earlier run's module, see
+	// src/shader_identifier.hpp, and its SPIR-V, which a module is created
+	// from for the compile when the pipeline cache misses. code must outlive
+	// the cache.
+	ShaderIdentifier identifier;
+	std::span<const uint32_t> code;
+};
+
+auto copy_specialization(const VkSpecializationInfo* info)
+		-> SpecializationCopy;
+
+// How a pipeline blends into its color attachments.
+enum class BlendMode : uint8_t {
+	// Overwrites them.
+	none,
+	// Blends premultiplied colors over the first attachment and leaves the
+	// motion vectors as they are.
+	premultiplied,
+	// Adds to the weighted blended transparency accumulation in the first
+	// attachment and multiplies the revealage in the second by one minus the
+	// red it writes, see src/transparency.hpp.
+	weighted,
+};
+
+// The fixed function state the pipelines are created with, and the shader
+// objects' state set to match. Constant expressions, so state built from
+// constants is made and checked when compiling.
+constexpr auto rasterization_state(const RasterState& raster)
+		-> VkPipelineRasterizationStateCreateInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.depthClampEnable = VK_FALSE,
+			.rasterizerDiscardEnable = VK_FALSE,
+			.polygonMode = VK_POLYGON_MODE_FILL,
+			.cullMode = raster.cull_mode,
+			.frontFace = raster.front_face,
+			.depthBiasEnable = VK_FALSE,
+			.depthBiasConstantFactor = 0,
+			.depthBiasClamp = 0,
+			.depthBiasSlopeFactor = 0,
+			.lineWidth = 1};
+}
+
+constexpr auto multisample_state(VkSampleCountFlagBits samples)
+		-> VkPipelineMultisampleStateCreateInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.rasterizationSamples = samples,
+			.sampleShadingEnable = VK_FALSE,
+			.minSampleShading = 0,
+			.pSampleMask = VK_NULL_HANDLE,
+			.alphaToCoverageEnable = VK_FALSE,
+			.alphaToOneEnable = VK_FALSE};
+}
+
+// Both color attachments' blending, the second unused with one attachment.
+constexpr auto blend_attachment_states(
+		BlendMode blend,
+		VkColorComponentFlags color_write_mask)
+		-> std::array<VkPipelineColorBlendAttachmentState, 2> {
+	auto attachment = VkPipelineColorBlendAttachmentState{
+			.blendEnable = VK_FALSE,
+			.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+			.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+			.colorBlendOp = VK_BLEND_OP_ADD,
+			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+			.alphaBlendOp = VK_BLEND_OP_ADD,
+			.colorWriteMask = color_write_mask};
+	auto attachments = std::array{attachment, attachment};
+	if (blend == BlendMode::premultiplied) {
+		auto& blended = attachments.at(0);
+		blended.blendEnable = VK_TRUE;
+		blended.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		blended.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		attachments.at(1).colorWriteMask = 0;
+	} else if (blend == BlendMode::weighted) {
+		auto& accumulation = attachments.at(0);
+		accumulation.blendEnable = VK_TRUE;
+		accumulation.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		accumulation.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		auto& revealage = attachments.at(1);
+		revealage.blendEnable = VK_TRUE;
+		revealage.srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+		revealage.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+		revealage.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		revealage.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	}
+	return attachments;
+}
+
+// Everything the demo's graphics pipelines differ in. The rest of the state
+// is fixed: viewport and scissor are dynamic, color attachments are written
+// without blending unless a blend mode is set and stencil is off. Pipelines
+// without a vertex stage are mesh shading ones and have no vertex input or
+// input assembly.
+struct GraphicsPipelineState {
+	std::vector<PipelineShaderStage> stages;
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	// Baked unless extended_dynamic_state, see RasterState.
+	RasterState raster;
+	bool extended_dynamic_state{};
+	VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+	// Overrides of depth_stencil_state().
+	VkBool32 depth_write{VK_TRUE};
+	VkCompareOp depth_compare{g_depth_compare_op};
+	VkColorComponentFlags color_write_mask{};
+	BlendMode blend{BlendMode::none};
+	// Attachment formats for dynamic rendering, used when render_pass is
+	// null.
+	VkFormat color_format{};
+	VkFormat depth_format{};
+	// A second color attachment unless undefined, written with the same
+	// mask: the motion vectors, or the revealage of weighted blending.
+	VkFormat motion_format{};
+	// Drawn in dynamic rendering with a shading rate image, whose fragment
+	// sizes replace the pipeline's 1x1.
+	bool shading_rate_attachment{};
+	// The views of multiview dynamic rendering the pipeline draws, zero
+	// without multiview.
+	uint32_t view_mask{};
+	VkRenderPass render_pass{};
+	VkPipelineLayout layout{};
+	// Names the state in the usage manifest, see src/pipeline_manifest.hpp.
+	// Unlike the key it is the same in every run. Not part of the key.
+	std::string_view name;
+};
+
+// The state flattened into words, equal for states that produce the same
+// pipeline. Handles are part of it, so keys are only stable while the modules,
+// render pass and layout they name exist.
+struct PipelineStateKey {
+	std::vector<uint64_t> words;
+	// FNV-1a over the words.
+	uint64_t hash{};
+};
+
+// Continues the FNV-1a hash of some words with word, so a key can be extended
+// without hashing it again.
+constexpr auto hash_state_word(uint64_t hash, uint64_t word) -> uint64_t {
+	constexpr auto fnv_prime = uint64_t{1099511628211U};
+	for (auto i = 0U; i < 8; i++) {
+		hash = (hash ^ ((word >> (i * 8U)) & 0xffU)) * fnv_prime;
+	}
+	return hash;
+}
+
+constexpr auto hash_state_words(std::span<const uint64_t> words) -> uint64_t {
+	auto hash = uint64_t{14695981039346656037U};
+	for (auto word : words) {
+		hash = hash_state_word(hash, word);
+	}
+	return hash;
+}
+
+// Flattens the whole state, which walks every stage's specialization. States
+// requested every frame compute it once and pass it to the lookups.
+auto pipeline_state_key(const GraphicsPipelineState& state)
+		-> PipelineStateKey;
+// Points every stage that uses from at to instead.
+void replace_shader_module(
+		GraphicsPipelineState& state,
+		VkShaderModule from,
+		VkShaderModule to);
+// The color attachments the state draws to, one or two, and how it blends
+// into them. The second entry is unused with one attachment.
+auto color_attachment_count(const GraphicsPipelineState& state) -> uint32_t;
+auto color_blend_state(const GraphicsPipelineState& state)
+		-> std::array<VkPipelineColorBlendAttachmentState, 2>;
+
+struct PipelineStateKeyHash {
+	auto operator()(const PipelineStateKey& key) const -> size_t {
+		return key.hash;
+	}
+};
+
+struct PipelineStateKeyEqual {
+	auto operator()(const PipelineStateKey& a, const PipelineStateKey& b) const
+			-> bool {
+		return a.words == b.words;
+	}
+};
+
+// Owns its state so a compile thread can compile it. pipeline is published
+// once compiled.
+struct CachedPipeline {
+	GraphicsPipelineState state;
+	// The VK_GRAPHICS_PIPELINE_LIBRARY_* subsets of a pipeline library, zero
+	// for a complete pipeline.
+	VkGraphicsPipelineLibraryFlagsEXT library_parts{};
+	std::atomic<VkPipeline> pipeline{};
+	// Set by whichever compiles the pipeline. Requeued at a more urgent
+	// priority it has several compiles queued, and the later ones find it
+	// claimed.
+	std::atomic<bool> claimed{};
+	// The most urgent priority it was queued at.
+	std::optional<CompilePriority> queued;
+	// Whether its name is in the cache's used names.
+	bool used{};
+};
+
+using CachedPipelines = std::unordered_map<
+		PipelineStateKey,
+		std::unique_ptr<CachedPipeline>,
+		PipelineStateKeyHash,
+		PipelineStateKeyEqual>;
+
+// Graphics pipelines by state, so a state requested twice compiles once.
+// Compilation goes through the driver's VkPipelineCache as well, which makes
+// the first request of a later run cheap too. Only one thread at a time may
+// use the cache; background compiles run on the compile pool.
+//
+// With graphics_pipeline_library a pipeline is linked from four libraries:
+// vertex input, pre-rasterization shaders, fragment shader and fragment
+// output. Each is keyed by only the state it depends on, so pipelines that
+// differ in one part share the other three, and a new combination of
+// compiled parts only costs a fast link.
+struct PipelineStateCache {
+	VkPipelineCache pipeline_cache{};
+	bool graphics_pipeline_library{};
+	CachedPipelines pipelines;
+	CachedPipelines libraries;
+	// Outlives the cache.
+	CompilePool* compiler{};
+	// Names of the states drawn with: got, or requested at visible priority.
+	std::set<std::string, std::less<>> used;
+};
+
+auto create_pipeline_state_cache(
+		VkPipelineCache& pipeline_cache,
+		bool graphics_pipeline_library,
+		CompilePool& compiler) -> PipelineStateCache;
+// Waits for background compiles, then destroys every pipeline and library.
+// The GPU must be done with them.
+void destroy_pipeline_state_cache(
+		VkDevice& device,
+		PipelineStateCache& cache);
+
+// Returns the state's pipeline, compiling it on the calling thread first if
+// it is not compiled yet. Only waits for a background compile of it or one
+// of its libraries that already started, queued ones are taken over.
+auto get_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state) -> VkPipeline;
+// Like the above with the state's pipeline_state_key, which it must be the
+// current key of, so the lookup is a probe of the map.
+auto get_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		const PipelineStateKey& key) -> VkPipeline;
+// Returns the state's pipeline if it is compiled. Otherwise queues a
+// background compile at priority and returns null, so the caller draws with
+// a fallback until the pipeline is ready instead of hitching. Requesting it
+// again at a more urgent priority moves it up. With libraries only the
+// missing parts are compiled in the background, and the pipeline is linked
+// on the calling thread once they are all ready.
+auto request_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		CompilePriority priority) -> VkPipeline;
+auto request_graphics_pipeline(
+		VkDevice& device,
+		PipelineStateCache& cache,
+		const GraphicsPipelineState& state,
+		const PipelineStateKey& key,
+		CompilePriority priority) -> VkPipeline;
+// Waits for background compiles, then drops every pipeline and library with
+// a stage using module and returns them for the caller to destroy once the
+// GPU is done with them. Must run before module is destroyed, since a new
+// module could reuse its handle and match the stale keys.
+auto evict_graphics_pipelines(
+		PipelineStateCache& cache,
+		VkShaderModule module) -> std::vector<VkPipeline>;
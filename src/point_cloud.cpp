@@ -0,0 +1,844 @@
+#include "point_cloud.hpp"
+
+#include "culling.hpp"
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+
+namespace {
+
+constexpr auto g_cooked_point_magic =
+		std::array<char, 8>{'V', 'K', 'D', 'P', 'O', 'I', 'N', 'T'};
+constexpr auto g_cooked_point_version = 1U;
+
+// A cooked point cloud is this header followed by the nodes and the points,
+// which start at offsets aligned for them, so they are read straight out of
+// the mapping. Fields are in host byte order, like cooked meshes.
+struct CookedPointHeader {
+	std::array<char, 8> magic{};
+	uint32_t version{};
+	uint32_t node_count{};
+	uint64_t point_count{};
+	uint64_t nodes_offset{};
+	uint64_t points_offset{};
+	std::array<float, 4> bounding_sphere{};
+	std::array<uint32_t, 2> padding{};
+};
+
+static_assert(sizeof(CookedPointHeader) == 64);
+
+// node_pages of a node that is not resident.
+constexpr auto g_point_page_absent = 0U;
+
+constexpr auto g_storage_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+// Pixels without a point keep what the scene had.
+constexpr auto g_storage_update = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+				VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in point_splat.comp.
+struct PointConstants {
+	glm::mat4 transform{1.0F};
+	BindlessHandle pool{};
+	BindlessHandle draws{};
+	BindlessHandle splats{};
+	// Of the splat buffer's rows, and of the part of it the frame draws.
+	uint32_t stride{};
+	uint32_t width{};
+	uint32_t height{};
+	std::array<uint32_t, 2> padding{};
+};
+
+// A node's points in the cook, the end of the range included in the node's
+// children.
+struct NodeRange {
+	uint32_t node{};
+	size_t begin{};
+	size_t end{};
+	uint32_t depth{};
+};
+
+// Splits off the next whitespace separated token of line, like the OBJ
+// reader.
+auto next_token(std::string_view& line) -> std::string_view {
+	auto start = line.find_first_not_of(" \t\r,");
+	if (start == std::string_view::npos) {
+		line = {};
+		return {};
+	}
+	line.remove_prefix(start);
+	auto end = std::min(line.find_first_of(" \t\r,"), line.size());
+	auto token = line.substr(0, end);
+	line.remove_prefix(end);
+	return token;
+}
+
+auto parse_float(std::string_view token, float& value) -> bool {
+	auto [end, error] =
+			std::from_chars(token.data(), token.data() + token.size(), value);
+	return error == std::errc{} && end == token.data() + token.size();
+}
+
+auto pack_color(glm::vec3 color) -> uint32_t {
+	auto bytes = glm::uvec3(glm::clamp(color, 0.0F, 1.0F) * 255.0F + 0.5F);
+	return bytes.r | (bytes.g << 8U) | (bytes.b << 16U) | (0xffU << 24U);
+}
+
+auto read_points(
+		const std::filesystem::path& path,
+		std::vector<CloudPoint>& points) -> bool {
+	auto file = std::ifstream(path);
+	if (!file) {
+		fmt::print(stderr, "Failed to open point cloud {}\n", path.string());
+		return false;
+	}
+	auto colors = std::vector<glm::vec3>{};
+	// Colors above 1 anywhere mean the file stores bytes.
+	auto color_scale = 1.0F;
+	auto text = std::string{};
+	for (auto line_idx = size_t{1}; std::getline(file, text); line_idx++) {
+		auto line = std::string_view(text);
+		auto values = std::array<float, 6>{0.0F, 0.0F, 0.0F, 1.0F, 1.0F, 1.0F};
+		auto count = size_t{};
+		auto valid = true;
+		for (auto token = next_token(line); !token.empty() && valid;
+				 token = next_token(line)) {
+			valid = count < values.size() && parse_float(token, values.at(count));
+			count++;
+		}
+		if (count == 0) {
+			continue;
+		}
+		if (!valid || (count != 3 && count != 6)) {
+			fmt::print(
+					stderr,
+					"Malformed line {} in point cloud {}\n",
+					line_idx,
+					path.string());
+			return false;
+		}
+		points.emplace_back(CloudPoint{
+				.position = glm::vec3(values[0], values[1], values[2]),
+				.color = 0});
+		colors.emplace_back(values[3], values[4], values[5]);
+		if (std::max({values[3], values[4], values[5]}) > 1.0F) {
+			color_scale = 1.0F / 255.0F;
+		}
+	}
+	if (points.empty()) {
+		fmt::print(stderr, "Point cloud {} has no points\n", path.string());
+		return false;
+	}
+	for (auto i = size_t{}; i < points.size(); i++) {
+		points[i].color = pack_color(colors[i] * color_scale);
+	}
+	return true;
+}
+
+// Builds the nodes top down, a level at a time, so every node's children
+// are next to each other. Each node keeps the first point of every cell of
+// its grid and passes the others to the octants they are in, reordering
+// points so that every node's points are contiguous.
+auto build_octree(
+		std::vector<CloudPoint>& points,
+		glm::vec3 center,
+		float half_size) -> std::vector<PointNode> {
+	auto nodes = std::vector<PointNode>{};
+	nodes.emplace_back(PointNode{.center = center, .half_size = half_size});
+	auto queue = std::deque<NodeRange>{};
+	queue.emplace_back(NodeRange{
+			.node = 0,
+			.begin = 0,
+			.end = points.size(),
+			.depth = 0});
+	auto cells = std::unordered_set<uint32_t>{};
+	auto kept = std::vector<CloudPoint>{};
+	auto octants = std::array<std::vector<CloudPoint>, 8>{};
+	auto dropped = size_t{};
+	while (!queue.empty()) {
+		auto range = queue.front();
+		queue.pop_front();
+		auto node = nodes[range.node];
+		node.first_point = range.begin;
+		auto count = range.end - range.begin;
+		if (count <= g_point_page_size || range.depth == g_max_point_depth) {
+			// The deepest nodes are cut to a page, the rest stays unused in the
+			// file.
+			dropped += count - std::min<size_t>(count, g_point_page_size);
+			node.point_count =
+					static_cast<uint32_t>(std::min<size_t>(count, g_point_page_size));
+			nodes[range.node] = node;
+			continue;
+		}
+
+		cells.clear();
+		kept.clear();
+		for (auto& octant : octants) {
+			octant.clear();
+		}
+		auto origin = node.center - node.half_size;
+		auto cell_scale = static_cast<float>(g_point_node_grid) /
+				(node.half_size * 2.0F);
+		for (auto i = range.begin; i < range.end; i++) {
+			const auto& point = points[i];
+			auto cell = glm::min(
+					glm::uvec3(glm::max((point.position - origin) * cell_scale, 0.0F)),
+					glm::uvec3(g_point_node_grid - 1));
+			auto key = (cell.x * g_point_node_grid + cell.y) * g_point_node_grid +
+					cell.z;
+			if (kept.size() < g_point_page_size && cells.insert(key).second) {
+				kept.emplace_back(point);
+				continue;
+			}
+			auto octant = (point.position.x >= node.center.x ? 4U : 0U) |
+					(point.position.y >= node.center.y ? 2U : 0U) |
+					(point.position.z >= node.center.z ? 1U : 0U);
+			octants.at(octant).emplace_back(point);
+		}
+
+		auto first = points.begin() + static_cast<ptrdiff_t>(range.begin);
+		first = std::copy(kept.begin(), kept.end(), first);
+		node.point_count = static_cast<uint32_t>(kept.size());
+		node.first_child = static_cast<uint32_t>(nodes.size());
+		auto child_begin = range.begin + kept.size();
+		auto child_half = node.half_size * 0.5F;
+		for (auto octant = 0U; octant < octants.size(); octant++) {
+			const auto& octant_points = octants.at(octant);
+			if (octant_points.empty()) {
+				continue;
+			}
+			node.child_mask |= 1U << octant;
+			auto side = glm::vec3(
+					(octant & 4U) != 0 ? 1.0F : -1.0F,
+					(octant & 2U) != 0 ? 1.0F : -1.0F,
+					(octant & 1U) != 0 ? 1.0F : -1.0F);
+			queue.emplace_back(NodeRange{
+					.node = static_cast<uint32_t>(nodes.size()),
+					.begin = child_begin,
+					.end = child_begin + octant_points.size(),
+					.depth = range.depth + 1});
+			nodes.emplace_back(PointNode{
+					.center = node.center + side * child_half,
+					.half_size = child_half});
+			first = std::copy(octant_points.begin(), octant_points.end(), first);
+			child_begin += octant_points.size();
+		}
+		nodes[range.node] = node;
+	}
+	if (dropped > 0) {
+		fmt::print(
+				stderr,
+				"{} points are below the octree's deepest level, ignoring them\n",
+				dropped);
+	}
+	return nodes;
+}
+
+auto valid_nodes(
+		std::span<const PointNode> nodes,
+		uint64_t point_count) -> bool {
+	for (auto i = size_t{}; i < nodes.size(); i++) {
+		const auto& node = nodes[i];
+		auto children = static_cast<uint32_t>(std::popcount(node.child_mask));
+		// Children after their parent, so the tree has no cycles.
+		auto valid = node.point_count <= g_point_page_size &&
+				node.first_point <= point_count &&
+				node.point_count <= point_count - node.first_point &&
+				node.child_mask < (1U << 8U) &&
+				(children == 0 ||
+				 (node.first_child > i && node.first_child <= nodes.size() &&
+					children <= nodes.size() - node.first_child));
+		if (!valid) {
+			return false;
+		}
+	}
+	return true;
+}
+
+auto in_frustum(const Frustum& frustum, glm::vec3 center, float radius)
+		-> bool {
+	return std::all_of(
+			frustum.planes.begin(),
+			frustum.planes.end(),
+			[&](const glm::vec4& plane) {
+				return glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+			});
+}
+
+// Frees the least recently drawn page that no frame in flight draws.
+auto evict_page(PointRenderer& renderer) -> bool {
+	auto node_count = renderer.node_pages.size();
+	auto oldest = renderer.page_nodes.size();
+	for (auto page = size_t{}; page < renderer.page_nodes.size(); page++) {
+		auto node = renderer.page_nodes[page];
+		if (node == node_count || renderer.loading[node] ||
+				renderer.page_used[page] + renderer.frames.size() >= renderer.frame) {
+			continue;
+		}
+		if (oldest == renderer.page_nodes.size() ||
+				renderer.page_used[page] < renderer.page_used[oldest]) {
+			oldest = page;
+		}
+	}
+	if (oldest == renderer.page_nodes.size()) {
+		return false;
+	}
+	renderer.node_pages[renderer.page_nodes[oldest]] = g_point_page_absent;
+	renderer.page_nodes[oldest] = static_cast<uint32_t>(node_count);
+	renderer.free_pages.emplace_back(static_cast<uint32_t>(oldest));
+	return true;
+}
+
+}  // namespace
+
+auto cook_point_cloud(
+		const std::filesystem::path& input,
+		const std::filesystem::path& output) -> bool {
+	auto points = std::vector<CloudPoint>{};
+	if (!read_points(input, points)) {
+		return false;
+	}
+	auto low = points.front().position;
+	auto high = low;
+	for (const auto& point : points) {
+		low = glm::min(low, point.position);
+		high = glm::max(high, point.position);
+	}
+	auto center = (low + high) * 0.5F;
+	auto extent = high - low;
+	// A cube around the box, never empty.
+	auto half_size =
+			std::max(std::max({extent.x, extent.y, extent.z}) * 0.5F, 1e-6F);
+	auto nodes = build_octree(points, center, half_size);
+
+	auto header = CookedPointHeader{
+			.magic = g_cooked_point_magic,
+			.version = g_cooked_point_version,
+			.node_count = static_cast<uint32_t>(nodes.size()),
+			.point_count = points.size(),
+			.nodes_offset = sizeof(CookedPointHeader),
+			.points_offset =
+					sizeof(CookedPointHeader) + nodes.size() * sizeof(PointNode),
+			.bounding_sphere = {
+					center.x,
+					center.y,
+					center.z,
+					std::max(glm::length(extent) * 0.5F, 1e-6F)},
+			.padding = {}};
+	auto file = std::ofstream(output, std::ios::binary | std::ios::trunc);
+	// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(
+			reinterpret_cast<const char*>(nodes.data()),
+			static_cast<std::streamsize>(nodes.size() * sizeof(PointNode)));
+	file.write(
+			reinterpret_cast<const char*>(points.data()),
+			static_cast<std::streamsize>(points.size() * sizeof(CloudPoint)));
+	// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+	if (!file) {
+		fmt::print(stderr, "Failed to write point cloud {}\n", output.string());
+		return false;
+	}
+	return true;
+}
+
+auto open_point_cloud(const std::filesystem::path& path) -> PointCloud {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map point cloud {}\n", path.string());
+		std::terminate();
+	}
+	auto header = CookedPointHeader{};
+	auto size = file->bytes.size();
+	if (size >= sizeof(header)) {
+		std::memcpy(&header, file->bytes.data(), sizeof(header));
+	}
+	if (header.magic != g_cooked_point_magic ||
+			header.version != g_cooked_point_version) {
+		fmt::print(
+				stderr,
+				"{} is not a cooked point cloud of this version\n",
+				path.string());
+		std::terminate();
+	}
+	auto cloud = PointCloud{};
+	auto valid = header.node_count > 0 &&
+			header.nodes_offset == sizeof(header) &&
+			header.points_offset == header.nodes_offset +
+							uint64_t{header.node_count} * sizeof(PointNode) &&
+			header.points_offset <= size &&
+			header.point_count <=
+					(size - header.points_offset) / sizeof(CloudPoint);
+	if (valid) {
+		const auto* bytes = file->bytes.data();
+		// The mapping is page aligned and the offsets are aligned for both.
+		// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast)
+		cloud.nodes = std::span(
+				reinterpret_cast<const PointNode*>(bytes + header.nodes_offset),
+				header.node_count);
+		cloud.points = std::span(
+				reinterpret_cast<const CloudPoint*>(bytes + header.points_offset),
+				header.point_count);
+		// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast)
+		valid = valid_nodes(cloud.nodes, header.point_count);
+	}
+	if (!valid) {
+		fmt::print(stderr, "Cooked point cloud {} is malformed\n", path.string());
+		std::terminate();
+	}
+	cloud.file = *file;
+	cloud.bounding_sphere = glm::vec4(
+			header.bounding_sphere[0],
+			header.bounding_sphere[1],
+			header.bounding_sphere[2],
+			header.bounding_sphere[3]);
+	return cloud;
+}
+
+void close_point_cloud(PointCloud& cloud) {
+	unmap_file(cloud.file);
+	cloud = PointCloud{};
+}
+
+auto create_point_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& splat_module,
+		VkShaderModule& resolve_module,
+		const VkSpecializationInfo* specialization,
+		const PointCloud& cloud,
+		size_t frame_count) -> PointRenderer {
+	auto renderer = PointRenderer{};
+
+	auto scene_binding = VkDescriptorSetLayoutBinding{
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.pImmutableSamplers = VK_NULL_HANDLE};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = 1,
+			.pBindings = &scene_binding};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&renderer.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create point cloud set layout\n");
+		std::terminate();
+	}
+
+	// Both passes share the layout, splatting leaves set 1 unbound.
+	auto set_layouts = std::array{bindless.set_layout, renderer.set_layout};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(PointConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&renderer.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create point cloud pipeline layout\n");
+		std::terminate();
+	}
+	renderer.splat_pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			renderer.pipeline_layout,
+			splat_module,
+			specialization,
+			0);
+	renderer.resolve_pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			renderer.pipeline_layout,
+			resolve_module,
+			specialization,
+			0);
+
+	auto pool_size =
+			VkDeviceSize{sizeof(CloudPoint)} * g_point_page_size * g_point_pages;
+	renderer.pool = create_buffer(
+			device,
+			allocator,
+			pool_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	renderer.pool_handle =
+			add_bindless_buffer(device, bindless, renderer.pool.handle, 0, pool_size);
+	auto node_count = static_cast<uint32_t>(cloud.nodes.size());
+	renderer.node_pages.assign(node_count, g_point_page_absent);
+	renderer.loading.assign(node_count, false);
+	renderer.page_nodes.assign(g_point_pages, node_count);
+	renderer.page_used.assign(g_point_pages, 0);
+	for (auto page = g_point_pages; page > 0; page--) {
+		renderer.free_pages.emplace_back(page - 1);
+	}
+
+	// The table is read in place like the uniform ring.
+	auto draws_size = VkDeviceSize{sizeof(PointDraw)} * g_point_pages;
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = renderer.frames.emplace_back();
+		frame.draws = create_dynamic_buffer(
+				device,
+				allocator,
+				draws_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.draws_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.draws.handle,
+				0,
+				draws_size);
+	}
+	return renderer;
+}
+
+void destroy_point_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		PointRenderer& renderer) {
+	for (auto& frame : renderer.frames) {
+		remove_bindless_buffer(device, bindless, frame.draws_handle);
+		destroy_buffer(device, allocator, frame.draws);
+	}
+	if (renderer.splats.handle != VK_NULL_HANDLE) {
+		remove_bindless_buffer(device, bindless, renderer.splats_handle);
+		destroy_buffer(device, allocator, renderer.splats);
+	}
+	remove_bindless_buffer(device, bindless, renderer.pool_handle);
+	destroy_buffer(device, allocator, renderer.pool);
+	vkDestroyPipeline(device, renderer.resolve_pipeline, host_callbacks());
+	vkDestroyPipeline(device, renderer.splat_pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, renderer.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, renderer.set_layout, host_callbacks());
+	renderer = PointRenderer{};
+}
+
+void update_point_cloud(
+		VkDevice& device,
+		Uploader& uploader,
+		PointRenderer& renderer,
+		const PointCloud& cloud,
+		size_t frame_idx,
+		const glm::mat4& transform,
+		float lod_scale) {
+	renderer.frame++;
+	std::erase_if(renderer.pending, [&](const PendingNode& pending) {
+		if (!upload_complete(device, uploader, pending.ticket)) {
+			return false;
+		}
+		renderer.node_pages[pending.node] = pending.page + 1;
+		renderer.loading[pending.node] = false;
+		return true;
+	});
+
+	auto frustum = extract_frustum(transform);
+	auto rows = glm::transpose(transform);
+	auto scale = std::max(
+			glm::length(glm::vec3(rows[0])),
+			glm::length(glm::vec3(rows[1])));
+	auto w_scale = glm::length(glm::vec3(rows[3]));
+	auto draws = std::span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<PointDraw*>(
+					renderer.frames.at(frame_idx).draws.allocation.mapped),
+			g_point_pages);
+	auto draw_count = 0U;
+	// Breadth first, so the requests come coarsest first.
+	renderer.requests.clear();
+	renderer.visit.assign(1, 0);
+	for (auto i = size_t{}; i < renderer.visit.size(); i++) {
+		auto node_idx = renderer.visit[i];
+		const auto& node = cloud.nodes[node_idx];
+		auto radius = node.half_size * std::sqrt(3.0F);
+		if (!in_frustum(frustum, node.center, radius)) {
+			continue;
+		}
+		auto page = renderer.node_pages[node_idx];
+		if (page == g_point_page_absent) {
+			if (!renderer.loading[node_idx]) {
+				renderer.requests.emplace_back(node_idx);
+			}
+			continue;
+		}
+		renderer.page_used[page - 1] = renderer.frame;
+		draws[draw_count] = PointDraw{
+				.first_point = (page - 1) * g_point_page_size,
+				.point_count = node.point_count};
+		draw_count++;
+		// Clip w of the node's nearest point, and its points' spacing.
+		auto w = glm::dot(rows[3], glm::vec4(node.center, 1.0F)) -
+				radius * w_scale;
+		auto spacing =
+				node.half_size * 2.0F / static_cast<float>(g_point_node_grid);
+		auto fine_enough = w > 0.0F && spacing * scale * lod_scale <= w;
+		if (node.child_mask == 0 || fine_enough) {
+			continue;
+		}
+		auto children = static_cast<uint32_t>(std::popcount(node.child_mask));
+		for (auto child = 0U; child < children; child++) {
+			renderer.visit.emplace_back(node.first_child + child);
+		}
+	}
+	renderer.draw_count = draw_count;
+	renderer.transform = transform;
+
+	auto wanted = std::min<size_t>(
+			renderer.requests.size(),
+			g_point_stream_budget);
+	while (renderer.free_pages.size() < wanted && evict_page(renderer)) {
+	}
+	for (auto i = size_t{}; i < wanted && !renderer.free_pages.empty(); i++) {
+		auto page = renderer.free_pages.back();
+		renderer.free_pages.pop_back();
+		auto node_idx = renderer.requests[i];
+		const auto& node = cloud.nodes[node_idx];
+		renderer.page_nodes[page] = node_idx;
+		renderer.page_used[page] = renderer.frame;
+		renderer.loading[node_idx] = true;
+		// Reading the points faults them in from the file.
+		upload_buffer(
+				device,
+				uploader,
+				renderer.pool.handle,
+				VkDeviceSize{sizeof(CloudPoint)} * page * g_point_page_size,
+				std::as_bytes(cloud.points.subspan(node.first_point, node.point_count)),
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+		renderer.pending.emplace_back(PendingNode{
+				.node = node_idx,
+				.page = page,
+				.ticket = uploader.next_ticket});
+	}
+}
+
+void resize_point_splats(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		BindlessTable& bindless,
+		PointRenderer& renderer,
+		VkExtent2D target_extent) {
+	if (target_extent.width == renderer.extent.width &&
+			target_extent.height == renderer.extent.height) {
+		return;
+	}
+	if (renderer.splats.handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device,
+				 &allocator,
+				 &bindless,
+				 splats = renderer.splats,
+				 handle = renderer.splats_handle]() mutable {
+					remove_bindless_buffer(device, bindless, handle);
+					destroy_buffer(device, allocator, splats);
+				});
+	}
+	renderer.extent = target_extent;
+	auto size = VkDeviceSize{sizeof(uint64_t)} * target_extent.width *
+			target_extent.height;
+	renderer.splats = create_buffer(
+			device,
+			allocator,
+			size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	renderer.splats_handle =
+			add_bindless_buffer(device, bindless, renderer.splats.handle, 0, size);
+}
+
+void add_point_cloud_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		PointRenderer& renderer,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		uint32_t scene,
+		VkExtent2D render_extent) {
+	auto constants = PointConstants{
+			.transform = renderer.transform,
+			.pool = renderer.pool_handle,
+			.draws = renderer.frames.at(frame_idx).draws_handle,
+			.splats = renderer.splats_handle,
+			.stride = renderer.extent.width,
+			.width = std::min(render_extent.width, renderer.extent.width),
+			.height = std::min(render_extent.height, renderer.extent.height),
+			.padding = {}};
+	auto draw_count = renderer.draw_count;
+	// The last frame's resolve is the last read of the splats.
+	auto splats = import_graph_buffer(
+			graph,
+			renderer.splats.handle,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED},
+			std::nullopt);
+
+	auto record_clear = [&renderer](VkCommandBuffer command_buffer) {
+		vkCmdFillBuffer(
+				command_buffer,
+				renderer.splats.handle,
+				0,
+				VK_WHOLE_SIZE,
+				0);
+	};
+	auto clear_pass = add_graph_pass(graph, "point_clear", record_clear, false);
+	graph_write(
+			graph,
+			clear_pass,
+			splats,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+					.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+
+	auto record_splat = [&profiler, &renderer, &bindless, frame_idx, constants,
+											 draw_count](VkCommandBuffer command_buffer) {
+		if (draw_count == 0) {
+			return;
+		}
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "point_splat");
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				renderer.splat_pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				renderer.pipeline_layout,
+				bindless);
+		vkCmdPushConstants(
+				command_buffer,
+				renderer.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				g_point_page_size / g_point_group_size,
+				draw_count,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto splat_pass = add_graph_pass(graph, "point_splat", record_splat, false);
+	graph_write(graph, splat_pass, splats, g_storage_update);
+
+	auto record_resolve = [&device, &graph, &profiler, &descriptors, &renderer,
+												 &bindless, frame_idx, constants,
+												 scene](VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "point_resolve");
+		auto* set = allocate_frame_set(
+				device,
+				descriptors,
+				frame_idx,
+				renderer.set_layout);
+		auto image = VkDescriptorImageInfo{
+				.sampler = VK_NULL_HANDLE,
+				.imageView = graph_image_view(graph, scene),
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+		auto write = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = 0,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = &image,
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE};
+		vkUpdateDescriptorSets(device, 1, &write, 0, VK_NULL_HANDLE);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				renderer.resolve_pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				renderer.pipeline_layout,
+				bindless);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				renderer.pipeline_layout,
+				1,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		vkCmdPushConstants(
+				command_buffer,
+				renderer.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(constants.width + g_point_tile_size - 1) / g_point_tile_size,
+				(constants.height + g_point_tile_size - 1) / g_point_tile_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto resolve_pass =
+			add_graph_pass(graph, "point_resolve", record_resolve, false);
+	graph_read(graph, resolve_pass, splats, g_storage_read);
+	graph_write(graph, resolve_pass, scene, g_storage_update);
+}
+
+auto point_cloud_fit(const PointCloud& cloud, glm::vec4 sphere) -> glm::mat4 {
+	auto scale = sphere.w / cloud.bounding_sphere.w;
+	auto fit = glm::mat4(scale);
+	fit[3] = glm::vec4(
+			glm::vec3(sphere) - glm::vec3(cloud.bounding_sphere) * scale,
+			1.0F);
+	return fit;
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "deletion.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "upload.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+// Points a node holds at most, and a page of the pool. Matches the dispatch
+// of point_splat.comp, whose workgroups splat g_point_group_size each.
+constexpr auto g_point_page_size = 16384U;
+constexpr auto g_point_group_size = 256U;
+// Cells a node's cube is split into along each side when cooking. A node
+// keeps one point per cell, so its points are about a cell apart and the
+// rest go to its children.
+constexpr auto g_point_node_grid = 64U;
+constexpr auto g_max_point_depth = 20U;
+// Pages of the pool on the device, and pages streamed into it per frame at
+// most.
+constexpr auto g_point_pages = 512U;
+constexpr auto g_point_stream_budget = 16U;
+// Matches local_size of the RESOLVE variant of point_splat.comp, a
+// workgroup resolves a tile of this many pixels squared.
+constexpr auto g_point_tile_size = 8U;
+
+// A point and its sRGB color, red in the low byte. Layout matches
+// point_splat.comp.
+struct CloudPoint {
+	glm::vec3 position{};
+	uint32_t color{};
+};
+static_assert(sizeof(CloudPoint) == 16);
+
+// A cube of the octree. Its points are a sample of everything inside it, one
+// per cell of a g_point_node_grid grid, and its children hold the points it
+// left out. Children are stored consecutively from first_child, in the
+// order of the bits set in child_mask: bit x * 4 + y * 2 + z for the octant
+// on the positive side in the axes set.
+struct PointNode {
+	glm::vec3 center{};
+	float half_size{};
+	uint64_t first_point{};
+	uint32_t point_count{};
+	uint32_t first_child{};
+	uint32_t child_mask{};
+	std::array<uint32_t, 3> padding{};
+};
+static_assert(sizeof(PointNode) == 48);
+
+// A cooked point cloud, mapped. The nodes and points are read from the
+// mapping as they are streamed, so only the pages in use are touched and the
+// file can be far larger than memory.
+struct PointCloud {
+	MappedFile file;
+	std::span<const PointNode> nodes;
+	std::span<const CloudPoint> points;
+	// Center in xyz, radius in w.
+	glm::vec4 bounding_sphere{};
+};
+
+// Reads the "x y z [r g b]" lines of a text file, the colors either all in
+// 0 to 1 or all in 0 to 255, builds the octree and writes it to output: a
+// header, the nodes top down, then the points in the order of the nodes.
+auto cook_point_cloud(
+		const std::filesystem::path& input,
+		const std::filesystem::path& output) -> bool;
+// Maps a cooked point cloud after checking it.
+auto open_point_cloud(const std::filesystem::path& path) -> PointCloud;
+void close_point_cloud(PointCloud& cloud);
+
+// A page to splat, the pool index of its first point. Layout matches
+// point_splat.comp.
+struct PointDraw {
+	uint32_t first_point{};
+	uint32_t point_count{};
+};
+
+// A frame in flight's draw table.
+struct PointFrame {
+	Buffer draws;
+	BindlessHandle draws_handle{};
+};
+
+struct PendingNode {
+	uint32_t node{};
+	uint32_t page{};
+	UploadTicket ticket{};
+};
+
+// A compute rasterizer for point clouds too big and too dense for point
+// primitives. Each page of points is splatted by one row of workgroups,
+// which project their points and keep the nearest of each pixel with a
+// 64-bit atomic max of the reversed depth over the color. The resolve pass
+// then writes the pixels that got a point into the scene, taken as a
+// storage image through set 1 like the visibility pass's. The splats are
+// not tested against the scene's depth, so the points are drawn over it.
+//
+// The octree is streamed into a pool of fixed size pages, a node per page,
+// like the pages of a virtual texture: a frame draws the resident nodes in
+// the frustum whose parents were too coarse, and loads the missing ones
+// coarsest first. Children are only visited once their parent is resident,
+// so there always is a coarser sample where a node is still loading. Pages
+// of nodes no frame in flight draws are evicted least recently used first.
+struct PointRenderer {
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline splat_pipeline{};
+	VkPipeline resolve_pipeline{};
+	Buffer pool;
+	BindlessHandle pool_handle{};
+	// A uint64_t per pixel of extent, rows of extent.width, cleared every
+	// frame.
+	Buffer splats;
+	BindlessHandle splats_handle{};
+	VkExtent2D extent{};
+	// Page held by each node plus one, or 0 when it is not resident.
+	std::vector<uint32_t> node_pages;
+	// Node held by each page, or the node count when it is empty.
+	std::vector<uint32_t> page_nodes;
+	// Frame each page was last drawn on.
+	std::vector<uint64_t> page_used;
+	std::vector<uint32_t> free_pages;
+	std::vector<PendingNode> pending;
+	// Whether a node is pending, indexed like the nodes.
+	std::vector<bool> loading;
+	std::vector<PointFrame> frames;
+	uint64_t frame{};
+	// What the frame's passes splat, set by update_point_cloud.
+	glm::mat4 transform{1.0F};
+	uint32_t draw_count{};
+	std::vector<uint32_t> visit;
+	std::vector<uint32_t> requests;
+};
+
+// splat_module and resolve_module are point_splat.comp and its RESOLVE
+// variant, specialized for the bindless table.
+auto create_point_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& splat_module,
+		VkShaderModule& resolve_module,
+		const VkSpecializationInfo* specialization,
+		const PointCloud& cloud,
+		size_t frame_count) -> PointRenderer;
+// The device must be idle.
+void destroy_point_renderer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		PointRenderer& renderer);
+
+// Picks the nodes the frame slot draws through transform, which takes the
+// cloud to clip space, writes its draw table and loads missing nodes into the
+// uploader's current batch. Refines nodes whose point spacing is more than
+// 1 / lod_scale of the clip w they are seen at, like select_mesh_lod. The
+// slot's last frame must be complete.
+void update_point_cloud(
+		VkDevice& device,
+		Uploader& uploader,
+		PointRenderer& renderer,
+		const PointCloud& cloud,
+		size_t frame_idx,
+		const glm::mat4& transform,
+		float lod_scale);
+
+// Recreates the splat buffer when the output's extent changed, the old one
+// is destroyed once the frames using it are done. Scaled render extents fit
+// into it, so dynamic resolution does not recreate it.
+void resize_point_splats(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		BindlessTable& bindless,
+		PointRenderer& renderer,
+		VkExtent2D target_extent);
+
+// Adds the passes splatting the frame's nodes and resolving them into the
+// top left render_extent of scene, which must have g_post_scene_format and
+// STORAGE usage.
+void add_point_cloud_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		PointRenderer& renderer,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		uint32_t scene,
+		VkExtent2D render_extent);
+
+// Scales and moves the cloud's bounding sphere onto sphere, so the cloud
+// is seen where the mesh is.
+auto point_cloud_fit(const PointCloud& cloud, glm::vec4 sphere) -> glm::mat4;
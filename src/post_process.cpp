@@ -0,0 +1,423 @@
+#include "post_process.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+#include <span>
+#include <string_view>
+
+namespace {
+
+constexpr auto g_post_input_binding = 0U;
+constexpr auto g_post_bloom_binding = 1U;
+constexpr auto g_post_output_binding = 2U;
+
+constexpr auto g_sampled_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// The resources one dispatch binds. bloom is only read by the composite.
+struct PostBindings {
+	uint32_t input{};
+	uint32_t bloom{g_graph_imported};
+	uint32_t output{};
+};
+
+auto half(VkExtent2D extent) -> VkExtent2D {
+	return VkExtent2D{
+			.width = (extent.width + 1) / 2,
+			.height = (extent.height + 1) / 2};
+}
+
+auto group_count(uint32_t size, uint32_t group_size) -> uint32_t {
+	return (size + group_size - 1) / group_size;
+}
+
+// Writes the pass's set for this frame's views.
+auto write_post_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		DescriptorAllocator& descriptors,
+		const PostProcess& post,
+		size_t frame_idx,
+		const PostBindings& bindings) -> FrameSet {
+	auto sampled = [&](uint32_t binding, uint32_t image) {
+		return FrameImageDescriptor{
+				.binding = binding,
+				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.image = VkDescriptorImageInfo{
+						.sampler = post.sampler,
+						.imageView = graph_image_view(graph, image),
+						.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+	};
+	auto image_descriptors = std::array{
+			sampled(g_post_input_binding, bindings.input),
+			FrameImageDescriptor{
+					.binding = g_post_output_binding,
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.image = VkDescriptorImageInfo{
+							.sampler = VK_NULL_HANDLE,
+							.imageView = graph_image_view(graph, bindings.output),
+							.imageLayout = VK_IMAGE_LAYOUT_GENERAL}},
+			FrameImageDescriptor{},
+	};
+	// Bindings a pipeline does not use may stay unwritten.
+	auto count = size_t{2};
+	if (bindings.bloom != g_graph_imported) {
+		image_descriptors.at(2) = sampled(g_post_bloom_binding, bindings.bloom);
+		count = 3;
+	}
+	return write_frame_set(
+			device,
+			descriptors,
+			frame_idx,
+			post.set_layout,
+			std::span(image_descriptors).first(count));
+}
+
+void add_post_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		PostProcess& post,
+		size_t frame_idx,
+		std::string_view name,
+		VkPipeline pipeline,
+		const PostBindings& bindings,
+		const PostConstants& constants,
+		VkExtent2D groups) {
+	auto record = [&device, &graph, &profiler, &descriptors, &post, frame_idx,
+								 name, pipeline, bindings, constants, groups](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass = begin_gpu_pass(profiler, command_buffer, frame_idx, name);
+		auto set =
+				write_post_set(device, graph, descriptors, post, frame_idx, bindings);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		bind_frame_set(
+				command_buffer,
+				descriptors,
+				frame_idx,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				post.pipeline_layout,
+				0,
+				set);
+		vkCmdPushConstants(
+				command_buffer,
+				post.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(command_buffer, groups.width, groups.height, 1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, name, record, false);
+	graph_read(graph, pass, bindings.input, g_sampled_read);
+	if (bindings.bloom != g_graph_imported) {
+		graph_read(graph, pass, bindings.bloom, g_sampled_read);
+	}
+	graph_write(graph, pass, bindings.output, g_storage_write);
+}
+
+}  // namespace
+
+auto post_output_format(OutputTransfer transfer) -> VkFormat {
+	switch (transfer) {
+		case OutputTransfer::srgb:
+		case OutputTransfer::pq:
+			return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+		case OutputTransfer::linear:
+			return VK_FORMAT_R16G16B16A16_SFLOAT;
+		case OutputTransfer::hardware_srgb:
+			break;
+	}
+	return VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+auto post_composite_variant(OutputTransfer transfer) -> ShaderVariant {
+	switch (transfer) {
+		case OutputTransfer::srgb:
+			return g_shader_variant_output_10bit;
+		case OutputTransfer::pq:
+			return g_shader_variant_output_10bit | g_shader_variant_output_hdr;
+		case OutputTransfer::linear:
+			return g_shader_variant_output_hdr;
+		case OutputTransfer::hardware_srgb:
+			break;
+	}
+	return 0;
+}
+
+auto create_post_process(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& downsample_module,
+		VkShaderModule& blur_module,
+		VkShaderModule& composite_module,
+		OutputTransfer transfer,
+		const DescriptorAllocator& descriptors) -> PostProcess {
+	auto post = PostProcess{};
+	post.transfer = transfer;
+	// Inputs are sampled linearly where bloom is upsampled, and fetched
+	// texel by texel everywhere else.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	post.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto sampled_binding = [&](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = &post.sampler};
+	};
+	auto bindings = std::array{
+			sampled_binding(g_post_input_binding),
+			sampled_binding(g_post_bloom_binding),
+			VkDescriptorSetLayoutBinding{
+					.binding = g_post_output_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_layout_flags(descriptors),
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&post.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create post-processing set layout\n");
+		std::terminate();
+	}
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(PostConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &post.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&post.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create post-processing pipeline layout\n");
+		std::terminate();
+	}
+	post.downsample = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			post.pipeline_layout,
+			downsample_module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	post.blur = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			post.pipeline_layout,
+			blur_module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	post.composite = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			post.pipeline_layout,
+			composite_module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	return post;
+}
+
+void destroy_post_process(
+		VkDevice& device,
+		SamplerCache& samplers,
+		PostProcess& post) {
+	vkDestroyPipeline(device, post.downsample, host_callbacks());
+	vkDestroyPipeline(device, post.blur, host_callbacks());
+	vkDestroyPipeline(device, post.composite, host_callbacks());
+	vkDestroyPipelineLayout(device, post.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, post.set_layout, host_callbacks());
+	release_sampler(device, samplers, post.sampler);
+	post = PostProcess{};
+}
+
+void add_post_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		PostProcess& post,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t output,
+		VkExtent2D render_extent,
+		VkExtent2D image_extent) {
+	// Like the scene, bloom is sized after the images rather than the render
+	// extent, so a new scale does not recreate it.
+	auto bloom_image_extent = half(image_extent);
+	auto bloom_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_post_bloom_format,
+			.extent =
+					VkExtent3D{
+							.width = bloom_image_extent.width,
+							.height = bloom_image_extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	auto bloom =
+			add_transient_image(graph, bloom_info, VK_IMAGE_ASPECT_COLOR_BIT);
+	auto blurred =
+			add_transient_image(graph, bloom_info, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	// PQ is relative to 10000 nits, scRGB's 1.0 is 80 nits.
+	const auto& settings = post.settings;
+	auto output_peak = 1.0F;
+	auto output_scale = 1.0F;
+	if (post.transfer == OutputTransfer::pq) {
+		output_peak = settings.peak_nits / settings.paper_white_nits;
+		output_scale = settings.paper_white_nits / 10000.0F;
+	} else if (post.transfer == OutputTransfer::linear) {
+		output_peak = settings.peak_nits / settings.paper_white_nits;
+		output_scale = settings.paper_white_nits / 80.0F;
+	}
+
+	auto bloom_extent = half(render_extent);
+	auto constants = PostConstants{
+			.width = static_cast<int32_t>(bloom_extent.width),
+			.height = static_cast<int32_t>(bloom_extent.height),
+			.direction_x = 1,
+			.direction_y = 0,
+			.bloom_texel_x = 1.0F / static_cast<float>(bloom_image_extent.width),
+			.bloom_texel_y = 1.0F / static_cast<float>(bloom_image_extent.height),
+			.bloom_threshold = settings.bloom_threshold,
+			.bloom_strength = settings.bloom_strength,
+			.exposure = settings.exposure,
+			.contrast = settings.contrast,
+			.saturation = settings.saturation,
+			.sharpen = settings.sharpen,
+			.output_peak = output_peak,
+			.output_scale = output_scale};
+	auto bloom_groups = VkExtent2D{
+			.width = group_count(bloom_extent.width, g_post_group_size),
+			.height = group_count(bloom_extent.height, g_post_group_size)};
+	add_post_pass(
+			device,
+			graph,
+			profiler,
+			descriptors,
+			post,
+			frame_idx,
+			"bloom_downsample",
+			post.downsample,
+			PostBindings{.input = scene, .bloom = g_graph_imported, .output = bloom},
+			constants,
+			bloom_groups);
+
+	// A blur workgroup covers a run of one row or column.
+	add_post_pass(
+			device,
+			graph,
+			profiler,
+			descriptors,
+			post,
+			frame_idx,
+			"bloom_blur_x",
+			post.blur,
+			PostBindings{
+					.input = bloom,
+					.bloom = g_graph_imported,
+					.output = blurred},
+			constants,
+			VkExtent2D{
+					.width = group_count(bloom_extent.width, g_bloom_blur_group_size),
+					.height = bloom_extent.height});
+	constants.direction_x = 0;
+	constants.direction_y = 1;
+	add_post_pass(
+			device,
+			graph,
+			profiler,
+			descriptors,
+			post,
+			frame_idx,
+			"bloom_blur_y",
+			post.blur,
+			PostBindings{
+					.input = blurred,
+					.bloom = g_graph_imported,
+					.output = bloom},
+			constants,
+			VkExtent2D{
+					.width = group_count(bloom_extent.height, g_bloom_blur_group_size),
+					.height = bloom_extent.width});
+
+	constants.width = static_cast<int32_t>(render_extent.width);
+	constants.height = static_cast<int32_t>(render_extent.height);
+	add_post_pass(
+			device,
+			graph,
+			profiler,
+			descriptors,
+			post,
+			frame_idx,
+			"post_composite",
+			post.composite,
+			PostBindings{.input = scene, .bloom = bloom, .output = output},
+			constants,
+			VkExtent2D{
+					.width = group_count(render_extent.width, g_post_group_size),
+					.height = group_count(render_extent.height, g_post_group_size)});
+}
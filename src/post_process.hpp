@@ -0,0 +1,122 @@
+#pragma once
+
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "shaders.hpp"
+#include "surface_format.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Matches local_size in bloom_downsample.comp and post_composite.comp.
+constexpr auto g_post_group_size = 8U;
+// Matches local_size_x in bloom_blur.comp.
+constexpr auto g_bloom_blur_group_size = 64U;
+// The scene is drawn in linear HDR and bloom is kept at half its resolution.
+// The composite's output format depends on the swap chain's, see
+// post_output_format.
+constexpr auto g_post_scene_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr auto g_post_bloom_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+struct PostSettings {
+	// Brightness above which the scene blooms.
+	float bloom_threshold{1.0F};
+	float bloom_strength{0.5F};
+	float exposure{1.0F};
+	// Around mid grey, after tonemapping.
+	float contrast{1.05F};
+	float saturation{1.1F};
+	// Weight of the unsharp mask, 0 turns sharpening off.
+	float sharpen{0.25F};
+	// Brightness of SDR white and the display's peak on HDR outputs, BT.2408
+	// suggests 203 nits for the former.
+	float paper_white_nits{203.0F};
+	float peak_nits{1000.0F};
+};
+
+// Push constants of the post shaders. Layout matches them.
+struct PostConstants {
+	// Pixels the dispatch writes.
+	int32_t width{};
+	int32_t height{};
+	// Axis bloom_blur.comp blurs along.
+	int32_t direction_x{};
+	int32_t direction_y{};
+	// 1 / the bloom image's size, for sampling it normalized.
+	float bloom_texel_x{};
+	float bloom_texel_y{};
+	float bloom_threshold{};
+	float bloom_strength{};
+	float exposure{};
+	float contrast{};
+	float saturation{};
+	float sharpen{};
+	// Brightest output, relative to SDR white.
+	float output_peak{};
+	// What SDR white is in the output's units.
+	float output_scale{};
+};
+static_assert(sizeof(PostConstants) == 56);
+
+// Post-processing as a short chain of compute dispatches instead of one
+// full-screen pass per effect. A downsample keeps the bright half-resolution
+// scene, a separable blur spreads it with its taps in shared memory, and a
+// single composite fuses sharpening, the bloom add, exposure, tonemapping and
+// color grading, so the full-resolution scene is read once and the output
+// written once. Each dispatch is a render graph pass, which places the
+// barriers between them. The passes use a descriptor set layout of their own:
+// binding 0 is the input, binding 1 the bloom the composite adds and
+// binding 2 the storage image written. Each pass writes a new set through
+// the DescriptorAllocator every frame, since transient views only exist
+// while the graph executes.
+struct PostProcess {
+	PostSettings settings;
+	OutputTransfer transfer{};
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline downsample{};
+	VkPipeline blur{};
+	VkPipeline composite{};
+};
+
+// The composite writes linear 8-bit for sRGB swap chains, which the blit
+// encodes, 10-bit for the transfers it encodes, and FP16 for scRGB.
+auto post_output_format(OutputTransfer transfer) -> VkFormat;
+// The post_composite.comp variant encoding for transfer.
+auto post_composite_variant(OutputTransfer transfer) -> ShaderVariant;
+
+// composite_module is the post_composite_variant for transfer. descriptors
+// is the allocator the passes are added with.
+auto create_post_process(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& downsample_module,
+		VkShaderModule& blur_module,
+		VkShaderModule& composite_module,
+		OutputTransfer transfer,
+		const DescriptorAllocator& descriptors) -> PostProcess;
+void destroy_post_process(
+		VkDevice& device,
+		SamplerCache& samplers,
+		PostProcess& post);
+
+// Adds the passes reading scene and writing output, which must have been
+// created with g_post_scene_format and the post_output_format. Only the top
+// left render_extent of both is used, out of images image_extent in size.
+// scene needs SAMPLED usage, output STORAGE usage.
+void add_post_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		PostProcess& post,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t output,
+		VkExtent2D render_extent,
+		VkExtent2D image_extent);
@@ -0,0 +1,737 @@
+#include "profiler.hpp"
+
+#include "capabilities.hpp"
+#include "hitch.hpp"
+#include "host_memory.hpp"
+#include "log.hpp"
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <numeric>
+#include <span>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+
+constexpr auto g_gpu_stats_window = size_t{256};
+constexpr auto g_gpu_report_interval = uint64_t{600};
+// Frames between calibrations, and the samples a calibration takes to find
+// one where the two timestamps were taken close together.
+constexpr auto g_calibration_interval = uint64_t{60};
+constexpr auto g_calibration_attempts = 3;
+constexpr auto g_pipeline_statistics =
+		VkQueryPipelineStatisticFlags{
+				VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT};
+// Results are written in bit order, one value per enabled statistic.
+constexpr auto g_pipeline_statistic_count = 3U;
+constexpr auto g_counter_names = std::array<std::string_view, 4>{
+		"vs invocations",
+		"clipping primitives",
+		"fs invocations",
+		"samples passed"};
+static_assert(g_counter_names.size() == g_gpu_counter_count);
+
+auto create_query_pool(
+		VkDevice& device,
+		VkQueryType type,
+		VkQueryPipelineStatisticFlags statistics) -> VkQueryPool {
+	auto query_pool_info = VkQueryPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.queryType = type,
+			.queryCount = g_max_gpu_passes * 2,
+			.pipelineStatistics = statistics};
+	auto* query_pool = VkQueryPool{};
+	if (vkCreateQueryPool(
+					device,
+					&query_pool_info,
+					host_callbacks(),
+					&query_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create query pool\n");
+		std::terminate();
+	}
+	return query_pool;
+}
+
+auto create_performance_pool(
+		VkDevice& device,
+		uint32_t queue_family_idx,
+		const std::vector<PerformanceCounter>& counters) -> VkQueryPool {
+	auto indices = std::vector<uint32_t>{};
+	for (const auto& counter : counters) {
+		indices.emplace_back(counter.index);
+	}
+	auto performance_info = VkQueryPoolPerformanceCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.queueFamilyIndex = queue_family_idx,
+			.counterIndexCount = static_cast<uint32_t>(indices.size()),
+			.pCounterIndices = indices.data()};
+	auto query_pool_info = VkQueryPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.pNext = &performance_info,
+			.flags = 0,
+			.queryType = VK_QUERY_TYPE_PERFORMANCE_QUERY_KHR,
+			.queryCount = g_max_gpu_passes,
+			.pipelineStatistics = 0};
+	auto* query_pool = VkQueryPool{};
+	if (vkCreateQueryPool(
+					device,
+					&query_pool_info,
+					host_callbacks(),
+					&query_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create performance query pool\n");
+		std::terminate();
+	}
+	return query_pool;
+}
+
+auto occlusion_flags(const GpuProfiler& profiler) -> VkQueryControlFlags {
+	if (profiler.precise_occlusion) {
+		return VK_QUERY_CONTROL_PRECISE_BIT;
+	}
+	return 0;
+}
+
+auto find_pass(GpuProfiler& profiler, std::string_view name) -> uint32_t {
+	for (auto i = size_t{}; i < profiler.passes.size(); i++) {
+		if (profiler.passes.at(i).name == name) {
+			return static_cast<uint32_t>(i);
+		}
+	}
+	auto& stats = profiler.passes.emplace_back();
+	stats.name = name;
+	stats.samples.reserve(g_gpu_stats_window);
+	return static_cast<uint32_t>(profiler.passes.size() - 1);
+}
+
+void add_sample(
+		const GpuProfiler& profiler,
+		GpuPassStats& stats,
+		double milliseconds) {
+	if (profiler.keep_history) {
+		stats.history.emplace_back(milliseconds);
+	}
+	if (stats.samples.size() < g_gpu_stats_window) {
+		stats.samples.emplace_back(milliseconds);
+	} else {
+		stats.samples.at(stats.next) = milliseconds;
+	}
+	stats.next = (stats.next + 1) % g_gpu_stats_window;
+}
+
+void print_samples(const GpuPassStats& stats, std::vector<double>& sorted) {
+	if (stats.samples.empty()) {
+		return;
+	}
+	sorted.assign(stats.samples.begin(), stats.samples.end());
+	std::sort(sorted.begin(), sorted.end());
+	auto sum = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+	auto p99 = sorted.at((sorted.size() - 1) * 99 / 100);
+	log_message(
+			LogLevel::info,
+			"GPU {}: min {:.3f} ms, avg {:.3f} ms, p99 {:.3f} ms",
+			stats.name,
+			sorted.front(),
+			sum / static_cast<double>(sorted.size()),
+			p99);
+}
+
+void print_stats(GpuProfiler& profiler) {
+	auto sorted = std::vector<double>{};
+	print_samples(profiler.start_latency, sorted);
+	for (auto& stats : profiler.passes) {
+		print_samples(stats, sorted);
+		if (stats.counter_frames != 0) {
+			for (auto i = size_t{}; i < g_gpu_counter_count; i++) {
+				auto collected = i < g_pipeline_statistic_count
+						? profiler.statistics
+						: profiler.occlusion;
+				if (!collected) {
+					continue;
+				}
+				log_message(
+						LogLevel::info,
+						"GPU {}: {} {} per frame",
+						stats.name,
+						g_counter_names.at(i),
+						stats.counter_totals.at(i) / stats.counter_frames);
+			}
+			stats.counter_totals = {};
+			stats.counter_frames = 0;
+		}
+		if (stats.performance_frames != 0) {
+			for (auto i = size_t{}; i < profiler.performance_counters.size(); i++) {
+				const auto& counter = profiler.performance_counters.at(i);
+				log_message(
+						LogLevel::info,
+						"GPU {}: {} {:.3f} {} per frame",
+						stats.name,
+						counter.name,
+						stats.performance_totals.at(i) /
+								static_cast<double>(stats.performance_frames),
+						performance_counter_unit(counter));
+			}
+		}
+	}
+}
+
+// Converts a value of g_host_time_domain.
+auto host_time(uint64_t value) -> std::chrono::steady_clock::time_point {
+#ifdef _WIN32
+	auto frequency = LARGE_INTEGER{};
+	QueryPerformanceFrequency(&frequency);
+	auto ticks_per_second = static_cast<uint64_t>(frequency.QuadPart);
+	auto nanoseconds = value / ticks_per_second * 1'000'000'000 +
+			value % ticks_per_second * 1'000'000'000 / ticks_per_second;
+#else
+	auto nanoseconds = value;
+#endif
+	return std::chrono::steady_clock::time_point(
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::nanoseconds(nanoseconds)));
+}
+
+// The mask of a timestamp's valid bits.
+auto valid_bits_mask(uint32_t valid_bits) -> uint64_t {
+	return valid_bits >= 64 ? UINT64_MAX : (uint64_t{1} << valid_bits) - 1;
+}
+
+// The host time of a timestamp masked to timestamp_mask, which may be before
+// or after the calibration. A queue with fewer valid bits counts the same
+// ticks, so the calibration is compared modulo its mask.
+auto gpu_host_time(
+		const GpuProfiler& profiler,
+		uint64_t ticks,
+		uint64_t timestamp_mask) -> std::chrono::steady_clock::time_point {
+	auto delta = (ticks - profiler.calibration_ticks) & timestamp_mask;
+	auto signed_delta = static_cast<double>(delta);
+	if (delta > timestamp_mask / 2) {
+		signed_delta -= static_cast<double>(timestamp_mask) + 1.0;
+	}
+	return profiler.calibration_time +
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double, std::nano>(
+							signed_delta * profiler.timestamp_period));
+}
+
+void calibrate(VkDevice& device, GpuProfiler& profiler) {
+	auto infos = std::array{
+			VkCalibratedTimestampInfoEXT{
+					.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+					.pNext = VK_NULL_HANDLE,
+					.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT},
+			VkCalibratedTimestampInfoEXT{
+					.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+					.pNext = VK_NULL_HANDLE,
+					.timeDomain = g_host_time_domain}};
+	// A thread preempted between the two reads samples them far apart, which
+	// the deviation shows.
+	auto best_deviation = UINT64_MAX;
+	for (auto i = 0; i < g_calibration_attempts; i++) {
+		auto timestamps = std::array<uint64_t, 2>{};
+		auto deviation = uint64_t{};
+		if (vkGetCalibratedTimestampsEXT(
+						device,
+						static_cast<uint32_t>(infos.size()),
+						infos.data(),
+						timestamps.data(),
+						&deviation) != VK_SUCCESS ||
+				deviation >= best_deviation) {
+			continue;
+		}
+		best_deviation = deviation;
+		profiler.calibration_ticks = timestamps.at(0) & profiler.timestamp_mask;
+		profiler.calibration_time = host_time(timestamps.at(1));
+	}
+	if (best_deviation == UINT64_MAX) {
+		fmt::print(stderr, "Failed to get calibrated timestamps\n");
+		std::terminate();
+	}
+	calibrate_gpu_zones(
+			profiler.zones,
+			profiler.calibration_ticks,
+			static_cast<float>(profiler.timestamp_period));
+}
+
+// Adds the pass's counters to its totals unless they are not available yet.
+// Performance queries take no result flags, their values being typed by the
+// counters.
+void read_performance_counters(
+		VkDevice& device,
+		const GpuProfiler& profiler,
+		const GpuProfilerFrame& frame,
+		uint32_t pass,
+		GpuPassStats& stats) {
+	auto results = std::vector<VkPerformanceCounterResultKHR>(
+			profiler.performance_counters.size());
+	auto results_size = results.size() * sizeof(VkPerformanceCounterResultKHR);
+	if (vkGetQueryPoolResults(
+					device,
+					frame.performance_pool,
+					pass,
+					1,
+					results_size,
+					results.data(),
+					results_size,
+					0) != VK_SUCCESS) {
+		return;
+	}
+	stats.performance_totals.resize(results.size());
+	for (auto i = size_t{}; i < results.size(); i++) {
+		stats.performance_totals.at(i) += performance_counter_value(
+				profiler.performance_counters.at(i),
+				results.at(i));
+	}
+	stats.performance_frames++;
+}
+
+// Reads query results without VK_QUERY_RESULT_WAIT_BIT, so this returns false
+// instead of blocking when they are not available.
+auto read_queries(
+		VkDevice& device,
+		VkQueryPool query_pool,
+		uint32_t first_query,
+		std::span<uint64_t> results,
+		uint32_t values_per_query) -> bool {
+	return vkGetQueryPoolResults(
+							device,
+							query_pool,
+							first_query,
+							static_cast<uint32_t>(results.size() / values_per_query),
+							results.size_bytes(),
+							results.data(),
+							values_per_query * sizeof(uint64_t),
+							VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+}
+
+void resolve_frame(
+		VkDevice& device,
+		GpuProfiler& profiler,
+		GpuProfilerFrame& frame) {
+	if (frame.passes.empty()) {
+		return;
+	}
+	auto pass_count = static_cast<uint32_t>(frame.passes.size());
+	auto timestamps = std::array<uint64_t, g_max_gpu_passes * 2>{};
+	auto have_timestamps = profiler.timestamps &&
+			read_queries(
+					device,
+					frame.timestamp_pool,
+					0,
+					std::span(timestamps).first(pass_count * 2),
+					1);
+	auto start_ms = std::vector<double>{};
+	if (have_timestamps && profiler.calibrated) {
+		// The passes of other queues may start first.
+		auto first_start = std::chrono::steady_clock::time_point::max();
+		for (auto i = uint32_t{}; i < pass_count; i++) {
+			auto mask = frame.passes.at(i).timestamp_mask;
+			auto start = gpu_host_time(profiler, timestamps.at(i * 2) & mask, mask);
+			start_ms.emplace_back(std::chrono::duration<double, std::milli>(
+					start - frame.recording_start)
+							.count());
+			first_start = std::min(first_start, start);
+		}
+		add_sample(
+				profiler,
+				profiler.start_latency,
+				std::chrono::duration<double, std::milli>(
+						first_start - frame.recording_start)
+						.count());
+	}
+	for (auto i = uint32_t{}; i < pass_count; i++) {
+		auto& pass = frame.passes.at(i);
+		auto& stats = profiler.passes.at(pass.stats);
+		auto milliseconds = 0.0;
+		if (have_timestamps) {
+			auto ticks = (timestamps.at(i * 2 + 1) - timestamps.at(i * 2)) &
+					pass.timestamp_mask;
+			milliseconds =
+					static_cast<double>(ticks) * profiler.timestamp_period / 1e6;
+			add_sample(profiler, stats, milliseconds);
+			auto begin = timestamps.at(i * 2) & pass.timestamp_mask;
+			report_gpu_zone(
+					profiler.zones,
+					stats.name,
+					begin,
+					begin + ticks,
+					static_cast<float>(profiler.timestamp_period));
+			if (profiler.calibrated && hitch_recording()) {
+				record_gpu_hitch_event(
+						stats.name,
+						gpu_host_time(profiler, begin, pass.timestamp_mask),
+						gpu_host_time(profiler, begin + ticks, pass.timestamp_mask));
+			}
+		}
+		auto counters = std::array<uint64_t, g_gpu_counter_count>{};
+		auto have_counters = pass.counters &&
+				(!profiler.statistics ||
+				 read_queries(
+						 device,
+						 frame.statistics_pool,
+						 i,
+						 std::span(counters).first(g_pipeline_statistic_count),
+						 g_pipeline_statistic_count)) &&
+				(!profiler.occlusion ||
+				 read_queries(
+						 device,
+						 frame.occlusion_pool,
+						 i,
+						 std::span(counters).last(1),
+						 1));
+		if (have_counters) {
+			for (auto c = size_t{}; c < g_gpu_counter_count; c++) {
+				stats.counter_totals.at(c) += counters.at(c);
+			}
+			stats.counter_frames++;
+		}
+		if (pass.performance) {
+			read_performance_counters(device, profiler, frame, i, stats);
+		}
+		if (profiler.csv.is_open() && (have_timestamps || have_counters)) {
+			fmt::print(profiler.csv, "{},{},", frame.frame_number, stats.name);
+			if (have_timestamps) {
+				fmt::print(profiler.csv, "{:.6f}", milliseconds);
+			}
+			fmt::print(profiler.csv, ",");
+			if (!start_ms.empty()) {
+				fmt::print(profiler.csv, "{:.6f}", start_ms.at(i));
+			}
+			for (auto counter : counters) {
+				if (have_counters) {
+					fmt::print(profiler.csv, ",{}", counter);
+				} else {
+					fmt::print(profiler.csv, ",");
+				}
+			}
+			fmt::print(profiler.csv, "\n");
+		}
+	}
+}
+
+auto begin_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::string_view name,
+		uint64_t timestamp_mask) -> uint32_t {
+	if (!profiler.timestamps && !profiler.statistics && !profiler.occlusion &&
+			profiler.performance_counters.empty()) {
+		return g_gpu_pass_none;
+	}
+	auto& frame = profiler.frames.at(frame_idx);
+	if (frame.passes.size() == g_max_gpu_passes) {
+		return g_gpu_pass_none;
+	}
+	auto pass = static_cast<uint32_t>(frame.passes.size());
+	frame.passes.emplace_back(
+			GpuFramePass{
+					.stats = find_pass(profiler, name),
+					.timestamp_mask = timestamp_mask,
+					.counters = false});
+	if (profiler.timestamps) {
+		// Each pass resets its own queries, so passes recorded on different
+		// queues do not have to agree on who resets the pool.
+		vkCmdResetQueryPool(command_buffer, frame.timestamp_pool, pass * 2, 2);
+		vkCmdWriteTimestamp(
+				command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				frame.timestamp_pool,
+				pass * 2);
+	}
+	return pass;
+}
+
+}  // namespace
+
+void enable_gpu_statistics_features(
+		const VkPhysicalDeviceFeatures& supported,
+		VkPhysicalDeviceFeatures& enabled) {
+	enabled.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+	enabled.occlusionQueryPrecise = supported.occlusionQueryPrecise;
+	// Draws are recorded into secondary command buffers, which can only be
+	// executed while a query is active, and contribute to it, through
+	// inherited queries.
+	enabled.inheritedQueries = supported.inheritedQueries;
+}
+
+auto create_gpu_profiler(
+		VkDevice& device,
+		const VkPhysicalDeviceProperties& properties,
+		uint32_t timestamp_valid_bits,
+		bool calibrated_timestamps,
+		const VkPhysicalDeviceFeatures& enabled_features,
+		bool statistics,
+		uint32_t graphics_family_idx,
+		std::vector<PerformanceCounter> performance_counters,
+		size_t frame_count,
+		const std::filesystem::path& csv_path) -> GpuProfiler {
+	auto profiler = GpuProfiler{};
+	profiler.timestamps =
+			properties.limits.timestampComputeAndGraphics == VK_TRUE &&
+			timestamp_valid_bits != 0;
+	if (!profiler.timestamps) {
+		fmt::print(stderr, "GPU timestamps are not supported\n");
+	}
+	if (statistics) {
+		// The queries stay active across the main pass's secondaries, which
+		// inherit_gpu_counters names them to.
+		profiler.statistics =
+				enabled_features.pipelineStatisticsQuery == VK_TRUE &&
+				enabled_features.inheritedQueries == VK_TRUE;
+		profiler.occlusion = enabled_features.inheritedQueries == VK_TRUE;
+		profiler.precise_occlusion =
+				enabled_features.occlusionQueryPrecise == VK_TRUE;
+		if (!profiler.statistics) {
+			fmt::print(
+					stderr,
+					"Inherited pipeline statistics queries are not supported\n");
+		}
+		if (!profiler.occlusion) {
+			fmt::print(stderr, "Inherited occlusion queries are not supported\n");
+		}
+	}
+	profiler.performance_counters = std::move(performance_counters);
+	if (!profiler.performance_counters.empty()) {
+		// Counter queries may only be recorded while the lock is held.
+		auto lock_info = VkAcquireProfilingLockInfoKHR{
+				.sType = VK_STRUCTURE_TYPE_ACQUIRE_PROFILING_LOCK_INFO_KHR,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.timeout = UINT64_MAX};
+		if (vkAcquireProfilingLockKHR(device, &lock_info) != VK_SUCCESS) {
+			fmt::print(
+					stderr,
+					"Failed to acquire the profiling lock, reading no performance "
+					"counters\n");
+			profiler.performance_counters.clear();
+		}
+	}
+	profiler.timestamp_period = properties.limits.timestampPeriod;
+	profiler.timestamp_mask = valid_bits_mask(timestamp_valid_bits);
+	profiler.calibrated = profiler.timestamps && calibrated_timestamps;
+	profiler.start_latency.name = "frame start latency";
+	if (profiler.calibrated) {
+		calibrate(device, profiler);
+	}
+
+	profiler.frames.resize(frame_count);
+	for (auto& frame : profiler.frames) {
+		if (profiler.timestamps) {
+			frame.timestamp_pool =
+					create_query_pool(device, VK_QUERY_TYPE_TIMESTAMP, 0);
+		}
+		if (profiler.statistics) {
+			frame.statistics_pool = create_query_pool(
+					device,
+					VK_QUERY_TYPE_PIPELINE_STATISTICS,
+					g_pipeline_statistics);
+		}
+		if (profiler.occlusion) {
+			frame.occlusion_pool =
+					create_query_pool(device, VK_QUERY_TYPE_OCCLUSION, 0);
+		}
+		if (!profiler.performance_counters.empty()) {
+			frame.performance_pool = create_performance_pool(
+					device,
+					graphics_family_idx,
+					profiler.performance_counters);
+			vkResetQueryPool(device, frame.performance_pool, 0, g_max_gpu_passes);
+		}
+		frame.passes.reserve(g_max_gpu_passes);
+	}
+
+	if (!csv_path.empty()) {
+		profiler.csv = std::ofstream(csv_path, std::ios::trunc);
+		if (!profiler.csv) {
+			fmt::print(stderr, "Failed to open {}\n", csv_path.string());
+			std::terminate();
+		}
+		fmt::print(
+				profiler.csv,
+				"frame,pass,gpu_ms,start_ms,vs_invocations,clipping_primitives,"
+				"fs_invocations,samples_passed\n");
+	}
+	return profiler;
+}
+
+void destroy_gpu_profiler(VkDevice& device, GpuProfiler& profiler) {
+	for (auto& frame : profiler.frames) {
+		vkDestroyQueryPool(device, frame.timestamp_pool, host_callbacks());
+		vkDestroyQueryPool(device, frame.statistics_pool, host_callbacks());
+		vkDestroyQueryPool(device, frame.occlusion_pool, host_callbacks());
+		vkDestroyQueryPool(device, frame.performance_pool, host_callbacks());
+	}
+	if (!profiler.performance_counters.empty()) {
+		vkReleaseProfilingLockKHR(device);
+	}
+	profiler = GpuProfiler{};
+}
+
+void begin_gpu_frame(
+		VkDevice& device,
+		GpuProfiler& profiler,
+		size_t frame_idx) {
+	if (profiler.frames.empty()) {
+		return;
+	}
+	auto& frame = profiler.frames.at(frame_idx);
+	resolve_frame(device, profiler, frame);
+	// Counter queries cannot be reset in the command buffers that begin them.
+	if (frame.performance_pool != VK_NULL_HANDLE) {
+		vkResetQueryPool(device, frame.performance_pool, 0, g_max_gpu_passes);
+	}
+	frame.passes.clear();
+	frame.recording_start = std::chrono::steady_clock::now();
+	if (profiler.calibrated &&
+			profiler.frame_number % g_calibration_interval == 0) {
+		calibrate(device, profiler);
+	}
+	frame.frame_number = profiler.frame_number++;
+	if (profiler.frame_number % g_gpu_report_interval == 0) {
+		print_stats(profiler);
+	}
+}
+
+void flush_gpu_profiler(VkDevice& device, GpuProfiler& profiler) {
+	for (auto& frame : profiler.frames) {
+		resolve_frame(device, profiler, frame);
+		frame.passes.clear();
+	}
+}
+
+auto latest_gpu_pass_time(const GpuProfiler& profiler, std::string_view name)
+		-> std::optional<double> {
+	for (const auto& stats : profiler.passes) {
+		if (stats.name == name && !stats.samples.empty()) {
+			// next is one past the newest sample, wrapping once the window is
+			// full.
+			auto newest =
+					(stats.next + stats.samples.size() - 1) % stats.samples.size();
+			return stats.samples.at(newest);
+		}
+	}
+	return std::nullopt;
+}
+
+auto begin_gpu_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::string_view name) -> uint32_t {
+	return begin_pass(
+			profiler,
+			command_buffer,
+			frame_idx,
+			name,
+			profiler.timestamp_mask);
+}
+
+auto begin_gpu_queue_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::string_view name,
+		uint32_t timestamp_valid_bits) -> uint32_t {
+	// The pass's two queries would never become available, and fail reading
+	// the frame's.
+	if (timestamp_valid_bits == 0) {
+		return g_gpu_pass_none;
+	}
+	return begin_pass(
+			profiler,
+			command_buffer,
+			frame_idx,
+			name,
+			valid_bits_mask(timestamp_valid_bits));
+}
+
+void end_gpu_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass) {
+	if (pass == g_gpu_pass_none || !profiler.timestamps) {
+		return;
+	}
+	vkCmdWriteTimestamp(
+			command_buffer,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			profiler.frames.at(frame_idx).timestamp_pool,
+			pass * 2 + 1);
+}
+
+void begin_gpu_counters(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass) {
+	if (pass == g_gpu_pass_none) {
+		return;
+	}
+	auto& frame = profiler.frames.at(frame_idx);
+	if (profiler.statistics) {
+		vkCmdResetQueryPool(command_buffer, frame.statistics_pool, pass, 1);
+		vkCmdBeginQuery(command_buffer, frame.statistics_pool, pass, 0);
+	}
+	if (profiler.occlusion) {
+		vkCmdResetQueryPool(command_buffer, frame.occlusion_pool, pass, 1);
+		vkCmdBeginQuery(
+				command_buffer,
+				frame.occlusion_pool,
+				pass,
+				occlusion_flags(profiler));
+	}
+	if (frame.performance_pool != VK_NULL_HANDLE) {
+		vkCmdBeginQuery(command_buffer, frame.performance_pool, pass, 0);
+	}
+	frame.passes.at(pass).counters = profiler.statistics || profiler.occlusion;
+	frame.passes.at(pass).performance =
+			frame.performance_pool != VK_NULL_HANDLE;
+}
+
+void end_gpu_counters(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass) {
+	if (pass == g_gpu_pass_none) {
+		return;
+	}
+	auto& frame = profiler.frames.at(frame_idx);
+	if (profiler.statistics) {
+		vkCmdEndQuery(command_buffer, frame.statistics_pool, pass);
+	}
+	if (profiler.occlusion) {
+		vkCmdEndQuery(command_buffer, frame.occlusion_pool, pass);
+	}
+	if (frame.performance_pool != VK_NULL_HANDLE) {
+		vkCmdEndQuery(command_buffer, frame.performance_pool, pass);
+	}
+}
+
+void inherit_gpu_counters(
+		const GpuProfiler& profiler,
+		VkCommandBufferInheritanceInfo& inheritance) {
+	if (profiler.occlusion) {
+		inheritance.occlusionQueryEnable = VK_TRUE;
+		inheritance.queryFlags = occlusion_flags(profiler);
+	}
+	if (profiler.statistics) {
+		inheritance.pipelineStatistics = g_pipeline_statistics;
+	}
+}
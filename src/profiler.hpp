@@ -0,0 +1,175 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "instrument.hpp"
+#include "performance_counters.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr auto g_max_gpu_passes = 32U;
+constexpr auto g_gpu_pass_none = UINT32_MAX;
+
+// Counters collected per pass in statistics mode: vertex shader invocations,
+// clipping primitives, fragment shader invocations and samples passed.
+constexpr auto g_gpu_counter_count = 4U;
+
+// Rolling window of the most recent GPU times of a pass, in milliseconds, and
+// the counter totals since the last report. history keeps every time when the
+// profiler keeps history.
+struct GpuPassStats {
+	std::string name;
+	std::vector<double> samples;
+	size_t next{};
+	std::vector<double> history;
+	std::array<uint64_t, g_gpu_counter_count> counter_totals{};
+	uint64_t counter_frames{};
+	// Sums of the selected performance counters over every frame, unlike the
+	// counter totals.
+	std::vector<double> performance_totals;
+	uint64_t performance_frames{};
+};
+
+struct GpuFramePass {
+	uint32_t stats{};
+	// The valid bits of the timestamps of the queue the pass was recorded on.
+	uint64_t timestamp_mask{};
+	bool counters{};
+	bool performance{};
+};
+
+// Queries of one frame in flight. They are read back the next time the slot
+// comes around, once its fence has been waited on, so reading never stalls.
+struct GpuProfilerFrame {
+	VkQueryPool timestamp_pool{};
+	VkQueryPool statistics_pool{};
+	VkQueryPool occlusion_pool{};
+	VkQueryPool performance_pool{};
+	std::vector<GpuFramePass> passes;
+	uint64_t frame_number{};
+	// When the CPU began recording the frame.
+	std::chrono::steady_clock::time_point recording_start;
+};
+
+struct GpuProfiler {
+	bool timestamps{};
+	// Pipeline statistics and occlusion queries around graphics passes.
+	bool statistics{};
+	bool occlusion{};
+	bool precise_occlusion{};
+	// Vendor counters read around graphics passes, with the profiling lock
+	// held for as long as the profiler lives.
+	std::vector<PerformanceCounter> performance_counters;
+	// Nanoseconds per timestamp tick.
+	double timestamp_period{};
+	// The valid bits of the graphics queue's timestamps, which calibration
+	// samples.
+	uint64_t timestamp_mask{};
+	std::vector<GpuProfilerFrame> frames;
+	std::vector<GpuPassStats> passes;
+	// With calibrated timestamps, how long after the CPU began recording a
+	// frame its first pass started on the GPU, which tells a frame held up by
+	// the CPU apart from one queued behind GPU work.
+	bool calibrated{};
+	GpuPassStats start_latency;
+	// A timestamp and the host time it was sampled with, taken again every
+	// few frames so the two clocks cannot drift apart.
+	uint64_t calibration_ticks{};
+	std::chrono::steady_clock::time_point calibration_time;
+	uint64_t frame_number{};
+	bool keep_history{};
+	std::ofstream csv;
+	// Where the resolved passes are reported as GPU zones.
+	GpuZoneContext zones;
+};
+
+// Device features the statistics mode needs, to be enabled at device
+// creation. Unsupported features are left off and the matching counters are
+// skipped.
+void enable_gpu_statistics_features(
+		const VkPhysicalDeviceFeatures& supported,
+		VkPhysicalDeviceFeatures& enabled);
+
+// Timestamps are disabled on devices without timestampComputeAndGraphics.
+// calibrated_timestamps is whether the device was created with them.
+// statistics turns on the counters, given the features enabled on the device.
+// performance_counters are read from graphics_family_idx, and need the
+// performance query capability when there are any. Every resolved sample is
+// appended to csv_path when it is not empty.
+auto create_gpu_profiler(
+		VkDevice& device,
+		const VkPhysicalDeviceProperties& properties,
+		uint32_t timestamp_valid_bits,
+		bool calibrated_timestamps,
+		const VkPhysicalDeviceFeatures& enabled_features,
+		bool statistics,
+		uint32_t graphics_family_idx,
+		std::vector<PerformanceCounter> performance_counters,
+		size_t frame_count,
+		const std::filesystem::path& csv_path) -> GpuProfiler;
+// The device must be idle.
+void destroy_gpu_profiler(VkDevice& device, GpuProfiler& profiler);
+
+// Collects the results of the frame that last used this slot and prints the
+// statistics periodically. The frame fence must have been waited on, and so
+// must every other queue's work for the slot. Called as the CPU begins
+// recording the frame, which the frame start latency is measured from.
+void begin_gpu_frame(VkDevice& device, GpuProfiler& profiler, size_t frame_idx);
+
+// Collects the results of every frame slot. The device must be idle.
+void flush_gpu_profiler(VkDevice& device, GpuProfiler& profiler);
+
+// The GPU time of the most recently resolved frame with the pass, nothing
+// before one was resolved or without timestamps.
+auto latest_gpu_pass_time(const GpuProfiler& profiler, std::string_view name)
+		-> std::optional<double>;
+
+// Writes the timestamps around a pass. Both must be recorded outside a render
+// pass instance, on a queue that supports timestamps. Returns
+// g_gpu_pass_none when profiling is off or the frame is out of queries.
+auto begin_gpu_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::string_view name) -> uint32_t;
+// Like begin_gpu_pass, on a queue of another family, whose timestamps have
+// timestamp_valid_bits. Returns g_gpu_pass_none when it is zero.
+auto begin_gpu_queue_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		std::string_view name,
+		uint32_t timestamp_valid_bits) -> uint32_t;
+void end_gpu_pass(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass);
+
+// Wraps a graphics pass in the statistics and performance queries. Must be
+// recorded on the graphics queue, between begin_gpu_pass and the render pass,
+// in command buffers begun after the profiler was created.
+void begin_gpu_counters(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass);
+void end_gpu_counters(
+		GpuProfiler& profiler,
+		VkCommandBuffer command_buffer,
+		size_t frame_idx,
+		uint32_t pass);
+
+// Secondary command buffers executed while the counters are active must
+// inherit the queries.
+void inherit_gpu_counters(
+		const GpuProfiler& profiler,
+		VkCommandBufferInheritanceInfo& inheritance);
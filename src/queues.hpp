@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+// What the counters of the queues are padded to, so a producer and a
+// consumer on different cores do not keep taking each other's cache line.
+constexpr auto g_cache_line_size = size_t{64};
+
+// Bounded queue between one producing and one consuming thread, lock-free
+// and wait-free. Elements are stored inline and moved in and out, so a full
+// queue refuses new ones instead of growing.
+template <typename T, size_t Capacity>
+struct SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be 2^n");
+
+	std::array<T, Capacity> items{};
+	// Counts of elements ever pushed and popped.
+	alignas(g_cache_line_size) std::atomic<size_t> head{};
+	alignas(g_cache_line_size) std::atomic<size_t> tail{};
+
+	// Only the producer pushes. value is left alone when the queue is full.
+	auto try_push(T&& value) -> bool {
+		auto position = head.load(std::memory_order_relaxed);
+		if (position - tail.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		items[position & (Capacity - 1)] = std::move(value);
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+	// Only the consumer pops.
+	auto try_pop() -> std::optional<T> {
+		auto position = tail.load(std::memory_order_relaxed);
+		if (position == head.load(std::memory_order_acquire)) {
+			return std::nullopt;
+		}
+		auto value = std::move(items[position & (Capacity - 1)]);
+		tail.store(position + 1, std::memory_order_release);
+		return value;
+	}
+};
+
+// Bounded queue any number of threads push to and pop from, lock-free with
+// a sequence number per cell: a cell is free to push into when its sequence
+// equals the push position, and holds an element to pop when it is one past
+// the pop position. Elements come out in the order they went in.
+template <typename T, size_t Capacity>
+struct MpmcQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be 2^n");
+
+	struct Cell {
+		std::atomic<size_t> sequence{};
+		T value{};
+	};
+
+	std::array<Cell, Capacity> cells;
+	alignas(g_cache_line_size) std::atomic<size_t> head{};
+	alignas(g_cache_line_size) std::atomic<size_t> tail{};
+
+	MpmcQueue() {
+		for (auto i = size_t{}; i < Capacity; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// value is left alone when the queue is full.
+	auto try_push(T&& value) -> bool {
+		auto position = head.load(std::memory_order_relaxed);
+		while (true) {
+			auto& cell = cells[position & (Capacity - 1)];
+			auto sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence == position) {
+				if (head.compare_exchange_weak(
+								position,
+								position + 1,
+								std::memory_order_relaxed)) {
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (sequence < position) {
+				// The cell still holds the element pushed a lap earlier.
+				return false;
+			} else {
+				position = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	auto try_pop() -> std::optional<T> {
+		auto position = tail.load(std::memory_order_relaxed);
+		while (true) {
+			auto& cell = cells[position & (Capacity - 1)];
+			auto sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence == position + 1) {
+				if (tail.compare_exchange_weak(
+								position,
+								position + 1,
+								std::memory_order_relaxed)) {
+					auto value = std::move(cell.value);
+					cell.sequence.store(
+							position + Capacity,
+							std::memory_order_release);
+					return value;
+				}
+			} else if (sequence < position + 1) {
+				return std::nullopt;
+			} else {
+				position = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	// A hint, exact only while no other thread pushes or pops.
+	[[nodiscard]] auto empty() const -> bool {
+		return head.load(std::memory_order_relaxed) ==
+				tail.load(std::memory_order_relaxed);
+	}
+};
+
+// Many producers and a single consumer, such as threads handing work to the
+// frame loop. The multi-consumer queue serves, its one consumer never has to
+// retry.
+template <typename T, size_t Capacity>
+using MpscQueue = MpmcQueue<T, Capacity>;
@@ -0,0 +1,281 @@
+#include "radix_sort.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "specialization.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant block in radix_sort.comp.
+struct RadixSortConstants {
+	BindlessHandle source{};
+	BindlessHandle target{};
+	BindlessHandle histograms{};
+	uint32_t count{};
+	uint32_t shift{};
+	uint32_t group_count{};
+	BindlessHandle offsets{};
+	uint32_t scanned{};
+};
+
+auto group_count(uint32_t count) -> uint32_t {
+	return (count + g_radix_sort_group_size - 1) / g_radix_sort_group_size;
+}
+
+// A count for every digit and group, then the totals of the digits.
+auto histogram_size(uint32_t capacity) -> VkDeviceSize {
+	return VkDeviceSize{sizeof(uint32_t)} * g_radix_digit_count *
+			(group_count(capacity) + 1);
+}
+
+// A start for every digit and group, laid out like the counts.
+auto offsets_size(uint32_t capacity) -> VkDeviceSize {
+	return VkDeviceSize{sizeof(uint32_t)} * g_radix_digit_count *
+			group_count(capacity);
+}
+
+auto buffer_barrier(const Buffer& buffer) -> VkBufferMemoryBarrier2 {
+	return {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+					VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+// Orders every stage after the one before, and the first after the last
+// sort, which used the same scratch buffer, histograms and offsets.
+void sort_barrier(const RadixSort& sort, VkCommandBuffer command_buffer) {
+	auto barriers = std::array{
+			buffer_barrier(sort.scratch),
+			buffer_barrier(sort.histograms),
+			buffer_barrier(sort.offsets)};
+	pipeline_barrier(sort.synchronization2, command_buffer, barriers, {});
+}
+
+void dispatch_stage(
+		const RadixSort& sort,
+		VkCommandBuffer command_buffer,
+		RadixSortStage stage,
+		const RadixSortConstants& constants,
+		uint32_t groups) {
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			sort.pipelines.at(static_cast<size_t>(stage)));
+	vkCmdPushConstants(
+			command_buffer,
+			sort.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(constants),
+			&constants);
+	vkCmdDispatch(command_buffer, groups, 1, 1);
+}
+
+}  // namespace
+
+auto create_radix_sort(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		uint32_t capacity,
+		bool synchronization2) -> RadixSort {
+	auto sort = RadixSort{};
+	sort.synchronization2 = synchronization2;
+	sort.capacity = capacity;
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(RadixSortConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&sort.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create radix sort pipeline layout\n");
+		std::terminate();
+	}
+	for (auto i = 0U; i < g_radix_sort_stage_count; i++) {
+		auto constants = make_specialization_constants(
+				bindless.images.capacity,
+				bindless.buffers.capacity,
+				bindless.samplers.capacity,
+				i);
+		auto specialization = specialization_info(constants);
+		sort.pipelines.at(i) = create_compute_pipeline(
+				device,
+				pipeline_cache,
+				sort.pipeline_layout,
+				module,
+				&specialization,
+				0);
+	}
+
+	auto scratch_size = VkDeviceSize{2 * sizeof(uint32_t)} * capacity;
+	sort.scratch = create_buffer(
+			device,
+			allocator,
+			scratch_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	sort.scratch_handle = add_bindless_buffer(
+			device,
+			bindless,
+			sort.scratch.handle,
+			0,
+			scratch_size);
+	sort.histograms = create_buffer(
+			device,
+			allocator,
+			histogram_size(capacity),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	sort.histograms_handle = add_bindless_buffer(
+			device,
+			bindless,
+			sort.histograms.handle,
+			0,
+			histogram_size(capacity));
+	sort.offsets = create_buffer(
+			device,
+			allocator,
+			offsets_size(capacity),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	sort.offsets_handle = add_bindless_buffer(
+			device,
+			bindless,
+			sort.offsets.handle,
+			0,
+			offsets_size(capacity));
+	return sort;
+}
+
+void destroy_radix_sort(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		RadixSort& sort) {
+	remove_bindless_buffer(device, bindless, sort.scratch_handle);
+	remove_bindless_buffer(device, bindless, sort.histograms_handle);
+	remove_bindless_buffer(device, bindless, sort.offsets_handle);
+	destroy_buffer(device, allocator, sort.scratch);
+	destroy_buffer(device, allocator, sort.histograms);
+	destroy_buffer(device, allocator, sort.offsets);
+	for (auto* pipeline : sort.pipelines) {
+		vkDestroyPipeline(device, pipeline, host_callbacks());
+	}
+	vkDestroyPipelineLayout(device, sort.pipeline_layout, host_callbacks());
+	sort = RadixSort{};
+}
+
+void record_radix_sort(
+		const RadixSort& sort,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		const Buffer& pairs,
+		BindlessHandle pairs_handle,
+		uint32_t count,
+		const PrefixScan* scan) {
+	if (count == 0 || count > sort.capacity) {
+		return;
+	}
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			sort.pipeline_layout,
+			bindless);
+	auto groups = group_count(count);
+	// The count stage leaves how many counts there are after them, where the
+	// scan reads it, and the scan writes its total past that.
+	auto counts = g_radix_digit_count * groups;
+	auto scanned = scan != nullptr && counts <= scan->capacity;
+	sort_barrier(sort, command_buffer);
+	for (auto pass = 0U; pass < g_radix_sort_passes; pass++) {
+		auto to_scratch = pass % 2 == 0;
+		auto constants = RadixSortConstants{
+				.source = to_scratch ? pairs_handle : sort.scratch_handle,
+				.target = to_scratch ? sort.scratch_handle : pairs_handle,
+				.histograms = sort.histograms_handle,
+				.count = count,
+				.shift = pass * g_radix_digit_bits,
+				.group_count = groups,
+				.offsets = sort.offsets_handle,
+				.scanned = scanned ? 1U : 0U};
+		dispatch_stage(
+				sort,
+				command_buffer,
+				RadixSortStage::count,
+				constants,
+				groups);
+		sort_barrier(sort, command_buffer);
+		if (scanned) {
+			record_prefix_scan(
+					*scan,
+					bindless,
+					command_buffer,
+					sort.histograms_handle,
+					sort.offsets_handle,
+					ScanCounts{
+							.list = sort.histograms_handle,
+							.count_slot = counts,
+							.result_slot = counts + 1});
+			sort_barrier(sort, command_buffer);
+			bind_bindless_table(
+					command_buffer,
+					VK_PIPELINE_BIND_POINT_COMPUTE,
+					sort.pipeline_layout,
+					bindless);
+		} else {
+			dispatch_stage(
+					sort,
+					command_buffer,
+					RadixSortStage::scan,
+					constants,
+					g_radix_digit_count);
+			sort_barrier(sort, command_buffer);
+		}
+		dispatch_stage(
+				sort,
+				command_buffer,
+				RadixSortStage::scatter,
+				constants,
+				groups);
+		// The pairs scattered are read by the next pass.
+		auto barriers = std::array{
+				buffer_barrier(pairs),
+				buffer_barrier(sort.scratch),
+				buffer_barrier(sort.histograms),
+				buffer_barrier(sort.offsets)};
+		pipeline_barrier(sort.synchronization2, command_buffer, barriers, {});
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "scan.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Match local_size_x and the digit size in radix_sort.comp. Every group sorts
+// a tile of a pair per invocation, and a pass sorts by one digit, so keys take
+// 32 / g_radix_digit_bits passes.
+constexpr auto g_radix_sort_group_size = 256U;
+constexpr auto g_radix_digit_bits = 4U;
+constexpr auto g_radix_digit_count = 1U << g_radix_digit_bits;
+constexpr auto g_radix_sort_passes = 32U / g_radix_digit_bits;
+// The passes move the pairs to the scratch buffer and back, so the sorted
+// pairs end up where they started.
+static_assert(g_radix_sort_passes % 2 == 0);
+
+// The specialization of radix_sort.comp, one pipeline each.
+enum class RadixSortStage : uint32_t {
+	count,
+	scan,
+	scatter,
+};
+constexpr auto g_radix_sort_stage_count = 3U;
+
+// A stable sort of key-value pairs by 32-bit keys on the GPU, least
+// significant digit first. Each pass counts the digits of every group's tile,
+// scans the counts into where the groups' pairs go and scatters the pairs
+// there, which takes a fixed number of dispatches, unlike a bitonic sort.
+// The counts are kept digit major, so with a PrefixScan the scan is one
+// exclusive prefix sum over all of them, rather than a group for every digit
+// scanning its row and the scatter adding up the digits' totals.
+// Pairs are two uint32_t, the key and the value, in a bindless storage
+// buffer.
+//
+// The scratch buffer and the histograms are reused by every sort, so all of
+// them must be recorded to one queue, which runs them in order.
+struct RadixSort {
+	bool synchronization2{};
+	// The most pairs a sort takes.
+	uint32_t capacity{};
+	VkPipelineLayout pipeline_layout{};
+	std::array<VkPipeline, g_radix_sort_stage_count> pipelines{};
+	Buffer scratch;
+	Buffer histograms;
+	// Where every group's pairs of each digit go, when a PrefixScan wrote
+	// them.
+	Buffer offsets;
+	BindlessHandle scratch_handle{};
+	BindlessHandle histograms_handle{};
+	BindlessHandle offsets_handle{};
+};
+
+// module is radix_sort.comp. capacity must be at least one.
+auto create_radix_sort(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		uint32_t capacity,
+		bool synchronization2) -> RadixSort;
+// The device must be idle.
+void destroy_radix_sort(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		RadixSort& sort);
+
+// Sorts the first count pairs of the buffer by their keys, keeping pairs
+// with equal keys in order. Their writes must have been made visible to
+// COMPUTE_SHADER, and the sorted pairs are written by COMPUTE_SHADER. Binds
+// the bindless table with the sort's own layout, so compute pipelines
+// recorded after it have to bind it again. count is at most capacity. scan
+// may be null, and its scans are only used when its capacity takes the
+// counts, g_radix_digit_count for every group of count; it must be recorded
+// to the sort's queue.
+void record_radix_sort(
+		const RadixSort& sort,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		const Buffer& pairs,
+		BindlessHandle pairs_handle,
+		uint32_t count,
+		const PrefixScan* scan);
@@ -0,0 +1,709 @@
+#include "ray_tracing.hpp"
+
+#include "host_memory.hpp"
+#include "log.hpp"
+
+#include <fmt/core.h>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory_resource>
+#include <optional>
+
+namespace {
+
+constexpr auto g_blas_flags = VkBuildAccelerationStructureFlagsKHR{
+		VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+		VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR};
+constexpr auto g_tlas_flags = VkBuildAccelerationStructureFlagsKHR{
+		VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+		VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR};
+
+constexpr auto g_build_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		.access = VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+constexpr auto g_build_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		.access = VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+constexpr auto g_scratch_access = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		.access = VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+				VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+static_assert(sizeof(VkTransformMatrixKHR) == sizeof(InstanceTransform));
+
+auto create_acceleration_structure(
+		VkDevice& device,
+		Allocator& allocator,
+		VkAccelerationStructureTypeKHR type,
+		VkDeviceSize size) -> AccelerationStructure {
+	auto structure = AccelerationStructure{};
+	structure.buffer = create_buffer(
+			device,
+			allocator,
+			size,
+			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+					VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto create_info = VkAccelerationStructureCreateInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.createFlags = 0,
+			.buffer = structure.buffer.handle,
+			.offset = 0,
+			.size = size,
+			.type = type,
+			.deviceAddress = 0};
+	if (vkCreateAccelerationStructureKHR(
+					device,
+					&create_info,
+					host_callbacks(),
+					&structure.handle) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create acceleration structure\n");
+		std::terminate();
+	}
+	auto address_info = VkAccelerationStructureDeviceAddressInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.accelerationStructure = structure.handle};
+	structure.address =
+			vkGetAccelerationStructureDeviceAddressKHR(device, &address_info);
+	return structure;
+}
+
+void destroy_acceleration_structure(
+		VkDevice& device,
+		Allocator& allocator,
+		AccelerationStructure& structure) {
+	vkDestroyAccelerationStructureKHR(
+			device,
+			structure.handle,
+			host_callbacks());
+	destroy_buffer(device, allocator, structure.buffer);
+	structure = AccelerationStructure{};
+}
+
+// Scratch addresses must be aligned beyond what buffers are, so the buffer
+// gets room to round its address up.
+auto create_scratch_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkDeviceSize alignment) -> Buffer {
+	return create_buffer(
+			device,
+			allocator,
+			size + alignment,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+					VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+}
+
+auto scratch_address(
+		VkDevice& device,
+		const Buffer& buffer,
+		VkDeviceSize alignment) -> VkDeviceAddress {
+	auto address = buffer_device_address(device, buffer);
+	return (address + alignment - 1) / alignment * alignment;
+}
+
+// Where the full detail level of a mesh lies in its buffers, to be copied
+// into a buffer builds can read: the positions first, then the indices.
+// Positions are all of the vertex buffer but for split meshes, whose colors
+// follow them. Vertices are multiples of 4 bytes, which aligns the indices.
+struct BlasInput {
+	VkDeviceSize vertex_size{};
+	uint32_t vertex_count{};
+	VkDeviceSize index_offset{};
+	VkDeviceSize index_size{};
+	uint32_t triangle_count{};
+};
+
+auto blas_input(const Mesh& mesh) -> BlasInput {
+	auto vertex_size = mesh.layout == VertexLayout::split
+			? mesh.stream_offsets.at(1)
+			: mesh.vertices.size;
+	auto index_bytes = mesh.index_type == VK_INDEX_TYPE_UINT16
+			? VkDeviceSize{sizeof(uint16_t)}
+			: VkDeviceSize{sizeof(uint32_t)};
+	const auto& lod = mesh.lods.front();
+	return BlasInput{
+			.vertex_size = vertex_size,
+			.vertex_count =
+					static_cast<uint32_t>(vertex_size / mesh.attribute_stride),
+			.index_offset = lod.first_index * index_bytes,
+			.index_size = lod.index_count * index_bytes,
+			.triangle_count = lod.index_count / 3};
+}
+
+// The mesh's triangles as the builds read them from the copy at address.
+// Quantized positions are left to the instances to map back.
+auto blas_geometry(
+		const Mesh& mesh,
+		const BlasInput& input,
+		VkDeviceAddress address) -> VkAccelerationStructureGeometryKHR {
+	auto geometry = VkAccelerationStructureGeometryKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+			.geometry = {},
+			.flags = VK_GEOMETRY_OPAQUE_BIT_KHR};
+	geometry.geometry.triangles = VkAccelerationStructureGeometryTrianglesDataKHR{
+			.sType =
+					VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.vertexFormat = mesh.layout == VertexLayout::quantized
+					? VK_FORMAT_R16G16B16A16_SNORM
+					: VK_FORMAT_R32G32B32_SFLOAT,
+			.vertexData = {.deviceAddress = address},
+			.vertexStride = mesh.attribute_stride,
+			.maxVertex = input.vertex_count - 1,
+			.indexType = mesh.index_type,
+			.indexData = {.deviceAddress = address + input.vertex_size},
+			.transformData = {.deviceAddress = 0}};
+	return geometry;
+}
+
+auto tlas_geometry(VkDeviceAddress instances)
+		-> VkAccelerationStructureGeometryKHR {
+	auto geometry = VkAccelerationStructureGeometryKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+			.geometry = {},
+			.flags = VK_GEOMETRY_OPAQUE_BIT_KHR};
+	geometry.geometry.instances = VkAccelerationStructureGeometryInstancesDataKHR{
+			.sType =
+					VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.arrayOfPointers = VK_FALSE,
+			.data = {.deviceAddress = instances}};
+	return geometry;
+}
+
+auto build_sizes(
+		VkDevice& device,
+		VkAccelerationStructureTypeKHR type,
+		VkBuildAccelerationStructureFlagsKHR flags,
+		const VkAccelerationStructureGeometryKHR& geometry,
+		uint32_t primitive_count) -> VkAccelerationStructureBuildSizesInfoKHR {
+	auto build_info = VkAccelerationStructureBuildGeometryInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.type = type,
+			.flags = flags,
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.srcAccelerationStructure = VK_NULL_HANDLE,
+			.dstAccelerationStructure = VK_NULL_HANDLE,
+			.geometryCount = 1,
+			.pGeometries = &geometry,
+			.ppGeometries = VK_NULL_HANDLE,
+			.scratchData = {.deviceAddress = 0}};
+	auto sizes = VkAccelerationStructureBuildSizesInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.accelerationStructureSize = 0,
+			.updateScratchSize = 0,
+			.buildScratchSize = 0};
+	vkGetAccelerationStructureBuildSizesKHR(
+			device,
+			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+			&build_info,
+			&primitive_count,
+			&sizes);
+	return sizes;
+}
+
+void record_build(
+		VkCommandBuffer command_buffer,
+		const VkAccelerationStructureBuildGeometryInfoKHR& build_info,
+		uint32_t primitive_count) {
+	auto range = VkAccelerationStructureBuildRangeInfoKHR{
+			.primitiveCount = primitive_count,
+			.primitiveOffset = 0,
+			.firstVertex = 0,
+			.transformOffset = 0};
+	const auto* ranges = &range;
+	vkCmdBuildAccelerationStructuresKHR(command_buffer, 1, &build_info, &ranges);
+}
+
+// Copies the mesh into a buffer builds can read, since its own buffers are
+// vertex and index buffers only, then builds the bottom level structure and
+// queries its compacted size. The copy and the scratch memory are only kept
+// for the frame.
+void add_blas_build_passes(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		RayTracing& ray_tracing,
+		const Mesh& mesh) {
+	auto input = blas_input(mesh);
+	auto copy = create_buffer(
+			device,
+			allocator,
+			input.vertex_size + input.index_size,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+					VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+					VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto copy_address = buffer_device_address(device, copy);
+	auto sizes = build_sizes(
+			device,
+			VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			g_blas_flags,
+			blas_geometry(mesh, input, copy_address),
+			input.triangle_count);
+	ray_tracing.blas = create_acceleration_structure(
+			device,
+			allocator,
+			VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			sizes.accelerationStructureSize);
+	auto scratch = create_scratch_buffer(
+			device,
+			allocator,
+			sizes.buildScratchSize,
+			ray_tracing.scratch_alignment);
+	auto scratch_data =
+			scratch_address(device, scratch, ray_tracing.scratch_alignment);
+	defer_deletion(
+			deletions,
+			[&device, &allocator, copy, scratch]() mutable {
+				destroy_buffer(device, allocator, copy);
+				destroy_buffer(device, allocator, scratch);
+			});
+
+	// Whatever last wrote the mesh, an upload's ownership acquire included,
+	// has to be visible to the copy.
+	auto mesh_written = GraphState{
+			.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			.access = VK_ACCESS_2_MEMORY_WRITE_BIT,
+			.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+	auto copy_read = GraphState{
+			.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+			.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+			.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+	auto vertices = import_graph_buffer(
+			graph,
+			mesh.vertices.handle,
+			mesh_written,
+			std::nullopt);
+	auto indices = import_graph_buffer(
+			graph,
+			mesh.indices.handle,
+			mesh_written,
+			std::nullopt);
+	auto copy_resource =
+			import_graph_buffer(graph, copy.handle, GraphState{}, std::nullopt);
+	auto scratch_resource =
+			import_graph_buffer(graph, scratch.handle, GraphState{}, std::nullopt);
+	auto blas_resource = import_graph_buffer(
+			graph,
+			ray_tracing.blas.buffer.handle,
+			GraphState{},
+			std::nullopt);
+
+	auto copy_pass = add_graph_pass(
+			graph,
+			"blas_input",
+			[source = mesh.vertices.handle,
+			 vertices_offset = mesh.vertices_offset,
+			 index_source = mesh.indices.handle,
+			 indices_offset = mesh.indices_offset,
+			 target = copy.handle,
+			 input](VkCommandBuffer command_buffer) {
+				auto vertex_region = VkBufferCopy{
+						.srcOffset = vertices_offset,
+						.dstOffset = 0,
+						.size = input.vertex_size};
+				vkCmdCopyBuffer(command_buffer, source, target, 1, &vertex_region);
+				auto index_region = VkBufferCopy{
+						.srcOffset = indices_offset + input.index_offset,
+						.dstOffset = input.vertex_size,
+						.size = input.index_size};
+				vkCmdCopyBuffer(
+						command_buffer,
+						index_source,
+						target,
+						1,
+						&index_region);
+			},
+			false);
+	graph_read(graph, copy_pass, vertices, copy_read);
+	graph_read(graph, copy_pass, indices, copy_read);
+	graph_write(
+			graph,
+			copy_pass,
+			copy_resource,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+
+	auto build_pass = add_graph_pass(
+			graph,
+			"blas_build",
+			[&mesh,
+			 input,
+			 copy_address,
+			 blas = ray_tracing.blas.handle,
+			 scratch_data](VkCommandBuffer command_buffer) {
+				auto geometry = blas_geometry(mesh, input, copy_address);
+				auto build_info = VkAccelerationStructureBuildGeometryInfoKHR{
+						.sType =
+								VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+						.pNext = VK_NULL_HANDLE,
+						.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+						.flags = g_blas_flags,
+						.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+						.srcAccelerationStructure = VK_NULL_HANDLE,
+						.dstAccelerationStructure = blas,
+						.geometryCount = 1,
+						.pGeometries = &geometry,
+						.ppGeometries = VK_NULL_HANDLE,
+						.scratchData = {.deviceAddress = scratch_data}};
+				record_build(command_buffer, build_info, input.triangle_count);
+			},
+			true);
+	graph_read(
+			graph,
+			build_pass,
+			copy_resource,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					.access = VK_ACCESS_2_SHADER_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_UNDEFINED});
+	graph_write(graph, build_pass, scratch_resource, g_scratch_access);
+	graph_write(graph, build_pass, blas_resource, g_build_write);
+
+	// Resets and queries are ordered by submission, the query only has to
+	// wait for the build.
+	auto query_pass = add_graph_pass(
+			graph,
+			"blas_query",
+			[blas = ray_tracing.blas.handle,
+			 query_pool = ray_tracing.compaction_query](
+					VkCommandBuffer command_buffer) {
+				vkCmdResetQueryPool(command_buffer, query_pool, 0, 1);
+				vkCmdWriteAccelerationStructuresPropertiesKHR(
+						command_buffer,
+						1,
+						&blas,
+						VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+						query_pool,
+						0);
+			},
+			true);
+	graph_read(graph, query_pass, blas_resource, g_build_read);
+}
+
+// Copies the bottom level structure into one of its compacted size once the
+// query returned it. The original is released once the frame is done.
+void add_blas_compact_pass(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		RayTracing& ray_tracing) {
+	auto compacted_size = VkDeviceSize{};
+	auto result = vkGetQueryPoolResults(
+			device,
+			ray_tracing.compaction_query,
+			0,
+			1,
+			sizeof(compacted_size),
+			&compacted_size,
+			sizeof(compacted_size),
+			VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY) {
+		return;
+	}
+	if (result != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to query the compacted BLAS size\n");
+		std::terminate();
+	}
+	ray_tracing.blas_compacted = true;
+
+	auto compacted = create_acceleration_structure(
+			device,
+			allocator,
+			VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			compacted_size);
+	auto source = import_graph_buffer(
+			graph,
+			ray_tracing.blas.buffer.handle,
+			g_build_read,
+			std::nullopt);
+	auto target = import_graph_buffer(
+			graph,
+			compacted.buffer.handle,
+			GraphState{},
+			std::nullopt);
+	auto pass = add_graph_pass(
+			graph,
+			"blas_compact",
+			[source = ray_tracing.blas.handle,
+			 target = compacted.handle](VkCommandBuffer command_buffer) {
+				auto copy_info = VkCopyAccelerationStructureInfoKHR{
+						.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+						.pNext = VK_NULL_HANDLE,
+						.src = source,
+						.dst = target,
+						.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR};
+				vkCmdCopyAccelerationStructureKHR(command_buffer, &copy_info);
+			},
+			true);
+	graph_read(graph, pass, source, g_build_read);
+	graph_write(graph, pass, target, g_build_write);
+	log_message(
+			LogLevel::info,
+			"Compacted BLAS from {} to {} bytes",
+			ray_tracing.blas.buffer.size,
+			compacted_size);
+	defer_deletion(
+			deletions,
+			[&device, &allocator, old = ray_tracing.blas]() mutable {
+				destroy_acceleration_structure(device, allocator, old);
+			});
+	ray_tracing.blas = compacted;
+}
+
+// instance's transform with the mesh's position scale and offset folded in,
+// since the bottom level structure holds the positions as stored.
+auto instance_transform(const Mesh& mesh, const InstanceTransform& instance)
+		-> InstanceTransform {
+	auto transform = InstanceTransform{};
+	for (auto row = size_t{}; row < 3; row++) {
+		const auto& factors = instance.rows.at(row);
+		auto linear = glm::vec3(factors);
+		transform.rows.at(row) = glm::vec4(
+				linear * mesh.position_scale,
+				glm::dot(linear, mesh.position_offset) + factors.w);
+	}
+	return transform;
+}
+
+}  // namespace
+
+auto create_ray_tracing(
+		VkDevice& device,
+		VkPhysicalDevice physical_device,
+		Allocator& allocator,
+		uint32_t max_instances,
+		size_t frame_count) -> RayTracing {
+	auto ray_tracing = RayTracing{};
+	auto structure_properties =
+			VkPhysicalDeviceAccelerationStructurePropertiesKHR{};
+	structure_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &structure_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	ray_tracing.scratch_alignment = std::max(
+			VkDeviceSize{
+					structure_properties.minAccelerationStructureScratchOffsetAlignment},
+			VkDeviceSize{1});
+
+	auto query_info = VkQueryPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			.queryCount = 1,
+			.pipelineStatistics = 0};
+	if (vkCreateQueryPool(
+					device,
+					&query_info,
+					host_callbacks(),
+					&ray_tracing.compaction_query) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create BLAS compaction query pool\n");
+		std::terminate();
+	}
+
+	ray_tracing.max_instances = max_instances;
+	auto sizes = build_sizes(
+			device,
+			VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+			g_tlas_flags,
+			tlas_geometry(0),
+			max_instances);
+	ray_tracing.tlas = create_acceleration_structure(
+			device,
+			allocator,
+			VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+			sizes.accelerationStructureSize);
+	ray_tracing.tlas_scratch = create_scratch_buffer(
+			device,
+			allocator,
+			std::max(sizes.buildScratchSize, sizes.updateScratchSize),
+			ray_tracing.scratch_alignment);
+	ray_tracing.tlas_scratch_address = scratch_address(
+			device,
+			ray_tracing.tlas_scratch,
+			ray_tracing.scratch_alignment);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		ray_tracing.instances.emplace_back(create_dynamic_buffer(
+				device,
+				allocator,
+				VkDeviceSize{max_instances} *
+						sizeof(VkAccelerationStructureInstanceKHR),
+				VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+						VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT));
+	}
+	return ray_tracing;
+}
+
+void destroy_ray_tracing(
+		VkDevice& device,
+		Allocator& allocator,
+		RayTracing& ray_tracing) {
+	for (auto& buffer : ray_tracing.instances) {
+		destroy_buffer(device, allocator, buffer);
+	}
+	destroy_buffer(device, allocator, ray_tracing.tlas_scratch);
+	destroy_acceleration_structure(device, allocator, ray_tracing.tlas);
+	if (ray_tracing.blas.handle != VK_NULL_HANDLE) {
+		destroy_acceleration_structure(device, allocator, ray_tracing.blas);
+	}
+	vkDestroyQueryPool(device, ray_tracing.compaction_query, host_callbacks());
+	ray_tracing = RayTracing{};
+}
+
+auto add_ray_tracing_passes(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		RayTracing& ray_tracing,
+		const Mesh& mesh,
+		bool mesh_uploaded,
+		std::span<const InstanceTransform> instances,
+		size_t frame_idx) -> uint32_t {
+	if (instances.size() > ray_tracing.max_instances) {
+		fmt::print(
+				stderr,
+				"TLAS overflow: {} instances, room for {}\n",
+				instances.size(),
+				ray_tracing.max_instances);
+		std::terminate();
+	}
+	if (ray_tracing.blas.handle == VK_NULL_HANDLE && mesh_uploaded) {
+		add_blas_build_passes(
+				device,
+				allocator,
+				deletions,
+				graph,
+				ray_tracing,
+				mesh);
+	} else if (
+			ray_tracing.blas.handle != VK_NULL_HANDLE &&
+			!ray_tracing.blas_compacted) {
+		add_blas_compact_pass(device, allocator, deletions, graph, ray_tracing);
+	}
+
+	auto count = uint32_t{};
+	if (ray_tracing.blas.handle != VK_NULL_HANDLE) {
+		count = static_cast<uint32_t>(instances.size());
+		auto structures =
+				std::pmr::vector<VkAccelerationStructureInstanceKHR>(graph.arena);
+		for (auto i = uint32_t{}; i < count; i++) {
+			auto structure = VkAccelerationStructureInstanceKHR{
+					.transform = {},
+					.instanceCustomIndex = i,
+					.mask = 0xFF,
+					.instanceShaderBindingTableRecordOffset = 0,
+					.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
+					.accelerationStructureReference = ray_tracing.blas.address};
+			auto transform = instance_transform(mesh, instances[i]);
+			std::memcpy(&structure.transform, &transform, sizeof(transform));
+			structures.emplace_back(structure);
+		}
+		std::memcpy(
+				ray_tracing.instances.at(frame_idx).allocation.mapped,
+				structures.data(),
+				structures.size() * sizeof(VkAccelerationStructureInstanceKHR));
+	}
+	auto update = ray_tracing.tlas_built && count == ray_tracing.built_count &&
+			ray_tracing.blas.address == ray_tracing.built_blas &&
+			ray_tracing.updates < g_tlas_rebuild_interval;
+	if (update) {
+		ray_tracing.updates++;
+	} else {
+		ray_tracing.tlas_built = true;
+		ray_tracing.built_count = count;
+		ray_tracing.built_blas = ray_tracing.blas.address;
+		ray_tracing.updates = 0;
+	}
+
+	// Builds of earlier frames used the scratch memory, and their fragment
+	// shaders read the top level structure. The bottom level one was last
+	// written by a build or a compaction this frame or earlier.
+	auto tlas = import_graph_buffer(
+			graph,
+			ray_tracing.tlas.buffer.handle,
+			g_tlas_read,
+			std::nullopt);
+	auto scratch = import_graph_buffer(
+			graph,
+			ray_tracing.tlas_scratch.handle,
+			g_scratch_access,
+			std::nullopt);
+	auto blas = ray_tracing.blas.handle == VK_NULL_HANDLE
+			? g_graph_imported
+			: import_graph_buffer(
+						graph,
+						ray_tracing.blas.buffer.handle,
+						g_build_read,
+						std::nullopt);
+	auto pass = add_graph_pass(
+			graph,
+			"tlas",
+			[tlas = ray_tracing.tlas.handle,
+			 instances_address = buffer_device_address(
+					 device,
+					 ray_tracing.instances.at(frame_idx)),
+			 scratch_data = ray_tracing.tlas_scratch_address,
+			 count,
+			 update](VkCommandBuffer command_buffer) {
+				auto geometry = tlas_geometry(instances_address);
+				auto build_info = VkAccelerationStructureBuildGeometryInfoKHR{
+						.sType =
+								VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+						.pNext = VK_NULL_HANDLE,
+						.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+						.flags = g_tlas_flags,
+						.mode = update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR
+													 : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+						.srcAccelerationStructure = update ? tlas : VK_NULL_HANDLE,
+						.dstAccelerationStructure = tlas,
+						.geometryCount = 1,
+						.pGeometries = &geometry,
+						.ppGeometries = VK_NULL_HANDLE,
+						.scratchData = {.deviceAddress = scratch_data}};
+				record_build(command_buffer, build_info, count);
+			},
+			false);
+	graph_write(graph, pass, scratch, g_scratch_access);
+	if (blas != g_graph_imported) {
+		graph_read(graph, pass, blas, g_build_read);
+	}
+	// An update reads the structure it refits in place.
+	graph_write(
+			graph,
+			pass,
+			tlas,
+			update ? g_scratch_access : g_build_write);
+	return tlas;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "instancing.hpp"
+#include "mesh.hpp"
+#include "render_graph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Updates of the top level structure between two builds. An update only
+// refits its nodes, which loosen as the instances move.
+constexpr auto g_tlas_rebuild_interval = uint32_t{64};
+
+// How the fragment shader reads the top level structure, the state of its
+// resource once the passes tracing through it ran.
+constexpr auto g_tlas_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.access = VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+struct AccelerationStructure {
+	Buffer buffer;
+	VkAccelerationStructureKHR handle{};
+	VkDeviceAddress address{};
+};
+
+// Acceleration structures of the demo's scene, a single mesh drawn as any
+// number of instances. The bottom level structure is built from the mesh once
+// its uploads are done, then compacted once the build reported the compacted
+// size, which takes a frame or two. The top level structure is built or
+// updated every frame from that frame's instances.
+struct RayTracing {
+	// minAccelerationStructureScratchOffsetAlignment.
+	VkDeviceSize scratch_alignment{};
+	AccelerationStructure blas;
+	bool blas_compacted{};
+	VkQueryPool compaction_query{};
+	// Sized for max_instances, so its handle never changes and the bindless
+	// table points at it from the start.
+	AccelerationStructure tlas;
+	uint32_t max_instances{};
+	Buffer tlas_scratch;
+	VkDeviceAddress tlas_scratch_address{};
+	// Host visible VkAccelerationStructureInstanceKHR arrays, one per frame in
+	// flight, read by the builds in place like the uniform ring.
+	std::vector<Buffer> instances;
+	// What the top level structure was last built from. Updates have to keep
+	// the instance count, and instances of another bottom level structure
+	// would leave it a poor fit.
+	bool tlas_built{};
+	uint32_t built_count{};
+	VkDeviceAddress built_blas{};
+	uint32_t updates{};
+};
+
+// The allocator must do device addresses and the device have the ray query
+// capability.
+auto create_ray_tracing(
+		VkDevice& device,
+		VkPhysicalDevice physical_device,
+		Allocator& allocator,
+		uint32_t max_instances,
+		size_t frame_count) -> RayTracing;
+// The device must be idle.
+void destroy_ray_tracing(
+		VkDevice& device,
+		Allocator& allocator,
+		RayTracing& ray_tracing);
+
+// Adds the frame's acceleration structure passes and returns the top level
+// structure's resource, which passes tracing rays read at g_tlas_read. The
+// bottom level structure is only built once mesh_uploaded, until then the
+// top level one is empty and every ray misses. instances place the mesh in
+// the space rays are traced in, at most max_instances of them.
+auto add_ray_tracing_passes(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		RenderGraph& graph,
+		RayTracing& ray_tracing,
+		const Mesh& mesh,
+		bool mesh_uploaded,
+		std::span<const InstanceTransform> instances,
+		size_t frame_idx) -> uint32_t;
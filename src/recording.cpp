@@ -0,0 +1,259 @@
+#include "recording.hpp"
+
+#include "host_memory.hpp"
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// Smallest chunk worth a secondary command buffer; below this the cost of
+// vkCmdExecuteCommands and the rebinding at the start of each chunk dominates.
+constexpr auto g_min_chunk_items = size_t{128};
+// Chunks per thread, so threads that finish early can pick up more work.
+constexpr auto g_chunks_per_thread = size_t{4};
+
+// Baked secondaries live for many frames, so their pools are not transient.
+auto create_recording_pool(
+		VkDevice& device,
+		uint32_t family_idx,
+		VkCommandPoolCreateFlags flags) -> RecordingPool {
+	auto pool = RecordingPool{};
+	auto pool_info = VkCommandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = flags,
+			.queueFamilyIndex = family_idx};
+	if (vkCreateCommandPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&pool.command_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create recording command pool\n");
+		std::terminate();
+	}
+	return pool;
+}
+
+auto next_command_buffer(VkDevice& device, RecordingPool& pool)
+		-> VkCommandBuffer {
+	if (pool.used == pool.command_buffers.size()) {
+		auto allocate_info = VkCommandBufferAllocateInfo{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.commandPool = pool.command_pool,
+				.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+				.commandBufferCount = 1};
+		auto* command_buffer = VkCommandBuffer{};
+		if (vkAllocateCommandBuffers(device, &allocate_info, &command_buffer) !=
+				VK_SUCCESS) {
+			fmt::print(stderr, "Failed to allocate secondary command buffer\n");
+			std::terminate();
+		}
+		pool.command_buffers.emplace_back(command_buffer);
+	}
+	return pool.command_buffers.at(pool.used++);
+}
+
+auto create_thread_pools(
+		VkDevice& device,
+		JobSystem& jobs,
+		uint32_t family_idx,
+		VkCommandPoolCreateFlags flags) -> std::vector<RecordingPool> {
+	auto pools = std::vector<RecordingPool>{};
+	pools.reserve(job_thread_count(jobs));
+	for (auto i = size_t{}; i < job_thread_count(jobs); i++) {
+		pools.emplace_back(create_recording_pool(device, family_idx, flags));
+	}
+	return pools;
+}
+
+void reset_pools(VkDevice& device, std::vector<RecordingPool>& pools) {
+	for (auto& pool : pools) {
+		vkResetCommandPool(device, pool.command_pool, 0);
+		pool.used = 0;
+	}
+}
+
+// Records item_count items into chunks, from the pools of the threads
+// recording them.
+void record_chunks(
+		VkDevice& device,
+		JobSystem& jobs,
+		std::vector<RecordingPool>& pools,
+		VkCommandBufferUsageFlags usage,
+		const VkCommandBufferInheritanceInfo& inheritance,
+		size_t item_count,
+		const RecordRange& record,
+		std::vector<VkCommandBuffer>& chunks) {
+	auto thread_count = job_thread_count(jobs);
+	auto chunk_size = std::max(
+			g_min_chunk_items,
+			(item_count + thread_count * g_chunks_per_thread - 1) /
+					(thread_count * g_chunks_per_thread));
+	auto chunk_count = (item_count + chunk_size - 1) / chunk_size;
+	chunks.resize(chunk_count);
+
+	auto begin_info = VkCommandBufferBeginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+			.pInheritanceInfo = &inheritance};
+	auto record_chunk = [&](size_t chunk) {
+		VKDEMO_ZONE("record_chunk");
+		auto& pool = pools.at(current_job_thread());
+		auto* command_buffer = next_command_buffer(device, pool);
+		vkBeginCommandBuffer(command_buffer, &begin_info);
+		auto begin = chunk * chunk_size;
+		record(command_buffer, begin, std::min(begin + chunk_size, item_count));
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to record secondary command buffer\n");
+			std::terminate();
+		}
+		chunks.at(chunk) = command_buffer;
+	};
+	// A single chunk is not worth a round trip through the job queues.
+	if (chunk_count == 1) {
+		record_chunk(0);
+	} else {
+		auto counter = JobCounter{};
+		for (auto chunk = size_t{}; chunk < chunk_count; chunk++) {
+			submit_job(
+					jobs,
+					counter,
+					[&record_chunk, chunk] { record_chunk(chunk); });
+		}
+		wait_for_counter(jobs, counter);
+	}
+}
+
+}  // namespace
+
+auto create_parallel_recorder(
+		VkDevice& device,
+		JobSystem& jobs,
+		uint32_t family_idx,
+		size_t frame_count) -> ParallelRecorder {
+	auto recorder = ParallelRecorder{};
+	recorder.jobs = &jobs;
+	recorder.pools.reserve(frame_count);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		recorder.pools.emplace_back(create_thread_pools(
+				device,
+				jobs,
+				family_idx,
+				VK_COMMAND_POOL_CREATE_TRANSIENT_BIT));
+	}
+	return recorder;
+}
+
+void destroy_parallel_recorder(VkDevice& device, ParallelRecorder& recorder) {
+	for (auto& frame_pools : recorder.pools) {
+		for (auto& pool : frame_pools) {
+			vkDestroyCommandPool(device, pool.command_pool, host_callbacks());
+		}
+	}
+	recorder = ParallelRecorder{};
+}
+
+void begin_parallel_frame(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		size_t frame_idx) {
+	reset_pools(device, recorder.pools.at(frame_idx));
+}
+
+void record_parallel(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		size_t frame_idx,
+		VkCommandBuffer primary,
+		const VkCommandBufferInheritanceInfo& inheritance,
+		size_t item_count,
+		const RecordRange& record) {
+	if (item_count == 0) {
+		return;
+	}
+	record_chunks(
+			device,
+			*recorder.jobs,
+			recorder.pools.at(frame_idx),
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			inheritance,
+			item_count,
+			record,
+			recorder.chunks);
+	vkCmdExecuteCommands(
+			primary,
+			static_cast<uint32_t>(recorder.chunks.size()),
+			recorder.chunks.data());
+}
+
+auto create_baked_recording(
+		VkDevice& device,
+		JobSystem& jobs,
+		uint32_t family_idx,
+		size_t frame_count) -> BakedRecording {
+	auto baked = BakedRecording{};
+	baked.frames.resize(frame_count);
+	for (auto& frame : baked.frames) {
+		frame.pools = create_thread_pools(device, jobs, family_idx, 0);
+	}
+	return baked;
+}
+
+void destroy_baked_recording(VkDevice& device, BakedRecording& baked) {
+	for (auto& frame : baked.frames) {
+		for (auto& pool : frame.pools) {
+			vkDestroyCommandPool(device, pool.command_pool, host_callbacks());
+		}
+	}
+	baked = BakedRecording{};
+}
+
+void invalidate_baked_recording(BakedRecording& baked) {
+	for (auto& frame : baked.frames) {
+		frame.recorded = false;
+	}
+}
+
+void record_baked(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		BakedRecording& baked,
+		size_t frame_idx,
+		VkCommandBuffer primary,
+		const VkCommandBufferInheritanceInfo& inheritance,
+		size_t item_count,
+		std::span<const uint64_t> key,
+		const RecordRange& record) {
+	auto& frame = baked.frames.at(frame_idx);
+	if (!frame.recorded || !std::ranges::equal(frame.key, key)) {
+		reset_pools(device, frame.pools);
+		frame.chunks.clear();
+		if (item_count > 0) {
+			record_chunks(
+					device,
+					*recorder.jobs,
+					frame.pools,
+					0,
+					inheritance,
+					item_count,
+					record,
+					frame.chunks);
+		}
+		frame.key.assign(key.begin(), key.end());
+		frame.recorded = true;
+	}
+	if (frame.chunks.empty()) {
+		return;
+	}
+	vkCmdExecuteCommands(
+			primary,
+			static_cast<uint32_t>(frame.chunks.size()),
+			frame.chunks.data());
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "jobs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Command pool of one recording thread for one frame in flight. The pool is
+// reset each frame and its secondary command buffers are reused.
+struct RecordingPool {
+	VkCommandPool command_pool{};
+	std::vector<VkCommandBuffer> command_buffers;
+	size_t used{};
+};
+
+// Records items [begin, end) into a secondary command buffer. Secondaries do
+// not inherit state, so every chunk has to bind its own pipeline, descriptor
+// sets and dynamic state. Runs concurrently with other chunks.
+using RecordRange = std::function<
+		void(VkCommandBuffer command_buffer, size_t begin, size_t end)>;
+
+// Splits draw recording into jobs. Each job thread records into secondary
+// command buffers from its own pool, and the primary executes them in item
+// order.
+struct ParallelRecorder {
+	JobSystem* jobs{};
+	// Indexed by frame, then by job thread.
+	std::vector<std::vector<RecordingPool>> pools;
+	std::vector<VkCommandBuffer> chunks;
+};
+
+// The secondaries of one frame in flight that later frames execute again.
+struct BakedFrame {
+	// One for every job thread, only reset to rerecord.
+	std::vector<RecordingPool> pools;
+	std::vector<VkCommandBuffer> chunks;
+	// What the chunks were recorded with.
+	std::vector<uint64_t> key;
+	bool recorded{};
+};
+
+// Secondaries recorded once, without ONE_TIME_SUBMIT, for draws whose
+// commands stay the same from frame to frame, and executed again until the
+// key they were recorded with changes. Every frame in flight has its own,
+// since the commands name the frame's buffers and uniform slots, and they
+// are only reset once the frame's fence was waited on.
+struct BakedRecording {
+	std::vector<BakedFrame> frames;
+};
+
+auto create_parallel_recorder(
+		VkDevice& device,
+		JobSystem& jobs,
+		uint32_t family_idx,
+		size_t frame_count) -> ParallelRecorder;
+// The device must be idle.
+void destroy_parallel_recorder(VkDevice& device, ParallelRecorder& recorder);
+
+// Resets the frame's pools. The frame fence must have been waited on.
+void begin_parallel_frame(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		size_t frame_idx);
+
+// Records item_count items inside the render pass described by inheritance
+// and executes them into primary, which must have begun the render pass with
+// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+void record_parallel(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		size_t frame_idx,
+		VkCommandBuffer primary,
+		const VkCommandBufferInheritanceInfo& inheritance,
+		size_t item_count,
+		const RecordRange& record);
+
+auto create_baked_recording(
+		VkDevice& device,
+		JobSystem& jobs,
+		uint32_t family_idx,
+		size_t frame_count) -> BakedRecording;
+// The device must be idle.
+void destroy_baked_recording(VkDevice& device, BakedRecording& baked);
+
+// Rerecords every frame's secondaries the next time they are used, for when
+// something they name was replaced without changing their key, like a
+// pipeline or a buffer whose handle may be reused.
+void invalidate_baked_recording(BakedRecording& baked);
+
+// Appends the bytes of value to a key of record_baked, a word at a time.
+template <typename T>
+void append_baked_key(std::vector<uint64_t>& key, const T& value) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	auto first = key.size();
+	key.resize(first + (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+	std::memcpy(key.data() + first, &value, sizeof(T));
+}
+
+// Like record_parallel, but executes the frame's baked secondaries when they
+// were recorded with the same key, and only records them otherwise. key must
+// tell apart everything record and inheritance put into the commands that
+// is not invalidated otherwise, including item_count. The frame fence must
+// have been waited on.
+void record_baked(
+		VkDevice& device,
+		ParallelRecorder& recorder,
+		BakedRecording& baked,
+		size_t frame_idx,
+		VkCommandBuffer primary,
+		const VkCommandBufferInheritanceInfo& inheritance,
+		size_t item_count,
+		std::span<const uint64_t> key,
+		const RecordRange& record);
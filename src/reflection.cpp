@@ -0,0 +1,570 @@
+#include "reflection.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_spirv_magic = uint32_t{0x07230203};
+constexpr auto g_spirv_header_words = size_t{5};
+
+// The opcodes, decorations, storage classes and execution models read here,
+// from the SPIR-V specification.
+constexpr auto g_op_entry_point = 15U;
+constexpr auto g_op_type_int = 21U;
+constexpr auto g_op_type_float = 22U;
+constexpr auto g_op_type_vector = 23U;
+constexpr auto g_op_type_matrix = 24U;
+constexpr auto g_op_type_image = 25U;
+constexpr auto g_op_type_sampler = 26U;
+constexpr auto g_op_type_sampled_image = 27U;
+constexpr auto g_op_type_array = 28U;
+constexpr auto g_op_type_runtime_array = 29U;
+constexpr auto g_op_type_struct = 30U;
+constexpr auto g_op_type_pointer = 32U;
+constexpr auto g_op_constant = 43U;
+constexpr auto g_op_spec_constant = 50U;
+constexpr auto g_op_variable = 59U;
+constexpr auto g_op_decorate = 71U;
+constexpr auto g_op_member_decorate = 72U;
+constexpr auto g_op_type_acceleration_structure = 5341U;
+
+constexpr auto g_decoration_buffer_block = 3U;
+constexpr auto g_decoration_array_stride = 6U;
+constexpr auto g_decoration_matrix_stride = 7U;
+constexpr auto g_decoration_built_in = 11U;
+constexpr auto g_decoration_location = 30U;
+constexpr auto g_decoration_binding = 33U;
+constexpr auto g_decoration_descriptor_set = 34U;
+constexpr auto g_decoration_offset = 35U;
+
+constexpr auto g_storage_uniform_constant = 0U;
+constexpr auto g_storage_input = 1U;
+constexpr auto g_storage_uniform = 2U;
+constexpr auto g_storage_push_constant = 9U;
+constexpr auto g_storage_storage_buffer = 12U;
+
+struct MemberLayout {
+	uint32_t offset{};
+	uint32_t matrix_stride{};
+};
+
+struct Decorations {
+	std::optional<uint32_t> location;
+	std::optional<uint32_t> binding;
+	std::optional<uint32_t> set;
+	uint32_t array_stride{};
+	bool buffer_block{};
+	bool built_in{};
+	std::vector<MemberLayout> members;
+};
+
+// Every result id's defining instruction, operands after the opcode word.
+struct Module {
+	std::vector<std::span<const uint32_t>> definitions;
+	std::vector<Decorations> decorations;
+};
+
+[[noreturn]] void malformed(const char* what) {
+	fmt::print(stderr, "Malformed SPIR-V: {}\n", what);
+	std::terminate();
+}
+
+auto operand(std::span<const uint32_t> operands, size_t i) -> uint32_t {
+	if (i >= operands.size()) {
+		malformed("missing operand");
+	}
+	return operands[i];
+}
+
+auto definition(const Module& module, uint32_t id)
+		-> std::span<const uint32_t> {
+	if (id >= module.definitions.size() || module.definitions[id].empty()) {
+		malformed("undefined id");
+	}
+	return module.definitions[id];
+}
+
+// Opcode of an id's definition, followed by its operands.
+auto opcode(const Module& module, uint32_t id) -> uint32_t {
+	return definition(module, id).front() & 0xffffU;
+}
+
+auto constant_value(const Module& module, uint32_t id) -> uint32_t {
+	auto op = opcode(module, id);
+	if (op != g_op_constant && op != g_op_spec_constant) {
+		malformed("array length is not a constant");
+	}
+	// Spec constants count with their default, which is a lower bound for
+	// arrays sized by them.
+	return operand(definition(module, id), 3);
+}
+
+auto type_size(const Module& module, uint32_t type, uint32_t matrix_stride)
+		-> uint32_t {
+	auto words = definition(module, type);
+	switch (opcode(module, type)) {
+		case g_op_type_int:
+		case g_op_type_float:
+			return operand(words, 2) / 8;
+		case g_op_type_vector:
+			return operand(words, 3) * type_size(module, operand(words, 2), 0);
+		case g_op_type_matrix: {
+			auto column = operand(words, 2);
+			auto stride =
+					matrix_stride != 0 ? matrix_stride : type_size(module, column, 0);
+			return operand(words, 3) * stride;
+		}
+		case g_op_type_array: {
+			auto element = operand(words, 2);
+			auto stride = module.decorations.at(type).array_stride;
+			if (stride == 0) {
+				stride = type_size(module, element, 0);
+			}
+			return constant_value(module, operand(words, 3)) * stride;
+		}
+		case g_op_type_struct: {
+			const auto& members = module.decorations.at(type).members;
+			auto size = uint32_t{};
+			for (auto i = size_t{}; i + 2 < words.size(); i++) {
+				auto layout = i < members.size() ? members[i] : MemberLayout{};
+				size = std::max(
+						size,
+						layout.offset +
+								type_size(module, words[i + 2], layout.matrix_stride));
+			}
+			return size;
+		}
+		default:
+			malformed("unsized type in a block");
+	}
+}
+
+auto input_format(const Module& module, uint32_t type) -> VkFormat {
+	auto words = definition(module, type);
+	auto component = type;
+	auto count = 1U;
+	if (opcode(module, type) == g_op_type_vector) {
+		component = operand(words, 2);
+		count = operand(words, 3);
+	}
+	auto component_words = definition(module, component);
+	auto is_float = opcode(module, component) == g_op_type_float;
+	auto is_signed = is_float || operand(component_words, 3) != 0;
+	if (operand(component_words, 2) != 32 || count < 1 || count > 4) {
+		return VK_FORMAT_UNDEFINED;
+	}
+	constexpr auto float_formats = std::array{
+			VK_FORMAT_R32_SFLOAT,
+			VK_FORMAT_R32G32_SFLOAT,
+			VK_FORMAT_R32G32B32_SFLOAT,
+			VK_FORMAT_R32G32B32A32_SFLOAT};
+	constexpr auto sint_formats = std::array{
+			VK_FORMAT_R32_SINT,
+			VK_FORMAT_R32G32_SINT,
+			VK_FORMAT_R32G32B32_SINT,
+			VK_FORMAT_R32G32B32A32_SINT};
+	constexpr auto uint_formats = std::array{
+			VK_FORMAT_R32_UINT,
+			VK_FORMAT_R32G32_UINT,
+			VK_FORMAT_R32G32B32_UINT,
+			VK_FORMAT_R32G32B32A32_UINT};
+	if (is_float) {
+		return float_formats.at(count - 1);
+	}
+	return is_signed ? sint_formats.at(count - 1) : uint_formats.at(count - 1);
+}
+
+// Appends one input per location the type takes from location on.
+void add_inputs(
+		const Module& module,
+		uint32_t type,
+		uint32_t location,
+		std::vector<ShaderInput>& inputs) {
+	auto words = definition(module, type);
+	auto op = opcode(module, type);
+	if (op == g_op_type_array) {
+		auto length = constant_value(module, operand(words, 3));
+		for (auto i = 0U; i < length; i++) {
+			add_inputs(module, operand(words, 2), location + i, inputs);
+		}
+	} else if (op == g_op_type_matrix) {
+		for (auto i = 0U; i < operand(words, 3); i++) {
+			add_inputs(module, operand(words, 2), location + i, inputs);
+		}
+	} else {
+		inputs.emplace_back(ShaderInput{
+				.location = location,
+				.format = input_format(module, type)});
+	}
+}
+
+auto descriptor_type(const Module& module, uint32_t storage, uint32_t type)
+		-> std::optional<VkDescriptorType> {
+	// Arrays of descriptors declare one binding.
+	while (opcode(module, type) == g_op_type_array ||
+				 opcode(module, type) == g_op_type_runtime_array) {
+		type = operand(definition(module, type), 2);
+	}
+	if (storage == g_storage_storage_buffer) {
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+	if (storage == g_storage_uniform) {
+		return module.decorations.at(type).buffer_block
+				? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+				: VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	}
+	if (storage != g_storage_uniform_constant) {
+		return std::nullopt;
+	}
+	switch (opcode(module, type)) {
+		case g_op_type_image:
+			// Sampled 2 is a storage image, 1 one used with a sampler.
+			return operand(definition(module, type), 7) == 2
+					? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+					: VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		case g_op_type_sampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case g_op_type_sampled_image:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case g_op_type_acceleration_structure:
+			return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+		default:
+			return std::nullopt;
+	}
+}
+
+auto execution_stage(uint32_t model) -> VkShaderStageFlagBits {
+	switch (model) {
+		case 0:
+			return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1:
+			return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2:
+			return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3:
+			return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4:
+			return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5:
+			return VK_SHADER_STAGE_COMPUTE_BIT;
+		case 5364:
+			return VK_SHADER_STAGE_TASK_BIT_EXT;
+		case 5365:
+			return VK_SHADER_STAGE_MESH_BIT_EXT;
+		default:
+			malformed("unknown execution model");
+	}
+}
+
+void decorate(Decorations& target, uint32_t decoration, uint32_t value) {
+	switch (decoration) {
+		case g_decoration_buffer_block:
+			target.buffer_block = true;
+			break;
+		case g_decoration_array_stride:
+			target.array_stride = value;
+			break;
+		case g_decoration_built_in:
+			target.built_in = true;
+			break;
+		case g_decoration_location:
+			target.location = value;
+			break;
+		case g_decoration_binding:
+			target.binding = value;
+			break;
+		case g_decoration_descriptor_set:
+			target.set = value;
+			break;
+		default:
+			break;
+	}
+}
+
+auto parse_module(std::span<const uint32_t> code, uint32_t& execution_model)
+		-> Module {
+	if (code.size() < g_spirv_header_words || code[0] != g_spirv_magic) {
+		malformed("bad header");
+	}
+	auto module = Module{};
+	auto bound = code[3];
+	module.definitions.resize(bound);
+	module.decorations.resize(bound);
+	auto has_entry_point = false;
+	auto id = [&](uint32_t value) -> uint32_t {
+		if (value >= bound) {
+			malformed("id out of bounds");
+		}
+		return value;
+	};
+	for (auto i = g_spirv_header_words; i < code.size();) {
+		auto word_count = code[i] >> 16U;
+		auto op = code[i] & 0xffffU;
+		if (word_count == 0 || i + word_count > code.size()) {
+			malformed("truncated instruction");
+		}
+		auto words = code.subspan(i, word_count);
+		auto operands = words.subspan(1);
+		i += word_count;
+		switch (op) {
+			case g_op_entry_point:
+				if (!has_entry_point) {
+					execution_model = operand(operands, 0);
+					has_entry_point = true;
+				}
+				break;
+			case g_op_decorate: {
+				auto& target = module.decorations.at(id(operand(operands, 0)));
+				auto value = operands.size() > 2 ? operands[2] : 0U;
+				decorate(target, operand(operands, 1), value);
+				break;
+			}
+			case g_op_member_decorate: {
+				auto& members = module.decorations.at(id(operand(operands, 0))).members;
+				auto member = operand(operands, 1);
+				if (member >= members.size()) {
+					members.resize(member + 1);
+				}
+				if (operand(operands, 2) == g_decoration_offset) {
+					members.at(member).offset = operand(operands, 3);
+				} else if (operand(operands, 2) == g_decoration_matrix_stride) {
+					members.at(member).matrix_stride = operand(operands, 3);
+				} else if (operand(operands, 2) == g_decoration_built_in) {
+					module.decorations.at(operand(operands, 0)).built_in = true;
+				}
+				break;
+			}
+			case g_op_type_int:
+			case g_op_type_float:
+			case g_op_type_vector:
+			case g_op_type_matrix:
+			case g_op_type_image:
+			case g_op_type_sampler:
+			case g_op_type_sampled_image:
+			case g_op_type_array:
+			case g_op_type_runtime_array:
+			case g_op_type_struct:
+			case g_op_type_pointer:
+			case g_op_type_acceleration_structure:
+				module.definitions.at(id(operand(operands, 0))) = words;
+				break;
+			case g_op_constant:
+			case g_op_spec_constant:
+			case g_op_variable:
+				module.definitions.at(id(operand(operands, 1))) = words;
+				break;
+			default:
+				break;
+		}
+	}
+	if (!has_entry_point) {
+		malformed("no entry point");
+	}
+	return module;
+}
+
+}  // namespace
+
+auto reflect_shader(std::span<const uint32_t> code) -> ShaderReflection {
+	auto execution_model = uint32_t{};
+	auto module = parse_module(code, execution_model);
+	auto reflection = ShaderReflection{};
+	reflection.stage = execution_stage(execution_model);
+	for (auto variable = uint32_t{}; variable < module.definitions.size();
+			 variable++) {
+		const auto& words = module.definitions[variable];
+		if (words.empty() || (words.front() & 0xffffU) != g_op_variable) {
+			continue;
+		}
+		auto storage = operand(words, 3);
+		auto pointer = definition(module, operand(words, 1));
+		auto type = operand(pointer, 3);
+		const auto& decorations = module.decorations.at(variable);
+		if (storage == g_storage_push_constant) {
+			reflection.push_constant_size = std::max(
+					reflection.push_constant_size,
+					type_size(module, type, 0));
+		} else if (
+				storage == g_storage_input &&
+				reflection.stage == VK_SHADER_STAGE_VERTEX_BIT &&
+				decorations.location.has_value() && !decorations.built_in) {
+			add_inputs(module, type, *decorations.location, reflection.inputs);
+		} else if (decorations.binding.has_value()) {
+			auto descriptor = descriptor_type(module, storage, type);
+			if (descriptor.has_value()) {
+				reflection.bindings.emplace_back(ShaderBinding{
+						.set = decorations.set.value_or(0),
+						.binding = *decorations.binding,
+						.type = *descriptor});
+			}
+		}
+	}
+	std::sort(
+			reflection.inputs.begin(),
+			reflection.inputs.end(),
+			[](const ShaderInput& a, const ShaderInput& b) {
+				return a.location < b.location;
+			});
+	return reflection;
+}
+
+auto reflect_push_constant_range(
+		std::span<const ShaderReflection> stages,
+		uint32_t pushed_size) -> VkPushConstantRange {
+	auto range = VkPushConstantRange{
+			.stageFlags = 0,
+			.offset = 0,
+			.size = pushed_size};
+	for (const auto& stage : stages) {
+		if (stage.push_constant_size != 0) {
+			range.stageFlags |= stage.stage;
+			range.size = std::max(range.size, stage.push_constant_size);
+		}
+	}
+	if (range.stageFlags == 0) {
+		fmt::print(stderr, "No shader stage has push constants\n");
+		std::terminate();
+	}
+	return range;
+}
+
+auto shader_fits_layout(
+		const ShaderReflection& shader,
+		std::span<const ShaderBinding> available,
+		const VkPushConstantRange& push_constant_range) -> bool {
+	for (const auto& binding : shader.bindings) {
+		auto found = std::any_of(
+				available.begin(),
+				available.end(),
+				[&](const ShaderBinding& candidate) {
+					return candidate.set == binding.set &&
+							candidate.binding == binding.binding &&
+							candidate.type == binding.type;
+				});
+		if (!found) {
+			fmt::print(
+					stderr,
+					"Shader uses set {} binding {} with descriptor type {}, which "
+					"the layout does not have\n",
+					binding.set,
+					binding.binding,
+					static_cast<int>(binding.type));
+			return false;
+		}
+	}
+	if (shader.push_constant_size != 0 &&
+			((push_constant_range.stageFlags & shader.stage) == 0 ||
+			 shader.push_constant_size > push_constant_range.size)) {
+		fmt::print(
+				stderr,
+				"Shader push constants of {} bytes do not fit the layout's range\n",
+				shader.push_constant_size);
+		return false;
+	}
+	return true;
+}
+
+auto shader_fits_vertex_input(
+		const ShaderReflection& vertex,
+		std::span<const VkVertexInputAttributeDescription> attributes) -> bool {
+	for (const auto& input : vertex.inputs) {
+		auto provided = std::any_of(
+				attributes.begin(),
+				attributes.end(),
+				[&](const VkVertexInputAttributeDescription& attribute) {
+					return attribute.location == input.location;
+				});
+		if (!provided) {
+			fmt::print(
+					stderr,
+					"Vertex shader reads location {}, which has no attribute\n",
+					input.location);
+			return false;
+		}
+	}
+	return true;
+}
+
+void match_vertex_input(
+		const ShaderReflection& vertex,
+		VertexInputDescription& description) {
+	auto& attributes = description.attributes;
+	if (!shader_fits_vertex_input(vertex, attributes)) {
+		std::terminate();
+	}
+	std::erase_if(attributes, [&](const VkVertexInputAttributeDescription& a) {
+		return std::none_of(
+				vertex.inputs.begin(),
+				vertex.inputs.end(),
+				[&](const ShaderInput& input) {
+					return input.location == a.location;
+				});
+	});
+}
+
+auto get_pipeline_layout(
+		VkDevice& device,
+		PipelineLayoutCache& cache,
+		std::span<const VkDescriptorSetLayout> set_layouts,
+		std::span<const VkPushConstantRange> push_constant_ranges)
+		-> VkPipelineLayout {
+	auto same_range = [](const VkPushConstantRange& a,
+											 const VkPushConstantRange& b) {
+		return a.stageFlags == b.stageFlags && a.offset == b.offset &&
+				a.size == b.size;
+	};
+	for (const auto& cached : cache.layouts) {
+		if (std::equal(
+						cached.set_layouts.begin(),
+						cached.set_layouts.end(),
+						set_layouts.begin(),
+						set_layouts.end()) &&
+				std::equal(
+						cached.push_constant_ranges.begin(),
+						cached.push_constant_ranges.end(),
+						push_constant_ranges.begin(),
+						push_constant_ranges.end(),
+						same_range)) {
+			return cached.layout;
+		}
+	}
+
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount =
+					static_cast<uint32_t>(push_constant_ranges.size()),
+			.pPushConstantRanges = push_constant_ranges.data()};
+	auto* layout = VkPipelineLayout{};
+	if (vkCreatePipelineLayout(device, &layout_info, host_callbacks(), &layout) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create pipeline layout\n");
+		std::terminate();
+	}
+	cache.layouts.emplace_back(CachedPipelineLayout{
+			.set_layouts = {set_layouts.begin(), set_layouts.end()},
+			.push_constant_ranges =
+					{push_constant_ranges.begin(), push_constant_ranges.end()},
+			.layout = layout});
+	return layout;
+}
+
+void destroy_pipeline_layout_cache(
+		VkDevice& device,
+		PipelineLayoutCache& cache) {
+	for (auto& cached : cache.layouts) {
+		vkDestroyPipelineLayout(device, cached.layout, host_callbacks());
+	}
+	cache.layouts.clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "mesh.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A descriptor binding a shader declares. Arrays of descriptors are one
+// binding.
+struct ShaderBinding {
+	uint32_t set{};
+	uint32_t binding{};
+	VkDescriptorType type{};
+};
+
+// A user defined stage input. Arrays and matrices take one location per
+// element or column, each listed on its own.
+struct ShaderInput {
+	uint32_t location{};
+	VkFormat format{};
+};
+
+// What the layouts of a pipeline have to provide for a SPIR-V module, read
+// from the module itself so layouts follow the shaders instead of being
+// written out next to them.
+struct ShaderReflection {
+	VkShaderStageFlagBits stage{};
+	std::vector<ShaderBinding> bindings;
+	// Bytes of the push constant block, zero without one.
+	uint32_t push_constant_size{};
+	// Only for vertex shaders, sorted by location.
+	std::vector<ShaderInput> inputs;
+};
+
+// Reads the module's first entry point. Terminates on malformed SPIR-V.
+auto reflect_shader(std::span<const uint32_t> code) -> ShaderReflection;
+
+// One range for the stages that have a push constant block, as large as the
+// largest and at least pushed_size, what the host pushes at once, since a
+// push has to stay within the range. Terminates when no stage has a block.
+auto reflect_push_constant_range(
+		std::span<const ShaderReflection> stages,
+		uint32_t pushed_size) -> VkPushConstantRange;
+// Whether a pipeline layout with set 0 made of available and the given push
+// constant range provides everything the shader declares. Prints the first
+// mismatch.
+auto shader_fits_layout(
+		const ShaderReflection& shader,
+		std::span<const ShaderBinding> available,
+		const VkPushConstantRange& push_constant_range) -> bool;
+// Whether every location the vertex shader reads has an attribute. Prints the
+// first one missing.
+auto shader_fits_vertex_input(
+		const ShaderReflection& vertex,
+		std::span<const VkVertexInputAttributeDescription> attributes) -> bool;
+// Drops the attributes the vertex shader does not read. Terminates when it
+// reads a location the description has no attribute for.
+void match_vertex_input(
+		const ShaderReflection& vertex,
+		VertexInputDescription& description);
+
+struct CachedPipelineLayout {
+	std::vector<VkDescriptorSetLayout> set_layouts;
+	std::vector<VkPushConstantRange> push_constant_ranges;
+	VkPipelineLayout layout{};
+};
+
+// Pipeline layouts by their set layouts and push constant ranges. Pipelines
+// with equal reflected needs get the same layout, so binding one of them
+// after another keeps the bound descriptor sets and push constants valid.
+struct PipelineLayoutCache {
+	std::vector<CachedPipelineLayout> layouts;
+};
+
+auto get_pipeline_layout(
+		VkDevice& device,
+		PipelineLayoutCache& cache,
+		std::span<const VkDescriptorSetLayout> set_layouts,
+		std::span<const VkPushConstantRange> push_constant_ranges)
+		-> VkPipelineLayout;
+// The device must be idle.
+void destroy_pipeline_layout_cache(
+		VkDevice& device,
+		PipelineLayoutCache& cache);
@@ -0,0 +1,713 @@
+#include "reflection_probes.hpp"
+
+#include "depth.hpp"
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+namespace {
+
+// Match the bindings of EnvironmentPrefilter::set_layout.
+constexpr auto g_sampled_binding = 0U;
+constexpr auto g_storage_image_binding = 1U;
+// Matches the local size of environment_prefilter.comp.
+constexpr auto g_group_size = 8U;
+constexpr auto g_all_faces = (1U << g_probe_faces) - 1;
+// Of the probe's radius, geometry closer to the probe is clipped.
+constexpr auto g_near_scale = 0.01F;
+
+// Where the capture is between frames.
+constexpr auto g_capture_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_color_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+constexpr auto g_depth_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+constexpr auto g_blit_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+		.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+constexpr auto g_blit_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_BLIT_BIT,
+		.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Screen right, screen down and forward of a face, as cube_direction in
+// environment_prefilter.comp has them.
+struct FaceBasis {
+	glm::vec3 right;
+	glm::vec3 down;
+	glm::vec3 forward;
+};
+
+auto face_basis(uint32_t face) -> FaceBasis {
+	switch (face) {
+		case 0:
+			return {{0, 0, -1}, {0, -1, 0}, {1, 0, 0}};
+		case 1:
+			return {{0, 0, 1}, {0, -1, 0}, {-1, 0, 0}};
+		case 2:
+			return {{1, 0, 0}, {0, 0, 1}, {0, 1, 0}};
+		case 3:
+			return {{1, 0, 0}, {0, 0, -1}, {0, -1, 0}};
+		case 4:
+			return {{1, 0, 0}, {0, -1, 0}, {0, 0, 1}};
+		default:
+			return {{-1, 0, 0}, {0, -1, 0}, {0, 0, -1}};
+	}
+}
+
+auto face_size(uint32_t level) -> uint32_t {
+	return g_environment_face_size >> level;
+}
+
+auto create_probe_image(
+		VkDevice& device,
+		Allocator& allocator,
+		uint32_t level_count,
+		VkImageUsageFlags usage) -> Image {
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_environment_format,
+			.extent =
+					VkExtent3D{
+							.width = g_environment_face_size,
+							.height = g_environment_face_size,
+							.depth = 1},
+			.mipLevels = level_count,
+			.arrayLayers = g_probe_faces,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	return create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+}
+
+auto create_view(
+		VkDevice& device,
+		VkImage image,
+		VkImageViewType type,
+		const GraphSubresources& subresources) -> VkImageView {
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image,
+			.viewType = type,
+			.format = g_environment_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = subresources.base_level,
+					.levelCount = subresources.level_count,
+					.baseArrayLayer = subresources.base_layer,
+					.layerCount = subresources.layer_count}};
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a reflection probe view\n");
+		std::terminate();
+	}
+	return view;
+}
+
+void create_probe_sets(
+		VkDevice& device,
+		const EnvironmentPrefilter& prefilter,
+		VkDescriptorPool descriptor_pool,
+		ReflectionProbe& probe) {
+	auto layouts =
+			std::array<VkDescriptorSetLayout, g_environment_specular_levels>{};
+	layouts.fill(prefilter.set_layout);
+	auto allocate_info = VkDescriptorSetAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = descriptor_pool,
+			.descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+			.pSetLayouts = layouts.data()};
+	if (vkAllocateDescriptorSets(device, &allocate_info, probe.sets.data()) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate reflection probe sets\n");
+		std::terminate();
+	}
+	auto capture_info = VkDescriptorImageInfo{
+			.sampler = VK_NULL_HANDLE,
+			.imageView = probe.capture_view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	for (auto level = uint32_t{}; level < g_environment_specular_levels;
+			 level++) {
+		auto storage_info = VkDescriptorImageInfo{
+				.sampler = VK_NULL_HANDLE,
+				.imageView = probe.level_views.at(level),
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+		auto writes = std::array{
+				VkWriteDescriptorSet{
+						.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+						.pNext = VK_NULL_HANDLE,
+						.dstSet = probe.sets.at(level),
+						.dstBinding = g_sampled_binding,
+						.dstArrayElement = 0,
+						.descriptorCount = 1,
+						.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+						.pImageInfo = &capture_info,
+						.pBufferInfo = VK_NULL_HANDLE,
+						.pTexelBufferView = VK_NULL_HANDLE},
+				VkWriteDescriptorSet{
+						.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+						.pNext = VK_NULL_HANDLE,
+						.dstSet = probe.sets.at(level),
+						.dstBinding = g_storage_image_binding,
+						.dstArrayElement = 0,
+						.descriptorCount = 1,
+						.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+						.pImageInfo = &storage_info,
+						.pBufferInfo = VK_NULL_HANDLE,
+						.pTexelBufferView = VK_NULL_HANDLE}};
+		vkUpdateDescriptorSets(
+				device,
+				static_cast<uint32_t>(writes.size()),
+				writes.data(),
+				0,
+				VK_NULL_HANDLE);
+	}
+}
+
+auto create_probe(
+		VkDevice& device,
+		Allocator& allocator,
+		const EnvironmentPrefilter& prefilter,
+		VkDescriptorPool descriptor_pool) -> ReflectionProbe {
+	auto probe = ReflectionProbe{};
+	probe.capture = create_probe_image(
+			device,
+			allocator,
+			g_probe_capture_levels,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+	probe.capture_view = create_view(
+			device,
+			probe.capture.handle,
+			VK_IMAGE_VIEW_TYPE_CUBE,
+			GraphSubresources{
+					.base_level = 0,
+					.level_count = g_probe_capture_levels,
+					.base_layer = 0,
+					.layer_count = g_probe_faces});
+	for (auto face = uint32_t{}; face < g_probe_faces; face++) {
+		probe.face_views.at(face) = create_view(
+				device,
+				probe.capture.handle,
+				VK_IMAGE_VIEW_TYPE_2D,
+				GraphSubresources{
+						.base_level = 0,
+						.level_count = 1,
+						.base_layer = face,
+						.layer_count = 1});
+	}
+	probe.specular = create_probe_image(
+			device,
+			allocator,
+			g_environment_specular_levels,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+	probe.specular_view = create_view(
+			device,
+			probe.specular.handle,
+			VK_IMAGE_VIEW_TYPE_CUBE,
+			GraphSubresources{
+					.base_level = 0,
+					.level_count = g_environment_specular_levels,
+					.base_layer = 0,
+					.layer_count = g_probe_faces});
+	for (auto level = uint32_t{}; level < g_environment_specular_levels;
+			 level++) {
+		probe.level_views.at(level) = create_view(
+				device,
+				probe.specular.handle,
+				VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+				GraphSubresources{
+						.base_level = level,
+						.level_count = 1,
+						.base_layer = 0,
+						.layer_count = g_probe_faces});
+	}
+	create_probe_sets(device, prefilter, descriptor_pool, probe);
+	return probe;
+}
+
+void destroy_probe(
+		VkDevice& device,
+		Allocator& allocator,
+		ReflectionProbe& probe) {
+	vkDestroyImageView(device, probe.capture_view, host_callbacks());
+	for (auto* view : probe.face_views) {
+		vkDestroyImageView(device, view, host_callbacks());
+	}
+	vkDestroyImageView(device, probe.specular_view, host_callbacks());
+	for (auto* view : probe.level_views) {
+		vkDestroyImageView(device, view, host_callbacks());
+	}
+	destroy_image(device, allocator, probe.capture);
+	destroy_image(device, allocator, probe.specular);
+	probe = ReflectionProbe{};
+}
+
+void add_face_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		const ReflectionProbes& probes,
+		const ReflectionProbe& probe,
+		uint32_t capture,
+		uint32_t face,
+		GraphRecord draw) {
+	auto depth = add_transient_image(
+			graph,
+			VkImageCreateInfo{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+					.pNext = VK_NULL_HANDLE,
+					.flags = 0,
+					.imageType = VK_IMAGE_TYPE_2D,
+					.format = probes.depth_format,
+					.extent =
+							VkExtent3D{
+									.width = g_environment_face_size,
+									.height = g_environment_face_size,
+									.depth = 1},
+					.mipLevels = 1,
+					.arrayLayers = 1,
+					.samples = VK_SAMPLE_COUNT_1_BIT,
+					.tiling = VK_IMAGE_TILING_OPTIMAL,
+					.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+					.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+					.queueFamilyIndexCount = 0,
+					.pQueueFamilyIndices = VK_NULL_HANDLE,
+					.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED},
+			VK_IMAGE_ASPECT_DEPTH_BIT);
+	auto* face_view = probe.face_views.at(face);
+	auto record = [&graph, &profiler, frame_idx, face_view, depth,
+								 draw = std::move(draw)](VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "reflection_probe");
+		auto color_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = face_view,
+				.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.clearValue = VkClearValue{.color = {.float32 = {0, 0, 0, 1}}}};
+		auto depth_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = graph_image_view(graph, depth),
+				.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.clearValue = VkClearValue{
+						.depthStencil = {.depth = g_depth_clear_value, .stencil = 0}}};
+		auto rendering_info = VkRenderingInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderArea =
+						VkRect2D{
+								.offset = {0, 0},
+								.extent = {g_environment_face_size, g_environment_face_size}},
+				.layerCount = 1,
+				.viewMask = 0,
+				.colorAttachmentCount = 1,
+				.pColorAttachments = &color_attachment,
+				.pDepthAttachment = &depth_attachment,
+				.pStencilAttachment = VK_NULL_HANDLE};
+		vkCmdBeginRendering(command_buffer, &rendering_info);
+		draw(command_buffer);
+		vkCmdEndRendering(command_buffer);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "reflection_probe", record, false);
+	graph_write_subresources(
+			graph,
+			pass,
+			capture,
+			GraphSubresources{
+					.base_level = 0,
+					.level_count = 1,
+					.base_layer = face,
+					.layer_count = 1},
+			g_color_write);
+	graph_write(graph, pass, depth, g_depth_write);
+}
+
+// Each level of the capture's chain is blitted from the one above, for every
+// face at once.
+void add_mip_passes(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		const ReflectionProbe& probe,
+		uint32_t capture) {
+	auto* image = probe.capture.handle;
+	for (auto level = uint32_t{1}; level < g_probe_capture_levels; level++) {
+		auto record = [&profiler, frame_idx, image, level](
+											VkCommandBuffer command_buffer) {
+			auto gpu_pass = begin_gpu_pass(
+					profiler,
+					command_buffer,
+					frame_idx,
+					"reflection_probe_mips");
+			auto corner = [](uint32_t size) {
+				return VkOffset3D{
+						.x = static_cast<int32_t>(size),
+						.y = static_cast<int32_t>(size),
+						.z = 1};
+			};
+			auto region = VkImageBlit{
+					.srcSubresource =
+							VkImageSubresourceLayers{
+									.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+									.mipLevel = level - 1,
+									.baseArrayLayer = 0,
+									.layerCount = g_probe_faces},
+					.srcOffsets = {VkOffset3D{}, corner(face_size(level - 1))},
+					.dstSubresource =
+							VkImageSubresourceLayers{
+									.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+									.mipLevel = level,
+									.baseArrayLayer = 0,
+									.layerCount = g_probe_faces},
+					.dstOffsets = {VkOffset3D{}, corner(face_size(level))}};
+			vkCmdBlitImage(
+					command_buffer,
+					image,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					image,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1,
+					&region,
+					VK_FILTER_LINEAR);
+			end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+		};
+		auto pass = add_graph_pass(graph, "reflection_probe_mips", record, false);
+		graph_read_subresources(
+				graph,
+				pass,
+				capture,
+				GraphSubresources{
+						.base_level = level - 1,
+						.level_count = 1,
+						.base_layer = 0,
+						.layer_count = g_probe_faces},
+				g_blit_read);
+		graph_write_subresources(
+				graph,
+				pass,
+				capture,
+				GraphSubresources{
+						.base_level = level,
+						.level_count = 1,
+						.base_layer = 0,
+						.layer_count = g_probe_faces},
+				g_blit_write);
+	}
+}
+
+void add_prefilter_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		const ReflectionProbes& probes,
+		const ReflectionProbe& probe,
+		uint32_t capture) {
+	auto specular = import_graph_image(
+			graph,
+			probe.specular.handle,
+			probe.specular_view,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			probe.ready ? g_probe_specular_read : GraphState{},
+			g_probe_specular_read);
+	auto* pipeline = probes.pipeline;
+	auto* pipeline_layout = probes.pipeline_layout;
+	auto sets = probe.sets;
+	auto record = [&profiler, frame_idx, pipeline, pipeline_layout, sets](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass = begin_gpu_pass(
+				profiler,
+				command_buffer,
+				frame_idx,
+				"reflection_probe_prefilter");
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				pipeline);
+		auto constants = EnvironmentConstants{
+				.size = 0,
+				.roughness = 0,
+				.sample_count = g_environment_sample_count,
+				.source_levels = static_cast<float>(g_probe_capture_levels),
+				.source_texels = static_cast<float>(
+						g_probe_faces * g_environment_face_size *
+						g_environment_face_size)};
+		for (auto level = uint32_t{}; level < g_environment_specular_levels;
+				 level++) {
+			vkCmdBindDescriptorSets(
+					command_buffer,
+					VK_PIPELINE_BIND_POINT_COMPUTE,
+					pipeline_layout,
+					0,
+					1,
+					&sets.at(level),
+					0,
+					VK_NULL_HANDLE);
+			constants.size = static_cast<int32_t>(face_size(level));
+			constants.roughness = static_cast<float>(level) /
+					static_cast<float>(g_environment_specular_levels - 1);
+			vkCmdPushConstants(
+					command_buffer,
+					pipeline_layout,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					0,
+					sizeof(constants),
+					&constants);
+			auto groups = (face_size(level) + g_group_size - 1) / g_group_size;
+			vkCmdDispatch(command_buffer, groups, groups, g_probe_faces);
+		}
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass =
+			add_graph_pass(graph, "reflection_probe_prefilter", record, false);
+	graph_read(graph, pass, capture, g_capture_read);
+	graph_write(graph, pass, specular, g_storage_write);
+}
+
+}  // namespace
+
+auto create_reflection_probes(
+		VkDevice& device,
+		Allocator& allocator,
+		const EnvironmentPrefilter& prefilter,
+		size_t count,
+		VkFormat depth_format) -> ReflectionProbes {
+	auto probes = ReflectionProbes{};
+	probes.pipeline_layout = prefilter.pipeline_layout;
+	probes.pipeline = prefilter.cube_specular;
+	probes.depth_format = depth_format;
+	auto set_count =
+			static_cast<uint32_t>(count * g_environment_specular_levels);
+	auto pool_sizes = std::array{
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = set_count},
+			VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = set_count}};
+	auto pool_info = VkDescriptorPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.maxSets = set_count,
+			.poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data()};
+	if (vkCreateDescriptorPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&probes.descriptor_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create reflection probe descriptor pool\n");
+		std::terminate();
+	}
+	for (auto i = size_t{}; i < count; i++) {
+		probes.probes.emplace_back(create_probe(
+				device,
+				allocator,
+				prefilter,
+				probes.descriptor_pool));
+	}
+	return probes;
+}
+
+void destroy_reflection_probes(
+		VkDevice& device,
+		Allocator& allocator,
+		ReflectionProbes& probes) {
+	for (auto& probe : probes.probes) {
+		destroy_probe(device, allocator, probe);
+	}
+	vkDestroyDescriptorPool(device, probes.descriptor_pool, host_callbacks());
+	probes = ReflectionProbes{};
+}
+
+void place_reflection_probes(
+		ReflectionProbes& probes,
+		glm::vec4 bounding_sphere) {
+	auto center = glm::vec3(bounding_sphere);
+	auto radius = bounding_sphere.w;
+	auto count = probes.probes.size();
+	for (auto i = size_t{}; i < count; i++) {
+		auto angle = glm::two_pi<float>() * static_cast<float>(i) /
+				static_cast<float>(count);
+		auto& probe = probes.probes.at(i);
+		probe.position = center +
+				glm::vec3(std::cos(angle), 0.0F, std::sin(angle)) * (2.0F * radius);
+		probe.radius = radius;
+		probe.changed = true;
+	}
+	probes.placed = true;
+}
+
+void invalidate_reflection_probes(
+		ReflectionProbes& probes,
+		glm::vec3 center,
+		float radius) {
+	for (auto& probe : probes.probes) {
+		if (glm::distance(center, probe.position) <= radius + probe.radius) {
+			probe.changed = true;
+		}
+	}
+}
+
+auto probe_face_transform(const ReflectionProbe& probe, uint32_t face)
+		-> glm::mat4 {
+	// The rows give the face's clip space from the offset to the probe: x and
+	// y along the face, w the distance along its axis, and z the near plane's,
+	// so depth is reversed and reaches 0 at infinity.
+	auto basis = face_basis(face);
+	auto rows = glm::mat4(
+			glm::vec4(basis.right, 0.0F),
+			glm::vec4(basis.down, 0.0F),
+			glm::vec4(0.0F, 0.0F, 0.0F, probe.radius * g_near_scale),
+			glm::vec4(basis.forward, 0.0F));
+	auto offset = glm::mat4(1.0F);
+	offset[3] = glm::vec4(-probe.position, 1.0F);
+	return glm::transpose(rows) * offset;
+}
+
+auto select_probe_face(
+		ReflectionProbes& probes,
+		const glm::mat4& view_projection)
+		-> std::optional<std::pair<size_t, uint32_t>> {
+	auto frame = probes.frame++;
+	if (!probes.placed) {
+		return std::nullopt;
+	}
+	if (!probes.cycling.has_value()) {
+		// Reversed depth puts the near plane at 1.
+		auto near = glm::inverse(view_projection) *
+				glm::vec4(0.0F, 0.0F, 1.0F, 1.0F);
+		auto eye = glm::vec3(near) / near.w;
+		// Overdue probes weigh in by frames waited per radius of distance, an
+		// invalidated one as if it waited a whole refresh on top.
+		auto best_priority = 0.0F;
+		for (auto i = size_t{}; i < probes.probes.size(); i++) {
+			const auto& probe = probes.probes.at(i);
+			auto distance =
+					std::max(glm::distance(eye, probe.position), probe.radius) /
+					probe.radius;
+			auto waited = static_cast<float>(frame - probe.refreshed);
+			if (!probe.changed &&
+					waited < static_cast<float>(g_probe_refresh_frames) * distance) {
+				continue;
+			}
+			auto priority = waited / distance;
+			if (probe.changed) {
+				priority += static_cast<float>(g_probe_refresh_frames);
+			}
+			if (priority > best_priority || !probes.cycling.has_value()) {
+				best_priority = priority;
+				probes.cycling = i;
+			}
+		}
+		if (!probes.cycling.has_value()) {
+			return std::nullopt;
+		}
+		auto& probe = probes.probes.at(*probes.cycling);
+		probe.cycle_faces = 0;
+		probe.refreshed = frame;
+		probe.changed = false;
+	}
+	const auto& probe = probes.probes.at(*probes.cycling);
+	auto face = static_cast<uint32_t>(std::countr_one(probe.cycle_faces));
+	return std::pair{*probes.cycling, face};
+}
+
+void add_reflection_probe_passes(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		ReflectionProbes& probes,
+		size_t probe_idx,
+		uint32_t face,
+		GraphRecord draw) {
+	auto& probe = probes.probes.at(probe_idx);
+	// Faces not rendered this frame keep what the last cycle left, where the
+	// prefilter last sampled them.
+	auto capture = import_graph_image(
+			graph,
+			probe.capture.handle,
+			probe.capture_view,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			probe.captured ? g_capture_read : GraphState{},
+			g_capture_read);
+	add_face_pass(
+			graph,
+			profiler,
+			frame_idx,
+			probes,
+			probe,
+			capture,
+			face,
+			std::move(draw));
+	probe.captured = true;
+	probe.cycle_faces |= 1U << face;
+	if (probe.cycle_faces != g_all_faces) {
+		return;
+	}
+	add_mip_passes(graph, profiler, frame_idx, probe, capture);
+	add_prefilter_pass(graph, profiler, frame_idx, probes, probe, capture);
+	probe.ready = true;
+	probes.cycling.reset();
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+#include "environment.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+constexpr auto g_probe_faces = 6U;
+// The capture keeps a full chain down to 1x1, which the prefilter reads
+// the rough lobes from like it does the environment map's.
+constexpr auto g_probe_capture_levels = 8U;
+static_assert(g_environment_face_size >> (g_probe_capture_levels - 1) == 1);
+// Frames a probe that did not change waits before it is refreshed anyway,
+// scaled by how far it is from the view. Nearby probes catch up with what
+// was not invalidated sooner.
+constexpr auto g_probe_refresh_frames = uint64_t{600};
+
+// How the shading passes would sample a probe's specular cube, and where it
+// is between frames.
+constexpr auto g_probe_specular_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+// A cube captured from position, g_environment_face_size texels a side in
+// g_environment_format, and a specular cube prefiltered from it with the
+// layout of Environment::specular. radius is what the probe stands for,
+// changes within it invalidate the probe.
+struct ReflectionProbe {
+	glm::vec3 position{};
+	float radius{};
+	Image capture;
+	// A cube view of every level, sampled by the prefilter.
+	VkImageView capture_view{};
+	// Level 0 of each face, rendered to.
+	std::array<VkImageView, g_probe_faces> face_views{};
+	Image specular;
+	VkImageView specular_view{};
+	// A 2D array view of each level, written by the prefilter.
+	std::array<VkImageView, g_environment_specular_levels> level_views{};
+	// Sample the capture and write a level, written once at creation.
+	std::array<VkDescriptorSet, g_environment_specular_levels> sets{};
+	// Faces rendered since the cycle started, as bits.
+	uint32_t cycle_faces{};
+	// The frame the last cycle started.
+	uint64_t refreshed{};
+	// Whether something within radius changed since the cycle started.
+	bool changed{true};
+	// Whether the images were written before, their contents and layouts
+	// are undefined until they were.
+	bool captured{};
+	// Whether specular holds a full prefiltered cube, in
+	// g_probe_specular_read.
+	bool ready{};
+};
+
+// Cube map reflection probes for scenes too dynamic to bake. Rendering
+// every probe every frame is out of reach, so one face of one probe is
+// rendered per frame: a probe that starts a cycle renders its six faces on
+// that frame and the five after, then its capture is reduced to a chain and
+// prefiltered into its specular cube through the environment's compute
+// path. The specular cube is only written then, so it stays whole while the
+// next capture is under way. Between cycles
+// the probe to refresh is picked by how long ago and how near to the view
+// it was last rendered, and whether it was invalidated since.
+//
+// Faces are drawn by the caller into level 0 of the capture, with the
+// transform probe_face_transform gives, under dynamic rendering and with
+// reversed depth. The cube's faces mirror the main view, so front faces are
+// wound the other way round from its.
+struct ReflectionProbes {
+	// Of the prefilter, whose set layout and pipeline layout the sets and the
+	// dispatches use.
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	VkDescriptorPool descriptor_pool{};
+	VkFormat depth_format{};
+	std::vector<ReflectionProbe> probes;
+	// The probe whose cycle is running, if any.
+	std::optional<size_t> cycling;
+	uint64_t frame{};
+	bool placed{};
+};
+
+// prefilter must have its cube_specular pipeline. depth_format is what faces
+// are drawn with.
+auto create_reflection_probes(
+		VkDevice& device,
+		Allocator& allocator,
+		const EnvironmentPrefilter& prefilter,
+		size_t count,
+		VkFormat depth_format) -> ReflectionProbes;
+// The device must be idle.
+void destroy_reflection_probes(
+		VkDevice& device,
+		Allocator& allocator,
+		ReflectionProbes& probes);
+
+// Places the probes evenly on a ring around a bounding sphere, level with
+// its centre and a radius out from its surface, each standing for a sphere
+// of that radius, and marks them changed. Probes are only scheduled once
+// placed.
+void place_reflection_probes(
+		ReflectionProbes& probes,
+		glm::vec4 bounding_sphere);
+
+// Marks the probes whose spheres the sphere at center touches as changed,
+// so they are refreshed before the ones that were not.
+void invalidate_reflection_probes(
+		ReflectionProbes& probes,
+		glm::vec3 center,
+		float radius);
+
+// From world space to the clip space of a face, looking out of the probe
+// with a quarter turn field of view, in the order and orientation of Vulkan
+// cube maps.
+auto probe_face_transform(const ReflectionProbe& probe, uint32_t face)
+		-> glm::mat4;
+
+// The probe and face to render this frame, none when nothing is due.
+// Distances are taken from the middle of view_projection's near plane.
+// Starts the next cycle when none is
+// running, once per frame. The face only counts as rendered once its passes
+// were added, so a frame that cannot draw it gets the same face again.
+auto select_probe_face(
+		ReflectionProbes& probes,
+		const glm::mat4& view_projection)
+		-> std::optional<std::pair<size_t, uint32_t>>;
+
+// Adds the pass rendering face of the probe at probe_idx with draw, and at
+// the end of the probe's cycle the passes reducing and prefiltering its
+// capture. draw records inside the face's rendering and sets the viewport
+// and scissor to the g_environment_face_size square itself.
+void add_reflection_probe_passes(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		ReflectionProbes& probes,
+		size_t probe_idx,
+		uint32_t face,
+		GraphRecord draw);
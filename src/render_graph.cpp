@@ -0,0 +1,893 @@
+#include "render_graph.hpp"
+
+#include "compression.hpp"
+#include "debug_labels.hpp"
+#include "host_memory.hpp"
+#include "instrument.hpp"
+#include "log.hpp"
+#include "sync.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace {
+
+// What happened to a resource so far while the graph records.
+struct Tracking {
+	// Stages and access of the last write, or of the initial state.
+	VkPipelineStageFlags2 write_stages{};
+	VkAccessFlags2 write_access{};
+	// Reads since the last write that were made to wait on it.
+	VkPipelineStageFlags2 read_stages{};
+	VkAccessFlags2 read_access{};
+	VkImageLayout layout{};
+};
+
+// Subresources as half open ranges of levels and layers. Ends of
+// VK_REMAINING_MIP_LEVELS and VK_REMAINING_ARRAY_LAYERS run to the last one.
+struct SubresourceBox {
+	uint32_t level_begin{};
+	uint32_t level_end{};
+	uint32_t layer_begin{};
+	uint32_t layer_end{};
+};
+
+constexpr auto g_whole_resource = SubresourceBox{
+		.level_begin = 0,
+		.level_end = VK_REMAINING_MIP_LEVELS,
+		.layer_begin = 0,
+		.layer_end = VK_REMAINING_ARRAY_LAYERS};
+
+// Subresources of a resource that were used alike so far. A resource's
+// regions do not overlap and cover all of it.
+struct TrackedRegion {
+	SubresourceBox box;
+	Tracking tracking;
+};
+
+auto same_tracking(const Tracking& a, const Tracking& b) -> bool {
+	return a.write_stages == b.write_stages && a.write_access == b.write_access &&
+			a.read_stages == b.read_stages && a.read_access == b.read_access &&
+			a.layout == b.layout;
+}
+
+auto subresource_box(const GraphSubresources& subresources) -> SubresourceBox {
+	auto end = [](uint32_t base, uint32_t count, uint32_t remaining) {
+		return count == remaining ? remaining : base + count;
+	};
+	return SubresourceBox{
+			.level_begin = subresources.base_level,
+			.level_end = end(
+					subresources.base_level,
+					subresources.level_count,
+					VK_REMAINING_MIP_LEVELS),
+			.layer_begin = subresources.base_layer,
+			.layer_end = end(
+					subresources.base_layer,
+					subresources.layer_count,
+					VK_REMAINING_ARRAY_LAYERS)};
+}
+
+auto box_empty(const SubresourceBox& box) -> bool {
+	return box.level_begin >= box.level_end || box.layer_begin >= box.layer_end;
+}
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+auto same_transient(const TransientImage& a, const TransientImage& b) -> bool {
+	return a.info.flags == b.info.flags && a.info.format == b.info.format &&
+			a.info.extent.width == b.info.extent.width &&
+			a.info.extent.height == b.info.extent.height &&
+			a.info.arrayLayers == b.info.arrayLayers &&
+			a.info.samples == b.info.samples && a.info.usage == b.info.usage &&
+			a.aspect == b.aspect && a.first_pass == b.first_pass &&
+			a.last_pass == b.last_pass;
+}
+
+auto lifetimes_overlap(const TransientImage& a, const TransientImage& b)
+		-> bool {
+	return a.first_pass <= b.last_pass && b.first_pass <= a.last_pass;
+}
+
+auto memory_overlaps(const TransientImage& a, const TransientImage& b)
+		-> bool {
+	return a.heap == b.heap && a.offset < b.offset + b.size &&
+			b.offset < a.offset + a.size;
+}
+
+// Whether a pass using the resource depends on its previous contents.
+auto reads_contents(const GraphAccess& access) -> bool {
+	constexpr auto writes = VkAccessFlags2{
+			VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+			VK_ACCESS_2_MEMORY_WRITE_BIT};
+	return !access.write || (access.state.access & ~writes) != 0;
+}
+
+void add_access(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphSubresources& subresources,
+		const GraphState& state,
+		bool write) {
+	if (pass + 1 != graph.passes.size()) {
+		fmt::print(
+				stderr,
+				"Render graph access declared after a later pass than {}\n",
+				graph.passes.at(pass).name);
+		std::terminate();
+	}
+	graph.accesses.emplace_back(GraphAccess{
+			.resource = resource,
+			.state = state,
+			.write = write,
+			.subresources = subresources});
+	graph.passes.at(pass).access_count++;
+}
+
+auto pass_accesses(const RenderGraph& graph, const GraphPass& pass)
+		-> std::span<const GraphAccess> {
+	return std::span(graph.accesses)
+			.subspan(pass.first_access, pass.access_count);
+}
+
+// Walks back from the outputs, keeping the passes that write something a kept
+// pass reads.
+void cull_passes(RenderGraph& graph) {
+	auto needed = std::pmr::vector<bool>(graph.resources.size(), graph.arena);
+	for (auto i = size_t{}; i < graph.resources.size(); i++) {
+		needed[i] = graph.resources[i].final.has_value();
+	}
+	for (auto& pass : graph.passes | std::views::reverse) {
+		auto accesses = pass_accesses(graph, pass);
+		pass.culled = !pass.side_effects &&
+				std::none_of(accesses.begin(), accesses.end(), [&](const auto& a) {
+					return a.write && needed[a.resource];
+				});
+		if (pass.culled) {
+			continue;
+		}
+		for (const auto& access : accesses) {
+			if (reads_contents(access)) {
+				needed[access.resource] = true;
+			}
+		}
+	}
+}
+
+void find_lifetimes(RenderGraph& graph) {
+	for (auto& transient : graph.transients) {
+		transient.first_pass = g_graph_unused;
+		transient.last_pass = 0;
+	}
+	for (auto i = uint32_t{}; i < graph.passes.size(); i++) {
+		if (graph.passes[i].culled) {
+			continue;
+		}
+		for (const auto& access : pass_accesses(graph, graph.passes[i])) {
+			auto idx = graph.resources.at(access.resource).transient;
+			if (idx == g_graph_imported) {
+				continue;
+			}
+			auto& transient = graph.transients.at(idx);
+			transient.first_pass = std::min(transient.first_pass, i);
+			transient.last_pass = std::max(transient.last_pass, i);
+		}
+	}
+}
+
+void release_transients(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph) {
+	for (auto& transient : graph.placed) {
+		vkDestroyImageView(device, transient.view, host_callbacks());
+		vkDestroyImage(device, transient.image, host_callbacks());
+	}
+	for (auto& heap : graph.heaps) {
+		free_memory(device, allocator, heap);
+	}
+	graph.placed.clear();
+	graph.heaps.clear();
+}
+
+// How many of the placed transients got each kind of compression.
+void log_transient_compression(VkDevice device, const RenderGraph& graph) {
+	auto counts = std::vector<std::pair<std::string, uint32_t>>{};
+	for (const auto& transient : graph.placed) {
+		if (transient.first_pass == g_graph_unused) {
+			continue;
+		}
+		auto kind = describe_image_compression(
+				query_image_compression(device, transient.image, transient.aspect));
+		auto found = std::find_if(
+				counts.begin(),
+				counts.end(),
+				[&](const auto& count) { return count.first == kind; });
+		if (found == counts.end()) {
+			counts.emplace_back(std::move(kind), 1U);
+		} else {
+			found->second++;
+		}
+	}
+	auto parts = std::vector<std::string>{};
+	for (const auto& [kind, count] : counts) {
+		parts.emplace_back(fmt::format("{} {}", count, kind));
+	}
+	log_message(
+			LogLevel::info,
+			"Render graph image compression: {}",
+			fmt::format("{}", fmt::join(parts, ", ")));
+}
+
+// Creates the transients and packs them first fit, largest first: each image
+// goes to the lowest offset not taken by an image it is alive with.
+void place_transients(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph) {
+	release_transients(device, allocator, graph);
+	graph.placed = graph.transients;
+	auto compression = image_compression_control(
+			graph.compression.value_or(VK_IMAGE_COMPRESSION_DEFAULT_EXT),
+			VK_NULL_HANDLE);
+	auto requirements = std::vector<VkMemoryRequirements>(graph.placed.size());
+	for (auto i = size_t{}; i < graph.placed.size(); i++) {
+		auto& transient = graph.placed[i];
+		if (transient.first_pass == g_graph_unused) {
+			continue;
+		}
+		auto image_info = transient.info;
+		if (graph.compression.has_value()) {
+			image_info.pNext = &compression;
+		}
+		if (vkCreateImage(
+						device,
+						&image_info,
+						host_callbacks(),
+						&transient.image) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create a transient image\n");
+			std::terminate();
+		}
+		vkGetImageMemoryRequirements(device, transient.image, &requirements[i]);
+		transient.size = requirements[i].size;
+	}
+
+	auto order = std::vector<size_t>(graph.placed.size());
+	std::iota(order.begin(), order.end(), size_t{});
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return graph.placed[a].size > graph.placed[b].size;
+	});
+	auto heap_requirements = std::vector<VkMemoryRequirements>{};
+	auto done = std::vector<size_t>{};
+	for (auto i : order) {
+		auto& transient = graph.placed[i];
+		if (transient.first_pass == g_graph_unused) {
+			continue;
+		}
+		const auto& image_requirements = requirements[i];
+		transient.heap = 0;
+		while (transient.heap < heap_requirements.size() &&
+					 (heap_requirements[transient.heap].memoryTypeBits &
+						image_requirements.memoryTypeBits) == 0) {
+			transient.heap++;
+		}
+		if (transient.heap == heap_requirements.size()) {
+			heap_requirements.emplace_back(VkMemoryRequirements{
+					.size = 0,
+					.alignment = 1,
+					.memoryTypeBits = image_requirements.memoryTypeBits});
+		}
+		auto& heap = heap_requirements[transient.heap];
+		transient.offset = 0;
+		for (auto moved = true; moved;) {
+			moved = false;
+			for (auto j : done) {
+				const auto& other = graph.placed[j];
+				if (lifetimes_overlap(transient, other) &&
+						memory_overlaps(transient, other)) {
+					transient.offset = align_up(
+							other.offset + other.size,
+							image_requirements.alignment);
+					moved = true;
+				}
+			}
+		}
+		heap.size = std::max(heap.size, transient.offset + transient.size);
+		heap.alignment = std::max(heap.alignment, image_requirements.alignment);
+		heap.memoryTypeBits &= image_requirements.memoryTypeBits;
+		done.emplace_back(i);
+	}
+
+	for (const auto& heap : heap_requirements) {
+		graph.heaps.emplace_back(allocate_memory(
+				device,
+				allocator,
+				heap,
+				ResourceKind::optimal,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0,
+				MemoryPriority::high));
+	}
+	for (auto& transient : graph.placed) {
+		if (transient.first_pass == g_graph_unused) {
+			continue;
+		}
+		const auto& heap = graph.heaps[transient.heap];
+		vkBindImageMemory(
+				device,
+				transient.image,
+				heap.memory,
+				heap.offset + transient.offset);
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = transient.image,
+				.viewType = transient.info.arrayLayers > 1
+						? VK_IMAGE_VIEW_TYPE_2D_ARRAY
+						: VK_IMAGE_VIEW_TYPE_2D,
+				.format = transient.info.format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = VkImageSubresourceRange{
+						.aspectMask = transient.aspect,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = transient.info.arrayLayers}};
+		if (vkCreateImageView(
+						device,
+						&view_info,
+						host_callbacks(),
+						&transient.view) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create a transient image view\n");
+			std::terminate();
+		}
+	}
+	if (graph.compression.has_value()) {
+		log_transient_compression(device, graph);
+	}
+}
+
+auto transients_changed(const RenderGraph& graph) -> bool {
+	if (graph.transients.size() != graph.placed.size()) {
+		return true;
+	}
+	for (auto i = size_t{}; i < graph.transients.size(); i++) {
+		if (!same_transient(graph.transients[i], graph.placed[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void add_barrier(
+		RenderGraph& graph,
+		const GraphResource& resource,
+		const Tracking& from,
+		const SubresourceBox& box,
+		VkPipelineStageFlags2 src_stages,
+		VkAccessFlags2 src_access,
+		const GraphState& to) {
+	if (resource.buffer != VK_NULL_HANDLE) {
+		graph.buffer_barriers.emplace_back(VkBufferMemoryBarrier2{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+				.pNext = VK_NULL_HANDLE,
+				.srcStageMask = src_stages,
+				.srcAccessMask = src_access,
+				.dstStageMask = to.stages,
+				.dstAccessMask = to.access,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.buffer = resource.buffer,
+				.offset = 0,
+				.size = VK_WHOLE_SIZE});
+		return;
+	}
+	graph.image_barriers.emplace_back(VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stages,
+			.srcAccessMask = src_access,
+			.dstStageMask = to.stages,
+			.dstAccessMask = to.access,
+			.oldLayout = from.layout,
+			.newLayout = to.layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = resource.image,
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = resource.aspect,
+					.baseMipLevel = box.level_begin,
+					.levelCount = box.level_end == VK_REMAINING_MIP_LEVELS
+							? VK_REMAINING_MIP_LEVELS
+							: box.level_end - box.level_begin,
+					.baseArrayLayer = box.layer_begin,
+					.layerCount = box.layer_end == VK_REMAINING_ARRAY_LAYERS
+							? VK_REMAINING_ARRAY_LAYERS
+							: box.layer_end - box.layer_begin}});
+}
+
+// Moves a resource to state, with a barrier when it is needed. Reads after a
+// write wait on the write unless an earlier barrier already covered their
+// stages. Writes and layout transitions wait on everything since the last
+// write, but only the write's memory has to be made available.
+void transition(
+		RenderGraph& graph,
+		const GraphResource& resource,
+		Tracking& tracking,
+		const SubresourceBox& box,
+		const GraphState& state,
+		bool write) {
+	auto is_image = resource.buffer == VK_NULL_HANDLE;
+	auto relayout = is_image && tracking.layout != state.layout;
+	if (!write && !relayout) {
+		auto covered = (state.stages & ~tracking.read_stages) == 0 &&
+				(state.access & ~tracking.read_access) == 0;
+		if (!covered && tracking.write_stages != 0) {
+			add_barrier(
+					graph,
+					resource,
+					tracking,
+					box,
+					tracking.write_stages,
+					tracking.write_access,
+					state);
+		}
+		tracking.read_stages |= state.stages;
+		tracking.read_access |= state.access;
+		return;
+	}
+
+	auto src_stages = tracking.write_stages | tracking.read_stages;
+	if (src_stages != 0 || relayout) {
+		add_barrier(
+				graph,
+				resource,
+				tracking,
+				box,
+				src_stages,
+				tracking.write_access,
+				state);
+	}
+	tracking.layout = state.layout;
+	if (write) {
+		tracking.write_stages = state.stages;
+		tracking.write_access = state.access;
+		tracking.read_stages = 0;
+		tracking.read_access = 0;
+		return;
+	}
+	// The transition is ordered before state's stages, later readers chain
+	// on them.
+	tracking.write_stages = state.stages;
+	tracking.read_stages = state.stages;
+	tracking.read_access = state.access;
+}
+
+// Moves the subresources in box to state. Regions box cuts through are split,
+// the part inside is transitioned and the rest keeps its tracking. Once every
+// region is in the same state again they merge back into one, so images used
+// whole cost no more than before they were split.
+void transition_subresources(
+		RenderGraph& graph,
+		const GraphResource& resource,
+		std::pmr::vector<TrackedRegion>& regions,
+		const SubresourceBox& box,
+		const GraphState& state,
+		bool write) {
+	auto region_count = regions.size();
+	for (auto i = size_t{}; i < region_count; i++) {
+		auto region = regions[i];
+		auto inside = SubresourceBox{
+				.level_begin = std::max(region.box.level_begin, box.level_begin),
+				.level_end = std::min(region.box.level_end, box.level_end),
+				.layer_begin = std::max(region.box.layer_begin, box.layer_begin),
+				.layer_end = std::min(region.box.layer_end, box.layer_end)};
+		if (box_empty(inside)) {
+			continue;
+		}
+		// The levels below and above inside keep all of the region's layers,
+		// the layers beside it only inside's levels.
+		auto keep = [&](const SubresourceBox& part) {
+			if (!box_empty(part)) {
+				regions.emplace_back(
+						TrackedRegion{.box = part, .tracking = region.tracking});
+			}
+		};
+		keep(SubresourceBox{
+				.level_begin = region.box.level_begin,
+				.level_end = inside.level_begin,
+				.layer_begin = region.box.layer_begin,
+				.layer_end = region.box.layer_end});
+		keep(SubresourceBox{
+				.level_begin = inside.level_end,
+				.level_end = region.box.level_end,
+				.layer_begin = region.box.layer_begin,
+				.layer_end = region.box.layer_end});
+		keep(SubresourceBox{
+				.level_begin = inside.level_begin,
+				.level_end = inside.level_end,
+				.layer_begin = region.box.layer_begin,
+				.layer_end = inside.layer_begin});
+		keep(SubresourceBox{
+				.level_begin = inside.level_begin,
+				.level_end = inside.level_end,
+				.layer_begin = inside.layer_end,
+				.layer_end = region.box.layer_end});
+		regions[i].box = inside;
+		transition(graph, resource, regions[i].tracking, inside, state, write);
+	}
+	auto merged = std::all_of(
+			regions.begin(),
+			regions.end(),
+			[&](const TrackedRegion& region) {
+				return same_tracking(region.tracking, regions.front().tracking);
+			});
+	if (regions.size() > 1 && merged) {
+		regions.front().box = g_whole_resource;
+		regions.resize(1);
+	}
+}
+
+void plan_barriers(RenderGraph& graph) {
+	auto tracking = std::pmr::vector<std::pmr::vector<TrackedRegion>>(
+			graph.resources.size(),
+			graph.arena);
+	for (auto i = size_t{}; i < graph.resources.size(); i++) {
+		const auto& initial = graph.resources[i].initial;
+		tracking[i].emplace_back(TrackedRegion{
+				.box = g_whole_resource,
+				.tracking = Tracking{
+						.write_stages = initial.stages,
+						.write_access = initial.access,
+						.read_stages = 0,
+						.read_access = 0,
+						.layout = initial.layout}});
+	}
+	// The resource of each transient, to find the ones it shares memory with.
+	auto transient_resources = std::pmr::vector<uint32_t>(
+			graph.transients.size(),
+			g_graph_imported,
+			graph.arena);
+	for (auto i = uint32_t{}; i < graph.resources.size(); i++) {
+		auto idx = graph.resources[i].transient;
+		if (idx != g_graph_imported) {
+			transient_resources.at(idx) = i;
+		}
+	}
+
+	for (auto i = uint32_t{}; i < graph.passes.size(); i++) {
+		auto& pass = graph.passes[i];
+		pass.first_buffer_barrier =
+				static_cast<uint32_t>(graph.buffer_barriers.size());
+		pass.first_image_barrier =
+				static_cast<uint32_t>(graph.image_barriers.size());
+		if (pass.culled) {
+			continue;
+		}
+		for (const auto& access : pass_accesses(graph, pass)) {
+			const auto& resource = graph.resources.at(access.resource);
+			auto& regions = tracking.at(access.resource);
+			// A transient's first use waits on the earlier images in its
+			// memory.
+			if (resource.transient != g_graph_imported &&
+					graph.placed.at(resource.transient).first_pass == i) {
+				const auto& transient = graph.placed.at(resource.transient);
+				for (auto j = size_t{}; j < graph.placed.size(); j++) {
+					const auto& other = graph.placed[j];
+					if (other.first_pass == g_graph_unused || other.last_pass >= i ||
+							!memory_overlaps(transient, other)) {
+						continue;
+					}
+					for (const auto& other_region : tracking.at(transient_resources[j])) {
+						const auto& other_state = other_region.tracking;
+						for (auto& region : regions) {
+							region.tracking.write_stages |=
+									other_state.write_stages | other_state.read_stages;
+							region.tracking.write_access |= other_state.write_access;
+						}
+					}
+				}
+			}
+			transition_subresources(
+					graph,
+					resource,
+					regions,
+					resource.buffer == VK_NULL_HANDLE
+							? subresource_box(access.subresources)
+							: g_whole_resource,
+					access.state,
+					access.write);
+		}
+		pass.buffer_barrier_count =
+				static_cast<uint32_t>(graph.buffer_barriers.size()) -
+				pass.first_buffer_barrier;
+		pass.image_barrier_count =
+				static_cast<uint32_t>(graph.image_barriers.size()) -
+				pass.first_image_barrier;
+	}
+
+	graph.first_final_buffer_barrier =
+			static_cast<uint32_t>(graph.buffer_barriers.size());
+	graph.first_final_image_barrier =
+			static_cast<uint32_t>(graph.image_barriers.size());
+	for (auto i = size_t{}; i < graph.resources.size(); i++) {
+		const auto& resource = graph.resources[i];
+		if (!resource.final.has_value()) {
+			continue;
+		}
+		// An output that stays where it is and is not accessed after the
+		// graph needs nothing.
+		for (auto& region : tracking[i]) {
+			auto relayout = resource.buffer == VK_NULL_HANDLE &&
+					region.tracking.layout != resource.final->layout;
+			if (relayout || resource.final->access != 0) {
+				transition(
+						graph,
+						resource,
+						region.tracking,
+						region.box,
+						*resource.final,
+						false);
+			}
+		}
+	}
+}
+
+}  // namespace
+
+auto create_render_graph(
+		bool synchronization2,
+		std::optional<VkImageCompressionFlagsEXT> compression) -> RenderGraph {
+	auto graph = RenderGraph{};
+	graph.synchronization2 = synchronization2;
+	graph.compression = compression;
+	return graph;
+}
+
+void destroy_render_graph(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph) {
+	release_transients(device, allocator, graph);
+	graph = RenderGraph{};
+}
+
+void begin_render_graph(RenderGraph& graph, std::pmr::memory_resource& arena) {
+	graph.arena = &arena;
+	graph.resources.clear();
+	graph.passes.clear();
+	graph.accesses.clear();
+	graph.transients.clear();
+	graph.buffer_barriers.clear();
+	graph.image_barriers.clear();
+}
+
+auto import_graph_image(
+		RenderGraph& graph,
+		VkImage image,
+		VkImageView view,
+		VkImageAspectFlags aspect,
+		const GraphState& initial,
+		std::optional<GraphState> final) -> uint32_t {
+	graph.resources.emplace_back(GraphResource{
+			.image = image,
+			.view = view,
+			.aspect = aspect,
+			.buffer = VK_NULL_HANDLE,
+			.transient = g_graph_imported,
+			.initial = initial,
+			.final = final});
+	return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+auto import_graph_buffer(
+		RenderGraph& graph,
+		VkBuffer buffer,
+		const GraphState& initial,
+		std::optional<GraphState> final) -> uint32_t {
+	graph.resources.emplace_back(GraphResource{
+			.image = VK_NULL_HANDLE,
+			.view = VK_NULL_HANDLE,
+			.aspect = 0,
+			.buffer = buffer,
+			.transient = g_graph_imported,
+			.initial = initial,
+			.final = final});
+	return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+auto add_transient_image(
+		RenderGraph& graph,
+		const VkImageCreateInfo& info,
+		VkImageAspectFlags aspect) -> uint32_t {
+	auto& transient = graph.transients.emplace_back();
+	transient.info = info;
+	transient.info.pNext = VK_NULL_HANDLE;
+	transient.info.queueFamilyIndexCount = 0;
+	transient.info.pQueueFamilyIndices = VK_NULL_HANDLE;
+	transient.aspect = aspect;
+	graph.resources.emplace_back(GraphResource{
+			.image = VK_NULL_HANDLE,
+			.view = VK_NULL_HANDLE,
+			.aspect = aspect,
+			.buffer = VK_NULL_HANDLE,
+			.transient = static_cast<uint32_t>(graph.transients.size() - 1),
+			.initial = GraphState{},
+			.final = std::nullopt});
+	return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+auto add_graph_pass(
+		RenderGraph& graph,
+		std::string_view name,
+		GraphRecord record,
+		bool side_effects) -> uint32_t {
+	graph.passes.emplace_back(GraphPass{
+			.name = name,
+			.record = std::move(record),
+			.side_effects = side_effects,
+			.culled = false,
+			.first_access = static_cast<uint32_t>(graph.accesses.size()),
+			.access_count = 0,
+			.first_buffer_barrier = 0,
+			.buffer_barrier_count = 0,
+			.first_image_barrier = 0,
+			.image_barrier_count = 0});
+	return static_cast<uint32_t>(graph.passes.size() - 1);
+}
+
+void graph_read(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphState& state) {
+	add_access(graph, pass, resource, GraphSubresources{}, state, false);
+}
+
+void graph_write(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphState& state) {
+	add_access(graph, pass, resource, GraphSubresources{}, state, true);
+}
+
+void graph_read_subresources(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphSubresources& subresources,
+		const GraphState& state) {
+	add_access(graph, pass, resource, subresources, state, false);
+}
+
+void graph_write_subresources(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphSubresources& subresources,
+		const GraphState& state) {
+	add_access(graph, pass, resource, subresources, state, true);
+}
+
+auto graph_image(const RenderGraph& graph, uint32_t resource) -> VkImage {
+	const auto& entry = graph.resources.at(resource);
+	return entry.transient == g_graph_imported
+			? entry.image
+			: graph.placed.at(entry.transient).image;
+}
+
+auto graph_image_view(const RenderGraph& graph, uint32_t resource)
+		-> VkImageView {
+	const auto& entry = graph.resources.at(resource);
+	return entry.transient == g_graph_imported
+			? entry.view
+			: graph.placed.at(entry.transient).view;
+}
+
+auto graph_contents_used_later(const RenderGraph& graph, uint32_t resource)
+		-> bool {
+	if (graph.resources.at(resource).final.has_value()) {
+		return true;
+	}
+	for (auto i = graph.recording + 1; i < graph.passes.size(); i++) {
+		const auto& pass = graph.passes[i];
+		if (pass.culled) {
+			continue;
+		}
+		for (const auto& access : pass_accesses(graph, pass)) {
+			if (access.resource != resource) {
+				continue;
+			}
+			if (reads_contents(access)) {
+				return true;
+			}
+			// Overwritten whole before anything reads it.
+			const auto& subresources = access.subresources;
+			if (subresources.base_level == 0 &&
+					subresources.level_count == VK_REMAINING_MIP_LEVELS &&
+					subresources.base_layer == 0 &&
+					subresources.layer_count == VK_REMAINING_ARRAY_LAYERS) {
+				return false;
+			}
+		}
+	}
+	return false;
+}
+
+void execute_render_graph(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph,
+		VkCommandBuffer command_buffer) {
+	VKDEMO_ZONE("execute_render_graph");
+	cull_passes(graph);
+	find_lifetimes(graph);
+	if (transients_changed(graph)) {
+		place_transients(device, allocator, graph);
+	}
+	for (auto i = size_t{}; i < graph.resources.size(); i++) {
+		auto& resource = graph.resources[i];
+		if (resource.transient != g_graph_imported) {
+			resource.image = graph.placed.at(resource.transient).image;
+		}
+	}
+	plan_barriers(graph);
+
+	auto buffer_barriers = std::span<const VkBufferMemoryBarrier2>(
+			graph.buffer_barriers);
+	auto image_barriers =
+			std::span<const VkImageMemoryBarrier2>(graph.image_barriers);
+	for (auto i = uint32_t{}; i < graph.passes.size(); i++) {
+		const auto& pass = graph.passes[i];
+		if (pass.culled) {
+			continue;
+		}
+		if (pass.buffer_barrier_count != 0 || pass.image_barrier_count != 0) {
+			pipeline_barrier(
+					graph.synchronization2,
+					command_buffer,
+					buffer_barriers.subspan(
+							pass.first_buffer_barrier,
+							pass.buffer_barrier_count),
+					image_barriers.subspan(
+							pass.first_image_barrier,
+							pass.image_barrier_count));
+		}
+		begin_debug_label(command_buffer, pass.name);
+		graph.recording = i;
+		pass.record(command_buffer);
+		end_debug_label(command_buffer);
+	}
+	auto final_buffer_barriers =
+			buffer_barriers.subspan(graph.first_final_buffer_barrier);
+	auto final_image_barriers =
+			image_barriers.subspan(graph.first_final_image_barrier);
+	if (!final_buffer_barriers.empty() || !final_image_barriers.empty()) {
+		pipeline_barrier(
+				graph.synchronization2,
+				command_buffer,
+				final_buffer_barriers,
+				final_image_barriers);
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+constexpr auto g_graph_imported = UINT32_MAX;
+// first_pass of a transient no pass uses.
+constexpr auto g_graph_unused = UINT32_MAX;
+
+// How a pass uses a resource, or the state a resource is in. layout only
+// applies to images.
+struct GraphState {
+	VkPipelineStageFlags2 stages{};
+	VkAccessFlags2 access{};
+	VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+};
+
+struct GraphResource {
+	VkImage image{};
+	VkImageView view{};
+	VkImageAspectFlags aspect{};
+	VkBuffer buffer{};
+	// Index into RenderGraph::transients, or g_graph_imported.
+	uint32_t transient{g_graph_imported};
+	// Where the resource is when the graph starts.
+	GraphState initial{};
+	// Imported resources with a final state are the graph's outputs: passes
+	// writing them are kept, and they are moved to it after the last pass.
+	std::optional<GraphState> final;
+};
+
+// An image the graph creates and owns. Transients whose lifetimes do not
+// overlap share memory.
+struct TransientImage {
+	VkImageCreateInfo info{};
+	VkImageAspectFlags aspect{};
+	// First and last pass using the image, after culling.
+	uint32_t first_pass{};
+	uint32_t last_pass{};
+	VkImage image{};
+	VkImageView view{};
+	// Images are only placed together when they have a memory type in
+	// common, each heap is one allocation.
+	uint32_t heap{};
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+};
+
+// Mip levels and array layers of an image a pass uses, all of them by
+// default.
+struct GraphSubresources {
+	uint32_t base_level{};
+	uint32_t level_count{VK_REMAINING_MIP_LEVELS};
+	uint32_t base_layer{};
+	uint32_t layer_count{VK_REMAINING_ARRAY_LAYERS};
+};
+
+struct GraphAccess {
+	uint32_t resource{};
+	GraphState state{};
+	bool write{};
+	GraphSubresources subresources{};
+};
+
+using GraphRecord = std::function<void(VkCommandBuffer command_buffer)>;
+
+struct GraphPass {
+	std::string_view name;
+	GraphRecord record;
+	// Kept even when nothing reads what the pass writes.
+	bool side_effects{};
+	bool culled{};
+	uint32_t first_access{};
+	uint32_t access_count{};
+	// Barriers recorded before the pass, as ranges of the graph's barriers.
+	uint32_t first_buffer_barrier{};
+	uint32_t buffer_barrier_count{};
+	uint32_t first_image_barrier{};
+	uint32_t image_barrier_count{};
+};
+
+// Per frame description of the passes and the resources they read and write.
+// Executing it culls the passes that contribute nothing to the outputs, works
+// out the barriers between the remaining ones and lets transient images share
+// memory. One graph is used per frame in flight, so its transients are
+// free once the frame's fence was waited on. The graph is rebuilt every
+// frame, but transients are only recreated when their descriptions or
+// lifetimes change.
+struct RenderGraph {
+	bool synchronization2{};
+	// What transients ask VkImageCompressionControlEXT for, empty without
+	// image compression control. What they got is logged when they are
+	// placed.
+	std::optional<VkImageCompressionFlagsEXT> compression;
+	// Where execution keeps its scratch arrays, given by begin_render_graph.
+	std::pmr::memory_resource* arena{};
+	std::vector<GraphResource> resources;
+	std::vector<GraphPass> passes;
+	std::vector<GraphAccess> accesses;
+	std::vector<TransientImage> transients;
+	// Transients that were created, indexed like transients, and the memory
+	// they share.
+	std::vector<TransientImage> placed;
+	std::vector<Allocation> heaps;
+	std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+	std::vector<VkImageMemoryBarrier2> image_barriers;
+	// The barriers moving the outputs to their final states run from these to
+	// the end, after the last pass.
+	uint32_t first_final_buffer_barrier{};
+	uint32_t first_final_image_barrier{};
+	// The pass recording while the graph executes.
+	uint32_t recording{};
+};
+
+auto create_render_graph(
+		bool synchronization2,
+		std::optional<VkImageCompressionFlagsEXT> compression) -> RenderGraph;
+// The device must be idle.
+void destroy_render_graph(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph);
+
+// Starts describing a new frame. The graph's previous frame must be done.
+// arena must stay valid until the graph was executed.
+void begin_render_graph(RenderGraph& graph, std::pmr::memory_resource& arena);
+
+auto import_graph_image(
+		RenderGraph& graph,
+		VkImage image,
+		VkImageView view,
+		VkImageAspectFlags aspect,
+		const GraphState& initial,
+		std::optional<GraphState> final) -> uint32_t;
+auto import_graph_buffer(
+		RenderGraph& graph,
+		VkBuffer buffer,
+		const GraphState& initial,
+		std::optional<GraphState> final) -> uint32_t;
+// info must describe an optimally tiled 2D image with one mip level. An image
+// of several layers is seen through a 2D array view of all of them. Its
+// contents are undefined at the first pass using it.
+auto add_transient_image(
+		RenderGraph& graph,
+		const VkImageCreateInfo& info,
+		VkImageAspectFlags aspect) -> uint32_t;
+
+// Passes run in the order they are added. Accesses are declared right after
+// their pass, before the next one is added, at most one per resource unless
+// they are for disjoint subresources. A pass that reads and writes a resource
+// declares a write with both access kinds. Barriers are planned per
+// subresource: a resource starts out in one state, and an image splits into
+// ranges of levels and layers where passes use parts of it differently.
+auto add_graph_pass(
+		RenderGraph& graph,
+		std::string_view name,
+		GraphRecord record,
+		bool side_effects) -> uint32_t;
+void graph_read(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphState& state);
+void graph_write(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphState& state);
+// Like graph_read and graph_write, for some mip levels and layers of an image.
+// Only they get barriers, so a pass can read one level while writing the next,
+// and the rest keep their state. A pass may access a resource more than once
+// this way when the subresources do not overlap.
+void graph_read_subresources(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphSubresources& subresources,
+		const GraphState& state);
+void graph_write_subresources(
+		RenderGraph& graph,
+		uint32_t pass,
+		uint32_t resource,
+		const GraphSubresources& subresources,
+		const GraphState& state);
+
+// Only valid while the graph executes, transients are created by then.
+auto graph_image(const RenderGraph& graph, uint32_t resource) -> VkImage;
+auto graph_image_view(const RenderGraph& graph, uint32_t resource)
+		-> VkImageView;
+// Only valid while a pass records: whether a later pass that was kept reads
+// what the recording pass leaves in resource, or the graph outputs it. Passes
+// pick the store ops of their attachments with it, so contents nothing reads
+// are not written back to memory, which costs the most on tiled GPUs.
+auto graph_contents_used_later(const RenderGraph& graph, uint32_t resource)
+		-> bool;
+
+// Records the passes that are not culled into command_buffer, each after the
+// barriers it needs.
+void execute_render_graph(
+		VkDevice& device,
+		Allocator& allocator,
+		RenderGraph& graph,
+		VkCommandBuffer command_buffer);
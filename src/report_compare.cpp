@@ -0,0 +1,273 @@
+#include "report_compare.hpp"
+
+#include "json.hpp"
+#include "mapped_file.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr auto g_regression_alpha = 0.05;
+constexpr auto g_min_change_percent = 1.0;
+// Runs of both builds together up to which every split of them is counted.
+constexpr auto g_max_exact_runs = size_t{20};
+constexpr auto g_gated_metric = std::string_view("frame_time.p99_ms");
+constexpr auto g_summary_statistics = std::array<std::string_view, 3>{
+		"avg_ms",
+		"p50_ms",
+		"p99_ms"};
+
+using RunMetrics = std::vector<std::pair<std::string, double>>;
+
+void add_summary(
+		RunMetrics& metrics,
+		std::string_view prefix,
+		const JsonValue* summary) {
+	if (summary == nullptr) {
+		return;
+	}
+	for (auto statistic : g_summary_statistics) {
+		const auto* value = json_member(*summary, statistic);
+		if (value != nullptr && value->kind == JsonValue::Kind::number) {
+			metrics.emplace_back(
+					fmt::format("{}.{}", prefix, statistic),
+					value->number);
+		}
+	}
+}
+
+auto read_report(const std::filesystem::path& path) -> RunMetrics {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to open {}\n", path.string());
+		std::terminate();
+	}
+	auto report = parse_json(std::string_view(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<const char*>(file->bytes.data()),
+			file->bytes.size()));
+	unmap_file(*file);
+	if (!report.has_value()) {
+		fmt::print(stderr, "Failed to parse {}\n", path.string());
+		std::terminate();
+	}
+	auto metrics = RunMetrics{};
+	add_summary(metrics, "frame_time", json_member(*report, "frame_time"));
+	add_summary(
+			metrics,
+			"cpu_record_time",
+			json_member(*report, "cpu_record_time"));
+	const auto* passes = json_member(*report, "gpu_passes");
+	if (passes != nullptr) {
+		for (const auto& pass : passes->elements) {
+			const auto* name = json_member(pass, "name");
+			if (name != nullptr && name->kind == JsonValue::Kind::string) {
+				add_summary(
+						metrics,
+						fmt::format("gpu.{}", name->string),
+						json_member(pass, "time"));
+			}
+		}
+	}
+	return metrics;
+}
+
+// The values of a metric in every run that has it.
+auto metric_values(std::span<const RunMetrics> runs, std::string_view name)
+		-> std::vector<double> {
+	auto values = std::vector<double>{};
+	for (const auto& run : runs) {
+		for (const auto& [metric, value] : run) {
+			if (metric == name) {
+				values.emplace_back(value);
+				break;
+			}
+		}
+	}
+	return values;
+}
+
+auto median(std::vector<double> values) -> double {
+	std::sort(values.begin(), values.end());
+	auto middle = values.size() / 2;
+	return values.size() % 2 == 1
+			? values.at(middle)
+			: 0.5 * (values.at(middle - 1) + values.at(middle));
+}
+
+// Ranks of the pooled values starting at 1, ties sharing the average of
+// their ranks.
+auto midranks(std::span<const double> values) -> std::vector<double> {
+	auto order = std::vector<size_t>(values.size());
+	std::iota(order.begin(), order.end(), size_t{});
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return values[a] < values[b];
+	});
+	auto ranks = std::vector<double>(values.size());
+	for (auto first = size_t{}; first < order.size();) {
+		auto last = first;
+		while (last + 1 < order.size() &&
+					 values[order.at(last + 1)] == values[order.at(first)]) {
+			last++;
+		}
+		auto rank = 0.5 * static_cast<double>(first + last) + 1.0;
+		for (auto i = first; i <= last; i++) {
+			ranks.at(order.at(i)) = rank;
+		}
+		first = last + 1;
+	}
+	return ranks;
+}
+
+// The chance of the higher sample's rank sum coming out at least as large as
+// observed if both samples came from one distribution. Small values mean
+// higher is larger.
+auto mann_whitney_p(
+		std::span<const double> lower,
+		std::span<const double> higher) -> double {
+	auto pooled = std::vector<double>(lower.begin(), lower.end());
+	pooled.insert(pooled.end(), higher.begin(), higher.end());
+	auto ranks = midranks(pooled);
+	auto n = lower.size();
+	auto m = higher.size();
+	auto observed = std::accumulate(
+			ranks.begin() + static_cast<std::ptrdiff_t>(n),
+			ranks.end(),
+			0.0);
+	// Counts the splits of the pooled runs with a rank sum that large.
+	if (n + m <= g_max_exact_runs) {
+		auto total = size_t{};
+		auto extreme = size_t{};
+		for (auto mask = uint32_t{}; mask < (uint32_t{1} << (n + m)); mask++) {
+			if (static_cast<size_t>(std::popcount(mask)) != m) {
+				continue;
+			}
+			auto rank_sum = 0.0;
+			for (auto i = size_t{}; i < n + m; i++) {
+				if ((mask & (uint32_t{1} << i)) != 0) {
+					rank_sum += ranks.at(i);
+				}
+			}
+			total++;
+			if (rank_sum >= observed - 1e-9) {
+				extreme++;
+			}
+		}
+		return static_cast<double>(extreme) / static_cast<double>(total);
+	}
+	auto count = static_cast<double>(n + m);
+	auto ties = 0.0;
+	auto sorted = pooled;
+	std::sort(sorted.begin(), sorted.end());
+	for (auto first = sorted.begin(); first != sorted.end();) {
+		auto last = std::upper_bound(first, sorted.end(), *first);
+		auto tied = static_cast<double>(last - first);
+		ties += tied * tied * tied - tied;
+		first = last;
+	}
+	auto u = observed - static_cast<double>(m * (m + 1)) / 2.0;
+	auto mean = static_cast<double>(n * m) / 2.0;
+	auto variance = static_cast<double>(n * m) / 12.0 *
+			(count + 1.0 - ties / (count * (count - 1.0)));
+	if (variance <= 0.0) {
+		return 1.0;
+	}
+	auto z = (u - mean - 0.5) / std::sqrt(variance);
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// The smallest p-value any outcome of the runs can reach.
+auto min_p(size_t n, size_t m) -> double {
+	auto splits = 1.0;
+	for (auto i = size_t{1}; i <= m; i++) {
+		splits = splits * static_cast<double>(n + i) / static_cast<double>(i);
+	}
+	return 1.0 / splits;
+}
+
+}  // namespace
+
+auto benchmark_reports_regressed(
+		std::span<const std::filesystem::path> baseline,
+		std::span<const std::filesystem::path> candidate) -> bool {
+	auto baseline_runs = std::vector<RunMetrics>{};
+	for (const auto& path : baseline) {
+		baseline_runs.emplace_back(read_report(path));
+	}
+	auto candidate_runs = std::vector<RunMetrics>{};
+	for (const auto& path : candidate) {
+		candidate_runs.emplace_back(read_report(path));
+	}
+	if (min_p(baseline.size(), candidate.size()) >= g_regression_alpha) {
+		fmt::print(
+				stderr,
+				"{} baseline and {} candidate runs can never differ significantly, "
+				"repeat the benchmark more often\n",
+				baseline.size(),
+				candidate.size());
+	}
+	fmt::print(
+			"{:<40} {:>10} {:>10} {:>8} {:>8}\n",
+			"metric",
+			"baseline",
+			"candidate",
+			"change",
+			"p");
+	auto gated_regression = false;
+	auto regressions = size_t{};
+	auto compared = size_t{};
+	for (const auto& [name, value] : baseline_runs.front()) {
+		auto before = metric_values(baseline_runs, name);
+		auto after = metric_values(candidate_runs, name);
+		if (after.empty()) {
+			continue;
+		}
+		auto before_median = median(before);
+		auto after_median = median(after);
+		auto change = before_median > 0.0
+				? (after_median - before_median) / before_median * 100.0
+				: 0.0;
+		auto slower_p = mann_whitney_p(before, after);
+		auto faster_p = mann_whitney_p(after, before);
+		auto verdict = std::string_view{};
+		auto p = slower_p;
+		if (slower_p < g_regression_alpha && change >= g_min_change_percent) {
+			verdict = "regressed";
+			regressions++;
+			gated_regression = gated_regression || name == g_gated_metric;
+		} else if (
+				faster_p < g_regression_alpha && change <= -g_min_change_percent) {
+			verdict = "improved";
+			p = faster_p;
+		}
+		fmt::print(
+				"{:<40} {:>10.4f} {:>10.4f} {:>+7.2f}% {:>8.4f}",
+				name,
+				before_median,
+				after_median,
+				change,
+				p);
+		fmt::print("{}{}\n", verdict.empty() ? "" : " ", verdict);
+		compared++;
+	}
+	fmt::print(
+			"{} of {} metrics regressed, {} {}\n",
+			regressions,
+			compared,
+			g_gated_metric,
+			gated_regression ? "regressed" : "did not regress");
+	return gated_regression;
+}
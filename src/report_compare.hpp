@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+// Compares the benchmark reports of repeated runs of a baseline and a
+// candidate build metric by metric: the average, median and 99th percentile
+// of the frame time, the CPU recording time and every GPU pass. A metric
+// regressed when the candidate's runs are slower by a one-sided Mann-Whitney
+// U test at the 5% level and its median across runs grew by 1% or more, and
+// improved the other way around. The test is exact for up to 20 runs in all
+// and normally approximated beyond, and needs at least four runs of each
+// build to reach significance.
+//
+// Prints a table of every metric to stdout and returns whether the frame
+// time p99, the metric changes are gated on, regressed.
+auto benchmark_reports_regressed(
+		std::span<const std::filesystem::path> baseline,
+		std::span<const std::filesystem::path> candidate) -> bool;
@@ -0,0 +1,318 @@
+#include "resident_instances.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant block in instance_copy.comp.
+struct InstanceCopyHandles {
+	BindlessHandle source{};
+	BindlessHandle destination{};
+	BindlessHandle indices{};
+	uint32_t first{};
+	uint32_t count{};
+	// Whether the indices pick where instances go rather than where they come
+	// from.
+	VkBool32 scatter{};
+};
+
+// Scatters of earlier frames wrote the resident instances and their gathers
+// read them.
+constexpr auto g_resident_access = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+				VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+constexpr auto g_copy_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+constexpr auto g_copy_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+void check_capacity(size_t count, uint32_t capacity) {
+	if (count > capacity) {
+		fmt::print(
+				stderr,
+				"Resident instance overflow: {} instances, room for {}\n",
+				count,
+				capacity);
+		std::terminate();
+	}
+}
+
+void record_copy(
+		VkCommandBuffer command_buffer,
+		const ResidentInstances& resident,
+		const InstanceCopyHandles& handles) {
+	vkCmdPushConstants(
+			command_buffer,
+			resident.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	vkCmdDispatch(
+			command_buffer,
+			(handles.count + g_instance_copy_group_size - 1) /
+					g_instance_copy_group_size,
+			1,
+			1);
+}
+
+}  // namespace
+
+auto create_resident_instances(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t capacity) -> ResidentInstances {
+	auto resident = ResidentInstances{};
+	resident.capacity = capacity;
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(InstanceCopyHandles)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&resident.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create instance copy pipeline layout\n");
+		std::terminate();
+	}
+	resident.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			resident.pipeline_layout,
+			module,
+			specialization,
+			0);
+
+	auto instances_size = VkDeviceSize{capacity} * sizeof(InstanceTransform);
+	auto indices_size = VkDeviceSize{capacity} * sizeof(uint32_t);
+	resident.instances = create_buffer(
+			device,
+			allocator,
+			instances_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	resident.instances_handle = add_bindless_buffer(
+			device,
+			bindless,
+			resident.instances.handle,
+			0,
+			instances_size);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = resident.frames.emplace_back();
+		frame.updates = create_dynamic_buffer(
+				device,
+				allocator,
+				instances_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.update_indices = create_dynamic_buffer(
+				device,
+				allocator,
+				indices_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.gather_indices = create_dynamic_buffer(
+				device,
+				allocator,
+				indices_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.updates_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.updates.handle,
+				0,
+				instances_size);
+		frame.update_indices_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.update_indices.handle,
+				0,
+				indices_size);
+		frame.gather_indices_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.gather_indices.handle,
+				0,
+				indices_size);
+	}
+	return resident;
+}
+
+void destroy_resident_instances(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ResidentInstances& resident) {
+	for (auto& frame : resident.frames) {
+		remove_bindless_buffer(device, bindless, frame.updates_handle);
+		remove_bindless_buffer(device, bindless, frame.update_indices_handle);
+		remove_bindless_buffer(device, bindless, frame.gather_indices_handle);
+		destroy_buffer(device, allocator, frame.updates);
+		destroy_buffer(device, allocator, frame.update_indices);
+		destroy_buffer(device, allocator, frame.gather_indices);
+	}
+	remove_bindless_buffer(device, bindless, resident.instances_handle);
+	destroy_buffer(device, allocator, resident.instances);
+	vkDestroyPipeline(device, resident.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, resident.pipeline_layout, host_callbacks());
+	resident = ResidentInstances{};
+}
+
+void stage_instance_updates(
+		ResidentInstances& resident,
+		size_t frame_idx,
+		std::span<const InstanceTransform> instances) {
+	check_capacity(instances.size(), resident.capacity);
+	auto& frame = resident.frames.at(frame_idx);
+	frame.update_count = 0;
+	frame.gather_count = 0;
+	frame.gathers.clear();
+	auto* updates = frame.updates.allocation.mapped;
+	auto* indices = frame.update_indices.allocation.mapped;
+	auto everything = resident.shadow.size() != instances.size();
+	resident.shadow.resize(instances.size());
+	for (auto i = size_t{}; i < instances.size(); i++) {
+		auto& held = resident.shadow.at(i);
+		if (!everything &&
+				std::memcmp(&held, &instances[i], sizeof(InstanceTransform)) == 0) {
+			continue;
+		}
+		held = instances[i];
+		auto index = static_cast<uint32_t>(i);
+		std::memcpy(
+				updates + size_t{frame.update_count} * sizeof(held),
+				&held,
+				sizeof(held));
+		std::memcpy(
+				indices + size_t{frame.update_count} * sizeof(index),
+				&index,
+				sizeof(index));
+		frame.update_count++;
+	}
+}
+
+void stage_instance_gather(
+		ResidentInstances& resident,
+		size_t frame_idx,
+		InstanceStream& stream,
+		uint32_t resource,
+		std::span<const uint32_t> indices) {
+	auto& frame = resident.frames.at(frame_idx);
+	check_capacity(frame.gather_count + indices.size(), resident.capacity);
+	check_capacity(indices.size(), stream.capacity);
+	std::memcpy(
+			frame.gather_indices.allocation.mapped +
+					size_t{frame.gather_count} * sizeof(uint32_t),
+			indices.data(),
+			indices.size_bytes());
+	auto count = static_cast<uint32_t>(indices.size());
+	frame.gathers.emplace_back(InstanceGather{
+			.stream = stream.handles.at(frame_idx),
+			.first = frame.gather_count,
+			.count = count,
+			.resource = resource});
+	frame.gather_count += count;
+	stream.counts.at(frame_idx) = count;
+}
+
+void add_resident_instance_passes(
+		RenderGraph& graph,
+		ResidentInstances& resident,
+		const BindlessTable& bindless,
+		size_t frame_idx) {
+	const auto& frame = resident.frames.at(frame_idx);
+	if (frame.update_count == 0 && frame.gather_count == 0) {
+		return;
+	}
+	auto instances = import_graph_buffer(
+			graph,
+			resident.instances.handle,
+			g_resident_access,
+			std::nullopt);
+	auto bind = [&resident, &bindless](VkCommandBuffer command_buffer) {
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				resident.pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				resident.pipeline_layout,
+				bindless);
+	};
+	if (frame.update_count != 0) {
+		auto pass = add_graph_pass(
+				graph,
+				"instance_scatter",
+				[&resident, &frame, bind](VkCommandBuffer command_buffer) {
+					bind(command_buffer);
+					record_copy(
+							command_buffer,
+							resident,
+							InstanceCopyHandles{
+									.source = frame.updates_handle,
+									.destination = resident.instances_handle,
+									.indices = frame.update_indices_handle,
+									.first = 0,
+									.count = frame.update_count,
+									.scatter = VK_TRUE});
+				},
+				false);
+		graph_write(graph, pass, instances, g_copy_write);
+	}
+	if (frame.gather_count == 0) {
+		return;
+	}
+	auto pass = add_graph_pass(
+			graph,
+			"instance_gather",
+			[&resident, &frame, bind](VkCommandBuffer command_buffer) {
+				bind(command_buffer);
+				for (const auto& gather : frame.gathers) {
+					if (gather.count != 0) {
+						record_copy(
+								command_buffer,
+								resident,
+								InstanceCopyHandles{
+										.source = resident.instances_handle,
+										.destination = gather.stream,
+										.indices = frame.gather_indices_handle,
+										.first = gather.first,
+										.count = gather.count,
+										.scatter = VK_FALSE});
+					}
+				}
+			},
+			false);
+	graph_read(graph, pass, instances, g_copy_read);
+	for (const auto& gather : frame.gathers) {
+		graph_write(graph, pass, gather.resource, g_copy_write);
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "instancing.hpp"
+#include "render_graph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Matches local_size_x in instance_copy.comp.
+constexpr auto g_instance_copy_group_size = 64U;
+
+// A stream to fill from the resident instances, the run of the frame's
+// gather indices it takes them from, and its graph buffer.
+struct InstanceGather {
+	BindlessHandle stream{};
+	uint32_t first{};
+	uint32_t count{};
+	uint32_t resource{};
+};
+
+// Host visible, written after the frame's fence was waited on: the changed
+// instances and where they go, and which instances the streams gather.
+struct ResidentInstanceFrame {
+	Buffer updates;
+	Buffer update_indices;
+	Buffer gather_indices;
+	BindlessHandle updates_handle{};
+	BindlessHandle update_indices_handle{};
+	BindlessHandle gather_indices_handle{};
+	uint32_t update_count{};
+	uint32_t gather_count{};
+	std::vector<InstanceGather> gathers;
+};
+
+// Every instance's transform stays in a device local storage buffer, and a
+// frame only uploads the ones that changed since the frame before, as
+// indices and values that a compute pass scatters into it. The streams the
+// draws read are then gathered from it by index on the GPU, so a static
+// scene costs the bus four bytes per visible instance rather than a
+// transform, and nothing at all for the instances themselves.
+struct ResidentInstances {
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	uint32_t capacity{};
+	Buffer instances;
+	BindlessHandle instances_handle{};
+	// What the GPU holds once every staged update ran, updated as they are
+	// staged.
+	std::vector<InstanceTransform> shadow;
+	std::vector<ResidentInstanceFrame> frames;
+};
+
+// module is instance_copy.comp, whose bindless arrays are sized by
+// specialization. capacity is the most instances there ever are.
+auto create_resident_instances(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t capacity) -> ResidentInstances;
+// The device must be idle.
+void destroy_resident_instances(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ResidentInstances& resident);
+
+// Starts the frame's staging with the instances that differ from what the
+// GPU holds, after the frame fence was waited on. An instance count that
+// changed uploads every instance.
+void stage_instance_updates(
+		ResidentInstances& resident,
+		size_t frame_idx,
+		std::span<const InstanceTransform> instances);
+// Fills the frame's buffer of stream with the resident instances at
+// indices and sets its count. resource is that buffer in graph.
+void stage_instance_gather(
+		ResidentInstances& resident,
+		size_t frame_idx,
+		InstanceStream& stream,
+		uint32_t resource,
+		std::span<const uint32_t> indices);
+
+// Adds the pass scattering the frame's updates into the resident instances
+// and the one gathering the streams from them, nothing for what was not
+// staged. The streams are written by COMPUTE_SHADER, the passes drawing them
+// read their resources as VERTEX_ATTRIBUTE_INPUT.
+void add_resident_instance_passes(
+		RenderGraph& graph,
+		ResidentInstances& resident,
+		const BindlessTable& bindless,
+		size_t frame_idx);
@@ -0,0 +1,242 @@
+#include "scan.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "specialization.hpp"
+#include "subgroups.hpp"
+#include "sync.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// Layout matches the push_constant block in scan.comp.
+struct ScanHandles {
+	BindlessHandle source{};
+	BindlessHandle target{};
+	BindlessHandle states{};
+	BindlessHandle counts{};
+	uint32_t count_slot{};
+	uint32_t result_slot{};
+};
+
+auto tile_count(const PrefixScan& scan) -> uint32_t {
+	auto tile = scan.group_size * g_scan_items;
+	return (scan.capacity + tile - 1) / tile;
+}
+
+auto states_barrier(
+		const PrefixScan& scan,
+		VkPipelineStageFlags2 src_stages,
+		VkAccessFlags2 src_access,
+		VkPipelineStageFlags2 dst_stages,
+		VkAccessFlags2 dst_access) -> VkBufferMemoryBarrier2 {
+	return {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = src_stages,
+			.srcAccessMask = src_access,
+			.dstStageMask = dst_stages,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = scan.states.handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE};
+}
+
+void record_stage(
+		const PrefixScan& scan,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		ScanStage stage,
+		BindlessHandle source,
+		BindlessHandle target,
+		const ScanCounts& counts) {
+	// Every scan starts from unpublished tiles, after the last one is done
+	// with them.
+	auto shader_access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	auto clear_barrier = std::array{states_barrier(
+			scan,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			shader_access,
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT)};
+	pipeline_barrier(scan.synchronization2, command_buffer, clear_barrier, {});
+	vkCmdFillBuffer(command_buffer, scan.states.handle, 0, VK_WHOLE_SIZE, 0);
+	auto scan_barrier = std::array{states_barrier(
+			scan,
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			shader_access)};
+	pipeline_barrier(scan.synchronization2, command_buffer, scan_barrier, {});
+
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			scan.pipeline_layout,
+			bindless);
+	vkCmdBindPipeline(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			scan.pipelines.at(static_cast<size_t>(stage)));
+	auto handles = ScanHandles{
+			.source = source,
+			.target = target,
+			.states = scan.states_handle,
+			.counts = counts.list,
+			.count_slot = counts.count_slot,
+			.result_slot = counts.result_slot};
+	vkCmdPushConstants(
+			command_buffer,
+			scan.pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(handles),
+			&handles);
+	vkCmdDispatch(command_buffer, tile_count(scan), 1, 1);
+}
+
+}  // namespace
+
+auto scan_subgroup_size(VkPhysicalDevice physical_device)
+		-> std::optional<uint32_t> {
+	auto support = query_subgroup_support(physical_device);
+	if (!has_subgroup_operations(
+					support,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					VK_SUBGROUP_FEATURE_BASIC_BIT |
+							VK_SUBGROUP_FEATURE_ARITHMETIC_BIT)) {
+		return std::nullopt;
+	}
+	return support.size;
+}
+
+auto create_prefix_scan(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		uint32_t subgroup_size,
+		uint32_t max_group_size,
+		uint32_t capacity,
+		bool synchronization2) -> PrefixScan {
+	auto scan = PrefixScan{};
+	scan.synchronization2 = synchronization2;
+	scan.capacity = capacity;
+	// As many subgroups as the limit takes, up to g_scan_subgroups.
+	auto subgroups = std::clamp(
+			max_group_size / subgroup_size,
+			1U,
+			g_scan_subgroups);
+	scan.group_size = subgroups * subgroup_size;
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(ScanHandles)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&scan.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create scan pipeline layout\n");
+		std::terminate();
+	}
+	for (auto i = 0U; i < g_scan_stage_count; i++) {
+		auto constants = make_specialization_constants(
+				bindless.images.capacity,
+				bindless.buffers.capacity,
+				bindless.samplers.capacity,
+				i,
+				scan.group_size);
+		auto specialization = specialization_info(constants);
+		scan.pipelines.at(i) = create_compute_pipeline(
+				device,
+				pipeline_cache,
+				scan.pipeline_layout,
+				module,
+				&specialization,
+				0);
+	}
+
+	auto states_size = VkDeviceSize{sizeof(uint32_t)} * (1 + tile_count(scan));
+	scan.states = create_buffer(
+			device,
+			allocator,
+			states_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	scan.states_handle = add_bindless_buffer(
+			device,
+			bindless,
+			scan.states.handle,
+			0,
+			states_size);
+	return scan;
+}
+
+void destroy_prefix_scan(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		PrefixScan& scan) {
+	remove_bindless_buffer(device, bindless, scan.states_handle);
+	destroy_buffer(device, allocator, scan.states);
+	for (auto* pipeline : scan.pipelines) {
+		vkDestroyPipeline(device, pipeline, host_callbacks());
+	}
+	vkDestroyPipelineLayout(device, scan.pipeline_layout, host_callbacks());
+	scan = PrefixScan{};
+}
+
+void record_prefix_scan(
+		const PrefixScan& scan,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		BindlessHandle source,
+		BindlessHandle target,
+		const ScanCounts& counts) {
+	record_stage(
+			scan,
+			bindless,
+			command_buffer,
+			ScanStage::scan,
+			source,
+			target,
+			counts);
+}
+
+void record_compaction(
+		const PrefixScan& scan,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		BindlessHandle source,
+		BindlessHandle target,
+		const ScanCounts& counts) {
+	record_stage(
+			scan,
+			bindless,
+			command_buffer,
+			ScanStage::compact,
+			source,
+			target,
+			counts);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Match scan.comp. Every invocation sums g_scan_items values in a row, so a
+// group takes a tile of that many times its size. Compaction drops the values
+// equal to g_scan_dropped.
+constexpr auto g_scan_items = 4U;
+constexpr auto g_scan_dropped = ~0U;
+// Subgroups in a group, unless the device's limits take fewer.
+constexpr auto g_scan_subgroups = 8U;
+
+// The specialization of scan.comp, one pipeline each.
+enum class ScanStage : uint32_t {
+	scan,
+	compact,
+};
+constexpr auto g_scan_stage_count = 2U;
+
+// Where a scan finds how many values it takes and writes its result, as
+// slots of a bindless list of uint32_t, so neither has to come from the CPU.
+struct ScanCounts {
+	BindlessHandle list{};
+	uint32_t count_slot{};
+	uint32_t result_slot{};
+};
+
+// Prefix sums and stream compaction of uint32_t lists on the GPU, in a single
+// pass. A group sums its tile with subgroup arithmetic and publishes the sum,
+// then finds the sum of the tiles before it by looking back at what their
+// groups published: their own sums, or the sums of everything up to them once
+// they know it, so a group rarely waits on more than its neighbour. Sums must
+// stay below 2^30, the bits a tile state has next to its flag.
+//
+// The tile states are reused by every scan, so all of them must be recorded
+// to one queue, which runs them in order.
+struct PrefixScan {
+	bool synchronization2{};
+	// The most values a scan takes, which every dispatch covers.
+	uint32_t capacity{};
+	// A multiple of the subgroup size.
+	uint32_t group_size{};
+	VkPipelineLayout pipeline_layout{};
+	std::array<VkPipeline, g_scan_stage_count> pipelines{};
+	// The next tile to hand out, then the state of every tile.
+	Buffer states;
+	BindlessHandle states_handle{};
+};
+
+// The subgroup size of compute shaders, if they have the subgroup arithmetic
+// the scan needs. Needs features2.
+auto scan_subgroup_size(VkPhysicalDevice physical_device)
+		-> std::optional<uint32_t>;
+
+// module is scan.comp. max_group_size is the device's limit on the
+// invocations of a group. capacity must be at least one.
+auto create_prefix_scan(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		uint32_t subgroup_size,
+		uint32_t max_group_size,
+		uint32_t capacity,
+		bool synchronization2) -> PrefixScan;
+// The device must be idle.
+void destroy_prefix_scan(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		PrefixScan& scan);
+
+// Both write the values and the result from COMPUTE_SHADER, after the
+// writes of their inputs were made visible to it. The count is at most
+// capacity, and source and target are different lists. They bind the
+// bindless table with the scan's own layout, so compute pipelines recorded
+// after them have to bind it again.
+//
+// Writes the sum of the values before each of source to target, and the sum
+// of all of them to the result.
+void record_prefix_scan(
+		const PrefixScan& scan,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		BindlessHandle source,
+		BindlessHandle target,
+		const ScanCounts& counts);
+// Copies the values of source other than g_scan_dropped to the start of
+// target, in order, and writes how many there were to the result.
+void record_compaction(
+		const PrefixScan& scan,
+		const BindlessTable& bindless,
+		VkCommandBuffer command_buffer,
+		BindlessHandle source,
+		BindlessHandle target,
+		const ScanCounts& counts);
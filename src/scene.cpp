@@ -0,0 +1,156 @@
+#include "scene.hpp"
+
+#include "huge_pages.hpp"
+
+#include <fmt/core.h>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat3x3.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <span>
+
+namespace {
+
+auto local_transform(const Scene& scene, size_t idx) -> InstanceTransform {
+	auto linear = glm::mat3_cast(scene.rotations[idx]);
+	const auto& scale = scene.scales[idx];
+	const auto& position = scene.positions[idx];
+	// The columns of the rotation scaled, with the translation last.
+	return InstanceTransform{
+			.rows = {
+					glm::vec4(
+							linear[0].x * scale.x,
+							linear[1].x * scale.y,
+							linear[2].x * scale.z,
+							position.x),
+					glm::vec4(
+							linear[0].y * scale.x,
+							linear[1].y * scale.y,
+							linear[2].y * scale.z,
+							position.y),
+					glm::vec4(
+							linear[0].z * scale.x,
+							linear[1].z * scale.y,
+							linear[2].z * scale.z,
+							position.z)}};
+}
+
+// parent * local, both affine with an implicit last row of (0, 0, 0, 1).
+auto combine(const InstanceTransform& parent, const InstanceTransform& local)
+		-> InstanceTransform {
+	auto transform = InstanceTransform{};
+	for (auto row = size_t{}; row < 3; row++) {
+		const auto& factors = parent.rows.at(row);
+		transform.rows.at(row) = factors.x * local.rows[0] +
+				factors.y * local.rows[1] + factors.z * local.rows[2] +
+				glm::vec4(0.0F, 0.0F, 0.0F, factors.w);
+	}
+	return transform;
+}
+
+void update_entities(Scene& scene, size_t begin, size_t end) {
+	for (auto i = begin; i < end; i++) {
+		auto local = local_transform(scene, i);
+		auto parent = scene.parents[i];
+		scene.world[i] =
+				parent == g_no_parent ? local : combine(scene.world[parent], local);
+	}
+}
+
+}  // namespace
+
+auto create_scene(std::span<const SceneEntity> entities) -> Scene {
+	auto depths = std::vector<uint32_t>(entities.size());
+	auto level_sizes = std::vector<size_t>{};
+	for (auto i = size_t{}; i < entities.size(); i++) {
+		auto parent = entities[i].parent;
+		if (parent != g_no_parent && parent >= i) {
+			fmt::print(stderr, "Scene entity {} comes before its parent\n", i);
+			std::terminate();
+		}
+		auto depth = parent == g_no_parent ? 0U : depths.at(parent) + 1;
+		depths.at(i) = depth;
+		if (depth == level_sizes.size()) {
+			level_sizes.emplace_back();
+		}
+		level_sizes.at(depth)++;
+	}
+
+	auto scene = Scene{};
+	scene.levels.emplace_back(0);
+	for (auto size : level_sizes) {
+		scene.levels.emplace_back(scene.levels.back() + size);
+	}
+	// Sorted by depth with a counting sort, which keeps the order within a
+	// level.
+	auto next = std::vector<size_t>(scene.levels.begin(), scene.levels.end() - 1);
+	auto sorted = std::vector<uint32_t>(entities.size());
+	for (auto i = size_t{}; i < entities.size(); i++) {
+		sorted.at(i) = static_cast<uint32_t>(next.at(depths.at(i))++);
+	}
+	scene.positions.resize(entities.size());
+	scene.rotations.resize(entities.size());
+	scene.scales.resize(entities.size());
+	scene.parents.resize(entities.size());
+	scene.world.resize(entities.size());
+	advise_huge_pages(std::as_writable_bytes(std::span(scene.positions)));
+	advise_huge_pages(std::as_writable_bytes(std::span(scene.rotations)));
+	advise_huge_pages(std::as_writable_bytes(std::span(scene.scales)));
+	advise_huge_pages(std::as_writable_bytes(std::span(scene.parents)));
+	advise_huge_pages(std::as_writable_bytes(std::span(scene.world)));
+	for (auto i = size_t{}; i < entities.size(); i++) {
+		const auto& entity = entities[i];
+		auto idx = sorted.at(i);
+		scene.positions.at(idx) = entity.position;
+		scene.rotations.at(idx) = entity.rotation;
+		scene.scales.at(idx) = entity.scale;
+		scene.parents.at(idx) =
+				entity.parent == g_no_parent ? g_no_parent : sorted.at(entity.parent);
+	}
+	return scene;
+}
+
+void update_scene_transforms(JobSystem& jobs, Scene& scene) {
+	for (auto level = size_t{}; level + 1 < scene.levels.size(); level++) {
+		auto first = scene.levels.at(level);
+		parallel_for(
+				jobs,
+				scene.levels.at(level + 1) - first,
+				g_scene_update_grain,
+				[&scene, first](size_t begin, size_t end) {
+					update_entities(scene, first + begin, first + end);
+				});
+	}
+}
+
+void update_scene_transforms(Scene& scene) {
+	if (!scene.levels.empty()) {
+		update_entities(scene, 0, scene.levels.back());
+	}
+}
+
+auto grid_entities(uint32_t count, glm::vec4 bounding_sphere)
+		-> std::vector<SceneEntity> {
+	auto side = static_cast<uint32_t>(
+			std::ceil(std::sqrt(static_cast<float>(count))));
+	auto cell = 2.0F / static_cast<float>(side);
+	// Each copy's sphere fits its cell, centered on it.
+	auto scale = bounding_sphere.w > 0.0F ? 0.5F * cell / bounding_sphere.w
+																				: 1.0F;
+	auto entities = std::vector<SceneEntity>{};
+	entities.reserve(count);
+	for (auto i = 0U; i < count; i++) {
+		auto center = glm::vec3(
+				-1.0F + cell * (static_cast<float>(i % side) + 0.5F),
+				-1.0F + cell * (static_cast<float>(i / side) + 0.5F),
+				0.0F);
+		entities.emplace_back(SceneEntity{
+				.position = center - scale * glm::vec3(bounding_sphere),
+				.rotation = glm::quat(1.0F, 0.0F, 0.0F, 0.0F),
+				.scale = glm::vec3(scale),
+				.parent = g_no_parent});
+	}
+	return entities;
+}
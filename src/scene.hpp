@@ -0,0 +1,55 @@
+#pragma once
+
+#include "instancing.hpp"
+#include "jobs.hpp"
+
+#include <glm/ext/quaternion_float.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+constexpr auto g_no_parent = ~uint32_t{};
+// Entities per transform update job.
+constexpr auto g_scene_update_grain = size_t{4096};
+
+struct SceneEntity {
+	glm::vec3 position{};
+	glm::quat rotation{1.0F, 0.0F, 0.0F, 0.0F};
+	glm::vec3 scale{1.0F};
+	uint32_t parent{g_no_parent};
+};
+
+// Entities as separate arrays instead of a graph of nodes, so the transform
+// update streams through each array once. Local transforms are relative to
+// the parent. Entities are sorted by their depth in the hierarchy: every
+// level only depends on the ones before it, so a level is updated in parallel
+// once the previous one is done.
+struct Scene {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	// g_no_parent for roots, otherwise an index into an earlier level.
+	std::vector<uint32_t> parents;
+	// From each entity to world space, written by update_scene_transforms.
+	std::vector<InstanceTransform> world;
+	// First entity of each level, followed by the entity count.
+	std::vector<size_t> levels;
+};
+
+// An entity's parent must come before it. Entities keep their order within
+// a level, so a scene without children keeps the order it was given in.
+auto create_scene(std::span<const SceneEntity> entities) -> Scene;
+// Recomputes every world transform, level by level, spread over the job
+// system.
+void update_scene_transforms(JobSystem& jobs, Scene& scene);
+// The same on the calling thread, for threads outside the job system.
+void update_scene_transforms(Scene& scene);
+
+// Lays count copies of an object with the given bounding sphere out in a
+// square grid over clip space x and y, scaled to fit their cells.
+auto grid_entities(uint32_t count, glm::vec4 bounding_sphere)
+		-> std::vector<SceneEntity>;
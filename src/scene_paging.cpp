@@ -0,0 +1,495 @@
+#include "scene_paging.hpp"
+
+#include "instrument.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+constexpr auto g_paged_scene_magic =
+		std::array<char, 8>{'V', 'K', 'D', 'C', 'E', 'L', 'L', 'S'};
+constexpr auto g_paged_scene_version = 1U;
+
+// The index of a cooked paged scene is this header followed by the instance
+// count of every cell, row by row. Each cell that has instances is a file of
+// them next to it, named by the cell's index. Fields are in host byte order,
+// like cooked meshes.
+struct PagedSceneHeader {
+	std::array<char, 8> magic{};
+	uint32_t version{};
+	uint32_t cells_x{};
+	uint32_t cells_y{};
+	uint32_t cell_capacity{};
+	std::array<float, 2> origin{};
+	float cell_size{};
+	std::array<uint32_t, 3> padding{};
+};
+
+static_assert(sizeof(PagedSceneHeader) == 48);
+
+auto index_path(const std::filesystem::path& directory)
+		-> std::filesystem::path {
+	return directory / "index.bin";
+}
+
+auto cell_path(const std::filesystem::path& directory, uint32_t cell)
+		-> std::filesystem::path {
+	return directory / fmt::format("{}.cell", cell);
+}
+
+// Splits off the next whitespace separated token of line, like the OBJ
+// reader.
+auto next_token(std::string_view& line) -> std::string_view {
+	auto start = line.find_first_not_of(" \t\r,");
+	if (start == std::string_view::npos) {
+		line = {};
+		return {};
+	}
+	line.remove_prefix(start);
+	auto end = std::min(line.find_first_of(" \t\r,"), line.size());
+	auto token = line.substr(0, end);
+	line.remove_prefix(end);
+	return token;
+}
+
+auto parse_float(std::string_view token, float& value) -> bool {
+	auto [end, error] =
+			std::from_chars(token.data(), token.data() + token.size(), value);
+	return error == std::errc{} && end == token.data() + token.size();
+}
+
+auto read_instances(
+		const std::filesystem::path& path,
+		std::vector<InstanceTransform>& instances) -> bool {
+	auto file = std::ifstream(path);
+	if (!file) {
+		fmt::print(stderr, "Failed to open scene {}\n", path.string());
+		return false;
+	}
+	auto text = std::string{};
+	for (auto line_idx = size_t{1}; std::getline(file, text); line_idx++) {
+		auto line = std::string_view(text);
+		auto values = std::array<float, 4>{0.0F, 0.0F, 0.0F, 1.0F};
+		auto count = size_t{};
+		auto valid = true;
+		for (auto token = next_token(line); !token.empty() && valid;
+				 token = next_token(line)) {
+			valid = count < values.size() && parse_float(token, values.at(count));
+			count++;
+		}
+		if (count == 0) {
+			continue;
+		}
+		if (!valid || count < 3) {
+			fmt::print(
+					stderr,
+					"Malformed line {} in scene {}\n",
+					line_idx,
+					path.string());
+			return false;
+		}
+		auto scale = values[3];
+		instances.emplace_back(InstanceTransform{
+				.rows = {
+						glm::vec4(scale, 0.0F, 0.0F, values[0]),
+						glm::vec4(0.0F, scale, 0.0F, values[1]),
+						glm::vec4(0.0F, 0.0F, scale, values[2])}});
+	}
+	if (instances.empty()) {
+		fmt::print(stderr, "Scene {} has no instances\n", path.string());
+		return false;
+	}
+	return true;
+}
+
+auto instance_position(const InstanceTransform& instance) -> glm::vec2 {
+	return {instance.rows[0].w, instance.rows[1].w};
+}
+
+auto write_bytes(
+		const std::filesystem::path& path,
+		std::span<const std::byte> bytes) -> bool {
+	auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+	file.write(
+			reinterpret_cast<const char*>(bytes.data()),
+			static_cast<std::streamsize>(bytes.size()));
+	if (!file) {
+		fmt::print(stderr, "Failed to write {}\n", path.string());
+		return false;
+	}
+	return true;
+}
+
+// The view's center on the scene and how far it reaches from it along x and
+// y: the clip square at the middle of the depth range, taken back through
+// camera.
+struct ViewFootprint {
+	glm::vec2 center{};
+	glm::vec2 reach{};
+};
+
+auto view_footprint(const glm::mat4& camera) -> ViewFootprint {
+	auto inverse = glm::inverse(camera);
+	auto unproject = [&](float x, float y) {
+		auto point = inverse * glm::vec4(x, y, 0.5F, 1.0F);
+		return glm::vec2(point) / point.w;
+	};
+	auto footprint = ViewFootprint{.center = unproject(0.0F, 0.0F)};
+	for (auto corner : std::array{
+					 glm::vec2(-1.0F, -1.0F),
+					 glm::vec2(1.0F, -1.0F),
+					 glm::vec2(-1.0F, 1.0F),
+					 glm::vec2(1.0F, 1.0F)}) {
+		footprint.reach = glm::max(
+				footprint.reach,
+				glm::abs(unproject(corner.x, corner.y) - footprint.center));
+	}
+	return footprint;
+}
+
+auto finite(glm::vec2 value) -> bool {
+	return std::isfinite(value.x) && std::isfinite(value.y);
+}
+
+// Adds the cells overlapping the view placed at center to the wanted cells,
+// the nearest to it first, skipping those wanted already.
+void want_cells(ScenePager& pager, glm::vec2 center, glm::vec2 reach) {
+	auto margin = glm::vec2(pager.settings.margin * pager.cell_size);
+	auto low = glm::floor((center - reach - margin - pager.origin) /
+			pager.cell_size);
+	auto high = glm::floor((center + reach + margin - pager.origin) /
+			pager.cell_size);
+	auto grid = glm::vec2(pager.cells);
+	// A camera seeing the plane edge on puts its corners at infinity.
+	if (!finite(low) || !finite(high) || high.x < 0.0F || high.y < 0.0F ||
+			low.x >= grid.x || low.y >= grid.y) {
+		return;
+	}
+	auto first = glm::uvec2(glm::max(low, 0.0F));
+	auto last = glm::uvec2(glm::min(high, grid - 1.0F));
+	auto begin = pager.wanted.size();
+	for (auto y = first.y; y <= last.y; y++) {
+		for (auto x = first.x; x <= last.x; x++) {
+			auto cell = y * pager.cells.x + x;
+			if (pager.cell_wanted.at(cell) != pager.update) {
+				pager.cell_wanted.at(cell) = pager.update;
+				pager.wanted.emplace_back(cell);
+			}
+		}
+	}
+	auto distance = [&](uint32_t cell) {
+		auto xy = glm::vec2(cell % pager.cells.x, cell / pager.cells.x);
+		auto cell_center = pager.origin + (xy + 0.5F) * pager.cell_size;
+		auto offset = cell_center - center;
+		return glm::dot(offset, offset);
+	};
+	std::sort(
+			pager.wanted.begin() + static_cast<std::ptrdiff_t>(begin),
+			pager.wanted.end(),
+			[&](uint32_t lhs, uint32_t rhs) {
+				return distance(lhs) < distance(rhs);
+			});
+}
+
+void empty_slot(ScenePager& pager, uint32_t slot) {
+	auto cell = pager.slot_cells.at(slot);
+	if (cell != pager.cell_counts.size()) {
+		pager.cell_slots.at(cell) = 0;
+	}
+	pager.slot_cells.at(slot) = static_cast<uint32_t>(pager.cell_counts.size());
+	pager.slot_counts.at(slot) = 0;
+}
+
+// An empty slot, or the one whose cell was needed longest ago and not this
+// update. Loading slots are kept.
+auto pick_slot(ScenePager& pager) -> std::optional<uint32_t> {
+	auto none = static_cast<uint32_t>(pager.cell_counts.size());
+	auto picked = std::optional<uint32_t>{};
+	for (auto slot = 0U; slot < pager.slot_cells.size(); slot++) {
+		if (pager.slot_cells.at(slot) == none) {
+			return slot;
+		}
+		if (!pager.slot_loading.at(slot) &&
+				pager.slot_used.at(slot) != pager.update &&
+				(!picked || pager.slot_used.at(slot) < pager.slot_used.at(*picked))) {
+			picked = slot;
+		}
+	}
+	if (picked) {
+		empty_slot(pager, *picked);
+	}
+	return picked;
+}
+
+// Copies the cell into its slot on a job once it was read. Only the index's
+// fields and the slot's instances are touched, which nothing else does
+// while it loads.
+auto load_cell(
+		AsyncScheduler& scheduler,
+		ScenePager& pager,
+		uint32_t cell,
+		uint32_t slot) -> AsyncTask {
+	// Updates run on the simulation's thread, which may not submit jobs, so
+	// the read starts from the polling thread.
+	co_await resume_on_poll(scheduler);
+	auto file = co_await read_file(scheduler, cell_path(pager.directory, cell));
+	auto load =
+			ScenePageLoad{.cell = cell, .slot = slot, .count = 0, .failed = true};
+	if (file.has_value()) {
+		auto count = pager.cell_counts.at(cell);
+		auto size = size_t{count} * sizeof(InstanceTransform);
+		if (file->bytes.size() == size) {
+			std::memcpy(
+					&pager.instances.at(size_t{slot} * pager.cell_capacity),
+					file->bytes.data(),
+					size);
+			load.count = count;
+			load.failed = false;
+		}
+		unmap_file(*file);
+	}
+	auto lock = std::scoped_lock(pager.mutex);
+	pager.loaded.emplace_back(load);
+}
+
+void take_loads(ScenePager& pager) {
+	auto loaded = std::vector<ScenePageLoad>{};
+	{
+		auto lock = std::scoped_lock(pager.mutex);
+		std::swap(loaded, pager.loaded);
+	}
+	for (const auto& load : loaded) {
+		pager.in_flight--;
+		pager.slot_loading.at(load.slot) = false;
+		if (load.failed) {
+			log_message(
+					LogLevel::warning,
+					"Failed to read scene cell {}",
+					cell_path(pager.directory, load.cell).string());
+			pager.cell_failed.at(load.cell) = true;
+			empty_slot(pager, load.slot);
+		} else {
+			pager.slot_counts.at(load.slot) = load.count;
+		}
+	}
+}
+
+}  // namespace
+
+auto cook_paged_scene(
+		const std::filesystem::path& input,
+		const std::filesystem::path& output) -> bool {
+	auto instances = std::vector<InstanceTransform>{};
+	if (!read_instances(input, instances)) {
+		return false;
+	}
+	auto low = instance_position(instances.front());
+	auto high = low;
+	for (const auto& instance : instances) {
+		low = glm::min(low, instance_position(instance));
+		high = glm::max(high, instance_position(instance));
+	}
+	// Square cells of about g_paged_cell_target instances were they spread
+	// evenly, never empty.
+	auto extent = glm::max(high - low, 1e-6F);
+	auto cell_size = std::sqrt(
+			extent.x * extent.y * static_cast<float>(g_paged_cell_target) /
+			static_cast<float>(instances.size()));
+	auto cells = glm::uvec2(glm::max(glm::ceil(extent / cell_size), 1.0F));
+	auto cell_instances =
+			std::vector<std::vector<InstanceTransform>>(size_t{cells.x} * cells.y);
+	for (const auto& instance : instances) {
+		auto xy = glm::min(
+				glm::uvec2((instance_position(instance) - low) / cell_size),
+				cells - 1U);
+		cell_instances.at(size_t{xy.y} * cells.x + xy.x).emplace_back(instance);
+	}
+
+	auto error = std::error_code{};
+	std::filesystem::create_directories(output, error);
+	if (error) {
+		fmt::print(stderr, "Failed to create {}\n", output.string());
+		return false;
+	}
+	auto counts = std::vector<uint32_t>{};
+	auto header = PagedSceneHeader{
+			.magic = g_paged_scene_magic,
+			.version = g_paged_scene_version,
+			.cells_x = cells.x,
+			.cells_y = cells.y,
+			.cell_capacity = 0,
+			.origin = {low.x, low.y},
+			.cell_size = cell_size,
+			.padding = {}};
+	for (auto cell = size_t{}; cell < cell_instances.size(); cell++) {
+		const auto& cell_contents = cell_instances.at(cell);
+		auto count = static_cast<uint32_t>(cell_contents.size());
+		counts.emplace_back(count);
+		header.cell_capacity = std::max(header.cell_capacity, count);
+		if (count != 0 &&
+				!write_bytes(
+						cell_path(output, static_cast<uint32_t>(cell)),
+						std::as_bytes(std::span(cell_contents)))) {
+			return false;
+		}
+	}
+	auto index = std::vector<std::byte>(sizeof(header));
+	std::memcpy(index.data(), &header, sizeof(header));
+	auto count_bytes = std::as_bytes(std::span(counts));
+	index.insert(index.end(), count_bytes.begin(), count_bytes.end());
+	return write_bytes(index_path(output), index);
+}
+
+auto open_paged_scene(
+		AsyncScheduler& scheduler,
+		const std::filesystem::path& directory,
+		const ScenePagingSettings& settings) -> std::unique_ptr<ScenePager> {
+	auto path = index_path(directory);
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map paged scene {}\n", path.string());
+		std::terminate();
+	}
+	auto header = PagedSceneHeader{};
+	auto size = file->bytes.size();
+	if (size >= sizeof(header)) {
+		std::memcpy(&header, file->bytes.data(), sizeof(header));
+	}
+	auto cell_count = uint64_t{header.cells_x} * header.cells_y;
+	if (header.magic != g_paged_scene_magic ||
+			header.version != g_paged_scene_version || cell_count == 0 ||
+			size != sizeof(header) + cell_count * sizeof(uint32_t) ||
+			header.cell_capacity == 0 || !(header.cell_size > 0.0F) ||
+			settings.cache_cells == 0) {
+		fmt::print(
+				stderr,
+				"{} is not a paged scene of this version\n",
+				path.string());
+		std::terminate();
+	}
+	auto pager = std::make_unique<ScenePager>();
+	pager->settings = settings;
+	pager->scheduler = &scheduler;
+	pager->directory = directory;
+	pager->cells = glm::uvec2(header.cells_x, header.cells_y);
+	pager->origin = glm::vec2(header.origin[0], header.origin[1]);
+	pager->cell_size = header.cell_size;
+	pager->cell_capacity = header.cell_capacity;
+	pager->cell_counts.resize(cell_count);
+	std::memcpy(
+			pager->cell_counts.data(),
+			file->bytes.data() + sizeof(header),
+			cell_count * sizeof(uint32_t));
+	unmap_file(*file);
+	for (auto count : pager->cell_counts) {
+		if (count > pager->cell_capacity) {
+			fmt::print(stderr, "Paged scene {} is corrupt\n", path.string());
+			std::terminate();
+		}
+	}
+	pager->cell_slots.resize(cell_count);
+	pager->cell_failed.resize(cell_count);
+	pager->cell_wanted.resize(cell_count);
+	pager->slot_cells.resize(
+			settings.cache_cells,
+			static_cast<uint32_t>(cell_count));
+	pager->slot_counts.resize(settings.cache_cells);
+	pager->slot_loading.resize(settings.cache_cells);
+	pager->slot_used.resize(settings.cache_cells);
+	pager->instances.resize(paged_instance_count(*pager));
+	return pager;
+}
+
+auto paged_instance_count(const ScenePager& pager) -> size_t {
+	return size_t{pager.settings.cache_cells} * pager.cell_capacity;
+}
+
+void update_scene_pager(ScenePager& pager, const glm::mat4& camera) {
+	VKDEMO_ZONE("update_scene_pager");
+	// Cells are never wanted at update 0, which cell_wanted starts at.
+	pager.update++;
+	take_loads(pager);
+	auto footprint = view_footprint(camera);
+	auto velocity = pager.placed ? footprint.center - pager.previous_center
+															 : glm::vec2(0.0F);
+	pager.previous_center = footprint.center;
+	pager.placed = true;
+
+	pager.wanted.clear();
+	want_cells(pager, footprint.center, footprint.reach);
+	const auto& settings = pager.settings;
+	for (auto i = 1U; i <= settings.lookahead_samples; i++) {
+		auto steps = settings.lookahead_steps * static_cast<float>(i) /
+				static_cast<float>(settings.lookahead_samples);
+		want_cells(pager, footprint.center + velocity * steps, footprint.reach);
+	}
+	// Every wanted cell is marked before any is evicted for a load, so a
+	// prefetch never evicts a cell in view.
+	for (auto cell : pager.wanted) {
+		if (auto slot = pager.cell_slots.at(cell); slot != 0) {
+			pager.slot_used.at(slot - 1) = pager.update;
+		}
+	}
+	for (auto cell : pager.wanted) {
+		if (pager.in_flight >= settings.max_loads) {
+			break;
+		}
+		if (pager.cell_slots.at(cell) != 0 || pager.cell_counts.at(cell) == 0 ||
+				pager.cell_failed.at(cell)) {
+			continue;
+		}
+		auto slot = pick_slot(pager);
+		if (!slot) {
+			break;
+		}
+		pager.slot_cells.at(*slot) = cell;
+		pager.slot_counts.at(*slot) = 0;
+		pager.slot_loading.at(*slot) = true;
+		pager.slot_used.at(*slot) = pager.update;
+		pager.cell_slots.at(cell) = *slot + 1;
+		pager.in_flight++;
+		load_cell(*pager.scheduler, pager, cell, *slot);
+	}
+}
+
+void copy_paged_instances(
+		const ScenePager& pager,
+		std::span<InstanceTransform> world) {
+	auto capacity = size_t{pager.cell_capacity};
+	for (auto slot = size_t{}; slot < pager.slot_cells.size(); slot++) {
+		auto first = slot * capacity;
+		// Empty slots count none, loading ones only once taken.
+		auto count = pager.slot_loading.at(slot)
+				? size_t{}
+				: size_t{pager.slot_counts.at(slot)};
+		std::copy_n(
+				pager.instances.begin() + static_cast<std::ptrdiff_t>(first),
+				count,
+				world.begin() + static_cast<std::ptrdiff_t>(first));
+		std::fill_n(
+				world.begin() + static_cast<std::ptrdiff_t>(first + count),
+				capacity - count,
+				InstanceTransform{});
+	}
+}
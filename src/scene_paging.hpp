@@ -0,0 +1,119 @@
+#pragma once
+
+#include "async.hpp"
+#include "instancing.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// Instances the cook aims to put in a cell, which sizes the cells.
+constexpr auto g_paged_cell_target = 1024U;
+
+struct ScenePagingSettings {
+	// Cells the caches hold at once.
+	uint32_t cache_cells{64};
+	// Steps of the camera's motion ahead that cells are prefetched for, and
+	// the points along that path the view is placed at.
+	float lookahead_steps{30.0F};
+	uint32_t lookahead_samples{4};
+	// Around the view, in cells, needed now rather than prefetched.
+	float margin{0.5F};
+	// Cell reads in flight at most, the nearest cells start first.
+	uint32_t max_loads{8};
+};
+
+// A read that finished, handed from the job that copied it to the next
+// update.
+struct ScenePageLoad {
+	uint32_t cell{};
+	uint32_t slot{};
+	uint32_t count{};
+	bool failed{};
+};
+
+// An out-of-core scene: instances of the mesh binned into a grid of cells
+// over x and y, a file per cell next to an index of the grid, of which only
+// a fixed number is held at once. Every update places the view on the
+// scene, needs the cells under it and prefetches the ones under where the
+// camera's motion takes it next, so cells are read before they come into
+// view instead of popping in late. Reads go through the async scheduler's
+// file reader, the nearest first, and land in slots of the instance array
+// that evict their cells least recently needed first.
+//
+// The slots are both caches: the CPU only holds the cells in them, and the
+// instances drawn are the slots in order, cell_capacity each, so a cell
+// keeps its place in the resident instances while it stays and the GPU only
+// receives the slots that changed. Slots without a cell hold zero
+// transforms, whose bounding spheres have a radius of zero.
+struct ScenePager {
+	ScenePagingSettings settings;
+	AsyncScheduler* scheduler{};
+	std::filesystem::path directory;
+	glm::uvec2 cells{};
+	glm::vec2 origin{};
+	float cell_size{};
+	// Instances in the fullest cell, the size of a slot.
+	uint32_t cell_capacity{};
+	// Instances in each cell, as the index lists them.
+	std::vector<uint32_t> cell_counts;
+	// Slot of each cell plus one, also while it loads, 0 for none.
+	std::vector<uint32_t> cell_slots;
+	// Cells that failed to read, which are not read again.
+	std::vector<bool> cell_failed;
+	// Cell held or loading in each slot, the cell count when it is empty.
+	std::vector<uint32_t> slot_cells;
+	std::vector<uint32_t> slot_counts;
+	std::vector<bool> slot_loading;
+	// Update each slot's cell was last needed at.
+	std::vector<uint64_t> slot_used;
+	// cache_cells slots of cell_capacity. Jobs copy reads into the slots
+	// they reserved, which nothing else touches until the load is taken.
+	std::vector<InstanceTransform> instances;
+	std::mutex mutex;
+	std::vector<ScenePageLoad> loaded;
+	uint32_t in_flight{};
+	uint64_t update{};
+	// The view's center at the last update, for the camera's motion.
+	glm::vec2 previous_center{};
+	bool placed{};
+	// Cells wanted this update, by the update they were last wanted at.
+	std::vector<uint64_t> cell_wanted;
+	std::vector<uint32_t> wanted;
+};
+
+// Reads the "x y z [scale]" lines of a text file, an instance of the mesh at
+// each position, and writes them into output as a cooked paged scene: cells
+// of about g_paged_cell_target instances each and the index of the grid.
+auto cook_paged_scene(
+		const std::filesystem::path& input,
+		const std::filesystem::path& output) -> bool;
+
+// Reads the index of a cooked paged scene after checking it. Cells are read
+// through scheduler, which must outlive every read, so the pager is only
+// destroyed after the scheduler.
+auto open_paged_scene(
+		AsyncScheduler& scheduler,
+		const std::filesystem::path& directory,
+		const ScenePagingSettings& settings) -> std::unique_ptr<ScenePager>;
+
+// Instances the pager draws, its slots' instances together.
+auto paged_instance_count(const ScenePager& pager) -> size_t;
+
+// Takes the reads that finished, then needs the cells under the view camera
+// shows and requests the missing ones along with those ahead of its motion.
+// camera takes the scene to clip space. Called from one thread at a time.
+void update_scene_pager(ScenePager& pager, const glm::mat4& camera);
+
+// Writes the resident cells' instances into world, which holds
+// paged_instance_count, zero for the rest.
+void copy_paged_instances(
+		const ScenePager& pager,
+		std::span<InstanceTransform> world);
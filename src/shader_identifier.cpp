@@ -0,0 +1,136 @@
+#include "shader_identifier.hpp"
+
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+auto to_hex(std::span<const uint8_t> bytes) -> std::string {
+	auto hex = std::string{};
+	for (auto byte : bytes) {
+		hex += fmt::format("{:02x}", byte);
+	}
+	return hex;
+}
+
+auto from_hex(std::string_view hex) -> std::optional<ShaderIdentifier> {
+	if (hex.size() % 2 != 0) {
+		return std::nullopt;
+	}
+	auto bytes = ShaderIdentifier(hex.size() / 2);
+	for (auto i = size_t{}; i < bytes.size(); i++) {
+		const auto* first = hex.data() + (i * 2);
+		auto [last, error] = std::from_chars(first, first + 2, bytes.at(i), 16);
+		if (error != std::errc{} || last != first + 2) {
+			return std::nullopt;
+		}
+	}
+	return bytes;
+}
+
+}  // namespace
+
+auto query_identifier_algorithm(VkPhysicalDevice device)
+		-> IdentifierAlgorithm {
+	auto identifier_properties =
+			VkPhysicalDeviceShaderModuleIdentifierPropertiesEXT{};
+	identifier_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_PROPERTIES_EXT;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &identifier_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(device, &properties);
+	auto algorithm = IdentifierAlgorithm{};
+	std::copy_n(
+			std::begin(identifier_properties.shaderModuleIdentifierAlgorithmUUID),
+			algorithm.size(),
+			algorithm.begin());
+	return algorithm;
+}
+
+auto get_shader_identifier(VkDevice& device, VkShaderModule module)
+		-> ShaderIdentifier {
+	auto identifier = VkShaderModuleIdentifierEXT{};
+	identifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+	vkGetShaderModuleIdentifierEXT(device, module, &identifier);
+	auto bytes = std::span(identifier.identifier)
+			.first(std::min<size_t>(
+					identifier.identifierSize,
+					VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT));
+	return ShaderIdentifier(bytes.begin(), bytes.end());
+}
+
+auto load_shader_identifiers(
+		const std::filesystem::path& path,
+		const IdentifierAlgorithm& algorithm) -> ShaderIdentifiers {
+	auto identifiers =
+			ShaderIdentifiers{.algorithm = algorithm, .identifiers = {}};
+	auto file = std::ifstream(path);
+	auto line = std::string{};
+	if (!std::getline(file, line) || line != to_hex(algorithm)) {
+		return identifiers;
+	}
+	while (std::getline(file, line)) {
+		auto space = line.find(' ');
+		auto identifier = space != std::string::npos
+				? from_hex(std::string_view(line).substr(space + 1))
+				: std::nullopt;
+		if (!identifier.has_value() || identifier->empty() ||
+				identifier->size() > VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT) {
+			log_message(
+					LogLevel::warning,
+					"Ignoring malformed shader identifiers {}",
+					path.string());
+			identifiers.identifiers.clear();
+			return identifiers;
+		}
+		identifiers.identifiers.emplace(
+				line.substr(0, space),
+				std::move(*identifier));
+	}
+	return identifiers;
+}
+
+void save_shader_identifiers(
+		const std::filesystem::path& path,
+		const ShaderIdentifiers& identifiers) {
+	auto error = std::error_code{};
+	std::filesystem::create_directories(path.parent_path(), error);
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::trunc);
+		file << to_hex(identifiers.algorithm) << '\n';
+		for (const auto& [name, identifier] : identifiers.identifiers) {
+			file << name << ' ' << to_hex(identifier) << '\n';
+		}
+		if (!file) {
+			log_message(
+					LogLevel::warning,
+					"Failed to write shader identifiers {}",
+					path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, error);
+	if (error) {
+		log_message(
+				LogLevel::warning,
+				"Failed to write shader identifiers {}",
+				path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// What VK_EXT_shader_module_identifier identifies a module by. A pipeline
+// created from identifiers in place of modules is found in the pipeline
+// cache without the SPIR-V, so a warm start creates no modules for the
+// pipelines it draws with.
+using ShaderIdentifier = std::vector<uint8_t>;
+using IdentifierAlgorithm = std::array<uint8_t, VK_UUID_SIZE>;
+
+// The identifiers of a run's modules by SPIR-V file name, saved next to the
+// pipeline cache. Identifiers only match between drivers with the same
+// algorithm.
+struct ShaderIdentifiers {
+	IdentifierAlgorithm algorithm{};
+	std::map<std::string, ShaderIdentifier, std::less<>> identifiers;
+};
+
+auto query_identifier_algorithm(VkPhysicalDevice device)
+		-> IdentifierAlgorithm;
+auto get_shader_identifier(VkDevice& device, VkShaderModule module)
+		-> ShaderIdentifier;
+
+// One line with the algorithm in hex, then one per module with its name and
+// identifier. Empty when the file is missing, malformed or written with
+// another algorithm.
+auto load_shader_identifiers(
+		const std::filesystem::path& path,
+		const IdentifierAlgorithm& algorithm) -> ShaderIdentifiers;
+// Replaces the file through a temporary one like the pipeline cache.
+void save_shader_identifiers(
+		const std::filesystem::path& path,
+		const ShaderIdentifiers& identifiers);
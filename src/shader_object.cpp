@@ -0,0 +1,229 @@
+#include "shader_object.hpp"
+
+#include "depth.hpp"
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "static_vector.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// The least maxVertexInputBindings and maxVertexInputAttributes of any
+// device.
+constexpr auto g_max_vertex_bindings = size_t{16};
+constexpr auto g_max_vertex_attributes = size_t{16};
+
+// Every graphics stage has to be bound, the ones the demo does not use to
+// null. Task and mesh may be bound to null without the features.
+constexpr auto g_graphics_stages = std::array{
+		VK_SHADER_STAGE_VERTEX_BIT,
+		VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+		VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+		VK_SHADER_STAGE_GEOMETRY_BIT,
+		VK_SHADER_STAGE_TASK_BIT_EXT,
+		VK_SHADER_STAGE_MESH_BIT_EXT,
+		VK_SHADER_STAGE_FRAGMENT_BIT};
+
+auto find_stage(const GraphicsPipelineState& state, VkShaderStageFlagBits stage)
+		-> const PipelineShaderStage* {
+	auto found = std::find_if(
+			state.stages.begin(),
+			state.stages.end(),
+			[&](const PipelineShaderStage& candidate) {
+				return candidate.stage == stage;
+			});
+	return found != state.stages.end() ? &*found : nullptr;
+}
+
+auto specialization_of(const PipelineShaderStage& stage)
+		-> VkSpecializationInfo {
+	const auto& copy = stage.specialization;
+	return VkSpecializationInfo{
+			.mapEntryCount = static_cast<uint32_t>(copy.entries.size()),
+			.pMapEntries = copy.entries.data(),
+			.dataSize = copy.data.size(),
+			.pData = copy.data.data()};
+}
+
+void set_vertex_input(
+		VkCommandBuffer command_buffer,
+		const GraphicsPipelineState& state) {
+	auto bindings = StaticVector<
+			VkVertexInputBindingDescription2EXT,
+			g_max_vertex_bindings>{};
+	for (const auto& binding : state.bindings) {
+		bindings.emplace_back(VkVertexInputBindingDescription2EXT{
+				.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT,
+				.pNext = VK_NULL_HANDLE,
+				.binding = binding.binding,
+				.stride = binding.stride,
+				.inputRate = binding.inputRate,
+				.divisor = 1});
+	}
+	auto attributes = StaticVector<
+			VkVertexInputAttributeDescription2EXT,
+			g_max_vertex_attributes>{};
+	for (const auto& attribute : state.attributes) {
+		attributes.emplace_back(VkVertexInputAttributeDescription2EXT{
+				.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT,
+				.pNext = VK_NULL_HANDLE,
+				.location = attribute.location,
+				.binding = attribute.binding,
+				.format = attribute.format,
+				.offset = attribute.offset});
+	}
+	vkCmdSetVertexInputEXT(
+			command_buffer,
+			static_cast<uint32_t>(bindings.size()),
+			bindings.data(),
+			static_cast<uint32_t>(attributes.size()),
+			attributes.data());
+}
+
+// The blend and write state of the state's color attachments, which a depth
+// only state still has and masks off.
+void set_color_blend(
+		VkCommandBuffer command_buffer,
+		const GraphicsPipelineState& state) {
+	auto count = color_attachment_count(state);
+	auto attachments = color_blend_state(state);
+	auto enables = std::array<VkBool32, 2>{};
+	auto equations = std::array<VkColorBlendEquationEXT, 2>{};
+	auto write_masks = std::array<VkColorComponentFlags, 2>{};
+	for (auto i = size_t{}; i < attachments.size(); i++) {
+		const auto& attachment = attachments.at(i);
+		enables.at(i) = attachment.blendEnable;
+		equations.at(i) = VkColorBlendEquationEXT{
+				.srcColorBlendFactor = attachment.srcColorBlendFactor,
+				.dstColorBlendFactor = attachment.dstColorBlendFactor,
+				.colorBlendOp = attachment.colorBlendOp,
+				.srcAlphaBlendFactor = attachment.srcAlphaBlendFactor,
+				.dstAlphaBlendFactor = attachment.dstAlphaBlendFactor,
+				.alphaBlendOp = attachment.alphaBlendOp};
+		write_masks.at(i) = attachment.colorWriteMask;
+	}
+	vkCmdSetColorBlendEnableEXT(command_buffer, 0, count, enables.data());
+	vkCmdSetColorBlendEquationEXT(command_buffer, 0, count, equations.data());
+	vkCmdSetColorWriteMaskEXT(command_buffer, 0, count, write_masks.data());
+}
+
+}  // namespace
+
+auto create_shader_objects(
+		VkDevice& device,
+		const GraphicsPipelineState& state,
+		std::span<const uint32_t> vertex_code,
+		std::span<const uint32_t> fragment_code,
+		std::span<const VkDescriptorSetLayout> set_layouts,
+		std::span<const VkPushConstantRange> push_constant_ranges)
+		-> ShaderObjects {
+	const auto* vertex = find_stage(state, VK_SHADER_STAGE_VERTEX_BIT);
+	const auto* fragment = find_stage(state, VK_SHADER_STAGE_FRAGMENT_BIT);
+	if (vertex == nullptr || fragment == nullptr) {
+		fmt::print(stderr, "Shader objects need a vertex and fragment stage\n");
+		std::terminate();
+	}
+	auto specializations =
+			std::array{specialization_of(*vertex), specialization_of(*fragment)};
+	auto shader_info = [&](
+			VkShaderStageFlagBits stage,
+			VkShaderStageFlags next_stage,
+			std::span<const uint32_t> code,
+			const VkSpecializationInfo& specialization) {
+		return VkShaderCreateInfoEXT{
+				.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.stage = stage,
+				.nextStage = next_stage,
+				.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT,
+				.codeSize = code.size_bytes(),
+				.pCode = code.data(),
+				.pName = "main",
+				.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+				.pSetLayouts = set_layouts.data(),
+				.pushConstantRangeCount =
+						static_cast<uint32_t>(push_constant_ranges.size()),
+				.pPushConstantRanges = push_constant_ranges.data(),
+				.pSpecializationInfo = specialization.mapEntryCount != 0
+						? &specialization
+						: VK_NULL_HANDLE};
+	};
+	auto shader_infos = std::array{
+			shader_info(
+					VK_SHADER_STAGE_VERTEX_BIT,
+					VK_SHADER_STAGE_FRAGMENT_BIT,
+					vertex_code,
+					specializations.at(0)),
+			shader_info(
+					VK_SHADER_STAGE_FRAGMENT_BIT,
+					0,
+					fragment_code,
+					specializations.at(1))};
+	auto shaders = std::array<VkShaderEXT, 2>{};
+	if (vkCreateShadersEXT(
+					device,
+					static_cast<uint32_t>(shader_infos.size()),
+					shader_infos.data(),
+					host_callbacks(),
+					shaders.data()) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create shader objects\n");
+		std::terminate();
+	}
+	return ShaderObjects{.vertex = shaders.at(0), .fragment = shaders.at(1)};
+}
+
+void destroy_shader_objects(VkDevice& device, ShaderObjects& objects) {
+	vkDestroyShaderEXT(device, objects.vertex, host_callbacks());
+	vkDestroyShaderEXT(device, objects.fragment, host_callbacks());
+	objects = ShaderObjects{};
+}
+
+void bind_shader_objects(
+		VkCommandBuffer command_buffer,
+		const ShaderObjects& objects,
+		const GraphicsPipelineState& state,
+		const VkViewport& viewport,
+		const VkRect2D& scissor) {
+	auto shaders = std::array<VkShaderEXT, g_graphics_stages.size()>{};
+	shaders.front() = objects.vertex;
+	if (find_stage(state, VK_SHADER_STAGE_FRAGMENT_BIT) != nullptr) {
+		shaders.back() = objects.fragment;
+	}
+	vkCmdBindShadersEXT(
+			command_buffer,
+			static_cast<uint32_t>(g_graphics_stages.size()),
+			g_graphics_stages.data(),
+			shaders.data());
+
+	vkCmdSetViewportWithCount(command_buffer, 1, &viewport);
+	vkCmdSetScissorWithCount(command_buffer, 1, &scissor);
+	set_vertex_input(command_buffer, state);
+	vkCmdSetPrimitiveRestartEnable(command_buffer, VK_FALSE);
+	set_raster_state(command_buffer, state.raster, true);
+	vkCmdSetRasterizerDiscardEnable(command_buffer, VK_FALSE);
+	vkCmdSetPolygonModeEXT(command_buffer, VK_POLYGON_MODE_FILL);
+	vkCmdSetDepthBiasEnable(command_buffer, VK_FALSE);
+
+	// Two words cover the 64 samples a mask can have.
+	auto sample_mask = std::array{~VkSampleMask{}, ~VkSampleMask{}};
+	vkCmdSetRasterizationSamplesEXT(command_buffer, state.samples);
+	vkCmdSetSampleMaskEXT(command_buffer, state.samples, sample_mask.data());
+	vkCmdSetAlphaToCoverageEnableEXT(command_buffer, VK_FALSE);
+
+	auto depth_stencil = depth_stencil_state();
+	vkCmdSetDepthTestEnable(command_buffer, depth_stencil.depthTestEnable);
+	vkCmdSetDepthWriteEnable(command_buffer, state.depth_write);
+	vkCmdSetDepthCompareOp(command_buffer, state.depth_compare);
+	vkCmdSetDepthBoundsTestEnable(
+			command_buffer,
+			depth_stencil.depthBoundsTestEnable);
+	vkCmdSetStencilTestEnable(command_buffer, depth_stencil.stencilTestEnable);
+	set_color_blend(command_buffer, state);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "pipeline_state.hpp"
+
+#include <cstdint>
+#include <span>
+
+// A vertex and fragment shader compiled as unlinked shader objects. Drawing
+// with them takes no pipeline: every state a pipeline would bake in is set
+// while recording, so any GraphicsPipelineState that uses the two stages
+// draws with them right away, without a compile.
+struct ShaderObjects {
+	VkShaderEXT vertex{};
+	VkShaderEXT fragment{};
+};
+
+// Creates the objects of state's vertex and fragment stage, specialized the
+// same way, from their SPIR-V. The set layouts and push constant ranges must
+// be the ones of state's pipeline layout.
+auto create_shader_objects(
+		VkDevice& device,
+		const GraphicsPipelineState& state,
+		std::span<const uint32_t> vertex_code,
+		std::span<const uint32_t> fragment_code,
+		std::span<const VkDescriptorSetLayout> set_layouts,
+		std::span<const VkPushConstantRange> push_constant_ranges)
+		-> ShaderObjects;
+void destroy_shader_objects(VkDevice& device, ShaderObjects& objects);
+
+// Binds the objects and sets the state state's pipeline would have. The
+// fragment object is only bound when state has a fragment stage, so a depth
+// only state draws with the vertex object alone. Only draws in dynamic
+// rendering with state's attachments and without a shading rate attachment.
+void bind_shader_objects(
+		VkCommandBuffer command_buffer,
+		const ShaderObjects& objects,
+		const GraphicsPipelineState& state,
+		const VkViewport& viewport,
+		const VkRect2D& scissor);
@@ -0,0 +1,138 @@
+#include "shader_reload.hpp"
+
+#include "instrument.hpp"
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+// Optimized like the build's shaders, apart from the spirv-opt passes.
+#ifdef USE_VALIDATION_LAYERS
+constexpr auto g_glslc_optimization = std::string_view("-g -O0");
+#else
+constexpr auto g_glslc_optimization = std::string_view("-O");
+#endif
+
+void compile_shader(
+		WatchedShader& watched,
+		const std::filesystem::path& output) {
+	VKDEMO_ZONE("compile_shader");
+	auto command = fmt::format(
+			"glslc {} {} \"{}\" -o \"{}\"",
+			g_glslc_optimization,
+			shader_compile_args(watched.shader, watched.variant),
+			watched.source.string(),
+			output.string());
+	// NOLINTNEXTLINE(cert-env33-c) running glslc is the point
+	auto status = std::system(command.c_str());
+	watched.state.store(
+			status == 0 ? ShaderBuildState::succeeded : ShaderBuildState::failed,
+			std::memory_order_release);
+}
+
+}  // namespace
+
+auto create_shader_reloader(
+		const std::filesystem::path& source_dir,
+		const std::filesystem::path& output_dir,
+		std::span<const ShaderVariantName> shaders) -> ShaderReloader {
+	auto reloader = ShaderReloader{};
+	reloader.output_dir = output_dir;
+	reloader.compiling = std::make_unique<JobCounter>();
+	auto error = std::error_code{};
+	std::filesystem::create_directories(output_dir, error);
+	if (error) {
+		fmt::print(
+				stderr,
+				"Failed to create shader output directory {}: {}\n",
+				output_dir.string(),
+				error.message());
+	}
+	for (const auto& name : shaders) {
+		auto& watched =
+				reloader.shaders.emplace_back(std::make_unique<WatchedShader>());
+		watched->shader = name.shader;
+		watched->variant = name.variant;
+		watched->source = source_dir / shader_file_name(name.shader);
+		watched->modified =
+				std::filesystem::last_write_time(watched->source, error);
+		if (error) {
+			fmt::print(
+					stderr,
+					"Watching missing shader source {}\n",
+					watched->source.string());
+		}
+	}
+	reloader.next_poll =
+			std::chrono::steady_clock::now() + g_shader_poll_interval;
+	return reloader;
+}
+
+void destroy_shader_reloader(JobSystem& jobs, ShaderReloader& reloader) {
+	wait_for_counter(jobs, *reloader.compiling);
+	reloader.shaders.clear();
+}
+
+auto poll_shader_reloader(JobSystem& jobs, ShaderReloader& reloader)
+		-> std::vector<ReloadedShader> {
+	auto reloaded = std::vector<ReloadedShader>{};
+	for (auto& watched : reloader.shaders) {
+		auto state = watched->state.load(std::memory_order_acquire);
+		if (state == ShaderBuildState::succeeded) {
+			reloaded.emplace_back(ReloadedShader{
+					.shader = watched->shader,
+					.variant = watched->variant,
+					.blob = load_shader(
+							watched->shader,
+							watched->variant,
+							nullptr,
+							reloader.output_dir)});
+			log_message(LogLevel::info, "Reloaded {}", watched->source.string());
+		} else if (state == ShaderBuildState::failed) {
+			log_message(
+					LogLevel::warning,
+					"Keeping previous {}",
+					watched->source.string());
+		}
+		if (state == ShaderBuildState::succeeded ||
+				state == ShaderBuildState::failed) {
+			watched->state.store(ShaderBuildState::idle);
+		}
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (now < reloader.next_poll) {
+		return reloaded;
+	}
+	reloader.next_poll = now + g_shader_poll_interval;
+	for (auto& watched : reloader.shaders) {
+		if (watched->state.load() != ShaderBuildState::idle) {
+			continue;
+		}
+		// Sources that are missing or being replaced are tried again on the
+		// next poll.
+		auto error = std::error_code{};
+		auto modified = std::filesystem::last_write_time(watched->source, error);
+		if (error || modified == watched->modified) {
+			continue;
+		}
+		watched->modified = modified;
+		watched->state.store(ShaderBuildState::compiling);
+		auto output = reloader.output_dir /
+				shader_binary_name(watched->shader, watched->variant);
+		submit_background_job(
+				jobs,
+				*reloader.compiling,
+				[&watched = *watched, output = std::move(output)] {
+					compile_shader(watched, output);
+				});
+	}
+	return reloaded;
+}
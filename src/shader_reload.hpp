@@ -0,0 +1,71 @@
+#pragma once
+
+#include "jobs.hpp"
+#include "shaders.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+// How often the sources are checked for changes.
+constexpr auto g_shader_poll_interval = std::chrono::milliseconds(250);
+
+enum class ShaderBuildState {
+	idle,
+	compiling,
+	succeeded,
+	failed,
+};
+
+// A GLSL source and the time it last changed. The compile job publishes the
+// result through state.
+struct WatchedShader {
+	Shader shader{};
+	ShaderVariant variant{};
+	std::filesystem::path source;
+	std::filesystem::file_time_type modified;
+	std::atomic<ShaderBuildState> state{};
+};
+
+// Development mode that rebuilds shaders from their GLSL sources while the
+// demo runs, so shader changes do not need a restart. Sources are polled
+// instead of watched through the OS, which works the same everywhere. A
+// changed source is compiled by spawning glslc in a job, which writes the
+// SPIR-V to output_dir for the render thread to pick up.
+struct ShaderReloader {
+	std::filesystem::path output_dir;
+	// Behind pointers so compile jobs can hold on to them.
+	std::vector<std::unique_ptr<WatchedShader>> shaders;
+	std::chrono::steady_clock::time_point next_poll;
+	std::unique_ptr<JobCounter> compiling;
+};
+
+struct ShaderVariantName {
+	Shader shader{};
+	ShaderVariant variant{};
+};
+
+struct ReloadedShader {
+	Shader shader{};
+	ShaderVariant variant{};
+	ShaderBlob blob;
+};
+
+// Watches <source_dir>/<name> for every shader variant. Sources are
+// considered compiled as they are, only later changes are rebuilt.
+auto create_shader_reloader(
+		const std::filesystem::path& source_dir,
+		const std::filesystem::path& output_dir,
+		std::span<const ShaderVariantName> shaders) -> ShaderReloader;
+// Waits for the compiles in flight.
+void destroy_shader_reloader(JobSystem& jobs, ShaderReloader& reloader);
+
+// Queues a compile of every source that changed since it was last compiled,
+// checking at most once per g_shader_poll_interval. Returns the shaders
+// whose compile finished since the last poll, which the caller releases. A
+// failed compile keeps the previous shader after glslc printed its errors.
+auto poll_shader_reloader(JobSystem& jobs, ShaderReloader& reloader)
+		-> std::vector<ReloadedShader>;
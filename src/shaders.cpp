@@ -0,0 +1,806 @@
+#include "shaders.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+// glslc -mfmt=c emits a braced list of 32-bit words, so the arrays are
+// naturally aligned for vkCreateShaderModule.
+// NOLINTBEGIN(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+constexpr uint32_t g_shader_vert[] =
+#include "shader.vert.spv.inc"
+		;
+constexpr uint32_t g_shader_vert_instanced[] =
+#include "shader.vert.1.spv.inc"
+		;
+constexpr uint32_t g_shader_vert_motion[] =
+#include "shader.vert.2.spv.inc"
+		;
+constexpr uint32_t g_shader_vert_instanced_motion[] =
+#include "shader.vert.3.spv.inc"
+		;
+constexpr uint32_t g_shader_vert_stereo[] =
+#include "shader.vert.4.spv.inc"
+		;
+constexpr uint32_t g_shader_vert_instanced_stereo[] =
+#include "shader.vert.5.spv.inc"
+		;
+constexpr uint32_t g_shader_frag[] =
+#include "shader.frag.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights[] =
+#include "shader.frag.1.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_motion[] =
+#include "shader.frag.2.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion[] =
+#include "shader.frag.3.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_half[] =
+#include "shader.frag.4.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_half[] =
+#include "shader.frag.5.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_motion_half[] =
+#include "shader.frag.6.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_half[] =
+#include "shader.frag.7.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_fog[] =
+#include "shader.frag.9.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_fog[] =
+#include "shader.frag.11.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_half_fog[] =
+#include "shader.frag.13.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_half_fog[] =
+#include "shader.frag.15.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_shadows[] =
+#include "shader.frag.17.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_shadows[] =
+#include "shader.frag.19.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_half_shadows[] =
+#include "shader.frag.21.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_half_shadows[] =
+#include "shader.frag.23.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_fog_shadows[] =
+#include "shader.frag.25.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_fog_shadows[] =
+#include "shader.frag.27.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_half_fog_shadows[] =
+#include "shader.frag.29.spv.inc"
+		;
+constexpr uint32_t g_shader_frag_clustered_lights_motion_half_fog_shadows[] =
+#include "shader.frag.31.spv.inc"
+		;
+constexpr uint32_t g_pulling_vert[] =
+#include "pulling.vert.spv.inc"
+		;
+constexpr uint32_t g_pulling_vert_motion[] =
+#include "pulling.vert.1.spv.inc"
+		;
+constexpr uint32_t g_draw_list_comp[] =
+#include "draw_list.comp.spv.inc"
+		;
+constexpr uint32_t g_meshlet_task[] =
+#include "meshlet.task.spv.inc"
+		;
+constexpr uint32_t g_meshlet_mesh[] =
+#include "meshlet.mesh.spv.inc"
+		;
+constexpr uint32_t g_bloom_downsample_comp[] =
+#include "bloom_downsample.comp.spv.inc"
+		;
+constexpr uint32_t g_bloom_blur_comp[] =
+#include "bloom_blur.comp.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp[] =
+#include "post_composite.comp.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_srgb[] =
+#include "post_composite.comp.1.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_scrgb[] =
+#include "post_composite.comp.2.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_pq[] =
+#include "post_composite.comp.3.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_half[] =
+#include "post_composite.comp.4.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_srgb_half[] =
+#include "post_composite.comp.5.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_scrgb_half[] =
+#include "post_composite.comp.6.spv.inc"
+		;
+constexpr uint32_t g_post_composite_comp_pq_half[] =
+#include "post_composite.comp.7.spv.inc"
+		;
+constexpr uint32_t g_ray_query_frag[] =
+#include "ray_query.frag.spv.inc"
+		;
+constexpr uint32_t g_light_cluster_comp[] =
+#include "light_cluster.comp.spv.inc"
+		;
+constexpr uint32_t g_visibility_frag[] =
+#include "visibility.frag.spv.inc"
+		;
+constexpr uint32_t g_visibility_shade_comp[] =
+#include "visibility_shade.comp.spv.inc"
+		;
+constexpr uint32_t g_visibility_shade_comp_scalarized[] =
+#include "visibility_shade.comp.1.spv.inc"
+		;
+constexpr uint32_t g_shading_rate_comp[] =
+#include "shading_rate.comp.spv.inc"
+		;
+constexpr uint32_t g_shading_rate_comp_content[] =
+#include "shading_rate.comp.1.spv.inc"
+		;
+constexpr uint32_t g_temporal_comp[] =
+#include "temporal.comp.spv.inc"
+		;
+constexpr uint32_t g_particles_comp[] =
+#include "particles.comp.spv.inc"
+		;
+constexpr uint32_t g_radix_sort_comp[] =
+#include "radix_sort.comp.spv.inc"
+		;
+constexpr uint32_t g_scan_comp[] =
+#include "scan.comp.spv.inc"
+		;
+constexpr uint32_t g_particle_vert[] =
+#include "particle.vert.spv.inc"
+		;
+constexpr uint32_t g_particle_frag[] =
+#include "particle.frag.spv.inc"
+		;
+constexpr uint32_t g_particle_frag_weighted_oit[] =
+#include "particle.frag.1.spv.inc"
+		;
+constexpr uint32_t g_oit_composite_comp[] =
+#include "oit_composite.comp.spv.inc"
+		;
+constexpr uint32_t g_decompress_comp[] =
+#include "decompress.comp.spv.inc"
+		;
+constexpr uint32_t g_downsample_comp[] =
+#include "downsample.comp.spv.inc"
+		;
+constexpr uint32_t g_downsample_comp_subgroup_quad[] =
+#include "downsample.comp.1.spv.inc"
+		;
+constexpr uint32_t g_environment_prefilter_comp[] =
+#include "environment_prefilter.comp.spv.inc"
+		;
+constexpr uint32_t g_environment_prefilter_comp_brdf_lut[] =
+#include "environment_prefilter.comp.1.spv.inc"
+		;
+constexpr uint32_t g_environment_prefilter_comp_cube_source[] =
+#include "environment_prefilter.comp.2.spv.inc"
+		;
+constexpr uint32_t g_environment_irradiance_comp[] =
+#include "environment_irradiance.comp.spv.inc"
+		;
+constexpr uint32_t g_point_splat_comp[] =
+#include "point_splat.comp.spv.inc"
+		;
+constexpr uint32_t g_point_splat_comp_resolve[] =
+#include "point_splat.comp.1.spv.inc"
+		;
+constexpr uint32_t g_line_vert[] =
+#include "line.vert.spv.inc"
+		;
+constexpr uint32_t g_line_frag[] =
+#include "line.frag.spv.inc"
+		;
+constexpr uint32_t g_terrain_vert[] =
+#include "terrain.vert.spv.inc"
+		;
+constexpr uint32_t g_terrain_frag[] =
+#include "terrain.frag.spv.inc"
+		;
+constexpr uint32_t g_terrain_frag_virtual_texture[] =
+#include "terrain.frag.1.spv.inc"
+		;
+constexpr uint32_t g_impostor_vert[] =
+#include "impostor.vert.spv.inc"
+		;
+constexpr uint32_t g_impostor_frag[] =
+#include "impostor.frag.spv.inc"
+		;
+constexpr uint32_t g_skinning_comp[] =
+#include "skinning.comp.spv.inc"
+		;
+constexpr uint32_t g_instance_copy_comp[] =
+#include "instance_copy.comp.spv.inc"
+		;
+constexpr uint32_t g_overlay_vert[] =
+#include "overlay.vert.spv.inc"
+		;
+constexpr uint32_t g_overlay_frag[] =
+#include "overlay.frag.spv.inc"
+		;
+constexpr uint32_t g_gbuffer_frag[] =
+#include "gbuffer.frag.spv.inc"
+		;
+constexpr uint32_t g_deferred_lighting_comp[] =
+#include "deferred_lighting.comp.spv.inc"
+		;
+constexpr uint32_t g_deferred_lighting_comp_ambient_occlusion[] =
+#include "deferred_lighting.comp.1.spv.inc"
+		;
+constexpr uint32_t g_fog_scatter_comp[] =
+#include "fog_scatter.comp.spv.inc"
+		;
+constexpr uint32_t g_fog_integrate_comp[] =
+#include "fog_integrate.comp.spv.inc"
+		;
+constexpr uint32_t g_ambient_occlusion_comp[] =
+#include "ambient_occlusion.comp.spv.inc"
+		;
+constexpr uint32_t g_depth_pyramid_comp[] =
+#include "depth_pyramid.comp.spv.inc"
+		;
+// NOLINTEND(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays)
+
+struct EmbeddedShader {
+	Shader shader;
+	ShaderVariant variant;
+	std::string_view name;
+	std::span<const uint32_t> code;
+};
+
+constexpr auto g_embedded_shaders = std::array{
+		EmbeddedShader{Shader::shader_vert, 0, "shader.vert", g_shader_vert},
+		EmbeddedShader{
+				Shader::shader_vert,
+				g_shader_variant_instanced,
+				"shader.vert",
+				g_shader_vert_instanced},
+		EmbeddedShader{
+				Shader::shader_vert,
+				g_shader_variant_motion_vectors,
+				"shader.vert",
+				g_shader_vert_motion},
+		EmbeddedShader{
+				Shader::shader_vert,
+				g_shader_variant_instanced | g_shader_variant_motion_vectors,
+				"shader.vert",
+				g_shader_vert_instanced_motion},
+		EmbeddedShader{
+				Shader::shader_vert,
+				g_shader_variant_stereo,
+				"shader.vert",
+				g_shader_vert_stereo},
+		EmbeddedShader{
+				Shader::shader_vert,
+				g_shader_variant_instanced | g_shader_variant_stereo,
+				"shader.vert",
+				g_shader_vert_instanced_stereo},
+		EmbeddedShader{Shader::shader_frag, 0, "shader.frag", g_shader_frag},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights,
+				"shader.frag",
+				g_shader_frag_clustered_lights},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_motion_vectors,
+				"shader.frag",
+				g_shader_frag_motion},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_half_float,
+				"shader.frag",
+				g_shader_frag_half},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_half_float,
+				"shader.frag",
+				g_shader_frag_clustered_lights_half},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_motion_vectors | g_shader_variant_half_float,
+				"shader.frag",
+				g_shader_frag_motion_half},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_half_float,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_half},
+		// FOG does nothing without CLUSTERED_LIGHTS, so only those variants are
+		// embedded.
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_fog,
+				"shader.frag",
+				g_shader_frag_clustered_lights_fog},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_fog,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_fog},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_half_float |
+						g_shader_variant_fog,
+				"shader.frag",
+				g_shader_frag_clustered_lights_half_fog},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_half_float | g_shader_variant_fog,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_half_fog},
+		// Nor does SHADOWS.
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_half_float |
+						g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_half_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_half_float | g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_half_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_fog |
+						g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_fog_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_fog | g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_fog_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_half_float |
+						g_shader_variant_fog | g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_half_fog_shadows},
+		EmbeddedShader{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights | g_shader_variant_motion_vectors |
+						g_shader_variant_half_float | g_shader_variant_fog |
+						g_shader_variant_shadows,
+				"shader.frag",
+				g_shader_frag_clustered_lights_motion_half_fog_shadows},
+		EmbeddedShader{Shader::pulling_vert, 0, "pulling.vert", g_pulling_vert},
+		EmbeddedShader{
+				Shader::pulling_vert,
+				g_shader_variant_pulled_motion_vectors,
+				"pulling.vert",
+				g_pulling_vert_motion},
+		EmbeddedShader{
+				Shader::draw_list_comp,
+				0,
+				"draw_list.comp",
+				g_draw_list_comp},
+		EmbeddedShader{Shader::meshlet_task, 0, "meshlet.task", g_meshlet_task},
+		EmbeddedShader{Shader::meshlet_mesh, 0, "meshlet.mesh", g_meshlet_mesh},
+		EmbeddedShader{
+				Shader::bloom_downsample_comp,
+				0,
+				"bloom_downsample.comp",
+				g_bloom_downsample_comp},
+		EmbeddedShader{
+				Shader::bloom_blur_comp,
+				0,
+				"bloom_blur.comp",
+				g_bloom_blur_comp},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				0,
+				"post_composite.comp",
+				g_post_composite_comp},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_10bit,
+				"post_composite.comp",
+				g_post_composite_comp_srgb},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_hdr,
+				"post_composite.comp",
+				g_post_composite_comp_scrgb},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_10bit | g_shader_variant_output_hdr,
+				"post_composite.comp",
+				g_post_composite_comp_pq},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_half_float,
+				"post_composite.comp",
+				g_post_composite_comp_half},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_10bit | g_shader_variant_half_float,
+				"post_composite.comp",
+				g_post_composite_comp_srgb_half},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_hdr | g_shader_variant_half_float,
+				"post_composite.comp",
+				g_post_composite_comp_scrgb_half},
+		EmbeddedShader{
+				Shader::post_composite_comp,
+				g_shader_variant_output_10bit | g_shader_variant_output_hdr |
+						g_shader_variant_half_float,
+				"post_composite.comp",
+				g_post_composite_comp_pq_half},
+		EmbeddedShader{
+				Shader::ray_query_frag,
+				0,
+				"ray_query.frag",
+				g_ray_query_frag},
+		EmbeddedShader{
+				Shader::light_cluster_comp,
+				0,
+				"light_cluster.comp",
+				g_light_cluster_comp},
+		EmbeddedShader{
+				Shader::visibility_frag,
+				0,
+				"visibility.frag",
+				g_visibility_frag},
+		EmbeddedShader{
+				Shader::visibility_shade_comp,
+				0,
+				"visibility_shade.comp",
+				g_visibility_shade_comp},
+		EmbeddedShader{
+				Shader::visibility_shade_comp,
+				g_shader_variant_scalarized,
+				"visibility_shade.comp",
+				g_visibility_shade_comp_scalarized},
+		EmbeddedShader{
+				Shader::shading_rate_comp,
+				0,
+				"shading_rate.comp",
+				g_shading_rate_comp},
+		EmbeddedShader{
+				Shader::shading_rate_comp,
+				g_shader_variant_content_rate,
+				"shading_rate.comp",
+				g_shading_rate_comp_content},
+		EmbeddedShader{Shader::temporal_comp, 0, "temporal.comp", g_temporal_comp},
+		EmbeddedShader{
+				Shader::particles_comp,
+				0,
+				"particles.comp",
+				g_particles_comp},
+		EmbeddedShader{
+				Shader::radix_sort_comp,
+				0,
+				"radix_sort.comp",
+				g_radix_sort_comp},
+		EmbeddedShader{Shader::scan_comp, 0, "scan.comp", g_scan_comp},
+		EmbeddedShader{Shader::particle_vert, 0, "particle.vert", g_particle_vert},
+		EmbeddedShader{Shader::particle_frag, 0, "particle.frag", g_particle_frag},
+		EmbeddedShader{
+				Shader::particle_frag,
+				g_shader_variant_weighted_oit,
+				"particle.frag",
+				g_particle_frag_weighted_oit},
+		EmbeddedShader{
+				Shader::oit_composite_comp,
+				0,
+				"oit_composite.comp",
+				g_oit_composite_comp},
+		EmbeddedShader{
+				Shader::decompress_comp,
+				0,
+				"decompress.comp",
+				g_decompress_comp},
+		EmbeddedShader{
+				Shader::downsample_comp,
+				0,
+				"downsample.comp",
+				g_downsample_comp},
+		EmbeddedShader{
+				Shader::downsample_comp,
+				g_shader_variant_subgroup_quad,
+				"downsample.comp",
+				g_downsample_comp_subgroup_quad},
+		EmbeddedShader{
+				Shader::environment_prefilter_comp,
+				0,
+				"environment_prefilter.comp",
+				g_environment_prefilter_comp},
+		EmbeddedShader{
+				Shader::environment_prefilter_comp,
+				g_shader_variant_brdf_lut,
+				"environment_prefilter.comp",
+				g_environment_prefilter_comp_brdf_lut},
+		EmbeddedShader{
+				Shader::environment_prefilter_comp,
+				g_shader_variant_cube_source,
+				"environment_prefilter.comp",
+				g_environment_prefilter_comp_cube_source},
+		EmbeddedShader{
+				Shader::environment_irradiance_comp,
+				0,
+				"environment_irradiance.comp",
+				g_environment_irradiance_comp},
+		EmbeddedShader{
+				Shader::point_splat_comp,
+				0,
+				"point_splat.comp",
+				g_point_splat_comp},
+		EmbeddedShader{
+				Shader::point_splat_comp,
+				g_shader_variant_point_resolve,
+				"point_splat.comp",
+				g_point_splat_comp_resolve},
+		EmbeddedShader{Shader::line_vert, 0, "line.vert", g_line_vert},
+		EmbeddedShader{Shader::line_frag, 0, "line.frag", g_line_frag},
+		EmbeddedShader{Shader::terrain_vert, 0, "terrain.vert", g_terrain_vert},
+		EmbeddedShader{Shader::terrain_frag, 0, "terrain.frag", g_terrain_frag},
+		EmbeddedShader{
+				Shader::terrain_frag,
+				g_shader_variant_virtual_texture,
+				"terrain.frag",
+				g_terrain_frag_virtual_texture},
+		EmbeddedShader{Shader::impostor_vert, 0, "impostor.vert", g_impostor_vert},
+		EmbeddedShader{Shader::impostor_frag, 0, "impostor.frag", g_impostor_frag},
+		EmbeddedShader{Shader::skinning_comp, 0, "skinning.comp", g_skinning_comp},
+		EmbeddedShader{
+				Shader::instance_copy_comp,
+				0,
+				"instance_copy.comp",
+				g_instance_copy_comp},
+		EmbeddedShader{Shader::overlay_vert, 0, "overlay.vert", g_overlay_vert},
+		EmbeddedShader{Shader::overlay_frag, 0, "overlay.frag", g_overlay_frag},
+		EmbeddedShader{Shader::gbuffer_frag, 0, "gbuffer.frag", g_gbuffer_frag},
+		EmbeddedShader{
+				Shader::deferred_lighting_comp,
+				0,
+				"deferred_lighting.comp",
+				g_deferred_lighting_comp},
+		EmbeddedShader{
+				Shader::deferred_lighting_comp,
+				g_shader_variant_ambient_occlusion,
+				"deferred_lighting.comp",
+				g_deferred_lighting_comp_ambient_occlusion},
+		EmbeddedShader{
+				Shader::fog_scatter_comp,
+				0,
+				"fog_scatter.comp",
+				g_fog_scatter_comp},
+		EmbeddedShader{
+				Shader::fog_integrate_comp,
+				0,
+				"fog_integrate.comp",
+				g_fog_integrate_comp},
+		EmbeddedShader{
+				Shader::ambient_occlusion_comp,
+				0,
+				"ambient_occlusion.comp",
+				g_ambient_occlusion_comp},
+		EmbeddedShader{
+				Shader::depth_pyramid_comp,
+				0,
+				"depth_pyramid.comp",
+				g_depth_pyramid_comp},
+};
+
+// Keep in sync with shader_variants in shaders/meson.build.
+struct VariantDefine {
+	Shader shader;
+	ShaderVariant bit;
+	std::string_view define;
+};
+
+constexpr auto g_variant_defines = std::array{
+		VariantDefine{Shader::shader_vert, g_shader_variant_instanced, "INSTANCED"},
+		VariantDefine{
+				Shader::shader_frag,
+				g_shader_variant_clustered_lights,
+				"CLUSTERED_LIGHTS"},
+		VariantDefine{
+				Shader::shader_vert,
+				g_shader_variant_motion_vectors,
+				"MOTION_VECTORS"},
+		VariantDefine{
+				Shader::shader_frag,
+				g_shader_variant_motion_vectors,
+				"MOTION_VECTORS"},
+		VariantDefine{
+				Shader::shader_frag,
+				g_shader_variant_half_float,
+				"HALF_FLOAT"},
+		VariantDefine{Shader::shader_frag, g_shader_variant_fog, "FOG"},
+		VariantDefine{Shader::shader_frag, g_shader_variant_shadows, "SHADOWS"},
+		VariantDefine{Shader::shader_vert, g_shader_variant_stereo, "STEREO"},
+		VariantDefine{
+				Shader::pulling_vert,
+				g_shader_variant_pulled_motion_vectors,
+				"MOTION_VECTORS"},
+		VariantDefine{
+				Shader::post_composite_comp,
+				g_shader_variant_output_10bit,
+				"OUTPUT_10BIT"},
+		VariantDefine{
+				Shader::post_composite_comp,
+				g_shader_variant_output_hdr,
+				"OUTPUT_HDR"},
+		VariantDefine{
+				Shader::post_composite_comp,
+				g_shader_variant_half_float,
+				"HALF_FLOAT"},
+		VariantDefine{
+				Shader::shading_rate_comp,
+				g_shader_variant_content_rate,
+				"CONTENT"},
+		VariantDefine{
+				Shader::particle_frag,
+				g_shader_variant_weighted_oit,
+				"WEIGHTED_OIT"},
+		VariantDefine{
+				Shader::downsample_comp,
+				g_shader_variant_subgroup_quad,
+				"SUBGROUP_QUAD"},
+		VariantDefine{
+				Shader::environment_prefilter_comp,
+				g_shader_variant_brdf_lut,
+				"BRDF_LUT"},
+		VariantDefine{
+				Shader::environment_prefilter_comp,
+				g_shader_variant_cube_source,
+				"CUBE_SOURCE"},
+		VariantDefine{
+				Shader::point_splat_comp,
+				g_shader_variant_point_resolve,
+				"RESOLVE"},
+		VariantDefine{
+				Shader::deferred_lighting_comp,
+				g_shader_variant_ambient_occlusion,
+				"AMBIENT_OCCLUSION"},
+		VariantDefine{
+				Shader::visibility_shade_comp,
+				g_shader_variant_scalarized,
+				"SUBGROUP"},
+		VariantDefine{
+				Shader::terrain_frag,
+				g_shader_variant_virtual_texture,
+				"VIRTUAL_TEXTURE"},
+};
+
+constexpr auto g_spirv_magic = uint32_t{0x07230203};
+
+auto embedded_shader(Shader shader, ShaderVariant variant)
+		-> const EmbeddedShader& {
+	for (const auto& embedded : g_embedded_shaders) {
+		if (embedded.shader == shader && embedded.variant == variant) {
+			return embedded;
+		}
+	}
+	fmt::print(
+			stderr,
+			"Unknown shader {} variant {}\n",
+			static_cast<int>(shader),
+			variant);
+	std::terminate();
+}
+
+}  // namespace
+
+auto shader_file_name(Shader shader) -> std::string_view {
+	return embedded_shader(shader, 0).name;
+}
+
+auto shader_binary_name(Shader shader, ShaderVariant variant) -> std::string {
+	const auto& embedded = embedded_shader(shader, variant);
+	if (variant == 0) {
+		return fmt::format("{}.spv", embedded.name);
+	}
+	return fmt::format("{}.{}.spv", embedded.name, variant);
+}
+
+auto shader_compile_args(Shader shader, ShaderVariant variant) -> std::string {
+	// Keep in sync with shaders/meson.build.
+	auto args = std::string{};
+	switch (shader) {
+		case Shader::pulling_vert:
+		case Shader::meshlet_task:
+		case Shader::meshlet_mesh:
+		case Shader::ray_query_frag:
+		case Shader::visibility_shade_comp:
+		case Shader::skinning_comp:
+			args = "--target-env=vulkan1.2";
+			break;
+		case Shader::scan_comp:
+		case Shader::downsample_comp:
+			args = "--target-env=vulkan1.1";
+			break;
+		default:
+			break;
+	}
+	for (const auto& define : g_variant_defines) {
+		if (define.shader == shader && (variant & define.bit) != 0) {
+			args += fmt::format(" -D{}", define.define);
+		}
+	}
+	return args;
+}
+
+auto load_shader(
+		Shader shader,
+		ShaderVariant variant,
+		const Archive* archive,
+		const std::filesystem::path& override_dir) -> ShaderBlob {
+	const auto& embedded = embedded_shader(shader, variant);
+	if (override_dir.empty()) {
+		return ShaderBlob{.code = embedded.code, .file = std::nullopt};
+	}
+
+	auto path = override_dir / shader_binary_name(shader, variant);
+	auto file = open_asset(archive, path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map shader {}\n", path.string());
+		std::terminate();
+	}
+	if (file->bytes.size() % sizeof(uint32_t) != 0) {
+		fmt::print(stderr, "Truncated SPIR-V module {}\n", path.string());
+		std::terminate();
+	}
+	auto code = std::span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<const uint32_t*>(file->bytes.data()),
+			file->bytes.size() / sizeof(uint32_t));
+	if (code.front() != g_spirv_magic) {
+		fmt::print(stderr, "Not a SPIR-V module {}\n", path.string());
+		std::terminate();
+	}
+	return ShaderBlob{.code = code, .file = file};
+}
+
+void release_shader(ShaderBlob& blob) {
+	if (blob.file.has_value()) {
+		unmap_file(*blob.file);
+	}
+	blob = ShaderBlob{};
+}
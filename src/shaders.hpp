@@ -0,0 +1,140 @@
+#pragma once
+
+#include "archive.hpp"
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+enum class Shader {
+	shader_vert,
+	shader_frag,
+	pulling_vert,
+	draw_list_comp,
+	meshlet_task,
+	meshlet_mesh,
+	bloom_downsample_comp,
+	bloom_blur_comp,
+	post_composite_comp,
+	ray_query_frag,
+	light_cluster_comp,
+	visibility_frag,
+	visibility_shade_comp,
+	shading_rate_comp,
+	temporal_comp,
+	particles_comp,
+	radix_sort_comp,
+	scan_comp,
+	particle_vert,
+	particle_frag,
+	oit_composite_comp,
+	decompress_comp,
+	downsample_comp,
+	environment_prefilter_comp,
+	environment_irradiance_comp,
+	point_splat_comp,
+	line_vert,
+	line_frag,
+	terrain_vert,
+	terrain_frag,
+	impostor_vert,
+	impostor_frag,
+	skinning_comp,
+	instance_copy_comp,
+	overlay_vert,
+	overlay_frag,
+	gbuffer_frag,
+	deferred_lighting_comp,
+	fog_scatter_comp,
+	fog_integrate_comp,
+	ambient_occlusion_comp,
+	depth_pyramid_comp,
+};
+
+// Bits of the defines a shader variant was compiled with, so the choices
+// are made at build time instead of branching per pixel. Every combination
+// of a shader's defines is compiled offline, see shaders/meson.build.
+using ShaderVariant = uint32_t;
+
+// shader.vert: INSTANCED, reads the per-instance stream of
+// src/instancing.hpp.
+constexpr auto g_shader_variant_instanced = ShaderVariant{1};
+// shader.frag: CLUSTERED_LIGHTS, shades with the lights of
+// src/light_clusters.hpp.
+constexpr auto g_shader_variant_clustered_lights = ShaderVariant{1};
+// shader.vert, pulling.vert and shader.frag: MOTION_VECTORS, writes the
+// motion vectors of src/temporal.hpp. The first define of pulling.vert.
+constexpr auto g_shader_variant_motion_vectors = ShaderVariant{2};
+constexpr auto g_shader_variant_pulled_motion_vectors = ShaderVariant{1};
+// shader.vert: STEREO, draws the eyes of src/stereo.hpp as multiview views.
+constexpr auto g_shader_variant_stereo = ShaderVariant{4};
+// post_composite.comp: OUTPUT_10BIT and OUTPUT_HDR, the encodings of
+// OutputTransfer in src/surface_format.hpp.
+constexpr auto g_shader_variant_output_10bit = ShaderVariant{1};
+constexpr auto g_shader_variant_output_hdr = ShaderVariant{2};
+// shader.frag and post_composite.comp: HALF_FLOAT, does the color math
+// that tolerates it with 16-bit floats, for devices with shader_float16.
+constexpr auto g_shader_variant_half_float = ShaderVariant{4};
+// shader.frag: FOG, with CLUSTERED_LIGHTS applies the froxel fog of
+// src/fog.hpp.
+constexpr auto g_shader_variant_fog = ShaderVariant{8};
+// shader.frag: SHADOWS, with CLUSTERED_LIGHTS adds a sun casting the
+// cascaded shadow maps of src/shadow.hpp.
+constexpr auto g_shader_variant_shadows = ShaderVariant{16};
+// shading_rate.comp: CONTENT, rates from the scene's contrast instead of
+// foveation, see src/shading_rate.hpp.
+constexpr auto g_shader_variant_content_rate = ShaderVariant{1};
+// particle.frag: WEIGHTED_OIT, writes the weighted blended transparency of
+// src/transparency.hpp.
+constexpr auto g_shader_variant_weighted_oit = ShaderVariant{1};
+// downsample.comp: SUBGROUP_QUAD, combines the texels of quads with subgroup
+// quad operations instead of through shared memory, see src/downsample.hpp.
+constexpr auto g_shader_variant_subgroup_quad = ShaderVariant{1};
+// environment_prefilter.comp: BRDF_LUT, writes the split sum table of
+// src/environment.hpp instead of a specular level.
+constexpr auto g_shader_variant_brdf_lut = ShaderVariant{1};
+// environment_prefilter.comp: CUBE_SOURCE, prefilters a reflection probe's
+// capture cube of src/reflection_probes.hpp instead of the equirectangular
+// map.
+constexpr auto g_shader_variant_cube_source = ShaderVariant{2};
+// point_splat.comp: RESOLVE, writes the splatted points of
+// src/point_cloud.hpp into the scene instead of splatting them.
+constexpr auto g_shader_variant_point_resolve = ShaderVariant{1};
+// deferred_lighting.comp: AMBIENT_OCCLUSION, dims the ambient light by the
+// occlusion of src/ambient_occlusion.hpp.
+constexpr auto g_shader_variant_ambient_occlusion = ShaderVariant{1};
+// visibility_shade.comp: SUBGROUP, scalarizes the draws' bindless indices
+// with shaders/subgroup.glsl, see src/subgroups.hpp.
+constexpr auto g_shader_variant_scalarized = ShaderVariant{1};
+// terrain.frag: VIRTUAL_TEXTURE, samples the material from a virtual
+// texture, see TerrainMaterial in src/terrain.hpp.
+constexpr auto g_shader_variant_virtual_texture = ShaderVariant{1};
+
+struct ShaderBlob {
+	std::span<const uint32_t> code;
+	std::optional<MappedFile> file;
+};
+
+// The name of the shader's source.
+auto shader_file_name(Shader shader) -> std::string_view;
+// The SPIR-V file name of a variant, <name>.spv for variant 0 and
+// <name>.<variant>.spv for the others.
+auto shader_binary_name(Shader shader, ShaderVariant variant) -> std::string;
+// The extra glslc arguments the build compiles the variant with, including
+// its defines.
+auto shader_compile_args(Shader shader, ShaderVariant variant) -> std::string;
+
+// Uses the SPIR-V embedded at build time unless override_dir is set, in which
+// case <override_dir>/<binary name> is taken from archive, or memory-mapped
+// when archive is null or does not have it. Terminates for variants with bits
+// the shader has no define for.
+auto load_shader(
+		Shader shader,
+		ShaderVariant variant,
+		const Archive* archive,
+		const std::filesystem::path& override_dir) -> ShaderBlob;
+void release_shader(ShaderBlob& blob);
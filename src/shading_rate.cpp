@@ -0,0 +1,394 @@
+#include "shading_rate.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+#include <span>
+
+namespace {
+
+constexpr auto g_shading_rate_scene_binding = 0U;
+constexpr auto g_shading_rate_image_binding = 1U;
+
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_scene_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+// Layout matches the push_constant block in shading_rate.comp.
+struct ShadingRateConstants {
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t texel_width{};
+	uint32_t texel_height{};
+	float scene_texel_x{};
+	float scene_texel_y{};
+	float center_x{};
+	float center_y{};
+	float inner_radius{};
+	float outer_radius{};
+	float flat_contrast{};
+	float smooth_contrast{};
+};
+
+auto texel_count(uint32_t pixels, uint32_t texel) -> uint32_t {
+	return (pixels + texel - 1) / texel;
+}
+
+auto same_extent(VkExtent2D a, VkExtent2D b) -> bool {
+	return a.width == b.width && a.height == b.height;
+}
+
+// Writes the pass's set for this frame's views. Foveated rates sample no
+// scene.
+auto write_shading_rate_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		DescriptorAllocator& descriptors,
+		const ShadingRate& rates,
+		size_t frame_idx,
+		uint32_t rate_image,
+		uint32_t scene) -> FrameSet {
+	auto image_descriptors = std::array{
+			FrameImageDescriptor{
+					.binding = g_shading_rate_image_binding,
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.image = VkDescriptorImageInfo{
+							.sampler = VK_NULL_HANDLE,
+							.imageView = graph_image_view(graph, rate_image),
+							.imageLayout = VK_IMAGE_LAYOUT_GENERAL}},
+			FrameImageDescriptor{
+					.binding = g_shading_rate_scene_binding,
+					.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.image = VkDescriptorImageInfo{
+							.sampler = rates.sampler,
+							.imageView = VK_NULL_HANDLE,
+							.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}},
+	};
+	auto count = size_t{1};
+	if (rates.policy == ShadingRatePolicy::content) {
+		image_descriptors.at(1).image.imageView = graph_image_view(graph, scene);
+		count = 2;
+	}
+	return write_frame_set(
+			device,
+			descriptors,
+			frame_idx,
+			rates.set_layout,
+			std::span(image_descriptors).first(count));
+}
+
+}  // namespace
+
+auto shading_rate_texel_size(VkPhysicalDevice physical_device)
+		-> std::optional<VkExtent2D> {
+	auto format_properties = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(
+			physical_device,
+			g_shading_rate_format,
+			&format_properties);
+	auto required = VkFormatFeatureFlags{
+			VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT |
+			VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR};
+	if ((format_properties.optimalTilingFeatures & required) != required) {
+		return std::nullopt;
+	}
+	auto rate_properties = VkPhysicalDeviceFragmentShadingRatePropertiesKHR{};
+	rate_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &rate_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	auto texel_size =
+			rate_properties.minFragmentShadingRateAttachmentTexelSize;
+	if (texel_size.width == 0 || texel_size.height == 0) {
+		return std::nullopt;
+	}
+	return texel_size;
+}
+
+auto create_shading_rate(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		ShadingRatePolicy policy,
+		VkExtent2D texel_size,
+		const DescriptorAllocator& descriptors) -> ShadingRate {
+	auto rates = ShadingRate{};
+	rates.policy = policy;
+	rates.texel_size = texel_size;
+	// Linear filtering averages the pixels around each of a texel's samples.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	rates.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto bindings = std::array{
+			VkDescriptorSetLayoutBinding{
+					.binding = g_shading_rate_scene_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = &rates.sampler},
+			VkDescriptorSetLayoutBinding{
+					.binding = g_shading_rate_image_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_layout_flags(descriptors),
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&rates.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create shading rate set layout\n");
+		std::terminate();
+	}
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(ShadingRateConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &rates.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&rates.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create shading rate pipeline layout\n");
+		std::terminate();
+	}
+	rates.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			rates.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	return rates;
+}
+
+void destroy_shading_rate(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Allocator& allocator,
+		ShadingRate& rates) {
+	vkDestroyImageView(device, rates.view, host_callbacks());
+	destroy_image(device, allocator, rates.image);
+	vkDestroyPipeline(device, rates.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, rates.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, rates.set_layout, host_callbacks());
+	release_sampler(device, samplers, rates.sampler);
+	rates = ShadingRate{};
+}
+
+void resize_shading_rate(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		ShadingRate& rates,
+		VkExtent2D target_extent) {
+	auto extent = VkExtent2D{
+			.width = texel_count(target_extent.width, rates.texel_size.width),
+			.height = texel_count(target_extent.height, rates.texel_size.height)};
+	if (same_extent(extent, rates.extent)) {
+		return;
+	}
+	if (rates.image.handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device,
+				 &allocator,
+				 image = rates.image,
+				 view = rates.view]() mutable {
+					vkDestroyImageView(device, view, host_callbacks());
+					destroy_image(device, allocator, image);
+				});
+	}
+	rates.extent = extent;
+	rates.written_extent = VkExtent2D{};
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_shading_rate_format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR |
+					VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	rates.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = rates.image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = g_shading_rate_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &rates.view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create shading rate image view\n");
+		std::terminate();
+	}
+}
+
+auto import_shading_rate(RenderGraph& graph, const ShadingRate& rates)
+		-> uint32_t {
+	// Rates written by an earlier frame were left readable.
+	auto initial = g_shading_rate_read;
+	if (rates.written_extent.width == 0) {
+		initial = GraphState{};
+	}
+	return import_graph_image(
+			graph,
+			rates.image.handle,
+			rates.view,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			initial,
+			g_shading_rate_read);
+}
+
+void add_shading_rate_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		ShadingRate& rates,
+		size_t frame_idx,
+		uint32_t rate_image,
+		uint32_t scene,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) {
+	auto content = rates.policy == ShadingRatePolicy::content;
+	if (!content && same_extent(render_extent, rates.written_extent)) {
+		return;
+	}
+	rates.written_extent = render_extent;
+	auto height = static_cast<float>(render_extent.height);
+	auto constants = ShadingRateConstants{
+			.width = texel_count(render_extent.width, rates.texel_size.width),
+			.height = texel_count(render_extent.height, rates.texel_size.height),
+			.texel_width = rates.texel_size.width,
+			.texel_height = rates.texel_size.height,
+			.scene_texel_x = 1.0F / static_cast<float>(target_extent.width),
+			.scene_texel_y = 1.0F / static_cast<float>(target_extent.height),
+			.center_x = static_cast<float>(render_extent.width) * 0.5F,
+			.center_y = height * 0.5F,
+			.inner_radius = rates.settings.inner_radius * height,
+			.outer_radius = rates.settings.outer_radius * height,
+			.flat_contrast = rates.settings.flat_contrast,
+			.smooth_contrast = rates.settings.smooth_contrast};
+	auto record = [&device, &graph, &profiler, &descriptors, &rates, frame_idx,
+								 constants, rate_image, scene](VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "shading_rate");
+		auto set = write_shading_rate_set(
+				device,
+				graph,
+				descriptors,
+				rates,
+				frame_idx,
+				rate_image,
+				scene);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				rates.pipeline);
+		bind_frame_set(
+				command_buffer,
+				descriptors,
+				frame_idx,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				rates.pipeline_layout,
+				0,
+				set);
+		vkCmdPushConstants(
+				command_buffer,
+				rates.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				texel_count(constants.width, g_shading_rate_group_size),
+				texel_count(constants.height, g_shading_rate_group_size),
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "shading_rate", record, false);
+	if (content) {
+		graph_read(graph, pass, scene, g_scene_read);
+	}
+	graph_write(graph, pass, rate_image, g_storage_write);
+}
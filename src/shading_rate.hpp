@@ -0,0 +1,115 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "config.hpp"
+#include "deletion.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Matches local_size in shading_rate.comp, an invocation per rate texel.
+constexpr auto g_shading_rate_group_size = 8U;
+// A fragment size per texel, encoded like shading_rate.comp writes it.
+constexpr auto g_shading_rate_format = VK_FORMAT_R8_UINT;
+// How the main pass reads the rates.
+constexpr auto g_shading_rate_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+		.access = VK_ACCESS_2_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+		.layout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR};
+
+struct ShadingRateSettings {
+	// Foveated rates are 1x1 within the inner radius of the render area's
+	// center, 2x2 up to the outer one and 4x4 beyond. Fractions of its height.
+	float inner_radius{0.3F};
+	float outer_radius{0.6F};
+	// Content rates are 4x4 for texels whose luminance contrast is below the
+	// flat one, 2x2 below the smooth one and 1x1 above.
+	float flat_contrast{0.04F};
+	float smooth_contrast{0.12F};
+};
+
+// The shading rate image the main pass shades with and the compute pass
+// writing it. Foveated rates only depend on the render extent, so they are
+// rewritten when it changes. Content rates are written after the main pass
+// from the scene it drew and used by the next frame, so the image outlives
+// the frame instead of being a transient. Devices coarsen rates they do not
+// support further, down to 1x1. The pass's set is binding 0 the scene,
+// sampled, and binding 1 the rates as a storage image, written every frame
+// like the post passes' sets.
+struct ShadingRate {
+	ShadingRatePolicy policy{};
+	ShadingRateSettings settings;
+	// Pixels per texel of the image.
+	VkExtent2D texel_size{};
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	// Covers the target, in texels.
+	Image image;
+	VkImageView view{};
+	VkExtent2D extent{};
+	// The render extent the rates were last written for, zero while the image
+	// holds none.
+	VkExtent2D written_extent{};
+};
+
+// The smallest texel size the device takes shading rate images with, which
+// gives the finest control over rates. Empty unless g_shading_rate_format can
+// be both written by compute and read as a rate attachment.
+auto shading_rate_texel_size(VkPhysicalDevice physical_device)
+		-> std::optional<VkExtent2D>;
+
+// module is the shading_rate.comp variant for policy, which must not be off.
+// descriptors is the allocator the pass is added with.
+auto create_shading_rate(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		ShadingRatePolicy policy,
+		VkExtent2D texel_size,
+		const DescriptorAllocator& descriptors) -> ShadingRate;
+// The device must be idle.
+void destroy_shading_rate(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Allocator& allocator,
+		ShadingRate& rates);
+
+// Recreates the image when the target's extent needs a different number of
+// texels, the old one is destroyed once the frames using it are done.
+void resize_shading_rate(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		ShadingRate& rates,
+		VkExtent2D target_extent);
+
+// Imports the image into the frame's graph. Before the main pass, the rates
+// are only meant to be read if written_extent is non-zero.
+auto import_shading_rate(RenderGraph& graph, const ShadingRate& rates)
+		-> uint32_t;
+
+// Adds the pass writing the rates of the top left render_extent, which must
+// be called after resize_shading_rate. Foveated rates are written before the
+// main pass, and only when render_extent changed. Content rates are written
+// after it from scene, which must be sampled and cover target_extent. Must
+// be called after the frame fence was waited on.
+void add_shading_rate_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		ShadingRate& rates,
+		size_t frame_idx,
+		uint32_t rate_image,
+		uint32_t scene,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent);
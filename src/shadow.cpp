@@ -0,0 +1,514 @@
+#include "shadow.hpp"
+
+#include "depth.hpp"
+#include "host_memory.hpp"
+#include "matrix_batch.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+namespace {
+
+constexpr auto g_shadow_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+auto shadow_format_features(VkPhysicalDevice physical_device)
+		-> VkFormatFeatureFlags {
+	auto properties = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(
+			physical_device,
+			g_shadow_format,
+			&properties);
+	return properties.optimalTilingFeatures;
+}
+
+auto create_shadow_view(
+		VkDevice& device,
+		VkImage image,
+		VkImageViewType type,
+		uint32_t base_layer,
+		uint32_t layer_count) -> VkImageView {
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = image,
+			.viewType = type,
+			.format = g_shadow_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = base_layer,
+					.layerCount = layer_count}};
+	auto* view = VkImageView{};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a shadow map view\n");
+		std::terminate();
+	}
+	return view;
+}
+
+// Light space axes, z towards the light.
+struct LightBasis {
+	glm::vec3 x{};
+	glm::vec3 y{};
+	glm::vec3 z{};
+};
+
+auto light_basis(glm::vec3 to_light) -> LightBasis {
+	auto z = glm::normalize(to_light);
+	auto helper = std::abs(z.y) < 0.99F ? glm::vec3(0.0F, 1.0F, 0.0F)
+																			: glm::vec3(1.0F, 0.0F, 0.0F);
+	auto x = glm::normalize(glm::cross(helper, z));
+	return LightBasis{.x = x, .y = glm::cross(z, x), .z = z};
+}
+
+// Corners of the view frustum, the near plane's first.
+using FrustumCorners = std::array<glm::vec3, 8>;
+
+auto frustum_corners(const glm::mat4& inverse_transform) -> FrustumCorners {
+	// Reversed depth puts the near plane at 1.
+	const auto clip_corners = FrustumCorners{
+			glm::vec3(-1.0F, -1.0F, 1.0F),
+			glm::vec3(1.0F, -1.0F, 1.0F),
+			glm::vec3(-1.0F, 1.0F, 1.0F),
+			glm::vec3(1.0F, 1.0F, 1.0F),
+			glm::vec3(-1.0F, -1.0F, 0.0F),
+			glm::vec3(1.0F, -1.0F, 0.0F),
+			glm::vec3(-1.0F, 1.0F, 0.0F),
+			glm::vec3(1.0F, 1.0F, 0.0F)};
+	auto projected = std::array<glm::vec4, 8>{};
+	project_points(inverse_transform, clip_corners, projected);
+	auto corners = FrustumCorners{};
+	for (auto i = size_t{}; i < corners.size(); i++) {
+		corners.at(i) = glm::vec3(projected.at(i));
+	}
+	return corners;
+}
+
+// The practical split scheme: logarithmic splits keep texels per screen pixel
+// even, uniform ones keep the near cascades from getting too small.
+auto split_depth(
+		const ShadowSettings& settings,
+		float near,
+		float far,
+		size_t i) -> float {
+	auto fraction =
+			static_cast<float>(i + 1) / static_cast<float>(settings.cascade_count);
+	auto logarithmic = near * std::pow(far / near, fraction);
+	auto uniform = near + (far - near) * fraction;
+	return settings.split_lambda * logarithmic +
+			(1.0F - settings.split_lambda) * uniform;
+}
+
+struct Sphere {
+	glm::vec3 center{};
+	float radius{};
+};
+
+// Sphere around the frustum between two view depths. A sphere fits the slice
+// however the camera turns, so its radius and with it the texel size stay the
+// same from frame to frame. The radius is rounded up to keep float error from
+// changing it.
+auto slice_sphere(
+		const FrustumCorners& corners,
+		float near,
+		float far,
+		float begin,
+		float end) -> Sphere {
+	auto slice = FrustumCorners{};
+	auto rays = corners.size() / 2;
+	for (auto i = size_t{}; i < rays; i++) {
+		// View depth grows linearly along the rays through the corners.
+		auto ray = corners.at(i + rays) - corners.at(i);
+		slice.at(i) = corners.at(i) + ray * ((begin - near) / (far - near));
+		slice.at(i + rays) = corners.at(i) + ray * ((end - near) / (far - near));
+	}
+	auto center = glm::vec3{};
+	for (const auto& corner : slice) {
+		center += corner;
+	}
+	center /= static_cast<float>(slice.size());
+	auto radius = 0.0F;
+	for (const auto& corner : slice) {
+		radius = std::max(radius, glm::distance(center, corner));
+	}
+	auto step = glm::exp2(std::ceil(glm::log2(std::max(radius, 1e-6F)))) / 64.0F;
+	return Sphere{.center = center, .radius = std::ceil(radius / step) * step};
+}
+
+// Orthographic map of the light space square of half size radius around
+// center, over the depths of the scene's sphere.
+auto fit_cascade(
+		const LightBasis& basis,
+		const Sphere& sphere,
+		glm::vec4 scene,
+		uint32_t resolution,
+		float split) -> ShadowCascade {
+	auto texel_size = 2.0F * sphere.radius / static_cast<float>(resolution);
+	auto center = glm::vec2(
+			glm::dot(basis.x, sphere.center),
+			glm::dot(basis.y, sphere.center));
+	center = glm::floor(center / texel_size) * texel_size;
+	auto depth_range = std::max(2.0F * scene.w, 1e-6F);
+	auto depth_min = glm::dot(basis.z, glm::vec3(scene)) - scene.w;
+	auto rows = glm::mat4(
+			glm::vec4(basis.x / sphere.radius, -center.x / sphere.radius),
+			glm::vec4(basis.y / sphere.radius, -center.y / sphere.radius),
+			glm::vec4(basis.z / depth_range, -depth_min / depth_range),
+			glm::vec4(0.0F, 0.0F, 0.0F, 1.0F));
+	return ShadowCascade{
+			.transform = glm::transpose(rows),
+			.split = split,
+			.texel_size = texel_size,
+			.center = center,
+			.radius = sphere.radius};
+}
+
+// Whether a cached cascade still covers the sphere around its slice.
+auto covers(
+		const LightBasis& basis,
+		const ShadowCascade& cascade,
+		const Sphere& sphere) -> bool {
+	auto center = glm::vec2(
+			glm::dot(basis.x, sphere.center),
+			glm::dot(basis.y, sphere.center));
+	return glm::distance(center, cascade.center) + sphere.radius <=
+			cascade.radius;
+}
+
+}  // namespace
+
+auto update_shadow_cascades(
+		ShadowCache& cache,
+		const ShadowSettings& settings,
+		const glm::mat4& inverse_transform,
+		float near,
+		float far,
+		glm::vec3 to_light,
+		glm::vec4 scene) -> uint32_t {
+	auto count = static_cast<uint32_t>(
+			std::min(size_t{settings.cascade_count}, g_max_shadow_cascades));
+	if (count != cache.cascade_count) {
+		cache.cascade_count = count;
+		cache.valid = 0;
+	}
+	auto light_direction = glm::normalize(to_light);
+	if (glm::dot(light_direction, cache.light_direction) <
+			std::cos(settings.light_tolerance)) {
+		cache.light_direction = light_direction;
+		cache.valid = 0;
+	}
+	auto basis = light_basis(light_direction);
+	auto static_basis = light_basis(cache.light_direction);
+	auto corners = frustum_corners(inverse_transform);
+
+	auto render = uint32_t{};
+	auto begin = near;
+	for (auto i = size_t{}; i < count; i++) {
+		auto end = split_depth(settings, near, far, i);
+		auto sphere = slice_sphere(corners, near, far, begin, end);
+		auto bit = uint32_t{1} << i;
+		auto& cascade = cache.cascades.at(i);
+		if (i < settings.first_static_cascade) {
+			cascade = fit_cascade(basis, sphere, scene, settings.resolution, end);
+			render |= bit;
+		} else if (
+				(cache.valid & bit) == 0 || !covers(static_basis, cascade, sphere)) {
+			sphere.radius *= 1.0F + settings.static_margin;
+			cascade =
+					fit_cascade(static_basis, sphere, scene, settings.resolution, end);
+			render |= bit;
+		}
+		cascade.split = end;
+		begin = end;
+	}
+	cache.valid |= render;
+	return render;
+}
+
+void invalidate_shadow_cache(ShadowCache& cache) {
+	cache.valid = 0;
+}
+
+auto shadow_maps_supported(VkPhysicalDevice physical_device) -> bool {
+	auto needed = VkFormatFeatureFlags{
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT};
+	return (shadow_format_features(physical_device) & needed) == needed;
+}
+
+auto shadow_filter_linear(VkPhysicalDevice physical_device) -> bool {
+	return (shadow_format_features(physical_device) &
+					VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
+
+auto create_shadow_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const ShadowSettings& settings,
+		bool linear,
+		size_t frame_count) -> ShadowMaps {
+	auto maps = ShadowMaps{};
+	maps.settings = settings;
+	maps.settings.cascade_count = static_cast<uint32_t>(
+			std::min(size_t{settings.cascade_count}, g_max_shadow_cascades));
+	auto filter = linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	// Reversed depth is larger nearer the light, a lookup is lit where nothing
+	// in the map is nearer than it.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = filter,
+			.minFilter = filter,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_TRUE,
+			.compareOp = VK_COMPARE_OP_GREATER_OR_EQUAL,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	maps.sampler = acquire_sampler(device, samplers, sampler_info);
+	maps.sampler_handle = add_bindless_sampler(device, bindless, maps.sampler);
+
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_shadow_format,
+			.extent =
+					VkExtent3D{
+							.width = maps.settings.resolution,
+							.height = maps.settings.resolution,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = maps.settings.cascade_count,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+					VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	maps.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	maps.view = create_shadow_view(
+			device,
+			maps.image.handle,
+			VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+			0,
+			maps.settings.cascade_count);
+	maps.handle = add_bindless_image(
+			device,
+			bindless,
+			maps.view,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	for (auto i = 0U; i < maps.settings.cascade_count; i++) {
+		maps.cascade_views.at(i) = create_shadow_view(
+				device,
+				maps.image.handle,
+				VK_IMAGE_VIEW_TYPE_2D,
+				i,
+				1);
+	}
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = maps.frames.emplace_back();
+		frame.view = create_dynamic_buffer(
+				device,
+				allocator,
+				sizeof(ShadowView),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.view_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.view.handle,
+				0,
+				sizeof(ShadowView));
+	}
+	return maps;
+}
+
+void destroy_shadow_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		ShadowMaps& maps) {
+	for (auto& frame : maps.frames) {
+		remove_bindless_buffer(device, bindless, frame.view_handle);
+		destroy_buffer(device, allocator, frame.view);
+	}
+	for (auto i = 0U; i < maps.settings.cascade_count; i++) {
+		vkDestroyImageView(device, maps.cascade_views.at(i), host_callbacks());
+	}
+	remove_bindless_image(device, bindless, maps.handle);
+	vkDestroyImageView(device, maps.view, host_callbacks());
+	destroy_image(device, allocator, maps.image);
+	remove_bindless_sampler(device, bindless, maps.sampler_handle);
+	release_sampler(device, samplers, maps.sampler);
+	maps = ShadowMaps{};
+}
+
+auto update_shadow_maps(
+		ShadowMaps& maps,
+		size_t frame_idx,
+		const glm::mat4& inverse_transform,
+		float near,
+		float far,
+		glm::vec3 to_light,
+		glm::vec3 color,
+		glm::vec4 scene,
+		ShadowAtlasHandles atlas) -> uint32_t {
+	if (!maps.rendered) {
+		invalidate_shadow_cache(maps.cache);
+	}
+	auto render = update_shadow_cascades(
+			maps.cache,
+			maps.settings,
+			inverse_transform,
+			near,
+			far,
+			to_light,
+			scene);
+	// Until the first cascades are in, nothing is shadowed.
+	auto view = ShadowView{
+			.transforms = {},
+			.splits = glm::vec4(0.0F),
+			.texel_sizes = glm::vec4(0.0F),
+			.to_light = glm::normalize(to_light),
+			.cascade_count = maps.rendered ? maps.cache.cascade_count : 0U,
+			.color = color,
+			.map = maps.handle,
+			.sampler = maps.sampler_handle,
+			.atlas = atlas,
+			.padding = {}};
+	for (auto i = 0U; i < maps.cache.cascade_count; i++) {
+		const auto& cascade = maps.cache.cascades.at(i);
+		view.transforms.at(i) = cascade.transform;
+		view.splits[static_cast<glm::length_t>(i)] = cascade.split;
+		view.texel_sizes[static_cast<glm::length_t>(i)] = cascade.texel_size;
+	}
+	const auto& frame = maps.frames.at(frame_idx);
+	std::memcpy(frame.view.allocation.mapped, &view, sizeof(view));
+	return render;
+}
+
+auto import_shadow_maps(RenderGraph& graph, const ShadowMaps& maps)
+		-> uint32_t {
+	return import_graph_image(
+			graph,
+			maps.image.handle,
+			maps.view,
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			maps.rendered ? g_shadow_read : GraphState{},
+			g_shadow_read);
+}
+
+void add_shadow_cascade_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		ShadowMaps& maps,
+		uint32_t image,
+		uint32_t cascade,
+		GraphRecord draw) {
+	auto* cascade_view = maps.cascade_views.at(cascade);
+	auto resolution = maps.settings.resolution;
+	auto record = [&profiler, frame_idx, cascade_view, resolution,
+								 draw = std::move(draw)](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "shadow_cascade");
+		// The pipelines have a color attachment, which nothing is bound to.
+		auto color_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = VK_NULL_HANDLE,
+				.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.clearValue = VkClearValue{}};
+		auto depth_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = cascade_view,
+				.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.clearValue = VkClearValue{
+						.depthStencil = {.depth = g_depth_clear_value, .stencil = 0}}};
+		auto rendering_info = VkRenderingInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderArea =
+						VkRect2D{.offset = {0, 0}, .extent = {resolution, resolution}},
+				.layerCount = 1,
+				.viewMask = 0,
+				.colorAttachmentCount = 1,
+				.pColorAttachments = &color_attachment,
+				.pDepthAttachment = &depth_attachment,
+				.pStencilAttachment = VK_NULL_HANDLE};
+		vkCmdBeginRendering(command_buffer, &rendering_info);
+		draw(command_buffer);
+		vkCmdEndRendering(command_buffer);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "shadow_cascade", record, false);
+	graph_write_subresources(
+			graph,
+			pass,
+			image,
+			GraphSubresources{
+					.base_level = 0,
+					.level_count = 1,
+					.base_layer = cascade,
+					.layer_count = 1},
+			g_shadow_write);
+	if (cascade + 1 == maps.settings.cascade_count) {
+		maps.rendered = true;
+	}
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr auto g_max_shadow_cascades = size_t{4};
+// Float depth keeps the precision of reversed depth like the scene's.
+constexpr auto g_shadow_format = VK_FORMAT_D32_SFLOAT;
+
+struct ShadowSettings {
+	uint32_t cascade_count{4};
+	// Texels along each side of a cascade's map.
+	uint32_t resolution{2048};
+	// Split distances blend uniform splits (0) and logarithmic ones (1).
+	float split_lambda{0.75F};
+	// Cascades from this one on only hold static geometry, so they are cached
+	// and re-rendered only when the light or the camera moved far enough.
+	uint32_t first_static_cascade{2};
+	// Fraction of its radius a static cascade covers beyond its slice of the
+	// view frustum, how far the camera can move before it is re-rendered.
+	float static_margin{0.25F};
+	// Change of the light direction in radians that re-renders static cascades.
+	float light_tolerance{0.005F};
+};
+
+// An orthographic shadow map fit around a slice of the view frustum. Depth is
+// reversed like the scene's: 1 nearest the light, 0 farthest, so maps clear
+// to g_depth_clear_value and test with g_depth_compare_op.
+struct ShadowCascade {
+	// World space to the cascade's clip space.
+	glm::mat4 transform{1.0F};
+	// View depth at which the next cascade takes over, for picking a cascade
+	// while shading.
+	float split{};
+	// World space size of a texel, for depth biases scaled per cascade.
+	float texel_size{};
+	// Light space center and radius of the area the map covers. The center is
+	// snapped to whole texels so the map does not shimmer as the camera moves.
+	glm::vec2 center{};
+	float radius{};
+};
+
+// Cascades as they were last rendered. Dynamic cascades are fit anew every
+// frame, static ones keep the fit of their last rendering until it no longer
+// covers their slice.
+struct ShadowCache {
+	std::array<ShadowCascade, g_max_shadow_cascades> cascades{};
+	uint32_t cascade_count{};
+	// Bit i is set while cascade i's map is up to date.
+	uint32_t valid{};
+	// Towards the light, as the static cascades were rendered with.
+	glm::vec3 light_direction{};
+};
+
+// Fits the cascades of a frame and returns which must be rendered, bit i for
+// cache.cascades[i]. inverse_transform takes the camera's clip space to world
+// space, with the reversed depth of depth.hpp, and near and far are the view
+// depths of its planes, far being finite. to_light points towards a
+// directional light. scene holds the center in xyz and the radius in w of a
+// sphere around every shadow caster, which sets the depth range of every
+// cascade.
+auto update_shadow_cascades(
+		ShadowCache& cache,
+		const ShadowSettings& settings,
+		const glm::mat4& inverse_transform,
+		float near,
+		float far,
+		glm::vec3 to_light,
+		glm::vec4 scene) -> uint32_t;
+// Re-renders every cascade on the next update, for when static geometry
+// changed.
+void invalidate_shadow_cache(ShadowCache& cache);
+
+// The spot lights' shadow atlas of src/shadow_atlas.hpp: its depth image and
+// the frame's tiles, indexed like the lights.
+struct ShadowAtlasHandles {
+	BindlessHandle map{};
+	BindlessHandle tiles{};
+};
+
+// What the SHADOWS variant of shader.frag reads of the frame's cascades, in
+// the buffer the clusters' view points it to. Layout matches the ShadowList
+// block in shader.frag.
+struct ShadowView {
+	std::array<glm::mat4, g_max_shadow_cascades> transforms{};
+	// The split of each cascade, past the last one nothing is shadowed.
+	glm::vec4 splits{};
+	// The texel size of each cascade, which lookups offset the surface along
+	// its normal by.
+	glm::vec4 texel_sizes{};
+	glm::vec3 to_light{};
+	uint32_t cascade_count{};
+	glm::vec3 color{};
+	// A 2D array view of the cascades and a comparison sampler, which the
+	// atlas is sampled with too.
+	BindlessHandle map{};
+	BindlessHandle sampler{};
+	ShadowAtlasHandles atlas{};
+	uint32_t padding{};
+};
+static_assert(sizeof(ShadowView) == 336);
+
+struct ShadowFrame {
+	Buffer view;
+	BindlessHandle view_handle{};
+};
+
+// Cascaded shadow maps of a directional light, a layer of one image each.
+// Every frame update_shadow_maps fits the cascades to the view and the
+// frame's passes render the ones it returns, while the static cascades keep
+// what they were last rendered with. The image is kept in
+// SHADER_READ_ONLY_OPTIMAL between frames, where shader.frag samples it
+// through the bindless table.
+struct ShadowMaps {
+	ShadowSettings settings;
+	ShadowCache cache;
+	Image image;
+	// Of every layer, which the bindless table holds, and of each, rendered
+	// to.
+	VkImageView view{};
+	BindlessHandle handle{};
+	std::array<VkImageView, g_max_shadow_cascades> cascade_views{};
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+	std::vector<ShadowFrame> frames;
+	// Whether the image was rendered to before, its contents and layout are
+	// undefined until it was.
+	bool rendered{};
+};
+
+// Whether g_shadow_format can be rendered to and sampled, and whether
+// comparisons of it can be filtered linearly.
+auto shadow_maps_supported(VkPhysicalDevice physical_device) -> bool;
+auto shadow_filter_linear(VkPhysicalDevice physical_device) -> bool;
+
+// settings.cascade_count is clamped to g_max_shadow_cascades. Linear
+// comparisons blend the four texels around a lookup.
+auto create_shadow_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const ShadowSettings& settings,
+		bool linear,
+		size_t frame_count) -> ShadowMaps;
+// The device must be idle.
+void destroy_shadow_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		ShadowMaps& maps);
+
+// Fits the frame's cascades with update_shadow_cascades and writes the
+// frame's view for a light of color and the frame's atlas, after the frame
+// fence was waited on. Returns the cascades to render, which are all of them
+// until the image was rendered to.
+auto update_shadow_maps(
+		ShadowMaps& maps,
+		size_t frame_idx,
+		const glm::mat4& inverse_transform,
+		float near,
+		float far,
+		glm::vec3 to_light,
+		glm::vec3 color,
+		glm::vec4 scene,
+		ShadowAtlasHandles atlas) -> uint32_t;
+
+// Imports the image into the frame's graph, the passes shading with it read
+// the resource with g_shadow_read.
+auto import_shadow_maps(RenderGraph& graph, const ShadowMaps& maps)
+		-> uint32_t;
+constexpr auto g_shadow_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+// Adds the pass rendering cascade of image, which draw records into under
+// dynamic rendering with no color attachment written, drawing the casters
+// with the cascade's transform.
+void add_shadow_cascade_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		ShadowMaps& maps,
+		uint32_t image,
+		uint32_t cascade,
+		GraphRecord draw);
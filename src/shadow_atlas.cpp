@@ -0,0 +1,577 @@
+#include "shadow_atlas.hpp"
+
+#include "depth.hpp"
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <numbers>
+#include <optional>
+#include <utility>
+
+namespace {
+
+enum class NodeState : uint8_t {
+	// Neither the node nor anything below it is taken.
+	free,
+	// Some of its four children are taken.
+	split,
+	// A light's tile.
+	used,
+};
+
+// Fraction of a light's radius its map starts at.
+constexpr auto g_shadow_near_fraction = 0.01F;
+
+constexpr auto g_atlas_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+auto node(ShadowAtlas& atlas, uint32_t level, glm::uvec2 xy) -> uint8_t& {
+	// The levels before this one hold (4^level - 1) / 3 nodes.
+	auto offset = ((size_t{1} << (2U * level)) - 1) / 3;
+	return atlas.nodes.at(offset + (size_t{xy.y} << level) + xy.x);
+}
+
+auto is(ShadowAtlas& atlas, uint32_t level, glm::uvec2 xy, NodeState state)
+		-> bool {
+	return node(atlas, level, xy) == static_cast<uint8_t>(state);
+}
+
+// Takes a free node at level whose parent is split, splitting one of the
+// level above when there is none. Nodes are searched row by row, so tiles
+// pack towards the atlas's first rows.
+auto take_node(ShadowAtlas& atlas, uint32_t level, NodeState state)
+		-> std::optional<glm::uvec2> {
+	auto side = 1U << level;
+	for (auto y = 0U; y < side; y++) {
+		for (auto x = 0U; x < side; x++) {
+			auto xy = glm::uvec2(x, y);
+			if (is(atlas, level, xy, NodeState::free) &&
+					(level == 0 || is(atlas, level - 1, xy / 2U, NodeState::split))) {
+				node(atlas, level, xy) = static_cast<uint8_t>(state);
+				return xy;
+			}
+		}
+	}
+	if (level == 0) {
+		return std::nullopt;
+	}
+	auto parent = take_node(atlas, level - 1, NodeState::split);
+	if (!parent) {
+		return std::nullopt;
+	}
+	// The children of a free node are all free.
+	auto xy = *parent * 2U;
+	node(atlas, level, xy) = static_cast<uint8_t>(state);
+	return xy;
+}
+
+// Frees a node and merges its parents back while all their children are.
+void free_node(ShadowAtlas& atlas, uint32_t level, glm::uvec2 xy) {
+	node(atlas, level, xy) = static_cast<uint8_t>(NodeState::free);
+	while (level != 0) {
+		auto first = xy / 2U * 2U;
+		for (auto child = 0U; child < 4; child++) {
+			if (!is(atlas,
+							level,
+							first + glm::uvec2(child & 1U, child >> 1U),
+							NodeState::free)) {
+				return;
+			}
+		}
+		level--;
+		xy /= 2U;
+		node(atlas, level, xy) = static_cast<uint8_t>(NodeState::free);
+	}
+}
+
+auto tile_level(const ShadowAtlasSettings& settings, uint32_t size)
+		-> uint32_t {
+	return static_cast<uint32_t>(
+			std::countr_zero(settings.size) - std::countr_zero(size));
+}
+
+auto allocate_tile(ShadowAtlas& atlas, uint32_t size)
+		-> std::optional<ShadowAtlasTile> {
+	auto xy = take_node(atlas, tile_level(atlas.settings, size), NodeState::used);
+	if (!xy) {
+		return std::nullopt;
+	}
+	return ShadowAtlasTile{.x = xy->x * size, .y = xy->y * size, .size = size};
+}
+
+void release_tile(ShadowAtlas& atlas, ShadowAtlasLight& entry) {
+	if (entry.tile.size != 0) {
+		free_node(
+				atlas,
+				tile_level(atlas.settings, entry.tile.size),
+				glm::uvec2(entry.tile.x, entry.tile.y) / entry.tile.size);
+	}
+	entry.tile = ShadowAtlasTile{};
+	entry.valid = false;
+	entry.current = false;
+}
+
+auto casts_shadow(const ShadowAtlasSettings& settings, const Light& light)
+		-> bool {
+	return light.radius > 0.0F && light.spot_outer >= settings.min_spot_outer &&
+			light.spot_outer < 1.0F;
+}
+
+// Fraction of the screen the light's sphere covers, from the extents of the
+// sphere along each clip space axis. Zero when it lies outside the view, one
+// when the camera's plane cuts through it.
+auto screen_coverage(const glm::mat4& view_projection, const Light& light)
+		-> float {
+	auto clip = view_projection * glm::vec4(light.position, 1.0F);
+	auto extent = [&](int row) {
+		return light.radius * glm::length(glm::vec3(
+																	view_projection[0][row],
+																	view_projection[1][row],
+																	view_projection[2][row]));
+	};
+	auto w_extent = extent(3);
+	if (clip.w + w_extent <= 0.0F) {
+		return 0.0F;
+	}
+	if (clip.w - w_extent <= 0.0F) {
+		return 1.0F;
+	}
+	auto x_extent = extent(0);
+	auto y_extent = extent(1);
+	// Reversed depth puts the far plane at 0.
+	if (std::abs(clip.x) - x_extent > clip.w ||
+			std::abs(clip.y) - y_extent > clip.w || clip.z + extent(2) < 0.0F) {
+		return 0.0F;
+	}
+	// Clip space spans 2 along x and y.
+	auto area = std::numbers::pi_v<float> * x_extent * y_extent /
+			(clip.w * clip.w);
+	return std::min(area / 4.0F, 1.0F);
+}
+
+auto wanted_size(const ShadowAtlasSettings& settings, float coverage)
+		-> uint32_t {
+	if (coverage <= 0.0F) {
+		return 0;
+	}
+	auto side = static_cast<float>(settings.max_tile) *
+			std::sqrt(std::min(coverage / settings.full_coverage, 1.0F));
+	return std::clamp(
+			std::bit_ceil(static_cast<uint32_t>(std::ceil(side))),
+			settings.min_tile,
+			settings.max_tile);
+}
+
+auto moved(const Light& rendered, const Light& light) -> bool {
+	return rendered.position != light.position ||
+			rendered.direction != light.direction ||
+			rendered.radius != light.radius ||
+			rendered.spot_outer != light.spot_outer;
+}
+
+void set_row(glm::mat4& transform, int row, glm::vec3 axis, float offset) {
+	transform[0][row] = axis.x;
+	transform[1][row] = axis.y;
+	transform[2][row] = axis.z;
+	transform[3][row] = offset;
+}
+
+// Tangent of half the cone's angle, which its map's field of view spans.
+auto spot_tan_half(const Light& light) -> float {
+	return std::sqrt(1.0F - light.spot_outer * light.spot_outer) /
+			light.spot_outer;
+}
+
+// A perspective down the cone, its field of view the cone's, with reversed
+// depth from the near plane at 1 to the light's radius at 0.
+auto spot_transform(const Light& light) -> glm::mat4 {
+	auto forward = glm::normalize(light.direction);
+	auto helper = std::abs(forward.y) < 0.99F ? glm::vec3(0.0F, 1.0F, 0.0F)
+																						: glm::vec3(1.0F, 0.0F, 0.0F);
+	auto right = glm::normalize(glm::cross(forward, helper));
+	auto up = glm::cross(right, forward);
+	auto tan_half = spot_tan_half(light);
+	auto near = light.radius * g_shadow_near_fraction;
+	auto far = light.radius;
+	// depth = a + b / distance is 1 at near and 0 at far.
+	auto a = -near / (far - near);
+	auto b = near * far / (far - near);
+
+	auto transform = glm::mat4(0.0F);
+	auto axis_row = [&](int row, glm::vec3 axis, float offset) {
+		set_row(transform, row, axis, offset - glm::dot(axis, light.position));
+	};
+	axis_row(0, right / tan_half, 0.0F);
+	axis_row(1, up / tan_half, 0.0F);
+	axis_row(2, forward * a, b);
+	axis_row(3, forward, 0.0F);
+	return transform;
+}
+
+// Takes the light's clip space onto its tile's square of atlas texture
+// coordinates, before the divide by w.
+auto atlas_transform(
+		const ShadowAtlasSettings& settings,
+		const ShadowAtlasTile& tile,
+		const glm::mat4& transform) -> glm::mat4 {
+	auto atlas_size = static_cast<float>(settings.size);
+	auto scale = 0.5F * static_cast<float>(tile.size) / atlas_size;
+	auto bias = glm::mat4(1.0F);
+	bias[0][0] = scale;
+	bias[1][1] = scale;
+	// Column 3 is scaled by w, so the offset survives the divide.
+	bias[3][0] = static_cast<float>(tile.x) / atlas_size + scale;
+	bias[3][1] = static_cast<float>(tile.y) / atlas_size + scale;
+	return bias * transform;
+}
+
+}  // namespace
+
+auto create_shadow_atlas(const ShadowAtlasSettings& settings) -> ShadowAtlas {
+	if (!std::has_single_bit(settings.size) ||
+			!std::has_single_bit(settings.min_tile) ||
+			!std::has_single_bit(settings.max_tile) ||
+			settings.min_tile > settings.max_tile ||
+			settings.max_tile > settings.size) {
+		fmt::print(stderr, "Invalid shadow atlas tile sizes\n");
+		std::terminate();
+	}
+	auto atlas = ShadowAtlas{};
+	atlas.settings = settings;
+	atlas.levels = tile_level(settings, settings.min_tile) + 1;
+	atlas.nodes.resize(((size_t{1} << (2U * atlas.levels)) - 1) / 3);
+	return atlas;
+}
+
+void update_shadow_atlas(
+		ShadowAtlas& atlas,
+		std::span<const Light> lights,
+		const glm::mat4& view_projection) {
+	const auto& settings = atlas.settings;
+	for (auto i = lights.size(); i < atlas.lights.size(); i++) {
+		release_tile(atlas, atlas.lights.at(i));
+	}
+	atlas.lights.resize(lights.size());
+
+	// Tiles that no longer fit are freed up front so their space merges back
+	// before anything is placed. Lights out of view keep theirs until the
+	// space is needed, so they come back without a render.
+	auto wanted = std::vector<uint32_t>(lights.size());
+	auto order = std::vector<uint32_t>{};
+	for (auto i = size_t{}; i < lights.size(); i++) {
+		const auto& light = lights[i];
+		auto& entry = atlas.lights.at(i);
+		entry.coverage = casts_shadow(settings, light)
+				? screen_coverage(view_projection, light)
+				: 0.0F;
+		wanted.at(i) = wanted_size(settings, entry.coverage);
+		if (wanted.at(i) != 0 && entry.tile.size != 0 &&
+				(wanted.at(i) > entry.tile.size ||
+				 wanted.at(i) * 4 <= entry.tile.size)) {
+			release_tile(atlas, entry);
+		}
+		if (moved(entry.light, light)) {
+			entry.current = false;
+		}
+		if (wanted.at(i) != 0) {
+			order.emplace_back(static_cast<uint32_t>(i));
+		}
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+		return atlas.lights.at(lhs).coverage > atlas.lights.at(rhs).coverage;
+	});
+
+	// The lights covering the most are placed first. When the atlas is full,
+	// tiles of lights out of view are given up, then the tile is halved down
+	// to min_tile before the light goes without.
+	auto idle = size_t{};
+	for (auto i : order) {
+		auto& entry = atlas.lights.at(i);
+		if (entry.tile.size != 0) {
+			continue;
+		}
+		auto size = wanted.at(i);
+		auto tile = allocate_tile(atlas, size);
+		while (!tile) {
+			while (idle < lights.size() &&
+						 (wanted.at(idle) != 0 || atlas.lights.at(idle).tile.size == 0)) {
+				idle++;
+			}
+			if (idle < lights.size()) {
+				release_tile(atlas, atlas.lights.at(idle));
+			} else if (size > settings.min_tile) {
+				size /= 2;
+			} else {
+				break;
+			}
+			tile = allocate_tile(atlas, size);
+		}
+		if (tile) {
+			entry.tile = *tile;
+		}
+	}
+
+	atlas.renders.clear();
+	for (auto i : order) {
+		if (atlas.renders.size() == settings.max_renders) {
+			break;
+		}
+		auto& entry = atlas.lights.at(i);
+		if (entry.tile.size == 0 || entry.current) {
+			continue;
+		}
+		entry.light = lights[i];
+		entry.transform = spot_transform(entry.light);
+		entry.atlas_transform =
+				atlas_transform(settings, entry.tile, entry.transform);
+		entry.valid = true;
+		entry.current = true;
+		atlas.renders.emplace_back(i);
+	}
+}
+
+void invalidate_shadow_atlas(
+		ShadowAtlas& atlas,
+		glm::vec3 center,
+		float radius) {
+	for (auto& entry : atlas.lights) {
+		auto reach = entry.light.radius + radius;
+		auto offset = entry.light.position - center;
+		if (glm::dot(offset, offset) <= reach * reach) {
+			entry.current = false;
+		}
+	}
+}
+
+auto create_shadow_atlas_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		const ShadowAtlasSettings& settings,
+		uint32_t light_capacity,
+		size_t frame_count) -> ShadowAtlasMaps {
+	auto maps = ShadowAtlasMaps{};
+	maps.atlas = create_shadow_atlas(settings);
+	maps.light_capacity = light_capacity;
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_shadow_format,
+			.extent =
+					VkExtent3D{
+							.width = settings.size,
+							.height = settings.size,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+					VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	maps.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = maps.image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = g_shadow_format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(device, &view_info, host_callbacks(), &maps.view) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create the shadow atlas view\n");
+		std::terminate();
+	}
+	maps.handle = add_bindless_image(
+			device,
+			bindless,
+			maps.view,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	auto tiles_size = sizeof(ShadowAtlasTileView) * std::max(light_capacity, 1U);
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = maps.frames.emplace_back();
+		frame.tiles = create_dynamic_buffer(
+				device,
+				allocator,
+				tiles_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.tiles_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.tiles.handle,
+				0,
+				tiles_size);
+	}
+	return maps;
+}
+
+void destroy_shadow_atlas_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ShadowAtlasMaps& maps) {
+	for (auto& frame : maps.frames) {
+		remove_bindless_buffer(device, bindless, frame.tiles_handle);
+		destroy_buffer(device, allocator, frame.tiles);
+	}
+	remove_bindless_image(device, bindless, maps.handle);
+	vkDestroyImageView(device, maps.view, host_callbacks());
+	destroy_image(device, allocator, maps.image);
+	maps = ShadowAtlasMaps{};
+}
+
+void update_shadow_atlas_maps(
+		ShadowAtlasMaps& maps,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view_projection,
+		bool render) {
+	if (lights.size() > maps.light_capacity) {
+		fmt::print(
+				stderr,
+				"Shadow atlas overflow: {} lights, room for {}\n",
+				lights.size(),
+				maps.light_capacity);
+		std::terminate();
+	}
+	if (render) {
+		update_shadow_atlas(maps.atlas, lights, view_projection);
+	} else {
+		maps.atlas.renders.clear();
+	}
+	auto* tiles = maps.frames.at(frame_idx).tiles.allocation.mapped;
+	for (auto i = size_t{}; i < lights.size(); i++) {
+		auto tile = ShadowAtlasTileView{};
+		if (i < maps.atlas.lights.size() && maps.atlas.lights.at(i).valid) {
+			const auto& entry = maps.atlas.lights.at(i);
+			tile.transform = entry.atlas_transform;
+			tile.texel_scale = 2.0F * spot_tan_half(entry.light) /
+					static_cast<float>(entry.tile.size);
+			tile.valid = 1;
+		}
+		std::memcpy(tiles + i * sizeof(tile), &tile, sizeof(tile));
+	}
+}
+
+auto shadow_atlas_handles(const ShadowAtlasMaps& maps, size_t frame_idx)
+		-> ShadowAtlasHandles {
+	return ShadowAtlasHandles{
+			.map = maps.handle,
+			.tiles = maps.frames.at(frame_idx).tiles_handle};
+}
+
+auto import_shadow_atlas_maps(RenderGraph& graph, ShadowAtlasMaps& maps)
+		-> uint32_t {
+	// Nothing was valid before the first import, so its contents go.
+	auto initial = maps.imported ? g_shadow_read : GraphState{};
+	maps.imported = true;
+	return import_graph_image(
+			graph,
+			maps.image.handle,
+			maps.view,
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			initial,
+			g_shadow_read);
+}
+
+void add_shadow_atlas_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		const ShadowAtlasMaps& maps,
+		uint32_t image,
+		uint32_t light,
+		GraphRecord draw) {
+	const auto& tile = maps.atlas.lights.at(light).tile;
+	auto area = VkRect2D{
+			.offset =
+					VkOffset2D{
+							.x = static_cast<int32_t>(tile.x),
+							.y = static_cast<int32_t>(tile.y)},
+			.extent = VkExtent2D{.width = tile.size, .height = tile.size}};
+	auto* view = maps.view;
+	auto record = [&profiler, frame_idx, view, area, draw = std::move(draw)](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "shadow_atlas");
+		// The pipelines have a color attachment, which nothing is bound to.
+		auto color_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = VK_NULL_HANDLE,
+				.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.clearValue = VkClearValue{}};
+		// Loads and stores only touch the render area, the other tiles keep
+		// their maps.
+		auto depth_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = view,
+				.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.clearValue = VkClearValue{
+						.depthStencil = {.depth = g_depth_clear_value, .stencil = 0}}};
+		auto rendering_info = VkRenderingInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderArea = area,
+				.layerCount = 1,
+				.viewMask = 0,
+				.colorAttachmentCount = 1,
+				.pColorAttachments = &color_attachment,
+				.pDepthAttachment = &depth_attachment,
+				.pStencilAttachment = VK_NULL_HANDLE};
+		vkCmdBeginRendering(command_buffer, &rendering_info);
+		draw(command_buffer);
+		vkCmdEndRendering(command_buffer);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "shadow_atlas", record, false);
+	graph_write(graph, pass, image, g_atlas_write);
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "light_clusters.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "shadow.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct ShadowAtlasSettings {
+	// Texels along each side of the atlas, a power of two.
+	uint32_t size{8192};
+	// Bounds of the tile sizes lights get, powers of two no larger than size.
+	uint32_t min_tile{128};
+	uint32_t max_tile{2048};
+	// Fraction of the screen a light's sphere covers at which it gets
+	// max_tile. Tiles below it shrink with the square root of the coverage, so
+	// texels per screen pixel stay about even.
+	float full_coverage{0.25F};
+	// Tiles rendered per update at most, the lights covering the most first.
+	// Lights that miss out keep sampling their tile as it was last rendered.
+	uint32_t max_renders{8};
+	// Spot lights whose cone is wider than this cosine of its half angle are
+	// not given a tile, a single perspective map cannot hold them.
+	float min_spot_outer{0.1F};
+};
+
+// A square of the atlas in texels.
+struct ShadowAtlasTile {
+	uint32_t x{};
+	uint32_t y{};
+	// Zero for no tile.
+	uint32_t size{};
+};
+
+// A light's tile and what was last rendered into it. Depth is reversed like
+// the scene's, 1 at the light and 0 at its radius, so tiles clear to
+// g_depth_clear_value and test with g_depth_compare_op.
+struct ShadowAtlasLight {
+	ShadowAtlasTile tile;
+	// World space to the clip space of the light's perspective, for rendering
+	// into the tile with a viewport of its square.
+	glm::mat4 transform{1.0F};
+	// World space to atlas texture coordinates in xy and depth in z, for
+	// sampling the tile while shading.
+	glm::mat4 atlas_transform{1.0F};
+	// The light as it was rendered, a change of it re-renders the tile.
+	Light light{};
+	// Fraction of the screen the light covered at the last update.
+	float coverage{};
+	// Whether the tile holds the light's map for transform. Lights without a
+	// valid tile are shaded unshadowed.
+	bool valid{};
+	// Whether the map still matches the light and its casters as they are.
+	bool current{};
+};
+
+// Spot light shadows of many lights in one depth atlas. Every update sizes
+// each light's tile by how much of the screen the light covers and packs the
+// tiles into the atlas as a quadtree of power of two squares. Tiles are
+// cached: a light that did not move and whose casters did not move keeps
+// its tile and is not rendered again, so only lights that changed cost a
+// pass. Tiles only shrink once they are four times larger than wanted, so
+// lights hovering around a size do not re-render every frame.
+struct ShadowAtlas {
+	ShadowAtlasSettings settings;
+	// State of every quadtree node, the root first, then each level's nodes
+	// row by row.
+	std::vector<uint8_t> nodes;
+	uint32_t levels{};
+	// Indexed like the lights of the last update.
+	std::vector<ShadowAtlasLight> lights;
+	// Lights to render this frame, by index, filled by every update.
+	std::vector<uint32_t> renders;
+};
+
+auto create_shadow_atlas(const ShadowAtlasSettings& settings) -> ShadowAtlas;
+
+// Fits tiles to the frame's lights and fills atlas.renders with the ones to
+// render, each with its transform into its tile. lights are indexed like the
+// previous update's, a light whose index was dropped frees its tile.
+// view_projection takes world space to the camera's clip space.
+void update_shadow_atlas(
+		ShadowAtlas& atlas,
+		std::span<const Light> lights,
+		const glm::mat4& view_projection);
+
+// Re-renders the tiles of lights whose spheres the sphere at center touches,
+// for when a caster within it moved.
+void invalidate_shadow_atlas(
+		ShadowAtlas& atlas,
+		glm::vec3 center,
+		float radius);
+
+// What the SHADOWS variant of shader.frag reads of a light's tile, in the
+// frame's buffer of them. Layout matches the ShadowTileList block in
+// shader.frag.
+struct ShadowAtlasTileView {
+	// ShadowAtlasLight::atlas_transform.
+	glm::mat4 transform{1.0F};
+	// World space size of a texel at unit distance from the light, which
+	// lookups offset the surface along its normal by.
+	float texel_scale{};
+	// Nonzero while the tile holds the light's map.
+	uint32_t valid{};
+	std::array<uint32_t, 2> padding{};
+};
+static_assert(sizeof(ShadowAtlasTileView) == 80);
+
+struct ShadowAtlasFrame {
+	Buffer tiles;
+	BindlessHandle tiles_handle{};
+};
+
+// The atlas's depth image, whose tiles the frame's passes render with
+// add_shadow_atlas_pass. It is kept in SHADER_READ_ONLY_OPTIMAL between
+// frames like the cascades, and sampled with their comparison sampler.
+struct ShadowAtlasMaps {
+	ShadowAtlas atlas;
+	Image image;
+	VkImageView view{};
+	BindlessHandle handle{};
+	uint32_t light_capacity{};
+	std::vector<ShadowAtlasFrame> frames;
+	// Whether the image was imported before, its layout is undefined until
+	// then.
+	bool imported{};
+};
+
+// Creates the atlas with create_shadow_atlas, and the image and a tile
+// buffer per frame for light_capacity lights.
+auto create_shadow_atlas_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		const ShadowAtlasSettings& settings,
+		uint32_t light_capacity,
+		size_t frame_count) -> ShadowAtlasMaps;
+// The device must be idle.
+void destroy_shadow_atlas_maps(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		ShadowAtlasMaps& maps);
+
+// Fits the tiles with update_shadow_atlas and writes the frame's tiles,
+// after the frame fence was waited on. Without render the tiles stay as they
+// were and atlas.renders is left empty, for frames that cannot draw them.
+void update_shadow_atlas_maps(
+		ShadowAtlasMaps& maps,
+		size_t frame_idx,
+		std::span<const Light> lights,
+		const glm::mat4& view_projection,
+		bool render);
+
+// What update_shadow_maps passes on to shader.frag.
+auto shadow_atlas_handles(const ShadowAtlasMaps& maps, size_t frame_idx)
+		-> ShadowAtlasHandles;
+
+// Imports the image into the frame's graph, the passes shading with it read
+// the resource with g_shadow_read.
+auto import_shadow_atlas_maps(RenderGraph& graph, ShadowAtlasMaps& maps)
+		-> uint32_t;
+
+// Adds the pass rendering the tile of light, one of atlas.renders, which
+// draw records into with the light's transform. Only the tile is cleared and
+// stored, draw sets the viewport and scissor to it.
+void add_shadow_atlas_pass(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		const ShadowAtlasMaps& maps,
+		uint32_t image,
+		uint32_t light,
+		GraphRecord draw);
@@ -0,0 +1,187 @@
+#include "simulation.hpp"
+
+#include "huge_pages.hpp"
+#include "instrument.hpp"
+#include "stress_scene.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <span>
+#include <utility>
+
+namespace {
+
+constexpr auto g_snapshot_slot_mask = uint32_t{3};
+constexpr auto g_snapshot_fresh = uint32_t{4};
+constexpr auto g_snapshot_stopping = uint32_t{8};
+// Steps taken at once to catch up at most. A simulation further behind
+// drops the time it is missing rather than spending ever longer catching up.
+constexpr auto g_max_catch_up_steps = size_t{4};
+
+void simulate_step(Simulation& simulation, FrameSnapshot& snapshot) {
+	VKDEMO_ZONE("simulate");
+	snapshot.camera =
+			stress_scene_camera(simulation.stress_scene, snapshot.step);
+	if (simulation.pager != nullptr) {
+		update_scene_pager(*simulation.pager, snapshot.camera);
+		copy_paged_instances(*simulation.pager, snapshot.world);
+	} else {
+		// The world transforms are all rewritten, so the snapshot's array
+		// serves as the next one and nothing is copied.
+		update_scene_transforms(simulation.scene);
+		std::swap(simulation.scene.world, snapshot.world);
+	}
+	clear_bounding_spheres(snapshot.bounds);
+	if (snapshot.world.empty()) {
+		add_bounding_sphere(snapshot.bounds, simulation.bounding_sphere);
+	}
+	for (const auto& instance : snapshot.world) {
+		add_bounding_sphere(
+				snapshot.bounds,
+				instance_bounding_sphere(instance, simulation.bounding_sphere));
+	}
+}
+
+// Hands the simulated slot to the loop, false once it shuts down.
+auto publish_snapshot(Simulation& simulation) -> bool {
+	auto previous = simulation.handoff.load(std::memory_order_relaxed);
+	do {
+		if ((previous & g_snapshot_stopping) != 0) {
+			return false;
+		}
+	} while (!simulation.handoff.compare_exchange_weak(
+			previous,
+			simulation.simulating | g_snapshot_fresh,
+			std::memory_order_acq_rel));
+	simulation.handoff.notify_one();
+	// Either the slot the loop gave back or a snapshot it never took.
+	simulation.simulating = previous & g_snapshot_slot_mask;
+	return true;
+}
+
+auto stopping(const Simulation& simulation) -> bool {
+	return (simulation.handoff.load(std::memory_order_acquire) &
+					g_snapshot_stopping) != 0;
+}
+
+void run_lockstep(Simulation& simulation) {
+	for (auto step = size_t{};; step++) {
+		auto& snapshot = simulation.snapshots.at(simulation.simulating);
+		snapshot.step = step;
+		simulate_step(simulation, snapshot);
+		if (!publish_snapshot(simulation)) {
+			return;
+		}
+		// One frame ahead and no further.
+		auto current = simulation.handoff.load(std::memory_order_acquire);
+		while ((current & g_snapshot_fresh) != 0 &&
+				(current & g_snapshot_stopping) == 0) {
+			simulation.handoff.wait(current, std::memory_order_acquire);
+			current = simulation.handoff.load(std::memory_order_acquire);
+		}
+		if ((current & g_snapshot_stopping) != 0) {
+			return;
+		}
+	}
+}
+
+void run_fixed_steps(Simulation& simulation) {
+	auto due = std::chrono::steady_clock::now();
+	auto step = size_t{};
+	auto camera = stress_scene_camera(simulation.stress_scene, 0);
+	while (!stopping(simulation)) {
+		auto now = std::chrono::steady_clock::now();
+		auto steps = size_t{};
+		while (due <= now && steps < g_max_catch_up_steps) {
+			auto& snapshot = simulation.snapshots.at(simulation.simulating);
+			snapshot.step = step++;
+			snapshot.time = due;
+			snapshot.previous_camera = camera;
+			simulate_step(simulation, snapshot);
+			camera = snapshot.camera;
+			due += simulation.step;
+			steps++;
+		}
+		if (due <= now) {
+			due = now + simulation.step;
+		}
+		if (steps != 0 && !publish_snapshot(simulation)) {
+			return;
+		}
+		std::this_thread::sleep_until(due);
+	}
+}
+
+}  // namespace
+
+auto create_simulation(
+		StressScene stress_scene,
+		Scene scene,
+		ScenePager* pager,
+		glm::vec4 bounding_sphere,
+		size_t step_rate) -> std::unique_ptr<Simulation> {
+	auto simulation = std::make_unique<Simulation>();
+	simulation->stress_scene = stress_scene;
+	simulation->pager = pager;
+	simulation->bounding_sphere = bounding_sphere;
+	if (step_rate != 0) {
+		simulation->step =
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+						std::chrono::duration<double>(
+								1.0 / static_cast<double>(step_rate)));
+	}
+	auto instance_count = pager != nullptr ? paged_instance_count(*pager)
+																				 : scene.world.size();
+	for (auto& snapshot : simulation->snapshots) {
+		snapshot.world.resize(instance_count);
+		advise_huge_pages(std::as_writable_bytes(std::span(snapshot.world)));
+	}
+	simulation->scene = std::move(scene);
+	simulation->thread = std::thread(
+			step_rate == 0 ? run_lockstep : run_fixed_steps,
+			std::ref(*simulation));
+	return simulation;
+}
+
+void destroy_simulation(Simulation& simulation) {
+	simulation.handoff.fetch_or(g_snapshot_stopping, std::memory_order_release);
+	simulation.handoff.notify_one();
+	simulation.thread.join();
+}
+
+auto acquire_frame_snapshot(Simulation& simulation) -> const FrameSnapshot& {
+	VKDEMO_ZONE("acquire_frame_snapshot");
+	auto current = simulation.handoff.load(std::memory_order_acquire);
+	auto lockstep = simulation.step == std::chrono::steady_clock::duration{};
+	if ((current & g_snapshot_fresh) == 0 && !lockstep &&
+			simulation.rendered) {
+		return simulation.snapshots.at(simulation.rendering);
+	}
+	while ((current & g_snapshot_fresh) == 0) {
+		simulation.handoff.wait(current, std::memory_order_acquire);
+		current = simulation.handoff.load(std::memory_order_acquire);
+	}
+	auto previous = simulation.handoff.exchange(
+			simulation.rendering,
+			std::memory_order_acq_rel);
+	simulation.handoff.notify_one();
+	simulation.rendering = previous & g_snapshot_slot_mask;
+	simulation.rendered = true;
+	return simulation.snapshots.at(simulation.rendering);
+}
+
+auto interpolate_camera(
+		const Simulation& simulation,
+		const FrameSnapshot& snapshot,
+		std::chrono::steady_clock::time_point now) -> glm::mat4 {
+	if (simulation.step == std::chrono::steady_clock::duration{}) {
+		return snapshot.camera;
+	}
+	auto along = std::clamp(
+			std::chrono::duration<float>(now - snapshot.time) /
+					std::chrono::duration<float>(simulation.step),
+			0.0F,
+			1.0F);
+	return snapshot.previous_camera +
+			(snapshot.camera - snapshot.previous_camera) * along;
+}
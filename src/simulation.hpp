@@ -0,0 +1,93 @@
+#pragma once
+
+#include "config.hpp"
+#include "culling.hpp"
+#include "instancing.hpp"
+#include "scene.hpp"
+#include "scene_paging.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Snapshots in the ring: one being simulated, one being rendered and the
+// newest finished one between them, so neither side waits on a slot.
+constexpr auto g_frame_snapshot_count = size_t{3};
+
+// Everything the frame loop takes from the simulation for one frame. It is
+// not touched again until the loop asks for the next one.
+struct FrameSnapshot {
+	// Steps simulated before this one.
+	size_t step{};
+	// When the step is due, on the steady clock. Unused in lockstep.
+	std::chrono::steady_clock::time_point time;
+	// From the scene's space to clip space, at this step and the one before.
+	glm::mat4 camera{1.0F};
+	glm::mat4 previous_camera{1.0F};
+	// World transforms of the instanced copies, empty without instancing.
+	// The entities do not move, so they need no interpolation.
+	std::vector<InstanceTransform> world;
+	// One per instanced copy, or the mesh's own without instancing.
+	BoundingSpheres bounds;
+};
+
+// Simulates on a thread of its own so updating the scene overlaps with
+// recording frames. With a step rate the simulation takes fixed steps on
+// the steady clock whatever the frame rate, and the frame loop interpolates
+// between the last two. Without one it runs in lockstep instead, one step
+// per frame and one frame ahead, which keeps every frame's snapshot and the
+// runs reproducible.
+struct Simulation {
+	StressScene stress_scene{};
+	// Owned by the thread, empty without instancing.
+	Scene scene;
+	// Updated by the thread instead of the scene when the instances are
+	// paged, null otherwise.
+	ScenePager* pager{};
+	glm::vec4 bounding_sphere{};
+	// Zero in lockstep.
+	std::chrono::steady_clock::duration step{};
+	std::array<FrameSnapshot, g_frame_snapshot_count> snapshots;
+	// The newest finished slot in the low bits, with a flag while the loop did
+	// not take it yet and one once the simulation shuts down.
+	std::atomic<uint32_t> handoff{};
+	// Owned by either side.
+	uint32_t simulating{1};
+	uint32_t rendering{2};
+	// Whether the loop holds a snapshot yet.
+	bool rendered{};
+	std::thread thread;
+};
+
+// Instances of the mesh are the entities of scene, without instancing scene
+// is empty and the mesh is drawn once. A pager replaces the scene's entities
+// with its slots, paged in around each step's camera, and must outlive the
+// simulation. Zero step_rate runs in lockstep, otherwise it is in steps per
+// second.
+auto create_simulation(
+		StressScene stress_scene,
+		Scene scene,
+		ScenePager* pager,
+		glm::vec4 bounding_sphere,
+		size_t step_rate) -> std::unique_ptr<Simulation>;
+void destroy_simulation(Simulation& simulation);
+
+// The newest snapshot, which stays valid until the next call. In lockstep
+// it waits for the next step, otherwise only for the first one and frames
+// that come quicker than steps draw the same snapshot again.
+auto acquire_frame_snapshot(Simulation& simulation) -> const FrameSnapshot&;
+// The camera between the snapshot's last two steps, as far along as now is
+// past the last step's due time, so frames show the simulation one step
+// late but moving smoothly at any frame rate.
+auto interpolate_camera(
+		const Simulation& simulation,
+		const FrameSnapshot& snapshot,
+		std::chrono::steady_clock::time_point now) -> glm::mat4;
@@ -0,0 +1,334 @@
+#include "skinning.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <numbers>
+#include <utility>
+
+namespace {
+
+// The twist of the top joint at its widest, in radians, and the seconds it
+// takes to swing back and forth, for the wave and the sway.
+constexpr auto g_skin_twist = 0.6F;
+constexpr auto g_skin_wave_period = 3.0F;
+constexpr auto g_skin_sway_period = 5.0F;
+// The seconds the skinner takes to fade from the wave to the sway and back.
+constexpr auto g_skin_fade_period = 8.0F;
+// Keys per period in the baked clip.
+constexpr auto g_skin_keys = 32U;
+
+// Layout matches the push_constant block in skinning.comp.
+struct SkinningHandles {
+	VkDeviceAddress rest{};
+	VkDeviceAddress skinned{};
+	uint32_t vertex_stride{};
+	uint32_t vertex_count{};
+	BindlessHandle skin{};
+	BindlessHandle joints{};
+};
+
+constexpr auto g_skin_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+auto motion_period(SkinMotion motion) -> float {
+	return motion == SkinMotion::wave ? g_skin_wave_period : g_skin_sway_period;
+}
+
+}  // namespace
+
+auto rig_mesh(
+		const MeshData& data,
+		glm::vec4 bounding_sphere,
+		uint32_t joint_count) -> SkinRig {
+	auto rig = SkinRig{
+			.bounding_sphere = bounding_sphere,
+			.joint_count = std::clamp(joint_count, 2U, g_max_skin_joints),
+			.vertices = {}};
+	rig.vertices.reserve(data.positions.size());
+	auto bottom = bounding_sphere.y - bounding_sphere.w;
+	auto height = std::max(2.0F * bounding_sphere.w, 1e-6F);
+	auto last = static_cast<float>(rig.joint_count - 1);
+	for (const auto& position : data.positions) {
+		auto along = std::clamp((position.y - bottom) / height, 0.0F, 1.0F) * last;
+		auto below = std::min(static_cast<uint32_t>(along), rig.joint_count - 2);
+		auto upper = static_cast<uint8_t>(
+				std::lround((along - static_cast<float>(below)) * 255.0F));
+		auto& vertex = rig.vertices.emplace_back();
+		vertex.joints.at(0) = static_cast<uint8_t>(below);
+		vertex.joints.at(1) = static_cast<uint8_t>(below + 1);
+		vertex.weights.at(0) = static_cast<uint8_t>(255 - upper);
+		vertex.weights.at(1) = upper;
+	}
+	return rig;
+}
+
+auto pose_skin_rig(const SkinRig& rig, SkinMotion motion, float seconds)
+		-> std::array<glm::mat4, g_max_skin_joints> {
+	auto joints = std::array<glm::mat4, g_max_skin_joints>{};
+	joints.fill(glm::mat4(1.0F));
+	auto center = glm::vec3(rig.bounding_sphere);
+	auto phase =
+			2.0F * std::numbers::pi_v<float> * seconds / motion_period(motion);
+	auto lag = motion == SkinMotion::wave ? std::numbers::pi_v<float> : 0.0F;
+	for (auto i = 0U; i < rig.joint_count; i++) {
+		// Higher joints twist further, and in a wave lag behind, so the twist
+		// travels up the chain.
+		auto along = static_cast<float>(i) /
+				static_cast<float>(rig.joint_count - 1);
+		auto angle = g_skin_twist * along * std::sin(phase - along * lag);
+		auto cosine = std::cos(angle);
+		auto sine = std::sin(angle);
+		auto& joint = joints.at(i);
+		joint[0] = glm::vec4(cosine, 0.0F, -sine, 0.0F);
+		joint[2] = glm::vec4(sine, 0.0F, cosine, 0.0F);
+		// About the vertical line through the center.
+		joint[3] = glm::vec4(center - glm::vec3(joint * glm::vec4(center, 0.0F)),
+				1.0F);
+	}
+	return joints;
+}
+
+auto bake_skin_clip(const SkinRig& rig, SkinMotion motion) -> AnimationClip {
+	auto center = glm::vec3(rig.bounding_sphere);
+	auto period = motion_period(motion);
+	auto rotations = std::vector<glm::quat>{};
+	auto translations = std::vector<glm::vec3>{};
+	for (auto key = 0U; key < g_skin_keys; key++) {
+		auto seconds =
+				period * static_cast<float>(key) / static_cast<float>(g_skin_keys);
+		auto joints = pose_skin_rig(rig, motion, seconds);
+		for (auto i = 0U; i < rig.joint_count; i++) {
+			const auto& joint = joints.at(i);
+			rotations.emplace_back(glm::quat_cast(glm::mat3(joint)));
+			auto moved = glm::vec3(joint * glm::vec4(center, 1.0F));
+			translations.emplace_back(moved - center);
+		}
+	}
+	return compress_clip(
+			rig.joint_count,
+			period,
+			rotations,
+			translations);
+}
+
+auto create_skinner(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		const Mesh& mesh,
+		SkinRig rig,
+		size_t frame_count) -> Skinner {
+	auto skinner = Skinner{};
+	skinner.vertex_count = static_cast<uint32_t>(rig.vertices.size());
+	skinner.vertex_stride = mesh.attribute_stride;
+	skinner.rig = std::move(rig);
+	skinner.wave = bake_skin_clip(skinner.rig, SkinMotion::wave);
+	skinner.sway = bake_skin_clip(skinner.rig, SkinMotion::sway);
+	skinner.poses = create_joint_poses(skinner.rig.joint_count);
+	skinner.sway_poses = create_joint_poses(skinner.rig.joint_count);
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(SkinningHandles)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&skinner.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create skinning pipeline layout\n");
+		std::terminate();
+	}
+	skinner.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			skinner.pipeline_layout,
+			module,
+			specialization,
+			0);
+
+	auto skin_data = std::as_bytes(std::span(skinner.rig.vertices));
+	skinner.skin = create_buffer(
+			device,
+			allocator,
+			skin_data.size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	skinner.skin_handle = add_bindless_buffer(
+			device,
+			bindless,
+			skinner.skin.handle,
+			0,
+			skin_data.size());
+	upload_buffer(
+			device,
+			uploader,
+			skinner.skin.handle,
+			0,
+			skin_data,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+	auto joints_size = VkDeviceSize{sizeof(glm::mat4)} * g_max_skin_joints;
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& joints = skinner.joints.emplace_back(create_dynamic_buffer(
+				device,
+				allocator,
+				joints_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT));
+		skinner.joint_handles.emplace_back(
+				add_bindless_buffer(device, bindless, joints.handle, 0, joints_size));
+	}
+	// Laid out like the mesh's positions, so the draws read them with its
+	// stride. Interleaved meshes leave the color halves unused.
+	auto output_size =
+			VkDeviceSize{skinner.vertex_stride} * skinner.vertex_count;
+	for (auto i = size_t{}; i < frame_count + 1; i++) {
+		auto& output = skinner.outputs.emplace_back(create_buffer(
+				device,
+				allocator,
+				output_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+						VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0));
+		skinner.output_addresses.emplace_back(
+				buffer_device_address(device, output));
+	}
+	skinner.written = skinner.outputs.size();
+	skinner.start = std::chrono::steady_clock::now();
+	return skinner;
+}
+
+void destroy_skinner(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		Skinner& skinner) {
+	for (auto i = size_t{}; i < skinner.joints.size(); i++) {
+		remove_bindless_buffer(device, bindless, skinner.joint_handles.at(i));
+		destroy_buffer(device, allocator, skinner.joints.at(i));
+	}
+	for (auto& output : skinner.outputs) {
+		destroy_buffer(device, allocator, output);
+	}
+	remove_bindless_buffer(device, bindless, skinner.skin_handle);
+	destroy_buffer(device, allocator, skinner.skin);
+	vkDestroyPipeline(device, skinner.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, skinner.pipeline_layout, host_callbacks());
+	skinner = Skinner{};
+}
+
+auto add_skinning_pass(
+		RenderGraph& graph,
+		Skinner& skinner,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		const Mesh& mesh) -> SkinnedPositions {
+	auto elapsed = std::chrono::steady_clock::now() - skinner.start;
+	auto seconds = std::chrono::duration<float>(elapsed).count();
+	sample_clip(skinner.wave, seconds, skinner.poses);
+	sample_clip(skinner.sway, seconds, skinner.sway_poses);
+	// A blend of twists is a twist, so the mesh stays in its bounds through
+	// the fade.
+	auto fade = 0.5F -
+			0.5F * std::cos(
+					2.0F * std::numbers::pi_v<float> * seconds / g_skin_fade_period);
+	blend_poses(skinner.poses, skinner.sway_poses, fade, skinner.poses);
+	auto joints = std::array<glm::mat4, g_max_skin_joints>{};
+	joints.fill(glm::mat4(1.0F));
+	pose_matrices(skinner.poses, joints);
+	// Back from about the center to object space.
+	auto center = glm::vec3(skinner.rig.bounding_sphere);
+	for (auto i = 0U; i < skinner.rig.joint_count; i++) {
+		auto& joint = joints.at(i);
+		joint[3] += glm::vec4(center - glm::mat3(joint) * center, 0.0F);
+	}
+	std::memcpy(
+			skinner.joints.at(frame_idx).allocation.mapped,
+			joints.data(),
+			sizeof(joints));
+
+	// The first frame has nothing before it, so it does not move.
+	auto previous = skinner.written;
+	auto slot = (skinner.written + 1) % skinner.outputs.size();
+	if (previous == skinner.outputs.size()) {
+		slot = 0;
+		previous = 0;
+	}
+	skinner.written = slot;
+	auto output = import_graph_buffer(
+			graph,
+			skinner.outputs.at(slot).handle,
+			GraphState{},
+			std::nullopt);
+	auto pass = add_graph_pass(
+			graph,
+			"skinning",
+			[&skinner, &bindless, &mesh, slot, frame_idx](
+					VkCommandBuffer command_buffer) {
+				vkCmdBindPipeline(
+						command_buffer,
+						VK_PIPELINE_BIND_POINT_COMPUTE,
+						skinner.pipeline);
+				bind_bindless_table(
+						command_buffer,
+						VK_PIPELINE_BIND_POINT_COMPUTE,
+						skinner.pipeline_layout,
+						bindless);
+				// Read when recorded, since defragmenting may move the mesh.
+				auto handles = SkinningHandles{
+						.rest = mesh.attribute_addresses.at(0),
+						.skinned = skinner.output_addresses.at(slot),
+						.vertex_stride = skinner.vertex_stride,
+						.vertex_count = skinner.vertex_count,
+						.skin = skinner.skin_handle,
+						.joints = skinner.joint_handles.at(frame_idx)};
+				vkCmdPushConstants(
+						command_buffer,
+						skinner.pipeline_layout,
+						VK_SHADER_STAGE_COMPUTE_BIT,
+						0,
+						sizeof(handles),
+						&handles);
+				vkCmdDispatch(
+						command_buffer,
+						(skinner.vertex_count + g_skinning_group_size - 1) /
+								g_skinning_group_size,
+						1,
+						1);
+			},
+			false);
+	graph_write(graph, pass, output, g_skin_write);
+	return SkinnedPositions{
+			.positions = skinner.output_addresses.at(slot),
+			.previous_positions = skinner.output_addresses.at(previous),
+			.resource = output};
+}
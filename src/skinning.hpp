@@ -0,0 +1,141 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "animation.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "mesh.hpp"
+#include "render_graph.hpp"
+#include "upload.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Matches local_size_x in skinning.comp.
+constexpr auto g_skinning_group_size = 64U;
+// Joints a rig can have, and joints a vertex blends.
+constexpr auto g_max_skin_joints = 16U;
+constexpr auto g_skin_influences = 4U;
+
+// Layout matches the SkinList block in skinning.comp: joint indices, and
+// 8-bit unorm weights that add up to 255.
+struct SkinVertex {
+	std::array<uint8_t, g_skin_influences> joints{};
+	std::array<uint8_t, g_skin_influences> weights{};
+};
+static_assert(sizeof(SkinVertex) == 8);
+
+// A chain of joints up the y axis of a mesh's bounding sphere, each twisting
+// what is around it about the vertical line through the center, more the
+// higher it is. A twist keeps every vertex at its height and distance from
+// that line, and blends of twists lie between them, so the skinned mesh
+// stays inside the rest pose's bounding sphere and culls like it.
+struct SkinRig {
+	glm::vec4 bounding_sphere{};
+	uint32_t joint_count{};
+	// One per vertex of the mesh.
+	std::vector<SkinVertex> vertices;
+};
+
+// How the rig twists: wave sends the twist up the chain, each joint lagging
+// the one below, and sway turns the whole chain together, more slowly.
+enum class SkinMotion : uint8_t {
+	wave,
+	sway,
+};
+
+// Weights each vertex of data between the two joints nearest its height.
+// joint_count is clamped to [2, g_max_skin_joints].
+auto rig_mesh(
+		const MeshData& data,
+		glm::vec4 bounding_sphere,
+		uint32_t joint_count) -> SkinRig;
+// Object space transforms of the joints seconds into the motion, the first
+// joint_count of them used.
+auto pose_skin_rig(const SkinRig& rig, SkinMotion motion, float seconds)
+		-> std::array<glm::mat4, g_max_skin_joints>;
+// One period of pose_skin_rig as a clip, relative to the bounding sphere's
+// center. The twists have no translation there, so the sampled poses stay
+// twists between keys.
+auto bake_skin_clip(const SkinRig& rig, SkinMotion motion) -> AnimationClip;
+
+// Where the frame's draws read their positions: what the frame's skinning
+// pass writes, and what the frame before's did for the motion vectors.
+// resource is the graph buffer of positions that the passes reading them
+// declare.
+struct SkinnedPositions {
+	VkDeviceAddress positions{};
+	VkDeviceAddress previous_positions{};
+	uint32_t resource{};
+};
+
+// Skinning in a compute pass rather than in every vertex shader: once a
+// frame the rig's wave and sway clips are sampled and blended, and the
+// mesh's rest positions are blended by the posed joints into a ring of
+// position buffers laid out like the mesh's, which the depth pre-pass,
+// shading, motion vectors and lines all read in place of the mesh's. The
+// ring has a buffer more than there are frames in flight, so the one the
+// frame before wrote is still there for the motion vectors while the next
+// frame writes another.
+struct Skinner {
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	SkinRig rig;
+	AnimationClip wave;
+	AnimationClip sway;
+	// The wave's poses, blended towards the sway's.
+	JointPoses poses;
+	JointPoses sway_poses;
+	uint32_t vertex_count{};
+	uint32_t vertex_stride{};
+	Buffer skin;
+	BindlessHandle skin_handle{};
+	// The posed joints, one set for every frame in flight.
+	std::vector<Buffer> joints;
+	std::vector<BindlessHandle> joint_handles;
+	std::vector<Buffer> outputs;
+	std::vector<VkDeviceAddress> output_addresses;
+	// The output written last, outputs.size() before the first frame.
+	size_t written{};
+	std::chrono::steady_clock::time_point start;
+};
+
+// module is skinning.comp, whose bindless arrays are sized by specialization.
+// mesh must be pulled and not quantized, its vertices are what rig was made
+// for. Needs a device_address allocator.
+auto create_skinner(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		const Mesh& mesh,
+		SkinRig rig,
+		size_t frame_count) -> Skinner;
+// The device must be idle.
+void destroy_skinner(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		Skinner& skinner);
+
+// Samples the rig's clips for now, fading between them, and adds the pass
+// skinning mesh into the next output, after the frame fence was waited on.
+// The positions are written by COMPUTE_SHADER, the passes drawing with them
+// read the resource. The one the frame before wrote was made visible to its
+// readers then, which covers this frame's reads of it.
+auto add_skinning_pass(
+		RenderGraph& graph,
+		Skinner& skinner,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		const Mesh& mesh) -> SkinnedPositions;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Values for the specialization constants of a shader stage, laid out the way
+// VkSpecializationInfo wants them. The Nth value is constant_id N. Booleans
+// must be passed as VkBool32, since that is what SPIR-V bools are sized as.
+template <typename... Values>
+struct SpecializationConstants {
+	std::array<VkSpecializationMapEntry, sizeof...(Values)> entries{};
+	std::array<std::byte, (sizeof(Values) + ... + 0)> data{};
+};
+
+template <typename... Values>
+constexpr auto make_specialization_constants(Values... values)
+		-> SpecializationConstants<Values...> {
+	static_assert(
+			((std::is_arithmetic_v<Values> && !std::is_same_v<Values, bool> &&
+				(sizeof(Values) == 4 || sizeof(Values) == 8)) &&
+			 ...),
+			"Specialization constants are 32 or 64 bit scalars");
+	auto constants = SpecializationConstants<Values...>{};
+	auto id = uint32_t{};
+	auto offset = size_t{};
+	auto add = [&](auto value) {
+		auto bytes = std::bit_cast<std::array<std::byte, sizeof(value)>>(value);
+		constants.entries.at(id) = VkSpecializationMapEntry{
+				.constantID = id,
+				.offset = static_cast<uint32_t>(offset),
+				.size = sizeof(value)};
+		for (auto byte : bytes) {
+			constants.data.at(offset++) = byte;
+		}
+		id++;
+	};
+	(add(values), ...);
+	return constants;
+}
+
+// The returned info points into constants, which must outlive pipeline
+// creation.
+template <typename... Values>
+auto specialization_info(const SpecializationConstants<Values...>& constants)
+		-> VkSpecializationInfo {
+	return {
+			.mapEntryCount = static_cast<uint32_t>(constants.entries.size()),
+			.pMapEntries = constants.entries.data(),
+			.dataSize = constants.data.size(),
+			.pData = constants.data.data()};
+}
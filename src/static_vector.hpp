@@ -0,0 +1,69 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <span>
+#include <utility>
+
+// A vector with its elements stored inline, for the short arrays Vulkan info
+// structs point at, so building them never allocates. Capacities cover
+// everything the code can add, running out of room terminates. Elements never
+// move while the vector lives, so pointers to them stay valid as it grows.
+template <typename T, size_t Capacity>
+struct StaticVector {
+	std::array<T, Capacity> items{};
+	size_t count{};
+
+	auto emplace_back(T item) -> T& {
+		if (count == Capacity) {
+			fmt::print(stderr, "StaticVector capacity of {} exceeded\n", Capacity);
+			std::terminate();
+		}
+		items[count] = std::move(item);
+		return items[count++];
+	}
+	void assign(std::span<const T> source) {
+		clear();
+		for (const auto& item : source) {
+			emplace_back(item);
+		}
+	}
+	void clear() {
+		count = 0;
+	}
+
+	[[nodiscard]] auto size() const -> size_t {
+		return count;
+	}
+	[[nodiscard]] auto empty() const -> bool {
+		return count == 0;
+	}
+	[[nodiscard]] auto data() -> T* {
+		return items.data();
+	}
+	[[nodiscard]] auto data() const -> const T* {
+		return items.data();
+	}
+	auto operator[](size_t idx) -> T& {
+		return items[idx];
+	}
+	auto operator[](size_t idx) const -> const T& {
+		return items[idx];
+	}
+	[[nodiscard]] auto begin() -> T* {
+		return items.data();
+	}
+	[[nodiscard]] auto begin() const -> const T* {
+		return items.data();
+	}
+	[[nodiscard]] auto end() -> T* {
+		return items.data() + count;
+	}
+	[[nodiscard]] auto end() const -> const T* {
+		return items.data() + count;
+	}
+};
@@ -0,0 +1,132 @@
+#include "stereo.hpp"
+
+#include <algorithm>
+#include <array>
+
+auto stereo_eye_extent(VkExtent2D target_extent) -> VkExtent2D {
+	return VkExtent2D{
+			.width = std::max(target_extent.width / g_stereo_views, 1U),
+			.height = target_extent.height};
+}
+
+void resize_stereo_target(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		StereoTarget& stereo,
+		VkFormat color_format,
+		VkFormat depth_format,
+		VkSampleCountFlagBits samples,
+		VkExtent2D target_extent) {
+	auto eye_extent = stereo_eye_extent(target_extent);
+	if (eye_extent.width == stereo.eye_extent.width &&
+			eye_extent.height == stereo.eye_extent.height) {
+		return;
+	}
+	if (stereo.attachments.depth.image.handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device, &allocator, attachments = stereo.attachments]() mutable {
+					destroy_scene_attachments(device, allocator, attachments);
+				});
+	}
+	stereo.eye_extent = eye_extent;
+	stereo.attachments = create_scene_attachments(
+			device,
+			allocator,
+			color_format,
+			depth_format,
+			eye_extent,
+			samples,
+			g_stereo_views,
+			0);
+}
+
+void destroy_stereo_target(
+		VkDevice& device,
+		Allocator& allocator,
+		StereoTarget& stereo) {
+	destroy_scene_attachments(device, allocator, stereo.attachments);
+	stereo = StereoTarget{};
+}
+
+auto stereo_draw_uniforms(const glm::mat4& transform) -> DrawUniforms {
+	// Within the frustum z / w is between 0 and 1, so neither eye moves x / w
+	// by more than this.
+	auto parallax = g_stereo_separation *
+			std::max(g_stereo_convergence, 1.0F - g_stereo_convergence);
+	auto widening = 1.0F + parallax;
+	auto narrowed = glm::mat4(1.0F);
+	narrowed[0][0] = 1.0F / widening;
+	auto uniforms = DrawUniforms{};
+	uniforms.transform = narrowed * transform;
+	uniforms.jitter =
+			glm::vec4(widening, g_stereo_separation, g_stereo_convergence, 0.0F);
+	return uniforms;
+}
+
+void add_stereo_copy(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t target,
+		VkExtent2D eye_extent) {
+	auto record = [&graph, &profiler, frame_idx, scene, target, eye_extent](
+			VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "stereo");
+		auto regions = std::array<VkImageCopy, g_stereo_views>{};
+		for (auto eye = 0U; eye < g_stereo_views; eye++) {
+			regions.at(eye) = VkImageCopy{
+					.srcSubresource =
+							VkImageSubresourceLayers{
+									.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+									.mipLevel = 0,
+									.baseArrayLayer = eye,
+									.layerCount = 1},
+					.srcOffset = VkOffset3D{},
+					.dstSubresource =
+							VkImageSubresourceLayers{
+									.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+									.mipLevel = 0,
+									.baseArrayLayer = 0,
+									.layerCount = 1},
+					.dstOffset =
+							VkOffset3D{
+									.x = static_cast<int32_t>(eye * eye_extent.width),
+									.y = 0,
+									.z = 0},
+					.extent = VkExtent3D{
+							.width = eye_extent.width,
+							.height = eye_extent.height,
+							.depth = 1}};
+		}
+		vkCmdCopyImage(
+				command_buffer,
+				graph_image(graph, scene),
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				graph_image(graph, target),
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(regions.size()),
+				regions.data());
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "stereo", record, false);
+	graph_read(
+			graph,
+			pass,
+			scene,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.access = VK_ACCESS_2_TRANSFER_READ_BIT,
+					.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL});
+	graph_write(
+			graph,
+			pass,
+			target,
+			GraphState{
+					.stages = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.access = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL});
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "attachments.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "uniforms.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// One view per eye, the left eye's in layer 0.
+constexpr auto g_stereo_views = 2U;
+constexpr auto g_stereo_view_mask = (1U << g_stereo_views) - 1U;
+// How far apart the eyes see a surface, in clip space x per unit of depth
+// away from the convergence depth, where both see it in the same place.
+constexpr auto g_stereo_separation = 0.04F;
+constexpr auto g_stereo_convergence = 0.5F;
+
+// Side by side stereo for head mounted displays. Both eyes are drawn by one
+// VK_KHR_multiview pass with a view per eye, so the draws are culled and
+// recorded once and the STEREO variant of shader.vert moves each view's
+// vertices by gl_ViewIndex. The eyes are the layers of a scene target half
+// the output's width, copied next to each other into the output. The depth
+// and MSAA attachments have a layer per eye as well, so they are kept here
+// instead of with the swap chain.
+struct StereoTarget {
+	SceneAttachments attachments;
+	// Of each eye's layer.
+	VkExtent2D eye_extent{};
+};
+
+// Half of the output's width, with an odd column left out.
+auto stereo_eye_extent(VkExtent2D target_extent) -> VkExtent2D;
+// Recreates the attachments when the target's extent changed, the old ones
+// are destroyed once the frames using them are done.
+void resize_stereo_target(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		StereoTarget& stereo,
+		VkFormat color_format,
+		VkFormat depth_format,
+		VkSampleCountFlagBits samples,
+		VkExtent2D target_extent);
+// The device must be idle.
+void destroy_stereo_target(
+		VkDevice& device,
+		Allocator& allocator,
+		StereoTarget& stereo);
+
+// The constants both eyes draw transform with. The transform is narrowed in
+// x until its frustum holds both eyes', so culling against it once serves
+// both. jitter holds what the STEREO variant of shader.vert widens it back
+// by, the separation and the convergence depth.
+auto stereo_draw_uniforms(const glm::mat4& transform) -> DrawUniforms;
+
+// Adds the pass copying the eyes of scene, g_stereo_views layers of
+// eye_extent, to the left and right halves of target. Both must be in the
+// same format, scene allowing copies from and target to.
+void add_stereo_copy(
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t target,
+		VkExtent2D eye_extent);
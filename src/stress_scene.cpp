@@ -0,0 +1,153 @@
+#include "stress_scene.hpp"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// Frames the camera takes around its loop.
+constexpr auto g_camera_loop_frames = size_t{600};
+constexpr auto g_streaming_zoom = 8.0F;
+constexpr auto g_scene_zoom = 1.25F;
+constexpr auto g_unique_mesh_count = uint32_t{10000};
+constexpr auto g_unique_mesh_grid = uint32_t{100};
+
+// Spreads the bits of an index so neighbouring meshes differ.
+auto hash_index(uint32_t idx) -> uint32_t {
+	idx ^= idx >> 16U;
+	idx *= 0x7feb352dU;
+	idx ^= idx >> 15U;
+	idx *= 0x846ca68bU;
+	idx ^= idx >> 16U;
+	return idx;
+}
+
+auto unit_float(uint32_t bits) -> float {
+	return static_cast<float>(bits & 0xffffU) / 65535.0F;
+}
+
+// A cube in front of the far plane like the triangle, with one color per
+// face.
+auto cube_mesh() -> MeshData {
+	auto data = MeshData{};
+	constexpr auto half = 0.25F;
+	const auto center = glm::vec3{0.0F, 0.0F, 0.5F};
+	for (auto axis = 0; axis < 3; axis++) {
+		for (auto side = -1; side <= 1; side += 2) {
+			auto normal = glm::vec3{};
+			normal[axis] = static_cast<float>(side);
+			auto u = glm::vec3{};
+			u[(axis + 1) % 3] = 1.0F;
+			auto v = glm::vec3{};
+			v[(axis + 2) % 3] = static_cast<float>(side);
+			auto color = glm::vec3{0.25F};
+			color[axis] = side > 0 ? 1.0F : 0.6F;
+			auto first = static_cast<uint32_t>(data.positions.size());
+			for (auto corner : std::array<glm::vec2, 4>{
+							 glm::vec2{-1.0F, -1.0F},
+							 glm::vec2{1.0F, -1.0F},
+							 glm::vec2{1.0F, 1.0F},
+							 glm::vec2{-1.0F, 1.0F}}) {
+				data.positions.emplace_back(
+						center + half * (normal + corner.x * u + corner.y * v));
+				data.colors.emplace_back(color);
+			}
+			for (auto idx : {0U, 1U, 2U, 0U, 2U, 3U}) {
+				data.indices.emplace_back(first + idx);
+			}
+		}
+	}
+	return data;
+}
+
+// Polygons of 3 to 8 sides with their own size, turn and colors, one to a
+// cell of a grid over the view.
+auto unique_meshes() -> MeshData {
+	auto data = MeshData{};
+	auto cell = 2.0F / static_cast<float>(g_unique_mesh_grid);
+	for (auto i = 0U; i < g_unique_mesh_count; i++) {
+		auto bits = hash_index(i);
+		auto sides = 3U + bits % 6U;
+		auto radius = cell * (0.2F + 0.3F * unit_float(bits >> 3U));
+		auto turn = glm::two_pi<float>() * unit_float(bits >> 9U);
+		auto center = glm::vec3(
+				-1.0F + cell * (static_cast<float>(i % g_unique_mesh_grid) + 0.5F),
+				-1.0F + cell * (static_cast<float>(i / g_unique_mesh_grid) + 0.5F),
+				0.5F);
+		auto color = glm::vec3(
+				unit_float(bits),
+				unit_float(bits >> 8U),
+				unit_float(bits >> 16U));
+		auto first = static_cast<uint32_t>(data.positions.size());
+		data.positions.emplace_back(center);
+		data.colors.emplace_back(color);
+		for (auto side = 0U; side < sides; side++) {
+			auto angle = turn +
+					glm::two_pi<float>() * static_cast<float>(side) /
+							static_cast<float>(sides);
+			data.positions.emplace_back(
+					center +
+					radius * glm::vec3(std::cos(angle), std::sin(angle), 0.0F));
+			data.colors.emplace_back(color * (0.5F + 0.5F * std::cos(angle)));
+			data.indices.emplace_back(first);
+			data.indices.emplace_back(first + 1 + side);
+			data.indices.emplace_back(first + 1 + (side + 1) % sides);
+		}
+	}
+	return data;
+}
+
+// A plane covering the view, for the lights to shade every pixel.
+auto plane_mesh() -> MeshData {
+	auto data = MeshData{};
+	data.positions = {
+			glm::vec3{-1.0F, -1.0F, 0.5F},
+			glm::vec3{1.0F, -1.0F, 0.5F},
+			glm::vec3{1.0F, 1.0F, 0.5F},
+			glm::vec3{-1.0F, 1.0F, 0.5F}};
+	data.colors.assign(4, glm::vec3{0.5F});
+	data.indices = {0, 1, 2, 0, 2, 3};
+	return data;
+}
+
+}  // namespace
+
+auto stress_scene_mesh(StressScene scene) -> std::optional<MeshData> {
+	switch (scene) {
+		case StressScene::cubes:
+			return cube_mesh();
+		case StressScene::meshes:
+			return unique_meshes();
+		case StressScene::lights:
+		case StressScene::overdraw:
+			return plane_mesh();
+		default:
+			return std::nullopt;
+	}
+}
+
+auto stress_scene_camera(StressScene scene, size_t frame) -> glm::mat4 {
+	if (scene == StressScene::none) {
+		return glm::mat4{1.0F};
+	}
+	auto angle = glm::two_pi<float>() *
+			static_cast<float>(frame % g_camera_loop_frames) /
+			static_cast<float>(g_camera_loop_frames);
+	auto max_zoom =
+			scene == StressScene::streaming ? g_streaming_zoom : g_scene_zoom;
+	auto zoom = 1.0F + (max_zoom - 1.0F) * 0.5F * (1.0F - std::cos(angle));
+	// Panned no further than keeps the view inside the scene at that zoom.
+	auto pan = (1.0F - 1.0F / zoom) *
+			glm::vec2(std::sin(angle), std::sin(2.0F * angle));
+	auto transform = glm::mat4{1.0F};
+	transform[0][0] = zoom;
+	transform[1][1] = zoom;
+	transform[3][0] = -zoom * pan.x;
+	transform[3][1] = -zoom * pan.y;
+	return transform;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "config.hpp"
+#include "mesh.hpp"
+
+#include <glm/mat4x4.hpp>
+
+#include <cstddef>
+#include <optional>
+
+// The geometry of a stress scene, generated the same on every run, or
+// nothing for scenes that draw the built-in triangle or --mesh. The unique
+// meshes of the meshes scene are merged into one, since the demo draws a
+// single mesh, so they stress geometry rather than draw calls.
+auto stress_scene_mesh(StressScene scene) -> std::optional<MeshData>;
+
+// Where the camera of the scene is at a frame, as a transform of the clip
+// space the scenes are laid out in. It pans and zooms along a loop of a few
+// seconds, deep into the texture for the streaming scene. Identity without a
+// scene.
+auto stress_scene_camera(StressScene scene, size_t frame) -> glm::mat4;
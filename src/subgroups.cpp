@@ -0,0 +1,25 @@
+#include "subgroups.hpp"
+
+auto query_subgroup_support(VkPhysicalDevice physical_device)
+		-> SubgroupSupport {
+	auto subgroup_properties = VkPhysicalDeviceSubgroupProperties{};
+	subgroup_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &subgroup_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	return SubgroupSupport{
+			.size = subgroup_properties.subgroupSize,
+			.stages = subgroup_properties.supportedStages,
+			.operations = subgroup_properties.supportedOperations};
+}
+
+auto has_subgroup_operations(
+		const SubgroupSupport& support,
+		VkShaderStageFlags stages,
+		VkSubgroupFeatureFlags operations) -> bool {
+	return support.size != 0 && (support.stages & stages) == stages &&
+			(support.operations & operations) == operations;
+}
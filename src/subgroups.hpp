@@ -0,0 +1,30 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstdint>
+
+// What shaders/subgroup.glsl needs, and with its workgroup reductions.
+constexpr auto g_subgroup_library_operations = VkSubgroupFeatureFlags{
+		VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT};
+constexpr auto g_subgroup_reduction_operations =
+		g_subgroup_library_operations | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+
+// The device's VkPhysicalDeviceSubgroupProperties, which shader variants
+// built on subgroup operations are picked by.
+struct SubgroupSupport {
+	// Invocations of a subgroup, 0 when the device reports none.
+	uint32_t size{};
+	VkShaderStageFlags stages{};
+	VkSubgroupFeatureFlags operations{};
+};
+
+// Needs features2.
+auto query_subgroup_support(VkPhysicalDevice physical_device)
+		-> SubgroupSupport;
+
+// Whether shaders of every stage in stages have every one of operations.
+auto has_subgroup_operations(
+		const SubgroupSupport& support,
+		VkShaderStageFlags stages,
+		VkSubgroupFeatureFlags operations) -> bool;
@@ -0,0 +1,222 @@
+#include "submit.hpp"
+
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+namespace {
+
+void submit_frame(
+		const SubmitThread& submit,
+		const std::vector<QueuedSubmission>& queued) {
+	VKDEMO_ZONE("submit_frame");
+	auto batch = std::vector<Submission>{};
+	auto first = queued.begin();
+	while (first != queued.end()) {
+		auto last = first;
+		while (last->fence == VK_NULL_HANDLE && last + 1 != queued.end() &&
+					 (last + 1)->queue == first->queue) {
+			last++;
+		}
+		batch.clear();
+		for (auto it = first; it != last + 1; it++) {
+			batch.emplace_back(Submission{
+					.command_buffers = it->command_buffers,
+					.waits = it->waits,
+					.signals = it->signals,
+					.device_mask = it->device_mask});
+		}
+		if (submit_batch(
+						submit.synchronization2,
+						first->queue,
+						batch,
+						last->fence) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to submit draw command buffer\n");
+			std::terminate();
+		}
+		first = last + 1;
+	}
+}
+
+void run_submit_thread(SubmitThread& submit) {
+	auto lock = std::unique_lock(submit.mutex);
+	while (true) {
+		submit.changed.wait(
+				lock,
+				[&submit] { return submit.stopping || !submit.tasks.empty(); });
+		if (submit.tasks.empty()) {
+			return;
+		}
+		auto task = std::move(submit.tasks.front());
+		submit.tasks.pop_front();
+		lock.unlock();
+		task();
+		lock.lock();
+		submit.pending--;
+		submit.finished++;
+		submit.changed.notify_all();
+	}
+}
+
+// Tasks run in the order queued, so a task is done once as many are
+// finished as were queued up to it.
+auto push_task(SubmitThread& submit, std::function<void()> task)
+		-> uint64_t {
+	auto ticket = uint64_t{};
+	{
+		auto lock = std::lock_guard(submit.mutex);
+		submit.tasks.emplace_back(std::move(task));
+		submit.pending++;
+		ticket = ++submit.queued;
+	}
+	submit.changed.notify_all();
+	return ticket;
+}
+
+}  // namespace
+
+auto create_submit_thread(bool synchronization2, FrameLimiter& limiter)
+		-> std::unique_ptr<SubmitThread> {
+	auto submit = std::make_unique<SubmitThread>();
+	submit->synchronization2 = synchronization2;
+	submit->limiter = &limiter;
+	submit->thread = std::thread(run_submit_thread, std::ref(*submit));
+	return submit;
+}
+
+void destroy_submit_thread(SubmitThread& submit) {
+	{
+		auto lock = std::lock_guard(submit.mutex);
+		submit.stopping = true;
+	}
+	submit.changed.notify_all();
+	submit.thread.join();
+}
+
+void queue_submissions(
+		SubmitThread& submit,
+		std::vector<QueuedSubmission> submissions) {
+	push_task(submit, [&submit, submissions = std::move(submissions)] {
+		submit_frame(submit, submissions);
+	});
+}
+
+void queue_present(SubmitThread& submit, PresentRequest request) {
+	push_task(submit, [&submit, request = std::move(request)] {
+		auto outcome = present_frame(*submit.limiter, request);
+		auto lock = std::lock_guard(submit.mutex);
+		submit.outcomes.emplace_back(std::move(outcome));
+	});
+}
+
+void run_on_submit_thread(
+		SubmitThread& submit,
+		const std::function<void()>& task) {
+	wait_for_submit_task(submit, push_task(submit, [&task] { task(); }));
+}
+
+auto queue_on_submit_thread(SubmitThread& submit, std::function<void()> task)
+		-> uint64_t {
+	return push_task(submit, std::move(task));
+}
+
+void wait_for_submit_task(SubmitThread& submit, uint64_t ticket) {
+	VKDEMO_ZONE("wait_for_submit_task");
+	auto lock = std::unique_lock(submit.mutex);
+	submit.changed.wait(
+			lock,
+			[&submit, ticket] { return submit.finished >= ticket; });
+}
+
+void wait_for_submit_thread(SubmitThread& submit) {
+	VKDEMO_ZONE("wait_for_submit_thread");
+	auto lock = std::unique_lock(submit.mutex);
+	submit.changed.wait(lock, [&submit] { return submit.pending == 0; });
+}
+
+auto take_present_outcomes(SubmitThread& submit)
+		-> std::vector<PresentOutcome> {
+	auto lock = std::lock_guard(submit.mutex);
+	return std::exchange(submit.outcomes, {});
+}
+
+auto present_frame(FrameLimiter& limiter, const PresentRequest& request)
+		-> PresentOutcome {
+	auto outcome = PresentOutcome{};
+	outcome.swap_chains = request.swap_chains;
+	outcome.results.assign(request.swap_chains.size(), VK_SUCCESS);
+	auto present_count = static_cast<uint32_t>(request.swap_chains.size());
+	// Mirrors are not opened with a device group, so there is a single swap
+	// chain then.
+	auto group_present_info = VkDeviceGroupPresentInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.swapchainCount = 1,
+			.pDeviceMasks = &request.device_mask,
+			.mode = request.group_mode};
+	const auto* present_next = static_cast<const void*>(VK_NULL_HANDLE);
+	if (request.device_mask != 0) {
+		present_next = &group_present_info;
+	}
+	auto present_rectangle = request.damage.value_or(VkRectLayerKHR{});
+	auto present_regions = std::vector<VkPresentRegionKHR>(
+			present_count,
+			VkPresentRegionKHR{.rectangleCount = 0, .pRectangles = VK_NULL_HANDLE});
+	present_regions.front() = VkPresentRegionKHR{
+			.rectangleCount = 1,
+			.pRectangles = &present_rectangle};
+	auto regions_info = VkPresentRegionsKHR{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+			.pNext = present_next,
+			.swapchainCount = present_count,
+			.pRegions = present_regions.data()};
+	if (request.damage.has_value()) {
+		present_next = &regions_info;
+	}
+	auto present_id_info = VkPresentIdKHR{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+			.pNext = present_next,
+			.swapchainCount = present_count,
+			.pPresentIds = request.ids.data()};
+	if (!request.ids.empty()) {
+		present_next = &present_id_info;
+	}
+	auto fence_info = VkSwapchainPresentFenceInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+			.pNext = present_next,
+			.swapchainCount = present_count,
+			.pFences = request.fences.data()};
+	if (!request.fences.empty()) {
+		present_next = &fence_info;
+	}
+	auto mode_info = VkSwapchainPresentModeInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT,
+			.pNext = present_next,
+			.swapchainCount = present_count,
+			.pPresentModes = request.present_modes.data()};
+	if (!request.present_modes.empty()) {
+		present_next = &mode_info;
+	}
+	auto present_info = VkPresentInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+			.pNext = present_next,
+			.waitSemaphoreCount = present_count,
+			.pWaitSemaphores = request.waits.data(),
+			.swapchainCount = present_count,
+			.pSwapchains = request.swap_chains.data(),
+			.pImageIndices = request.indices.data(),
+			.pResults = outcome.results.data()};
+	// Held back on the CPU, so the presents and not the frame starts are
+	// evenly spaced.
+	wait_for_frame_limit(limiter);
+	{
+		VKDEMO_ZONE("present");
+		vkQueuePresentKHR(request.queue, &present_info);
+	}
+	outcome.presented = std::chrono::steady_clock::now();
+	return outcome;
+}
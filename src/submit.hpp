@@ -0,0 +1,105 @@
+#pragma once
+
+#include "dispatch.hpp"
+#include "frame_limiter.hpp"
+#include "sync.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// What a frame presents, kept until the submit thread gets to it. The first
+// swap chain is the window's, the others are mirrors.
+struct PresentRequest {
+	VkQueue queue{};
+	std::vector<VkSemaphore> waits;
+	std::vector<VkSwapchainKHR> swap_chains;
+	std::vector<uint32_t> indices;
+	// Chained when not empty. An id of zero leaves a present unpaced.
+	std::vector<uint64_t> ids;
+	// What changed in the window's image, chained when set. Mirrors report
+	// all of theirs.
+	std::optional<VkRectLayerKHR> damage;
+	// With swap chain maintenance, the fence each present signals and the
+	// mode it is presented with, chained when not empty.
+	std::vector<VkFence> fences;
+	std::vector<VkPresentModeKHR> present_modes;
+	// Chained when not zero, the GPUs of a device group that present.
+	uint32_t device_mask{};
+	VkDeviceGroupPresentModeFlagBitsKHR group_mode{};
+};
+
+// How a present went, the results in the order of its swap chains.
+struct PresentOutcome {
+	std::vector<VkSwapchainKHR> swap_chains;
+	std::vector<VkResult> results;
+	std::chrono::steady_clock::time_point presented;
+};
+
+// Submits frames and presents them on a thread of its own. The driver can
+// spend a while in vkQueueSubmit2 and vkQueuePresentKHR, and blocks in them
+// now and then, which the frame loop then records the next frame through
+// instead of waiting. Each queue gets one call per frame for all of that
+// frame's submissions to it. The queues and swap chains the thread submits
+// and presents to must not be used by other threads while it runs, so
+// their other uses, such as acquiring images, are run on it as well.
+// Acquiring can be queued without waiting, so when the presentation engine
+// is behind it is this thread that blocks until an image is available.
+struct SubmitThread {
+	bool synchronization2{};
+	// Waited for before each present.
+	FrameLimiter* limiter{};
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::function<void()>> tasks;
+	// Queued and not done yet, the running task included.
+	size_t pending{};
+	// Tasks done so far, which the tickets of queued tasks are compared to.
+	uint64_t finished{};
+	uint64_t queued{};
+	std::vector<PresentOutcome> outcomes;
+	bool stopping{};
+	std::thread thread;
+};
+
+auto create_submit_thread(bool synchronization2, FrameLimiter& limiter)
+		-> std::unique_ptr<SubmitThread>;
+// Finishes what is queued first.
+void destroy_submit_thread(SubmitThread& submit);
+
+// Submits in order after what is queued, each run of submissions to the same
+// queue with one call. A run ends after a submission with a fence, one call
+// signals only one.
+void queue_submissions(
+		SubmitThread& submit,
+		std::vector<QueuedSubmission> submissions);
+// Presents after what is queued, the outcome is taken later.
+void queue_present(SubmitThread& submit, PresentRequest request);
+// Runs task on the thread after what is queued, and waits for it.
+void run_on_submit_thread(
+		SubmitThread& submit,
+		const std::function<void()>& task);
+// Runs task on the thread after what is queued without waiting for it. What
+// it writes is read once wait_for_submit_task returns for the ticket.
+auto queue_on_submit_thread(SubmitThread& submit, std::function<void()> task)
+		-> uint64_t;
+// Until the task of ticket and everything queued before it are done.
+void wait_for_submit_task(SubmitThread& submit, uint64_t ticket);
+// Until everything queued is submitted and presented, before swap chains are
+// recreated or the device waited on.
+void wait_for_submit_thread(SubmitThread& submit);
+// The presents done since the last call, oldest first.
+auto take_present_outcomes(SubmitThread& submit)
+		-> std::vector<PresentOutcome>;
+
+// Presents right away on the calling thread, once limiter lets it.
+auto present_frame(FrameLimiter& limiter, const PresentRequest& request)
+		-> PresentOutcome;
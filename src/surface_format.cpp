@@ -0,0 +1,89 @@
+#include "surface_format.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+constexpr auto g_10bit_formats = std::array{
+		VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+		VK_FORMAT_A2R10G10B10_UNORM_PACK32};
+constexpr auto g_srgb_formats =
+		std::array{VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB};
+constexpr auto g_scrgb_formats = std::array{VK_FORMAT_R16G16B16A16_SFLOAT};
+
+auto find_format(
+		std::span<const VkSurfaceFormatKHR> formats,
+		std::span<const VkFormat> candidates,
+		VkColorSpaceKHR color_space) -> std::optional<VkSurfaceFormatKHR> {
+	for (auto candidate : candidates) {
+		auto found = std::find_if(
+				formats.begin(),
+				formats.end(),
+				[&](const VkSurfaceFormatKHR& format) {
+					return format.format == candidate &&
+							format.colorSpace == color_space;
+				});
+		if (found != formats.end()) {
+			return *found;
+		}
+	}
+	return std::nullopt;
+}
+
+auto output(
+		std::optional<VkSurfaceFormatKHR> format,
+		OutputTransfer transfer) -> std::optional<SurfaceOutput> {
+	if (!format.has_value()) {
+		return std::nullopt;
+	}
+	return SurfaceOutput{.format = *format, .transfer = transfer};
+}
+
+}  // namespace
+
+auto select_surface_output(
+		std::span<const VkSurfaceFormatKHR> formats,
+		OutputPolicy policy,
+		bool shader_encoding) -> std::optional<SurfaceOutput> {
+	switch (policy) {
+		case OutputPolicy::hdr10:
+			if (!shader_encoding) {
+				return std::nullopt;
+			}
+			return output(
+					find_format(
+							formats,
+							g_10bit_formats,
+							VK_COLOR_SPACE_HDR10_ST2084_EXT),
+					OutputTransfer::pq);
+		case OutputPolicy::scrgb:
+			return output(
+					find_format(
+							formats,
+							g_scrgb_formats,
+							VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT),
+					OutputTransfer::linear);
+		case OutputPolicy::sdr:
+			break;
+	}
+	if (shader_encoding) {
+		auto format = find_format(
+				formats,
+				g_10bit_formats,
+				VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+		if (format.has_value()) {
+			return output(format, OutputTransfer::srgb);
+		}
+	}
+	auto format =
+			find_format(formats, g_srgb_formats, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+	if (!format.has_value() && !formats.empty()) {
+		format = formats.front();
+	}
+	return output(format, OutputTransfer::hardware_srgb);
+}
+
+auto output_needs_encoding(OutputTransfer transfer) -> bool {
+	return transfer == OutputTransfer::srgb || transfer == OutputTransfer::pq;
+}
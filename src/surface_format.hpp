@@ -0,0 +1,36 @@
+#pragma once
+
+#include "config.hpp"
+#include "dispatch.hpp"
+
+#include <optional>
+#include <span>
+
+// How linear scene color is turned into what the swap chain format means.
+enum class OutputTransfer {
+	// An sRGB format, the hardware encodes the writes.
+	hardware_srgb,
+	// 10-bit UNORM in the sRGB color space, encoded by the post composite.
+	srgb,
+	// HDR10, BT.2020 primaries with the SMPTE ST 2084 curve.
+	pq,
+	// scRGB, linear BT.709 where 1.0 is 80 nits and brighter values go above.
+	linear,
+};
+
+struct SurfaceOutput {
+	VkSurfaceFormatKHR format{};
+	OutputTransfer transfer{};
+};
+
+// The format for policy out of the surface's, std::nullopt when it offers
+// none. Only transfers the hardware does are considered without
+// shader_encoding. SDR always finds one, with 8-bit sRGB or else the first
+// format, which is drawn to as if it were sRGB. The HDR color spaces are
+// only offered with VK_EXT_swapchain_colorspace enabled.
+auto select_surface_output(
+		std::span<const VkSurfaceFormatKHR> formats,
+		OutputPolicy policy,
+		bool shader_encoding) -> std::optional<SurfaceOutput>;
+// Whether the scene can only be shown after the post composite encoded it.
+auto output_needs_encoding(OutputTransfer transfer) -> bool;
@@ -0,0 +1,86 @@
+#include "swap_chain_depth.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+// A frame missed a vblank when it took this much longer than the median of
+// its window. With FIFO intervals come in whole refreshes, so a miss is
+// close to twice the median.
+constexpr auto g_missed_frame_ratio = 1.5;
+// Misses per window that call for another image.
+constexpr auto g_missed_frames_limit = size_t{3};
+// Windows without misses before an image is dropped again.
+constexpr auto g_steady_windows_limit = 8U;
+
+auto adapts(PresentPolicy policy) -> bool {
+	return policy == PresentPolicy::vsync || policy == PresentPolicy::adaptive;
+}
+
+}  // namespace
+
+auto create_swap_chain_depth(PresentPolicy policy) -> SwapChainDepth {
+	auto base_extra = policy == PresentPolicy::low_latency ? 0U : 1U;
+	return SwapChainDepth{
+			.policy = policy,
+			.base_extra = base_extra,
+			.extra_images = base_extra,
+			.intervals = {},
+			.last_present = std::nullopt,
+			.steady_windows = 0};
+}
+
+auto swap_chain_image_count(
+		const SwapChainDepth& depth,
+		const VkSurfaceCapabilitiesKHR& capabilities) -> uint32_t {
+	auto image_count = capabilities.minImageCount + depth.extra_images;
+	if (capabilities.maxImageCount > 0 &&
+			image_count > capabilities.maxImageCount) {
+		image_count = capabilities.maxImageCount;
+	}
+	return image_count;
+}
+
+auto record_swap_chain_present(SwapChainDepth& depth) -> bool {
+	if (!adapts(depth.policy)) {
+		return false;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (depth.last_present.has_value()) {
+		depth.intervals.emplace_back(
+				std::chrono::duration<double, std::milli>(now - *depth.last_present)
+						.count());
+	}
+	depth.last_present = now;
+	if (depth.intervals.size() < g_depth_window_frames) {
+		return false;
+	}
+
+	auto sorted = depth.intervals;
+	auto median = sorted.begin() + static_cast<std::ptrdiff_t>(sorted.size() / 2);
+	std::nth_element(sorted.begin(), median, sorted.end());
+	auto missed = static_cast<size_t>(std::count_if(
+			depth.intervals.begin(),
+			depth.intervals.end(),
+			[&](double interval) {
+				return interval > *median * g_missed_frame_ratio;
+			}));
+	depth.intervals.clear();
+
+	auto extra_images = depth.extra_images;
+	if (missed >= g_missed_frames_limit) {
+		depth.steady_windows = 0;
+		extra_images = std::min(extra_images + 1, g_max_extra_images);
+	} else if (missed == 0 && ++depth.steady_windows >= g_steady_windows_limit) {
+		depth.steady_windows = 0;
+		extra_images = std::max(extra_images, depth.base_extra + 1) - 1;
+	}
+	if (extra_images == depth.extra_images) {
+		return false;
+	}
+	depth.extra_images = extra_images;
+	// The new swap chain starts a fresh window.
+	depth.last_present.reset();
+	return true;
+}
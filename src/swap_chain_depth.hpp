@@ -0,0 +1,40 @@
+#pragma once
+
+#include "config.hpp"
+#include "dispatch.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Frames between decisions about the swap chain depth.
+constexpr auto g_depth_window_frames = size_t{120};
+// Images queued beyond the surface's minimum at most.
+constexpr auto g_max_extra_images = 2U;
+
+// How many images the swap chain queues beyond the surface's minimum. Every
+// extra image is one more frame of latency, but it also lets a slow frame fit
+// without missing a vblank. The low latency policy always takes the minimum.
+// Vsync and adaptive start one image above it. An image is added when frames
+// keep missing vblanks and dropped again once they have been on time for a
+// while. Uncapped presents do not wait for vblanks, so their depth is fixed.
+struct SwapChainDepth {
+	PresentPolicy policy{};
+	uint32_t base_extra{};
+	uint32_t extra_images{};
+	// Frame intervals of the current window, in milliseconds.
+	std::vector<double> intervals;
+	std::optional<std::chrono::steady_clock::time_point> last_present;
+	// Windows in a row without misses.
+	uint32_t steady_windows{};
+};
+
+auto create_swap_chain_depth(PresentPolicy policy) -> SwapChainDepth;
+// The minImageCount for a new swap chain.
+auto swap_chain_image_count(
+		const SwapChainDepth& depth,
+		const VkSurfaceCapabilitiesKHR& capabilities) -> uint32_t;
+// Called after every present. Returns whether the swap chain should be
+// recreated with a different image count.
+auto record_swap_chain_present(SwapChainDepth& depth) -> bool;
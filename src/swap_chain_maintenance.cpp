@@ -0,0 +1,126 @@
+#include "swap_chain_maintenance.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <limits>
+
+auto compatible_present_modes(
+		VkPhysicalDevice device,
+		VkSurfaceKHR surface,
+		VkPresentModeKHR present_mode,
+		std::span<const VkPresentModeKHR> available)
+		-> std::vector<VkPresentModeKHR> {
+	auto present_mode_info = VkSurfacePresentModeEXT{
+			.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.presentMode = present_mode};
+	auto surface_info = VkPhysicalDeviceSurfaceInfo2KHR{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR,
+			.pNext = &present_mode_info,
+			.surface = surface};
+	auto compatibility = VkSurfacePresentModeCompatibilityEXT{
+			.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_COMPATIBILITY_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.presentModeCount = 0,
+			.pPresentModes = VK_NULL_HANDLE};
+	auto capabilities = VkSurfaceCapabilities2KHR{
+			.sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR,
+			.pNext = &compatibility,
+			.surfaceCapabilities = {}};
+	auto modes = std::vector<VkPresentModeKHR>{present_mode};
+	if (vkGetPhysicalDeviceSurfaceCapabilities2KHR(
+					device,
+					&surface_info,
+					&capabilities) != VK_SUCCESS) {
+		return modes;
+	}
+	auto compatible =
+			std::vector<VkPresentModeKHR>(compatibility.presentModeCount);
+	compatibility.pPresentModes = compatible.data();
+	if (vkGetPhysicalDeviceSurfaceCapabilities2KHR(
+					device,
+					&surface_info,
+					&capabilities) != VK_SUCCESS) {
+		return modes;
+	}
+	compatible.resize(compatibility.presentModeCount);
+	for (auto mode : compatible) {
+		if (mode != present_mode &&
+				std::find(available.begin(), available.end(), mode) !=
+						available.end()) {
+			modes.emplace_back(mode);
+		}
+	}
+	return modes;
+}
+
+auto create_present_fences(VkDevice device, size_t count) -> PresentFences {
+	auto fences = PresentFences{};
+	auto fence_info = VkFenceCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0};
+	for (auto i = size_t{}; i < count; i++) {
+		auto* fence = VkFence{};
+		if (vkCreateFence(device, &fence_info, host_callbacks(), &fence) !=
+				VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create a present fence\n");
+			std::terminate();
+		}
+		fences.fences.emplace_back(fence);
+	}
+	fences.pending.assign(count, 0);
+	return fences;
+}
+
+auto next_present_fence(VkDevice device, PresentFences& fences, size_t slot)
+		-> VkFence {
+	auto* fence = fences.fences.at(slot);
+	if (fences.pending.at(slot) != 0) {
+		vkWaitForFences(
+				device,
+				1,
+				&fence,
+				VK_TRUE,
+				std::numeric_limits<uint64_t>::max());
+		vkResetFences(device, 1, &fence);
+	}
+	fences.pending.at(slot) = 1;
+	return fence;
+}
+
+void destroy_present_fences(VkDevice device, PresentFences& fences) {
+	for (auto i = size_t{}; i < fences.fences.size(); i++) {
+		if (fences.pending.at(i) != 0) {
+			vkWaitForFences(
+					device,
+					1,
+					&fences.fences.at(i),
+					VK_TRUE,
+					std::numeric_limits<uint64_t>::max());
+		}
+		vkDestroyFence(device, fences.fences.at(i), host_callbacks());
+	}
+	fences = PresentFences{};
+}
+
+void release_swap_chain_images(
+		VkDevice device,
+		VkSwapchainKHR swap_chain,
+		std::span<const uint32_t> indices) {
+	if (indices.empty()) {
+		return;
+	}
+	auto release_info = VkReleaseSwapchainImagesInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_RELEASE_SWAPCHAIN_IMAGES_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.swapchain = swap_chain,
+			.imageIndexCount = static_cast<uint32_t>(indices.size()),
+			.pImageIndices = indices.data()};
+	vkReleaseSwapchainImagesEXT(device, &release_info);
+}
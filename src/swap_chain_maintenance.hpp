@@ -0,0 +1,45 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// The modes a swap chain of surface made with present_mode can be switched
+// to between presents, without being recreated, with
+// VK_EXT_surface_maintenance1. Only modes of available are taken, and
+// present_mode comes first.
+auto compatible_present_modes(
+		VkPhysicalDevice device,
+		VkSurfaceKHR surface,
+		VkPresentModeKHR present_mode,
+		std::span<const VkPresentModeKHR> available)
+		-> std::vector<VkPresentModeKHR>;
+
+// Fences the presents to a swap chain signal once the presentation engine is
+// done with the semaphores they waited on, one per frame slot, with
+// VK_EXT_swapchain_maintenance1. Frame fences only cover the GPU's work, so
+// without them a retired swap chain and the semaphores of its presents are
+// only known to be free once the device is idle.
+struct PresentFences {
+	std::vector<VkFence> fences;
+	// Whether each fence was given to a present since it was last reset.
+	std::vector<uint8_t> pending;
+};
+
+auto create_present_fences(VkDevice device, size_t count) -> PresentFences;
+// Waits for the previous present of slot and returns its fence reset, for
+// the next one to signal.
+auto next_present_fence(VkDevice device, PresentFences& fences, size_t slot)
+		-> VkFence;
+// Waits for every present that was given a fence, then destroys them.
+void destroy_present_fences(VkDevice device, PresentFences& fences);
+
+// Gives images acquired from swap_chain back without presenting them. The
+// device must be done with them.
+void release_swap_chain_images(
+		VkDevice device,
+		VkSwapchainKHR swap_chain,
+		std::span<const uint32_t> indices);
@@ -0,0 +1,415 @@
+#include "sync.hpp"
+
+#include "host_memory.hpp"
+#include "instrument.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <limits>
+#include <memory_resource>
+#include <vector>
+
+namespace {
+
+// Stages and accesses that synchronization2 split out of a legacy flag.
+constexpr auto g_transfer_stages = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT |
+		VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT |
+		VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT;
+constexpr auto g_vertex_input_stages = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+constexpr auto g_shader_reads =
+		VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+constexpr auto g_legacy_mask = uint64_t{std::numeric_limits<uint32_t>::max()};
+// Stack space for the arrays a submission or barrier is translated into,
+// enough for the usual handful of entries. Larger ones spill to the heap.
+constexpr auto g_sync_scratch_size = size_t{2048};
+
+// The lowest GPU of device_mask, which waits on and signals the semaphores.
+auto device_index(uint32_t device_mask) -> uint32_t {
+	return device_mask == 0
+			? 0U
+			: static_cast<uint32_t>(std::countr_zero(device_mask));
+}
+
+// none_stage replaces an empty mask, which the legacy barriers reject.
+auto legacy_stages(
+		VkPipelineStageFlags2 stages,
+		VkPipelineStageFlags none_stage) -> VkPipelineStageFlags {
+	auto legacy = static_cast<VkPipelineStageFlags>(stages & g_legacy_mask);
+	if ((stages & g_transfer_stages) != 0U) {
+		legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	if ((stages & g_vertex_input_stages) != 0U) {
+		legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+	if ((stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) != 0U) {
+		legacy |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+				VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+				VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+				VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT;
+	}
+	return legacy == 0U ? none_stage : legacy;
+}
+
+auto legacy_access(VkAccessFlags2 access) -> VkAccessFlags {
+	auto legacy = static_cast<VkAccessFlags>(access & g_legacy_mask);
+	if ((access & g_shader_reads) != 0U) {
+		legacy |= VK_ACCESS_SHADER_READ_BIT;
+	}
+	if ((access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) != 0U) {
+		legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+	}
+	return legacy;
+}
+
+auto semaphore_submit_info(const SemaphoreOp& op, uint32_t device_idx)
+		-> VkSemaphoreSubmitInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.semaphore = op.semaphore,
+			.value = op.value,
+			.stageMask = op.stages,
+			.deviceIndex = device_idx};
+}
+
+}  // namespace
+
+auto create_queue_timeline(VkDevice& device, bool timeline_semaphores)
+		-> QueueTimeline {
+	auto timeline = QueueTimeline{};
+	if (!timeline_semaphores) {
+		return timeline;
+	}
+	auto type_info = VkSemaphoreTypeCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0};
+	auto semaphore_info = VkSemaphoreCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &type_info,
+			.flags = 0};
+	if (vkCreateSemaphore(
+					device,
+					&semaphore_info,
+					host_callbacks(),
+					&timeline.semaphore) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create timeline semaphore\n");
+		std::terminate();
+	}
+	return timeline;
+}
+
+void destroy_queue_timeline(VkDevice& device, QueueTimeline& timeline) {
+	vkDestroySemaphore(device, timeline.semaphore, host_callbacks());
+	timeline = QueueTimeline{};
+}
+
+auto create_submit_point(VkDevice& device, const QueueTimeline& timeline)
+		-> SubmitPoint {
+	auto point = SubmitPoint{};
+	if (timeline.semaphore != VK_NULL_HANDLE) {
+		point.timeline = timeline.semaphore;
+		point.value = timeline.value;
+		return point;
+	}
+	auto fence_info = VkFenceCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT};
+	if (vkCreateFence(device, &fence_info, host_callbacks(), &point.fence) !=
+			VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create fence\n");
+		std::terminate();
+	}
+	return point;
+}
+
+void destroy_submit_point(VkDevice& device, SubmitPoint& point) {
+	vkDestroyFence(device, point.fence, host_callbacks());
+	point = SubmitPoint{};
+}
+
+auto submit_point_reached(VkDevice& device, const SubmitPoint& point)
+		-> bool {
+	if (point.timeline == VK_NULL_HANDLE) {
+		return vkGetFenceStatus(device, point.fence) == VK_SUCCESS;
+	}
+	auto value = uint64_t{};
+	vkGetSemaphoreCounterValue(device, point.timeline, &value);
+	return value >= point.value;
+}
+
+void wait_for_submit_point(VkDevice& device, const SubmitPoint& point) {
+	VKDEMO_ZONE("wait_for_submit_point");
+	if (point.timeline == VK_NULL_HANDLE) {
+		vkWaitForFences(
+				device,
+				1,
+				&point.fence,
+				VK_TRUE,
+				std::numeric_limits<uint64_t>::max());
+		return;
+	}
+	auto wait_info = VkSemaphoreWaitInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &point.timeline,
+			.pValues = &point.value};
+	vkWaitSemaphores(device, &wait_info, std::numeric_limits<uint64_t>::max());
+}
+
+auto advance_submit_point(
+		VkDevice& device,
+		SubmitPoint& point,
+		QueueTimeline& timeline,
+		std::vector<SemaphoreOp>& signals) -> VkFence {
+	if (point.timeline == VK_NULL_HANDLE) {
+		vkResetFences(device, 1, &point.fence);
+		return point.fence;
+	}
+	point.value = ++timeline.value;
+	signals.emplace_back(SemaphoreOp{
+			.semaphore = timeline.semaphore,
+			.value = point.value,
+			.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+	return VK_NULL_HANDLE;
+}
+
+auto submit_commands(
+		bool synchronization2,
+		VkQueue queue,
+		std::span<const VkCommandBuffer> command_buffers,
+		std::span<const SemaphoreOp> waits,
+		std::span<const SemaphoreOp> signals,
+		VkFence fence,
+		uint32_t device_mask) -> VkResult {
+	auto submission = Submission{
+			.command_buffers = command_buffers,
+			.waits = waits,
+			.signals = signals,
+			.device_mask = device_mask};
+	return submit_batch(synchronization2, queue, {&submission, 1}, fence);
+}
+
+auto submit_batch(
+		bool synchronization2,
+		VkQueue queue,
+		std::span<const Submission> submissions,
+		VkFence fence) -> VkResult {
+	VKDEMO_ZONE("submit_batch");
+	auto wait_count = size_t{};
+	auto signal_count = size_t{};
+	auto command_buffer_count = size_t{};
+	for (const auto& submission : submissions) {
+		wait_count += submission.waits.size();
+		signal_count += submission.signals.size();
+		command_buffer_count += submission.command_buffers.size();
+	}
+	auto scratch_space = std::array<std::byte, g_sync_scratch_size>{};
+	auto scratch = std::pmr::monotonic_buffer_resource(
+			scratch_space.data(),
+			scratch_space.size());
+	// Every array is reserved up front, the submit infos point into them.
+	if (synchronization2) {
+		auto wait_infos = std::pmr::vector<VkSemaphoreSubmitInfo>(&scratch);
+		wait_infos.reserve(wait_count);
+		auto signal_infos = std::pmr::vector<VkSemaphoreSubmitInfo>(&scratch);
+		signal_infos.reserve(signal_count);
+		auto command_buffer_infos =
+				std::pmr::vector<VkCommandBufferSubmitInfo>(&scratch);
+		command_buffer_infos.reserve(command_buffer_count);
+		auto submit_infos = std::pmr::vector<VkSubmitInfo2>(&scratch);
+		submit_infos.reserve(submissions.size());
+		for (const auto& submission : submissions) {
+			auto device_idx = device_index(submission.device_mask);
+			const auto* first_wait = wait_infos.data() + wait_infos.size();
+			for (const auto& wait : submission.waits) {
+				wait_infos.emplace_back(semaphore_submit_info(wait, device_idx));
+			}
+			const auto* first_signal = signal_infos.data() + signal_infos.size();
+			for (const auto& signal : submission.signals) {
+				signal_infos.emplace_back(semaphore_submit_info(signal, device_idx));
+			}
+			const auto* first_command_buffer =
+					command_buffer_infos.data() + command_buffer_infos.size();
+			for (auto* command_buffer : submission.command_buffers) {
+				command_buffer_infos.emplace_back(VkCommandBufferSubmitInfo{
+						.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+						.pNext = VK_NULL_HANDLE,
+						.commandBuffer = command_buffer,
+						.deviceMask = submission.device_mask});
+			}
+			submit_infos.emplace_back(VkSubmitInfo2{
+					.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+					.pNext = VK_NULL_HANDLE,
+					.flags = 0,
+					.waitSemaphoreInfoCount =
+							static_cast<uint32_t>(submission.waits.size()),
+					.pWaitSemaphoreInfos = first_wait,
+					.commandBufferInfoCount =
+							static_cast<uint32_t>(submission.command_buffers.size()),
+					.pCommandBufferInfos = first_command_buffer,
+					.signalSemaphoreInfoCount =
+							static_cast<uint32_t>(submission.signals.size()),
+					.pSignalSemaphoreInfos = first_signal});
+		}
+		return vkQueueSubmit2(
+				queue,
+				static_cast<uint32_t>(submit_infos.size()),
+				submit_infos.data(),
+				fence);
+	}
+
+	auto wait_semaphores = std::pmr::vector<VkSemaphore>(&scratch);
+	auto wait_stages = std::pmr::vector<VkPipelineStageFlags>(&scratch);
+	auto wait_indices = std::pmr::vector<uint32_t>(&scratch);
+	wait_semaphores.reserve(wait_count);
+	wait_stages.reserve(wait_count);
+	wait_indices.reserve(wait_count);
+	auto masks = std::pmr::vector<uint32_t>(&scratch);
+	masks.reserve(command_buffer_count);
+	auto signal_semaphores = std::pmr::vector<VkSemaphore>(&scratch);
+	auto signal_indices = std::pmr::vector<uint32_t>(&scratch);
+	signal_semaphores.reserve(signal_count);
+	signal_indices.reserve(signal_count);
+	auto group_infos = std::pmr::vector<VkDeviceGroupSubmitInfo>(&scratch);
+	group_infos.reserve(submissions.size());
+	auto submit_infos = std::pmr::vector<VkSubmitInfo>(&scratch);
+	submit_infos.reserve(submissions.size());
+	for (const auto& submission : submissions) {
+		auto device_idx = device_index(submission.device_mask);
+		auto first_wait = wait_semaphores.size();
+		for (const auto& wait : submission.waits) {
+			wait_semaphores.emplace_back(wait.semaphore);
+			wait_stages.emplace_back(
+					legacy_stages(wait.stages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT));
+			wait_indices.emplace_back(device_idx);
+		}
+		auto first_signal = signal_semaphores.size();
+		for (const auto& signal : submission.signals) {
+			signal_semaphores.emplace_back(signal.semaphore);
+			signal_indices.emplace_back(device_idx);
+		}
+		auto first_mask = masks.size();
+		masks.insert(
+				masks.end(),
+				submission.command_buffers.size(),
+				submission.device_mask);
+		auto wait_semaphore_count = static_cast<uint32_t>(submission.waits.size());
+		auto command_buffer_total =
+				static_cast<uint32_t>(submission.command_buffers.size());
+		auto signal_semaphore_count =
+				static_cast<uint32_t>(submission.signals.size());
+		// Masks and indices only go in for a device group, the defaults run on
+		// every GPU and wait and signal on the first.
+		const auto& group_info = group_infos.emplace_back(VkDeviceGroupSubmitInfo{
+				.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.waitSemaphoreCount = wait_semaphore_count,
+				.pWaitSemaphoreDeviceIndices = wait_indices.data() + first_wait,
+				.commandBufferCount = command_buffer_total,
+				.pCommandBufferDeviceMasks = masks.data() + first_mask,
+				.signalSemaphoreCount = signal_semaphore_count,
+				.pSignalSemaphoreDeviceIndices =
+						signal_indices.data() + first_signal});
+		submit_infos.emplace_back(VkSubmitInfo{
+				.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+				.pNext = submission.device_mask == 0 ? VK_NULL_HANDLE : &group_info,
+				.waitSemaphoreCount = wait_semaphore_count,
+				.pWaitSemaphores = wait_semaphores.data() + first_wait,
+				.pWaitDstStageMask = wait_stages.data() + first_wait,
+				.commandBufferCount = command_buffer_total,
+				.pCommandBuffers = submission.command_buffers.data(),
+				.signalSemaphoreCount = signal_semaphore_count,
+				.pSignalSemaphores = signal_semaphores.data() + first_signal});
+	}
+	return vkQueueSubmit(
+			queue,
+			static_cast<uint32_t>(submit_infos.size()),
+			submit_infos.data(),
+			fence);
+}
+
+void pipeline_barrier(
+		bool synchronization2,
+		VkCommandBuffer command_buffer,
+		std::span<const VkBufferMemoryBarrier2> buffer_barriers,
+		std::span<const VkImageMemoryBarrier2> image_barriers) {
+	if (synchronization2) {
+		auto dependency_info = VkDependencyInfo{
+				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.dependencyFlags = 0,
+				.memoryBarrierCount = 0,
+				.pMemoryBarriers = VK_NULL_HANDLE,
+				.bufferMemoryBarrierCount =
+						static_cast<uint32_t>(buffer_barriers.size()),
+				.pBufferMemoryBarriers = buffer_barriers.data(),
+				.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size()),
+				.pImageMemoryBarriers = image_barriers.data()};
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+		return;
+	}
+
+	auto scratch_space = std::array<std::byte, g_sync_scratch_size>{};
+	auto scratch = std::pmr::monotonic_buffer_resource(
+			scratch_space.data(),
+			scratch_space.size());
+	auto src_stages = VkPipelineStageFlags2{};
+	auto dst_stages = VkPipelineStageFlags2{};
+	auto legacy_buffer_barriers =
+			std::pmr::vector<VkBufferMemoryBarrier>(&scratch);
+	legacy_buffer_barriers.reserve(buffer_barriers.size());
+	for (const auto& barrier : buffer_barriers) {
+		src_stages |= barrier.srcStageMask;
+		dst_stages |= barrier.dstStageMask;
+		legacy_buffer_barriers.emplace_back(VkBufferMemoryBarrier{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.pNext = VK_NULL_HANDLE,
+				.srcAccessMask = legacy_access(barrier.srcAccessMask),
+				.dstAccessMask = legacy_access(barrier.dstAccessMask),
+				.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+				.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+				.buffer = barrier.buffer,
+				.offset = barrier.offset,
+				.size = barrier.size});
+	}
+	auto legacy_image_barriers =
+			std::pmr::vector<VkImageMemoryBarrier>(&scratch);
+	legacy_image_barriers.reserve(image_barriers.size());
+	for (const auto& barrier : image_barriers) {
+		src_stages |= barrier.srcStageMask;
+		dst_stages |= barrier.dstStageMask;
+		legacy_image_barriers.emplace_back(VkImageMemoryBarrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.pNext = VK_NULL_HANDLE,
+				.srcAccessMask = legacy_access(barrier.srcAccessMask),
+				.dstAccessMask = legacy_access(barrier.dstAccessMask),
+				.oldLayout = barrier.oldLayout,
+				.newLayout = barrier.newLayout,
+				.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+				.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+				.image = barrier.image,
+				.subresourceRange = barrier.subresourceRange});
+	}
+	vkCmdPipelineBarrier(
+			command_buffer,
+			legacy_stages(src_stages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+			legacy_stages(dst_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+			0,
+			0,
+			VK_NULL_HANDLE,
+			static_cast<uint32_t>(legacy_buffer_barriers.size()),
+			legacy_buffer_barriers.data(),
+			static_cast<uint32_t>(legacy_image_barriers.size()),
+			legacy_image_barriers.data());
+}
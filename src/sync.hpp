@@ -0,0 +1,101 @@
+#pragma once
+
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Submissions and barriers go through synchronization2 and completion is
+// tracked with timeline semaphores on devices that have both, which Vulkan
+// 1.3 guarantees. Older devices take the original entry points and fences;
+// the synchronization2 structures are translated for them.
+
+// A semaphore wait or signal of a submission. value only applies to timeline
+// semaphores. For a wait, stages are the stages that wait; for a signal, the
+// stages that have to finish first.
+struct SemaphoreOp {
+	VkSemaphore semaphore{};
+	uint64_t value{};
+	VkPipelineStageFlags2 stages{};
+};
+
+// Counts the tracked submissions to one queue, each signalling the next value.
+// Empty on devices without timeline semaphores.
+struct QueueTimeline {
+	VkSemaphore semaphore{};
+	uint64_t value{};
+};
+
+// Completion of one submission: a value on a queue's timeline, or a fence
+// when there is none.
+struct SubmitPoint {
+	VkFence fence{};
+	VkSemaphore timeline{};
+	uint64_t value{};
+};
+
+auto create_queue_timeline(VkDevice& device, bool timeline_semaphores)
+		-> QueueTimeline;
+// The device must be idle.
+void destroy_queue_timeline(VkDevice& device, QueueTimeline& timeline);
+
+// New points count as reached.
+auto create_submit_point(VkDevice& device, const QueueTimeline& timeline)
+		-> SubmitPoint;
+void destroy_submit_point(VkDevice& device, SubmitPoint& point);
+auto submit_point_reached(VkDevice& device, const SubmitPoint& point) -> bool;
+void wait_for_submit_point(VkDevice& device, const SubmitPoint& point);
+// Moves a reached point to the next submission on its queue. That submission
+// must signal the returned fence and the operation appended to signals.
+auto advance_submit_point(
+		VkDevice& device,
+		SubmitPoint& point,
+		QueueTimeline& timeline,
+		std::vector<SemaphoreOp>& signals) -> VkFence;
+
+// One submission of a batch, whose spans stay the caller's.
+struct Submission {
+	std::span<const VkCommandBuffer> command_buffers;
+	std::span<const SemaphoreOp> waits;
+	std::span<const SemaphoreOp> signals;
+	uint32_t device_mask{};
+};
+
+// A submission that owns its arrays, so it can wait to be submitted later.
+struct QueuedSubmission {
+	VkQueue queue{};
+	std::vector<VkCommandBuffer> command_buffers;
+	std::vector<SemaphoreOp> waits;
+	std::vector<SemaphoreOp> signals;
+	VkFence fence{};
+	uint32_t device_mask{};
+};
+
+// Without synchronization2 there are no timelines, so every semaphore is
+// binary and only the stages of the waits carry over. device_mask picks the
+// GPUs of a device group the command buffers run on, zero for all of them.
+// The lowest of them waits on and signals the semaphores.
+auto submit_commands(
+		bool synchronization2,
+		VkQueue queue,
+		std::span<const VkCommandBuffer> command_buffers,
+		std::span<const SemaphoreOp> waits,
+		std::span<const SemaphoreOp> signals,
+		VkFence fence,
+		uint32_t device_mask) -> VkResult;
+// Submits all of submissions, in order, with a single call, which costs the
+// driver less than a call each. fence is signalled once all are done.
+auto submit_batch(
+		bool synchronization2,
+		VkQueue queue,
+		std::span<const Submission> submissions,
+		VkFence fence) -> VkResult;
+
+// Without synchronization2 the stages of all barriers are merged into a single
+// vkCmdPipelineBarrier.
+void pipeline_barrier(
+		bool synchronization2,
+		VkCommandBuffer command_buffer,
+		std::span<const VkBufferMemoryBarrier2> buffer_barriers,
+		std::span<const VkImageMemoryBarrier2> image_barriers);
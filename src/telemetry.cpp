@@ -0,0 +1,165 @@
+#include "telemetry.hpp"
+
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace {
+
+constexpr auto g_frame_quantiles = std::array{0.5, 0.9, 0.99};
+
+// The value below which quantile of the sorted times lie.
+auto quantile_of(const std::vector<double>& sorted, double quantile)
+		-> double {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	auto index =
+			static_cast<size_t>(quantile * static_cast<double>(sorted.size() - 1));
+	return sorted.at(index);
+}
+
+void write_telemetry(
+		Telemetry& telemetry,
+		const Allocator& allocator,
+		const MemoryBudget& budget,
+		const PipelineStateCache& pipelines) {
+	auto sorted = telemetry.frame_times;
+	std::sort(sorted.begin(), sorted.end());
+	auto median = quantile_of(sorted, 0.5);
+	telemetry.dropped_frames += static_cast<uint64_t>(std::count_if(
+			sorted.begin(),
+			sorted.end(),
+			[&](double milliseconds) { return milliseconds >= median * 2.0; }));
+	telemetry.frame_times.clear();
+
+	auto compiled = size_t{};
+	auto compiling = size_t{};
+	for (const auto* cached : {&pipelines.pipelines, &pipelines.libraries}) {
+		for (const auto& [key, pipeline] : *cached) {
+			if (pipeline->pipeline.load(std::memory_order_acquire) != nullptr) {
+				compiled++;
+			} else {
+				compiling++;
+			}
+		}
+	}
+
+	auto text = std::string{};
+	text += "# HELP vkdemo_frame_time_milliseconds Frame times, quantiles of the "
+					"last interval.\n";
+	text += "# TYPE vkdemo_frame_time_milliseconds summary\n";
+	for (auto quantile : g_frame_quantiles) {
+		text += fmt::format(
+				"vkdemo_frame_time_milliseconds{{quantile=\"{}\"}} {:.3f}\n",
+				quantile,
+				quantile_of(sorted, quantile));
+	}
+	text += fmt::format(
+			"vkdemo_frame_time_milliseconds_sum {:.3f}\n",
+			telemetry.frame_milliseconds);
+	text += fmt::format(
+			"vkdemo_frame_time_milliseconds_count {}\n",
+			telemetry.frames);
+	text += "# HELP vkdemo_dropped_frames_total Frames that took twice the "
+					"median of their interval or longer.\n";
+	text += "# TYPE vkdemo_dropped_frames_total counter\n";
+	text += fmt::format(
+			"vkdemo_dropped_frames_total {}\n",
+			telemetry.dropped_frames);
+	text += "# HELP vkdemo_heap_budget_bytes What a memory heap can hold.\n";
+	text += "# TYPE vkdemo_heap_budget_bytes gauge\n";
+	for (auto heap = uint32_t{}; heap < budget.heap_count; heap++) {
+		text += fmt::format(
+				"vkdemo_heap_budget_bytes{{heap=\"{}\"}} {}\n",
+				heap,
+				budget.heaps.at(heap).budget);
+	}
+	text += "# HELP vkdemo_heap_usage_bytes What a memory heap holds.\n";
+	text += "# TYPE vkdemo_heap_usage_bytes gauge\n";
+	for (auto heap = uint32_t{}; heap < budget.heap_count; heap++) {
+		text += fmt::format(
+				"vkdemo_heap_usage_bytes{{heap=\"{}\"}} {}\n",
+				heap,
+				budget.heaps.at(heap).usage);
+	}
+	text += "# HELP vkdemo_device_memory_allocations Live device memory "
+					"allocations.\n";
+	text += "# TYPE vkdemo_device_memory_allocations gauge\n";
+	text += fmt::format(
+			"vkdemo_device_memory_allocations {}\n",
+			allocator.allocation_count);
+	text += "# HELP vkdemo_pipelines Pipelines and pipeline libraries.\n";
+	text += "# TYPE vkdemo_pipelines gauge\n";
+	text += fmt::format("vkdemo_pipelines{{state=\"compiled\"}} {}\n", compiled);
+	text +=
+			fmt::format("vkdemo_pipelines{{state=\"compiling\"}} {}\n", compiling);
+
+	auto error = std::error_code{};
+	auto tmp_path = telemetry.path;
+	tmp_path += ".tmp";
+	{
+		auto file = std::ofstream(tmp_path, std::ios::trunc);
+		file << text;
+		if (!file) {
+			log_message(
+					LogLevel::warning,
+					"Failed to write telemetry {}",
+					telemetry.path.string());
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, telemetry.path, error);
+	if (error) {
+		log_message(
+				LogLevel::warning,
+				"Failed to write telemetry {}",
+				telemetry.path.string());
+		std::filesystem::remove(tmp_path, error);
+	}
+}
+
+}  // namespace
+
+auto create_telemetry(const std::filesystem::path& path) -> Telemetry {
+	auto telemetry = Telemetry{};
+	telemetry.path = path;
+	telemetry.next_write =
+			std::chrono::steady_clock::now() + g_telemetry_interval;
+	return telemetry;
+}
+
+void end_telemetry_frame(
+		Telemetry& telemetry,
+		const Allocator& allocator,
+		const MemoryBudget& budget,
+		const PipelineStateCache& pipelines) {
+	if (telemetry.path.empty()) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (telemetry.last_frame_end.has_value()) {
+		auto milliseconds = std::chrono::duration<double, std::milli>(
+				now - *telemetry.last_frame_end)
+				.count();
+		telemetry.frame_times.emplace_back(milliseconds);
+		telemetry.frame_milliseconds += milliseconds;
+		telemetry.frames++;
+	}
+	telemetry.last_frame_end = now;
+	if (now < telemetry.next_write) {
+		return;
+	}
+	write_telemetry(telemetry, allocator, budget, pipelines);
+	telemetry.next_write = now + g_telemetry_interval;
+	// Writing the file is no part of the next frame.
+	telemetry.last_frame_end = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "memory_budget.hpp"
+#include "pipeline_state.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// How often the metrics file is rewritten.
+constexpr auto g_telemetry_interval = std::chrono::seconds(10);
+
+// Metrics for watching many machines without attaching a profiler, written
+// every g_telemetry_interval to a file in the Prometheus text format, which
+// node_exporter's textfile collector serves as is. The file is replaced
+// through a rename, so a scrape never sees half of it. It holds the frame
+// time quantiles of the interval, the frames and dropped frames of the run,
+// the budget and usage of every memory heap, the live device memory
+// allocations and the pipelines compiled and still compiling.
+struct Telemetry {
+	std::filesystem::path path;
+	std::chrono::steady_clock::time_point next_write;
+	std::optional<std::chrono::steady_clock::time_point> last_frame_end;
+	// Frame times of the interval, in milliseconds.
+	std::vector<double> frame_times;
+	uint64_t frames{};
+	double frame_milliseconds{};
+	// Frames that took twice the median of their interval or longer.
+	uint64_t dropped_frames{};
+};
+
+// An empty path writes nothing.
+auto create_telemetry(const std::filesystem::path& path) -> Telemetry;
+
+// Called once per frame, after it was presented. Frame times are measured
+// between consecutive calls.
+void end_telemetry_frame(
+		Telemetry& telemetry,
+		const Allocator& allocator,
+		const MemoryBudget& budget,
+		const PipelineStateCache& pipelines);
@@ -0,0 +1,400 @@
+#include "temporal.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <optional>
+
+namespace {
+
+constexpr auto g_temporal_scene_binding = 0U;
+constexpr auto g_temporal_motion_binding = 1U;
+constexpr auto g_temporal_history_binding = 2U;
+constexpr auto g_temporal_resolved_binding = 3U;
+
+// Offsets of the jitter sequence at native resolution, more when upscaling.
+constexpr auto g_jitter_phases = 8.0F;
+constexpr auto g_max_jitter_phases = 64.0F;
+
+constexpr auto g_sampled_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in temporal.comp.
+struct TemporalConstants {
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t render_width{};
+	uint32_t render_height{};
+	float history_texel_x{};
+	float history_texel_y{};
+	float jitter_x{};
+	float jitter_y{};
+	float current_weight{};
+	uint32_t history_valid{};
+};
+
+// Writes the pass's set for this frame's views.
+auto write_temporal_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		DescriptorAllocator& descriptors,
+		const TemporalAa& temporal,
+		size_t frame_idx,
+		std::array<uint32_t, 4> images) -> FrameSet {
+	auto image_descriptors = std::array<FrameImageDescriptor, 4>{};
+	for (auto i = size_t{}; i < image_descriptors.size(); i++) {
+		auto storage = i == g_temporal_resolved_binding;
+		image_descriptors.at(i) = FrameImageDescriptor{
+				.binding = static_cast<uint32_t>(i),
+				.type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+												: VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.image = VkDescriptorImageInfo{
+						.sampler = storage ? VK_NULL_HANDLE : temporal.sampler,
+						.imageView = graph_image_view(graph, images.at(i)),
+						.imageLayout = storage ? VK_IMAGE_LAYOUT_GENERAL
+																	 : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+	}
+	return write_frame_set(
+			device,
+			descriptors,
+			frame_idx,
+			temporal.set_layout,
+			image_descriptors);
+}
+
+}  // namespace
+
+auto halton(uint32_t index, uint32_t base) -> float {
+	auto result = 0.0F;
+	auto fraction = 1.0F;
+	for (auto i = index; i > 0; i /= base) {
+		fraction /= static_cast<float>(base);
+		result += fraction * static_cast<float>(i % base);
+	}
+	return result;
+}
+
+auto create_temporal_aa(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors) -> TemporalAa {
+	auto temporal = TemporalAa{};
+	// The scene and motion vectors are fetched texel by texel, the history
+	// is sampled linearly where it was reprojected to.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	temporal.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto sampled_binding = [&](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = &temporal.sampler};
+	};
+	auto bindings = std::array{
+			sampled_binding(g_temporal_scene_binding),
+			sampled_binding(g_temporal_motion_binding),
+			sampled_binding(g_temporal_history_binding),
+			VkDescriptorSetLayoutBinding{
+					.binding = g_temporal_resolved_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_layout_flags(descriptors),
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&temporal.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create temporal set layout\n");
+		std::terminate();
+	}
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(TemporalConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &temporal.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&temporal.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create temporal pipeline layout\n");
+		std::terminate();
+	}
+	temporal.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			temporal.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	return temporal;
+}
+
+void destroy_temporal_aa(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Allocator& allocator,
+		TemporalAa& temporal) {
+	for (auto i = size_t{}; i < temporal.history.size(); i++) {
+		vkDestroyImageView(device, temporal.history_views.at(i), host_callbacks());
+		destroy_image(device, allocator, temporal.history.at(i));
+	}
+	vkDestroyPipeline(device, temporal.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, temporal.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, temporal.set_layout, host_callbacks());
+	release_sampler(device, samplers, temporal.sampler);
+	temporal = TemporalAa{};
+}
+
+void resize_temporal_aa(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		TemporalAa& temporal,
+		VkExtent2D target_extent) {
+	if (target_extent.width == temporal.extent.width &&
+			target_extent.height == temporal.extent.height) {
+		return;
+	}
+	if (temporal.history.at(0).handle != VK_NULL_HANDLE) {
+		defer_deletion(
+				deletion_queue,
+				[&device,
+				 &allocator,
+				 history = temporal.history,
+				 views = temporal.history_views]() mutable {
+					for (auto i = size_t{}; i < history.size(); i++) {
+						vkDestroyImageView(device, views.at(i), host_callbacks());
+						destroy_image(device, allocator, history.at(i));
+					}
+				});
+	}
+	temporal.extent = target_extent;
+	temporal.history_valid = false;
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_temporal_history_format,
+			.extent =
+					VkExtent3D{
+							.width = target_extent.width,
+							.height = target_extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	for (auto i = size_t{}; i < temporal.history.size(); i++) {
+		temporal.history.at(i) = create_image(
+				device,
+				allocator,
+				image_info,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0);
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = temporal.history.at(i).handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = g_temporal_history_format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = VkImageSubresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1}};
+		if (vkCreateImageView(
+						device,
+						&view_info,
+						host_callbacks(),
+						&temporal.history_views.at(i)) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create temporal history view\n");
+			std::terminate();
+		}
+	}
+}
+
+auto temporal_draw_uniforms(
+		TemporalAa& temporal,
+		const glm::mat4& transform,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> DrawUniforms {
+	auto scale = static_cast<float>(target_extent.height) /
+			static_cast<float>(render_extent.height);
+	auto phases = static_cast<uint32_t>(std::clamp(
+			std::ceil(g_jitter_phases * scale * scale),
+			g_jitter_phases,
+			g_max_jitter_phases));
+	temporal.jitter_index = temporal.jitter_index % phases + 1;
+	temporal.jitter = glm::vec2(
+			halton(temporal.jitter_index, 2) - 0.5F,
+			halton(temporal.jitter_index, 3) - 0.5F);
+	// Moves clip space x and y by the jitter times w, so the pixels shift by
+	// the jitter after the divide.
+	auto offset = temporal.jitter * 2.0F /
+			glm::vec2(
+					static_cast<float>(render_extent.width),
+					static_cast<float>(render_extent.height));
+	auto jitter_transform = glm::mat4(1.0F);
+	jitter_transform[3] = glm::vec4(offset, 0.0F, 1.0F);
+	auto uniforms = DrawUniforms{
+			.transform = jitter_transform * transform,
+			.previous_transform = temporal.previous_transform,
+			.jitter = glm::vec4(offset, 0.0F, 0.0F)};
+	temporal.previous_transform = transform;
+	return uniforms;
+}
+
+auto add_temporal_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		TemporalAa& temporal,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t motion,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> uint32_t {
+	auto current = temporal.current;
+	auto previous = 1 - current;
+	// Every image the accumulation uses is left readable at the end of the
+	// frame, so the next frame's write waits for the reads.
+	auto used = temporal.history_valid ? g_sampled_read : GraphState{};
+	auto history = import_graph_image(
+			graph,
+			temporal.history.at(previous).handle,
+			temporal.history_views.at(previous),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			std::nullopt);
+	auto resolved = import_graph_image(
+			graph,
+			temporal.history.at(current).handle,
+			temporal.history_views.at(current),
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			used,
+			g_sampled_read);
+	auto constants = TemporalConstants{
+			.width = target_extent.width,
+			.height = target_extent.height,
+			.render_width = render_extent.width,
+			.render_height = render_extent.height,
+			.history_texel_x = 1.0F / static_cast<float>(temporal.extent.width),
+			.history_texel_y = 1.0F / static_cast<float>(temporal.extent.height),
+			.jitter_x = temporal.jitter.x,
+			.jitter_y = temporal.jitter.y,
+			.current_weight = temporal.settings.current_weight,
+			.history_valid = temporal.history_valid ? 1U : 0U};
+	auto images = std::array{scene, motion, history, resolved};
+	auto record = [&device, &graph, &profiler, &descriptors, &temporal, frame_idx,
+								 constants, images](VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "temporal");
+		auto set = write_temporal_set(
+				device,
+				graph,
+				descriptors,
+				temporal,
+				frame_idx,
+				images);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				temporal.pipeline);
+		bind_frame_set(
+				command_buffer,
+				descriptors,
+				frame_idx,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				temporal.pipeline_layout,
+				0,
+				set);
+		vkCmdPushConstants(
+				command_buffer,
+				temporal.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(constants.width + g_temporal_group_size - 1) / g_temporal_group_size,
+				(constants.height + g_temporal_group_size - 1) /
+						g_temporal_group_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "temporal", record, false);
+	graph_read(graph, pass, scene, g_sampled_read);
+	graph_read(graph, pass, motion, g_sampled_read);
+	graph_read(graph, pass, history, g_sampled_read);
+	graph_write(graph, pass, resolved, g_storage_write);
+	temporal.current = previous;
+	temporal.history_valid = true;
+	return resolved;
+}
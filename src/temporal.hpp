@@ -0,0 +1,116 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "deletion.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "uniforms.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Matches local_size in temporal.comp.
+constexpr auto g_temporal_group_size = 8U;
+// The main pass's second color attachment, written by the MOTION_VECTORS
+// variant of shader.frag: how far each pixel's surface moved since the last
+// frame, in normalized coordinates of the render area.
+constexpr auto g_motion_format = VK_FORMAT_R16G16_SFLOAT;
+// The accumulated scene, which the post passes read in place of the scene.
+constexpr auto g_temporal_history_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+struct TemporalSettings {
+	// The weight of a frame's sample that lands on an output pixel's center,
+	// less for samples further from it. Lower is smoother but slower to pick
+	// up changes.
+	float current_weight{0.1F};
+};
+
+// Temporal anti-aliasing and upscaling. Every frame is drawn with a different
+// sub-pixel jitter, and temporal.comp accumulates the frames at the output
+// resolution. The accumulation ping-pongs between two history images, which
+// outlive the frame, so they are imported into the graph rather than being
+// transients. The pass's set is binding 0 the scene, binding 1 the motion
+// vectors, binding 2 the previous history, all sampled, and binding 3 the
+// history written, written every frame like the post passes' sets.
+struct TemporalAa {
+	TemporalSettings settings;
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::array<Image, 2> history;
+	std::array<VkImageView, 2> history_views{};
+	VkExtent2D extent{};
+	// The history the next frame writes, the other one is the previous.
+	uint32_t current{};
+	// Whether the previous history holds an earlier frame. Both images were
+	// used by a frame then, and were left readable.
+	bool history_valid{};
+	uint32_t jitter_index{};
+	// This frame's jitter in render pixels, and last frame's transform.
+	glm::vec2 jitter{};
+	glm::mat4 previous_transform{1.0F};
+};
+
+// The index'th element of the Halton sequence in base, in [0, 1). Jittered
+// samples step through bases 2 and 3, which cover the square evenly at every
+// length.
+auto halton(uint32_t index, uint32_t base) -> float;
+
+// descriptors is the allocator the pass is added with.
+auto create_temporal_aa(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors) -> TemporalAa;
+// The device must be idle.
+void destroy_temporal_aa(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Allocator& allocator,
+		TemporalAa& temporal);
+
+// Recreates the history when the target's extent changed, the old images
+// are destroyed once the frames using them are done. The accumulation starts
+// over.
+void resize_temporal_aa(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletion_queue,
+		TemporalAa& temporal,
+		VkExtent2D target_extent);
+
+// The frame's constants for the draws of transform, which is jittered by the
+// next offset of the sequence and paired with last frame's for the motion
+// vectors. Upscaled frames cycle through more offsets, so every output pixel
+// gets samples near its center.
+auto temporal_draw_uniforms(
+		TemporalAa& temporal,
+		const glm::mat4& transform,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> DrawUniforms;
+
+// Adds the pass accumulating the top left render_extent of scene into the
+// history, and returns the history written, which covers target_extent. Must
+// be called after resize_temporal_aa and the frame fence was waited on. scene
+// must be sampled and motion created with g_motion_format, both covering
+// target_extent.
+auto add_temporal_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		TemporalAa& temporal,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t motion,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> uint32_t;
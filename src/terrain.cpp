@@ -0,0 +1,633 @@
+#include "terrain.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+#include <glm/common.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+namespace {
+
+// Texels between a window's start and the first cell a level draws.
+constexpr auto g_clipmap_margin = (g_clipmap_size - g_clipmap_cells) / 2;
+static_assert(g_clipmap_margin >= 1 && g_clipmap_cells % 4 == 0);
+constexpr auto g_terrain_format = VK_FORMAT_R16_UINT;
+
+// The flight, in meters, meters per frame and radians.
+constexpr auto g_flight_height = 900.0F;
+constexpr auto g_flight_speed = 4.0F;
+constexpr auto g_flight_heading = 0.6F;
+constexpr auto g_flight_pitch = -0.25F;
+constexpr auto g_flight_fov = 1.0F;
+constexpr auto g_flight_near = 1.0F;
+
+// The material's level 0 in texels along each side, its pages, and the pages
+// its atlas holds along each side. Keep in sync with terrain.frag.
+constexpr auto g_material_size = 16384U;
+constexpr auto g_material_page_size = 128U;
+constexpr auto g_material_atlas_pages = 16U;
+constexpr auto g_material_page_budget = 16U;
+// Linear, like the colors terrain.frag mixes.
+constexpr auto g_material_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+// Layout matches the push_constant block of terrain.vert.
+struct TerrainConstants {
+	BindlessHandle uniform_buffer{};
+	uint32_t transform{};
+	BindlessHandle heights{};
+	BindlessHandle sampler{};
+	float texel_size{};
+	float height_scale{};
+	std::array<glm::ivec2, g_max_clipmap_levels> origins{};
+	// The VIRTUAL_TEXTURE variant's material, see TerrainMaterial, which only
+	// terrain.frag reads.
+	BindlessHandle page_table{};
+	BindlessHandle feedback{};
+	BindlessHandle atlas{};
+	BindlessHandle atlas_sampler{};
+	float period{};
+};
+static_assert(sizeof(TerrainConstants) == 108);
+
+constexpr auto g_terrain_stages = VkShaderStageFlags{
+		VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT};
+
+auto create_layout(VkDevice& device, const BindlessTable& bindless)
+		-> VkPipelineLayout {
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = g_terrain_stages,
+			.offset = 0,
+			.size = sizeof(TerrainConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &bindless.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	auto* layout = VkPipelineLayout{};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create terrain pipeline layout\n");
+		std::terminate();
+	}
+	return layout;
+}
+
+// Level texel the window of level is to start at. The window's center is
+// snapped to even texels, so the cells a level draws start on a texel of the
+// next level and the next level can leave out exactly those.
+auto window_origin(glm::vec2 center, uint32_t level) -> glm::ivec2 {
+	auto texels = center /
+			(g_terrain_texel_size * static_cast<float>(1U << level));
+	auto snapped = 2.0F * glm::floor(texels * 0.5F + 0.5F);
+	return glm::ivec2(snapped) - static_cast<int32_t>(g_clipmap_size / 2);
+}
+
+// Where [to, to + g_clipmap_size) leaves [from, from + g_clipmap_size), what
+// a window moving from from to to has to load along one direction.
+auto entered(int32_t from, int32_t to) -> std::pair<int32_t, int32_t> {
+	constexpr auto size = static_cast<int32_t>(g_clipmap_size);
+	if (to > from) {
+		return {std::max(from + size, to), to + size};
+	}
+	return {to, std::min(from, to + size)};
+}
+
+// Writes texels [begin, end) of level, which must not wrap around the
+// clipmap.
+void load_texels(
+		VkDevice& device,
+		Uploader& uploader,
+		Terrain& terrain,
+		const Heightfield& heightfield,
+		const ClipmapFrame& frame,
+		uint32_t level,
+		glm::ivec2 begin,
+		glm::ivec2 end) {
+	auto width = static_cast<uint32_t>(end.x - begin.x);
+	auto height = static_cast<uint32_t>(end.y - begin.y);
+	terrain.texels.resize(size_t{width} * height);
+	auto size = int64_t{heightfield.size};
+	auto step = int64_t{1} << level;
+	for (auto y = uint32_t{}; y < height; y++) {
+		// The heightfield repeats, so the texel is taken modulo its size.
+		auto row = ((begin.y + int64_t{y}) * step % size + size) % size;
+		for (auto x = uint32_t{}; x < width; x++) {
+			auto column = ((begin.x + int64_t{x}) * step % size + size) % size;
+			terrain.texels[size_t{y} * width + x] =
+					heightfield.heights[static_cast<size_t>(row * size + column)];
+		}
+	}
+	auto mask = static_cast<int32_t>(g_clipmap_size - 1);
+	update_image(
+			device,
+			uploader,
+			frame.heights.handle,
+			VkImageSubresourceLayers{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1},
+			VkOffset3D{
+					.x = begin.x & mask,
+					.y = static_cast<int32_t>(level * g_clipmap_size) +
+							(begin.y & mask),
+					.z = 0},
+			VkExtent3D{.width = width, .height = height, .depth = 1},
+			std::as_bytes(std::span(terrain.texels)),
+			VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+}
+
+// Writes texels [begin, end) of level, split where they wrap around the
+// clipmap. Empty regions write nothing.
+void load_region(
+		VkDevice& device,
+		Uploader& uploader,
+		Terrain& terrain,
+		const Heightfield& heightfield,
+		const ClipmapFrame& frame,
+		uint32_t level,
+		glm::ivec2 begin,
+		glm::ivec2 end) {
+	if (begin.x >= end.x || begin.y >= end.y) {
+		return;
+	}
+	constexpr auto size = static_cast<int32_t>(g_clipmap_size);
+	// Wraps at the next multiple of the size after begin.
+	auto split = glm::min(end, begin + size - (begin & (size - 1)));
+	auto ranges_x = std::array{
+			std::pair{begin.x, split.x},
+			std::pair{split.x, end.x}};
+	auto ranges_y = std::array{
+			std::pair{begin.y, split.y},
+			std::pair{split.y, end.y}};
+	for (auto [y0, y1] : ranges_y) {
+		for (auto [x0, x1] : ranges_x) {
+			if (x0 < x1 && y0 < y1) {
+				load_texels(
+						device,
+						uploader,
+						terrain,
+						heightfield,
+						frame,
+						level,
+						glm::ivec2(x0, y0),
+						glm::ivec2(x1, y1));
+			}
+		}
+	}
+}
+
+// The height in meters at heightfield texel coordinates, filtered between
+// the four texels around them. The heightfield repeats.
+auto sample_height(const Heightfield& heightfield, glm::vec2 texel) -> float {
+	auto size = static_cast<int64_t>(heightfield.size);
+	auto base = glm::floor(texel);
+	auto weight = texel - base;
+	auto fetch = [&](int64_t x, int64_t y) {
+		auto column = (x % size + size) % size;
+		auto row = (y % size + size) % size;
+		return static_cast<float>(
+				heightfield.heights[static_cast<size_t>(row * size + column)]);
+	};
+	auto x = static_cast<int64_t>(base.x);
+	auto y = static_cast<int64_t>(base.y);
+	auto top = glm::mix(fetch(x, y), fetch(x + 1, y), weight.x);
+	auto bottom = glm::mix(fetch(x, y + 1), fetch(x + 1, y + 1), weight.x);
+	return glm::mix(top, bottom, weight.y) / 65535.0F * g_terrain_height_scale;
+}
+
+// Bakes a page of the material like terrain.frag shades without it, from the
+// slope and height at each texel, with a grain that only shows up close.
+void bake_material_page(
+		const Heightfield& heightfield,
+		uint32_t level,
+		uint32_t x,
+		uint32_t y,
+		std::span<std::byte> texels) {
+	const auto grass = glm::vec3(0.18F, 0.3F, 0.1F);
+	const auto rock = glm::vec3(0.35F, 0.32F, 0.28F);
+	const auto snow = glm::vec3(0.9F, 0.92F, 0.95F);
+	// Heightfield texels a texel of the level covers, and the distance the
+	// slope is taken over, never under a heightfield texel.
+	auto samples = static_cast<float>(heightfield.size) /
+			static_cast<float>(g_material_size >> level);
+	auto step = std::max(samples, 1.0F);
+	for (auto row = 0U; row < g_material_page_size; row++) {
+		for (auto column = 0U; column < g_material_page_size; column++) {
+			auto global = glm::uvec2(
+					x * g_material_page_size + column,
+					y * g_material_page_size + row);
+			auto texel = (glm::vec2(global) + 0.5F) * samples;
+			auto dx = sample_height(heightfield, texel + glm::vec2(step, 0.0F)) -
+					sample_height(heightfield, texel - glm::vec2(step, 0.0F));
+			auto dz = sample_height(heightfield, texel + glm::vec2(0.0F, step)) -
+					sample_height(heightfield, texel - glm::vec2(0.0F, step));
+			auto normal = glm::normalize(
+					glm::vec3(-dx, 2.0F * step * g_terrain_texel_size, -dz));
+			auto height =
+					sample_height(heightfield, texel) / g_terrain_height_scale;
+			auto color =
+					glm::mix(grass, rock, glm::smoothstep(0.9F, 0.7F, normal.y));
+			color = glm::mix(
+					color,
+					snow,
+					glm::smoothstep(0.75F, 0.85F, height) *
+							glm::smoothstep(0.6F, 0.8F, normal.y));
+			auto hash = (global.x * 73856093U) ^ (global.y * 19349663U) ^
+					(level * 83492791U);
+			hash *= 2654435761U;
+			auto grain = 0.9F + 0.2F * static_cast<float>(hash >> 24U) / 255.0F;
+			color = glm::clamp(color * grain, 0.0F, 1.0F) * 255.0F + 0.5F;
+			auto* out = &texels[(size_t{row} * g_material_page_size + column) * 4];
+			out[0] = static_cast<std::byte>(color.r);
+			out[1] = static_cast<std::byte>(color.g);
+			out[2] = static_cast<std::byte>(color.b);
+			out[3] = std::byte{255};
+		}
+	}
+}
+
+}  // namespace
+
+auto open_heightfield(const std::filesystem::path& path) -> Heightfield {
+	auto file = map_file(path);
+	if (!file.has_value()) {
+		fmt::print(stderr, "Failed to map heightfield {}\n", path.string());
+		std::terminate();
+	}
+	auto count = file->bytes.size() / sizeof(uint16_t);
+	auto size = static_cast<uint32_t>(std::sqrt(static_cast<double>(count)));
+	while (size_t{size} * size > count) {
+		size--;
+	}
+	while (size_t{size + 1} * (size + 1) <= count) {
+		size++;
+	}
+	if (size < 2 || size_t{size} * size * sizeof(uint16_t) !=
+					file->bytes.size()) {
+		fmt::print(
+				stderr,
+				"{} is not a square heightfield of 16-bit heights\n",
+				path.string());
+		std::terminate();
+	}
+	auto heightfield = Heightfield{};
+	heightfield.size = size;
+	// The mapping is page aligned.
+	heightfield.heights = std::span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<const uint16_t*>(file->bytes.data()),
+			size_t{size} * size);
+	heightfield.file = *file;
+	return heightfield;
+}
+
+void close_heightfield(Heightfield& heightfield) {
+	unmap_file(heightfield.file);
+	heightfield = Heightfield{};
+}
+
+auto create_terrain(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> Terrain {
+	auto terrain = Terrain{};
+	terrain.draw_layout = create_layout(device, bindless);
+	// Heights are fetched texel by texel, integer formats cannot be filtered.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_NEAREST,
+			.minFilter = VK_FILTER_NEAREST,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	terrain.sampler = acquire_sampler(device, samplers, sampler_info);
+	terrain.sampler_handle =
+			add_bindless_sampler(device, bindless, terrain.sampler);
+
+	auto concurrent = queue_families[0] != queue_families[1];
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = g_terrain_format,
+			.extent =
+					VkExtent3D{
+							.width = g_clipmap_size,
+							.height = g_clipmap_size * g_max_clipmap_levels,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode =
+					concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = concurrent ? 2U : 0U,
+			.pQueueFamilyIndices = concurrent ? queue_families.data() : nullptr,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	auto range = VkImageSubresourceRange{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1};
+	terrain.frames.resize(frame_count);
+	for (auto& frame : terrain.frames) {
+		frame.heights = create_image(
+				device,
+				allocator,
+				image_info,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				0);
+		auto view_info = VkImageViewCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.image = frame.heights.handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = g_terrain_format,
+				.components =
+						VkComponentMapping{
+								.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+								.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+				.subresourceRange = range};
+		if (vkCreateImageView(
+						device,
+						&view_info,
+						host_callbacks(),
+						&frame.heights_view) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create a clipmap view\n");
+			std::terminate();
+		}
+		// Rows and columns are written while they are not drawn, so the
+		// clipmap stays in GENERAL.
+		frame.heights_handle = add_bindless_image(
+				device,
+				bindless,
+				frame.heights_view,
+				VK_IMAGE_LAYOUT_GENERAL);
+		initialize_image(
+				device,
+				uploader,
+				frame.heights.handle,
+				range,
+				VK_IMAGE_LAYOUT_GENERAL,
+				VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	}
+	return terrain;
+}
+
+void destroy_terrain(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		Terrain& terrain) {
+	for (auto& frame : terrain.frames) {
+		remove_bindless_image(device, bindless, frame.heights_handle);
+		vkDestroyImageView(device, frame.heights_view, host_callbacks());
+		destroy_image(device, allocator, frame.heights);
+	}
+	remove_bindless_sampler(device, bindless, terrain.sampler_handle);
+	release_sampler(device, samplers, terrain.sampler);
+	vkDestroyPipelineLayout(device, terrain.draw_layout, host_callbacks());
+	terrain = Terrain{};
+}
+
+void update_terrain(
+		VkDevice& device,
+		Uploader& uploader,
+		Terrain& terrain,
+		const Heightfield& heightfield,
+		size_t frame_idx,
+		glm::vec2 center) {
+	auto& frame = terrain.frames.at(frame_idx);
+	constexpr auto size = static_cast<int32_t>(g_clipmap_size);
+	for (auto level = uint32_t{}; level < g_max_clipmap_levels; level++) {
+		auto origin = window_origin(center, level);
+		auto& previous = frame.origins.at(level);
+		if (!frame.filled) {
+			load_region(
+					device,
+					uploader,
+					terrain,
+					heightfield,
+					frame,
+					level,
+					origin,
+					origin + size);
+		} else if (origin != previous) {
+			// The columns that came into view in every row of the window, then
+			// the rows that came into view in the columns that stayed.
+			auto [x0, x1] = entered(previous.x, origin.x);
+			auto [y0, y1] = entered(previous.y, origin.y);
+			load_region(
+					device,
+					uploader,
+					terrain,
+					heightfield,
+					frame,
+					level,
+					glm::ivec2(x0, origin.y),
+					glm::ivec2(x1, origin.y + size));
+			load_region(
+					device,
+					uploader,
+					terrain,
+					heightfield,
+					frame,
+					level,
+					glm::ivec2(std::max(previous.x, origin.x), y0),
+					glm::ivec2(std::min(previous.x, origin.x) + size, y1));
+		}
+		previous = origin;
+	}
+	frame.filled = true;
+}
+
+auto create_terrain_material(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const Heightfield& heightfield,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> TerrainMaterial {
+	auto material = TerrainMaterial{};
+	material.texture = create_virtual_texture(
+			device,
+			allocator,
+			uploader,
+			bindless,
+			VirtualTextureInfo{
+					.format = g_material_format,
+					.texel_size = 4,
+					.width = g_material_size,
+					.height = g_material_size,
+					.page_size = g_material_page_size,
+					.atlas_width = g_material_atlas_pages,
+					.atlas_height = g_material_atlas_pages,
+					.page_budget = g_material_page_budget},
+			[&heightfield](
+					uint32_t level,
+					uint32_t x,
+					uint32_t y,
+					std::span<std::byte> texels) {
+				bake_material_page(heightfield, level, x, y, texels);
+			},
+			queue_families,
+			frame_count);
+	material.period =
+			static_cast<float>(heightfield.size) * g_terrain_texel_size;
+	// terrain.frag keeps lookups half a texel inside their page.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	material.sampler = acquire_sampler(device, samplers, sampler_info);
+	material.sampler_handle =
+			add_bindless_sampler(device, bindless, material.sampler);
+	return material;
+}
+
+void destroy_terrain_material(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		TerrainMaterial& material) {
+	remove_bindless_sampler(device, bindless, material.sampler_handle);
+	release_sampler(device, samplers, material.sampler);
+	destroy_virtual_texture(device, allocator, bindless, material.texture);
+	material = TerrainMaterial{};
+}
+
+void draw_terrain(
+		VkCommandBuffer command_buffer,
+		const Terrain& terrain,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		const TerrainMaterial* material) {
+	const auto& frame = terrain.frames.at(frame_idx);
+	bind_bindless_table(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			terrain.draw_layout,
+			bindless);
+	auto constants = TerrainConstants{
+			.uniform_buffer = uniform_buffer,
+			.transform = transform,
+			.heights = frame.heights_handle,
+			.sampler = terrain.sampler_handle,
+			.texel_size = g_terrain_texel_size,
+			.height_scale = g_terrain_height_scale,
+			.origins = frame.origins,
+			.page_table = {},
+			.feedback = {},
+			.atlas = {},
+			.atlas_sampler = {},
+			.period = 0.0F};
+	if (material != nullptr) {
+		const auto& texture_frame = material->texture.frames.at(frame_idx);
+		constants.page_table = texture_frame.page_table_handle;
+		constants.feedback = texture_frame.feedback_handle;
+		constants.atlas = material->texture.atlas_handle;
+		constants.atlas_sampler = material->sampler_handle;
+		constants.period = material->period;
+	}
+	vkCmdPushConstants(
+			command_buffer,
+			terrain.draw_layout,
+			g_terrain_stages,
+			0,
+			sizeof(constants),
+			&constants);
+	// Two triangles per cell, an instance per level.
+	vkCmdDraw(
+			command_buffer,
+			g_clipmap_cells * g_clipmap_cells * 6,
+			g_max_clipmap_levels,
+			0,
+			0);
+}
+
+auto terrain_flight(size_t frame, float aspect) -> TerrainView {
+	auto heading =
+			glm::vec2(std::cos(g_flight_heading), std::sin(g_flight_heading));
+	auto ground = heading * g_flight_speed * static_cast<float>(frame);
+	auto view = TerrainView{
+			.eye = glm::vec3(ground.x, g_flight_height, ground.y),
+			.transform = glm::mat4{1.0F}};
+	auto forward = glm::vec3(
+			heading.x * std::cos(g_flight_pitch),
+			std::sin(g_flight_pitch),
+			heading.y * std::cos(g_flight_pitch));
+	auto look = glm::lookAt(
+			view.eye,
+			view.eye + forward,
+			glm::vec3(0.0F, 1.0F, 0.0F));
+	// Infinite and reversed: the near plane is at depth 1 and the horizon at
+	// 0. Clip y points down.
+	auto focal = 1.0F / std::tan(0.5F * g_flight_fov);
+	auto projection = glm::mat4{0.0F};
+	projection[0][0] = focal / std::max(aspect, 1e-3F);
+	projection[1][1] = -focal;
+	projection[2][3] = -1.0F;
+	projection[3][2] = g_flight_near;
+	view.transform = projection * look;
+	return view;
+}
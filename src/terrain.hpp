@@ -0,0 +1,171 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "mapped_file.hpp"
+#include "object_cache.hpp"
+#include "pipeline.hpp"
+#include "upload.hpp"
+#include "virtual_texture.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+// Texels of a clipmap level in each direction, a power of two so that
+// terrain.vert wraps them with a mask. A level draws a grid of
+// g_clipmap_cells squared around the camera, which needs one texel more than
+// that in each direction; the rest is slack for the window to be snapped.
+constexpr auto g_clipmap_size = 128U;
+constexpr auto g_clipmap_cells = 124U;
+constexpr auto g_max_clipmap_levels = 8U;
+// Meters between the heightfield's texels, and at its largest height.
+constexpr auto g_terrain_texel_size = 10.0F;
+constexpr auto g_terrain_height_scale = 600.0F;
+
+// Level l + 1 is drawn around level l, leaving out the cells it covers.
+constexpr auto g_terrain_raster = RasterState{
+		.cull_mode = VK_CULL_MODE_NONE,
+		.front_face = VK_FRONT_FACE_CLOCKWISE,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+
+// A raw file of square rows of little endian 16-bit heights, 0 to
+// g_terrain_height_scale meters, mapped. It repeats in every direction, so
+// the terrain has no edge to fly off.
+struct Heightfield {
+	MappedFile file;
+	std::span<const uint16_t> heights;
+	uint32_t size{};
+};
+
+auto open_heightfield(const std::filesystem::path& path) -> Heightfield;
+void close_heightfield(Heightfield& heightfield);
+
+// A frame in flight's copy of the clipmap, level l in rows l * g_clipmap_size
+// on. Texel (x, y) of level l, counted from the heightfield's first texel in
+// steps of 2^l, is stored at (x, y) modulo g_clipmap_size, so a window moving
+// by a texel only needs the row or column it moved onto.
+struct ClipmapFrame {
+	Image heights;
+	VkImageView heights_view{};
+	BindlessHandle heights_handle{};
+	// Level texel the window of each level starts at, g_clipmap_size in each
+	// direction from there.
+	std::array<glm::ivec2, g_max_clipmap_levels> origins{};
+	bool filled{};
+};
+
+// Terrain as a geometry clipmap, after Losasso and Hoppe: nested grids of the
+// same cell count around the camera, each level's cells twice the size of
+// the last one's, sampling a level of a clipmap whose texels are taken from
+// the heightfield at the same spacing. The grids are generated by
+// terrain.vert from the vertex index, so nothing but the clipmap is streamed,
+// and near a level's outer edge its heights blend into the next level's so
+// the two meet without cracks.
+//
+// Every frame in flight has its own clipmap, so the rows and columns that
+// come into view can be written while earlier frames still draw theirs. A
+// frame slot's clipmap is only updated once its last frame is done, with
+// what came into view since then, which is a few rows and columns per level
+// however far the heightfield reaches.
+struct Terrain {
+	VkPipelineLayout draw_layout{};
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+	std::vector<ClipmapFrame> frames;
+	std::vector<uint16_t> texels;
+};
+
+// queue_families are the graphics and upload families, the clipmaps are
+// shared between them when they differ.
+auto create_terrain(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> Terrain;
+// The device must be idle.
+void destroy_terrain(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		Terrain& terrain);
+
+// Centers the frame slot's levels on center, in meters, and writes what came
+// into their windows into the uploader's current batch, which the frame that
+// draws them has to acquire. The slot's last frame must be complete.
+void update_terrain(
+		VkDevice& device,
+		Uploader& uploader,
+		Terrain& terrain,
+		const Heightfield& heightfield,
+		size_t frame_idx,
+		glm::vec2 center);
+
+// The grass, rock and snow terrain.frag shades with, baked from the
+// heightfield into a virtual texture over one repeat of it. The
+// VIRTUAL_TEXTURE variant of terrain.frag samples it with the frame's page
+// table and asks for the pages it would like through the frame's feedback,
+// so only the pages around the flight are kept, at texels of a few meters
+// near it.
+struct TerrainMaterial {
+	VirtualTexture texture;
+	// Meters the texture spans along each side.
+	float period{};
+	VkSampler sampler{};
+	BindlessHandle sampler_handle{};
+};
+
+// Pages are baked from heightfield as they are asked for, so it must outlive
+// the material. queue_families are as for create_terrain.
+auto create_terrain_material(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		const Heightfield& heightfield,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> TerrainMaterial;
+// The device must be idle.
+void destroy_terrain_material(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		SamplerCache& samplers,
+		TerrainMaterial& material);
+
+// The bound pipeline must be one of terrain.vert and terrain.frag with
+// draw_layout. transform is the uniform slot of the matrix from the
+// terrain's meters, y up, to clip space. material is only read by the
+// VIRTUAL_TEXTURE variant, and null without it.
+void draw_terrain(
+		VkCommandBuffer command_buffer,
+		const Terrain& terrain,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		BindlessHandle uniform_buffer,
+		uint32_t transform,
+		const TerrainMaterial* material);
+
+// A flight over the terrain at a steady height and speed, the same path for
+// the same frames.
+struct TerrainView {
+	glm::vec3 eye{};
+	// From the terrain's meters to clip space, with the reversed depth of
+	// depth.hpp.
+	glm::mat4 transform{1.0F};
+};
+
+auto terrain_flight(size_t frame, float aspect) -> TerrainView;
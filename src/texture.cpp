@@ -0,0 +1,636 @@
+#include "texture.hpp"
+
+#include "downsample.hpp"
+#include "host_memory.hpp"
+#include "log.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <vector>
+
+namespace {
+
+constexpr auto g_ktx2_identifier = std::array<uint8_t, 12>{
+		0xAB,
+		0x4B,
+		0x54,
+		0x58,
+		0x20,
+		0x32,
+		0x30,
+		0xBB,
+		0x0D,
+		0x0A,
+		0x1A,
+		0x0A};
+
+struct Ktx2Header {
+	std::array<uint8_t, 12> identifier{};
+	uint32_t vk_format{};
+	uint32_t type_size{};
+	uint32_t pixel_width{};
+	uint32_t pixel_height{};
+	uint32_t pixel_depth{};
+	uint32_t layer_count{};
+	uint32_t face_count{};
+	uint32_t level_count{};
+	uint32_t supercompression_scheme{};
+	uint32_t dfd_byte_offset{};
+	uint32_t dfd_byte_length{};
+	uint32_t kvd_byte_offset{};
+	uint32_t kvd_byte_length{};
+	uint64_t sgd_byte_offset{};
+	uint64_t sgd_byte_length{};
+};
+
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2Level {
+	uint64_t byte_offset{};
+	uint64_t byte_length{};
+	uint64_t uncompressed_byte_length{};
+};
+
+struct BlockFormat {
+	VkFormat format{};
+	uint32_t block_width{};
+	uint32_t block_height{};
+	uint32_t block_size{};
+};
+
+// The formats textures can use. Uncompressed RGBA8 is only there as a last
+// resort for devices without any of the compressed families, and RGBA16F
+// for HDR environment maps on devices without BC6H.
+constexpr auto g_block_formats = std::array{
+		BlockFormat{VK_FORMAT_BC7_UNORM_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_BC7_SRGB_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 4, 4, 8},
+		BlockFormat{VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 4, 4, 8},
+		BlockFormat{VK_FORMAT_BC3_UNORM_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_BC3_SRGB_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_BC4_UNORM_BLOCK, 4, 4, 8},
+		BlockFormat{VK_FORMAT_BC5_UNORM_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_BC6H_UFLOAT_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_ASTC_6x6_UNORM_BLOCK, 6, 6, 16},
+		BlockFormat{VK_FORMAT_ASTC_6x6_SRGB_BLOCK, 6, 6, 16},
+		BlockFormat{VK_FORMAT_ASTC_8x8_UNORM_BLOCK, 8, 8, 16},
+		BlockFormat{VK_FORMAT_ASTC_8x8_SRGB_BLOCK, 8, 8, 16},
+		BlockFormat{VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, 4, 4, 8},
+		BlockFormat{VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, 4, 4, 8},
+		BlockFormat{VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, 4, 4, 16},
+		BlockFormat{VK_FORMAT_R8G8B8A8_UNORM, 1, 1, 4},
+		BlockFormat{VK_FORMAT_R8G8B8A8_SRGB, 1, 1, 4},
+		BlockFormat{VK_FORMAT_R16G16B16A16_SFLOAT, 1, 1, 8}};
+
+auto find_block_format(VkFormat format) -> const BlockFormat* {
+	const auto* found = std::find_if(
+			g_block_formats.begin(),
+			g_block_formats.end(),
+			[&](const BlockFormat& entry) { return entry.format == format; });
+	return found == g_block_formats.end() ? nullptr : found;
+}
+
+auto level_size(const BlockFormat& block, VkExtent3D extent) -> VkDeviceSize {
+	auto blocks_x = (extent.width + block.block_width - 1) / block.block_width;
+	auto blocks_y = (extent.height + block.block_height - 1) / block.block_height;
+	return VkDeviceSize{blocks_x} * blocks_y * block.block_size;
+}
+
+auto can_sample(VkPhysicalDevice& physical_device, VkFormat format) -> bool {
+	constexpr auto needed = VkFormatFeatureFlags{
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+			VK_FORMAT_FEATURE_TRANSFER_DST_BIT};
+	auto properties = VkFormatProperties{};
+	vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+	return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+// The layout host copies into the format's images go to: where they are
+// sampled from if host copies can write it, or else GENERAL, which they
+// always can. Nothing when host copies would make sampling the image slower,
+// which some devices report since they cannot compress such images.
+auto host_copy_layout(VkPhysicalDevice& physical_device, VkFormat format)
+		-> std::optional<VkImageLayout> {
+	auto performance = VkHostImageCopyDevicePerformanceQueryEXT{
+			.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.optimalDeviceAccess = VK_FALSE,
+			.identicalMemoryLayout = VK_FALSE};
+	auto format_properties = VkImageFormatProperties2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+			.pNext = &performance,
+			.imageFormatProperties = {}};
+	auto format_info = VkPhysicalDeviceImageFormatInfo2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+			.pNext = VK_NULL_HANDLE,
+			.format = format,
+			.type = VK_IMAGE_TYPE_2D,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT |
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.flags = 0};
+	if (vkGetPhysicalDeviceImageFormatProperties2(
+					physical_device,
+					&format_info,
+					&format_properties) != VK_SUCCESS ||
+			performance.optimalDeviceAccess != VK_TRUE) {
+		return std::nullopt;
+	}
+	auto copy_properties = VkPhysicalDeviceHostImageCopyPropertiesEXT{};
+	copy_properties.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+	auto properties = VkPhysicalDeviceProperties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &copy_properties,
+			.properties = {}};
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	auto layouts = std::vector<VkImageLayout>(copy_properties.copyDstLayoutCount);
+	copy_properties.pCopyDstLayouts = layouts.data();
+	vkGetPhysicalDeviceProperties2(physical_device, &properties);
+	if (std::find(
+					layouts.begin(),
+					layouts.end(),
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) != layouts.end()) {
+		return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	return VK_IMAGE_LAYOUT_GENERAL;
+}
+
+void transition_on_host(
+		VkDevice& device,
+		VkImage image,
+		const VkImageSubresourceRange& range,
+		VkImageLayout from,
+		VkImageLayout to) {
+	auto transition = VkHostImageLayoutTransitionInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.image = image,
+			.oldLayout = from,
+			.newLayout = to,
+			.subresourceRange = range};
+	if (vkTransitionImageLayoutEXT(device, 1, &transition) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to transition a texture level on the host\n");
+		std::terminate();
+	}
+}
+
+// Writes a level straight from the mapped file. Levels are only sampled once
+// resident, so the device is not using this one yet, and the next submission
+// makes the host's writes visible to it.
+void copy_level_on_host(
+		VkDevice& device,
+		const Texture& texture,
+		uint32_t level_idx) {
+	const auto& level = texture.levels.at(level_idx);
+	auto layout = *texture.host_copy_layout;
+	auto range = VkImageSubresourceRange{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = level_idx - texture.base_level,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1};
+	transition_on_host(
+			device,
+			texture.image.handle,
+			range,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			layout);
+	auto region = VkMemoryToImageCopyEXT{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.pHostPointer = texture.file->bytes.subspan(level.offset).data(),
+			.memoryRowLength = 0,
+			.memoryImageHeight = 0,
+			.imageSubresource =
+					VkImageSubresourceLayers{
+							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+							.mipLevel = range.baseMipLevel,
+							.baseArrayLayer = 0,
+							.layerCount = 1},
+			.imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
+			.imageExtent = level.extent};
+	auto copy_info = VkCopyMemoryToImageInfoEXT{
+			.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.dstImage = texture.image.handle,
+			.dstImageLayout = layout,
+			.regionCount = 1,
+			.pRegions = &region};
+	if (vkCopyMemoryToImageEXT(device, &copy_info) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to copy a texture level on the host\n");
+		std::terminate();
+	}
+	if (layout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		transition_on_host(
+				device,
+				texture.image.handle,
+				range,
+				layout,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+}
+
+// Checks the container and fills in the levels. Returns nothing when the
+// device cannot sample the file's format. With generate_levels, files that
+// ask for their chain to be generated get it.
+auto parse_ktx2(
+		VkPhysicalDevice& physical_device,
+		const std::filesystem::path& path,
+		std::span<const std::byte> bytes,
+		bool generate_levels) -> std::optional<Texture> {
+	auto header = Ktx2Header{};
+	if (bytes.size() < sizeof(header)) {
+		fmt::print(stderr, "Truncated KTX2 file {}\n", path.string());
+		std::terminate();
+	}
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (header.identifier != g_ktx2_identifier) {
+		fmt::print(stderr, "Not a KTX2 file {}\n", path.string());
+		std::terminate();
+	}
+	if (header.vk_format == VK_FORMAT_UNDEFINED ||
+			header.supercompression_scheme != 0) {
+		fmt::print(
+				stderr,
+				"KTX2 file {} needs transcoding, which is not supported\n",
+				path.string());
+		std::terminate();
+	}
+	if (header.pixel_width == 0 || header.pixel_height == 0 ||
+			header.pixel_depth > 1 ||
+			header.layer_count > 1 || header.face_count != 1) {
+		fmt::print(stderr, "KTX2 file {} is not a 2D texture\n", path.string());
+		std::terminate();
+	}
+	const auto* block =
+			find_block_format(static_cast<VkFormat>(header.vk_format));
+	if (block == nullptr) {
+		fmt::print(
+				stderr,
+				"KTX2 file {} has unsupported format {}\n",
+				path.string(),
+				header.vk_format);
+		std::terminate();
+	}
+	if (!can_sample(physical_device, block->format)) {
+		return std::nullopt;
+	}
+
+	// A level count of zero asks for the chain to be generated, only the base
+	// level is stored then.
+	auto level_count = std::max(header.level_count, 1U);
+	auto largest = std::max(header.pixel_width, header.pixel_height);
+	if (level_count > 32 || (largest >> (level_count - 1)) == 0) {
+		fmt::print(stderr, "KTX2 file {} has too many levels\n", path.string());
+		std::terminate();
+	}
+	if (bytes.size() < sizeof(header) + level_count * sizeof(Ktx2Level)) {
+		fmt::print(stderr, "Truncated KTX2 file {}\n", path.string());
+		std::terminate();
+	}
+	auto texture = Texture{};
+	texture.format = block->format;
+	texture.levels.resize(level_count);
+	for (auto i = uint32_t{}; i < level_count; i++) {
+		auto level = Ktx2Level{};
+		std::memcpy(
+				&level,
+				bytes.subspan(sizeof(header) + i * sizeof(level)).data(),
+				sizeof(level));
+		auto extent = VkExtent3D{
+				.width = std::max(header.pixel_width >> i, 1U),
+				.height = std::max(header.pixel_height >> i, 1U),
+				.depth = 1};
+		if (level.byte_length != level_size(*block, extent) ||
+				level.byte_offset > bytes.size() ||
+				level.byte_length > bytes.size() - level.byte_offset) {
+			fmt::print(
+					stderr,
+					"KTX2 file {} has a malformed level {}\n",
+					path.string(),
+					i);
+			std::terminate();
+		}
+		texture.levels[i] = TextureLevel{
+				.offset = level.byte_offset,
+				.size = level.byte_length,
+				.extent = extent,
+				.ticket = 0};
+	}
+	texture.next_level = level_count;
+	texture.resident_level = level_count;
+
+	auto base = VkExtent2D{
+			.width = header.pixel_width,
+			.height = header.pixel_height};
+	auto chain = downsample_level_count(base);
+	if (header.level_count != 0 || !generate_levels ||
+			!can_downsample(block->format) || chain == 1) {
+		return texture;
+	}
+	// Only level 0 is staged, the levels below are sized for the budget but
+	// have nothing in the file.
+	texture.generated_levels = true;
+	texture.levels.resize(chain);
+	for (auto i = uint32_t{1}; i < chain; i++) {
+		auto extent = VkExtent3D{
+				.width = std::max(header.pixel_width >> i, 1U),
+				.height = std::max(header.pixel_height >> i, 1U),
+				.depth = 1};
+		texture.levels[i] = TextureLevel{
+				.offset = 0,
+				.size = level_size(*block, extent),
+				.extent = extent,
+				.ticket = 0};
+	}
+	texture.next_level = 1;
+	texture.resident_level = chain;
+	return texture;
+}
+
+// Creates the image and view for the levels from texture.base_level on.
+void create_texture_image(
+		VkDevice& device,
+		Allocator& allocator,
+		Texture& texture) {
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = texture.format,
+			.extent = texture.levels.at(texture.base_level).extent,
+			.mipLevels =
+					static_cast<uint32_t>(texture.levels.size()) - texture.base_level,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	if (texture.host_copy_layout.has_value()) {
+		image_info.usage |= VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+	}
+	// Generated levels are written through UNORM storage views, which sRGB
+	// formats do not support themselves.
+	if (texture.generated_levels) {
+		image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		if (texture.format != VK_FORMAT_R8G8B8A8_UNORM) {
+			image_info.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT |
+					VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+		}
+	}
+	texture.image = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = texture.image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = texture.format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = VK_REMAINING_MIP_LEVELS,
+					.baseArrayLayer = 0,
+					.layerCount = 1}};
+	if (vkCreateImageView(
+					device,
+					&view_info,
+					host_callbacks(),
+					&texture.view) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create a texture image view\n");
+		std::terminate();
+	}
+}
+
+}  // namespace
+
+auto load_texture(
+		VkDevice& device,
+		VkPhysicalDevice& physical_device,
+		Allocator& allocator,
+		const Archive* archive,
+		std::span<const std::filesystem::path> candidates,
+		bool host_image_copy,
+		bool generate_levels) -> Texture {
+	auto texture = std::optional<Texture>{};
+	for (const auto& path : candidates) {
+		auto file = open_asset(archive, path);
+		if (!file.has_value()) {
+			fmt::print(stderr, "Failed to map texture {}\n", path.string());
+			std::terminate();
+		}
+		texture =
+				parse_ktx2(physical_device, path, file->bytes, generate_levels);
+		if (texture.has_value()) {
+			texture->file = file;
+			break;
+		}
+		unmap_file(*file);
+	}
+	if (!texture.has_value()) {
+		fmt::print(stderr, "No texture candidate has a supported format\n");
+		std::terminate();
+	}
+
+	// The chain is generated on the GPU after level 0 arrives, copying that
+	// on the host saves nothing.
+	if (host_image_copy && !texture->generated_levels) {
+		texture->host_copy_layout =
+				host_copy_layout(physical_device, texture->format);
+	}
+	create_texture_image(device, allocator, *texture);
+	return *texture;
+}
+
+void destroy_texture(VkDevice& device, Allocator& allocator, Texture& texture) {
+	if (texture.file.has_value()) {
+		unmap_file(*texture.file);
+	}
+	vkDestroyImageView(device, texture.view, host_callbacks());
+	destroy_image(device, allocator, texture.image);
+	texture = Texture{};
+}
+
+auto stream_texture(
+		VkDevice& device,
+		Uploader& uploader,
+		Texture& texture,
+		VkDeviceSize budget) -> bool {
+	auto staged = VkDeviceSize{};
+	while (texture.next_level > texture.base_level &&
+				 (staged == 0 || staged < budget)) {
+		auto& level = texture.levels.at(texture.next_level - 1);
+		staged += level.size;
+		texture.next_level--;
+		if (texture.host_copy_layout.has_value()) {
+			copy_level_on_host(device, texture, texture.next_level);
+			level.ticket = 0;
+			continue;
+		}
+		// Each level moves from an undefined layout on its own, the ones not
+		// uploaded yet are never sampled.
+		upload_image(
+				device,
+				uploader,
+				texture.image.handle,
+				VkImageSubresourceLayers{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = texture.next_level - texture.base_level,
+						.baseArrayLayer = 0,
+						.layerCount = 1},
+				level.extent,
+				texture.file->bytes.subspan(level.offset, level.size),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+				VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+		level.ticket = uploader.next_ticket;
+	}
+	return texture.next_level > texture.base_level;
+}
+
+void update_texture_residency(
+		VkDevice& device,
+		Uploader& uploader,
+		Texture& texture) {
+	// Those become resident all at once in record_texture_levels.
+	if (texture.generated_levels) {
+		return;
+	}
+	while (texture.resident_level > texture.next_level &&
+				 upload_complete(
+						 device,
+						 uploader,
+						 texture.levels.at(texture.resident_level - 1).ticket)) {
+		texture.resident_level--;
+	}
+}
+
+void record_texture_levels(
+		VkDevice& device,
+		DeletionQueue& deletions,
+		Downsampler& downsampler,
+		const Uploader& uploader,
+		Texture& texture,
+		VkCommandBuffer command_buffer) {
+	if (!texture.generated_levels ||
+			texture.resident_level == texture.base_level ||
+			texture.next_level != texture.base_level ||
+			texture.levels.at(texture.base_level).ticket >= uploader.next_ticket) {
+		return;
+	}
+	const auto& base = texture.levels.at(texture.base_level).extent;
+	record_downsample(
+			device,
+			deletions,
+			downsampler,
+			command_buffer,
+			texture.image.handle,
+			texture.format,
+			VkExtent2D{.width = base.width, .height = base.height},
+			static_cast<uint32_t>(texture.levels.size()) - texture.base_level,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	texture.resident_level = texture.base_level;
+}
+
+auto texture_image_size(const Texture& texture, uint32_t base_level)
+		-> VkDeviceSize {
+	auto size = VkDeviceSize{};
+	for (auto i = base_level; i < texture.levels.size(); i++) {
+		size += texture.levels.at(i).size;
+	}
+	return size;
+}
+
+void set_texture_base_level(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		Texture& texture,
+		uint32_t base_level) {
+	defer_deletion(
+			deletions,
+			[&device, &allocator, image = texture.image, view = texture.view]()
+					mutable {
+				vkDestroyImageView(device, view, host_callbacks());
+				destroy_image(device, allocator, image);
+			});
+	// The new image starts out undefined, so levels staged into the old one
+	// have to be staged again.
+	auto level_count = static_cast<uint32_t>(texture.levels.size());
+	texture.base_level = base_level;
+	texture.next_level = level_count;
+	texture.resident_level = level_count;
+	create_texture_image(device, allocator, texture);
+}
+
+void fit_texture_to_budget(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		const MemoryBudget& budget,
+		Texture& texture) {
+	// Generated chains only have level 0 to stream again.
+	if (texture.resident_level != texture.base_level ||
+			texture.generated_levels) {
+		return;
+	}
+	auto heap = allocation_heap(allocator, texture.image.allocation);
+	auto level_count = static_cast<uint32_t>(texture.levels.size());
+	auto base_level = texture.base_level;
+	if (memory_pressure(budget, heap, 0) == MemoryPressure::over) {
+		if (base_level + 1 == level_count) {
+			return;
+		}
+		base_level++;
+		log_message(
+				LogLevel::info,
+				"Memory heap {} is over budget, dropping texture level {}",
+				heap,
+				texture.base_level);
+	} else {
+		if (base_level == 0) {
+			return;
+		}
+		auto growth = texture_image_size(texture, base_level - 1) -
+				texture_image_size(texture, base_level);
+		if (memory_pressure(budget, heap, growth) != MemoryPressure::low) {
+			return;
+		}
+		base_level--;
+		log_message(
+				LogLevel::info,
+				"Memory heap {} is within budget, restoring texture level {}",
+				heap,
+				base_level);
+	}
+	set_texture_base_level(device, allocator, deletions, texture, base_level);
+}
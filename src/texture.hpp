@@ -0,0 +1,121 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "archive.hpp"
+#include "deletion.hpp"
+#include "dispatch.hpp"
+#include "downsample.hpp"
+#include "mapped_file.hpp"
+#include "memory_budget.hpp"
+#include "upload.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct TextureLevel {
+	// Where the level's blocks are in the file.
+	VkDeviceSize offset{};
+	VkDeviceSize size{};
+	VkExtent3D extent{};
+	// Set once the level was staged.
+	UploadTicket ticket{};
+};
+
+// A 2D texture read from a KTX2 file whose levels are already in a format the
+// GPU samples directly. Levels are streamed coarse to fine through the
+// uploader, so a texture is usable long before its full chain arrives. Under
+// memory pressure the image is rebuilt without its finest levels, which are
+// streamed in again once memory frees up.
+struct Texture {
+	// Mapped for the texture's lifetime, so dropped levels can be staged
+	// again. Only address space, the OS can reclaim the pages it read.
+	std::optional<MappedFile> file;
+	Image image;
+	VkImageView view{};
+	VkFormat format{};
+	// Indexed by mip level, level 0 is the largest.
+	std::vector<TextureLevel> levels;
+	// The finest level the image holds, which is the image's level 0.
+	uint32_t base_level{};
+	// Levels from next_level on have been staged.
+	uint32_t next_level{};
+	// Levels from resident_level on can be sampled, shaders have to clamp
+	// their LOD to it. Equals the level count until the coarsest arrives.
+	uint32_t resident_level{};
+	// Set when levels are copied from the mapped file into the image on the
+	// host, in this layout, instead of going through the uploader. They are
+	// resident as soon as they are staged.
+	std::optional<VkImageLayout> host_copy_layout;
+	// Set when the file only stores level 0 and the levels below are written
+	// from it on the GPU, see record_texture_levels. Such textures are never
+	// evicted down from level 0.
+	bool generated_levels{};
+};
+
+// Maps the candidates in order, from archive where it has them, and returns
+// the first whose format the device can sample, so an asset can ship as
+// BC7, ASTC and ETC2 and each device picks what it supports. Basis Universal
+// and supercompressed files are rejected, transcoding them is not supported.
+// With host_image_copy, levels skip the staging copy where the device reports
+// no cost to sampling the image for it. With generate_levels, RGBA8 files
+// whose level count is zero get a chain generated from their level 0.
+auto load_texture(
+		VkDevice& device,
+		VkPhysicalDevice& physical_device,
+		Allocator& allocator,
+		const Archive* archive,
+		std::span<const std::filesystem::path> candidates,
+		bool host_image_copy,
+		bool generate_levels) -> Texture;
+// The GPU must be done with the texture.
+void destroy_texture(VkDevice& device, Allocator& allocator, Texture& texture);
+
+// Stages the next levels into the uploader's current batch, coarsest first,
+// until budget bytes were staged. At least one level is staged per call.
+// Returns whether levels remain.
+auto stream_texture(
+		VkDevice& device,
+		Uploader& uploader,
+		Texture& texture,
+		VkDeviceSize budget) -> bool;
+// Moves resident_level past the levels whose uploads have completed.
+void update_texture_residency(
+		VkDevice& device,
+		Uploader& uploader,
+		Texture& texture);
+// Generates the levels below level 0 once the batch staging it was submitted,
+// in the command buffer that acquires it, and makes the chain resident.
+// Call after acquire_uploads.
+void record_texture_levels(
+		VkDevice& device,
+		DeletionQueue& deletions,
+		Downsampler& downsampler,
+		const Uploader& uploader,
+		Texture& texture,
+		VkCommandBuffer command_buffer);
+// The bytes of the levels from base_level on, close to what an image holding
+// them allocates.
+auto texture_image_size(const Texture& texture, uint32_t base_level)
+		-> VkDeviceSize;
+// Replaces the image with one holding levels from base_level on, coarser to
+// evict levels and finer to restore them. The old image goes to deletions and
+// every level is streamed again, starting over with the coarsest.
+void set_texture_base_level(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		Texture& texture,
+		uint32_t base_level);
+// Drops the finest level while the texture's heap is over budget and restores
+// it once that keeps the heap below the near share. Changes wait until the
+// previous image was fully streamed, which gives its deletion and the budget
+// time to catch up, so one spike does not evict the whole chain.
+void fit_texture_to_budget(
+		VkDevice& device,
+		Allocator& allocator,
+		DeletionQueue& deletions,
+		const MemoryBudget& budget,
+		Texture& texture);
@@ -0,0 +1,157 @@
+#include "thread_placement.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Nice value of raised threads, normal ones run at zero.
+constexpr auto g_raised_nice = -10;
+// Capacity relative to the fastest core below which a core counts as an
+// efficiency core. Leaves the middle cores of three tier ARM CPUs with the
+// performance cores.
+constexpr auto g_efficiency_capacity_percent = size_t{50};
+
+auto read_line(const std::filesystem::path& path)
+		-> std::optional<std::string> {
+	auto file = std::ifstream(path);
+	auto line = std::string{};
+	if (!file || !std::getline(file, line)) {
+		return std::nullopt;
+	}
+	return line;
+}
+
+auto parse_number(std::string_view text) -> std::optional<size_t> {
+	auto value = size_t{};
+	const auto* end = text.data() + text.size();
+	auto [last, error] = std::from_chars(text.data(), end, value);
+	if (error != std::errc{} || last != end) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+// Parses the kernel's lists of CPUs, such as 0-7,16-19. Empty when malformed.
+auto parse_cpu_list(std::string_view list) -> std::vector<size_t> {
+	auto cpus = std::vector<size_t>{};
+	while (!list.empty()) {
+		auto comma = list.find(',');
+		auto range = list.substr(0, comma);
+		list = comma == std::string_view::npos ? "" : list.substr(comma + 1);
+		auto dash = range.find('-');
+		auto first = parse_number(range.substr(0, dash));
+		auto last = dash == std::string_view::npos
+				? first
+				: parse_number(range.substr(dash + 1));
+		if (!first.has_value() || !last.has_value()) {
+			return {};
+		}
+		for (auto cpu = *first; cpu <= *last; cpu++) {
+			cpus.emplace_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+#ifdef __linux__
+void set_cores(pthread_t thread, std::span<const size_t> cores) {
+	if (cores.empty()) {
+		return;
+	}
+	auto cpus = cpu_set_t{};
+	CPU_ZERO(&cpus);
+	for (auto core : cores) {
+		CPU_SET(core, &cpus);
+	}
+	pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+}
+#endif
+
+}  // namespace
+
+auto detect_core_topology() -> CoreTopology {
+	auto core_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	auto topology = CoreTopology{};
+#ifdef __linux__
+	// Hybrid Intel CPUs register a PMU per core type.
+	auto big = read_line("/sys/devices/cpu_core/cpus");
+	auto small = read_line("/sys/devices/cpu_atom/cpus");
+	if (big.has_value() && small.has_value()) {
+		topology.performance = parse_cpu_list(*big);
+		topology.efficiency = parse_cpu_list(*small);
+		if (!topology.performance.empty()) {
+			return topology;
+		}
+	}
+	// ARM reports each core's capacity, 1024 for the fastest.
+	auto capacities = std::vector<size_t>{};
+	for (auto i = size_t{}; i < core_count; i++) {
+		auto line = read_line(
+				fmt::format("/sys/devices/system/cpu/cpu{}/cpu_capacity", i));
+		auto capacity =
+				line.has_value() ? parse_number(*line) : std::optional<size_t>{};
+		if (!capacity.has_value()) {
+			capacities.clear();
+			break;
+		}
+		capacities.emplace_back(*capacity);
+	}
+	if (!capacities.empty()) {
+		auto fastest = *std::max_element(capacities.begin(), capacities.end());
+		topology = CoreTopology{};
+		for (auto i = size_t{}; i < capacities.size(); i++) {
+			auto& cores =
+					capacities.at(i) * 100 < fastest * g_efficiency_capacity_percent
+					? topology.efficiency
+					: topology.performance;
+			cores.emplace_back(i);
+		}
+		return topology;
+	}
+#endif
+	topology = CoreTopology{};
+	topology.performance.resize(core_count);
+	std::iota(topology.performance.begin(), topology.performance.end(), 0);
+	return topology;
+}
+
+void set_thread_cores(
+		[[maybe_unused]] std::thread& thread,
+		[[maybe_unused]] std::span<const size_t> cores) {
+#ifdef __linux__
+	set_cores(thread.native_handle(), cores);
+#endif
+}
+
+void set_current_thread_cores([[maybe_unused]] std::span<const size_t> cores) {
+#ifdef __linux__
+	set_cores(pthread_self(), cores);
+#endif
+}
+
+auto raise_current_thread_priority() -> bool {
+#ifdef __linux__
+	// Nice values are per thread on Linux.
+	auto thread = static_cast<id_t>(gettid());
+	return setpriority(PRIO_PROCESS, thread, g_raised_nice) == 0;
+#else
+	return false;
+#endif
+}
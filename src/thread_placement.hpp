@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Where the job threads run. Shared leaves them to the OS. Pinned pins
+// worker i to core i. Core types keeps the main thread, which records and
+// submits the frames, and the simulation on the performance cores, the big
+// cores of hybrid CPUs, and puts the workers beyond those on the efficiency
+// cores, where background jobs run first.
+enum class ThreadPlacement {
+	shared,
+	pinned,
+	core_types,
+};
+
+// The cores by type. Where all cores are alike every core is a performance
+// core.
+struct CoreTopology {
+	std::vector<size_t> performance;
+	std::vector<size_t> efficiency;
+};
+
+// Reads the core types Linux reports for hybrid Intel CPUs, or the relative
+// core capacities it reports on ARM. Elsewhere all cores count as alike.
+auto detect_core_topology() -> CoreTopology;
+
+// Keeps thread on cores. Does nothing with no cores or where affinity is not
+// supported.
+void set_thread_cores(std::thread& thread, std::span<const size_t> cores);
+void set_current_thread_cores(std::span<const size_t> cores);
+// Favours the calling thread over normal priority threads sharing its core,
+// so background work does not deschedule it. Needs the right to raise
+// priorities, and returns whether it had it.
+auto raise_current_thread_priority() -> bool;
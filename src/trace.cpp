@@ -0,0 +1,92 @@
+#include "trace.hpp"
+
+#include "jobs.hpp"
+#include "json.hpp"
+
+#include <fmt/core.h>
+#include <fmt/ostream.h>
+
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <utility>
+
+namespace {
+
+auto trace_microseconds(
+		std::chrono::steady_clock::time_point origin,
+		std::chrono::steady_clock::time_point time) -> double {
+	return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+}  // namespace
+
+auto create_trace(const std::filesystem::path& path) -> Trace {
+	auto trace = Trace{};
+	trace.path = path;
+	trace.origin = std::chrono::steady_clock::now();
+	return trace;
+}
+
+auto begin_trace_event(Trace& trace, std::string_view name) -> size_t {
+	trace.events.emplace_back(start_trace_event(name));
+	return trace.events.size() - 1;
+}
+
+void end_trace_event(Trace& trace, size_t event) {
+	finish_trace_event(trace.events.at(event));
+}
+
+auto start_trace_event(std::string_view name) -> TraceEvent {
+	auto now = std::chrono::steady_clock::now();
+	return TraceEvent{
+			.name = std::string(name),
+			.begin = now,
+			.end = now,
+			.thread = current_job_thread()};
+}
+
+void finish_trace_event(TraceEvent& event) {
+	event.end = std::chrono::steady_clock::now();
+}
+
+void add_trace_event(Trace& trace, TraceEvent event) {
+	trace.events.emplace_back(std::move(event));
+}
+
+void write_trace(const Trace& trace) {
+	if (trace.path.empty()) {
+		return;
+	}
+	write_trace_events(trace.path, trace.origin, trace.events, "startup");
+}
+
+void write_trace_events(
+		const std::filesystem::path& path,
+		std::chrono::steady_clock::time_point origin,
+		std::span<const TraceEvent> events,
+		std::string_view category) {
+	auto file = std::ofstream(path, std::ios::trunc);
+	if (!file) {
+		fmt::print(stderr, "Failed to open {}\n", path.string());
+		std::terminate();
+	}
+	// Complete events carry their own duration, so nesting needs no matching
+	// begin and end records.
+	fmt::print(file, "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for (auto i = size_t{}; i < events.size(); i++) {
+		const auto& event = events[i];
+		auto begin = trace_microseconds(origin, event.begin);
+		fmt::print(
+				file,
+				"{}\n  {{\"name\": {}, \"cat\": {}, \"ph\": \"X\", "
+				"\"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 1, \"tid\": {}}}",
+				i == 0 ? "" : ",",
+				json_string(event.name),
+				json_string(category),
+				begin,
+				trace_microseconds(origin, event.end) - begin,
+				event.thread);
+	}
+	fmt::print(file, "\n]}}\n");
+}
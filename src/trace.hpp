@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The thread of events on the GPU timeline, past any job thread.
+constexpr auto g_trace_gpu_thread = size_t{1000};
+
+struct TraceEvent {
+	std::string name;
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::steady_clock::time_point end;
+	// Job thread the span ran on.
+	size_t thread{};
+};
+
+// Timed spans of startup and other one-off work.
+struct Trace {
+	std::filesystem::path path;
+	std::chrono::steady_clock::time_point origin;
+	std::vector<TraceEvent> events;
+};
+
+// Event times are relative to this call. Nothing is written when path is
+// empty.
+auto create_trace(const std::filesystem::path& path) -> Trace;
+
+// Returns the event to end. Events may nest. Only the thread that owns the
+// trace may call these.
+auto begin_trace_event(Trace& trace, std::string_view name) -> size_t;
+void end_trace_event(Trace& trace, size_t event);
+
+// Spans on other job threads are timed on their own and handed to the trace
+// by its owner once the job has been waited on.
+auto start_trace_event(std::string_view name) -> TraceEvent;
+void finish_trace_event(TraceEvent& event);
+void add_trace_event(Trace& trace, TraceEvent event);
+
+// Writes the ended events in the Chrome trace event format, which
+// chrome://tracing and Perfetto load.
+void write_trace(const Trace& trace);
+// Writes events of category with times relative to origin, in the same
+// format.
+void write_trace_events(
+		const std::filesystem::path& path,
+		std::chrono::steady_clock::time_point origin,
+		std::span<const TraceEvent> events,
+		std::string_view category);
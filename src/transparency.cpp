@@ -0,0 +1,354 @@
+#include "transparency.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <exception>
+#include <utility>
+
+namespace {
+
+constexpr auto g_oit_scene_binding = 0U;
+constexpr auto g_oit_accumulation_binding = 1U;
+constexpr auto g_oit_revealage_binding = 2U;
+constexpr auto g_oit_composited_binding = 3U;
+
+constexpr auto g_sampled_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_blend_output = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.access = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+				VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+constexpr auto g_depth_test = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+// Layout matches the push_constant block in oit_composite.comp.
+struct TransparencyConstants {
+	uint32_t width{};
+	uint32_t height{};
+};
+
+auto oit_image_info(VkFormat format, VkImageUsageFlags usage, VkExtent2D extent)
+		-> VkImageCreateInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = format,
+			.extent =
+					VkExtent3D{
+							.width = extent.width,
+							.height = extent.height,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = usage,
+			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = 0,
+			.pQueueFamilyIndices = VK_NULL_HANDLE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+auto oit_attachment(VkImageView view, VkClearValue clear_value)
+		-> VkRenderingAttachmentInfo {
+	return {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.imageView = view,
+			.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.resolveMode = VK_RESOLVE_MODE_NONE,
+			.resolveImageView = VK_NULL_HANDLE,
+			.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.clearValue = clear_value};
+}
+
+// Writes the pass's set for this frame's views.
+auto write_transparency_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		DescriptorAllocator& descriptors,
+		const Transparency& transparency,
+		size_t frame_idx,
+		std::array<uint32_t, 4> images) -> FrameSet {
+	auto image_descriptors = std::array<FrameImageDescriptor, 4>{};
+	for (auto i = size_t{}; i < image_descriptors.size(); i++) {
+		auto storage = i == g_oit_composited_binding;
+		image_descriptors.at(i) = FrameImageDescriptor{
+				.binding = static_cast<uint32_t>(i),
+				.type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+												: VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.image = VkDescriptorImageInfo{
+						.sampler = storage ? VK_NULL_HANDLE : transparency.sampler,
+						.imageView = graph_image_view(graph, images.at(i)),
+						.imageLayout = storage ? VK_IMAGE_LAYOUT_GENERAL
+																	 : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+	}
+	return write_frame_set(
+			device,
+			descriptors,
+			frame_idx,
+			transparency.set_layout,
+			image_descriptors);
+}
+
+}  // namespace
+
+auto create_transparency(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors) -> Transparency {
+	auto transparency = Transparency{};
+	// Every image is fetched texel by texel.
+	auto sampler_info = VkSamplerCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.magFilter = VK_FILTER_NEAREST,
+			.minFilter = VK_FILTER_NEAREST,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 1,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0,
+			.maxLod = 0,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE};
+	transparency.sampler = acquire_sampler(device, samplers, sampler_info);
+
+	auto sampled_binding = [&](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = &transparency.sampler};
+	};
+	auto bindings = std::array{
+			sampled_binding(g_oit_scene_binding),
+			sampled_binding(g_oit_accumulation_binding),
+			sampled_binding(g_oit_revealage_binding),
+			VkDescriptorSetLayoutBinding{
+					.binding = g_oit_composited_binding,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = 1,
+					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+					.pImmutableSamplers = VK_NULL_HANDLE},
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = descriptor_layout_flags(descriptors),
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&transparency.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create transparency set layout\n");
+		std::terminate();
+	}
+
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(TransparencyConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &transparency.set_layout,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&transparency.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create transparency pipeline layout\n");
+		std::terminate();
+	}
+	transparency.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			transparency.pipeline_layout,
+			module,
+			VK_NULL_HANDLE,
+			descriptor_pipeline_flags(descriptors));
+	return transparency;
+}
+
+void destroy_transparency(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Transparency& transparency) {
+	vkDestroyPipeline(device, transparency.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(
+			device,
+			transparency.pipeline_layout,
+			host_callbacks());
+	vkDestroyDescriptorSetLayout(
+			device,
+			transparency.set_layout,
+			host_callbacks());
+	release_sampler(device, samplers, transparency.sampler);
+	transparency = Transparency{};
+}
+
+auto add_transparency_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		Transparency& transparency,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t depth,
+		GraphRecord draw,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> uint32_t {
+	auto attachment_usage =
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	auto accumulation = add_transient_image(
+			graph,
+			oit_image_info(
+					g_oit_accumulation_format,
+					attachment_usage,
+					target_extent),
+			VK_IMAGE_ASPECT_COLOR_BIT);
+	auto revealage = add_transient_image(
+			graph,
+			oit_image_info(g_oit_revealage_format, attachment_usage, target_extent),
+			VK_IMAGE_ASPECT_COLOR_BIT);
+	auto composited = add_transient_image(
+			graph,
+			oit_image_info(
+					g_oit_composite_format,
+					VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+					target_extent),
+			VK_IMAGE_ASPECT_COLOR_BIT);
+
+	auto render_area = VkRect2D{.offset = {0, 0}, .extent = render_extent};
+	auto record_draws = [&graph, &profiler, frame_idx, accumulation, revealage,
+											 depth, render_area, draw = std::move(draw)](
+													VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "transparency");
+		// Nothing accumulated and everything revealed.
+		auto color_attachments = std::array{
+				oit_attachment(
+						graph_image_view(graph, accumulation),
+						VkClearValue{.color = {.float32 = {0, 0, 0, 0}}}),
+				oit_attachment(
+						graph_image_view(graph, revealage),
+						VkClearValue{.color = {.float32 = {1, 0, 0, 0}}})};
+		auto depth_attachment = VkRenderingAttachmentInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.imageView = graph_image_view(graph, depth),
+				.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.resolveMode = VK_RESOLVE_MODE_NONE,
+				.resolveImageView = VK_NULL_HANDLE,
+				.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.clearValue = VkClearValue{}};
+		auto rendering_info = VkRenderingInfo{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0,
+				.renderArea = render_area,
+				.layerCount = 1,
+				.viewMask = 0,
+				.colorAttachmentCount =
+						static_cast<uint32_t>(color_attachments.size()),
+				.pColorAttachments = color_attachments.data(),
+				.pDepthAttachment = &depth_attachment,
+				.pStencilAttachment = VK_NULL_HANDLE};
+		vkCmdBeginRendering(command_buffer, &rendering_info);
+		draw(command_buffer);
+		vkCmdEndRendering(command_buffer);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto draw_pass = add_graph_pass(graph, "transparency", record_draws, false);
+	graph_write(graph, draw_pass, accumulation, g_blend_output);
+	graph_write(graph, draw_pass, revealage, g_blend_output);
+	graph_read(graph, draw_pass, depth, g_depth_test);
+
+	auto constants = TransparencyConstants{
+			.width = render_extent.width,
+			.height = render_extent.height};
+	auto images = std::array{scene, accumulation, revealage, composited};
+	auto record_composite = [&device, &graph, &profiler, &descriptors,
+													 &transparency, frame_idx, constants,
+													 images](VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "oit_composite");
+		auto set = write_transparency_set(
+				device,
+				graph,
+				descriptors,
+				transparency,
+				frame_idx,
+				images);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				transparency.pipeline);
+		bind_frame_set(
+				command_buffer,
+				descriptors,
+				frame_idx,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				transparency.pipeline_layout,
+				0,
+				set);
+		vkCmdPushConstants(
+				command_buffer,
+				transparency.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(constants.width + g_oit_group_size - 1) / g_oit_group_size,
+				(constants.height + g_oit_group_size - 1) / g_oit_group_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto composite_pass =
+			add_graph_pass(graph, "oit_composite", record_composite, false);
+	graph_read(graph, composite_pass, scene, g_sampled_read);
+	graph_read(graph, composite_pass, accumulation, g_sampled_read);
+	graph_read(graph, composite_pass, revealage, g_sampled_read);
+	graph_write(graph, composite_pass, composited, g_storage_write);
+	return composited;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "object_cache.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Matches local_size in oit_composite.comp.
+constexpr auto g_oit_group_size = 8U;
+// The transparency pass's color attachments: the weighted sum of the
+// premultiplied fragments and their weighted coverage, then the product of
+// one minus the coverage of every fragment.
+constexpr auto g_oit_accumulation_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr auto g_oit_revealage_format = VK_FORMAT_R16_SFLOAT;
+// The scene with the transparency over it, which the passes after read in
+// place of the scene.
+constexpr auto g_oit_composite_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// Weighted blended order independent transparency, after McGuire and Bavoil.
+// Transparent fragments are added up with a weight that falls off with
+// depth instead of being blended in order, so their draws need no sorting.
+// The transparency pass draws them over the scene's depth into the two
+// attachments, and oit_composite.comp resolves them over the opaque scene.
+// The composite's set is binding 0 the scene, binding 1 the accumulation,
+// binding 2 the revealage, all sampled, and binding 3 the image written,
+// written every frame like the post passes' sets.
+struct Transparency {
+	VkSampler sampler{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+};
+
+// module is oit_composite.comp. descriptors is the allocator the passes are
+// added with.
+auto create_transparency(
+		VkDevice& device,
+		SamplerCache& samplers,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const DescriptorAllocator& descriptors) -> Transparency;
+// The device must be idle.
+void destroy_transparency(
+		VkDevice& device,
+		SamplerCache& samplers,
+		Transparency& transparency);
+
+// Adds the pass drawing the transparent fragments and the one compositing
+// them over the top left render_extent of scene, and returns the image
+// composited, which covers target_extent like scene. Must be called after the
+// frame fence was waited on. scene must be sampled, and depth is the scene's
+// single sampled depth, stored by the pass that wrote it. draw records the
+// transparent draws into dynamic rendering of g_oit_accumulation_format and
+// g_oit_revealage_format over depth, with pipelines that test against it
+// without writing and blend with BlendMode::weighted.
+auto add_transparency_passes(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		Transparency& transparency,
+		size_t frame_idx,
+		uint32_t scene,
+		uint32_t depth,
+		GraphRecord draw,
+		VkExtent2D render_extent,
+		VkExtent2D target_extent) -> uint32_t;
@@ -0,0 +1,63 @@
+#include "uniforms.hpp"
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+
+namespace {
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+auto create_uniform_ring(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkPhysicalDeviceLimits& limits,
+		size_t frame_count,
+		VkDeviceSize frame_size) -> UniformRing {
+	auto ring = UniformRing{};
+	ring.frame_size = align_up(frame_size, g_uniform_slot_size);
+	auto size = ring.frame_size * frame_count;
+	if (size > limits.maxStorageBufferRange) {
+		fmt::print(
+				stderr,
+				"Uniform ring of {} bytes exceeds the storage buffer range {}\n",
+				size,
+				limits.maxStorageBufferRange);
+		std::terminate();
+	}
+	// The GPU reads the constants where they were written, without a copy.
+	ring.buffer = create_dynamic_buffer(
+			device,
+			allocator,
+			size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	return ring;
+}
+
+void destroy_uniform_ring(
+		VkDevice& device,
+		Allocator& allocator,
+		UniformRing& ring) {
+	destroy_buffer(device, allocator, ring.buffer);
+	ring = UniformRing{};
+}
+
+void begin_uniform_frame(UniformRing& ring, size_t frame_idx) {
+	ring.frame_offset = ring.frame_size * frame_idx;
+	ring.head = 0;
+}
+
+void uniform_ring_overflow(const UniformRing& ring, VkDeviceSize size) {
+	fmt::print(
+			stderr,
+			"Uniform ring overflow: {} bytes requested, {} of {} used\n",
+			size,
+			ring.head,
+			ring.frame_size);
+	std::terminate();
+}
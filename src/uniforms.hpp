@@ -0,0 +1,137 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// Shaders read the ring as an array of vec4, so slices start on a vec4.
+constexpr auto g_uniform_slot_size = VkDeviceSize{16};
+
+// Per draw constants for the graphics pipeline, read from the ring by
+// shader.vert. The rest is only read by the MOTION_VECTORS variants, see
+// src/temporal.hpp: the transform of the previous frame without its jitter,
+// and the clip space offset transform was jittered by in xy. The STEREO
+// variants read jitter as the eyes' offsets instead, see src/stereo.hpp.
+struct DrawUniforms {
+	glm::mat4 transform{1.0F};
+	glm::mat4 previous_transform{1.0F};
+	glm::vec4 jitter{};
+};
+
+// The smallest maxPushConstantsSize the spec allows.
+constexpr auto g_max_push_constants_size = size_t{128};
+
+// DrawHandles::instances of draws that are not built by a draw list.
+constexpr auto g_no_instance_list = UINT32_MAX;
+
+// Per draw indices, passed as push constants. Layout matches the
+// push_constant blocks in shader.vert and pulling.vert. The vertex fields
+// are only read by pulling.vert, see Mesh::attribute_addresses. transform is
+// the ring slot of the draw's DrawUniforms; draws built by a draw list read
+// it from their DrawInstance in instances instead, see draw_list.hpp.
+// material and mesh index per material and per mesh tables, which stay 0
+// while the demo draws a single mesh without materials. The position fields
+// are Mesh::position_scale and position_offset, float arrays in the shaders
+// since std430 would align a vec3 to 16 bytes. The meshlet fields are only
+// read by meshlet.task and meshlet.mesh, see MeshletMesh. The light fields
+// are only read by shader.frag's CLUSTERED_LIGHTS variant, see LightClusters.
+// draw is the index visibility.frag writes into the visibility buffer, see
+// VisibilityShading.
+struct DrawHandles {
+	VkDeviceAddress positions{};
+	VkDeviceAddress colors{};
+	uint32_t vertex_stride{};
+	BindlessHandle uniform_buffer{};
+	BindlessHandle instances{g_no_instance_list};
+	uint32_t transform{};
+	uint32_t material{};
+	uint32_t mesh{};
+	glm::vec3 position_scale{1.0F};
+	glm::vec3 position_offset{};
+	VkDeviceAddress meshlets{};
+	uint32_t meshlet_count{};
+	BindlessHandle lights{};
+	BindlessHandle light_grid{};
+	uint32_t draw{};
+	// Last frame's positions of skinned meshes, for pulling.vert's motion
+	// vectors, see Skinner.
+	VkDeviceAddress previous_positions{};
+};
+static_assert(
+		offsetof(DrawHandles, lights) == 76,
+		"shader.frag declares the light fields at offset 76");
+static_assert(
+		offsetof(DrawHandles, draw) == 84,
+		"visibility.frag declares the draw field at offset 84");
+static_assert(
+		offsetof(DrawHandles, previous_positions) == 88,
+		"pulling.vert declares previous_positions at offset 88");
+static_assert(
+		offsetof(DrawHandles, previous_positions) + sizeof(VkDeviceAddress) ==
+				sizeof(DrawHandles),
+		"The largest shader block ends where DrawHandles does, so the range "
+		"reflected from the shaders covers every push");
+static_assert(
+		sizeof(DrawHandles) <= g_max_push_constants_size,
+		"Push constants must fit the smallest maxPushConstantsSize");
+static_assert(
+		sizeof(DrawHandles) % 4 == 0,
+		"Push constant ranges are multiples of 4 bytes");
+
+// A persistently mapped buffer split into one region per frame in flight.
+// Each draw's constants are written straight into the mapped region. The
+// buffer sits in the bindless table as a single storage buffer, so the only
+// per draw cost is bumping head and pushing the slot.
+struct UniformRing {
+	Buffer buffer;
+	VkDeviceSize frame_size{};
+	VkDeviceSize frame_offset{};
+	VkDeviceSize head{};
+};
+
+struct UniformSlice {
+	std::byte* data{};
+	// Offset into the buffer in units of g_uniform_slot_size.
+	uint32_t slot{};
+};
+
+auto create_uniform_ring(
+		VkDevice& device,
+		Allocator& allocator,
+		const VkPhysicalDeviceLimits& limits,
+		size_t frame_count,
+		VkDeviceSize frame_size) -> UniformRing;
+// The device must be idle.
+void destroy_uniform_ring(
+		VkDevice& device,
+		Allocator& allocator,
+		UniformRing& ring);
+
+// Starts writing into a frame's region. The frame fence must have been waited
+// on, so the GPU is no longer reading it.
+void begin_uniform_frame(UniformRing& ring, size_t frame_idx);
+
+[[noreturn]] void uniform_ring_overflow(
+		const UniformRing& ring,
+		VkDeviceSize size);
+
+// Reserves size bytes in the current frame's region.
+inline auto push_uniforms(UniformRing& ring, VkDeviceSize size)
+		-> UniformSlice {
+	if (ring.head + size > ring.frame_size) {
+		uniform_ring_overflow(ring, size);
+	}
+	auto offset = ring.frame_offset + ring.head;
+	ring.head = (ring.head + size + g_uniform_slot_size - 1) &
+			~(g_uniform_slot_size - 1);
+	return UniformSlice{
+			.data = ring.buffer.allocation.mapped + offset,
+			.slot = static_cast<uint32_t>(offset / g_uniform_slot_size)};
+}
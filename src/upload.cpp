@@ -0,0 +1,613 @@
+#include "upload.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+
+namespace {
+
+// Covers the texel block size of every format and the 4 byte alignment
+// buffer to image copies need.
+constexpr auto g_staging_alignment = VkDeviceSize{16};
+
+struct StagedData {
+	VkBuffer buffer{};
+	VkDeviceSize offset{};
+};
+
+auto align_up(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Returns the offset of size bytes in the ring, or nothing when the ring is
+// too full. Allocations never wrap around the end of the buffer.
+auto allocate_staging(StagingRing& ring, VkDeviceSize size)
+		-> std::optional<VkDeviceSize> {
+	auto start = align_up(ring.head, g_staging_alignment);
+	if (start % ring.size + size > ring.size) {
+		start = align_up(start, ring.size);
+	}
+	if (start + size - ring.tail > ring.size) {
+		return std::nullopt;
+	}
+	ring.head = start + size;
+	return start % ring.size;
+}
+
+auto create_staging_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		std::span<const std::byte> data) -> Buffer {
+	auto staging = create_buffer(
+			device,
+			allocator,
+			data.size(),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			0);
+	std::memcpy(staging.allocation.mapped, data.data(), data.size());
+	return staging;
+}
+
+auto transfers_ownership(const Uploader& uploader) -> bool {
+	return uploader.family_idx != uploader.graphics_family_idx;
+}
+
+auto create_batch(VkDevice& device, const Uploader& uploader) -> UploadBatch {
+	auto batch = UploadBatch{};
+	auto pool_info = VkCommandPoolCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = uploader.family_idx};
+	if (vkCreateCommandPool(
+					device,
+					&pool_info,
+					host_callbacks(),
+					&batch.command_pool) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create upload command pool\n");
+		std::terminate();
+	}
+	auto allocate_info = VkCommandBufferAllocateInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.commandPool = batch.command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1};
+	if (vkAllocateCommandBuffers(
+					device,
+					&allocate_info,
+					&batch.command_buffer) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to allocate upload command buffer\n");
+		std::terminate();
+	}
+	batch.done = create_submit_point(device, uploader.timeline);
+	if (transfers_ownership(uploader) &&
+			uploader.timeline.semaphore == VK_NULL_HANDLE) {
+		auto semaphore_info = VkSemaphoreCreateInfo{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+				.pNext = VK_NULL_HANDLE,
+				.flags = 0};
+		if (vkCreateSemaphore(
+						device,
+						&semaphore_info,
+						host_callbacks(),
+						&batch.ready) != VK_SUCCESS) {
+			fmt::print(stderr, "Failed to create upload semaphore\n");
+			std::terminate();
+		}
+	}
+	return batch;
+}
+
+void reclaim_batches(VkDevice& device, Uploader& uploader) {
+	for (auto& batch : uploader.batches) {
+		if (batch.state != UploadBatchState::submitted ||
+				!submit_point_reached(device, batch.done)) {
+			continue;
+		}
+		uploader.completed_ticket =
+				std::max(uploader.completed_ticket, batch.ticket);
+		uploader.ring.tail = std::max(uploader.ring.tail, batch.ring_end);
+		if (transfers_ownership(uploader) && !batch.acquired) {
+			continue;
+		}
+		if (batch.ready != VK_NULL_HANDLE &&
+				!submit_point_reached(device, batch.acquired_by)) {
+			continue;
+		}
+		for (auto& staging : batch.staging) {
+			destroy_buffer(device, *uploader.allocator, staging);
+		}
+		batch.staging.clear();
+		batch.ring_end = 0;
+		batch.buffer_acquires.clear();
+		batch.image_acquires.clear();
+		batch.acquire_stages = 0;
+		batch.acquired = false;
+		batch.acquired_by = SubmitPoint{};
+		vkResetCommandPool(device, batch.command_pool, 0);
+		batch.state = UploadBatchState::idle;
+	}
+}
+
+// Copies data into the ring, or into a staging buffer of its own when the
+// ring has no room.
+auto stage_data(
+		VkDevice& device,
+		Uploader& uploader,
+		UploadBatch& batch,
+		std::span<const std::byte> data) -> StagedData {
+	auto offset = allocate_staging(uploader.ring, data.size());
+	if (!offset.has_value()) {
+		auto staging = create_staging_buffer(device, *uploader.allocator, data);
+		batch.staging.emplace_back(staging);
+		return {.buffer = staging.handle, .offset = 0};
+	}
+	std::memcpy(
+			uploader.ring.buffer.allocation.mapped + *offset,
+			data.data(),
+			data.size());
+	batch.ring_end = uploader.ring.head;
+	return {.buffer = uploader.ring.buffer.handle, .offset = *offset};
+}
+
+// Records the batch's copies with one barrier before and one after. Copies
+// from the same source to the same destination share a command.
+void record_copies(const Uploader& uploader, UploadBatch& batch) {
+	auto* command_buffer = batch.command_buffer;
+	if (!batch.image_transitions.empty()) {
+		pipeline_barrier(
+				uploader.synchronization2,
+				command_buffer,
+				{},
+				batch.image_transitions);
+	}
+
+	std::stable_sort(
+			batch.buffer_copies.begin(),
+			batch.buffer_copies.end(),
+			[](const PendingBufferCopy& a, const PendingBufferCopy& b) {
+				return std::less<>{}(a.src, b.src) ||
+						(a.src == b.src && std::less<>{}(a.dst, b.dst));
+			});
+	auto buffer_regions = std::vector<VkBufferCopy>{};
+	for (auto i = size_t{}; i < batch.buffer_copies.size(); i++) {
+		const auto& copy = batch.buffer_copies[i];
+		buffer_regions.emplace_back(copy.region);
+		if (i + 1 < batch.buffer_copies.size() &&
+				batch.buffer_copies[i + 1].src == copy.src &&
+				batch.buffer_copies[i + 1].dst == copy.dst) {
+			continue;
+		}
+		vkCmdCopyBuffer(
+				command_buffer,
+				copy.src,
+				copy.dst,
+				static_cast<uint32_t>(buffer_regions.size()),
+				buffer_regions.data());
+		buffer_regions.clear();
+	}
+
+	std::stable_sort(
+			batch.image_copies.begin(),
+			batch.image_copies.end(),
+			[](const PendingImageCopy& a, const PendingImageCopy& b) {
+				return std::less<>{}(a.src, b.src) ||
+						(a.src == b.src && std::less<>{}(a.dst, b.dst));
+			});
+	auto image_regions = std::vector<VkBufferImageCopy>{};
+	for (auto i = size_t{}; i < batch.image_copies.size(); i++) {
+		const auto& copy = batch.image_copies[i];
+		image_regions.emplace_back(copy.region);
+		if (i + 1 < batch.image_copies.size() &&
+				batch.image_copies[i + 1].src == copy.src &&
+				batch.image_copies[i + 1].dst == copy.dst &&
+				batch.image_copies[i + 1].layout == copy.layout) {
+			continue;
+		}
+		vkCmdCopyBufferToImage(
+				command_buffer,
+				copy.src,
+				copy.dst,
+				copy.layout,
+				static_cast<uint32_t>(image_regions.size()),
+				image_regions.data());
+		image_regions.clear();
+	}
+
+	if (!batch.buffer_releases.empty() || !batch.image_releases.empty()) {
+		pipeline_barrier(
+				uploader.synchronization2,
+				command_buffer,
+				batch.buffer_releases,
+				batch.image_releases);
+	}
+	batch.buffer_copies.clear();
+	batch.image_copies.clear();
+	batch.image_transitions.clear();
+	batch.buffer_releases.clear();
+	batch.image_releases.clear();
+}
+
+auto recording_batch(VkDevice& device, Uploader& uploader) -> UploadBatch& {
+	if (uploader.recording.has_value()) {
+		return uploader.batches.at(*uploader.recording);
+	}
+	reclaim_batches(device, uploader);
+	auto idle = std::find_if(
+			uploader.batches.begin(),
+			uploader.batches.end(),
+			[](const UploadBatch& batch) {
+				return batch.state == UploadBatchState::idle;
+			});
+	if (idle == uploader.batches.end()) {
+		uploader.batches.emplace_back(create_batch(device, uploader));
+		idle = std::prev(uploader.batches.end());
+	}
+	uploader.recording =
+			static_cast<size_t>(std::distance(uploader.batches.begin(), idle));
+
+	auto begin_info = VkCommandBufferBeginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			.pInheritanceInfo = VK_NULL_HANDLE};
+	vkBeginCommandBuffer(idle->command_buffer, &begin_info);
+	idle->state = UploadBatchState::recording;
+	return *idle;
+}
+
+}  // namespace
+
+auto create_uploader(
+		VkDevice& device,
+		Allocator& allocator,
+		uint32_t family_idx,
+		uint32_t graphics_family_idx,
+		VkDeviceSize staging_size,
+		bool synchronization2) -> Uploader {
+	auto uploader = Uploader{};
+	uploader.ring.buffer = create_buffer(
+			device,
+			allocator,
+			staging_size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			0);
+	uploader.ring.size = staging_size;
+	uploader.family_idx = family_idx;
+	uploader.graphics_family_idx = graphics_family_idx;
+	uploader.synchronization2 = synchronization2;
+	uploader.timeline = create_queue_timeline(device, synchronization2);
+	uploader.allocator = &allocator;
+	vkGetDeviceQueue(device, family_idx, 0, &uploader.queue);
+	return uploader;
+}
+
+void destroy_uploader(VkDevice& device, Uploader& uploader) {
+	for (auto& batch : uploader.batches) {
+		for (auto& staging : batch.staging) {
+			destroy_buffer(device, *uploader.allocator, staging);
+		}
+		vkDestroySemaphore(device, batch.ready, host_callbacks());
+		destroy_submit_point(device, batch.done);
+		vkDestroyCommandPool(device, batch.command_pool, host_callbacks());
+	}
+	uploader.batches.clear();
+	uploader.recording.reset();
+	destroy_buffer(device, *uploader.allocator, uploader.ring.buffer);
+	uploader.ring = StagingRing{};
+	destroy_queue_timeline(device, uploader.timeline);
+}
+
+void upload_buffer(
+		VkDevice& device,
+		Uploader& uploader,
+		VkBuffer buffer,
+		VkDeviceSize offset,
+		std::span<const std::byte> data,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	if (data.empty()) {
+		return;
+	}
+	auto& batch = recording_batch(device, uploader);
+	auto staged = stage_data(device, uploader, batch, data);
+	batch.buffer_copies.emplace_back(PendingBufferCopy{
+			.src = staged.buffer,
+			.dst = buffer,
+			.region = VkBufferCopy{
+					.srcOffset = staged.offset,
+					.dstOffset = offset,
+					.size = data.size()}});
+
+	auto barrier = VkBufferMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+			.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = offset,
+			.size = data.size()};
+	if (!transfers_ownership(uploader)) {
+		batch.buffer_releases.emplace_back(barrier);
+		return;
+	}
+
+	// The release half only makes the write available; the acquire half on the
+	// graphics queue makes it visible to dst_stage.
+	barrier.srcQueueFamilyIndex = uploader.family_idx;
+	barrier.dstQueueFamilyIndex = uploader.graphics_family_idx;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	batch.buffer_releases.emplace_back(barrier);
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = dst_stage;
+	barrier.dstAccessMask = dst_access;
+	batch.buffer_acquires.emplace_back(barrier);
+	batch.acquire_stages |= dst_stage;
+}
+
+void upload_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceLayers& subresource,
+		VkExtent3D extent,
+		std::span<const std::byte> data,
+		VkImageLayout final_layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	if (data.empty()) {
+		return;
+	}
+	auto& batch = recording_batch(device, uploader);
+	auto staged = stage_data(device, uploader, batch, data);
+
+	auto range = VkImageSubresourceRange{
+			.aspectMask = subresource.aspectMask,
+			.baseMipLevel = subresource.mipLevel,
+			.levelCount = 1,
+			.baseArrayLayer = subresource.baseArrayLayer,
+			.layerCount = subresource.layerCount};
+	auto barrier = VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+			.srcAccessMask = VK_ACCESS_2_NONE,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+			.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = range};
+	batch.image_transitions.emplace_back(barrier);
+	batch.image_copies.emplace_back(PendingImageCopy{
+			.src = staged.buffer,
+			.dst = image,
+			.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.region = VkBufferImageCopy{
+					.bufferOffset = staged.offset,
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = subresource,
+					.imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
+					.imageExtent = extent}});
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = dst_stage;
+	barrier.dstAccessMask = dst_access;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = final_layout;
+	if (!transfers_ownership(uploader)) {
+		batch.image_releases.emplace_back(barrier);
+		return;
+	}
+
+	// Both halves of an ownership transfer have to specify the same layout
+	// transition; it is executed once.
+	barrier.srcQueueFamilyIndex = uploader.family_idx;
+	barrier.dstQueueFamilyIndex = uploader.graphics_family_idx;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	batch.image_releases.emplace_back(barrier);
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = dst_stage;
+	barrier.dstAccessMask = dst_access;
+	batch.image_acquires.emplace_back(barrier);
+	batch.acquire_stages |= dst_stage;
+}
+
+void initialize_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceRange& range,
+		VkImageLayout layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	auto& batch = recording_batch(device, uploader);
+	// The batch's copies into the image wait on the transition too.
+	batch.image_transitions.emplace_back(VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+			.srcAccessMask = VK_ACCESS_2_NONE,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | dst_stage,
+			.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | dst_access,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = range});
+	if (transfers_ownership(uploader)) {
+		batch.acquire_stages |= dst_stage;
+	}
+}
+
+void update_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceLayers& subresource,
+		VkOffset3D offset,
+		VkExtent3D extent,
+		std::span<const std::byte> data,
+		VkImageLayout layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access) {
+	if (data.empty()) {
+		return;
+	}
+	auto& batch = recording_batch(device, uploader);
+	auto staged = stage_data(device, uploader, batch, data);
+	batch.image_copies.emplace_back(PendingImageCopy{
+			.src = staged.buffer,
+			.dst = image,
+			.layout = layout,
+			.region = VkBufferImageCopy{
+					.bufferOffset = staged.offset,
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = subresource,
+					.imageOffset = offset,
+					.imageExtent = extent}});
+	// On another queue the semaphore wait of the graphics submission makes
+	// the copy visible.
+	if (transfers_ownership(uploader)) {
+		batch.acquire_stages |= dst_stage;
+		return;
+	}
+	batch.image_releases.emplace_back(VkImageMemoryBarrier2{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.pNext = VK_NULL_HANDLE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+			.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.dstStageMask = dst_stage,
+			.dstAccessMask = dst_access,
+			.oldLayout = layout,
+			.newLayout = layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image,
+			.subresourceRange = VkImageSubresourceRange{
+					.aspectMask = subresource.aspectMask,
+					.baseMipLevel = subresource.mipLevel,
+					.levelCount = 1,
+					.baseArrayLayer = subresource.baseArrayLayer,
+					.layerCount = subresource.layerCount}});
+}
+
+auto submit_uploads(VkDevice& device, Uploader& uploader) -> UploadTicket {
+	if (!uploader.recording.has_value()) {
+		return uploader.next_ticket - 1;
+	}
+	auto& batch = uploader.batches.at(*uploader.recording);
+	record_copies(uploader, batch);
+	if (vkEndCommandBuffer(batch.command_buffer) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to record upload command buffer\n");
+		std::terminate();
+	}
+	auto signals = std::vector<SemaphoreOp>{};
+	if (batch.ready != VK_NULL_HANDLE) {
+		signals.emplace_back(SemaphoreOp{
+				.semaphore = batch.ready,
+				.value = 0,
+				.stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+	}
+	auto* fence =
+			advance_submit_point(device, batch.done, uploader.timeline, signals);
+	if (submit_commands(
+					uploader.synchronization2,
+					uploader.queue,
+					{&batch.command_buffer, 1},
+					uploader.waits,
+					signals,
+					fence,
+					0) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to submit upload command buffer\n");
+		std::terminate();
+	}
+	uploader.waits.clear();
+	batch.ticket = uploader.next_ticket++;
+	batch.state = UploadBatchState::submitted;
+	uploader.recording.reset();
+	return batch.ticket;
+}
+
+void acquire_uploads(
+		Uploader& uploader,
+		VkCommandBuffer command_buffer,
+		const SubmitPoint& frame_done,
+		std::vector<SemaphoreOp>& waits) {
+	if (!transfers_ownership(uploader)) {
+		return;
+	}
+	for (auto& batch : uploader.batches) {
+		if (batch.state != UploadBatchState::submitted || batch.acquired) {
+			continue;
+		}
+		if (!batch.buffer_acquires.empty() || !batch.image_acquires.empty()) {
+			pipeline_barrier(
+					uploader.synchronization2,
+					command_buffer,
+					batch.buffer_acquires,
+					batch.image_acquires);
+		}
+		if (batch.ready != VK_NULL_HANDLE) {
+			waits.emplace_back(SemaphoreOp{
+					.semaphore = batch.ready,
+					.value = 0,
+					.stages = batch.acquire_stages});
+		} else {
+			waits.emplace_back(SemaphoreOp{
+					.semaphore = batch.done.timeline,
+					.value = batch.done.value,
+					.stages = batch.acquire_stages});
+		}
+		batch.acquired = true;
+		batch.acquired_by = frame_done;
+	}
+}
+
+auto upload_complete(VkDevice& device, Uploader& uploader, UploadTicket ticket)
+		-> bool {
+	reclaim_batches(device, uploader);
+	return ticket <= uploader.completed_ticket;
+}
+
+void wait_for_upload(
+		VkDevice& device,
+		Uploader& uploader,
+		UploadTicket ticket) {
+	if (upload_complete(device, uploader, ticket)) {
+		return;
+	}
+	for (auto& batch : uploader.batches) {
+		if (batch.state == UploadBatchState::submitted && batch.ticket <= ticket) {
+			wait_for_submit_point(device, batch.done);
+		}
+	}
+	reclaim_batches(device, uploader);
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "dispatch.hpp"
+#include "sync.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Identifies a submitted batch of uploads. Tickets increase monotonically, so
+// a completed ticket implies every earlier one has completed as well.
+using UploadTicket = uint64_t;
+
+enum class UploadBatchState {
+	idle,
+	recording,
+	submitted,
+};
+
+// Copies are collected while a batch records and go out together when it is
+// submitted.
+struct PendingBufferCopy {
+	VkBuffer src{};
+	VkBuffer dst{};
+	VkBufferCopy region{};
+};
+
+struct PendingImageCopy {
+	VkBuffer src{};
+	VkImage dst{};
+	VkImageLayout layout{};
+	VkBufferImageCopy region{};
+};
+
+struct UploadBatch {
+	UploadBatchState state{};
+	UploadTicket ticket{};
+	VkCommandPool command_pool{};
+	VkCommandBuffer command_buffer{};
+	SubmitPoint done;
+	// Signalled by the transfer queue and waited on by the graphics submission
+	// that acquires ownership of the uploaded resources. Only used without
+	// timeline semaphores; that submission waits on done otherwise.
+	VkSemaphore ready{};
+	// The graphics submission that waited on ready. The semaphore can only be
+	// signalled again once that submission has finished.
+	SubmitPoint acquired_by;
+	bool acquired{};
+	// Staging buffers of uploads that did not fit into the ring.
+	std::vector<Buffer> staging;
+	// End of the batch's data in the staging ring, freed when it is reclaimed.
+	VkDeviceSize ring_end{};
+	std::vector<PendingBufferCopy> buffer_copies;
+	std::vector<PendingImageCopy> image_copies;
+	// Recorded before the copies, moving the images to TRANSFER_DST.
+	std::vector<VkImageMemoryBarrier2> image_transitions;
+	// Recorded after the copies, making the writes visible or releasing them to
+	// the graphics queue.
+	std::vector<VkBufferMemoryBarrier2> buffer_releases;
+	std::vector<VkImageMemoryBarrier2> image_releases;
+	std::vector<VkBufferMemoryBarrier2> buffer_acquires;
+	std::vector<VkImageMemoryBarrier2> image_acquires;
+	VkPipelineStageFlags2 acquire_stages{};
+};
+
+// Persistently mapped staging memory shared by all batches. head and tail
+// count the bytes ever allocated and freed, so head - tail is the space in
+// use. Batches finish in submission order, so freeing is moving tail up to the
+// end of a reclaimed batch.
+struct StagingRing {
+	Buffer buffer;
+	VkDeviceSize size{};
+	VkDeviceSize head{};
+	VkDeviceSize tail{};
+};
+
+// Copies data into device-local resources on a dedicated transfer queue when
+// the device has one, and on the graphics queue otherwise. Destination
+// resources are expected to use exclusive sharing; when the queues differ,
+// ownership is released on the transfer queue and acquired again by the next
+// graphics submission through acquire_uploads().
+struct Uploader {
+	VkQueue queue{};
+	uint32_t family_idx{};
+	uint32_t graphics_family_idx{};
+	bool synchronization2{};
+	QueueTimeline timeline;
+	Allocator* allocator{};
+	StagingRing ring;
+	std::vector<UploadBatch> batches;
+	std::optional<size_t> recording;
+	// Waited on by the next batch submitted, like the binds of the pages it
+	// copies into.
+	std::vector<SemaphoreOp> waits;
+	UploadTicket next_ticket{1};
+	UploadTicket completed_ticket{};
+};
+
+auto create_uploader(
+		VkDevice& device,
+		Allocator& allocator,
+		uint32_t family_idx,
+		uint32_t graphics_family_idx,
+		VkDeviceSize staging_size,
+		bool synchronization2) -> Uploader;
+// The device must be idle.
+void destroy_uploader(VkDevice& device, Uploader& uploader);
+
+// Stages data for a copy in the current batch, in the staging ring unless it
+// is full. Uploads in one batch must not overlap, their copies are not
+// ordered. dst_stage and dst_access describe the first use of the data on the
+// graphics queue.
+void upload_buffer(
+		VkDevice& device,
+		Uploader& uploader,
+		VkBuffer buffer,
+		VkDeviceSize offset,
+		std::span<const std::byte> data,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
+// The image is transitioned from an undefined layout, so any previous
+// contents of the subresource are discarded.
+void upload_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceLayers& subresource,
+		VkExtent3D extent,
+		std::span<const std::byte> data,
+		VkImageLayout final_layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
+
+// Uploads into images that are written again while shaders use them stay in
+// one layout that allows transfer writes, usually GENERAL. They must be
+// shared concurrently with the graphics family when the uploader is on
+// another, so no ownership changes hands; the graphics submission only waits
+// on the batch. initialize_image moves such an image out of the undefined
+// layout before the batch's copies.
+void initialize_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceRange& range,
+		VkImageLayout layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
+// Writes a region of such an image. No submitted work may still use the
+// region.
+void update_image(
+		VkDevice& device,
+		Uploader& uploader,
+		VkImage image,
+		const VkImageSubresourceLayers& subresource,
+		VkOffset3D offset,
+		VkExtent3D extent,
+		std::span<const std::byte> data,
+		VkImageLayout layout,
+		VkPipelineStageFlags2 dst_stage,
+		VkAccessFlags2 dst_access);
+
+// Submits the current batch, if any, and returns its ticket. Returns the last
+// submitted ticket when nothing was recorded.
+auto submit_uploads(VkDevice& device, Uploader& uploader) -> UploadTicket;
+
+// Records the ownership acquire barriers of every submitted batch into a
+// graphics command buffer and appends the semaphores the submission has to
+// wait on. frame_done must be the point that submission signals.
+void acquire_uploads(
+		Uploader& uploader,
+		VkCommandBuffer command_buffer,
+		const SubmitPoint& frame_done,
+		std::vector<SemaphoreOp>& waits);
+
+// Reclaims finished batches and reports whether the given ticket has
+// completed on the transfer queue.
+auto upload_complete(VkDevice& device, Uploader& uploader, UploadTicket ticket)
+		-> bool;
+void wait_for_upload(
+		VkDevice& device,
+		Uploader& uploader,
+		UploadTicket ticket);
@@ -0,0 +1,353 @@
+#include "virtual_texture.hpp"
+
+#include "host_memory.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <utility>
+
+namespace {
+
+// slot_used of the coarsest level's slots, which are never evicted.
+constexpr auto g_pinned_slot = std::numeric_limits<uint64_t>::max();
+// Where the feedback is left for the fence to make visible to the CPU.
+constexpr auto g_feedback_host_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_HOST_BIT,
+		.access = VK_ACCESS_2_HOST_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+auto create_frame_buffer(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkDeviceSize size,
+		VkMemoryPropertyFlags preferred,
+		BindlessHandle& handle) -> Buffer {
+	auto buffer = create_buffer(
+			device,
+			allocator,
+			size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			preferred);
+	std::memset(buffer.allocation.mapped, 0, size);
+	handle = add_bindless_buffer(device, bindless, buffer.handle, 0, size);
+	return buffer;
+}
+
+void load_page(
+		VkDevice& device,
+		Uploader& uploader,
+		VirtualTexture& texture,
+		uint32_t page,
+		uint32_t slot) {
+	auto level = static_cast<uint32_t>(
+			std::upper_bound(
+					texture.level_offsets.begin(),
+					texture.level_offsets.end(),
+					page) -
+			texture.level_offsets.begin() - 1);
+	auto index = page - texture.level_offsets[level];
+	auto pages_x = texture.level_pages[level].width;
+	texture.loader(level, index % pages_x, index / pages_x, texture.texels);
+
+	const auto& info = texture.info;
+	update_image(
+			device,
+			uploader,
+			texture.atlas.handle,
+			VkImageSubresourceLayers{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1},
+			VkOffset3D{
+					.x = static_cast<int32_t>(slot % info.atlas_width * info.page_size),
+					.y = static_cast<int32_t>(slot / info.atlas_width * info.page_size),
+					.z = 0},
+			VkExtent3D{.width = info.page_size, .height = info.page_size, .depth = 1},
+			texture.texels,
+			VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+	texture.slot_pages[slot] = page;
+	texture.loading[page] = true;
+	texture.pending.emplace_back(PendingPage{
+			.page = page,
+			.slot = slot,
+			.ticket = uploader.next_ticket});
+}
+
+// Evicts the least recently used page that no pending load or in flight frame
+// needs. Returns whether one was found.
+auto evict_page(VirtualTexture& texture) -> bool {
+	auto oldest = texture.slot_pages.size();
+	for (auto slot = size_t{}; slot < texture.slot_pages.size(); slot++) {
+		auto page = texture.slot_pages[slot];
+		if (page == texture.page_count || texture.loading[page] ||
+				texture.slot_used[slot] == g_pinned_slot ||
+				texture.slot_used[slot] + texture.frames.size() >= texture.frame) {
+			continue;
+		}
+		if (oldest == texture.slot_pages.size() ||
+				texture.slot_used[slot] < texture.slot_used[oldest]) {
+			oldest = slot;
+		}
+	}
+	if (oldest == texture.slot_pages.size()) {
+		return false;
+	}
+	texture.page_table[texture.slot_pages[oldest]] = g_virtual_page_absent;
+	texture.slot_pages[oldest] = texture.page_count;
+	texture.evicted_slots.emplace_back(
+			static_cast<uint32_t>(oldest),
+			texture.frame);
+	return true;
+}
+
+}  // namespace
+
+auto create_virtual_texture(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		const VirtualTextureInfo& info,
+		PageLoader loader,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> VirtualTexture {
+	if (info.page_size == 0 || info.width % info.page_size != 0 ||
+			info.height % info.page_size != 0 || info.width == 0 ||
+			info.height == 0 || info.atlas_width * info.atlas_height < 2) {
+		fmt::print(stderr, "Invalid virtual texture layout\n");
+		std::terminate();
+	}
+	auto texture = VirtualTexture{};
+	texture.info = info;
+	texture.loader = std::move(loader);
+	// Levels halve until one page covers the whole texture.
+	for (auto extent = VkExtent2D{
+					 .width = info.width / info.page_size,
+					 .height = info.height / info.page_size};
+			 ;
+			 extent = VkExtent2D{
+					 .width = std::max(extent.width / 2, 1U),
+					 .height = std::max(extent.height / 2, 1U)}) {
+		texture.level_offsets.emplace_back(texture.page_count);
+		texture.level_pages.emplace_back(extent);
+		texture.page_count += extent.width * extent.height;
+		if (extent.width == 1 && extent.height == 1) {
+			break;
+		}
+	}
+
+	auto concurrent = queue_families[0] != queue_families[1];
+	auto image_info = VkImageCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.imageType = VK_IMAGE_TYPE_2D,
+			.format = info.format,
+			.extent =
+					VkExtent3D{
+							.width = info.atlas_width * info.page_size,
+							.height = info.atlas_height * info.page_size,
+							.depth = 1},
+			.mipLevels = 1,
+			.arrayLayers = 1,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.sharingMode =
+					concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+			.queueFamilyIndexCount = concurrent ? 2U : 0U,
+			.pQueueFamilyIndices = concurrent ? queue_families.data() : nullptr,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+	texture.atlas = create_image(
+			device,
+			allocator,
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
+	auto range = VkImageSubresourceRange{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1};
+	auto view_info = VkImageViewCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.image = texture.atlas.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = info.format,
+			.components =
+					VkComponentMapping{
+							.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+							.a = VK_COMPONENT_SWIZZLE_IDENTITY},
+			.subresourceRange = range};
+	if (vkCreateImageView(
+					device,
+					&view_info,
+					host_callbacks(),
+					&texture.atlas_view) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create the virtual texture atlas view\n");
+		std::terminate();
+	}
+	// Pages are written while shaders sample others, so the atlas stays in
+	// GENERAL.
+	texture.atlas_handle = add_bindless_image(
+			device,
+			bindless,
+			texture.atlas_view,
+			VK_IMAGE_LAYOUT_GENERAL);
+	initialize_image(
+			device,
+			uploader,
+			texture.atlas.handle,
+			range,
+			VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+
+	auto slot_count = info.atlas_width * info.atlas_height;
+	texture.page_table.resize(texture.page_count, g_virtual_page_absent);
+	texture.loading.resize(texture.page_count);
+	texture.slot_pages.resize(slot_count, texture.page_count);
+	texture.slot_used.resize(slot_count);
+	for (auto slot = slot_count; slot > 0; slot--) {
+		texture.free_slots.emplace_back(slot - 1);
+	}
+	texture.texels.resize(
+			VkDeviceSize{info.page_size} * info.page_size * info.texel_size);
+	auto table_size = VkDeviceSize{texture.page_count} * sizeof(uint32_t);
+	texture.frames.resize(frame_count);
+	for (auto& frame : texture.frames) {
+		frame.page_table = create_frame_buffer(
+				device,
+				allocator,
+				bindless,
+				table_size,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				frame.page_table_handle);
+		frame.feedback = create_frame_buffer(
+				device,
+				allocator,
+				bindless,
+				table_size,
+				VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+				frame.feedback_handle);
+	}
+
+	// The coarsest level is a single page.
+	auto slot = texture.free_slots.back();
+	texture.free_slots.pop_back();
+	texture.slot_used[slot] = g_pinned_slot;
+	load_page(device, uploader, texture, texture.page_count - 1, slot);
+	return texture;
+}
+
+void destroy_virtual_texture(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VirtualTexture& texture) {
+	for (auto& frame : texture.frames) {
+		remove_bindless_buffer(device, bindless, frame.page_table_handle);
+		remove_bindless_buffer(device, bindless, frame.feedback_handle);
+		destroy_buffer(device, allocator, frame.page_table);
+		destroy_buffer(device, allocator, frame.feedback);
+	}
+	remove_bindless_image(device, bindless, texture.atlas_handle);
+	vkDestroyImageView(device, texture.atlas_view, host_callbacks());
+	destroy_image(device, allocator, texture.atlas);
+	texture = VirtualTexture{};
+}
+
+void update_virtual_texture(
+		VkDevice& device,
+		Uploader& uploader,
+		VirtualTexture& texture,
+		size_t frame_idx) {
+	texture.frame++;
+	std::erase_if(texture.evicted_slots, [&](const auto& evicted) {
+		if (evicted.second + texture.frames.size() > texture.frame) {
+			return false;
+		}
+		texture.free_slots.emplace_back(evicted.first);
+		return true;
+	});
+	std::erase_if(texture.pending, [&](const PendingPage& pending) {
+		if (!upload_complete(device, uploader, pending.ticket)) {
+			return false;
+		}
+		texture.page_table[pending.page] = pending.slot + 1;
+		texture.loading[pending.page] = false;
+		return true;
+	});
+
+	auto& frame = texture.frames.at(frame_idx);
+	auto feedback = std::span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+			reinterpret_cast<uint32_t*>(frame.feedback.allocation.mapped),
+			texture.page_count);
+	texture.requests.clear();
+	for (auto page = uint32_t{}; page < texture.page_count; page++) {
+		if (feedback[page] == 0) {
+			continue;
+		}
+		auto entry = texture.page_table[page];
+		if (entry != g_virtual_page_absent) {
+			auto& used = texture.slot_used[entry - 1];
+			used = used == g_pinned_slot ? used : texture.frame;
+		} else if (!texture.loading[page]) {
+			texture.requests.emplace_back(page);
+		}
+	}
+	std::fill(feedback.begin(), feedback.end(), 0U);
+
+	// Coarser levels come later in the table and go first, so what arrives
+	// is a fallback for the levels below it.
+	std::sort(
+			texture.requests.begin(),
+			texture.requests.end(),
+			std::greater<>{});
+	auto wanted = std::min<size_t>(
+			texture.requests.size(),
+			texture.info.page_budget);
+	while (texture.free_slots.size() < wanted && evict_page(texture)) {
+	}
+	for (auto i = size_t{}; i < wanted && !texture.free_slots.empty(); i++) {
+		auto slot = texture.free_slots.back();
+		texture.free_slots.pop_back();
+		texture.slot_used[slot] = texture.frame;
+		load_page(device, uploader, texture, texture.requests[i], slot);
+	}
+
+	std::memcpy(
+			frame.page_table.allocation.mapped,
+			texture.page_table.data(),
+			texture.page_table.size() * sizeof(uint32_t));
+}
+
+auto import_virtual_texture_feedback(
+		RenderGraph& graph,
+		const VirtualTexture& texture,
+		size_t frame_idx) -> uint32_t {
+	// The host cleared it before the frame was submitted, which the submit
+	// makes visible.
+	return import_graph_buffer(
+			graph,
+			texture.frames.at(frame_idx).feedback.handle,
+			GraphState{},
+			g_feedback_host_read);
+}
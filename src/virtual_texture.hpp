@@ -0,0 +1,136 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "dispatch.hpp"
+#include "render_graph.hpp"
+#include "upload.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// How fragment shaders write the feedback.
+constexpr auto g_virtual_feedback_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+// Page table entry of a page that is not resident. Resident pages store their
+// atlas slot + 1, slots count row-major through the atlas.
+constexpr auto g_virtual_page_absent = 0U;
+
+// Fills texels with one page, page_size rows of page_size texels of the
+// texture's format.
+using PageLoader = std::function<void(
+		uint32_t level,
+		uint32_t x,
+		uint32_t y,
+		std::span<std::byte> texels)>;
+
+struct VirtualTextureInfo {
+	VkFormat format{};
+	uint32_t texel_size{};
+	// Size of level 0 in texels, a multiple of page_size.
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t page_size{};
+	// Pages the atlas holds in each direction.
+	uint32_t atlas_width{};
+	uint32_t atlas_height{};
+	// Pages loaded per frame at most.
+	uint32_t page_budget{};
+};
+
+// The buffers a frame's shaders see. Both hold one uint per page, level after
+// level, starting at the level offsets.
+struct VirtualTextureFrame {
+	Buffer page_table;
+	// Shaders set the entry of every page they would like to sample to a non
+	// zero value. Read by the host once the frame is complete, so the passes
+	// writing it have to end with a barrier to HOST/HOST_READ.
+	Buffer feedback;
+	BindlessHandle page_table_handle{};
+	BindlessHandle feedback_handle{};
+};
+
+struct PendingPage {
+	uint32_t page{};
+	uint32_t slot{};
+	UploadTicket ticket{};
+};
+
+// A texture far larger than memory, split into pages of which only the ones
+// the shaders asked for are kept in an atlas. The page table is a software
+// one, shaders look their page up and fall back to coarser levels while it is
+// missing. The coarsest level is loaded up front and never evicted, so there
+// always is a fallback. Other pages are evicted least recently used first,
+// and their slots are reused once every frame that could still sample them is
+// done.
+struct VirtualTexture {
+	VirtualTextureInfo info;
+	PageLoader loader;
+	// Pages of each level in each direction, and where the level starts in
+	// the page table.
+	std::vector<VkExtent2D> level_pages;
+	std::vector<uint32_t> level_offsets;
+	uint32_t page_count{};
+	Image atlas;
+	VkImageView atlas_view{};
+	BindlessHandle atlas_handle{};
+	// What every frame's page table is updated from.
+	std::vector<uint32_t> page_table;
+	// Page held by each slot, or page_count when it is empty.
+	std::vector<uint32_t> slot_pages;
+	// Frame each slot's page was last asked for.
+	std::vector<uint64_t> slot_used;
+	std::vector<uint32_t> free_slots;
+	// Slots evicted on a frame, free once it left the frames in flight.
+	std::vector<std::pair<uint32_t, uint64_t>> evicted_slots;
+	std::vector<PendingPage> pending;
+	// Whether a page is pending, indexed like the page table.
+	std::vector<bool> loading;
+	std::vector<VirtualTextureFrame> frames;
+	uint64_t frame{};
+	std::vector<uint32_t> requests;
+	std::vector<std::byte> texels;
+};
+
+// queue_families are the graphics and upload families, the atlas is shared
+// between them when they differ. Records the coarsest level's pages into the
+// uploader's current batch.
+auto create_virtual_texture(
+		VkDevice& device,
+		Allocator& allocator,
+		Uploader& uploader,
+		BindlessTable& bindless,
+		const VirtualTextureInfo& info,
+		PageLoader loader,
+		std::array<uint32_t, 2> queue_families,
+		size_t frame_count) -> VirtualTexture;
+// The device must be idle.
+void destroy_virtual_texture(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VirtualTexture& texture);
+
+// Reads the frame slot's feedback, loads the pages it asked for into the
+// uploader's current batch and writes the slot's page table. The slot's last
+// frame must be complete.
+void update_virtual_texture(
+		VkDevice& device,
+		Uploader& uploader,
+		VirtualTexture& texture,
+		size_t frame_idx);
+
+// Imports the frame slot's feedback into the frame's graph, ending with the
+// barrier to HOST/HOST_READ that update_virtual_texture's read needs.
+auto import_virtual_texture_feedback(
+		RenderGraph& graph,
+		const VirtualTexture& texture,
+		size_t frame_idx) -> uint32_t;
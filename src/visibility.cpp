@@ -0,0 +1,288 @@
+#include "visibility.hpp"
+
+#include "host_memory.hpp"
+#include "pipeline.hpp"
+#include "subgroups.hpp"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+constexpr auto g_visibility_binding = 0U;
+constexpr auto g_visibility_scene_binding = 1U;
+
+constexpr auto g_storage_read = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+constexpr auto g_storage_write = GraphState{
+		.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL};
+
+// Layout matches the push_constant block in visibility_shade.comp.
+struct VisibilityConstants {
+	BindlessHandle draws{};
+	uint32_t draw_count{};
+	uint32_t width{};
+	uint32_t height{};
+	uint32_t highlight{};
+};
+
+// Points the frame's set at this frame's views. The frame's fence was waited
+// on, so the set is no longer in use.
+void write_visibility_set(
+		VkDevice& device,
+		const RenderGraph& graph,
+		VkDescriptorSet set,
+		uint32_t visibility,
+		uint32_t scene) {
+	auto images = std::array{
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = graph_image_view(graph, visibility),
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+			VkDescriptorImageInfo{
+					.sampler = VK_NULL_HANDLE,
+					.imageView = graph_image_view(graph, scene),
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+	};
+	auto image_write = [&](uint32_t binding, const VkDescriptorImageInfo* info) {
+		return VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = set,
+				.dstBinding = binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = info,
+				.pBufferInfo = VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE};
+	};
+	auto writes = std::array{
+			image_write(g_visibility_binding, &images.at(0)),
+			image_write(g_visibility_scene_binding, &images.at(1)),
+	};
+	vkUpdateDescriptorSets(
+			device,
+			static_cast<uint32_t>(writes.size()),
+			writes.data(),
+			0,
+			VK_NULL_HANDLE);
+}
+
+}  // namespace
+
+auto visibility_shade_variant(VkPhysicalDevice physical_device)
+		-> ShaderVariant {
+	auto support = query_subgroup_support(physical_device);
+	return has_subgroup_operations(
+								 support,
+								 VK_SHADER_STAGE_COMPUTE_BIT,
+								 g_subgroup_library_operations)
+			? g_shader_variant_scalarized
+			: ShaderVariant{0};
+}
+
+auto create_visibility_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t draw_capacity) -> VisibilityShading {
+	auto shading = VisibilityShading{};
+	shading.draw_capacity = draw_capacity;
+
+	auto storage_binding = [](uint32_t binding) {
+		return VkDescriptorSetLayoutBinding{
+				.binding = binding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+				.pImmutableSamplers = VK_NULL_HANDLE};
+	};
+	auto bindings = std::array{
+			storage_binding(g_visibility_binding),
+			storage_binding(g_visibility_scene_binding),
+	};
+	auto set_layout_info = VkDescriptorSetLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data()};
+	if (vkCreateDescriptorSetLayout(
+					device,
+					&set_layout_info,
+					host_callbacks(),
+					&shading.set_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create visibility set layout\n");
+		std::terminate();
+	}
+
+	auto set_layouts = std::array{bindless.set_layout, shading.set_layout};
+	auto push_constant_range = VkPushConstantRange{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(VisibilityConstants)};
+	auto layout_info = VkPipelineLayoutCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
+			.pSetLayouts = set_layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &push_constant_range};
+	if (vkCreatePipelineLayout(
+					device,
+					&layout_info,
+					host_callbacks(),
+					&shading.pipeline_layout) != VK_SUCCESS) {
+		fmt::print(stderr, "Failed to create visibility pipeline layout\n");
+		std::terminate();
+	}
+	shading.pipeline = create_compute_pipeline(
+			device,
+			pipeline_cache,
+			shading.pipeline_layout,
+			module,
+			specialization,
+			0);
+
+	// The table is read in place like the uniform ring.
+	auto draws_size = VkDeviceSize{sizeof(VisibilityDraw)} * draw_capacity;
+	for (auto i = size_t{}; i < frame_count; i++) {
+		auto& frame = shading.frames.emplace_back();
+		frame.draws = create_dynamic_buffer(
+				device,
+				allocator,
+				draws_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+		frame.draws_handle = add_bindless_buffer(
+				device,
+				bindless,
+				frame.draws.handle,
+				0,
+				draws_size);
+	}
+	return shading;
+}
+
+void destroy_visibility_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VisibilityShading& shading) {
+	for (auto& frame : shading.frames) {
+		remove_bindless_buffer(device, bindless, frame.draws_handle);
+		destroy_buffer(device, allocator, frame.draws);
+	}
+	vkDestroyPipeline(device, shading.pipeline, host_callbacks());
+	vkDestroyPipelineLayout(device, shading.pipeline_layout, host_callbacks());
+	vkDestroyDescriptorSetLayout(device, shading.set_layout, host_callbacks());
+	shading = VisibilityShading{};
+}
+
+auto visibility_draw(const DrawHandles& handles, const Mesh& mesh, uint32_t lod)
+		-> VisibilityDraw {
+	return VisibilityDraw{
+			.positions = handles.positions,
+			.colors = handles.colors,
+			.indices = mesh.index_address,
+			.vertex_stride = handles.vertex_stride,
+			.uniform_buffer = handles.uniform_buffer,
+			.transform = handles.transform,
+			.first_index = mesh.lods.at(lod).first_index,
+			.index_size = mesh.index_type == VK_INDEX_TYPE_UINT16 ? 2U : 4U,
+			.position_scale = handles.position_scale,
+			.position_offset = handles.position_offset,
+			.padding = 0};
+}
+
+void add_visibility_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		VisibilityShading& shading,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		std::span<const VisibilityDraw> draws,
+		uint32_t visibility,
+		uint32_t scene,
+		VkExtent2D render_extent,
+		uint32_t highlight) {
+	if (draws.size() > shading.draw_capacity) {
+		fmt::print(
+				stderr,
+				"Visibility draw overflow: {} draws, room for {}\n",
+				draws.size(),
+				shading.draw_capacity);
+		std::terminate();
+	}
+	const auto& frame = shading.frames.at(frame_idx);
+	std::memcpy(frame.draws.allocation.mapped, draws.data(), draws.size_bytes());
+	auto constants = VisibilityConstants{
+			.draws = frame.draws_handle,
+			.draw_count = static_cast<uint32_t>(draws.size()),
+			.width = render_extent.width,
+			.height = render_extent.height,
+			.highlight = highlight};
+	auto record = [&device, &graph, &profiler, &descriptors, &shading, &bindless,
+								 frame_idx, constants, visibility, scene](
+										VkCommandBuffer command_buffer) {
+		auto gpu_pass =
+				begin_gpu_pass(profiler, command_buffer, frame_idx, "visibility");
+		auto* set = allocate_frame_set(
+				device,
+				descriptors,
+				frame_idx,
+				shading.set_layout);
+		write_visibility_set(device, graph, set, visibility, scene);
+		vkCmdBindPipeline(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline);
+		bind_bindless_table(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline_layout,
+				bindless);
+		vkCmdBindDescriptorSets(
+				command_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				shading.pipeline_layout,
+				1,
+				1,
+				&set,
+				0,
+				VK_NULL_HANDLE);
+		vkCmdPushConstants(
+				command_buffer,
+				shading.pipeline_layout,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0,
+				sizeof(constants),
+				&constants);
+		vkCmdDispatch(
+				command_buffer,
+				(constants.width + g_visibility_tile_size - 1) /
+						g_visibility_tile_size,
+				(constants.height + g_visibility_tile_size - 1) /
+						g_visibility_tile_size,
+				1);
+		end_gpu_pass(profiler, command_buffer, frame_idx, gpu_pass);
+	};
+	auto pass = add_graph_pass(graph, "visibility", record, false);
+	graph_read(graph, pass, visibility, g_storage_read);
+	graph_write(graph, pass, scene, g_storage_write);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bindless.hpp"
+#include "descriptor_allocator.hpp"
+#include "dispatch.hpp"
+#include "mesh.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "shaders.hpp"
+#include "uniforms.hpp"
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Matches local_size in visibility_shade.comp, a workgroup shades a tile of
+// this many pixels squared.
+constexpr auto g_visibility_tile_size = 8U;
+// The visibility buffer holds a triangle id per pixel: the draw plus one in
+// the top bits, the triangle of the draw in the low g_visibility_triangle_bits,
+// and 0 where nothing was drawn. Matches visibility.frag and
+// visibility_shade.comp.
+constexpr auto g_visibility_format = VK_FORMAT_R32_UINT;
+constexpr auto g_visibility_triangle_bits = 24U;
+constexpr auto g_max_visibility_draws =
+		(1U << (32U - g_visibility_triangle_bits)) - 1;
+// What the shading pass writes, the format of the scene it shades.
+constexpr auto g_visibility_scene_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// Where the shading pass refetches a draw's triangles from, at the draw's
+// index in the frame's table. Layout matches visibility_shade.comp, which
+// indexes the fields like pulling.vert does DrawHandles.
+struct VisibilityDraw {
+	VkDeviceAddress positions{};
+	VkDeviceAddress colors{};
+	VkDeviceAddress indices{};
+	uint32_t vertex_stride{};
+	BindlessHandle uniform_buffer{};
+	uint32_t transform{};
+	// Index of the draw's first triangle, and 2 or 4 bytes per index.
+	uint32_t first_index{};
+	uint32_t index_size{};
+	glm::vec3 position_scale{1.0F};
+	glm::vec3 position_offset{};
+	uint32_t padding{};
+};
+static_assert(sizeof(VisibilityDraw) == 72);
+
+// A frame in flight's draw table.
+struct VisibilityFrame {
+	Buffer draws;
+	BindlessHandle draws_handle{};
+};
+
+// Visibility buffer shading. The main pass rasterizes triangle ids with
+// visibility.frag instead of shading, so overdraw and the helper lanes of
+// small triangles only cost an id write. A compute pass then shades every
+// pixel once, in screen tiles, from the triangle it refetches through the
+// draw table. The pass binds the bindless table as set 0 and a set of its
+// own as set 1: binding 0 the visibility buffer, binding 1 the scene as a
+// storage image, taken from the frame's descriptor pools like the post
+// passes' sets.
+struct VisibilityShading {
+	uint32_t draw_capacity{};
+	VkDescriptorSetLayout set_layout{};
+	VkPipelineLayout pipeline_layout{};
+	VkPipeline pipeline{};
+	std::vector<VisibilityFrame> frames;
+};
+
+// The visibility_shade.comp variant for the device, which must have Vulkan
+// 1.1. Pixels of a tile index the uniform rings of different draws, which
+// some devices only do fast when the index is dynamically uniform.
+auto visibility_shade_variant(VkPhysicalDevice physical_device)
+		-> ShaderVariant;
+
+// module is the visibility_shade_variant of visibility_shade.comp,
+// specialized like pulling.vert for the mesh's vertex layout.
+auto create_visibility_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VkPipelineCache& pipeline_cache,
+		VkShaderModule& module,
+		const VkSpecializationInfo* specialization,
+		size_t frame_count,
+		uint32_t draw_capacity) -> VisibilityShading;
+// The device must be idle.
+void destroy_visibility_shading(
+		VkDevice& device,
+		Allocator& allocator,
+		BindlessTable& bindless,
+		VisibilityShading& shading);
+
+// The table entry of a draw of the pulled mesh made with handles.
+auto visibility_draw(const DrawHandles& handles, const Mesh& mesh, uint32_t lod)
+		-> VisibilityDraw;
+
+// Writes the frame's draw table, whose entries must be at the handles' draw
+// indices, and adds the pass shading visibility into scene. Must be called
+// after the frame fence was waited on. visibility must have been created with
+// g_visibility_format and scene with g_visibility_scene_format, both with
+// STORAGE usage. Only the top left render_extent is shaded. The draw at index
+// highlight - 1 is tinted, none for 0.
+void add_visibility_pass(
+		VkDevice& device,
+		RenderGraph& graph,
+		GpuProfiler& profiler,
+		DescriptorAllocator& descriptors,
+		VisibilityShading& shading,
+		const BindlessTable& bindless,
+		size_t frame_idx,
+		std::span<const VisibilityDraw> draws,
+		uint32_t visibility,
+		uint32_t scene,
+		VkExtent2D render_extent,
+		uint32_t highlight);